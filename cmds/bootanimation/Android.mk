@@ -16,7 +16,8 @@ LOCAL_SHARED_LIBRARIES := \
 	libskia \
     libEGL \
     libGLESv1_CM \
-    libgui
+    libgui \
+    libETC1
 
 LOCAL_C_INCLUDES := \
 	$(call include-path-for, corecg graphics)
@@ -37,6 +38,10 @@ ifeq ($(TARGET_BOOTANIMATION_USE_RGB565),true)
     LOCAL_CFLAGS += -DUSE_565
 endif
 
+ifneq ($(TARGET_BOOTANIMATION_PREFETCH_FRAMES),)
+    LOCAL_CFLAGS += -DPREFETCH_FRAMES=$(TARGET_BOOTANIMATION_PREFETCH_FRAMES)
+endif
+
 LOCAL_MODULE:= bootanimation
 
 
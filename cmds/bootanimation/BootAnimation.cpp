@@ -49,6 +49,8 @@
 #include <GLES/glext.h>
 #include <EGL/eglext.h>
 
+#include <ETC1/etc1.h>
+
 #include "BootAnimation.h"
 
 #define USER_BOOTANIMATION_FILE "/data/local/bootanimation.zip"
@@ -56,6 +58,14 @@
 #define SYSTEM_ENCRYPTED_BOOTANIMATION_FILE "/system/media/bootanimation-encrypted.zip"
 #define EXIT_PROP_NAME "service.bootanim.exit"
 
+// Number of frames decoded ahead of the one on screen.
+#ifndef PREFETCH_FRAMES
+#define PREFETCH_FRAMES 4
+#endif
+
+// Upper bound for the memory held by prefetched frames.
+#define MAX_PREFETCH_BYTES (32 * 1024 * 1024)
+
 extern "C" int clock_nanosleep(clockid_t clock_id, int flags,
                            const struct timespec *request,
                            struct timespec *remain);
@@ -64,7 +74,7 @@ namespace android {
 
 // ---------------------------------------------------------------------------
 
-BootAnimation::BootAnimation() : Thread(false)
+BootAnimation::BootAnimation() : Thread(false), mStreamTexture(0), mStreamSeq(0)
 {
     mSession = new SurfaceComposerClient();
 }
@@ -151,34 +161,322 @@ status_t BootAnimation::initTexture(Texture* texture, AssetManager& assets,
     return NO_ERROR;
 }
 
-status_t BootAnimation::initTexture(void* buffer, size_t len)
-{
-    //StopWatch watch("blah");
+struct BootAnimation::DecodedFrame {
+    DecodedFrame() : part(0), frame(0), failed(false), seq(0), baseSeq(0), dirtyTop(0),
+            dirtyBottom(0), etc1Data(NULL), etc1Width(0), etc1Height(0) {}
+
+    // position in the animation
+    size_t part;
+    size_t frame;
+
+    // set if the frame couldn't be decoded, nothing else is valid then
+    bool failed;
+
+    // decode order, and the frame the dirty rows are relative to (0: none)
+    uint32_t seq;
+    uint32_t baseSeq;
+    int dirtyTop;
+    int dirtyBottom;
 
+    // either decoded pixels or an ETC1 image straight from the zip
     SkBitmap bitmap;
+    const void* etc1Data;
+    int etc1Width;
+    int etc1Height;
+    int width;
+    int height;
+};
+
+/*
+ * Decodes frames on their own thread, in the order movie() will show them,
+ * keeping up to a fixed number of them ready. Only the GL upload is left to
+ * the render thread, so slow storage no longer stalls the animation.
+ */
+class BootAnimation::FrameDecoder : public Thread {
+public:
+    FrameDecoder(const Animation& animation, size_t capacity, bool etc1Supported)
+        : Thread(false), mAnimation(animation), mCapacity(capacity),
+          mEtc1Supported(etc1Supported), mPart(0), mRep(0), mFrame(0),
+          mGeneration(0), mSeq(0), mPrevSeq(0), mDone(false) {
+    }
+
+    // Waits for the given frame, which may have failed to decode. Returns
+    // false if the decoder has nothing more to give, in which case the
+    // caller decodes the frame itself.
+    bool acquire(size_t part, size_t frame, DecodedFrame* out) {
+        Mutex::Autolock _l(mLock);
+        for (;;) {
+            while (!mQueue.isEmpty()) {
+                DecodedFrame head(mQueue[0]);
+                mQueue.removeAt(0);
+                mCondition.broadcast();
+                if (head.part == part && head.frame == frame) {
+                    *out = head;
+                    return true;
+                }
+            }
+            if (mDone || exitPending()) {
+                return false;
+            }
+            mCondition.wait(mLock);
+        }
+    }
+
+    // Called when playback moves on to the given part, possibly early.
+    void seekToPart(size_t part) {
+        Mutex::Autolock _l(mLock);
+        if (mPart < part) {
+            mPart = part;
+            mRep = 0;
+            mFrame = 0;
+            mGeneration++;
+        }
+        while (!mQueue.isEmpty() && mQueue[0].part < part) {
+            mQueue.removeAt(0);
+        }
+        mCondition.broadcast();
+    }
+
+    void stop() {
+        {
+            Mutex::Autolock _l(mLock);
+            requestExit();
+            mCondition.broadcast();
+        }
+        requestExitAndWait();
+    }
+
+private:
+    virtual bool threadLoop() {
+        Mutex::Autolock _l(mLock);
+        while (!exitPending()) {
+            if (mPart >= mAnimation.parts.size()) {
+                mDone = true;
+                mCondition.broadcast();
+                return false;
+            }
+            if (mQueue.size() >= mCapacity) {
+                mCondition.wait(mLock);
+                continue;
+            }
+
+            const Animation::Part& part(mAnimation.parts[mPart]);
+            if (mFrame >= part.frames.size()) {
+                nextPart();
+                continue;
+            }
+
+            DecodedFrame decoded;
+            decoded.part = mPart;
+            decoded.frame = mFrame;
+            const uint32_t generation = mGeneration;
+            const bool stream = part.count == 1 || part.noTextureCache;
+            const Animation::Frame& frame(part.frames[mFrame]);
+            advance(part);
+
+            mLock.unlock();
+            bool ok = decodeFrame(frame, mEtc1Supported, &decoded);
+            mLock.lock();
+
+            if (generation != mGeneration) {
+                mPrevSeq = 0;
+                continue;
+            }
+            if (!ok) {
+                // Queue a marker so that acquire() doesn't go on waiting for it
+                DecodedFrame failed;
+                failed.part = decoded.part;
+                failed.frame = decoded.frame;
+                failed.failed = true;
+                mPrevSeq = 0;
+                mQueue.push(failed);
+                mCondition.broadcast();
+                continue;
+            }
+
+            decoded.seq = ++mSeq;
+            if (stream) {
+                findDirtyRows(&decoded);
+            } else {
+                mPrevSeq = 0;
+            }
+            mQueue.push(decoded);
+            mCondition.broadcast();
+        }
+        return false;
+    }
+
+    // Frames that are shown again from their cached texture are decoded
+    // once; all others are decoded on every repetition of their part.
+    void advance(const Animation::Part& part) {
+        if (++mFrame < part.frames.size()) {
+            return;
+        }
+        mFrame = 0;
+        int reps = part.noTextureCache ? part.count : 1;
+        if (reps != 0 && ++mRep >= reps) {
+            nextPart();
+        }
+    }
+
+    void nextPart() {
+        mPart++;
+        mRep = 0;
+        mFrame = 0;
+    }
+
+    // Compares against the previous streamed frame so the render thread
+    // only has to upload the rows that changed.
+    void findDirtyRows(DecodedFrame* decoded) {
+        const SkBitmap& bitmap(decoded->bitmap);
+        if (decoded->etc1Data != NULL || bitmap.isNull()) {
+            mPrevSeq = 0;
+            return;
+        }
+
+        decoded->dirtyTop = 0;
+        decoded->dirtyBottom = bitmap.height();
+        if (mPrevSeq != 0
+                && mPrevBitmap.width() == bitmap.width()
+                && mPrevBitmap.height() == bitmap.height()
+                && mPrevBitmap.getConfig() == bitmap.getConfig()
+                && mPrevBitmap.rowBytes() == bitmap.rowBytes()) {
+            mPrevBitmap.lockPixels();
+            bitmap.lockPixels();
+            const char* prev = (const char*) mPrevBitmap.getPixels();
+            const char* cur = (const char*) bitmap.getPixels();
+            const size_t rowBytes = bitmap.rowBytes();
+            int top = 0;
+            int bottom = bitmap.height();
+            while (top < bottom && !memcmp(prev + top * rowBytes, cur + top * rowBytes,
+                    rowBytes)) {
+                top++;
+            }
+            while (bottom > top && !memcmp(prev + (bottom - 1) * rowBytes,
+                    cur + (bottom - 1) * rowBytes, rowBytes)) {
+                bottom--;
+            }
+            bitmap.unlockPixels();
+            mPrevBitmap.unlockPixels();
+            decoded->baseSeq = mPrevSeq;
+            decoded->dirtyTop = top;
+            decoded->dirtyBottom = bottom;
+        }
+
+        mPrevBitmap = bitmap;
+        mPrevSeq = decoded->seq;
+    }
+
+    const Animation& mAnimation;
+    const size_t mCapacity;
+    const bool mEtc1Supported;
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<DecodedFrame> mQueue;
+
+    // next frame to decode
+    size_t mPart;
+    int mRep;
+    size_t mFrame;
+    uint32_t mGeneration;
+
+    uint32_t mSeq;
+    SkBitmap mPrevBitmap;
+    uint32_t mPrevSeq;
+    bool mDone;
+};
+
+static bool isPowerOfTwo(int n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+bool BootAnimation::decodeFrame(const Animation::Frame& frame, bool etc1Supported,
+        DecodedFrame* out)
+{
+    const void* buffer = frame.map->getDataPtr();
+    const size_t len = frame.map->getDataLength();
+
+    if (frame.name.getPathExtension() == ".pkm") {
+        const etc1_byte* header = (const etc1_byte*) buffer;
+        if (len < ETC_PKM_HEADER_SIZE || !etc1_pkm_is_valid(header)) {
+            ALOGW("Invalid ETC1 frame %s", frame.name.string());
+            return false;
+        }
+        const int encodedWidth = etc1_pkm_get_width(header);
+        const int encodedHeight = etc1_pkm_get_height(header);
+        const int width = (header[12] << 8) | header[13];
+        const int height = (header[14] << 8) | header[15];
+        if (len < ETC_PKM_HEADER_SIZE
+                + etc1_get_encoded_data_size(encodedWidth, encodedHeight)) {
+            ALOGW("Truncated ETC1 frame %s", frame.name.string());
+            return false;
+        }
+        const etc1_byte* data = header + ETC_PKM_HEADER_SIZE;
+        out->width = width;
+        out->height = height;
+
+        if (etc1Supported && isPowerOfTwo(encodedWidth) && isPowerOfTwo(encodedHeight)) {
+            // Fault the data in here rather than on the render thread.
+            volatile etc1_byte sink = 0;
+            for (size_t i = 0; i < len; i += 4096) {
+                sink ^= ((const etc1_byte*) buffer)[i];
+            }
+            out->etc1Data = data;
+            out->etc1Width = encodedWidth;
+            out->etc1Height = encodedHeight;
+            return true;
+        }
+
+        // No hardware support for this frame; expand it to 565 instead.
+        out->bitmap.setConfig(SkBitmap::kRGB_565_Config, width, height);
+        if (!out->bitmap.allocPixels()) {
+            return false;
+        }
+        return etc1_decode_image(data, (etc1_byte*) out->bitmap.getPixels(),
+                width, height, 2, out->bitmap.rowBytes()) == 0;
+    }
+
     SkMemoryStream  stream(buffer, len);
     SkImageDecoder* codec = SkImageDecoder::Factory(&stream);
+    if (!codec) {
+        return false;
+    }
     codec->setDitherImage(false);
-    if (codec) {
-        codec->decode(&stream, &bitmap,
-                #ifdef USE_565
-                SkBitmap::kRGB_565_Config,
-                #else
-                SkBitmap::kARGB_8888_Config,
-                #endif
-                SkImageDecoder::kDecodePixels_Mode);
-        delete codec;
+    codec->decode(&stream, &out->bitmap,
+            #ifdef USE_565
+            SkBitmap::kRGB_565_Config,
+            #else
+            SkBitmap::kARGB_8888_Config,
+            #endif
+            SkImageDecoder::kDecodePixels_Mode);
+    delete codec;
+
+    out->width = out->bitmap.width();
+    out->height = out->bitmap.height();
+    return !out->bitmap.isNull();
+}
+
+void BootAnimation::uploadFrame(const DecodedFrame& frame)
+{
+    const int w = frame.width;
+    const int h = frame.height;
+    GLint crop[4] = { 0, h, w, -h };
+
+    if (frame.etc1Data != NULL) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES,
+                frame.etc1Width, frame.etc1Height, 0,
+                etc1_get_encoded_data_size(frame.etc1Width, frame.etc1Height),
+                frame.etc1Data);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
+        return;
     }
 
-    // ensure we can call getPixels(). No need to call unlock, since the
-    // bitmap will go out of scope when we return from this method.
+    // ensure we can call getPixels().
+    const SkBitmap& bitmap(frame.bitmap);
     bitmap.lockPixels();
-
-    const int w = bitmap.width();
-    const int h = bitmap.height();
     const void* p = bitmap.getPixels();
 
-    GLint crop[4] = { 0, h, w, -h };
     int tw = 1 << (31 - __builtin_clz(w));
     int th = 1 << (31 - __builtin_clz(h));
     if (tw < w) tw <<= 1;
@@ -211,10 +509,54 @@ status_t BootAnimation::initTexture(void* buffer, size_t len)
         default:
             break;
     }
+    bitmap.unlockPixels();
 
     glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
+}
 
-    return NO_ERROR;
+/*
+ * Uploads a frame that is not cached into the shared stream texture. When
+ * the texture still holds the frame this one was compared against, only
+ * the rows that changed are sent.
+ */
+void BootAnimation::uploadStreamFrame(const DecodedFrame& frame)
+{
+    if (mStreamTexture == 0) {
+        glGenTextures(1, &mStreamTexture);
+        glBindTexture(GL_TEXTURE_2D, mStreamTexture);
+        glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, mStreamTexture);
+    }
+
+    const SkBitmap& bitmap(frame.bitmap);
+    if (frame.etc1Data != NULL || frame.baseSeq == 0 || frame.baseSeq != mStreamSeq) {
+        uploadFrame(frame);
+        mStreamSeq = frame.etc1Data != NULL ? 0 : frame.seq;
+        return;
+    }
+
+    if (frame.dirtyBottom > frame.dirtyTop) {
+        bitmap.lockPixels();
+        const char* p = (const char*) bitmap.getPixels()
+                + frame.dirtyTop * bitmap.rowBytes();
+        const int rows = frame.dirtyBottom - frame.dirtyTop;
+        switch (bitmap.getConfig()) {
+            case SkBitmap::kARGB_8888_Config:
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, frame.dirtyTop, frame.width, rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, p);
+                break;
+            case SkBitmap::kRGB_565_Config:
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, frame.dirtyTop, frame.width, rows,
+                        GL_RGB, GL_UNSIGNED_SHORT_5_6_5, p);
+                break;
+            default:
+                break;
+        }
+        bitmap.unlockPixels();
+    }
+    mStreamSeq = frame.seq;
 }
 
 status_t BootAnimation::readyToRun() {
@@ -490,6 +832,7 @@ bool BootAnimation::movie()
                                     Animation::Frame frame;
                                     frame.name = leaf;
                                     frame.map = map;
+                                    frame.tid = 0;
                                     Animation::Part& part(animation.parts.editItemAt(j));
                                     part.frames.add(frame);
                                 }
@@ -524,20 +867,43 @@ bool BootAnimation::movie()
     nsecs_t lastFrame = systemTime();
     nsecs_t frameDuration = s2ns(1) / animation.fps;
 
-    Region clearReg(Rect(mWidth, mHeight));
-    clearReg.subtractSelf(Rect(xc, yc, xc+animation.width, yc+animation.height));
-
-    for (int i=0 ; i<pcount ; i++) {
-        const Animation::Part& part(animation.parts[i]);
+    for (size_t i=0 ; i<pcount ; i++) {
+        Animation::Part& part(animation.parts.editItemAt(i));
         const size_t fcount = part.frames.size();
 
         // can be 1, 0, or not set
         #ifdef NO_TEXTURE_CACHE
-        const int noTextureCache = NO_TEXTURE_CACHE;
+        part.noTextureCache = NO_TEXTURE_CACHE;
         #else
-        const int noTextureCache = ((animation.width * animation.height * fcount) >
-                                 48 * 1024 * 1024) ? 1 : 0;
+        part.noTextureCache = (animation.width * animation.height * fcount) >
+                                 48 * 1024 * 1024;
         #endif
+    }
+
+    const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+    const bool etc1Supported = extensions != NULL
+            && strstr(extensions, "GL_OES_compressed_ETC1_RGB8_texture") != NULL;
+
+    size_t frameBytes = animation.width * animation.height * 4;
+    size_t prefetch = PREFETCH_FRAMES;
+    if (frameBytes > 0 && prefetch * frameBytes > MAX_PREFETCH_BYTES) {
+        prefetch = MAX_PREFETCH_BYTES / frameBytes;
+    }
+    if (prefetch < 1) {
+        prefetch = 1;
+    }
+
+    sp<FrameDecoder> decoder = new FrameDecoder(animation, prefetch, etc1Supported);
+    decoder->run("BootAnimationDecoder", PRIORITY_DISPLAY);
+
+    Region clearReg(Rect(mWidth, mHeight));
+    clearReg.subtractSelf(Rect(xc, yc, xc+animation.width, yc+animation.height));
+
+    for (int i=0 ; i<pcount ; i++) {
+        const Animation::Part& part(animation.parts[i]);
+        const size_t fcount = part.frames.size();
+        const bool noTextureCache = part.noTextureCache;
+        const bool stream = part.count == 1 || noTextureCache;
 
         glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -553,15 +919,20 @@ bool BootAnimation::movie()
                 if (r > 0 && !noTextureCache) {
                     glBindTexture(GL_TEXTURE_2D, frame.tid);
                 } else {
-                    if (part.count != 1) {
+                    DecodedFrame decoded;
+                    const bool ok = decoder->acquire(i, j, &decoded) ? !decoded.failed
+                            : decodeFrame(frame, etc1Supported, &decoded);
+                    if (!ok) {
+                        ALOGW("Couldn't decode frame %s", frame.name.string());
+                    } else if (stream) {
+                        uploadStreamFrame(decoded);
+                    } else {
                         glGenTextures(1, &frame.tid);
                         glBindTexture(GL_TEXTURE_2D, frame.tid);
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                        uploadFrame(decoded);
                     }
-                    initTexture(
-                            frame.map->getDataPtr(),
-                            frame.map->getDataLength());
                 }
 
                 if (!clearReg.isEmpty()) {
@@ -595,9 +966,6 @@ bool BootAnimation::movie()
                 }
 
                 checkExit();
- 
-                if (noTextureCache)
-                    glDeleteTextures(1, &frame.tid);
             }
 
             usleep(part.pause * ns2us(frameDuration));
@@ -608,12 +976,21 @@ bool BootAnimation::movie()
         }
 
         // free the textures for this part
-        if (part.count != 1 && !noTextureCache) {
+        if (!stream) {
             for (size_t j=0 ; j<fcount ; j++) {
                 const Animation::Frame& frame(part.frames[j]);
                 glDeleteTextures(1, &frame.tid);
             }
         }
+
+        decoder->seekToPart(i + 1);
+    }
+
+    decoder->stop();
+    if (mStreamTexture) {
+        glDeleteTextures(1, &mStreamTexture);
+        mStreamTexture = 0;
+        mStreamSeq = 0;
     }
 
     return false;
@@ -71,6 +71,7 @@ private:
             String8 path;
             SortedVector<Frame> frames;
             bool playUntilComplete;
+            bool noTextureCache;
         };
         int fps;
         int width;
@@ -78,8 +79,15 @@ private:
         Vector<Part> parts;
     };
 
+    // A frame ready to be uploaded, produced ahead of time by FrameDecoder.
+    struct DecodedFrame;
+    class FrameDecoder;
+
     status_t initTexture(Texture* texture, AssetManager& asset, const char* name);
-    status_t initTexture(void* buffer, size_t len);
+    static bool decodeFrame(const Animation::Frame& frame, bool etc1Supported,
+            DecodedFrame* out);
+    void uploadFrame(const DecodedFrame& frame);
+    void uploadStreamFrame(const DecodedFrame& frame);
     bool android();
     bool movie();
 
@@ -97,6 +105,11 @@ private:
     sp<Surface> mFlingerSurface;
     bool        mAndroidAnimation;
     ZipFileRO   mZip;
+
+    // Texture reused by frames that are not cached, and the sequence number
+    // of the frame it currently holds, so unchanged rows can be skipped.
+    GLuint      mStreamTexture;
+    uint32_t    mStreamSeq;
 };
 
 // ---------------------------------------------------------------------------
@@ -268,6 +268,34 @@ AndroidRuntime::~AndroidRuntime()
     return jniRegisterNativeMethods(env, className, gMethods, numMethods);
 }
 
+/*
+ * Register native methods that the Java class may not declare.
+ */
+/*static*/ int AndroidRuntime::registerOptionalNativeMethods(JNIEnv* env,
+    const char* className, const JNINativeMethod* gMethods, int numMethods)
+{
+    jclass clazz = env->FindClass(className);
+    if (clazz == NULL) {
+        env->ExceptionClear();
+        ALOGW("Unable to find class '%s' for optional natives", className);
+        return -1;
+    }
+
+    int registered = 0;
+    for (int i = 0; i < numMethods; i++) {
+        if (env->RegisterNatives(clazz, &gMethods[i], 1) < 0) {
+            // NoSuchMethodError, the class does not declare this one
+            env->ExceptionClear();
+            ALOGV("Skipping optional native %s.%s%s", className,
+                    gMethods[i].name, gMethods[i].signature);
+        } else {
+            registered++;
+        }
+    }
+    env->DeleteLocalRef(clazz);
+    return registered;
+}
+
 status_t AndroidRuntime::callMain(const char* className,
     jclass clazz, int argc, const char* const argv[])
 {
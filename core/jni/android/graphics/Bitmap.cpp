@@ -14,8 +14,16 @@
 
 #include <jni.h>
 
+#include <cutils/ashmem.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <Caches.h>
 
+#ifdef __ARM_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 #if 0
     #define TRACE_BITMAP(code)  code
 #else
@@ -29,10 +37,82 @@
 typedef void (*FromColorProc)(void* dst, const SkColor src[], int width,
                               int x, int y);
 
+#ifdef __ARM_HAVE_NEON
+// The 32 bit conversions below handle rows 8 pixels at a time and return how many
+// pixels they converted; the scalar procs finish the row. vld4_u8 splits pixels into
+// one vector per byte, which for an SkColor are B, G, R and A.
+
+// Same rounding as SkMulDiv255Round: prod = c * a + 128, (prod + (prod >> 8)) >> 8
+static inline uint8x8_t MulDiv255Round_neon(uint8x8_t c, uint8x8_t a) {
+    uint16x8_t prod = vaddq_u16(vmull_u8(c, a), vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(prod, vshrq_n_u16(prod, 8)), 8);
+}
+
+static int FromColor_D32_neon(SkPMColor* d, const SkColor* src, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint8x8x4_t c = vld4_u8((const uint8_t*)(src + i));
+        uint8x8_t a = c.val[3];
+        uint8x8x4_t pm;
+        pm.val[SK_R32_SHIFT / 8] = MulDiv255Round_neon(c.val[2], a);
+        pm.val[SK_G32_SHIFT / 8] = MulDiv255Round_neon(c.val[1], a);
+        pm.val[SK_B32_SHIFT / 8] = MulDiv255Round_neon(c.val[0], a);
+        pm.val[SK_A32_SHIFT / 8] = a;
+        vst4_u8((uint8_t*)(d + i), pm);
+    }
+    return i;
+}
+
+static inline uint8x8x4_t ToColorOpaque_neon(const uint8x8x4_t& pm) {
+    uint8x8x4_t c;
+    c.val[0] = pm.val[SK_B32_SHIFT / 8];
+    c.val[1] = pm.val[SK_G32_SHIFT / 8];
+    c.val[2] = pm.val[SK_R32_SHIFT / 8];
+    c.val[3] = vdup_n_u8(0xFF);
+    return c;
+}
+
+static int ToColor_S32_Opaque_neon(SkColor dst[], const SkPMColor* s, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint8x8x4_t pm = vld4_u8((const uint8_t*)(s + i));
+        vst4_u8((uint8_t*)(dst + i), ToColorOpaque_neon(pm));
+    }
+    return i;
+}
+
+// Blocks of opaque or fully transparent pixels need no unpremultiply; the others
+// go through the reciprocal table of SkUnPreMultiply
+static int ToColor_S32_Alpha_neon(SkColor dst[], const SkPMColor* s, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint8x8x4_t pm = vld4_u8((const uint8_t*)(s + i));
+        uint64_t alphas = vget_lane_u64(vreinterpret_u64_u8(pm.val[SK_A32_SHIFT / 8]), 0);
+        if (alphas == ~uint64_t(0)) {
+            vst4_u8((uint8_t*)(dst + i), ToColorOpaque_neon(pm));
+        } else if (alphas == 0) {
+            vst1q_u32((uint32_t*)(dst + i), vdupq_n_u32(0));
+            vst1q_u32((uint32_t*)(dst + i + 4), vdupq_n_u32(0));
+        } else {
+            for (int j = i; j < i + 8; j++) {
+                dst[j] = SkUnPreMultiply::PMColorToColor(s[j]);
+            }
+        }
+    }
+    return i;
+}
+#endif
+
 static void FromColor_D32(void* dst, const SkColor src[], int width,
                           int, int) {
     SkPMColor* d = (SkPMColor*)dst;
 
+#ifdef __ARM_HAVE_NEON
+    int converted = FromColor_D32_neon(d, src, width);
+    d += converted;
+    src += converted;
+    width -= converted;
+#endif
     for (int i = 0; i < width; i++) {
         *d++ = SkPreMultiplyColor(*src++);
     }
@@ -117,6 +197,15 @@ static void ToColor_S32_Alpha(SkColor dst[], const void* src, int width,
                               SkColorTable*) {
     SkASSERT(width > 0);
     const SkPMColor* s = (const SkPMColor*)src;
+#ifdef __ARM_HAVE_NEON
+    int converted = ToColor_S32_Alpha_neon(dst, s, width);
+    dst += converted;
+    s += converted;
+    width -= converted;
+    if (width == 0) {
+        return;
+    }
+#endif
     do {
         *dst++ = SkUnPreMultiply::PMColorToColor(*s++);
     } while (--width != 0);
@@ -126,6 +215,15 @@ static void ToColor_S32_Opaque(SkColor dst[], const void* src, int width,
                                SkColorTable*) {
     SkASSERT(width > 0);
     const SkPMColor* s = (const SkPMColor*)src;
+#ifdef __ARM_HAVE_NEON
+    int converted = ToColor_S32_Opaque_neon(dst, s, width);
+    dst += converted;
+    s += converted;
+    width -= converted;
+    if (width == 0) {
+        return;
+    }
+#endif
     do {
         SkPMColor c = *s++;
         *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
@@ -355,6 +453,82 @@ static void Bitmap_setHasAlpha(JNIEnv* env, jobject, SkBitmap* bitmap,
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Pixels of at least this many bytes are parceled as an ashmem file descriptor
+#define BITMAP_ASHMEM_MIN_SIZE (64 * 1024)
+
+enum {
+    kParcelPixels_Blob   = 0,
+    kParcelPixels_Ashmem = 1,
+};
+
+/*  Pixels of an immutable bitmap received from another process, mapped
+    read-only from the ashmem region it sent.
+ */
+class AshmemPixelRef : public SkMallocPixelRef {
+public:
+    AshmemPixelRef(void* addr, size_t size, SkColorTable* ctable) :
+            SkMallocPixelRef(addr, size, ctable), fSize(size) {
+    }
+
+    virtual ~AshmemPixelRef() {
+        munmap(fStorage, fSize);
+        // Set this to NULL to prevent the SkMallocPixelRef destructor
+        // from freeing the memory.
+        fStorage = NULL;
+    }
+
+private:
+    size_t fSize;
+};
+
+static bool writeAshmemPixels(android::Parcel* p, const SkBitmap* bitmap, size_t size) {
+    int fd = ashmem_create_region("bitmap", size);
+    if (fd < 0) {
+        return false;
+    }
+
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    bitmap->lockPixels();
+    const void* pSrc = bitmap->getPixels();
+    if (pSrc == NULL) {
+        memset(addr, 0, size);
+    } else {
+        memcpy(addr, pSrc, size);
+    }
+    bitmap->unlockPixels();
+    munmap(addr, size);
+
+    // Seal the region before sharing it, so the receiver can't write to it
+    if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+        close(fd);
+        return false;
+    }
+
+    p->writeInt32(kParcelPixels_Ashmem);
+    if (p->writeFileDescriptor(fd, true /*takeOwnership*/) != android::NO_ERROR) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+// Returns the read-only mapping of the ashmem region in the parcel, or NULL.
+// The mapping keeps the region alive, the parcel still owns the fd.
+static void* mapAshmemPixels(android::Parcel* p, size_t size) {
+    int fd = p->readFileDescriptor();
+    if (fd < 0 || ashmem_get_size_region(fd) < (int) size) {
+        return NULL;
+    }
+
+    void* addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    return addr == MAP_FAILED ? NULL : addr;
+}
+
 static jobject Bitmap_createFromParcel(JNIEnv* env, jobject, jobject parcel) {
     if (parcel == NULL) {
         SkDebugf("-------- unparcel parcel is NULL\n");
@@ -393,8 +567,30 @@ static jobject Bitmap_createFromParcel(JNIEnv* env, jobject, jobject parcel) {
         }
     }
 
+    size_t size = bitmap->getSize();
+
+    const bool isAshmem = p->readInt32() == kParcelPixels_Ashmem;
+    void* ashmemAddr = isAshmem ? mapAshmemPixels(p, size) : NULL;
+    if (isAshmem && ashmemAddr == NULL) {
+        SkSafeUnref(ctable);
+        doThrowRE(env, "Could not map bitmap from parcel ashmem.");
+        delete bitmap;
+        return NULL;
+    }
+
+    if (isAshmem && !isMutable) {
+        SkPixelRef* pr = new AshmemPixelRef(ashmemAddr, size, ctable);
+        bitmap->setPixelRef(pr)->unref();
+        bitmap->lockPixels();
+        SkSafeUnref(ctable);
+        return GraphicsJNI::createBitmap(env, bitmap, NULL, isMutable, NULL, NULL, density);
+    }
+
     jbyteArray buffer = GraphicsJNI::allocateJavaPixelRef(env, bitmap, ctable);
     if (NULL == buffer) {
+        if (ashmemAddr != NULL) {
+            munmap(ashmemAddr, size);
+        }
         SkSafeUnref(ctable);
         delete bitmap;
         return NULL;
@@ -402,7 +598,14 @@ static jobject Bitmap_createFromParcel(JNIEnv* env, jobject, jobject parcel) {
 
     SkSafeUnref(ctable);
 
-    size_t size = bitmap->getSize();
+    if (ashmemAddr != NULL) {
+        // The region is read-only, so a mutable bitmap gets its own copy
+        bitmap->lockPixels();
+        memcpy(bitmap->getPixels(), ashmemAddr, size);
+        bitmap->unlockPixels();
+        munmap(ashmemAddr, size);
+        return GraphicsJNI::createBitmap(env, bitmap, buffer, isMutable, NULL, NULL, density);
+    }
 
     android::Parcel::ReadableBlob blob;
     android::status_t status = p->readBlob(size, &blob);
@@ -453,6 +656,18 @@ static jboolean Bitmap_writeToParcel(JNIEnv* env, jobject,
 
     size_t size = bitmap->getSize();
 
+    if (size >= BITMAP_ASHMEM_MIN_SIZE) {
+        size_t start = p->dataPosition();
+        if (writeAshmemPixels(p, bitmap, size)) {
+            return true;
+        }
+        // Fall back to copying the pixels into the parcel
+        p->setDataPosition(start);
+        p->setDataSize(start);
+    }
+
+    p->writeInt32(kParcelPixels_Blob);
+
     android::Parcel::WritableBlob blob;
     android::status_t status = p->writeBlob(size, &blob);
     if (status) {
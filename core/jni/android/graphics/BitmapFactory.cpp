@@ -208,6 +208,7 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
 
     NinePatchPeeker peeker(decoder);
     JavaPixelAllocator javaAllocator(env);
+    PooledPixelAllocator pooledAllocator(&javaAllocator);
 
     SkBitmap* bitmap;
     if (javaBitmap == NULL) {
@@ -226,7 +227,9 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
 
     decoder->setPeeker(&peeker);
     if (!isPurgeable) {
-        decoder->setAllocator(&javaAllocator);
+        // Small decodes, such as thumbnails, reuse the pixel buffers of bitmaps of the
+        // same size that were recycled or collected, instead of a new Java array each
+        decoder->setAllocator(&pooledAllocator);
     }
 
     AutoDecoderCancel adc(options, decoder);
@@ -39,6 +39,7 @@
 #include <binder/Parcel.h>
 #include <jni.h>
 #include <androidfw/Asset.h>
+#include <utils/GenerationCache.h>
 #include <sys/stat.h>
 
 #if 0
@@ -47,6 +48,151 @@
     #define TRACE_BITMAP(code)
 #endif
 
+// Bytes of decoded regions kept by each decoder
+#define REGION_CACHE_SIZE_IN_BYTES (4 * 1024 * 1024)
+
+namespace android {
+
+/**
+ * A decoded region: its bounds and the options it was decoded with
+ */
+struct RegionCacheKey {
+    RegionCacheKey(const SkIRect& region, int sampleSize, SkBitmap::Config config,
+            bool dither, bool preferQualityOverSpeed) :
+            region(region), sampleSize(sampleSize), config(config), dither(dither),
+            preferQualityOverSpeed(preferQualityOverSpeed) {
+    }
+
+    static int compare(const RegionCacheKey& lhs, const RegionCacheKey& rhs) {
+        int deltaInt = lhs.region.fLeft - rhs.region.fLeft;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.region.fTop - rhs.region.fTop;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.region.fRight - rhs.region.fRight;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.region.fBottom - rhs.region.fBottom;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.sampleSize - rhs.sampleSize;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = int(lhs.config) - int(rhs.config);
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = int(lhs.dither) - int(rhs.dither);
+        if (deltaInt != 0) return deltaInt;
+        return int(lhs.preferQualityOverSpeed) - int(rhs.preferQualityOverSpeed);
+    }
+
+    SkIRect region;
+    int sampleSize;
+    SkBitmap::Config config;
+    bool dither;
+    bool preferQualityOverSpeed;
+};
+
+inline int strictly_order_type(const RegionCacheKey& lhs, const RegionCacheKey& rhs) {
+    return RegionCacheKey::compare(lhs, rhs) < 0;
+}
+
+inline int compare_type(const RegionCacheKey& lhs, const RegionCacheKey& rhs) {
+    return RegionCacheKey::compare(lhs, rhs);
+}
+
+/**
+ * A copy of a decoded region. Whether it is opaque is kept separately, as copying
+ * the pixels doesn't preserve it.
+ */
+struct RegionCacheEntry {
+    SkBitmap bitmap;
+    bool isOpaque;
+};
+
+/**
+ * Region decoder that keeps the regions it decoded most recently, so that viewers
+ * panning back and forth over the same tiles do not decode them again. Calls are
+ * serialized by the Java BitmapRegionDecoder, so the cache needs no lock.
+ */
+class CachingRegionDecoder : public SkBitmapRegionDecoder,
+        private OnEntryRemoved<RegionCacheKey, RegionCacheEntry*> {
+public:
+    CachingRegionDecoder(SkImageDecoder* decoder, SkStream* stream, int width, int height) :
+            SkBitmapRegionDecoder(decoder, stream, width, height),
+            mCache(GenerationCache<RegionCacheKey, RegionCacheEntry*>::kUnlimitedCapacity),
+            mSize(0) {
+        mCache.setOnEntryRemovedListener(this);
+    }
+
+    ~CachingRegionDecoder() {
+        mCache.clear();
+    }
+
+    /**
+     * Used as a callback when an entry is removed from the cache
+     * Do not invoke directly
+     */
+    void operator()(RegionCacheKey& key, RegionCacheEntry*& entry) {
+        mSize -= entry->bitmap.getSize();
+        delete entry;
+    }
+
+    const RegionCacheEntry* get(const RegionCacheKey& key) {
+        return mCache.get(key);
+    }
+
+    void put(const RegionCacheKey& key, const SkBitmap& bitmap) {
+        // Color tables are not worth keeping track of
+        if (bitmap.getColorTable() != NULL || bitmap.getSize() > REGION_CACHE_SIZE_IN_BYTES ||
+                mCache.get(key) != NULL) {
+            return;
+        }
+        RegionCacheEntry* entry = new RegionCacheEntry;
+        if (!bitmap.copyTo(&entry->bitmap, bitmap.config())) {
+            delete entry;
+            return;
+        }
+        entry->isOpaque = bitmap.isOpaque();
+        const size_t size = entry->bitmap.getSize();
+        while (mSize + size > REGION_CACHE_SIZE_IN_BYTES && mCache.removeOldest()) {
+        }
+        mSize += size;
+        mCache.put(key, entry);
+    }
+
+private:
+    GenerationCache<RegionCacheKey, RegionCacheEntry*> mCache;
+    size_t mSize;
+};
+
+/**
+ * Copies a cached region into bitmap, either a bitmap being reused, which must have the
+ * same geometry, or a new one allocated with allocator.
+ */
+static bool copyCachedRegion(const RegionCacheEntry& entry, SkBitmap* bitmap, bool reuse,
+        SkBitmap::Allocator* allocator) {
+    const SkBitmap& cached = entry.bitmap;
+    if (reuse) {
+        if (bitmap->config() != cached.config() || bitmap->width() != cached.width() ||
+                bitmap->height() != cached.height() || bitmap->rowBytes() != cached.rowBytes()) {
+            return false;
+        }
+    } else {
+        bitmap->setConfig(cached.config(), cached.width(), cached.height());
+        if (!allocator->allocPixelRef(bitmap, NULL)) {
+            return false;
+        }
+    }
+
+    SkAutoLockPixels alpSrc(cached);
+    SkAutoLockPixels alpDst(*bitmap);
+    if (bitmap->getPixels() == NULL || cached.getPixels() == NULL) {
+        return false;
+    }
+    memcpy(bitmap->getPixels(), cached.getPixels(), cached.getSize());
+    bitmap->setIsOpaque(entry.isOpaque);
+    bitmap->notifyPixelsChanged();
+    return true;
+}
+
+} // namespace android
+
 using namespace android;
 
 static SkMemoryStream* buildSkMemoryStream(SkStream *stream) {
@@ -90,7 +236,7 @@ static jobject doBuildTileIndex(JNIEnv* env, SkStream* stream) {
         return nullObjectReturn("decoder->buildTileIndex returned false");
     }
 
-    SkBitmapRegionDecoder *bm = new SkBitmapRegionDecoder(decoder, stream, width, height);
+    SkBitmapRegionDecoder *bm = new CachingRegionDecoder(decoder, stream, width, height);
 
     return GraphicsJNI::createBitmapRegionDecoder(env, bm);
 }
@@ -233,8 +379,16 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *b
         adb.reset(bitmap);
     }
 
-    if (!brd->decodeRegion(bitmap, region, prefConfig, sampleSize)) {
-        return nullObjectReturn("decoder->decodeRegion returned false");
+    // All the region decoders are created by doBuildTileIndex()
+    CachingRegionDecoder* crd = static_cast<CachingRegionDecoder*>(brd);
+    RegionCacheKey key(region, sampleSize, prefConfig, doDither, preferQualityOverSpeed);
+    const RegionCacheEntry* cached = crd->get(key);
+    if (cached == NULL || !copyCachedRegion(*cached, bitmap, tileBitmap != NULL,
+            decoder->getAllocator())) {
+        if (!brd->decodeRegion(bitmap, region, prefConfig, sampleSize)) {
+            return nullObjectReturn("decoder->decodeRegion returned false");
+        }
+        crd->put(key, *bitmap);
     }
 
     // update options (if any)
@@ -269,7 +423,7 @@ static int nativeGetWidth(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
 }
 
 static void nativeClean(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
-    delete brd;
+    delete static_cast<CachingRegionDecoder*>(brd);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -557,6 +557,65 @@ public:
                                  const SkPaint* paint) {
         canvas->drawBitmapMatrix(*bitmap, *matrix, paint);
     }
+
+    // Draws count rectangles, each stored as left, top, right, bottom
+    // starting at rects[offset], so charts and similar widgets don't pay
+    // a JNI transition per bar.
+    static void drawRects(JNIEnv* env, jobject, SkCanvas* canvas,
+                          jfloatArray jrects, jint offset, jint count,
+                          SkPaint* paint) {
+        NPE_CHECK_RETURN_VOID(env, jrects);
+        AutoJavaFloatArray autoRects(env, jrects, 0, kRO_JNIAccess);
+        const float* rects = autoRects.ptr();
+
+        if ((offset | count) < 0 ||
+                int64_t(offset) + int64_t(count) * 4 > autoRects.length()) {
+            doThrowAIOOBE(env);
+            return;
+        }
+
+        const float* src = rects + offset;
+        for (int i = 0; i < count; i++) {
+            canvas->drawRectCoords(SkFloatToScalar(src[0]), SkFloatToScalar(src[1]),
+                                   SkFloatToScalar(src[2]), SkFloatToScalar(src[3]),
+                                   *paint);
+            src += 4;
+        }
+    }
+
+    // Draws count sprites out of one bitmap. srcRects holds integer
+    // left, top, right, bottom bounds within the bitmap and dstRects the
+    // matching float destination bounds.
+    static void drawBitmapsAtlas(JNIEnv* env, jobject, SkCanvas* canvas,
+                                 const SkBitmap* bitmap,
+                                 jintArray jsrcRects, jint srcOffset,
+                                 jfloatArray jdstRects, jint dstOffset,
+                                 jint count, const SkPaint* paint) {
+        NPE_CHECK_RETURN_VOID(env, jsrcRects);
+        NPE_CHECK_RETURN_VOID(env, jdstRects);
+        AutoJavaIntArray autoSrc(env, jsrcRects);
+        AutoJavaFloatArray autoDst(env, jdstRects, 0, kRO_JNIAccess);
+
+        if ((srcOffset | dstOffset | count) < 0 ||
+                int64_t(srcOffset) + int64_t(count) * 4 > autoSrc.length() ||
+                int64_t(dstOffset) + int64_t(count) * 4 > autoDst.length()) {
+            doThrowAIOOBE(env);
+            return;
+        }
+
+        const jint* src = autoSrc.ptr() + srcOffset;
+        const float* dst = autoDst.ptr() + dstOffset;
+        SkIRect srcRect;
+        SkRect dstRect;
+        for (int i = 0; i < count; i++) {
+            srcRect.set(src[0], src[1], src[2], src[3]);
+            dstRect.set(SkFloatToScalar(dst[0]), SkFloatToScalar(dst[1]),
+                        SkFloatToScalar(dst[2]), SkFloatToScalar(dst[3]));
+            canvas->drawBitmapRect(*bitmap, &srcRect, dstRect, paint);
+            src += 4;
+            dst += 4;
+        }
+    }
     
     static void drawBitmapMesh(JNIEnv* env, jobject, SkCanvas* canvas,
                           const SkBitmap* bitmap, int meshWidth, int meshHeight,
@@ -995,6 +1054,13 @@ static JNINativeMethod gCanvasMethods[] = {
     {"freeTextLayoutCaches", "()V", (void*) SkCanvasGlue::freeTextLayoutCaches}
 };
 
+// Only registered if Canvas declares them
+static JNINativeMethod gCanvasOptionalMethods[] = {
+    {"native_drawRects", "(I[FIII)V", (void*) SkCanvasGlue::drawRects},
+    {"native_drawBitmapsAtlas", "(II[II[FIII)V",
+        (void*) SkCanvasGlue::drawBitmapsAtlas},
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 #include <android_runtime/AndroidRuntime.h>
@@ -1008,7 +1074,9 @@ int register_android_graphics_Canvas(JNIEnv* env) {
     int result;
 
     REG(env, "android/graphics/Canvas", gCanvasMethods);
-    
+    android::AndroidRuntime::registerOptionalNativeMethods(env, "android/graphics/Canvas",
+            gCanvasOptionalMethods, SK_ARRAY_COUNT(gCanvasOptionalMethods));
+
     return result;
 }
 
@@ -9,6 +9,11 @@ static jmethodID    gInputStream_availableMethodID;
 static jmethodID    gInputStream_readMethodID;
 static jmethodID    gInputStream_skipMethodID;
 
+/*  Reads from the Java InputStream a whole storage array at a time and serves the
+    decoders' small reads from a native copy, instead of calling into Java for each.
+    A fill only asks for what a single InputStream.read() returns, so a slow network
+    stream still hands data over as soon as it arrives.
+ */
 class JavaInputStreamAdaptor : public SkStream {
 public:
     JavaInputStreamAdaptor(JNIEnv* env, jobject js, jbyteArray ar)
@@ -17,12 +22,30 @@ public:
         fCapacity   = env->GetArrayLength(ar);
         SkASSERT(fCapacity > 0);
         fBytesRead  = 0;
+        fBuffer = (char*)sk_malloc_throw(fCapacity);
+        fBufferStart = 0;
+        fBufferLength = 0;
+        fBufferOffset = 0;
+    }
+
+    virtual ~JavaInputStreamAdaptor() {
+        sk_free(fBuffer);
     }
 
 	virtual bool rewind() {
         JNIEnv* env = fEnv;
 
+        // Nothing past the first buffer has been read, so it still holds the start of
+        // the stream and the Java stream's mark (which may be smaller) is not needed
+        if (fBufferStart == 0) {
+            fBufferOffset = 0;
+            return true;
+        }
+
         fBytesRead = 0;
+        fBufferStart = 0;
+        fBufferLength = 0;
+        fBufferOffset = 0;
 
         env->CallVoidMethod(fJavaInputStream, gInputStream_resetMethodID);
         if (env->ExceptionCheck()) {
@@ -34,46 +57,92 @@ public:
         return true;
     }
 
-    size_t doRead(void* buffer, size_t size) {
+    // Returns the number of bytes read by a single InputStream.read(), 0 at eof or on error
+    size_t readOnce(void* buffer, size_t size) {
         JNIEnv* env = fEnv;
+        size_t requested = size;
+        if (requested > fCapacity)
+            requested = fCapacity;
+
+        jint n = env->CallIntMethod(fJavaInputStream,
+                                    gInputStream_readMethodID, fJavaByteArray, 0, requested);
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+            SkDebugf("---- read threw an exception\n");
+            return 0;
+        }
+
+        if (n < 0) { // n == 0 should not be possible, see InputStream read() specifications.
+            return 0;  // eof
+        }
+
+        env->GetByteArrayRegion(fJavaByteArray, 0, n,
+                                reinterpret_cast<jbyte*>(buffer));
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+            SkDebugf("---- read:GetByteArrayRegion threw an exception\n");
+            return 0;
+        }
+
+        fBytesRead += n;
+        return n;
+    }
+
+    size_t doRead(void* buffer, size_t size) {
         size_t bytesRead = 0;
         // read the bytes
         do {
-            size_t requested = size;
-            if (requested > fCapacity)
-                requested = fCapacity;
-
-            jint n = env->CallIntMethod(fJavaInputStream,
-                                        gInputStream_readMethodID, fJavaByteArray, 0, requested);
-            if (env->ExceptionCheck()) {
-                env->ExceptionDescribe();
-                env->ExceptionClear();
-                SkDebugf("---- read threw an exception\n");
-                return 0;
+            size_t n = this->readOnce(buffer, size);
+            if (0 == n) {
+                break;
             }
+            buffer = (void*)((char*)buffer + n);
+            bytesRead += n;
+            size -= n;
+        } while (size != 0);
 
-            if (n < 0) { // n == 0 should not be possible, see InputStream read() specifications.
-                break;  // eof
-            }
+        return bytesRead;
+    }
 
-            env->GetByteArrayRegion(fJavaByteArray, 0, n,
-                                    reinterpret_cast<jbyte*>(buffer));
-            if (env->ExceptionCheck()) {
-                env->ExceptionDescribe();
-                env->ExceptionClear();
-                SkDebugf("---- read:GetByteArrayRegion threw an exception\n");
-                return 0;
+    size_t doBufferedRead(void* buffer, size_t size) {
+        size_t bytesRead = 0;
+        while (size != 0) {
+            size_t buffered = fBufferLength - fBufferOffset;
+            if (0 == buffered) {
+                if (size >= fCapacity) {
+                    // Large reads go straight to the caller's buffer
+                    bytesRead += this->doRead(buffer, size);
+                    this->dropBuffer();
+                    break;
+                }
+                fBufferStart = fBytesRead;
+                fBufferOffset = 0;
+                fBufferLength = this->readOnce(fBuffer, fCapacity);
+                if (0 == fBufferLength) {
+                    break;  // eof
+                }
+                continue;
             }
 
+            size_t n = size < buffered ? size : buffered;
+            memcpy(buffer, fBuffer + fBufferOffset, n);
+            fBufferOffset += n;
             buffer = (void*)((char*)buffer + n);
             bytesRead += n;
             size -= n;
-            fBytesRead += n;
-        } while (size != 0);
-
+        }
         return bytesRead;
     }
 
+    // Forgets the buffered bytes after the Java stream was read or skipped directly
+    void dropBuffer() {
+        fBufferStart = fBytesRead;
+        fBufferLength = 0;
+        fBufferOffset = 0;
+    }
+
     size_t doSkip(size_t size) {
         JNIEnv* env = fEnv;
 
@@ -89,6 +158,7 @@ public:
             skipped = 0;
         }
 
+        fBytesRead += (size_t)skipped;
         return (size_t)skipped;
     }
 
@@ -106,16 +176,22 @@ public:
     }
 
 	virtual size_t read(void* buffer, size_t size) {
-        JNIEnv* env = fEnv;
         if (NULL == buffer) {
+            size_t buffered = fBufferLength - fBufferOffset;
             if (0 == size) {
-                return this->doSize();
+                return buffered + this->doSize();
             } else {
+                if (size <= buffered) {
+                    fBufferOffset += size;
+                    return size;
+                }
+                fBufferOffset = fBufferLength;
+
                 /*  InputStream.skip(n) can return <=0 but still not be at EOF
                     If we see that value, we need to call read(), which will
                     block if waiting for more data, or return -1 at EOF
                  */
-                size_t amountSkipped = 0;
+                size_t amountSkipped = buffered;
                 do {
                     size_t amount = this->doSkip(size - amountSkipped);
                     if (0 == amount) {
@@ -128,10 +204,11 @@ public:
                     }
                     amountSkipped += amount;
                 } while (amountSkipped < size);
+                this->dropBuffer();
                 return amountSkipped;
             }
         }
-        return this->doRead(buffer, size);
+        return this->doBufferedRead(buffer, size);
     }
 
 private:
@@ -139,7 +216,11 @@ private:
     jobject     fJavaInputStream;   // the caller owns this object
     jbyteArray  fJavaByteArray;     // the caller owns this object
     size_t      fCapacity;
-    size_t      fBytesRead;
+    size_t      fBytesRead;         // position in the Java stream
+    char*       fBuffer;            // native copy of bytes read ahead
+    size_t      fBufferStart;       // position of fBuffer[0] in the Java stream
+    size_t      fBufferLength;
+    size_t      fBufferOffset;      // next byte of fBuffer to hand out
 };
 
 SkStream* CreateJavaInputStreamAdaptor(JNIEnv* env, jobject stream,
@@ -9,6 +9,9 @@
 #include "SkPicture.h"
 #include "SkRegion.h"
 #include <android_runtime/AndroidRuntime.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 void doThrowNPE(JNIEnv* env) {
     jniThrowNullPointerException(env, NULL);
@@ -525,6 +528,129 @@ bool JavaPixelAllocator::allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Bitmaps up to this many bytes are backed by pooled buffers
+#define POOLED_PIXELS_MAX_SIZE (256 * 1024)
+
+// Bytes of unused buffers the pool holds on to
+#define PIXEL_POOL_MAX_IDLE_SIZE (2 * 1024 * 1024)
+
+// Set up by register_android_graphics_Graphics(), or NULL if the runtime
+// doesn't support native allocation accounting
+static JavaVM* gVM;
+static jobject gVMRuntime;
+static jmethodID gVMRuntime_registerNativeAllocation;
+static jmethodID gVMRuntime_registerNativeFree;
+
+static android::Mutex gPixelPoolMutex;
+static android::KeyedVector<uint64_t, android::Vector<void*> > gPixelPool;
+static size_t gPixelPoolIdleSize;
+
+static uint64_t pixelPoolKey(const SkBitmap& bitmap) {
+    return (uint64_t(bitmap.width()) << 32) | (uint64_t(bitmap.height()) << 8) |
+            uint64_t(bitmap.config());
+}
+
+static void* acquirePooledPixels(uint64_t key, size_t size) {
+    void* storage = NULL;
+    {
+        android::Mutex::Autolock _l(gPixelPoolMutex);
+        ssize_t index = gPixelPool.indexOfKey(key);
+        if (index >= 0) {
+            android::Vector<void*>& buffers = gPixelPool.editValueAt(index);
+            storage = buffers.top();
+            buffers.pop();
+            if (buffers.isEmpty()) {
+                gPixelPool.removeItemsAt(index);
+            }
+            gPixelPoolIdleSize -= size;
+        }
+    }
+    if (storage != NULL) {
+        // Don't hand the previous bitmap's pixels to the new one
+        memset(storage, 0, size);
+        return storage;
+    }
+    return sk_malloc_flags(size, 0);
+}
+
+static void releasePooledPixels(uint64_t key, void* storage, size_t size) {
+    {
+        android::Mutex::Autolock _l(gPixelPoolMutex);
+        if (gPixelPoolIdleSize + size <= PIXEL_POOL_MAX_IDLE_SIZE) {
+            ssize_t index = gPixelPool.indexOfKey(key);
+            if (index < 0) {
+                index = gPixelPool.add(key, android::Vector<void*>());
+            }
+            gPixelPool.editValueAt(index).push(storage);
+            gPixelPoolIdleSize += size;
+            return;
+        }
+    }
+    sk_free(storage);
+}
+
+// Tells the VM about pixels held by a bitmap in native memory, so that the
+// garbage collector runs as if they were on the Java heap.
+static void trackPooledPixels(jmethodID method, size_t size) {
+    if (gVMRuntime == NULL) {
+        return;
+    }
+    JNIEnv* env = NULL;
+    if (gVM->GetEnv((void**)&env, JNI_VERSION_1_4) != JNI_OK || env == NULL) {
+        return;
+    }
+    env->CallVoidMethod(gVMRuntime, method, jint(size));
+    GraphicsJNI::hasException(env); // For the side effect of logging.
+}
+
+class PooledPixelRef : public SkMallocPixelRef {
+public:
+    PooledPixelRef(void* storage, size_t size, SkColorTable* ctable, uint64_t key) :
+            SkMallocPixelRef(storage, size, ctable), fKey(key), fSize(size) {
+        trackPooledPixels(gVMRuntime_registerNativeAllocation, size);
+    }
+
+    virtual ~PooledPixelRef() {
+        trackPooledPixels(gVMRuntime_registerNativeFree, fSize);
+        releasePooledPixels(fKey, fStorage, fSize);
+        // Set this to NULL to prevent the SkMallocPixelRef destructor
+        // from freeing the memory.
+        fStorage = NULL;
+    }
+
+private:
+    uint64_t fKey;
+    size_t fSize;
+};
+
+PooledPixelAllocator::PooledPixelAllocator(SkBitmap::Allocator* fallback)
+    : fFallback(fallback) {
+}
+
+bool PooledPixelAllocator::allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
+    Sk64 size64 = bitmap->getSize64();
+    if (size64.isNeg() || !size64.is32() || size64.get32() == 0 ||
+            size64.get32() > POOLED_PIXELS_MAX_SIZE) {
+        return fFallback->allocPixelRef(bitmap, ctable);
+    }
+
+    size_t size = size64.get32();
+    uint64_t key = pixelPoolKey(*bitmap);
+    void* addr = acquirePooledPixels(key, size);
+    if (addr == NULL) {
+        return fFallback->allocPixelRef(bitmap, ctable);
+    }
+
+    SkPixelRef* pr = new PooledPixelRef(addr, size, ctable, key);
+    bitmap->setPixelRef(pr)->unref();
+    // since we're already allocated, we lockPixels right away
+    // HeapAllocator behaves this way too
+    bitmap->lockPixels();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 JavaHeapBitmapRef::JavaHeapBitmapRef(JNIEnv* env, SkBitmap* nativeBitmap, jbyteArray buffer) {
     fEnv = env;
     fNativeBitmap = nativeBitmap;
@@ -609,5 +735,22 @@ int register_android_graphics_Graphics(JNIEnv* env)
     gRegion_constructorMethodID = env->GetMethodID(gRegion_class, "<init>",
         "(II)V");
 
+    // Only used if the runtime declares them
+    c = env->FindClass("dalvik/system/VMRuntime");
+    if (c != NULL) {
+        m = env->GetStaticMethodID(c, "getRuntime", "()Ldalvik/system/VMRuntime;");
+        gVMRuntime_registerNativeAllocation = env->GetMethodID(c,
+                "registerNativeAllocation", "(I)V");
+        gVMRuntime_registerNativeFree = env->GetMethodID(c, "registerNativeFree", "(I)V");
+        if (m != NULL && gVMRuntime_registerNativeAllocation != NULL &&
+                gVMRuntime_registerNativeFree != NULL) {
+            jobject runtime = env->CallStaticObjectMethod(c, m);
+            if (runtime != NULL && env->GetJavaVM(&gVM) == JNI_OK) {
+                gVMRuntime = env->NewGlobalRef(runtime);
+            }
+        }
+    }
+    env->ExceptionClear();
+
     return 0;
 }
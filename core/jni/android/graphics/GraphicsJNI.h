@@ -164,6 +164,22 @@ private:
     int fAllocCount;
 };
 
+/** Allocator which backs small bitmaps with native buffers taken from a pool,
+ *  bucketed by width, height and config, and gives the buffer back to the pool
+ *  when the pixel ref goes away (Bitmap.recycle() or finalization). Other bitmaps
+ *  are allocated by the fallback allocator. Pooled pixels in use are reported to
+ *  the VM as native allocations, so they still count towards garbage collection.
+ */
+class PooledPixelAllocator : public SkBitmap::Allocator {
+public:
+    PooledPixelAllocator(SkBitmap::Allocator* fallback);
+    // overrides
+    virtual bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable);
+
+private:
+    SkBitmap::Allocator* fFallback;
+};
+
 enum JNIAccess {
     kRO_JNIAccess,
     kRW_JNIAccess
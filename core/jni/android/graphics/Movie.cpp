@@ -8,6 +8,8 @@
 #include <androidfw/Asset.h>
 #include <androidfw/ResourceTypes.h>
 #include <netinet/in.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #if 0
     #define TRACE_BITMAP(code)  code
@@ -15,27 +17,260 @@
     #define TRACE_BITMAP(code)
 #endif
 
+// Default amount of memory, in bytes, used to cache composited frames
+#define DEFAULT_FRAME_CACHE_LIMIT (4 * 1024 * 1024)
+
+// GIF frame delays are in hundredths of a second, so the pixels shown can only
+// change on multiples of this many milliseconds from the start of the movie
+#define FRAME_SLOT_MS 10
+
 static jclass       gMovie_class;
 static jmethodID    gMovie_constructorMethodID;
 static jfieldID     gMovie_nativeInstanceID;
 
+/**
+ * A decoded movie, shared by all the Movie instances created from the same
+ * encoded data. Composited frames are cached and reused across instances
+ * and loops. Each cached frame covers the slots [start, end), of FRAME_SLOT_MS
+ * each, which were all decoded and found to show the same pixels.
+ */
+struct MovieSource {
+    struct Frame {
+        int start;
+        int end;
+        uint32_t lastUse;
+        SkBitmap bitmap;
+    };
+
+    void* data;
+    size_t length;
+    uint32_t hash;
+    int refCount;
+    SkMovie* movie;
+    Vector<Frame> frames;
+};
+
+/**
+ * Per Movie instance state, the time is not shared with other instances.
+ */
+struct MovieInstance {
+    MovieSource* source;
+    int time;
+};
+
+// Guards the sources and their frame caches, including the shared decoders
+static android::Mutex gMovieLock;
+static Vector<MovieSource*> gMovieSources;
+static size_t gMovieFrameCacheSize = 0;
+static size_t gMovieFrameCacheLimit = DEFAULT_FRAME_CACHE_LIMIT;
+static uint32_t gMovieFrameGeneration = 0;
+
+static uint32_t hashMovieData(const void* data, size_t length) {
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*) data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void removeMovieFrameLocked(MovieSource* source, size_t index) {
+    gMovieFrameCacheSize -= source->frames[index].bitmap.getSize();
+    source->frames.removeAt(index);
+}
+
+/**
+ * Evicts the least recently used frames, across all sources, until the
+ * cache fits in the specified number of bytes.
+ */
+static void trimMovieFrameCacheLocked(size_t limit) {
+    while (gMovieFrameCacheSize > limit) {
+        MovieSource* oldestSource = NULL;
+        size_t oldestIndex = 0;
+        uint32_t oldestAge = 0;
+        for (size_t i = 0; i < gMovieSources.size(); i++) {
+            MovieSource* source = gMovieSources[i];
+            for (size_t j = 0; j < source->frames.size(); j++) {
+                uint32_t age = gMovieFrameGeneration - source->frames[j].lastUse;
+                if (!oldestSource || age > oldestAge) {
+                    oldestSource = source;
+                    oldestIndex = j;
+                    oldestAge = age;
+                }
+            }
+        }
+        if (!oldestSource) break;
+        removeMovieFrameLocked(oldestSource, oldestIndex);
+    }
+}
+
+/**
+ * Returns the source decoded from the specified data, decoding it only if
+ * no other movie uses the same data. The data is copied by the source.
+ */
+static MovieSource* acquireMovieSource(const void* data, size_t length) {
+    uint32_t hash = hashMovieData(data, length);
+
+    android::Mutex::Autolock _l(gMovieLock);
+    for (size_t i = 0; i < gMovieSources.size(); i++) {
+        MovieSource* source = gMovieSources[i];
+        if (source->data && source->hash == hash && source->length == length &&
+                !memcmp(source->data, data, length)) {
+            source->refCount++;
+            return source;
+        }
+    }
+
+    SkMovie* movie = SkMovie::DecodeMemory(data, length);
+    if (!movie) {
+        return NULL;
+    }
+    void* copy = malloc(length);
+    if (!copy) {
+        delete movie;
+        return NULL;
+    }
+    memcpy(copy, data, length);
+
+    MovieSource* source = new MovieSource;
+    source->data = copy;
+    source->length = length;
+    source->hash = hash;
+    source->refCount = 1;
+    source->movie = movie;
+    gMovieSources.add(source);
+    return source;
+}
+
+static void releaseMovieSource(MovieSource* source) {
+    android::Mutex::Autolock _l(gMovieLock);
+    if (--source->refCount > 0) return;
+
+    while (!source->frames.isEmpty()) {
+        removeMovieFrameLocked(source, source->frames.size() - 1);
+    }
+    for (size_t i = 0; i < gMovieSources.size(); i++) {
+        if (gMovieSources[i] == source) {
+            gMovieSources.removeAt(i);
+            break;
+        }
+    }
+    delete source->movie;
+    free(source->data);
+    delete source;
+}
+
+/**
+ * Returns the frame shown by the source at the specified time. The
+ * returned bitmap shares its pixels with the cache and remains valid
+ * after the lock is released.
+ */
+static SkBitmap getMovieFrameLocked(MovieSource* source, int time) {
+    Vector<MovieSource::Frame>& frames = source->frames;
+    const int slot = time / FRAME_SLOT_MS;
+
+    // Frames are sorted by start slot and never overlap
+    size_t index = 0;
+    while (index < frames.size() && frames[index].start <= slot) {
+        index++;
+    }
+    if (time >= 0 && index > 0 && slot < frames[index - 1].end) {
+        MovieSource::Frame& frame = frames.editItemAt(index - 1);
+        frame.lastUse = ++gMovieFrameGeneration;
+        return frame.bitmap;
+    }
+
+    SkMovie* movie = source->movie;
+    movie->setTime(time);
+    const SkBitmap& composited = movie->bitmap();
+
+    // SkMovie clamps negative times to the end of the movie, don't cache those
+    if (time < 0 || gMovieFrameCacheLimit == 0 ||
+            composited.getSize() > gMovieFrameCacheLimit) {
+        SkBitmap frame;
+        composited.copyTo(&frame, composited.config());
+        return frame;
+    }
+
+    // A neighbouring frame that ends right before this slot, or starts right
+    // after it, and shows the same pixels is extended instead of storing a copy.
+    // Spans only ever grow over slots that were decoded, so a frame shown in
+    // between two identical ones is never hidden by them.
+    SkAutoLockPixels alp(composited);
+    for (int i = (int) index - 1; i <= (int) index; i++) {
+        if (i < 0 || i >= (int) frames.size()) continue;
+        MovieSource::Frame& frame = frames.editItemAt(i);
+        if (frame.end != slot && frame.start != slot + 1) continue;
+        SkAutoLockPixels afp(frame.bitmap);
+        if (frame.bitmap.getSize() == composited.getSize() &&
+                !memcmp(frame.bitmap.getPixels(), composited.getPixels(),
+                        composited.getSize())) {
+            if (slot < frame.start) frame.start = slot;
+            if (slot >= frame.end) frame.end = slot + 1;
+            frame.lastUse = ++gMovieFrameGeneration;
+            return frame.bitmap;
+        }
+    }
+
+    MovieSource::Frame frame;
+    frame.start = slot;
+    frame.end = slot + 1;
+    frame.lastUse = ++gMovieFrameGeneration;
+    if (!composited.copyTo(&frame.bitmap, composited.config())) {
+        return composited;
+    }
+    frame.bitmap.setImmutable();
+    frames.insertAt(frame, index);
+    gMovieFrameCacheSize += frame.bitmap.getSize();
+    // Never evict the frame that was just inserted
+    trimMovieFrameCacheLocked(gMovieFrameCacheLimit);
+    return frame.bitmap;
+}
+
+static jobject create_jmovie(JNIEnv* env, MovieSource* source) {
+    if (NULL == source) {
+        return NULL;
+    }
+    MovieInstance* instance = new MovieInstance;
+    instance->source = source;
+    instance->time = 0;
+    return env->NewObject(gMovie_class, gMovie_constructorMethodID,
+            static_cast<jint>(reinterpret_cast<uintptr_t>(instance)));
+}
+
 jobject create_jmovie(JNIEnv* env, SkMovie* moov) {
     if (NULL == moov) {
         return NULL;
     }
-    return env->NewObject(gMovie_class, gMovie_constructorMethodID,
-            static_cast<jint>(reinterpret_cast<uintptr_t>(moov)));
+    // Movies decoded elsewhere are not shared with other instances
+    MovieSource* source = new MovieSource;
+    source->data = NULL;
+    source->length = 0;
+    source->hash = 0;
+    source->refCount = 1;
+    source->movie = moov;
+    {
+        android::Mutex::Autolock _l(gMovieLock);
+        gMovieSources.add(source);
+    }
+    return create_jmovie(env, source);
 }
 
-static SkMovie* J2Movie(JNIEnv* env, jobject movie) {
+static MovieInstance* J2MovieInstance(JNIEnv* env, jobject movie) {
     SkASSERT(env);
     SkASSERT(movie);
     SkASSERT(env->IsInstanceOf(movie, gMovie_class));
-    SkMovie* m = (SkMovie*)env->GetIntField(movie, gMovie_nativeInstanceID);
+    MovieInstance* m = (MovieInstance*)env->GetIntField(movie, gMovie_nativeInstanceID);
     SkASSERT(m);
     return m;
 }
 
+static SkMovie* J2Movie(JNIEnv* env, jobject movie) {
+    // The shared decoder is only safe to use for its immutable properties
+    return J2MovieInstance(env, movie)->source->movie;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 static int movie_width(JNIEnv* env, jobject movie) {
@@ -60,7 +295,22 @@ static int movie_duration(JNIEnv* env, jobject movie) {
 
 static jboolean movie_setTime(JNIEnv* env, jobject movie, int ms) {
     NPE_CHECK_RETURN_ZERO(env, movie);
-    return J2Movie(env, movie)->setTime(ms);
+    MovieInstance* instance = J2MovieInstance(env, movie);
+    android::Mutex::Autolock _l(gMovieLock);
+    SkMovie* decoder = instance->source->movie;
+    int duration = decoder->duration();
+    if (ms > duration) {
+        ms = duration;
+    }
+    if (ms < 0) {
+        ms = 0;
+    }
+    // The decoder is shared, bring it back to this instance's time first so
+    // that it reports whether the new time shows another frame
+    decoder->setTime(instance->time);
+    bool changed = decoder->setTime(ms);
+    instance->time = ms;
+    return changed;
 }
 
 static void movie_draw(JNIEnv* env, jobject movie, jobject canvas,
@@ -69,11 +319,15 @@ static void movie_draw(JNIEnv* env, jobject movie, jobject canvas,
     NPE_CHECK_RETURN_VOID(env, canvas);
     // its OK for paint to be null
 
-    SkMovie* m = J2Movie(env, movie);
+    MovieInstance* m = J2MovieInstance(env, movie);
     SkCanvas* c = GraphicsJNI::getNativeCanvas(env, canvas);
     SkScalar sx = SkFloatToScalar(fx);
     SkScalar sy = SkFloatToScalar(fy);
-    const SkBitmap& b = m->bitmap();
+    SkBitmap b;
+    {
+        android::Mutex::Autolock _l(gMovieLock);
+        b = getMovieFrameLocked(m->source, m->time);
+    }
     const SkPaint* p = jpaint ? GraphicsJNI::getNativePaint(env, jpaint) : NULL;
 
     c->drawBitmap(b, sx, sy, p);
@@ -90,9 +344,33 @@ static jobject movie_decodeStream(JNIEnv* env, jobject clazz, jobject istream) {
         return 0;
     }
 
-    SkMovie* moov = SkMovie::DecodeStream(strm);
+    // Read the whole stream so that the encoded data can be matched against
+    // the movies that were already decoded
+    size_t capacity = 16 * 1024;
+    size_t length = 0;
+    char* data = (char*) malloc(capacity);
+    while (data) {
+        size_t count = strm->read(data + length, capacity - length);
+        if (count == 0) break;
+        length += count;
+        if (length == capacity) {
+            capacity *= 2;
+            char* grown = (char*) realloc(data, capacity);
+            if (!grown) {
+                free(data);
+            }
+            data = grown;
+        }
+    }
     strm->unref();
-    return create_jmovie(env, moov);
+
+    if (!data || env->ExceptionCheck()) {
+        free(data);
+        return 0;
+    }
+    MovieSource* source = acquireMovieSource(data, length);
+    free(data);
+    return create_jmovie(env, source);
 }
 
 static jobject movie_decodeByteArray(JNIEnv* env, jobject clazz,
@@ -108,14 +386,21 @@ static jobject movie_decodeByteArray(JNIEnv* env, jobject clazz,
     }
 
     AutoJavaByteArray   ar(env, byteArray);
-    SkMovie* moov = SkMovie::DecodeMemory(ar.ptr() + offset, length);
-    return create_jmovie(env, moov);
+    MovieSource* source = acquireMovieSource(ar.ptr() + offset, length);
+    return create_jmovie(env, source);
 }
 
-static void movie_destructor(JNIEnv* env, jobject, SkMovie* movie) {
+static void movie_destructor(JNIEnv* env, jobject, MovieInstance* movie) {
+    releaseMovieSource(movie->source);
     delete movie;
 }
 
+static void movie_setFrameCacheLimit(JNIEnv* env, jobject, int bytes) {
+    android::Mutex::Autolock _l(gMovieLock);
+    gMovieFrameCacheLimit = bytes > 0 ? bytes : 0;
+    trimMovieFrameCacheLocked(gMovieFrameCacheLimit);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 
 #include <android_runtime/AndroidRuntime.h>
@@ -135,6 +420,11 @@ static JNINativeMethod gMethods[] = {
                             (void*)movie_decodeByteArray },
 };
 
+// Only registered if Movie declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "nativeSetFrameCacheLimit", "(I)V", (void*)movie_setFrameCacheLimit },
+};
+
 #define kClassPathName  "android/graphics/Movie"
 
 #define RETURN_ERR_IF_NULL(value)   do { if (!(value)) { assert(0); return -1; } } while (false)
@@ -151,6 +441,9 @@ int register_android_graphics_Movie(JNIEnv* env)
     gMovie_nativeInstanceID = env->GetFieldID(gMovie_class, "mNativeMovie", "I");
     RETURN_ERR_IF_NULL(gMovie_nativeInstanceID);
 
-    return android::AndroidRuntime::registerNativeMethods(env, kClassPathName,
+    int result = android::AndroidRuntime::registerNativeMethods(env, kClassPathName,
                                                        gMethods, SK_ARRAY_COUNT(gMethods));
+    android::AndroidRuntime::registerOptionalNativeMethods(env, kClassPathName,
+            gOptionalMethods, SK_ARRAY_COUNT(gOptionalMethods));
+    return result;
 }
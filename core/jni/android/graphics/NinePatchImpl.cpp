@@ -20,11 +20,14 @@
 
 #include <androidfw/ResourceTypes.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #include "SkBitmap.h"
 #include "SkCanvas.h"
 #include "SkNinePatch.h"
 #include "SkPaint.h"
+#include "SkPath.h"
 #include "SkUnPreMultiply.h"
 
 #define USE_TRACE
@@ -102,78 +105,65 @@ SkScalar calculateStretch(SkScalar boundsLimit, SkScalar startingPoint,
                           numStrechyPixelsRemaining);
 }
 
-void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
-                       const SkBitmap& bitmap, const android::Res_png_9patch& chunk,
-                       const SkPaint* paint, SkRegion** outRegion) {
-    if (canvas && canvas->quickReject(bounds, SkCanvas::kBW_EdgeType)) {
-        return;
-    }
-
-    SkPaint defaultPaint;
-    if (NULL == paint) {
-        // matches default dither in NinePatchDrawable.java.
-        defaultPaint.setDither(true);
-        paint = &defaultPaint;
-    }
-    
-    // if our SkCanvas were back by GL we should enable this and draw this as
-    // a mesh, which will be faster in most cases.
-    if (false) {
-        SkNinePatch::DrawMesh(canvas, bounds, bitmap,
-                              chunk.xDivs, chunk.numXDivs,
-                              chunk.yDivs, chunk.numYDivs,
-                              paint);
-        return;
-    }
+/**
+ * Position of every patch of a 9-patch stretched to a given size. The
+ * destination rectangles are relative to the top-left corner of the bounds
+ * so that a layout can be reused at any position.
+ */
+struct NinePatchLayout {
+    struct Patch {
+        SkIRect src;
+        SkRect dst;
+        uint32_t color;
+    };
 
-#ifdef USE_TRACE
-    gTrace = true;
-#endif
+    SkScalar width;
+    SkScalar height;
+    int bitmapWidth;
+    int bitmapHeight;
+    android::Vector<int32_t> xDivs;
+    android::Vector<int32_t> yDivs;
+    android::Vector<uint32_t> colors;
+    android::Vector<Patch> patches;
+    uint32_t lastUse;
+    bool inUse;
+    bool cached;
+};
 
-    SkASSERT(canvas || outRegion);
+struct ColorBatch {
+    uint32_t color;
+    int count;
+    SkRect first;
+    SkPath path;
+};
 
-#ifdef USE_TRACE
-    if (canvas) {
-        const SkMatrix& m = canvas->getTotalMatrix();
-        ALOGV("ninepatch [%g %g %g] [%g %g %g]\n",
-                 SkScalarToFloat(m[0]), SkScalarToFloat(m[1]), SkScalarToFloat(m[2]),
-                 SkScalarToFloat(m[3]), SkScalarToFloat(m[4]), SkScalarToFloat(m[5]));
-    }
-#endif
+// Number of layouts kept, the common case is a list of identical rows
+#define LAYOUT_CACHE_SIZE 16
 
-#ifdef USE_TRACE
-    if (gTrace) {
-        ALOGV("======== ninepatch bounds [%g %g]\n", SkScalarToFloat(bounds.width()), SkScalarToFloat(bounds.height()));
-        ALOGV("======== ninepatch paint bm [%d,%d]\n", bitmap.width(), bitmap.height());
-        ALOGV("======== ninepatch xDivs [%d,%d]\n", chunk.xDivs[0], chunk.xDivs[1]);
-        ALOGV("======== ninepatch yDivs [%d,%d]\n", chunk.yDivs[0], chunk.yDivs[1]);
-    }
-#endif
+static android::Mutex gLayoutLock;
+static NinePatchLayout* gLayouts[LAYOUT_CACHE_SIZE];
+static uint32_t gLayoutGeneration = 0;
 
-    if (bounds.isEmpty() ||
-        bitmap.width() == 0 || bitmap.height() == 0 ||
-        (paint && paint->getXfermode() == NULL && paint->getAlpha() == 0))
-    {
-#ifdef USE_TRACE
-        if (gTrace) ALOGV("======== abort ninepatch draw\n");
-#endif
-        return;
-    }
-    
-    // should try a quick-reject test before calling lockPixels 
-
-    SkAutoLockPixels alp(bitmap);
-    // after the lock, it is valid to check getPixels()
-    if (bitmap.getPixels() == NULL)
-        return;
+static bool layoutMatches(const NinePatchLayout* layout, SkScalar width, SkScalar height,
+                          int bitmapWidth, int bitmapHeight,
+                          const android::Res_png_9patch& chunk) {
+    return layout->width == width && layout->height == height &&
+            layout->bitmapWidth == bitmapWidth && layout->bitmapHeight == bitmapHeight &&
+            layout->xDivs.size() == (size_t) chunk.numXDivs &&
+            layout->yDivs.size() == (size_t) chunk.numYDivs &&
+            layout->colors.size() == (size_t) chunk.numColors &&
+            !memcmp(layout->xDivs.array(), chunk.xDivs, chunk.numXDivs * sizeof(int32_t)) &&
+            !memcmp(layout->yDivs.array(), chunk.yDivs, chunk.numYDivs * sizeof(int32_t)) &&
+            !memcmp(layout->colors.array(), chunk.colors, chunk.numColors * sizeof(uint32_t));
+}
 
-    const bool hasXfer = paint->getXfermode() != NULL;
+static void computeLayout(NinePatchLayout* layout, const android::Res_png_9patch& chunk) {
+    const SkRect bounds = SkRect::MakeWH(layout->width, layout->height);
     SkRect      dst;
     SkIRect     src;
 
     const int32_t x0 = chunk.xDivs[0];
     const int32_t y0 = chunk.yDivs[0];
-    const SkColor initColor = ((SkPaint*)paint)->getColor();
     const uint8_t numXDivs = chunk.numXDivs;
     const uint8_t numYDivs = chunk.numYDivs;
     int i;
@@ -183,8 +173,8 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
     bool xIsStretchable;
     const bool initialXIsStretchable =  (x0 == 0);
     bool yIsStretchable = (y0 == 0);
-    const int bitmapWidth = bitmap.width();
-    const int bitmapHeight = bitmap.height();
+    const int bitmapWidth = layout->bitmapWidth;
+    const int bitmapHeight = layout->bitmapHeight;
 
     SkScalar* dstRights = (SkScalar*) alloca((numXDivs + 1) * sizeof(SkScalar));
     bool dstRightsHaveBeenCached = false;
@@ -200,14 +190,7 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
     }
     int numFixedYPixelsRemaining = bitmapHeight - numStretchyYPixelsRemaining;
 
-#ifdef USE_TRACE
-    ALOGV("NinePatch [%d %d] bounds [%g %g %g %g] divs [%d %d]\n",
-             bitmap.width(), bitmap.height(),
-             SkScalarToFloat(bounds.fLeft), SkScalarToFloat(bounds.fTop),
-             SkScalarToFloat(bounds.width()), SkScalarToFloat(bounds.height()),
-             numXDivs, numYDivs);
-#endif
-
+    layout->patches.clear();
     src.fTop = 0;
     dst.fTop = bounds.fTop;
     // The first row always starts with the top being at y=0 and the bottom
@@ -289,32 +272,12 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
             if (dst.fRight <= dst.fLeft || dst.fBottom <= dst.fTop) {
                 goto nextDiv;
             }
-            // If this patch is transparent, skip and don't draw.
-            if (color == android::Res_png_9patch::TRANSPARENT_COLOR && !hasXfer) {
-                if (outRegion) {
-                    if (*outRegion == NULL) {
-                        *outRegion = new SkRegion();
-                    }
-                    SkIRect idst;
-                    dst.round(&idst);
-                    //ALOGI("Adding trans rect: (%d,%d)-(%d,%d)\n",
-                    //     idst.fLeft, idst.fTop, idst.fRight, idst.fBottom);
-                    (*outRegion)->op(idst, SkRegion::kUnion_Op);
-                }
-                goto nextDiv;
-            }
-            if (canvas) {
-#ifdef USE_TRACE
-                ALOGV("-- src [%d %d %d %d] dst [%g %g %g %g]\n",
-                         src.fLeft, src.fTop, src.width(), src.height(),
-                         SkScalarToFloat(dst.fLeft), SkScalarToFloat(dst.fTop),
-                         SkScalarToFloat(dst.width()), SkScalarToFloat(dst.height()));
-                if (2 == src.width() && SkIntToScalar(5) == dst.width()) {
-                    ALOGV("--- skip patch\n");
-                }
-#endif
-                drawStretchyPatch(canvas, src, dst, bitmap, *paint, initColor,
-                                  color, hasXfer);
+            {
+                NinePatchLayout::Patch patch;
+                patch.src = src;
+                patch.dst = dst;
+                patch.color = color;
+                layout->patches.add(patch);
             }
 
 nextDiv:
@@ -326,3 +289,219 @@ nextDiv:
         dstRightsHaveBeenCached = true;
     }
 }
+
+/**
+ * Returns the layout of the specified 9-patch stretched to the specified
+ * size, computing it only if it is not in the cache. The layout must be
+ * given back with releaseLayout().
+ */
+static NinePatchLayout* acquireLayout(SkScalar width, SkScalar height,
+                                      int bitmapWidth, int bitmapHeight,
+                                      const android::Res_png_9patch& chunk) {
+    android::Mutex::Autolock _l(gLayoutLock);
+
+    int victim = -1;
+    for (int i = 0; i < LAYOUT_CACHE_SIZE; i++) {
+        NinePatchLayout* layout = gLayouts[i];
+        if (layout == NULL) {
+            if (victim < 0 || gLayouts[victim] != NULL) victim = i;
+            continue;
+        }
+        if (layout->inUse) continue;
+        if (layoutMatches(layout, width, height, bitmapWidth, bitmapHeight, chunk)) {
+            layout->inUse = true;
+            layout->lastUse = ++gLayoutGeneration;
+            return layout;
+        }
+        if (victim < 0 || (gLayouts[victim] != NULL &&
+                gLayoutGeneration - layout->lastUse >
+                gLayoutGeneration - gLayouts[victim]->lastUse)) {
+            victim = i;
+        }
+    }
+
+    NinePatchLayout* layout;
+    if (victim < 0) {
+        // Every layout is being used by another thread
+        layout = new NinePatchLayout;
+        layout->cached = false;
+    } else {
+        layout = gLayouts[victim];
+        if (layout == NULL) {
+            layout = new NinePatchLayout;
+            layout->cached = true;
+            gLayouts[victim] = layout;
+        }
+    }
+    layout->width = width;
+    layout->height = height;
+    layout->bitmapWidth = bitmapWidth;
+    layout->bitmapHeight = bitmapHeight;
+    layout->xDivs.clear();
+    layout->xDivs.appendArray(chunk.xDivs, chunk.numXDivs);
+    layout->yDivs.clear();
+    layout->yDivs.appendArray(chunk.yDivs, chunk.numYDivs);
+    layout->colors.clear();
+    layout->colors.appendArray(chunk.colors, chunk.numColors);
+    computeLayout(layout, chunk);
+    layout->inUse = true;
+    layout->lastUse = ++gLayoutGeneration;
+    return layout;
+}
+
+static void releaseLayout(NinePatchLayout* layout) {
+    android::Mutex::Autolock _l(gLayoutLock);
+    if (!layout->cached) {
+        delete layout;
+        return;
+    }
+    layout->inUse = false;
+}
+
+static void addToBatch(android::Vector<ColorBatch>& batches, uint32_t color,
+                       const SkRect& dst) {
+    for (size_t i = 0; i < batches.size(); i++) {
+        ColorBatch& batch = batches.editItemAt(i);
+        if (batch.color == color) {
+            if (batch.count++ == 1) {
+                batch.path.addRect(batch.first);
+            }
+            batch.path.addRect(dst);
+            return;
+        }
+    }
+    ColorBatch batch;
+    batch.color = color;
+    batch.count = 1;
+    batch.first = dst;
+    batches.add(batch);
+}
+
+void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
+                       const SkBitmap& bitmap, const android::Res_png_9patch& chunk,
+                       const SkPaint* paint, SkRegion** outRegion) {
+    if (canvas && canvas->quickReject(bounds, SkCanvas::kBW_EdgeType)) {
+        return;
+    }
+
+    SkPaint defaultPaint;
+    if (NULL == paint) {
+        // matches default dither in NinePatchDrawable.java.
+        defaultPaint.setDither(true);
+        paint = &defaultPaint;
+    }
+    
+    // if our SkCanvas were back by GL we should enable this and draw this as
+    // a mesh, which will be faster in most cases.
+    if (false) {
+        SkNinePatch::DrawMesh(canvas, bounds, bitmap,
+                              chunk.xDivs, chunk.numXDivs,
+                              chunk.yDivs, chunk.numYDivs,
+                              paint);
+        return;
+    }
+
+#ifdef USE_TRACE
+    gTrace = true;
+#endif
+
+    SkASSERT(canvas || outRegion);
+
+#ifdef USE_TRACE
+    if (canvas) {
+        const SkMatrix& m = canvas->getTotalMatrix();
+        ALOGV("ninepatch [%g %g %g] [%g %g %g]\n",
+                 SkScalarToFloat(m[0]), SkScalarToFloat(m[1]), SkScalarToFloat(m[2]),
+                 SkScalarToFloat(m[3]), SkScalarToFloat(m[4]), SkScalarToFloat(m[5]));
+    }
+#endif
+
+#ifdef USE_TRACE
+    if (gTrace) {
+        ALOGV("======== ninepatch bounds [%g %g]\n", SkScalarToFloat(bounds.width()), SkScalarToFloat(bounds.height()));
+        ALOGV("======== ninepatch paint bm [%d,%d]\n", bitmap.width(), bitmap.height());
+        ALOGV("======== ninepatch xDivs [%d,%d]\n", chunk.xDivs[0], chunk.xDivs[1]);
+        ALOGV("======== ninepatch yDivs [%d,%d]\n", chunk.yDivs[0], chunk.yDivs[1]);
+    }
+#endif
+
+    if (bounds.isEmpty() ||
+        bitmap.width() == 0 || bitmap.height() == 0 ||
+        (paint && paint->getXfermode() == NULL && paint->getAlpha() == 0))
+    {
+#ifdef USE_TRACE
+        if (gTrace) ALOGV("======== abort ninepatch draw\n");
+#endif
+        return;
+    }
+    
+    // should try a quick-reject test before calling lockPixels 
+
+    SkAutoLockPixels alp(bitmap);
+    // after the lock, it is valid to check getPixels()
+    if (bitmap.getPixels() == NULL)
+        return;
+
+    const bool hasXfer = paint->getXfermode() != NULL;
+    const SkColor initColor = ((SkPaint*)paint)->getColor();
+
+    NinePatchLayout* layout = acquireLayout(bounds.width(), bounds.height(),
+                                            bitmap.width(), bitmap.height(), chunk);
+
+    // Patches filled with a single color from the chunk are batched, with
+    // one path draw per distinct color. The patches never overlap so the
+    // order in which they are drawn does not matter.
+    android::Vector<ColorBatch> batches;
+    SkRect dst;
+
+    for (size_t k = 0; k < layout->patches.size(); k++) {
+        const NinePatchLayout::Patch& patch = layout->patches[k];
+        dst = patch.dst;
+        dst.offset(bounds.fLeft, bounds.fTop);
+
+        // If this patch is transparent, skip and don't draw.
+        if (patch.color == android::Res_png_9patch::TRANSPARENT_COLOR && !hasXfer) {
+            if (outRegion) {
+                if (*outRegion == NULL) {
+                    *outRegion = new SkRegion();
+                }
+                SkIRect idst;
+                dst.round(&idst);
+                //ALOGI("Adding trans rect: (%d,%d)-(%d,%d)\n",
+                //     idst.fLeft, idst.fTop, idst.fRight, idst.fBottom);
+                (*outRegion)->op(idst, SkRegion::kUnion_Op);
+            }
+            continue;
+        }
+        if (canvas) {
+#ifdef USE_TRACE
+            ALOGV("-- src [%d %d %d %d] dst [%g %g %g %g]\n",
+                     patch.src.fLeft, patch.src.fTop, patch.src.width(), patch.src.height(),
+                     SkScalarToFloat(dst.fLeft), SkScalarToFloat(dst.fTop),
+                     SkScalarToFloat(dst.width()), SkScalarToFloat(dst.height()));
+#endif
+            if (patch.color != android::Res_png_9patch::NO_COLOR) {
+                addToBatch(batches, patch.color, dst);
+            } else {
+                SkIRect src = patch.src;
+                drawStretchyPatch(canvas, src, dst, bitmap, *paint, initColor,
+                                  patch.color, hasXfer);
+            }
+        }
+    }
+
+    releaseLayout(layout);
+
+    // Each batch replaces the paint color, modulate with the caller's alpha
+    const int initAlpha = SkColorGetA(initColor);
+    for (size_t k = 0; k < batches.size(); k++) {
+        const ColorBatch& batch = batches[k];
+        ((SkPaint*)paint)->setColor(modAlpha(batch.color, initAlpha));
+        if (batch.count == 1) {
+            canvas->drawRect(batch.first, *paint);
+        } else {
+            canvas->drawPath(batch.path, *paint);
+        }
+    }
+    ((SkPaint*)paint)->setColor(initColor);
+}
@@ -21,10 +21,319 @@
 #include "SkCanvas.h"
 #include "SkPicture.h"
 #include "SkTemplates.h"
+#include "SkTDArray.h"
 #include "CreateJavaOutputStreamAdaptor.h"
 
 namespace android {
 
+/**
+ * Recording canvas that splits a picture into a grid of tiles. State calls
+ * (save/restore, matrix and clip changes) are sent to every tile, while each
+ * draw call is only sent to the tiles its bounds touch. When recording ends
+ * the tiles are folded into the destination picture, each one wrapped in a
+ * save/clipRect/restore block, so that playback can skip every tile that
+ * falls outside of the current clip.
+ */
+class TiledPictureRecorder : public SkCanvas {
+public:
+    TiledPictureRecorder(int width, int height, int tileSize)
+            : mWidth(width), mHeight(height) {
+        int tilesX = (width + tileSize - 1) / tileSize;
+        int tilesY = (height + tileSize - 1) / tileSize;
+        for (int y = 0; y < tilesY; y++) {
+            for (int x = 0; x < tilesX; x++) {
+                Tile* tile = mTiles.append();
+                tile->bounds.set(x * tileSize, y * tileSize,
+                        SkMin32((x + 1) * tileSize, width),
+                        SkMin32((y + 1) * tileSize, height));
+                tile->picture = new SkPicture;
+                tile->canvas = tile->picture->beginRecording(width, height);
+                tile->drawCount = 0;
+            }
+        }
+    }
+
+    virtual ~TiledPictureRecorder() {
+        for (int i = 0; i < mTiles.count(); i++) {
+            mTiles[i].picture->unref();
+        }
+    }
+
+    /**
+     * Ends recording of all the tiles and replaces the content of the
+     * specified picture with them. Tiles nothing was drawn into are dropped.
+     */
+    void finish(SkPicture* pict) {
+        SkCanvas* canvas = pict->beginRecording(mWidth, mHeight);
+        for (int i = 0; i < mTiles.count(); i++) {
+            Tile& tile = mTiles[i];
+            tile.picture->endRecording();
+            if (tile.drawCount == 0) continue;
+
+            SkRect r;
+            r.set(tile.bounds);
+            canvas->save(kClip_SaveFlag);
+            // The clip is not anti-aliased so that adjacent tiles cover
+            // every pixel exactly once, whatever the playback matrix
+            canvas->clipRect(r, SkRegion::kIntersect_Op, false);
+            canvas->drawPicture(*tile.picture);
+            canvas->restore();
+        }
+        pict->endRecording();
+    }
+
+    virtual int save(SaveFlags flags) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->save(flags);
+        return INHERITED::save(flags);
+    }
+
+    virtual int saveLayer(const SkRect* bounds, const SkPaint* paint, SaveFlags flags) {
+        for (int i = 0; i < mTiles.count(); i++) {
+            mTiles[i].canvas->saveLayer(bounds, paint, flags);
+        }
+        // Only track the matrix, the layer itself is never rendered
+        return INHERITED::save(kMatrixClip_SaveFlag);
+    }
+
+    virtual void restore() {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->restore();
+        INHERITED::restore();
+    }
+
+    virtual bool translate(SkScalar dx, SkScalar dy) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->translate(dx, dy);
+        return INHERITED::translate(dx, dy);
+    }
+
+    virtual bool scale(SkScalar sx, SkScalar sy) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->scale(sx, sy);
+        return INHERITED::scale(sx, sy);
+    }
+
+    virtual bool rotate(SkScalar degrees) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->rotate(degrees);
+        return INHERITED::rotate(degrees);
+    }
+
+    virtual bool skew(SkScalar sx, SkScalar sy) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->skew(sx, sy);
+        return INHERITED::skew(sx, sy);
+    }
+
+    virtual bool concat(const SkMatrix& matrix) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->concat(matrix);
+        return INHERITED::concat(matrix);
+    }
+
+    virtual void setMatrix(const SkMatrix& matrix) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->setMatrix(matrix);
+        INHERITED::setMatrix(matrix);
+    }
+
+    virtual bool clipRect(const SkRect& rect, SkRegion::Op op, bool doAA) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->clipRect(rect, op, doAA);
+        return true;
+    }
+
+    virtual bool clipPath(const SkPath& path, SkRegion::Op op, bool doAA) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->clipPath(path, op, doAA);
+        return true;
+    }
+
+    virtual bool clipRegion(const SkRegion& region, SkRegion::Op op) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->clipRegion(region, op);
+        return true;
+    }
+
+    virtual void drawPaint(const SkPaint& paint) {
+        for (int i = 0; i < touchAll(); i++) mTiles[i].canvas->drawPaint(paint);
+    }
+
+    virtual void drawPoints(PointMode mode, size_t count, const SkPoint pts[],
+            const SkPaint& paint) {
+        SkRect bounds;
+        bounds.set(pts, count);
+        // Points and lines are stroked even with a zero width paint
+        SkScalar outset = SkMaxScalar(paint.getStrokeWidth(), SK_Scalar1);
+        bounds.outset(outset, outset);
+        for (Tile* tile = first(bounds, &paint); tile; tile = next(tile)) {
+            tile->canvas->drawPoints(mode, count, pts, paint);
+        }
+    }
+
+    virtual void drawRect(const SkRect& rect, const SkPaint& paint) {
+        SkRect bounds(rect);
+        bounds.sort();
+        for (Tile* tile = first(bounds, &paint); tile; tile = next(tile)) {
+            tile->canvas->drawRect(rect, paint);
+        }
+    }
+
+    virtual void drawPath(const SkPath& path, const SkPaint& paint) {
+        const SkRect* bounds = path.isInverseFillType() ? NULL : &path.getBounds();
+        for (Tile* tile = first(bounds, &paint); tile; tile = next(tile)) {
+            tile->canvas->drawPath(path, paint);
+        }
+    }
+
+    virtual void drawBitmap(const SkBitmap& bitmap, SkScalar left, SkScalar top,
+            const SkPaint* paint) {
+        SkRect bounds;
+        bounds.set(left, top, left + SkIntToScalar(bitmap.width()),
+                top + SkIntToScalar(bitmap.height()));
+        for (Tile* tile = first(bounds, paint); tile; tile = next(tile)) {
+            tile->canvas->drawBitmap(bitmap, left, top, paint);
+        }
+    }
+
+    virtual void drawBitmapRect(const SkBitmap& bitmap, const SkIRect* src,
+            const SkRect& dst, const SkPaint* paint) {
+        SkRect bounds(dst);
+        bounds.sort();
+        for (Tile* tile = first(bounds, paint); tile; tile = next(tile)) {
+            tile->canvas->drawBitmapRect(bitmap, src, dst, paint);
+        }
+    }
+
+    virtual void drawBitmapMatrix(const SkBitmap& bitmap, const SkMatrix& m,
+            const SkPaint* paint) {
+        SkRect bounds;
+        bounds.set(0, 0, SkIntToScalar(bitmap.width()), SkIntToScalar(bitmap.height()));
+        m.mapRect(&bounds);
+        for (Tile* tile = first(bounds, paint); tile; tile = next(tile)) {
+            tile->canvas->drawBitmapMatrix(bitmap, m, paint);
+        }
+    }
+
+    virtual void drawSprite(const SkBitmap& bitmap, int left, int top,
+            const SkPaint* paint) {
+        // Sprites ignore the matrix, their position is in device space
+        for (int i = 0; i < mTiles.count(); i++) {
+            Tile& tile = mTiles[i];
+            if (SkIRect::Intersects(tile.bounds, SkIRect::MakeXYWH(left, top,
+                    bitmap.width(), bitmap.height()))) {
+                tile.drawCount++;
+                tile.canvas->drawSprite(bitmap, left, top, paint);
+            }
+        }
+    }
+
+    virtual void drawText(const void* text, size_t byteLength, SkScalar x, SkScalar y,
+            const SkPaint& paint) {
+        for (int i = 0; i < touchAll(); i++) {
+            mTiles[i].canvas->drawText(text, byteLength, x, y, paint);
+        }
+    }
+
+    virtual void drawPosText(const void* text, size_t byteLength, const SkPoint pos[],
+            const SkPaint& paint) {
+        for (int i = 0; i < touchAll(); i++) {
+            mTiles[i].canvas->drawPosText(text, byteLength, pos, paint);
+        }
+    }
+
+    virtual void drawPosTextH(const void* text, size_t byteLength, const SkScalar xpos[],
+            SkScalar constY, const SkPaint& paint) {
+        for (int i = 0; i < touchAll(); i++) {
+            mTiles[i].canvas->drawPosTextH(text, byteLength, xpos, constY, paint);
+        }
+    }
+
+    virtual void drawTextOnPath(const void* text, size_t byteLength, const SkPath& path,
+            const SkMatrix* matrix, const SkPaint& paint) {
+        for (int i = 0; i < touchAll(); i++) {
+            mTiles[i].canvas->drawTextOnPath(text, byteLength, path, matrix, paint);
+        }
+    }
+
+    virtual void drawPicture(SkPicture& picture) {
+        SkRect bounds;
+        bounds.set(0, 0, SkIntToScalar(picture.width()), SkIntToScalar(picture.height()));
+        for (Tile* tile = first(bounds, NULL); tile; tile = next(tile)) {
+            tile->canvas->drawPicture(picture);
+        }
+    }
+
+    virtual void drawVertices(VertexMode mode, int vertexCount, const SkPoint vertices[],
+            const SkPoint texs[], const SkColor colors[], SkXfermode* xmode,
+            const uint16_t indices[], int indexCount, const SkPaint& paint) {
+        SkRect bounds;
+        bounds.set(vertices, vertexCount);
+        for (Tile* tile = first(bounds, &paint); tile; tile = next(tile)) {
+            tile->canvas->drawVertices(mode, vertexCount, vertices, texs, colors, xmode,
+                    indices, indexCount, paint);
+        }
+    }
+
+    virtual void drawData(const void* data, size_t length) {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].canvas->drawData(data, length);
+    }
+
+private:
+    struct Tile {
+        SkIRect bounds;
+        SkPicture* picture;
+        SkCanvas* canvas;
+        int drawCount;
+    };
+
+    /**
+     * Marks every tile as used and returns the number of tiles. Used for the
+     * draw calls whose bounds cannot be cheaply computed.
+     */
+    int touchAll() {
+        for (int i = 0; i < mTiles.count(); i++) mTiles[i].drawCount++;
+        return mTiles.count();
+    }
+
+    /**
+     * Computes the bounds, in picture space, of a draw call covering the
+     * specified local bounds and returns the first tile they touch. A NULL
+     * bounds, or a paint whose effects cannot be bounded, touches every tile.
+     */
+    Tile* first(const SkRect* localBounds, const SkPaint* paint) {
+        mDrawBounds.set(0, 0, mWidth, mHeight);
+        if (localBounds && (!paint || paint->canComputeFastBounds())) {
+            SkRect bounds(*localBounds);
+            if (paint) {
+                SkRect storage;
+                bounds = paint->computeFastBounds(*localBounds, &storage);
+            }
+            getTotalMatrix().mapRect(&bounds);
+            // Round out and pad by a pixel to account for anti-aliasing
+            bounds.roundOut(&mDrawBounds);
+            mDrawBounds.outset(1, 1);
+        }
+        return advance(0);
+    }
+
+    Tile* first(const SkRect& localBounds, const SkPaint* paint) {
+        return first(&localBounds, paint);
+    }
+
+    Tile* next(Tile* tile) {
+        return advance(tile - mTiles.begin() + 1);
+    }
+
+    Tile* advance(int index) {
+        for (; index < mTiles.count(); index++) {
+            Tile& tile = mTiles[index];
+            if (SkIRect::Intersects(tile.bounds, mDrawBounds)) {
+                tile.drawCount++;
+                return &tile;
+            }
+        }
+        return NULL;
+    }
+
+    int mWidth;
+    int mHeight;
+    SkTDArray<Tile> mTiles;
+    SkIRect mDrawBounds;
+
+    typedef SkCanvas INHERITED;
+};
+
 class SkPictureGlue {
 public:
     static SkPicture* newPicture(JNIEnv* env, jobject, const SkPicture* src) {
@@ -94,6 +403,25 @@ public:
     static void endRecording(JNIEnv* env, jobject, SkPicture* pict) {
         pict->endRecording();
     }
+
+    static SkCanvas* beginTiledRecording(JNIEnv* env, jobject, SkPicture* pict,
+                                         int w, int h, int tileSize) {
+        if (tileSize <= 0) {
+            return beginRecording(env, NULL, pict, w, h);
+        }
+        // The recorder is owned by the Canvas.java that wraps it, the
+        // picture is only written to when the recording ends
+        return new TiledPictureRecorder(w, h, tileSize);
+    }
+
+    static void endTiledRecording(JNIEnv* env, jobject, SkPicture* pict,
+                                  SkCanvas* canvas, int tileSize) {
+        if (tileSize <= 0) {
+            pict->endRecording();
+            return;
+        }
+        static_cast<TiledPictureRecorder*>(canvas)->finish(pict);
+    }
 };
 
 static JNINativeMethod gPictureMethods[] = {
@@ -108,6 +436,12 @@ static JNINativeMethod gPictureMethods[] = {
     {"nativeDestructor","(I)V", (void*) SkPictureGlue::killPicture}
 };
 
+// Only registered if Picture declares them
+static JNINativeMethod gPictureOptionalMethods[] = {
+    {"nativeBeginTiledRecording", "(IIII)I", (void*) SkPictureGlue::beginTiledRecording},
+    {"nativeEndTiledRecording", "(III)V", (void*) SkPictureGlue::endTiledRecording},
+};
+
 #include <android_runtime/AndroidRuntime.h>
     
 #define REG(env, name, array) \
@@ -119,6 +453,8 @@ int register_android_graphics_Picture(JNIEnv* env) {
     int result;
     
     REG(env, "android/graphics/Picture", gPictureMethods);
+    android::AndroidRuntime::registerOptionalNativeMethods(env, "android/graphics/Picture",
+            gPictureOptionalMethods, SK_ARRAY_COUNT(gPictureOptionalMethods));
     
     return result;
 }
@@ -40,24 +40,20 @@ namespace android {
 #define TYPEFACE_THAI "/system/fonts/DroidSansThai.ttf"
 
 ANDROID_SINGLETON_STATIC_INSTANCE(TextLayoutEngine);
+ANDROID_SINGLETON_STATIC_INSTANCE(TextBidiCache);
 
 //--------------------------------------------------------------------------------------------------
 
 TextLayoutCache::TextLayoutCache(TextLayoutShaper* shaper) :
         mShaper(shaper),
-        mCache(GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
-        mSize(0), mMaxSize(MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB)),
         mCacheHitCount(0), mNanosecondsSaved(0) {
     init();
 }
 
 TextLayoutCache::~TextLayoutCache() {
-    mCache.clear();
 }
 
 void TextLayoutCache::init() {
-    mCache.setOnEntryRemovedListener(this);
-
     mDebugLevel = readRtlDebugLevel();
     mDebugEnabled = mDebugLevel & kRtlDebugCaches;
     ALOGD("Using debug level = %d - Debug Enabled = %d", mDebugLevel, mDebugEnabled);
@@ -71,14 +67,54 @@ void TextLayoutCache::init() {
     mInitialized = true;
 }
 
+TextLayoutCache::Stripe::Stripe() :
+        mCache(GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
+        mSize(0),
+        mMaxSize(MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB) / TEXT_LAYOUT_CACHE_STRIPE_COUNT),
+        mHits(0), mMisses(0) {
+    mCache.setOnEntryRemovedListener(this);
+}
+
+TextLayoutCache::Stripe::~Stripe() {
+    mCache.clear();
+}
+
 /**
  *  Callbacks
  */
-void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc) {
+void TextLayoutCache::Stripe::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc) {
     size_t totalSizeToDelete = text.getSize() + desc->getSize();
     mSize -= totalSizeToDelete;
-    if (mDebugEnabled) {
-        ALOGD("Cache value %p deleted, size = %d", desc.get(), totalSizeToDelete);
+}
+
+void TextLayoutCache::Stripe::makeRoom(size_t size, bool debugEnabled) {
+    if (mSize + size <= mMaxSize) {
+        return;
+    }
+
+    // A stripe that is full while at least a quarter of its lookups hit is holding text
+    // that gets drawn again, so give it more room rather than evicting
+    const uint32_t maxStripeSize = MB(MAX_TEXT_LAYOUT_CACHE_SIZE_IN_MB) /
+            TEXT_LAYOUT_CACHE_STRIPE_COUNT;
+    if (mMaxSize < maxStripeSize && mHits * 3 >= mMisses) {
+        mMaxSize = mMaxSize * 2 < maxStripeSize ? mMaxSize * 2 : maxStripeSize;
+        mHits = 0;
+        mMisses = 0;
+        if (debugEnabled) {
+            ALOGD("Growing cache stripe %p to %u bytes", this, mMaxSize);
+        }
+    }
+
+    if (mSize + size > mMaxSize && debugEnabled) {
+        ALOGD("Need to clean some entries for making some room for a new entry");
+    }
+    while (mSize + size > mMaxSize) {
+        // This will call the callback
+        bool removedOne = mCache.removeOldest();
+        LOG_ALWAYS_FATAL_IF(!removedOne, "The cache is non-empty but we "
+                "failed to remove the oldest entry.  "
+                "mSize = %u, size = %u, mMaxSize = %u, mCache.size() = %u",
+                mSize, size, mMaxSize, mCache.size());
     }
 }
 
@@ -86,7 +122,20 @@ void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>&
  * Cache clearing
  */
 void TextLayoutCache::clear() {
-    mCache.clear();
+    for (size_t i = 0; i < TEXT_LAYOUT_CACHE_STRIPE_COUNT; i++) {
+        Stripe& stripe = mStripes[i];
+        AutoMutex _l(stripe.mLock);
+        stripe.mCache.clear();
+        stripe.mMaxSize = MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB) /
+                TEXT_LAYOUT_CACHE_STRIPE_COUNT;
+        stripe.mHits = 0;
+        stripe.mMisses = 0;
+    }
+}
+
+void TextLayoutCache::purgeShaperCaches() {
+    AutoMutex _l(mShaperLock);
+    mShaper->purgeCaches();
 }
 
 /*
@@ -94,7 +143,6 @@ void TextLayoutCache::clear() {
  */
 sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
             const jchar* text, jint start, jint count, jint contextCount, jint dirFlags) {
-    AutoMutex _l(mLock);
     nsecs_t startTime = 0;
     if (mDebugEnabled) {
         startTime = systemTime(SYSTEM_TIME_MONOTONIC);
@@ -102,9 +150,19 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
 
     // Create the key
     TextLayoutCacheKey key(paint, text, start, count, contextCount, dirFlags);
+    Stripe& stripe = mStripes[key.getHash() % TEXT_LAYOUT_CACHE_STRIPE_COUNT];
 
     // Get value from cache if possible
-    sp<TextLayoutValue> value = mCache.get(key);
+    sp<TextLayoutValue> value;
+    {
+        AutoMutex _l(stripe.mLock);
+        value = stripe.mCache.get(key);
+        if (value != NULL) {
+            stripe.mHits++;
+        } else {
+            stripe.mMisses++;
+        }
+    }
 
     // Value not found for the key, we need to add a new value in the cache
     if (value == NULL) {
@@ -115,39 +173,38 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
         value = new TextLayoutValue(contextCount);
 
         // Compute advances and store them
-        mShaper->computeValues(value.get(), paint,
-                reinterpret_cast<const UChar*>(text), start, count,
-                size_t(contextCount), int(dirFlags));
+        {
+            AutoMutex _l(mShaperLock);
+            mShaper->computeValues(value.get(), paint,
+                    reinterpret_cast<const UChar*>(text), start, count,
+                    size_t(contextCount), int(dirFlags));
+        }
 
         if (mDebugEnabled) {
             value->setElapsedTime(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
         }
 
+        AutoMutex _l(stripe.mLock);
+
+        // Another thread may have shaped the same text meanwhile
+        sp<TextLayoutValue> existing = stripe.mCache.get(key);
+        if (existing != NULL) {
+            return existing;
+        }
+
         // Don't bother to add in the cache if the entry is too big
         size_t size = key.getSize() + value->getSize();
-        if (size <= mMaxSize) {
+        if (size <= stripe.mMaxSize) {
             // Cleanup to make some room if needed
-            if (mSize + size > mMaxSize) {
-                if (mDebugEnabled) {
-                    ALOGD("Need to clean some entries for making some room for a new entry");
-                }
-                while (mSize + size > mMaxSize) {
-                    // This will call the callback
-                    bool removedOne = mCache.removeOldest();
-                    LOG_ALWAYS_FATAL_IF(!removedOne, "The cache is non-empty but we "
-                            "failed to remove the oldest entry.  "
-                            "mSize = %u, size = %u, mMaxSize = %u, mCache.size() = %u",
-                            mSize, size, mMaxSize, mCache.size());
-                }
-            }
+            stripe.makeRoom(size, mDebugEnabled);
 
             // Update current cache size
-            mSize += size;
+            stripe.mSize += size;
 
             // Copy the text when we insert the new entry
             key.internalTextCopy();
 
-            bool putOne = mCache.put(key, value);
+            bool putOne = stripe.mCache.put(key, value);
             LOG_ALWAYS_FATAL_IF(!putOne, "Failed to put an entry into the cache.  "
                     "This indicates that the cache already has an entry with the "
                     "same key but it should not since we checked earlier!"
@@ -158,9 +215,10 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
                 nsecs_t totalTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
                 ALOGD("CACHE MISS: Added entry %p "
                         "with start = %d, count = %d, contextCount = %d, "
-                        "entry size %d bytes, remaining space %d bytes"
+                        "entry size %d bytes, remaining space %d bytes in stripe"
                         " - Compute time %0.6f ms - Put time %0.6f ms - Text = '%s'",
-                        value.get(), start, count, contextCount, size, mMaxSize - mSize,
+                        value.get(), start, count, contextCount, size,
+                        stripe.mMaxSize - stripe.mSize,
                         value->getElapsedTime() * 0.000001f,
                         (totalTime - value->getElapsedTime()) * 0.000001f,
                         String8(text + start, count).string());
@@ -169,9 +227,9 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
             if (mDebugEnabled) {
                 ALOGD("CACHE MISS: Calculated but not storing entry because it is too big "
                         "with start = %d, count = %d, contextCount = %d, "
-                        "entry size %d bytes, remaining space %d bytes"
+                        "entry size %d bytes, remaining space %d bytes in stripe"
                         " - Compute time %0.6f ms - Text = '%s'",
-                        start, count, contextCount, size, mMaxSize - mSize,
+                        start, count, contextCount, size, stripe.mMaxSize - stripe.mSize,
                         value->getElapsedTime() * 0.000001f,
                         String8(text + start, count).string());
             }
@@ -180,8 +238,12 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
         // This is a cache hit, just log timestamp and user infos
         if (mDebugEnabled) {
             nsecs_t elapsedTimeThruCacheGet = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
-            mNanosecondsSaved += (value->getElapsedTime() - elapsedTimeThruCacheGet);
-            ++mCacheHitCount;
+            uint32_t cacheHitCount;
+            {
+                AutoMutex _l(mStatsLock);
+                mNanosecondsSaved += (value->getElapsedTime() - elapsedTimeThruCacheGet);
+                cacheHitCount = ++mCacheHitCount;
+            }
 
             if (value->getElapsedTime() > 0) {
                 float deltaPercent = 100 * ((value->getElapsedTime() - elapsedTimeThruCacheGet)
@@ -189,13 +251,13 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
                 ALOGD("CACHE HIT #%d with start = %d, count = %d, contextCount = %d"
                         "- Compute time %0.6f ms - "
                         "Cache get time %0.6f ms - Gain in percent: %2.2f - Text = '%s'",
-                        mCacheHitCount, start, count, contextCount,
+                        cacheHitCount, start, count, contextCount,
                         value->getElapsedTime() * 0.000001f,
                         elapsedTimeThruCacheGet * 0.000001f,
                         deltaPercent,
                         String8(text + start, count).string());
             }
-            if (mCacheHitCount % DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL == 0) {
+            if (cacheHitCount % DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL == 0) {
                 dumpCacheStats();
             }
         }
@@ -204,14 +266,24 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
 }
 
 void TextLayoutCache::dumpCacheStats() {
-    float remainingPercent = 100 * ((mMaxSize - mSize) / ((float)mMaxSize));
     float timeRunningInSec = (systemTime(SYSTEM_TIME_MONOTONIC) - mCacheStartTime) / 1000000000;
 
+    size_t cacheSize = 0;
     size_t bytes = 0;
-    size_t cacheSize = mCache.size();
-    for (size_t i = 0; i < cacheSize; i++) {
-        bytes += mCache.getKeyAt(i).getSize() + mCache.getValueAt(i)->getSize();
+    uint32_t size = 0;
+    uint32_t maxSize = 0;
+    for (size_t s = 0; s < TEXT_LAYOUT_CACHE_STRIPE_COUNT; s++) {
+        Stripe& stripe = mStripes[s];
+        AutoMutex _l(stripe.mLock);
+        size_t stripeEntries = stripe.mCache.size();
+        for (size_t i = 0; i < stripeEntries; i++) {
+            bytes += stripe.mCache.getKeyAt(i).getSize() + stripe.mCache.getValueAt(i)->getSize();
+        }
+        cacheSize += stripeEntries;
+        size += stripe.mSize;
+        maxSize += stripe.mMaxSize;
     }
+    float remainingPercent = 100 * ((maxSize - size) / ((float)maxSize));
 
     ALOGD("------------------------------------------------");
     ALOGD("Cache stats");
@@ -219,18 +291,34 @@ void TextLayoutCache::dumpCacheStats() {
     ALOGD("pid       : %d", getpid());
     ALOGD("running   : %.0f seconds", timeRunningInSec);
     ALOGD("entries   : %d", cacheSize);
-    ALOGD("max size  : %d bytes", mMaxSize);
-    ALOGD("used      : %d bytes according to mSize, %d bytes actual", mSize, bytes);
-    ALOGD("remaining : %d bytes or %2.2f percent", mMaxSize - mSize, remainingPercent);
+    ALOGD("max size  : %d bytes", maxSize);
+    ALOGD("used      : %d bytes according to mSize, %d bytes actual", size, bytes);
+    ALOGD("remaining : %d bytes or %2.2f percent", maxSize - size, remainingPercent);
     ALOGD("hits      : %d", mCacheHitCount);
     ALOGD("saved     : %0.6f ms", mNanosecondsSaved * 0.000001f);
     ALOGD("------------------------------------------------");
 }
 
+/**
+ * One-at-a-time hashing of the key fields
+ */
+static inline uint32_t hashMix(uint32_t hash, uint32_t data) {
+    hash += data;
+    hash += (hash << 10);
+    hash ^= (hash >> 6);
+    return hash;
+}
+
+static inline uint32_t hashScalar(uint32_t hash, SkScalar value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return hashMix(hash, bits);
+}
+
 /**
  * TextLayoutCacheKey
  */
-TextLayoutCacheKey::TextLayoutCacheKey(): text(NULL), start(0), count(0), contextCount(0),
+TextLayoutCacheKey::TextLayoutCacheKey(): text(NULL), hash(0), start(0), count(0), contextCount(0),
         dirFlags(0), typeface(NULL), textSize(0), textSkewX(0), textScaleX(0), flags(0),
         hinting(SkPaint::kNo_Hinting)  {
 }
@@ -245,11 +333,31 @@ TextLayoutCacheKey::TextLayoutCacheKey(const SkPaint* paint, const UChar* text,
     textScaleX = paint->getTextScaleX();
     flags = paint->getFlags();
     hinting = paint->getHinting();
+
+    uint32_t h = 0;
+    for (size_t i = 0; i < contextCount; i++) {
+        h = hashMix(h, text[i]);
+    }
+    h = hashMix(h, start);
+    h = hashMix(h, count);
+    h = hashMix(h, contextCount);
+    h = hashMix(h, dirFlags);
+    h = hashMix(h, uint32_t(uintptr_t(typeface)));
+    h = hashScalar(h, textSize);
+    h = hashScalar(h, textSkewX);
+    h = hashScalar(h, textScaleX);
+    h = hashMix(h, flags);
+    h = hashMix(h, hinting);
+    h += (h << 3);
+    h ^= (h >> 11);
+    h += (h << 15);
+    hash = h;
 }
 
 TextLayoutCacheKey::TextLayoutCacheKey(const TextLayoutCacheKey& other) :
         text(NULL),
         textCopy(other.textCopy),
+        hash(other.hash),
         start(other.start),
         count(other.count),
         contextCount(other.contextCount),
@@ -266,6 +374,10 @@ TextLayoutCacheKey::TextLayoutCacheKey(const TextLayoutCacheKey& other) :
 }
 
 int TextLayoutCacheKey::compare(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs) {
+    // Keys are ordered by hash first, so that probes almost never get to the text
+    if (lhs.hash < rhs.hash) return -1;
+    if (lhs.hash > rhs.hash) return +1;
+
     int deltaInt = lhs.start - rhs.start;
     if (deltaInt != 0) return (deltaInt);
 
@@ -331,7 +443,303 @@ uint32_t TextLayoutValue::getElapsedTime() {
     return mElapsedTime;
 }
 
-TextLayoutShaper::TextLayoutShaper() : mShaperItemGlyphArraySize(0) {
+/**
+ * TextLayoutWordKey
+ */
+TextLayoutWordKey::TextLayoutWordKey(): text(NULL), count(0), isRTL(false), typeface(NULL),
+        textSize(0), textSkewX(0), textScaleX(0), flags(0), hinting(SkPaint::kNo_Hinting) {
+}
+
+TextLayoutWordKey::TextLayoutWordKey(const SkPaint* paint, const UChar* text,
+        size_t count, bool isRTL) :
+            text(text), count(count), isRTL(isRTL) {
+    typeface = paint->getTypeface();
+    textSize = paint->getTextSize();
+    textSkewX = paint->getTextSkewX();
+    textScaleX = paint->getTextScaleX();
+    flags = paint->getFlags();
+    hinting = paint->getHinting();
+}
+
+TextLayoutWordKey::TextLayoutWordKey(const TextLayoutWordKey& other) :
+        text(NULL),
+        textCopy(other.textCopy),
+        count(other.count),
+        isRTL(other.isRTL),
+        typeface(other.typeface),
+        textSize(other.textSize),
+        textSkewX(other.textSkewX),
+        textScaleX(other.textScaleX),
+        flags(other.flags),
+        hinting(other.hinting) {
+    if (other.text) {
+        textCopy.setTo(other.text, other.count);
+    }
+}
+
+int TextLayoutWordKey::compare(const TextLayoutWordKey& lhs, const TextLayoutWordKey& rhs) {
+    int deltaInt = lhs.count - rhs.count;
+    if (deltaInt != 0) return (deltaInt);
+
+    deltaInt = lhs.isRTL - rhs.isRTL;
+    if (deltaInt != 0) return (deltaInt);
+
+    if (lhs.typeface < rhs.typeface) return -1;
+    if (lhs.typeface > rhs.typeface) return +1;
+
+    if (lhs.textSize < rhs.textSize) return -1;
+    if (lhs.textSize > rhs.textSize) return +1;
+
+    if (lhs.textSkewX < rhs.textSkewX) return -1;
+    if (lhs.textSkewX > rhs.textSkewX) return +1;
+
+    if (lhs.textScaleX < rhs.textScaleX) return -1;
+    if (lhs.textScaleX > rhs.textScaleX) return +1;
+
+    deltaInt = lhs.flags - rhs.flags;
+    if (deltaInt != 0) return (deltaInt);
+
+    deltaInt = lhs.hinting - rhs.hinting;
+    if (deltaInt != 0) return (deltaInt);
+
+    return memcmp(lhs.getText(), rhs.getText(), lhs.count * sizeof(UChar));
+}
+
+void TextLayoutWordKey::internalTextCopy() {
+    textCopy.setTo(text, count);
+    text = NULL;
+}
+
+size_t TextLayoutWordKey::getSize() const {
+    return sizeof(TextLayoutWordKey) + sizeof(UChar) * count;
+}
+
+/**
+ * TextLayoutWordCache
+ */
+TextLayoutWordCache::TextLayoutWordCache() :
+        mCache(GenerationCache<TextLayoutWordKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
+        mSize(0), mMaxSize(MB(DEFAULT_TEXT_LAYOUT_WORD_CACHE_SIZE_IN_MB)) {
+    mCache.setOnEntryRemovedListener(this);
+}
+
+TextLayoutWordCache::~TextLayoutWordCache() {
+    mCache.clear();
+}
+
+void TextLayoutWordCache::operator()(TextLayoutWordKey& key, sp<TextLayoutValue>& value) {
+    mSize -= key.getSize() + value->getSize();
+}
+
+sp<TextLayoutValue> TextLayoutWordCache::get(const TextLayoutWordKey& key) {
+    return mCache.get(key);
+}
+
+void TextLayoutWordCache::put(TextLayoutWordKey& key, const sp<TextLayoutValue>& value) {
+    size_t size = key.getSize() + value->getSize();
+    if (size > mMaxSize) {
+        return;
+    }
+    while (mSize + size > mMaxSize) {
+        // This will call the callback
+        if (!mCache.removeOldest()) {
+            break;
+        }
+    }
+    mSize += size;
+
+    key.internalTextCopy();
+    mCache.put(key, value);
+}
+
+void TextLayoutWordCache::clear() {
+    mCache.clear();
+}
+
+/**
+ * TextBidiKey
+ */
+TextBidiKey::TextBidiKey(): text(NULL), hash(0), count(0), paraLevel(0) {
+}
+
+TextBidiKey::TextBidiKey(const UChar* text, size_t count, UBiDiLevel paraLevel) :
+        text(text), count(count), paraLevel(paraLevel) {
+    uint32_t h = 0;
+    for (size_t i = 0; i < count; i++) {
+        h = hashMix(h, text[i]);
+    }
+    h = hashMix(h, paraLevel);
+    h += (h << 3);
+    h ^= (h >> 11);
+    h += (h << 15);
+    hash = h;
+}
+
+TextBidiKey::TextBidiKey(const TextBidiKey& other) :
+        text(NULL),
+        textCopy(other.textCopy),
+        hash(other.hash),
+        count(other.count),
+        paraLevel(other.paraLevel) {
+    if (other.text) {
+        textCopy.setTo(other.text, other.count);
+    }
+}
+
+int TextBidiKey::compare(const TextBidiKey& lhs, const TextBidiKey& rhs) {
+    // The hash makes most comparisons of different paragraphs stop before the text
+    if (lhs.hash < rhs.hash) return -1;
+    if (lhs.hash > rhs.hash) return +1;
+
+    int deltaInt = lhs.count - rhs.count;
+    if (deltaInt != 0) return (deltaInt);
+
+    deltaInt = lhs.paraLevel - rhs.paraLevel;
+    if (deltaInt != 0) return (deltaInt);
+
+    return memcmp(lhs.getText(), rhs.getText(), lhs.count * sizeof(UChar));
+}
+
+void TextBidiKey::internalTextCopy() {
+    textCopy.setTo(text, count);
+    text = NULL;
+}
+
+size_t TextBidiKey::getSize() const {
+    return sizeof(TextBidiKey) + sizeof(UChar) * count;
+}
+
+/**
+ * TextBidiValue
+ */
+size_t TextBidiValue::getSize() const {
+    return sizeof(TextBidiValue) + sizeof(UBiDiLevel) * mLevels.capacity() +
+            sizeof(Run) * mRuns.capacity();
+}
+
+/**
+ * TextBidiCache
+ */
+TextBidiCache::TextBidiCache() :
+        mCache(GenerationCache<TextBidiKey, sp<TextBidiValue> >::kUnlimitedCapacity),
+        mSize(0), mMaxSize(MB(DEFAULT_TEXT_BIDI_CACHE_SIZE_IN_MB)) {
+    mCache.setOnEntryRemovedListener(this);
+}
+
+TextBidiCache::~TextBidiCache() {
+    mCache.clear();
+}
+
+void TextBidiCache::operator()(TextBidiKey& key, sp<TextBidiValue>& value) {
+    mSize -= key.getSize() + value->getSize();
+}
+
+sp<TextBidiValue> TextBidiCache::getValue(const UChar* text, size_t count,
+        UBiDiLevel paraLevel) {
+    if (paraLevel == 0 || paraLevel == UBIDI_DEFAULT_LTR) {
+        size_t i = 0;
+        while (i < count && text[i] < UNICODE_FIRST_RTL_CHAR) {
+            i++;
+        }
+        if (i == count) {
+            // Only left-to-right, neutral and European number characters, which all
+            // resolve to level 0 in a left-to-right paragraph
+            sp<TextBidiValue> value = new TextBidiValue();
+            value->mLevels.insertAt(0, 0, count);
+            if (count) {
+                TextBidiValue::Run run = { 0, int32_t(count), false };
+                value->mRuns.add(run);
+            }
+            return value;
+        }
+    }
+
+    if (count > MAX_TEXT_BIDI_CACHE_TEXT_LENGTH) {
+        return computeValue(text, count, paraLevel);
+    }
+
+    TextBidiKey key(text, count, paraLevel);
+    {
+        Mutex::Autolock _l(mLock);
+        sp<TextBidiValue> value = mCache.get(key);
+        if (value != NULL) {
+            return value;
+        }
+    }
+
+    // Analyze without holding the lock, another thread may add the same paragraph
+    // meanwhile, in which case put() keeps the first one
+    sp<TextBidiValue> value = computeValue(text, count, paraLevel);
+    if (value == NULL) {
+        return value;
+    }
+
+    size_t size = key.getSize() + value->getSize();
+    if (size > mMaxSize) {
+        return value;
+    }
+
+    Mutex::Autolock _l(mLock);
+    while (mSize + size > mMaxSize) {
+        // This will call the callback
+        if (!mCache.removeOldest()) {
+            break;
+        }
+    }
+    key.internalTextCopy();
+    if (mCache.put(key, value)) {
+        mSize += size;
+    }
+    return value;
+}
+
+sp<TextBidiValue> TextBidiCache::computeValue(const UChar* text, size_t count,
+        UBiDiLevel paraLevel) {
+    UErrorCode status = U_ZERO_ERROR;
+    UBiDi* bidi = ubidi_openSized(count, 0, &status);
+    if (!bidi) {
+        ALOGW("Cannot ubidi_openSized()");
+        return NULL;
+    }
+
+    sp<TextBidiValue> value;
+    ubidi_setPara(bidi, text, count, paraLevel, NULL, &status);
+    const UBiDiLevel* levels = U_SUCCESS(status) ? ubidi_getLevels(bidi, &status) : NULL;
+    if (U_SUCCESS(status) && (levels || !count)) {
+        value = new TextBidiValue();
+        value->mParaLevel = ubidi_getParaLevel(bidi);
+        value->mLevels.appendArray(levels, count);
+
+        ssize_t rc = ubidi_countRuns(bidi, &status);
+        if (U_SUCCESS(status) && rc > 0) {
+            value->mRuns.setCapacity(rc);
+            for (ssize_t i = 0; i < rc; i++) {
+                TextBidiValue::Run run;
+                run.start = -1;
+                run.length = -1;
+                run.isRTL = ubidi_getVisualRun(bidi, i, &run.start, &run.length) == UBIDI_RTL;
+                if (run.start == -1 || run.length == -1) {
+                    ALOGW("Visual run is not valid");
+                    value->mRuns.clear();
+                    break;
+                }
+                value->mRuns.add(run);
+            }
+        }
+    } else {
+        ALOGW("Cannot set Para");
+    }
+    ubidi_close(bidi);
+    return value;
+}
+
+void TextBidiCache::clear() {
+    Mutex::Autolock _l(mLock);
+    mCache.clear();
+}
+
+TextLayoutShaper::TextLayoutShaper() :
+        mLastHBFaceFontID(0), mLastHBFace(NULL), mShaperItemGlyphArraySize(0) {
     init();
 
     mFontRec.klass = &harfbuzzSkiaClass;
@@ -418,92 +826,71 @@ void TextLayoutShaper::computeValues(const SkPaint* paint, const UChar* chars,
         if (forceLTR || forceRTL) {
             useSingleRun = true;
         } else {
-            UBiDi* bidi = ubidi_open();
-            if (bidi) {
-                UErrorCode status = U_ZERO_ERROR;
 #if DEBUG_GLYPHS
-                ALOGD("******** ComputeValues -- start");
-                ALOGD("      -- string = '%s'", String8(chars + start, count).string());
-                ALOGD("      -- start = %d", start);
-                ALOGD("      -- count = %d", count);
-                ALOGD("      -- contextCount = %d", contextCount);
-                ALOGD("      -- bidiReq = %d", bidiReq);
+            ALOGD("******** ComputeValues -- start");
+            ALOGD("      -- string = '%s'", String8(chars + start, count).string());
+            ALOGD("      -- start = %d", start);
+            ALOGD("      -- count = %d", count);
+            ALOGD("      -- contextCount = %d", contextCount);
+            ALOGD("      -- bidiReq = %d", bidiReq);
 #endif
-                ubidi_setPara(bidi, chars, contextCount, bidiReq, NULL, &status);
-                if (U_SUCCESS(status)) {
-                    int paraDir = ubidi_getParaLevel(bidi) & kDirection_Mask; // 0 if ltr, 1 if rtl
-                    ssize_t rc = ubidi_countRuns(bidi, &status);
+            sp<TextBidiValue> bidi = TextBidiCache::getInstance().getValue(chars,
+                    contextCount, bidiReq);
+            if (bidi != NULL) {
+                int paraDir = bidi->getParaLevel() & kDirection_Mask; // 0 if ltr, 1 if rtl
+                size_t rc = bidi->getRunCount();
 #if DEBUG_GLYPHS
-                    ALOGD("      -- dirFlags = %d", dirFlags);
-                    ALOGD("      -- paraDir = %d", paraDir);
-                    ALOGD("      -- run-count = %d", int(rc));
+                ALOGD("      -- dirFlags = %d", dirFlags);
+                ALOGD("      -- paraDir = %d", paraDir);
+                ALOGD("      -- run-count = %d", int(rc));
 #endif
-                    if (U_SUCCESS(status) && rc == 1) {
-                        // Normal case: one run, status is ok
-                        isRTL = (paraDir == 1);
-                        useSingleRun = true;
-                    } else if (!U_SUCCESS(status) || rc < 1) {
-                        ALOGW("Need to force to single run -- string = '%s',"
-                                " status = %d, rc = %d",
-                                String8(chars + start, count).string(), status, int(rc));
-                        isRTL = (paraDir == 1);
-                        useSingleRun = true;
-                    } else {
-                        int32_t end = start + count;
-                        for (size_t i = 0; i < size_t(rc); ++i) {
-                            int32_t startRun = -1;
-                            int32_t lengthRun = -1;
-                            UBiDiDirection runDir = ubidi_getVisualRun(bidi, i, &startRun, &lengthRun);
-
-                            if (startRun == -1 || lengthRun == -1) {
-                                // Something went wrong when getting the visual run, need to clear
-                                // already computed data before doing a single run pass
-                                ALOGW("Visual run is not valid");
-                                outGlyphs->clear();
-                                outAdvances->clear();
-                                *outTotalAdvance = 0;
-                                isRTL = (paraDir == 1);
-                                useSingleRun = true;
-                                break;
-                            }
-
-                            if (startRun >= end) {
-                                continue;
-                            }
-                            int32_t endRun = startRun + lengthRun;
-                            if (endRun <= int32_t(start)) {
-                                continue;
-                            }
-                            if (startRun < int32_t(start)) {
-                                startRun = int32_t(start);
-                            }
-                            if (endRun > end) {
-                                endRun = end;
-                            }
-
-                            lengthRun = endRun - startRun;
-                            isRTL = (runDir == UBIDI_RTL);
-                            jfloat runTotalAdvance = 0;
+                if (rc == 1) {
+                    // Normal case: one run
+                    isRTL = (paraDir == 1);
+                    useSingleRun = true;
+                } else if (rc < 1) {
+                    ALOGW("Need to force to single run -- string = '%s'",
+                            String8(chars + start, count).string());
+                    isRTL = (paraDir == 1);
+                    useSingleRun = true;
+                } else {
+                    int32_t end = start + count;
+                    for (size_t i = 0; i < rc; ++i) {
+                        const TextBidiValue::Run& run = bidi->getRunAt(i);
+                        int32_t startRun = run.start;
+                        int32_t lengthRun = run.length;
+
+                        if (startRun >= end) {
+                            continue;
+                        }
+                        int32_t endRun = startRun + lengthRun;
+                        if (endRun <= int32_t(start)) {
+                            continue;
+                        }
+                        if (startRun < int32_t(start)) {
+                            startRun = int32_t(start);
+                        }
+                        if (endRun > end) {
+                            endRun = end;
+                        }
+
+                        lengthRun = endRun - startRun;
+                        isRTL = run.isRTL;
+                        jfloat runTotalAdvance = 0;
 #if DEBUG_GLYPHS
-                            ALOGD("Processing Bidi Run = %d -- run-start = %d, run-len = %d, isRTL = %d",
-                                    i, startRun, lengthRun, isRTL);
+                        ALOGD("Processing Bidi Run = %d -- run-start = %d, run-len = %d, isRTL = %d",
+                                i, startRun, lengthRun, isRTL);
 #endif
-                            computeRunValues(paint, chars + startRun, lengthRun, isRTL,
-                                    outAdvances, &runTotalAdvance, outGlyphs);
+                        computeRunValues(paint, chars + startRun, lengthRun, isRTL,
+                                outAdvances, &runTotalAdvance, outGlyphs);
 
-                            *outTotalAdvance += runTotalAdvance;
-                        }
+                        *outTotalAdvance += runTotalAdvance;
                     }
-                } else {
-                    ALOGW("Cannot set Para");
-                    useSingleRun = true;
-                    isRTL = (bidiReq = 1) || (bidiReq = UBIDI_DEFAULT_RTL);
                 }
-                ubidi_close(bidi);
             } else {
-                ALOGW("Cannot ubidi_open()");
+                ALOGW("Cannot compute bidi runs");
                 useSingleRun = true;
-                isRTL = (bidiReq = 1) || (bidiReq = UBIDI_DEFAULT_RTL);
+                isRTL = (bidiReq == 1) || (bidiReq == UBIDI_DEFAULT_RTL);
             }
         }
 
@@ -533,6 +920,39 @@ static void logGlyphs(HB_ShaperItem shaperItem) {
     }
 }
 
+/**
+ * Text made of Latin characters only is a single Common script run, for which Harfbuzz
+ * script itemization can be skipped.
+ */
+static bool isLatinOnly(const UChar* chars, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (chars[i] >= UNICODE_FIRST_NON_LATIN_CHAR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool nextLatinRun(HB_ScriptItem* item, hb_uint32 length, bool* done) {
+    if (*done) {
+        return false;
+    }
+    item->pos = 0;
+    item->length = length;
+    item->script = HB_Script_Common;
+    *done = true;
+    return true;
+}
+
+/**
+ * A word starts after a space, unless it is followed by another space or by a diacritic
+ * that combines with it (which is normalized together with the space).
+ */
+static bool isWordStart(const UChar* chars, size_t index) {
+    return chars[index - 1] == ' ' && chars[index] != ' ' &&
+            ::ublock_getCode(chars[index]) != UBLOCK_COMBINING_DIACRITICAL_MARKS;
+}
+
 void TextLayoutShaper::computeRunValues(const SkPaint* paint, const UChar* chars,
         size_t count, bool isRTL,
         Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
@@ -543,6 +963,76 @@ void TextLayoutShaper::computeRunValues(const SkPaint* paint, const UChar* chars
         return;
     }
 
+    // Split the BiDi run into words (each keeping its trailing spaces) and lay them out
+    // from the word cache, so that editing one word of a paragraph only reshapes that word
+    mWordStarts.clear();
+    mWordStarts.add(0);
+    for (size_t i = 1; i < count; i++) {
+        if (isWordStart(chars, i)) {
+            mWordStarts.add(i);
+        }
+    }
+
+    // Advances are in logical order, glyphs in visual order: like the script runs, the
+    // words of a RTL run are visited from the last one
+    const size_t advancesBase = outAdvances->size();
+    outAdvances->insertAt(0, advancesBase, count);
+    jfloat totalAdvance = 0;
+    const size_t wordCount = mWordStarts.size();
+    for (size_t w = 0; w < wordCount; w++) {
+        size_t index = isRTL ? wordCount - 1 - w : w;
+        size_t wordStart = mWordStarts[index];
+        size_t wordEnd = (index + 1 < wordCount) ? mWordStarts[index + 1] : count;
+
+        sp<TextLayoutValue> word = getWordValue(paint, chars + wordStart,
+                wordEnd - wordStart, isRTL);
+
+        const jfloat* advances = word->getAdvances();
+        for (size_t i = 0; i < word->getAdvancesCount(); i++) {
+            outAdvances->editItemAt(advancesBase + wordStart + i) = advances[i];
+        }
+        totalAdvance += word->getTotalAdvance();
+        if (outGlyphs) {
+            outGlyphs->appendArray(word->getGlyphs(), word->getGlyphsCount());
+        }
+    }
+    *outTotalAdvance = totalAdvance;
+}
+
+sp<TextLayoutValue> TextLayoutShaper::getWordValue(const SkPaint* paint, const UChar* chars,
+        size_t count, bool isRTL) {
+    TextLayoutWordKey key(paint, chars, count, isRTL);
+    bool cacheable = count <= MAX_TEXT_LAYOUT_WORD_LENGTH;
+    sp<TextLayoutValue> value;
+    if (cacheable) {
+        value = mWordCache.get(key);
+        if (value != NULL) {
+#if DEBUG_GLYPHS
+            ALOGD("Word cache hit for '%s'", String8(chars, count).string());
+#endif
+            return value;
+        }
+    }
+
+    value = new TextLayoutValue(count);
+    computeWordValues(paint, chars, count, isRTL,
+            &value->mAdvances, &value->mTotalAdvance, &value->mGlyphs);
+    if (cacheable) {
+        mWordCache.put(key, value);
+    }
+    return value;
+}
+
+void TextLayoutShaper::computeWordValues(const SkPaint* paint, const UChar* chars,
+        size_t count, bool isRTL,
+        Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+        Vector<jchar>* const outGlyphs) {
+    if (!count) {
+        // We cannot shape an empty run.
+        *outTotalAdvance = 0;
+        return;
+    }
+
     // To be filled in later
     for (size_t i = 0; i < count; i++) {
         outAdvances->add(0);
@@ -649,7 +1139,10 @@ void TextLayoutShaper::computeRunValues(const SkPaint* paint, const UChar* chars
     ssize_t indexFontRun = isRTL ? mShaperItem.stringLength - 1 : 0;
     unsigned numCodePoints = 0;
     jfloat totalAdvance = 0;
-    while ((isRTL) ?
+    const bool latinOnly = !isRTL && isLatinOnly(mShaperItem.string, mShaperItem.stringLength);
+    bool latinRunDone = false;
+    while (latinOnly ? nextLatinRun(&mShaperItem.item, mShaperItem.stringLength, &latinRunDone) :
+            (isRTL) ?
             hb_utf16_script_run_prev(&numCodePoints, &mShaperItem.item, mShaperItem.string,
                     mShaperItem.stringLength, &indexFontRun):
             hb_utf16_script_run_next(&numCodePoints, &mShaperItem.item, mShaperItem.string,
@@ -872,6 +1365,7 @@ size_t TextLayoutShaper::shapeFontRun(const SkPaint* paint, bool isRTL) {
     // If we are a "common" script we dont need to shift
     size_t baseGlyphCount = 0;
     SkUnichar firstUnichar = 0;
+    SkTypeface* fallbackTypeface = NULL;
     switch (mShaperItem.item.script) {
     case HB_Script_Arabic:
     case HB_Script_Hebrew:
@@ -885,7 +1379,9 @@ size_t TextLayoutShaper::shapeFontRun(const SkPaint* paint, bool isRTL) {
         while (firstUnichar == ' ' && text16 < text16End) {
             firstUnichar = SkUTF16_NextUnichar(&text16);
         }
-        baseGlyphCount = paint->getBaseGlyphCount(firstUnichar);
+        fallbackTypeface = typefaceForUnichar(paint, typeface, firstUnichar,
+                mShaperItem.item.script);
+        baseGlyphCount = getCachedBaseGlyphCount(paint, fallbackTypeface, firstUnichar);
         break;
     }
     default:
@@ -894,7 +1390,7 @@ size_t TextLayoutShaper::shapeFontRun(const SkPaint* paint, bool isRTL) {
 
     // We test the baseGlyphCount to see if the typeface supports the requested script
     if (baseGlyphCount != 0) {
-        typeface = typefaceForUnichar(paint, typeface, firstUnichar, mShaperItem.item.script);
+        typeface = fallbackTypeface;
     }
 
     if (!typeface) {
@@ -977,26 +1473,56 @@ SkTypeface* TextLayoutShaper::getCachedTypeface(SkTypeface** typeface, const cha
 
 HB_Face TextLayoutShaper::getCachedHBFace(SkTypeface* typeface) {
     SkFontID fontId = typeface->uniqueID();
+    if (mLastHBFace && fontId == mLastHBFaceFontID) {
+        return mLastHBFace;
+    }
+    HB_Face face;
     ssize_t index = mCachedHBFaces.indexOfKey(fontId);
     if (index >= 0) {
-        return mCachedHBFaces.valueAt(index);
-    }
-    HB_Face face = HB_NewFace(typeface, harfbuzzSkiaGetTable);
-    if (face) {
+        face = mCachedHBFaces.valueAt(index);
+    } else {
+        face = HB_NewFace(typeface, harfbuzzSkiaGetTable);
+        if (face) {
 #if DEBUG_GLYPHS
-        ALOGD("Created HB_NewFace %p from paint typeface = %p", face, typeface);
+            ALOGD("Created HB_NewFace %p from paint typeface = %p", face, typeface);
 #endif
-        mCachedHBFaces.add(fontId, face);
+            mCachedHBFaces.add(fontId, face);
+        }
     }
+    mLastHBFaceFontID = fontId;
+    mLastHBFace = face;
     return face;
 }
 
+/**
+ * Finding the base glyph count walks the fallback fonts; the characters of a run share the
+ * fallback typeface of its script, so this is done once per paint and fallback typeface.
+ */
+size_t TextLayoutShaper::getCachedBaseGlyphCount(const SkPaint* paint,
+        SkTypeface* fallbackTypeface, SkUnichar unichar) {
+    if (!fallbackTypeface) {
+        return paint->getBaseGlyphCount(unichar);
+    }
+    uint64_t key = (uint64_t(SkTypeface::UniqueID(paint->getTypeface())) << 32) |
+            SkTypeface::UniqueID(fallbackTypeface);
+    ssize_t index = mCachedBaseGlyphCounts.indexOfKey(key);
+    if (index >= 0) {
+        return mCachedBaseGlyphCounts.valueAt(index);
+    }
+    size_t baseGlyphCount = paint->getBaseGlyphCount(unichar);
+    mCachedBaseGlyphCounts.add(key, baseGlyphCount);
+    return baseGlyphCount;
+}
+
 void TextLayoutShaper::purgeCaches() {
     size_t cacheSize = mCachedHBFaces.size();
     for (size_t i = 0; i < cacheSize; i++) {
         HB_FreeFace(mCachedHBFaces.valueAt(i));
     }
     mCachedHBFaces.clear();
+    mLastHBFace = NULL;
+    mCachedBaseGlyphCounts.clear();
+    mWordCache.clear();
     unrefTypefaces();
     init();
 }
@@ -1011,6 +1537,17 @@ TextLayoutEngine::TextLayoutEngine() {
 }
 
 TextLayoutEngine::~TextLayoutEngine() {
+    if (mPrefetchThread != NULL) {
+        {
+            Mutex::Autolock _l(mPrefetchLock);
+            mPrefetchThread->requestExit();
+            mPrefetchCondition.broadcast();
+        }
+        mPrefetchThread->requestExitAndWait();
+        mPrefetchThread.clear();
+    }
+    clearPrefetchRequests();
+
     delete mTextLayoutCache;
     delete mShaper;
 }
@@ -1033,10 +1570,73 @@ sp<TextLayoutValue> TextLayoutEngine::getValue(const SkPaint* paint, const jchar
     return value;
 }
 
+void TextLayoutEngine::prefetchValue(const SkPaint* paint, const jchar* text,
+        jint start, jint count, jint contextCount, jint dirFlags) {
+#if USE_TEXT_LAYOUT_CACHE
+    Mutex::Autolock _l(mPrefetchLock);
+    if (mPrefetchRequests.size() >= MAX_TEXT_LAYOUT_PREFETCH_REQUESTS) {
+        return;
+    }
+
+    PrefetchRequest* request = new PrefetchRequest;
+    request->paint = *paint;
+    request->text.appendArray(text, contextCount);
+    request->start = start;
+    request->count = count;
+    request->dirFlags = dirFlags;
+    mPrefetchRequests.add(request);
+
+    if (mPrefetchThread == NULL) {
+        mPrefetchThread = new PrefetchThread(this);
+        mPrefetchThread->run("TextLayoutPrefetch", PRIORITY_BACKGROUND);
+    }
+    mPrefetchCondition.signal();
+#endif
+}
+
+bool TextLayoutEngine::PrefetchThread::threadLoop() {
+    return mEngine->prefetchNext();
+}
+
+bool TextLayoutEngine::prefetchNext() {
+    PrefetchRequest* request = NULL;
+
+    {
+        Mutex::Autolock _l(mPrefetchLock);
+        while (mPrefetchRequests.isEmpty()) {
+            if (mPrefetchThread->exitPending()) {
+                return false;
+            }
+            mPrefetchCondition.wait(mPrefetchLock);
+        }
+        if (mPrefetchThread->exitPending()) {
+            return false;
+        }
+        request = mPrefetchRequests[0];
+        mPrefetchRequests.removeAt(0);
+    }
+
+    // The cache does the locking, the value is only wanted for its side effect
+    mTextLayoutCache->getValue(&request->paint, request->text.array(), request->start,
+            request->count, request->text.size(), request->dirFlags);
+    delete request;
+    return true;
+}
+
+void TextLayoutEngine::clearPrefetchRequests() {
+    Mutex::Autolock _l(mPrefetchLock);
+    for (size_t i = 0; i < mPrefetchRequests.size(); i++) {
+        delete mPrefetchRequests[i];
+    }
+    mPrefetchRequests.clear();
+}
+
 void TextLayoutEngine::purgeCaches() {
 #if USE_TEXT_LAYOUT_CACHE
+    clearPrefetchRequests();
     mTextLayoutCache->clear();
-    mShaper->purgeCaches();
+    mTextLayoutCache->purgeShaperCaches();
+    TextBidiCache::getInstance().clear();
 #if DEBUG_GLYPHS
     ALOGD("Purged TextLayoutEngine caches");
 #endif
@@ -48,6 +48,7 @@
 #define UNICODE_FIRST_HIGH_SURROGATE    0xd800
 #define UNICODE_FIRST_PRIVATE_USE       0xe000
 #define UNICODE_FIRST_RTL_CHAR          0x0590
+#define UNICODE_FIRST_NON_LATIN_CHAR    0x0250
 
 // Temporary buffer size
 #define CHAR_BUFFER_SIZE 80
@@ -56,7 +57,28 @@
 #define MB(s) s * 1024 * 1024
 
 // Define the default cache size in Mb
-#define DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB 0.250f
+#define DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB 0.500f
+
+// Define the size in Mb up to which the cache grows while it is getting hits
+#define MAX_TEXT_LAYOUT_CACHE_SIZE_IN_MB 2.0f
+
+// Define the number of independently locked parts of the cache
+#define TEXT_LAYOUT_CACHE_STRIPE_COUNT 4
+
+// Define the size of the word cache of the shaper in Mb
+#define DEFAULT_TEXT_LAYOUT_WORD_CACHE_SIZE_IN_MB 0.125f
+
+// Words longer than this (in UTF-16 units) are shaped but not kept in the word cache
+#define MAX_TEXT_LAYOUT_WORD_LENGTH 48
+
+// Define the size of the bidi cache in Mb
+#define DEFAULT_TEXT_BIDI_CACHE_SIZE_IN_MB 0.0625f
+
+// Paragraphs longer than this (in UTF-16 units) are analyzed but not kept in the bidi cache
+#define MAX_TEXT_BIDI_CACHE_TEXT_LENGTH 2048
+
+// Define the maximum number of text runs waiting to be prefetched
+#define MAX_TEXT_LAYOUT_PREFETCH_REQUESTS 32
 
 // Define the interval in number of cache hits between two statistics dump
 #define DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL 100
@@ -86,11 +108,17 @@ public:
      */
     size_t getSize() const;
 
+    /**
+     * Hash of the text and of all the other fields, computed once by the constructor.
+     */
+    inline uint32_t getHash() const { return hash; }
+
     static int compare(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs);
 
 private:
     const UChar* text; // if text is NULL, use textCopy
     String16 textCopy;
+    uint32_t hash;
     size_t start;
     size_t count;
     size_t contextCount;
@@ -158,6 +186,197 @@ private:
 
 }; // TextLayoutCacheValue
 
+/**
+ * TextLayoutWordKey is the key of the word cache: one word of a run and the paint
+ * attributes it is shaped with
+ */
+class TextLayoutWordKey {
+public:
+    TextLayoutWordKey();
+
+    TextLayoutWordKey(const SkPaint* paint, const UChar* text, size_t count, bool isRTL);
+
+    TextLayoutWordKey(const TextLayoutWordKey& other);
+
+    /**
+     * As for TextLayoutCacheKey, the text is only copied when the key goes into the cache.
+     */
+    void internalTextCopy();
+
+    size_t getSize() const;
+
+    static int compare(const TextLayoutWordKey& lhs, const TextLayoutWordKey& rhs);
+
+private:
+    const UChar* text; // if text is NULL, use textCopy
+    String16 textCopy;
+    size_t count;
+    bool isRTL;
+    SkTypeface* typeface;
+    SkScalar textSize;
+    SkScalar textSkewX;
+    SkScalar textScaleX;
+    uint32_t flags;
+    SkPaint::Hinting hinting;
+
+    inline const UChar* getText() const { return text ? text : textCopy.string(); }
+
+}; // TextLayoutWordKey
+
+inline int strictly_order_type(const TextLayoutWordKey& lhs, const TextLayoutWordKey& rhs) {
+    return TextLayoutWordKey::compare(lhs, rhs) < 0;
+}
+
+inline int compare_type(const TextLayoutWordKey& lhs, const TextLayoutWordKey& rhs) {
+    return TextLayoutWordKey::compare(lhs, rhs);
+}
+
+/**
+ * Cache of shaped words, so that a run whose words have been seen before (in this or
+ * in another text) is laid out without calling Harfbuzz.
+ */
+class TextLayoutWordCache : private OnEntryRemoved<TextLayoutWordKey, sp<TextLayoutValue> >
+{
+public:
+    TextLayoutWordCache();
+
+    ~TextLayoutWordCache();
+
+    /**
+     * Used as a callback when an entry is removed from the cache
+     * Do not invoke directly
+     */
+    void operator()(TextLayoutWordKey& key, sp<TextLayoutValue>& value);
+
+    sp<TextLayoutValue> get(const TextLayoutWordKey& key);
+
+    /**
+     * Adds a word, evicting the least recently used ones if needed. The key text is copied.
+     */
+    void put(TextLayoutWordKey& key, const sp<TextLayoutValue>& value);
+
+    void clear();
+
+private:
+    GenerationCache<TextLayoutWordKey, sp<TextLayoutValue> > mCache;
+
+    uint32_t mSize;
+    uint32_t mMaxSize;
+
+}; // TextLayoutWordCache
+
+/**
+ * TextBidiKey is the key of the bidi cache: a paragraph and its requested level
+ */
+class TextBidiKey {
+public:
+    TextBidiKey();
+
+    TextBidiKey(const UChar* text, size_t count, UBiDiLevel paraLevel);
+
+    TextBidiKey(const TextBidiKey& other);
+
+    /**
+     * As for TextLayoutCacheKey, the text is only copied when the key goes into the cache.
+     */
+    void internalTextCopy();
+
+    size_t getSize() const;
+
+    static int compare(const TextBidiKey& lhs, const TextBidiKey& rhs);
+
+private:
+    const UChar* text; // if text is NULL, use textCopy
+    String16 textCopy;
+    uint32_t hash;
+    size_t count;
+    UBiDiLevel paraLevel;
+
+    inline const UChar* getText() const { return text ? text : textCopy.string(); }
+
+}; // TextBidiKey
+
+inline int strictly_order_type(const TextBidiKey& lhs, const TextBidiKey& rhs) {
+    return TextBidiKey::compare(lhs, rhs) < 0;
+}
+
+inline int compare_type(const TextBidiKey& lhs, const TextBidiKey& rhs) {
+    return TextBidiKey::compare(lhs, rhs);
+}
+
+/**
+ * Result of the bidi analysis of a paragraph: the resolved paragraph level, the level
+ * of each character and the visual runs.
+ */
+class TextBidiValue : public RefBase {
+public:
+    struct Run {
+        int32_t start;
+        int32_t length;
+        bool isRTL;
+    };
+
+    TextBidiValue(): mParaLevel(0) { }
+
+    inline UBiDiLevel getParaLevel() const { return mParaLevel; }
+    inline const UBiDiLevel* getLevels() const { return mLevels.array(); }
+
+    /**
+     * Visual runs, in visual order. Empty if ICU could not compute them, in which case
+     * the paragraph should be laid out as a single run.
+     */
+    inline size_t getRunCount() const { return mRuns.size(); }
+    inline const Run& getRunAt(size_t index) const { return mRuns.itemAt(index); }
+
+    size_t getSize() const;
+
+private:
+    UBiDiLevel mParaLevel;
+    Vector<UBiDiLevel> mLevels;
+    Vector<Run> mRuns;
+
+    friend class TextBidiCache;
+
+}; // TextBidiValue
+
+/**
+ * Cache of bidi analyses, shared by AndroidBidi and the TextLayoutShaper, as text layout
+ * asks for the same paragraphs again and again. Paragraphs without any right-to-left
+ * character laid out left-to-right are resolved without ICU and are not cached.
+ */
+class TextBidiCache : public Singleton<TextBidiCache>,
+        private OnEntryRemoved<TextBidiKey, sp<TextBidiValue> > {
+public:
+    TextBidiCache();
+
+    ~TextBidiCache();
+
+    /**
+     * Used as a callback when an entry is removed from the cache
+     * Do not invoke directly
+     */
+    void operator()(TextBidiKey& key, sp<TextBidiValue>& value);
+
+    /**
+     * Returns the analysis of the given paragraph with the given requested level (0, 1,
+     * UBIDI_DEFAULT_LTR or UBIDI_DEFAULT_RTL), or NULL if ICU failed.
+     */
+    sp<TextBidiValue> getValue(const UChar* text, size_t count, UBiDiLevel paraLevel);
+
+    void clear();
+
+private:
+    Mutex mLock;
+    GenerationCache<TextBidiKey, sp<TextBidiValue> > mCache;
+
+    uint32_t mSize;
+    uint32_t mMaxSize;
+
+    static sp<TextBidiValue> computeValue(const UChar* text, size_t count,
+            UBiDiLevel paraLevel);
+
+}; // TextBidiCache
+
 /**
  * The TextLayoutShaper is responsible for shaping (with the Harfbuzz library)
  */
@@ -205,6 +424,17 @@ private:
      */
     KeyedVector<SkFontID, HB_Face> mCachedHBFaces;
 
+    /**
+     * Last Harfbuzz face returned, as consecutive runs mostly use the same font
+     */
+    SkFontID mLastHBFaceFontID;
+    HB_Face mLastHBFace;
+
+    /**
+     * Cache of the base glyph counts of fallback fonts, by paint and fallback typeface
+     */
+    KeyedVector<uint64_t, size_t> mCachedBaseGlyphCounts;
+
     /**
      * Cache of glyph array size
      */
@@ -220,6 +450,16 @@ private:
      */
     UnicodeString mBuffer;
 
+    /**
+     * Cache of the words shaped so far
+     */
+    TextLayoutWordCache mWordCache;
+
+    /**
+     * Start of each word of the run being laid out
+     */
+    Vector<size_t> mWordStarts;
+
     void init();
     void unrefTypefaces();
 
@@ -238,8 +478,18 @@ private:
             Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
             Vector<jchar>* const outGlyphs);
 
+    sp<TextLayoutValue> getWordValue(const SkPaint* paint, const UChar* chars,
+            size_t count, bool isRTL);
+
+    void computeWordValues(const SkPaint* paint, const UChar* chars,
+            size_t count, bool isRTL,
+            Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+            Vector<jchar>* const outGlyphs);
+
     SkTypeface* getCachedTypeface(SkTypeface** typeface, const char path[]);
     HB_Face getCachedHBFace(SkTypeface* typeface);
+    size_t getCachedBaseGlyphCount(const SkPaint* paint, SkTypeface* fallbackTypeface,
+            SkUnichar unichar);
 
     void ensureShaperItemGlyphArrays(size_t size);
     void createShaperItemGlyphArrays(size_t size);
@@ -249,9 +499,12 @@ private:
 
 /**
  * Cache of text layout information.
+ *
+ * Entries are spread by key hash over TEXT_LAYOUT_CACHE_STRIPE_COUNT stripes, each with
+ * its own lock, so that threads measuring different texts do not wait on each other for
+ * cache hits. Shaping a missing entry is serialized, as the shaper is not thread safe.
  */
-class TextLayoutCache : private OnEntryRemoved<TextLayoutCacheKey, sp<TextLayoutValue> >
-{
+class TextLayoutCache {
 public:
     TextLayoutCache(TextLayoutShaper* shaper);
 
@@ -261,30 +514,61 @@ public:
         return mInitialized;
     }
 
-    /**
-     * Used as a callback when an entry is removed from the cache
-     * Do not invoke directly
-     */
-    void operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc);
-
     sp<TextLayoutValue> getValue(const SkPaint* paint, const jchar* text, jint start,
             jint count, jint contextCount, jint dirFlags);
 
     /**
-     * Clear the cache
+     * Clear the cache and shrink it back to its default size
      */
     void clear();
 
+    /**
+     * Purge the shaper's caches, waiting for any text being shaped
+     */
+    void purgeShaperCaches();
+
 private:
+    /**
+     * One independently locked part of the cache
+     */
+    class Stripe : private OnEntryRemoved<TextLayoutCacheKey, sp<TextLayoutValue> > {
+    public:
+        Stripe();
+
+        ~Stripe();
+
+        /**
+         * Used as a callback when an entry is removed from the cache
+         * Do not invoke directly
+         */
+        void operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc);
+
+        /**
+         * Evict entries until one of the given size fits, first growing the stripe if it
+         * has been useful since it last grew. Must be called with mLock held.
+         */
+        void makeRoom(size_t size, bool debugEnabled);
+
+        Mutex mLock;
+        GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> > mCache;
+
+        uint32_t mSize;
+        uint32_t mMaxSize;
+
+        /**
+         * Lookups since the stripe was last resized
+         */
+        uint32_t mHits;
+        uint32_t mMisses;
+    };
+
     TextLayoutShaper* mShaper;
-    Mutex mLock;
+    Mutex mShaperLock;
     bool mInitialized;
 
-    GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> > mCache;
-
-    uint32_t mSize;
-    uint32_t mMaxSize;
+    Stripe mStripes[TEXT_LAYOUT_CACHE_STRIPE_COUNT];
 
+    Mutex mStatsLock;
     uint32_t mCacheHitCount;
     uint64_t mNanosecondsSaved;
 
@@ -316,11 +600,48 @@ public:
     sp<TextLayoutValue> getValue(const SkPaint* paint, const jchar* text, jint start,
             jint count, jint contextCount, jint dirFlags);
 
+    /**
+     * Queues a text run to be shaped on a background thread, so that a later getValue()
+     * with the same arguments is a cache hit. The paint and the text are copied, and the
+     * request is dropped if too many are already waiting.
+     */
+    void prefetchValue(const SkPaint* paint, const jchar* text, jint start,
+            jint count, jint contextCount, jint dirFlags);
+
     void purgeCaches();
 
 private:
+    struct PrefetchRequest {
+        SkPaint paint;
+        Vector<jchar> text;
+        jint start;
+        jint count;
+        jint dirFlags;
+    };
+
+    /**
+     * Shapes the text runs queued by prefetchValue().
+     */
+    class PrefetchThread: public Thread {
+    public:
+        PrefetchThread(TextLayoutEngine* engine): Thread(false), mEngine(engine) { }
+
+    private:
+        virtual bool threadLoop();
+
+        TextLayoutEngine* mEngine;
+    }; // class PrefetchThread
+
     TextLayoutCache* mTextLayoutCache;
     TextLayoutShaper* mShaper;
+
+    Vector<PrefetchRequest*> mPrefetchRequests;
+    sp<PrefetchThread> mPrefetchThread;
+    Mutex mPrefetchLock;
+    Condition mPrefetchCondition;
+
+    bool prefetchNext();
+    void clearPrefetchRequests();
 }; // TextLayoutEngine
 
 } // namespace android
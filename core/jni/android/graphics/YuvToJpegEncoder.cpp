@@ -6,6 +6,10 @@
 
 #include <jni.h>
 
+#ifdef __ARM_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
     // for now.
@@ -116,7 +120,18 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
     for (int row = 0; row < 8; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
         uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
+        int i = 0;
+#ifdef __ARM_HAVE_NEON
+        // 16 VU pairs at a time
+        for (; i + 16 <= (width >> 1); i += 16) {
+            int index = row * (width >> 1) + i;
+            uint8x16x2_t pairs = vld2q_u8(vu);
+            vst1q_u8(uRows + index, pairs.val[1]);
+            vst1q_u8(vRows + index, pairs.val[0]);
+            vu += 32;
+        }
+#endif
+        for (; i < (width >> 1); ++i) {
             int index = row * (width >> 1) + i;
             uRows[index] = vu[1];
             vRows[index] = vu[0];
@@ -187,7 +202,23 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
         uint8_t* vRows, int rowIndex, int width, int height) {
     for (int row = 0; row < 16; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
+        int i = 0;
+#ifdef __ARM_HAVE_NEON
+        // 8 YUYV groups, 16 pixels, at a time
+        for (; i + 8 <= (width >> 1); i += 8) {
+            int indexY = row * width + (i << 1);
+            int indexU = row * (width >> 1) + i;
+            uint8x8x4_t yuyv = vld4_u8(yuvSeg);
+            uint8x8x2_t ys;
+            ys.val[0] = yuyv.val[0];
+            ys.val[1] = yuyv.val[2];
+            vst2_u8(yRows + indexY, ys);
+            vst1_u8(uRows + indexU, yuyv.val[1]);
+            vst1_u8(vRows + indexU, yuyv.val[3]);
+            yuvSeg += 32;
+        }
+#endif
+        for (; i < (width >> 1); ++i) {
             int indexY = row * width + (i << 1);
             int indexU = row * (width >> 1) + i;
             yRows[indexY] = yuvSeg[0];
@@ -24,6 +24,10 @@
 #include <assert.h>
 #include <dlfcn.h>
 
+#if defined(__ARM_HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <GLES/gl.h>
 #include <ETC1/etc1.h>
 
@@ -42,10 +46,18 @@ namespace android {
 
 static inline
 void mx4transform(float x, float y, float z, float w, const float* pM, float* pDest) {
+#if defined(__ARM_HAVE_NEON)
+    float32x4_t r = vmulq_n_f32(vld1q_f32(pM), x);
+    r = vmlaq_n_f32(r, vld1q_f32(pM + 4), y);
+    r = vmlaq_n_f32(r, vld1q_f32(pM + 8), z);
+    r = vmlaq_n_f32(r, vld1q_f32(pM + 12), w);
+    vst1q_f32(pDest, r);
+#else
     pDest[0] = pM[0 + 4 * 0] * x + pM[0 + 4 * 1] * y + pM[0 + 4 * 2] * z + pM[0 + 4 * 3] * w;
     pDest[1] = pM[1 + 4 * 0] * x + pM[1 + 4 * 1] * y + pM[1 + 4 * 2] * z + pM[1 + 4 * 3] * w;
     pDest[2] = pM[2 + 4 * 0] * x + pM[2 + 4 * 1] * y + pM[2 + 4 * 2] * z + pM[2 + 4 * 3] * w;
     pDest[3] = pM[3 + 4 * 0] * x + pM[3 + 4 * 1] * y + pM[3 + 4 * 2] * z + pM[3 + 4 * 3] * w;
+#endif
 }
 
 class MallocHelper {
@@ -261,7 +273,39 @@ void util_computeBoundingSphere(JNIEnv *env, jclass clazz,
     float z0 = *pSrc++;
     float z1 = z0;
 
-    for(int i = 1; i < positionsCount; i++) {
+    int i = 1;
+#if defined(__ARM_HAVE_NEON)
+    // Four points at a time, deinterleaved into x, y and z lanes.
+    if (positionsCount - i >= 4) {
+        float32x4_t minX = vdupq_n_f32(x0), maxX = minX;
+        float32x4_t minY = vdupq_n_f32(y0), maxY = minY;
+        float32x4_t minZ = vdupq_n_f32(z0), maxZ = minZ;
+        for (; positionsCount - i >= 4; i += 4, pSrc += 12) {
+            float32x4x3_t p = vld3q_f32(pSrc);
+            minX = vminq_f32(minX, p.val[0]);
+            maxX = vmaxq_f32(maxX, p.val[0]);
+            minY = vminq_f32(minY, p.val[1]);
+            maxY = vmaxq_f32(maxY, p.val[1]);
+            minZ = vminq_f32(minZ, p.val[2]);
+            maxZ = vmaxq_f32(maxZ, p.val[2]);
+        }
+        float32x2_t t;
+        t = vpmin_f32(vget_low_f32(minX), vget_high_f32(minX));
+        x0 = vget_lane_f32(vpmin_f32(t, t), 0);
+        t = vpmax_f32(vget_low_f32(maxX), vget_high_f32(maxX));
+        x1 = vget_lane_f32(vpmax_f32(t, t), 0);
+        t = vpmin_f32(vget_low_f32(minY), vget_high_f32(minY));
+        y0 = vget_lane_f32(vpmin_f32(t, t), 0);
+        t = vpmax_f32(vget_low_f32(maxY), vget_high_f32(maxY));
+        y1 = vget_lane_f32(vpmax_f32(t, t), 0);
+        t = vpmin_f32(vget_low_f32(minZ), vget_high_f32(minZ));
+        z0 = vget_lane_f32(vpmin_f32(t, t), 0);
+        t = vpmax_f32(vget_low_f32(maxZ), vget_high_f32(maxZ));
+        z1 = vget_lane_f32(vpmax_f32(t, t), 0);
+    }
+#endif
+
+    for(; i < positionsCount; i++) {
         {
             float x = *pSrc++;
             if (x < x0) {
@@ -335,6 +379,50 @@ static bool sphereHitsFrustum(const float* pFrustum, const float* pSphere) {
     return true;
 }
 
+// Writes the indices of the spheres that hit the frustum to pResults, up
+// to resultsCapacity of them, and returns how many hit in total.
+
+static int cullSpheres(const float* pFrustum, const float* pSphere, int spheresCount,
+        int* pResults, int resultsCapacity) {
+    int outputCount = 0;
+    int i = 0;
+#if defined(__ARM_HAVE_NEON)
+    // Four spheres per iteration, deinterleaved into x, y, z and radius
+    // lanes and tested against all six planes at once.
+    for (; spheresCount - i >= 4; i += 4, pSphere += 16) {
+        float32x4x4_t s = vld4q_f32(pSphere);
+        float32x4_t negRadius = vnegq_f32(s.val[3]);
+        uint32x4_t hit = vdupq_n_u32(~0u);
+        const float* pPlane = pFrustum;
+        for (int p = 0; p < 6; p++, pPlane += 4) {
+            float32x4_t d = vmlaq_n_f32(vdupq_n_f32(pPlane[3]), s.val[0], pPlane[0]);
+            d = vmlaq_n_f32(d, s.val[1], pPlane[1]);
+            d = vmlaq_n_f32(d, s.val[2], pPlane[2]);
+            hit = vandq_u32(hit, vcgtq_f32(d, negRadius));
+        }
+        uint32_t lanes[4];
+        vst1q_u32(lanes, hit);
+        for (int j = 0; j < 4; j++) {
+            if (lanes[j]) {
+                if (outputCount < resultsCapacity) {
+                    *pResults++ = i + j;
+                }
+                outputCount++;
+            }
+        }
+    }
+#endif
+    for (; i < spheresCount; i++, pSphere += 4) {
+        if (sphereHitsFrustum(pFrustum, pSphere)) {
+            if (outputCount < resultsCapacity) {
+                *pResults++ = i;
+            }
+            outputCount++;
+        }
+    }
+    return outputCount;
+}
+
 static void computeFrustum(const float* m, float* f) {
     float m3 = m[3];
     float m7 = m[7];
@@ -395,8 +483,6 @@ int util_frustumCullSpheres(JNIEnv *env, jclass clazz,
         jintArray results_ref, jint resultsOffset, jint resultsCapacity) {
     float frustum[6*4];
     int outputCount;
-    int* pResults;
-    float* pSphere;
     FloatArrayHelper mvp(env, mvp_ref, mvpOffset, 16);
     FloatArrayHelper spheres(env, spheres_ref, spheresOffset, spheresCount * 4);
     IntArrayHelper results(env, results_ref, resultsOffset, resultsCapacity);
@@ -414,17 +500,8 @@ int util_frustumCullSpheres(JNIEnv *env, jclass clazz,
 
     // Cull the spheres
 
-    pSphere = spheres.mData;
-    pResults = results.mData;
-    outputCount = 0;
-    for(int i = 0; i < spheresCount; i++, pSphere += 4) {
-        if (sphereHitsFrustum(frustum, pSphere)) {
-            if (outputCount < resultsCapacity) {
-                *pResults++ = i;
-            }
-            outputCount++;
-        }
-    }
+    outputCount = cullSpheres(frustum, spheres.mData, spheresCount,
+            results.mData, resultsCapacity);
     results.commitChanges();
     return outputCount;
 }
@@ -470,6 +547,26 @@ int util_visibilityTest(JNIEnv *env, jclass clazz,
 static
 void multiplyMM(float* r, const float* lhs, const float* rhs)
 {
+#if defined(__ARM_HAVE_NEON)
+    // Each result column is the lhs columns weighted by one rhs column.
+    // Both inputs are fully loaded before anything is stored.
+    float32x4_t l0 = vld1q_f32(lhs);
+    float32x4_t l1 = vld1q_f32(lhs + 4);
+    float32x4_t l2 = vld1q_f32(lhs + 8);
+    float32x4_t l3 = vld1q_f32(lhs + 12);
+    float32x4_t c[4];
+    for (int i=0 ; i<4 ; i++) {
+        float32x4_t rc = vld1q_f32(rhs + 4 * i);
+        float32x4_t ri = vmulq_lane_f32(l0, vget_low_f32(rc), 0);
+        ri = vmlaq_lane_f32(ri, l1, vget_low_f32(rc), 1);
+        ri = vmlaq_lane_f32(ri, l2, vget_high_f32(rc), 0);
+        c[i] = vmlaq_lane_f32(ri, l3, vget_high_f32(rc), 1);
+    }
+    vst1q_f32(r, c[0]);
+    vst1q_f32(r + 4, c[1]);
+    vst1q_f32(r + 8, c[2]);
+    vst1q_f32(r + 12, c[3]);
+#else
     for (int i=0 ; i<4 ; i++) {
         register const float rhs_i0 = rhs[ I(i,0) ];
         register float ri0 = lhs[ I(0,0) ] * rhs_i0;
@@ -488,6 +585,7 @@ void multiplyMM(float* r, const float* lhs, const float* rhs)
         r[ I(i,2) ] = ri2;
         r[ I(i,3) ] = ri3;
     }
+#endif
 }
 
 static
@@ -515,6 +613,52 @@ void util_multiplyMM(JNIEnv *env, jclass clazz,
     resultMat.commitChanges();
 }
 
+/*
+ public static native void multiplyMMBatch(float[] result, int resultOffset,
+ float[] lhs, int lhsOffset, float[] rhs, int rhsOffset, int count,
+ boolean sharedLhs);
+
+ Multiplies count pairs of matrices laid out back to back. When sharedLhs
+ is set, the single lhs matrix is applied to every rhs matrix.
+ */
+
+static
+void util_multiplyMMBatch(JNIEnv *env, jclass clazz,
+    jfloatArray result_ref, jint resultOffset,
+    jfloatArray lhs_ref, jint lhsOffset,
+    jfloatArray rhs_ref, jint rhsOffset,
+    jint count, jboolean sharedLhs) {
+
+    if (count < 0 || count > 0x7fffffff / 16) {
+        doThrowIAE(env, "count out of range");
+        return;
+    }
+
+    FloatArrayHelper resultMat(env, result_ref, resultOffset, 16 * count);
+    FloatArrayHelper lhs(env, lhs_ref, lhsOffset, sharedLhs ? 16 : 16 * count);
+    FloatArrayHelper rhs(env, rhs_ref, rhsOffset, 16 * count);
+
+    bool checkOK = resultMat.check() && lhs.check() && rhs.check();
+
+    if ( !checkOK ) {
+        return;
+    }
+
+    resultMat.bind();
+    lhs.bind();
+    rhs.bind();
+
+    const int lhsStride = sharedLhs ? 0 : 16;
+    float* pResult = resultMat.mData;
+    const float* pLhs = lhs.mData;
+    const float* pRhs = rhs.mData;
+    for (int i = 0; i < count; i++, pResult += 16, pLhs += lhsStride, pRhs += 16) {
+        multiplyMM(pResult, pLhs, pRhs);
+    }
+
+    resultMat.commitChanges();
+}
+
 static
 void multiplyMV(float* r, const float* lhs, const float* rhs)
 {
@@ -1020,6 +1164,11 @@ static JNINativeMethod gMatrixMethods[] = {
     { "multiplyMV", "([FI[FI[FI)V", (void*)util_multiplyMV },
 };
 
+// Only registered if android.opengl.Matrix declares them
+static JNINativeMethod gMatrixOptionalMethods[] = {
+    { "multiplyMMBatch", "([FI[FI[FIIZ)V", (void*)util_multiplyMMBatch },
+};
+
 static JNINativeMethod gVisibilityMethods[] = {
     { "computeBoundingSphere", "([FII[FI)V", (void*)util_computeBoundingSphere },
     { "frustumCullSpheres", "([FI[FII[III)I", (void*)util_frustumCullSpheres },
@@ -1073,6 +1222,10 @@ int register_android_opengl_classes(JNIEnv* env)
             break;
         }
     }
+    if (result >= 0) {
+        AndroidRuntime::registerOptionalNativeMethods(env, "android/opengl/Matrix",
+                gMatrixOptionalMethods, NELEM(gMatrixOptionalMethods));
+    }
     return result;
 }
 
@@ -17,17 +17,26 @@
 #define LOG_TAG "FullBackup_native"
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include "JNIHelp.h"
 #include <android_runtime/AndroidRuntime.h>
 
 #include <androidfw/BackupHelpers.h>
 
+#include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace android
 {
 
+// Number of upcoming files whose reads are started while a file is streamed
+#define PREFETCH_DEPTH 4
+// Only files up to this size are prefetched; large files stream sequentially
+#define PREFETCH_MAX_FILE_SIZE (256 * 1024)
+
 // android.app.backup.BackupDataOutput
 static struct {
     // This is actually a native pointer to the underlying BackupDataWriter instance
@@ -110,12 +119,106 @@ static int backupToTar(JNIEnv* env, jobject clazz, jstring packageNameObj,
     return write_tarfile(packageName, domain, rootpath, path, writer);
 }
 
+/*
+ * Asks the kernel to start reading a small file in the background, so that the
+ * reads of several small files overlap with streaming the current one.
+ */
+static void prefetchFile(const String8& path) {
+#ifdef POSIX_FADV_WILLNEED
+    struct stat s;
+    if (lstat(path.string(), &s) != 0 || !S_ISREG(s.st_mode)
+            || s.st_size > PREFETCH_MAX_FILE_SIZE) {
+        return;
+    }
+    int fd = open(path.string(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#endif
+}
+
+static String8 getStringElement(JNIEnv* env, jobjectArray array, jsize index) {
+    jstring str = (jstring) env->GetObjectArrayElement(array, index);
+    const char* chars = (str) ? env->GetStringUTFChars(str, NULL) : NULL;
+    String8 result(chars ? chars : "");
+    if (chars) env->ReleaseStringUTFChars(str, chars);
+    env->DeleteLocalRef(str);
+    return result;
+}
+
+/*
+ * Writes several files of one domain to the given output, in order, with the
+ * same semantics as backupToTar() for each of them.  Returns the first error
+ * encountered; the files after it are not written.
+ */
+static int backupFilesToTar(JNIEnv* env, jobject clazz, jstring packageNameObj,
+        jstring domainObj, jstring linkdomain,
+        jstring rootpathObj, jobjectArray pathsObj, jobject dataOutputObj) {
+    BackupDataWriter* writer = (BackupDataWriter*) env->GetIntField(dataOutputObj,
+            sBackupDataOutput.mBackupWriter);
+    if (!writer) {
+        ALOGE("No output stream provided");
+        return -1;
+    }
+    if (!pathsObj) {
+        return 0;
+    }
+
+    const char* packagenamechars = (packageNameObj) ? env->GetStringUTFChars(packageNameObj, NULL) : NULL;
+    const char* rootchars = (rootpathObj) ? env->GetStringUTFChars(rootpathObj, NULL) : NULL;
+    const char* domainchars = (domainObj) ? env->GetStringUTFChars(domainObj, NULL) : NULL;
+
+    String8 packageName(packagenamechars ? packagenamechars : "");
+    String8 rootpath(rootchars ? rootchars : "");
+    String8 domain(domainchars ? domainchars : "");
+
+    if (domainchars) env->ReleaseStringUTFChars(domainObj, domainchars);
+    if (rootchars) env->ReleaseStringUTFChars(rootpathObj, rootchars);
+    if (packagenamechars) env->ReleaseStringUTFChars(packageNameObj, packagenamechars);
+
+    Vector<String8> paths;
+    jsize count = env->GetArrayLength(pathsObj);
+    for (jsize i = 0; i < count; i++) {
+        paths.add(getStringElement(env, pathsObj, i));
+    }
+
+    for (jsize i = 0; i < count && i < PREFETCH_DEPTH; i++) {
+        prefetchFile(paths[i]);
+    }
+
+    for (jsize i = 0; i < count; i++) {
+        if (i + PREFETCH_DEPTH < count) {
+            prefetchFile(paths[i + PREFETCH_DEPTH]);
+        }
+
+        const String8& path = paths[i];
+        if (path.length() < rootpath.length()) {
+            ALOGE("file path [%s] shorter than root path [%s]",
+                    path.string(), rootpath.string());
+            return -1;
+        }
+        int err = write_tarfile(packageName, domain, rootpath, path, writer);
+        if (err) {
+            return err;
+        }
+    }
+    return 0;
+}
+
 static const JNINativeMethod g_methods[] = {
     { "backupToTar",
             "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Landroid/app/backup/BackupDataOutput;)I",
             (void*)backupToTar },
 };
 
+// Only registered if FullBackup declares them
+static const JNINativeMethod g_optional_methods[] = {
+    { "backupFilesToTar",
+            "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;[Ljava/lang/String;Landroid/app/backup/BackupDataOutput;)I",
+            (void*)backupFilesToTar },
+};
+
 int register_android_app_backup_FullBackup(JNIEnv* env)
 {
     jclass clazz = env->FindClass("android/app/backup/BackupDataOutput");
@@ -125,8 +228,11 @@ int register_android_app_backup_FullBackup(JNIEnv* env)
     LOG_FATAL_IF(sBackupDataOutput.mBackupwriter == NULL,
             "Unable to find mBackupWriter field in android.app.backup.BackupDataOutput");
 
-    return AndroidRuntime::registerNativeMethods(env, "android/app/backup/FullBackup",
+    int result = AndroidRuntime::registerNativeMethods(env, "android/app/backup/FullBackup",
             g_methods, NELEM(g_methods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/app/backup/FullBackup",
+            g_optional_methods, NELEM(g_optional_methods));
+    return result;
 }
 
 }
@@ -67,6 +67,9 @@ jfieldID get_field(JNIEnv *env,
         (err)->name, (err)->message); \
         dbus_error_free((err)); }
 
+/* max number of device property changes sent to java in one call */
+#define EVENT_LOOP_PROPERTY_BATCH_SIZE 32
+
 struct event_loop_native_data_t {
     DBusConnection *conn;
     const char *adapter;
@@ -91,6 +94,10 @@ struct event_loop_native_data_t {
     jobject me;
     /* flag to indicate if the event loop thread is running */
     bool running;
+    /* device property changes not sent to java yet, as global refs */
+    jobject batchedPaths[EVENT_LOOP_PROPERTY_BATCH_SIZE];
+    jobject batchedProperties[EVENT_LOOP_PROPERTY_BATCH_SIZE];
+    int batchedCount;
 };
 
 struct _Properties {
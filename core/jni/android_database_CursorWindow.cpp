@@ -37,6 +37,10 @@
 
 namespace android {
 
+// Windows grow in place up to this multiple of the requested size before
+// they report being full, so large queries need fewer refills.
+static const size_t CURSOR_WINDOW_MAX_GROWTH = 4;
+
 static struct {
     jfieldID data;
     jfieldID sizeCopied;
@@ -65,7 +69,8 @@ static jint nativeCreate(JNIEnv* env, jclass clazz, jstring nameObj, jint cursor
     env->ReleaseStringUTFChars(nameObj, nameStr);
 
     CursorWindow* window;
-    status_t status = CursorWindow::create(name, cursorWindowSize, &window);
+    status_t status = CursorWindow::create(name, cursorWindowSize,
+            cursorWindowSize * CURSOR_WINDOW_MAX_GROWTH, &window);
     if (status || !window) {
         ALOGE("Could not allocate CursorWindow '%s' of size %d due to error %d.",
                 name.string(), cursorWindowSize, status);
@@ -330,17 +335,8 @@ static void nativeCopyStringToBuffer(JNIEnv* env, jclass clazz, jint windowPtr,
     }
 }
 
-static jlong nativeGetLong(JNIEnv* env, jclass clazz, jint windowPtr,
-        jint row, jint column) {
-    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting long for %d,%d from %p", row, column, window);
-
-    CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
-    if (!fieldSlot) {
-        throwExceptionWithRowCol(env, row, column);
-        return 0;
-    }
-
+static jlong getFieldSlotLong(JNIEnv* env, CursorWindow* window,
+        CursorWindow::FieldSlot* fieldSlot) {
     int32_t type = window->getFieldSlotType(fieldSlot);
     if (type == CursorWindow::FIELD_TYPE_INTEGER) {
         return window->getFieldSlotValueLong(fieldSlot);
@@ -361,17 +357,21 @@ static jlong nativeGetLong(JNIEnv* env, jclass clazz, jint windowPtr,
     }
 }
 
-static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jint windowPtr,
+static jlong nativeGetLong(JNIEnv* env, jclass clazz, jint windowPtr,
         jint row, jint column) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting double for %d,%d from %p", row, column, window);
+    LOG_WINDOW("Getting long for %d,%d from %p", row, column, window);
 
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
         throwExceptionWithRowCol(env, row, column);
-        return 0.0;
+        return 0;
     }
+    return getFieldSlotLong(env, window, fieldSlot);
+}
 
+static jdouble getFieldSlotDouble(JNIEnv* env, CursorWindow* window,
+        CursorWindow::FieldSlot* fieldSlot) {
     int32_t type = window->getFieldSlotType(fieldSlot);
     if (type == CursorWindow::FIELD_TYPE_FLOAT) {
         return window->getFieldSlotValueDouble(fieldSlot);
@@ -392,6 +392,112 @@ static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jint windowPtr,
     }
 }
 
+static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jint windowPtr,
+        jint row, jint column) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting double for %d,%d from %p", row, column, window);
+
+    CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
+    if (!fieldSlot) {
+        throwExceptionWithRowCol(env, row, column);
+        return 0.0;
+    }
+    return getFieldSlotDouble(env, window, fieldSlot);
+}
+
+// Number of values converted on the stack before each copy out to Java
+// by the column accessors below.
+static const size_t COLUMN_BATCH_SIZE = 128;
+
+/*
+ * Copies a column of values starting at startRow into a long[] in a single
+ * call, converting each field as nativeGetLong would.  Returns the number of
+ * rows copied, which is limited by both the array length and the window.
+ */
+static jint nativeGetLongColumn(JNIEnv* env, jclass clazz, jint windowPtr,
+        jint column, jint startRow, jlongArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting long column %d from row %d from %p", column, startRow, window);
+
+    uint32_t numRows = window->getNumRows();
+    if (startRow < 0 || uint32_t(startRow) > numRows
+            || column < 0 || uint32_t(column) >= window->getNumColumns()) {
+        throwExceptionWithRowCol(env, startRow, column);
+        return 0;
+    }
+    size_t count = numRows - startRow;
+    size_t capacity = env->GetArrayLength(valuesObj);
+    if (count > capacity) {
+        count = capacity;
+    }
+
+    jlong batch[COLUMN_BATCH_SIZE];
+    for (size_t done = 0; done < count; ) {
+        size_t n = count - done < COLUMN_BATCH_SIZE ? count - done : COLUMN_BATCH_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(startRow + done + i,
+                    column);
+            batch[i] = getFieldSlotLong(env, window, fieldSlot);
+            if (env->ExceptionCheck()) {
+                return 0;
+            }
+        }
+        env->SetLongArrayRegion(valuesObj, done, n, batch);
+        done += n;
+    }
+    return count;
+}
+
+/*
+ * Like nativeGetLongColumn, for a double[] with the conversions of nativeGetDouble.
+ */
+static jint nativeGetDoubleColumn(JNIEnv* env, jclass clazz, jint windowPtr,
+        jint column, jint startRow, jdoubleArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting double column %d from row %d from %p", column, startRow, window);
+
+    uint32_t numRows = window->getNumRows();
+    if (startRow < 0 || uint32_t(startRow) > numRows
+            || column < 0 || uint32_t(column) >= window->getNumColumns()) {
+        throwExceptionWithRowCol(env, startRow, column);
+        return 0;
+    }
+    size_t count = numRows - startRow;
+    size_t capacity = env->GetArrayLength(valuesObj);
+    if (count > capacity) {
+        count = capacity;
+    }
+
+    jdouble batch[COLUMN_BATCH_SIZE];
+    for (size_t done = 0; done < count; ) {
+        size_t n = count - done < COLUMN_BATCH_SIZE ? count - done : COLUMN_BATCH_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(startRow + done + i,
+                    column);
+            batch[i] = getFieldSlotDouble(env, window, fieldSlot);
+            if (env->ExceptionCheck()) {
+                return 0;
+            }
+        }
+        env->SetDoubleArrayRegion(valuesObj, done, n, batch);
+        done += n;
+    }
+    return count;
+}
+
+/*
+ * Returns a direct ByteBuffer over the window's memory so that read-only
+ * clients can decode it without a JNI call per field, or null if the window
+ * is writable.  The buffer aliases the mapping and must not outlive the window.
+ */
+static jobject nativeGetDataBuffer(JNIEnv* env, jclass clazz, jint windowPtr) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    if (!window->isReadOnly()) {
+        return NULL;
+    }
+    return env->NewDirectByteBuffer(const_cast<void*>(window->data()), window->size());
+}
+
 static jboolean nativePutBlob(JNIEnv* env, jclass clazz, jint windowPtr,
         jbyteArray valueObj, jint row, jint column) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
@@ -521,6 +627,18 @@ static JNINativeMethod sMethods[] =
             (void*)nativePutNull },
 };
 
+// Bulk accessors, only registered if CursorWindow declares them
+static JNINativeMethod sOptionalMethods[] =
+{
+    /* name, signature, funcPtr */
+    { "nativeGetLongColumn", "(III[J)I",
+            (void*)nativeGetLongColumn },
+    { "nativeGetDoubleColumn", "(III[D)I",
+            (void*)nativeGetDoubleColumn },
+    { "nativeGetDataBuffer", "(I)Ljava/nio/ByteBuffer;",
+            (void*)nativeGetDataBuffer },
+};
+
 #define FIND_CLASS(var, className) \
         var = env->FindClass(className); \
         LOG_FATAL_IF(! var, "Unable to find class " className);
@@ -542,8 +660,11 @@ int register_android_database_CursorWindow(JNIEnv * env)
     gEmptyString = jstring(env->NewGlobalRef(env->NewStringUTF("")));
     LOG_FATAL_IF(!gEmptyString, "Unable to create empty string");
 
-    return AndroidRuntime::registerNativeMethods(env, "android/database/CursorWindow",
+    int result = AndroidRuntime::registerNativeMethods(env, "android/database/CursorWindow",
             sMethods, NELEM(sMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/database/CursorWindow",
+            sOptionalMethods, NELEM(sOptionalMethods));
+    return result;
 }
 
 } // namespace android
@@ -16,10 +16,28 @@
 
 #include "android_database_SQLiteCommon.h"
 
+#include <utils/KeyedVector.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
 
 namespace android {
 
+// Maximum number of distinct statements tracked by the statement statistics.
+// When the table is full, the statement that ran least recently is dropped.
+static const size_t MAX_STATEMENT_STATS = 128;
+
+struct StatementStats {
+    uint32_t count;
+    uint32_t lastUse;
+    sqlite3_uint64 totalNs;
+    sqlite3_uint64 maxNs;
+};
+
+static Mutex gStatementStatsLock;
+static KeyedVector<String8, StatementStats> gStatementStats;
+// Incremented for each recorded execution, orders the entries by last use.
+static uint32_t gStatementStatsClock;
+
 /* throw a SQLiteException with a message appropriate for the error in handle */
 void throw_sqlite3_exception(JNIEnv* env, sqlite3* handle) {
     throw_sqlite3_exception(env, handle, NULL);
@@ -134,5 +152,67 @@ void throw_sqlite3_exception(JNIEnv* env, int errcode,
     }
 }
 
+void record_sqlite3_statement_time(const char* sql, sqlite3_uint64 ns) {
+    String8 key(sql);
+
+    AutoMutex _l(gStatementStatsLock);
+    ssize_t index = gStatementStats.indexOfKey(key);
+    if (index < 0) {
+        if (gStatementStats.size() >= MAX_STATEMENT_STATS) {
+            size_t victim = 0;
+            for (size_t i = 1; i < gStatementStats.size(); i++) {
+                // Unsigned difference, correct across wraparound
+                if (gStatementStatsClock - gStatementStats.valueAt(i).lastUse
+                        > gStatementStatsClock - gStatementStats.valueAt(victim).lastUse) {
+                    victim = i;
+                }
+            }
+            gStatementStats.removeItemsAt(victim);
+        }
+        StatementStats stats;
+        stats.count = 0;
+        stats.totalNs = 0;
+        stats.maxNs = 0;
+        index = gStatementStats.add(key, stats);
+    }
+
+    StatementStats& stats = gStatementStats.editValueAt(index);
+    stats.count += 1;
+    stats.lastUse = ++gStatementStatsClock;
+    stats.totalNs += ns;
+    if (ns > stats.maxNs) {
+        stats.maxNs = ns;
+    }
+}
+
+void dump_sqlite3_statement_stats(String8& out) {
+    AutoMutex _l(gStatementStatsLock);
+
+    // Order by total time with a simple selection over the indices; the
+    // table is small and this is only used for debugging output.
+    size_t count = gStatementStats.size();
+    Vector<size_t> order;
+    order.setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        order.add(i);
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t best = i;
+        for (size_t j = i + 1; j < count; j++) {
+            if (gStatementStats.valueAt(order[j]).totalNs
+                    > gStatementStats.valueAt(order[best]).totalNs) {
+                best = j;
+            }
+        }
+        size_t tmp = order[i];
+        order.editItemAt(i) = order[best];
+        order.editItemAt(best) = tmp;
+
+        const StatementStats& stats = gStatementStats.valueAt(order[i]);
+        out.appendFormat("  %10.3f ms total, %6u runs, %8.3f ms max: %s\n",
+                stats.totalNs * 0.000001f, stats.count, stats.maxNs * 0.000001f,
+                gStatementStats.keyAt(order[i]).string());
+    }
+}
 
 } // namespace android
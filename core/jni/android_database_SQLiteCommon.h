@@ -22,6 +22,8 @@
 
 #include <sqlite3.h>
 
+#include <utils/String8.h>
+
 // Special log tags defined in SQLiteDebug.java.
 #define SQLITE_LOG_TAG "SQLiteLog"
 #define SQLITE_TRACE_TAG "SQLiteStatements"
@@ -46,6 +48,13 @@ void throw_sqlite3_exception_errcode(JNIEnv* env, int errcode, const char* messa
 void throw_sqlite3_exception(JNIEnv* env, int errcode,
         const char* sqlite3Message, const char* message);
 
+/* record that an execution of the statement with the given SQL took the
+   given number of nanoseconds, for the process-wide statement statistics */
+void record_sqlite3_statement_time(const char* sql, sqlite3_uint64 ns);
+
+/* append a summary of the statement statistics, most expensive first */
+void dump_sqlite3_statement_stats(String8& out);
+
 }
 
 #endif // _ANDROID_DATABASE_SQLITE_COMMON_H
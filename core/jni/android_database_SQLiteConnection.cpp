@@ -23,7 +23,9 @@
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/Vector.h>
 #include <cutils/ashmem.h>
+#include <cutils/properties.h>
 #include <sys/mman.h>
 
 #include <string.h>
@@ -55,6 +57,12 @@ namespace android {
  */
 static const int BUSY_TIMEOUT_MS = 2500;
 
+/* Maximum number of finalized statements kept prepared per connection.
+ * The Java layer finalizes statements that fall out of its own small cache;
+ * parking them here lets a later prepare of the same SQL skip compilation.
+ */
+static const size_t STATEMENT_CACHE_SIZE = 16;
+
 static struct {
     jfieldID name;
     jfieldID numArgs;
@@ -82,11 +90,32 @@ struct SQLiteConnection {
     const String8 label;
 
     volatile bool canceled;
+    bool profile;
+    bool collectStats;
+
+    // Statements parked by nativeFinalizeStatement, oldest first.  They have
+    // been reset and had their bindings cleared.
+    struct CachedStatement {
+        uint32_t hash;
+        String16 sql;
+        sqlite3_stmt* statement;
+    };
+    Vector<CachedStatement> statementCache;
 
     SQLiteConnection(sqlite3* db, int openFlags, const String8& path, const String8& label) :
-        db(db), openFlags(openFlags), path(path), label(label), canceled(false) { }
+        db(db), openFlags(openFlags), path(path), label(label), canceled(false),
+        profile(false), collectStats(false) { }
 };
 
+static uint32_t hashSql(const jchar* sql, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ sql[i]) * 16777619u;
+    }
+    return hash;
+}
+
 // Called each time a statement begins execution, when tracing is enabled.
 static void sqliteTraceCallback(void *data, const char *sql) {
     SQLiteConnection* connection = static_cast<SQLiteConnection*>(data);
@@ -94,11 +123,17 @@ static void sqliteTraceCallback(void *data, const char *sql) {
             connection->label.string(), sql);
 }
 
-// Called each time a statement finishes execution, when profiling is enabled.
+// Called each time a statement finishes execution, when profiling or the
+// statement statistics are enabled.
 static void sqliteProfileCallback(void *data, const char *sql, sqlite3_uint64 tm) {
     SQLiteConnection* connection = static_cast<SQLiteConnection*>(data);
-    ALOG(LOG_VERBOSE, SQLITE_PROFILE_TAG, "%s: \"%s\" took %0.3f ms\n",
-            connection->label.string(), sql, tm * 0.000001f);
+    if (connection->collectStats) {
+        record_sqlite3_statement_time(sql, tm);
+    }
+    if (connection->profile) {
+        ALOG(LOG_VERBOSE, SQLITE_PROFILE_TAG, "%s: \"%s\" took %0.3f ms\n",
+                connection->label.string(), sql, tm * 0.000001f);
+    }
 }
 
 // Called after each SQLite VM instruction when cancelation is enabled.
@@ -164,7 +199,15 @@ static jint nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFlag
     if (enableTrace) {
         sqlite3_trace(db, &sqliteTraceCallback, connection);
     }
-    if (enableProfile) {
+    connection->profile = enableProfile;
+
+    // The statement statistics cost a lookup per statement, only collect them
+    // when asked to.  The property is read when the connection is opened.
+    char propBuf[PROPERTY_VALUE_MAX];
+    property_get("debug.sqlite.stmtstats", propBuf, "");
+    connection->collectStats = strcmp(propBuf, "1") == 0 || strcmp(propBuf, "true") == 0;
+
+    if (connection->profile || connection->collectStats) {
         sqlite3_profile(db, &sqliteProfileCallback, connection);
     }
 
@@ -177,6 +220,11 @@ static void nativeClose(JNIEnv* env, jclass clazz, jint connectionPtr) {
 
     if (connection) {
         ALOGV("Closing connection %p", connection->db);
+        for (size_t i = 0; i < connection->statementCache.size(); i++) {
+            sqlite3_finalize(connection->statementCache[i].statement);
+        }
+        connection->statementCache.clear();
+
         int err = sqlite3_close(connection->db);
         if (err != SQLITE_OK) {
             // This can happen if sub-objects aren't closed first.  Make sure the caller knows.
@@ -285,6 +333,19 @@ static jint nativePrepareStatement(JNIEnv* env, jclass clazz, jint connectionPtr
 
     jsize sqlLength = env->GetStringLength(sqlString);
     const jchar* sql = env->GetStringCritical(sqlString, NULL);
+    uint32_t hash = hashSql(sql, sqlLength);
+    Vector<SQLiteConnection::CachedStatement>& cache = connection->statementCache;
+    for (size_t i = cache.size(); i-- > 0; ) {
+        const SQLiteConnection::CachedStatement& entry = cache[i];
+        if (entry.hash == hash && entry.sql.size() == size_t(sqlLength)
+                && !memcmp(entry.sql.string(), sql, sqlLength * sizeof(jchar))) {
+            sqlite3_stmt* statement = entry.statement;
+            cache.removeAt(i);
+            env->ReleaseStringCritical(sqlString, sql);
+            ALOGV("Reused statement %p on connection %p", statement, connection->db);
+            return reinterpret_cast<jint>(statement);
+        }
+    }
     sqlite3_stmt* statement;
     int err = sqlite3_prepare16_v2(connection->db,
             sql, sqlLength * sizeof(jchar), &statement, NULL);
@@ -315,6 +376,28 @@ static void nativeFinalizeStatement(JNIEnv* env, jclass clazz, jint connectionPt
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
+    // Park the statement for reuse by a later prepare of the same SQL.  The result
+    // of sqlite3_reset only reports errors from the last execution, so it is ignored.
+    const char* sql = sqlite3_sql(statement);
+    if (sql) {
+        sqlite3_reset(statement);
+        if (sqlite3_clear_bindings(statement) == SQLITE_OK) {
+            Vector<SQLiteConnection::CachedStatement>& cache = connection->statementCache;
+            if (cache.size() >= STATEMENT_CACHE_SIZE) {
+                sqlite3_finalize(cache[0].statement);
+                cache.removeAt(0);
+            }
+            SQLiteConnection::CachedStatement entry;
+            entry.sql = String16(sql);
+            entry.hash = hashSql(reinterpret_cast<const jchar*>(entry.sql.string()),
+                    entry.sql.size());
+            entry.statement = statement;
+            cache.add(entry);
+            ALOGV("Cached statement %p on connection %p", statement, connection->db);
+            return;
+        }
+    }
+
     // We ignore the result of sqlite3_finalize because it is really telling us about
     // whether any errors occurred while executing the statement.  The statement itself
     // is always finalized regardless.
@@ -564,6 +647,97 @@ static jint nativeExecuteForBlobFileDescriptor(JNIEnv* env, jclass clazz,
     return -1;
 }
 
+// Size of the buffer that incremental blob reads are staged through on their
+// way into the caller's byte[].
+static const size_t BLOB_READ_CHUNK_SIZE = 16 * 1024;
+
+/* Opens a handle for incremental I/O on one blob, so that large blobs can be
+ * read in chunks rather than materialized whole by a query and then copied
+ * into ashmem or a Java byte[].
+ */
+static jint nativeOpenBlob(JNIEnv* env, jclass clazz, jint connectionPtr,
+        jstring databaseNameStr, jstring tableStr, jstring columnStr,
+        jlong rowId, jboolean writable) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    const char* databaseName = env->GetStringUTFChars(databaseNameStr, NULL);
+    const char* table = env->GetStringUTFChars(tableStr, NULL);
+    const char* column = env->GetStringUTFChars(columnStr, NULL);
+    sqlite3_blob* blob;
+    int err = sqlite3_blob_open(connection->db, databaseName, table, column,
+            rowId, writable ? 1 : 0, &blob);
+    env->ReleaseStringUTFChars(columnStr, column);
+    env->ReleaseStringUTFChars(tableStr, table);
+    env->ReleaseStringUTFChars(databaseNameStr, databaseName);
+
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception(env, connection->db, "Could not open blob");
+        return 0;
+    }
+
+    ALOGV("Opened blob %p on connection %p", blob, connection->db);
+    return reinterpret_cast<jint>(blob);
+}
+
+static void nativeCloseBlob(JNIEnv* env, jclass clazz, jint connectionPtr,
+        jint blobPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    ALOGV("Closed blob %p on connection %p", blob, connection->db);
+    sqlite3_blob_close(blob);
+}
+
+static jint nativeGetBlobSize(JNIEnv* env, jclass clazz, jint connectionPtr,
+        jint blobPtr) {
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+    return sqlite3_blob_bytes(blob);
+}
+
+/* Reads up to length bytes of the blob starting at blobOffset into
+ * buffer[bufferOffset...].  Returns the number of bytes read, which is only
+ * short at the end of the blob.
+ */
+static jint nativeReadBlob(JNIEnv* env, jclass clazz, jint connectionPtr,
+        jint blobPtr, jbyteArray bufferObj, jint bufferOffset,
+        jint blobOffset, jint length) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_blob* blob = reinterpret_cast<sqlite3_blob*>(blobPtr);
+
+    int blobSize = sqlite3_blob_bytes(blob);
+    jsize bufferSize = env->GetArrayLength(bufferObj);
+    if (bufferOffset < 0 || length < 0 || blobOffset < 0
+            || length > bufferSize - bufferOffset) {
+        jniThrowException(env, "java/lang/IndexOutOfBoundsException", NULL);
+        return 0;
+    }
+    if (blobOffset >= blobSize) {
+        return 0;
+    }
+    if (length > blobSize - blobOffset) {
+        length = blobSize - blobOffset;
+    }
+
+    // sqlite3_blob_read may do I/O, so stage through a bounded buffer rather
+    // than holding the array in a critical region.
+    jbyte chunk[BLOB_READ_CHUNK_SIZE];
+    jint done = 0;
+    while (done < length) {
+        jint n = length - done;
+        if (n > jint(BLOB_READ_CHUNK_SIZE)) {
+            n = BLOB_READ_CHUNK_SIZE;
+        }
+        int err = sqlite3_blob_read(blob, chunk, n, blobOffset + done);
+        if (err != SQLITE_OK) {
+            throw_sqlite3_exception(env, connection->db, "Could not read blob");
+            return 0;
+        }
+        env->SetByteArrayRegion(bufferObj, bufferOffset + done, n, chunk);
+        done += n;
+    }
+    return done;
+}
+
 enum CopyRowResult {
     CPR_OK,
     CPR_FULL,
@@ -572,8 +746,10 @@ enum CopyRowResult {
 
 static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
         sqlite3_stmt* statement, int numColumns, int startPos, int addedRows) {
-    // Allocate a new field directory for the row.
-    status_t status = window->allocRow();
+    // Allocate a new field directory for the row.  The fields are then stored
+    // straight into the directory rather than looking the row up per field.
+    CursorWindow::FieldSlot* fieldDir;
+    status_t status = window->allocRow(&fieldDir);
     if (status) {
         LOG_WINDOW("Failed allocating fieldDir at startPos %d row %d, error=%d",
                 startPos, addedRows, status);
@@ -592,7 +768,7 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
             // ensure all strings are NULL terminated, so increase size by
             // one to make sure we store the terminator.
             size_t sizeIncludingNull = sqlite3_column_bytes(statement, i) + 1;
-            status = window->putString(addedRows, i, text, sizeIncludingNull);
+            status = window->putString(&fieldDir[i], text, sizeIncludingNull);
             if (status) {
                 LOG_WINDOW("Failed allocating %u bytes for text at %d,%d, error=%d",
                         sizeIncludingNull, startPos + addedRows, i, status);
@@ -604,30 +780,18 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
         } else if (type == SQLITE_INTEGER) {
             // INTEGER data
             int64_t value = sqlite3_column_int64(statement, i);
-            status = window->putLong(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a long in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
+            window->putLong(&fieldDir[i], value);
             LOG_WINDOW("%d,%d is INTEGER 0x%016llx", startPos + addedRows, i, value);
         } else if (type == SQLITE_FLOAT) {
             // FLOAT data
             double value = sqlite3_column_double(statement, i);
-            status = window->putDouble(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a double in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
+            window->putDouble(&fieldDir[i], value);
             LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value);
         } else if (type == SQLITE_BLOB) {
             // BLOB data
             const void* blob = sqlite3_column_blob(statement, i);
             size_t size = sqlite3_column_bytes(statement, i);
-            status = window->putBlob(addedRows, i, blob, size);
+            status = window->putBlob(&fieldDir[i], blob, size);
             if (status) {
                 LOG_WINDOW("Failed allocating %u bytes for blob at %d,%d, error=%d",
                         size, startPos + addedRows, i, status);
@@ -638,14 +802,7 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
                     startPos + addedRows, i, size);
         } else if (type == SQLITE_NULL) {
             // NULL field
-            status = window->putNull(addedRows, i);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a null in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
-
+            window->putNull(&fieldDir[i]);
             LOG_WINDOW("%d,%d is NULL", startPos + addedRows, i);
         } else {
             // Unknown data
@@ -844,6 +1001,20 @@ static JNINativeMethod sMethods[] =
             (void*)nativeResetCancel },
 };
 
+// Incremental blob reads, only registered if SQLiteConnection declares them
+static JNINativeMethod sOptionalMethods[] =
+{
+    /* name, signature, funcPtr */
+    { "nativeOpenBlob", "(ILjava/lang/String;Ljava/lang/String;Ljava/lang/String;JZ)I",
+            (void*)nativeOpenBlob },
+    { "nativeCloseBlob", "(II)V",
+            (void*)nativeCloseBlob },
+    { "nativeGetBlobSize", "(II)I",
+            (void*)nativeGetBlobSize },
+    { "nativeReadBlob", "(II[BIII)I",
+            (void*)nativeReadBlob },
+};
+
 #define FIND_CLASS(var, className) \
         var = env->FindClass(className); \
         LOG_FATAL_IF(! var, "Unable to find class " className);
@@ -871,8 +1042,11 @@ int register_android_database_SQLiteConnection(JNIEnv *env)
     FIND_CLASS(clazz, "java/lang/String");
     gStringClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
 
-    return AndroidRuntime::registerNativeMethods(env, "android/database/sqlite/SQLiteConnection",
-            sMethods, NELEM(sMethods));
+    int result = AndroidRuntime::registerNativeMethods(env,
+            "android/database/sqlite/SQLiteConnection", sMethods, NELEM(sMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+            "android/database/sqlite/SQLiteConnection", sOptionalMethods, NELEM(sOptionalMethods));
+    return result;
 }
 
 } // namespace android
@@ -25,9 +25,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
+#include <utils/String16.h>
 
 #include <sqlite3.h>
 
+#include "android_database_SQLiteCommon.h"
+
 namespace android {
 
 static struct {
@@ -52,6 +55,16 @@ static void nativeGetPagerStats(JNIEnv *env, jobject clazz, jobject statsObj)
     env->SetIntField(statsObj, gSQLiteDebugPagerStatsClassInfo.largestMemAlloc, largestMemAlloc);
 }
 
+static jstring nativeDumpStatementStats(JNIEnv *env, jobject clazz)
+{
+    String8 dump;
+    dump_sqlite3_statement_stats(dump);
+
+    // Statements may contain text that is not modified UTF-8, so go through UTF-16.
+    String16 utf16(dump);
+    return env->NewString(reinterpret_cast<const jchar*>(utf16.string()), utf16.size());
+}
+
 /*
  * JNI registration.
  */
@@ -62,6 +75,13 @@ static JNINativeMethod gMethods[] =
             (void*) nativeGetPagerStats },
 };
 
+// Only registered if SQLiteDebug declares them
+static JNINativeMethod gOptionalMethods[] =
+{
+    { "nativeDumpStatementStats", "()Ljava/lang/String;",
+            (void*) nativeDumpStatementStats },
+};
+
 #define FIND_CLASS(var, className) \
         var = env->FindClass(className); \
         LOG_FATAL_IF(! var, "Unable to find class " className);
@@ -82,8 +102,11 @@ int register_android_database_SQLiteDebug(JNIEnv *env)
     GET_FIELD_ID(gSQLiteDebugPagerStatsClassInfo.pageCacheOverflow, clazz,
             "pageCacheOverflow", "I");
 
-    return AndroidRuntime::registerNativeMethods(env, "android/database/sqlite/SQLiteDebug",
-            gMethods, NELEM(gMethods));
+    int result = AndroidRuntime::registerNativeMethods(env,
+            "android/database/sqlite/SQLiteDebug", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/database/sqlite/SQLiteDebug",
+            gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 } // namespace android
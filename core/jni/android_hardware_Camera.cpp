@@ -47,11 +47,20 @@ struct fields_t {
     jmethodID   post_event;
     jmethodID   rect_constructor;
     jmethodID   face_constructor;
+    jmethodID   buffer_limit;
 };
 
 static fields_t fields;
 static Mutex sLock;
 
+// Maximum number of preview frames delivered as direct buffers that the
+// application may hold at once. Frames are dropped while the limit is reached.
+#define MAX_DIRECT_PREVIEW_FRAMES 3
+
+// Value of ext1 for preview frames delivered as a direct ByteBuffer. ext2 then
+// holds the token that releases the frame through _releasePreviewFrame().
+#define PREVIEW_FRAME_DIRECT_BUFFER 1
+
 // provides persistent context for calls from native code to Java
 class JNICameraContext: public CameraListener
 {
@@ -65,14 +74,18 @@ public:
     void postMetadata(JNIEnv *env, int32_t msgType, camera_frame_metadata_t *metadata);
     void addCallbackBuffer(JNIEnv *env, jbyteArray cbb, int msgType);
     void setCallbackMode(JNIEnv *env, bool installed, bool manualMode);
+    void setDirectBufferMode(bool enabled);
+    void releaseDirectFrame(JNIEnv *env, jint token);
     sp<Camera> getCamera() { Mutex::Autolock _l(mLock); return mCamera; }
     bool isRawImageCallbackBufferAvailable() const;
     void release();
 
 private:
     void copyAndPost(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType);
+    bool postDirect(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType);
     void clearCallbackBuffers_l(JNIEnv *env, Vector<jbyteArray> *buffers);
     void clearCallbackBuffers_l(JNIEnv *env);
+    void invalidateDirectFrame_l(JNIEnv *env, size_t index);
     jbyteArray getCallbackBuffer(JNIEnv *env, Vector<jbyteArray> *buffers, size_t bufferSize);
 
     jobject     mCameraJObjectWeak;     // weak reference to java object
@@ -100,6 +113,22 @@ private:
     bool mManualBufferMode;              // Whether to use application managed buffers.
     bool mManualCameraCallbackSet;       // Whether the callback has been set, used to
                                          // reduce unnecessary calls to set the callback.
+
+    /*
+     * Preview frames handed to the application as direct ByteBuffers. The
+     * camera reuses its heap as soon as postData() returns, so each frame is
+     * copied into a buffer of its own, which is reused once the application
+     * releases the frame by token. This saves allocating a byte[] per frame.
+     */
+    struct DirectFrame {
+        jint token;                      // Identifies the frame held by the application, 0 if free.
+        void* data;
+        size_t capacity;
+        jobject buffer;                  // Global reference to the ByteBuffer handed out.
+    };
+    DirectFrame mDirectFrames[MAX_DIRECT_PREVIEW_FRAMES];
+    jint mNextDirectToken;
+    bool mDirectBufferMode;              // Whether to deliver preview frames as direct buffers.
 };
 
 bool JNICameraContext::isRawImageCallbackBufferAvailable() const
@@ -138,6 +167,9 @@ JNICameraContext::JNICameraContext(JNIEnv* env, jobject weak_this, jclass clazz,
 
     mManualBufferMode = false;
     mManualCameraCallbackSet = false;
+    mDirectBufferMode = false;
+    memset(mDirectFrames, 0, sizeof(mDirectFrames));
+    mNextDirectToken = 1;
 }
 
 void JNICameraContext::release()
@@ -163,6 +195,12 @@ void JNICameraContext::release()
         mRectClass = NULL;
     }
     clearCallbackBuffers_l(env);
+    for (size_t i = 0; i < MAX_DIRECT_PREVIEW_FRAMES; i++) {
+        invalidateDirectFrame_l(env, i);
+        free(mDirectFrames[i].data);
+        mDirectFrames[i].data = NULL;
+        mDirectFrames[i].capacity = 0;
+    }
     mCamera.clear();
 }
 
@@ -219,10 +257,99 @@ jbyteArray JNICameraContext::getCallbackBuffer(
     return obj;
 }
 
+bool JNICameraContext::postDirect(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType)
+{
+    size_t index = 0;
+    while (index < MAX_DIRECT_PREVIEW_FRAMES && mDirectFrames[index].token != 0) {
+        index++;
+    }
+    if (index == MAX_DIRECT_PREVIEW_FRAMES) {
+        ALOGV("All direct preview frames are held by the application, dropping frame");
+        return true;
+    }
+
+    ssize_t offset;
+    size_t size;
+    sp<IMemoryHeap> heap = dataPtr->getMemory(&offset, &size);
+    uint8_t *heapBase = (uint8_t*)heap->base();
+    if (heapBase == NULL) {
+        ALOGE("image heap is NULL");
+        return false;
+    }
+
+    DirectFrame& frame = mDirectFrames[index];
+    if (frame.capacity < size) {
+        void* data = realloc(frame.data, size);
+        if (data == NULL) {
+            ALOGE("Couldn't allocate %d bytes for direct preview frame", size);
+            return false;
+        }
+        frame.data = data;
+        frame.capacity = size;
+    }
+    memcpy(frame.data, heapBase + offset, size);
+
+    jobject buffer = env->NewDirectByteBuffer(frame.data, size);
+    if (buffer == NULL) {
+        ALOGE("Couldn't allocate direct buffer for preview frame");
+        env->ExceptionClear();
+        return false;
+    }
+    frame.buffer = env->NewGlobalRef(buffer);
+    frame.token = mNextDirectToken++;
+    if (mNextDirectToken <= 0) {
+        mNextDirectToken = 1;
+    }
+
+    env->CallStaticVoidMethod(mCameraJClass, fields.post_event,
+            mCameraJObjectWeak, msgType, PREVIEW_FRAME_DIRECT_BUFFER, frame.token, buffer);
+    env->DeleteLocalRef(buffer);
+    return true;
+}
+
+// Empties the ByteBuffer the application holds for the frame, so it cannot read
+// a later frame through it, and frees the frame for reuse.
+void JNICameraContext::invalidateDirectFrame_l(JNIEnv *env, size_t index)
+{
+    DirectFrame& frame = mDirectFrames[index];
+    if (frame.buffer != NULL) {
+        jobject me = env->CallObjectMethod(frame.buffer, fields.buffer_limit, 0);
+        env->DeleteLocalRef(me);
+        env->DeleteGlobalRef(frame.buffer);
+        frame.buffer = NULL;
+    }
+    frame.token = 0;
+}
+
+void JNICameraContext::releaseDirectFrame(JNIEnv *env, jint token)
+{
+    Mutex::Autolock _l(mLock);
+    for (size_t i = 0; token != 0 && i < MAX_DIRECT_PREVIEW_FRAMES; i++) {
+        if (mDirectFrames[i].token == token) {
+            invalidateDirectFrame_l(env, i);
+            return;
+        }
+    }
+    ALOGW("releasePreviewFrame: %d is not a preview frame held by the application", token);
+}
+
+void JNICameraContext::setDirectBufferMode(bool enabled)
+{
+    Mutex::Autolock _l(mLock);
+    // Frames already delivered remain valid until they are released
+    mDirectBufferMode = enabled;
+}
+
 void JNICameraContext::copyAndPost(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType)
 {
     jbyteArray obj = NULL;
 
+    // Preview frames may be delivered without copy, see setDirectBufferMode()
+    if (msgType == CAMERA_MSG_PREVIEW_FRAME && mDirectBufferMode && !mManualBufferMode &&
+            dataPtr != NULL && postDirect(env, dataPtr, msgType)) {
+        return;
+    }
+
     // allocate Java byte array and copy data
     if (dataPtr != NULL) {
         ssize_t offset;
@@ -647,6 +774,28 @@ static void android_hardware_Camera_setHasPreviewCallback(JNIEnv *env, jobject t
 #endif
  }
 
+static void android_hardware_Camera_setDirectPreviewBuffers(JNIEnv *env, jobject thiz,
+        jboolean enabled)
+{
+    ALOGV("setDirectPreviewBuffers: %d", (int)enabled);
+    JNICameraContext* context;
+    sp<Camera> camera = get_native_camera(env, thiz, &context);
+    if (camera == 0) return;
+
+    context->setDirectBufferMode(enabled);
+}
+
+static void android_hardware_Camera_releasePreviewFrame(JNIEnv *env, jobject thiz,
+        jint token)
+{
+    ALOGV("releasePreviewFrame: %d", token);
+    JNICameraContext* context;
+    sp<Camera> camera = get_native_camera(env, thiz, &context);
+    if (camera == 0) return;
+
+    context->releaseDirectFrame(env, token);
+}
+
 static void android_hardware_Camera_addCallbackBuffer(JNIEnv *env, jobject thiz, jbyteArray bytes, int msgType) {
     ALOGV("addCallbackBuffer: 0x%x", msgType);
 
@@ -947,6 +1096,16 @@ static JNINativeMethod camMethods[] = {
     (void *)android_hardware_Camera_enableFocusMoveCallback},
 };
 
+// Only registered if Camera declares them
+static JNINativeMethod camOptionalMethods[] = {
+  { "_setDirectPreviewBuffers",
+    "(Z)V",
+    (void *)android_hardware_Camera_setDirectPreviewBuffers },
+  { "_releasePreviewFrame",
+    "(I)V",
+    (void *)android_hardware_Camera_releasePreviewFrame },
+};
+
 struct field {
     const char *class_name;
     const char *field_name;
@@ -1019,7 +1178,17 @@ int register_android_hardware_Camera(JNIEnv *env)
         return -1;
     }
 
+    clazz = env->FindClass("java/nio/Buffer");
+    fields.buffer_limit = env->GetMethodID(clazz, "limit", "(I)Ljava/nio/Buffer;");
+    if (fields.buffer_limit == NULL) {
+        ALOGE("Can't find java/nio/Buffer.limit(int)");
+        return -1;
+    }
+
     // Register native functions
-    return AndroidRuntime::registerNativeMethods(env, "android/hardware/Camera",
+    int result = AndroidRuntime::registerNativeMethods(env, "android/hardware/Camera",
                                               camMethods, NELEM(camMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/hardware/Camera",
+                                              camOptionalMethods, NELEM(camOptionalMethods));
+    return result;
 }
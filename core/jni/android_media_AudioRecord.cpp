@@ -34,6 +34,7 @@
 #include <media/AudioRecord.h>
 #include <media/mediarecorder.h>
 
+#include <cutils/atomic.h>
 #include <cutils/bitops.h>
 
 #include <system/audio.h>
@@ -60,11 +61,31 @@ struct fields_t {
 };
 static fields_t javaAudioRecordFields;
 
+// Layout of a ring buffer attached with native_attach_ring_buffer(). The direct ByteBuffer
+// starts with a header of native-order ints, followed by the audio data. Positions are running
+// byte counts that wrap at 2^32; the callback thread only advances the write position and
+// Java only advances the read position, so neither side needs a lock.
+enum {
+    RING_WRITE_POS  = 0,    // bytes captured so far, written by the callback thread
+    RING_READ_POS   = 1,    // bytes consumed so far, written by Java
+    RING_OVERRUNS   = 2,    // bytes dropped because Java fell behind
+    RING_HEADER_INTS = 4,
+};
+#define RING_HEADER_SIZE (RING_HEADER_INTS * sizeof(int32_t))
+
+struct audiorecord_ring {
+    jobject             buffer;     // global ref keeping the direct ByteBuffer alive
+    volatile int32_t*   header;
+    uint8_t*            data;
+    uint32_t            size;
+};
+
 struct audiorecord_callback_cookie {
     jclass      audioRecord_class;
     jobject     audioRecord_ref;
     bool        busy;
     Condition   cond;
+    audiorecord_ring* ring;
 };
 
 static Mutex sLock;
@@ -96,21 +117,52 @@ jint android_media_translateRecorderErrorCode(int code) {
 }
 
 
+// ----------------------------------------------------------------------------
+// Copies as much of the captured buffer into the ring as there is room for, and counts
+// the rest as an overrun. Only called from the AudioRecord callback thread.
+static void writeToRing(audiorecord_ring* ring, const uint8_t* src, uint32_t size) {
+    uint32_t writePos = (uint32_t)ring->header[RING_WRITE_POS];
+    uint32_t readPos = (uint32_t)android_atomic_acquire_load(&ring->header[RING_READ_POS]);
+    uint32_t used = writePos - readPos;
+    uint32_t room = used < ring->size ? ring->size - used : 0;
+    uint32_t count = size < room ? size : room;
+
+    uint32_t offset = writePos % ring->size;
+    uint32_t first = ring->size - offset;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, src + first, count - first);
+
+    android_atomic_release_store((int32_t)(writePos + count), &ring->header[RING_WRITE_POS]);
+    if (count < size) {
+        android_atomic_add((int32_t)(size - count), &ring->header[RING_OVERRUNS]);
+    }
+}
+
 // ----------------------------------------------------------------------------
 static void recorderCallback(int event, void* user, void *info) {
 
     audiorecord_callback_cookie *callbackInfo = (audiorecord_callback_cookie *)user;
+    audiorecord_ring* ring;
     {
         Mutex::Autolock l(sLock);
         if (sAudioRecordCallBackCookies.indexOf(callbackInfo) < 0) {
             return;
         }
         callbackInfo->busy = true;
+        ring = callbackInfo->ring;
     }
     if (event == AudioRecord::EVENT_MORE_DATA) {
-        // set size to 0 to signal we're not using the callback to read more data
         AudioRecord::Buffer* pBuff = (AudioRecord::Buffer*)info;
-        pBuff->size = 0;
+        if (ring != NULL) {
+            // hand the whole buffer back as consumed, whatever did not fit is an overrun
+            writeToRing(ring, (const uint8_t*)pBuff->raw, pBuff->size);
+        } else {
+            // set size to 0 to signal we're not using the callback to read more data
+            pBuff->size = 0;
+        }
 
     } else if (event == AudioRecord::EVENT_MARKER) {
         JNIEnv *env = AndroidRuntime::getJNIEnv();
@@ -269,6 +321,7 @@ android_media_AudioRecord_setup(JNIEnv *env, jobject thiz, jobject weak_this,
     // we use a weak reference so the AudioRecord object can be garbage collected.
     lpCallbackData->audioRecord_ref = env->NewGlobalRef(weak_this);
     lpCallbackData->busy = false;
+    lpCallbackData->ring = NULL;
 
     lpRecorder->set((audio_source_t) source,
         sampleRateInHertz,
@@ -356,6 +409,25 @@ android_media_AudioRecord_stop(JNIEnv *env, jobject thiz)
 // ----------------------------------------------------------------------------
 
 #define CALLBACK_COND_WAIT_TIMEOUT_MS 1000
+
+// Waits for a callback in progress to finish. Must be called with sLock held.
+static void waitForCallback(audiorecord_callback_cookie *lpCookie) {
+    while (lpCookie->busy) {
+        if (lpCookie->cond.waitRelative(sLock,
+                                        milliseconds(CALLBACK_COND_WAIT_TIMEOUT_MS)) !=
+                                                NO_ERROR) {
+            break;
+        }
+    }
+}
+
+static void freeRing(JNIEnv *env, audiorecord_ring* ring) {
+    if (ring != NULL) {
+        env->DeleteGlobalRef(ring->buffer);
+        delete ring;
+    }
+}
+
 static void android_media_AudioRecord_release(JNIEnv *env,  jobject thiz) {
     sp<AudioRecord> lpRecorder = setAudioRecord(env, thiz, 0);
     if (lpRecorder == NULL) {
@@ -375,16 +447,11 @@ static void android_media_AudioRecord_release(JNIEnv *env,  jobject thiz) {
     if (lpCookie) {
         Mutex::Autolock l(sLock);
         ALOGV("deleting lpCookie: %x\n", (int)lpCookie);
-        while (lpCookie->busy) {
-            if (lpCookie->cond.waitRelative(sLock,
-                                            milliseconds(CALLBACK_COND_WAIT_TIMEOUT_MS)) !=
-                                                    NO_ERROR) {
-                break;
-            }
-        }
+        waitForCallback(lpCookie);
         sAudioRecordCallBackCookies.remove(lpCookie);
         env->DeleteGlobalRef(lpCookie->audioRecord_class);
         env->DeleteGlobalRef(lpCookie->audioRecord_ref);
+        freeRing(env, lpCookie->ring);
         delete lpCookie;
     }
 }
@@ -474,6 +541,78 @@ static jint android_media_AudioRecord_readInDirectBuffer(JNIEnv *env,  jobject t
 }
 
 
+// ----------------------------------------------------------------------------
+// Makes the callback thread copy captured audio into the given direct ByteBuffer, laid out
+// as described for audiorecord_ring, instead of leaving it for the read calls. Passing null
+// detaches the current ring and goes back to read-driven capture.
+static jint android_media_AudioRecord_attachRingBuffer(JNIEnv *env,  jobject thiz,
+                                                  jobject jBuffer) {
+    sp<AudioRecord> lpRecorder = getAudioRecord(env, thiz);
+    audiorecord_callback_cookie *lpCookie = (audiorecord_callback_cookie *)env->GetIntField(
+        thiz, javaAudioRecordFields.nativeCallbackCookie);
+    if (lpRecorder == NULL || lpCookie == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+            "Unable to retrieve AudioRecord pointer for attachRingBuffer()");
+        return AUDIORECORD_ERROR;
+    }
+
+    audiorecord_ring* ring = NULL;
+    if (jBuffer != NULL) {
+        uint8_t* address = (uint8_t*) env->GetDirectBufferAddress(jBuffer);
+        jlong capacity = env->GetDirectBufferCapacity(jBuffer);
+        size_t frameSize = lpRecorder->frameSize();
+        if (address == NULL || ((uintptr_t)address & (sizeof(int32_t) - 1)) != 0
+                || capacity < (jlong)(RING_HEADER_SIZE + frameSize)
+                || capacity - RING_HEADER_SIZE > 0x7fffffff) {
+            ALOGE("Ring buffer must be an aligned direct buffer larger than %d bytes",
+                    (int)(RING_HEADER_SIZE + frameSize));
+            return AUDIORECORD_ERROR_BAD_VALUE;
+        }
+
+        ring = new audiorecord_ring;
+        ring->buffer = env->NewGlobalRef(jBuffer);
+        ring->header = (volatile int32_t*) address;
+        ring->data = address + RING_HEADER_SIZE;
+        // keep whole frames in the ring so a read never starts mid-frame
+        ring->size = (uint32_t)(capacity - RING_HEADER_SIZE) / frameSize * frameSize;
+        for (int i = 0; i < RING_HEADER_INTS; i++) {
+            ring->header[i] = 0;
+        }
+    }
+
+    audiorecord_ring* old;
+    {
+        Mutex::Autolock l(sLock);
+        old = lpCookie->ring;
+        // taking sLock also publishes the zeroed header to the callback thread
+        lpCookie->ring = ring;
+        // the callback thread may still be writing to the old ring
+        waitForCallback(lpCookie);
+    }
+    freeRing(env, old);
+    return AUDIORECORD_SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+// Returns the ring write position with acquire semantics, so that the data up to it is
+// visible to the caller.
+static jint android_media_AudioRecord_getRingPosition(JNIEnv *env,  jobject thiz) {
+    audiorecord_callback_cookie *lpCookie = (audiorecord_callback_cookie *)env->GetIntField(
+        thiz, javaAudioRecordFields.nativeCallbackCookie);
+    if (lpCookie == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+            "Unable to retrieve AudioRecord pointer for getRingPosition()");
+        return 0;
+    }
+
+    Mutex::Autolock l(sLock);
+    if (lpCookie->ring == NULL) {
+        return 0;
+    }
+    return android_atomic_acquire_load(&lpCookie->ring->header[RING_WRITE_POS]);
+}
+
+
 // ----------------------------------------------------------------------------
 static jint android_media_AudioRecord_set_marker_pos(JNIEnv *env,  jobject thiz,
         jint markerPos) {
@@ -587,6 +726,13 @@ static JNINativeMethod gMethods[] = {
                              "(III)I",   (void *)android_media_AudioRecord_get_min_buff_size},
 };
 
+// Only registered if AudioRecord declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"native_attach_ring_buffer","(Ljava/nio/ByteBuffer;)I",
+                                       (void *)android_media_AudioRecord_attachRingBuffer},
+    {"native_get_ring_position","()I", (void *)android_media_AudioRecord_getRingPosition},
+};
+
 // field names found in android/media/AudioRecord.java
 #define JAVA_POSTEVENT_CALLBACK_NAME  "postEventFromNative"
 #define JAVA_CONST_PCM16_NAME         "ENCODING_PCM_16BIT"
@@ -679,8 +825,11 @@ int register_android_media_AudioRecord(JNIEnv *env)
         return -1;
     }
 
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
             kClassPathName, gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+            kClassPathName, gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 // ----------------------------------------------------------------------------
@@ -595,6 +595,92 @@ jint writeToTrack(const sp<AudioTrack>& track, jint audioFormat, jbyte* data,
 
 }
 
+// ----------------------------------------------------------------------------
+// Copies count bytes at offset from either the Java array or, when it is NULL, the
+// native data into dst. Returns false if the array region is out of bounds, in which
+// case an exception is pending.
+static bool copyAudioData(JNIEnv *env, jbyteArray javaAudioData, const jbyte* data,
+                          jint offset, size_t count, int8_t* dst) {
+    if (javaAudioData == NULL) {
+        memcpy(dst, data + offset, count);
+        return true;
+    }
+    env->GetByteArrayRegion(javaAudioData, offset, count, (jbyte *)dst);
+    return !env->ExceptionCheck();
+}
+
+// Same as the streaming case of writeToTrack(), but only takes as much data as the
+// track's buffer has room for right now instead of waiting for AudioFlinger to
+// consume it. Returns the number of bytes taken, which may be 0.
+// The data is read from javaAudioData if it is not NULL and from data otherwise.
+// Java arrays are copied a region at a time rather than pinned in a critical section,
+// since obtainBuffer() may still make binder calls to restore a dead track.
+jint writeToTrackNonBlocking(JNIEnv *env, const sp<AudioTrack>& track, jint audioFormat,
+                             jbyteArray javaAudioData, jbyte* data,
+                             jint offsetInBytes, jint sizeInBytes) {
+    if (track->sharedBuffer() != 0) {
+        // static tracks never wait, the blocking path already returns immediately
+        if (javaAudioData == NULL) {
+            return writeToTrack(track, audioFormat, data, offsetInBytes, sizeInBytes);
+        }
+        jbyte* cAudioData = env->GetByteArrayElements(javaAudioData, NULL);
+        if (cAudioData == NULL) {
+            ALOGE("Error retrieving source of audio data to play, can't play");
+            return 0; // out of memory or no data to load
+        }
+        jint written = writeToTrack(track, audioFormat, cAudioData, offsetInBytes, sizeInBytes);
+        env->ReleaseByteArrayElements(javaAudioData, cAudioData, JNI_ABORT);
+        return written;
+    }
+
+    const size_t frameSize = track->frameSize();
+    jint offset = offsetInBytes;
+    size_t remaining = sizeInBytes;
+    jint written = 0;
+    while (remaining >= frameSize) {
+        AudioTrack::Buffer audioBuffer;
+        audioBuffer.frameCount = remaining / frameSize;
+        status_t err = track->obtainBuffer(&audioBuffer, 0 /*waitCount*/);
+        if (err == WOULD_BLOCK) {
+            break;
+        }
+        if (err < 0) {
+            return written > 0 ? written : android_media_translateErrorCode(err);
+        }
+
+        size_t toWrite;
+        bool copied;
+        if (audioFormat == javaAudioTrackFields.PCM8) {
+            // the track holds 16bit samples, expand as AudioTrack::write() does. The 8bit
+            // samples are copied into the upper half of the buffer and expanded in place,
+            // each sample is read before its slot is overwritten.
+            toWrite = audioBuffer.size >> 1;
+            const int8_t *src = audioBuffer.i8 + toWrite;
+            copied = copyAudioData(env, javaAudioData, data, offset, toWrite,
+                    audioBuffer.i8 + toWrite);
+            int16_t *dst = audioBuffer.i16;
+            for (size_t i = 0; copied && i < toWrite; i++) {
+                *dst++ = (int16_t)(src[i]^0x80) << 8;
+            }
+        } else {
+            toWrite = audioBuffer.size;
+            copied = copyAudioData(env, javaAudioData, data, offset, toWrite, audioBuffer.i8);
+        }
+        if (!copied) {
+            audioBuffer.size = 0;
+            audioBuffer.frameCount = 0;
+            track->releaseBuffer(&audioBuffer);
+            return written;
+        }
+        track->releaseBuffer(&audioBuffer);
+
+        offset += toWrite;
+        remaining -= toWrite;
+        written += toWrite;
+    }
+    return written;
+}
+
 // ----------------------------------------------------------------------------
 static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thiz,
                                                   jbyteArray javaAudioData,
@@ -613,7 +699,8 @@ static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thi
     // NOTE: We may use GetPrimitiveArrayCritical() when the JNI implementation changes in such
     // a way that it becomes much more efficient. When doing so, we will have to prevent the
     // AudioSystem callback to be called while in critical section (in case of media server
-    // process crash for instance)
+    // process crash for instance). A blocking write can wait on AudioFlinger for as long
+    // as the audio takes to play, and even a non-blocking write may restore a dead track.
     jbyte* cAudioData = NULL;
     if (javaAudioData) {
         cAudioData = (jbyte *)env->GetByteArrayElements(javaAudioData, NULL);
@@ -636,6 +723,72 @@ static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thi
 }
 
 
+// ----------------------------------------------------------------------------
+// Non-blocking writes never wait on AudioFlinger, so they copy straight out of the
+// Java array into the track's buffer without pinning or copying the whole array.
+static jint android_media_AudioTrack_native_write_byte_nonblocking(JNIEnv *env,  jobject thiz,
+                                                  jbyteArray javaAudioData,
+                                                  jint offsetInBytes, jint sizeInBytes,
+                                                  jint javaAudioFormat) {
+    sp<AudioTrack> lpTrack = getAudioTrack(env, thiz);
+    if (lpTrack == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+            "Unable to retrieve AudioTrack pointer for write()");
+        return 0;
+    }
+
+    if (javaAudioData == NULL) {
+        ALOGE("NULL java array of audio data to play, can't play");
+        return 0;
+    }
+
+    return writeToTrackNonBlocking(env, lpTrack, javaAudioFormat, javaAudioData, NULL,
+            offsetInBytes, sizeInBytes);
+}
+
+// ----------------------------------------------------------------------------
+// Writes from a direct ByteBuffer, whose memory is handed to the track as is.
+static jint android_media_AudioTrack_native_write_native_bytes(JNIEnv *env,  jobject thiz,
+                                                  jobject javaByteBuffer,
+                                                  jint offsetInBytes, jint sizeInBytes,
+                                                  jint javaAudioFormat, jboolean isBlocking) {
+    sp<AudioTrack> lpTrack = getAudioTrack(env, thiz);
+    if (lpTrack == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+            "Unable to retrieve AudioTrack pointer for write()");
+        return 0;
+    }
+
+    jbyte* bytes = javaByteBuffer != NULL ?
+            (jbyte *)env->GetDirectBufferAddress(javaByteBuffer) : NULL;
+    if (bytes == NULL) {
+        ALOGE("Audio data is not in a direct ByteBuffer, can't play");
+        return AUDIOTRACK_ERROR_BAD_VALUE;
+    }
+    jlong capacity = env->GetDirectBufferCapacity(javaByteBuffer);
+    if (offsetInBytes < 0 || sizeInBytes < 0 || offsetInBytes + (jlong)sizeInBytes > capacity) {
+        return AUDIOTRACK_ERROR_BAD_VALUE;
+    }
+
+    if (isBlocking) {
+        return writeToTrack(lpTrack, javaAudioFormat, bytes, offsetInBytes, sizeInBytes);
+    }
+    return writeToTrackNonBlocking(env, lpTrack, javaAudioFormat, NULL, bytes,
+            offsetInBytes, sizeInBytes);
+}
+
+// ----------------------------------------------------------------------------
+static jint android_media_AudioTrack_native_write_short_nonblocking(JNIEnv *env,  jobject thiz,
+                                                  jshortArray javaAudioData,
+                                                  jint offsetInShorts, jint sizeInShorts,
+                                                  jint javaAudioFormat) {
+    return (android_media_AudioTrack_native_write_byte_nonblocking(env, thiz,
+                                                 (jbyteArray) javaAudioData,
+                                                 offsetInShorts*2, sizeInShorts*2,
+                                                 javaAudioFormat)
+            / 2);
+}
+
 // ----------------------------------------------------------------------------
 static jint android_media_AudioTrack_native_write_short(JNIEnv *env,  jobject thiz,
                                                   jshortArray javaAudioData,
@@ -910,6 +1063,17 @@ static JNINativeMethod gMethods[] = {
                              "(I)I",     (void *)android_media_AudioTrack_attachAuxEffect},
 };
 
+// Only registered if AudioTrack declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"native_write_byte_nonblocking",
+                             "([BIII)I", (void *)android_media_AudioTrack_native_write_byte_nonblocking},
+    {"native_write_short_nonblocking",
+                             "([SIII)I", (void *)android_media_AudioTrack_native_write_short_nonblocking},
+    {"native_write_native_bytes",
+                             "(Ljava/nio/ByteBuffer;IIIZ)I",
+                                         (void *)android_media_AudioTrack_native_write_native_bytes},
+};
+
 
 // field names found in android/media/AudioTrack.java
 #define JAVA_POSTEVENT_CALLBACK_NAME                    "postEventFromNative"
@@ -1072,7 +1236,11 @@ int register_android_media_AudioTrack(JNIEnv *env)
         return -1;
     }
 
-    return AndroidRuntime::registerNativeMethods(env, kClassPathName, gMethods, NELEM(gMethods));
+    int result = AndroidRuntime::registerNativeMethods(env, kClassPathName,
+            gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, kClassPathName,
+            gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 
@@ -20,6 +20,7 @@
 #include "jni.h"
 #include "utils/Log.h"
 #include "utils/misc.h"
+#include "android_runtime/AndroidRuntime.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -32,10 +33,14 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include <cutils/sockets.h>
 #include <netinet/tcp.h>
 
+// Maximum number of buffers of a single readv_native or writev_native call
+#define MAX_IOVECS 64
+
 namespace android {
 
 static jfieldID field_inboundFileDescriptors;
@@ -508,32 +513,25 @@ static int socket_process_cmsg(JNIEnv *env, jobject thisJ, struct msghdr * pMsg)
 }
 
 /**
- * Reads data from a socket into buf, processing any ancillary data
- * and adding it to thisJ.
+ * Reads data from a socket into the iovcnt buffers of iov, processing
+ * any ancillary data and adding it to thisJ.
  *
  * Returns the length of normal data read, or -1 if an exception has
  * been thrown in this function.
  */
-static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
-        void *buffer, size_t len)
+static ssize_t socket_readv_all(JNIEnv *env, jobject thisJ, int fd,
+        struct iovec *iov, int iovcnt)
 {
     ssize_t ret;
-    ssize_t bytesread = 0;
     struct msghdr msg;
-    struct iovec iv;
-    unsigned char *buf = (unsigned char *)buffer;
     // Enough buffer for a pile of fd's. We throw an exception if
     // this buffer is too small.
     struct cmsghdr cmsgbuf[2*sizeof(cmsghdr) + 0x100];
 
     memset(&msg, 0, sizeof(msg));
-    memset(&iv, 0, sizeof(iv));
-
-    iv.iov_base = buf;
-    iv.iov_len = len;
 
-    msg.msg_iov = &iv;
-    msg.msg_iovlen = 1;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
     msg.msg_control = cmsgbuf;
     msg.msg_controllen = sizeof(cmsgbuf);
 
@@ -560,7 +558,9 @@ static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
         return -1;
     }
 
-    if (ret >= 0) {
+    // The kernel sets msg_controllen to the length of the ancillary data
+    // received, which is nearly always none
+    if (msg.msg_controllen > 0) {
         socket_process_cmsg(env, thisJ, &msg);
     }
 
@@ -568,18 +568,38 @@ static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
 }
 
 /**
- * Writes all the data in the specified buffer to the specified socket.
+ * Reads data from a socket into buf, see socket_readv_all().
+ */
+static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
+        void *buffer, size_t len)
+{
+    struct iovec iv;
+
+    iv.iov_base = buffer;
+    iv.iov_len = len;
+
+    return socket_readv_all(env, thisJ, fd, &iv, 1);
+}
+
+/**
+ * Writes all the data in the iovcnt buffers of iov to the specified
+ * socket, along with any pending outbound file descriptors. The iovecs
+ * are updated as data gets written.
  *
  * Returns 0 on success or -1 if an exception was thrown.
  */
-static int socket_write_all(JNIEnv *env, jobject object, int fd,
-        void *buf, size_t len)
+static int socket_writev_all(JNIEnv *env, jobject object, int fd,
+        struct iovec *iov, int iovcnt)
 {
     ssize_t ret;
     struct msghdr msg;
-    unsigned char *buffer = (unsigned char *)buf;
+    size_t len = 0;
     memset(&msg, 0, sizeof(msg));
 
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
     jobjectArray outboundFds
             = (jobjectArray)env->GetObjectField(
                 object, field_outboundFileDescriptors);
@@ -624,14 +644,8 @@ static int socket_write_all(JNIEnv *env, jobject object, int fd,
 
     // We only write our msg_control during the first write
     while (len > 0) {
-        struct iovec iv;
-        memset(&iv, 0, sizeof(iv));
-
-        iv.iov_base = buffer;
-        iv.iov_len = len;
-
-        msg.msg_iov = &iv;
-        msg.msg_iovlen = 1;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
 
         do {
             ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
@@ -642,9 +656,19 @@ static int socket_write_all(JNIEnv *env, jobject object, int fd,
             return -1;
         }
 
-        buffer += ret;
         len -= ret;
 
+        // Skip the buffers that were fully written
+        while (iovcnt > 0 && (size_t) ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+
         // Wipes out any msg_control too
         memset(&msg, 0, sizeof(msg));
     }
@@ -652,6 +676,21 @@ static int socket_write_all(JNIEnv *env, jobject object, int fd,
     return 0;
 }
 
+/**
+ * Writes all the data in the specified buffer to the specified socket,
+ * see socket_writev_all().
+ */
+static int socket_write_all(JNIEnv *env, jobject object, int fd,
+        void *buf, size_t len)
+{
+    struct iovec iv;
+
+    iv.iov_base = buf;
+    iv.iov_len = len;
+
+    return socket_writev_all(env, object, fd, &iv, 1);
+}
+
 static jint socket_read (JNIEnv *env, jobject object, jobject fileDescriptor)
 {
     int fd;
@@ -790,6 +829,223 @@ static void socket_writeba (JNIEnv *env, jobject object,
     env->ReleaseByteArrayElements(buffer, byteBuffer, JNI_ABORT);
 }
 
+/**
+ * Returns the address of the len bytes at off in the direct ByteBuffer
+ * buffer, or NULL if an exception was thrown.
+ */
+static void* socket_get_direct_buffer(JNIEnv *env, jobject buffer,
+        jint off, jint len)
+{
+    if (buffer == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return NULL;
+    }
+
+    unsigned char *address = (unsigned char *)env->GetDirectBufferAddress(buffer);
+
+    if (address == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "not a direct buffer");
+        return NULL;
+    }
+
+    if (off < 0 || len < 0 || len > env->GetDirectBufferCapacity(buffer) - off) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return NULL;
+    }
+
+    return address + off;
+}
+
+/**
+ * Fills iov with the regions of the direct ByteBuffers described by
+ * buffers, offsets and lengths.
+ *
+ * Returns the number of iovecs, or -1 if an exception was thrown.
+ */
+static int socket_get_iovecs(JNIEnv *env, jobjectArray buffers,
+        jintArray offsets, jintArray lengths, struct iovec *iov, int maxcnt)
+{
+    if (buffers == NULL || offsets == NULL || lengths == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return -1;
+    }
+
+    int count = env->GetArrayLength(buffers);
+
+    if (count > maxcnt || env->GetArrayLength(offsets) != count
+            || env->GetArrayLength(lengths) != count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return -1;
+    }
+
+    jint offs[count];
+    jint lens[count];
+    env->GetIntArrayRegion(offsets, 0, count, offs);
+    env->GetIntArrayRegion(lengths, 0, count, lens);
+
+    for (int i = 0; i < count; i++) {
+        jobject buffer = env->GetObjectArrayElement(buffers, i);
+        if (env->ExceptionOccurred() != NULL) {
+            return -1;
+        }
+
+        iov[i].iov_base = socket_get_direct_buffer(env, buffer, offs[i], lens[i]);
+        iov[i].iov_len = lens[i];
+
+        env->DeleteLocalRef(buffer);
+
+        if (iov[i].iov_base == NULL) {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+static jint socket_read_direct (JNIEnv *env, jobject object,
+        jobject buffer, jint off, jint len, jobject fileDescriptor)
+{
+    int fd;
+    void *address;
+    int ret;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return (jint)-1;
+    }
+
+    address = socket_get_direct_buffer(env, buffer, off, len);
+
+    if (address == NULL) {
+        return (jint)-1;
+    }
+
+    if (len == 0) {
+        // because socket_read_all returns 0 on EOF
+        return 0;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return (jint)-1;
+    }
+
+    // The memory of a direct buffer does not move, no copy is needed
+    ret = socket_read_all(env, object, fd, address, len);
+
+    // A return of -1 above means an exception is pending
+
+    return (jint) ((ret == 0) ? -1 : ret);
+}
+
+static void socket_write_direct (JNIEnv *env, jobject object,
+        jobject buffer, jint off, jint len, jobject fileDescriptor)
+{
+    int fd;
+    void *address;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    address = socket_get_direct_buffer(env, buffer, off, len);
+
+    if (address == NULL) {
+        return;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+
+    socket_write_all(env, object, fd, address, len);
+
+    // A return of -1 above means an exception is pending
+}
+
+/*
+ * Reads into several direct ByteBuffers with a single recvmsg(), filling
+ * them in order. Returns the number of bytes read, or -1 on end of stream.
+ */
+static jint socket_readv (JNIEnv *env, jobject object, jobjectArray buffers,
+        jintArray offsets, jintArray lengths, jobject fileDescriptor)
+{
+    int fd;
+    struct iovec iov[MAX_IOVECS];
+    int iovcnt;
+    size_t len = 0;
+    int ret;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return (jint)-1;
+    }
+
+    iovcnt = socket_get_iovecs(env, buffers, offsets, lengths, iov, MAX_IOVECS);
+
+    if (iovcnt < 0) {
+        return (jint)-1;
+    }
+
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
+    if (len == 0) {
+        // because socket_readv_all returns 0 on EOF
+        return 0;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return (jint)-1;
+    }
+
+    ret = socket_readv_all(env, object, fd, iov, iovcnt);
+
+    // A return of -1 above means an exception is pending
+
+    return (jint) ((ret == 0) ? -1 : ret);
+}
+
+/*
+ * Writes all the data of several direct ByteBuffers, gathered by sendmsg().
+ */
+static void socket_writev (JNIEnv *env, jobject object, jobjectArray buffers,
+        jintArray offsets, jintArray lengths, jobject fileDescriptor)
+{
+    int fd;
+    struct iovec iov[MAX_IOVECS];
+    int iovcnt;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    iovcnt = socket_get_iovecs(env, buffers, offsets, lengths, iov, MAX_IOVECS);
+
+    if (iovcnt < 0) {
+        return;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+
+    socket_writev_all(env, object, fd, iov, iovcnt);
+
+    // A return of -1 above means an exception is pending
+}
+
 static jobject socket_get_peer_credentials(JNIEnv *env,
         jobject object, jobject fileDescriptor)
 {
@@ -906,6 +1162,18 @@ static JNINativeMethod gMethods[] = {
 
 };
 
+// Only registered if LocalSocketImpl declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"readDirect_native", "(Ljava/nio/ByteBuffer;IILjava/io/FileDescriptor;)I",
+            (void*) socket_read_direct},
+    {"writeDirect_native", "(Ljava/nio/ByteBuffer;IILjava/io/FileDescriptor;)V",
+            (void*) socket_write_direct},
+    {"readv_native", "([Ljava/nio/ByteBuffer;[I[ILjava/io/FileDescriptor;)I",
+            (void*) socket_readv},
+    {"writev_native", "([Ljava/nio/ByteBuffer;[I[ILjava/io/FileDescriptor;)V",
+            (void*) socket_writev},
+};
+
 int register_android_net_LocalSocketImpl(JNIEnv *env)
 {
     jclass clazz;
@@ -953,8 +1221,15 @@ int register_android_net_LocalSocketImpl(JNIEnv *env)
         goto error;
     }
 
-    return jniRegisterNativeMethods(env,
+    int result;
+
+    result = jniRegisterNativeMethods(env,
         "android/net/LocalSocketImpl", gMethods, NELEM(gMethods));
+    if (result == 0) {
+        AndroidRuntime::registerOptionalNativeMethods(env,
+            "android/net/LocalSocketImpl", gOptionalMethods, NELEM(gOptionalMethods));
+    }
+    return result;
 
 error:
     ALOGE("Error registering android.net.LocalSocketImpl");
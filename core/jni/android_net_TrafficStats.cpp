@@ -28,11 +28,19 @@
 #include <ScopedUtfChars.h>
 #include <utils/misc.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 namespace android {
 
 static const uint64_t VALUE_UNKNOWN = -1;
 static const char* IFACE_STAT_ALL = "/proc/net/xt_qtaguid/iface_stat_all";
+static const char* UID_STAT_DIR = "/proc/uid_stat";
+
+// Parsed snapshots are reused for this long, since stats polling asks for many
+// counters of the same instant one at a time
+static const nsecs_t STAT_CACHE_TTL = ms2ns(200);
 
 enum Tx_Rx {
     TX,
@@ -60,6 +68,22 @@ struct IfaceStat {
     uint64_t txPackets;
 };
 
+struct IfaceEntry {
+    char iface[32];
+    IfaceStat stat;
+};
+
+struct UidEntry {
+    int uid;
+    IfaceStat stat;
+};
+
+static Mutex gSnapshotLock;
+static Vector<IfaceEntry> gIfaceSnapshot;
+static nsecs_t gIfaceSnapshotTime = 0;
+static Vector<UidEntry> gUidSnapshot;
+static nsecs_t gUidSnapshotTime = 0;
+
 // Returns an ASCII decimal number read from the specified file, -1 on error.
 static jlong readNumber(char const* filename) {
     char buf[80];
@@ -81,44 +105,145 @@ static jlong readNumber(char const* filename) {
     return atoll(buf);
 }
 
-static int parseIfaceStat(const char* iface, struct IfaceStat* stat) {
+// Same as readNumber(), relative to an open directory.
+static jlong readNumberAt(int dirfd, char const* filename) {
+    char buf[80];
+    int fd = openat(dirfd, filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+
+    buf[len] = '\0';
+    return atoll(buf);
+}
+
+// Reads every interface of IFACE_STAT_ALL in one pass. Called with gSnapshotLock held.
+static int loadIfaceSnapshot() {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (gIfaceSnapshotTime != 0 && now - gIfaceSnapshotTime < STAT_CACHE_TTL) {
+        return 0;
+    }
+
     FILE *fp = fopen(IFACE_STAT_ALL, "r");
     if (!fp) {
         return errno;
     }
 
     char buffer[256];
-    char cur_iface[32];
+    IfaceEntry entry;
     int active;
     uint64_t rxBytes, rxPackets, txBytes, txPackets, devRxBytes, devRxPackets, devTxBytes,
             devTxPackets;
 
+    gIfaceSnapshot.clear();
     while (fgets(buffer, 256, fp) != NULL) {
-        if (sscanf(buffer, "%31s %d %llu %llu %llu %llu %llu %llu %llu %llu", cur_iface, &active,
+        if (sscanf(buffer, "%31s %d %llu %llu %llu %llu %llu %llu %llu %llu", entry.iface, &active,
                    &rxBytes, &rxPackets, &txBytes, &txPackets, &devRxBytes, &devRxPackets,
                    &devTxBytes, &devTxPackets) != 10) {
             continue;
         }
 
-        if (!iface || !strcmp(iface, cur_iface)) {
-            stat->rxBytes += rxBytes;
-            stat->rxPackets += rxPackets;
-            stat->txBytes += txBytes;
-            stat->txPackets += txPackets;
-
-            if (active) {
-                stat->rxBytes += devRxBytes;
-                stat->rxPackets += devRxPackets;
-                stat->txBytes += devTxBytes;
-                stat->txPackets += devTxPackets;
-            }
+        entry.stat.rxBytes = rxBytes;
+        entry.stat.rxPackets = rxPackets;
+        entry.stat.txBytes = txBytes;
+        entry.stat.txPackets = txPackets;
+
+        if (active) {
+            entry.stat.rxBytes += devRxBytes;
+            entry.stat.rxPackets += devRxPackets;
+            entry.stat.txBytes += devTxBytes;
+            entry.stat.txPackets += devTxPackets;
         }
+        gIfaceSnapshot.add(entry);
     }
 
     fclose(fp);
+    gIfaceSnapshotTime = now;
+    return 0;
+}
+
+static int parseIfaceStat(const char* iface, struct IfaceStat* stat) {
+    AutoMutex _l(gSnapshotLock);
+    int err = loadIfaceSnapshot();
+    if (err) {
+        return err;
+    }
+
+    for (size_t i = 0; i < gIfaceSnapshot.size(); i++) {
+        const IfaceEntry& entry = gIfaceSnapshot[i];
+        if (!iface || !strcmp(iface, entry.iface)) {
+            stat->rxBytes += entry.stat.rxBytes;
+            stat->rxPackets += entry.stat.rxPackets;
+            stat->txBytes += entry.stat.txBytes;
+            stat->txPackets += entry.stat.txPackets;
+        }
+    }
     return 0;
 }
 
+// Missing files count as zero, as in getUidBytes() and getUidPkts() for TCP_AND_UDP.
+static uint64_t sumNumbersAt(int dirfd, char const* tcpFilename, char const* udpFilename) {
+    jlong tcp = readNumberAt(dirfd, tcpFilename);
+    jlong udp = readNumberAt(dirfd, udpFilename);
+    return (tcp >= 0 ? tcp : 0) + (udp >= 0 ? udp : 0);
+}
+
+// Reads the TCP plus UDP counters of every UID in UID_STAT_DIR. Called with
+// gSnapshotLock held.
+static int loadUidSnapshot() {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (gUidSnapshotTime != 0 && now - gUidSnapshotTime < STAT_CACHE_TTL) {
+        return 0;
+    }
+
+    DIR* dir = opendir(UID_STAT_DIR);
+    if (dir == NULL) {
+        return errno;
+    }
+
+    gUidSnapshot.clear();
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL) {
+        char* end;
+        long uid = strtol(de->d_name, &end, 10);
+        if (de->d_name[0] == '\0' || *end != '\0') {
+            continue;
+        }
+
+        int uidfd = openat(dirfd(dir), de->d_name, O_RDONLY | O_DIRECTORY);
+        if (uidfd < 0) {
+            continue;
+        }
+
+        UidEntry entry;
+        entry.uid = uid;
+        entry.stat.rxBytes = sumNumbersAt(uidfd, "tcp_rcv", "udp_rcv");
+        entry.stat.rxPackets = sumNumbersAt(uidfd, "tcp_rcv_pkt", "udp_rcv_pkt");
+        entry.stat.txBytes = sumNumbersAt(uidfd, "tcp_snd", "udp_snd");
+        entry.stat.txPackets = sumNumbersAt(uidfd, "tcp_snd_pkt", "udp_snd_pkt");
+        close(uidfd);
+
+        gUidSnapshot.add(entry);
+    }
+
+    closedir(dir);
+    gUidSnapshotTime = now;
+    return 0;
+}
+
+static void packIfaceStat(jlong* out, const IfaceStat& stat) {
+    out[RX_BYTES] = stat.rxBytes;
+    out[RX_PACKETS] = stat.rxPackets;
+    out[TX_BYTES] = stat.txBytes;
+    out[TX_PACKETS] = stat.txPackets;
+}
+
 static uint64_t getIfaceStatType(const char* iface, IfaceStatType type) {
     struct IfaceStat stat;
     memset(&stat, 0, sizeof(IfaceStat));
@@ -157,6 +282,67 @@ static jlong getIfaceStat(JNIEnv* env, jclass clazz, jstring iface, jint type) {
     }
 }
 
+/*
+ * Fills names[i] and stats[4 * i ... 4 * i + 3], indexed by IfaceStatType, for
+ * every interface at once. Returns the number of interfaces, after filling
+ * nothing if either array is too small, or -1 if the stats cannot be read.
+ */
+static jint getIfaceStats(JNIEnv* env, jclass clazz, jobjectArray names, jlongArray stats) {
+    AutoMutex _l(gSnapshotLock);
+    if (loadIfaceSnapshot()) {
+        return -1;
+    }
+
+    jint count = gIfaceSnapshot.size();
+    if (names == NULL || stats == NULL || env->GetArrayLength(names) < count
+            || env->GetArrayLength(stats) < count * 4) {
+        return count;
+    }
+
+    for (jint i = 0; i < count; i++) {
+        const IfaceEntry& entry = gIfaceSnapshot[i];
+        jstring name = env->NewStringUTF(entry.iface);
+        if (name == NULL) {
+            return -1;
+        }
+        env->SetObjectArrayElement(names, i, name);
+        env->DeleteLocalRef(name);
+
+        jlong values[4];
+        packIfaceStat(values, entry.stat);
+        env->SetLongArrayRegion(stats, i * 4, 4, values);
+    }
+    return count;
+}
+
+/*
+ * Fills uids[i] and stats[4 * i ... 4 * i + 3], indexed by IfaceStatType, with
+ * the TCP plus UDP totals of every UID at once. Same return value as
+ * getIfaceStats().
+ */
+static jint getUidStats(JNIEnv* env, jclass clazz, jintArray uids, jlongArray stats) {
+    AutoMutex _l(gSnapshotLock);
+    if (loadUidSnapshot()) {
+        return -1;
+    }
+
+    jint count = gUidSnapshot.size();
+    if (uids == NULL || stats == NULL || env->GetArrayLength(uids) < count
+            || env->GetArrayLength(stats) < count * 4) {
+        return count;
+    }
+
+    for (jint i = 0; i < count; i++) {
+        const UidEntry& entry = gUidSnapshot[i];
+        jint uid = entry.uid;
+        env->SetIntArrayRegion(uids, i, 1, &uid);
+
+        jlong values[4];
+        packIfaceStat(values, entry.stat);
+        env->SetLongArrayRegion(stats, i * 4, 4, values);
+    }
+    return count;
+}
 
 // Per-UID stats require reading from a constructed filename.
 
@@ -313,9 +499,18 @@ static JNINativeMethod gMethods[] = {
     {"getUidUdpRxPackets", "(I)J", (void*) getUidUdpRxPackets},
 };
 
+/* Whole-table snapshots, only registered if TrafficStats declares them */
+static JNINativeMethod gOptionalMethods[] = {
+    {"nativeGetIfaceStats", "([Ljava/lang/String;[J)I", (void*) getIfaceStats},
+    {"nativeGetUidStats", "([I[J)I", (void*) getUidStats},
+};
+
 int register_android_net_TrafficStats(JNIEnv* env) {
-    return AndroidRuntime::registerNativeMethods(env, "android/net/TrafficStats",
+    int result = AndroidRuntime::registerNativeMethods(env, "android/net/TrafficStats",
             gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/net/TrafficStats",
+            gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 }
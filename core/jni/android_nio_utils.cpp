@@ -22,6 +22,9 @@ struct NioJNIData {
     jmethodID getBasePointerID;
     jmethodID getBaseArrayID;
     jmethodID getBaseArrayOffsetID;
+
+    jfieldID positionID;
+    jfieldID elementSizeShiftID;
 };
 
 static NioJNIData gNioJNI;
@@ -33,6 +36,16 @@ void* android::nio_getPointer(JNIEnv *_env, jobject buffer, jarray *array) {
     jint offset;
     void *data;
 
+    // Direct buffers: the base address is kept by the VM, so only the
+    // position needs to be applied and no Java code has to run.
+    data = _env->GetDirectBufferAddress(buffer);
+    if (data != NULL) {
+        jint position = _env->GetIntField(buffer, gNioJNI.positionID);
+        jint elementSizeShift = _env->GetIntField(buffer, gNioJNI.elementSizeShiftID);
+        *array = NULL;
+        return (void *) ((char *) data + (position << elementSizeShift));
+    }
+
     pointer = _env->CallStaticLongMethod(gNioJNI.nioAccessClass,
                                          gNioJNI.getBasePointerID, buffer);
     if (pointer != 0L) {
@@ -107,6 +120,10 @@ int register_android_nio_utils(JNIEnv* env) {
     // now record a permanent version of the class ID
     gNioJNI.nioAccessClass = (jclass) env->NewGlobalRef(localClass);
 
+    jclass bufferClass = findClass(env, "java/nio/Buffer");
+    gNioJNI.positionID = getFieldID(env, bufferClass, "position", "I");
+    gNioJNI.elementSizeShiftID = getFieldID(env, bufferClass, "_elementSizeShift", "I");
+
     return 0;
 }
 
@@ -83,6 +83,15 @@ getPointer(JNIEnv *_env, jobject buffer, jarray *array, jint *remaining)
     limit = _env->GetIntField(buffer, limitID);
     elementSizeShift = _env->GetIntField(buffer, elementSizeShiftID);
     *remaining = (limit - position) << elementSizeShift;
+
+    // Direct buffers carry their base address; reading it avoids the
+    // upcall into NIOAccess on every call.
+    data = _env->GetDirectBufferAddress(buffer);
+    if (data != NULL) {
+        *array = NULL;
+        return (void *) ((char *) data + (position << elementSizeShift));
+    }
+
     pointer = _env->CallStaticLongMethod(nioAccessClass,
             getBasePointerID, buffer);
     if (pointer != 0L) {
@@ -76,6 +76,15 @@ getPointer(JNIEnv *_env, jobject buffer, jarray *array, jint *remaining)
     limit = _env->GetIntField(buffer, limitID);
     elementSizeShift = _env->GetIntField(buffer, elementSizeShiftID);
     *remaining = (limit - position) << elementSizeShift;
+
+    // Direct buffers carry their base address; reading it avoids the
+    // upcall into NIOAccess on every call.
+    data = _env->GetDirectBufferAddress(buffer);
+    if (data != NULL) {
+        *array = NULL;
+        return (void *) ((char *) data + (position << elementSizeShift));
+    }
+
     pointer = _env->CallStaticLongMethod(nioAccessClass,
             getBasePointerID, buffer);
     if (pointer != 0L) {
@@ -126,6 +135,152 @@ static void glVertexAttribPointerBounds(GLuint indx, GLint size, GLenum type,
     glVertexAttribPointer(indx, size, type, normalized, stride, pointer);
 }
 
+/*
+ * Bulk uniform upload. Each command is three ints: the uniform type
+ * (GL_FLOAT ... GL_FLOAT_MAT4, GL_INT ... GL_INT_VEC4), the location and
+ * the element count. Values are taken in order from the float or int data
+ * array depending on the type, so an entire draw's uniforms go down in a
+ * single JNI call.
+ */
+
+static int
+uniformComponents(GLenum type, bool *isInt) {
+    *isInt = false;
+    switch (type) {
+        case GL_FLOAT:      return 1;
+        case GL_FLOAT_VEC2: return 2;
+        case GL_FLOAT_VEC3: return 3;
+        case GL_FLOAT_VEC4: return 4;
+        case GL_FLOAT_MAT2: return 4;
+        case GL_FLOAT_MAT3: return 9;
+        case GL_FLOAT_MAT4: return 16;
+    }
+    *isInt = true;
+    switch (type) {
+        case GL_INT:        return 1;
+        case GL_INT_VEC2:   return 2;
+        case GL_INT_VEC3:   return 3;
+        case GL_INT_VEC4:   return 4;
+    }
+    return 0;
+}
+
+static void
+uploadUniform(GLenum type, GLint location, GLsizei count,
+        const GLfloat *f, const GLint *i) {
+    switch (type) {
+        case GL_FLOAT:      glUniform1fv(location, count, f); break;
+        case GL_FLOAT_VEC2: glUniform2fv(location, count, f); break;
+        case GL_FLOAT_VEC3: glUniform3fv(location, count, f); break;
+        case GL_FLOAT_VEC4: glUniform4fv(location, count, f); break;
+        case GL_FLOAT_MAT2: glUniformMatrix2fv(location, count, GL_FALSE, f); break;
+        case GL_FLOAT_MAT3: glUniformMatrix3fv(location, count, GL_FALSE, f); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(location, count, GL_FALSE, f); break;
+        case GL_INT:        glUniform1iv(location, count, i); break;
+        case GL_INT_VEC2:   glUniform2iv(location, count, i); break;
+        case GL_INT_VEC3:   glUniform3iv(location, count, i); break;
+        case GL_INT_VEC4:   glUniform4iv(location, count, i); break;
+    }
+}
+
+static void
+android_glUniformBulk___3II_3FI_3II
+  (JNIEnv *_env, jobject _this, jintArray commands_ref, jint commandsOffset,
+        jint commandCount, jfloatArray floats_ref, jint floatsOffset,
+        jintArray ints_ref, jint intsOffset) {
+    jint *commands_base = (jint *) 0;
+    GLfloat *floats_base = (GLfloat *) 0;
+    GLint *ints_base = (GLint *) 0;
+    jint floatsRemaining = 0;
+    jint intsRemaining = 0;
+    jint floatsNeeded = 0;
+    jint intsNeeded = 0;
+    const jint *commands;
+    const GLfloat *f;
+    const GLint *i;
+
+    if (!commands_ref) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException", "commands == null");
+        return;
+    }
+    if (commandsOffset < 0 || commandCount < 0 || floatsOffset < 0 || intsOffset < 0) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException", "offset < 0");
+        return;
+    }
+    // Divide rather than multiply so a huge commandCount cannot overflow.
+    if (commandsOffset > _env->GetArrayLength(commands_ref)
+            || commandCount > (_env->GetArrayLength(commands_ref) - commandsOffset) / 3) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException",
+                "length - commandsOffset < commandCount * 3");
+        return;
+    }
+    if (floats_ref) {
+        floatsRemaining = _env->GetArrayLength(floats_ref) - floatsOffset;
+    }
+    if (ints_ref) {
+        intsRemaining = _env->GetArrayLength(ints_ref) - intsOffset;
+    }
+
+    // Validate everything before any array is pinned.
+    commands_base = (jint *) _env->GetIntArrayElements(commands_ref, (jboolean *)0);
+    if (!commands_base) {
+        return;
+    }
+    commands = commands_base + commandsOffset;
+    for (jint c = 0; c < commandCount; c++) {
+        bool isInt;
+        int n = uniformComponents((GLenum)commands[c * 3], &isInt);
+        jint count = commands[c * 3 + 2];
+        if (n == 0 || count < 0) {
+            _env->ReleaseIntArrayElements(commands_ref, commands_base, JNI_ABORT);
+            jniThrowException(_env, "java/lang/IllegalArgumentException",
+                    "invalid uniform command");
+            return;
+        }
+        jint* needed = isInt ? &intsNeeded : &floatsNeeded;
+        jint available = isInt ? intsRemaining : floatsRemaining;
+        if (count > (available - *needed) / n) {
+            _env->ReleaseIntArrayElements(commands_ref, commands_base, JNI_ABORT);
+            jniThrowException(_env, "java/lang/IllegalArgumentException",
+                    isInt ? "ints remaining too small" : "floats remaining too small");
+            return;
+        }
+        *needed += count * n;
+    }
+
+    if (floatsNeeded > 0) {
+        floats_base = (GLfloat *)
+            _env->GetPrimitiveArrayCritical(floats_ref, (jboolean *)0);
+    }
+    if (intsNeeded > 0) {
+        ints_base = (GLint *)
+            _env->GetPrimitiveArrayCritical(ints_ref, (jboolean *)0);
+    }
+    f = floats_base ? floats_base + floatsOffset : (GLfloat *) 0;
+    i = ints_base ? ints_base + intsOffset : (GLint *) 0;
+
+    for (jint c = 0; c < commandCount; c++) {
+        bool isInt;
+        GLenum type = (GLenum)commands[c * 3];
+        GLsizei count = (GLsizei)commands[c * 3 + 2];
+        int n = uniformComponents(type, &isInt);
+        uploadUniform(type, (GLint)commands[c * 3 + 1], count, f, i);
+        if (isInt) {
+            i += count * n;
+        } else {
+            f += count * n;
+        }
+    }
+
+    if (ints_base) {
+        _env->ReleasePrimitiveArrayCritical(ints_ref, ints_base, JNI_ABORT);
+    }
+    if (floats_base) {
+        _env->ReleasePrimitiveArrayCritical(floats_ref, floats_base, JNI_ABORT);
+    }
+    _env->ReleaseIntArrayElements(commands_ref, commands_base, JNI_ABORT);
+}
+
 // --------------------------------------------------------------------------
 /* void glActiveTexture ( GLenum texture ) */
 static void
@@ -5059,9 +5214,16 @@ static JNINativeMethod methods[] = {
 {"glViewport", "(IIII)V", (void *) android_glViewport__IIII },
 };
 
+// Only registered if GLES20 declares them
+static JNINativeMethod optionalMethods[] = {
+{"glUniformBulk", "([II[FI[II)V", (void *) android_glUniformBulk___3II_3FI_3II },
+};
+
 int register_android_opengl_jni_GLES20(JNIEnv *_env)
 {
     int err;
     err = android::AndroidRuntime::registerNativeMethods(_env, classPathName, methods, NELEM(methods));
+    android::AndroidRuntime::registerOptionalNativeMethods(_env, classPathName,
+            optionalMethods, NELEM(optionalMethods));
     return err;
 }
@@ -17,6 +17,7 @@
 #define LOG_TAG "android.os.Debug"
 #include "JNIHelp.h"
 #include "jni.h"
+#include <android_runtime/AndroidRuntime.h>
 #include <utils/String8.h>
 #include "utils/misc.h"
 #include "cutils/debugger.h"
@@ -117,127 +118,240 @@ static jlong android_os_Debug_getNativeHeapFreeSize(JNIEnv *env, jobject clazz)
 #endif
 }
 
-static void read_mapinfo(FILE *fp, stats_t* stats)
+/*
+ * /proc/<pid>/smaps of a large process runs to hundreds of KB, so it is read
+ * with a few big read() calls and tokenized in place instead of line by line
+ * with fgets() and sscanf().
+ */
+struct smaps_buffer {
+    char* data;
+    size_t size;
+};
+
+#define SMAPS_INITIAL_CAPACITY (64 * 1024)
+
+static bool read_smaps(int pid, smaps_buffer* buf)
 {
-    char line[1024];
-    int len, nameLen;
-    bool skip, done = false;
+    char tmp[128];
+    sprintf(tmp, "/proc/%d/smaps", pid);
+    int fd = open(tmp, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
 
-    unsigned size = 0, resident = 0, pss = 0;
-    unsigned shared_clean = 0, shared_dirty = 0;
-    unsigned private_clean = 0, private_dirty = 0;
-    unsigned referenced = 0;
-    unsigned temp;
+    size_t capacity = SMAPS_INITIAL_CAPACITY;
+    buf->data = (char*)malloc(capacity);
+    buf->size = 0;
+    while (buf->data != NULL) {
+        if (buf->size == capacity) {
+            capacity *= 2;
+            char* data = (char*)realloc(buf->data, capacity);
+            if (data == NULL) {
+                free(buf->data);
+                buf->data = NULL;
+                break;
+            }
+            buf->data = data;
+        }
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, buf->data + buf->size, capacity - buf->size));
+        if (n <= 0) {
+            break;
+        }
+        buf->size += n;
+    }
+    close(fd);
+    return buf->data != NULL;
+}
 
-    unsigned long int start;
-    unsigned long int end = 0;
-    unsigned long int prevEnd = 0;
-    char* name;
-    int name_pos;
+static inline const char* next_line(const char* p, const char* end)
+{
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    return nl != NULL ? nl + 1 : end;
+}
 
-    int whichHeap = HEAP_UNKNOWN;
-    int prevHeap = HEAP_UNKNOWN;
+static inline bool line_starts_with(const char* p, const char* end,
+                                    const char* prefix, size_t prefixLen)
+{
+    return size_t(end - p) >= prefixLen && memcmp(p, prefix, prefixLen) == 0;
+}
 
-    if(fgets(line, sizeof(line), fp) == 0) return;
+#define LINE_STARTS_WITH(p, end, prefix) line_starts_with(p, end, prefix, sizeof(prefix) - 1)
 
-    while (!done) {
-        prevHeap = whichHeap;
-        prevEnd = end;
-        whichHeap = HEAP_UNKNOWN;
-        skip = false;
+static inline int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
 
-        len = strlen(line);
-        if (len < 1) return;
-        line[--len] = 0;
+static const char* parse_hex(const char* p, const char* end, unsigned long* value)
+{
+    unsigned long v = 0;
+    const char* start = p;
+    int digit;
+    while (p < end && (digit = hex_digit(*p)) >= 0) {
+        v = (v << 4) | digit;
+        p++;
+    }
+    *value = v;
+    return p != start ? p : NULL;
+}
 
-        if (sscanf(line, "%lx-%lx %*s %*x %*x:%*x %*d%n", &start, &end, &name_pos) != 2) {
-            skip = true;
-        } else {
-            while (isspace(line[name_pos])) {
-                name_pos += 1;
-            }
-            name = line + name_pos;
-            nameLen = strlen(name);
-
-            if (strstr(name, "[heap]") == name) {
-                whichHeap = HEAP_NATIVE;
-            } else if (strstr(name, "/dev/ashmem/dalvik-") == name) {
-                whichHeap = HEAP_DALVIK;
-            } else if (strstr(name, "/dev/ashmem/CursorWindow") == name) {
-                whichHeap = HEAP_CURSOR;
-            } else if (strstr(name, "/dev/ashmem/") == name) {
-                whichHeap = HEAP_ASHMEM;
-            } else if (strstr(name, "/dev/") == name) {
-                whichHeap = HEAP_UNKNOWN_DEV;
-            } else if (nameLen > 3 && strcmp(name+nameLen-3, ".so") == 0) {
-                whichHeap = HEAP_SO;
-            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".jar") == 0) {
-                whichHeap = HEAP_JAR;
-            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".apk") == 0) {
-                whichHeap = HEAP_APK;
-            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".ttf") == 0) {
-                whichHeap = HEAP_TTF;
-            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".dex") == 0) {
-                whichHeap = HEAP_DEX;
-            } else if (nameLen > 0) {
-                whichHeap = HEAP_UNKNOWN_MAP;
-            } else if (start == prevEnd && prevHeap == HEAP_SO) {
-                // bss section of a shared library.
-                whichHeap = HEAP_SO;
-            }
+// Returns the value of a "Name:   1234 kB" line, given the end of its name.
+static unsigned parse_kb(const char* p, const char* end)
+{
+    while (p < end && *p == ' ') {
+        p++;
+    }
+    unsigned v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (*p++ - '0');
+    }
+    return v;
+}
+
+static inline const char* skip_field(const char* p, const char* end)
+{
+    while (p < end && *p == ' ') p++;
+    while (p < end && *p != ' ') p++;
+    return p;
+}
+
+static inline bool ends_with(const char* name, size_t nameLen, const char* suffix, size_t suffixLen)
+{
+    return nameLen > suffixLen && memcmp(name + nameLen - suffixLen, suffix, suffixLen) == 0;
+}
+
+#define NAME_STARTS_WITH(name, len, prefix) line_starts_with(name, name + len, prefix, sizeof(prefix) - 1)
+#define NAME_ENDS_WITH(name, len, suffix) ends_with(name, len, suffix, sizeof(suffix) - 1)
+
+static int classify_mapping(const char* name, size_t nameLen, unsigned long start,
+                            unsigned long prevEnd, int prevHeap)
+{
+    if (NAME_STARTS_WITH(name, nameLen, "[heap]")) {
+        return HEAP_NATIVE;
+    } else if (NAME_STARTS_WITH(name, nameLen, "/dev/")) {
+        if (NAME_STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-")) {
+            return HEAP_DALVIK;
+        } else if (NAME_STARTS_WITH(name, nameLen, "/dev/ashmem/CursorWindow")) {
+            return HEAP_CURSOR;
+        } else if (NAME_STARTS_WITH(name, nameLen, "/dev/ashmem/")) {
+            return HEAP_ASHMEM;
         }
+        return HEAP_UNKNOWN_DEV;
+    } else if (NAME_ENDS_WITH(name, nameLen, ".so")) {
+        return HEAP_SO;
+    } else if (NAME_ENDS_WITH(name, nameLen, ".jar")) {
+        return HEAP_JAR;
+    } else if (NAME_ENDS_WITH(name, nameLen, ".apk")) {
+        return HEAP_APK;
+    } else if (NAME_ENDS_WITH(name, nameLen, ".ttf")) {
+        return HEAP_TTF;
+    } else if (NAME_ENDS_WITH(name, nameLen, ".dex")) {
+        return HEAP_DEX;
+    } else if (nameLen > 0) {
+        return HEAP_UNKNOWN_MAP;
+    } else if (start == prevEnd && prevHeap == HEAP_SO) {
+        // bss section of a shared library.
+        return HEAP_SO;
+    }
+    return HEAP_UNKNOWN;
+}
 
-        //ALOGI("native=%d dalvik=%d sqlite=%d: %s\n", isNativeHeap, isDalvikHeap,
-        //    isSqliteHeap, line);
-            
-        while (true) {
-            if (fgets(line, 1024, fp) == 0) {
-                done = true;
-                break;
+/*
+ * Parses a mapping header such as
+ * "10000000-10001000 ---p 10000000 00:00 0          /system/lib/libc.so".
+ * Attribute lines start with an upper case name, so they never parse as one.
+ */
+static bool parse_mapping_header(const char* p, const char* end, unsigned long* start,
+                                 unsigned long* mapEnd, const char** name, size_t* nameLen)
+{
+    p = parse_hex(p, end, start);
+    if (p == NULL || p == end || *p != '-') {
+        return false;
+    }
+    p = parse_hex(p + 1, end, mapEnd);
+    if (p == NULL || p == end || *p != ' ') {
+        return false;
+    }
+
+    // permissions, offset, device and inode
+    for (int i = 0; i < 4; i++) {
+        p = skip_field(p, end);
+    }
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    const char* nameEnd = end;
+    if (nameEnd > p && nameEnd[-1] == '\n') {
+        nameEnd--;
+    }
+    *name = p;
+    *nameLen = nameEnd - p;
+    return true;
+}
+
+static void read_mapinfo(const char* data, size_t size, stats_t* stats)
+{
+    const char* limit = data + size;
+
+    unsigned pss = 0, shared_dirty = 0, private_dirty = 0;
+    unsigned long start = 0, end = 0, prevEnd = 0;
+    int whichHeap = HEAP_UNKNOWN;
+    int prevHeap = HEAP_UNKNOWN;
+    bool inMapping = false;
+    bool skip = false;
+
+    for (const char* p = data; p < limit; ) {
+        const char* next = next_line(p, limit);
+
+        if (hex_digit(*p) >= 0) {
+            if (inMapping && !skip) {
+                stats[whichHeap].pss += pss;
+                stats[whichHeap].privateDirty += private_dirty;
+                stats[whichHeap].sharedDirty += shared_dirty;
             }
 
-            if (sscanf(line, "Size: %d kB", &temp) == 1) {
-                size = temp;
-            } else if (sscanf(line, "Rss: %d kB", &temp) == 1) {
-                resident = temp;
-            } else if (sscanf(line, "Pss: %d kB", &temp) == 1) {
-                pss = temp;
-            } else if (sscanf(line, "Shared_Clean: %d kB", &temp) == 1) {
-                shared_clean = temp;
-            } else if (sscanf(line, "Shared_Dirty: %d kB", &temp) == 1) {
-                shared_dirty = temp;
-            } else if (sscanf(line, "Private_Clean: %d kB", &temp) == 1) {
-                private_clean = temp;
-            } else if (sscanf(line, "Private_Dirty: %d kB", &temp) == 1) {
-                private_dirty = temp;
-            } else if (sscanf(line, "Referenced: %d kB", &temp) == 1) {
-                referenced = temp;
-            } else if (strlen(line) > 30 && line[8] == '-' && line[17] == ' ') {
-                // looks like a new mapping
-                // example: "10000000-10001000 ---p 10000000 00:00 0"
-                break;
+            prevHeap = whichHeap;
+            prevEnd = end;
+            pss = shared_dirty = private_dirty = 0;
+            inMapping = true;
+
+            const char* name;
+            size_t nameLen;
+            if (parse_mapping_header(p, next, &start, &end, &name, &nameLen)) {
+                skip = false;
+                whichHeap = classify_mapping(name, nameLen, start, prevEnd, prevHeap);
+            } else {
+                skip = true;
+                whichHeap = HEAP_UNKNOWN;
             }
+        } else if (LINE_STARTS_WITH(p, next, "Pss:")) {
+            pss = parse_kb(p + sizeof("Pss:") - 1, next);
+        } else if (LINE_STARTS_WITH(p, next, "Shared_Dirty:")) {
+            shared_dirty = parse_kb(p + sizeof("Shared_Dirty:") - 1, next);
+        } else if (LINE_STARTS_WITH(p, next, "Private_Dirty:")) {
+            private_dirty = parse_kb(p + sizeof("Private_Dirty:") - 1, next);
         }
 
-        if (!skip) {
-            stats[whichHeap].pss += pss;
-            stats[whichHeap].privateDirty += private_dirty;
-            stats[whichHeap].sharedDirty += shared_dirty;
-        }
+        p = next;
+    }
+
+    if (inMapping && !skip) {
+        stats[whichHeap].pss += pss;
+        stats[whichHeap].privateDirty += private_dirty;
+        stats[whichHeap].sharedDirty += shared_dirty;
     }
 }
 
 static void load_maps(int pid, stats_t* stats)
 {
-    char tmp[128];
-    FILE *fp;
-    
-    sprintf(tmp, "/proc/%d/smaps", pid);
-    fp = fopen(tmp, "r");
-    if (fp == 0) return;
+    smaps_buffer buf;
+    if (!read_smaps(pid, &buf)) return;
 
-    read_mapinfo(fp, stats);
-    fclose(fp);
+    read_mapinfo(buf.data, buf.size, stats);
+    free(buf.data);
 }
 
 static void android_os_Debug_getDirtyPagesPid(JNIEnv *env, jobject clazz,
@@ -284,32 +398,91 @@ static void android_os_Debug_getDirtyPages(JNIEnv *env, jobject clazz, jobject o
 
 static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid)
 {
-    char line[1024];
     jlong pss = 0;
-    unsigned temp;
-
-    char tmp[128];
-    FILE *fp;
-
-    sprintf(tmp, "/proc/%d/smaps", pid);
-    fp = fopen(tmp, "r");
-    if (fp == 0) return 0;
 
-    while (true) {
-        if (fgets(line, 1024, fp) == 0) {
-            break;
-        }
+    smaps_buffer buf;
+    if (!read_smaps(pid, &buf)) return 0;
 
-        if (sscanf(line, "Pss: %d kB", &temp) == 1) {
-            pss += temp;
+    const char* limit = buf.data + buf.size;
+    for (const char* p = buf.data; p < limit; ) {
+        const char* next = next_line(p, limit);
+        if (LINE_STARTS_WITH(p, next, "Pss:")) {
+            pss += parse_kb(p + sizeof("Pss:") - 1, next);
         }
+        p = next;
     }
 
-    fclose(fp);
+    free(buf.data);
 
     return pss;
 }
 
+/*
+ * Fills outPss[i] with the PSS of pids[i], in kB, so that callers measuring
+ * every process cross JNI once.
+ */
+static void android_os_Debug_getPssPids(JNIEnv *env, jobject clazz,
+        jintArray pidsArray, jlongArray outPssArray)
+{
+    if (pidsArray == NULL || outPssArray == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+    jsize count = env->GetArrayLength(pidsArray);
+    if (env->GetArrayLength(outPssArray) < count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outPss is shorter than pids");
+        return;
+    }
+
+    jint* pids = env->GetIntArrayElements(pidsArray, NULL);
+    if (pids == NULL) {
+        return;
+    }
+    jlong* outPss = env->GetLongArrayElements(outPssArray, NULL);
+    if (outPss == NULL) {
+        env->ReleaseIntArrayElements(pidsArray, pids, JNI_ABORT);
+        return;
+    }
+
+    for (jsize i = 0; i < count; i++) {
+        outPss[i] = android_os_Debug_getPssPid(env, clazz, pids[i]);
+    }
+
+    env->ReleaseLongArrayElements(outPssArray, outPss, 0);
+    env->ReleaseIntArrayElements(pidsArray, pids, JNI_ABORT);
+}
+
+/*
+ * Fills outInfos[i] with the memory usage of pids[i].
+ */
+static void android_os_Debug_getMemoryInfoPids(JNIEnv *env, jobject clazz,
+        jintArray pidsArray, jobjectArray outInfos)
+{
+    if (pidsArray == NULL || outInfos == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+    jsize count = env->GetArrayLength(pidsArray);
+    if (env->GetArrayLength(outInfos) < count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outInfos is shorter than pids");
+        return;
+    }
+
+    for (jsize i = 0; i < count; i++) {
+        jint pid;
+        env->GetIntArrayRegion(pidsArray, i, 1, &pid);
+        jobject info = env->GetObjectArrayElement(outInfos, i);
+        if (info == NULL) {
+            jniThrowNullPointerException(env, "outInfos element");
+            return;
+        }
+        android_os_Debug_getDirtyPagesPid(env, clazz, pid, info);
+        env->DeleteLocalRef(info);
+    }
+}
+
 static jlong android_os_Debug_getPss(JNIEnv *env, jobject clazz)
 {
     return android_os_Debug_getPssPid(env, clazz, getpid());
@@ -362,6 +535,8 @@ static jint android_os_getBinderReceivedTransactions(JNIEnv *env, jobject clazz)
 jint android_os_Debug_getLocalObjectCount(JNIEnv* env, jobject clazz);
 jint android_os_Debug_getProxyObjectCount(JNIEnv* env, jobject clazz);
 jint android_os_Debug_getDeathObjectCount(JNIEnv* env, jobject clazz);
+void dumpBinderProxyStats(JNIEnv* env, FILE* fp);
+void dumpBinderTransactionStats(FILE* fp);
 
 
 /* pulled out of bionic */
@@ -504,17 +679,20 @@ static void dumpNativeHeap(FILE* fp)
  * Dump the native heap, writing human-readable output to the specified
  * file descriptor.
  */
-static void android_os_Debug_dumpNativeHeap(JNIEnv* env, jobject clazz,
-    jobject fileDescriptor)
+/*
+ * Opens a stdio stream on a copy of a java.io.FileDescriptor, throwing and
+ * returning NULL on failure. The caller closes the stream with fclose().
+ */
+static FILE* openDumpStream(JNIEnv* env, jobject fileDescriptor)
 {
     if (fileDescriptor == NULL) {
         jniThrowNullPointerException(env, NULL);
-        return;
+        return NULL;
     }
     int origFd = jniGetFDFromFileDescriptor(env, fileDescriptor);
     if (origFd < 0) {
         jniThrowRuntimeException(env, "Invalid file descriptor");
-        return;
+        return NULL;
     }
 
     /* dup() the descriptor so we don't close the original with fclose() */
@@ -522,7 +700,7 @@ static void android_os_Debug_dumpNativeHeap(JNIEnv* env, jobject clazz,
     if (fd < 0) {
         ALOGW("dup(%d) failed: %s\n", origFd, strerror(errno));
         jniThrowRuntimeException(env, "dup() failed");
-        return;
+        return NULL;
     }
 
     FILE* fp = fdopen(fd, "w");
@@ -530,6 +708,16 @@ static void android_os_Debug_dumpNativeHeap(JNIEnv* env, jobject clazz,
         ALOGW("fdopen(%d) failed: %s\n", fd, strerror(errno));
         close(fd);
         jniThrowRuntimeException(env, "fdopen() failed");
+        return NULL;
+    }
+    return fp;
+}
+
+static void android_os_Debug_dumpNativeHeap(JNIEnv* env, jobject clazz,
+    jobject fileDescriptor)
+{
+    FILE* fp = openDumpStream(env, fileDescriptor);
+    if (fp == NULL) {
         return;
     }
 
@@ -540,6 +728,40 @@ static void android_os_Debug_dumpNativeHeap(JNIEnv* env, jobject clazz,
     fclose(fp);
 }
 
+/*
+ * Dump the binder proxies of this process, counted per interface, to the
+ * specified file descriptor.
+ */
+static void android_os_Debug_dumpBinderProxyStats(JNIEnv* env, jobject clazz,
+    jobject fileDescriptor)
+{
+    FILE* fp = openDumpStream(env, fileDescriptor);
+    if (fp == NULL) {
+        return;
+    }
+
+    dumpBinderProxyStats(env, fp);
+
+    fclose(fp);
+}
+
+/*
+ * Dump the sampled binder transaction latency and size histograms of this
+ * process to the specified file descriptor.
+ */
+static void android_os_Debug_dumpBinderTransactionStats(JNIEnv* env, jobject clazz,
+    jobject fileDescriptor)
+{
+    FILE* fp = openDumpStream(env, fileDescriptor);
+    if (fp == NULL) {
+        return;
+    }
+
+    dumpBinderTransactionStats(fp);
+
+    fclose(fp);
+}
+
 
 static void android_os_Debug_dumpNativeBacktraceToFile(JNIEnv* env, jobject clazz,
     jint pid, jstring fileName)
@@ -605,6 +827,18 @@ static JNINativeMethod gMethods[] = {
             (void*)android_os_Debug_dumpNativeBacktraceToFile },
 };
 
+// Only registered if Debug declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "getPss",                 "([I[J)V",
+            (void*) android_os_Debug_getPssPids },
+    { "getMemoryInfo",          "([I[Landroid/os/Debug$MemoryInfo;)V",
+            (void*) android_os_Debug_getMemoryInfoPids },
+    { "dumpBinderProxyStats",   "(Ljava/io/FileDescriptor;)V",
+            (void*)android_os_Debug_dumpBinderProxyStats },
+    { "dumpBinderTransactionStats", "(Ljava/io/FileDescriptor;)V",
+            (void*)android_os_Debug_dumpBinderTransactionStats },
+};
+
 int register_android_os_Debug(JNIEnv *env)
 {
     jclass clazz = env->FindClass("android/os/Debug$MemoryInfo");
@@ -620,7 +854,10 @@ int register_android_os_Debug(JNIEnv *env)
 
     otherStats_field = env->GetFieldID(clazz, "otherStats", "[I");
 
-    return jniRegisterNativeMethods(env, "android/os/Debug", gMethods, NELEM(gMethods));
+    int result = jniRegisterNativeMethods(env, "android/os/Debug", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/os/Debug",
+            gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 }; // namespace android
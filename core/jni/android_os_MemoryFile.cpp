@@ -15,7 +15,9 @@
  */
 
 #define LOG_TAG "MemoryFile"
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 
 #include <cutils/ashmem.h>
 #include <android_runtime/AndroidRuntime.h>
@@ -26,6 +28,20 @@
 
 namespace android {
 
+/*
+ * Number of ByteBuffer views acquired on each ashmem region, by fd. A region
+ * stays pinned while it has views, even if purging is allowed, as a purge
+ * would silently replace the data seen through the views with zeroes.
+ */
+static Mutex gViewsLock;
+static KeyedVector<int, int> gViewCounts;
+
+static bool hasViews(int fd)
+{
+    Mutex::Autolock _l(gViewsLock);
+    return gViewCounts.indexOfKey(fd) >= 0;
+}
+
 static jobject android_os_MemoryFile_open(JNIEnv* env, jobject clazz, jstring name, jint length)
 {
     const char* namestr = (name ? env->GetStringUTFChars(name, NULL) : NULL);
@@ -64,6 +80,17 @@ static void android_os_MemoryFile_close(JNIEnv* env, jobject clazz, jobject file
 {
     int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
     if (fd >= 0) {
+        {
+            // The views would point into a mapping that the caller is about to unmap
+            Mutex::Autolock _l(gViewsLock);
+            ssize_t index = gViewCounts.indexOfKey(fd);
+            if (index >= 0) {
+                ALOGW("Closing a region with %d buffers not released", gViewCounts.valueAt(index));
+                jniThrowException(env, "java/lang/IllegalStateException",
+                        "buffers of the region have not been released");
+                return;
+            }
+        }
         jniSetFileDescriptorOfFD(env, fileDescriptor, -1);
         close(fd);
     }
@@ -74,6 +101,8 @@ static jint android_os_MemoryFile_read(JNIEnv* env, jobject clazz,
         jint count, jboolean unpinned)
 {
     int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+    // A region with views is kept pinned, it must not be unpinned below
+    unpinned = unpinned && !hasViews(fd);
     if (unpinned && ashmem_pin_region(fd, 0, 0) == ASHMEM_WAS_PURGED) {
         ashmem_unpin_region(fd, 0, 0);
         jniThrowException(env, "java/io/IOException", "ashmem region was purged");
@@ -93,6 +122,8 @@ static jint android_os_MemoryFile_write(JNIEnv* env, jobject clazz,
         jint count, jboolean unpinned)
 {
     int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+    // A region with views is kept pinned, it must not be unpinned below
+    unpinned = unpinned && !hasViews(fd);
     if (unpinned && ashmem_pin_region(fd, 0, 0) == ASHMEM_WAS_PURGED) {
         ashmem_unpin_region(fd, 0, 0);
         jniThrowException(env, "java/io/IOException", "ashmem region was purged");
@@ -107,9 +138,81 @@ static jint android_os_MemoryFile_write(JNIEnv* env, jobject clazz,
     return count;
 }
 
+static jobject android_os_MemoryFile_acquire_buffer(JNIEnv* env, jobject clazz,
+        jobject fileDescriptor, jint address, jint length, jboolean unpinned)
+{
+    int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    // The view must not reach past the end of the region
+    int size = ashmem_get_size_region(fd);
+    if (size < 0) {
+        jniThrowIOException(env, errno);
+        return NULL;
+    }
+    if (address == 0 || length <= 0 || length > size) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "bad range");
+        return NULL;
+    }
+
+    Mutex::Autolock _l(gViewsLock);
+    ssize_t index = gViewCounts.indexOfKey(fd);
+    if (index < 0) {
+        if (unpinned && ashmem_pin_region(fd, 0, 0) == ASHMEM_WAS_PURGED) {
+            ashmem_unpin_region(fd, 0, 0);
+            jniThrowException(env, "java/io/IOException", "ashmem region was purged");
+            return NULL;
+        }
+        index = gViewCounts.add(fd, 0);
+    }
+
+    // The view reads and writes the mapping directly, without copies
+    jobject buffer = env->NewDirectByteBuffer((void*) address, length);
+    if (buffer == NULL) {
+        if (gViewCounts.valueAt(index) == 0) {
+            gViewCounts.removeItemsAt(index);
+            if (unpinned) {
+                ashmem_unpin_region(fd, 0, 0);
+            }
+        }
+        return NULL;
+    }
+
+    gViewCounts.editValueAt(index)++;
+    return buffer;
+}
+
+static void android_os_MemoryFile_release_buffer(JNIEnv* env, jobject clazz,
+        jobject fileDescriptor, jboolean unpinned)
+{
+    int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    Mutex::Autolock _l(gViewsLock);
+    ssize_t index = gViewCounts.indexOfKey(fd);
+    if (index < 0) {
+        ALOGW("Releasing a buffer of a region without buffers, fd = %d", fd);
+        return;
+    }
+
+    if (--gViewCounts.editValueAt(index) == 0) {
+        gViewCounts.removeItemsAt(index);
+        if (unpinned) {
+            ashmem_unpin_region(fd, 0, 0);
+        }
+    }
+}
+
 static void android_os_MemoryFile_pin(JNIEnv* env, jobject clazz, jobject fileDescriptor, jboolean pin)
 {
     int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (!pin) {
+        Mutex::Autolock _l(gViewsLock);
+        if (gViewCounts.indexOfKey(fd) >= 0) {
+            // Unpinned by the release of the last buffer
+            return;
+        }
+    }
+
     int result = (pin ? ashmem_pin_region(fd, 0, 0) : ashmem_unpin_region(fd, 0, 0));
     if (result < 0) {
         jniThrowException(env, "java/io/IOException", NULL);
@@ -148,11 +251,23 @@ static const JNINativeMethod methods[] = {
             (void*)android_os_MemoryFile_get_size}
 };
 
+// Only registered if MemoryFile declares them
+static const JNINativeMethod optionalMethods[] = {
+    {"native_acquire_buffer", "(Ljava/io/FileDescriptor;IIZ)Ljava/nio/ByteBuffer;",
+            (void*)android_os_MemoryFile_acquire_buffer},
+    {"native_release_buffer", "(Ljava/io/FileDescriptor;Z)V",
+            (void*)android_os_MemoryFile_release_buffer},
+};
+
 int register_android_os_MemoryFile(JNIEnv* env)
 {
-    return AndroidRuntime::registerNativeMethods(
+    int result = AndroidRuntime::registerNativeMethods(
         env, "android/os/MemoryFile",
         methods, NELEM(methods));
+    AndroidRuntime::registerOptionalNativeMethods(
+        env, "android/os/MemoryFile",
+        optionalMethods, NELEM(optionalMethods));
+    return result;
 }
 
 }
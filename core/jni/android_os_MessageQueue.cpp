@@ -21,12 +21,14 @@
 
 #include <utils/Looper.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 #include "android_os_MessageQueue.h"
 
 namespace android {
 
 static struct {
     jfieldID mPtr;   // native object attached to the DVM MessageQueue
+    jmethodID dispatchFdEvents; // optional, NULL if fds cannot be watched
 } gMessageQueueClassInfo;
 
 
@@ -37,13 +39,43 @@ public:
 
     virtual void raiseException(JNIEnv* env, const char* msg, jthrowable exceptionObj);
 
-    void pollOnce(JNIEnv* env, int timeoutMillis);
+    void pollOnce(JNIEnv* env, jobject messageQueueObj, int timeoutMillis);
 
     void wake();
 
+    /* Watches a file descriptor for the given ALOOPER_EVENT_* events.
+     * The fds that become ready during one wake of the looper are handed to the
+     * Java MessageQueue together through dispatchFdEvents(int[], int[]), which
+     * must drain them before the next poll since the looper is level-triggered.
+     * An fd that reports an error or hangup is unregistered after its dispatch. */
+    bool addFd(int fd, int events);
+    void removeFd(int fd);
+
 private:
+    class FdCallback : public LooperCallback {
+    public:
+        FdCallback(NativeMessageQueue* queue) : mQueue(queue) { }
+
+        virtual int handleEvent(int fd, int events, void* data);
+
+    private:
+        NativeMessageQueue* mQueue; // the queue unregisters its fds before it is destroyed
+    };
+
+    void dispatchFdEvents(JNIEnv* env, jobject messageQueueObj);
+
     bool mInCallback;
     jthrowable mExceptionObj;
+
+    // Fds can be added and removed from any thread, while the looper thread drops
+    // those that hang up.
+    Mutex mLock;
+    sp<FdCallback> mFdCallback; // guarded by mLock
+    Vector<int> mFds; // guarded by mLock
+
+    // Only used by the looper thread.
+    Vector<int> mPendingFds;
+    Vector<int> mPendingEvents;
 };
 
 
@@ -73,6 +105,10 @@ NativeMessageQueue::NativeMessageQueue() : mInCallback(false), mExceptionObj(NUL
 }
 
 NativeMessageQueue::~NativeMessageQueue() {
+    AutoMutex _l(mLock);
+    for (size_t i = 0; i < mFds.size(); i++) {
+        mLooper->removeFd(mFds[i]);
+    }
 }
 
 void NativeMessageQueue::raiseException(JNIEnv* env, const char* msg, jthrowable exceptionObj) {
@@ -92,14 +128,20 @@ void NativeMessageQueue::raiseException(JNIEnv* env, const char* msg, jthrowable
     }
 }
 
-void NativeMessageQueue::pollOnce(JNIEnv* env, int timeoutMillis) {
+void NativeMessageQueue::pollOnce(JNIEnv* env, jobject messageQueueObj, int timeoutMillis) {
     mInCallback = true;
     mLooper->pollOnce(timeoutMillis);
     mInCallback = false;
     if (mExceptionObj) {
+        mPendingFds.clear();
+        mPendingEvents.clear();
         env->Throw(mExceptionObj);
         env->DeleteLocalRef(mExceptionObj);
         mExceptionObj = NULL;
+        return;
+    }
+    if (!mPendingFds.isEmpty()) {
+        dispatchFdEvents(env, messageQueueObj);
     }
 }
 
@@ -107,6 +149,71 @@ void NativeMessageQueue::wake() {
     mLooper->wake();
 }
 
+bool NativeMessageQueue::addFd(int fd, int events) {
+    if (!gMessageQueueClassInfo.dispatchFdEvents) {
+        return false;
+    }
+
+    AutoMutex _l(mLock);
+    if (mFdCallback == NULL) {
+        mFdCallback = new FdCallback(this);
+    }
+    if (mLooper->addFd(fd, 0, events, mFdCallback, NULL) != 1) {
+        return false;
+    }
+    if (mFds.indexOf(fd) < 0) {
+        mFds.add(fd);
+    }
+    return true;
+}
+
+void NativeMessageQueue::removeFd(int fd) {
+    AutoMutex _l(mLock);
+    ssize_t index = mFds.indexOf(fd);
+    if (index >= 0) {
+        mFds.removeAt(index);
+        mLooper->removeFd(fd);
+    }
+}
+
+int NativeMessageQueue::FdCallback::handleEvent(int fd, int events, void* data) {
+    mQueue->mPendingFds.add(fd);
+    mQueue->mPendingEvents.add(events);
+    if (events & (ALOOPER_EVENT_ERROR | ALOOPER_EVENT_HANGUP)) {
+        AutoMutex _l(mQueue->mLock);
+        ssize_t index = mQueue->mFds.indexOf(fd);
+        if (index >= 0) {
+            mQueue->mFds.removeAt(index);
+        }
+        return 0; // remove the callback
+    }
+    return 1;
+}
+
+void NativeMessageQueue::dispatchFdEvents(JNIEnv* env, jobject messageQueueObj) {
+    size_t count = mPendingFds.size();
+    jintArray fds = env->NewIntArray(count);
+    jintArray events = env->NewIntArray(count);
+    if (fds != NULL && events != NULL) {
+        env->SetIntArrayRegion(fds, 0, count, mPendingFds.array());
+        env->SetIntArrayRegion(events, 0, count, mPendingEvents.array());
+    }
+    mPendingFds.clear();
+    mPendingEvents.clear();
+
+    // A failed allocation leaves an OutOfMemoryError pending for the caller
+    if (fds != NULL && events != NULL) {
+        env->CallVoidMethod(messageQueueObj, gMessageQueueClassInfo.dispatchFdEvents,
+                fds, events);
+    }
+    if (fds != NULL) {
+        env->DeleteLocalRef(fds);
+    }
+    if (events != NULL) {
+        env->DeleteLocalRef(events);
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 static NativeMessageQueue* android_os_MessageQueue_getNativeMessageQueue(JNIEnv* env,
@@ -154,7 +261,7 @@ static void throwQueueNotInitialized(JNIEnv* env) {
 static void android_os_MessageQueue_nativePollOnce(JNIEnv* env, jobject obj,
         jint ptr, jint timeoutMillis) {
     NativeMessageQueue* nativeMessageQueue = reinterpret_cast<NativeMessageQueue*>(ptr);
-    nativeMessageQueue->pollOnce(env, timeoutMillis);
+    nativeMessageQueue->pollOnce(env, obj, timeoutMillis);
 }
 
 static void android_os_MessageQueue_nativeWake(JNIEnv* env, jobject obj, jint ptr) {
@@ -162,6 +269,18 @@ static void android_os_MessageQueue_nativeWake(JNIEnv* env, jobject obj, jint pt
     return nativeMessageQueue->wake();
 }
 
+static jboolean android_os_MessageQueue_nativeAddFd(JNIEnv* env, jobject obj,
+        jint ptr, jint fd, jint events) {
+    NativeMessageQueue* nativeMessageQueue = reinterpret_cast<NativeMessageQueue*>(ptr);
+    return nativeMessageQueue->addFd(fd, events) ? JNI_TRUE : JNI_FALSE;
+}
+
+static void android_os_MessageQueue_nativeRemoveFd(JNIEnv* env, jobject obj,
+        jint ptr, jint fd) {
+    NativeMessageQueue* nativeMessageQueue = reinterpret_cast<NativeMessageQueue*>(ptr);
+    nativeMessageQueue->removeFd(fd);
+}
+
 // ----------------------------------------------------------------------------
 
 static JNINativeMethod gMessageQueueMethods[] = {
@@ -172,6 +291,13 @@ static JNINativeMethod gMessageQueueMethods[] = {
     { "nativeWake", "(I)V", (void*)android_os_MessageQueue_nativeWake }
 };
 
+// Fd watching, only registered if MessageQueue declares it
+static JNINativeMethod gMessageQueueOptionalMethods[] = {
+    /* name, signature, funcPtr */
+    { "nativeAddFd", "(III)Z", (void*)android_os_MessageQueue_nativeAddFd },
+    { "nativeRemoveFd", "(II)V", (void*)android_os_MessageQueue_nativeRemoveFd }
+};
+
 #define FIND_CLASS(var, className) \
         var = env->FindClass(className); \
         LOG_FATAL_IF(! var, "Unable to find class " className);
@@ -184,13 +310,21 @@ int register_android_os_MessageQueue(JNIEnv* env) {
     int res = jniRegisterNativeMethods(env, "android/os/MessageQueue",
             gMessageQueueMethods, NELEM(gMessageQueueMethods));
     LOG_FATAL_IF(res < 0, "Unable to register native methods.");
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/os/MessageQueue",
+            gMessageQueueOptionalMethods, NELEM(gMessageQueueOptionalMethods));
 
     jclass clazz;
     FIND_CLASS(clazz, "android/os/MessageQueue");
 
     GET_FIELD_ID(gMessageQueueClassInfo.mPtr, clazz,
             "mPtr", "I");
-    
+
+    gMessageQueueClassInfo.dispatchFdEvents = env->GetMethodID(clazz,
+            "dispatchFdEvents", "([I[I)V");
+    if (!gMessageQueueClassInfo.dispatchFdEvents) {
+        env->ExceptionClear();
+    }
+
     return 0;
 }
 
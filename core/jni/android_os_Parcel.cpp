@@ -23,6 +23,7 @@
 #include "JNIHelp.h"
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -188,6 +189,54 @@ static void android_os_Parcel_writeNative(JNIEnv* env, jclass clazz, jint native
     }
 }
 
+/*
+ * Blobs of more than a few KB are passed as an ashmem region by Parcel::writeBlob(),
+ * so large payloads take only a file descriptor of the binder buffer. The receiving
+ * side maps the region read-only.
+ */
+static void android_os_Parcel_writeBlob(JNIEnv* env, jclass clazz, jint nativePtr, jobject data,
+                                        jint offset, jint length)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    if (data == NULL) {
+        const status_t err = parcel->writeInt32(-1);
+        if (err != NO_ERROR) {
+            signalExceptionForError(env, clazz, err);
+        }
+        return;
+    }
+
+    if (offset < 0 || length < 0
+            || offset > env->GetArrayLength((jarray)data) - length) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return;
+    }
+
+    status_t err = parcel->writeInt32(length);
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+        return;
+    }
+
+    Parcel::WritableBlob blob;
+    err = parcel->writeBlob(length, &blob);
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+        return;
+    }
+
+    jbyte* ar = (jbyte*)env->GetPrimitiveArrayCritical((jarray)data, 0);
+    if (ar) {
+        memcpy(blob.data(), ar + offset, length);
+        env->ReleasePrimitiveArrayCritical((jarray)data, ar, JNI_ABORT);
+    }
+    blob.release();
+}
+
 static void android_os_Parcel_writeInt(JNIEnv* env, jclass clazz, jint nativePtr, jint val) {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
     const status_t err = parcel->writeInt32(val);
@@ -272,6 +321,211 @@ static void android_os_Parcel_writeFileDescriptor(JNIEnv* env, jclass clazz, jin
     }
 }
 
+template<typename T>
+static void writePrimitiveArray(JNIEnv* env, jclass clazz, jint nativePtr, jarray data,
+                                jint offset, jint length)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    if (data == NULL) {
+        const status_t err = parcel->writeInt32(-1);
+        if (err != NO_ERROR) {
+            signalExceptionForError(env, clazz, err);
+        }
+        return;
+    }
+
+    if (offset < 0 || length < 0 || offset > env->GetArrayLength(data) - length) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return;
+    }
+    if (size_t(length) > INT_MAX / sizeof(T)) {
+        signalExceptionForError(env, clazz, BAD_VALUE);
+        return;
+    }
+
+    const status_t err = parcel->writeInt32(length);
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+        return;
+    }
+
+    void* dest = parcel->writeInplace(length * sizeof(T));
+    if (dest == NULL) {
+        signalExceptionForError(env, clazz, NO_MEMORY);
+        return;
+    }
+
+    T* ar = (T*)env->GetPrimitiveArrayCritical(data, 0);
+    if (ar) {
+        memcpy(dest, ar + offset, length * sizeof(T));
+        env->ReleasePrimitiveArrayCritical(data, ar, JNI_ABORT);
+    }
+}
+
+static void android_os_Parcel_writeIntArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                            jintArray data, jint offset, jint length)
+{
+    writePrimitiveArray<jint>(env, clazz, nativePtr, data, offset, length);
+}
+
+static void android_os_Parcel_writeLongArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                             jlongArray data, jint offset, jint length)
+{
+    writePrimitiveArray<jlong>(env, clazz, nativePtr, data, offset, length);
+}
+
+static void android_os_Parcel_writeFloatArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                              jfloatArray data, jint offset, jint length)
+{
+    writePrimitiveArray<jfloat>(env, clazz, nativePtr, data, offset, length);
+}
+
+static void android_os_Parcel_writeDoubleArray(JNIEnv* env, jclass clazz, jint nativePtr,
+                                               jdoubleArray data, jint offset, jint length)
+{
+    writePrimitiveArray<jdouble>(env, clazz, nativePtr, data, offset, length);
+}
+
+/*
+ * A field layout is a byte array of JNI type letters ('I', 'J', 'F' or 'D'), one
+ * per field, in parcel order. The values for each type are taken in turn from the
+ * array of that type, so a record marshals as one in-place block that reads back
+ * exactly as the equivalent sequence of writeInt/writeLong/writeFloat/writeDouble.
+ */
+struct FieldCounts {
+    size_t ints;
+    size_t longs;
+    size_t floats;
+    size_t doubles;
+};
+
+static bool countFields(const jbyte* layout, jsize count, FieldCounts* counts, size_t* size)
+{
+    memset(counts, 0, sizeof(FieldCounts));
+    for (jsize i = 0; i < count; i++) {
+        switch (layout[i]) {
+            case 'I': counts->ints++; break;
+            case 'J': counts->longs++; break;
+            case 'F': counts->floats++; break;
+            case 'D': counts->doubles++; break;
+            default: return false;
+        }
+    }
+    *size = (counts->ints + counts->floats) * sizeof(int32_t)
+            + (counts->longs + counts->doubles) * sizeof(int64_t);
+    return true;
+}
+
+static bool checkFieldArrays(JNIEnv* env, const FieldCounts& counts, jintArray ints,
+                             jlongArray longs, jfloatArray floats, jdoubleArray doubles)
+{
+    if ((counts.ints && (ints == NULL || size_t(env->GetArrayLength(ints)) < counts.ints))
+            || (counts.longs && (longs == NULL
+                    || size_t(env->GetArrayLength(longs)) < counts.longs))
+            || (counts.floats && (floats == NULL
+                    || size_t(env->GetArrayLength(floats)) < counts.floats))
+            || (counts.doubles && (doubles == NULL
+                    || size_t(env->GetArrayLength(doubles)) < counts.doubles))) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Field layout does not match the value arrays");
+        return false;
+    }
+    return true;
+}
+
+// Copies every field between the parcel block and the value arrays, in layout order
+static void copyFields(JNIEnv* env, jbyteArray layout, jintArray ints, jlongArray longs,
+                       jfloatArray floats, jdoubleArray doubles, uint8_t* block, bool toBlock)
+{
+    jsize count = env->GetArrayLength(layout);
+    jbyte* fields = (jbyte*)env->GetPrimitiveArrayCritical(layout, 0);
+    if (fields == NULL) {
+        return;
+    }
+    jint* i32 = ints ? (jint*)env->GetPrimitiveArrayCritical(ints, 0) : NULL;
+    jlong* i64 = longs ? (jlong*)env->GetPrimitiveArrayCritical(longs, 0) : NULL;
+    jfloat* f32 = floats ? (jfloat*)env->GetPrimitiveArrayCritical(floats, 0) : NULL;
+    jdouble* f64 = doubles ? (jdouble*)env->GetPrimitiveArrayCritical(doubles, 0) : NULL;
+
+    jint* nextInt = i32;
+    jlong* nextLong = i64;
+    jfloat* nextFloat = f32;
+    jdouble* nextDouble = f64;
+    for (jsize i = 0; i < count; i++) {
+        void* value;
+        size_t size;
+        switch (fields[i]) {
+            case 'I': value = nextInt++; size = sizeof(jint); break;
+            case 'J': value = nextLong++; size = sizeof(jlong); break;
+            case 'F': value = nextFloat++; size = sizeof(jfloat); break;
+            default: value = nextDouble++; size = sizeof(jdouble); break;
+        }
+        if (toBlock) {
+            memcpy(block, value, size);
+        } else {
+            memcpy(value, block, size);
+        }
+        block += size;
+    }
+
+    const jint mode = toBlock ? JNI_ABORT : 0;
+    if (f64) env->ReleasePrimitiveArrayCritical(doubles, f64, mode);
+    if (f32) env->ReleasePrimitiveArrayCritical(floats, f32, mode);
+    if (i64) env->ReleasePrimitiveArrayCritical(longs, i64, mode);
+    if (i32) env->ReleasePrimitiveArrayCritical(ints, i32, mode);
+    env->ReleasePrimitiveArrayCritical(layout, fields, JNI_ABORT);
+}
+
+static bool prepareFields(JNIEnv* env, jbyteArray layout, jintArray ints, jlongArray longs,
+                          jfloatArray floats, jdoubleArray doubles, size_t* size)
+{
+    if (layout == NULL) {
+        jniThrowNullPointerException(env, "layout");
+        return false;
+    }
+
+    FieldCounts counts;
+    jsize count = env->GetArrayLength(layout);
+    jbyte* fields = (jbyte*)env->GetPrimitiveArrayCritical(layout, 0);
+    if (fields == NULL) {
+        return false;
+    }
+    bool valid = countFields(fields, count, &counts, size);
+    env->ReleasePrimitiveArrayCritical(layout, fields, JNI_ABORT);
+    if (!valid) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Field layout holds an unknown type");
+        return false;
+    }
+    return checkFieldArrays(env, counts, ints, longs, floats, doubles);
+}
+
+static void android_os_Parcel_writeFields(JNIEnv* env, jclass clazz, jint nativePtr,
+        jbyteArray layout, jintArray ints, jlongArray longs, jfloatArray floats,
+        jdoubleArray doubles)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    size_t size;
+    if (!prepareFields(env, layout, ints, longs, floats, doubles, &size)) {
+        return;
+    }
+
+    void* dest = parcel->writeInplace(size);
+    if (dest == NULL) {
+        signalExceptionForError(env, clazz, NO_MEMORY);
+        return;
+    }
+    copyFields(env, layout, ints, longs, floats, doubles, (uint8_t*)dest, true);
+}
+
 static jbyteArray android_os_Parcel_createByteArray(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     jbyteArray ret = NULL;
@@ -298,6 +552,108 @@ static jbyteArray android_os_Parcel_createByteArray(JNIEnv* env, jclass clazz, j
     return ret;
 }
 
+static jbyteArray android_os_Parcel_readBlob(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    jbyteArray ret = NULL;
+
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        int32_t len = parcel->readInt32();
+        if (len >= 0) {
+            Parcel::ReadableBlob blob;
+            status_t err = parcel->readBlob(len, &blob);
+            if (err != NO_ERROR) {
+                signalExceptionForError(env, clazz, err);
+                return NULL;
+            }
+
+            ret = env->NewByteArray(len);
+            if (ret != NULL) {
+                jbyte* a2 = (jbyte*)env->GetPrimitiveArrayCritical(ret, 0);
+                if (a2) {
+                    memcpy(a2, blob.data(), len);
+                    env->ReleasePrimitiveArrayCritical(ret, a2, 0);
+                }
+            }
+            blob.release();
+        }
+    }
+
+    return ret;
+}
+
+template<typename T, typename A>
+static A createPrimitiveArray(JNIEnv* env, jint nativePtr, A (JNIEnv::*newArray)(jsize))
+{
+    A ret = NULL;
+
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        int32_t len = parcel->readInt32();
+
+        // sanity check the stored length against the true data size
+        if (len >= 0 && size_t(len) <= parcel->dataAvail() / sizeof(T)) {
+            ret = (env->*newArray)(len);
+
+            if (ret != NULL) {
+                T* a2 = (T*)env->GetPrimitiveArrayCritical(ret, 0);
+                if (a2) {
+                    const void* data = parcel->readInplace(len * sizeof(T));
+                    memcpy(a2, data, len * sizeof(T));
+                    env->ReleasePrimitiveArrayCritical(ret, a2, 0);
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+static jintArray android_os_Parcel_createIntArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return createPrimitiveArray<jint>(env, nativePtr, &JNIEnv::NewIntArray);
+}
+
+static jlongArray android_os_Parcel_createLongArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return createPrimitiveArray<jlong>(env, nativePtr, &JNIEnv::NewLongArray);
+}
+
+static jfloatArray android_os_Parcel_createFloatArray(JNIEnv* env, jclass clazz, jint nativePtr)
+{
+    return createPrimitiveArray<jfloat>(env, nativePtr, &JNIEnv::NewFloatArray);
+}
+
+static jdoubleArray android_os_Parcel_createDoubleArray(JNIEnv* env, jclass clazz,
+                                                        jint nativePtr)
+{
+    return createPrimitiveArray<jdouble>(env, nativePtr, &JNIEnv::NewDoubleArray);
+}
+
+static void android_os_Parcel_readFields(JNIEnv* env, jclass clazz, jint nativePtr,
+        jbyteArray layout, jintArray ints, jlongArray longs, jfloatArray floats,
+        jdoubleArray doubles)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    size_t size;
+    if (!prepareFields(env, layout, ints, longs, floats, doubles, &size)) {
+        return;
+    }
+
+    if (size > parcel->dataAvail()) {
+        signalExceptionForError(env, clazz, NOT_ENOUGH_DATA);
+        return;
+    }
+    const void* data = parcel->readInplace(size);
+    if (data != NULL) {
+        copyFields(env, layout, ints, longs, floats, doubles, (uint8_t*)data, false);
+    }
+}
+
 static jint android_os_Parcel_readInt(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -669,6 +1025,24 @@ static const JNINativeMethod gParcelMethods[] = {
     {"nativeEnforceInterface",    "(ILjava/lang/String;)V", (void*)android_os_Parcel_enforceInterface},
 };
 
+// Only registered if Parcel declares them
+static const JNINativeMethod gParcelOptionalMethods[] = {
+    {"nativeWriteBlob",           "(I[BII)V", (void*)android_os_Parcel_writeBlob},
+    {"nativeReadBlob",            "(I)[B", (void*)android_os_Parcel_readBlob},
+
+    {"nativeWriteIntArray",       "(I[III)V", (void*)android_os_Parcel_writeIntArray},
+    {"nativeWriteLongArray",      "(I[JII)V", (void*)android_os_Parcel_writeLongArray},
+    {"nativeWriteFloatArray",     "(I[FII)V", (void*)android_os_Parcel_writeFloatArray},
+    {"nativeWriteDoubleArray",    "(I[DII)V", (void*)android_os_Parcel_writeDoubleArray},
+    {"nativeWriteFields",         "(I[B[I[J[F[D)V", (void*)android_os_Parcel_writeFields},
+
+    {"nativeCreateIntArray",      "(I)[I", (void*)android_os_Parcel_createIntArray},
+    {"nativeCreateLongArray",     "(I)[J", (void*)android_os_Parcel_createLongArray},
+    {"nativeCreateFloatArray",    "(I)[F", (void*)android_os_Parcel_createFloatArray},
+    {"nativeCreateDoubleArray",   "(I)[D", (void*)android_os_Parcel_createDoubleArray},
+    {"nativeReadFields",          "(I[B[I[J[F[D)V", (void*)android_os_Parcel_readFields},
+};
+
 const char* const kParcelPathName = "android/os/Parcel";
 
 int register_android_os_Parcel(JNIEnv* env)
@@ -684,9 +1058,13 @@ int register_android_os_Parcel(JNIEnv* env)
                                                    "()Landroid/os/Parcel;");
     gParcelOffsets.recycle = env->GetMethodID(clazz, "recycle", "()V");
 
-    return AndroidRuntime::registerNativeMethods(
+    int result = AndroidRuntime::registerNativeMethods(
         env, kParcelPathName,
         gParcelMethods, NELEM(gParcelMethods));
+    AndroidRuntime::registerOptionalNativeMethods(
+        env, kParcelPathName,
+        gParcelOptionalMethods, NELEM(gParcelOptionalMethods));
+    return result;
 }
 
 };
@@ -19,10 +19,16 @@
 #include "JNIHelp.h"
 
 #include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <unistd.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 
 #include <android_runtime/AndroidRuntime.h>
 
@@ -34,6 +40,18 @@ static struct parcel_file_descriptor_offsets_t
     jfieldID mFileDescriptor;
 } gParcelFileDescriptorOffsets;
 
+/*
+ * Mappings made by mapNative(), keyed by the address of their buffer, so that
+ * unmapNative() only ever unmaps what mapNative() mapped.
+ */
+struct FileMapping {
+    void* base;
+    size_t size;
+};
+
+static Mutex gMappingsLock;
+static KeyedVector<uintptr_t, FileMapping> gMappings;
+
 static jobject android_os_ParcelFileDescriptor_getFileDescriptorFromFd(JNIEnv* env,
     jobject clazz, jint origfd)
 {
@@ -118,6 +136,80 @@ static jlong android_os_ParcelFileDescriptor_getFdNative(JNIEnv* env, jobject cl
     return fd;
 }
 
+static jobject android_os_ParcelFileDescriptor_mapNative(JNIEnv* env,
+    jobject clazz, jlong offset, jlong length, jboolean writable)
+{
+    jint fd = getFd(env, clazz);
+    if (fd < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "bad file descriptor");
+        return NULL;
+    }
+
+    // Pages mapped past the end of the file would fault when accessed
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "not a regular file");
+        return NULL;
+    }
+    if (offset < 0 || length <= 0 || length > INT_MAX || offset + length > st.st_size) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "bad range");
+        return NULL;
+    }
+
+    // mmap() wants an offset aligned on a page
+    const jlong pageSize = sysconf(_SC_PAGESIZE);
+    const jlong alignedOffset = offset & ~(pageSize - 1);
+    const size_t delta = offset - alignedOffset;
+    if (alignedOffset != (off_t) alignedOffset) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "offset too large");
+        return NULL;
+    }
+
+    int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+    void* base = mmap(NULL, length + delta, prot, MAP_SHARED, fd, alignedOffset);
+    if (base == MAP_FAILED) {
+        jniThrowException(env, "java/io/IOException", strerror(errno));
+        return NULL;
+    }
+
+    char* address = (char*) base + delta;
+    jobject buffer = env->NewDirectByteBuffer(address, length);
+    if (buffer == NULL) {
+        munmap(base, length + delta);
+        return NULL;
+    }
+
+    FileMapping mapping = { base, size_t(length + delta) };
+    Mutex::Autolock _l(gMappingsLock);
+    gMappings.add((uintptr_t) address, mapping);
+    return buffer;
+}
+
+static void android_os_ParcelFileDescriptor_unmapNative(JNIEnv* env,
+    jobject clazz, jobject buffer)
+{
+    if (buffer == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    FileMapping mapping;
+    {
+        Mutex::Autolock _l(gMappingsLock);
+        ssize_t index = gMappings.indexOfKey((uintptr_t) env->GetDirectBufferAddress(buffer));
+        if (index < 0) {
+            jniThrowException(env, "java/lang/IllegalArgumentException", "not a mapped buffer");
+            return;
+        }
+        mapping = gMappings.valueAt(index);
+        gMappings.removeItemsAt(index);
+    }
+
+    if (munmap(mapping.base, mapping.size) != 0) {
+        jniThrowException(env, "java/io/IOException", strerror(errno));
+    }
+}
+
 static const JNINativeMethod gParcelFileDescriptorMethods[] = {
     {"getFileDescriptorFromFd", "(I)Ljava/io/FileDescriptor;",
         (void*)android_os_ParcelFileDescriptor_getFileDescriptorFromFd},
@@ -133,6 +225,14 @@ static const JNINativeMethod gParcelFileDescriptorMethods[] = {
         (void*)android_os_ParcelFileDescriptor_getFdNative}
 };
 
+// Only registered if ParcelFileDescriptor declares them
+static const JNINativeMethod gParcelFileDescriptorOptionalMethods[] = {
+    {"mapNative", "(JJZ)Ljava/nio/ByteBuffer;",
+        (void*)android_os_ParcelFileDescriptor_mapNative},
+    {"unmapNative", "(Ljava/nio/ByteBuffer;)V",
+        (void*)android_os_ParcelFileDescriptor_unmapNative}
+};
+
 const char* const kParcelFileDescriptorPathName = "android/os/ParcelFileDescriptor";
 
 int register_android_os_ParcelFileDescriptor(JNIEnv* env)
@@ -143,9 +243,13 @@ int register_android_os_ParcelFileDescriptor(JNIEnv* env)
     LOG_FATAL_IF(gParcelFileDescriptorOffsets.mFileDescriptor == NULL,
                  "Unable to find mFileDescriptor field in android.os.ParcelFileDescriptor");
 
-    return AndroidRuntime::registerNativeMethods(
+    int result = AndroidRuntime::registerNativeMethods(
         env, kParcelFileDescriptorPathName,
         gParcelFileDescriptorMethods, NELEM(gParcelFileDescriptorMethods));
+    AndroidRuntime::registerOptionalNativeMethods(
+        env, kParcelFileDescriptorPathName,
+        gParcelFileDescriptorOptionalMethods, NELEM(gParcelFileDescriptorOptionalMethods));
+    return result;
 }
 
 }
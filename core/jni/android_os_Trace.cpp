@@ -17,13 +17,28 @@
 #define LOG_TAG "Trace"
 
 #include <JNIHelp.h>
+#include <android_runtime/AndroidRuntime.h>
 #include <ScopedUtfChars.h>
 
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
 #include <utils/Trace.h>
+#include <utils/threads.h>
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 
 namespace android {
 
+#define MAX_TRACE_SECTIONS 1024
+
+// Section names registered once from Java, so that begin calls can pass a
+// token instead of converting the name string every time. Entries are never
+// removed, so a token read without the lock always sees its name.
+static const char* gSectionNames[MAX_TRACE_SECTIONS];
+static volatile int32_t gSectionCount = 0;
+static KeyedVector<String8, jint> gSectionTokens;
+static Mutex gSectionLock;
+
 static jlong android_os_Trace_nativeGetEnabledTags(JNIEnv* env, jclass clazz) {
     return Tracer::getEnabledTags();
 }
@@ -45,6 +60,54 @@ static void android_os_Trace_nativeTraceEnd(JNIEnv* env, jclass clazz,
     Tracer::traceEnd(tag);
 }
 
+static jint android_os_Trace_nativeRegisterSection(JNIEnv* env, jclass clazz,
+        jstring nameStr) {
+    ScopedUtfChars name(env, nameStr);
+    if (name.c_str() == NULL) {
+        return -1;
+    }
+
+    String8 key(name.c_str());
+    AutoMutex _l(gSectionLock);
+    ssize_t index = gSectionTokens.indexOfKey(key);
+    if (index >= 0) {
+        return gSectionTokens.valueAt(index);
+    }
+
+    jint token = gSectionCount;
+    if (token >= MAX_TRACE_SECTIONS) {
+        ALOGW("Too many trace sections registered, ignoring '%s'", name.c_str());
+        return -1;
+    }
+    gSectionNames[token] = strdup(name.c_str());
+    gSectionTokens.add(key, token);
+    android_atomic_release_store(token + 1, &gSectionCount);
+    return token;
+}
+
+static bool isValidSectionToken(jint token) {
+    return token >= 0 && token < android_atomic_acquire_load(&gSectionCount);
+}
+
+// Sections begun by token must be ended by token: an invalid token, such as the
+// -1 returned once the table is full, neither begins nor ends a section, so it
+// cannot end one of the caller's sections instead.
+static void android_os_Trace_nativeTraceBeginToken(JNIEnv* env, jclass clazz,
+        jlong tag, jint token) {
+    if (!isValidSectionToken(token)) {
+        ALOGW("Ignoring unknown trace section token %d", token);
+        return;
+    }
+    Tracer::traceBegin(tag, gSectionNames[token]);
+}
+
+static void android_os_Trace_nativeTraceEndToken(JNIEnv* env, jclass clazz,
+        jlong tag, jint token) {
+    if (isValidSectionToken(token)) {
+        Tracer::traceEnd(tag);
+    }
+}
+
 static JNINativeMethod gTraceMethods[] = {
     /* name, signature, funcPtr */
     { "nativeGetEnabledTags",
@@ -61,10 +124,26 @@ static JNINativeMethod gTraceMethods[] = {
             (void*)android_os_Trace_nativeTraceEnd },
 };
 
+// Registered-token sections, only registered if Trace declares them
+static JNINativeMethod gTraceOptionalMethods[] = {
+    /* name, signature, funcPtr */
+    { "nativeRegisterSection",
+            "(Ljava/lang/String;)I",
+            (void*)android_os_Trace_nativeRegisterSection },
+    { "nativeTraceBeginToken",
+            "(JI)V",
+            (void*)android_os_Trace_nativeTraceBeginToken },
+    { "nativeTraceEndToken",
+            "(JI)V",
+            (void*)android_os_Trace_nativeTraceEndToken },
+};
+
 int register_android_os_Trace(JNIEnv* env) {
     int res = jniRegisterNativeMethods(env, "android/os/Trace",
             gTraceMethods, NELEM(gTraceMethods));
     LOG_FATAL_IF(res < 0, "Unable to register native methods.");
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/os/Trace",
+            gTraceOptionalMethods, NELEM(gTraceOptionalMethods));
 
     return 0;
 }
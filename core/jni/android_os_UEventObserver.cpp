@@ -22,9 +22,42 @@
 #include "JNIHelp.h"
 #include "android_runtime/AndroidRuntime.h"
 
+#include <utils/threads.h>
+#include <utils/Vector.h>
+#include <utils/String8.h>
+
+#include <string.h>
+
 namespace android
 {
 
+static Mutex gMatchesMutex;
+static Vector<String8> gMatches;
+// Messages are only filtered once Java has registered a match
+static bool gFilterEnabled = false;
+
+/*
+ * Returns true if any of the zero-delimited fields of the message contains
+ * one of the registered matches.
+ */
+static bool isMatch(const char* buffer, size_t length) {
+    AutoMutex _l(gMatchesMutex);
+    if (!gFilterEnabled) {
+        return true;
+    }
+
+    const char* end = buffer + length;
+    for (size_t i = 0; i < gMatches.size(); i++) {
+        const String8& match = gMatches.itemAt(i);
+        for (const char* field = buffer; field < end; field += strlen(field) + 1) {
+            if (strstr(field, match.string())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static void
 android_os_UEventObserver_native_setup(JNIEnv *env, jclass clazz)
 {
@@ -40,18 +73,68 @@ android_os_UEventObserver_next_event(JNIEnv *env, jclass clazz, jbyteArray jbuff
     int buf_sz = env->GetArrayLength(jbuffer);
     char *buffer = (char*)env->GetByteArrayElements(jbuffer, NULL);
 
-    int length = uevent_next_event(buffer, buf_sz - 1);
+    // Drop the messages nobody is observing without waking up Java
+    int length;
+    do {
+        length = uevent_next_event(buffer, buf_sz - 1);
+        if (length <= 0) {
+            break;
+        }
+        buffer[length] = '\0';
+    } while (!isMatch(buffer, length));
 
     env->ReleaseByteArrayElements(jbuffer, (jbyte*)buffer, 0);
 
     return length;
 }
 
+static void
+android_os_UEventObserver_native_add_match(JNIEnv *env, jclass clazz, jstring matchStr)
+{
+    const char* match = env->GetStringUTFChars(matchStr, NULL);
+    if (match == NULL) {
+        return;
+    }
+
+    AutoMutex _l(gMatchesMutex);
+    gMatches.add(String8(match));
+    gFilterEnabled = true;
+
+    env->ReleaseStringUTFChars(matchStr, match);
+}
+
+static void
+android_os_UEventObserver_native_remove_match(JNIEnv *env, jclass clazz, jstring matchStr)
+{
+    const char* match = env->GetStringUTFChars(matchStr, NULL);
+    if (match == NULL) {
+        return;
+    }
+
+    AutoMutex _l(gMatchesMutex);
+    for (size_t i = 0; i < gMatches.size(); i++) {
+        if (gMatches.itemAt(i) == match) {
+            gMatches.removeAt(i);
+            break; // only remove first occurrence
+        }
+    }
+
+    env->ReleaseStringUTFChars(matchStr, match);
+}
+
 static JNINativeMethod gMethods[] = {
     {"native_setup", "()V",   (void *)android_os_UEventObserver_native_setup},
     {"next_event",   "([B)I", (void *)android_os_UEventObserver_next_event},
 };
 
+// Only registered if UEventObserver declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"native_add_match", "(Ljava/lang/String;)V",
+            (void *)android_os_UEventObserver_native_add_match},
+    {"native_remove_match", "(Ljava/lang/String;)V",
+            (void *)android_os_UEventObserver_native_remove_match},
+};
+
 
 int register_android_os_UEventObserver(JNIEnv *env)
 {
@@ -63,8 +146,11 @@ int register_android_os_UEventObserver(JNIEnv *env)
         return -1;
     }
 
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
                 "android/os/UEventObserver", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+                "android/os/UEventObserver", gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 }   // namespace android
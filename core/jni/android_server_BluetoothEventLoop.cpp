@@ -42,9 +42,12 @@ namespace android {
 
 #ifdef HAVE_BLUETOOTH
 static jfieldID field_mNativeData;
+static jclass class_String;
+static jclass class_StringArray;
 
 static jmethodID method_onPropertyChanged;
 static jmethodID method_onDevicePropertyChanged;
+static jmethodID method_onDevicePropertiesChanged;
 static jmethodID method_onDeviceFound;
 static jmethodID method_onDeviceDisappeared;
 static jmethodID method_onDeviceCreated;
@@ -80,6 +83,93 @@ typedef event_loop_native_data_t native_data_t;
 
 #define EVENT_LOOP_REFS 10
 
+/* signals handled by event_filter() */
+enum {
+    SIGNAL_UNKNOWN = -1,
+    SIGNAL_ADAPTER_DEVICE_FOUND,
+    SIGNAL_ADAPTER_DEVICE_DISAPPEARED,
+    SIGNAL_ADAPTER_DEVICE_CREATED,
+    SIGNAL_ADAPTER_DEVICE_REMOVED,
+    SIGNAL_ADAPTER_PROPERTY_CHANGED,
+    SIGNAL_DEVICE_PROPERTY_CHANGED,
+    SIGNAL_DEVICE_DISCONNECT_REQUESTED,
+    SIGNAL_INPUT_PROPERTY_CHANGED,
+    SIGNAL_NETWORK_PROPERTY_CHANGED,
+    SIGNAL_NETWORK_SERVER_DEVICE_DISCONNECTED,
+    SIGNAL_NETWORK_SERVER_DEVICE_CONNECTED,
+    SIGNAL_HEALTH_DEVICE_CHANNEL_CONNECTED,
+    SIGNAL_HEALTH_DEVICE_CHANNEL_DELETED,
+    SIGNAL_HEALTH_DEVICE_PROPERTY_CHANGED,
+};
+
+struct event_signal_t {
+    const char *interface;
+    const char *member;
+    int id;
+};
+
+static const event_signal_t sEventSignals[] = {
+    { "org.bluez.Adapter", "DeviceFound", SIGNAL_ADAPTER_DEVICE_FOUND },
+    { "org.bluez.Adapter", "DeviceDisappeared", SIGNAL_ADAPTER_DEVICE_DISAPPEARED },
+    { "org.bluez.Adapter", "DeviceCreated", SIGNAL_ADAPTER_DEVICE_CREATED },
+    { "org.bluez.Adapter", "DeviceRemoved", SIGNAL_ADAPTER_DEVICE_REMOVED },
+    { "org.bluez.Adapter", "PropertyChanged", SIGNAL_ADAPTER_PROPERTY_CHANGED },
+    { "org.bluez.Device", "PropertyChanged", SIGNAL_DEVICE_PROPERTY_CHANGED },
+    { "org.bluez.Device", "DisconnectRequested", SIGNAL_DEVICE_DISCONNECT_REQUESTED },
+    { "org.bluez.Input", "PropertyChanged", SIGNAL_INPUT_PROPERTY_CHANGED },
+    { "org.bluez.Network", "PropertyChanged", SIGNAL_NETWORK_PROPERTY_CHANGED },
+    { "org.bluez.NetworkServer", "DeviceDisconnected", SIGNAL_NETWORK_SERVER_DEVICE_DISCONNECTED },
+    { "org.bluez.NetworkServer", "DeviceConnected", SIGNAL_NETWORK_SERVER_DEVICE_CONNECTED },
+    { "org.bluez.HealthDevice", "ChannelConnected", SIGNAL_HEALTH_DEVICE_CHANNEL_CONNECTED },
+    { "org.bluez.HealthDevice", "ChannelDeleted", SIGNAL_HEALTH_DEVICE_CHANNEL_DELETED },
+    { "org.bluez.HealthDevice", "PropertyChanged", SIGNAL_HEALTH_DEVICE_PROPERTY_CHANGED },
+};
+
+/* open addressing table of (index + 1) in sEventSignals, 0 if empty */
+#define EVENT_SIGNAL_HASH_SIZE 64
+static unsigned char sEventSignalHash[EVENT_SIGNAL_HASH_SIZE];
+
+static unsigned int hash_event_signal(const char *interface, const char *member) {
+    unsigned int hash = 5381;
+    for (const char *c = interface; *c; c++) {
+        hash = hash * 33 + *c;
+    }
+    hash = hash * 33 + '.';
+    for (const char *c = member; *c; c++) {
+        hash = hash * 33 + *c;
+    }
+    return hash;
+}
+
+static void init_event_signal_hash() {
+    memset(sEventSignalHash, 0, sizeof(sEventSignalHash));
+    for (unsigned int i = 0; i < NELEM(sEventSignals); i++) {
+        unsigned int slot = hash_event_signal(sEventSignals[i].interface,
+                sEventSignals[i].member) % EVENT_SIGNAL_HASH_SIZE;
+        while (sEventSignalHash[slot]) {
+            slot = (slot + 1) % EVENT_SIGNAL_HASH_SIZE;
+        }
+        sEventSignalHash[slot] = i + 1;
+    }
+}
+
+/* Returns the SIGNAL_ id of the given signal, replacing a chain of
+ * dbus_message_is_signal() string comparisons. */
+static int find_event_signal(const char *interface, const char *member) {
+    if (interface == NULL || member == NULL) {
+        return SIGNAL_UNKNOWN;
+    }
+    unsigned int slot = hash_event_signal(interface, member) % EVENT_SIGNAL_HASH_SIZE;
+    while (sEventSignalHash[slot]) {
+        const event_signal_t *s = &sEventSignals[sEventSignalHash[slot] - 1];
+        if (!strcmp(s->member, member) && !strcmp(s->interface, interface)) {
+            return s->id;
+        }
+        slot = (slot + 1) % EVENT_SIGNAL_HASH_SIZE;
+    }
+    return SIGNAL_UNKNOWN;
+}
+
 static inline native_data_t * get_native_data(JNIEnv *env, jobject object) {
     return (native_data_t *)(env->GetIntField(object,
                                                  field_mNativeData));
@@ -89,6 +179,52 @@ native_data_t *get_EventLoop_native_data(JNIEnv *env, jobject object) {
     return get_native_data(env, object);
 }
 
+/* Sends the batched device property changes to java, in one call. Must be
+ * called before any other call into java from the event loop, so that java
+ * sees the events in order. */
+static void flush_device_property_changes(native_data_t *nat, JNIEnv *env) {
+    int count = nat->batchedCount;
+    if (count == 0) {
+        return;
+    }
+    nat->batchedCount = 0;
+
+    if (count == 1) {
+        env->CallVoidMethod(nat->me, method_onDevicePropertyChanged,
+                            nat->batchedPaths[0], nat->batchedProperties[0]);
+    } else {
+        env->PushLocalFrame(EVENT_LOOP_REFS);
+        jobjectArray paths = env->NewObjectArray(count, class_String, NULL);
+        jobjectArray properties = env->NewObjectArray(count, class_StringArray, NULL);
+        if (paths != NULL && properties != NULL) {
+            for (int i = 0; i < count; i++) {
+                env->SetObjectArrayElement(paths, i, nat->batchedPaths[i]);
+                env->SetObjectArrayElement(properties, i, nat->batchedProperties[i]);
+            }
+            env->CallVoidMethod(nat->me, method_onDevicePropertiesChanged,
+                                paths, properties);
+        } else {
+            ALOGE("%s: out of memory, dropping %d property changes", __FUNCTION__, count);
+        }
+        env->PopLocalFrame(NULL);
+    }
+
+    for (int i = 0; i < count; i++) {
+        env->DeleteGlobalRef(nat->batchedPaths[i]);
+        env->DeleteGlobalRef(nat->batchedProperties[i]);
+    }
+}
+
+static void batch_device_property_change(native_data_t *nat, JNIEnv *env,
+                                         jstring path, jobjectArray properties) {
+    if (nat->batchedCount == EVENT_LOOP_PROPERTY_BATCH_SIZE) {
+        flush_device_property_changes(nat, env);
+    }
+    nat->batchedPaths[nat->batchedCount] = env->NewGlobalRef(path);
+    nat->batchedProperties[nat->batchedCount] = env->NewGlobalRef(properties);
+    nat->batchedCount++;
+}
+
 #endif
 static void classInitNative(JNIEnv* env, jclass clazz) {
     ALOGV("%s", __FUNCTION__);
@@ -99,6 +235,15 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
     method_onDevicePropertyChanged = env->GetMethodID(clazz,
                                                       "onDevicePropertyChanged",
                                                       "(Ljava/lang/String;[Ljava/lang/String;)V");
+    // Optional, device property changes are sent one by one without it
+    method_onDevicePropertiesChanged = env->GetMethodID(clazz,
+            "onDevicePropertiesChanged", "([Ljava/lang/String;[[Ljava/lang/String;)V");
+    if (method_onDevicePropertiesChanged == NULL) {
+        env->ExceptionClear();
+    }
+    class_String = (jclass) env->NewGlobalRef(env->FindClass("java/lang/String"));
+    class_StringArray = (jclass) env->NewGlobalRef(env->FindClass("[Ljava/lang/String;"));
+    init_event_signal_hash();
     method_onDeviceFound = env->GetMethodID(clazz, "onDeviceFound",
                                             "(Ljava/lang/String;[Ljava/lang/String;)V");
     method_onDeviceDisappeared = env->GetMethodID(clazz, "onDeviceDisappeared",
@@ -713,6 +858,8 @@ static void *eventLoopMain(void *ptr) {
         while (dbus_connection_dispatch(nat->conn) ==
                 DBUS_DISPATCH_DATA_REMAINS) {
         }
+        // End of the burst of messages read by dbus_watch_handle()
+        flush_device_property_changes(nat, env);
 
         poll(nat->pollData, nat->pollMemberCount, -1);
     }
@@ -864,10 +1011,16 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
         dbus_message_get_interface(msg), dbus_message_get_member(msg),
         dbus_message_get_path(msg));
 
+    int signal_id = find_event_signal(dbus_message_get_interface(msg),
+                                      dbus_message_get_member(msg));
+    if (signal_id != SIGNAL_DEVICE_PROPERTY_CHANGED) {
+        // Keep the order of the events seen by java
+        flush_device_property_changes(nat, env);
+    }
+
     env->PushLocalFrame(EVENT_LOOP_REFS);
-    if (dbus_message_is_signal(msg,
-                               "org.bluez.Adapter",
-                               "DeviceFound")) {
+    switch (signal_id) {
+    case SIGNAL_ADAPTER_DEVICE_FOUND: {
         char *c_address;
         DBusMessageIter iter;
         jobjectArray str_array = NULL;
@@ -885,9 +1038,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
         } else
             LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.Adapter",
-                                     "DeviceDisappeared")) {
+    }
+    case SIGNAL_ADAPTER_DEVICE_DISAPPEARED: {
         char *c_address;
         if (dbus_message_get_args(msg, &err,
                                   DBUS_TYPE_STRING, &c_address,
@@ -897,9 +1049,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
                                 env->NewStringUTF(c_address));
         } else LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.Adapter",
-                                     "DeviceCreated")) {
+    }
+    case SIGNAL_ADAPTER_DEVICE_CREATED: {
         char *c_object_path;
         if (dbus_message_get_args(msg, &err,
                                   DBUS_TYPE_OBJECT_PATH, &c_object_path,
@@ -910,9 +1061,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
                                 env->NewStringUTF(c_object_path));
         } else LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.Adapter",
-                                     "DeviceRemoved")) {
+    }
+    case SIGNAL_ADAPTER_DEVICE_REMOVED: {
         char *c_object_path;
         if (dbus_message_get_args(msg, &err,
                                  DBUS_TYPE_OBJECT_PATH, &c_object_path,
@@ -923,9 +1073,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
                                env->NewStringUTF(c_object_path));
         } else LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                      "org.bluez.Adapter",
-                                      "PropertyChanged")) {
+    }
+    case SIGNAL_ADAPTER_PROPERTY_CHANGED: {
         jobjectArray str_array = parse_adapter_property_change(env, msg);
         if (str_array != NULL) {
             /* Check if bluetoothd has (re)started, if so update the path. */
@@ -946,29 +1095,33 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
                               str_array);
         } else LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                      "org.bluez.Device",
-                                      "PropertyChanged")) {
+    }
+    case SIGNAL_DEVICE_PROPERTY_CHANGED: {
         jobjectArray str_array = parse_remote_device_property_change(env, msg);
         if (str_array != NULL) {
             const char *remote_device_path = dbus_message_get_path(msg);
-            env->CallVoidMethod(nat->me,
-                            method_onDevicePropertyChanged,
-                            env->NewStringUTF(remote_device_path),
-                            str_array);
+            jstring path = env->NewStringUTF(remote_device_path);
+            if (method_onDevicePropertiesChanged != NULL) {
+                // Sent by flush_device_property_changes() with the
+                // others of this burst
+                batch_device_property_change(nat, env, path, str_array);
+            } else {
+                env->CallVoidMethod(nat->me,
+                                method_onDevicePropertyChanged,
+                                path,
+                                str_array);
+            }
         } else LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                      "org.bluez.Device",
-                                      "DisconnectRequested")) {
+    }
+    case SIGNAL_DEVICE_DISCONNECT_REQUESTED: {
         const char *remote_device_path = dbus_message_get_path(msg);
         env->CallVoidMethod(nat->me,
                             method_onDeviceDisconnectRequested,
                             env->NewStringUTF(remote_device_path));
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                      "org.bluez.Input",
-                                      "PropertyChanged")) {
+    }
+    case SIGNAL_INPUT_PROPERTY_CHANGED: {
 
         jobjectArray str_array =
                     parse_input_property_change(env, msg);
@@ -982,9 +1135,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
             LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
         }
         goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.Network",
-                                     "PropertyChanged")) {
+    }
+    case SIGNAL_NETWORK_PROPERTY_CHANGED: {
 
        jobjectArray str_array =
                    parse_pan_property_change(env, msg);
@@ -998,9 +1150,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
            LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
        }
        goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.NetworkServer",
-                                     "DeviceDisconnected")) {
+    }
+    case SIGNAL_NETWORK_SERVER_DEVICE_DISCONNECTED: {
        char *c_address;
        if (dbus_message_get_args(msg, &err,
                                   DBUS_TYPE_STRING, &c_address,
@@ -1012,9 +1163,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
            LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
        }
        goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.NetworkServer",
-                                     "DeviceConnected")) {
+    }
+    case SIGNAL_NETWORK_SERVER_DEVICE_CONNECTED: {
        char *c_address;
        char *c_iface;
        uint16_t uuid;
@@ -1033,9 +1183,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
            LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
        }
        goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.HealthDevice",
-                                     "ChannelConnected")) {
+    }
+    case SIGNAL_HEALTH_DEVICE_CHANNEL_CONNECTED: {
        const char *c_path = dbus_message_get_path(msg);
        const char *c_channel_path;
        jboolean exists = JNI_TRUE;
@@ -1051,9 +1200,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
            LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
        }
        goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.HealthDevice",
-                                     "ChannelDeleted")) {
+    }
+    case SIGNAL_HEALTH_DEVICE_CHANNEL_DELETED: {
 
        const char *c_path = dbus_message_get_path(msg);
        const char *c_channel_path;
@@ -1070,9 +1218,8 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
            LOG_AND_FREE_DBUS_ERROR_WITH_MSG(&err, msg);
        }
        goto success;
-    } else if (dbus_message_is_signal(msg,
-                                     "org.bluez.HealthDevice",
-                                     "PropertyChanged")) {
+    }
+    case SIGNAL_HEALTH_DEVICE_PROPERTY_CHANGED: {
         jobjectArray str_array =
                     parse_health_device_property_change(env, msg);
         if (str_array != NULL) {
@@ -1086,6 +1233,9 @@ static DBusHandlerResult event_filter(DBusConnection *conn, DBusMessage *msg,
        }
        goto success;
     }
+    default:
+        break;
+    }
 
     ret = a2dp_event_filter(msg, env);
     env->PopLocalFrame(NULL);
@@ -1111,6 +1261,7 @@ DBusHandlerResult agent_event_filter(DBusConnection *conn,
     if (nat == NULL) return DBUS_HANDLER_RESULT_HANDLED;
 
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
     env->PushLocalFrame(EVENT_LOOP_REFS);
 
     if (dbus_message_is_method_call(msg,
@@ -1320,6 +1471,7 @@ void onCreatePairedDeviceResult(DBusMessage *msg, void *user, void *n) {
     jstring addr;
 
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     ALOGV("... address = %s", address);
 
@@ -1387,6 +1539,7 @@ void onCreateDeviceResult(DBusMessage *msg, void *user, void *n) {
     dbus_error_init(&err);
     JNIEnv *env;
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     ALOGV("... Address = %s", address);
 
@@ -1417,6 +1570,7 @@ void onDiscoverServicesResult(DBusMessage *msg, void *user, void *n) {
     dbus_error_init(&err);
     JNIEnv *env;
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     ALOGV("... Device Path = %s", path);
 
@@ -1444,6 +1598,7 @@ void onGetDeviceServiceChannelResult(DBusMessage *msg, void *user, void *n) {
     dbus_error_init(&err);
     JNIEnv *env;
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     jint channel = -2;
 
@@ -1476,6 +1631,7 @@ void onInputDeviceConnectionResult(DBusMessage *msg, void *user, void *n) {
     dbus_error_init(&err);
     JNIEnv *env;
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     jint result = INPUT_OPERATION_SUCCESS;
     if (dbus_set_error_from_message(&err, msg)) {
@@ -1515,6 +1671,7 @@ void onPanDeviceConnectionResult(DBusMessage *msg, void *user, void *n) {
     dbus_error_init(&err);
     JNIEnv *env;
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     jint result = PAN_OPERATION_SUCCESS;
     if (dbus_set_error_from_message(&err, msg)) {
@@ -1553,6 +1710,7 @@ void onHealthDeviceConnectionResult(DBusMessage *msg, void *user, void *n) {
     dbus_error_init(&err);
     JNIEnv *env;
     nat->vm->GetEnv((void**)&env, nat->envVer);
+    flush_device_property_changes(nat, env);
 
     jint result = HEALTH_OPERATION_SUCCESS;
     if (dbus_set_error_from_message(&err, msg)) {
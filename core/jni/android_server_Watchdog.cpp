@@ -27,6 +27,9 @@
 #include "jni.h"
 #include "JNIHelp.h"
 #include <android_runtime/AndroidRuntime.h>
+#include <androidfw/StallDetector.h>
+
+using android::StallDetector;
 
 static void dumpOneStack(int tid, int outFd) {
     char buf[64];
@@ -97,6 +100,67 @@ done:
     env->ReleaseStringUTFChars(pathStr, path);
 }
 
+static void startStallDetector(JNIEnv* env, jobject clazz, jint sampleIntervalMillis,
+        jint thresholdMillis, jboolean nativeBacktraces) {
+    android::status_t result = StallDetector::start(
+            milliseconds_to_nanoseconds(sampleIntervalMillis),
+            milliseconds_to_nanoseconds(thresholdMillis), nativeBacktraces);
+    if (result == android::BAD_VALUE) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Sample interval and threshold must be positive");
+    }
+}
+
+static void stopStallDetector(JNIEnv* env, jobject clazz) {
+    StallDetector::stop();
+}
+
+// Watches the calling looper thread, initially idle.  The looper must then report each
+// message it dispatches with looperBeginWork() and looperEndWork().
+static void registerLooperThread(JNIEnv* env, jobject clazz, jstring nameStr) {
+    if (!nameStr) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Null name");
+        return;
+    }
+
+    const char *name = env->GetStringUTFChars(nameStr, NULL);
+    StallDetector::registerThread(name);
+    StallDetector::endWork();
+    env->ReleaseStringUTFChars(nameStr, name);
+}
+
+static void unregisterLooperThread(JNIEnv* env, jobject clazz) {
+    StallDetector::unregisterThread();
+}
+
+static void looperBeginWork(JNIEnv* env, jobject clazz) {
+    StallDetector::beginWork();
+}
+
+static void looperEndWork(JNIEnv* env, jobject clazz) {
+    StallDetector::endWork();
+}
+
+static void dumpStalls(JNIEnv* env, jobject clazz, jstring pathStr) {
+    if (!pathStr) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Null path");
+        return;
+    }
+
+    const char *path = env->GetStringUTFChars(pathStr, NULL);
+
+    int outFd = open(path, O_WRONLY | O_APPEND | O_CREAT,
+        S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+    if (outFd < 0) {
+        ALOGE("Unable to open stall dump file: %d (%s)", errno, strerror(errno));
+    } else {
+        StallDetector::dump(outFd);
+        close(outFd);
+    }
+
+    env->ReleaseStringUTFChars(pathStr, path);
+}
+
 // ----------------------------------------
 
 namespace android {
@@ -105,9 +169,23 @@ static const JNINativeMethod g_methods[] = {
     { "native_dumpKernelStacks", "(Ljava/lang/String;)V", (void*)dumpKernelStacks },
 };
 
+// Only registered if Watchdog declares them
+static const JNINativeMethod g_optional_methods[] = {
+    { "native_startStallDetector", "(IIZ)V", (void*)startStallDetector },
+    { "native_stopStallDetector", "()V", (void*)stopStallDetector },
+    { "native_registerLooperThread", "(Ljava/lang/String;)V", (void*)registerLooperThread },
+    { "native_unregisterLooperThread", "()V", (void*)unregisterLooperThread },
+    { "native_looperBeginWork", "()V", (void*)looperBeginWork },
+    { "native_looperEndWork", "()V", (void*)looperEndWork },
+    { "native_dumpStalls", "(Ljava/lang/String;)V", (void*)dumpStalls },
+};
+
 int register_android_server_Watchdog(JNIEnv* env) {
-    return AndroidRuntime::registerNativeMethods(env, "com/android/server/Watchdog",
-                                                 g_methods, NELEM(g_methods));
+    int result = AndroidRuntime::registerNativeMethods(env, "com/android/server/Watchdog",
+                                                       g_methods, NELEM(g_methods));
+    AndroidRuntime::registerOptionalNativeMethods(env, "com/android/server/Watchdog",
+                                                  g_optional_methods, NELEM(g_optional_methods));
+    return result;
 }
 
 }
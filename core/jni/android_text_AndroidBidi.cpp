@@ -17,11 +17,14 @@
 
 #define LOG_TAG "AndroidUnicode"
 
+#include <string.h>
+
 #include "JNIHelp.h"
 #include <android_runtime/AndroidRuntime.h>
 #include "utils/misc.h"
 #include "utils/Log.h"
 #include "unicode/ubidi.h"
+#include "TextLayoutCache.h"
 
 namespace android {
 
@@ -36,18 +39,18 @@ static jint runBidi(JNIEnv* env, jobject obj, jint dir, jcharArray chsArray,
     if (chs != NULL) {
         jbyte* info = env->GetByteArrayElements(infoArray, NULL);
         if (info != NULL) {
-            UErrorCode status = U_ZERO_ERROR;
-            UBiDi* bidi = ubidi_openSized(n, 0, &status);
-            ubidi_setPara(bidi, chs, n, dir, NULL, &status);
-            if (U_SUCCESS(status)) {
-                for (int i = 0; i < n; ++i) {
-                  info[i] = ubidi_getLevelAt(bidi, i);
+            // Layouts ask for the same paragraphs again and again, share the cache
+            // of the text layout engine
+            sp<TextBidiValue> bidi = TextBidiCache::getInstance().getValue(chs, n,
+                    UBiDiLevel(dir));
+            if (bidi != NULL) {
+                if (n > 0) {
+                    memcpy(info, bidi->getLevels(), n * sizeof(UBiDiLevel));
                 }
-                result = ubidi_getParaLevel(bidi);
+                result = bidi->getParaLevel();
             } else {
                 jniThrowException(env, "java/lang/RuntimeException", NULL);
             }
-            ubidi_close(bidi);
 
             env->ReleaseByteArrayElements(infoArray, info, 0);
         }
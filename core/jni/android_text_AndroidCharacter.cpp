@@ -17,6 +17,8 @@
 
 #define LOG_TAG "AndroidUnicode"
 
+#include <pthread.h>
+
 #include "JNIHelp.h"
 #include "ScopedPrimitiveArray.h"
 #include <android_runtime/AndroidRuntime.h>
@@ -51,6 +53,38 @@ static int directionality_map[U_CHAR_DIRECTION_COUNT] = {
 
 namespace android {
 
+static int directionalityOf(int c)
+{
+    int dir = u_charDirection(c);
+    if (dir < 0 || dir >= U_CHAR_DIRECTION_COUNT)
+        return PROPERTY_UNDEFINED;
+    return directionality_map[dir];
+}
+
+static int eastAsianWidthOf(int c)
+{
+    int width = u_getIntPropertyValue(c, UCHAR_EAST_ASIAN_WIDTH);
+    if (width < 0 || width >= U_EA_COUNT)
+        return PROPERTY_UNDEFINED;
+    return width;
+}
+
+// Properties of the Latin-1 characters, which make up most of the text that is measured,
+// looked up once so that the array functions below only call ICU for other characters
+#define LATIN1_CHAR_COUNT 256
+
+static jbyte gLatin1Directionalities[LATIN1_CHAR_COUNT];
+static jbyte gLatin1EastAsianWidths[LATIN1_CHAR_COUNT];
+static pthread_once_t gLatin1Once = PTHREAD_ONCE_INIT;
+
+static void initLatin1Properties()
+{
+    for (int c = 0; c < LATIN1_CHAR_COUNT; c++) {
+        gLatin1Directionalities[c] = directionalityOf(c);
+        gLatin1EastAsianWidths[c] = eastAsianWidthOf(c);
+    }
+}
+
 static void getDirectionalities(JNIEnv* env, jobject obj, jcharArray srcArray, jbyteArray destArray, int count)
 {
     ScopedCharArrayRO src(env, srcArray);
@@ -67,38 +101,30 @@ static void getDirectionalities(JNIEnv* env, jobject obj, jcharArray srcArray, j
         return;
     }
 
+    pthread_once(&gLatin1Once, initLatin1Properties);
+
+    const jchar* chars = src.get();
+    jbyte* dirs = dest.get();
     for (int i = 0; i < count; i++) {
-        if (src[i] >= 0xD800 && src[i] <= 0xDBFF &&
+        int c = chars[i];
+        if (c < LATIN1_CHAR_COUNT) {
+            dirs[i] = gLatin1Directionalities[c];
+        } else if (c >= 0xD800 && c <= 0xDBFF &&
             i + 1 < count &&
-            src[i + 1] >= 0xDC00 && src[i + 1] <= 0xDFFF) {
-            int c = 0x00010000 + ((src[i] - 0xD800) << 10) +
-                                 (src[i + 1] & 0x3FF);
-            int dir = u_charDirection(c);
-            if (dir < 0 || dir >= U_CHAR_DIRECTION_COUNT)
-                dir = PROPERTY_UNDEFINED;
-            else
-                dir = directionality_map[dir];
-
-            dest[i++] = dir;
-            dest[i] = dir;
+            chars[i + 1] >= 0xDC00 && chars[i + 1] <= 0xDFFF) {
+            c = 0x00010000 + ((c - 0xD800) << 10) + (chars[i + 1] & 0x3FF);
+            int dir = directionalityOf(c);
+            dirs[i++] = dir;
+            dirs[i] = dir;
         } else {
-            int c = src[i];
-            int dir = u_charDirection(c);
-            if (dir < 0 || dir >= U_CHAR_DIRECTION_COUNT)
-                dest[i] = PROPERTY_UNDEFINED;
-            else
-                dest[i] = directionality_map[dir];
+            dirs[i] = directionalityOf(c);
         }
     }
 }
 
 static jint getEastAsianWidth(JNIEnv* env, jobject obj, jchar input)
 {
-    int width = u_getIntPropertyValue(input, UCHAR_EAST_ASIAN_WIDTH);
-    if (width < 0 || width >= U_EA_COUNT)
-        width = PROPERTY_UNDEFINED;
-
-    return width;
+    return eastAsianWidthOf(input);
 }
 
 static void getEastAsianWidths(JNIEnv* env, jobject obj, jcharArray srcArray,
@@ -120,26 +146,23 @@ static void getEastAsianWidths(JNIEnv* env, jobject obj, jcharArray srcArray,
         return;
     }
 
+    pthread_once(&gLatin1Once, initLatin1Properties);
+
+    const jchar* chars = src.get() + start;
+    jbyte* widths = dest.get();
     for (int i = 0; i < count; i++) {
-        const int srci = start + i;
-        if (src[srci] >= 0xD800 && src[srci] <= 0xDBFF &&
+        int c = chars[i];
+        if (c < LATIN1_CHAR_COUNT) {
+            widths[i] = gLatin1EastAsianWidths[c];
+        } else if (c >= 0xD800 && c <= 0xDBFF &&
             i + 1 < count &&
-            src[srci + 1] >= 0xDC00 && src[srci + 1] <= 0xDFFF) {
-            int c = 0x00010000 + ((src[srci] - 0xD800) << 10) +
-                                 (src[srci + 1] & 0x3FF);
-            int width = u_getIntPropertyValue(c, UCHAR_EAST_ASIAN_WIDTH);
-            if (width < 0 || width >= U_EA_COUNT)
-                width = PROPERTY_UNDEFINED;
-
-            dest[i++] = width;
-            dest[i] = width;
+            chars[i + 1] >= 0xDC00 && chars[i + 1] <= 0xDFFF) {
+            c = 0x00010000 + ((c - 0xD800) << 10) + (chars[i + 1] & 0x3FF);
+            int width = eastAsianWidthOf(c);
+            widths[i++] = width;
+            widths[i] = width;
         } else {
-            int c = src[srci];
-            int width = u_getIntPropertyValue(c, UCHAR_EAST_ASIAN_WIDTH);
-            if (width < 0 || width >= U_EA_COUNT)
-                width = PROPERTY_UNDEFINED;
-
-            dest[i] = width;
+            widths[i] = eastAsianWidthOf(c);
         }
     }
 }
@@ -16,6 +16,7 @@
 
 #define LOG_TAG "JavaBinder"
 //#define LOG_NDEBUG 0
+#define ATRACE_TAG ATRACE_TAG_VIEW
 
 #include "android_os_Parcel.h"
 #include "android_util_Binder.h"
@@ -41,6 +42,8 @@
 #include <binder/IServiceManager.h>
 #include <utils/threads.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
 
 #include <ScopedUtfChars.h>
 #include <ScopedLocalRef.h>
@@ -228,6 +231,188 @@ bail:
     env->DeleteLocalRef(msgstr);
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Transaction statistics, per interface descriptor, transaction code and
+ * direction. One in BINDER_STATS_SAMPLE_INTERVAL transactions is recorded,
+ * plus every transaction that takes BINDER_STATS_SLOW_NS or longer, which
+ * also go to a ring of recent slow calls.
+ */
+#define BINDER_STATS_SAMPLE_INTERVAL 16
+#define BINDER_STATS_SLOW_NS (50 * 1000000LL)
+#define BINDER_STATS_BUCKETS 20
+#define BINDER_STATS_RECENT 64
+
+struct TransactionStatsKey {
+    String16 descriptor;
+    uint32_t code;
+    bool incoming;
+
+    bool operator<(const TransactionStatsKey& rhs) const {
+        if (incoming != rhs.incoming) return incoming < rhs.incoming;
+        if (code != rhs.code) return code < rhs.code;
+        return descriptor < rhs.descriptor;
+    }
+};
+
+struct TransactionStats {
+    uint32_t count;
+    uint32_t slowCount;
+    nsecs_t totalTime;
+    nsecs_t maxTime;
+    // bucket i counts values in [2^i, 2^(i+1)), the last bucket is open ended
+    uint32_t latencyUs[BINDER_STATS_BUCKETS];
+    uint32_t sizeBytes[BINDER_STATS_BUCKETS];
+};
+
+struct SlowTransaction {
+    TransactionStatsKey key;
+    nsecs_t when;
+    nsecs_t duration;
+    size_t dataSize;
+    size_t replySize;
+};
+
+static Mutex gTransactionStatsLock;
+static KeyedVector<TransactionStatsKey, TransactionStats> gTransactionStats;
+static SlowTransaction gSlowTransactions[BINDER_STATS_RECENT];
+static size_t gSlowTransactionCount = 0;
+static volatile int32_t gTransactionSequence = 0;
+
+static bool shouldSampleTransaction()
+{
+    return android_atomic_inc(&gTransactionSequence) % BINDER_STATS_SAMPLE_INTERVAL == 0;
+}
+
+static size_t statsBucket(uint64_t value)
+{
+    size_t bucket = 0;
+    while (value > 1 && bucket < BINDER_STATS_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * The interface descriptor of a call, read back from the interface token that
+ * Parcel.writeInterfaceToken() puts at the start of every AIDL call.  Unlike
+ * getInterfaceDescriptor() this costs no transaction for a proxy and no call into
+ * Java for a local binder.  Calls outside the user range, such as the IBinder meta
+ * transactions, have no token and get an empty descriptor.
+ */
+static String16 transactionDescriptor(const Parcel& data, uint32_t code)
+{
+    String16 descriptor;
+    if (code >= IBinder::FIRST_CALL_TRANSACTION && code <= IBinder::LAST_CALL_TRANSACTION
+            && data.dataSize() > sizeof(int32_t)) {
+        const size_t position = data.dataPosition();
+        data.setDataPosition(0);
+        data.readInt32(); // strict mode policy
+        descriptor = data.readString16();
+        data.setDataPosition(position);
+    }
+    return descriptor;
+}
+
+static void recordTransaction(const String16& descriptor, uint32_t code, bool incoming,
+        nsecs_t duration, size_t dataSize, size_t replySize)
+{
+    TransactionStatsKey key;
+    key.descriptor = descriptor;
+    key.code = code;
+    key.incoming = incoming;
+    const bool slow = duration >= BINDER_STATS_SLOW_NS;
+
+    AutoMutex _l(gTransactionStatsLock);
+    ssize_t index = gTransactionStats.indexOfKey(key);
+    if (index < 0) {
+        TransactionStats stats;
+        memset(&stats, 0, sizeof(stats));
+        index = gTransactionStats.add(key, stats);
+    }
+    TransactionStats& stats = gTransactionStats.editValueAt(index);
+    stats.count++;
+    if (slow) {
+        stats.slowCount++;
+    }
+    stats.totalTime += duration;
+    if (duration > stats.maxTime) {
+        stats.maxTime = duration;
+    }
+    stats.latencyUs[statsBucket(duration / 1000)]++;
+    stats.sizeBytes[statsBucket(dataSize + replySize)]++;
+
+    if (slow) {
+        SlowTransaction& entry =
+                gSlowTransactions[gSlowTransactionCount++ % BINDER_STATS_RECENT];
+        entry.key = key;
+        entry.when = systemTime(SYSTEM_TIME_MONOTONIC);
+        entry.duration = duration;
+        entry.dataSize = dataSize;
+        entry.replySize = replySize;
+    }
+}
+
+static void beginTransactionTrace(const char* what, const String16& descriptor, uint32_t code)
+{
+    String8 name = String8::format("%s %s#%u", what, String8(descriptor).string(), code);
+    Tracer::traceBegin(ATRACE_TAG, name.string());
+}
+
+static void printStatsBuckets(FILE* fp, const char* label, const uint32_t* buckets)
+{
+    size_t last = 0;
+    for (size_t i = 0; i < BINDER_STATS_BUCKETS; i++) {
+        if (buckets[i]) {
+            last = i;
+        }
+    }
+    fprintf(fp, "      %s:", label);
+    for (size_t i = 0; i <= last; i++) {
+        fprintf(fp, " %u", buckets[i]);
+    }
+    fprintf(fp, "\n");
+}
+
+namespace android {
+
+void dumpBinderTransactionStats(FILE* fp)
+{
+    AutoMutex _l(gTransactionStatsLock);
+
+    fprintf(fp, "Binder transactions (1 in %d sampled, plus all calls >= %lldms):\n",
+            BINDER_STATS_SAMPLE_INTERVAL, BINDER_STATS_SLOW_NS / 1000000);
+    fprintf(fp, "  histogram buckets are powers of two of microseconds and bytes\n");
+    for (size_t i = 0; i < gTransactionStats.size(); i++) {
+        const TransactionStatsKey& key = gTransactionStats.keyAt(i);
+        const TransactionStats& stats = gTransactionStats.valueAt(i);
+        fprintf(fp, "  %s %s#%u: %u calls, %u slow, avg %lldus, max %lldus\n",
+                key.incoming ? "in " : "out", String8(key.descriptor).string(), key.code,
+                stats.count, stats.slowCount,
+                stats.totalTime / stats.count / 1000, stats.maxTime / 1000);
+        printStatsBuckets(fp, "latency", stats.latencyUs);
+        printStatsBuckets(fp, "size", stats.sizeBytes);
+    }
+
+    size_t count = gSlowTransactionCount < BINDER_STATS_RECENT
+            ? gSlowTransactionCount : BINDER_STATS_RECENT;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    fprintf(fp, "Recent slow binder transactions:\n");
+    for (size_t i = 0; i < count; i++) {
+        const SlowTransaction& entry =
+                gSlowTransactions[(gSlowTransactionCount - 1 - i) % BINDER_STATS_RECENT];
+        fprintf(fp, "  %lldms ago: %s %s#%u took %lldms, %u bytes sent, %u received\n",
+                (now - entry.when) / 1000000,
+                entry.key.incoming ? "in " : "out", String8(entry.key.descriptor).string(),
+                entry.key.code, entry.duration / 1000000,
+                entry.dataSize, entry.replySize);
+    }
+}
+
+}
+
 class JavaBBinderHolder;
 
 class JavaBBinder : public BBinder
@@ -271,6 +456,13 @@ protected:
         const int strict_policy_before = thread_state->getStrictModePolicy();
         thread_state->setLastTransactionBinderFlags(flags);
 
+        const bool sampled = shouldSampleTransaction();
+        const bool tracing = ATRACE_ENABLED();
+        if (tracing) {
+            beginTransactionTrace("binder onTransact", transactionDescriptor(data, code), code);
+        }
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
         //printf("Transact from %p to Java code sending: ", this);
         //data.print();
         //printf("\n");
@@ -278,6 +470,15 @@ protected:
             code, (int32_t)&data, (int32_t)reply, flags);
         jthrowable excep = env->ExceptionOccurred();
 
+        const nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        if (tracing) {
+            Tracer::traceEnd(ATRACE_TAG);
+        }
+        if (sampled || duration >= BINDER_STATS_SLOW_NS) {
+            recordTransaction(transactionDescriptor(data, code), code, true, duration,
+                    data.dataSize(), reply ? reply->dataSize() : 0);
+        }
+
         if (excep) {
             report_exception(env, excep,
                 "*** Uncaught remote exception!  "
@@ -543,15 +744,25 @@ sp<JavaDeathRecipient> DeathRecipientList::find(jobject recipient) {
 
 namespace android {
 
+static Mutex mProxyLock;
+
+// The weak reference global ref of every Java proxy currently attached to a
+// native IBinder, mapped to that IBinder. Guarded by mProxyLock.
+static KeyedVector<jobject, IBinder*> gProxyTable;
+static int32_t gNumProxiesCreated = 0;
+static size_t gProxyTableWarnSize = 2000;
+
 static void proxy_cleanup(const void* id, void* obj, void* cleanupCookie)
 {
     android_atomic_dec(&gNumProxyRefs);
     JNIEnv* env = javavm_to_jnienv((JavaVM*)cleanupCookie);
+    {
+        AutoMutex _l(mProxyLock);
+        gProxyTable.removeItem((jobject)obj);
+    }
     env->DeleteGlobalRef((jobject)obj);
 }
 
-static Mutex mProxyLock;
-
 jobject javaObjectForIBinder(JNIEnv* env, const sp<IBinder>& val)
 {
     if (val == NULL) return NULL;
@@ -578,6 +789,7 @@ jobject javaObjectForIBinder(JNIEnv* env, const sp<IBinder>& val)
         LOGDEATH("Proxy object %p of IBinder %p no longer in working set!!!", object, val.get());
         android_atomic_dec(&gNumProxyRefs);
         val->detachObject(&gBinderProxyOffsets);
+        gProxyTable.removeItem(object);
         env->DeleteGlobalRef(object);
     }
 
@@ -594,20 +806,81 @@ jobject javaObjectForIBinder(JNIEnv* env, const sp<IBinder>& val)
                 env->GetObjectField(object, gBinderProxyOffsets.mSelf));
         val->attachObject(&gBinderProxyOffsets, refObject,
                 jnienv_to_javavm(env), proxy_cleanup);
+        gProxyTable.add(refObject, val.get());
 
         // Also remember the death recipients registered on this proxy
         sp<DeathRecipientList> drl = new DeathRecipientList;
         drl->incStrong((void*)javaObjectForIBinder);
         env->SetIntField(object, gBinderProxyOffsets.mOrgue, reinterpret_cast<jint>(drl.get()));
 
-        // Note that a new object reference has been created.
+        // Proxies are not counted towards incRefsCreated(). Their weak references
+        // are released by proxy_cleanup() once the proxy is finalized, so forcing
+        // a GC for them only stalls processes that hold many proxies.
         android_atomic_inc(&gNumProxyRefs);
-        incRefsCreated(env);
+        gNumProxiesCreated++;
+        if (gProxyTable.size() >= gProxyTableWarnSize) {
+            ALOGW("Process holds %d binder proxies", gProxyTable.size());
+            gProxyTableWarnSize *= 2;
+        }
     }
 
     return object;
 }
 
+void dumpBinderProxyStats(JNIEnv* env, FILE* fp)
+{
+    // Only proxies that are still reachable are counted per interface.  The
+    // weak references are copied under mProxyLock so that WeakReference.get()
+    // is called without holding it; proxy_cleanup() may delete the table's
+    // references meanwhile.  Holding the Java proxy keeps its IBinder alive
+    // while the strong reference is taken.
+    Vector<jobject> refs;
+    int32_t created;
+    {
+        AutoMutex _l(mProxyLock);
+        const size_t N = gProxyTable.size();
+        created = gNumProxiesCreated;
+        refs.setCapacity(N);
+        for (size_t i = 0; i < N; i++) {
+            refs.add(env->NewGlobalRef(gProxyTable.keyAt(i)));
+        }
+    }
+
+    const size_t total = refs.size();
+    Vector< sp<IBinder> > live;
+    for (size_t i = 0; i < total; i++) {
+        jobject proxy = env->CallObjectMethod(refs[i], gWeakReferenceOffsets.mGet);
+        if (proxy != NULL) {
+            IBinder* binder = (IBinder*)env->GetIntField(proxy, gBinderProxyOffsets.mObject);
+            if (binder != NULL) {
+                live.add(binder);
+            }
+            env->DeleteLocalRef(proxy);
+        }
+        env->DeleteGlobalRef(refs[i]);
+    }
+
+    KeyedVector<String16, size_t> counts;
+    for (size_t i = 0; i < live.size(); i++) {
+        String16 descriptor(live[i]->getInterfaceDescriptor());
+        ssize_t index = counts.indexOfKey(descriptor);
+        if (index >= 0) {
+            counts.editValueAt(index)++;
+        } else {
+            counts.add(descriptor, 1);
+        }
+    }
+
+    fprintf(fp, "Binder proxies: %d attached, %d reachable, %d created\n",
+            total, live.size(), created);
+    for (size_t i = 0; i < counts.size(); i++) {
+        String8 name(counts.keyAt(i));
+        fprintf(fp, "  %6d %s\n", counts.valueAt(i),
+                name.length() > 0 ? name.string() : "<unknown>");
+    }
+    live.clear();
+}
+
 sp<IBinder> ibinderForJavaObject(JNIEnv* env, jobject obj)
 {
     if (obj == NULL) return NULL;
@@ -1085,9 +1358,25 @@ static jboolean android_os_BinderProxy_transact(JNIEnv* env, jobject obj,
     if (time_binder_calls) {
         start_millis = uptimeMillis();
     }
+    const bool sampled = shouldSampleTransaction();
+    const bool tracing = ATRACE_ENABLED();
+    if (tracing) {
+        beginTransactionTrace("binder transact", transactionDescriptor(*data, code), code);
+    }
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
     //printf("Transact from Java code to %p sending: ", target); data->print();
     status_t err = target->transact(code, *data, reply, flags);
     //if (reply) printf("Transact from Java code to %p received: ", target); reply->print();
+
+    const nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    if (tracing) {
+        Tracer::traceEnd(ATRACE_TAG);
+    }
+    if (sampled || duration >= BINDER_STATS_SLOW_NS) {
+        recordTransaction(transactionDescriptor(*data, code), code, false, duration,
+                data->dataSize(), reply ? reply->dataSize() : 0);
+    }
     if (time_binder_calls) {
         conditionally_log_binder_call(start_millis, target, code);
     }
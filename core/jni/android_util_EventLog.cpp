@@ -138,6 +138,151 @@ static jint android_util_EventLog_writeEvent_Array(JNIEnv* env, jobject clazz,
     return android_bWriteLog(tag, buf, pos);
 }
 
+/*
+ * Builds a list event payload in place, in the same format as
+ * writeEvent(int, Object...), for the fixed-shape writers below.  Items
+ * that do not fit are dropped and strings are truncated, as above.
+ */
+class EventListBuilder {
+public:
+    EventListBuilder() : mPos(2), mCount(0) { }  // Room for type tag & count
+
+    void appendInt(jint value) {
+        if (mPos + 1 + sizeof(value) > kMax) return;
+        mBuf[mPos++] = EVENT_TYPE_INT;
+        memcpy(&mBuf[mPos], &value, sizeof(value));
+        mPos += sizeof(value);
+        mCount++;
+    }
+
+    void appendLong(jlong value) {
+        if (mPos + 1 + sizeof(value) > kMax) return;
+        mBuf[mPos++] = EVENT_TYPE_LONG;
+        memcpy(&mBuf[mPos], &value, sizeof(value));
+        mPos += sizeof(value);
+        mCount++;
+    }
+
+    void appendString(JNIEnv* env, jstring value) {
+        if (mPos + 1 + sizeof(jint) > kMax) return;
+        jint len;
+        uint8_t* dest = &mBuf[mPos + 1 + sizeof(len)];
+        const size_t room = kMax - mPos - 1 - sizeof(len);
+        if (value == NULL) {
+            len = room < 4 ? room : 4;
+            memcpy(dest, "NULL", len);
+        } else {
+            len = env->GetStringUTFLength(value);
+            if ((size_t) len <= room) {
+                // Encode straight into the payload, without a temporary copy
+                env->GetStringUTFRegion(value, 0, env->GetStringLength(value), (char*) dest);
+            } else {
+                const char* str = env->GetStringUTFChars(value, NULL);
+                len = room;
+                memcpy(dest, str, len);
+                env->ReleaseStringUTFChars(value, str);
+            }
+        }
+        mBuf[mPos++] = EVENT_TYPE_STRING;
+        memcpy(&mBuf[mPos], &len, sizeof(len));
+        mPos += sizeof(len) + len;
+        mCount++;
+    }
+
+    jint write(jint tag) {
+        mBuf[0] = EVENT_TYPE_LIST;
+        mBuf[1] = mCount;
+        mBuf[mPos++] = '\n';
+        return android_bWriteLog(tag, mBuf, mPos);
+    }
+
+private:
+    static const size_t kMax = MAX_EVENT_PAYLOAD - 1;  // leave room for final newline
+
+    uint8_t mBuf[MAX_EVENT_PAYLOAD];
+    size_t mPos;
+    uint8_t mCount;
+};
+
+/*
+ * In class android.util.EventLog:
+ *  static native int writeEvent(int tag, int value1, int value2)
+ */
+static jint android_util_EventLog_writeEvent_IntInt(JNIEnv* env, jobject clazz,
+                                                    jint tag, jint value1, jint value2) {
+    EventListBuilder builder;
+    builder.appendInt(value1);
+    builder.appendInt(value2);
+    return builder.write(tag);
+}
+
+/*
+ * In class android.util.EventLog:
+ *  static native int writeEvent(int tag, int value1, int value2, int value3)
+ */
+static jint android_util_EventLog_writeEvent_IntIntInt(JNIEnv* env, jobject clazz,
+                                                       jint tag, jint value1, jint value2,
+                                                       jint value3) {
+    EventListBuilder builder;
+    builder.appendInt(value1);
+    builder.appendInt(value2);
+    builder.appendInt(value3);
+    return builder.write(tag);
+}
+
+/*
+ * In class android.util.EventLog:
+ *  static native int writeEvent(int tag, long value1, long value2)
+ */
+static jint android_util_EventLog_writeEvent_LongLong(JNIEnv* env, jobject clazz,
+                                                      jint tag, jlong value1, jlong value2) {
+    EventListBuilder builder;
+    builder.appendLong(value1);
+    builder.appendLong(value2);
+    return builder.write(tag);
+}
+
+/*
+ * In class android.util.EventLog:
+ *  static native int writeEvent(int tag, int value1, String value2)
+ */
+static jint android_util_EventLog_writeEvent_IntString(JNIEnv* env, jobject clazz,
+                                                       jint tag, jint value1, jstring value2) {
+    EventListBuilder builder;
+    builder.appendInt(value1);
+    builder.appendString(env, value2);
+    return builder.write(tag);
+}
+
+/*
+ * In class android.util.EventLog:
+ *  static native int writeEvent(int tag, int value1, int value2, String value3)
+ */
+static jint android_util_EventLog_writeEvent_IntIntString(JNIEnv* env, jobject clazz,
+                                                          jint tag, jint value1, jint value2,
+                                                          jstring value3) {
+    EventListBuilder builder;
+    builder.appendInt(value1);
+    builder.appendInt(value2);
+    builder.appendString(env, value3);
+    return builder.write(tag);
+}
+
+/*
+ * In class android.util.EventLog:
+ *  static native int writeEvent(int tag, int value1, int value2, int value3, String value4)
+ */
+static jint android_util_EventLog_writeEvent_IntIntIntString(JNIEnv* env, jobject clazz,
+                                                             jint tag, jint value1, jint value2,
+                                                             jint value3, jstring value4) {
+    EventListBuilder builder;
+    builder.appendInt(value1);
+    builder.appendInt(value2);
+    builder.appendInt(value3);
+    builder.appendString(env, value4);
+    return builder.write(tag);
+}
+
 /*
  * In class android.util.EventLog:
  *  static native void readEvents(int[] tags, Collection<Event> output)
@@ -245,6 +390,25 @@ static JNINativeMethod gRegisterMethods[] = {
     },
 };
 
+// Fixed-shape writers, only registered if EventLog declares them
+static JNINativeMethod gOptionalRegisterMethods[] = {
+    { "writeEvent", "(III)I", (void*) android_util_EventLog_writeEvent_IntInt },
+    { "writeEvent", "(IIII)I", (void*) android_util_EventLog_writeEvent_IntIntInt },
+    { "writeEvent", "(IJJ)I", (void*) android_util_EventLog_writeEvent_LongLong },
+    { "writeEvent",
+      "(IILjava/lang/String;)I",
+      (void*) android_util_EventLog_writeEvent_IntString
+    },
+    { "writeEvent",
+      "(IIILjava/lang/String;)I",
+      (void*) android_util_EventLog_writeEvent_IntIntString
+    },
+    { "writeEvent",
+      "(IIIILjava/lang/String;)I",
+      (void*) android_util_EventLog_writeEvent_IntIntIntString
+    },
+};
+
 static struct { const char *name; jclass *clazz; } gClasses[] = {
     { "android/util/EventLog$Event", &gEventClass },
     { "java/lang/Integer", &gIntegerClass },
@@ -291,10 +455,15 @@ int register_android_util_EventLog(JNIEnv* env) {
         }
     }
 
-    return AndroidRuntime::registerNativeMethods(
+    int result = AndroidRuntime::registerNativeMethods(
             env,
             "android/util/EventLog",
             gRegisterMethods, NELEM(gRegisterMethods));
+    AndroidRuntime::registerOptionalNativeMethods(
+            env,
+            "android/util/EventLog",
+            gOptionalRegisterMethods, NELEM(gOptionalRegisterMethods));
+    return result;
 }
 
 }; // namespace android
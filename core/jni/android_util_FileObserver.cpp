@@ -19,6 +19,10 @@
 #include "jni.h"
 #include "utils/Log.h"
 #include "utils/misc.h"
+#include "utils/String8.h"
+#include "utils/threads.h"
+#include "utils/Timers.h"
+#include "utils/Vector.h"
 #include "android_runtime/AndroidRuntime.h"
 
 #include <stdio.h>
@@ -26,6 +30,8 @@
 #include <string.h>
 #include <stdint.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 
@@ -36,6 +42,347 @@
 namespace android {
 
 static jmethodID method_onEvent;
+static jmethodID method_onEvents; // optional, NULL if batch delivery is not supported
+
+static jclass class_String;
+
+#ifdef HAVE_INOTIFY
+
+// Maximum number of events delivered to Java in a single call
+#define MAX_EVENT_BATCH 64
+
+/*
+ * A watch added by startWatchingRecursive() for a directory of the watched
+ * tree. Events of subdirectories are reported to Java with the descriptor of
+ * the root watch and a path relative to the root.
+ *
+ * All observers share one inotify descriptor, and the kernel hands out one
+ * watch per directory, so a directory may be part of several trees and also be
+ * watched directly with startWatching(). Watches are therefore only ever
+ * widened with IN_MASK_ADD, each owner only gets the events it asked for, and a
+ * watch is only removed from the kernel once nobody owns it anymore.
+ */
+struct SubWatch {
+    int fd;
+    int wd;
+    int rootWd;
+    uint32_t mask;    // mask requested by the application for the root
+    String8 path;     // relative to the root
+    String8 rootPath; // absolute path of the root
+};
+
+// A watch added by startWatching() and the mask the application asked for
+struct PlainWatch {
+    int fd;
+    int wd;
+    uint32_t mask;
+};
+
+struct PendingEvent {
+    int wd;
+    uint32_t mask;
+    String8 path;
+    bool hasPath;
+};
+
+static Mutex gWatchLock;
+static Vector<SubWatch> gSubWatches;
+static Vector<PlainWatch> gPlainWatches;
+// Time during which repeated IN_MODIFY events for a path are collapsed
+static nsecs_t gCoalesceWindow = 0;
+
+static ssize_t findSubWatchLocked(int fd, int wd, int rootWd) {
+    for (size_t i = 0; i < gSubWatches.size(); i++) {
+        const SubWatch& subWatch = gSubWatches[i];
+        if (subWatch.fd == fd && subWatch.wd == wd && subWatch.rootWd == rootWd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static ssize_t findPlainWatchLocked(int fd, int wd) {
+    for (size_t i = 0; i < gPlainWatches.size(); i++) {
+        if (gPlainWatches[i].fd == fd && gPlainWatches[i].wd == wd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool isWatchOwnedLocked(int fd, int wd) {
+    if (findPlainWatchLocked(fd, wd) >= 0) {
+        return true;
+    }
+    for (size_t i = 0; i < gSubWatches.size(); i++) {
+        if (gSubWatches[i].fd == fd && gSubWatches[i].wd == wd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Removes the watch from the kernel unless another observer still owns it
+static void releaseWatchLocked(int fd, int wd) {
+    if (!isWatchOwnedLocked(fd, wd)) {
+        inotify_rm_watch(fd, wd);
+    }
+}
+
+/*
+ * Watches, recursively, all the subdirectories of the specified directory as
+ * part of the tree rooted at rootWd.
+ */
+static void addSubWatchesLocked(int fd, int rootWd, uint32_t mask, const String8& rootPath,
+        const String8& absolutePath, const String8& relativePath) {
+    DIR* dir = opendir(absolutePath.string());
+    if (dir == NULL) {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type != DT_DIR || !strcmp(entry->d_name, ".") ||
+                !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        String8 childPath(absolutePath);
+        childPath.appendPath(entry->d_name);
+        String8 childRelativePath(relativePath);
+        childRelativePath.appendPath(entry->d_name);
+
+        int wd = inotify_add_watch(fd, childPath.string(),
+                mask | IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD);
+        if (wd < 0) {
+            ALOGW("Failed to watch %s: %s", childPath.string(), strerror(errno));
+            continue;
+        }
+        if (wd == rootWd || findSubWatchLocked(fd, wd, rootWd) >= 0) {
+            // Already part of this tree, through a link or a previous scan
+            continue;
+        }
+
+        SubWatch subWatch;
+        subWatch.fd = fd;
+        subWatch.wd = wd;
+        subWatch.rootWd = rootWd;
+        subWatch.mask = mask;
+        subWatch.path = childRelativePath;
+        subWatch.rootPath = rootPath;
+        gSubWatches.add(subWatch);
+
+        addSubWatchesLocked(fd, rootWd, mask, rootPath, childPath, childRelativePath);
+    }
+    closedir(dir);
+}
+
+// Forgets the tree rooted at rootWd, including the root itself
+static void removeSubWatchesLocked(int fd, int rootWd) {
+    Vector<int> released;
+    for (size_t i = 0; i < gSubWatches.size(); ) {
+        const SubWatch& subWatch = gSubWatches[i];
+        if (subWatch.fd == fd && subWatch.rootWd == rootWd) {
+            released.add(subWatch.wd);
+            gSubWatches.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+    for (size_t i = 0; i < released.size(); i++) {
+        releaseWatchLocked(fd, released[i]);
+    }
+}
+
+// Forgets every owner of a watch the kernel has dropped
+static void forgetWatchLocked(int fd, int wd) {
+    ssize_t plain = findPlainWatchLocked(fd, wd);
+    if (plain >= 0) {
+        gPlainWatches.removeAt(plain);
+    }
+    for (size_t i = 0; i < gSubWatches.size(); ) {
+        const SubWatch& subWatch = gSubWatches[i];
+        if (subWatch.fd != fd || subWatch.wd != wd) {
+            i++;
+            continue;
+        }
+        if (subWatch.rootWd == wd) {
+            // The root went away, so does the rest of its tree
+            removeSubWatchesLocked(fd, wd);
+            i = 0;
+        } else {
+            gSubWatches.removeAt(i);
+        }
+    }
+}
+
+static void deliverEvents(JNIEnv* env, jobject object, Vector<PendingEvent>& events) {
+    size_t count = events.size();
+    if (count == 0) {
+        return;
+    }
+
+    if (method_onEvents != NULL) {
+        jintArray wds = env->NewIntArray(count);
+        jintArray masks = env->NewIntArray(count);
+        jobjectArray paths = env->NewObjectArray(count, class_String, NULL);
+        if (wds != NULL && masks != NULL && paths != NULL) {
+            jint* wdValues = env->GetIntArrayElements(wds, NULL);
+            jint* maskValues = env->GetIntArrayElements(masks, NULL);
+            for (size_t i = 0; i < count; i++) {
+                const PendingEvent& event = events[i];
+                wdValues[i] = event.wd;
+                maskValues[i] = event.mask;
+                if (event.hasPath) {
+                    jstring path = env->NewStringUTF(event.path.string());
+                    env->SetObjectArrayElement(paths, i, path);
+                    env->DeleteLocalRef(path);
+                }
+            }
+            env->ReleaseIntArrayElements(wds, wdValues, 0);
+            env->ReleaseIntArrayElements(masks, maskValues, 0);
+
+            env->CallVoidMethod(object, method_onEvents, wds, masks, paths, (jint) count);
+        }
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+        env->DeleteLocalRef(wds);
+        env->DeleteLocalRef(masks);
+        env->DeleteLocalRef(paths);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            const PendingEvent& event = events[i];
+            jstring path = NULL;
+            if (event.hasPath) {
+                path = env->NewStringUTF(event.path.string());
+            }
+
+            env->CallVoidMethod(object, method_onEvent, event.wd, event.mask, path);
+            if (env->ExceptionCheck()) {
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+            }
+            if (path != NULL) {
+                env->DeleteLocalRef(path);
+            }
+        }
+    }
+    events.clear();
+}
+
+static void addPendingEvent(const PendingEvent& event, Vector<PendingEvent>& pending,
+        bool coalesce) {
+    if (coalesce && (event.mask & IN_MODIFY)) {
+        for (ssize_t i = pending.size() - 1; i >= 0; i--) {
+            const PendingEvent& previous = pending[i];
+            if (previous.wd == event.wd && previous.hasPath == event.hasPath
+                    && previous.path == event.path) {
+                if (previous.mask == event.mask) {
+                    // Nothing happened to the path since, drop the repeat
+                    return;
+                }
+                break;
+            }
+        }
+    }
+    pending.add(event);
+}
+
+/*
+ * Adds an event to the pending batch for each observer that owns its watch,
+ * translating the events of recursive watches. Repeated modifications of the
+ * same path are collapsed when coalescing is enabled.
+ */
+static void queueEvent(int fd, const struct inotify_event* event,
+        Vector<PendingEvent>& pending, bool coalesce) {
+    PendingEvent pendingEvent;
+    pendingEvent.wd = event->wd;
+    pendingEvent.mask = event->mask;
+    pendingEvent.hasPath = event->len > 0;
+    if (pendingEvent.hasPath) {
+        pendingEvent.path.setTo(event->name);
+    }
+
+    // Events of the watch itself, then those translated for the trees it is in
+    bool deliver = false;
+    Vector<PendingEvent> translated;
+    {
+        AutoMutex _l(gWatchLock);
+        bool owned = false;
+        ssize_t plain = findPlainWatchLocked(fd, event->wd);
+        if (plain >= 0) {
+            owned = true;
+            deliver = event->mask & (gPlainWatches[plain].mask | IN_IGNORED);
+        }
+
+        for (size_t i = 0; i < gSubWatches.size(); i++) {
+            if (gSubWatches[i].fd != fd || gSubWatches[i].wd != event->wd) {
+                continue;
+            }
+            owned = true;
+            SubWatch subWatch = gSubWatches[i];
+
+            // Watch the directories created or moved into the tree
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    && event->len > 0) {
+                String8 relativePath(subWatch.path);
+                relativePath.appendPath(event->name);
+                String8 absolutePath(subWatch.rootPath);
+                absolutePath.appendPath(relativePath.string());
+
+                int wd = inotify_add_watch(fd, absolutePath.string(),
+                        subWatch.mask | IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD);
+                if (wd >= 0 && wd != subWatch.rootWd
+                        && findSubWatchLocked(fd, wd, subWatch.rootWd) < 0) {
+                    SubWatch child(subWatch);
+                    child.wd = wd;
+                    child.path = relativePath;
+                    gSubWatches.add(child);
+                    // Catch the subdirectories created before the watch was added
+                    addSubWatchesLocked(fd, subWatch.rootWd, subWatch.mask, subWatch.rootPath,
+                            absolutePath, relativePath);
+                }
+            }
+
+            if (subWatch.wd == subWatch.rootWd) {
+                // Java knows the root, it only gets the events it asked for
+                if (event->mask & ((subWatch.mask & IN_ALL_EVENTS) | IN_IGNORED)) {
+                    deliver = true;
+                }
+            } else if (event->mask & subWatch.mask & IN_ALL_EVENTS) {
+                // Java does not know the descriptors of subdirectories, nor
+                // hears about them going away
+                PendingEvent subEvent(pendingEvent);
+                subEvent.wd = subWatch.rootWd;
+                subEvent.path = subWatch.path;
+                if (pendingEvent.hasPath) {
+                    subEvent.path.appendPath(pendingEvent.path.string());
+                }
+                subEvent.hasPath = true;
+                translated.add(subEvent);
+            }
+        }
+
+        if (!owned) {
+            // Not ours to filter, e.g. queue overflows
+            deliver = true;
+        }
+        if (event->mask & IN_IGNORED) {
+            forgetWatchLocked(fd, event->wd);
+        }
+    }
+
+    if (deliver) {
+        addPendingEvent(pendingEvent, pending, coalesce);
+    }
+    for (size_t i = 0; i < translated.size(); i++) {
+        addPendingEvent(translated[i], pending, coalesce);
+    }
+}
+
+#endif // HAVE_INOTIFY
 
 static jint android_os_fileobserver_init(JNIEnv* env, jobject object)
 {
@@ -54,11 +401,35 @@ static void android_os_fileobserver_observe(JNIEnv* env, jobject object, jint fd
 {
 #ifdef HAVE_INOTIFY
  
-    char event_buf[512];
+    char event_buf[4096];
     struct inotify_event* event;
+    Vector<PendingEvent> pending;
+    nsecs_t batchStart = 0;
          
     while (1)
     {
+        // Wait for more events while the coalescing window of the batch is open
+        nsecs_t window;
+        {
+            AutoMutex _l(gWatchLock);
+            window = gCoalesceWindow;
+        }
+        if (!pending.isEmpty()) {
+            nsecs_t remaining = batchStart + window - systemTime(SYSTEM_TIME_MONOTONIC);
+            int timeout = remaining > 0 ? toMillisecondTimeoutDelay(0, remaining) : 0;
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            int ready = timeout > 0 ? poll(&pfd, 1, timeout) : 0;
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0 || pending.size() >= MAX_EVENT_BATCH) {
+                deliverEvents(env, object, pending);
+                continue;
+            }
+        }
+
         int event_pos = 0;
         int num_bytes = read(fd, event_buf, sizeof(event_buf));
         
@@ -68,35 +439,33 @@ static void android_os_fileobserver_observe(JNIEnv* env, jobject object, jint fd
                 continue;
 
             ALOGE("***** ERROR! android_os_fileobserver_observe() got a short event!");
+            deliverEvents(env, object, pending);
             return;
         }
+
+        if (pending.isEmpty()) {
+            batchStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
         
         while (num_bytes >= (int)sizeof(*event))
         {
             int event_size;
             event = (struct inotify_event *)(event_buf + event_pos);
 
-            jstring path = NULL;
-            
-            if (event->len > 0)
-            {
-                path = env->NewStringUTF(event->name);
-            }
-
-            env->CallVoidMethod(object, method_onEvent, event->wd, event->mask, path);
-            if (env->ExceptionCheck()) {
-                env->ExceptionDescribe();
-                env->ExceptionClear();
-            }
-            if (path != NULL)
-            {
-                env->DeleteLocalRef(path);
+            queueEvent(fd, event, pending, window > 0);
+            if (pending.size() >= MAX_EVENT_BATCH) {
+                deliverEvents(env, object, pending);
+                batchStart = systemTime(SYSTEM_TIME_MONOTONIC);
             }
 
             event_size = sizeof(*event) + event->len;
             num_bytes -= event_size;
             event_pos += event_size;
         }
+
+        if (window == 0) {
+            deliverEvents(env, object, pending);
+        }
     }
     
 #endif // HAVE_INOTIFY
@@ -112,9 +481,24 @@ static jint android_os_fileobserver_startWatching(JNIEnv* env, jobject object, j
     {
         const char* path = env->GetStringUTFChars(pathString, NULL);
         
-        res = inotify_add_watch(fd, path, mask);
+        // Recursive watches may already watch the path for other observers
+        AutoMutex _l(gWatchLock);
+        res = inotify_add_watch(fd, path, mask | IN_MASK_ADD);
         
         env->ReleaseStringUTFChars(pathString, path);
+
+        if (res >= 0) {
+            ssize_t index = findPlainWatchLocked(fd, res);
+            if (index >= 0) {
+                gPlainWatches.editItemAt(index).mask = mask;
+            } else {
+                PlainWatch plain;
+                plain.fd = fd;
+                plain.wd = res;
+                plain.mask = mask;
+                gPlainWatches.add(plain);
+            }
+        }
     }
 
 #endif // HAVE_INOTIFY
@@ -122,11 +506,65 @@ static jint android_os_fileobserver_startWatching(JNIEnv* env, jobject object, j
     return res;
 }
 
+static jint android_os_fileobserver_startWatchingRecursive(JNIEnv* env, jobject object,
+        jint fd, jstring pathString, jint mask)
+{
+    int res = -1;
+
+#ifdef HAVE_INOTIFY
+
+    if (fd >= 0)
+    {
+        const char* path = env->GetStringUTFChars(pathString, NULL);
+        String8 rootPath(path);
+        env->ReleaseStringUTFChars(pathString, path);
+
+        AutoMutex _l(gWatchLock);
+        res = inotify_add_watch(fd, rootPath.string(),
+                mask | IN_CREATE | IN_MOVED_TO | IN_MASK_ADD);
+        if (res >= 0)
+        {
+            if (findSubWatchLocked(fd, res, res) < 0) {
+                SubWatch root;
+                root.fd = fd;
+                root.wd = res;
+                root.rootWd = res;
+                root.mask = mask;
+                root.rootPath = rootPath;
+                gSubWatches.add(root);
+            }
+            addSubWatchesLocked(fd, res, mask, rootPath, rootPath, String8());
+        }
+    }
+
+#endif // HAVE_INOTIFY
+
+    return res;
+}
+
 static void android_os_fileobserver_stopWatching(JNIEnv* env, jobject object, jint fd, jint wfd)
 {
 #ifdef HAVE_INOTIFY
 
-    inotify_rm_watch((int)fd, (uint32_t)wfd);
+    AutoMutex _l(gWatchLock);
+    ssize_t plain = findPlainWatchLocked(fd, wfd);
+    if (plain >= 0) {
+        gPlainWatches.removeAt(plain);
+    }
+    if (findSubWatchLocked(fd, wfd, wfd) >= 0) {
+        removeSubWatchesLocked(fd, wfd);
+    }
+    releaseWatchLocked(fd, wfd);
+
+#endif // HAVE_INOTIFY
+}
+
+static void android_os_fileobserver_setCoalesceWindow(JNIEnv* env, jobject object, jint millis)
+{
+#ifdef HAVE_INOTIFY
+
+    AutoMutex _l(gWatchLock);
+    gCoalesceWindow = millis > 0 ? milliseconds_to_nanoseconds(millis) : 0;
 
 #endif // HAVE_INOTIFY
 }
@@ -136,10 +574,17 @@ static JNINativeMethod sMethods[] = {
     { "init", "()I", (void*)android_os_fileobserver_init },
     { "observe", "(I)V", (void*)android_os_fileobserver_observe },
     { "startWatching", "(ILjava/lang/String;I)I", (void*)android_os_fileobserver_startWatching },
-    { "stopWatching", "(II)V", (void*)android_os_fileobserver_stopWatching }
+    { "stopWatching", "(II)V", (void*)android_os_fileobserver_stopWatching },
     
 };
 
+// Only registered if FileObserver$ObserverThread declares them
+static JNINativeMethod sOptionalMethods[] = {
+    { "startWatchingRecursive", "(ILjava/lang/String;I)I",
+            (void*)android_os_fileobserver_startWatchingRecursive },
+    { "setCoalesceWindow", "(I)V", (void*)android_os_fileobserver_setCoalesceWindow },
+};
+
 int register_android_os_FileObserver(JNIEnv* env)
 {
     jclass clazz;
@@ -159,7 +604,20 @@ int register_android_os_FileObserver(JNIEnv* env)
         return -1;
     }
 
-    return AndroidRuntime::registerNativeMethods(env, "android/os/FileObserver$ObserverThread", sMethods, NELEM(sMethods));
+    method_onEvents = env->GetMethodID(clazz, "onEvents", "([I[I[Ljava/lang/String;I)V");
+    if (method_onEvents == NULL)
+    {
+        env->ExceptionClear();
+    }
+
+    jclass stringClass = env->FindClass("java/lang/String");
+    class_String = (jclass) env->NewGlobalRef(stringClass);
+
+    int result = AndroidRuntime::registerNativeMethods(env,
+            "android/os/FileObserver$ObserverThread", sMethods, NELEM(sMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+            "android/os/FileObserver$ObserverThread", sOptionalMethods, NELEM(sOptionalMethods));
+    return result;
 }
 
 } /* namespace android */
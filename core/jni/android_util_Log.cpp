@@ -19,9 +19,12 @@
 #define LOG_TAG "Log_println"
 
 #include <assert.h>
+#include <cutils/logger.h>
 #include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
 
 #include "jni.h"
 #include "JNIHelp.h"
@@ -31,6 +34,15 @@
 
 #define MIN(a,b) ((a<b)?a:b)
 
+// Levels read from the log.tag.* properties are cached per tag for this long,
+// so a setprop still takes effect without restarting the process
+#define LEVEL_CACHE_TTL ms2ns(1000)
+#define LEVEL_CACHE_SIZE 64
+
+// Tags and messages that fit are converted on the stack instead of through
+// GetStringUTFChars(), which allocates a copy for every line
+#define TAG_BUFFER_SIZE 128
+
 namespace android {
 
 struct levels_t {
@@ -57,7 +69,27 @@ static int toLevel(const char* value)
     return levels.info;
 }
 
-static jboolean isLoggable(const char* tag, jint level) {
+struct LevelCacheEntry {
+    char tag[PROPERTY_KEY_MAX];
+    int level;
+    nsecs_t expires;
+};
+
+// Direct-mapped by the hash of the tag, a colliding tag replaces the entry
+static LevelCacheEntry gLevelCache[LEVEL_CACHE_SIZE];
+static Mutex gLevelCacheLock;
+
+static size_t hashTag(const char* tag)
+{
+    size_t hash = 0;
+    while (*tag) {
+        hash = hash * 31 + (unsigned char)*tag++;
+    }
+    return hash;
+}
+
+static int lookupLevel(const char* tag)
+{
     String8 key;
     key.append(LOG_NAMESPACE);
     key.append(tag);
@@ -67,17 +99,86 @@ static jboolean isLoggable(const char* tag, jint level) {
         buf[0] = '\0';
     }
 
-    int logLevel = toLevel(buf);
+    return toLevel(buf);
+}
+
+static int tagLevel(const char* tag)
+{
+    if (strlen(tag) >= PROPERTY_KEY_MAX) {
+        return lookupLevel(tag);
+    }
+
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    LevelCacheEntry& entry = gLevelCache[hashTag(tag) % LEVEL_CACHE_SIZE];
+    {
+        AutoMutex _l(gLevelCacheLock);
+        if (now < entry.expires && !strcmp(entry.tag, tag)) {
+            return entry.level;
+        }
+    }
+
+    int level = lookupLevel(tag);
+
+    AutoMutex _l(gLevelCacheLock);
+    strcpy(entry.tag, tag);
+    entry.level = level;
+    entry.expires = now + LEVEL_CACHE_TTL;
+    return level;
+}
+
+static jboolean isLoggable(const char* tag, jint level) {
+    int logLevel = tagLevel(tag);
     return logLevel >= 0 && level >= logLevel;
 }
 
+/*
+ * Converts a string to modified UTF-8 in the given buffer when it fits, and
+ * through GetStringUTFChars() otherwise.
+ */
+class ScopedLogString {
+public:
+    ScopedLogString(JNIEnv* env, jstring str, char* buffer, size_t bufferSize)
+            : mEnv(env), mString(str), mChars(NULL), mAllocated(false) {
+        if (str == NULL) {
+            return;
+        }
+        jsize utfLength = env->GetStringUTFLength(str);
+        if (size_t(utfLength) < bufferSize) {
+            env->GetStringUTFRegion(str, 0, env->GetStringLength(str), buffer);
+            buffer[utfLength] = '\0';
+            mChars = buffer;
+        } else {
+            mChars = env->GetStringUTFChars(str, NULL);
+            mAllocated = true;
+        }
+    }
+
+    ~ScopedLogString() {
+        if (mAllocated && mChars != NULL) {
+            mEnv->ReleaseStringUTFChars(mString, mChars);
+        }
+    }
+
+    const char* c_str() const {
+        return mChars;
+    }
+
+private:
+    JNIEnv* mEnv;
+    jstring mString;
+    const char* mChars;
+    bool mAllocated;
+};
+
 static jboolean android_util_Log_isLoggable(JNIEnv* env, jobject clazz, jstring tag, jint level)
 {
     if (tag == NULL) {
         return false;
     }
 
-    const char* chars = env->GetStringUTFChars(tag, NULL);
+    char buf[PROPERTY_KEY_MAX];
+    ScopedLogString tagChars(env, tag, buf, sizeof(buf));
+    const char* chars = tagChars.c_str();
     if (!chars) {
         return false;
     }
@@ -93,7 +194,6 @@ static jboolean android_util_Log_isLoggable(JNIEnv* env, jobject clazz, jstring
         result = isLoggable(chars, level);
     }
 
-    env->ReleaseStringUTFChars(tag, chars);
     return result;
 }
 
@@ -108,9 +208,6 @@ bool android_util_Log_isVerboseLogEnabled(const char* tag) {
 static jint android_util_Log_println_native(JNIEnv* env, jobject clazz,
         jint bufID, jint priority, jstring tagObj, jstring msgObj)
 {
-    const char* tag = NULL;
-    const char* msg = NULL;
-
     if (msgObj == NULL) {
         jniThrowNullPointerException(env, "println needs a message");
         return -1;
@@ -121,17 +218,13 @@ static jint android_util_Log_println_native(JNIEnv* env, jobject clazz,
         return -1;
     }
 
-    if (tagObj != NULL)
-        tag = env->GetStringUTFChars(tagObj, NULL);
-    msg = env->GetStringUTFChars(msgObj, NULL);
-
-    int res = __android_log_buf_write(bufID, (android_LogPriority)priority, tag, msg);
-
-    if (tag != NULL)
-        env->ReleaseStringUTFChars(tagObj, tag);
-    env->ReleaseStringUTFChars(msgObj, msg);
+    char tagBuf[TAG_BUFFER_SIZE];
+    char msgBuf[LOGGER_ENTRY_MAX_PAYLOAD];
+    ScopedLogString tag(env, tagObj, tagBuf, sizeof(tagBuf));
+    ScopedLogString msg(env, msgObj, msgBuf, sizeof(msgBuf));
 
-    return res;
+    return __android_log_buf_write(bufID, (android_LogPriority)priority,
+            tag.c_str(), msg.c_str());
 }
 
 /*
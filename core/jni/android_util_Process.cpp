@@ -23,6 +23,7 @@
 #include <binder/IServiceManager.h>
 #include <cutils/sched_policy.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
 #include <utils/Vector.h>
 
 #include <android_runtime/AndroidRuntime.h>
@@ -825,6 +826,150 @@ jboolean android_os_Process_readProcFile(JNIEnv* env, jobject clazz,
 
 }
 
+// Same parsing as parseProcLineArray(), for PROC_OUT_LONG fields only and
+// without going through JNI for every line.
+static bool parseProcLongs(const char* buffer, jsize endIndex, const jint* formatData,
+        jsize NF, jlong* longsData, jsize NL)
+{
+    jsize i = 0;
+    jsize di = 0;
+
+    for (jsize fi=0; fi<NF; fi++) {
+        const jint mode = formatData[fi];
+        if ((mode&PROC_PARENS) != 0) {
+            i++;
+        }
+        const char term = (char)(mode&PROC_TERM_MASK);
+        const jsize start = i;
+        if (i >= endIndex) {
+            return false;
+        }
+
+        if ((mode&PROC_PARENS) != 0) {
+            while (buffer[i] != ')' && i < endIndex) {
+                i++;
+            }
+            i++;
+        }
+        while (buffer[i] != term && i < endIndex) {
+            i++;
+        }
+
+        if (i < endIndex) {
+            i++;
+            if ((mode&PROC_COMBINE) != 0) {
+                while (buffer[i] == term && i < endIndex) {
+                    i++;
+                }
+            }
+        }
+
+        if ((mode&(PROC_OUT_FLOAT|PROC_OUT_LONG|PROC_OUT_STRING)) != 0) {
+            // strtoll() stops at the terminator, the buffer is 0 terminated
+            if ((mode&PROC_OUT_LONG) != 0 && di < NL) {
+                longsData[di] = strtoll(buffer+start, NULL, 10);
+            }
+            di++;
+        }
+    }
+    return true;
+}
+
+static int gProcDirFd = -1;
+static Mutex gProcDirLock;
+
+static int procDirFd()
+{
+    AutoMutex _l(gProcDirLock);
+    if (gProcDirFd < 0) {
+        gProcDirFd = open("/proc", O_RDONLY | O_DIRECTORY);
+    }
+    return gProcDirFd;
+}
+
+/*
+ * Reads /proc/<pid>/stat, or /proc/<parentPid>/task/<pid>/stat when parentPid is
+ * not negative, for every pid and parses it with the given format into row i of
+ * outLongs. A row has one column per output field of the format, like the
+ * outLongs of readProcFile(). Rows of pids that cannot be read are set to -1.
+ * Returns the number of pids read.
+ */
+jint android_os_Process_readProcStats(JNIEnv* env, jobject clazz,
+        jint parentPid, jintArray pidsArray, jintArray format, jlongArray outLongs)
+{
+    if (pidsArray == NULL || format == NULL || outLongs == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return 0;
+    }
+
+    const jsize NP = env->GetArrayLength(pidsArray);
+    const jsize NF = env->GetArrayLength(format);
+    jint* formatData = env->GetIntArrayElements(format, 0);
+    if (formatData == NULL) {
+        return 0;
+    }
+    jsize columns = 0;
+    for (jsize fi=0; fi<NF; fi++) {
+        if ((formatData[fi]&(PROC_OUT_FLOAT|PROC_OUT_LONG|PROC_OUT_STRING)) != 0) {
+            columns++;
+        }
+    }
+    if (env->GetArrayLength(outLongs) < NP * columns) {
+        env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outLongs is too small for the pids and format");
+        return 0;
+    }
+
+    jint* pids = env->GetIntArrayElements(pidsArray, 0);
+    jlong* longsData = env->GetLongArrayElements(outLongs, 0);
+    if (pids == NULL || longsData == NULL) {
+        if (pids != NULL) {
+            env->ReleaseIntArrayElements(pidsArray, pids, JNI_ABORT);
+        }
+        env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return 0;
+    }
+
+    const int dirfd = procDirFd();
+    char path[64];
+    char buffer[1024];
+    jint count = 0;
+    for (jsize p=0; p<NP; p++) {
+        jlong* row = longsData + p * columns;
+        bool parsed = false;
+
+        if (parentPid >= 0) {
+            snprintf(path, sizeof(path), "%d/task/%d/stat", parentPid, pids[p]);
+        } else {
+            snprintf(path, sizeof(path), "%d/stat", pids[p]);
+        }
+        int fd = dirfd >= 0 ? openat(dirfd, path, O_RDONLY) : -1;
+        if (fd >= 0) {
+            const int len = read(fd, buffer, sizeof(buffer)-1);
+            close(fd);
+            if (len > 0) {
+                buffer[len] = 0;
+                parsed = parseProcLongs(buffer, len, formatData, NF, row, columns);
+            }
+        }
+
+        if (parsed) {
+            count++;
+        } else {
+            for (jsize c=0; c<columns; c++) {
+                row[c] = -1;
+            }
+        }
+    }
+
+    env->ReleaseLongArrayElements(outLongs, longsData, 0);
+    env->ReleaseIntArrayElements(pidsArray, pids, JNI_ABORT);
+    env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
+    return count;
+}
+
 void android_os_Process_setApplicationObject(JNIEnv* env, jobject clazz,
                                              jobject binderObject)
 {
@@ -1010,11 +1155,20 @@ static const JNINativeMethod methods[] = {
     //{"setApplicationObject", "(Landroid/os/IBinder;)V", (void*)android_os_Process_setApplicationObject},
 };
 
+// Only registered if Process declares them
+static const JNINativeMethod optionalMethods[] = {
+    {"readProcStats", "(I[I[I[J)I", (void*)android_os_Process_readProcStats},
+};
+
 const char* const kProcessPathName = "android/os/Process";
 
 int register_android_os_Process(JNIEnv* env)
 {
-    return AndroidRuntime::registerNativeMethods(
+    int result = AndroidRuntime::registerNativeMethods(
         env, kProcessPathName,
         methods, NELEM(methods));
+    AndroidRuntime::registerOptionalNativeMethods(
+        env, kProcessPathName,
+        optionalMethods, NELEM(optionalMethods));
+    return result;
 }
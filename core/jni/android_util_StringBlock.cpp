@@ -79,12 +79,14 @@ static jstring android_content_StringBlock_nativeGetString(JNIEnv* env, jobject
         return 0;
     }
 
-    size_t len;
-    const char* str8 = osb->string8At(idx, &len);
+    // Build the Java string straight from the pool's UTF-8 data when it is
+    // valid modified UTF-8; otherwise go through the decoded UTF-16 copy.
+    const char* str8 = osb->modifiedUtf8At(idx);
     if (str8 != NULL) {
         return env->NewStringUTF(str8);
     }
 
+    size_t len;
     const char16_t* str = osb->stringAt(idx, &len);
     if (str == NULL) {
         jniThrowException(env, "java/lang/IndexOutOfBoundsException", NULL);
@@ -535,6 +535,168 @@ static void android_view_GLES20Canvas_resetPaintFilter(JNIEnv* env, jobject claz
     renderer->resetPaintFilter();
 }
 
+// ----------------------------------------------------------------------------
+// Command buffers
+// ----------------------------------------------------------------------------
+
+/**
+ * Opcodes of the command buffer written by GLES20RecordingCanvas. Each
+ * command is an opcode word followed by its arguments, one 32-bit word
+ * each in native byte order: floats as their bits, native objects
+ * (paints, matrices, shaders...) as their pointer. Commands that return
+ * a value or reference Java arrays keep their own JNI entry points; the
+ * Java side flushes its buffer before calling one of them.
+ */
+enum {
+    kCommandSave = 1,               // flags
+    kCommandRestore,                //
+    kCommandRestoreToCount,         // saveCount
+    kCommandTranslate,              // dx, dy
+    kCommandRotate,                 // degrees
+    kCommandScale,                  // sx, sy
+    kCommandSkew,                   // sx, sy
+    kCommandSetMatrix,              // matrix
+    kCommandConcatMatrix,           // matrix
+    kCommandClipRect,               // left, top, right, bottom, op
+    kCommandDrawColor,              // color, mode
+    kCommandDrawRect,               // left, top, right, bottom, paint
+    kCommandDrawRoundRect,          // left, top, right, bottom, rx, ry, paint
+    kCommandDrawCircle,             // x, y, radius, paint
+    kCommandDrawOval,               // left, top, right, bottom, paint
+    kCommandDrawArc,                // left, top, right, bottom, start, sweep, useCenter, paint
+    kCommandDrawPath,               // path, paint
+    kCommandResetModifiers,         // modifiers
+    kCommandSetupShader,            // shader
+    kCommandSetupColorFilter,       // filter
+    kCommandSetupShadow,            // radius, dx, dy, color
+    kCommandSetupPaintFilter,       // clearBits, setBits
+    kCommandResetPaintFilter,       //
+    kCommandCount
+};
+
+// Number of argument words following each opcode
+static const uint8_t kCommandArgCount[kCommandCount] = {
+    0,  // unused
+    1, 0, 1, 2, 1, 2, 2, 1, 1, 5,
+    2, 5, 7, 4, 5, 8, 2, 1, 1, 1,
+    4, 2, 0
+};
+
+union CommandWord {
+    int32_t i;
+    float f;
+};
+
+template<typename T>
+static inline T* commandPointer(const CommandWord& word) {
+    return reinterpret_cast<T*>(intptr_t(word.i));
+}
+
+/**
+ * Decodes the first wordCount words of a direct buffer into calls on the
+ * renderer. Returns the number of words consumed, which is less than
+ * wordCount only if an unknown or truncated command was found.
+ */
+static jint android_view_GLES20Canvas_replayCommands(JNIEnv* env, jobject clazz,
+        OpenGLRenderer* renderer, jobject buffer, jint wordCount) {
+    const CommandWord* words = (const CommandWord*) env->GetDirectBufferAddress(buffer);
+    if (!words || wordCount < 0 ||
+            jlong(wordCount) * 4 > env->GetDirectBufferCapacity(buffer)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Commands must be in a direct buffer");
+        return 0;
+    }
+
+    jint pos = 0;
+    while (pos < wordCount) {
+        const int32_t op = words[pos].i;
+        if (op <= 0 || op >= kCommandCount || pos + 1 + kCommandArgCount[op] > wordCount) {
+            ALOGW("Bad command %d at word %d of %d", op, pos, wordCount);
+            return pos;
+        }
+        const CommandWord* a = &words[pos + 1];
+        switch (op) {
+            case kCommandSave:
+                renderer->save(a[0].i);
+                break;
+            case kCommandRestore:
+                renderer->restore();
+                break;
+            case kCommandRestoreToCount:
+                renderer->restoreToCount(a[0].i);
+                break;
+            case kCommandTranslate:
+                renderer->translate(a[0].f, a[1].f);
+                break;
+            case kCommandRotate:
+                renderer->rotate(a[0].f);
+                break;
+            case kCommandScale:
+                renderer->scale(a[0].f, a[1].f);
+                break;
+            case kCommandSkew:
+                renderer->skew(a[0].f, a[1].f);
+                break;
+            case kCommandSetMatrix:
+                renderer->setMatrix(commandPointer<SkMatrix>(a[0]));
+                break;
+            case kCommandConcatMatrix:
+                renderer->concatMatrix(commandPointer<SkMatrix>(a[0]));
+                break;
+            case kCommandClipRect:
+                renderer->clipRect(a[0].f, a[1].f, a[2].f, a[3].f, (SkRegion::Op) a[4].i);
+                break;
+            case kCommandDrawColor:
+                renderer->drawColor(a[0].i, (SkXfermode::Mode) a[1].i);
+                break;
+            case kCommandDrawRect:
+                renderer->drawRect(a[0].f, a[1].f, a[2].f, a[3].f,
+                        commandPointer<SkPaint>(a[4]));
+                break;
+            case kCommandDrawRoundRect:
+                renderer->drawRoundRect(a[0].f, a[1].f, a[2].f, a[3].f, a[4].f, a[5].f,
+                        commandPointer<SkPaint>(a[6]));
+                break;
+            case kCommandDrawCircle:
+                renderer->drawCircle(a[0].f, a[1].f, a[2].f, commandPointer<SkPaint>(a[3]));
+                break;
+            case kCommandDrawOval:
+                renderer->drawOval(a[0].f, a[1].f, a[2].f, a[3].f,
+                        commandPointer<SkPaint>(a[4]));
+                break;
+            case kCommandDrawArc:
+                renderer->drawArc(a[0].f, a[1].f, a[2].f, a[3].f, a[4].f, a[5].f,
+                        a[6].i != 0, commandPointer<SkPaint>(a[7]));
+                break;
+            case kCommandDrawPath:
+                renderer->drawPath(commandPointer<SkPath>(a[0]), commandPointer<SkPaint>(a[1]));
+                break;
+            case kCommandResetModifiers:
+                if (a[0].i & MODIFIER_SHADOW) renderer->resetShadow();
+                if (a[0].i & MODIFIER_SHADER) renderer->resetShader();
+                if (a[0].i & MODIFIER_COLOR_FILTER) renderer->resetColorFilter();
+                break;
+            case kCommandSetupShader:
+                renderer->setupShader(commandPointer<SkiaShader>(a[0]));
+                break;
+            case kCommandSetupColorFilter:
+                renderer->setupColorFilter(commandPointer<SkiaColorFilter>(a[0]));
+                break;
+            case kCommandSetupShadow:
+                renderer->setupShadow(a[0].f, a[1].f, a[2].f, a[3].i);
+                break;
+            case kCommandSetupPaintFilter:
+                renderer->setupPaintFilter(a[0].i, a[1].i);
+                break;
+            case kCommandResetPaintFilter:
+                renderer->resetPaintFilter();
+                break;
+        }
+        pos += 1 + kCommandArgCount[op];
+    }
+    return pos;
+}
+
 // ----------------------------------------------------------------------------
 // Text
 // ----------------------------------------------------------------------------
@@ -802,6 +964,27 @@ static void android_view_GLES20Canvas_updateTextureLayer(JNIEnv* env, jobject cl
     }
 }
 
+/**
+ * Like updateTextureLayer() but returns false when the SurfaceTexture had
+ * no new frame and nothing else about the layer changed, so the caller
+ * can skip invalidating the view and its parent.
+ */
+static jboolean android_view_GLES20Canvas_updateTextureLayerIfChanged(JNIEnv* env,
+        jobject clazz, Layer* layer, jint width, jint height, jboolean isOpaque,
+        jobject surface) {
+    float transform[16];
+    sp<SurfaceTexture> surfaceTexture(SurfaceTexture_getSurfaceTexture(env, surface));
+
+    if (surfaceTexture->updateTexImage() != NO_ERROR) {
+        return JNI_FALSE;
+    }
+    surfaceTexture->getTransformMatrix(transform);
+    GLenum renderTarget = surfaceTexture->getCurrentTextureTarget();
+
+    return LayerRenderer::updateTextureLayer(layer, width, height, isOpaque, renderTarget,
+            transform, surfaceTexture->getTimestamp()) ? JNI_TRUE : JNI_FALSE;
+}
+
 static void android_view_GLES20Canvas_updateRenderLayer(JNIEnv* env, jobject clazz,
         Layer* layer, OpenGLRenderer* renderer, DisplayList* displayList,
         jint left, jint top, jint right, jint bottom) {
@@ -1009,6 +1192,16 @@ static JNINativeMethod gMethods[] = {
 #endif
 };
 
+#ifdef USE_OPENGL_RENDERER
+// Only registered if GLES20Canvas declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "nReplayCommands",    "(ILjava/nio/ByteBuffer;I)I",
+            (void*) android_view_GLES20Canvas_replayCommands },
+    { "nUpdateTextureLayerIfChanged", "(IIIZLandroid/graphics/SurfaceTexture;)Z",
+            (void*) android_view_GLES20Canvas_updateTextureLayerIfChanged },
+};
+#endif
+
 static JNINativeMethod gActivityThreadMethods[] = {
     { "dumpGraphicsInfo",        "(Ljava/io/FileDescriptor;)V",
                                                (void*) android_app_ActivityThread_dumpGraphics }
@@ -1033,7 +1226,13 @@ int register_android_view_GLES20Canvas(JNIEnv* env) {
     FIND_CLASS(clazz, "android/graphics/Rect");
     GET_METHOD_ID(gRectClassInfo.set, clazz, "set", "(IIII)V");
 
-    return AndroidRuntime::registerNativeMethods(env, kClassPathName, gMethods, NELEM(gMethods));
+    int result = AndroidRuntime::registerNativeMethods(env, kClassPathName,
+            gMethods, NELEM(gMethods));
+#ifdef USE_OPENGL_RENDERER
+    AndroidRuntime::registerOptionalNativeMethods(env, kClassPathName,
+            gOptionalMethods, NELEM(gOptionalMethods));
+#endif
+    return result;
 }
 
 const char* const kActivityThreadPathName = "android/app/ActivityThread";
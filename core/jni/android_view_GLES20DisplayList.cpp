@@ -23,6 +23,7 @@
 #include <nativehelper/JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
 
+#include <Animator.h>
 #include <DisplayListRenderer.h>
 
 namespace android {
@@ -175,6 +176,62 @@ static void android_view_GLES20DisplayList_offsetTopBottom(JNIEnv* env,
     displayList->offsetTopBottom(offset);
 }
 
+// ----------------------------------------------------------------------------
+// DisplayList animators
+// ----------------------------------------------------------------------------
+
+static void android_view_GLES20DisplayList_animateFloat(JNIEnv* env,
+        jobject clazz, DisplayList* displayList, jint property,
+        jfloatArray fractions, jfloatArray values, jint interpolatorType,
+        jfloat interpolatorFactor, jlong duration, jlong startDelay,
+        jint repeatCount, jint repeatMode) {
+    const jsize count = env->GetArrayLength(values);
+    if (property < 0 || property >= PropertyAnimator::kPropertyCount ||
+            count < 2 || env->GetArrayLength(fractions) != count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return;
+    }
+
+    PropertyAnimator* animator = new PropertyAnimator(PropertyAnimator::Property(property));
+    jfloat* fractionsArray = env->GetFloatArrayElements(fractions, NULL);
+    jfloat* valuesArray = env->GetFloatArrayElements(values, NULL);
+    bool valid = true;
+    for (jsize i = 0; i < count && valid; i++) {
+        valid = animator->addKeyframe(fractionsArray[i], valuesArray[i]);
+    }
+    env->ReleaseFloatArrayElements(values, valuesArray, JNI_ABORT);
+    env->ReleaseFloatArrayElements(fractions, fractionsArray, JNI_ABORT);
+    if (!valid) {
+        delete animator;
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Keyframe fractions must be increasing within [0..1]");
+        return;
+    }
+
+    animator->setInterpolator(Interpolator::create(interpolatorType, interpolatorFactor));
+    animator->setDuration(milliseconds_to_nanoseconds(duration));
+    animator->setStartDelay(milliseconds_to_nanoseconds(startDelay));
+    animator->setRepeatCount(repeatCount);
+    animator->setRepeatMode(repeatMode);
+
+    displayList->addAnimator(animator);
+}
+
+static void android_view_GLES20DisplayList_cancelAnimator(JNIEnv* env,
+        jobject clazz, DisplayList* displayList, jint property) {
+    displayList->cancelAnimator(property);
+}
+
+static jboolean android_view_GLES20DisplayList_hasAnimators(JNIEnv* env,
+        jobject clazz, DisplayList* displayList) {
+    return displayList->hasAnimators();
+}
+
+static jfloat android_view_GLES20DisplayList_getPropertyValue(JNIEnv* env,
+        jobject clazz, DisplayList* displayList, jint property) {
+    return displayList->getPropertyValue(property);
+}
+
 #endif // USE_OPENGL_RENDERER
 
 // ----------------------------------------------------------------------------
@@ -213,10 +270,20 @@ static JNINativeMethod gMethods[] = {
             (void*) android_view_GLES20DisplayList_setLeftTopRightBottom },
     { "nOffsetLeftRight",      "(II)V",  (void*) android_view_GLES20DisplayList_offsetLeftRight },
     { "nOffsetTopBottom",      "(II)V",  (void*) android_view_GLES20DisplayList_offsetTopBottom },
-
 #endif
 };
 
+#ifdef USE_OPENGL_RENDERER
+// Only registered if GLES20DisplayList declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "nAnimateFloat",         "(II[F[FIFJJII)V",
+            (void*) android_view_GLES20DisplayList_animateFloat },
+    { "nCancelAnimator",       "(II)V",  (void*) android_view_GLES20DisplayList_cancelAnimator },
+    { "nHasAnimators",         "(I)Z",   (void*) android_view_GLES20DisplayList_hasAnimators },
+    { "nGetPropertyValue",     "(II)F",  (void*) android_view_GLES20DisplayList_getPropertyValue },
+};
+#endif
+
 #ifdef USE_OPENGL_RENDERER
     #define FIND_CLASS(var, className) \
             var = env->FindClass(className); \
@@ -231,7 +298,13 @@ static JNINativeMethod gMethods[] = {
 #endif
 
 int register_android_view_GLES20DisplayList(JNIEnv* env) {
-    return AndroidRuntime::registerNativeMethods(env, kClassPathName, gMethods, NELEM(gMethods));
+    int result = AndroidRuntime::registerNativeMethods(env, kClassPathName,
+            gMethods, NELEM(gMethods));
+#ifdef USE_OPENGL_RENDERER
+    AndroidRuntime::registerOptionalNativeMethods(env, kClassPathName,
+            gOptionalMethods, NELEM(gOptionalMethods));
+#endif
+    return result;
 }
 
 };
@@ -22,6 +22,10 @@
 
 #include <EGL/egl_cache.h>
 
+#ifdef USE_OPENGL_RENDERER
+    #include <ProgramCache.h>
+#endif
+
 #ifdef USE_OPENGL_RENDERER
     EGLAPI void EGLAPIENTRY eglBeginFrame(EGLDisplay dpy, EGLSurface surface);
 #endif
@@ -133,6 +137,9 @@ static void android_view_HardwareRenderer_setupShadersDiskCache(JNIEnv* env, job
 
     const char* cacheArray = env->GetStringUTFChars(diskCachePath, NULL);
     egl_cache_t::get()->setCacheFilename(cacheArray);
+#ifdef USE_OPENGL_RENDERER
+    uirenderer::ProgramCache::setCacheFilename(cacheArray);
+#endif
     env->ReleaseStringUTFChars(diskCachePath, cacheArray);
 }
 
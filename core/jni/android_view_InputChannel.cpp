@@ -209,7 +209,23 @@ static void android_view_InputChannel_nativeReadFromParcel(JNIEnv* env, jobject
                 return;
             }
 
-            InputChannel* inputChannel = new InputChannel(name, dupFd);
+            InputChannel* inputChannel;
+            bool hasRing = parcel->readInt32();
+            if (hasRing) {
+                int rawRingFd = parcel->readFileDescriptor();
+                bool isRingServer = parcel->readInt32();
+                int dupRingFd = dup(rawRingFd);
+                if (dupRingFd < 0) {
+                    ALOGE("Error %d dup channel ring fd %d.", errno, rawRingFd);
+                    close(dupFd);
+                    jniThrowRuntimeException(env,
+                            "Could not read input channel file descriptors from parcel.");
+                    return;
+                }
+                inputChannel = new InputChannel(name, dupFd, dupRingFd, isRingServer);
+            } else {
+                inputChannel = new InputChannel(name, dupFd);
+            }
             NativeInputChannel* nativeInputChannel = new NativeInputChannel(inputChannel);
 
             android_view_InputChannel_setNativeInputChannel(env, obj, nativeInputChannel);
@@ -229,6 +245,13 @@ static void android_view_InputChannel_nativeWriteToParcel(JNIEnv* env, jobject o
             parcel->writeInt32(1);
             parcel->writeString8(inputChannel->getName());
             parcel->writeDupFileDescriptor(inputChannel->getFd());
+            if (inputChannel->getRingFd() >= 0) {
+                parcel->writeInt32(1);
+                parcel->writeDupFileDescriptor(inputChannel->getRingFd());
+                parcel->writeInt32(inputChannel->isRingServer());
+            } else {
+                parcel->writeInt32(0);
+            }
         } else {
             parcel->writeInt32(0);
         }
@@ -36,11 +36,17 @@
 
 namespace android {
 
+// Maximum number of input events handed to Java in a single upcall.
+static const size_t MAX_DISPATCH_BATCH_SIZE = 16;
+
 static struct {
     jclass clazz;
 
     jmethodID dispatchInputEvent;
+    jmethodID dispatchInputEvents; // optional, NULL if batch dispatch is not supported
     jmethodID dispatchBatchedInputEventPending;
+
+    jclass inputEventClazz;
 } gInputEventReceiverClassInfo;
 
 
@@ -65,6 +71,16 @@ private:
     PreallocatedInputEventFactory mInputEventFactory;
     bool mBatchedInputEventPending;
 
+    // Events consumed but not dispatched yet, the arrays are reused across batches.
+    jintArray mDispatchSeqArrayGlobal;
+    jobjectArray mDispatchEventArrayGlobal;
+    jint mDispatchSeqs[MAX_DISPATCH_BATCH_SIZE];
+    size_t mDispatchCount;
+
+    bool queueInputEvent(JNIEnv* env, uint32_t seq, jobject inputEventObj);
+    bool flushInputEvents(JNIEnv* env);
+    void cancelInputEvents();
+
     const char* getInputChannelName() {
         return mInputConsumer.getChannel()->getName().string();
     }
@@ -78,7 +94,22 @@ NativeInputEventReceiver::NativeInputEventReceiver(JNIEnv* env,
         const sp<MessageQueue>& messageQueue) :
         mReceiverObjGlobal(env->NewGlobalRef(receiverObj)),
         mInputConsumer(inputChannel), mMessageQueue(messageQueue),
-        mBatchedInputEventPending(false) {
+        mBatchedInputEventPending(false),
+        mDispatchSeqArrayGlobal(NULL), mDispatchEventArrayGlobal(NULL), mDispatchCount(0) {
+    if (gInputEventReceiverClassInfo.dispatchInputEvents) {
+        jintArray seqArray = env->NewIntArray(MAX_DISPATCH_BATCH_SIZE);
+        jobjectArray eventArray = env->NewObjectArray(MAX_DISPATCH_BATCH_SIZE,
+                gInputEventReceiverClassInfo.inputEventClazz, NULL);
+        if (seqArray && eventArray) {
+            mDispatchSeqArrayGlobal = jintArray(env->NewGlobalRef(seqArray));
+            mDispatchEventArrayGlobal = jobjectArray(env->NewGlobalRef(eventArray));
+        } else {
+            // Dispatch events one at a time instead.
+            env->ExceptionClear();
+        }
+        env->DeleteLocalRef(seqArray);
+        env->DeleteLocalRef(eventArray);
+    }
 #if DEBUG_DISPATCH_CYCLE
     ALOGD("channel '%s' ~ Initializing input event receiver.", getInputChannelName());
 #endif
@@ -87,6 +118,10 @@ NativeInputEventReceiver::NativeInputEventReceiver(JNIEnv* env,
 NativeInputEventReceiver::~NativeInputEventReceiver() {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->DeleteGlobalRef(mReceiverObjGlobal);
+    if (mDispatchSeqArrayGlobal) {
+        env->DeleteGlobalRef(mDispatchSeqArrayGlobal);
+        env->DeleteGlobalRef(mDispatchEventArrayGlobal);
+    }
 }
 
 status_t NativeInputEventReceiver::initialize() {
@@ -135,6 +170,70 @@ int NativeInputEventReceiver::handleEvent(int receiveFd, int events, void* data)
     return status == OK || status == NO_MEMORY ? 1 : 0;
 }
 
+bool NativeInputEventReceiver::queueInputEvent(JNIEnv* env, uint32_t seq,
+        jobject inputEventObj) {
+    if (!mDispatchEventArrayGlobal) {
+#if DEBUG_DISPATCH_CYCLE
+        ALOGD("channel '%s' ~ Dispatching input event.", getInputChannelName());
+#endif
+        env->CallVoidMethod(mReceiverObjGlobal,
+                gInputEventReceiverClassInfo.dispatchInputEvent, seq, inputEventObj);
+        if (env->ExceptionCheck()) {
+            ALOGE("Exception dispatching input event.");
+            return false;
+        }
+        return true;
+    }
+
+    env->SetObjectArrayElement(mDispatchEventArrayGlobal, mDispatchCount, inputEventObj);
+    mDispatchSeqs[mDispatchCount++] = seq;
+    if (mDispatchCount == MAX_DISPATCH_BATCH_SIZE) {
+        return flushInputEvents(env);
+    }
+    return true;
+}
+
+bool NativeInputEventReceiver::flushInputEvents(JNIEnv* env) {
+    if (mDispatchCount == 0) {
+        return true;
+    }
+
+#if DEBUG_DISPATCH_CYCLE
+    ALOGD("channel '%s' ~ Dispatching %d input events.", getInputChannelName(),
+            int(mDispatchCount));
+#endif
+    size_t count = mDispatchCount;
+    mDispatchCount = 0;
+    env->SetIntArrayRegion(mDispatchSeqArrayGlobal, 0, count, mDispatchSeqs);
+    env->CallVoidMethod(mReceiverObjGlobal,
+            gInputEventReceiverClassInfo.dispatchInputEvents,
+            mDispatchSeqArrayGlobal, mDispatchEventArrayGlobal, jint(count));
+    bool ok = !env->ExceptionCheck();
+    if (!ok) {
+        ALOGE("Exception dispatching input events.");
+    }
+
+    // Do not keep the events alive, Java recycles them once they are finished.
+    jthrowable exception = env->ExceptionOccurred();
+    env->ExceptionClear();
+    for (size_t i = 0; i < count; i++) {
+        env->SetObjectArrayElement(mDispatchEventArrayGlobal, i, NULL);
+    }
+    if (exception) {
+        env->Throw(exception);
+        env->DeleteLocalRef(exception);
+    }
+    return ok;
+}
+
+void NativeInputEventReceiver::cancelInputEvents() {
+    // The array elements are overwritten by the next batch.
+    for (size_t i = 0; i < mDispatchCount; i++) {
+        mInputConsumer.sendFinishedSignal(mDispatchSeqs[i], false);
+    }
+    mDispatchCount = 0;
+}
+
 status_t NativeInputEventReceiver::consumeEvents(JNIEnv* env,
         bool consumeBatches, nsecs_t frameTime) {
 #if DEBUG_DISPATCH_CYCLE
@@ -153,6 +252,12 @@ status_t NativeInputEventReceiver::consumeEvents(JNIEnv* env,
         status_t status = mInputConsumer.consume(&mInputEventFactory,
                 consumeBatches, frameTime, &seq, &inputEvent);
         if (status) {
+            // Hand all the events consumed so far to Java in one upcall.
+            if (skipCallbacks) {
+                cancelInputEvents();
+            } else if (!flushInputEvents(env)) {
+                skipCallbacks = true;
+            }
             if (status == WOULD_BLOCK) {
                 if (!skipCallbacks && !mBatchedInputEventPending
                         && mInputConsumer.hasPendingBatch()) {
@@ -202,15 +307,10 @@ status_t NativeInputEventReceiver::consumeEvents(JNIEnv* env,
             }
 
             if (inputEventObj) {
-#if DEBUG_DISPATCH_CYCLE
-                ALOGD("channel '%s' ~ Dispatching input event.", getInputChannelName());
-#endif
-                env->CallVoidMethod(mReceiverObjGlobal,
-                        gInputEventReceiverClassInfo.dispatchInputEvent, seq, inputEventObj);
-                if (env->ExceptionCheck()) {
-                    ALOGE("Exception dispatching input event.");
+                if (!queueInputEvent(env, seq, inputEventObj)) {
                     skipCallbacks = true;
                 }
+                env->DeleteLocalRef(inputEventObj);
             } else {
                 ALOGW("channel '%s' ~ Failed to obtain event object.", getInputChannelName());
                 skipCallbacks = true;
@@ -320,6 +420,15 @@ int register_android_view_InputEventReceiver(JNIEnv* env) {
     GET_METHOD_ID(gInputEventReceiverClassInfo.dispatchBatchedInputEventPending,
             gInputEventReceiverClassInfo.clazz,
             "dispatchBatchedInputEventPending", "()V");
+
+    // Receivers that do not implement batch dispatch get one upcall per event.
+    gInputEventReceiverClassInfo.dispatchInputEvents = env->GetMethodID(
+            gInputEventReceiverClassInfo.clazz,
+            "dispatchInputEvents", "([I[Landroid/view/InputEvent;I)V");
+    if (!gInputEventReceiverClassInfo.dispatchInputEvents) {
+        env->ExceptionClear();
+    }
+    FIND_CLASS(gInputEventReceiverClassInfo.inputEventClazz, "android/view/InputEvent");
     return 0;
 }
 
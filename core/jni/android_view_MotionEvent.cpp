@@ -643,17 +643,17 @@ static void android_view_MotionEvent_nativeGetPointerCoords(JNIEnv* env, jclass
         return;
     }
 
-    const PointerCoords* rawPointerCoords;
+    PointerCoords rawPointerCoords;
     if (historyPos == HISTORY_CURRENT) {
-        rawPointerCoords = event->getRawPointerCoords(pointerIndex);
+        event->getRawPointerCoords(pointerIndex, &rawPointerCoords);
     } else {
         size_t historySize = event->getHistorySize();
         if (!validateHistoryPos(env, historyPos, historySize)) {
             return;
         }
-        rawPointerCoords = event->getHistoricalRawPointerCoords(pointerIndex, historyPos);
+        event->getHistoricalRawPointerCoords(pointerIndex, historyPos, &rawPointerCoords);
     }
-    pointerCoordsFromNative(env, rawPointerCoords, event->getXOffset(), event->getYOffset(),
+    pointerCoordsFromNative(env, &rawPointerCoords, event->getXOffset(), event->getYOffset(),
             outPointerCoordsObj);
 }
 
@@ -19,13 +19,18 @@
 
 #include <android_runtime/AndroidRuntime.h>
 
+#include <cutils/atomic.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 #include <utils/ZipFileRO.h>
 #include <ScopedUtfChars.h>
 
 #include <zlib.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -49,6 +54,13 @@
 #define TMP_FILE_PATTERN "/tmp.XXXXXX"
 #define TMP_FILE_PATTERN_LEN (sizeof(TMP_FILE_PATTERN) - 1)
 
+// Stored entries whose data starts on a page boundary can be mapped
+// straight out of the APK.
+#define IN_PLACE_ALIGNMENT 4096
+
+// Upper bound on the number of threads extracting libraries at once.
+#define MAX_EXTRACTION_THREADS 4
+
 namespace android {
 
 // These match PackageManager.java install codes
@@ -60,8 +72,20 @@ typedef enum {
     INSTALL_FAILED_INTERNAL_ERROR = -110,
 } install_status_t;
 
+// These match the NativeLibraryHelper.java copy flags
+enum {
+    // Leave page aligned, uncompressed libraries in the APK so they can be
+    // loaded in place rather than copied out.
+    COPY_FLAG_SKIP_IN_PLACE = 1 << 0,
+};
+
 typedef install_status_t (*iterFunc)(JNIEnv*, void*, ZipFileRO*, ZipEntryRO, const char*);
 
+struct NativeLibrary {
+    ZipEntryRO entry;
+    String8 fileName;
+};
+
 // Equivalent to isFilenameSafe
 static bool
 isFilenameSafe(const char* filename)
@@ -157,16 +181,53 @@ sumFiles(JNIEnv* env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const
     return INSTALL_SUCCEEDED;
 }
 
+/*
+ * Reserves the blocks for a library up front, so that running out of space
+ * fails before anything is inflated and the file is laid out contiguously.
+ */
+static bool
+preallocateFile(int fd, size_t size)
+{
+#if defined(__GLIBC__)
+    if (fallocate(fd, 0, 0, size) == 0) {
+        return true;
+    }
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        return false;
+    }
+#endif
+    // No fallocate; uncompressEntry will extend the file as it writes.
+    return true;
+}
+
+/*
+ * Returns true if the entry is stored uncompressed with its data starting on
+ * a page boundary, so the library can be mapped directly from the APK.
+ */
+static bool
+isLoadableInPlace(ZipFileRO* zipFile, ZipEntryRO zipEntry)
+{
+    int method;
+    off64_t offset;
+
+    if (!zipFile->getEntryInfo(zipEntry, &method, NULL, NULL, &offset, NULL, NULL)) {
+        return false;
+    }
+
+    return method == ZipFileRO::kCompressStored && (offset % IN_PLACE_ALIGNMENT) == 0;
+}
+
 /*
  * Copy the native library if needed.
  *
  * This function assumes the library and path names passed in are considered safe.
+ * It does not touch the JNIEnv, so it may be called from any thread.
  */
 static install_status_t
-copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
+extractLibrary(ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName,
+        const char* nativeLibPath, uint32_t flags)
 {
-    jstring* javaNativeLibPath = (jstring*) arg;
-    ScopedUtfChars nativeLibPath(env, *javaNativeLibPath);
+    const size_t nativeLibPathLen = strlen(nativeLibPath);
 
     size_t uncompLen;
     long when;
@@ -184,38 +245,49 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
 
     // Build local file path
     const size_t fileNameLen = strlen(fileName);
-    char localFileName[nativeLibPath.size() + fileNameLen + 2];
+    char localFileName[nativeLibPathLen + fileNameLen + 2];
 
-    if (strlcpy(localFileName, nativeLibPath.c_str(), sizeof(localFileName)) != nativeLibPath.size()) {
+    if (strlcpy(localFileName, nativeLibPath, sizeof(localFileName)) != nativeLibPathLen) {
         ALOGD("Couldn't allocate local file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
 
-    *(localFileName + nativeLibPath.size()) = '/';
+    *(localFileName + nativeLibPathLen) = '/';
 
-    if (strlcpy(localFileName + nativeLibPath.size() + 1, fileName, sizeof(localFileName)
-                    - nativeLibPath.size() - 1) != fileNameLen) {
+    if (strlcpy(localFileName + nativeLibPathLen + 1, fileName, sizeof(localFileName)
+                    - nativeLibPathLen - 1) != fileNameLen) {
         ALOGD("Couldn't allocate local file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
 
+    if ((flags & COPY_FLAG_SKIP_IN_PLACE) && isLoadableInPlace(zipFile, zipEntry)) {
+        // Drop any copy left from an earlier install so the APK's copy is the
+        // only one.
+        if (unlink(localFileName) < 0 && errno != ENOENT) {
+            ALOGI("Couldn't remove stale %s: %s\n", localFileName, strerror(errno));
+            return INSTALL_FAILED_CONTAINER_ERROR;
+        }
+        ALOGV("Leaving %s in place\n", fileName);
+        return INSTALL_SUCCEEDED;
+    }
+
     // Only copy out the native file if it's different.
     struct stat st;
     if (!isFileDifferent(localFileName, uncompLen, modTime, crc, &st)) {
         return INSTALL_SUCCEEDED;
     }
 
-    char localTmpFileName[nativeLibPath.size() + TMP_FILE_PATTERN_LEN + 2];
-    if (strlcpy(localTmpFileName, nativeLibPath.c_str(), sizeof(localTmpFileName))
-            != nativeLibPath.size()) {
+    char localTmpFileName[nativeLibPathLen + TMP_FILE_PATTERN_LEN + 2];
+    if (strlcpy(localTmpFileName, nativeLibPath, sizeof(localTmpFileName))
+            != nativeLibPathLen) {
         ALOGD("Couldn't allocate local file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
 
-    *(localFileName + nativeLibPath.size()) = '/';
+    *(localFileName + nativeLibPathLen) = '/';
 
-    if (strlcpy(localTmpFileName + nativeLibPath.size(), TMP_FILE_PATTERN,
-                    TMP_FILE_PATTERN_LEN - nativeLibPath.size()) != TMP_FILE_PATTERN_LEN) {
+    if (strlcpy(localTmpFileName + nativeLibPathLen, TMP_FILE_PATTERN,
+                    TMP_FILE_PATTERN_LEN - nativeLibPathLen) != TMP_FILE_PATTERN_LEN) {
         ALOGI("Couldn't allocate temporary file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
@@ -226,6 +298,14 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
         return INSTALL_FAILED_CONTAINER_ERROR;
     }
 
+    if (!preallocateFile(fd, uncompLen)) {
+        ALOGI("Couldn't reserve %zu bytes for %s: %s\n", uncompLen, localTmpFileName,
+                strerror(errno));
+        close(fd);
+        unlink(localTmpFileName);
+        return INSTALL_FAILED_INSUFFICIENT_STORAGE;
+    }
+
     if (!zipFile->uncompressEntry(zipEntry, fd)) {
         ALOGI("Failed uncompressing %s to %s\n", fileName, localTmpFileName);
         close(fd);
@@ -266,33 +346,32 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
     return INSTALL_SUCCEEDED;
 }
 
-static install_status_t
-iterateOverNativeFiles(JNIEnv *env, jstring javaFilePath, jstring javaCpuAbi, jstring javaCpuAbi2,
-        iterFunc callFunc, void* callArg) {
-    ScopedUtfChars filePath(env, javaFilePath);
-    ScopedUtfChars cpuAbi(env, javaCpuAbi);
-    ScopedUtfChars cpuAbi2(env, javaCpuAbi2);
-
-    ZipFileRO zipFile;
-
-    if (zipFile.open(filePath.c_str()) != NO_ERROR) {
-        ALOGI("Couldn't open APK %s\n", filePath.c_str());
-        return INSTALL_FAILED_INVALID_APK;
-    }
+/*
+ * Walks the APK once and collects the libraries to install. Libraries for
+ * the primary ABI and the secondary ABI are gathered separately; if any
+ * primary ABI library exists only those are used, regardless of the order
+ * the entries appear in the zip.
+ */
+static void
+collectNativeFiles(ZipFileRO* zipFile, const char* cpuAbiStr, const char* cpuAbi2Str,
+        Vector<NativeLibrary>* libraries) {
+    const size_t cpuAbiLen = strlen(cpuAbiStr);
+    const size_t cpuAbi2Len = strlen(cpuAbi2Str);
 
-    const int N = zipFile.getNumEntries();
+    const int N = zipFile->getNumEntries();
 
     char fileName[PATH_MAX];
-    bool hasPrimaryAbi = false;
+    Vector<NativeLibrary> primary;
+    Vector<NativeLibrary> secondary;
 
     for (int i = 0; i < N; i++) {
-        const ZipEntryRO entry = zipFile.findEntryByIndex(i);
+        const ZipEntryRO entry = zipFile->findEntryByIndex(i);
         if (entry == NULL) {
             continue;
         }
 
         // Make sure this entry has a filename.
-        if (zipFile.getEntryFileName(entry, fileName, sizeof(fileName))) {
+        if (zipFile->getEntryFileName(entry, fileName, sizeof(fileName))) {
             continue;
         }
 
@@ -315,55 +394,189 @@ iterateOverNativeFiles(JNIEnv *env, jstring javaFilePath, jstring javaCpuAbi, js
         const char* cpuAbiOffset = fileName + APK_LIB_LEN;
         const size_t cpuAbiRegionSize = lastSlash - cpuAbiOffset;
 
-        ALOGV("Comparing ABIs %s and %s versus %s\n", cpuAbi.c_str(), cpuAbi2.c_str(), cpuAbiOffset);
-        if (cpuAbi.size() == cpuAbiRegionSize
-                && *(cpuAbiOffset + cpuAbi.size()) == '/'
-                && !strncmp(cpuAbiOffset, cpuAbi.c_str(), cpuAbiRegionSize)) {
-            ALOGV("Using primary ABI %s\n", cpuAbi.c_str());
-            hasPrimaryAbi = true;
-        } else if (cpuAbi2.size() == cpuAbiRegionSize
-                && *(cpuAbiOffset + cpuAbi2.size()) == '/'
-                && !strncmp(cpuAbiOffset, cpuAbi2.c_str(), cpuAbiRegionSize)) {
-
-            /*
-             * If this library matches both the primary and secondary ABIs,
-             * only use the primary ABI.
-             */
-            if (hasPrimaryAbi) {
-                ALOGV("Already saw primary ABI, skipping secondary ABI %s\n", cpuAbi2.c_str());
-                continue;
-            } else {
-                ALOGV("Using secondary ABI %s\n", cpuAbi2.c_str());
-            }
+        ALOGV("Comparing ABIs %s and %s versus %s\n", cpuAbiStr, cpuAbi2Str, cpuAbiOffset);
+        Vector<NativeLibrary>* target;
+        if (cpuAbiLen == cpuAbiRegionSize
+                && *(cpuAbiOffset + cpuAbiLen) == '/'
+                && !strncmp(cpuAbiOffset, cpuAbiStr, cpuAbiRegionSize)) {
+            target = &primary;
+        } else if (cpuAbi2Len == cpuAbiRegionSize
+                && *(cpuAbiOffset + cpuAbi2Len) == '/'
+                && !strncmp(cpuAbiOffset, cpuAbi2Str, cpuAbiRegionSize)) {
+            target = &secondary;
         } else {
             ALOGV("abi didn't match anything: %s (end at %zd)\n", cpuAbiOffset, cpuAbiRegionSize);
             continue;
         }
 
-        // If this is a .so file, check to see if we need to copy it.
+        // If this is a .so file, we'll want to install it.
         if ((!strncmp(fileName + fileNameLen - LIB_SUFFIX_LEN, LIB_SUFFIX, LIB_SUFFIX_LEN)
                     && !strncmp(lastSlash, LIB_PREFIX, LIB_PREFIX_LEN)
                     && isFilenameSafe(lastSlash + 1))
                 || !strncmp(lastSlash + 1, GDBSERVER, GDBSERVER_LEN)) {
+            NativeLibrary library;
+            library.entry = entry;
+            library.fileName.setTo(lastSlash + 1);
+            target->push(library);
+        }
+    }
+
+    /*
+     * If the APK carries libraries for both the primary and secondary ABIs,
+     * only use the primary ABI.
+     */
+    if (!primary.isEmpty()) {
+        ALOGV("Using primary ABI %s\n", cpuAbiStr);
+        *libraries = primary;
+    } else {
+        ALOGV("Using secondary ABI %s\n", cpuAbi2Str);
+        *libraries = secondary;
+    }
+}
+
+static install_status_t
+iterateOverNativeFiles(JNIEnv *env, jstring javaFilePath, jstring javaCpuAbi, jstring javaCpuAbi2,
+        iterFunc callFunc, void* callArg) {
+    ScopedUtfChars filePath(env, javaFilePath);
+    ScopedUtfChars cpuAbi(env, javaCpuAbi);
+    ScopedUtfChars cpuAbi2(env, javaCpuAbi2);
+
+    ZipFileRO zipFile;
+
+    if (zipFile.open(filePath.c_str()) != NO_ERROR) {
+        ALOGI("Couldn't open APK %s\n", filePath.c_str());
+        return INSTALL_FAILED_INVALID_APK;
+    }
 
-            install_status_t ret = callFunc(env, callArg, &zipFile, entry, lastSlash + 1);
+    Vector<NativeLibrary> libraries;
+    collectNativeFiles(&zipFile, cpuAbi.c_str(), cpuAbi2.c_str(), &libraries);
 
-            if (ret != INSTALL_SUCCEEDED) {
-                ALOGV("Failure for entry %s", lastSlash + 1);
-                return ret;
-            }
+    for (size_t i = 0; i < libraries.size(); i++) {
+        const NativeLibrary& library = libraries[i];
+        install_status_t ret = callFunc(env, callArg, &zipFile, library.entry,
+                library.fileName.string());
+
+        if (ret != INSTALL_SUCCEEDED) {
+            ALOGV("Failure for entry %s", library.fileName.string());
+            return ret;
         }
     }
 
     return INSTALL_SUCCEEDED;
 }
 
+struct ExtractionJob {
+    ZipFileRO* zipFile;
+    const Vector<NativeLibrary>* libraries;
+    const char* nativeLibPath;
+    uint32_t flags;
+
+    volatile int32_t nextIndex;
+    volatile int32_t status;
+};
+
+/*
+ * Pulls libraries off the shared job until none are left or one fails.
+ * ZipFileRO serializes its own file access, and each library goes to its
+ * own temporary file, so the workers need no further coordination.
+ */
+static void*
+extractionThread(void* arg)
+{
+    ExtractionJob* job = (ExtractionJob*) arg;
+
+    for (;;) {
+        if (android_atomic_acquire_load(&job->status) != INSTALL_SUCCEEDED) {
+            break;
+        }
+
+        size_t index = (size_t) android_atomic_inc(&job->nextIndex);
+        if (index >= job->libraries->size()) {
+            break;
+        }
+
+        const NativeLibrary& library = job->libraries->itemAt(index);
+        install_status_t ret = extractLibrary(job->zipFile, library.entry,
+                library.fileName.string(), job->nativeLibPath, job->flags);
+        if (ret != INSTALL_SUCCEEDED) {
+            ALOGV("Failure for entry %s", library.fileName.string());
+            android_atomic_release_cas(INSTALL_SUCCEEDED, ret, &job->status);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static install_status_t
+copyNativeFiles(JNIEnv *env, jstring javaFilePath, jstring javaNativeLibPath,
+        jstring javaCpuAbi, jstring javaCpuAbi2, uint32_t flags) {
+    ScopedUtfChars filePath(env, javaFilePath);
+    ScopedUtfChars nativeLibPath(env, javaNativeLibPath);
+    ScopedUtfChars cpuAbi(env, javaCpuAbi);
+    ScopedUtfChars cpuAbi2(env, javaCpuAbi2);
+
+    ZipFileRO zipFile;
+
+    if (zipFile.open(filePath.c_str()) != NO_ERROR) {
+        ALOGI("Couldn't open APK %s\n", filePath.c_str());
+        return INSTALL_FAILED_INVALID_APK;
+    }
+
+    Vector<NativeLibrary> libraries;
+    collectNativeFiles(&zipFile, cpuAbi.c_str(), cpuAbi2.c_str(), &libraries);
+
+    ExtractionJob job;
+    job.zipFile = &zipFile;
+    job.libraries = &libraries;
+    job.nativeLibPath = nativeLibPath.c_str();
+    job.flags = flags;
+    job.nextIndex = 0;
+    job.status = INSTALL_SUCCEEDED;
+
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t numThreads = numCpus > 1 ? (size_t) numCpus : 1;
+    if (numThreads > MAX_EXTRACTION_THREADS) {
+        numThreads = MAX_EXTRACTION_THREADS;
+    }
+    if (numThreads > libraries.size()) {
+        numThreads = libraries.size();
+    }
+
+    // The calling thread works on the job too, so only spawn the rest.
+    pthread_t threads[MAX_EXTRACTION_THREADS];
+    size_t numStarted = 0;
+    for (size_t i = 1; i < numThreads; i++) {
+        if (pthread_create(&threads[numStarted], NULL, extractionThread, &job) != 0) {
+            ALOGW("Couldn't start extraction thread: %s", strerror(errno));
+            break;
+        }
+        numStarted++;
+    }
+
+    extractionThread(&job);
+
+    for (size_t i = 0; i < numStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return (install_status_t) job.status;
+}
+
 static jint
 com_android_internal_content_NativeLibraryHelper_copyNativeBinaries(JNIEnv *env, jclass clazz,
         jstring javaFilePath, jstring javaNativeLibPath, jstring javaCpuAbi, jstring javaCpuAbi2)
 {
-    return (jint) iterateOverNativeFiles(env, javaFilePath, javaCpuAbi, javaCpuAbi2,
-            copyFileIfChanged, &javaNativeLibPath);
+    return (jint) copyNativeFiles(env, javaFilePath, javaNativeLibPath, javaCpuAbi, javaCpuAbi2, 0);
+}
+
+static jint
+com_android_internal_content_NativeLibraryHelper_copyNativeBinariesWithFlags(JNIEnv *env,
+        jclass clazz, jstring javaFilePath, jstring javaNativeLibPath, jstring javaCpuAbi,
+        jstring javaCpuAbi2, jint flags)
+{
+    return (jint) copyNativeFiles(env, javaFilePath, javaNativeLibPath, javaCpuAbi, javaCpuAbi2,
+            (uint32_t) flags);
 }
 
 static jlong
@@ -386,11 +599,22 @@ static JNINativeMethod gMethods[] = {
             (void *)com_android_internal_content_NativeLibraryHelper_sumNativeBinaries},
 };
 
+// Only registered if NativeLibraryHelper declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"nativeCopyNativeBinariesWithFlags",
+            "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;I)I",
+            (void *)com_android_internal_content_NativeLibraryHelper_copyNativeBinariesWithFlags},
+};
+
 
 int register_com_android_internal_content_NativeLibraryHelper(JNIEnv *env)
 {
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
                 "com/android/internal/content/NativeLibraryHelper", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+                "com/android/internal/content/NativeLibraryHelper",
+                gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 };
@@ -19,13 +19,28 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <utils/misc.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 #include <errno.h>
 #include <sys/select.h>
 
 #include "jni.h"
 #include <JNIHelp.h>
+#include <ScopedUtfChars.h>
 #include "android_runtime/AndroidRuntime.h"
+#include "android_runtime/android_util_AssetManager.h"
+
+#include <androidfw/Asset.h>
+#include <androidfw/AssetManager.h>
+#include <androidfw/ResourceTypes.h>
 
 #include <linux/capability.h>
 #include <linux/prctl.h>
@@ -285,6 +300,235 @@ static jobject com_android_internal_os_ZygoteInit_createFileDescriptor (
     return jniCreateFileDescriptor(env, fd);
 }
 
+/*
+ * Preload profiling.
+ *
+ * ZygoteInit reports how long each class and resource took to preload;
+ * the timings are kept here and written out, slowest first, before the
+ * zygote starts forking.
+ */
+enum {
+    PRELOAD_KIND_CLASS = 0,
+    PRELOAD_KIND_RESOURCE = 1,
+    PRELOAD_KIND_PREFETCH = 2,  // file read by the resource prefetch thread
+    PRELOAD_KIND_COUNT
+};
+
+static const char* const kPreloadKindNames[PRELOAD_KIND_COUNT] = {
+    "class", "resource", "prefetch"
+};
+
+struct PreloadTiming {
+    int kind;
+    nsecs_t duration;
+    String8 name;
+};
+
+static Mutex gPreloadLock;
+static Vector<PreloadTiming> gPreloadTimings;
+
+static void recordPreloadTiming(int kind, const String8& name, nsecs_t duration)
+{
+    PreloadTiming timing;
+    timing.kind = kind;
+    timing.duration = duration;
+    timing.name = name;
+    Mutex::Autolock _l(gPreloadLock);
+    gPreloadTimings.add(timing);
+}
+
+static int comparePreloadTimings(const PreloadTiming* a, const PreloadTiming* b)
+{
+    return a->duration > b->duration ? -1 : (a->duration < b->duration ? 1 : 0);
+}
+
+/*
+ * In class com.android.internal.os.ZygoteInit:
+ * private static native void nativeRecordPreload(int kind, String name, long durationNanos)
+ */
+static void com_android_internal_os_ZygoteInit_nativeRecordPreload(
+        JNIEnv* env, jobject clazz, jint kind, jstring name, jlong durationNanos)
+{
+    if (kind < 0 || kind >= PRELOAD_KIND_COUNT || name == NULL) {
+        return;
+    }
+    ScopedUtfChars nameChars(env, name);
+    if (nameChars.c_str() == NULL) {
+        return;
+    }
+    recordPreloadTiming(kind, String8(nameChars.c_str()), durationNanos);
+}
+
+/*
+ * In class com.android.internal.os.ZygoteInit:
+ * private static native int nativeWritePreloadReport(String path)
+ *
+ * Writes and then forgets all recorded timings. Returns 0 or an errno
+ * value.
+ */
+static jint com_android_internal_os_ZygoteInit_nativeWritePreloadReport(
+        JNIEnv* env, jobject clazz, jstring path)
+{
+    ScopedUtfChars pathChars(env, path);
+    if (pathChars.c_str() == NULL) {
+        return EINVAL;
+    }
+
+    Vector<PreloadTiming> timings;
+    {
+        Mutex::Autolock _l(gPreloadLock);
+        timings = gPreloadTimings;
+        gPreloadTimings.clear();
+    }
+
+    FILE* out = fopen(pathChars.c_str(), "w");
+    if (out == NULL) {
+        int err = errno;
+        ALOGW("Unable to write preload report %s: %s", pathChars.c_str(), strerror(err));
+        return err;
+    }
+
+    nsecs_t totals[PRELOAD_KIND_COUNT] = { 0 };
+    size_t counts[PRELOAD_KIND_COUNT] = { 0 };
+    for (size_t i = 0; i < timings.size(); i++) {
+        totals[timings[i].kind] += timings[i].duration;
+        counts[timings[i].kind]++;
+    }
+    for (int kind = 0; kind < PRELOAD_KIND_COUNT; kind++) {
+        fprintf(out, "# %s: %zu preloaded in %.1fms\n", kPreloadKindNames[kind],
+                counts[kind], totals[kind] / 1000000.0);
+    }
+
+    timings.sort(comparePreloadTimings);
+    for (size_t i = 0; i < timings.size(); i++) {
+        fprintf(out, "%8lld %-8s %s\n", (long long)(timings[i].duration / 1000),
+                kPreloadKindNames[timings[i].kind], timings[i].name.string());
+    }
+
+    int err = ferror(out) ? EIO : 0;
+    if (fclose(out) != 0 && err == 0) {
+        err = errno;
+    }
+    return err;
+}
+
+/*
+ * Resource prefetch.
+ *
+ * While the main thread loads classes, a helper thread resolves the
+ * resources ZygoteInit is going to preload and reads their files into
+ * memory, so the decode done later on the main thread doesn't wait on
+ * the disk. The thread must be joined before the zygote forks.
+ */
+struct ResourcePrefetch {
+    AssetManager* assets;
+    Vector<uint32_t> ids;
+};
+
+static pthread_t gPrefetchThread;
+static bool gPrefetchStarted = false;
+
+static void prefetchResourceFile(AssetManager* assets, const ResTable& res, uint32_t id)
+{
+    Res_value value;
+    ssize_t block = res.getResource(id, &value);
+    if (block >= 0) {
+        block = res.resolveReference(&value, block);
+    }
+    if (block < 0 || value.dataType != Res_value::TYPE_STRING) {
+        // a plain value, nothing on disk to fetch
+        return;
+    }
+
+    const ResStringPool* pool = res.getTableStringBlock(block);
+    size_t len;
+    const char16_t* str = pool != NULL ? pool->stringAt(value.data, &len) : NULL;
+    if (str == NULL) {
+        return;
+    }
+    String8 path(str, len);
+
+    const nsecs_t start = systemTime();
+    Asset* asset = assets->openNonAsset(res.getTableCookie(block), path.string(),
+            Asset::ACCESS_BUFFER);
+    if (asset == NULL) {
+        return;
+    }
+    const unsigned char* data = static_cast<const unsigned char*>(asset->getBuffer(false));
+    if (data != NULL) {
+        // Fault in every page now, on this thread, rather than during decode.
+        const size_t length = asset->getLength();
+        volatile unsigned char sink = 0;
+        for (size_t offset = 0; offset < length; offset += 4096) {
+            sink ^= data[offset];
+        }
+    }
+    delete asset;
+    recordPreloadTiming(PRELOAD_KIND_PREFETCH, path, systemTime() - start);
+}
+
+static void* resourcePrefetchThread(void* arg)
+{
+    ResourcePrefetch* prefetch = static_cast<ResourcePrefetch*>(arg);
+    const ResTable& res(prefetch->assets->getResources());
+    for (size_t i = 0; i < prefetch->ids.size(); i++) {
+        prefetchResourceFile(prefetch->assets, res, prefetch->ids[i]);
+    }
+    delete prefetch;
+    return NULL;
+}
+
+/*
+ * In class com.android.internal.os.ZygoteInit:
+ * private static native boolean nativeStartResourcePrefetch(AssetManager assets, int[] ids)
+ */
+static jboolean com_android_internal_os_ZygoteInit_nativeStartResourcePrefetch(
+        JNIEnv* env, jobject clazz, jobject assetManager, jintArray ids)
+{
+    if (gPrefetchStarted) {
+        return JNI_FALSE;
+    }
+    AssetManager* assets = assetManagerForJavaObject(env, assetManager);
+    if (assets == NULL || ids == NULL) {
+        return JNI_FALSE;
+    }
+
+    ResourcePrefetch* prefetch = new ResourcePrefetch();
+    prefetch->assets = assets;
+    const jsize count = env->GetArrayLength(ids);
+    jint* elements = env->GetIntArrayElements(ids, NULL);
+    if (elements == NULL) {
+        delete prefetch;
+        return JNI_FALSE;
+    }
+    for (jsize i = 0; i < count; i++) {
+        prefetch->ids.add(uint32_t(elements[i]));
+    }
+    env->ReleaseIntArrayElements(ids, elements, JNI_ABORT);
+
+    int err = pthread_create(&gPrefetchThread, NULL, resourcePrefetchThread, prefetch);
+    if (err != 0) {
+        ALOGW("Unable to start resource prefetch thread: %s", strerror(err));
+        delete prefetch;
+        return JNI_FALSE;
+    }
+    gPrefetchStarted = true;
+    return JNI_TRUE;
+}
+
+/*
+ * In class com.android.internal.os.ZygoteInit:
+ * private static native void nativeJoinResourcePrefetch()
+ */
+static void com_android_internal_os_ZygoteInit_nativeJoinResourcePrefetch(
+        JNIEnv* env, jobject clazz)
+{
+    if (gPrefetchStarted) {
+        pthread_join(gPrefetchThread, NULL);
+        gPrefetchStarted = false;
+    }
+}
+
 /*
  * JNI registration.
  */
@@ -313,10 +557,25 @@ static JNINativeMethod gMethods[] = {
     { "createFileDescriptor", "(I)Ljava/io/FileDescriptor;",
         (void *) com_android_internal_os_ZygoteInit_createFileDescriptor }
 };
+
+// Only registered if ZygoteInit declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "nativeRecordPreload", "(ILjava/lang/String;J)V",
+        (void *) com_android_internal_os_ZygoteInit_nativeRecordPreload },
+    { "nativeWritePreloadReport", "(Ljava/lang/String;)I",
+        (void *) com_android_internal_os_ZygoteInit_nativeWritePreloadReport },
+    { "nativeStartResourcePrefetch", "(Landroid/content/res/AssetManager;[I)Z",
+        (void *) com_android_internal_os_ZygoteInit_nativeStartResourcePrefetch },
+    { "nativeJoinResourcePrefetch", "()V",
+        (void *) com_android_internal_os_ZygoteInit_nativeJoinResourcePrefetch }
+};
 int register_com_android_internal_os_ZygoteInit(JNIEnv* env)
 {
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
             "com/android/internal/os/ZygoteInit", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+            "com/android/internal/os/ZygoteInit", gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
 }; // namespace android
@@ -17,6 +17,8 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android_drm_DrmManagerClient"
 #include <utils/Log.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
 
 #include <jni.h>
 #include <JNIHelp.h>
@@ -35,8 +37,28 @@
 
 #include <DrmManagerClientImpl.h>
 
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
 using namespace android;
 
+// Size of the chunks read by convertFileRange() when the caller does not choose
+#define DEFAULT_CONVERT_CHUNK_SIZE (64 * 1024)
+
+// Returned by convertDataDirect() when the output buffer cannot hold the
+// required number of bytes. Always below the negated DrmConvertedStatus codes.
+#define CONVERT_OUTPUT_TOO_SMALL(required) (-DrmConvertedStatus::STATUS_ERROR - (jint) (required))
+
+// Conversions whose output did not fit the caller's buffer, by session, held
+// until the caller retries with a larger one. Guarded by sPendingLock.
+static Mutex sPendingLock;
+static KeyedVector<int64_t, DrmConvertedStatus*> sPendingConversions;
+
+static int64_t convertSessionKey(int uniqueId, int convertId) {
+    return ((int64_t) uniqueId << 32) | (uint32_t) convertId;
+}
+
 /**
  * Utility class used to extract the value from the provided java object.
  * May need to add some utility function to create java object.
@@ -670,11 +692,208 @@ static jobject android_drm_DrmManagerClient_convertData(
     return status;
 }
 
+static void ReleaseConvertedStatus(DrmConvertedStatus* pDrmConvertedStatus) {
+    if (NULL != pDrmConvertedStatus) {
+        if (NULL != pDrmConvertedStatus->convertedData) {
+            delete [] pDrmConvertedStatus->convertedData->data;
+            delete pDrmConvertedStatus->convertedData;
+        }
+        delete pDrmConvertedStatus;
+    }
+}
+
+/*
+ * Copies the converted data of a status into a native destination and
+ * releases the status. Returns the number of bytes copied, or the negated
+ * status code if the conversion failed or the destination is too small.
+ */
+static jint CopyConvertedData(DrmConvertedStatus* pDrmConvertedStatus, char* dest, jint capacity) {
+    if (NULL == pDrmConvertedStatus) {
+        return -DrmConvertedStatus::STATUS_ERROR;
+    }
+
+    jint result = -pDrmConvertedStatus->statusCode;
+    if (DrmConvertedStatus::STATUS_OK == pDrmConvertedStatus->statusCode) {
+        result = 0;
+        DrmBuffer* convertedData = pDrmConvertedStatus->convertedData;
+        if (NULL != convertedData) {
+            if (convertedData->length > capacity) {
+                ALOGE("Converted data (%d bytes) does not fit in %d bytes",
+                        convertedData->length, capacity);
+                result = -DrmConvertedStatus::STATUS_ERROR;
+            } else {
+                memcpy(dest, convertedData->data, convertedData->length);
+                result = convertedData->length;
+            }
+        }
+    }
+
+    ReleaseConvertedStatus(pDrmConvertedStatus);
+    return result;
+}
+
+/*
+ * Converts data held in direct ByteBuffers. The input is handed to the DRM
+ * engine in place and the output is written into the caller's buffer, so
+ * neither side goes through a Java array.
+ *
+ * If the output does not fit, nothing is written and the required size is
+ * returned as CONVERT_OUTPUT_TOO_SMALL(required). The converted data is kept
+ * for the session, and the next call returns it in place of converting its
+ * input again, so the caller retries with the same input and a larger buffer.
+ */
+static jint android_drm_DrmManagerClient_convertDataDirect(
+            JNIEnv* env, jobject thiz, jint uniqueId, jint convertId,
+            jobject input, jint inputOffset, jint inputLength, jobject output, jint outputOffset) {
+    ALOGV("convertDataDirect Enter");
+
+    char* inputData = (char*) env->GetDirectBufferAddress(input);
+    char* outputData = (char*) env->GetDirectBufferAddress(output);
+    jlong inputCapacity = env->GetDirectBufferCapacity(input);
+    jlong outputCapacity = env->GetDirectBufferCapacity(output);
+    if (NULL == inputData || NULL == outputData) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Buffers must be direct ByteBuffers");
+        return -DrmConvertedStatus::STATUS_ERROR;
+    }
+    if (inputOffset < 0 || inputLength < 0 || inputOffset > inputCapacity
+            || inputLength > inputCapacity - inputOffset
+            || outputOffset < 0 || outputOffset > outputCapacity) {
+        jniThrowException(env, "java/lang/IndexOutOfBoundsException", NULL);
+        return -DrmConvertedStatus::STATUS_ERROR;
+    }
+
+    const int64_t key = convertSessionKey(uniqueId, convertId);
+    DrmConvertedStatus* pDrmConvertedStatus = NULL;
+    {
+        Mutex::Autolock _l(sPendingLock);
+        ssize_t index = sPendingConversions.indexOfKey(key);
+        if (index >= 0) {
+            pDrmConvertedStatus = sPendingConversions.valueAt(index);
+            sPendingConversions.removeItemsAt(index);
+        }
+    }
+    if (NULL == pDrmConvertedStatus) {
+        const DrmBuffer buffer(inputData + inputOffset, inputLength);
+        pDrmConvertedStatus
+                = getDrmManagerClientImpl(env, thiz)->convertData(uniqueId, convertId, &buffer);
+    }
+
+    const jint capacity = outputCapacity - outputOffset;
+    if (NULL != pDrmConvertedStatus
+            && DrmConvertedStatus::STATUS_OK == pDrmConvertedStatus->statusCode
+            && NULL != pDrmConvertedStatus->convertedData
+            && pDrmConvertedStatus->convertedData->length > capacity) {
+        jint required = pDrmConvertedStatus->convertedData->length;
+        Mutex::Autolock _l(sPendingLock);
+        sPendingConversions.add(key, pDrmConvertedStatus);
+        ALOGV("convertDataDirect - needs %d bytes, has %d", required, capacity);
+        return CONVERT_OUTPUT_TOO_SMALL(required);
+    }
+    jint result = CopyConvertedData(pDrmConvertedStatus, outputData + outputOffset, capacity);
+
+    ALOGV("convertDataDirect - Exit");
+    return result;
+}
+
+/*
+ * Streams a range of a file through a convert session, writing the
+ * converted data to another file. Each chunk is read, converted and written
+ * natively, so large files never go through the Java heap. Returns the
+ * number of bytes written, or the negated status code on failure.
+ */
+static jlong android_drm_DrmManagerClient_convertFileRange(
+            JNIEnv* env, jobject thiz, jint uniqueId, jint convertId,
+            jobject inputDescriptor, jlong offset, jlong length, jint chunkSize,
+            jobject outputDescriptor) {
+    ALOGV("convertFileRange Enter");
+
+    int inputFd = jniGetFDFromFileDescriptor(env, inputDescriptor);
+    int outputFd = jniGetFDFromFileDescriptor(env, outputDescriptor);
+    if (inputFd < 0 || outputFd < 0 || offset < 0 || length < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return -DrmConvertedStatus::STATUS_ERROR;
+    }
+    if (chunkSize <= 0) {
+        chunkSize = DEFAULT_CONVERT_CHUNK_SIZE;
+    }
+
+    char* chunk = new char[chunkSize];
+    sp<DrmManagerClientImpl> client = getDrmManagerClientImpl(env, thiz);
+    jlong written = 0;
+    jlong position = offset;
+    jlong remaining = length;
+
+    while (remaining > 0) {
+        ssize_t toRead = remaining < chunkSize ? (ssize_t) remaining : chunkSize;
+        ssize_t bytesRead = pread64(inputFd, chunk, toRead, position);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            if (bytesRead < 0) {
+                ALOGE("Failed to read DRM content: %s", strerror(errno));
+                written = -DrmConvertedStatus::STATUS_INPUTDATA_ERROR;
+            }
+            break;
+        }
+        position += bytesRead;
+        remaining -= bytesRead;
+
+        const DrmBuffer buffer(chunk, bytesRead);
+        DrmConvertedStatus* pDrmConvertedStatus
+                = client->convertData(uniqueId, convertId, &buffer);
+        if (NULL == pDrmConvertedStatus
+                || DrmConvertedStatus::STATUS_OK != pDrmConvertedStatus->statusCode) {
+            written = NULL != pDrmConvertedStatus
+                    ? -pDrmConvertedStatus->statusCode : -DrmConvertedStatus::STATUS_ERROR;
+            ReleaseConvertedStatus(pDrmConvertedStatus);
+            break;
+        }
+
+        DrmBuffer* convertedData = pDrmConvertedStatus->convertedData;
+        const char* data = NULL != convertedData ? convertedData->data : NULL;
+        ssize_t pending = NULL != convertedData ? convertedData->length : 0;
+        while (pending > 0) {
+            ssize_t bytesWritten = write(outputFd, data, pending);
+            if (bytesWritten < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ALOGE("Failed to write converted DRM content: %s", strerror(errno));
+                break;
+            }
+            data += bytesWritten;
+            pending -= bytesWritten;
+            written += bytesWritten;
+        }
+        ReleaseConvertedStatus(pDrmConvertedStatus);
+        if (pending > 0) {
+            written = -DrmConvertedStatus::STATUS_ERROR;
+            break;
+        }
+    }
+
+    delete [] chunk;
+
+    ALOGV("convertFileRange - Exit");
+    return written;
+}
+
 static jobject android_drm_DrmManagerClient_closeConvertSession(
             JNIEnv* env, jobject thiz, int uniqueId, jint convertId) {
 
     ALOGV("closeConvertSession Enter");
 
+    {
+        Mutex::Autolock _l(sPendingLock);
+        ssize_t index = sPendingConversions.indexOfKey(convertSessionKey(uniqueId, convertId));
+        if (index >= 0) {
+            ReleaseConvertedStatus(sPendingConversions.valueAt(index));
+            sPendingConversions.removeItemsAt(index);
+        }
+    }
+
     DrmConvertedStatus* pDrmConvertedStatus
                 = getDrmManagerClientImpl(env, thiz)->closeConvertSession(uniqueId, convertId);
     jobject status = GetConvertedStatus(env, pDrmConvertedStatus);
@@ -743,6 +962,15 @@ static JNINativeMethod nativeMethods[] = {
                                     (void*)android_drm_DrmManagerClient_closeConvertSession},
 };
 
+// Only registered if DrmManagerClient declares them
+static JNINativeMethod nativeOptionalMethods[] = {
+    {"_convertDataDirect", "(IILjava/nio/ByteBuffer;IILjava/nio/ByteBuffer;I)I",
+                                    (void*)android_drm_DrmManagerClient_convertDataDirect},
+
+    {"_convertFileRange", "(IILjava/io/FileDescriptor;JJILjava/io/FileDescriptor;)J",
+                                    (void*)android_drm_DrmManagerClient_convertFileRange},
+};
+
 static int registerNativeMethods(JNIEnv* env) {
     int result = -1;
 
@@ -753,6 +981,9 @@ static int registerNativeMethods(JNIEnv* env) {
         if (env->RegisterNatives(clazz, nativeMethods, sizeof(nativeMethods)
                 / sizeof(nativeMethods[0])) == JNI_OK) {
             result = 0;
+            AndroidRuntime::registerOptionalNativeMethods(env, "android/drm/DrmManagerClient",
+                    nativeOptionalMethods,
+                    sizeof(nativeOptionalMethods) / sizeof(nativeOptionalMethods[0]));
         }
     }
     return result;
@@ -463,6 +463,21 @@ nAllocationCreateTyped(JNIEnv *_env, jobject _this, RsContext con, jint type, ji
     return (jint) rsAllocationCreateTyped(con, (RsType)type, (RsAllocationMipmapControl)mips, (uint32_t)usage, (uint32_t)pointer);
 }
 
+static jint
+nAllocationCreateTypedDirect(JNIEnv *_env, jobject _this, RsContext con, jint type, jint mips, jint usage, jobject buffer)
+{
+    // The allocation uses the buffer memory as its backing store, so the
+    // caller must keep the buffer alive for as long as the allocation.
+    void *pointer = _env->GetDirectBufferAddress(buffer);
+    LOG_API("nAllocationCreateTypedDirect, con(%p), type(%p), mip(%i), usage(%i), ptr(%p)", con, (RsElement)type, mips, usage, pointer);
+    if (pointer == NULL) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException",
+                "buffer must be a direct ByteBuffer");
+        return 0;
+    }
+    return (jint) rsAllocationCreateTyped(con, (RsType)type, (RsAllocationMipmapControl)mips, (uint32_t)usage, (uint32_t)pointer);
+}
+
 static void
 nAllocationSyncAll(JNIEnv *_env, jobject _this, RsContext con, jint a, jint bits)
 {
@@ -1019,6 +1034,203 @@ nScriptForEachV(JNIEnv *_env, jobject _this, RsContext con,
     _env->ReleaseByteArrayElements(params, ptr, JNI_ABORT);
 }
 
+// -----------------------------------
+
+/*
+ * Command batches let Java record several allocation updates and script
+ * launches and submit them with a single JNI call. Each command is a run
+ * of ints in the command array, starting with its opcode. Payloads are
+ * referenced by offset and size into a single data block, which is either
+ * a byte array or a direct ByteBuffer.
+ */
+enum {
+    // alloc, offset, lod, count, dataOffset, sizeBytes
+    BATCH_ALLOCATION_DATA_1D = 1,
+    // alloc, xoff, yoff, lod, face, w, h, dataOffset, sizeBytes
+    BATCH_ALLOCATION_DATA_2D = 2,
+    // script, slot, dataOffset, sizeBytes
+    BATCH_SCRIPT_INVOKE = 3,
+    // script, slot, ain, aout, dataOffset, sizeBytes (no params if sizeBytes is 0)
+    BATCH_SCRIPT_FOREACH = 4,
+    // alloc, bits
+    BATCH_ALLOCATION_SYNC_ALL = 5,
+};
+
+/*
+ * Returns the number of arguments of a batch command, or -1 if the opcode is
+ * unknown, and the index of its dataOffset argument (-1 if it has no data).
+ */
+static jint
+batchCommandLayout(jint op, jint *outDataArg)
+{
+    switch (op) {
+    case BATCH_ALLOCATION_DATA_1D:  *outDataArg = 4;  return 6;
+    case BATCH_ALLOCATION_DATA_2D:  *outDataArg = 7;  return 9;
+    case BATCH_SCRIPT_INVOKE:       *outDataArg = 2;  return 4;
+    case BATCH_SCRIPT_FOREACH:      *outDataArg = 4;  return 6;
+    case BATCH_ALLOCATION_SYNC_ALL: *outDataArg = -1; return 2;
+    }
+    return -1;
+}
+
+static bool
+batchDataInRange(jint offset, jint sizeBytes, size_t dataLength)
+{
+    return offset >= 0 && sizeBytes >= 0 && (size_t)offset <= dataLength
+            && (size_t)sizeBytes <= dataLength - offset;
+}
+
+/*
+ * Checks the whole batch before anything is submitted, so that a malformed
+ * batch has no effect. Returns NULL if the batch is valid.
+ */
+static const char *
+validateCommandBatch(const jint *cmds, jint cmdLength, size_t dataLength)
+{
+    jint pos = 0;
+    while (pos < cmdLength) {
+        jint dataArg;
+        jint argCount = batchCommandLayout(cmds[pos], &dataArg);
+        if (argCount < 0) {
+            return "Unknown RenderScript batch command";
+        }
+        if (argCount > cmdLength - pos - 1) {
+            return "Truncated RenderScript batch command";
+        }
+        if (dataArg >= 0) {
+            const jint *c = &cmds[pos + 1];
+            if (!batchDataInRange(c[dataArg], c[dataArg + 1], dataLength)) {
+                return "RenderScript batch data out of range";
+            }
+        }
+        pos += argCount + 1;
+    }
+    return NULL;
+}
+
+static void
+executeCommandBatch(JNIEnv *_env, RsContext con, const jint *cmds, jint cmdLength,
+                    const uint8_t *data, size_t dataLength)
+{
+    const char *error = validateCommandBatch(cmds, cmdLength, dataLength);
+    if (error != NULL) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException", error);
+        return;
+    }
+
+    jint pos = 0;
+    while (pos < cmdLength) {
+        const jint *c = &cmds[pos + 1];
+        jint dataArg;
+        jint argCount = batchCommandLayout(cmds[pos], &dataArg);
+        jint dataOffset = dataArg >= 0 ? c[dataArg] : 0;
+        jint sizeBytes = dataArg >= 0 ? c[dataArg + 1] : 0;
+        const void *ptr = data != NULL ? data + dataOffset : NULL;
+
+        switch (cmds[pos]) {
+        case BATCH_ALLOCATION_DATA_1D:
+            LOG_API("batch rsAllocation1DData, con(%p), alloc(%p), offset(%i), count(%i), sizeBytes(%i)",
+                    con, (RsAllocation)c[0], c[1], c[3], sizeBytes);
+            rsAllocation1DData(con, (RsAllocation)c[0], c[1], c[2], c[3], ptr, sizeBytes);
+            break;
+        case BATCH_ALLOCATION_DATA_2D:
+            LOG_API("batch rsAllocation2DData, con(%p), alloc(%p), xoff(%i), yoff(%i), w(%i), h(%i)",
+                    con, (RsAllocation)c[0], c[1], c[2], c[5], c[6]);
+            rsAllocation2DData(con, (RsAllocation)c[0], c[1], c[2], c[3],
+                               (RsAllocationCubemapFace)c[4], c[5], c[6], ptr, sizeBytes);
+            break;
+        case BATCH_SCRIPT_INVOKE:
+            LOG_API("batch rsScriptInvokeV, con(%p), s(%p), slot(%i)", con, (void *)c[0], c[1]);
+            if (sizeBytes > 0) {
+                rsScriptInvokeV(con, (RsScript)c[0], c[1], ptr, sizeBytes);
+            } else {
+                rsScriptInvoke(con, (RsScript)c[0], c[1]);
+            }
+            break;
+        case BATCH_SCRIPT_FOREACH:
+            LOG_API("batch rsScriptForEach, con(%p), s(%p), slot(%i)", con, (void *)c[0], c[1]);
+            rsScriptForEach(con, (RsScript)c[0], c[1], (RsAllocation)c[2], (RsAllocation)c[3],
+                            sizeBytes > 0 ? ptr : NULL, sizeBytes);
+            break;
+        case BATCH_ALLOCATION_SYNC_ALL:
+            LOG_API("batch rsAllocationSyncAll, con(%p), a(%p), bits(0x%08x)", con, (RsAllocation)c[0], c[1]);
+            rsAllocationSyncAll(con, (RsAllocation)c[0], (RsAllocationUsageType)c[1]);
+            break;
+        }
+
+        pos += argCount + 1;
+    }
+}
+
+static void
+nCommandBatch(JNIEnv *_env, jobject _this, RsContext con, jintArray cmds, jint cmdLength,
+              jbyteArray data)
+{
+    LOG_API("nCommandBatch, con(%p), cmdLength(%i)", con, cmdLength);
+    if (cmds == NULL) {
+        jniThrowNullPointerException(_env, "cmds == null");
+        return;
+    }
+    if (cmdLength < 0 || cmdLength > _env->GetArrayLength(cmds)) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException", "cmdLength out of range");
+        return;
+    }
+
+    // Both pins throw OutOfMemoryError when they fail
+    jint *cmdPtr = _env->GetIntArrayElements(cmds, NULL);
+    if (cmdPtr == NULL) {
+        return;
+    }
+    jbyte *dataPtr = NULL;
+    jint dataLength = 0;
+    if (data != NULL) {
+        dataLength = _env->GetArrayLength(data);
+        dataPtr = _env->GetByteArrayElements(data, NULL);
+        if (dataPtr == NULL) {
+            _env->ReleaseIntArrayElements(cmds, cmdPtr, JNI_ABORT);
+            return;
+        }
+    }
+
+    executeCommandBatch(_env, con, cmdPtr, cmdLength, (const uint8_t *)dataPtr, dataLength);
+
+    if (dataPtr != NULL) {
+        _env->ReleaseByteArrayElements(data, dataPtr, JNI_ABORT);
+    }
+    _env->ReleaseIntArrayElements(cmds, cmdPtr, JNI_ABORT);
+}
+
+static void
+nCommandBatchDirect(JNIEnv *_env, jobject _this, RsContext con, jintArray cmds, jint cmdLength,
+                    jobject data)
+{
+    LOG_API("nCommandBatchDirect, con(%p), cmdLength(%i)", con, cmdLength);
+    if (cmds == NULL || data == NULL) {
+        jniThrowNullPointerException(_env, cmds == NULL ? "cmds == null" : "data == null");
+        return;
+    }
+    if (cmdLength < 0 || cmdLength > _env->GetArrayLength(cmds)) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException", "cmdLength out of range");
+        return;
+    }
+
+    // The payloads are read in place, without pinning or copying
+    void *dataPtr = _env->GetDirectBufferAddress(data);
+    jlong dataLength = _env->GetDirectBufferCapacity(data);
+    if (dataPtr == NULL || dataLength < 0) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException",
+                "data must be a direct ByteBuffer");
+        return;
+    }
+
+    jint *cmdPtr = _env->GetIntArrayElements(cmds, NULL);
+    if (cmdPtr == NULL) {
+        return;
+    }
+    executeCommandBatch(_env, con, cmdPtr, cmdLength, (const uint8_t *)dataPtr, dataLength);
+    _env->ReleaseIntArrayElements(cmds, cmdPtr, JNI_ABORT);
+}
+
 
 // -----------------------------------
 
@@ -1441,10 +1653,20 @@ static JNINativeMethod methods[] = {
 
 };
 
+// Only registered if RenderScript declares them
+static JNINativeMethod optionalMethods[] = {
+{"rsnAllocationCreateTypedDirect",   "(IIIILjava/nio/ByteBuffer;)I",          (void*)nAllocationCreateTypedDirect },
+{"rsnCommandBatch",                  "(I[II[B)V",                             (void*)nCommandBatch },
+{"rsnCommandBatch",                  "(I[IILjava/nio/ByteBuffer;)V",          (void*)nCommandBatchDirect },
+};
+
 static int registerFuncs(JNIEnv *_env)
 {
-    return android::AndroidRuntime::registerNativeMethods(
+    int result = android::AndroidRuntime::registerNativeMethods(
             _env, classPathName, methods, NELEM(methods));
+    android::AndroidRuntime::registerOptionalNativeMethods(
+            _env, classPathName, optionalMethods, NELEM(optionalMethods));
+    return result;
 }
 
 // ---------------------------------------------------------------------------
@@ -50,6 +50,14 @@ public:
     static int registerNativeMethods(JNIEnv* env,
         const char* className, const JNINativeMethod* gMethods, int numMethods);
 
+    /**
+     * Register methods that the class may not declare, one by one.  Methods the
+     * class does not declare are skipped instead of aborting.  Returns the number
+     * of methods registered, or -1 if the class cannot be found.
+     */
+    static int registerOptionalNativeMethods(JNIEnv* env,
+        const char* className, const JNINativeMethod* gMethods, int numMethods);
+
     /**
      * Call a class's static main method with the given arguments,
      */
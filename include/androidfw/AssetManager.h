@@ -147,6 +147,15 @@ public:
      */
     Asset* open(const char* fileName, AccessMode mode);
 
+    /*
+     * Open an asset like open(), but without holding the manager's lock
+     * while the entry is looked up and the Asset is created, so threads
+     * streaming assets do not wait behind resource loading. Only assets in
+     * Zip archives are handled this way; if any asset path is a directory
+     * this simply calls open().
+     */
+    Asset* openConcurrent(const char* fileName, AccessMode mode);
+
     /*
      * Open a non-asset file as an asset.
      *
@@ -255,6 +264,8 @@ private:
         const String8& dirName, const String8& fileName);
 
     ZipFileRO* getZipFileLocked(const asset_path& path);
+    void updateConcurrentZipsLocked();
+    void invalidateConcurrentZipsLocked();
     Asset* openAssetFromFileLocked(const String8& fileName, AccessMode mode);
     Asset* openAssetFromZipLocked(const ZipFileRO* pZipFile,
         const ZipEntryRO entry, AccessMode mode, const String8& entryName);
@@ -280,6 +291,9 @@ private:
     void setLocaleLocked(const char* locale);
     void updateResourceParamsLocked() const;
 
+    bool updateIdmapFileLocked(const String8& originalPath, const String8& overlayPath,
+                               const String8& idmapPath);
+
     bool createIdmapFileLocked(const String8& originalPath, const String8& overlayPath,
                                const String8& idmapPath);
 
@@ -296,6 +310,24 @@ private:
 
         ZipFileRO* getZip();
 
+        /*
+         * The files and subdirectories directly inside one directory of the
+         * archive.  Subdirectories are kept apart so that they take precedence
+         * over files of the same name, as in a full scan.
+         */
+        struct Dir {
+            SortedVector<AssetDir::FileInfo> files;
+            SortedVector<AssetDir::FileInfo> dirs;
+        };
+
+        /*
+         * Return the contents of "dirName" ("" for the root), or NULL if the
+         * archive has nothing in it.  The index of all directories is built
+         * from the central directory on first use and kept for the life of
+         * the SharedZip, so it is shared by every AssetManager in the process.
+         */
+        const Dir* getDir(const String8& dirName);
+
         Asset* getResourceTableAsset();
         Asset* setResourceTableAsset(Asset* asset);
 
@@ -318,6 +350,12 @@ private:
         Asset* mResourceTableAsset;
         ResTable* mResourceTable;
 
+        void buildDirIndexLocked();
+
+        Mutex mDirIndexLock;
+        bool mDirIndexValid;
+        DefaultKeyedVector<String8, Dir*> mDirIndex;
+
         static Mutex gLock;
         static DefaultKeyedVector<String8, wp<SharedZip> > gOpen;
     };
@@ -340,6 +378,8 @@ private:
          */
         ZipFileRO* getZip(const String8& path);
 
+        const SharedZip::Dir* getZipDir(const String8& path, const String8& dirName);
+
         Asset* getZipResourceTableAsset(const String8& path);
         Asset* setZipResourceTableAsset(const String8& path, Asset* asset);
 
@@ -383,6 +423,19 @@ private:
     CacheMode       mCacheMode;         // is the cache enabled?
     bool            mCacheValid;        // clear when locale or vendor changes
     SortedVector<AssetDir::FileInfo> mCache;
+
+    /*
+     * The Zip archives of the non-skin asset paths, most recently added
+     * first, for openConcurrent().  Rebuilt under mLock when the paths
+     * change, and otherwise only read under mConcurrentLock.  The archives
+     * stay open for the life of the AssetManager, so the pointers may be
+     * used after the lock is dropped.
+     */
+    mutable Mutex   mConcurrentLock;
+    bool            mConcurrentValid;
+    bool            mConcurrentUsable;  // false if some path is a directory
+    Vector<ZipFileRO*> mConcurrentZips;
+    Vector<String8> mConcurrentZipNames;
 };
 
 }; // namespace android
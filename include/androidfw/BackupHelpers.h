@@ -19,6 +19,8 @@
 
 #include <utils/Errors.h>
 #include <utils/String8.h>
+
+#include <sys/uio.h>
 #include <utils/KeyedVector.h>
 
 namespace android {
@@ -80,12 +82,15 @@ public:
      */
     status_t WriteEntityData(const void* data, size_t size);
 
+    /* Gathers several pieces of entity data into a single write. */
+    status_t WriteEntityData(const struct iovec* iov, int iovcnt);
+
     void SetKeyPrefix(const String8& keyPrefix);
 
 private:
     explicit BackupDataWriter();
-    status_t write_padding_for(int n);
-    
+    status_t write_fully(const struct iovec* iov, int iovcnt);
+
     int m_fd;
     status_t m_status;
     ssize_t m_pos;
@@ -50,7 +50,7 @@ namespace android {
  */
 class CursorWindow {
     CursorWindow(const String8& name, int ashmemFd,
-            void* data, size_t size, bool readOnly);
+            void* data, size_t size, size_t maxSize, bool readOnly);
 
 public:
     /* Field types. */
@@ -81,12 +81,22 @@ public:
     ~CursorWindow();
 
     static status_t create(const String8& name, size_t size, CursorWindow** outCursorWindow);
+
+    /**
+     * Creates a window of the given size that grows in place, up to maxSize,
+     * when an allocation does not fit.  The whole of maxSize is reserved up
+     * front but ashmem only commits the pages that are actually written.
+     */
+    static status_t create(const String8& name, size_t size, size_t maxSize,
+            CursorWindow** outCursorWindow);
     static status_t createFromParcel(Parcel* parcel, CursorWindow** outCursorWindow);
 
     status_t writeToParcel(Parcel* parcel);
 
     inline String8 name() { return mName; }
+    inline const void* data() { return mData; }
     inline size_t size() { return mSize; }
+    inline bool isReadOnly() { return mReadOnly; }
     inline size_t freeSpace() { return mSize - mHeader->freeOffset; }
     inline uint32_t getNumRows() { return mHeader->numRows; }
     inline uint32_t getNumColumns() { return mHeader->numColumns; }
@@ -101,12 +111,42 @@ public:
     status_t allocRow();
     status_t freeLastRow();
 
+    /**
+     * Allocate a row slot and its directory, returning the directory.
+     * Callers filling a whole row can then store each column through
+     * &fieldDir[column] without looking the row up again.
+     */
+    status_t allocRow(FieldSlot** outFieldDir);
+
     status_t putBlob(uint32_t row, uint32_t column, const void* value, size_t size);
     status_t putString(uint32_t row, uint32_t column, const char* value, size_t sizeIncludingNull);
     status_t putLong(uint32_t row, uint32_t column, int64_t value);
     status_t putDouble(uint32_t row, uint32_t column, double value);
     status_t putNull(uint32_t row, uint32_t column);
 
+    /**
+     * Store a value in a field slot of a row allocated by this window.
+     * Only blobs and strings can fail, when the window has no room for the data.
+     */
+    status_t putBlob(FieldSlot* fieldSlot, const void* value, size_t size);
+    status_t putString(FieldSlot* fieldSlot, const char* value, size_t sizeIncludingNull);
+
+    inline void putLong(FieldSlot* fieldSlot, int64_t value) {
+        fieldSlot->type = FIELD_TYPE_INTEGER;
+        fieldSlot->data.l = value;
+    }
+
+    inline void putDouble(FieldSlot* fieldSlot, double value) {
+        fieldSlot->type = FIELD_TYPE_FLOAT;
+        fieldSlot->data.d = value;
+    }
+
+    inline void putNull(FieldSlot* fieldSlot) {
+        fieldSlot->type = FIELD_TYPE_NULL;
+        fieldSlot->data.buffer.offset = 0;
+        fieldSlot->data.buffer.size = 0;
+    }
+
     /**
      * Gets the field slot at the specified row and column.
      * Returns null if the requested row or column is not in the window.
@@ -138,13 +178,19 @@ public:
 
 private:
     static const size_t ROW_SLOT_CHUNK_NUM_ROWS = 100;
+    static const size_t INITIAL_CHUNK_DIR_CAPACITY = 16;
 
     struct Header {
         // Offset of the lowest unused byte in the window.
         uint32_t freeOffset;
 
-        // Offset of the first row slot chunk.
-        uint32_t firstChunkOffset;
+        // Offset of the row slot chunk directory, an array of chunkDirCapacity
+        // chunk offsets of which the first numChunks are in use.  The directory
+        // is reallocated at twice its capacity when it fills up, so finding
+        // the chunk for a row is a single index.
+        uint32_t chunkDirOffset;
+        uint32_t chunkDirCapacity;
+        uint32_t numChunks;
 
         uint32_t numRows;
         uint32_t numColumns;
@@ -156,13 +202,13 @@ private:
 
     struct RowSlotChunk {
         RowSlot slots[ROW_SLOT_CHUNK_NUM_ROWS];
-        uint32_t nextChunkOffset;
     };
 
     String8 mName;
     int mAshmemFd;
     void* mData;
     size_t mSize;
+    size_t mMaxSize;
     bool mReadOnly;
     Header* mHeader;
 
@@ -184,7 +230,7 @@ private:
     RowSlot* getRowSlot(uint32_t row);
     RowSlot* allocRowSlot();
 
-    status_t putBlobOrString(uint32_t row, uint32_t column,
+    status_t putBlobOrString(FieldSlot* fieldSlot,
             const void* value, size_t size, int32_t type);
 };
 
@@ -368,7 +368,7 @@ public:
 
     inline nsecs_t getEventTime() const { return mSampleEventTimes[getHistorySize()]; }
 
-    const PointerCoords* getRawPointerCoords(size_t pointerIndex) const;
+    void getRawPointerCoords(size_t pointerIndex, PointerCoords* outPointerCoords) const;
 
     float getRawAxisValue(int32_t axis, size_t pointerIndex) const;
 
@@ -424,8 +424,8 @@ public:
         return mSampleEventTimes[historicalIndex];
     }
 
-    const PointerCoords* getHistoricalRawPointerCoords(
-            size_t pointerIndex, size_t historicalIndex) const;
+    void getHistoricalRawPointerCoords(size_t pointerIndex, size_t historicalIndex,
+            PointerCoords* outPointerCoords) const;
 
     float getHistoricalRawAxisValue(int32_t axis, size_t pointerIndex,
             size_t historicalIndex) const;
@@ -534,9 +534,6 @@ public:
         return mPointerProperties.array();
     }
     inline const nsecs_t* getSampleEventTimes() const { return mSampleEventTimes.array(); }
-    inline const PointerCoords* getSamplePointerCoords() const {
-            return mSamplePointerCoords.array();
-    }
 
 protected:
     int32_t mAction;
@@ -551,7 +548,20 @@ protected:
     nsecs_t mDownTime;
     Vector<PointerProperties> mPointerProperties;
     Vector<nsecs_t> mSampleEventTimes;
-    Vector<PointerCoords> mSamplePointerCoords;
+
+    // Pointer coordinates of each sample, stored compactly in sample-major order.
+    // Each pointer of each sample has the bits of the axes it holds and the offset of
+    // its values in mSampleAxisValues, which only contains the values that are present.
+    Vector<uint64_t> mSampleAxisBits;
+    Vector<uint32_t> mSampleAxisValueOffsets;
+    Vector<float> mSampleAxisValues;
+
+    void clearSamplePointerCoords();
+    void appendSamplePointerCoords(const PointerCoords& pointerCoords);
+    void appendSamplePointerCoords(const MotionEvent* other, size_t index);
+    void getSamplePointerCoords(size_t index, PointerCoords* outPointerCoords) const;
+    float getSampleAxisValue(size_t index, int32_t axis) const;
+    float* editSampleAxisValue(size_t index, int32_t axis);
 };
 
 /*
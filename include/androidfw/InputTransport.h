@@ -28,6 +28,7 @@
  */
 
 #include <androidfw/Input.h>
+#include <androidfw/VelocityTracker.h>
 #include <utils/Errors.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
@@ -125,6 +126,11 @@ struct InputMessage {
  * Each endpoint has its own InputChannel object that specifies its file descriptor.
  *
  * The input channel is closed when all references to it are released.
+ *
+ * When the debug.inputchannel.ring property is set to 1, channel pairs also share an
+ * ashmem region holding one single-producer, single-consumer ring per direction.
+ * Messages are then written to the ring and the socket only carries a one byte doorbell
+ * per message, so the socket stays readable exactly while messages are pending.
  */
 class InputChannel : public RefBase {
 protected:
@@ -133,6 +139,12 @@ protected:
 public:
     InputChannel(const String8& name, int fd);
 
+    /* Creates a channel that exchanges messages through the shared memory ring in ringFd
+     * and uses fd as its doorbell.  The channel takes ownership of both descriptors.
+     * The server and client ends read and write opposite halves of the ring.
+     */
+    InputChannel(const String8& name, int fd, int ringFd, bool isRingServer);
+
     /* Creates a pair of input channels.
      *
      * Returns OK on success.
@@ -143,6 +155,10 @@ public:
     inline String8 getName() const { return mName; }
     inline int getFd() const { return mFd; }
 
+    /* Gets the shared memory ring fd, or -1 if the channel only uses its socket. */
+    inline int getRingFd() const { return mRingFd; }
+    inline bool isRingServer() const { return mIsRingServer; }
+
     /* Sends a message to the other endpoint.
      *
      * If the channel is full then the message is guaranteed not to have been sent at all.
@@ -156,6 +172,19 @@ public:
      */
     status_t sendMessage(const InputMessage* msg);
 
+    /* Sends several messages to the other endpoint using as few system calls as possible.
+     * Messages are sent in order and each one is delivered as a separate packet.
+     *
+     * The number of messages that were sent is returned in outSentCount even when
+     * an error occurs; the remaining messages are guaranteed not to have been sent.
+     *
+     * Returns OK if all messages were sent.
+     * Returns WOULD_BLOCK if the channel became full before all messages were sent.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count, size_t* outSentCount);
+
     /* Receives a message sent by the other endpoint.
      *
      * If there is no message present, try again after poll() indicates that the fd
@@ -169,8 +198,25 @@ public:
     status_t receiveMessage(InputMessage* msg);
 
 private:
+    struct RingQueue;
+    struct Ring;
+
     String8 mName;
     int mFd;
+
+    int mRingFd;
+    bool mIsRingServer;
+    Ring* mRing;
+    RingQueue* mSendQueue;
+    RingQueue* mReceiveQueue;
+
+    void mapRing();
+    status_t sendRingMessage(const InputMessage* msg);
+    status_t receiveRingMessage(InputMessage* msg);
+    status_t sendDoorbell();
+    status_t receiveDoorbell();
+
+    static bool isRingEnabled();
 };
 
 /*
@@ -184,15 +230,40 @@ public:
     /* Destroys the publisher and releases its input channel. */
     ~InputPublisher();
 
+    /* Maximum number of events that can be published in a single batch. */
+    static const size_t MAX_BATCH_SIZE = 8;
+
     /* Gets the underlying input channel. */
     inline sp<InputChannel> getChannel() { return mChannel; }
 
+    /* Starts a batch.  Until endBatch() is called, published events are queued
+     * in the publisher instead of being written to the channel.  The publish methods
+     * then only report validation errors and return NO_MEMORY once the batch
+     * holds MAX_BATCH_SIZE events.
+     */
+    void beginBatch();
+
+    /* Ends the current batch and writes the queued events to the channel with
+     * a single vectored send.  The number of events that were actually sent is
+     * returned in outSentCount; it is always a prefix of the batch.
+     *
+     * Returns OK if all queued events were sent.
+     * Returns WOULD_BLOCK if the channel became full before all events were sent.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t endBatch(size_t* outSentCount);
+
+    /* Returns true if a batch is in progress and cannot hold any more events. */
+    inline bool isBatchFull() const { return mBatching && mBatchCount == MAX_BATCH_SIZE; }
+
     /* Publishes a key event to the input channel.
      *
      * Returns OK on success.
      * Returns WOULD_BLOCK if the channel is full.
      * Returns DEAD_OBJECT if the channel's peer has been closed.
      * Returns BAD_VALUE if seq is 0.
+     * Returns NO_MEMORY if the current batch is full.
      * Other errors probably indicate that the channel is broken.
      */
     status_t publishKeyEvent(
@@ -214,6 +285,7 @@ public:
      * Returns WOULD_BLOCK if the channel is full.
      * Returns DEAD_OBJECT if the channel's peer has been closed.
      * Returns BAD_VALUE if seq is 0 or if pointerCount is less than 1 or greater than MAX_POINTERS.
+     * Returns NO_MEMORY if the current batch is full.
      * Other errors probably indicate that the channel is broken.
      */
     status_t publishMotionEvent(
@@ -250,6 +322,14 @@ public:
 
 private:
     sp<InputChannel> mChannel;
+
+    // Events queued between beginBatch() and endBatch(), allocated on first use.
+    bool mBatching;
+    size_t mBatchCount;
+    InputMessage* mBatchMessages;
+
+    InputMessage* obtainMessage(InputMessage* localMsg);
+    status_t publishMessage(InputMessage* msg);
 };
 
 /*
@@ -331,6 +411,10 @@ private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    // Name of the velocity tracker strategy used to predict touches past the most recent
+    // sample, or empty to extrapolate linearly from the last two samples.
+    const String8 mPredictorStrategy;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
@@ -377,6 +461,10 @@ private:
         History history[2];
         History lastResample;
 
+        // Tracks the recent movement of the pointers when touch prediction is enabled,
+        // otherwise NULL.  Owned by the touch state.
+        VelocityTracker* velocityTracker;
+
         void initialize(int32_t deviceId, int32_t source) {
             this->deviceId = deviceId;
             this->source = source;
@@ -416,6 +504,7 @@ private:
             Batch& batch, size_t count, uint32_t* outSeq, InputEvent** outEvent);
 
     void updateTouchState(InputMessage* msg);
+    void addTouchMovement(TouchState& touchState, const InputMessage* msg);
     void rewriteMessage(const TouchState& state, InputMessage* msg);
     void resampleTouchState(nsecs_t frameTime, MotionEvent* event,
             const InputMessage *next);
@@ -433,6 +522,7 @@ private:
     static bool shouldResampleTool(int32_t toolType);
 
     static bool isTouchResamplingEnabled();
+    static String8 getTouchPredictorStrategy();
 };
 
 } // namespace android
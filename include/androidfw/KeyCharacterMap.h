@@ -169,6 +169,12 @@ private:
         Behavior* firstBehavior;
     };
 
+    /* The key and meta state that produce a character. */
+    struct CharacterKey {
+        int32_t keyCode;
+        int32_t metaState;
+    };
+
     class Parser {
         enum State {
             STATE_TOP = 0,
@@ -219,6 +225,10 @@ private:
     KeyedVector<int32_t, int32_t> mKeysByScanCode;
     KeyedVector<int32_t, int32_t> mKeysByUsageCode;
 
+    // Reverse index from characters to the keys that produce them, used by findKey().
+    // Rebuilt by indexCharacters() whenever mKeys changes.
+    KeyedVector<char16_t, CharacterKey> mKeysByCharacter;
+
     KeyCharacterMap();
     KeyCharacterMap(const KeyCharacterMap& other);
 
@@ -228,6 +238,7 @@ private:
     static bool matchesMetaState(int32_t eventMetaState, int32_t behaviorMetaState);
 
     bool findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMetaState) const;
+    void indexCharacters();
 
     static status_t load(Tokenizer* tokenizer, Format format, sp<KeyCharacterMap>* outMap);
 
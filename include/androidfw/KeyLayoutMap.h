@@ -25,6 +25,8 @@
 
 namespace android {
 
+class FileMap;
+
 struct AxisInfo {
     enum Mode {
         // Axis value is reported directly.
@@ -59,11 +61,23 @@ struct AxisInfo {
  * Describes a mapping from keyboard scan codes and joystick axes to Android key codes and axes.
  *
  * This object is immutable after it has been loaded.
+ *
+ * Key layouts can also be compiled into a binary form (by validatekeymaps) that is
+ * memory mapped instead of parsed.  The compiled form of "Foo.kl" is "Foo.klc" in the
+ * same directory; it is used in place of the text file as long as it is not older.
  */
 class KeyLayoutMap : public RefBase {
 public:
+    /* Loads a key layout map, preferring its compiled form when available.
+     * Devices that use the same key layout file share the same map. */
     static status_t load(const String8& filename, sp<KeyLayoutMap>* outMap);
 
+    /* Parses a key layout map from its text form, ignoring any compiled form. */
+    static status_t parse(const String8& filename, sp<KeyLayoutMap>* outMap);
+
+    /* Writes the compiled form of the key layout map to the specified file. */
+    status_t compile(const String8& filename) const;
+
     status_t mapKey(int32_t scanCode, int32_t usageCode,
             int32_t* outKeyCode, uint32_t* outFlags) const;
     status_t findScanCodesForKey(int32_t keyCode, Vector<int32_t>* outScanCodes) const;
@@ -79,13 +93,56 @@ private:
         uint32_t flags;
     };
 
+    // Layout of the compiled form: a header followed by the keys sorted by scan code,
+    // the keys sorted by usage code and the axes sorted by scan code.
+    struct CompiledHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t scanCodeKeyCount;
+        uint32_t usageCodeKeyCount;
+        uint32_t axisCount;
+    };
+
+    struct CompiledKey {
+        int32_t code;
+        int32_t keyCode;
+        uint32_t flags;
+    };
+
+    struct CompiledAxis {
+        int32_t scanCode;
+        int32_t mode;
+        int32_t axis;
+        int32_t highAxis;
+        int32_t splitValue;
+        int32_t flatOverride;
+    };
+
+    static const uint32_t COMPILED_MAGIC = 0x434c4b41; // 'AKLC'
+    static const uint32_t COMPILED_VERSION = 1;
+
+    // Entries of a parsed map.
     KeyedVector<int32_t, Key> mKeysByScanCode;
     KeyedVector<int32_t, Key> mKeysByUsageCode;
     KeyedVector<int32_t, AxisInfo> mAxes;
 
+    // Entries of a compiled map, which point into mCompiledMap.
+    FileMap* mCompiledMap;
+    const CompiledKey* mCompiledKeysByScanCode;
+    size_t mCompiledKeysByScanCodeCount;
+    const CompiledKey* mCompiledKeysByUsageCode;
+    size_t mCompiledKeysByUsageCodeCount;
+    const CompiledAxis* mCompiledAxes;
+    size_t mCompiledAxisCount;
+
     KeyLayoutMap();
 
-    const Key* getKey(int32_t scanCode, int32_t usageCode) const;
+    static status_t loadCompiled(const String8& filename, sp<KeyLayoutMap>* outMap);
+    static const CompiledKey* findCompiledKey(const CompiledKey* keys, size_t count,
+            int32_t code);
+
+    bool getKey(int32_t scanCode, int32_t usageCode, int32_t* outKeyCode,
+            uint32_t* outFlags) const;
 
     class Parser {
         KeyLayoutMap* mMap;
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ANDROIDFW_LATENCY_HISTOGRAM_H
+#define _ANDROIDFW_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Counts latencies in power of two buckets starting at 0.5ms, the last bucket
+ * is open ended.
+ *
+ * Used by the system services to report the latency of their event pipelines
+ * in their dumpsys output.  Not thread-safe, callers provide their own locking.
+ */
+struct LatencyHistogram {
+    enum { BUCKET_COUNT = 12 };
+
+    uint32_t counts[BUCKET_COUNT];
+    uint32_t total;
+    nsecs_t max;
+
+    LatencyHistogram();
+
+    void add(nsecs_t latency);
+
+    /* Returns the upper bound of the bucket holding the given percentile. */
+    nsecs_t getPercentile(uint32_t percent) const;
+
+    /* Appends one line summarizing the histogram, starting with prefix. */
+    void dump(String8& dump, const char* prefix, const char* name) const;
+};
+
+} // namespace android
+
+#endif // _ANDROIDFW_LATENCY_HISTOGRAM_H
@@ -19,7 +19,9 @@
 
 #include <stdint.h>
 #include <strings.h>
+#include <sys/types.h>
 
+#include <utils/Compat.h>
 #include <utils/RefBase.h>
 #include <utils/String8.h>
 
@@ -134,7 +136,8 @@ private:
 
     size_t mFileSize;
 
-    size_t mFooterStart;
+    /* Where the footer starts; OBBs can be larger than 4GB. */
+    off64_t mFooterStart;
 
     unsigned char* mReadBuf;
 
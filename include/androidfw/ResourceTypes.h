@@ -24,7 +24,9 @@
 #include <androidfw/Asset.h>
 #include <utils/ByteOrder.h>
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <androidfw/PackageRedirectionMap.h>
+#include <utils/RefBase.h>
 #include <utils/String16.h>
 #include <utils/Vector.h>
 
@@ -456,6 +458,12 @@ public:
     // Note: returns null if the string pool is not UTF8.
     const char* string8At(size_t idx, size_t* outLen) const;
 
+    // Return the NUL-terminated UTF8 string entry if it is also valid
+    // modified UTF-8 (no embedded NULs or supplementary characters), as
+    // expected by JNI's NewStringUTF().  Returns null otherwise, including
+    // when the pool is not UTF8.
+    const char* modifiedUtf8At(size_t idx) const;
+
     // Return string whether the pool is UTF8 or UTF16.  Does not allow you
     // to distinguish null.
     const String8 string8ObjectAt(size_t idx) const;
@@ -473,6 +481,11 @@ public:
     bool isUTF8() const;
 
 private:
+    struct decode_block;
+
+    void buildIndexLocked() const;
+    char16_t* allocDecodedLocked(size_t count) const;
+
     status_t                    mError;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
@@ -482,9 +495,18 @@ private:
     const uint32_t*             mEntryStyles;
     const void*                 mStrings;
     char16_t**                  mCache;
+    // Arena holding the strings in mCache, so that decoding a whole pool
+    // does not make one heap allocation per string.
+    mutable decode_block*       mDecodeBlocks;
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
+
+    // Open-addressing hash index used by indexOfString() on unsorted pools,
+    // built on the first lookup.  Each slot is a (hash, index + 1) pair; an
+    // index of 0 marks an empty slot.
+    mutable uint32_t*           mIndex;
+    mutable size_t              mIndexMask;
 };
 
 /** ********************************************************************
@@ -1353,6 +1375,9 @@ public:
      * @param outBag Filled inm with a pointer to the bag mappings.
      *
      * @return ssize_t Either a >= 0 bag count of negative error code.
+     *
+     * The table is only locked for reading while the bag is held, so several
+     * threads may hold bags at the same time.
      */
     ssize_t lockBag(uint32_t resID, const bag_entry** outBag) const;
 
@@ -1408,6 +1433,8 @@ public:
         void dumpToLog() const;
         
     private:
+        friend class ResTable;
+
         Theme(const Theme&);
         Theme& operator=(const Theme&);
 
@@ -1420,16 +1447,36 @@ public:
             size_t numEntries;
             theme_entry* entries;
         };
+        // Package data is reference counted and shared copy-on-write between
+        // themes and the table's theme snapshot cache.
         struct package_info {
+            volatile int32_t refCount;
             size_t numTypes;
             type_info types[];
         };
+        // The result of applying a sequence of styles to an empty theme.
+        struct snapshot {
+            Vector<uint32_t> styles;
+            package_info* packages[Res_MAXPACKAGE];
+        };
 
-        void free_package(package_info* pi);
-        package_info* copy_package(package_info* pi);
+        static package_info* acquire_package(package_info* pi);
+        static void free_package(package_info* pi);
+        static package_info* copy_package(package_info* pi);
+        static void free_snapshot(snapshot* s);
+        package_info* edit_package(size_t pidx);
+        void set_packages(package_info* const* packages);
 
         const ResTable& mTable;
         package_info*   mPackages[Res_MAXPACKAGE];
+
+        // The (resID, force) pairs applied to this theme so far, used as the
+        // key into the table's theme snapshot cache.  Not valid once the theme
+        // has been set from a theme of another table or the cache has been
+        // cleared since the styles were applied.
+        Vector<uint32_t> mStyles;
+        bool            mStylesValid;
+        uint32_t        mStylesGeneration;
     };
 
     void setParameters(const ResTable_config* params);
@@ -1562,6 +1609,7 @@ private:
     struct Type;
     struct Package;
     struct PackageGroup;
+    struct FilteredType;
     struct bag_set;
 
     status_t add(const void* data, size_t size, void* cookie,
@@ -1576,14 +1624,47 @@ private:
     status_t parsePackage(
         const ResTable_package* const pkg, const Header* const header, uint32_t idmap_id);
 
+    void updateFilteredTypes();
+    void updateFilteredTypesLocked();
+    void clearFilteredTypesLocked();
+
+    const Theme::snapshot* findThemeSnapshotLocked(const Vector<uint32_t>& styles) const;
+    void clearThemeCache() const;
+
+    void updateRedirectionIndex();
+
+    const bag_set* findBag(uint32_t resID) const;
+    ssize_t buildBagLocked(uint32_t resID, const bag_entry** outBag,
+            uint32_t* outTypeSpecFlags) const;
+
     void print_value(const Package* pkg, const Res_value& value) const;
     
-    mutable Mutex               mLock;
+    // Held for reading while looking up bags and for writing while changing
+    // the parameters or the filtered types, which invalidates the bag cache.
+    mutable RWLock              mLock;
+
+    // Serializes computing new bags.  Bags that have already been computed
+    // are published to the bag cache and read without taking this lock.
+    mutable Mutex               mBagBuildLock;
+
+    // Recently built theme snapshots, oldest first.  Guarded by mThemeCacheLock
+    // and cleared whenever the bags they were built from may have changed.
+    mutable Mutex               mThemeCacheLock;
+    mutable Vector<Theme::snapshot*> mThemeCache;
+    mutable uint32_t            mThemeCacheGeneration;
 
     status_t                    mError;
 
     ResTable_config             mParams;
 
+    // For each type, the configurations that match mParams.  Rebuilt whenever
+    // the parameters or the set of packages change so that lookups with the
+    // current parameters only need to consider these.  Guarded by
+    // mFilteredTypesLock; getEntry() holds a reference to the one it uses so
+    // that a concurrent rebuild cannot free it.
+    mutable Mutex               mFilteredTypesLock;
+    KeyedVector<const Type*, sp<FilteredType> > mFilteredTypes;
+
     // Array of all resource tables.
     Vector<Header*>             mHeaders;
 
@@ -1598,6 +1679,13 @@ private:
     // one).  Resources requested which are found in this map will be
     // automatically redirected to the appropriate themed value.
     Vector<PackageRedirectionMap*> mRedirectionMap;
+
+    // Mapping from resource package IDs to indices (plus one) into
+    // mRedirectionMap, so that resources of packages without redirections
+    // are rejected with a single load.  Only valid if mRedirectionIndexValid;
+    // maps added before their first redirection have no package yet.
+    uint8_t                     mRedirectionPackageMap[256];
+    bool                        mRedirectionIndexValid;
 };
 
 }   // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ANDROIDFW_STALL_DETECTOR_H
+#define _ANDROIDFW_STALL_DETECTOR_H
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Detects stalls of looper threads within the process.
+ *
+ * A watched thread reports a heartbeat each time it wakes up to process work and
+ * each time it goes back to waiting for more.  A sampling thread checks the
+ * heartbeats at a high frequency and records a stall whenever a thread has been
+ * busy for longer than the threshold, which catches latency spikes long before the
+ * watchdog decides that the process is hung.  Idle threads are never considered
+ * stalled, however long they wait.
+ *
+ * Each stall is recorded once, with the kernel stack and wait channel of the
+ * stalled thread, the state of the other watched threads (which usually hold the
+ * lock it is waiting for) and optionally a native backtrace from debuggerd, into a
+ * ring buffer of the most recent stalls.
+ *
+ * Heartbeats are lock-free and do nothing on threads that are not registered, so
+ * they can be left in loops that unit tests run on their own threads.
+ */
+class StallDetector {
+public:
+    enum {
+        // Maximum number of threads that can be watched at once.
+        MAX_WATCHED_THREADS = 16,
+
+        // Number of stalls kept in the ring buffer.
+        MAX_RECORDED_STALLS = 8,
+    };
+
+    /* Watches the calling thread under the given name, initially busy.  The thread is
+     * no longer watched once it exits or calls unregisterThread(). */
+    static status_t registerThread(const char* name);
+    static void unregisterThread();
+
+    /* Called by a watched thread when it starts processing work. */
+    static void beginWork();
+
+    /* Called by a watched thread when it is about to wait for more work. */
+    static void endWork();
+
+    /* Starts sampling the watched threads, or changes the parameters of the running
+     * sampler.  A thread is stalled once it has been busy for longer than the threshold.
+     * Native backtraces stop the whole process while debuggerd unwinds it so they are
+     * captured at most once every few seconds. */
+    static status_t start(nsecs_t sampleInterval, nsecs_t threshold, bool nativeBacktraces);
+    static void stop();
+
+    /* Writes the watched threads and the recorded stalls, oldest first, to the fd. */
+    static void dump(int fd);
+};
+
+} // namespace android
+
+#endif // _ANDROIDFW_STALL_DETECTOR_H
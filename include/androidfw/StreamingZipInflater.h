@@ -22,6 +22,7 @@
 #include <zlib.h>
 
 #include <utils/Compat.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -29,6 +30,7 @@ class StreamingZipInflater {
 public:
     static const size_t INPUT_CHUNK_SIZE = 64 * 1024;
     static const size_t OUTPUT_CHUNK_SIZE = 64 * 1024;
+    static const size_t CHECKPOINT_INTERVAL = 1024 * 1024;
 
     // Flavor that pages in the compressed data from a fd
     StreamingZipInflater(int fd, off64_t compDataStart, size_t uncompSize, size_t compSize);
@@ -43,13 +45,27 @@ public:
     ssize_t read(void* outBuf, size_t count);
 
     // seeking backwards requires uncompressing fom the beginning, so is very
-    // expensive.  seeking forwards only requires uncompressing from the current
-    // position to the destination.
+    // expensive unless checkpoints are enabled, in which case it resumes from the
+    // nearest checkpoint at or before the destination.  seeking forwards only
+    // requires uncompressing from the current position to the destination.
     off64_t seekAbsolute(off64_t absoluteInputPosition);
 
+    // Save the decoder state every 'interval' bytes of uncompressed output the
+    // first time that output is decoded.  Each checkpoint holds a copy of the
+    // zlib state including its 32KB window.  0 (the default) disables them.
+    void setCheckpointInterval(size_t interval);
+
 private:
+    struct Checkpoint {
+        off64_t outPosition;    // uncompressed offset of the next decoded byte
+        size_t inOffset;        // offset into the compressed data of the next input byte
+        z_stream state;
+    };
+
     void initInflateState();
     int readNextChunk();
+    void addCheckpoint();
+    bool restoreCheckpoint(const Checkpoint& checkpoint);
 
     // where to find the uncompressed data
     int mFd;
@@ -77,6 +93,10 @@ private:
     // input state bookkeeping
     size_t mInNextChunkOffset;  // offset from start of blob at which the next input chunk lies
     // the z_stream contains state about input block consumption
+
+    // seek checkpoints, in increasing order of outPosition
+    size_t mCheckpointInterval;
+    Vector<Checkpoint> mCheckpoints;
 };
 
 }
@@ -66,6 +66,12 @@ public:
             const sp<IObbActionListener>& token, const int32_t nonce) = 0;
     virtual bool isObbMounted(const String16& filename) = 0;
     virtual bool getMountedObbPath(const String16& filename, String16& path) = 0;
+    /*
+     * Abandons a pending mountObb() or unmountObb() started with the given
+     * listener and nonce. Stages already finished are undone, and the
+     * listener's onObbResult() reports the cancellation.
+     */
+    virtual void cancelObbAction(const sp<IObbActionListener>& token, const int32_t nonce) = 0;
     virtual int32_t decryptStorage(const String16& password) = 0;
     virtual int32_t encryptStorage(const String16& password) = 0;
 };
@@ -29,7 +29,23 @@ class IObbActionListener: public IInterface
 public:
     DECLARE_META_INTERFACE(ObbActionListener);
 
+    /* Stages reported by onObbProgress() while an OBB is being mounted. */
+    enum {
+        STAGE_VERIFY = 1,       // reading and checking the OBB footer
+        STAGE_CRYPT_SETUP = 2,  // deriving the key and setting up dm-crypt
+        STAGE_FSCK = 3,         // checking the filesystem
+        STAGE_MOUNT = 4,        // mounting it
+    };
+
     virtual void onObbResult(const String16& filename, const int32_t nonce, const int32_t state) = 0;
+
+    /*
+     * Called as the mount of filename moves through its stages, before the
+     * final onObbResult(). progress is in percent within the stage, or -1
+     * if unknown. Listeners not interested in progress ignore it.
+     */
+    virtual void onObbProgress(const String16& filename, const int32_t nonce,
+            const int32_t stage, const int32_t progress) { }
 };
 
 // ----------------------------------------------------------------------------
@@ -36,6 +36,7 @@ commonUiSources:= \
     Keyboard.cpp \
     KeyCharacterMap.cpp \
     KeyLayoutMap.cpp \
+    LatencyHistogram.cpp \
     VelocityControl.cpp \
     VelocityTracker.cpp \
     VirtualKeyMap.cpp
@@ -71,7 +72,8 @@ LOCAL_SRC_FILES:= \
 	BackupData.cpp \
 	BackupHelpers.cpp \
     CursorWindow.cpp \
-	InputTransport.cpp
+	InputTransport.cpp \
+	StallDetector.cpp
 
 LOCAL_SHARED_LIBRARIES := \
 	liblog \
@@ -268,8 +268,33 @@ Asset::~Asset(void)
 }
 #endif
 
+/*
+ * Tell the kernel how a mapped asset is going to be read, so it can size
+ * its readahead accordingly.
+ */
+static void adviseMap(FileMap* dataMap, Asset::AccessMode mode)
+{
+    switch (mode) {
+    case Asset::ACCESS_RANDOM:
+        dataMap->advise(FileMap::RANDOM);
+        break;
+    case Asset::ACCESS_STREAMING:
+        dataMap->advise(FileMap::SEQUENTIAL);
+        break;
+    case Asset::ACCESS_BUFFER:
+        dataMap->advise(FileMap::WILLNEED);
+        break;
+    default:
+        break;
+    }
+}
+
 /*
  * Create a new Asset from a memory mapping.
+ *
+ * The asset reads straight out of the mapping; getBuffer() only copies the
+ * data if the entry is not word aligned in the archive, which never happens
+ * for APKs that have been through zipalign.
  */
 /*static*/ Asset* Asset::createFromUncompressedMap(FileMap* dataMap,
     AccessMode mode)
@@ -283,6 +308,7 @@ Asset::~Asset(void)
         return NULL;
 
     pAsset->mAccessMode = mode;
+    adviseMap(dataMap, mode);
     return pAsset;
 }
 
@@ -301,6 +327,9 @@ Asset::~Asset(void)
         return NULL;
 
     pAsset->mAccessMode = mode;
+    // The inflater walks the compressed bytes front to back whatever the
+    // caller's access pattern, so random access still wants readahead.
+    dataMap->advise(mode == ACCESS_BUFFER ? FileMap::WILLNEED : FileMap::SEQUENTIAL);
     return pAsset;
 }
 
@@ -612,6 +641,7 @@ const void* _FileAsset::getBuffer(bool wordAligned)
 
         ALOGV(" getBuffer: mapped\n");
 
+        adviseMap(map, getAccessMode());
         mMap = map;
         if (!wordAligned) {
             return  mMap->getDataPtr();
@@ -718,6 +748,9 @@ status_t _CompressedAsset::openChunk(int fd, off64_t offset,
 
     if (uncompressedLen > StreamingZipInflater::OUTPUT_CHUNK_SIZE) {
         mZipInflater = new StreamingZipInflater(mFd, offset, uncompressedLen, compressedLen);
+        if (uncompressedLen > 2 * StreamingZipInflater::CHECKPOINT_INTERVAL) {
+            mZipInflater->setCheckpointInterval(StreamingZipInflater::CHECKPOINT_INTERVAL);
+        }
     }
 
     return NO_ERROR;
@@ -748,6 +781,9 @@ status_t _CompressedAsset::openChunk(FileMap* dataMap, int compressionMethod,
 
     if (uncompressedLen > StreamingZipInflater::OUTPUT_CHUNK_SIZE) {
         mZipInflater = new StreamingZipInflater(dataMap, uncompressedLen);
+        if (uncompressedLen > 2 * StreamingZipInflater::CHECKPOINT_INTERVAL) {
+            mZipInflater->setCheckpointInterval(StreamingZipInflater::CHECKPOINT_INTERVAL);
+        }
     }
     return NO_ERROR;
 }
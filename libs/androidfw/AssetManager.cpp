@@ -42,6 +42,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef HAVE_ANDROID_OS
+#include <sys/file.h>
+#endif
+
 #ifndef TEMP_FAILURE_RETRY
 /* Used to retry syscalls that can return EINTR. */
 #define TEMP_FAILURE_RETRY(exp) ({         \
@@ -115,7 +119,8 @@ int32_t AssetManager::getGlobalCount()
 AssetManager::AssetManager(CacheMode cacheMode)
     : mLocale(NULL), mVendor(NULL),
       mResources(NULL), mConfig(new ResTable_config),
-      mCacheMode(cacheMode), mCacheValid(false)
+      mCacheMode(cacheMode), mCacheValid(false),
+      mConcurrentValid(false), mConcurrentUsable(false)
 {
     int count = android_atomic_inc(&gCount)+1;
     //ALOGI("Creating AssetManager %p #%d\n", this, count);
@@ -173,6 +178,7 @@ bool AssetManager::addAssetPath(const String8& path, void** cookie, bool asSkin)
          ap.type == kFileTypeDirectory ? "dir" : "zip", ap.path.string());
 
     mAssetPaths.add(ap);
+    invalidateConcurrentZipsLocked();
 
     // new paths are always added at the end
     if (cookie) {
@@ -194,10 +200,7 @@ bool AssetManager::addAssetPath(const String8& path, void** cookie, bool asSkin)
             bool addOverlay = (oap.type == kFileTypeRegular); // only .apks supported as overlay
             if (addOverlay) {
                 oap.idmap = idmapPathForPackagePath(overlayPath);
-
-                if (isIdmapStaleLocked(ap.path, oap.path, oap.idmap)) {
-                    addOverlay = createIdmapFileLocked(ap.path, oap.path, oap.idmap);
-                }
+                addOverlay = updateIdmapFileLocked(ap.path, oap.path, oap.idmap);
             }
             if (addOverlay) {
                 mAssetPaths.add(oap);
@@ -210,6 +213,40 @@ bool AssetManager::addAssetPath(const String8& path, void** cookie, bool asSkin)
     return true;
 }
 
+/*
+ * Make sure the idmap for the overlay is up to date, regenerating it if
+ * needed.  Every process adding the framework resources gets here, so an
+ * exclusive lock on a companion file makes sure only the first one to see a
+ * stale idmap regenerates it; the others wait and then find it current.
+ */
+bool AssetManager::updateIdmapFileLocked(const String8& originalPath,
+                                         const String8& overlayPath,
+                                         const String8& idmapPath)
+{
+    int lockFd = -1;
+#ifdef HAVE_ANDROID_OS
+    String8 lockPath(idmapPath);
+    lockPath.append(".lock");
+    lockFd = TEMP_FAILURE_RETRY(::open(lockPath.string(), O_RDONLY | O_CREAT, 0644));
+    if (lockFd != -1 && TEMP_FAILURE_RETRY(flock(lockFd, LOCK_EX)) == -1) {
+        ALOGW("failed to lock %s: %s\n", lockPath.string(), strerror(errno));
+        TEMP_FAILURE_RETRY(close(lockFd));
+        lockFd = -1;
+    }
+#endif
+
+    bool result = true;
+    if (isIdmapStaleLocked(originalPath, overlayPath, idmapPath)) {
+        result = createIdmapFileLocked(originalPath, overlayPath, idmapPath);
+    }
+
+    if (lockFd != -1) {
+        // closing the descriptor releases the lock
+        TEMP_FAILURE_RETRY(close(lockFd));
+    }
+    return result;
+}
+
 bool AssetManager::isIdmapStaleLocked(const String8& originalPath, const String8& overlayPath,
                                       const String8& idmapPath)
 {
@@ -295,6 +332,7 @@ bool AssetManager::createIdmapFileLocked(const String8& originalPath, const Stri
     int fd = 0;
     uint32_t* data = NULL;
     size_t size;
+    String8 tmpPath;
 
     for (int i = 0; i < 2; ++i) {
         asset_path ap;
@@ -326,15 +364,20 @@ bool AssetManager::createIdmapFileLocked(const String8& originalPath, const Stri
     // This should be abstracted (eg replaced by a stand-alone
     // application like dexopt, triggered by something equivalent to
     // installd).
-    fd = TEMP_FAILURE_RETRY(::open(idmapPath.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    //
+    // Write to a temporary file and rename it into place, so that other
+    // processes never see a partially written idmap.
+    tmpPath = idmapPath;
+    tmpPath.appendFormat(".%d.tmp", getpid());
+    fd = TEMP_FAILURE_RETRY(::open(tmpPath.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
     if (fd == -1) {
-        ALOGW("failed to write idmap file %s (open: %s)\n", idmapPath.string(), strerror(errno));
+        ALOGW("failed to write idmap file %s (open: %s)\n", tmpPath.string(), strerror(errno));
         goto error_free;
     }
     for (;;) {
-        ssize_t written = TEMP_FAILURE_RETRY(write(fd, data + offset, size));
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd, (const char*)data + offset, size));
         if (written < 0) {
-            ALOGW("failed to write idmap file %s (write: %s)\n", idmapPath.string(),
+            ALOGW("failed to write idmap file %s (write: %s)\n", tmpPath.string(),
                  strerror(errno));
             goto error_close;
         }
@@ -344,10 +387,19 @@ bool AssetManager::createIdmapFileLocked(const String8& originalPath, const Stri
             break;
         }
     }
+    if (TEMP_FAILURE_RETRY(close(fd)) == -1
+            || rename(tmpPath.string(), idmapPath.string()) == -1) {
+        ALOGW("failed to write idmap file %s (rename: %s)\n", idmapPath.string(),
+             strerror(errno));
+        unlink(tmpPath.string());
+        goto error_free;
+    }
 
     retval = true;
+    goto error_free;
 error_close:
     TEMP_FAILURE_RETRY(close(fd));
+    unlink(tmpPath.string());
 error_free:
     free(data);
 error:
@@ -515,6 +567,96 @@ Asset* AssetManager::open(const char* fileName, AccessMode mode)
     return NULL;
 }
 
+void AssetManager::invalidateConcurrentZipsLocked()
+{
+    AutoMutex _l(mConcurrentLock);
+    mConcurrentValid = false;
+}
+
+void AssetManager::updateConcurrentZipsLocked()
+{
+    Vector<ZipFileRO*> zips;
+    Vector<String8> names;
+    bool usable = true;
+
+    size_t i = mAssetPaths.size();
+    while (i > 0) {
+        i--;
+        const asset_path& ap = mAssetPaths.itemAt(i);
+        if (ap.asSkin) {
+            continue;
+        }
+        if (ap.type == kFileTypeDirectory) {
+            usable = false;
+            break;
+        }
+        ZipFileRO* pZip = getZipFileLocked(ap);
+        if (pZip != NULL) {
+            zips.add(pZip);
+            names.add(ZipSet::getPathName(ap.path.string()));
+        }
+    }
+
+    AutoMutex _l(mConcurrentLock);
+    mConcurrentZips = zips;
+    mConcurrentZipNames = names;
+    mConcurrentUsable = usable;
+    mConcurrentValid = true;
+}
+
+Asset* AssetManager::openConcurrent(const char* fileName, AccessMode mode)
+{
+    Vector<ZipFileRO*> zips;
+    Vector<String8> names;
+    bool valid;
+    bool usable;
+
+    {
+        AutoMutex _l(mConcurrentLock);
+        valid = mConcurrentValid;
+        usable = mConcurrentUsable;
+        zips = mConcurrentZips;
+        names = mConcurrentZipNames;
+    }
+
+    if (!valid) {
+        {
+            AutoMutex _l(mLock);
+            LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
+            updateConcurrentZipsLocked();
+        }
+        AutoMutex _l(mConcurrentLock);
+        usable = mConcurrentUsable;
+        zips = mConcurrentZips;
+        names = mConcurrentZipNames;
+    }
+
+    if (!usable) {
+        return open(fileName, mode);
+    }
+
+    String8 assetName(kAssetsRoot);
+    assetName.appendPath(fileName);
+
+    for (size_t i = 0; i < zips.size(); i++) {
+        ZipFileRO* pZip = zips[i];
+        ZipEntryRO entry = pZip->findEntryByName(assetName.string());
+        if (entry == NULL) {
+            continue;
+        }
+        // Neither of these touch state guarded by mLock.
+        Asset* pAsset = openAssetFromZipLocked(pZip, entry, mode, assetName);
+        if (pAsset != NULL) {
+            pAsset->setAssetSource(
+                    createZipSourceNameLocked(names[i], String8(""), assetName));
+            return pAsset;
+        }
+        // Like open(), fall back to the asset in the next path.
+    }
+
+    return NULL;
+}
+
 /*
  * Open a non-asset file as if it were an asset.
  *
@@ -669,10 +811,13 @@ void AssetManager::updateResTableFromAssetPath(ResTable *rt, const asset_path& a
                         mZipSet.setZipResourceTableAsset(ap.path, ass);
                 }
             }
-            if (cookiePos == 0 && ass != NULL) {
+            if (cookiePos == 1 && ass != NULL) {
                 // If this is the first resource table in the asset
                 // manager, then we are going to cache it so that we
-                // can quickly copy it out for others.
+                // can quickly copy it out for others.  The zygote does
+                // this for the framework resources while preloading, so
+                // forked processes inherit the parsed table and only copy
+                // its package groups.
                 ALOGV("Creating shared resources for %s", ap.path.string());
                 sharedRes = new ResTable();
                 sharedRes->add(ass, cookie, false);
@@ -1434,7 +1579,6 @@ bool AssetManager::scanAndMergeZipLocked(SortedVector<AssetDir::FileInfo>* pMerg
     const asset_path& ap, const char* rootDir, const char* baseDirName)
 {
     ZipFileRO* pZip;
-    Vector<String8> dirs;
     AssetDir::FileInfo info;
     SortedVector<AssetDir::FileInfo> contents;
     String8 sourceName, zipName, dirName;
@@ -1452,86 +1596,35 @@ bool AssetManager::scanAndMergeZipLocked(SortedVector<AssetDir::FileInfo>* pMerg
     dirName.appendPath(baseDirName);
 
     /*
-     * Scan through the list of files, looking for a match.  The files in
-     * the Zip table of contents are not in sorted order, so we have to
-     * process the entire list.  We're looking for a string that begins
-     * with the characters in "dirName", is followed by a '/', and has no
-     * subsequent '/' in the stuff that follows.
-     *
-     * What makes this especially fun is that directories are not stored
-     * explicitly in Zip archives, so we have to infer them from context.
-     * When we see "sounds/foo.wav" we have to leave a note to ourselves
-     * to insert a directory called "sounds" into the list.  We store
-     * these in temporary vector so that we only return each one once.
+     * The files in the Zip table of contents are not in sorted order, so
+     * rather than processing the entire list for every directory, look the
+     * directory up in the archive's index of directory contents.  See
+     * SharedZip::buildDirIndexLocked() for how directories, which are not
+     * stored explicitly in Zip archives, are inferred.
      *
      * Name comparisons are case-sensitive to match UNIX filesystem
      * semantics.
      */
-    int dirNameLen = dirName.length();
-    for (int i = 0; i < pZip->getNumEntries(); i++) {
-        ZipEntryRO entry;
-        char nameBuf[256];
-
-        entry = pZip->findEntryByIndex(i);
-        if (pZip->getEntryFileName(entry, nameBuf, sizeof(nameBuf)) != 0) {
-            // TODO: fix this if we expect to have long names
-            ALOGE("ARGH: name too long?\n");
-            continue;
+    const SharedZip::Dir* dir = mZipSet.getZipDir(ap.path, dirName);
+    if (dir != NULL) {
+        for (size_t i = 0; i < dir->files.size(); i++) {
+            info = dir->files[i];
+            info.setSourceName(
+                createZipSourceNameLocked(zipName, dirName, info.getFileName()));
+            contents.add(info);
         }
-        //printf("Comparing %s in %s?\n", nameBuf, dirName.string());
-        if (dirNameLen == 0 ||
-            (strncmp(nameBuf, dirName.string(), dirNameLen) == 0 &&
-             nameBuf[dirNameLen] == '/'))
-        {
-            const char* cp;
-            const char* nextSlash;
-
-            cp = nameBuf + dirNameLen;
-            if (dirNameLen != 0)
-                cp++;       // advance past the '/'
-
-            nextSlash = strchr(cp, '/');
-//xxx this may break if there are bare directory entries
-            if (nextSlash == NULL) {
-                /* this is a file in the requested directory */
-
-                info.set(String8(nameBuf).getPathLeaf(), kFileTypeRegular);
-
-                info.setSourceName(
-                    createZipSourceNameLocked(zipName, dirName, info.getFileName()));
-
-                contents.add(info);
-                //printf("FOUND: file '%s'\n", info.getFileName().string());
-            } else {
-                /* this is a subdir; add it if we don't already have it*/
-                String8 subdirName(cp, nextSlash - cp);
-                size_t j;
-                size_t N = dirs.size();
-
-                for (j = 0; j < N; j++) {
-                    if (subdirName == dirs[j]) {
-                        break;
-                    }
-                }
-                if (j == N) {
-                    dirs.add(subdirName);
-                }
 
-                //printf("FOUND: dir '%s'\n", subdirName.string());
-            }
+        /*
+         * Add the set of unique directories.
+         */
+        for (size_t i = 0; i < dir->dirs.size(); i++) {
+            info = dir->dirs[i];
+            info.setSourceName(
+                createZipSourceNameLocked(zipName, dirName, info.getFileName()));
+            contents.add(info);
         }
     }
 
-    /*
-     * Add the set of unique directories.
-     */
-    for (int i = 0; i < (int) dirs.size(); i++) {
-        info.set(dirs[i], kFileTypeDirectory);
-        info.setSourceName(
-            createZipSourceNameLocked(zipName, dirName, info.getFileName()));
-        contents.add(info);
-    }
-
     mergeInfoLocked(pMergedInfo, &contents);
 
     return true;
@@ -1792,7 +1885,7 @@ DefaultKeyedVector<String8, wp<AssetManager::SharedZip> > AssetManager::SharedZi
 
 AssetManager::SharedZip::SharedZip(const String8& path, time_t modWhen)
     : mPath(path), mZipFile(NULL), mModWhen(modWhen),
-      mResourceTableAsset(NULL), mResourceTable(NULL)
+      mResourceTableAsset(NULL), mResourceTable(NULL), mDirIndexValid(false)
 {
     //ALOGI("Creating SharedZip %p %s\n", this, (const char*)mPath);
     mZipFile = new ZipFileRO;
@@ -1823,6 +1916,71 @@ ZipFileRO* AssetManager::SharedZip::getZip()
     return mZipFile;
 }
 
+const AssetManager::SharedZip::Dir* AssetManager::SharedZip::getDir(const String8& dirName)
+{
+    AutoMutex _l(mDirIndexLock);
+    if (!mDirIndexValid) {
+        buildDirIndexLocked();
+        mDirIndexValid = true;
+    }
+    return mDirIndex.valueFor(dirName);
+}
+
+/*
+ * Record every entry of the archive in each directory that contains it,
+ * either as a file (no further '/') or as the subdirectory that leads to
+ * it.  Directories are not stored explicitly in Zip archives, so they are
+ * inferred from the entry names.  This matches what scanning the whole
+ * central directory for each listing used to produce.
+ */
+void AssetManager::SharedZip::buildDirIndexLocked()
+{
+    if (mZipFile == NULL) {
+        return;
+    }
+
+    AssetDir::FileInfo info;
+    const int N = mZipFile->getNumEntries();
+    for (int i = 0; i < N; i++) {
+        ZipEntryRO entry;
+        char nameBuf[256];
+
+        entry = mZipFile->findEntryByIndex(i);
+        if (mZipFile->getEntryFileName(entry, nameBuf, sizeof(nameBuf)) != 0) {
+            // TODO: fix this if we expect to have long names
+            ALOGE("ARGH: name too long?\n");
+            continue;
+        }
+
+        // Walk the directories containing this entry, starting at the root.
+        const char* dirEnd = nameBuf;
+        const char* cp = nameBuf;
+        while (true) {
+            String8 dirName(nameBuf, dirEnd - nameBuf);
+            ssize_t idx = mDirIndex.indexOfKey(dirName);
+            Dir* dir;
+            if (idx >= 0) {
+                dir = mDirIndex.valueAt(idx);
+            } else {
+                dir = new Dir();
+                mDirIndex.add(dirName, dir);
+            }
+
+            const char* nextSlash = strchr(cp, '/');
+            if (nextSlash == NULL) {
+                info.set(String8(nameBuf).getPathLeaf(), kFileTypeRegular);
+                dir->files.add(info);
+                break;
+            }
+            info.set(String8(cp, nextSlash - cp), kFileTypeDirectory);
+            dir->dirs.add(info);
+
+            dirEnd = nextSlash;
+            cp = nextSlash + 1;
+        }
+    }
+}
+
 Asset* AssetManager::SharedZip::getResourceTableAsset()
 {
     ALOGV("Getting from SharedZip %p resource asset %p\n", this, mResourceTableAsset);
@@ -1883,6 +2041,9 @@ AssetManager::SharedZip::~SharedZip()
         delete mZipFile;
         ALOGV("Closed '%s'\n", mPath.string());
     }
+    for (size_t i = 0; i < mDirIndex.size(); i++) {
+        delete mDirIndex.valueAt(i);
+    }
 }
 
 /*
@@ -1931,6 +2092,18 @@ ZipFileRO* AssetManager::ZipSet::getZip(const String8& path)
     return zip->getZip();
 }
 
+const AssetManager::SharedZip::Dir* AssetManager::ZipSet::getZipDir(const String8& path,
+        const String8& dirName)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    if (zip == NULL) {
+        zip = SharedZip::get(path);
+        mZipFile.editItemAt(idx) = zip;
+    }
+    return zip->getDir(dirName);
+}
+
 Asset* AssetManager::ZipSet::getZipResourceTableAsset(const String8& path)
 {
     int idx = getIndex(path);
@@ -2037,6 +2210,7 @@ bool AssetManager::detachThemePath(const String8 &packageName, void* cookie)
 
     /* TODO: Ensure that this cookie is added with asSkin == true. */
     mAssetPaths.removeAt(which);
+    invalidateConcurrentZipsLocked();
 
     ResTable* rt = mResources;
     if (rt == NULL) {
@@ -19,8 +19,10 @@
 #include <androidfw/BackupHelpers.h>
 #include <utils/ByteOrder.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <cutils/log.h>
@@ -68,23 +70,40 @@ BackupDataWriter::~BackupDataWriter()
 {
 }
 
-// Pad out anything they've previously written to the next 4 byte boundary.
+// Write out all of the given buffers, normally in a single writev.  After a
+// short write, the rest goes out piece by piece.
 status_t
-BackupDataWriter::write_padding_for(int n)
+BackupDataWriter::write_fully(const struct iovec* iov, int iovcnt)
 {
     ssize_t amt;
-    ssize_t paddingSize;
-
-    paddingSize = padding_extra(n);
-    if (paddingSize > 0) {
-        uint32_t padding = 0xbcbcbcbc;
-        if (DEBUG) ALOGI("writing %d padding bytes for %d", paddingSize, n);
-        amt = write(m_fd, &padding, paddingSize);
-        if (amt != paddingSize) {
-            m_status = errno;
-            return m_status;
+    do {
+        amt = writev(m_fd, iov, iovcnt);
+    } while (amt < 0 && errno == EINTR);
+
+    for (int i = 0; i < iovcnt; i++) {
+        const char* base = (const char*)iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+        if (amt > 0) {
+            size_t consumed = (size_t)amt < len ? amt : len;
+            m_pos += consumed;
+            amt -= consumed;
+            base += consumed;
+            len -= consumed;
+        }
+        while (len > 0) {
+            ssize_t n = write(m_fd, base, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                m_status = errno;
+                if (DEBUG) ALOGD("write returned error %d (%s)", m_status, strerror(m_status));
+                return m_status;
+            }
+            m_pos += n;
+            base += n;
+            len -= n;
         }
-        m_pos += amt;
     }
     return NO_ERROR;
 }
@@ -96,13 +115,6 @@ BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
         return m_status;
     }
 
-    ssize_t amt;
-
-    amt = write_padding_for(m_pos);
-    if (amt != 0) {
-        return amt;
-    }
-
     String8 k;
     if (m_keyPrefix.length() > 0) {
         k = m_keyPrefix;
@@ -125,27 +137,39 @@ BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
     header.keyLen = tolel(keyLen);
     header.dataSize = tolel(dataSize);
 
-    if (DEBUG) ALOGI("writing entity header, %d bytes", sizeof(entity_header_v1));
-    amt = write(m_fd, &header, sizeof(entity_header_v1));
-    if (amt != sizeof(entity_header_v1)) {
-        m_status = errno;
-        return m_status;
+    // Padding for the previous entity's data, the header, the key and the
+    // key's padding all go out in a single write.
+    uint32_t padding = 0xbcbcbcbc;
+    struct iovec iov[4];
+    int iovcnt = 0;
+    size_t leadingPadding = padding_extra(m_pos);
+    if (leadingPadding > 0) {
+        iov[iovcnt].iov_base = &padding;
+        iov[iovcnt].iov_len = leadingPadding;
+        iovcnt++;
     }
-    m_pos += amt;
-
-    if (DEBUG) ALOGI("writing entity header key, %d bytes", keyLen+1);
-    amt = write(m_fd, k.string(), keyLen+1);
-    if (amt != keyLen+1) {
-        m_status = errno;
-        return m_status;
+    iov[iovcnt].iov_base = &header;
+    iov[iovcnt].iov_len = sizeof(entity_header_v1);
+    iovcnt++;
+    iov[iovcnt].iov_base = const_cast<char*>(k.string());
+    iov[iovcnt].iov_len = keyLen+1;
+    iovcnt++;
+    size_t keyPadding = padding_extra(keyLen+1);
+    if (keyPadding > 0) {
+        iov[iovcnt].iov_base = &padding;
+        iov[iovcnt].iov_len = keyPadding;
+        iovcnt++;
     }
-    m_pos += amt;
 
-    amt = write_padding_for(keyLen+1);
+    if (DEBUG) ALOGI("writing entity header and key, %d bytes", keyLen+1);
+    status_t err = write_fully(iov, iovcnt);
+    if (err != NO_ERROR) {
+        return err;
+    }
 
     m_entityCount++;
 
-    return amt;
+    return NO_ERROR;
 }
 
 status_t
@@ -163,14 +187,20 @@ BackupDataWriter::WriteEntityData(const void* data, size_t size)
     // We don't write padding here, because they're allowed to call this several
     // times with smaller buffers.  We write it at the end of WriteEntityHeader
     // instead.
-    ssize_t amt = write(m_fd, data, size);
-    if (amt != (ssize_t)size) {
-        m_status = errno;
-        if (DEBUG) ALOGD("write returned error %d (%s)", m_status, strerror(m_status));
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return write_fully(&iov, 1);
+}
+
+status_t
+BackupDataWriter::WriteEntityData(const struct iovec* iov, int iovcnt)
+{
+    if (m_status != NO_ERROR) {
         return m_status;
     }
-    m_pos += amt;
-    return NO_ERROR;
+
+    return write_fully(iov, iovcnt);
 }
 
 void
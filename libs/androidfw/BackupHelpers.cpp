@@ -23,6 +23,7 @@
 #include <utils/String8.h>
 
 #include <errno.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
@@ -315,9 +316,23 @@ compute_crc32(int fd)
     const int bufsize = 4*1024;
     int amt;
 
-    char* buf = (char*)malloc(bufsize);
     int crc = crc32(0L, Z_NULL, 0);
 
+    // Hash straight out of the page cache when the file can be mapped, which
+    // saves copying every block through a bounce buffer.
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            crc = crc32(crc, (const Bytef*)data, st.st_size);
+            munmap(data, st.st_size);
+            return crc;
+        }
+    }
+
+    char* buf = (char*)malloc(bufsize);
+
     lseek(fd, 0, SEEK_SET);
 
     while ((amt = read(fd, buf, bufsize)) != 0) {
@@ -336,11 +351,21 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
     KeyedVector<String8,FileState> oldSnapshot;
     KeyedVector<String8,FileRec> newSnapshot;
 
+    // Files last modified strictly before the old snapshot was written, and
+    // whose metadata still matches it, cannot have changed since; their
+    // contents need not be read again.  Anything newer could have been
+    // rewritten within the same second, so it still gets its crc checked.
+    time_t oldSnapshotTime = 0;
     if (oldSnapshotFD != -1) {
         err = read_snapshot_file(oldSnapshotFD, &oldSnapshot);
         if (err != 0) {
             // On an error, treat this as a full backup.
             oldSnapshot.clear();
+        } else {
+            struct stat st;
+            if (fstat(oldSnapshotFD, &st) == 0) {
+                oldSnapshotTime = st.st_mtime;
+            }
         }
     }
 
@@ -397,6 +422,16 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
             // both files exist, check them
             const FileState& f = oldSnapshot.valueAt(n);
 
+            if (f.modTime_sec == g.s.modTime_sec && f.modTime_nsec == g.s.modTime_nsec
+                    && f.mode == g.s.mode && f.size == g.s.size
+                    && f.modTime_sec < oldSnapshotTime) {
+                LOGP("unchanged: %s", q.string());
+                g.s.crc32 = f.crc32;
+                n++;
+                m++;
+                continue;
+            }
+
             int fd = open(g.file.string(), O_RDONLY);
             if (fd < 0) {
                 // We can't open the file.  Don't report it as a delete either.  Let the
@@ -481,12 +516,123 @@ static int write_pax_header_entry(char* buf, const char* key, const char* value)
     return sprintf(buf, "%d %s=%s\n", len, key, value);
 }
 
+#ifndef SEEK_DATA
+// Linux values; kernels or file systems without support fail these with EINVAL
+#define SEEK_DATA 3
+#define SEEK_HOLE 4
+#endif
+
+// Size of the buffer used to stream file contents into the tar stream.
+static const size_t TAR_DATA_BUFSIZE = 256 * 1024;
+
+// Returns the start of the next data region at or after offset, or size if only
+// a hole remains.  When the file system does not report holes, the whole file
+// is treated as data.
+static off64_t find_data_start(int fd, off64_t offset, off64_t size) {
+    off64_t data = lseek64(fd, offset, SEEK_DATA);
+    if (data < 0) {
+        return (errno == ENXIO) ? size : offset;
+    }
+    // Read whole tar blocks so that every chunk but the last stays 512-aligned
+    data &= ~((off64_t) 511);
+    return (data < size) ? data : size;
+}
+
+// Returns the end of the data region that starts at offset.
+static off64_t find_data_end(int fd, off64_t offset, off64_t size) {
+    off64_t hole = lseek64(fd, offset, SEEK_HOLE);
+    if (hole <= offset || hole >= size) {
+        return size;
+    }
+    hole = (hole + 511) & ~((off64_t) 511);
+    return (hole < size) ? hole : size;
+}
+
+#ifdef POSIX_FADV_DONTNEED
+// Returns whether none of [offset, offset + length) of the file is in the page
+// cache.  The pages a read of such a range brings in can be dropped again
+// without evicting anything the app itself was using.
+static bool is_range_uncached(int fd, off64_t offset, size_t length) {
+    const off64_t pageSize = sysconf(_SC_PAGESIZE);
+    off64_t start = offset & ~(pageSize - 1);
+    size_t span = (size_t) (offset - start) + length;
+    if (length == 0 || start != (off_t) start) {
+        return false;
+    }
+    void* addr = mmap(NULL, span, PROT_READ, MAP_SHARED, fd, (off_t) start);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    size_t pages = (span + pageSize - 1) / pageSize;
+    unsigned char* resident = new unsigned char[pages];
+    bool uncached = mincore(addr, span, resident) == 0;
+    for (size_t i = 0; uncached && i < pages; i++) {
+        uncached = !(resident[i] & 1);
+    }
+    delete[] resident;
+    munmap(addr, span);
+    return uncached;
+}
+#endif
+
+// Sends the contents of [offset, end) of the file as tar data.  Holes are
+// not read from disk; their zeros are generated directly.
+static int send_tarfile_range(BackupDataWriter* writer, int fd, char* buf, size_t bufSize,
+        off64_t offset, off64_t end, bool isHole, const String8& filepath) {
+    if (isHole) {
+        memset(buf, 0, bufSize);
+    }
+    while (offset < end) {
+        size_t toRead = (end - offset < (off64_t) bufSize) ? (size_t) (end - offset) : bufSize;
+        ssize_t nRead = toRead;
+        if (!isHole) {
+#ifdef POSIX_FADV_DONTNEED
+            bool uncached = is_range_uncached(fd, offset, toRead);
+#endif
+            nRead = pread64(fd, buf, toRead, offset);
+            if (nRead < 0) {
+                if (errno == EINTR) continue;
+                int err = errno;
+                ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
+                        err, strerror(err));
+                return err;
+            } else if (nRead == 0) {
+                ALOGE("EOF but expect %lld more bytes in [%s]", (long long) (end - offset),
+                        filepath.string());
+                return EIO;
+            }
+#ifdef POSIX_FADV_DONTNEED
+            // The data is not needed again.  Only drop what this read brought in, so
+            // pages the app had cached, e.g. of a live database, stay resident.
+            if (uncached) {
+                posix_fadvise(fd, offset, nRead, POSIX_FADV_DONTNEED);
+            }
+#endif
+        }
+        offset += nRead;
+
+        // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.
+        ssize_t partial = nRead % 512;
+        if (partial > 0) {
+            ssize_t remainder = 512 - partial;
+            memset(buf + nRead, 0, remainder);
+            nRead += remainder;
+        }
+        send_tarfile_chunk(writer, buf, nRead);
+    }
+    return 0;
+}
+
 // Wire format to the backup manager service is chunked:  each chunk is prefixed by
 // a 4-byte count of its size.  A chunk size of zero (four zero bytes) indicates EOD.
 void send_tarfile_chunk(BackupDataWriter* writer, const char* buffer, size_t size) {
     uint32_t chunk_size_no = htonl(size);
-    writer->WriteEntityData(&chunk_size_no, 4);
-    if (size != 0) writer->WriteEntityData(buffer, size);
+    struct iovec iov[2];
+    iov[0].iov_base = &chunk_size_no;
+    iov[0].iov_len = 4;
+    iov[1].iov_base = const_cast<char*>(buffer);
+    iov[1].iov_len = size;
+    writer->WriteEntityData(iov, size != 0 ? 2 : 1);
 }
 
 int write_tarfile(const String8& packageName, const String8& domain,
@@ -535,7 +681,6 @@ int write_tarfile(const String8& packageName, const String8& domain,
     const int isdir = S_ISDIR(s.st_mode);
     if (isdir) s.st_size = 0;   // directories get no actual data in the tar stream
 
-    // !!! TODO: use mmap when possible to avoid churning the buffer cache
     // !!! TODO: this will break with symlinks; need to use readlink(2)
     int fd = open(filepath.string(), O_RDONLY);
     if (fd < 0) {
@@ -678,39 +823,45 @@ int write_tarfile(const String8& packageName, const String8& domain,
 
     // Now write the file data itself, for real files.  We honor tar's convention that
     // only full 512-byte blocks are sent to write().
-    if (!isdir) {
-        off64_t toWrite = s.st_size;
-        while (toWrite > 0) {
-            size_t toRead = (toWrite < BUFSIZE) ? toWrite : BUFSIZE;
-            ssize_t nRead = read(fd, buf, toRead);
-            if (nRead < 0) {
-                err = errno;
-                ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
-                        err, strerror(err));
-                break;
-            } else if (nRead == 0) {
-                ALOGE("EOF but expect %lld more bytes in [%s]", (long long) toWrite,
-                        filepath.string());
-                err = EIO;
-                break;
-            }
+    if (!isdir && s.st_size > 0) {
+        // Small files only need a buffer their own (block-rounded) size
+        size_t dataBufSize = TAR_DATA_BUFSIZE;
+        if (s.st_size < (off64_t) dataBufSize) {
+            dataBufSize = (s.st_size + 511) & ~511;
+        }
+        char* dataBuf = (char*) malloc(dataBufSize);
+        if (dataBuf == NULL) {
+            ALOGE("Out of mem allocating transfer buffer");
+            err = ENOMEM;
+            goto cleanup;
+        }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
-            // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.  This
-            // depends on the OS guarantee that for ordinary files, read() will never return
-            // less than the number of bytes requested.
-            ssize_t partial = (nRead+512) % 512;
-            if (partial > 0) {
-                ssize_t remainder = 512 - partial;
-                memset(buf + nRead, 0, remainder);
-                nRead += remainder;
+        // Walk the file as alternating hole and data regions.  The tar stream has
+        // no sparse encoding, so holes are still sent as zeros, but never read.
+        off64_t pos = 0;
+        while (pos < s.st_size && err == 0) {
+            off64_t dataStart = find_data_start(fd, pos, s.st_size);
+            if (dataStart > pos) {
+                err = send_tarfile_range(writer, fd, dataBuf, dataBufSize, pos, dataStart,
+                        true, filepath);
+                pos = dataStart;
+            }
+            if (pos < s.st_size && err == 0) {
+                off64_t dataEnd = find_data_end(fd, pos, s.st_size);
+                err = send_tarfile_range(writer, fd, dataBuf, dataBufSize, pos, dataEnd,
+                        false, filepath);
+                pos = dataEnd;
             }
-            send_tarfile_chunk(writer, buf, nRead);
-            toWrite -= nRead;
         }
+        free(dataBuf);
     }
 
 cleanup:
-    delete [] buf;
+    free(buf);
 done:
     close(fd);
     return err;
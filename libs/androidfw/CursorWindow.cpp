@@ -30,35 +30,45 @@
 namespace android {
 
 CursorWindow::CursorWindow(const String8& name, int ashmemFd,
-        void* data, size_t size, bool readOnly) :
-        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mReadOnly(readOnly) {
+        void* data, size_t size, size_t maxSize, bool readOnly) :
+        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mMaxSize(maxSize),
+        mReadOnly(readOnly) {
     mHeader = static_cast<Header*>(mData);
 }
 
 CursorWindow::~CursorWindow() {
-    ::munmap(mData, mSize);
+    ::munmap(mData, mMaxSize);
     ::close(mAshmemFd);
 }
 
 status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** outCursorWindow) {
+    return create(name, size, size, outCursorWindow);
+}
+
+status_t CursorWindow::create(const String8& name, size_t size, size_t maxSize,
+        CursorWindow** outCursorWindow) {
     String8 ashmemName("CursorWindow: ");
     ashmemName.append(name);
 
+    if (maxSize < size) {
+        maxSize = size;
+    }
+
     status_t result;
-    int ashmemFd = ashmem_create_region(ashmemName.string(), size);
+    int ashmemFd = ashmem_create_region(ashmemName.string(), maxSize);
     if (ashmemFd < 0) {
         result = -errno;
     } else {
         result = ashmem_set_prot_region(ashmemFd, PROT_READ | PROT_WRITE);
         if (result >= 0) {
-            void* data = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ashmemFd, 0);
+            void* data = ::mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, ashmemFd, 0);
             if (data == MAP_FAILED) {
                 result = -errno;
             } else {
                 result = ashmem_set_prot_region(ashmemFd, PROT_READ);
                 if (result >= 0) {
                     CursorWindow* window = new CursorWindow(name, ashmemFd,
-                            data, size, false /*readOnly*/);
+                            data, size, maxSize, false /*readOnly*/);
                     result = window->clear();
                     if (!result) {
                         LOG_WINDOW("Created new CursorWindow: freeOffset=%d, "
@@ -73,7 +83,7 @@ status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** o
                     delete window;
                 }
             }
-            ::munmap(data, size);
+            ::munmap(data, maxSize);
         }
         ::close(ashmemFd);
     }
@@ -102,7 +112,7 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
                     result = -errno;
                 } else {
                     CursorWindow* window = new CursorWindow(name, dupAshmemFd,
-                            data, size, true /*readOnly*/);
+                            data, size, size, true /*readOnly*/);
                     LOG_WINDOW("Created CursorWindow from parcel: freeOffset=%d, "
                             "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
                             window->mHeader->freeOffset,
@@ -133,13 +143,16 @@ status_t CursorWindow::clear() {
         return INVALID_OPERATION;
     }
 
-    mHeader->freeOffset = sizeof(Header) + sizeof(RowSlotChunk);
-    mHeader->firstChunkOffset = sizeof(Header);
+    size_t chunkDirSize = INITIAL_CHUNK_DIR_CAPACITY * sizeof(uint32_t);
+    mHeader->freeOffset = sizeof(Header) + chunkDirSize + sizeof(RowSlotChunk);
+    mHeader->chunkDirOffset = sizeof(Header);
+    mHeader->chunkDirCapacity = INITIAL_CHUNK_DIR_CAPACITY;
+    mHeader->numChunks = 1;
     mHeader->numRows = 0;
     mHeader->numColumns = 0;
 
-    RowSlotChunk* firstChunk = static_cast<RowSlotChunk*>(offsetToPtr(mHeader->firstChunkOffset));
-    firstChunk->nextChunkOffset = 0;
+    uint32_t* chunkDir = static_cast<uint32_t*>(offsetToPtr(mHeader->chunkDirOffset));
+    chunkDir[0] = sizeof(Header) + chunkDirSize;
     return OK;
 }
 
@@ -158,6 +171,11 @@ status_t CursorWindow::setNumColumns(uint32_t numColumns) {
 }
 
 status_t CursorWindow::allocRow() {
+    FieldSlot* fieldDir;
+    return allocRow(&fieldDir);
+}
+
+status_t CursorWindow::allocRow(FieldSlot** outFieldDir) {
     if (mReadOnly) {
         return INVALID_OPERATION;
     }
@@ -183,6 +201,7 @@ status_t CursorWindow::allocRow() {
     LOG_WINDOW("Allocated row %u, rowSlot is at offset %u, fieldDir is %d bytes at offset %u\n",
             mHeader->numRows - 1, offsetFromPtr(rowSlot), fieldDirSize, fieldDirOffset);
     rowSlot->offset = fieldDirOffset;
+    *outFieldDir = fieldDir;
     return OK;
 }
 
@@ -208,6 +227,16 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
 
     uint32_t offset = mHeader->freeOffset + padding;
     uint32_t nextFreeOffset = offset + size;
+    if (nextFreeOffset > mSize && nextFreeOffset <= mMaxSize) {
+        // Grow in place.  The region is already mapped, so this only moves
+        // the limit; pages are committed as they are written.
+        size_t newSize = mSize * 2;
+        if (newSize < nextFreeOffset) {
+            newSize = nextFreeOffset;
+        }
+        mSize = newSize < mMaxSize ? newSize : mMaxSize;
+        LOG_WINDOW("Grew window to %d bytes", mSize);
+    }
     if (nextFreeOffset > mSize) {
         ALOGW("Window is full: requested allocation %d bytes, "
                 "free space %d bytes, window size %d bytes",
@@ -220,37 +249,46 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
 }
 
 CursorWindow::RowSlot* CursorWindow::getRowSlot(uint32_t row) {
-    uint32_t chunkPos = row;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos >= ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
+    uint32_t chunkIndex = row / ROW_SLOT_CHUNK_NUM_ROWS;
+    if (chunkIndex >= mHeader->numChunks) {
+        return NULL;
     }
-    return &chunk->slots[chunkPos];
+    const uint32_t* chunkDir = static_cast<const uint32_t*>(
+            offsetToPtr(mHeader->chunkDirOffset));
+    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunkDir[chunkIndex]));
+    return &chunk->slots[row % ROW_SLOT_CHUNK_NUM_ROWS];
 }
 
 CursorWindow::RowSlot* CursorWindow::allocRowSlot() {
-    uint32_t chunkPos = mHeader->numRows;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos > ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
-    }
-    if (chunkPos == ROW_SLOT_CHUNK_NUM_ROWS) {
-        if (!chunk->nextChunkOffset) {
-            chunk->nextChunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
-            if (!chunk->nextChunkOffset) {
+    uint32_t row = mHeader->numRows;
+    uint32_t chunkIndex = row / ROW_SLOT_CHUNK_NUM_ROWS;
+
+    // Chunks left behind by freeLastRow() are reused, so a new chunk is only
+    // needed when the row lands past the last one.
+    if (chunkIndex >= mHeader->numChunks) {
+        if (mHeader->numChunks == mHeader->chunkDirCapacity) {
+            uint32_t newCapacity = mHeader->chunkDirCapacity * 2;
+            uint32_t newDirOffset = alloc(newCapacity * sizeof(uint32_t), true /*aligned*/);
+            if (!newDirOffset) {
                 return NULL;
             }
+            memcpy(offsetToPtr(newDirOffset), offsetToPtr(mHeader->chunkDirOffset),
+                    mHeader->numChunks * sizeof(uint32_t));
+            mHeader->chunkDirOffset = newDirOffset;
+            mHeader->chunkDirCapacity = newCapacity;
+        }
+
+        uint32_t chunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
+        if (!chunkOffset) {
+            return NULL;
         }
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunk->nextChunkOffset = 0;
-        chunkPos = 0;
+        uint32_t* chunkDir = static_cast<uint32_t*>(offsetToPtr(mHeader->chunkDirOffset));
+        chunkDir[mHeader->numChunks++] = chunkOffset;
     }
+
+    RowSlot* rowSlot = getRowSlot(row);
     mHeader->numRows += 1;
-    return &chunk->slots[chunkPos];
+    return rowSlot;
 }
 
 CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t column) {
@@ -270,16 +308,19 @@ CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t colum
 }
 
 status_t CursorWindow::putBlob(uint32_t row, uint32_t column, const void* value, size_t size) {
-    return putBlobOrString(row, column, value, size, FIELD_TYPE_BLOB);
+    if (mReadOnly) {
+        return INVALID_OPERATION;
+    }
+
+    FieldSlot* fieldSlot = getFieldSlot(row, column);
+    if (!fieldSlot) {
+        return BAD_VALUE;
+    }
+    return putBlobOrString(fieldSlot, value, size, FIELD_TYPE_BLOB);
 }
 
 status_t CursorWindow::putString(uint32_t row, uint32_t column, const char* value,
         size_t sizeIncludingNull) {
-    return putBlobOrString(row, column, value, sizeIncludingNull, FIELD_TYPE_STRING);
-}
-
-status_t CursorWindow::putBlobOrString(uint32_t row, uint32_t column,
-        const void* value, size_t size, int32_t type) {
     if (mReadOnly) {
         return INVALID_OPERATION;
     }
@@ -288,7 +329,20 @@ status_t CursorWindow::putBlobOrString(uint32_t row, uint32_t column,
     if (!fieldSlot) {
         return BAD_VALUE;
     }
+    return putBlobOrString(fieldSlot, value, sizeIncludingNull, FIELD_TYPE_STRING);
+}
+
+status_t CursorWindow::putBlob(FieldSlot* fieldSlot, const void* value, size_t size) {
+    return putBlobOrString(fieldSlot, value, size, FIELD_TYPE_BLOB);
+}
 
+status_t CursorWindow::putString(FieldSlot* fieldSlot, const char* value,
+        size_t sizeIncludingNull) {
+    return putBlobOrString(fieldSlot, value, sizeIncludingNull, FIELD_TYPE_STRING);
+}
+
+status_t CursorWindow::putBlobOrString(FieldSlot* fieldSlot,
+        const void* value, size_t size, int32_t type) {
     uint32_t offset = alloc(size);
     if (!offset) {
         return NO_MEMORY;
@@ -312,8 +366,7 @@ status_t CursorWindow::putLong(uint32_t row, uint32_t column, int64_t value) {
         return BAD_VALUE;
     }
 
-    fieldSlot->type = FIELD_TYPE_INTEGER;
-    fieldSlot->data.l = value;
+    putLong(fieldSlot, value);
     return OK;
 }
 
@@ -327,8 +380,7 @@ status_t CursorWindow::putDouble(uint32_t row, uint32_t column, double value) {
         return BAD_VALUE;
     }
 
-    fieldSlot->type = FIELD_TYPE_FLOAT;
-    fieldSlot->data.d = value;
+    putDouble(fieldSlot, value);
     return OK;
 }
 
@@ -342,9 +394,7 @@ status_t CursorWindow::putNull(uint32_t row, uint32_t column) {
         return BAD_VALUE;
     }
 
-    fieldSlot->type = FIELD_TYPE_NULL;
-    fieldSlot->data.buffer.offset = 0;
-    fieldSlot->data.buffer.size = 0;
+    putNull(fieldSlot);
     return OK;
 }
 
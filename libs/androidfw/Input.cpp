@@ -310,7 +310,7 @@ void MotionEvent::initialize(
     mPointerProperties.clear();
     mPointerProperties.appendArray(pointerProperties, pointerCount);
     mSampleEventTimes.clear();
-    mSamplePointerCoords.clear();
+    clearSamplePointerCoords();
     addSample(eventTime, pointerCoords);
 }
 
@@ -330,15 +330,18 @@ void MotionEvent::copyFrom(const MotionEvent* other, bool keepHistory) {
 
     if (keepHistory) {
         mSampleEventTimes = other->mSampleEventTimes;
-        mSamplePointerCoords = other->mSamplePointerCoords;
+        mSampleAxisBits = other->mSampleAxisBits;
+        mSampleAxisValueOffsets = other->mSampleAxisValueOffsets;
+        mSampleAxisValues = other->mSampleAxisValues;
     } else {
         mSampleEventTimes.clear();
         mSampleEventTimes.push(other->getEventTime());
-        mSamplePointerCoords.clear();
+        clearSamplePointerCoords();
         size_t pointerCount = other->getPointerCount();
         size_t historySize = other->getHistorySize();
-        mSamplePointerCoords.appendArray(other->mSamplePointerCoords.array()
-                + (historySize * pointerCount), pointerCount);
+        for (size_t i = 0; i < pointerCount; i++) {
+            appendSamplePointerCoords(other, historySize * pointerCount + i);
+        }
     }
 }
 
@@ -346,19 +349,84 @@ void MotionEvent::addSample(
         int64_t eventTime,
         const PointerCoords* pointerCoords) {
     mSampleEventTimes.push(eventTime);
-    mSamplePointerCoords.appendArray(pointerCoords, getPointerCount());
+    size_t pointerCount = getPointerCount();
+    for (size_t i = 0; i < pointerCount; i++) {
+        appendSamplePointerCoords(pointerCoords[i]);
+    }
+}
+
+void MotionEvent::clearSamplePointerCoords() {
+    mSampleAxisBits.clear();
+    mSampleAxisValueOffsets.clear();
+    mSampleAxisValues.clear();
+}
+
+void MotionEvent::appendSamplePointerCoords(const PointerCoords& pointerCoords) {
+    mSampleAxisBits.push(pointerCoords.bits);
+    mSampleAxisValueOffsets.push(mSampleAxisValues.size());
+    uint32_t count = __builtin_popcountll(pointerCoords.bits);
+    if (count) {
+        mSampleAxisValues.appendArray(pointerCoords.values, count);
+    }
+}
+
+void MotionEvent::appendSamplePointerCoords(const MotionEvent* other, size_t index) {
+    uint64_t bits = other->mSampleAxisBits.itemAt(index);
+    mSampleAxisBits.push(bits);
+    mSampleAxisValueOffsets.push(mSampleAxisValues.size());
+    uint32_t count = __builtin_popcountll(bits);
+    if (count) {
+        mSampleAxisValues.appendArray(other->mSampleAxisValues.array()
+                + other->mSampleAxisValueOffsets.itemAt(index), count);
+    }
 }
 
-const PointerCoords* MotionEvent::getRawPointerCoords(size_t pointerIndex) const {
-    return &mSamplePointerCoords[getHistorySize() * getPointerCount() + pointerIndex];
+void MotionEvent::getSamplePointerCoords(size_t index, PointerCoords* outPointerCoords) const {
+    uint64_t bits = mSampleAxisBits.itemAt(index);
+    const float* values = mSampleAxisValues.array() + mSampleAxisValueOffsets.itemAt(index);
+    uint32_t count = __builtin_popcountll(bits);
+    outPointerCoords->bits = bits;
+    for (uint32_t i = 0; i < count; i++) {
+        outPointerCoords->values[i] = values[i];
+    }
+}
+
+float MotionEvent::getSampleAxisValue(size_t index, int32_t axis) const {
+    if (axis < 0 || axis > 63) {
+        return 0;
+    }
+
+    uint64_t bits = mSampleAxisBits.itemAt(index);
+    uint64_t axisBit = 1LL << axis;
+    if (!(bits & axisBit)) {
+        return 0;
+    }
+    return mSampleAxisValues.itemAt(mSampleAxisValueOffsets.itemAt(index)
+            + __builtin_popcountll(bits & (axisBit - 1LL)));
+}
+
+float* MotionEvent::editSampleAxisValue(size_t index, int32_t axis) {
+    uint64_t bits = mSampleAxisBits.itemAt(index);
+    uint64_t axisBit = 1LL << axis;
+    if (!(bits & axisBit)) {
+        return NULL;
+    }
+    return &mSampleAxisValues.editItemAt(mSampleAxisValueOffsets.itemAt(index)
+            + __builtin_popcountll(bits & (axisBit - 1LL)));
+}
+
+void MotionEvent::getRawPointerCoords(size_t pointerIndex,
+        PointerCoords* outPointerCoords) const {
+    getSamplePointerCoords(getHistorySize() * getPointerCount() + pointerIndex,
+            outPointerCoords);
 }
 
 float MotionEvent::getRawAxisValue(int32_t axis, size_t pointerIndex) const {
-    return getRawPointerCoords(pointerIndex)->getAxisValue(axis);
+    return getSampleAxisValue(getHistorySize() * getPointerCount() + pointerIndex, axis);
 }
 
 float MotionEvent::getAxisValue(int32_t axis, size_t pointerIndex) const {
-    float value = getRawPointerCoords(pointerIndex)->getAxisValue(axis);
+    float value = getRawAxisValue(axis, pointerIndex);
     switch (axis) {
     case AMOTION_EVENT_AXIS_X:
         return value + mXOffset;
@@ -368,19 +436,20 @@ float MotionEvent::getAxisValue(int32_t axis, size_t pointerIndex) const {
     return value;
 }
 
-const PointerCoords* MotionEvent::getHistoricalRawPointerCoords(
-        size_t pointerIndex, size_t historicalIndex) const {
-    return &mSamplePointerCoords[historicalIndex * getPointerCount() + pointerIndex];
+void MotionEvent::getHistoricalRawPointerCoords(size_t pointerIndex, size_t historicalIndex,
+        PointerCoords* outPointerCoords) const {
+    getSamplePointerCoords(historicalIndex * getPointerCount() + pointerIndex,
+            outPointerCoords);
 }
 
 float MotionEvent::getHistoricalRawAxisValue(int32_t axis, size_t pointerIndex,
         size_t historicalIndex) const {
-    return getHistoricalRawPointerCoords(pointerIndex, historicalIndex)->getAxisValue(axis);
+    return getSampleAxisValue(historicalIndex * getPointerCount() + pointerIndex, axis);
 }
 
 float MotionEvent::getHistoricalAxisValue(int32_t axis, size_t pointerIndex,
         size_t historicalIndex) const {
-    float value = getHistoricalRawPointerCoords(pointerIndex, historicalIndex)->getAxisValue(axis);
+    float value = getHistoricalRawAxisValue(axis, pointerIndex, historicalIndex);
     switch (axis) {
     case AMOTION_EVENT_AXIS_X:
         return value + mXOffset;
@@ -411,9 +480,20 @@ void MotionEvent::scale(float scaleFactor) {
     mXPrecision *= scaleFactor;
     mYPrecision *= scaleFactor;
 
-    size_t numSamples = mSamplePointerCoords.size();
+    // Same axes as PointerCoords::scale().  Axes that are not present are 0 and stay 0.
+    static const int32_t scaledAxes[] = {
+        AMOTION_EVENT_AXIS_X, AMOTION_EVENT_AXIS_Y,
+        AMOTION_EVENT_AXIS_TOUCH_MAJOR, AMOTION_EVENT_AXIS_TOUCH_MINOR,
+        AMOTION_EVENT_AXIS_TOOL_MAJOR, AMOTION_EVENT_AXIS_TOOL_MINOR,
+    };
+    size_t numSamples = mSampleAxisBits.size();
     for (size_t i = 0; i < numSamples; i++) {
-        mSamplePointerCoords.editItemAt(i).scale(scaleFactor);
+        for (size_t j = 0; j < sizeof(scaledAxes) / sizeof(scaledAxes[0]); j++) {
+            float* value = editSampleAxisValue(i, scaledAxes[j]);
+            if (value) {
+                *value *= scaleFactor;
+            }
+        }
     }
 }
 
@@ -456,10 +536,25 @@ void MotionEvent::transform(const SkMatrix* matrix) {
     mXOffset = newXOffset;
     mYOffset = newYOffset;
 
-    // Apply the transformation to all samples.
-    size_t numSamples = mSamplePointerCoords.size();
+    // Apply the transformation to all samples.  The set of axes present may change
+    // so the samples are unpacked and packed again.
+    Vector<uint64_t> sampleAxisBits(mSampleAxisBits);
+    Vector<uint32_t> sampleAxisValueOffsets(mSampleAxisValueOffsets);
+    Vector<float> sampleAxisValues(mSampleAxisValues);
+    size_t numSamples = sampleAxisBits.size();
+    clearSamplePointerCoords();
+    mSampleAxisBits.setCapacity(numSamples);
+    mSampleAxisValueOffsets.setCapacity(numSamples);
+    mSampleAxisValues.setCapacity(sampleAxisValues.size() + numSamples);
     for (size_t i = 0; i < numSamples; i++) {
-        PointerCoords& c = mSamplePointerCoords.editItemAt(i);
+        PointerCoords c;
+        c.bits = sampleAxisBits.itemAt(i);
+        const float* values = sampleAxisValues.array() + sampleAxisValueOffsets.itemAt(i);
+        uint32_t count = __builtin_popcountll(c.bits);
+        for (uint32_t j = 0; j < count; j++) {
+            c.values[j] = values[j];
+        }
+
         float x = c.getAxisValue(AMOTION_EVENT_AXIS_X) + oldXOffset;
         float y = c.getAxisValue(AMOTION_EVENT_AXIS_Y) + oldYOffset;
         matrix->mapXY(SkFloatToScalar(x), SkFloatToScalar(y), &point);
@@ -468,6 +563,7 @@ void MotionEvent::transform(const SkMatrix* matrix) {
 
         float orientation = c.getAxisValue(AMOTION_EVENT_AXIS_ORIENTATION);
         c.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, transformAngle(matrix, orientation));
+        appendSamplePointerCoords(c);
     }
 }
 
@@ -495,8 +591,9 @@ status_t MotionEvent::readFromParcel(Parcel* parcel) {
     mPointerProperties.setCapacity(pointerCount);
     mSampleEventTimes.clear();
     mSampleEventTimes.setCapacity(sampleCount);
-    mSamplePointerCoords.clear();
-    mSamplePointerCoords.setCapacity(sampleCount * pointerCount);
+    clearSamplePointerCoords();
+    mSampleAxisBits.setCapacity(sampleCount * pointerCount);
+    mSampleAxisValueOffsets.setCapacity(sampleCount * pointerCount);
 
     for (size_t i = 0; i < pointerCount; i++) {
         mPointerProperties.push();
@@ -508,10 +605,16 @@ status_t MotionEvent::readFromParcel(Parcel* parcel) {
     while (sampleCount-- > 0) {
         mSampleEventTimes.push(parcel->readInt64());
         for (size_t i = 0; i < pointerCount; i++) {
-            mSamplePointerCoords.push();
-            status_t status = mSamplePointerCoords.editTop().readFromParcel(parcel);
-            if (status) {
-                return status;
+            // Same encoding as PointerCoords::readFromParcel().
+            uint64_t bits = parcel->readInt64();
+            uint32_t count = __builtin_popcountll(bits);
+            if (count > PointerCoords::MAX_AXES) {
+                return BAD_VALUE;
+            }
+            mSampleAxisBits.push(bits);
+            mSampleAxisValueOffsets.push(mSampleAxisValues.size());
+            for (uint32_t j = 0; j < count; j++) {
+                mSampleAxisValues.push(parcel->readInt32());
             }
         }
     }
@@ -544,13 +647,18 @@ status_t MotionEvent::writeToParcel(Parcel* parcel) const {
         parcel->writeInt32(properties.toolType);
     }
 
-    const PointerCoords* pc = mSamplePointerCoords.array();
+    size_t index = 0;
     for (size_t h = 0; h < sampleCount; h++) {
         parcel->writeInt64(mSampleEventTimes.itemAt(h));
-        for (size_t i = 0; i < pointerCount; i++) {
-            status_t status = (pc++)->writeToParcel(parcel);
-            if (status) {
-                return status;
+        for (size_t i = 0; i < pointerCount; i++, index++) {
+            // Same encoding as PointerCoords::writeToParcel().
+            uint64_t bits = mSampleAxisBits.itemAt(index);
+            const float* values = mSampleAxisValues.array()
+                    + mSampleAxisValueOffsets.itemAt(index);
+            uint32_t count = __builtin_popcountll(bits);
+            parcel->writeInt64(bits);
+            for (uint32_t j = 0; j < count; j++) {
+                parcel->writeInt32(values[j]);
             }
         }
     }
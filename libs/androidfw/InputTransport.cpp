@@ -20,15 +20,21 @@
 #define DEBUG_RESAMPLING 0
 
 
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <androidfw/InputTransport.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <math.h>
+#include <string.h>
 
 
 namespace android {
@@ -39,6 +45,17 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Capacity in bytes of each direction of a shared memory ring.  Must be a power of two.
+// Like the socket buffer, it needs to hold a few dozen large motion events.
+static const uint32_t RING_QUEUE_CAPACITY = 32 * 1024;
+
+// Size of the header preceding each message in a ring.  Records are padded to this size
+// so that headers are always aligned and never straddle the end of the ring.
+static const uint32_t RING_RECORD_HEADER_SIZE = 8;
+
+// Record length marking the unused space at the end of a ring before it wraps around.
+static const uint32_t RING_RECORD_WRAP = 0xffffffff;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
@@ -58,6 +75,17 @@ inline static T min(const T& a, const T& b) {
     return a < b ? a : b;
 }
 
+#if defined(__NR_sendmmsg)
+// Same layout as the kernel's struct mmsghdr, which the C library may not declare.
+struct ChannelMmsgHdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+// Cleared when the kernel does not implement sendmmsg.
+static volatile bool gHaveSendMmsg = true;
+#endif
+
 inline static float lerp(float a, float b, float alpha) {
     return a + alpha * (b - a);
 }
@@ -94,8 +122,26 @@ size_t InputMessage::size() const {
 
 // --- InputChannel ---
 
+// One direction of a shared memory ring.  head and tail are free running byte counters
+// written only by the consumer and the producer respectively; they live on separate
+// cache lines so that the two processes do not contend on them.
+struct InputChannel::RingQueue {
+    int32_t head;
+    int32_t headPadding[15];
+    int32_t tail;
+    int32_t tailPadding[15];
+    uint8_t data[RING_QUEUE_CAPACITY];
+};
+
+// Layout of the ashmem region shared by the two ends of a channel.
+struct InputChannel::Ring {
+    RingQueue serverToClient;
+    RingQueue clientToServer;
+};
+
 InputChannel::InputChannel(const String8& name, int fd) :
-        mName(name), mFd(fd) {
+        mName(name), mFd(fd), mRingFd(-1), mIsRingServer(false),
+        mRing(NULL), mSendQueue(NULL), mReceiveQueue(NULL) {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel constructed: name='%s', fd=%d",
             mName.string(), fd);
@@ -106,15 +152,70 @@ InputChannel::InputChannel(const String8& name, int fd) :
             "non-blocking.  errno=%d", mName.string(), errno);
 }
 
+InputChannel::InputChannel(const String8& name, int fd, int ringFd, bool isRingServer) :
+        mName(name), mFd(fd), mRingFd(ringFd), mIsRingServer(isRingServer),
+        mRing(NULL), mSendQueue(NULL), mReceiveQueue(NULL) {
+#if DEBUG_CHANNEL_LIFECYCLE
+    ALOGD("Input channel constructed: name='%s', fd=%d, ringFd=%d, ringServer=%s",
+            mName.string(), fd, ringFd, isRingServer ? "true" : "false");
+#endif
+
+    int result = fcntl(mFd, F_SETFL, O_NONBLOCK);
+    LOG_ALWAYS_FATAL_IF(result != 0, "channel '%s' ~ Could not make socket "
+            "non-blocking.  errno=%d", mName.string(), errno);
+
+    mapRing();
+}
+
 InputChannel::~InputChannel() {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel destroyed: name='%s', fd=%d",
             mName.string(), mFd);
 #endif
 
+    if (mRing) {
+        ::munmap(mRing, sizeof(Ring));
+    }
+    if (mRingFd >= 0) {
+        ::close(mRingFd);
+    }
     ::close(mFd);
 }
 
+void InputChannel::mapRing() {
+    int size = ashmem_get_size_region(mRingFd);
+    LOG_ALWAYS_FATAL_IF(size < int(sizeof(Ring)), "channel '%s' ~ Shared memory ring "
+            "is too small, size=%d", mName.string(), size);
+
+    void* data = ::mmap(NULL, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, mRingFd, 0);
+    LOG_ALWAYS_FATAL_IF(data == MAP_FAILED, "channel '%s' ~ Could not map shared memory "
+            "ring.  errno=%d", mName.string(), errno);
+
+    mRing = static_cast<Ring*>(data);
+    if (mIsRingServer) {
+        mSendQueue = &mRing->serverToClient;
+        mReceiveQueue = &mRing->clientToServer;
+    } else {
+        mSendQueue = &mRing->clientToServer;
+        mReceiveQueue = &mRing->serverToClient;
+    }
+}
+
+bool InputChannel::isRingEnabled() {
+    char value[PROPERTY_VALUE_MAX];
+    int length = property_get("debug.inputchannel.ring", value, NULL);
+    if (length > 0) {
+        if (!strcmp("1", value)) {
+            return true;
+        }
+        if (strcmp("0", value)) {
+            ALOGD("Unrecognized property value for 'debug.inputchannel.ring'.  "
+                    "Use '1' or '0'.");
+        }
+    }
+    return false;
+}
+
 status_t InputChannel::openInputChannelPair(const String8& name,
         sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
     int sockets[2];
@@ -135,15 +236,39 @@ status_t InputChannel::openInputChannelPair(const String8& name,
 
     String8 serverChannelName = name;
     serverChannelName.append(" (server)");
-    outServerChannel = new InputChannel(serverChannelName, sockets[0]);
-
     String8 clientChannelName = name;
     clientChannelName.append(" (client)");
+
+    if (isRingEnabled()) {
+        String8 ashmemName("InputChannel: ");
+        ashmemName.append(name);
+        int serverRingFd = ashmem_create_region(ashmemName.string(), sizeof(Ring));
+        int clientRingFd = serverRingFd >= 0 ? dup(serverRingFd) : -1;
+        if (clientRingFd >= 0) {
+            outServerChannel = new InputChannel(serverChannelName, sockets[0],
+                    serverRingFd, true /*isRingServer*/);
+            outClientChannel = new InputChannel(clientChannelName, sockets[1],
+                    clientRingFd, false /*isRingServer*/);
+            return OK;
+        }
+
+        ALOGW("channel '%s' ~ Could not create shared memory ring, using the socket "
+                "instead.  errno=%d", name.string(), errno);
+        if (serverRingFd >= 0) {
+            ::close(serverRingFd);
+        }
+    }
+
+    outServerChannel = new InputChannel(serverChannelName, sockets[0]);
     outClientChannel = new InputChannel(clientChannelName, sockets[1]);
     return OK;
 }
 
 status_t InputChannel::sendMessage(const InputMessage* msg) {
+    if (mRing) {
+        return sendRingMessage(msg);
+    }
+
     size_t msgLength = msg->size();
     ssize_t nWrite;
     do {
@@ -179,7 +304,86 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count,
+        size_t* outSentCount) {
+    size_t sent = 0;
+#if defined(__NR_sendmmsg)
+    while (!mRing && gHaveSendMmsg && sent < count) {
+        struct iovec iov[InputPublisher::MAX_BATCH_SIZE];
+        ChannelMmsgHdr hdrs[InputPublisher::MAX_BATCH_SIZE];
+        size_t chunk = count - sent;
+        if (chunk > InputPublisher::MAX_BATCH_SIZE) {
+            chunk = InputPublisher::MAX_BATCH_SIZE;
+        }
+        memset(hdrs, 0, sizeof(ChannelMmsgHdr) * chunk);
+        for (size_t i = 0; i < chunk; i++) {
+            iov[i].iov_base = const_cast<InputMessage*>(&msgs[sent + i]);
+            iov[i].iov_len = msgs[sent + i].size();
+            hdrs[i].msg_hdr.msg_iov = &iov[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int nSent;
+        do {
+            nSent = syscall(__NR_sendmmsg, mFd, hdrs, chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            int error = errno;
+            if (error == ENOSYS) {
+                gHaveSendMmsg = false;
+                break;
+            }
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ error sending %d messages, errno=%d", mName.string(),
+                    chunk, error);
+#endif
+            *outSentCount = sent;
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return WOULD_BLOCK;
+            }
+            if (error == EPIPE || error == ENOTCONN) {
+                return DEAD_OBJECT;
+            }
+            return -error;
+        }
+
+        for (int i = 0; i < nSent; i++) {
+            if (hdrs[i].msg_len != iov[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.string(), msgs[sent + i].header.type);
+#endif
+                *outSentCount = sent + i;
+                return DEAD_OBJECT;
+            }
+        }
+        sent += nSent;
+
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ sent %d messages", mName.string(), nSent);
+#endif
+    }
+#endif
+
+    // Fall back to one send per message.
+    while (sent < count) {
+        status_t status = sendMessage(&msgs[sent]);
+        if (status) {
+            *outSentCount = sent;
+            return status;
+        }
+        sent += 1;
+    }
+    *outSentCount = sent;
+    return OK;
+}
+
 status_t InputChannel::receiveMessage(InputMessage* msg) {
+    if (mRing) {
+        return receiveRingMessage(msg);
+    }
+
     ssize_t nRead;
     do {
         nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
@@ -219,14 +423,191 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::sendRingMessage(const InputMessage* msg) {
+    RingQueue* queue = mSendQueue;
+    uint32_t msgLength = msg->size();
+    uint32_t recordSize = (RING_RECORD_HEADER_SIZE + msgLength + RING_RECORD_HEADER_SIZE - 1)
+            & ~(RING_RECORD_HEADER_SIZE - 1);
+
+    // The tail is only written by this end, the head is updated by the peer.
+    uint32_t oldTail = uint32_t(queue->tail);
+    uint32_t head = uint32_t(android_atomic_acquire_load(&queue->head));
+    uint32_t offset = oldTail & (RING_QUEUE_CAPACITY - 1);
+    uint32_t contiguous = RING_QUEUE_CAPACITY - offset;
+    uint32_t needed = contiguous < recordSize ? recordSize + contiguous : recordSize;
+    uint32_t used = oldTail - head;
+    if (used > RING_QUEUE_CAPACITY || RING_QUEUE_CAPACITY - used < needed) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ could not send message of type %d, ring is full",
+                mName.string(), msg->header.type);
+#endif
+        return WOULD_BLOCK;
+    }
+
+    uint32_t tail = oldTail;
+    if (contiguous < recordSize) {
+        *reinterpret_cast<uint32_t*>(queue->data + offset) = RING_RECORD_WRAP;
+        tail += contiguous;
+        offset = 0;
+    }
+    *reinterpret_cast<uint32_t*>(queue->data + offset) = msgLength;
+    memcpy(queue->data + offset + RING_RECORD_HEADER_SIZE, msg, msgLength);
+    android_atomic_release_store(int32_t(tail + recordSize), &queue->tail);
+
+    // The peer only reads a message after receiving its doorbell, so if the doorbell
+    // cannot be sent the message can safely be withdrawn.
+    status_t status = sendDoorbell();
+    if (status) {
+        android_atomic_release_store(int32_t(oldTail), &queue->tail);
+        return status;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ sent message of type %d through ring", mName.string(),
+            msg->header.type);
+#endif
+    return OK;
+}
+
+status_t InputChannel::receiveRingMessage(InputMessage* msg) {
+    status_t status = receiveDoorbell();
+    if (status) {
+        return status;
+    }
+
+    // The peer is not trusted, so every offset and length read from the ring is checked.
+    RingQueue* queue = mReceiveQueue;
+    uint32_t head = uint32_t(queue->head);
+    uint32_t tail = uint32_t(android_atomic_acquire_load(&queue->tail));
+    uint32_t offset = head & (RING_QUEUE_CAPACITY - 1);
+    if (head == tail || tail - head > RING_QUEUE_CAPACITY
+            || (offset & (RING_RECORD_HEADER_SIZE - 1))) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ received doorbell but the ring is inconsistent", mName.string());
+#endif
+        return BAD_VALUE;
+    }
+
+    uint32_t msgLength = *reinterpret_cast<const uint32_t*>(queue->data + offset);
+    if (msgLength == RING_RECORD_WRAP) {
+        head += RING_QUEUE_CAPACITY - offset;
+        offset = 0;
+        msgLength = *reinterpret_cast<const uint32_t*>(queue->data);
+    }
+    if (msgLength > sizeof(InputMessage)
+            || msgLength > RING_QUEUE_CAPACITY - offset - RING_RECORD_HEADER_SIZE) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ received invalid ring record", mName.string());
+#endif
+        return BAD_VALUE;
+    }
+
+    memcpy(msg, queue->data + offset + RING_RECORD_HEADER_SIZE, msgLength);
+    uint32_t recordSize = (RING_RECORD_HEADER_SIZE + msgLength + RING_RECORD_HEADER_SIZE - 1)
+            & ~(RING_RECORD_HEADER_SIZE - 1);
+    android_atomic_release_store(int32_t(head + recordSize), &queue->head);
+
+    if (!msg->isValid(msgLength)) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ received invalid message", mName.string());
+#endif
+        return BAD_VALUE;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received message of type %d through ring", mName.string(),
+            msg->header.type);
+#endif
+    return OK;
+}
+
+status_t InputChannel::sendDoorbell() {
+    uint8_t doorbell = 0;
+    ssize_t nWrite;
+    do {
+        nWrite = ::send(mFd, &doorbell, sizeof(doorbell), MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (nWrite == -1 && errno == EINTR);
+
+    if (nWrite < 0) {
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+    return nWrite == sizeof(doorbell) ? OK : DEAD_OBJECT;
+}
+
+status_t InputChannel::receiveDoorbell() {
+    uint8_t doorbell;
+    ssize_t nRead;
+    do {
+        nRead = ::recv(mFd, &doorbell, sizeof(doorbell), MSG_DONTWAIT);
+    } while (nRead == -1 && errno == EINTR);
+
+    if (nRead < 0) {
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+    return nRead == 0 ? DEAD_OBJECT : OK;
+}
+
 
 // --- InputPublisher ---
 
+const size_t InputPublisher::MAX_BATCH_SIZE;
+
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mBatching(false), mBatchCount(0), mBatchMessages(NULL) {
 }
 
 InputPublisher::~InputPublisher() {
+    delete[] mBatchMessages;
+}
+
+void InputPublisher::beginBatch() {
+    if (!mBatchMessages) {
+        mBatchMessages = new InputMessage[MAX_BATCH_SIZE];
+    }
+    mBatching = true;
+    mBatchCount = 0;
+}
+
+status_t InputPublisher::endBatch(size_t* outSentCount) {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ endBatch: count=%d",
+            mChannel->getName().string(), mBatchCount);
+#endif
+
+    size_t count = mBatchCount;
+    mBatching = false;
+    mBatchCount = 0;
+    if (!count) {
+        *outSentCount = 0;
+        return OK;
+    }
+    return mChannel->sendMessages(mBatchMessages, count, outSentCount);
+}
+
+InputMessage* InputPublisher::obtainMessage(InputMessage* localMsg) {
+    return mBatching ? &mBatchMessages[mBatchCount] : localMsg;
+}
+
+status_t InputPublisher::publishMessage(InputMessage* msg) {
+    if (mBatching) {
+        mBatchCount += 1;
+        return OK;
+    }
+    return mChannel->sendMessage(msg);
 }
 
 status_t InputPublisher::publishKeyEvent(
@@ -255,7 +636,12 @@ status_t InputPublisher::publishKeyEvent(
         return BAD_VALUE;
     }
 
-    InputMessage msg;
+    if (isBatchFull()) {
+        return NO_MEMORY;
+    }
+
+    InputMessage localMsg;
+    InputMessage& msg = *obtainMessage(&localMsg);
     msg.header.type = InputMessage::TYPE_KEY;
     msg.body.key.seq = seq;
     msg.body.key.deviceId = deviceId;
@@ -268,7 +654,7 @@ status_t InputPublisher::publishKeyEvent(
     msg.body.key.repeatCount = repeatCount;
     msg.body.key.downTime = downTime;
     msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    return publishMessage(&msg);
 }
 
 status_t InputPublisher::publishMotionEvent(
@@ -311,7 +697,12 @@ status_t InputPublisher::publishMotionEvent(
         return BAD_VALUE;
     }
 
-    InputMessage msg;
+    if (isBatchFull()) {
+        return NO_MEMORY;
+    }
+
+    InputMessage localMsg;
+    InputMessage& msg = *obtainMessage(&localMsg);
     msg.header.type = InputMessage::TYPE_MOTION;
     msg.body.motion.seq = seq;
     msg.body.motion.deviceId = deviceId;
@@ -332,7 +723,7 @@ status_t InputPublisher::publishMotionEvent(
         msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
         msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
     }
-    return mChannel->sendMessage(&msg);
+    return publishMessage(&msg);
 }
 
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
@@ -362,10 +753,14 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
+        mPredictorStrategy(getTouchPredictorStrategy()),
         mChannel(channel), mMsgDeferred(false) {
 }
 
 InputConsumer::~InputConsumer() {
+    for (size_t i = 0; i < mTouchStates.size(); i++) {
+        delete mTouchStates[i].velocityTracker;
+    }
 }
 
 bool InputConsumer::isTouchResamplingEnabled() {
@@ -383,6 +778,14 @@ bool InputConsumer::isTouchResamplingEnabled() {
     return true;
 }
 
+String8 InputConsumer::getTouchPredictorStrategy() {
+    // A velocity tracker strategy such as "lsq2" or "int1".  Empty keeps the linear
+    // extrapolation between the last two samples.
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.inputconsumer.predictor", value, "");
+    return String8(value);
+}
+
 status_t InputConsumer::consume(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent) {
 #if DEBUG_TRANSPORT_ACTIONS
@@ -581,10 +984,16 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index < 0) {
             mTouchStates.push();
             index = mTouchStates.size() - 1;
+            mTouchStates.editItemAt(index).velocityTracker = mPredictorStrategy.isEmpty()
+                    ? NULL : new VelocityTracker(mPredictorStrategy.string());
         }
         TouchState& touchState = mTouchStates.editItemAt(index);
         touchState.initialize(deviceId, source);
         touchState.addHistory(msg);
+        if (touchState.velocityTracker) {
+            touchState.velocityTracker->clear();
+            addTouchMovement(touchState, msg);
+        }
         break;
     }
 
@@ -593,6 +1002,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.addHistory(msg);
+            addTouchMovement(touchState, msg);
             if (eventTime < touchState.lastResample.eventTime) {
                 rewriteMessage(touchState, msg);
             } else {
@@ -608,6 +1018,12 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
             rewriteMessage(touchState, msg);
+            if (touchState.velocityTracker) {
+                // Start a new movement trace for the pointer that just went down.
+                BitSet32 downIdBits;
+                downIdBits.markBit(msg->body.motion.getActionId());
+                touchState.velocityTracker->clearPointers(downIdBits);
+            }
         }
         break;
     }
@@ -637,6 +1053,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             const TouchState& touchState = mTouchStates.itemAt(index);
             rewriteMessage(touchState, msg);
+            delete touchState.velocityTracker;
             mTouchStates.removeAt(index);
         }
         break;
@@ -644,6 +1061,27 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
     }
 }
 
+void InputConsumer::addTouchMovement(TouchState& touchState, const InputMessage* msg) {
+    if (!touchState.velocityTracker) {
+        return;
+    }
+
+    // The velocity tracker expects positions in order of increasing pointer id.
+    BitSet32 idBits;
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        idBits.markBit(msg->body.motion.pointers[i].properties.id);
+    }
+    VelocityTracker::Position positions[MAX_POINTERS];
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        const InputMessage::Body::Motion::Pointer& pointer = msg->body.motion.pointers[i];
+        VelocityTracker::Position& position =
+                positions[idBits.getIndexOfBit(pointer.properties.id)];
+        position.x = pointer.coords.getX();
+        position.y = pointer.coords.getY();
+    }
+    touchState.velocityTracker->addMovement(msg->body.motion.eventTime, idBits, positions);
+}
+
 void InputConsumer::rewriteMessage(const TouchState& state, InputMessage* msg) {
     for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
         uint32_t id = msg->body.motion.pointers[i].properties.id;
@@ -704,6 +1142,7 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     const History* other;
     History future;
     float alpha;
+    bool predict = false;
     if (next) {
         // Interpolate between current sample and future sample.
         // So current->eventTime <= sampleTime <= future.eventTime.
@@ -738,6 +1177,7 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
             sampleTime = maxPredict;
         }
         alpha = float(current->eventTime - sampleTime) / delta;
+        predict = touchState.velocityTracker != NULL;
     } else {
 #if DEBUG_RESAMPLING
         ALOGD("Not resampled, insufficient data.");
@@ -754,7 +1194,32 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         touchState.lastResample.idBits.markBit(id);
         PointerCoords& resampledCoords = touchState.lastResample.pointers[i];
         const PointerCoords& currentCoords = current->getPointerById(id);
-        if (other->idBits.hasBit(id)
+        VelocityTracker::Estimator estimator;
+        if (predict && shouldResampleTool(event->getToolType(i))
+                && touchState.velocityTracker->getEstimator(id, &estimator)
+                && estimator.degree >= 1) {
+            // Advance the current sample along the estimated trajectory.  Only the
+            // derivative terms are used so that the prediction starts exactly at the
+            // current position rather than at the smoothed fit.
+            float t = (sampleTime - current->eventTime) * 0.000000001f;
+            float x = currentCoords.getX();
+            float y = currentCoords.getY();
+            float tn = 1;
+            for (uint32_t n = 1; n <= estimator.degree; n++) {
+                tn *= t;
+                x += estimator.xCoeff[n] * tn;
+                y += estimator.yCoeff[n] * tn;
+            }
+            resampledCoords.copyFrom(currentCoords);
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
+#if DEBUG_RESAMPLING
+            ALOGD("[%d] - out (%0.3f, %0.3f), cur (%0.3f, %0.3f), predicted %0.3fms "
+                    "with degree %d",
+                    id, x, y, currentCoords.getX(), currentCoords.getY(),
+                    t * 1000, estimator.degree);
+#endif
+        } else if (other->idBits.hasBit(id)
                 && shouldResampleTool(event->getToolType(i))) {
             const PointerCoords& otherCoords = other->getPointerById(id);
             resampledCoords.copyFrom(currentCoords);
@@ -91,7 +91,7 @@ KeyCharacterMap::KeyCharacterMap() :
 
 KeyCharacterMap::KeyCharacterMap(const KeyCharacterMap& other) :
     RefBase(), mType(other.mType), mKeysByScanCode(other.mKeysByScanCode),
-    mKeysByUsageCode(other.mKeysByUsageCode) {
+    mKeysByUsageCode(other.mKeysByUsageCode), mKeysByCharacter(other.mKeysByCharacter) {
     for (size_t i = 0; i < other.mKeys.size(); i++) {
         mKeys.add(other.mKeys.keyAt(i), new Key(*other.mKeys.valueAt(i)));
     }
@@ -154,6 +154,7 @@ status_t KeyCharacterMap::load(Tokenizer* tokenizer,
                 elapsedTime / 1000000.0);
 #endif
         if (!status) {
+            map->indexCharacters();
             *outMap = map;
         }
     }
@@ -191,6 +192,8 @@ sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
         map->mKeysByUsageCode.replaceValueFor(overlay->mKeysByUsageCode.keyAt(i),
                 overlay->mKeysByUsageCode.valueAt(i));
     }
+
+    map->indexCharacters();
     return map;
 }
 
@@ -297,6 +300,9 @@ bool KeyCharacterMap::getEvents(int32_t deviceId, const char16_t* chars, size_t
         Vector<KeyEvent>& outEvents) const {
     nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
 
+    // Each character produces at least a down and an up.
+    outEvents.setCapacity(outEvents.size() + numChars * 2);
+
     for (size_t i = 0; i < numChars; i++) {
         int32_t keyCode, metaState;
         char16_t ch = chars[i];
@@ -419,24 +425,41 @@ bool KeyCharacterMap::findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMeta
         return false;
     }
 
+    ssize_t index = mKeysByCharacter.indexOfKey(ch);
+    if (index < 0) {
+        return false;
+    }
+    const CharacterKey& characterKey = mKeysByCharacter.valueAt(index);
+    *outKeyCode = characterKey.keyCode;
+    *outMetaState = characterKey.metaState;
+    return true;
+}
+
+void KeyCharacterMap::indexCharacters() {
+    mKeysByCharacter.clear();
+
+    // Characters map to the first key that produces them, in key code order.
     for (size_t i = 0; i < mKeys.size(); i++) {
+        int32_t keyCode = mKeys.keyAt(i);
         const Key* key = mKeys.valueAt(i);
 
-        // Try to find the most general behavior that maps to this character.
+        // Use the most general behavior that maps to each character.
         // For example, the base key behavior will usually be last in the list.
-        const Behavior* found = NULL;
         for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
-            if (behavior->character == ch) {
-                found = behavior;
+            char16_t ch = behavior->character;
+            if (!ch) {
+                continue;
             }
-        }
-        if (found) {
-            *outKeyCode = mKeys.keyAt(i);
-            *outMetaState = found->metaState;
-            return true;
+            ssize_t index = mKeysByCharacter.indexOfKey(ch);
+            if (index >= 0 && mKeysByCharacter.valueAt(index).keyCode != keyCode) {
+                continue;
+            }
+            CharacterKey characterKey;
+            characterKey.keyCode = keyCode;
+            characterKey.metaState = behavior->metaState;
+            mKeysByCharacter.replaceValueFor(ch, characterKey);
         }
     }
-    return false;
 }
 
 void KeyCharacterMap::addKey(Vector<KeyEvent>& outEvents,
@@ -602,6 +625,8 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
             return NULL;
         }
     }
+
+    map->indexCharacters();
     return map;
 }
 
@@ -17,13 +17,19 @@
 #define LOG_TAG "KeyLayoutMap"
 
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <android/keycodes.h>
 #include <androidfw/Keyboard.h>
 #include <androidfw/KeyLayoutMap.h>
+#include <utils/FileMap.h>
 #include <utils/Log.h>
 #include <utils/Errors.h>
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
+#include <utils/threads.h>
 
 // Enables debug output for the parser.
 #define DEBUG_PARSER 0
@@ -39,17 +45,231 @@ namespace android {
 
 static const char* WHITESPACE = " \t\r";
 
+// Suffix appended to the name of a key layout file to get the name of its compiled form.
+static const char* COMPILED_SUFFIX = "c";
+
+// Upper bound on the number of entries in a compiled key layout map, used to
+// reject corrupt files before computing their expected size.
+static const uint32_t MAX_COMPILED_ENTRIES = 65536;
+
+// Key layout maps that are currently loaded, by file name.
+struct CachedKeyLayoutMap {
+    wp<KeyLayoutMap> map;
+    time_t modificationTime;
+};
+
+static Mutex gCacheLock;
+static KeyedVector<String8, CachedKeyLayoutMap> gCache;
+
+static time_t getModificationTime(const String8& filename) {
+    struct stat st;
+    return stat(filename.string(), &st) ? -1 : st.st_mtime;
+}
+
+static bool writeFully(int fd, const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (size) {
+        ssize_t nWrite = write(fd, p, size);
+        if (nWrite < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += nWrite;
+        size -= nWrite;
+    }
+    return true;
+}
+
 // --- KeyLayoutMap ---
 
-KeyLayoutMap::KeyLayoutMap() {
+KeyLayoutMap::KeyLayoutMap() :
+        mCompiledMap(NULL),
+        mCompiledKeysByScanCode(NULL), mCompiledKeysByScanCodeCount(0),
+        mCompiledKeysByUsageCode(NULL), mCompiledKeysByUsageCodeCount(0),
+        mCompiledAxes(NULL), mCompiledAxisCount(0) {
 }
 
 KeyLayoutMap::~KeyLayoutMap() {
+    if (mCompiledMap) {
+        mCompiledMap->release();
+    }
 }
 
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    String8 compiledFilename(filename);
+    compiledFilename.append(COMPILED_SUFFIX);
+    time_t modificationTime = getModificationTime(filename);
+    time_t compiledModificationTime = getModificationTime(compiledFilename);
+    if (compiledModificationTime > modificationTime) {
+        modificationTime = compiledModificationTime;
+    }
+
+    AutoMutex _l(gCacheLock);
+
+    ssize_t index = gCache.indexOfKey(filename);
+    if (index >= 0) {
+        const CachedKeyLayoutMap& cached = gCache.valueAt(index);
+        sp<KeyLayoutMap> map = cached.map.promote();
+        if (map != NULL && cached.modificationTime == modificationTime) {
+            *outMap = map;
+            return NO_ERROR;
+        }
+        gCache.removeItemsAt(index);
+    }
+
+    status_t status = NAME_NOT_FOUND;
+    if (compiledModificationTime >= 0 && compiledModificationTime >= modificationTime) {
+        status = loadCompiled(compiledFilename, outMap);
+        if (status) {
+            ALOGW("Ignoring compiled key layout map file %s, error %d.",
+                    compiledFilename.string(), status);
+        }
+    }
+    if (status) {
+        status = parse(filename, outMap);
+    }
+
+    if (!status) {
+        CachedKeyLayoutMap cached;
+        cached.map = *outMap;
+        cached.modificationTime = modificationTime;
+        gCache.add(filename, cached);
+    }
+    return status;
+}
+
+status_t KeyLayoutMap::loadCompiled(const String8& filename, sp<KeyLayoutMap>* outMap) {
+    int fd = open(filename.string(), O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || size_t(st.st_size) < sizeof(CompiledHeader)) {
+        close(fd);
+        return BAD_VALUE;
+    }
+
+    FileMap* fileMap = new FileMap();
+    if (!fileMap->create(NULL, fd, 0, st.st_size, true)) {
+        fileMap->release();
+        close(fd);
+        return NO_MEMORY;
+    }
+    close(fd);
+
+    sp<KeyLayoutMap> map = new KeyLayoutMap();
+    map->mCompiledMap = fileMap;
+
+    const CompiledHeader* header = static_cast<const CompiledHeader*>(fileMap->getDataPtr());
+    if (header->magic != COMPILED_MAGIC || header->version != COMPILED_VERSION
+            || header->scanCodeKeyCount > MAX_COMPILED_ENTRIES
+            || header->usageCodeKeyCount > MAX_COMPILED_ENTRIES
+            || header->axisCount > MAX_COMPILED_ENTRIES) {
+        return BAD_VALUE;
+    }
+    size_t size = sizeof(CompiledHeader)
+            + (header->scanCodeKeyCount + header->usageCodeKeyCount) * sizeof(CompiledKey)
+            + header->axisCount * sizeof(CompiledAxis);
+    if (size != fileMap->getDataLength()) {
+        return BAD_VALUE;
+    }
+
+    map->mCompiledKeysByScanCode = reinterpret_cast<const CompiledKey*>(header + 1);
+    map->mCompiledKeysByScanCodeCount = header->scanCodeKeyCount;
+    map->mCompiledKeysByUsageCode = map->mCompiledKeysByScanCode + header->scanCodeKeyCount;
+    map->mCompiledKeysByUsageCodeCount = header->usageCodeKeyCount;
+    map->mCompiledAxes = reinterpret_cast<const CompiledAxis*>(
+            map->mCompiledKeysByUsageCode + header->usageCodeKeyCount);
+    map->mCompiledAxisCount = header->axisCount;
+
+    // Lookups use binary search so the entries must be strictly ordered.
+    for (size_t i = 1; i < map->mCompiledKeysByScanCodeCount; i++) {
+        if (map->mCompiledKeysByScanCode[i - 1].code >= map->mCompiledKeysByScanCode[i].code) {
+            return BAD_VALUE;
+        }
+    }
+    for (size_t i = 1; i < map->mCompiledKeysByUsageCodeCount; i++) {
+        if (map->mCompiledKeysByUsageCode[i - 1].code >= map->mCompiledKeysByUsageCode[i].code) {
+            return BAD_VALUE;
+        }
+    }
+    for (size_t i = 1; i < map->mCompiledAxisCount; i++) {
+        if (map->mCompiledAxes[i - 1].scanCode >= map->mCompiledAxes[i].scanCode) {
+            return BAD_VALUE;
+        }
+    }
+
+    *outMap = map;
+    return NO_ERROR;
+}
+
+status_t KeyLayoutMap::compile(const String8& filename) const {
+    if (mCompiledMap) {
+        // Only parsed maps are compiled; a compiled map can simply be copied.
+        return INVALID_OPERATION;
+    }
+
+    CompiledHeader header;
+    header.magic = COMPILED_MAGIC;
+    header.version = COMPILED_VERSION;
+    header.scanCodeKeyCount = mKeysByScanCode.size();
+    header.usageCodeKeyCount = mKeysByUsageCode.size();
+    header.axisCount = mAxes.size();
+
+    // KeyedVector keeps its entries sorted, which is the order the compiled form needs.
+    Vector<CompiledKey> keys;
+    for (size_t i = 0; i < mKeysByScanCode.size(); i++) {
+        CompiledKey key;
+        key.code = mKeysByScanCode.keyAt(i);
+        key.keyCode = mKeysByScanCode.valueAt(i).keyCode;
+        key.flags = mKeysByScanCode.valueAt(i).flags;
+        keys.push(key);
+    }
+    for (size_t i = 0; i < mKeysByUsageCode.size(); i++) {
+        CompiledKey key;
+        key.code = mKeysByUsageCode.keyAt(i);
+        key.keyCode = mKeysByUsageCode.valueAt(i).keyCode;
+        key.flags = mKeysByUsageCode.valueAt(i).flags;
+        keys.push(key);
+    }
+    Vector<CompiledAxis> axes;
+    for (size_t i = 0; i < mAxes.size(); i++) {
+        const AxisInfo& axisInfo = mAxes.valueAt(i);
+        CompiledAxis axis;
+        axis.scanCode = mAxes.keyAt(i);
+        axis.mode = axisInfo.mode;
+        axis.axis = axisInfo.axis;
+        axis.highAxis = axisInfo.highAxis;
+        axis.splitValue = axisInfo.splitValue;
+        axis.flatOverride = axisInfo.flatOverride;
+        axes.push(axis);
+    }
+
+    int fd = open(filename.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ALOGE("Error %d creating compiled key layout map file %s.", errno, filename.string());
+        return -errno;
+    }
+    bool success = writeFully(fd, &header, sizeof(header))
+            && writeFully(fd, keys.array(), keys.size() * sizeof(CompiledKey))
+            && writeFully(fd, axes.array(), axes.size() * sizeof(CompiledAxis));
+    status_t status = success ? NO_ERROR : -errno;
+    close(fd);
+    if (status) {
+        ALOGE("Error %d writing compiled key layout map file %s.", status, filename.string());
+        unlink(filename.string());
+    }
+    return status;
+}
+
+status_t KeyLayoutMap::parse(const String8& filename, sp<KeyLayoutMap>* outMap) {
+    outMap->clear();
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -82,8 +302,7 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
 
 status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
         int32_t* outKeyCode, uint32_t* outFlags) const {
-    const Key* key = getKey(scanCode, usageCode);
-    if (!key) {
+    if (!getKey(scanCode, usageCode, outKeyCode, outFlags)) {
 #if DEBUG_MAPPING
         ALOGD("mapKey: scanCode=%d, usageCode=0x%08x ~ Failed.", scanCode, usageCode);
 #endif
@@ -92,9 +311,6 @@ status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
         return NAME_NOT_FOUND;
     }
 
-    *outKeyCode = key->keyCode;
-    *outFlags = key->flags;
-
 #if DEBUG_MAPPING
     ALOGD("mapKey: scanCode=%d, usageCode=0x%08x ~ Result keyCode=%d, outFlags=0x%08x.",
             scanCode, usageCode, *outKeyCode, *outFlags);
@@ -102,23 +318,74 @@ status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
     return NO_ERROR;
 }
 
-const KeyLayoutMap::Key* KeyLayoutMap::getKey(int32_t scanCode, int32_t usageCode) const {
+const KeyLayoutMap::CompiledKey* KeyLayoutMap::findCompiledKey(
+        const CompiledKey* keys, size_t count, int32_t code) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (keys[mid].code < code) {
+            low = mid + 1;
+        } else if (keys[mid].code > code) {
+            high = mid;
+        } else {
+            return &keys[mid];
+        }
+    }
+    return NULL;
+}
+
+bool KeyLayoutMap::getKey(int32_t scanCode, int32_t usageCode,
+        int32_t* outKeyCode, uint32_t* outFlags) const {
+    if (mCompiledMap) {
+        const CompiledKey* key = NULL;
+        if (usageCode) {
+            key = findCompiledKey(mCompiledKeysByUsageCode, mCompiledKeysByUsageCodeCount,
+                    usageCode);
+        }
+        if (!key && scanCode) {
+            key = findCompiledKey(mCompiledKeysByScanCode, mCompiledKeysByScanCodeCount,
+                    scanCode);
+        }
+        if (!key) {
+            return false;
+        }
+        *outKeyCode = key->keyCode;
+        *outFlags = key->flags;
+        return true;
+    }
+
+    const Key* key = NULL;
     if (usageCode) {
         ssize_t index = mKeysByUsageCode.indexOfKey(usageCode);
         if (index >= 0) {
-            return &mKeysByUsageCode.valueAt(index);
+            key = &mKeysByUsageCode.valueAt(index);
         }
     }
-    if (scanCode) {
+    if (!key && scanCode) {
         ssize_t index = mKeysByScanCode.indexOfKey(scanCode);
         if (index >= 0) {
-            return &mKeysByScanCode.valueAt(index);
+            key = &mKeysByScanCode.valueAt(index);
         }
     }
-    return NULL;
+    if (!key) {
+        return false;
+    }
+    *outKeyCode = key->keyCode;
+    *outFlags = key->flags;
+    return true;
 }
 
 status_t KeyLayoutMap::findScanCodesForKey(int32_t keyCode, Vector<int32_t>* outScanCodes) const {
+    if (mCompiledMap) {
+        for (size_t i = 0; i < mCompiledKeysByScanCodeCount; i++) {
+            if (mCompiledKeysByScanCode[i].keyCode == keyCode) {
+                outScanCodes->add(mCompiledKeysByScanCode[i].code);
+            }
+        }
+        return NO_ERROR;
+    }
+
     const size_t N = mKeysByScanCode.size();
     for (size_t i=0; i<N; i++) {
         if (mKeysByScanCode.valueAt(i).keyCode == keyCode) {
@@ -129,16 +396,43 @@ status_t KeyLayoutMap::findScanCodesForKey(int32_t keyCode, Vector<int32_t>* out
 }
 
 status_t KeyLayoutMap::mapAxis(int32_t scanCode, AxisInfo* outAxisInfo) const {
-    ssize_t index = mAxes.indexOfKey(scanCode);
-    if (index < 0) {
+    if (mCompiledMap) {
+        size_t low = 0;
+        size_t high = mCompiledAxisCount;
+        const CompiledAxis* axis = NULL;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (mCompiledAxes[mid].scanCode < scanCode) {
+                low = mid + 1;
+            } else if (mCompiledAxes[mid].scanCode > scanCode) {
+                high = mid;
+            } else {
+                axis = &mCompiledAxes[mid];
+                break;
+            }
+        }
+        if (!axis) {
 #if DEBUG_MAPPING
-        ALOGD("mapAxis: scanCode=%d ~ Failed.", scanCode);
+            ALOGD("mapAxis: scanCode=%d ~ Failed.", scanCode);
 #endif
-        return NAME_NOT_FOUND;
+            return NAME_NOT_FOUND;
+        }
+        outAxisInfo->mode = AxisInfo::Mode(axis->mode);
+        outAxisInfo->axis = axis->axis;
+        outAxisInfo->highAxis = axis->highAxis;
+        outAxisInfo->splitValue = axis->splitValue;
+        outAxisInfo->flatOverride = axis->flatOverride;
+    } else {
+        ssize_t index = mAxes.indexOfKey(scanCode);
+        if (index < 0) {
+#if DEBUG_MAPPING
+            ALOGD("mapAxis: scanCode=%d ~ Failed.", scanCode);
+#endif
+            return NAME_NOT_FOUND;
+        }
+        *outAxisInfo = mAxes.valueAt(index);
     }
 
-    *outAxisInfo = mAxes.valueAt(index);
-
 #if DEBUG_MAPPING
     ALOGD("mapAxis: scanCode=%d ~ Result mode=%d, axis=%d, highAxis=%d, "
             "splitValue=%d, flatOverride=%d.",
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/LatencyHistogram.h>
+
+namespace android {
+
+LatencyHistogram::LatencyHistogram() :
+        total(0), max(0) {
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = 0;
+    }
+}
+
+void LatencyHistogram::add(nsecs_t latency) {
+    if (latency < 0) {
+        latency = 0;
+    }
+
+    // Bucket 0 holds latencies under 0.5ms, bucket i holds [2^(i-2), 2^(i-1)) ms.
+    size_t bucket = 0;
+    nsecs_t limit = 500000LL;
+    while (bucket < BUCKET_COUNT - 1 && latency >= limit) {
+        bucket += 1;
+        limit *= 2;
+    }
+    counts[bucket] += 1;
+    total += 1;
+    if (latency > max) {
+        max = latency;
+    }
+}
+
+nsecs_t LatencyHistogram::getPercentile(uint32_t percent) const {
+    uint64_t threshold = (uint64_t(total) * percent + 99) / 100;
+    uint64_t cumulative = 0;
+    nsecs_t limit = 500000LL;
+    for (size_t i = 0; i < BUCKET_COUNT - 1; i++) {
+        cumulative += counts[i];
+        if (cumulative >= threshold) {
+            return limit < max ? limit : max;
+        }
+        limit *= 2;
+    }
+    return max;
+}
+
+void LatencyHistogram::dump(String8& dump, const char* prefix, const char* name) const {
+    if (!total) {
+        dump.appendFormat("%s%s: <no samples>\n", prefix, name);
+        return;
+    }
+    dump.appendFormat("%s%s: count=%u, p50<=%0.1fms, p90<=%0.1fms, p99<=%0.1fms, "
+            "max=%0.1fms\n", prefix, name, total,
+            getPercentile(50) * 0.000001f, getPercentile(90) * 0.000001f,
+            getPercentile(99) * 0.000001f, max * 0.000001f);
+}
+
+} // namespace android
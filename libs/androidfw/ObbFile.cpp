@@ -69,6 +69,11 @@
     _rc; })
 #endif
 
+#ifdef __APPLE__
+/* off_t is always 64 bits there */
+#define ftruncate64 ftruncate
+#endif
+
 
 namespace android {
 
@@ -127,94 +132,86 @@ bool ObbFile::parseObbFile(int fd)
         return false;
     }
 
-    ssize_t actual;
-    size_t footerSize;
-
-    {
-        lseek64(fd, fileLength - kFooterTagSize, SEEK_SET);
-
-        char *footer = new char[kFooterTagSize];
-        actual = TEMP_FAILURE_RETRY(read(fd, footer, kFooterTagSize));
-        if (actual != kFooterTagSize) {
-            ALOGW("couldn't read footer signature: %s\n", strerror(errno));
-            return false;
-        }
-
-        unsigned int fileSig = get4LE((unsigned char*)footer + sizeof(int32_t));
-        if (fileSig != kSignature) {
-            ALOGW("footer didn't match magic string (expected 0x%08x; got 0x%08x)\n",
-                    kSignature, fileSig);
-            return false;
-        }
-
-        footerSize = get4LE((unsigned char*)footer);
-        if (footerSize > (size_t)fileLength - kFooterTagSize
-                || footerSize > kMaxBufSize) {
-            ALOGW("claimed footer size is too large (0x%08zx; file size is 0x%08llx)\n",
-                    footerSize, fileLength);
-            return false;
-        }
+    // The footer is at most kMaxBufSize plus the tag, so a single read of
+    // the end of the file gets all of it, however large the file is.
+    size_t tailSize = kMaxBufSize + kFooterTagSize;
+    if ((off64_t) tailSize > fileLength) {
+        tailSize = (size_t) fileLength;
+    }
+    const off64_t tailStart = fileLength - tailSize;
 
-        if (footerSize < (kFooterMinSize - kFooterTagSize)) {
-            ALOGW("claimed footer size is too small (0x%zx; minimum size is 0x%x)\n",
-                    footerSize, kFooterMinSize - kFooterTagSize);
-            return false;
-        }
+    unsigned char* tail = (unsigned char*)malloc(tailSize);
+    if (tail == NULL) {
+        ALOGW("couldn't allocate footer buffer: %s\n", strerror(errno));
+        return false;
     }
 
-    off64_t fileOffset = fileLength - footerSize - kFooterTagSize;
-    if (lseek64(fd, fileOffset, SEEK_SET) != fileOffset) {
-        ALOGW("seek %lld failed: %s\n", fileOffset, strerror(errno));
+    ssize_t actual = TEMP_FAILURE_RETRY(pread64(fd, tail, tailSize, tailStart));
+    if (actual != (ssize_t)tailSize) {
+        ALOGW("couldn't read ObbFile footer: %s\n", strerror(errno));
+        free(tail);
         return false;
     }
 
-    mFooterStart = fileOffset;
+    const unsigned char* footer = tail + tailSize - kFooterTagSize;
+    unsigned int fileSig = get4LE(footer + sizeof(int32_t));
+    if (fileSig != kSignature) {
+        ALOGW("footer didn't match magic string (expected 0x%08x; got 0x%08x)\n",
+                kSignature, fileSig);
+        free(tail);
+        return false;
+    }
 
-    char* scanBuf = (char*)malloc(footerSize);
-    if (scanBuf == NULL) {
-        ALOGW("couldn't allocate scanBuf: %s\n", strerror(errno));
+    size_t footerSize = get4LE(footer);
+    if (footerSize > tailSize - kFooterTagSize) {
+        ALOGW("claimed footer size is too large (0x%08zx; file size is 0x%08llx)\n",
+                footerSize, fileLength);
+        free(tail);
         return false;
     }
 
-    actual = TEMP_FAILURE_RETRY(read(fd, scanBuf, footerSize));
-    // readAmount is guaranteed to be less than kMaxBufSize
-    if (actual != (ssize_t)footerSize) {
-        ALOGI("couldn't read ObbFile footer: %s\n", strerror(errno));
-        free(scanBuf);
+    if (footerSize < (kFooterMinSize - kFooterTagSize)) {
+        ALOGW("claimed footer size is too small (0x%zx; minimum size is 0x%x)\n",
+                footerSize, kFooterMinSize - kFooterTagSize);
+        free(tail);
         return false;
     }
 
+    mFooterStart = fileLength - footerSize - kFooterTagSize;
+
+    const unsigned char* scanBuf = footer - footerSize;
+
 #ifdef DEBUG
-    for (int i = 0; i < footerSize; ++i) {
+    for (size_t i = 0; i < footerSize; ++i) {
         ALOGI("char: 0x%02x\n", scanBuf[i]);
     }
 #endif
 
-    uint32_t sigVersion = get4LE((unsigned char*)scanBuf);
+    uint32_t sigVersion = get4LE(scanBuf);
     if (sigVersion != kSigVersion) {
         ALOGW("Unsupported ObbFile version %d\n", sigVersion);
-        free(scanBuf);
+        free(tail);
         return false;
     }
 
-    mVersion = (int32_t) get4LE((unsigned char*)scanBuf + kPackageVersionOffset);
-    mFlags = (int32_t) get4LE((unsigned char*)scanBuf + kFlagsOffset);
+    mVersion = (int32_t) get4LE(scanBuf + kPackageVersionOffset);
+    mFlags = (int32_t) get4LE(scanBuf + kFlagsOffset);
 
-    memcpy(&mSalt, (unsigned char*)scanBuf + kSaltOffset, sizeof(mSalt));
+    memcpy(&mSalt, scanBuf + kSaltOffset, sizeof(mSalt));
 
-    size_t packageNameLen = get4LE((unsigned char*)scanBuf + kPackageNameLenOffset);
+    size_t packageNameLen = get4LE(scanBuf + kPackageNameLenOffset);
     if (packageNameLen == 0
             || packageNameLen > (footerSize - kPackageNameOffset)) {
         ALOGW("bad ObbFile package name length (0x%04zx; 0x%04zx possible)\n",
                 packageNameLen, footerSize - kPackageNameOffset);
-        free(scanBuf);
+        free(tail);
         return false;
     }
 
-    char* packageName = reinterpret_cast<char*>(scanBuf + kPackageNameOffset);
-    mPackageName = String8(const_cast<char*>(packageName), packageNameLen);
+    const char* packageName = reinterpret_cast<const char*>(scanBuf + kPackageNameOffset);
+    mPackageName = String8(packageName, packageNameLen);
 
-    free(scanBuf);
+    free(tail);
 
 #ifdef DEBUG
     ALOGI("Obb scan succeeded: packageName=%s, version=%d\n", mPackageName.string(), mVersion);
@@ -248,60 +245,50 @@ bool ObbFile::writeTo(int fd)
         return false;
     }
 
-    lseek64(fd, 0, SEEK_END);
-
     if (mPackageName.size() == 0 || mVersion == -1) {
         ALOGW("tried to write uninitialized ObbFile data\n");
         return false;
     }
 
-    unsigned char intBuf[sizeof(uint32_t)+1];
-    memset(&intBuf, 0, sizeof(intBuf));
-
-    put4LE(intBuf, kSigVersion);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write signature version: %s\n", strerror(errno));
-        return false;
-    }
-
-    put4LE(intBuf, mVersion);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write package version\n");
-        return false;
-    }
-
-    put4LE(intBuf, mFlags);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write package version\n");
-        return false;
-    }
-
-    if (write(fd, mSalt, sizeof(mSalt)) != (ssize_t)sizeof(mSalt)) {
-        ALOGW("couldn't write salt: %s\n", strerror(errno));
+    const size_t packageNameLen = mPackageName.size();
+    const size_t footerSize = kPackageNameOffset + packageNameLen;
+    if (footerSize > kMaxBufSize) {
+        ALOGW("package name is too long (%zu bytes)\n", packageNameLen);
         return false;
     }
 
-    size_t packageNameLen = mPackageName.size();
-    put4LE(intBuf, packageNameLen);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write package name length: %s\n", strerror(errno));
+    // Build the whole footer and append it with one write.
+    const size_t totalSize = footerSize + kFooterTagSize;
+    unsigned char* buf = (unsigned char*)malloc(totalSize);
+    if (buf == NULL) {
+        ALOGW("couldn't allocate footer buffer: %s\n", strerror(errno));
         return false;
     }
 
-    if (write(fd, mPackageName.string(), packageNameLen) != (ssize_t)packageNameLen) {
-        ALOGW("couldn't write package name: %s\n", strerror(errno));
-        return false;
-    }
+    put4LE(buf, kSigVersion);
+    put4LE(buf + kPackageVersionOffset, mVersion);
+    put4LE(buf + kFlagsOffset, mFlags);
+    memcpy(buf + kSaltOffset, mSalt, sizeof(mSalt));
+    put4LE(buf + kPackageNameLenOffset, packageNameLen);
+    memcpy(buf + kPackageNameOffset, mPackageName.string(), packageNameLen);
+    put4LE(buf + footerSize, footerSize);
+    put4LE(buf + footerSize + sizeof(uint32_t), kSignature);
 
-    put4LE(intBuf, kPackageNameOffset + packageNameLen);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write footer size: %s\n", strerror(errno));
+    off64_t fileLength = lseek64(fd, 0, SEEK_END);
+    if (fileLength < 0) {
+        ALOGW("error seeking in ObbFile: %s\n", strerror(errno));
+        free(buf);
         return false;
     }
 
-    put4LE(intBuf, kSignature);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write footer magic signature: %s\n", strerror(errno));
+    ssize_t actual = TEMP_FAILURE_RETRY(write(fd, buf, totalSize));
+    free(buf);
+    if (actual != (ssize_t)totalSize) {
+        ALOGW("couldn't write ObbFile footer: %s\n", strerror(errno));
+        if (actual > 0) {
+            // don't leave a partial footer behind
+            ftruncate64(fd, fileLength);
+        }
         return false;
     }
 
@@ -337,7 +324,10 @@ bool ObbFile::removeFrom(int fd)
         return false;
     }
 
-    ftruncate(fd, mFooterStart);
+    if (ftruncate64(fd, mFooterStart) != 0) {
+        ALOGW("couldn't truncate ObbFile footer: %s\n", strerror(errno));
+        return false;
+    }
 
     return true;
 }
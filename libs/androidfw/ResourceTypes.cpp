@@ -311,12 +311,14 @@ Res_png_9patch* Res_png_9patch::deserialize(const void* inData)
 // --------------------------------------------------------------------
 
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL), mDecodeBlocks(NULL),
+      mIndex(NULL), mIndexMask(0)
 {
 }
 
 ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL), mDecodeBlocks(NULL),
+      mIndex(NULL), mIndexMask(0)
 {
     setTo(data, size, copyData);
 }
@@ -513,16 +515,20 @@ void ResStringPool::uninit()
         free(mOwnedData);
         mOwnedData = NULL;
     }
-    if (mHeader != NULL && mCache != NULL) {
-        for (size_t x = 0; x < mHeader->stringCount; x++) {
-            if (mCache[x] != NULL) {
-                free(mCache[x]);
-                mCache[x] = NULL;
-            }
-        }
+    if (mCache != NULL) {
         free(mCache);
         mCache = NULL;
     }
+    while (mDecodeBlocks != NULL) {
+        decode_block* next = mDecodeBlocks->next;
+        free(mDecodeBlocks);
+        mDecodeBlocks = next;
+    }
+    if (mIndex != NULL) {
+        free(mIndex);
+        mIndex = NULL;
+        mIndexMask = 0;
+    }
 }
 
 /**
@@ -569,6 +575,61 @@ decodeLength(const uint8_t** str)
     return len;
 }
 
+// Size of the blocks the UTF-8 decode cache is carved out of, in char16_t.
+static const size_t DECODE_BLOCK_SIZE = 4096;
+
+struct ResStringPool::decode_block
+{
+    decode_block* next;
+    size_t used;
+    size_t size;
+    char16_t data[];
+};
+
+char16_t* ResStringPool::allocDecodedLocked(size_t count) const
+{
+    decode_block* block = mDecodeBlocks;
+    if (block == NULL || block->size - block->used < count) {
+        const size_t size = count > DECODE_BLOCK_SIZE ? count : DECODE_BLOCK_SIZE;
+        block = (decode_block*)malloc(sizeof(decode_block) + size*sizeof(char16_t));
+        if (block == NULL) {
+            return NULL;
+        }
+        block->used = 0;
+        block->size = size;
+        if (mDecodeBlocks != NULL && count > DECODE_BLOCK_SIZE) {
+            // Keep filling the current block after an oversized string.
+            block->next = mDecodeBlocks->next;
+            mDecodeBlocks->next = block;
+        } else {
+            block->next = mDecodeBlocks;
+            mDecodeBlocks = block;
+        }
+    }
+    char16_t* result = block->data + block->used;
+    block->used += count;
+    return result;
+}
+
+/**
+ * Returns true if the first 'len' bytes of 'str' are all 7-bit ASCII,
+ * checking a word at a time once 'str' is aligned.
+ */
+static inline bool isAscii(const uint8_t* str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && ((uintptr_t)(str + i) & (sizeof(uint32_t) - 1)) != 0) {
+        if (str[i++] & 0x80) return false;
+    }
+    for (; i + sizeof(uint32_t) <= len; i += sizeof(uint32_t)) {
+        if (*(const uint32_t*)(str + i) & 0x80808080) return false;
+    }
+    for (; i < len; i++) {
+        if (str[i] & 0x80) return false;
+    }
+    return true;
+}
+
 const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
@@ -601,7 +662,11 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                         return mCache[idx];
                     }
 
-                    ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
+                    // ASCII strings, by far the most common, widen one byte
+                    // per code unit without going through the UTF-8 decoder.
+                    const bool ascii = isAscii(u8str, u8len);
+                    ssize_t actualLen = ascii ? (ssize_t)u8len
+                            : utf8_to_utf16_length(u8str, u8len);
                     if (actualLen < 0 || (size_t)actualLen != *u16len) {
                         ALOGW("Bad string block: string #%lld decoded length is not correct "
                                 "%lld vs %llu\n",
@@ -609,14 +674,21 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                         return NULL;
                     }
 
-                    char16_t *u16str = (char16_t *)calloc(*u16len+1, sizeof(char16_t));
+                    char16_t *u16str = allocDecodedLocked(*u16len+1);
                     if (!u16str) {
                         ALOGW("No memory when trying to allocate decode cache for string #%d\n",
                                 (int)idx);
                         return NULL;
                     }
 
-                    utf8_to_utf16(u8str, u8len, u16str);
+                    if (ascii) {
+                        for (size_t i = 0; i < u8len; i++) {
+                            u16str[i] = u8str[i];
+                        }
+                        u16str[u8len] = 0;
+                    } else {
+                        utf8_to_utf16(u8str, u8len, u16str);
+                    }
                     mCache[idx] = u16str;
                     return u16str;
                 } else {
@@ -661,6 +733,38 @@ const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
     return NULL;
 }
 
+const char* ResStringPool::modifiedUtf8At(size_t idx) const
+{
+    if (mError == NO_ERROR && idx < mHeader->stringCount
+            && (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0) {
+        const uint32_t off = mEntries[idx];
+        if (off < (mStringPoolSize-1)) {
+            const uint8_t* strings = (uint8_t*)mStrings;
+            const uint8_t* str = strings+off;
+            size_t u16len = decodeLength(&str);
+            size_t u8len = decodeLength(&str);
+            // The terminating NUL must be inside the pool too.
+            if ((uint32_t)(str+u8len-strings) < mStringPoolSize && str[u8len] == 0) {
+                if (isAscii(str, u8len)) {
+                    // A NUL would make the decoded length too long.
+                    return strlen((const char*)str) == u8len ? (const char*)str : NULL;
+                }
+                for (size_t i = 0; i < u8len; i++) {
+                    // Embedded NULs and 4-byte sequences differ in modified UTF-8.
+                    if (str[i] == 0 || str[i] >= 0xf0) {
+                        return NULL;
+                    }
+                }
+                ssize_t actualLen = utf8_to_utf16_length(str, u8len);
+                if (actualLen >= 0 && (size_t)actualLen == u16len) {
+                    return (const char*)str;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
 const String8 ResStringPool::string8ObjectAt(size_t idx) const
 {
     size_t len;
@@ -691,6 +795,82 @@ const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
     return NULL;
 }
 
+static inline uint32_t hashString16(const char16_t* str, size_t len)
+{
+    // FNV-1a over the UTF-16 code units.
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void ResStringPool::buildIndexLocked() const
+{
+    const size_t N = mHeader->stringCount;
+    size_t numSlots = 16;
+    while (numSlots < N * 2) {
+        numSlots <<= 1;
+    }
+    uint32_t* index = (uint32_t*)calloc(numSlots * 2, sizeof(uint32_t));
+    if (index == NULL) {
+        ALOGW("No memory when trying to allocate string pool index for %d strings\n", (int)N);
+        return;
+    }
+    const size_t mask = numSlots - 1;
+
+    // UTF-8 strings are decoded into a scratch buffer only to be hashed, so
+    // building the index does not fill the decode cache.
+    const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+    char16_t* scratch = NULL;
+    size_t scratchSize = 0;
+
+    for (size_t i = 0; i < N; i++) {
+        const char16_t* s = NULL;
+        size_t len = 0;
+        if (isUTF8) {
+            size_t u8len;
+            const char* u8str = string8At(i, &u8len);
+            if (u8str != NULL) {
+                ssize_t u16len = utf8_to_utf16_length((const uint8_t*)u8str, u8len);
+                if (u16len >= 0) {
+                    if ((size_t)u16len + 1 > scratchSize) {
+                        free(scratch);
+                        scratchSize = u16len + 1;
+                        scratch = (char16_t*)malloc(scratchSize * sizeof(char16_t));
+                        if (scratch == NULL) {
+                            scratchSize = 0;
+                            continue;
+                        }
+                    }
+                    utf8_to_utf16((const uint8_t*)u8str, u8len, scratch);
+                    s = scratch;
+                    len = u16len;
+                }
+            }
+        } else {
+            s = stringAt(i, &len);
+        }
+        if (s == NULL) {
+            continue;
+        }
+
+        const uint32_t hash = hashString16(s, len);
+        size_t slot = hash & mask;
+        while (index[slot * 2 + 1] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        index[slot * 2] = hash;
+        index[slot * 2 + 1] = i + 1;
+    }
+    free(scratch);
+
+    // Make the index contents visible before publishing it to lock-free readers.
+    mIndexMask = mask;
+    __sync_synchronize();
+    mIndex = index;
+}
+
 ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 {
     if (mError != NO_ERROR) {
@@ -726,6 +906,36 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
             }
         }
     } else {
+        // Look the string up in the hash index, building it on first use.
+        // Pools may contain duplicates, in which case the last one wins to
+        // match the linear search below.
+        const uint32_t* index = mIndex;
+        if (index == NULL) {
+            AutoMutex lock(mDecodeLock);
+            if (mIndex == NULL) {
+                buildIndexLocked();
+            }
+            index = mIndex;
+        } else {
+            __sync_synchronize();
+        }
+        if (index != NULL) {
+            const uint32_t hash = hashString16(str, strLen);
+            ssize_t found = NAME_NOT_FOUND;
+            size_t slot = hash & mIndexMask;
+            while (index[slot * 2 + 1] != 0) {
+                const ssize_t i = index[slot * 2 + 1] - 1;
+                if (index[slot * 2] == hash && i > found) {
+                    const char16_t* s = stringAt(i, &len);
+                    if (s && strzcmp16(s, len, str, strLen) == 0) {
+                        found = i;
+                    }
+                }
+                slot = (slot + 1) & mIndexMask;
+            }
+            return found;
+        }
+
         // It is unusual to get the ID from an unsorted string block...
         // most often this happens because we want to get IDs for style
         // span tags; since those always appear at the end of the string
@@ -2329,6 +2539,14 @@ struct ResTable::Package
     }
 };
 
+// The configurations of a type that match the table's current parameters,
+// in the same order as in Type::configs, along with their host-order copies.
+struct ResTable::FilteredType : public LightRefBase<FilteredType>
+{
+    Vector<const ResTable_type*>    configs;
+    Vector<ResTable_config>         hostConfigs;
+};
+
 // A group of objects describing a particular resource package.
 // The first in 'package' is always the root object (from the resource
 // table that defined the package); the ones after are skins on top of it.
@@ -2398,8 +2616,11 @@ struct ResTable::bag_set
     // Followed by 'numAttr' bag_entry structures.
 };
 
+// Maximum number of theme snapshots kept by a table.
+static const size_t MAX_THEME_SNAPSHOTS = 32;
+
 ResTable::Theme::Theme(const ResTable& table)
-    : mTable(table)
+    : mTable(table), mStylesValid(true), mStylesGeneration(0)
 {
     memset(mPackages, 0, sizeof(mPackages));
 }
@@ -2414,8 +2635,19 @@ ResTable::Theme::~Theme()
     }
 }
 
+ResTable::Theme::package_info* ResTable::Theme::acquire_package(package_info* pi)
+{
+    if (pi != NULL) {
+        android_atomic_inc(&pi->refCount);
+    }
+    return pi;
+}
+
 void ResTable::Theme::free_package(package_info* pi)
 {
+    if (android_atomic_dec(&pi->refCount) != 1) {
+        return;
+    }
     for (size_t j=0; j<pi->numTypes; j++) {
         theme_entry* te = pi->types[j].entries;
         if (te != NULL) {
@@ -2429,6 +2661,7 @@ ResTable::Theme::package_info* ResTable::Theme::copy_package(package_info* pi)
 {
     package_info* newpi = (package_info*)malloc(
         sizeof(package_info) + (pi->numTypes*sizeof(type_info)));
+    newpi->refCount = 1;
     newpi->numTypes = pi->numTypes;
     for (size_t j=0; j<newpi->numTypes; j++) {
         size_t cnt = pi->types[j].numEntries;
@@ -2445,6 +2678,39 @@ ResTable::Theme::package_info* ResTable::Theme::copy_package(package_info* pi)
     return newpi;
 }
 
+void ResTable::Theme::free_snapshot(snapshot* s)
+{
+    for (size_t i=0; i<Res_MAXPACKAGE; i++) {
+        if (s->packages[i] != NULL) {
+            free_package(s->packages[i]);
+        }
+    }
+    delete s;
+}
+
+ResTable::Theme::package_info* ResTable::Theme::edit_package(size_t pidx)
+{
+    package_info* pi = mPackages[pidx];
+    if (pi != NULL && android_atomic_acquire_load(&pi->refCount) > 1) {
+        // Shared with another theme or a snapshot; make our own copy first.
+        package_info* newpi = copy_package(pi);
+        free_package(pi);
+        mPackages[pidx] = pi = newpi;
+    }
+    return pi;
+}
+
+void ResTable::Theme::set_packages(package_info* const* packages)
+{
+    for (size_t i=0; i<Res_MAXPACKAGE; i++) {
+        package_info* pi = acquire_package(packages[i]);
+        if (mPackages[i] != NULL) {
+            free_package(mPackages[i]);
+        }
+        mPackages[i] = pi;
+    }
+}
+
 status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
 {
     const bag_entry* bag;
@@ -2457,6 +2723,33 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
     if (redirect != 0) {
         resID = redirect;
     }
+
+    // Applying the same sequence of styles always produces the same theme, so
+    // reuse the result if the table already has it.
+    Vector<uint32_t> styles;
+    if (mStylesValid) {
+        AutoMutex _l(mTable.mThemeCacheLock);
+        if (mStyles.isEmpty()) {
+            mStylesGeneration = mTable.mThemeCacheGeneration;
+        } else if (mStylesGeneration != mTable.mThemeCacheGeneration) {
+            mStylesValid = false;
+        }
+    }
+    if (mStylesValid) {
+        styles = mStyles;
+        styles.add(resID);
+        styles.add(force ? 1 : 0);
+
+        AutoMutex _l(mTable.mThemeCacheLock);
+        const snapshot* s = mTable.findThemeSnapshotLocked(styles);
+        if (s != NULL) {
+            set_packages(s->packages);
+            mStyles = styles;
+            mTable.unlock();
+            return NO_ERROR;
+        }
+    }
+
     const ssize_t N = mTable.getBagLocked(resID, &bag, &bagTypeSpecFlags);
     TABLE_NOISY(ALOGV("Applying style 0x%08x to theme %p, count=%d", resID, this, N));
     if (N < 0) {
@@ -2487,12 +2780,13 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
             }
             curPackage = p;
             curPackageIndex = pidx;
-            curPI = mPackages[pidx];
+            curPI = edit_package(pidx);
             if (curPI == NULL) {
                 PackageGroup* const grp = mTable.mPackageGroups[pidx];
                 int cnt = grp->typeCount;
                 curPI = (package_info*)malloc(
                     sizeof(package_info) + (cnt*sizeof(type_info)));
+                curPI->refCount = 1;
                 curPI->numTypes = cnt;
                 memset(curPI->types, 0, cnt*sizeof(type_info));
                 mPackages[pidx] = curPI;
@@ -2536,6 +2830,25 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
         bag++;
     }
 
+    if (mStylesValid) {
+        mStyles = styles;
+
+        AutoMutex _l(mTable.mThemeCacheLock);
+        if (mStylesGeneration == mTable.mThemeCacheGeneration
+                && mTable.findThemeSnapshotLocked(styles) == NULL) {
+            if (mTable.mThemeCache.size() >= MAX_THEME_SNAPSHOTS) {
+                free_snapshot(mTable.mThemeCache[0]);
+                mTable.mThemeCache.removeAt(0);
+            }
+            snapshot* s = new snapshot();
+            s->styles = styles;
+            for (size_t i=0; i<Res_MAXPACKAGE; i++) {
+                s->packages[i] = acquire_package(mPackages[i]);
+            }
+            mTable.mThemeCache.add(s);
+        }
+    }
+
     mTable.unlock();
 
     //ALOGI("Applying style 0x%08x (force=%d)  theme %p...\n", resID, force, this);
@@ -2551,16 +2864,11 @@ status_t ResTable::Theme::setTo(const Theme& other)
     //other.dumpToLog();
     
     if (&mTable == &other.mTable) {
-        for (size_t i=0; i<Res_MAXPACKAGE; i++) {
-            if (mPackages[i] != NULL) {
-                free_package(mPackages[i]);
-            }
-            if (other.mPackages[i] != NULL) {
-                mPackages[i] = copy_package(other.mPackages[i]);
-            } else {
-                mPackages[i] = NULL;
-            }
-        }
+        // Share the package data; it is copied on the next write.
+        set_packages(other.mPackages);
+        mStyles = other.mStyles;
+        mStylesValid = other.mStylesValid;
+        mStylesGeneration = other.mStylesGeneration;
     } else {
         // @todo: need to really implement this, not just copy
         // the system package (which is still wrong because it isn't
@@ -2575,6 +2883,8 @@ status_t ResTable::Theme::setTo(const Theme& other)
                 mPackages[i] = NULL;
             }
         }
+        mStyles.clear();
+        mStylesValid = false;
     }
 
     //ALOGI("Final theme:");
@@ -2682,18 +2992,20 @@ void ResTable::Theme::dumpToLog() const
 }
 
 ResTable::ResTable()
-    : mError(NO_INIT)
+    : mError(NO_INIT), mThemeCacheGeneration(0), mRedirectionIndexValid(true)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
+    memset(mRedirectionPackageMap, 0, sizeof(mRedirectionPackageMap));
     //ALOGI("Creating ResTable %p\n", this);
 }
 
 ResTable::ResTable(const void* data, size_t size, void* cookie, bool copyData)
-    : mError(NO_INIT)
+    : mError(NO_INIT), mThemeCacheGeneration(0), mRedirectionIndexValid(true)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
+    memset(mRedirectionPackageMap, 0, sizeof(mRedirectionPackageMap));
     add(data, size, cookie, copyData);
     LOG_FATAL_IF(mError != NO_ERROR, "Error parsing resource table");
     //ALOGI("Creating ResTable %p\n", this);
@@ -2713,7 +3025,10 @@ inline ssize_t ResTable::getResourcePackageIndex(uint32_t resID) const
 status_t ResTable::add(const void* data, size_t size, void* cookie, bool copyData,
                        const void* idmap)
 {
-    return add(data, size, cookie, NULL, copyData, reinterpret_cast<const Asset*>(idmap));
+    status_t err = add(data, size, cookie, NULL, copyData,
+            reinterpret_cast<const Asset*>(idmap));
+    updateFilteredTypes();
+    return err;
 }
 
 status_t ResTable::add(Asset* asset, void* cookie, bool copyData, const void* idmap)
@@ -2724,7 +3039,10 @@ status_t ResTable::add(Asset* asset, void* cookie, bool copyData, const void* id
         return UNKNOWN_ERROR;
     }
     size_t size = (size_t)asset->getLength();
-    return add(data, size, cookie, asset, copyData, reinterpret_cast<const Asset*>(idmap));
+    status_t err = add(data, size, cookie, asset, copyData,
+            reinterpret_cast<const Asset*>(idmap));
+    updateFilteredTypes();
+    return err;
 }
 
 status_t ResTable::add(ResTable* src)
@@ -2747,7 +3065,8 @@ status_t ResTable::add(ResTable* src)
     }
     
     memcpy(mPackageMap, src->mPackageMap, sizeof(mPackageMap));
-    
+
+    updateFilteredTypes();
     return mError;
 }
 
@@ -2905,6 +3224,7 @@ void ResTable::uninit()
     mPackageGroups.clear();
     mHeaders.clear();
 
+    clearFilteredTypesLocked();
     clearRedirections();
 }
 
@@ -3171,6 +3491,11 @@ uint32_t ResTable::lookupRedirectionMap(uint32_t resID) const
 
     const int p = Res_GETPACKAGE(resID)+1;
 
+    if (mRedirectionIndexValid) {
+        const size_t idx = mRedirectionPackageMap[p & 0xff];
+        return idx != 0 ? mRedirectionMap[idx-1]->lookupRedirection(resID) : 0;
+    }
+
     const size_t N = mRedirectionMap.size();
     for (size_t i=0; i<N; i++) {
         PackageRedirectionMap* resMap = mRedirectionMap[i];
@@ -3197,7 +3522,7 @@ const char16_t* ResTable::valueToString(
 
 ssize_t ResTable::lockBag(uint32_t resID, const bag_entry** outBag) const
 {
-    mLock.lock();
+    mLock.readLock();
     ssize_t err = getBagLocked(resID, outBag);
     if (err < NO_ERROR) {
         //printf("*** get failed!  unlocking\n");
@@ -3214,7 +3539,7 @@ void ResTable::unlockBag(const bag_entry* bag) const
 
 void ResTable::lock() const
 {
-    mLock.lock();
+    mLock.readLock();
 }
 
 void ResTable::unlock() const
@@ -3222,6 +3547,49 @@ void ResTable::unlock() const
     mLock.unlock();
 }
 
+// Makes the contents of a newly computed bag cache entry visible to other
+// threads before the entry itself is published.
+static inline void publishBarrier()
+{
+    __sync_synchronize();
+}
+
+const ResTable::bag_set* ResTable::findBag(uint32_t resID) const
+{
+    const ssize_t p = getResourcePackageIndex(resID);
+    const int t = Res_GETTYPE(resID);
+    const int e = Res_GETENTRY(resID);
+    if (p < 0 || t < 0) {
+        return NULL;
+    }
+
+    const PackageGroup* const grp = mPackageGroups[p];
+    if (grp == NULL || t >= (int)grp->typeCount) {
+        return NULL;
+    }
+
+    const Type* const typeConfigs = grp->packages[0]->getType(t);
+    if (typeConfigs == NULL || e >= (int)typeConfigs->entryCount) {
+        return NULL;
+    }
+
+    bag_set*** const bags = grp->bags;
+    if (!bags) {
+        return NULL;
+    }
+    bag_set** const typeSet = bags[t];
+    if (!typeSet) {
+        return NULL;
+    }
+    bag_set* const set = typeSet[e];
+    publishBarrier();
+    if (set == NULL || set == (bag_set*)0xFFFFFFFF) {
+        // Not computed yet, or currently being computed by another thread.
+        return NULL;
+    }
+    return set;
+}
+
 ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
         uint32_t* outTypeSpecFlags) const
 {
@@ -3229,6 +3597,24 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
         return mError;
     }
 
+    // Fast path: the bag has already been computed and published.
+    const bag_set* set = findBag(resID);
+    if (set != NULL) {
+        if (outTypeSpecFlags != NULL) {
+            *outTypeSpecFlags = set->typeSpecFlags;
+        }
+        *outBag = (const bag_entry*)(set+1);
+        return set->numAttrs;
+    }
+
+    AutoMutex _l(mBagBuildLock);
+    return buildBagLocked(resID, outBag, outTypeSpecFlags);
+}
+
+ssize_t ResTable::buildBagLocked(uint32_t resID, const bag_entry** outBag,
+        uint32_t* outTypeSpecFlags) const
+{
+
     const ssize_t p = getResourcePackageIndex(resID);
     const int t = Res_GETTYPE(resID);
     const int e = Res_GETENTRY(resID);
@@ -3289,14 +3675,17 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
 
     // Bag not found, we need to compute it!
     if (!grp->bags) {
-        grp->bags = (bag_set***)calloc(grp->typeCount, sizeof(bag_set*));
-        if (!grp->bags) return NO_MEMORY;
+        bag_set*** bags = (bag_set***)calloc(grp->typeCount, sizeof(bag_set*));
+        if (!bags) return NO_MEMORY;
+        publishBarrier();
+        grp->bags = bags;
     }
 
     bag_set** typeSet = grp->bags[t];
     if (!typeSet) {
         typeSet = (bag_set**)calloc(NENTRY, sizeof(bag_set*));
         if (!typeSet) return NO_MEMORY;
+        publishBarrier();
         grp->bags[t] = typeSet;
     }
 
@@ -3398,7 +3787,7 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
                     }
                 }
             }
-            const ssize_t NP = getBagLocked(parentActual, &parentBag, &parentTypeSpecFlags);
+            const ssize_t NP = buildBagLocked(parentActual, &parentBag, &parentTypeSpecFlags);
             const size_t NT = ((NP >= 0) ? NP : 0) + N;
             set = (bag_set*)malloc(sizeof(bag_set)+sizeof(bag_entry)*NT);
             if (set == NULL) {
@@ -3509,6 +3898,7 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
     }
 
     // And this is it...
+    publishBarrier();
     typeSet[e] = set;
     if (set) {
         if (outTypeSpecFlags != NULL) {
@@ -3523,19 +3913,20 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
 
 void ResTable::setParameters(const ResTable_config* params)
 {
-    mLock.lock();
+    mLock.writeLock();
     TABLE_GETENTRY(ALOGI("Setting parameters: %s\n", params->toString().string()));
     mParams = *params;
     for (size_t i=0; i<mPackageGroups.size(); i++) {
         TABLE_NOISY(ALOGI("CLEARING BAGS FOR GROUP %d!", i));
         mPackageGroups[i]->clearBagCache();
     }
+    updateFilteredTypesLocked();
     mLock.unlock();
 }
 
 void ResTable::getParameters(ResTable_config* params) const
 {
-    mLock.lock();
+    mLock.readLock();
     *params = mParams;
     mLock.unlock();
 }
@@ -4864,21 +5255,38 @@ ssize_t ResTable::getEntry(
     uint32_t offset = ResTable_type::NO_ENTRY;
     ResTable_config bestConfig;
     memset(&bestConfig, 0, sizeof(bestConfig)); // make the compiler shut up
-    
-    const size_t NT = allTypes->configs.size();
+
+    // When looking up with the current parameters, only the configurations
+    // already known to match them need to be considered.
+    // The reference keeps them alive if setParameters() replaces them meanwhile.
+    sp<FilteredType> filtered;
+    if (config == &mParams) {
+        AutoMutex _l(mFilteredTypesLock);
+        ssize_t index = mFilteredTypes.indexOfKey(allTypes);
+        if (index >= 0) {
+            filtered = mFilteredTypes.valueAt(index);
+        }
+    }
+
+    const size_t NT = filtered != NULL ? filtered->configs.size() : allTypes->configs.size();
     for (size_t i=0; i<NT; i++) {
-        const ResTable_type* const thisType = allTypes->configs[i];
-        if (thisType == NULL) continue;
-        
+        const ResTable_type* thisType;
         ResTable_config thisConfig;
-        thisConfig.copyFromDtoH(thisType->config);
+        if (filtered != NULL) {
+            thisType = filtered->configs[i];
+            thisConfig = filtered->hostConfigs[i];
+        } else {
+            thisType = allTypes->configs[i];
+            if (thisType == NULL) continue;
+            thisConfig.copyFromDtoH(thisType->config);
+        }
 
         TABLE_GETENTRY(ALOGI("Match entry 0x%x in type 0x%x (sz 0x%x): %s\n",
                            entryIndex, typeIndex+1, dtohl(thisType->config.size),
                            thisConfig.toString().string()));
         
         // Check to make sure this one is valid for the current parameters.
-        if (config && !thisConfig.match(*config)) {
+        if (filtered == NULL && config && !thisConfig.match(*config)) {
             TABLE_GETENTRY(ALOGI("Does not match config!\n"));
             continue;
         }
@@ -4950,6 +5358,86 @@ ssize_t ResTable::getEntry(
     return offset + dtohs(entry->size);
 }
 
+void ResTable::updateFilteredTypes()
+{
+    mLock.writeLock();
+    updateFilteredTypesLocked();
+    mLock.unlock();
+}
+
+void ResTable::updateFilteredTypesLocked()
+{
+    clearThemeCache();
+
+    KeyedVector<const Type*, sp<FilteredType> > filteredTypes;
+
+    const size_t NG = mPackageGroups.size();
+    for (size_t ig=0; ig<NG; ig++) {
+        const PackageGroup* const grp = mPackageGroups[ig];
+        const size_t NP = grp->packages.size();
+        for (size_t ip=0; ip<NP; ip++) {
+            const Package* const package = grp->packages[ip];
+            const size_t NT = package->types.size();
+            for (size_t it=0; it<NT; it++) {
+                const Type* const type = package->types[it];
+                if (type == NULL || filteredTypes.indexOfKey(type) >= 0) {
+                    continue;
+                }
+
+                sp<FilteredType> filtered = new FilteredType();
+                const size_t NC = type->configs.size();
+                for (size_t ic=0; ic<NC; ic++) {
+                    const ResTable_type* const thisType = type->configs[ic];
+                    if (thisType == NULL) continue;
+
+                    ResTable_config thisConfig;
+                    thisConfig.copyFromDtoH(thisType->config);
+                    if (thisConfig.match(mParams)) {
+                        filtered->configs.add(thisType);
+                        filtered->hostConfigs.add(thisConfig);
+                    }
+                }
+                filteredTypes.add(type, filtered);
+            }
+        }
+    }
+
+    AutoMutex _l(mFilteredTypesLock);
+    mFilteredTypes = filteredTypes;
+}
+
+const ResTable::Theme::snapshot* ResTable::findThemeSnapshotLocked(
+        const Vector<uint32_t>& styles) const
+{
+    const size_t N = mThemeCache.size();
+    for (size_t i=0; i<N; i++) {
+        const Theme::snapshot* s = mThemeCache[i];
+        if (s->styles.size() == styles.size()
+                && memcmp(s->styles.array(), styles.array(),
+                        styles.size()*sizeof(uint32_t)) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+void ResTable::clearThemeCache() const
+{
+    AutoMutex _l(mThemeCacheLock);
+    const size_t N = mThemeCache.size();
+    for (size_t i=0; i<N; i++) {
+        Theme::free_snapshot(mThemeCache[i]);
+    }
+    mThemeCache.clear();
+    mThemeCacheGeneration++;
+}
+
+void ResTable::clearFilteredTypesLocked()
+{
+    AutoMutex _l(mFilteredTypesLock);
+    mFilteredTypes.clear();
+}
+
 status_t ResTable::parsePackage(const ResTable_package* const pkg,
                                 const Header* const header, uint32_t idmap_id)
 {
@@ -5357,6 +5845,7 @@ void ResTable::removeAssetsByCookie(const String8 &packageName, void* cookie)
                 pg->packages.removeAt(index);
                 delete pkg;
             }
+            updateFilteredTypes();
             return;
         }
     }
@@ -5375,12 +5864,35 @@ void ResTable::addRedirections(PackageRedirectionMap* resMap)
 {
     // TODO: Replace an existing entry matching the same package.
     mRedirectionMap.add(resMap);
+    updateRedirectionIndex();
+    clearThemeCache();
 }
 
 void ResTable::clearRedirections()
 {
     /* This memory is being managed by strong references at the Java layer. */
     mRedirectionMap.clear();
+    updateRedirectionIndex();
+    clearThemeCache();
+}
+
+void ResTable::updateRedirectionIndex()
+{
+    memset(mRedirectionPackageMap, 0, sizeof(mRedirectionPackageMap));
+    mRedirectionIndexValid = mRedirectionMap.size() < 256;
+
+    const size_t N = mRedirectionMap.size();
+    for (size_t i=0; i<N && mRedirectionIndexValid; i++) {
+        const int p = mRedirectionMap[i]->getPackage();
+        if (p < 0 || p > 0xff) {
+            // No redirections yet, so the package is not known.  Fall back
+            // to scanning the maps on each lookup.
+            mRedirectionIndexValid = false;
+        } else if (mRedirectionPackageMap[p] == 0) {
+            // The first map for a package wins, as with the linear scan.
+            mRedirectionPackageMap[p] = i+1;
+        }
+    }
 }
 
 #ifndef HAVE_ANDROID_OS
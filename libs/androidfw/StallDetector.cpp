@@ -0,0 +1,553 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StallDetector"
+//#define LOG_NDEBUG 0
+
+#include <androidfw/StallDetector.h>
+#include <cutils/atomic.h>
+#include <cutils/debugger.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+// Native backtraces are captured at most this often.
+static const nsecs_t NATIVE_BACKTRACE_INTERVAL = 10 * 1000000000LL;
+
+// Maximum size of the text captured for one stall.
+static const size_t STALL_TEXT_SIZE = 8192;
+
+static const size_t THREAD_NAME_SIZE = 32;
+
+// --- Watched threads ---
+
+struct Watch {
+    // Only written by the watched thread, see setBusy().  The sequence number is odd
+    // while the heartbeat is being updated.
+    volatile int32_t seq;
+    bool busy;
+    nsecs_t busySince;
+
+    // Guarded by gLock.
+    bool used;
+    pid_t tid;
+    char name[THREAD_NAME_SIZE];
+};
+
+struct WatchSnapshot {
+    size_t index;
+    pid_t tid;
+    char name[THREAD_NAME_SIZE];
+    bool busy;
+    nsecs_t busySince;
+};
+
+struct StallRecord {
+    char name[THREAD_NAME_SIZE];
+    pid_t tid;
+    nsecs_t busySince;
+    nsecs_t duration; // as of the last sample, or the first sample after the stall ended
+    bool ongoing;
+    size_t textLength;
+    char text[STALL_TEXT_SIZE];
+};
+
+class StallSampler;
+
+static Mutex gLock;
+static Watch gWatches[StallDetector::MAX_WATCHED_THREADS];
+
+// Allocated by the first start() to keep them out of processes that never sample.
+static StallRecord* gRecords;
+static size_t gRecordCount; // number of stalls recorded so far
+static sp<StallSampler> gSampler;
+
+static pthread_key_t gWatchKey;
+static pthread_once_t gWatchKeyOnce = PTHREAD_ONCE_INIT;
+
+static void setBusy(Watch* watch, bool busy) {
+    watch->seq++;
+    android_memory_barrier();
+    watch->busy = busy;
+    watch->busySince = systemTime(SYSTEM_TIME_MONOTONIC);
+    android_memory_barrier();
+    watch->seq++;
+}
+
+// Called with gLock held.
+static void snapshotWatchLocked(size_t index, WatchSnapshot* outSnapshot) {
+    const Watch& watch = gWatches[index];
+    outSnapshot->index = index;
+    outSnapshot->tid = watch.tid;
+    memcpy(outSnapshot->name, watch.name, THREAD_NAME_SIZE);
+
+    int32_t seq;
+    do {
+        seq = watch.seq;
+        android_memory_barrier();
+        outSnapshot->busy = watch.busy;
+        outSnapshot->busySince = watch.busySince;
+        android_memory_barrier();
+    } while ((seq & 1) || seq != watch.seq);
+}
+
+static void unregisterWatch(Watch* watch) {
+    AutoMutex _l(gLock);
+    watch->used = false;
+}
+
+static void watchKeyDestructor(void* value) {
+    if (value) {
+        unregisterWatch(static_cast<Watch*>(value));
+    }
+}
+
+static void initWatchKey() {
+    pthread_key_create(&gWatchKey, watchKeyDestructor);
+}
+
+static Watch* getCurrentWatch() {
+    pthread_once(&gWatchKeyOnce, initWatchKey);
+    return static_cast<Watch*>(pthread_getspecific(gWatchKey));
+}
+
+// --- Capture ---
+
+static void appendFile(String8& out, const char* path, const char* indent) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        out.appendFormat("%s<unable to open %s: %s>\n", indent, path, strerror(errno));
+        return;
+    }
+
+    String8 contents;
+    char buf[1024];
+    ssize_t nBytes;
+    while ((nBytes = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)))) > 0) {
+        contents.append(buf, nBytes);
+    }
+    close(fd);
+
+    const char* line = contents.string();
+    while (*line) {
+        const char* end = strchr(line, '\n');
+        size_t length = end ? end - line : strlen(line);
+        out.append(indent);
+        out.append(line, length);
+        out.append("\n");
+        line += end ? length + 1 : length;
+    }
+}
+
+// Appends the scheduler state and the wait channel of a thread on one line.  A thread
+// blocked on a mutex or a condition shows up as sleeping in futex_wait_queue_me.
+static void appendThreadState(String8& out, pid_t tid) {
+    char path[64];
+    char buf[256];
+    String8 state("?");
+    String8 wchan("?");
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    FILE* file = fopen(path, "r");
+    if (file) {
+        while (fgets(buf, sizeof(buf), file)) {
+            if (!strncmp(buf, "State:", 6)) {
+                const char* value = buf + 6;
+                value += strspn(value, " \t");
+                state.setTo(value, strcspn(value, "\n"));
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/wchan", tid);
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        ssize_t nBytes = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf) - 1));
+        if (nBytes > 0) {
+            wchan.setTo(buf, nBytes);
+        }
+        close(fd);
+    }
+
+    out.appendFormat("%s, wchan %s", state.string(), wchan.string());
+}
+
+// Asks debuggerd for the native backtraces of the process, stalled thread first.  The
+// pipe does not block so that output that does not fit is simply dropped.
+static void appendNativeBacktrace(String8& out, pid_t tid) {
+    int fds[2];
+    if (pipe(fds)) {
+        out.appendFormat("      <unable to create pipe: %s>\n", strerror(errno));
+        return;
+    }
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    int result = dump_backtrace_to_file(tid, fds[1]);
+    close(fds[1]);
+
+    char buf[1024];
+    ssize_t nBytes;
+    size_t total = 0;
+    while ((nBytes = TEMP_FAILURE_RETRY(read(fds[0], buf, sizeof(buf)))) > 0
+            && total < STALL_TEXT_SIZE) {
+        out.append(buf, nBytes);
+        total += nBytes;
+    }
+    close(fds[0]);
+
+    if (result < 0 && !total) {
+        out.append("      <debuggerd did not return a backtrace>\n");
+    }
+}
+
+// --- StallSampler ---
+
+class StallSampler : public Thread {
+public:
+    StallSampler() : Thread(/*canCallJava*/ false),
+            mSampleInterval(0), mThreshold(0), mNativeBacktraces(false),
+            mLastNativeBacktraceTime(-NATIVE_BACKTRACE_INTERVAL) {
+        memset(mReported, 0, sizeof(mReported));
+    }
+
+    void setParameters(nsecs_t sampleInterval, nsecs_t threshold, bool nativeBacktraces) {
+        AutoMutex _l(mLock);
+        mSampleInterval = sampleInterval;
+        mThreshold = threshold;
+        mNativeBacktraces = nativeBacktraces;
+        mCondition.signal();
+    }
+
+    void getParameters(nsecs_t* outSampleInterval, nsecs_t* outThreshold) {
+        AutoMutex _l(mLock);
+        *outSampleInterval = mSampleInterval;
+        *outThreshold = mThreshold;
+    }
+
+    void stop() {
+        requestExit();
+        { // acquire lock
+            AutoMutex _l(mLock);
+            mCondition.signal();
+        } // release lock
+        join();
+    }
+
+private:
+    // The stall last recorded for each watch slot.
+    struct Reported {
+        bool valid;
+        pid_t tid;
+        nsecs_t busySince;
+        size_t serial; // value of gRecordCount when it was recorded
+    };
+
+    Mutex mLock;
+    Condition mCondition;
+    nsecs_t mSampleInterval;
+    nsecs_t mThreshold;
+    bool mNativeBacktraces;
+
+    // Only used by the sampler thread.
+    nsecs_t mLastNativeBacktraceTime;
+    Reported mReported[StallDetector::MAX_WATCHED_THREADS];
+
+    virtual bool threadLoop() {
+        nsecs_t threshold;
+        bool nativeBacktraces;
+        { // acquire lock
+            AutoMutex _l(mLock);
+            if (!exitPending()) {
+                mCondition.waitRelative(mLock, mSampleInterval);
+            }
+            threshold = mThreshold;
+            nativeBacktraces = mNativeBacktraces;
+        } // release lock
+
+        if (exitPending()) {
+            return false;
+        }
+        sample(threshold, nativeBacktraces);
+        return true;
+    }
+
+    void sample(nsecs_t threshold, bool nativeBacktraces) {
+        WatchSnapshot snapshots[StallDetector::MAX_WATCHED_THREADS];
+        bool used[StallDetector::MAX_WATCHED_THREADS];
+        size_t count = 0;
+        nsecs_t now;
+        { // acquire lock
+            AutoMutex _l(gLock);
+            now = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (size_t i = 0; i < StallDetector::MAX_WATCHED_THREADS; i++) {
+                used[i] = gWatches[i].used;
+                if (used[i]) {
+                    snapshotWatchLocked(i, &snapshots[count++]);
+                }
+            }
+        } // release lock
+
+        // A thread that exits or unregisters while stalled ends its stall.  When it
+        // happened is not known, so the duration is left as of the last sample.
+        for (size_t i = 0; i < StallDetector::MAX_WATCHED_THREADS; i++) {
+            if (!used[i] && mReported[i].valid) {
+                updateRecord(mReported[i].serial, 0, false);
+                mReported[i].valid = false;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            const WatchSnapshot& snapshot = snapshots[i];
+            Reported& reported = mReported[snapshot.index];
+            bool sameStall = reported.valid && reported.tid == snapshot.tid
+                    && snapshot.busy && reported.busySince == snapshot.busySince;
+
+            if (reported.valid && !sameStall) {
+                updateRecord(reported.serial, now - reported.busySince, false);
+                reported.valid = false;
+            }
+            if (!snapshot.busy || now - snapshot.busySince < threshold) {
+                continue;
+            }
+
+            if (sameStall) {
+                updateRecord(reported.serial, now - snapshot.busySince, true);
+            } else {
+                reported.valid = true;
+                reported.tid = snapshot.tid;
+                reported.busySince = snapshot.busySince;
+                reported.serial = record(snapshot, snapshots, count, now, nativeBacktraces);
+            }
+        }
+    }
+
+    size_t record(const WatchSnapshot& stalled, const WatchSnapshot* snapshots, size_t count,
+            nsecs_t now, bool nativeBacktraces) {
+        nsecs_t duration = now - stalled.busySince;
+        ALOGW("Thread '%s' (tid %d) has been busy for %lldms",
+                stalled.name, stalled.tid, nanoseconds_to_milliseconds(duration));
+
+        char path[64];
+        String8 text;
+        text.append("      State: ");
+        appendThreadState(text, stalled.tid);
+        text.append("\n      Kernel stack:\n");
+        snprintf(path, sizeof(path), "/proc/self/task/%d/stack", stalled.tid);
+        appendFile(text, path, "        ");
+
+        bool hasOthers = false;
+        for (size_t i = 0; i < count; i++) {
+            const WatchSnapshot& other = snapshots[i];
+            if (other.index == stalled.index) {
+                continue;
+            }
+            if (!hasOthers) {
+                text.append("      Other watched threads:\n");
+                hasOthers = true;
+            }
+            text.appendFormat("        '%s' tid=%d: ", other.name, other.tid);
+            if (other.busy) {
+                text.appendFormat("busy for %lldms, ",
+                        nanoseconds_to_milliseconds(now - other.busySince));
+            } else {
+                text.append("idle, ");
+            }
+            appendThreadState(text, other.tid);
+            text.append("\n");
+        }
+
+        if (nativeBacktraces && now - mLastNativeBacktraceTime >= NATIVE_BACKTRACE_INTERVAL) {
+            mLastNativeBacktraceTime = now;
+            text.append("      Native backtraces:\n");
+            appendNativeBacktrace(text, stalled.tid);
+        }
+
+        AutoMutex _l(gLock);
+        size_t serial = gRecordCount++;
+        StallRecord& record = gRecords[serial % StallDetector::MAX_RECORDED_STALLS];
+        memcpy(record.name, stalled.name, THREAD_NAME_SIZE);
+        record.tid = stalled.tid;
+        record.busySince = stalled.busySince;
+        record.duration = duration;
+        record.ongoing = true;
+        record.textLength = text.size() < STALL_TEXT_SIZE ? text.size() : STALL_TEXT_SIZE;
+        memcpy(record.text, text.string(), record.textLength);
+        return serial;
+    }
+
+    void updateRecord(size_t serial, nsecs_t duration, bool ongoing) {
+        AutoMutex _l(gLock);
+        if (gRecordCount - serial > StallDetector::MAX_RECORDED_STALLS) {
+            return; // overwritten since
+        }
+        StallRecord& record = gRecords[serial % StallDetector::MAX_RECORDED_STALLS];
+        if (duration > record.duration) {
+            record.duration = duration;
+        }
+        record.ongoing = ongoing;
+    }
+};
+
+// --- StallDetector ---
+
+status_t StallDetector::registerThread(const char* name) {
+    Watch* watch = getCurrentWatch();
+
+    AutoMutex _l(gLock);
+    if (!watch) {
+        for (size_t i = 0; i < MAX_WATCHED_THREADS; i++) {
+            if (!gWatches[i].used) {
+                watch = &gWatches[i];
+                break;
+            }
+        }
+        if (!watch) {
+            ALOGW("Unable to watch thread '%s', all %d slots are in use",
+                    name, MAX_WATCHED_THREADS);
+            return NO_MEMORY;
+        }
+    }
+
+    setBusy(watch, true);
+    watch->used = true;
+    watch->tid = gettid();
+    snprintf(watch->name, sizeof(watch->name), "%s", name);
+    pthread_setspecific(gWatchKey, watch);
+    return OK;
+}
+
+void StallDetector::unregisterThread() {
+    Watch* watch = getCurrentWatch();
+    if (watch) {
+        pthread_setspecific(gWatchKey, NULL);
+        unregisterWatch(watch);
+    }
+}
+
+void StallDetector::beginWork() {
+    Watch* watch = getCurrentWatch();
+    if (watch && !watch->busy) {
+        setBusy(watch, true);
+    }
+}
+
+void StallDetector::endWork() {
+    Watch* watch = getCurrentWatch();
+    if (watch && watch->busy) {
+        setBusy(watch, false);
+    }
+}
+
+status_t StallDetector::start(nsecs_t sampleInterval, nsecs_t threshold,
+        bool nativeBacktraces) {
+    if (sampleInterval <= 0 || threshold <= 0) {
+        return BAD_VALUE;
+    }
+
+    AutoMutex _l(gLock);
+    if (gSampler != NULL) {
+        gSampler->setParameters(sampleInterval, threshold, nativeBacktraces);
+        return OK;
+    }
+
+    if (!gRecords) {
+        gRecords = new StallRecord[MAX_RECORDED_STALLS];
+    }
+
+    sp<StallSampler> sampler = new StallSampler();
+    sampler->setParameters(sampleInterval, threshold, nativeBacktraces);
+    status_t result = sampler->run("StallDetector", PRIORITY_URGENT_DISPLAY);
+    if (result) {
+        ALOGE("Could not start stall detector thread due to error %d.", result);
+        return result;
+    }
+    gSampler = sampler;
+    return OK;
+}
+
+void StallDetector::stop() {
+    sp<StallSampler> sampler;
+    { // acquire lock
+        AutoMutex _l(gLock);
+        sampler = gSampler;
+        gSampler.clear();
+    } // release lock
+
+    // The sampler acquires gLock itself, so it must be joined without holding it.
+    if (sampler != NULL) {
+        sampler->stop();
+    }
+}
+
+void StallDetector::dump(int fd) {
+    String8 dump;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    gLock.lock();
+    if (gSampler != NULL) {
+        nsecs_t sampleInterval, threshold;
+        gSampler->getParameters(&sampleInterval, &threshold);
+        dump.appendFormat("Stall detector: threshold %lldms, sampled every %lldms\n",
+                nanoseconds_to_milliseconds(threshold),
+                nanoseconds_to_milliseconds(sampleInterval));
+    } else {
+        dump.append("Stall detector: stopped\n");
+    }
+
+    dump.append("  Watched threads:\n");
+    for (size_t i = 0; i < MAX_WATCHED_THREADS; i++) {
+        if (!gWatches[i].used) {
+            continue;
+        }
+        WatchSnapshot snapshot;
+        snapshotWatchLocked(i, &snapshot);
+        if (snapshot.busy) {
+            dump.appendFormat("    '%s' tid=%d: busy for %lldms\n", snapshot.name, snapshot.tid,
+                    nanoseconds_to_milliseconds(now - snapshot.busySince));
+        } else {
+            dump.appendFormat("    '%s' tid=%d: idle\n", snapshot.name, snapshot.tid);
+        }
+    }
+
+    size_t kept = gRecordCount;
+    if (kept > MAX_RECORDED_STALLS) {
+        kept = MAX_RECORDED_STALLS;
+    }
+    dump.appendFormat("  Recorded stalls: %d total, last %d kept\n", int(gRecordCount), int(kept));
+    for (size_t serial = gRecordCount - kept; serial < gRecordCount; serial++) {
+        const StallRecord& record = gRecords[serial % MAX_RECORDED_STALLS];
+        dump.appendFormat("    '%s' tid=%d: busy for %lldms, started %lldms ago%s\n",
+                record.name, record.tid, nanoseconds_to_milliseconds(record.duration),
+                nanoseconds_to_milliseconds(now - record.busySince),
+                record.ongoing ? " (ongoing)" : "");
+        dump.append(record.text, record.textLength);
+    }
+    gLock.unlock();
+
+    write(fd, dump.string(), dump.size());
+}
+
+} // namespace android
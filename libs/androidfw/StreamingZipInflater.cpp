@@ -45,6 +45,8 @@ StreamingZipInflater::StreamingZipInflater(int fd, off64_t compDataStart,
     mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
     mOutBuf = new uint8_t[mOutBufSize];
 
+    mCheckpointInterval = 0;
+
     initInflateState();
 }
 
@@ -63,6 +65,8 @@ StreamingZipInflater::StreamingZipInflater(FileMap* dataMap, size_t uncompSize)
     mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
     mOutBuf = new uint8_t[mOutBufSize];
 
+    mCheckpointInterval = 0;
+
     initInflateState();
 }
 
@@ -70,6 +74,10 @@ StreamingZipInflater::~StreamingZipInflater() {
     // tear down the in-flight zip state just in case
     ::inflateEnd(&mInflateState);
 
+    for (size_t i = 0; i < mCheckpoints.size(); i++) {
+        ::inflateEnd(&mCheckpoints.editItemAt(i).state);
+    }
+
     if (mDataMap == NULL) {
         delete [] mInBuf;
     }
@@ -179,6 +187,15 @@ ssize_t StreamingZipInflater::read(void* outBuf, size_t count) {
                 // Note how much data we got, and off we go
                 mOutDeliverable = 0;
                 mOutLastDecoded = mOutBufSize - mInflateState.avail_out;
+
+                if (result != Z_STREAM_END && mCheckpointInterval > 0) {
+                    off64_t next = mCheckpoints.isEmpty() ? 0
+                            : mCheckpoints.top().outPosition;
+                    next += mCheckpointInterval;
+                    if (off64_t(mInflateState.total_out) >= next) {
+                        addCheckpoint();
+                    }
+                }
             }
         }
     }
@@ -207,10 +224,74 @@ int StreamingZipInflater::readNextChunk() {
     return 0;
 }
 
+void StreamingZipInflater::setCheckpointInterval(size_t interval) {
+    mCheckpointInterval = interval;
+}
+
+void StreamingZipInflater::addCheckpoint() {
+    Checkpoint checkpoint;
+    checkpoint.outPosition = mInflateState.total_out;
+    if (mDataMap == NULL) {
+        checkpoint.inOffset = mInNextChunkOffset - mInflateState.avail_in;
+    } else {
+        checkpoint.inOffset = mInflateState.next_in - mInBuf;
+    }
+    if (::inflateCopy(&checkpoint.state, &mInflateState) != Z_OK) {
+        ALOGW("Unable to save inflate checkpoint at %lld",
+                (long long) checkpoint.outPosition);
+        return;
+    }
+    ALOGV("Saved inflate checkpoint at %lld (input %d)",
+            (long long) checkpoint.outPosition, (int) checkpoint.inOffset);
+    mCheckpoints.push(checkpoint);
+}
+
+bool StreamingZipInflater::restoreCheckpoint(const Checkpoint& checkpoint) {
+    if (!mStreamNeedsInit) {
+        ::inflateEnd(&mInflateState);
+    }
+    if (::inflateCopy(&mInflateState, const_cast<z_stream*>(&checkpoint.state)) != Z_OK) {
+        initInflateState();
+        return false;
+    }
+    mStreamNeedsInit = false;
+
+    mOutCurPosition = checkpoint.outPosition;
+    mOutLastDecoded = mOutDeliverable = 0;
+
+    if (mDataMap == NULL) {
+        // the input buffer no longer holds the checkpoint's data; refill it
+        // from the saved offset on the next read
+        mInNextChunkOffset = checkpoint.inOffset;
+        ::lseek(mFd, mInFileStart + checkpoint.inOffset, SEEK_SET);
+        mInflateState.avail_in = 0;
+    } else {
+        mInflateState.next_in = (Bytef*) mInBuf + checkpoint.inOffset;
+        mInflateState.avail_in = mInBufSize - checkpoint.inOffset;
+    }
+    return true;
+}
+
 // seeking backwards requires uncompressing fom the beginning, so is very
-// expensive.  seeking forwards only requires uncompressing from the current
-// position to the destination.
+// expensive unless a checkpoint lies at or before the destination.  seeking
+// forwards only requires uncompressing from the current position (or from a
+// later checkpoint) to the destination.
 off64_t StreamingZipInflater::seekAbsolute(off64_t absoluteInputPosition) {
+    // resume from the nearest checkpoint at or before the destination if that
+    // saves decoding, either because we're going backwards or it's further along
+    ssize_t best = -1;
+    for (size_t i = 0; i < mCheckpoints.size()
+            && mCheckpoints[i].outPosition <= absoluteInputPosition; i++) {
+        best = i;
+    }
+    if (best >= 0 && (absoluteInputPosition < mOutCurPosition
+            || mCheckpoints[best].outPosition > mOutCurPosition)) {
+        if (restoreCheckpoint(mCheckpoints[best])) {
+            read(NULL, absoluteInputPosition - mOutCurPosition);
+            return absoluteInputPosition;
+        }
+    }
+
     if (absoluteInputPosition < mOutCurPosition) {
         // rewind and reprocess the data from the beginning
         if (!mStreamNeedsInit) {
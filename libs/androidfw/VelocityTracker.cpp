@@ -389,6 +389,42 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
     }
 }
 
+/**
+ * Calculates the coefficient of determination of the polynomial B with n coefficients
+ * for the data points X and Y weighted by W, as 1 - (SSerr / SStot) where SSerr is the
+ * residual sum of squares (variance of the error), and SStot is the total sum of
+ * squares (variance of the data) where each has been weighted.
+ */
+static float calculateDetermination(const float* x, const float* y,
+        const float* w, uint32_t m, uint32_t n, const float* b) {
+    float ymean = 0;
+    for (uint32_t h = 0; h < m; h++) {
+        ymean += y[h];
+    }
+    ymean /= m;
+
+    float sserr = 0;
+    float sstot = 0;
+    for (uint32_t h = 0; h < m; h++) {
+        float err = y[h] - b[0];
+        float term = 1;
+        for (uint32_t i = 1; i < n; i++) {
+            term *= x[h];
+            err -= term * b[i];
+        }
+        sserr += w[h] * w[h] * err * err;
+        float var = y[h] - ymean;
+        sstot += w[h] * w[h] * var * var;
+    }
+    float det = sstot > 0.000001f ? 1.0f - (sserr / sstot) : 1;
+#if DEBUG_STRATEGY
+    ALOGD("  - sserr=%f", sserr);
+    ALOGD("  - sstot=%f", sstot);
+    ALOGD("  - det=%f", det);
+#endif
+    return det;
+}
+
 /**
  * Solves a linear least squares problem to obtain a N degree polynomial that fits
  * the specified input data as nearly as possible.
@@ -523,35 +559,95 @@ static bool solveLeastSquares(const float* x, const float* y,
     ALOGD("  - b=%s", vectorToString(outB, n).string());
 #endif
 
-    // Calculate the coefficient of determination as 1 - (SSerr / SStot) where
-    // SSerr is the residual sum of squares (variance of the error),
-    // and SStot is the total sum of squares (variance of the data) where each
-    // has been weighted.
-    float ymean = 0;
+    *outDet = calculateDetermination(x, y, w, m, n, outB);
+    return true;
+}
+
+/**
+ * Solves the same problem as solveLeastSquares() for a polynomial of degree 1 or 2
+ * (n = 2 or 3), fitting both Y and Z against X at once.
+ *
+ * Rather than factoring A, this function accumulates the weighted power sums
+ * S[k] = sum(W[i]^2 X[i]^k) and solves the normal equations (At A) B = At W Y
+ * in closed form.  At A only depends on X and W so it is shared by both coordinates,
+ * and the whole fit is a single pass over the data without any temporary matrices.
+ * The sums are accumulated in double precision because the normal equations square
+ * the condition number of the problem.
+ *
+ * The Gram-Schmidt process in solveLeastSquares() gives up when a column of A is
+ * within a norm of 0.000001 of the span of the previous columns.  The squared norm
+ * of that residual is the ratio of successive leading principal minors of At A,
+ * so the same test is applied here to reject the same degenerate inputs.
+ */
+static bool solveLeastSquaresClosedForm(const float* x, const float* y, const float* z,
+        const float* w, uint32_t m, uint32_t n, float* outYB, float* outZB,
+        float* outYDet, float* outZDet) {
+    double s[5] = { 0, 0, 0, 0, 0 };
+    double sy[3] = { 0, 0, 0 };
+    double sz[3] = { 0, 0, 0 };
     for (uint32_t h = 0; h < m; h++) {
-        ymean += y[h];
+        double ww = double(w[h]) * w[h];
+        double t = x[h];
+        double t2 = t * t;
+        s[0] += ww;
+        s[1] += ww * t;
+        s[2] += ww * t2;
+        sy[0] += ww * y[h];
+        sy[1] += ww * y[h] * t;
+        sz[0] += ww * z[h];
+        sz[1] += ww * z[h] * t;
+        if (n == 3) {
+            s[3] += ww * t2 * t;
+            s[4] += ww * t2 * t2;
+            sy[2] += ww * y[h] * t2;
+            sz[2] += ww * z[h] * t2;
+        }
     }
-    ymean /= m;
 
-    float sserr = 0;
-    float sstot = 0;
-    for (uint32_t h = 0; h < m; h++) {
-        float err = y[h] - outB[0];
-        float term = 1;
-        for (uint32_t i = 1; i < n; i++) {
-            term *= x[h];
-            err -= term * outB[i];
+    const double minSquaredNorm = 0.000001 * 0.000001;
+    double det2 = s[0] * s[2] - s[1] * s[1];
+    if (s[0] < minSquaredNorm || det2 < minSquaredNorm * s[0]) {
+#if DEBUG_STRATEGY
+        ALOGD("solveLeastSquaresClosedForm: no solution, s0=%f, det2=%g", s[0], det2);
+#endif
+        return false;
+    }
+
+    if (n == 2) {
+        outYB[0] = float((s[2] * sy[0] - s[1] * sy[1]) / det2);
+        outYB[1] = float((s[0] * sy[1] - s[1] * sy[0]) / det2);
+        outZB[0] = float((s[2] * sz[0] - s[1] * sz[1]) / det2);
+        outZB[1] = float((s[0] * sz[1] - s[1] * sz[0]) / det2);
+    } else {
+        // At A is symmetric, and so is its adjugate.
+        double a00 = s[2] * s[4] - s[3] * s[3];
+        double a01 = s[2] * s[3] - s[1] * s[4];
+        double a02 = s[1] * s[3] - s[2] * s[2];
+        double a11 = s[0] * s[4] - s[2] * s[2];
+        double a12 = s[1] * s[2] - s[0] * s[3];
+        double a22 = det2;
+        double det3 = s[0] * a00 + s[1] * a01 + s[2] * a02;
+        if (det3 < minSquaredNorm * det2) {
+#if DEBUG_STRATEGY
+            ALOGD("solveLeastSquaresClosedForm: no solution, det2=%g, det3=%g", det2, det3);
+#endif
+            return false;
         }
-        sserr += w[h] * w[h] * err * err;
-        float var = y[h] - ymean;
-        sstot += w[h] * w[h] * var * var;
+
+        outYB[0] = float((a00 * sy[0] + a01 * sy[1] + a02 * sy[2]) / det3);
+        outYB[1] = float((a01 * sy[0] + a11 * sy[1] + a12 * sy[2]) / det3);
+        outYB[2] = float((a02 * sy[0] + a12 * sy[1] + a22 * sy[2]) / det3);
+        outZB[0] = float((a00 * sz[0] + a01 * sz[1] + a02 * sz[2]) / det3);
+        outZB[1] = float((a01 * sz[0] + a11 * sz[1] + a12 * sz[2]) / det3);
+        outZB[2] = float((a02 * sz[0] + a12 * sz[1] + a22 * sz[2]) / det3);
     }
-    *outDet = sstot > 0.000001f ? 1.0f - (sserr / sstot) : 1;
 #if DEBUG_STRATEGY
-    ALOGD("  - sserr=%f", sserr);
-    ALOGD("  - sstot=%f", sstot);
-    ALOGD("  - det=%f", *outDet);
+    ALOGD("solveLeastSquaresClosedForm: m=%d, n=%d, yb=%s, zb=%s", int(m), int(n),
+            vectorToString(outYB, n).string(), vectorToString(outZB, n).string());
 #endif
+
+    *outYDet = calculateDetermination(x, y, w, m, n, outYB);
+    *outZDet = calculateDetermination(x, z, w, m, n, outZB);
     return true;
 }
 
@@ -598,8 +694,12 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
     if (degree >= 1) {
         float xdet, ydet;
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        bool solved = degree <= 2
+                ? solveLeastSquaresClosedForm(time, x, y, w, m, n,
+                        outEstimator->xCoeff, outEstimator->yCoeff, &xdet, &ydet)
+                : solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
+                        && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet);
+        if (solved) {
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = degree;
             outEstimator->confidence = xdet * ydet;
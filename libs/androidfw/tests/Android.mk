@@ -4,10 +4,15 @@ include $(CLEAR_VARS)
 
 # Build the unit tests.
 test_src_files := \
+    CursorWindow_test.cpp \
     InputChannel_test.cpp \
     InputEvent_test.cpp \
     InputPublisherAndConsumer_test.cpp \
-    ObbFile_test.cpp
+    KeyLayoutMap_test.cpp \
+    ObbFile_test.cpp \
+    StallDetector_test.cpp \
+    StreamingZipInflater_test.cpp \
+    VelocityTracker_test.cpp
 
 shared_libraries := \
 	libandroidfw \
@@ -16,7 +21,8 @@ shared_libraries := \
 	libbinder \
 	libui \
 	libstlport \
-	libskia
+	libskia \
+	libz
 
 static_libraries := \
 	libgtest \
@@ -42,5 +48,17 @@ $(foreach file,$(test_src_files), \
     $(eval include $(BUILD_EXECUTABLE)) \
 )
 
+# Build the resource lookup benchmark. It is not a gtest; run it by hand,
+# optionally with the APKs whose resource tables should be measured.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := ResourceBenchmark.cpp
+LOCAL_SHARED_LIBRARIES := \
+	libandroidfw \
+	libcutils \
+	libutils
+LOCAL_MODULE := ResourceBenchmark
+LOCAL_MODULE_TAGS := $(module_tags)
+include $(BUILD_EXECUTABLE)
+
 # Build the manual test programs.
 include $(call all-makefiles-under, $(LOCAL_PATH))
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CursorWindow_test"
+#include <androidfw/CursorWindow.h>
+#include <utils/String8.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class CursorWindowTest : public testing::Test {
+protected:
+    CursorWindow* mWindow;
+
+    virtual void SetUp() {
+        ASSERT_EQ(OK, CursorWindow::create(String8("test"), 2 * 1024 * 1024, &mWindow));
+        ASSERT_EQ(OK, mWindow->setNumColumns(1));
+    }
+
+    virtual void TearDown() {
+        delete mWindow;
+    }
+};
+
+TEST_F(CursorWindowTest, ManyRows) {
+    // Enough rows to span many chunks and grow the chunk directory.
+    const uint32_t numRows = 10000;
+    for (uint32_t i = 0; i < numRows; i++) {
+        ASSERT_EQ(OK, mWindow->allocRow());
+        ASSERT_EQ(OK, mWindow->putLong(i, 0, i * 3));
+    }
+    ASSERT_EQ(numRows, mWindow->getNumRows());
+
+    for (uint32_t i = numRows; i-- > 0; ) {
+        CursorWindow::FieldSlot* slot = mWindow->getFieldSlot(i, 0);
+        ASSERT_TRUE(slot != NULL);
+        ASSERT_EQ(CursorWindow::FIELD_TYPE_INTEGER, mWindow->getFieldSlotType(slot));
+        ASSERT_EQ(int64_t(i * 3), mWindow->getFieldSlotValueLong(slot));
+    }
+    EXPECT_TRUE(mWindow->getFieldSlot(numRows, 0) == NULL);
+}
+
+TEST_F(CursorWindowTest, FreeLastRowReusesChunk) {
+    for (uint32_t i = 0; i < 101; i++) {
+        ASSERT_EQ(OK, mWindow->allocRow());
+    }
+    ASSERT_EQ(OK, mWindow->freeLastRow());
+    ASSERT_EQ(OK, mWindow->allocRow());
+    ASSERT_EQ(OK, mWindow->putLong(100, 0, 42));
+
+    CursorWindow::FieldSlot* slot = mWindow->getFieldSlot(100, 0);
+    ASSERT_TRUE(slot != NULL);
+    EXPECT_EQ(42, mWindow->getFieldSlotValueLong(slot));
+}
+
+} // namespace android
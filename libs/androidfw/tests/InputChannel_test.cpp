@@ -22,6 +22,8 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#include <sys/socket.h>
+#include <cutils/ashmem.h>
 
 #include "TestHelpers.h"
 
@@ -154,5 +156,59 @@ TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
             << "sendMessage should have returned DEAD_OBJECT";
 }
 
+TEST_F(InputChannelTest, RingChannels_ExchangeMessagesThroughSharedMemory) {
+    int sockets[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets));
+    int ringFd = ashmem_create_region("input channel test", 128 * 1024);
+    ASSERT_GE(ringFd, 0);
+
+    sp<InputChannel> serverChannel = new InputChannel(String8("server"), sockets[0],
+            ringFd, true /*isRingServer*/);
+    sp<InputChannel> clientChannel = new InputChannel(String8("client"), sockets[1],
+            dup(ringFd), false /*isRingServer*/);
+
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg))
+            << "receiveMessage should have returned WOULD_BLOCK before anything was sent";
+
+    // Send enough messages for the ring to wrap around several times.
+    for (uint32_t i = 0; i < 2000; i++) {
+        InputMessage serverMsg;
+        memset(&serverMsg, 0, sizeof(InputMessage));
+        serverMsg.header.type = InputMessage::TYPE_KEY;
+        serverMsg.body.key.seq = i + 1;
+        ASSERT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+                << "server channel should be able to send message through the ring";
+
+        InputMessage clientMsg;
+        ASSERT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+                << "client channel should be able to receive message through the ring";
+        ASSERT_EQ(InputMessage::TYPE_KEY, clientMsg.header.type);
+        ASSERT_EQ(i + 1, clientMsg.body.key.seq)
+                << "client channel should receive messages in order";
+
+        InputMessage clientReply;
+        memset(&clientReply, 0, sizeof(InputMessage));
+        clientReply.header.type = InputMessage::TYPE_FINISHED;
+        clientReply.body.finished.seq = i + 1;
+        clientReply.body.finished.handled = true;
+        ASSERT_EQ(OK, clientChannel->sendMessage(&clientReply))
+                << "client channel should be able to reply through the ring";
+
+        InputMessage serverReply;
+        ASSERT_EQ(OK, serverChannel->receiveMessage(&serverReply))
+                << "server channel should be able to receive the reply through the ring";
+        ASSERT_EQ(InputMessage::TYPE_FINISHED, serverReply.header.type);
+        ASSERT_EQ(i + 1, serverReply.body.finished.seq);
+    }
+
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg))
+            << "receiveMessage should have returned WOULD_BLOCK after draining the ring";
+
+    serverChannel.clear();
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessage(&msg))
+            << "receiveMessage should have returned DEAD_OBJECT after the peer was closed";
+}
+
 
 } // namespace android
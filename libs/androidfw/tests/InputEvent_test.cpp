@@ -326,18 +326,19 @@ void MotionEventTest::assertEqualsEventWithHistory(const MotionEvent* event) {
     ASSERT_EQ(ARBITRARY_EVENT_TIME + 1, event->getHistoricalEventTime(1));
     ASSERT_EQ(ARBITRARY_EVENT_TIME + 2, event->getEventTime());
 
-    ASSERT_EQ(11, event->getHistoricalRawPointerCoords(0, 0)->
-            getAxisValue(AMOTION_EVENT_AXIS_Y));
-    ASSERT_EQ(21, event->getHistoricalRawPointerCoords(1, 0)->
-            getAxisValue(AMOTION_EVENT_AXIS_Y));
-    ASSERT_EQ(111, event->getHistoricalRawPointerCoords(0, 1)->
-            getAxisValue(AMOTION_EVENT_AXIS_Y));
-    ASSERT_EQ(121, event->getHistoricalRawPointerCoords(1, 1)->
-            getAxisValue(AMOTION_EVENT_AXIS_Y));
-    ASSERT_EQ(211, event->getRawPointerCoords(0)->
-            getAxisValue(AMOTION_EVENT_AXIS_Y));
-    ASSERT_EQ(221, event->getRawPointerCoords(1)->
-            getAxisValue(AMOTION_EVENT_AXIS_Y));
+    PointerCoords rawPointerCoords;
+    event->getHistoricalRawPointerCoords(0, 0, &rawPointerCoords);
+    ASSERT_EQ(11, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
+    event->getHistoricalRawPointerCoords(1, 0, &rawPointerCoords);
+    ASSERT_EQ(21, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
+    event->getHistoricalRawPointerCoords(0, 1, &rawPointerCoords);
+    ASSERT_EQ(111, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
+    event->getHistoricalRawPointerCoords(1, 1, &rawPointerCoords);
+    ASSERT_EQ(121, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
+    event->getRawPointerCoords(0, &rawPointerCoords);
+    ASSERT_EQ(211, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
+    event->getRawPointerCoords(1, &rawPointerCoords);
+    ASSERT_EQ(221, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
 
     ASSERT_EQ(11, event->getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_Y, 0, 0));
     ASSERT_EQ(21, event->getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_Y, 1, 0));
@@ -504,6 +505,41 @@ TEST_F(MotionEventTest, Scale) {
     ASSERT_EQ(218, event.getOrientation(0));
 }
 
+TEST_F(MotionEventTest, SparseAxes) {
+    PointerProperties pointerProperties[2];
+    PointerCoords pointerCoords[2];
+    for (size_t i = 0; i < 2; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+        pointerCoords[i].clear();
+    }
+    pointerCoords[0].setAxisValue(AMOTION_EVENT_AXIS_X, 10);
+    pointerCoords[0].setAxisValue(AMOTION_EVENT_AXIS_GENERIC_16, 16);
+    pointerCoords[1].setAxisValue(AMOTION_EVENT_AXIS_Y, 21);
+
+    MotionEvent event;
+    event.initialize(2, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0,
+            0, 0, 1, 1, ARBITRARY_DOWN_TIME, ARBITRARY_EVENT_TIME,
+            2, pointerProperties, pointerCoords);
+    pointerCoords[1].setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 1);
+    event.addSample(ARBITRARY_EVENT_TIME + 1, pointerCoords);
+
+    ASSERT_EQ(1U, event.getHistorySize());
+    ASSERT_EQ(10, event.getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_X, 0, 0));
+    ASSERT_EQ(0, event.getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_Y, 0, 0));
+    ASSERT_EQ(16, event.getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_GENERIC_16, 0, 0));
+    ASSERT_EQ(21, event.getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_Y, 1, 0));
+    ASSERT_EQ(0, event.getHistoricalRawAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 1, 0));
+    ASSERT_EQ(1, event.getRawAxisValue(AMOTION_EVENT_AXIS_PRESSURE, 1));
+    ASSERT_EQ(21, event.getRawAxisValue(AMOTION_EVENT_AXIS_Y, 1));
+
+    PointerCoords rawPointerCoords;
+    event.getRawPointerCoords(1, &rawPointerCoords);
+    ASSERT_EQ(pointerCoords[1].bits, rawPointerCoords.bits);
+    ASSERT_EQ(1, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_PRESSURE));
+    ASSERT_EQ(21, rawPointerCoords.getAxisValue(AMOTION_EVENT_AXIS_Y));
+}
+
 TEST_F(MotionEventTest, Parcel) {
     Parcel parcel;
 
@@ -284,4 +284,50 @@ TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
 }
 
+TEST_F(InputPublisherAndConsumerTest, PublishBatch_SendsAllEventsInOrderWhenEnded) {
+    status_t status;
+    mPublisher->beginBatch();
+    for (uint32_t seq = 1; seq <= InputPublisher::MAX_BATCH_SIZE; seq++) {
+        status = mPublisher->publishKeyEvent(seq, 1, AINPUT_SOURCE_KEYBOARD,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 30, 0, 0, 3, 4);
+        ASSERT_EQ(OK, status)
+                << "publisher publishKeyEvent should return OK while the batch has room";
+    }
+    EXPECT_TRUE(mPublisher->isBatchFull())
+            << "batch should be full after MAX_BATCH_SIZE events";
+
+    status = mPublisher->publishKeyEvent(99, 1, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, 30, 0, 0, 3, 4);
+    ASSERT_EQ(NO_MEMORY, status)
+            << "publisher publishKeyEvent should return NO_MEMORY when the batch is full";
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event);
+    ASSERT_EQ(WOULD_BLOCK, status)
+            << "consumer should not see batched events before the batch is ended";
+
+    size_t sentCount;
+    status = mPublisher->endBatch(&sentCount);
+    ASSERT_EQ(OK, status)
+            << "publisher endBatch should return OK";
+    ASSERT_EQ(InputPublisher::MAX_BATCH_SIZE, sentCount)
+            << "publisher endBatch should have sent every queued event";
+
+    for (uint32_t seq = 1; seq <= InputPublisher::MAX_BATCH_SIZE; seq++) {
+        status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event);
+        ASSERT_EQ(OK, status)
+                << "consumer consume should return OK";
+        ASSERT_EQ(AINPUT_EVENT_TYPE_KEY, event->getType())
+                << "consumer should have returned a key event";
+        EXPECT_EQ(seq, consumeSeq)
+                << "consumer should receive batched events in order";
+    }
+
+    status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event);
+    ASSERT_EQ(WOULD_BLOCK, status)
+            << "consumer should have consumed every batched event";
+}
+
 } // namespace android
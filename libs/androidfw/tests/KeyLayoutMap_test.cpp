@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/KeyLayoutMap.h>
+#include <android/keycodes.h>
+#include <androidfw/Input.h>
+#include <utils/String8.h>
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace android {
+
+static const char* TEST_LAYOUT =
+        "# Test layout\n"
+        "key 30 A\n"
+        "key 48 B WAKE\n"
+        "key 158 BACK VIRTUAL\n"
+        "key usage 0x0c0067 ENTER\n"
+        "axis 0x00 X\n"
+        "axis 0x01 invert Y\n"
+        "axis 0x02 split 0x7f LTRIGGER RTRIGGER flat 4\n";
+
+class KeyLayoutMapTest : public testing::Test {
+protected:
+    String8 mFilename;
+    String8 mCompiledFilename;
+
+    virtual void SetUp() {
+        const char* tmpDir = getenv("TMPDIR");
+        mFilename = String8::format("%s/KeyLayoutMap_test_%d.kl",
+                tmpDir ? tmpDir : "/data/local/tmp", getpid());
+        mCompiledFilename = mFilename;
+        mCompiledFilename.append("c");
+
+        FILE* file = fopen(mFilename.string(), "w");
+        ASSERT_TRUE(file != NULL) << "Couldn't create " << mFilename.string();
+        fputs(TEST_LAYOUT, file);
+        fclose(file);
+    }
+
+    virtual void TearDown() {
+        unlink(mFilename.string());
+        unlink(mCompiledFilename.string());
+    }
+
+    // Makes the compiled file newer than the text file.
+    void touchCompiled() {
+        struct utimbuf times;
+        times.actime = times.modtime = time(NULL) + 10;
+        utime(mCompiledFilename.string(), &times);
+    }
+
+    static void assertMapsTestLayout(const sp<KeyLayoutMap>& map) {
+        int32_t keyCode;
+        uint32_t flags;
+        ASSERT_EQ(NO_ERROR, map->mapKey(48, 0, &keyCode, &flags));
+        ASSERT_EQ(AKEYCODE_B, keyCode);
+        ASSERT_EQ(POLICY_FLAG_WAKE, flags);
+        ASSERT_EQ(NO_ERROR, map->mapKey(30, 0x0c0067, &keyCode, &flags))
+                << "Usage codes should take precedence over scan codes.";
+        ASSERT_EQ(AKEYCODE_ENTER, keyCode);
+        ASSERT_EQ(NAME_NOT_FOUND, map->mapKey(31, 0, &keyCode, &flags));
+        ASSERT_EQ(AKEYCODE_UNKNOWN, keyCode);
+
+        Vector<int32_t> scanCodes;
+        ASSERT_EQ(NO_ERROR, map->findScanCodesForKey(AKEYCODE_BACK, &scanCodes));
+        ASSERT_EQ(size_t(1), scanCodes.size());
+        ASSERT_EQ(158, scanCodes[0]);
+
+        AxisInfo axisInfo;
+        ASSERT_EQ(NO_ERROR, map->mapAxis(0x02, &axisInfo));
+        ASSERT_EQ(AxisInfo::MODE_SPLIT, axisInfo.mode);
+        ASSERT_EQ(AMOTION_EVENT_AXIS_LTRIGGER, axisInfo.axis);
+        ASSERT_EQ(AMOTION_EVENT_AXIS_RTRIGGER, axisInfo.highAxis);
+        ASSERT_EQ(0x7f, axisInfo.splitValue);
+        ASSERT_EQ(4, axisInfo.flatOverride);
+        ASSERT_EQ(NO_ERROR, map->mapAxis(0x01, &axisInfo));
+        ASSERT_EQ(AxisInfo::MODE_INVERT, axisInfo.mode);
+        ASSERT_EQ(NAME_NOT_FOUND, map->mapAxis(0x03, &axisInfo));
+    }
+};
+
+TEST_F(KeyLayoutMapTest, Load_WhenCompiledFormIsCurrent_MapsTheSameAsTheText) {
+    sp<KeyLayoutMap> parsedMap;
+    ASSERT_EQ(NO_ERROR, KeyLayoutMap::parse(mFilename, &parsedMap));
+    assertMapsTestLayout(parsedMap);
+
+    ASSERT_EQ(NO_ERROR, parsedMap->compile(mCompiledFilename));
+    touchCompiled();
+
+    // Change the text so that we can tell which form was loaded.
+    FILE* file = fopen(mFilename.string(), "w");
+    fputs("key 1 ESCAPE\n", file);
+    fclose(file);
+    struct utimbuf times;
+    times.actime = times.modtime = time(NULL) - 10;
+    utime(mFilename.string(), &times);
+
+    sp<KeyLayoutMap> loadedMap;
+    ASSERT_EQ(NO_ERROR, KeyLayoutMap::load(mFilename, &loadedMap));
+    assertMapsTestLayout(loadedMap);
+}
+
+TEST_F(KeyLayoutMapTest, Load_WhenCompiledFormIsCorrupt_ParsesTheText) {
+    FILE* file = fopen(mCompiledFilename.string(), "w");
+    fputs("not a compiled key layout", file);
+    fclose(file);
+    touchCompiled();
+
+    sp<KeyLayoutMap> map;
+    ASSERT_EQ(NO_ERROR, KeyLayoutMap::load(mFilename, &map));
+    assertMapsTestLayout(map);
+}
+
+TEST_F(KeyLayoutMapTest, Load_WhenAlreadyLoaded_SharesTheMap) {
+    sp<KeyLayoutMap> first, second;
+    ASSERT_EQ(NO_ERROR, KeyLayoutMap::load(mFilename, &first));
+    ASSERT_EQ(NO_ERROR, KeyLayoutMap::load(mFilename, &second));
+    ASSERT_EQ(first.get(), second.get());
+}
+
+} // namespace android
@@ -24,6 +24,7 @@
 
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 namespace android {
 
@@ -97,4 +98,28 @@ TEST_F(ObbFileTest, WriteThenRead) {
             << "salts should be the same";
 }
 
+TEST_F(ObbFileTest, WriteThenRemove) {
+    int fd = ::open(mFileName, O_RDWR | O_TRUNC);
+    ASSERT_GE(fd, 0) << "couldn't open fake .obb file";
+
+    const char contents[] = "not really a filesystem image";
+    ASSERT_EQ((ssize_t)sizeof(contents), write(fd, contents, sizeof(contents)));
+
+    mObbFile->setPackageName(String8("com.example.obbfile"));
+    mObbFile->setVersion(2);
+    EXPECT_TRUE(mObbFile->writeTo(fd))
+            << "couldn't write to fake .obb file";
+
+    mObbFile = new ObbFile();
+    EXPECT_TRUE(mObbFile->removeFrom(fd))
+            << "couldn't remove footer from fake .obb file";
+
+    EXPECT_EQ((off64_t)sizeof(contents), lseek64(fd, 0, SEEK_END))
+            << "removing the footer should restore the original contents";
+    EXPECT_FALSE(mObbFile->readFrom(fd))
+            << "footer should be gone";
+
+    close(fd);
+}
+
 }
@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Measures the resource lookups done by applications against real resource
+// tables. The APKs given on the command line (framework-res.apk by default)
+// are loaded in one AssetManager; every resource they define is then looked
+// up in each of the selected configurations, from one or more threads.
+//
+// For each operation the benchmark reports the latency percentiles of a
+// single call, computed over batches of calls, and the combined throughput
+// of all the threads.
+//
+
+#define LOG_TAG "ResourceBenchmark"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <androidfw/Asset.h>
+#include <androidfw/AssetDir.h>
+#include <androidfw/AssetManager.h>
+#include <androidfw/ResourceTypes.h>
+#include <utils/Log.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+#define DEFAULT_APK_PATH "/system/framework/framework-res.apk"
+#define DEFAULT_ITERATIONS 2000
+#define DEFAULT_CONFIG_COUNT 3
+// Calls timed together, so the cost of reading the clock does not dominate
+#define BATCH_SIZE 16
+#define MAX_THREADS 16
+
+// ----------------------------------------------------------------------------
+
+/**
+ * Everything looked up by the benchmarks, collected once from the table.
+ */
+struct Workload {
+    AssetManager* assets;
+    const ResTable* table;
+
+    Vector<uint32_t> resourceIds;
+    Vector<uint32_t> bagIds;
+    Vector<uint32_t> styleIds;
+    // Fully qualified names, package:type/entry
+    Vector<String16> names;
+    // Compiled XML files of the table, loaded in memory
+    Vector<String8> xmlFiles;
+    Vector<Asset*> xmlAssets;
+    // Files under assets/
+    Vector<String8> assetFiles;
+};
+
+/**
+ * State owned by each benchmark thread.
+ */
+struct ThreadState {
+    ThreadState(const ResTable& table): theme(table) {
+    }
+
+    ResTable::Theme theme;
+};
+
+typedef size_t (*BenchmarkOp)(const Workload& workload, ThreadState& state, size_t index);
+typedef size_t (*BenchmarkSize)(const Workload& workload);
+
+struct Benchmark {
+    const char* name;
+    BenchmarkSize size;
+    BenchmarkOp op;
+};
+
+// ----------------------------------------------------------------------------
+// Operations; each returns a value derived from its result so the calls can
+// not be optimized away.
+
+static size_t getResource(const Workload& w, ThreadState& state, size_t index) {
+    Res_value value;
+    ssize_t block = w.table->getResource(w.resourceIds[index], &value, true);
+    return block >= 0 ? value.data : 0;
+}
+
+static size_t getBagLocked(const Workload& w, ThreadState& state, size_t index) {
+    const ResTable::bag_entry* bag;
+    w.table->lock();
+    ssize_t count = w.table->getBagLocked(w.bagIds[index], &bag);
+    w.table->unlock();
+    return count >= 0 ? count : 0;
+}
+
+static size_t applyStyle(const Workload& w, ThreadState& state, size_t index) {
+    return state.theme.applyStyle(w.styleIds[index], true) == NO_ERROR;
+}
+
+static size_t identifierForName(const Workload& w, ThreadState& state, size_t index) {
+    const String16& name = w.names[index];
+    return w.table->identifierForName(name.string(), name.size());
+}
+
+static size_t stringAt(const Workload& w, ThreadState& state, size_t index) {
+    size_t len = 0;
+    w.table->getTableStringBlock(0)->stringAt(index, &len);
+    return len;
+}
+
+static size_t parseXml(const Workload& w, ThreadState& state, size_t index) {
+    Asset* asset = w.xmlAssets[index];
+    ResXMLTree tree;
+    if (tree.setTo(asset->getBuffer(true), asset->getLength(), false) != NO_ERROR) {
+        return 0;
+    }
+
+    size_t events = 0;
+    ResXMLParser::event_code_t code;
+    while ((code = tree.next()) != ResXMLParser::END_DOCUMENT &&
+            code != ResXMLParser::BAD_DOCUMENT) {
+        events++;
+    }
+    return events;
+}
+
+static size_t openAsset(const Workload& w, ThreadState& state, size_t index) {
+    Asset* asset = w.assets->open(w.assetFiles[index].string(), Asset::ACCESS_STREAMING);
+    if (!asset) return 0;
+    size_t length = asset->getLength();
+    delete asset;
+    return length;
+}
+
+static size_t openNonAsset(const Workload& w, ThreadState& state, size_t index) {
+    Asset* asset = w.assets->openNonAsset(w.xmlFiles[index].string(), Asset::ACCESS_STREAMING);
+    if (!asset) return 0;
+    size_t length = asset->getLength();
+    delete asset;
+    return length;
+}
+
+static size_t resourceCount(const Workload& w) { return w.resourceIds.size(); }
+static size_t bagCount(const Workload& w) { return w.bagIds.size(); }
+static size_t styleCount(const Workload& w) { return w.styleIds.size(); }
+static size_t nameCount(const Workload& w) { return w.names.size(); }
+static size_t stringCount(const Workload& w) {
+    return w.table->getTableCount() > 0 ? w.table->getTableStringBlock(0)->size() : 0;
+}
+static size_t xmlCount(const Workload& w) { return w.xmlAssets.size(); }
+static size_t assetCount(const Workload& w) { return w.assetFiles.size(); }
+static size_t xmlFileCount(const Workload& w) { return w.xmlFiles.size(); }
+
+static const Benchmark gBenchmarks[] = {
+    { "ResTable::getResource", resourceCount, getResource },
+    { "ResTable::getBagLocked", bagCount, getBagLocked },
+    { "Theme::applyStyle", styleCount, applyStyle },
+    { "ResTable::identifierForName", nameCount, identifierForName },
+    { "ResStringPool::stringAt", stringCount, stringAt },
+    { "ResXMLParser::next (document)", xmlCount, parseXml },
+    { "AssetManager::open", assetCount, openAsset },
+    { "AssetManager::openNonAsset", xmlFileCount, openNonAsset },
+};
+static const size_t gBenchmarkCount = sizeof(gBenchmarks) / sizeof(gBenchmarks[0]);
+
+// ----------------------------------------------------------------------------
+// Workload collection
+
+static bool isBagType(const String16& type) {
+    return type == String16("style") || type == String16("array") ||
+            type == String16("plurals") || type == String16("attr") ||
+            type == String16("declare-styleable");
+}
+
+static void collectResources(Workload& w) {
+    const ResTable& table = *w.table;
+
+    for (size_t p = 0; p < table.getBasePackageCount(); p++) {
+        const uint32_t packageId = table.getBasePackageId(p);
+        // Type identifiers start at 1 and are dense
+        for (uint32_t t = 1; t <= 0xff; t++) {
+            uint32_t e = 0;
+            for (; e <= 0xffff; e++) {
+                const uint32_t resID = (packageId << 24) | (t << 16) | e;
+                ResTable::resource_name name;
+                if (!table.getResourceName(resID, &name)) break;
+
+                const String16 type(name.type, name.typeLen);
+                if (isBagType(type)) {
+                    w.bagIds.add(resID);
+                    if (type == String16("style")) {
+                        w.styleIds.add(resID);
+                    }
+                } else {
+                    w.resourceIds.add(resID);
+                }
+
+                String16 fullName(name.package, name.packageLen);
+                fullName.append(String16(":"));
+                fullName.append(type);
+                fullName.append(String16("/"));
+                fullName.append(String16(name.name, name.nameLen));
+                w.names.add(fullName);
+
+                // Layouts, drawables, etc. that are compiled XML files
+                Res_value value;
+                ssize_t block = table.getResource(resID, &value, true);
+                if (block >= 0 && value.dataType == Res_value::TYPE_STRING) {
+                    size_t len;
+                    const char16_t* path = table.getTableStringBlock(block)->stringAt(
+                            value.data, &len);
+                    if (path) {
+                        String8 file(String16(path, len));
+                        if (file.getPathExtension() == ".xml") {
+                            w.xmlFiles.add(file);
+                        }
+                    }
+                }
+            }
+            if (e == 0) break;
+        }
+    }
+
+    for (size_t i = 0; i < w.xmlFiles.size(); i++) {
+        Asset* asset = w.assets->openNonAsset(w.xmlFiles[i].string(), Asset::ACCESS_BUFFER);
+        // The buffer is mapped now, the threads then share it read-only
+        if (asset && asset->getBuffer(true)) {
+            w.xmlAssets.add(asset);
+        } else {
+            delete asset;
+        }
+    }
+}
+
+static void collectAssets(Workload& w, const String8& dirName) {
+    AssetDir* dir = w.assets->openDir(dirName.string());
+    if (!dir) return;
+
+    for (size_t i = 0; i < dir->getFileCount(); i++) {
+        String8 path(dirName);
+        path.appendPath(dir->getFileName(i));
+        if (dir->getFileType(i) == kFileTypeDirectory) {
+            collectAssets(w, path);
+        } else {
+            w.assetFiles.add(path);
+        }
+    }
+    delete dir;
+}
+
+// ----------------------------------------------------------------------------
+// Runner
+
+struct RunInfo {
+    const Workload* workload;
+    const Benchmark* benchmark;
+    size_t iterations;
+    size_t threadIndex;
+    size_t threadCount;
+    // Time of each batch divided by BATCH_SIZE, filled in by the thread
+    nsecs_t* samples;
+    size_t checksum;
+};
+
+static void* benchmarkThread(void* cookie) {
+    RunInfo* info = (RunInfo*) cookie;
+    const Workload& w = *info->workload;
+    const size_t count = info->benchmark->size(w);
+    ThreadState state(*w.table);
+
+    // Threads start at different offsets so they don't walk the same entries
+    size_t index = info->threadIndex * count / info->threadCount;
+    size_t checksum = 0;
+    for (size_t i = 0; i < info->iterations; i++) {
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            checksum += info->benchmark->op(w, state, index);
+            if (++index >= count) index = 0;
+        }
+        info->samples[i] = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / BATCH_SIZE;
+    }
+    info->checksum = checksum;
+    return NULL;
+}
+
+static int compareSamples(const void* lhs, const void* rhs) {
+    const nsecs_t a = *(const nsecs_t*) lhs;
+    const nsecs_t b = *(const nsecs_t*) rhs;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static void runBenchmark(const Workload& w, const Benchmark& benchmark,
+        size_t iterations, size_t threadCount) {
+    const size_t count = benchmark.size(w);
+    if (count == 0) {
+        printf("  %-32s %2zu thread(s)   (nothing to look up)\n", benchmark.name, threadCount);
+        return;
+    }
+
+    const size_t sampleCount = iterations * threadCount;
+    nsecs_t* samples = new nsecs_t[sampleCount];
+    RunInfo infos[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t started = 0;
+    for (size_t i = 0; i < threadCount; i++) {
+        RunInfo& info = infos[i];
+        info.workload = &w;
+        info.benchmark = &benchmark;
+        info.iterations = iterations;
+        info.threadIndex = i;
+        info.threadCount = threadCount;
+        info.samples = samples + i * iterations;
+        info.checksum = 0;
+        if (threadCount == 1) {
+            benchmarkThread(&info);
+            started = 1;
+        } else if (pthread_create(&threads[i], NULL, benchmarkThread, &info) == 0) {
+            started++;
+        } else {
+            break;
+        }
+    }
+    for (size_t i = 0; threadCount > 1 && i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    if (started < threadCount) {
+        fprintf(stderr, "Could only start %zu of %zu threads\n", started, threadCount);
+        delete[] samples;
+        return;
+    }
+
+    qsort(samples, sampleCount, sizeof(nsecs_t), compareSamples);
+    const double opsPerSecond = elapsed > 0 ?
+            double(sampleCount) * BATCH_SIZE * 1000000000.0 / elapsed : 0.0;
+
+    printf("  %-32s %2zu thread(s)  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f us"
+            "  %10.0f ops/s\n", benchmark.name, threadCount,
+            samples[sampleCount / 2] / 1000.0, samples[sampleCount * 9 / 10] / 1000.0,
+            samples[sampleCount * 99 / 100] / 1000.0, samples[sampleCount - 1] / 1000.0,
+            opsPerSecond);
+
+    delete[] samples;
+}
+
+// ----------------------------------------------------------------------------
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-i iterations] [-c configs] [-t threads[,threads...]] "
+            "[-b benchmark] [apk...]\n", program);
+    fprintf(stderr, "  -i: batches of %d calls timed per thread (default %d)\n",
+            BATCH_SIZE, DEFAULT_ITERATIONS);
+    fprintf(stderr, "  -c: number of the table's configurations to run, "
+            "besides the default one (default %d)\n", DEFAULT_CONFIG_COUNT);
+    fprintf(stderr, "  -t: thread counts to run, up to %d (default 1)\n", MAX_THREADS);
+    fprintf(stderr, "  -b: only run the benchmarks whose name contains this string\n");
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+    size_t configCount = DEFAULT_CONFIG_COUNT;
+    Vector<size_t> threadCounts;
+    const char* filter = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:c:t:b:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'c':
+                configCount = atoi(optarg);
+                break;
+            case 't': {
+                char* s = optarg;
+                while (*s) {
+                    char* end;
+                    long n = strtol(s, &end, 10);
+                    if (end == s || n <= 0 || n > MAX_THREADS) {
+                        usage(argv[0]);
+                        return 1;
+                    }
+                    threadCounts.add(n);
+                    s = *end == ',' ? end + 1 : end;
+                }
+                break;
+            }
+            case 'b':
+                filter = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threadCounts.isEmpty()) {
+        threadCounts.add(1);
+    }
+
+    AssetManager assets;
+    if (optind == argc) {
+        if (!assets.addAssetPath(String8(DEFAULT_APK_PATH), NULL)) {
+            fprintf(stderr, "Could not load %s\n", DEFAULT_APK_PATH);
+            return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!assets.addAssetPath(String8(argv[i]), NULL)) {
+            fprintf(stderr, "Could not load %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Workload workload;
+    workload.assets = &assets;
+    workload.table = &assets.getResources();
+    if (workload.table->getError() != NO_ERROR) {
+        fprintf(stderr, "Could not load the resource table\n");
+        return 1;
+    }
+
+    const nsecs_t collectStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    collectResources(workload);
+    collectAssets(workload, String8(""));
+    printf("Collected %zu values, %zu bags, %zu styles, %zu XML files and %zu assets "
+            "in %.1f ms\n", workload.resourceIds.size(), workload.bagIds.size(),
+            workload.styleIds.size(), workload.xmlAssets.size(), workload.assetFiles.size(),
+            (systemTime(SYSTEM_TIME_MONOTONIC) - collectStart) / 1000000.0);
+
+    // The default configuration, then the ones the table has resources for
+    Vector<ResTable_config> configs;
+    ResTable_config config;
+    memset(&config, 0, sizeof(config));
+    config.size = sizeof(config);
+    configs.add(config);
+
+    Vector<ResTable_config> tableConfigs;
+    workload.table->getConfigurations(&tableConfigs);
+    for (size_t i = 0; i < tableConfigs.size() && configs.size() <= configCount; i++) {
+        bool known = false;
+        for (size_t j = 0; j < configs.size() && !known; j++) {
+            known = tableConfigs[i].compare(configs[j]) == 0;
+        }
+        if (!known) {
+            configs.add(tableConfigs[i]);
+        }
+    }
+
+    for (size_t c = 0; c < configs.size(); c++) {
+        assets.setConfiguration(configs[c]);
+        String8 name = configs[c].toString();
+        printf("\nConfiguration %s:\n", name.isEmpty() ? "default" : name.string());
+
+        for (size_t b = 0; b < gBenchmarkCount; b++) {
+            if (filter && !strstr(gBenchmarks[b].name, filter)) continue;
+            for (size_t t = 0; t < threadCounts.size(); t++) {
+                runBenchmark(workload, gBenchmarks[b], iterations, threadCounts[t]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < workload.xmlAssets.size(); i++) {
+        delete workload.xmlAssets[i];
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/StallDetector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+// Sampling parameters of the tests, small enough for the tests to run quickly.
+static const nsecs_t SAMPLE_INTERVAL = milliseconds_to_nanoseconds(2);
+static const nsecs_t THRESHOLD = milliseconds_to_nanoseconds(20);
+
+// Long enough for the sampler to see a stall, or to see that it has ended.
+static const useconds_t STALL_USEC = 60 * 1000;
+static const useconds_t SETTLE_USEC = 30 * 1000;
+
+class StallDetectorTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        ASSERT_EQ(OK, StallDetector::start(SAMPLE_INTERVAL, THRESHOLD, false));
+    }
+
+    virtual void TearDown() {
+        StallDetector::unregisterThread();
+        StallDetector::stop();
+    }
+
+    static String8 dump() {
+        String8 result;
+        FILE* file = tmpfile();
+        if (!file) {
+            return result;
+        }
+        StallDetector::dump(fileno(file));
+        rewind(file);
+        char buf[1024];
+        size_t nBytes;
+        while ((nBytes = fread(buf, 1, sizeof(buf), file)) > 0) {
+            result.append(buf, nBytes);
+        }
+        fclose(file);
+        return result;
+    }
+
+    // Returns the number of stalls recorded since the process started, which the
+    // tests compare before and after as the recorded stalls are process wide.
+    static int recordedStalls(const String8& dump) {
+        const char* line = strstr(dump.string(), "Recorded stalls: ");
+        int total = -1;
+        if (line) {
+            sscanf(line, "Recorded stalls: %d total", &total);
+        }
+        return total;
+    }
+
+    static int recordedStalls() {
+        return recordedStalls(dump());
+    }
+
+    static bool hasState(const char* name, const char* state) {
+        String8 line = String8::format("'%s' tid=%d: %s", name, gettid(), state);
+        return strstr(dump().string(), line.string()) != NULL;
+    }
+
+    static void stall() {
+        StallDetector::beginWork();
+        usleep(STALL_USEC);
+        StallDetector::endWork();
+        usleep(SETTLE_USEC);
+    }
+};
+
+TEST_F(StallDetectorTest, HeartbeatsOfUnregisteredThreadAreIgnored) {
+    int before = recordedStalls();
+
+    stall();
+
+    EXPECT_EQ(before, recordedStalls())
+            << "A thread that is not watched should never be recorded";
+}
+
+TEST_F(StallDetectorTest, BeginWorkAndEndWorkUpdateState) {
+    ASSERT_EQ(OK, StallDetector::registerThread("test-busy"));
+
+    EXPECT_TRUE(hasState("test-busy", "busy for "))
+            << "Thread should be busy once registered";
+
+    StallDetector::endWork();
+    EXPECT_TRUE(hasState("test-busy", "idle\n"))
+            << "Thread should be idle after endWork()";
+
+    StallDetector::beginWork();
+    EXPECT_TRUE(hasState("test-busy", "busy for "))
+            << "Thread should be busy after beginWork()";
+
+    StallDetector::unregisterThread();
+    EXPECT_FALSE(hasState("test-busy", ""))
+            << "Unregistered thread should no longer be listed";
+}
+
+TEST_F(StallDetectorTest, StallLongerThanThresholdIsRecordedOnce) {
+    ASSERT_EQ(OK, StallDetector::registerThread("test-stall"));
+    StallDetector::endWork();
+    int before = recordedStalls();
+
+    stall();
+
+    String8 result = dump();
+    EXPECT_EQ(before + 1, recordedStalls(result))
+            << "A stall should be recorded once, however many samples see it";
+    EXPECT_TRUE(strstr(result.string(), "(ongoing)") == NULL)
+            << "The stall should have ended with endWork()";
+}
+
+TEST_F(StallDetectorTest, IdleOrShortWorkIsNotRecorded) {
+    ASSERT_EQ(OK, StallDetector::registerThread("test-idle"));
+    StallDetector::endWork();
+    int before = recordedStalls();
+
+    usleep(STALL_USEC);
+    StallDetector::beginWork();
+    StallDetector::endWork();
+    usleep(SETTLE_USEC);
+
+    EXPECT_EQ(before, recordedStalls())
+            << "Idle threads and work under the threshold should not be recorded";
+}
+
+TEST_F(StallDetectorTest, UnregisteringEndsStall) {
+    ASSERT_EQ(OK, StallDetector::registerThread("test-exit"));
+    StallDetector::endWork();
+    int before = recordedStalls();
+
+    StallDetector::beginWork();
+    usleep(STALL_USEC);
+    StallDetector::unregisterThread();
+    usleep(SETTLE_USEC);
+
+    String8 result = dump();
+    EXPECT_EQ(before + 1, recordedStalls(result));
+    EXPECT_TRUE(strstr(result.string(), "(ongoing)") == NULL)
+            << "The stall of a thread that is no longer watched should have ended";
+}
+
+TEST_F(StallDetectorTest, RingBufferKeepsMostRecentStalls) {
+    ASSERT_EQ(OK, StallDetector::registerThread("test-ring"));
+    StallDetector::endWork();
+    int before = recordedStalls();
+
+    const int stalls = StallDetector::MAX_RECORDED_STALLS + 2;
+    for (int i = 0; i < stalls; i++) {
+        stall();
+    }
+
+    String8 result = dump();
+    EXPECT_EQ(before + stalls, recordedStalls(result));
+
+    String8 kept = String8::format("last %d kept", int(StallDetector::MAX_RECORDED_STALLS));
+    EXPECT_TRUE(strstr(result.string(), kept.string()) != NULL)
+            << "Only the most recent stalls should be kept";
+
+    size_t records = 0;
+    for (const char* s = result.string(); (s = strstr(s, "'test-ring' tid=")); s++) {
+        records++;
+    }
+    // Once in the watched threads, then once per recorded stall
+    EXPECT_EQ(size_t(1 + StallDetector::MAX_RECORDED_STALLS), records);
+}
+
+TEST_F(StallDetectorTest, StartRejectsBadParameters) {
+    EXPECT_EQ(BAD_VALUE, StallDetector::start(0, THRESHOLD, false));
+    EXPECT_EQ(BAD_VALUE, StallDetector::start(SAMPLE_INTERVAL, 0, false));
+}
+
+} // namespace android
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/StreamingZipInflater.h>
+#include <utils/Vector.h>
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace android {
+
+// Several checkpoints worth of data, and not a multiple of the output chunk size.
+static const size_t DATA_SIZE = 3 * StreamingZipInflater::CHECKPOINT_INTERVAL + 12345;
+
+// A small interval so that the tests also cover checkpoints within an output chunk.
+static const size_t SMALL_INTERVAL = 100 * 1000;
+
+class StreamingZipInflaterTest : public testing::Test {
+protected:
+    Vector<uint8_t> mData;
+    FILE* mCompressedFile;
+    size_t mCompressedSize;
+
+    virtual void SetUp() {
+        // Compressible but not trivially so, so that the input spans many chunks.
+        mData.insertAt(0, 0, DATA_SIZE);
+        uint32_t seed = 1;
+        for (size_t i = 0; i < DATA_SIZE; i++) {
+            seed = seed * 1103515245 + 12345;
+            mData.editItemAt(i) = uint8_t((seed >> 16) & 0x3f);
+        }
+
+        mCompressedFile = tmpfile();
+        ASSERT_TRUE(mCompressedFile != NULL);
+        ASSERT_NO_FATAL_FAILURE(deflateData());
+    }
+
+    virtual void TearDown() {
+        if (mCompressedFile) {
+            fclose(mCompressedFile);
+        }
+    }
+
+    // Writes the data as a raw deflate stream, the way zip entries store it.
+    void deflateData() {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        ASSERT_EQ(Z_OK, deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                -MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+
+        stream.next_in = (Bytef*) mData.array();
+        stream.avail_in = mData.size();
+        mCompressedSize = 0;
+        uint8_t buf[64 * 1024];
+        int result;
+        do {
+            stream.next_out = buf;
+            stream.avail_out = sizeof(buf);
+            result = deflate(&stream, Z_FINISH);
+            ASSERT_NE(Z_STREAM_ERROR, result);
+            size_t count = sizeof(buf) - stream.avail_out;
+            ASSERT_EQ(count, fwrite(buf, 1, count, mCompressedFile));
+            mCompressedSize += count;
+        } while (result != Z_STREAM_END);
+        deflateEnd(&stream);
+        fflush(mCompressedFile);
+    }
+
+    StreamingZipInflater* createInflater(size_t checkpointInterval) {
+        StreamingZipInflater* inflater = new StreamingZipInflater(fileno(mCompressedFile),
+                0, DATA_SIZE, mCompressedSize);
+        inflater->setCheckpointInterval(checkpointInterval);
+        return inflater;
+    }
+
+    void assertReadsAt(StreamingZipInflater* inflater, off64_t position, size_t count) {
+        ASSERT_EQ(position, inflater->seekAbsolute(position));
+        uint8_t buf[4096];
+        ASSERT_LE(count, sizeof(buf));
+        ASSERT_EQ(ssize_t(count), inflater->read(buf, count))
+                << "Short read at " << position;
+        ASSERT_EQ(0, memcmp(buf, mData.array() + position, count))
+                << "Wrong data at " << position;
+    }
+
+    void assertReadsAll(StreamingZipInflater* inflater) {
+        uint8_t buf[10000];
+        size_t total = 0;
+        ssize_t count;
+        while ((count = inflater->read(buf, sizeof(buf))) > 0) {
+            ASSERT_EQ(0, memcmp(buf, mData.array() + total, count))
+                    << "Wrong data at " << total;
+            total += count;
+        }
+        ASSERT_EQ(DATA_SIZE, total);
+    }
+};
+
+TEST_F(StreamingZipInflaterTest, ReadsWholeEntryWithCheckpoints) {
+    StreamingZipInflater* inflater = createInflater(SMALL_INTERVAL);
+    ASSERT_NO_FATAL_FAILURE(assertReadsAll(inflater));
+    delete inflater;
+}
+
+TEST_F(StreamingZipInflaterTest, SeeksBackwardsToCheckpoints) {
+    StreamingZipInflater* inflater = createInflater(StreamingZipInflater::CHECKPOINT_INTERVAL);
+    ASSERT_NO_FATAL_FAILURE(assertReadsAll(inflater));
+
+    // Right at, just before and just after checkpoints, then the very start.
+    const off64_t interval = StreamingZipInflater::CHECKPOINT_INTERVAL;
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 2 * interval + 100, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 2 * interval, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 2 * interval - 1, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, interval + 1, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 0, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, DATA_SIZE - 1000, 1000));
+    delete inflater;
+}
+
+TEST_F(StreamingZipInflaterTest, SeeksForwardsPastCheckpoints) {
+    StreamingZipInflater* inflater = createInflater(SMALL_INTERVAL);
+    ASSERT_NO_FATAL_FAILURE(assertReadsAll(inflater));
+
+    // Go back to the start, then skip over several checkpoints at once.
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 10, 100));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 7 * SMALL_INTERVAL + 3, 4000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 20 * SMALL_INTERVAL + 77, 4000));
+    delete inflater;
+}
+
+TEST_F(StreamingZipInflaterTest, SeeksWithoutCheckpoints) {
+    StreamingZipInflater* inflater = createInflater(0);
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, 2 * SMALL_INTERVAL, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, SMALL_INTERVAL, 1000));
+    ASSERT_NO_FATAL_FAILURE(assertReadsAt(inflater, DATA_SIZE - 10, 10));
+    delete inflater;
+}
+
+} // namespace android
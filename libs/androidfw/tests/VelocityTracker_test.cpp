@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/VelocityTracker.h>
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class VelocityTrackerTest : public testing::Test {
+protected:
+    virtual void SetUp() { }
+    virtual void TearDown() { }
+
+    // Adds samples of pointer 0 moving along x = vx t + ax t^2, y = vy t + ay t^2
+    // where t is in seconds relative to the last sample.
+    static void addMovements(VelocityTracker& tracker, size_t count, nsecs_t interval,
+            float vx, float ax, float vy, float ay) {
+        BitSet32 idBits;
+        idBits.markBit(0);
+        for (size_t i = 0; i < count; i++) {
+            float t = -float((count - 1 - i) * interval) * 0.000000001f;
+            VelocityTracker::Position position;
+            position.x = 100 + vx * t + ax * t * t;
+            position.y = 200 + vy * t + ay * t * t;
+            tracker.addMovement(i * interval, idBits, &position);
+        }
+    }
+};
+
+TEST_F(VelocityTrackerTest, GetVelocity_Lsq1_RecoversLinearMotion) {
+    VelocityTracker tracker("lsq1");
+    addMovements(tracker, 8, 8 * 1000000LL, 500, 0, -1200, 0);
+
+    float vx, vy;
+    ASSERT_TRUE(tracker.getVelocity(0, &vx, &vy));
+    EXPECT_NEAR(500, vx, 0.5);
+    EXPECT_NEAR(-1200, vy, 0.5);
+}
+
+TEST_F(VelocityTrackerTest, GetVelocity_Lsq2_RecoversQuadraticMotion) {
+    VelocityTracker tracker("lsq2");
+    addMovements(tracker, 10, 8 * 1000000LL, 500, 3000, -1200, -8000);
+
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(tracker.getEstimator(0, &estimator));
+    EXPECT_EQ(2U, estimator.degree);
+    EXPECT_NEAR(100, estimator.xCoeff[0], 0.01);
+    EXPECT_NEAR(500, estimator.xCoeff[1], 0.5);
+    EXPECT_NEAR(3000, estimator.xCoeff[2], 5);
+    EXPECT_NEAR(200, estimator.yCoeff[0], 0.01);
+    EXPECT_NEAR(-1200, estimator.yCoeff[1], 0.5);
+    EXPECT_NEAR(-8000, estimator.yCoeff[2], 5);
+    EXPECT_NEAR(1, estimator.confidence, 0.001);
+}
+
+TEST_F(VelocityTrackerTest, GetEstimator_WhenAllSamplesHaveTheSameTime_ReturnsPosition) {
+    VelocityTracker tracker("lsq2");
+    BitSet32 idBits;
+    idBits.markBit(0);
+    VelocityTracker::Position position;
+    for (int i = 0; i < 4; i++) {
+        position.x = 10 + i;
+        position.y = 20 + i;
+        tracker.addMovement(0, idBits, &position);
+    }
+
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(tracker.getEstimator(0, &estimator));
+    EXPECT_EQ(0U, estimator.degree);
+    EXPECT_EQ(13, estimator.xCoeff[0]);
+    EXPECT_EQ(23, estimator.yCoeff[0]);
+}
+
+} // namespace android
@@ -5,13 +5,17 @@ include $(CLEAR_VARS)
 # defined in the current device/board configuration
 ifeq ($(USE_OPENGL_RENDERER),true)
 	LOCAL_SRC_FILES:= \
+		utils/LinearAllocator.cpp \
 		utils/SortedListImpl.cpp \
+		Animator.cpp \
 		FontRenderer.cpp \
 		GammaFontRenderer.cpp \
 		Caches.cpp \
+		DirtyRegionBuilder.cpp \
 		DisplayListLogBuffer.cpp \
 		DisplayListRenderer.cpp \
 		FboCache.cpp \
+		FrameProfiler.cpp \
 		GradientCache.cpp \
 		LayerCache.cpp \
 		LayerRenderer.cpp \
@@ -20,6 +24,7 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		Patch.cpp \
 		PatchCache.cpp \
 		PathCache.cpp \
+		PathTessellator.cpp \
 		Program.cpp \
 		ProgramCache.cpp \
 		ResourceCache.cpp \
@@ -27,6 +32,7 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		SkiaColorFilter.cpp \
 		SkiaShader.cpp \
 		Snapshot.cpp \
+		Stencil.cpp \
 		TextureCache.cpp \
 		TextDropShadowCache.cpp
 	
@@ -44,6 +50,10 @@ ifeq ($(BOARD_USES_QCOM_HARDWARE),true)
 		hardware/qcom/display/libtilerenderer
 endif
 
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+	LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+
 ifeq ($(TARGET_BOARD_PLATFORM),exynos4)
 	LOCAL_CFLAGS += -DDONT_DISCARD_FRAMEBUFFER
 endif
@@ -51,7 +61,7 @@ endif
 	LOCAL_CFLAGS += -DUSE_OPENGL_RENDERER -DGL_GLEXT_PROTOTYPES
 	LOCAL_CFLAGS += -fvisibility=hidden
 	LOCAL_MODULE_CLASS := SHARED_LIBRARIES
-	LOCAL_SHARED_LIBRARIES := libcutils libutils libGLESv2 libskia libui
+	LOCAL_SHARED_LIBRARIES := libcutils libutils libEGL libGLESv2 libskia libui
 ifeq ($(BOARD_USES_QCOM_HARDWARE),true)
 	LOCAL_SHARED_LIBRARIES += libtilerenderer
 endif
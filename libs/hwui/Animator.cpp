@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <math.h>
+
+#include <utils/Log.h>
+
+#include "Animator.h"
+#include "DisplayListRenderer.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Interpolators
+///////////////////////////////////////////////////////////////////////////////
+
+Interpolator* Interpolator::create(int type, float factor) {
+    switch (type) {
+        case kTypeLinear:
+            return new LinearInterpolator();
+        case kTypeAccelerate:
+            return new AccelerateInterpolator(factor);
+        case kTypeDecelerate:
+            return new DecelerateInterpolator(factor);
+        case kTypeAccelerateDecelerate:
+            return new AccelerateDecelerateInterpolator();
+        case kTypeAnticipate:
+            return new AnticipateInterpolator(factor);
+        case kTypeOvershoot:
+            return new OvershootInterpolator(factor);
+    }
+    ALOGW("Unknown interpolator type %d", type);
+    return NULL;
+}
+
+float AccelerateInterpolator::interpolate(float input) const {
+    if (mFactor == 1.0f) {
+        return input * input;
+    }
+    return powf(input, mDoubleFactor);
+}
+
+float DecelerateInterpolator::interpolate(float input) const {
+    if (mFactor == 1.0f) {
+        return 1.0f - (1.0f - input) * (1.0f - input);
+    }
+    return 1.0f - powf(1.0f - input, mDoubleFactor);
+}
+
+float AccelerateDecelerateInterpolator::interpolate(float input) const {
+    return cosf((input + 1.0f) * M_PI) * 0.5f + 0.5f;
+}
+
+float AnticipateInterpolator::interpolate(float t) const {
+    return t * t * ((mTension + 1.0f) * t - mTension);
+}
+
+float OvershootInterpolator::interpolate(float t) const {
+    t -= 1.0f;
+    return t * t * ((mTension + 1.0f) * t + mTension) + 1.0f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Keyframes
+///////////////////////////////////////////////////////////////////////////////
+
+FloatKeyframeSet::~FloatKeyframeSet() {
+    for (size_t i = 0; i < mKeyframes.size(); i++) {
+        delete mKeyframes[i].interpolator;
+    }
+}
+
+bool FloatKeyframeSet::add(float fraction, float value, Interpolator* interpolator) {
+    if (!(fraction >= 0.0f && fraction <= 1.0f) ||
+            (!mKeyframes.isEmpty() && fraction < mKeyframes.top().fraction)) {
+        ALOGW("Keyframe fraction %f out of order", fraction);
+        delete interpolator;
+        return false;
+    }
+    Keyframe keyframe = { fraction, value, interpolator };
+    mKeyframes.add(keyframe);
+    return true;
+}
+
+float FloatKeyframeSet::interpolate(const Keyframe& prev, const Keyframe& next,
+        float fraction) const {
+    const float interval = next.fraction - prev.fraction;
+    if (interval <= 0.0f) {
+        // Keyframes at the same fraction, the value jumps to the next one
+        return fraction < prev.fraction ? prev.value : next.value;
+    }
+    float intervalFraction = (fraction - prev.fraction) / interval;
+    if (next.interpolator) {
+        intervalFraction = next.interpolator->interpolate(intervalFraction);
+    }
+    return prev.value + intervalFraction * (next.value - prev.value);
+}
+
+float FloatKeyframeSet::getValue(float fraction) const {
+    const size_t count = mKeyframes.size();
+    if (fraction <= 0.0f) {
+        return interpolate(mKeyframes[0], mKeyframes[1], fraction);
+    } else if (fraction >= 1.0f) {
+        return interpolate(mKeyframes[count - 2], mKeyframes[count - 1], fraction);
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        const Keyframe& next = mKeyframes[i];
+        if (fraction < next.fraction) {
+            return interpolate(mKeyframes[i - 1], next, fraction);
+        }
+    }
+    return mKeyframes[count - 1].value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Animator
+///////////////////////////////////////////////////////////////////////////////
+
+PropertyAnimator::PropertyAnimator(Property property): mProperty(property),
+        mInterpolator(new AccelerateDecelerateInterpolator()),
+        mDuration(milliseconds_to_nanoseconds(300)), mStartDelay(0),
+        mRepeatCount(0), mRepeatMode(kRepeatRestart),
+        mStartTime(-1), mIteration(0), mPlayingBackwards(false) {
+}
+
+PropertyAnimator::~PropertyAnimator() {
+    delete mInterpolator;
+}
+
+bool PropertyAnimator::addKeyframe(float fraction, float value, Interpolator* interpolator) {
+    return mKeyframes.add(fraction, value, interpolator);
+}
+
+void PropertyAnimator::setInterpolator(Interpolator* interpolator) {
+    delete mInterpolator;
+    mInterpolator = interpolator ? interpolator : new LinearInterpolator();
+}
+
+bool PropertyAnimator::animate(DisplayList* displayList, nsecs_t time) {
+    if (mKeyframes.size() < 2) {
+        return false;
+    }
+
+    if (mStartTime < 0) {
+        mStartTime = time + mStartDelay;
+    }
+    if (time < mStartTime) {
+        // Still in the start delay, the property keeps its current value
+        return true;
+    }
+
+    bool running = true;
+    float fraction = mDuration > 0 ? float(time - mStartTime) / mDuration : 1.0f;
+    if (fraction >= 1.0f) {
+        if (mRepeatCount == kRepeatInfinite || mIteration < mRepeatCount) {
+            int iterations = int(fraction);
+            if (mRepeatMode == kRepeatReverse && (iterations & 0x1)) {
+                mPlayingBackwards = !mPlayingBackwards;
+            }
+            mIteration += iterations;
+            mStartTime += iterations * mDuration;
+            fraction -= iterations;
+        } else {
+            fraction = 1.0f;
+            running = false;
+        }
+    }
+    if (mPlayingBackwards) {
+        fraction = 1.0f - fraction;
+    }
+
+    setValue(displayList, mKeyframes.getValue(mInterpolator->interpolate(fraction)));
+    return running;
+}
+
+void PropertyAnimator::setValue(DisplayList* displayList, float value) {
+    switch (mProperty) {
+        case kPropertyTranslationX:
+            displayList->setTranslationX(value);
+            break;
+        case kPropertyTranslationY:
+            displayList->setTranslationY(value);
+            break;
+        case kPropertyRotation:
+            displayList->setRotation(value);
+            break;
+        case kPropertyRotationX:
+            displayList->setRotationX(value);
+            break;
+        case kPropertyRotationY:
+            displayList->setRotationY(value);
+            break;
+        case kPropertyScaleX:
+            displayList->setScaleX(value);
+            break;
+        case kPropertyScaleY:
+            displayList->setScaleY(value);
+            break;
+        case kPropertyPivotX:
+            displayList->setPivotX(value);
+            break;
+        case kPropertyPivotY:
+            displayList->setPivotY(value);
+            break;
+        case kPropertyAlpha:
+            displayList->setAlpha(value);
+            break;
+        case kPropertyCount:
+            break;
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_ANIMATOR_H
+#define ANDROID_HWUI_ANIMATOR_H
+
+#include <cutils/compiler.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Interpolators
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Native counterparts of the interpolators of android.view.animation.
+ */
+class Interpolator {
+public:
+    // Must be kept in sync with the Java side
+    enum Type {
+        kTypeLinear = 0,
+        kTypeAccelerate,
+        kTypeDecelerate,
+        kTypeAccelerateDecelerate,
+        kTypeAnticipate,
+        kTypeOvershoot
+    };
+
+    virtual ~Interpolator() { }
+
+    virtual float interpolate(float input) const = 0;
+
+    /**
+     * Creates an interpolator of the given type. The factor is the factor of the
+     * accelerate and decelerate interpolators, or the tension of the anticipate and
+     * overshoot interpolators. Returns NULL for an unknown type.
+     */
+    ANDROID_API static Interpolator* create(int type, float factor);
+}; // class Interpolator
+
+class LinearInterpolator: public Interpolator {
+public:
+    virtual float interpolate(float input) const { return input; }
+}; // class LinearInterpolator
+
+class AccelerateInterpolator: public Interpolator {
+public:
+    AccelerateInterpolator(float factor): mFactor(factor), mDoubleFactor(2.0f * factor) { }
+
+    virtual float interpolate(float input) const;
+
+private:
+    float mFactor;
+    float mDoubleFactor;
+}; // class AccelerateInterpolator
+
+class DecelerateInterpolator: public Interpolator {
+public:
+    DecelerateInterpolator(float factor): mFactor(factor), mDoubleFactor(2.0f * factor) { }
+
+    virtual float interpolate(float input) const;
+
+private:
+    float mFactor;
+    float mDoubleFactor;
+}; // class DecelerateInterpolator
+
+class AccelerateDecelerateInterpolator: public Interpolator {
+public:
+    virtual float interpolate(float input) const;
+}; // class AccelerateDecelerateInterpolator
+
+class AnticipateInterpolator: public Interpolator {
+public:
+    AnticipateInterpolator(float tension): mTension(tension) { }
+
+    virtual float interpolate(float input) const;
+
+private:
+    float mTension;
+}; // class AnticipateInterpolator
+
+class OvershootInterpolator: public Interpolator {
+public:
+    OvershootInterpolator(float tension): mTension(tension) { }
+
+    virtual float interpolate(float input) const;
+
+private:
+    float mTension;
+}; // class OvershootInterpolator
+
+///////////////////////////////////////////////////////////////////////////////
+// Keyframes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Float keyframes of an animation, evaluated the same way as FloatKeyframeSet:
+ * the interpolator of a keyframe applies to the interval that ends with it.
+ */
+class FloatKeyframeSet {
+public:
+    FloatKeyframeSet() { }
+    ~FloatKeyframeSet();
+
+    /**
+     * Adds a keyframe. Keyframes must be added by increasing fraction, within [0..1];
+     * returns false and drops the keyframe otherwise. The keyframe takes ownership of
+     * the interpolator, which can be NULL for linear.
+     */
+    bool add(float fraction, float value, Interpolator* interpolator = NULL);
+
+    size_t size() const { return mKeyframes.size(); }
+
+    /**
+     * Returns the value at the given fraction of the animation. Fractions outside of
+     * [0..1] (overshooting interpolators) extrapolate the first or last interval.
+     * There must be at least two keyframes.
+     */
+    float getValue(float fraction) const;
+
+private:
+    struct Keyframe {
+        float fraction;
+        float value;
+        Interpolator* interpolator;
+    };
+
+    float interpolate(const Keyframe& prev, const Keyframe& next, float fraction) const;
+
+    Vector<Keyframe> mKeyframes;
+}; // class FloatKeyframeSet
+
+///////////////////////////////////////////////////////////////////////////////
+// Animator
+///////////////////////////////////////////////////////////////////////////////
+
+class DisplayList;
+
+/**
+ * Animates a float view property of a display list. Animators are run by the display
+ * list each time it is drawn, which writes the animated values directly into its view
+ * properties without going back to Java for every frame.
+ */
+class PropertyAnimator {
+public:
+    // Must be kept in sync with the Java side
+    enum Property {
+        kPropertyTranslationX = 0,
+        kPropertyTranslationY,
+        kPropertyRotation,
+        kPropertyRotationX,
+        kPropertyRotationY,
+        kPropertyScaleX,
+        kPropertyScaleY,
+        kPropertyPivotX,
+        kPropertyPivotY,
+        kPropertyAlpha,
+        kPropertyCount
+    };
+
+    // Same values as ValueAnimator
+    enum RepeatMode {
+        kRepeatRestart = 1,
+        kRepeatReverse = 2
+    };
+    static const int kRepeatInfinite = -1;
+
+    ANDROID_API PropertyAnimator(Property property);
+    ANDROID_API ~PropertyAnimator();
+
+    Property getProperty() const { return mProperty; }
+
+    /**
+     * See FloatKeyframeSet::add()
+     */
+    ANDROID_API bool addKeyframe(float fraction, float value, Interpolator* interpolator = NULL);
+
+    /**
+     * Sets the interpolator applied to the elapsed fraction of the whole animation. The
+     * animator takes ownership of the interpolator. The default is accelerate/decelerate,
+     * as for ValueAnimator.
+     */
+    ANDROID_API void setInterpolator(Interpolator* interpolator);
+
+    ANDROID_API void setDuration(nsecs_t duration) { mDuration = duration; }
+    ANDROID_API void setStartDelay(nsecs_t delay) { mStartDelay = delay; }
+    ANDROID_API void setRepeatCount(int count) { mRepeatCount = count; }
+    ANDROID_API void setRepeatMode(int mode) { mRepeatMode = mode; }
+
+    /**
+     * Sets the property of the display list to its value at the given time. The
+     * animation starts on the first call. Returns false once the animation is done,
+     * after setting the final value.
+     */
+    bool animate(DisplayList* displayList, nsecs_t time);
+
+private:
+    void setValue(DisplayList* displayList, float value);
+
+    Property mProperty;
+    FloatKeyframeSet mKeyframes;
+    Interpolator* mInterpolator;
+
+    nsecs_t mDuration;
+    nsecs_t mStartDelay;
+    int mRepeatCount;
+    int mRepeatMode;
+
+    // Start of the current iteration, -1 until the first frame
+    nsecs_t mStartTime;
+    int mIteration;
+    bool mPlayingBackwards;
+}; // class PropertyAnimator
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_ANIMATOR_H
@@ -16,6 +16,8 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <string.h>
+
 #include <utils/Log.h>
 #include <utils/String8.h>
 
@@ -55,6 +57,44 @@ Caches::Caches(): Singleton<Caches>(), mInitialized(false) {
     mDebugLevel = readDebugLevel();
     ALOGD("Enabling debug mode %d", mDebugLevel);
 
+    char property[PROPERTY_VALUE_MAX];
+    mDeferOps = property_get(PROPERTY_DEFER_OPS, property, "false") > 0 &&
+            !strcmp(property, "true");
+    if (mDeferOps) {
+        INIT_LOGD("  Display list operations will be reordered");
+    }
+
+    mPrefetchTextures = property_get(PROPERTY_TEXTURE_PREFETCH, property, "false") > 0 &&
+            !strcmp(property, "true");
+    if (mPrefetchTextures) {
+        INIT_LOGD("  Textures will be prefetched");
+    }
+
+    mTessellatePaths = property_get(PROPERTY_PATH_TESSELLATION, property, "false") > 0 &&
+            !strcmp(property, "true");
+    if (mTessellatePaths) {
+        INIT_LOGD("  Paths will be tessellated");
+    }
+
+    mMemoryBudget = 0;
+    if (property_get(PROPERTY_MEMORY_BUDGET, property, NULL) > 0) {
+        INIT_LOGD("  Setting memory budget to %sMB", property);
+        mMemoryBudget = MB(atof(property));
+    }
+
+#ifndef QCOM_HARDWARE
+    mTiledRendering = extensions.hasTiledRendering() &&
+            property_get(PROPERTY_TILED_RENDERING, property, "false") > 0 &&
+            !strcmp(property, "true");
+#else
+    // libtilerenderer already brackets the frames on these devices
+    mTiledRendering = false;
+#endif
+    if (mTiledRendering) {
+        INIT_LOGD("  Tiled rendering enabled");
+    }
+    mTiling = false;
+
 #if RENDER_LAYERS_AS_REGIONS
     INIT_LOGD("Layers will be composited as regions");
 #endif
@@ -81,11 +121,20 @@ void Caches::init() {
 
     mRegionMesh = NULL;
 
+    mLineMesh = NULL;
+    mLineMeshBuffer = 0;
+
+    memset(mBitmapMeshes, 0, sizeof(mBitmapMeshes));
+    mBitmapMeshGeneration = 0;
+    mBitmapMeshBuffer = 0;
+
     blend = false;
     lastSrcMode = GL_ZERO;
     lastDstMode = GL_ZERO;
     currentProgram = NULL;
 
+    programCache.init(extensions.hasProgramBinary());
+
     mInitialized = true;
 }
 
@@ -122,14 +171,35 @@ void Caches::initConstraints() {
 void Caches::terminate() {
     if (!mInitialized) return;
 
+    endTiling();
+
     glDeleteBuffers(1, &meshBuffer);
+    patchCache.clear();
     mCurrentBuffer = 0;
 
     glDeleteBuffers(1, &mRegionMeshIndices);
     delete[] mRegionMesh;
     mRegionMesh = NULL;
 
+    glDeleteBuffers(1, &mLineMeshBuffer);
+    mLineMeshBuffer = 0;
+    delete[] mLineMesh;
+    mLineMesh = NULL;
+
+    for (int i = 0; i < BITMAP_MESH_CACHE_SIZE; i++) {
+        BitmapMeshTopology& topology = mBitmapMeshes[i];
+        if (topology.indices) {
+            glDeleteBuffers(1, &topology.indices);
+            glDeleteBuffers(1, &topology.texCoords);
+        }
+    }
+    memset(mBitmapMeshes, 0, sizeof(mBitmapMeshes));
+    glDeleteBuffers(1, &mBitmapMeshBuffer);
+    mBitmapMeshBuffer = 0;
+    mCurrentIndicesBuffer = 0;
+
     fboCache.clear();
+    profiler.terminate();
 
     programCache.clear();
     currentProgram = NULL;
@@ -157,6 +227,8 @@ void Caches::dumpMemoryUsage(String8 &log) {
             gradientCache.getSize(), gradientCache.getMaxSize());
     log.appendFormat("  PathCache            %8d / %8d\n",
             pathCache.getSize(), pathCache.getMaxSize());
+    log.appendFormat("  PathMeshCache        %8d / %8d\n",
+            pathCache.getMeshSize(), pathCache.getMaxMeshSize());
     log.appendFormat("  CircleShapeCache     %8d / %8d\n",
             circleShapeCache.getSize(), circleShapeCache.getMaxSize());
     log.appendFormat("  OvalShapeCache       %8d / %8d\n",
@@ -179,11 +251,68 @@ void Caches::dumpMemoryUsage(String8 &log) {
     log.appendFormat("  PatchCache           %8d / %8d\n",
             patchCache.getSize(), patchCache.getMaxSize());
 
+    uint32_t total = getMemoryUsage();
+
+    log.appendFormat("Total memory usage:\n");
+    log.appendFormat("  %d bytes, %.2f MB\n", total, total / 1024.0f / 1024.0f);
+    if (mMemoryBudget > 0) {
+        log.appendFormat("  Budget: %d bytes, %.2f MB\n", mMemoryBudget,
+                mMemoryBudget / 1024.0f / 1024.0f);
+    }
+}
+
+void Caches::resetStats() {
+    stats.reset();
+    textureCache.stats.reset();
+    layerCache.stats.reset();
+    gradientCache.stats.reset();
+    programCache.stats.reset();
+    pathCache.stats.reset();
+    pathCache.meshStats.reset();
+    roundRectShapeCache.stats.reset();
+    circleShapeCache.stats.reset();
+    ovalShapeCache.stats.reset();
+    rectShapeCache.stats.reset();
+    arcShapeCache.stats.reset();
+    patchCache.stats.reset();
+    dropShadowCache.stats.reset();
+}
+
+static void dumpCacheStats(String8& log, const char* name, const CacheStats& stats) {
+    log.appendFormat("  %-20s %8d / %8d  %5.1f%%\n", name, stats.hits,
+            stats.hits + stats.misses, stats.getHitRate() * 100.0f);
+}
+
+void Caches::dumpStats(String8& log) {
+    log.appendFormat("GL work:\n");
+    log.appendFormat("  Draw calls           %8d\n", stats.drawCalls);
+    log.appendFormat("  Program changes      %8d\n", stats.programChanges);
+    log.appendFormat("  Blending changes     %8d\n", stats.blendChanges);
+    log.appendFormat("  Buffer changes       %8d\n", stats.bufferChanges);
+    log.appendFormat("  Texture unit changes %8d\n", stats.textureUnitChanges);
+    log.appendFormat("Cache hits / lookups:\n");
+    dumpCacheStats(log, "TextureCache", textureCache.stats);
+    dumpCacheStats(log, "LayerCache", layerCache.stats);
+    dumpCacheStats(log, "GradientCache", gradientCache.stats);
+    dumpCacheStats(log, "ProgramCache", programCache.stats);
+    dumpCacheStats(log, "PathCache", pathCache.stats);
+    dumpCacheStats(log, "PathMeshCache", pathCache.meshStats);
+    dumpCacheStats(log, "RoundRectShapeCache", roundRectShapeCache.stats);
+    dumpCacheStats(log, "CircleShapeCache", circleShapeCache.stats);
+    dumpCacheStats(log, "OvalShapeCache", ovalShapeCache.stats);
+    dumpCacheStats(log, "RectShapeCache", rectShapeCache.stats);
+    dumpCacheStats(log, "ArcShapeCache", arcShapeCache.stats);
+    dumpCacheStats(log, "PatchCache", patchCache.stats);
+    dumpCacheStats(log, "TextDropShadowCache", dropShadowCache.stats);
+}
+
+uint32_t Caches::getMemoryUsage() {
     uint32_t total = 0;
     total += textureCache.getSize();
     total += layerCache.getSize();
     total += gradientCache.getSize();
     total += pathCache.getSize();
+    total += pathCache.getMeshSize();
     total += dropShadowCache.getSize();
     total += roundRectShapeCache.getSize();
     total += circleShapeCache.getSize();
@@ -193,9 +322,7 @@ void Caches::dumpMemoryUsage(String8 &log) {
     for (uint32_t i = 0; i < fontRenderer.getFontRendererCount(); i++) {
         total += fontRenderer.getFontRendererSize(i);
     }
-
-    log.appendFormat("Total memory usage:\n");
-    log.appendFormat("  %d bytes, %.2f MB\n", total, total / 1024.0f / 1024.0f);
+    return total;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -223,6 +350,79 @@ void Caches::clearGarbage() {
     mDisplayListGarbage.clear();
 }
 
+/**
+ * Relative cost of evicting entries from each cache. Caches whose content is
+ * cheaper to rebuild give up more memory when the budget is exceeded.
+ */
+#define TRIM_WEIGHT_GRADIENTS 4
+#define TRIM_WEIGHT_SHAPES 3
+#define TRIM_WEIGHT_TEXTURES 2
+#define TRIM_WEIGHT_PATHS 1
+#define TRIM_WEIGHT_DROP_SHADOWS 1
+
+/**
+ * Evicts the oldest entries of the specified cache until it gives up its
+ * share of the excess memory. The maximum size of the cache is unchanged.
+ */
+template<typename T>
+static void trimCache(T& cache, uint32_t weight, uint32_t excess, double weightedTotal) {
+    const uint32_t size = cache.getSize();
+    const uint32_t share = (uint32_t) (excess * (size * (double) weight / weightedTotal) + 0.5);
+    if (share == 0) return;
+
+    const uint32_t maxSize = cache.getMaxSize();
+    cache.setMaxSize(share < size ? size - share : 0);
+    cache.setMaxSize(maxSize);
+}
+
+void Caches::enforceMemoryBudget() {
+    if (mMemoryBudget > 0) {
+        trimMemory(mMemoryBudget);
+    }
+}
+
+void Caches::trimMemory(uint32_t budget) {
+    uint32_t total = getMemoryUsage();
+    if (total <= budget) return;
+
+    FLUSH_LOGD("Trimming caches from %d to %d bytes", total, budget);
+
+    // Unused layers are only kept to avoid allocations, drop them first
+    total -= layerCache.getSize();
+    layerCache.clear();
+    if (total <= budget) return;
+
+    // Spread what remains over the other caches, in proportion to their size
+    // and to how cheap their entries are to rebuild. Each cache evicts its
+    // least recently used entries
+    const uint32_t excess = total - budget;
+    double weightedTotal = 0.0;
+    weightedTotal += gradientCache.getSize() * (double) TRIM_WEIGHT_GRADIENTS;
+    weightedTotal += (roundRectShapeCache.getSize() + circleShapeCache.getSize() +
+            ovalShapeCache.getSize() + rectShapeCache.getSize() +
+            arcShapeCache.getSize()) * (double) TRIM_WEIGHT_SHAPES;
+    weightedTotal += textureCache.getSize() * (double) TRIM_WEIGHT_TEXTURES;
+    weightedTotal += pathCache.getSize() * (double) TRIM_WEIGHT_PATHS;
+    weightedTotal += dropShadowCache.getSize() * (double) TRIM_WEIGHT_DROP_SHADOWS;
+
+    if (weightedTotal > 0.0) {
+        trimCache(gradientCache, TRIM_WEIGHT_GRADIENTS, excess, weightedTotal);
+        trimCache(roundRectShapeCache, TRIM_WEIGHT_SHAPES, excess, weightedTotal);
+        trimCache(circleShapeCache, TRIM_WEIGHT_SHAPES, excess, weightedTotal);
+        trimCache(ovalShapeCache, TRIM_WEIGHT_SHAPES, excess, weightedTotal);
+        trimCache(rectShapeCache, TRIM_WEIGHT_SHAPES, excess, weightedTotal);
+        trimCache(arcShapeCache, TRIM_WEIGHT_SHAPES, excess, weightedTotal);
+        trimCache(textureCache, TRIM_WEIGHT_TEXTURES, excess, weightedTotal);
+        trimCache(pathCache, TRIM_WEIGHT_PATHS, excess, weightedTotal);
+        trimCache(dropShadowCache, TRIM_WEIGHT_DROP_SHADOWS, excess, weightedTotal);
+    }
+
+    // The glyph caches can only give up their large glyphs pages
+    if (getMemoryUsage() > budget) {
+        fontRenderer.flush();
+    }
+}
+
 void Caches::deleteLayerDeferred(Layer* layer) {
     Mutex::Autolock _l(mGarbageLock);
     mLayerGarbage.push(layer);
@@ -233,6 +433,12 @@ void Caches::deleteDisplayListDeferred(DisplayList* displayList) {
     mDisplayListGarbage.push(displayList);
 }
 
+void Caches::prefetchTexture(SkBitmap* bitmap) {
+    if (mPrefetchTextures) {
+        textureCache.prefetch(bitmap);
+    }
+}
+
 void Caches::flush(FlushMode mode) {
     FLUSH_LOGD("Flushing caches (mode %d)", mode);
 
@@ -247,6 +453,7 @@ void Caches::flush(FlushMode mode) {
             fontRenderer.clear();
             // fall through
         case kFlushMode_Moderate:
+            programCache.saveToDisk();
             fontRenderer.flush();
             textureCache.flush();
             pathCache.clear();
@@ -260,6 +467,12 @@ void Caches::flush(FlushMode mode) {
             layerCache.clear();
             break;
     }
+
+    // Leave room under the budget so the caches don't start evicting
+    // entries again as soon as they repopulate
+    if (mMemoryBudget > 0) {
+        trimMemory(mMemoryBudget / 2);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -274,6 +487,7 @@ bool Caches::bindMeshBuffer(const GLuint buffer) {
     if (mCurrentBuffer != buffer) {
         glBindBuffer(GL_ARRAY_BUFFER, buffer);
         mCurrentBuffer = buffer;
+        stats.bufferChanges++;
         return true;
     }
     return false;
@@ -283,6 +497,7 @@ bool Caches::unbindMeshBuffer() {
     if (mCurrentBuffer) {
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         mCurrentBuffer = 0;
+        stats.bufferChanges++;
         return true;
     }
     return false;
@@ -292,6 +507,7 @@ bool Caches::bindIndicesBuffer(const GLuint buffer) {
     if (mCurrentIndicesBuffer != buffer) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
         mCurrentIndicesBuffer = buffer;
+        stats.bufferChanges++;
         return true;
     }
     return false;
@@ -301,6 +517,7 @@ bool Caches::unbindIndicesBuffer() {
     if (mCurrentIndicesBuffer) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
         mCurrentIndicesBuffer = 0;
+        stats.bufferChanges++;
         return true;
     }
     return false;
@@ -348,6 +565,7 @@ void Caches::activeTexture(GLuint textureUnit) {
     if (mTextureUnit != textureUnit) {
         glActiveTexture(gTextureUnits[textureUnit]);
         mTextureUnit = textureUnit;
+        stats.textureUnitChanges++;
     }
 }
 
@@ -366,6 +584,24 @@ void Caches::resetScissor() {
     mScissorX = mScissorY = mScissorWidth = mScissorHeight = 0;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Tiling
+///////////////////////////////////////////////////////////////////////////////
+
+void Caches::startTiling(GLint x, GLint y, GLint width, GLint height, bool discard) {
+    if (mTiledRendering && !mTiling && width > 0 && height > 0) {
+        glStartTilingQCOM(x, y, width, height, discard ? GL_NONE : GL_COLOR_BUFFER_BIT0_QCOM);
+        mTiling = true;
+    }
+}
+
+void Caches::endTiling() {
+    if (mTiling) {
+        glEndTilingQCOM(GL_COLOR_BUFFER_BIT0_QCOM);
+        mTiling = false;
+    }
+}
+
 TextureVertex* Caches::getRegionMesh() {
     // Create the mesh, 2 triangles and 4 vertices per rectangle in the region
     if (!mRegionMesh) {
@@ -396,5 +632,119 @@ TextureVertex* Caches::getRegionMesh() {
     return mRegionMesh;
 }
 
+AAVertex* Caches::getLineMesh() {
+    if (!mLineMesh) {
+        mLineMesh = new AAVertex[LINE_MESH_VERTEX_COUNT];
+    }
+    return mLineMesh;
+}
+
+bool Caches::bindLineMesh(GLsizei count) {
+    if (!mLineMeshBuffer) {
+        glGenBuffers(1, &mLineMeshBuffer);
+    }
+
+    bool force = bindMeshBuffer(mLineMeshBuffer);
+    // Respecifying the whole store lets the driver orphan the previous one
+    // instead of waiting for pending draws
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(AAVertex), mLineMesh, GL_STREAM_DRAW);
+
+    return force;
+}
+
+bool Caches::bindBitmapMesh(int meshWidth, int meshHeight, const float* vertices,
+        GLuint positionSlot, GLint texCoordsSlot) {
+    const uint32_t rowVertices = meshWidth + 1;
+    const uint32_t vertexCount = rowVertices * (meshHeight + 1);
+    if (meshWidth <= 0 || meshHeight <= 0 || vertexCount > 65536) {
+        return false;
+    }
+
+    BitmapMeshTopology* topology = NULL;
+    BitmapMeshTopology* oldest = &mBitmapMeshes[0];
+    for (int i = 0; i < BITMAP_MESH_CACHE_SIZE; i++) {
+        BitmapMeshTopology& candidate = mBitmapMeshes[i];
+        if (candidate.indices && candidate.width == meshWidth &&
+                candidate.height == meshHeight) {
+            topology = &candidate;
+            break;
+        }
+        if (!candidate.indices || (oldest->indices &&
+                mBitmapMeshGeneration - candidate.lastUse >
+                mBitmapMeshGeneration - oldest->lastUse)) {
+            oldest = &candidate;
+        }
+    }
+
+    if (!topology) {
+        topology = oldest;
+        if (!topology->indices) {
+            glGenBuffers(1, &topology->indices);
+            glGenBuffers(1, &topology->texCoords);
+        }
+        topology->width = meshWidth;
+        topology->height = meshHeight;
+
+        // Two triangles per cell, in the same order as the unindexed mesh
+        const uint32_t indexCount = meshWidth * meshHeight * 6;
+        uint16_t* indices = new uint16_t[indexCount];
+        uint16_t* index = indices;
+        for (int y = 0; y < meshHeight; y++) {
+            for (int x = 0; x < meshWidth; x++) {
+                uint16_t b = y * rowVertices + x;
+                uint16_t a = b + rowVertices;
+                uint16_t c = b + 1;
+                uint16_t d = a + 1;
+                *index++ = a;
+                *index++ = b;
+                *index++ = c;
+                *index++ = a;
+                *index++ = c;
+                *index++ = d;
+            }
+        }
+        bindIndicesBuffer(topology->indices);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t),
+                indices, GL_STATIC_DRAW);
+        delete[] indices;
+
+        float* texCoords = new float[vertexCount * 2];
+        float* texCoord = texCoords;
+        for (int y = 0; y <= meshHeight; y++) {
+            for (int x = 0; x <= meshWidth; x++) {
+                *texCoord++ = float(x) / meshWidth;
+                *texCoord++ = float(y) / meshHeight;
+            }
+        }
+        bindMeshBuffer(topology->texCoords);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * 2 * sizeof(float),
+                texCoords, GL_STATIC_DRAW);
+        delete[] texCoords;
+    } else {
+        bindIndicesBuffer(topology->indices);
+    }
+    topology->lastUse = ++mBitmapMeshGeneration;
+
+    // The pointers below are offsets in VBOs, make sure the next draw
+    // using client side arrays binds its pointers again
+    if (texCoordsSlot >= 0) {
+        bindMeshBuffer(topology->texCoords);
+        glVertexAttribPointer(texCoordsSlot, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+        mCurrentTexCoordsPointer = this;
+    }
+
+    if (!mBitmapMeshBuffer) {
+        glGenBuffers(1, &mBitmapMeshBuffer);
+    }
+    bindMeshBuffer(mBitmapMeshBuffer);
+    // Respecifying the whole store lets the driver orphan the previous one
+    // instead of waiting for pending draws
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * 2 * sizeof(float), vertices, GL_STREAM_DRAW);
+    glVertexAttribPointer(positionSlot, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    mCurrentPositionPointer = this;
+
+    return true;
+}
+
 }; // namespace uirenderer
 }; // namespace android
@@ -27,6 +27,7 @@
 
 #include "Extensions.h"
 #include "FontRenderer.h"
+#include "FrameProfiler.h"
 #include "GammaFontRenderer.h"
 #include "TextureCache.h"
 #include "LayerCache.h"
@@ -37,7 +38,9 @@
 #include "PathCache.h"
 #include "TextDropShadowCache.h"
 #include "FboCache.h"
+#include "RenderStats.h"
 #include "ResourceCache.h"
+#include "Stencil.h"
 
 namespace android {
 namespace uirenderer {
@@ -50,6 +53,12 @@ namespace uirenderer {
 
 #define REGION_MESH_QUAD_COUNT 512
 
+// Maximum number of vertices collected by a line batch
+#define LINE_MESH_VERTEX_COUNT 12288
+
+// Number of bitmap mesh topologies whose indices and texture coordinates are kept
+#define BITMAP_MESH_CACHE_SIZE 4
+
 // Generates simple and textured vertices
 #define FV(x, y, u, v) { { x, y }, { u, v } }
 
@@ -67,7 +76,8 @@ static const GLsizei gAlphaVertexStride = sizeof(AlphaVertex);
 static const GLsizei gAAVertexStride = sizeof(AAVertex);
 static const GLsizei gMeshTextureOffset = 2 * sizeof(float);
 static const GLsizei gVertexAAWidthOffset = 2 * sizeof(float);
-static const GLsizei gVertexAALengthOffset = 3 * sizeof(float);
+static const GLsizei gVertexAALengthOffset = 4 * sizeof(float);
+static const GLsizei gVertexAlphaOffset = 2 * sizeof(float);
 static const GLsizei gMeshCount = 4;
 
 static const GLenum gTextureUnits[] = {
@@ -132,12 +142,53 @@ public:
         return mDebugLevel;
     }
 
+    /**
+     * Indicates whether display lists should reorder their drawing
+     * operations to reduce the number of GL state changes.
+     */
+    bool isDeferringOps() const {
+        return mDeferOps;
+    }
+
+    /**
+     * Indicates whether paths that can be tessellated should be drawn as
+     * triangle meshes rather than alpha textures.
+     */
+    bool isTessellatingPaths() const {
+        return mTessellatePaths;
+    }
+
+    /**
+     * Hints that the specified bitmap will be drawn soon. When textures
+     * prefetching is enabled, the bitmap is prepared for upload on a
+     * background thread.
+     */
+    void prefetchTexture(SkBitmap* bitmap);
+
     /**
      * Call this on each frame to ensure that garbage is deleted from
      * GPU memory.
      */
     void clearGarbage();
 
+    /**
+     * Call this on each frame to evict entries from the caches when their
+     * combined size exceeds the memory budget.
+     */
+    void enforceMemoryBudget();
+
+    /**
+     * Returns the combined size, in bytes, of the caches.
+     */
+    uint32_t getMemoryUsage();
+
+    /**
+     * Returns the memory budget in bytes, 0 if no budget is set.
+     */
+    uint32_t getMemoryBudget() const {
+        return mMemoryBudget;
+    }
+
     /**
      * Can be used to delete a layer from a non EGL thread.
      */
@@ -204,6 +255,22 @@ public:
      */
     void resetScissor();
 
+    /**
+     * Tells the GPU which region of the current surface the following
+     * commands will render to. Does nothing unless tiled rendering is
+     * enabled. The coordinates are in surface coordinates, like glScissor.
+     *
+     * @param discard If true, the previous content of the region is not
+     *        needed and does not have to be loaded from memory
+     */
+    void startTiling(GLint x, GLint y, GLint width, GLint height, bool discard);
+
+    /**
+     * Ends the region started with startTiling(), if any. This must be
+     * called before changing the current framebuffer.
+     */
+    void endTiling();
+
     /**
      * Returns the mesh used to draw regions. Calling this method will
      * bind a VBO of type GL_ELEMENT_ARRAY_BUFFER that contains the
@@ -211,12 +278,50 @@ public:
      */
     TextureVertex* getRegionMesh();
 
+    /**
+     * Returns the mesh used to batch lines. The mesh can hold up to
+     * LINE_MESH_VERTEX_COUNT vertices.
+     */
+    AAVertex* getLineMesh();
+
+    /**
+     * Uploads the specified number of vertices from the line mesh to the
+     * VBO used to draw lines, and binds that VBO. Returns true if the
+     * binding changed.
+     */
+    bool bindLineMesh(GLsizei count);
+
+    /**
+     * Binds the buffers used to draw a bitmap mesh of meshWidth by meshHeight
+     * cells, as uploaded by drawBitmapMesh(). The indices and the texture
+     * coordinates only depend on the topology of the mesh and are cached in
+     * static VBOs; only the vertex positions, in the layout used by
+     * Canvas.drawBitmapMesh(), are uploaded to a streaming VBO. The mesh must
+     * then be drawn with glDrawElements(GL_TRIANGLES, meshWidth * meshHeight * 6,
+     * GL_UNSIGNED_SHORT, NULL).
+     *
+     * Returns false if the mesh has too many vertices for 16 bit indices, in
+     * which case nothing is bound.
+     */
+    bool bindBitmapMesh(int meshWidth, int meshHeight, const float* vertices,
+            GLuint positionSlot, GLint texCoordsSlot);
+
     /**
      * Displays the memory usage of each cache and the total sum.
      */
     void dumpMemoryUsage();
     void dumpMemoryUsage(String8& log);
 
+    /**
+     * Resets the GL work counters and the lookup counters of each cache.
+     */
+    void resetStats();
+    /**
+     * Displays the GL work counters and the hit rate of each cache since
+     * the last call to resetStats().
+     */
+    void dumpStats(String8& log);
+
     bool blend;
     GLenum lastSrcMode;
     GLenum lastDstMode;
@@ -247,6 +352,10 @@ public:
     GammaFontRenderer fontRenderer;
     ResourceCache resourceCache;
 
+    FrameProfiler profiler;
+    RenderStats stats;
+    Stencil stencil;
+
     // Debug methods
     PFNGLINSERTEVENTMARKEREXTPROC eventMark;
     PFNGLPUSHGROUPMARKEREXTPROC startMark;
@@ -259,6 +368,8 @@ private:
     void initExtensions();
     void initConstraints();
 
+    void trimMemory(uint32_t budget);
+
     static void eventMarkNull(GLsizei length, const GLchar* marker) { }
     static void startMarkNull(GLsizei length, const GLchar* marker) { }
     static void endMarkNull() { }
@@ -289,11 +400,33 @@ private:
     TextureVertex* mRegionMesh;
     GLuint mRegionMeshIndices;
 
+    // Used to render batched lines
+    AAVertex* mLineMesh;
+    GLuint mLineMeshBuffer;
+
+    // Used to render bitmap meshes
+    struct BitmapMeshTopology {
+        int width;
+        int height;
+        GLuint indices;
+        GLuint texCoords;
+        uint32_t lastUse;
+    };
+    BitmapMeshTopology mBitmapMeshes[BITMAP_MESH_CACHE_SIZE];
+    uint32_t mBitmapMeshGeneration;
+    GLuint mBitmapMeshBuffer;
+
     mutable Mutex mGarbageLock;
     Vector<Layer*> mLayerGarbage;
     Vector<DisplayList*> mDisplayListGarbage;
 
     DebugLevel mDebugLevel;
+    bool mDeferOps;
+    bool mPrefetchTextures;
+    bool mTessellatePaths;
+    uint32_t mMemoryBudget;
+    bool mTiledRendering;
+    bool mTiling;
     bool mInitialized;
 }; // class Caches
 
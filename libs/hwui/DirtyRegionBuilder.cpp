@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include "DirtyRegionBuilder.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Utils
+///////////////////////////////////////////////////////////////////////////////
+
+static inline bool contains(const android::Rect& outer, const android::Rect& inner) {
+    return outer.left <= inner.left && outer.top <= inner.top &&
+            outer.right >= inner.right && outer.bottom >= inner.bottom;
+}
+
+static int compareTop(const android::Rect* lhs, const android::Rect* rhs) {
+    return lhs->top < rhs->top ? -1 : (lhs->top > rhs->top ? 1 : 0);
+}
+
+static int compareLeft(const android::Rect* lhs, const android::Rect* rhs) {
+    return lhs->left < rhs->left ? -1 : (lhs->left > rhs->left ? 1 : 0);
+}
+
+static int compareEdge(const int32_t* lhs, const int32_t* rhs) {
+    return *lhs < *rhs ? -1 : (*lhs > *rhs ? 1 : 0);
+}
+
+static bool sameSpans(const Vector<android::Rect>& a, const Vector<android::Rect>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].left != b[i].left || a[i].right != b[i].right) return false;
+    }
+    return true;
+}
+
+static void emitBand(Vector<android::Rect>& out, const Vector<android::Rect>& band) {
+    out.appendVector(band);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors
+///////////////////////////////////////////////////////////////////////////////
+
+DirtyRegionBuilder::DirtyRegionBuilder(): mRegion(NULL) {
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Rectangles
+///////////////////////////////////////////////////////////////////////////////
+
+void DirtyRegionBuilder::add(Region* region, const android::Rect& rect) {
+    if (rect.isEmpty()) return;
+
+    if (region != mRegion) {
+        flush();
+        mRegion = region;
+    }
+
+    // Consecutive draws often hit the same area, which is cheap to detect
+    if (!mRects.isEmpty()) {
+        const android::Rect& last = mRects.top();
+        if (contains(last, rect)) return;
+        if (contains(rect, last)) {
+            mRects.editTop() = rect;
+            return;
+        }
+    }
+
+    mRects.add(rect);
+}
+
+void DirtyRegionBuilder::flush() {
+    if (mRegion && !mRects.isEmpty()) {
+        if (mRects.size() == 1) {
+            mRegion->orSelf(mRects[0]);
+        } else {
+            Region swept;
+            sweep(swept);
+            if (mRegion->isEmpty()) {
+                *mRegion = swept;
+            } else {
+                mRegion->orSelf(swept);
+            }
+        }
+    }
+    clear();
+}
+
+void DirtyRegionBuilder::clear() {
+    mRects.clear();
+    mRegion = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sweep
+///////////////////////////////////////////////////////////////////////////////
+
+void DirtyRegionBuilder::sweep(Region& out) {
+    mRects.sort(compareTop);
+
+    // Every top and bottom edge starts a new band
+    mEdges.clear();
+    for (size_t i = 0; i < mRects.size(); i++) {
+        mEdges.add(mRects[i].top);
+        mEdges.add(mRects[i].bottom);
+    }
+    mEdges.sort(compareEdge);
+
+    size_t edgeCount = 0;
+    int32_t* edges = mEdges.editArray();
+    for (size_t i = 0; i < mEdges.size(); i++) {
+        if (edgeCount == 0 || edges[edgeCount - 1] != edges[i]) {
+            edges[edgeCount++] = edges[i];
+        }
+    }
+
+    Vector<android::Rect> active;
+    size_t next = 0;
+    mPreviousBand.clear();
+    mSwept.clear();
+
+    for (size_t e = 0; e + 1 < edgeCount; e++) {
+        const int32_t top = edges[e];
+        const int32_t bottom = edges[e + 1];
+
+        // Drop the rectangles that ended above this band
+        size_t activeCount = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            if (active[i].bottom > top) {
+                active.editItemAt(activeCount++) = active[i];
+            }
+        }
+        while (active.size() > activeCount) {
+            active.pop();
+        }
+
+        while (next < mRects.size() && mRects[next].top <= top) {
+            active.add(mRects[next++]);
+        }
+
+        if (active.isEmpty()) {
+            emitBand(mSwept, mPreviousBand);
+            mPreviousBand.clear();
+            continue;
+        }
+
+        // Merge the horizontal spans of the band, every active rectangle
+        // covers the band entirely
+        active.sort(compareLeft);
+        mBand.clear();
+        for (size_t i = 0; i < active.size(); i++) {
+            const android::Rect& r = active[i];
+            if (!mBand.isEmpty() && r.left <= mBand.top().right) {
+                android::Rect& last = mBand.editTop();
+                if (r.right > last.right) last.right = r.right;
+            } else {
+                mBand.add(android::Rect(r.left, top, r.right, bottom));
+            }
+        }
+
+        // Bands with the same spans are coalesced vertically
+        if (!mPreviousBand.isEmpty() && mPreviousBand[0].bottom == top &&
+                sameSpans(mPreviousBand, mBand)) {
+            for (size_t i = 0; i < mPreviousBand.size(); i++) {
+                mPreviousBand.editItemAt(i).bottom = bottom;
+            }
+        } else {
+            emitBand(mSwept, mPreviousBand);
+            mPreviousBand = mBand;
+        }
+    }
+
+    emitBand(mSwept, mPreviousBand);
+    mPreviousBand.clear();
+
+    // addRectUnchecked() leaves the bounds alone, the region must be created
+    // with them like android_view_Surface does when converting an SkRegion
+    android::Rect bounds(mRects[0]);
+    for (size_t i = 1; i < mRects.size(); i++) {
+        const android::Rect& r = mRects[i];
+        if (r.left < bounds.left) bounds.left = r.left;
+        if (r.top < bounds.top) bounds.top = r.top;
+        if (r.right > bounds.right) bounds.right = r.right;
+        if (r.bottom > bounds.bottom) bounds.bottom = r.bottom;
+    }
+
+    out = Region(bounds);
+    if (mSwept.size() > 1) {
+        for (size_t i = 0; i < mSwept.size(); i++) {
+            const android::Rect& r = mSwept[i];
+            out.addRectUnchecked(r.left, r.top, r.right, r.bottom);
+        }
+    }
+    mSwept.clear();
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_DIRTY_REGION_BUILDER_H
+#define ANDROID_HWUI_DIRTY_REGION_BUILDER_H
+
+#include <ui/Region.h>
+
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Dirty region builder
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Accumulates dirty rectangles and unions them into a region in a single
+ * pass. Or'ing rectangles into a Region one at a time costs O(n) per
+ * rectangle, which becomes quadratic for layers dirtied by hundreds of
+ * draw operations. The builder instead sweeps all the pending rectangles
+ * at once to produce a y-x banded region.
+ */
+class DirtyRegionBuilder {
+public:
+    DirtyRegionBuilder();
+
+    /**
+     * Marks the specified rectangle as dirty in the specified region. The
+     * region is only modified when the pending rectangles are flushed. If
+     * the region differs from the region of the pending rectangles, those
+     * are flushed first.
+     */
+    void add(Region* region, const android::Rect& rect);
+
+    /**
+     * Unions all the pending rectangles into their region.
+     */
+    void flush();
+
+    /**
+     * Drops the pending rectangles without modifying their region.
+     */
+    void clear();
+
+    bool isEmpty() const {
+        return mRects.isEmpty();
+    }
+
+private:
+    /**
+     * Sets the specified region to the union of all the pending rectangles,
+     * including its bounds.
+     */
+    void sweep(Region& out);
+
+    Region* mRegion;
+    Vector<android::Rect> mRects;
+    // Scratch storage used by sweep()
+    Vector<int32_t> mEdges;
+    Vector<android::Rect> mBand;
+    Vector<android::Rect> mPreviousBand;
+    Vector<android::Rect> mSwept;
+}; // class DirtyRegionBuilder
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_DIRTY_REGION_BUILDER_H
@@ -44,6 +44,8 @@ const char* DisplayList::OP_NAMES[] = {
     "SetMatrix",
     "ConcatMatrix",
     "ClipRect",
+    "ClipPath",
+    "ClipRegion",
     "DrawDisplayList",
     "DrawLayer",
     "DrawBitmap",
@@ -86,6 +88,8 @@ void DisplayList::outputLogBuffer(int fd) {
     fprintf(file, "\nRecent DisplayList operations\n");
     logBuffer.outputCommands(file, OP_NAMES);
 
+    Caches::getInstance().profiler.output(file, OP_NAMES);
+
     String8 cachesLog;
     Caches::getInstance().dumpMemoryUsage(cachesLog);
     fprintf(file, "\nCaches:\n%s", cachesLog.string());
@@ -95,14 +99,16 @@ void DisplayList::outputLogBuffer(int fd) {
 }
 
 DisplayList::DisplayList(const DisplayListRenderer& recorder) :
-    mTransformMatrix(NULL), mTransformCamera(NULL), mTransformMatrix3D(NULL),
-    mStaticMatrix(NULL), mAnimationMatrix(NULL) {
+    mBufferCapacity(0), mTransformMatrix(NULL), mTransformCamera(NULL),
+    mTransformMatrix3D(NULL), mStaticMatrix(NULL), mAnimationMatrix(NULL) {
 
     initFromDisplayListRenderer(recorder);
 }
 
 DisplayList::~DisplayList() {
+    cancelAnimator(PropertyAnimator::kPropertyCount);
     clearResources();
+    sk_free((void*) mReader.base());
 }
 
 void DisplayList::initProperties() {
@@ -142,8 +148,6 @@ void DisplayList::destroyDisplayListDeferred(DisplayList* displayList) {
 }
 
 void DisplayList::clearResources() {
-    sk_free((void*) mReader.base());
-
     delete mTransformMatrix;
     delete mTransformCamera;
     delete mTransformMatrix3D;
@@ -180,8 +184,10 @@ void DisplayList::clearResources() {
     }
     mShaders.clear();
 
+    // The paints and matrices live in the allocator, only the paints
+    // hold references that must be released
     for (size_t i = 0; i < mPaints.size(); i++) {
-        delete mPaints.itemAt(i);
+        mPaints.itemAt(i)->~SkPaint();
     }
     mPaints.clear();
 
@@ -197,10 +203,9 @@ void DisplayList::clearResources() {
     }
     mSourcePaths.clear();
 
-    for (size_t i = 0; i < mMatrices.size(); i++) {
-        delete mMatrices.itemAt(i);
-    }
     mMatrices.clear();
+
+    mAllocator.clear();
 }
 
 void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorder, bool reusing) {
@@ -218,7 +223,15 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
     initProperties();
 
     mSize = writer.size();
-    void* buffer = sk_malloc_throw(mSize);
+
+    // Re-recording a view rarely changes the size of its display list
+    // much, keep the previous allocation when the new ops fit in it
+    void* buffer = (void*) mReader.base();
+    if (!buffer || mSize > mBufferCapacity || mSize < mBufferCapacity / 2) {
+        sk_free(buffer);
+        buffer = sk_malloc_throw(mSize);
+        mBufferCapacity = mSize;
+    }
     writer.flatten(buffer);
     mReader.setMemory(buffer, mSize);
 
@@ -229,6 +242,7 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
         SkBitmap* resource = bitmapResources.itemAt(i);
         mBitmapResources.add(resource);
         caches.resourceCache.incrementRefcount(resource);
+        caches.prefetchTexture(resource);
     }
 
     const Vector<SkBitmap*> &ownedBitmapResources = recorder.getOwnedBitmapResources();
@@ -272,6 +286,8 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
     for (size_t i = 0; i < matrices.size(); i++) {
         mMatrices.add(matrices.itemAt(i));
     }
+
+    mAllocator = recorder.getAllocator();
 }
 
 void DisplayList::init() {
@@ -307,6 +323,10 @@ void DisplayList::output(OpenGLRenderer& renderer, uint32_t level) {
 
     while (!mReader.eof()) {
         int op = mReader.readInt();
+        if (op & OP_IS_OPAQUE_MASK) {
+            ALOGD("%sOpaque", (char*) indent);
+            op &= ~OP_IS_OPAQUE_MASK;
+        }
         if (op & OP_MAY_BE_SKIPPED_MASK) {
             int skip = mReader.readInt();
             ALOGD("%sSkip %d", (char*) indent, skip);
@@ -401,6 +421,19 @@ void DisplayList::output(OpenGLRenderer& renderer, uint32_t level) {
                         f1, f2, f3, f4, regionOp);
             }
             break;
+            case ClipPath: {
+                SkPath* path = getPath();
+                int regionOp = getInt();
+                ALOGD("%s%s %p, %d", (char*) indent, OP_NAMES[op], path, regionOp);
+            }
+            break;
+            case ClipRegion: {
+                int32_t count = 0;
+                getFloats(count);
+                int regionOp = getInt();
+                ALOGD("%s%s %d, %d", (char*) indent, OP_NAMES[op], count / 4, regionOp);
+            }
+            break;
             case DrawDisplayList: {
                 DisplayList* displayList = getDisplayList();
                 int32_t flags = getInt();
@@ -749,6 +782,62 @@ void DisplayList::outputViewProperties(OpenGLRenderer& renderer, char* indent) {
     }
 }
 
+void DisplayList::addAnimator(PropertyAnimator* animator) {
+    cancelAnimator(animator->getProperty());
+    mAnimators.add(animator);
+}
+
+void DisplayList::cancelAnimator(int property) {
+    for (size_t i = 0; i < mAnimators.size(); ) {
+        PropertyAnimator* animator = mAnimators[i];
+        if (property == PropertyAnimator::kPropertyCount || animator->getProperty() == property) {
+            delete animator;
+            mAnimators.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+float DisplayList::getPropertyValue(int property) const {
+    switch (property) {
+        case PropertyAnimator::kPropertyTranslationX:
+            return mTranslationX;
+        case PropertyAnimator::kPropertyTranslationY:
+            return mTranslationY;
+        case PropertyAnimator::kPropertyRotation:
+            return mRotation;
+        case PropertyAnimator::kPropertyRotationX:
+            return mRotationX;
+        case PropertyAnimator::kPropertyRotationY:
+            return mRotationY;
+        case PropertyAnimator::kPropertyScaleX:
+            return mScaleX;
+        case PropertyAnimator::kPropertyScaleY:
+            return mScaleY;
+        case PropertyAnimator::kPropertyPivotX:
+            return mPivotX;
+        case PropertyAnimator::kPropertyPivotY:
+            return mPivotY;
+        case PropertyAnimator::kPropertyAlpha:
+            return mAlpha;
+    }
+    return 0.0f;
+}
+
+bool DisplayList::animate(nsecs_t time) {
+    for (size_t i = 0; i < mAnimators.size(); ) {
+        PropertyAnimator* animator = mAnimators[i];
+        if (!animator->animate(this, time)) {
+            delete animator;
+            mAnimators.removeAt(i);
+        } else {
+            i++;
+        }
+    }
+    return !mAnimators.isEmpty();
+}
+
 void DisplayList::setViewProperties(OpenGLRenderer& renderer, uint32_t level) {
 #if DEBUG_DISPLAY_LIST
         uint32_t count = (level + 1) * 2;
@@ -850,6 +939,12 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
             clipRect->right, clipRect->bottom);
 #endif
 
+    // A running animation redraws everything on the next frame, as where the
+    // display list will be drawn next is not known yet
+    if (hasAnimators() && animate(renderer.getFrameTime())) {
+        drawGlStatus |= DrawGlInfo::kStatusDraw;
+    }
+
     renderer.startMark(mName.string());
     int restoreTo = renderer.save(SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
     DISPLAY_LIST_LOGD("%s%s %d %d", indent, "Save",
@@ -864,8 +959,13 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
 
     DisplayListLogBuffer& logBuffer = DisplayListLogBuffer::getInstance();
     int saveCount = renderer.getSaveCount() - 1;
+    Caches& caches = Caches::getInstance();
+    const bool deferOps = caches.isDeferringOps();
     while (!mReader.eof()) {
         int op = mReader.readInt();
+        // Only meaningful for deferred operations
+        const bool opaque = op & OP_IS_OPAQUE_MASK;
+        op &= ~OP_IS_OPAQUE_MASK;
         if (op & OP_MAY_BE_SKIPPED_MASK) {
             int32_t skip = mReader.readInt();
             if (CC_LIKELY(flags & kReplayFlag_ClipChildren)) {
@@ -878,6 +978,14 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
             }
         }
         logBuffer.writeCommand(level, op);
+        caches.profiler.countOp(op);
+
+        // Any operation that cannot be deferred acts as a barrier: the
+        // pending batches must be executed in the current renderer state
+        if (deferOps && !mDeferredOps.isEmpty() && op != DrawBitmap &&
+                op != DrawBitmapRect && op != DrawPatch && op != DrawRect && op != DrawText) {
+            drawGlStatus |= flushDeferredOps(renderer);
+        }
 
         switch (op) {
             case DrawGLFunction: {
@@ -984,6 +1092,28 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 renderer.clipRect(f1, f2, f3, f4, (SkRegion::Op) regionOp);
             }
             break;
+            case ClipPath: {
+                SkPath* path = getPath();
+                int32_t regionOp = getInt();
+                DISPLAY_LIST_LOGD("%s%s %p, %d", (char*) indent, OP_NAMES[op], path, regionOp);
+                renderer.clipPath(path, (SkRegion::Op) regionOp);
+            }
+            break;
+            case ClipRegion: {
+                int32_t count = 0;
+                float* rects = getFloats(count);
+                int32_t regionOp = getInt();
+                DISPLAY_LIST_LOGD("%s%s %d, %d", (char*) indent, OP_NAMES[op],
+                        count / 4, regionOp);
+                SkRegion region;
+                for (int32_t i = 0; i < count; i += 4) {
+                    SkIRect r = SkIRect::MakeLTRB(rects[i], rects[i + 1],
+                            rects[i + 2], rects[i + 3]);
+                    region.op(r, SkRegion::kUnion_Op);
+                }
+                renderer.clipRegion(&region, (SkRegion::Op) regionOp);
+            }
+            break;
             case DrawDisplayList: {
                 DisplayList* displayList = getDisplayList();
                 int32_t flags = getInt();
@@ -1009,6 +1139,23 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 SkBitmap* bitmap = getBitmap();
                 float x = getFloat();
                 float y = getFloat();
+                if (deferOps) {
+                    DeferredOp deferred;
+                    deferred.op = op;
+                    deferred.bitmap = bitmap;
+                    deferred.paint = getUnfilteredPaint();
+                    deferred.f[0] = x;
+                    deferred.f[1] = y;
+                    DISPLAY_LIST_LOGD("%s%s %p, %.2f, %.2f, %p (deferred)", (char*) indent,
+                            OP_NAMES[op], bitmap, x, y, deferred.paint);
+                    // The bitmap may have been modified since it was recorded
+                    const bool opaqueBitmap = opaque && bitmap->isOpaque() &&
+                            (!mCaching || mMultipliedAlpha >= 255);
+                    drawGlStatus |= deferOp(renderer, deferred, x, y,
+                            x + bitmap->width(), y + bitmap->height(), kBatchBitmap, bitmap,
+                            opaqueBitmap);
+                    break;
+                }
                 SkPaint* paint = getPaint(renderer);
                 if (mCaching) {
                     paint->setAlpha(mMultipliedAlpha);
@@ -1037,6 +1184,25 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 float f6 = getFloat();
                 float f7 = getFloat();
                 float f8 = getFloat();
+                if (deferOps) {
+                    DeferredOp deferred;
+                    deferred.op = op;
+                    deferred.bitmap = bitmap;
+                    deferred.paint = getUnfilteredPaint();
+                    deferred.f[0] = f1;
+                    deferred.f[1] = f2;
+                    deferred.f[2] = f3;
+                    deferred.f[3] = f4;
+                    deferred.f[4] = f5;
+                    deferred.f[5] = f6;
+                    deferred.f[6] = f7;
+                    deferred.f[7] = f8;
+                    DISPLAY_LIST_LOGD("%s%s %p (deferred)", (char*) indent, OP_NAMES[op], bitmap);
+                    drawGlStatus |= deferOp(renderer, deferred, fminf(f5, f7), fminf(f6, f8),
+                            fmaxf(f5, f7), fmaxf(f6, f8), kBatchBitmap, bitmap,
+                            opaque && bitmap->isOpaque());
+                    break;
+                }
                 SkPaint* paint = getPaint(renderer);
                 DISPLAY_LIST_LOGD("%s%s %p, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f, %.2f, %p",
                         (char*) indent, OP_NAMES[op], bitmap,
@@ -1089,6 +1255,26 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 float top = getFloat();
                 float right = getFloat();
                 float bottom = getFloat();
+                if (deferOps) {
+                    DeferredOp deferred;
+                    deferred.op = op;
+                    deferred.bitmap = bitmap;
+                    deferred.paint = getUnfilteredPaint();
+                    deferred.xDivs = xDivs;
+                    deferred.yDivs = yDivs;
+                    deferred.colors = colors;
+                    deferred.xDivsCount = xDivsCount;
+                    deferred.yDivsCount = yDivsCount;
+                    deferred.numColors = numColors;
+                    deferred.f[0] = left;
+                    deferred.f[1] = top;
+                    deferred.f[2] = right;
+                    deferred.f[3] = bottom;
+                    DISPLAY_LIST_LOGD("%s%s (deferred)", (char*) indent, OP_NAMES[op]);
+                    drawGlStatus |= deferOp(renderer, deferred, left, top, right, bottom,
+                            kBatchPatch, bitmap, opaque && bitmap->isOpaque());
+                    break;
+                }
                 SkPaint* paint = getPaint(renderer);
 
                 DISPLAY_LIST_LOGD("%s%s", (char*) indent, OP_NAMES[op]);
@@ -1108,6 +1294,29 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 float f2 = getFloat();
                 float f3 = getFloat();
                 float f4 = getFloat();
+                if (deferOps) {
+                    SkPaint* unfiltered = getUnfilteredPaint();
+                    if (unfiltered->getStyle() == SkPaint::kFill_Style) {
+                        DeferredOp deferred;
+                        deferred.op = op;
+                        deferred.paint = unfiltered;
+                        deferred.f[0] = f1;
+                        deferred.f[1] = f2;
+                        deferred.f[2] = f3;
+                        deferred.f[3] = f4;
+                        DISPLAY_LIST_LOGD("%s%s %.2f, %.2f, %.2f, %.2f, %p (deferred)",
+                                (char*) indent, OP_NAMES[op], f1, f2, f3, f4, unfiltered);
+                        drawGlStatus |= deferOp(renderer, deferred, fminf(f1, f3), fminf(f2, f4),
+                                fmaxf(f1, f3), fmaxf(f2, f4), kBatchRect, NULL, opaque);
+                        break;
+                    }
+                    drawGlStatus |= flushDeferredOps(renderer);
+                    SkPaint* paint = renderer.filterPaint(unfiltered);
+                    DISPLAY_LIST_LOGD("%s%s %.2f, %.2f, %.2f, %.2f, %p", (char*) indent,
+                            OP_NAMES[op], f1, f2, f3, f4, paint);
+                    drawGlStatus |= renderer.drawRect(f1, f2, f3, f4, paint);
+                    break;
+                }
                 SkPaint* paint = getPaint(renderer);
                 DISPLAY_LIST_LOGD("%s%s %.2f, %.2f, %.2f, %.2f, %p", (char*) indent, OP_NAMES[op],
                         f1, f2, f3, f4, paint);
@@ -1190,6 +1399,54 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 int32_t count = getInt();
                 float x = getFloat();
                 float y = getFloat();
+                if (deferOps) {
+                    SkPaint* unfiltered = getUnfilteredPaint();
+                    float length = getFloat();
+                    if (!renderer.hasShadow() && unfiltered->getStyle() == SkPaint::kFill_Style &&
+                            !(unfiltered->getFlags() & (SkPaint::kUnderlineText_Flag |
+                                    SkPaint::kStrikeThruText_Flag |
+                                    SkPaint::kFakeBoldText_Flag))) {
+                        DeferredOp deferred;
+                        deferred.op = op;
+                        deferred.paint = unfiltered;
+                        deferred.text = text;
+                        deferred.count = count;
+                        deferred.f[0] = x;
+                        deferred.f[1] = y;
+                        deferred.f[2] = length;
+
+                        if (length < 0.0f) {
+                            length = unfiltered->measureText(text.text(), text.length());
+                        }
+                        float left = x;
+                        switch (unfiltered->getTextAlign()) {
+                            case SkPaint::kCenter_Align:
+                                left -= length / 2.0f;
+                                break;
+                            case SkPaint::kRight_Align:
+                                left -= length;
+                                break;
+                            default:
+                                break;
+                        }
+                        SkPaint::FontMetrics metrics;
+                        unfiltered->getFontMetrics(&metrics, 0.0f);
+
+                        DISPLAY_LIST_LOGD("%s%s %s, %d, %d, %.2f, %.2f, %p (deferred)",
+                                (char*) indent, OP_NAMES[op], text.text(), text.length(),
+                                count, x, y, unfiltered);
+                        drawGlStatus |= deferOp(renderer, deferred, left, y + metrics.fTop,
+                                left + length, y + metrics.fBottom, kBatchText, NULL);
+                        break;
+                    }
+                    drawGlStatus |= flushDeferredOps(renderer);
+                    SkPaint* paint = renderer.filterPaint(unfiltered);
+                    DISPLAY_LIST_LOGD("%s%s %s, %d, %d, %.2f, %.2f, %p, %.2f", (char*) indent,
+                            OP_NAMES[op], text.text(), text.length(), count, x, y, paint, length);
+                    drawGlStatus |= renderer.drawText(text.text(), text.length(), count, x, y,
+                            paint, length);
+                    break;
+                }
                 SkPaint* paint = getPaint(renderer);
                 float length = getFloat();
                 DISPLAY_LIST_LOGD("%s%s %s, %d, %d, %.2f, %.2f, %p, %.2f", (char*) indent,
@@ -1280,6 +1537,10 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
         }
     }
 
+    if (!mDeferredOps.isEmpty()) {
+        drawGlStatus |= flushDeferredOps(renderer);
+    }
+
     DISPLAY_LIST_LOGD("%s%s %d", (char*) indent, "RestoreToCount", restoreTo);
     renderer.restoreToCount(restoreTo);
     renderer.endMark();
@@ -1289,12 +1550,161 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
     return drawGlStatus;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Operations reordering
+///////////////////////////////////////////////////////////////////////////////
+
+status_t DisplayList::deferOp(OpenGLRenderer& renderer, DeferredOp& op,
+        float left, float top, float right, float bottom, DeferredBatchKind kind, const void* key,
+        bool opaque) {
+    status_t status = DrawGlInfo::kStatusDone;
+
+    // The renderer would reject this operation anyway
+    if (renderer.quickReject(left, top, right, bottom, op.bounds)) {
+        return status;
+    }
+    // Account for anti-aliasing and filtering
+    op.bounds.left -= 1.0f;
+    op.bounds.top -= 1.0f;
+    op.bounds.right += 1.0f;
+    op.bounds.bottom += 1.0f;
+    op.occluded = false;
+    op.next = -1;
+
+    if (mDeferredOps.size() >= MAX_DEFERRED_OPS) {
+        status |= flushDeferredOps(renderer);
+    }
+
+    Rect opaqueBounds;
+    if (opaque && !mDeferredOps.isEmpty() &&
+            renderer.getOpaqueBounds(left, top, right, bottom, opaqueBounds)) {
+        occludeDeferredOps(opaqueBounds);
+    }
+
+    const int32_t index = mDeferredOps.size();
+    mDeferredOps.add(op);
+
+    // Look for the most recent compatible batch. The operation can only
+    // be moved before the batches that follow it if it does not overlap
+    // any of them
+    int32_t count = mDeferredBatches.size();
+    int32_t last = count > MAX_DEFERRED_BATCH_LOOKBACK ? count - MAX_DEFERRED_BATCH_LOOKBACK : 0;
+    for (int32_t i = count - 1; i >= last; i--) {
+        DeferredBatch& batch = mDeferredBatches.editItemAt(i);
+        if (batch.kind == kind && batch.key == key) {
+            mDeferredOps.editItemAt(batch.tail).next = index;
+            batch.tail = index;
+            batch.bounds.unionWith(op.bounds);
+            return status;
+        }
+        if (batch.bounds.intersects(op.bounds)) {
+            break;
+        }
+    }
+
+    DeferredBatch batch;
+    batch.kind = kind;
+    batch.key = key;
+    batch.bounds.set(op.bounds);
+    batch.head = index;
+    batch.tail = index;
+    mDeferredBatches.add(batch);
+
+    return status;
+}
+
+void DisplayList::occludeDeferredOps(const Rect& bounds) {
+    // Operations are always executed before the operations deferred after
+    // them that they overlap, whatever batches they belong to
+    const size_t count = mDeferredOps.size();
+    for (size_t i = 0; i < count; i++) {
+        DeferredOp& op = mDeferredOps.editItemAt(i);
+        if (!op.occluded && bounds.contains(op.bounds)) {
+            op.occluded = true;
+        }
+    }
+}
+
+status_t DisplayList::flushDeferredOps(OpenGLRenderer& renderer) {
+    status_t status = DrawGlInfo::kStatusDone;
+
+    const size_t count = mDeferredBatches.size();
+    for (size_t i = 0; i < count; i++) {
+        int32_t index = mDeferredBatches.itemAt(i).head;
+        while (index >= 0) {
+            const DeferredOp& op = mDeferredOps.itemAt(index);
+            if (!op.occluded) {
+                status |= drawDeferredOp(renderer, op);
+            }
+            index = op.next;
+        }
+    }
+
+    mDeferredOps.clear();
+    mDeferredBatches.clear();
+
+    return status;
+}
+
+status_t DisplayList::drawDeferredOp(OpenGLRenderer& renderer, const DeferredOp& op) {
+    // The draw filter must be applied at execution time since
+    // the filtered paint is shared by all the operations
+    SkPaint* paint = renderer.filterPaint(op.paint);
+
+    switch (op.op) {
+        case DrawBitmap:
+            if (mCaching) {
+                paint->setAlpha(mMultipliedAlpha);
+            }
+            return renderer.drawBitmap(op.bitmap, op.f[0], op.f[1], paint);
+        case DrawBitmapRect:
+            return renderer.drawBitmap(op.bitmap, op.f[0], op.f[1], op.f[2], op.f[3],
+                    op.f[4], op.f[5], op.f[6], op.f[7], paint);
+        case DrawPatch:
+            return renderer.drawPatch(op.bitmap, op.xDivs, op.yDivs, op.colors,
+                    op.xDivsCount, op.yDivsCount, op.numColors,
+                    op.f[0], op.f[1], op.f[2], op.f[3], paint);
+        case DrawRect:
+            return renderer.drawRect(op.f[0], op.f[1], op.f[2], op.f[3], paint);
+        case DrawText:
+            return renderer.drawText(op.text.text(), op.text.length(), op.count,
+                    op.f[0], op.f[1], paint, op.f[2]);
+    }
+
+    return DrawGlInfo::kStatusDone;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Opacity
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Returns true if drawing the specified bitmap, or a rect if the bitmap is
+ * NULL, with the specified paint replaces the pixels it covers. The renderer
+ * state (alpha, shader, color filter, clip) is checked when the operation
+ * is replayed.
+ */
+static bool isOpaque(SkBitmap* bitmap, SkPaint* paint) {
+    if (bitmap && !bitmap->isOpaque()) return false;
+    if (!paint) return true;
+
+    if (paint->getAlpha() < 255 || paint->getShader() || paint->getColorFilter() ||
+            paint->getMaskFilter() || paint->getPathEffect() || paint->getLooper()) {
+        return false;
+    }
+
+    SkXfermode::Mode mode;
+    if (!SkXfermode::IsMode(paint->getXfermode(), &mode)) return false;
+    return mode == SkXfermode::kSrcOver_Mode || mode == SkXfermode::kSrc_Mode;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Base structure
 ///////////////////////////////////////////////////////////////////////////////
 
-DisplayListRenderer::DisplayListRenderer() : mWriter(MIN_WRITER_SIZE),
-        mTranslateX(0.0f), mTranslateY(0.0f), mHasTranslate(false), mHasDrawOps(false) {
+DisplayListRenderer::DisplayListRenderer() : mAllocator(new LinearAllocator()),
+        mWriter(MIN_WRITER_SIZE), mTranslateX(0.0f), mTranslateY(0.0f),
+        mHasTranslate(false), mHasDrawOps(false) {
 }
 
 DisplayListRenderer::~DisplayListRenderer() {
@@ -1340,6 +1750,9 @@ void DisplayListRenderer::reset() {
 
     mMatrices.clear();
 
+    mPathOffsets.clear();
+    mAllocator = new LinearAllocator();
+
     mHasDrawOps = false;
 }
 
@@ -1347,10 +1760,89 @@ void DisplayListRenderer::reset() {
 // Operations
 ///////////////////////////////////////////////////////////////////////////////
 
+static bool equals(const SkPath* a, const SkPath* b) {
+    return a->getSourcePath() == b->getSourcePath() &&
+            a->getGenerationID() == b->getGenerationID();
+}
+
+/**
+ * Points the ops that reference a copy identical to one of the previous
+ * copies at the previous copy instead. The previous copies that are reused
+ * are moved from previousCopies to copies, the copies they replace are
+ * deleted. The map, when specified, is updated to the reused copies.
+ */
+template<typename T>
+static void reuseCopies(SkWriter32& writer, const Vector<uint32_t>& offsets,
+        Vector<T*>& copies, Vector<T*>& previousCopies,
+        DefaultKeyedVector<T*, T*>* map = NULL) {
+    if (previousCopies.isEmpty()) return;
+
+    KeyedVector<T*, T*> replacements;
+    for (size_t i = 0; i < offsets.size(); i++) {
+        uint32_t* location = writer.peek32(offsets.itemAt(i));
+        T* copy = (T*) *location;
+        if (!copy) continue;
+
+        T* replacement = copy;
+        ssize_t index = replacements.indexOfKey(copy);
+        if (index >= 0) {
+            replacement = replacements.valueAt(index);
+        } else {
+            for (size_t j = 0; j < previousCopies.size(); j++) {
+                if (equals(previousCopies.itemAt(j), copy)) {
+                    replacement = previousCopies.itemAt(j);
+                    previousCopies.removeAt(j);
+                    break;
+                }
+            }
+            replacements.add(copy, replacement);
+        }
+
+        *location = (uint32_t) replacement;
+    }
+
+    for (size_t i = 0; i < replacements.size(); i++) {
+        T* copy = replacements.keyAt(i);
+        T* replacement = replacements.valueAt(i);
+        if (copy == replacement) continue;
+
+        for (size_t j = 0; j < copies.size(); j++) {
+            if (copies.itemAt(j) == copy) {
+                copies.replaceAt(replacement, j);
+                break;
+            }
+        }
+        if (map) {
+            for (size_t j = 0; j < map->size(); j++) {
+                if (map->valueAt(j) == copy) {
+                    map->replaceValueAt(j, replacement);
+                }
+            }
+        }
+        delete copy;
+    }
+}
+
+/**
+ * Re-recording a display list usually produces mostly the same paths as the
+ * previous recording. Reusing the previous copies avoids reallocating them
+ * and keeps the textures and meshes the path cache generated for them. Ops
+ * whose content did not change then keep the exact same encoding.
+ *
+ * Paints and matrices are not reused: they live in the allocator of the
+ * previous recording, which is released with it.
+ */
+void DisplayListRenderer::reuseResources(DisplayList* displayList) {
+    reuseCopies(mWriter, mPathOffsets, mPaths, displayList->mPaths, &mPathMap);
+}
+
 DisplayList* DisplayListRenderer::getDisplayList(DisplayList* displayList) {
     if (!displayList) {
         displayList = new DisplayList(*this);
     } else {
+        if (mWriter.size() > 0) {
+            reuseResources(displayList);
+        }
         displayList->initFromDisplayListRenderer(*this, true);
     }
     displayList->setRenderable(mHasDrawOps);
@@ -1370,6 +1862,8 @@ void DisplayListRenderer::setViewport(int width, int height) {
 
 int DisplayListRenderer::prepareDirty(float left, float top,
         float right, float bottom, bool opaque) {
+    Caches::getInstance().profiler.beginRecord();
+
     mSnapshot = new Snapshot(mFirstSnapshot,
             SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
     mSaveCount = 1;
@@ -1381,6 +1875,8 @@ int DisplayListRenderer::prepareDirty(float left, float top,
 void DisplayListRenderer::finish() {
     insertRestoreToCount();
     insertTranlate();
+
+    Caches::getInstance().profiler.endRecord();
 }
 
 void DisplayListRenderer::interrupt() {
@@ -1483,6 +1979,32 @@ bool DisplayListRenderer::clipRect(float left, float top, float right, float bot
     return OpenGLRenderer::clipRect(left, top, right, bottom, op);
 }
 
+bool DisplayListRenderer::clipPath(SkPath* path, SkRegion::Op op) {
+    addOp(DisplayList::ClipPath);
+    addPath(path);
+    addInt(op);
+    return OpenGLRenderer::clipPath(path, op);
+}
+
+bool DisplayListRenderer::clipRegion(SkRegion* region, SkRegion::Op op) {
+    // The region is flattened into its rectangles, they are few in practice
+    Vector<float> rects;
+    SkRegion::Iterator it(*region);
+    while (!it.done()) {
+        const SkIRect& r = it.rect();
+        rects.add(r.fLeft);
+        rects.add(r.fTop);
+        rects.add(r.fRight);
+        rects.add(r.fBottom);
+        it.next();
+    }
+
+    addOp(DisplayList::ClipRegion);
+    addFloats(rects.array(), rects.size());
+    addInt(op);
+    return OpenGLRenderer::clipRegion(region, op);
+}
+
 status_t DisplayListRenderer::drawDisplayList(DisplayList* displayList,
         Rect& dirty, int32_t flags, uint32_t level) {
     // dirty is an out parameter and should not be recorded,
@@ -1504,7 +2026,7 @@ status_t DisplayListRenderer::drawLayer(Layer* layer, float x, float y, SkPaint*
 
 status_t DisplayListRenderer::drawBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint) {
     const bool reject = quickReject(left, top, left + bitmap->width(), top + bitmap->height());
-    uint32_t* location = addOp(DisplayList::DrawBitmap, reject);
+    uint32_t* location = addOp(DisplayList::DrawBitmap, reject, isOpaque(bitmap, paint));
     addBitmap(bitmap);
     addPoint(left, top);
     addPaint(paint);
@@ -1530,7 +2052,7 @@ status_t DisplayListRenderer::drawBitmap(SkBitmap* bitmap, float srcLeft, float
         float srcRight, float srcBottom, float dstLeft, float dstTop,
         float dstRight, float dstBottom, SkPaint* paint) {
     const bool reject = quickReject(dstLeft, dstTop, dstRight, dstBottom);
-    uint32_t* location = addOp(DisplayList::DrawBitmapRect, reject);
+    uint32_t* location = addOp(DisplayList::DrawBitmapRect, reject, isOpaque(bitmap, paint));
     addBitmap(bitmap);
     addBounds(srcLeft, srcTop, srcRight, srcBottom);
     addBounds(dstLeft, dstTop, dstRight, dstBottom);
@@ -1571,7 +2093,7 @@ status_t DisplayListRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs,
         const int32_t* yDivs, const uint32_t* colors, uint32_t width, uint32_t height,
         int8_t numColors, float left, float top, float right, float bottom, SkPaint* paint) {
     const bool reject = quickReject(left, top, right, bottom);
-    uint32_t* location = addOp(DisplayList::DrawPatch, reject);
+    uint32_t* location = addOp(DisplayList::DrawPatch, reject, isOpaque(bitmap, paint));
     addBitmap(bitmap);
     addInts(xDivs, width);
     addInts(yDivs, height);
@@ -1591,9 +2113,9 @@ status_t DisplayListRenderer::drawColor(int color, SkXfermode::Mode mode) {
 
 status_t DisplayListRenderer::drawRect(float left, float top, float right, float bottom,
         SkPaint* paint) {
-    const bool reject = paint->getStyle() == SkPaint::kFill_Style &&
-            quickReject(left, top, right, bottom);
-    uint32_t* location = addOp(DisplayList::DrawRect, reject);
+    const bool fill = paint->getStyle() == SkPaint::kFill_Style;
+    const bool reject = fill && quickReject(left, top, right, bottom);
+    uint32_t* location = addOp(DisplayList::DrawRect, reject, fill && isOpaque(NULL, paint));
     addBounds(left, top, right, bottom);
     addPaint(paint);
     addSkip(location);
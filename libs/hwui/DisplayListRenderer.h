@@ -29,8 +29,10 @@
 
 #include <cutils/compiler.h>
 
+#include "Animator.h"
 #include "DisplayListLogBuffer.h"
 #include "OpenGLRenderer.h"
+#include "utils/LinearAllocator.h"
 
 namespace android {
 namespace uirenderer {
@@ -41,6 +43,14 @@ namespace uirenderer {
 
 #define MIN_WRITER_SIZE 4096
 #define OP_MAY_BE_SKIPPED_MASK 0xff000000
+// Set by the recorder on drawing operations whose paint and bitmap replace
+// the pixels they cover, see DisplayList::deferOp()
+#define OP_IS_OPAQUE_MASK 0x00800000
+
+// Maximum number of operations deferred before the batches are flushed
+#define MAX_DEFERRED_OPS 256
+// Maximum number of batches examined when looking for a compatible batch
+#define MAX_DEFERRED_BATCH_LOOKBACK 32
 
 // Debug
 #if DEBUG_DISPLAY_LIST
@@ -85,6 +95,8 @@ public:
         SetMatrix,
         ConcatMatrix,
         ClipRect,
+        ClipPath,
+        ClipRegion,
         // Drawing operations
         DrawDisplayList,
         DrawLayer,
@@ -389,6 +401,29 @@ public:
         mCaching = caching;
     }
 
+    /**
+     * Runs the animator each time the display list is drawn, until it is done. The
+     * display list takes ownership of the animator and cancels the previous animator
+     * of the same property, if any.
+     */
+    ANDROID_API void addAnimator(PropertyAnimator* animator);
+
+    /**
+     * Cancels the animator of the given property, which keeps its current value.
+     * PropertyAnimator::kPropertyCount cancels all the animators.
+     */
+    ANDROID_API void cancelAnimator(int property);
+
+    bool hasAnimators() const {
+        return !mAnimators.isEmpty();
+    }
+
+    /**
+     * Returns the current value of a view property, so that the view can pick up the
+     * value left by an animator once it is done or cancelled.
+     */
+    ANDROID_API float getPropertyValue(int property) const;
+
     int getWidth() {
         return mWidth;
     }
@@ -405,6 +440,13 @@ private:
 
     void updateMatrix();
 
+    /**
+     * Runs the animators for the given frame time, returns true if any is still running.
+     */
+    bool animate(nsecs_t time);
+
+    friend class DisplayListRenderer;
+
     class TextContainer {
     public:
         size_t length() const {
@@ -459,6 +501,15 @@ private:
         return renderer.filterPaint((SkPaint*) getInt());
     }
 
+    /**
+     * Returns the recorded paint without applying the renderer's draw filter.
+     * Used by deferred operations, the filter is applied when the operation
+     * is finally executed.
+     */
+    SkPaint* getUnfilteredPaint() {
+        return (SkPaint*) getInt();
+    }
+
     DisplayList* getDisplayList() {
         return (DisplayList*) getInt();
     }
@@ -487,6 +538,83 @@ private:
         text->mText = (const char*) mReader.skip(length);
     }
 
+    /**
+     * Kinds of deferred operations. Operations of the same kind that share
+     * the same key (the bitmap for instance) use the same program and texture
+     * and are grouped in the same batch.
+     */
+    enum DeferredBatchKind {
+        kBatchBitmap = 0,
+        kBatchPatch,
+        kBatchRect,
+        kBatchText
+    };
+
+    /**
+     * A drawing operation whose execution was deferred by replay() when
+     * operations reordering is enabled. All the parameters have already
+     * been read from the display list.
+     */
+    struct DeferredOp {
+        int32_t op;
+        SkBitmap* bitmap;
+        SkPaint* paint;
+        float f[8];
+        TextContainer text;
+        int32_t count;
+        int32_t* xDivs;
+        int32_t* yDivs;
+        uint32_t* colors;
+        uint32_t xDivsCount;
+        uint32_t yDivsCount;
+        int8_t numColors;
+        // Pixel bounds of the operation, in screen space
+        Rect bounds;
+        // True if the operation is hidden by an opaque operation deferred
+        // after it, it is then skipped when the batches are flushed
+        bool occluded;
+        // Index of the next operation in the same batch, -1 if none
+        int32_t next;
+    };
+
+    /**
+     * A list of deferred operations sharing the same program and texture.
+     */
+    struct DeferredBatch {
+        DeferredBatchKind kind;
+        const void* key;
+        // Union of the bounds of all the operations in the batch
+        Rect bounds;
+        int32_t head;
+        int32_t tail;
+    };
+
+    /**
+     * Defers the specified operation. The operation is added to the latest
+     * compatible batch unless it overlaps an operation recorded after that
+     * batch, in which case a new batch is created. Operations outside of the
+     * current clip are discarded.
+     *
+     * When the operation is opaque, the pending operations it entirely
+     * covers are marked as occluded and will not be executed.
+     */
+    status_t deferOp(OpenGLRenderer& renderer, DeferredOp& op, float left, float top,
+            float right, float bottom, DeferredBatchKind kind, const void* key,
+            bool opaque = false);
+
+    /**
+     * Marks the pending operations contained in the specified screen space
+     * rect as occluded.
+     */
+    void occludeDeferredOps(const Rect& bounds);
+
+    /**
+     * Executes all the deferred operations, batch by batch.
+     */
+    status_t flushDeferredOps(OpenGLRenderer& renderer);
+
+    status_t drawDeferredOp(OpenGLRenderer& renderer, const DeferredOp& op);
+
     Vector<SkBitmap*> mBitmapResources;
     Vector<SkBitmap*> mOwnedBitmapResources;
     Vector<SkiaColorFilter*> mFilterResources;
@@ -497,9 +625,14 @@ private:
     Vector<SkMatrix*> mMatrices;
     Vector<SkiaShader*> mShaders;
 
+    // Holds the paints and matrices
+    sp<LinearAllocator> mAllocator;
+
     mutable SkFlattenableReadBuffer mReader;
 
     size_t mSize;
+    // Size of the memory block holding the ops, kept across re-recordings
+    size_t mBufferCapacity;
 
     bool mIsRenderable;
 
@@ -528,6 +661,13 @@ private:
     SkMatrix* mStaticMatrix;
     SkMatrix* mAnimationMatrix;
     bool mCaching;
+
+    // Animators of the view properties, kept across re-recordings
+    Vector<PropertyAnimator*> mAnimators;
+
+    // Operations deferred by the reordering pass
+    Vector<DeferredOp> mDeferredOps;
+    Vector<DeferredBatch> mDeferredBatches;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -573,6 +713,8 @@ public:
     virtual void concatMatrix(SkMatrix* matrix);
 
     virtual bool clipRect(float left, float top, float right, float bottom, SkRegion::Op op);
+    virtual bool clipPath(SkPath* path, SkRegion::Op op);
+    virtual bool clipRegion(SkRegion* region, SkRegion::Op op);
 
     virtual status_t drawDisplayList(DisplayList* displayList, Rect& dirty, int32_t flags,
             uint32_t level = 0);
@@ -656,7 +798,13 @@ public:
         return mMatrices;
     }
 
+    const sp<LinearAllocator>& getAllocator() const {
+        return mAllocator;
+    }
+
 private:
+    void reuseResources(DisplayList* displayList);
+
     void insertRestoreToCount() {
         if (mRestoreSaveCount >= 0) {
             mWriter.writeInt(DisplayList::RestoreToCount);
@@ -683,17 +831,18 @@ private:
         mHasDrawOps = mHasDrawOps || drawOp >= DisplayList::DrawDisplayList;
     }
 
-    uint32_t* addOp(const DisplayList::Op drawOp, const bool reject) {
+    uint32_t* addOp(const DisplayList::Op drawOp, const bool reject, const bool opaque = false) {
         insertRestoreToCount();
         insertTranlate();
         mHasDrawOps = mHasDrawOps || drawOp >= DisplayList::DrawDisplayList;
+        const int32_t opaqueMask = opaque ? OP_IS_OPAQUE_MASK : 0;
         if (reject) {
-            mWriter.writeInt(OP_MAY_BE_SKIPPED_MASK | drawOp);
+            mWriter.writeInt(OP_MAY_BE_SKIPPED_MASK | opaqueMask | drawOp);
             mWriter.writeInt(0xdeaddead);
             mBufferSize = mWriter.size();
             return mWriter.peek32(mBufferSize - sizeof(int32_t));
         }
-        mWriter.writeInt(drawOp);
+        mWriter.writeInt(opaqueMask | drawOp);
         return NULL;
     }
 
@@ -767,6 +916,7 @@ private:
             mSourcePaths.add(path);
         }
 
+        mPathOffsets.add(mWriter.size());
         addInt((int) pathCopy);
     }
 
@@ -778,7 +928,7 @@ private:
 
         SkPaint* paintCopy = mPaintMap.valueFor(paint);
         if (paintCopy == NULL || paintCopy->getGenerationID() != paint->getGenerationID()) {
-            paintCopy = new SkPaint(*paint);
+            paintCopy = mAllocator->create(*paint);
             // replaceValueFor() performs an add if the entry doesn't exist
             mPaintMap.replaceValueFor(paint, paintCopy);
             mPaints.add(paintCopy);
@@ -797,7 +947,7 @@ private:
     inline void addMatrix(SkMatrix* matrix) {
         // Copying the matrix is cheap and prevents against the user changing the original
         // matrix before the operation that uses it
-        SkMatrix* copy = new SkMatrix(*matrix);
+        SkMatrix* copy = mAllocator->create(*matrix);
         addInt((int) copy);
         mMatrices.add(copy);
     }
@@ -860,6 +1010,14 @@ private:
 
     Vector<SkMatrix*> mMatrices;
 
+    // Locations in the stream of the pointers to the copies of paths,
+    // used to re-target the ops on re-recording
+    Vector<uint32_t> mPathOffsets;
+
+    // Holds the copies of paints and matrices, handed over to the
+    // display list along with the ops
+    sp<LinearAllocator> mAllocator;
+
     SkWriter32 mWriter;
     uint32_t mBufferSize;
 
@@ -68,6 +68,9 @@ public:
         mHasDiscardFramebuffer = hasExtension("GL_EXT_discard_framebuffer");
         mHasDebugMarker = hasExtension("GL_EXT_debug_marker");
         mHasDebugLabel = hasExtension("GL_EXT_debug_label");
+        mHasTimerQuery = hasExtension("GL_EXT_disjoint_timer_query");
+        mHasProgramBinary = hasExtension("GL_OES_get_program_binary");
+        mHasTiledRendering = hasExtension("GL_QCOM_tiled_rendering");
 
         const char* vendor = (const char*) glGetString(GL_VENDOR);
         EXT_LOGD("Vendor: %s", vendor);
@@ -85,6 +88,9 @@ public:
     inline bool hasDiscardFramebuffer() const { return mHasDiscardFramebuffer; }
     inline bool hasDebugMarker() const { return mHasDebugMarker; }
     inline bool hasDebugLabel() const { return mHasDebugLabel; }
+    inline bool hasTimerQuery() const { return mHasTimerQuery; }
+    inline bool hasProgramBinary() const { return mHasProgramBinary; }
+    inline bool hasTiledRendering() const { return mHasTiledRendering; }
 
     bool hasExtension(const char* extension) const {
         const String8 s(extension);
@@ -106,6 +112,9 @@ private:
     bool mHasDiscardFramebuffer;
     bool mHasDebugMarker;
     bool mHasDebugLabel;
+    bool mHasTimerQuery;
+    bool mHasProgramBinary;
+    bool mHasTiledRendering;
 }; // class Extensions
 
 }; // namespace uirenderer
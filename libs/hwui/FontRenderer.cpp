@@ -39,26 +39,121 @@ namespace uirenderer {
 #define MAX_TEXT_CACHE_WIDTH 2048
 #define TEXTURE_BORDER_SIZE 2
 
+// Heights of the pages created for glyphs that do not fit in a small page
+#define LARGE_TEXT_CACHE_HEIGHT 256
+#define MAX_LARGE_TEXT_CACHE_HEIGHT 512
+
+// Radius above which blurs are approximated with successive box blurs
+#define MAX_GAUSSIAN_BLUR_RADIUS 8
+#define BOX_BLUR_PASS_COUNT 3
+
 #define AUTO_KERN(prev, next) (((next) - (prev) + 32) >> 6 << 16)
 
 ///////////////////////////////////////////////////////////////////////////////
-// CacheTextureLine
+// CacheTexture
 ///////////////////////////////////////////////////////////////////////////////
 
-bool CacheTextureLine::fitBitmap(const SkGlyph& glyph, uint32_t *retOriginX, uint32_t *retOriginY) {
-    if (glyph.fHeight + TEXTURE_BORDER_SIZE > mMaxHeight) {
+void CacheTexture::reset() {
+    SkylineNode node;
+    node.x = 0;
+    node.y = 0;
+    node.width = mWidth;
+
+    mSkyline.clear();
+    mSkyline.push(node);
+}
+
+bool CacheTexture::fitBitmap(const SkGlyph& glyph, uint32_t *retOriginX, uint32_t *retOriginY) {
+    const uint32_t width = glyph.fWidth + TEXTURE_BORDER_SIZE;
+    const uint32_t height = glyph.fHeight + TEXTURE_BORDER_SIZE;
+
+    if (width > mWidth || height > mHeight) {
         return false;
     }
 
-    if (mCurrentCol + glyph.fWidth + TEXTURE_BORDER_SIZE < mMaxWidth) {
-        *retOriginX = mCurrentCol + 1;
-        *retOriginY = mCurrentRow + 1;
-        mCurrentCol += glyph.fWidth + TEXTURE_BORDER_SIZE;
-        mDirty = true;
-        return true;
+    // Find the lowest position for the glyph, ties are broken by picking
+    // the narrowest node to keep the skyline as flat as possible
+    ssize_t bestIndex = -1;
+    uint32_t bestY = mHeight;
+    uint32_t bestWidth = mWidth + 1;
+
+    const size_t count = mSkyline.size();
+    for (size_t i = 0; i < count; i++) {
+        const SkylineNode& node = mSkyline[i];
+        if (node.x + width > mWidth) {
+            break;
+        }
+
+        // The glyph rests on the highest node it spans
+        uint32_t y = node.y;
+        uint32_t remaining = width;
+        for (size_t j = i; j < count && remaining > 0; j++) {
+            const SkylineNode& spanned = mSkyline[j];
+            if (spanned.y > y) y = spanned.y;
+            remaining -= remaining < spanned.width ? remaining : spanned.width;
+        }
+
+        if (y + height <= mHeight && (y < bestY || (y == bestY && node.width < bestWidth))) {
+            bestIndex = i;
+            bestY = y;
+            bestWidth = node.width;
+        }
     }
 
-    return false;
+    if (bestIndex < 0) {
+        return false;
+    }
+
+    SkylineNode newNode;
+    newNode.x = mSkyline[bestIndex].x;
+    newNode.y = bestY + height;
+    newNode.width = width;
+    mSkyline.insertAt(newNode, bestIndex);
+
+    // Shrink or remove the nodes now covered by the glyph
+    const uint32_t right = newNode.x + newNode.width;
+    size_t i = bestIndex + 1;
+    while (i < mSkyline.size()) {
+        SkylineNode& node = mSkyline.editItemAt(i);
+        if (node.x >= right) {
+            break;
+        }
+        const uint32_t overlap = right - node.x;
+        if (overlap < node.width) {
+            node.x += overlap;
+            node.width -= overlap;
+            break;
+        }
+        mSkyline.removeAt(i);
+    }
+
+    // Merge adjacent nodes of the same height
+    i = 0;
+    while (i + 1 < mSkyline.size()) {
+        const uint16_t nextY = mSkyline[i + 1].y;
+        const uint16_t nextWidth = mSkyline[i + 1].width;
+        if (mSkyline[i].y == nextY) {
+            mSkyline.editItemAt(i).width += nextWidth;
+            mSkyline.removeAt(i + 1);
+        } else {
+            i++;
+        }
+    }
+
+    *retOriginX = newNode.x + 1;
+    *retOriginY = bestY + 1;
+    mDirtyRect.unionWith(Rect(newNode.x, bestY, newNode.x + width, bestY + height));
+
+    return true;
+}
+
+uint32_t CacheTexture::getRemainingArea() const {
+    uint32_t area = 0;
+    for (size_t i = 0; i < mSkyline.size(); i++) {
+        const SkylineNode& node = mSkyline[i];
+        area += (mHeight - node.y) * node.width;
+    }
+    return area;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -87,10 +182,10 @@ Font::~Font() {
     }
 }
 
-void Font::invalidateTextureCache(CacheTextureLine *cacheLine) {
+void Font::invalidateTextureCache(CacheTexture* cacheTexture) {
     for (uint32_t i = 0; i < mCachedGlyphs.size(); i++) {
         CachedGlyphInfo* cachedGlyph = mCachedGlyphs.valueAt(i);
-        if (cacheLine == NULL || cachedGlyph->mCachedTextureLine == cacheLine) {
+        if (cacheTexture == NULL || cachedGlyph->mCacheTexture == cacheTexture) {
             cachedGlyph->mIsValid = false;
         }
     }
@@ -134,7 +229,7 @@ void Font::drawCachedGlyph(CachedGlyphInfo* glyph, int x, int y,
     mState->appendMeshQuad(nPenX, nPenY, u1, v2,
             nPenX + width, nPenY, u2, v2,
             nPenX + width, nPenY - height, u2, v1,
-            nPenX, nPenY - height, u1, v1, glyph->mCachedTextureLine->mCacheTexture);
+            nPenX, nPenY - height, u1, v1, glyph->mCacheTexture);
 }
 
 void Font::drawCachedGlyphBitmap(CachedGlyphInfo* glyph, int x, int y,
@@ -145,7 +240,7 @@ void Font::drawCachedGlyphBitmap(CachedGlyphInfo* glyph, int x, int y,
     uint32_t endX = glyph->mStartX + glyph->mBitmapWidth;
     uint32_t endY = glyph->mStartY + glyph->mBitmapHeight;
 
-    CacheTexture *cacheTexture = glyph->mCachedTextureLine->mCacheTexture;
+    CacheTexture *cacheTexture = glyph->mCacheTexture;
     uint32_t cacheWidth = cacheTexture->mWidth;
     const uint8_t* cacheBuffer = cacheTexture->mTexture;
 
@@ -199,7 +294,7 @@ void Font::drawCachedGlyph(CachedGlyphInfo* glyph, float x, float hOffset, float
             position->fY + destination[2].fY, u2, v1,
             position->fX + destination[3].fX,
             position->fY + destination[3].fY, u1, v1,
-            glyph->mCachedTextureLine->mCacheTexture);
+            glyph->mCacheTexture);
 }
 
 CachedGlyphInfo* Font::getCachedGlyph(SkPaint* paint, glyph_t textUnit) {
@@ -409,8 +504,8 @@ void Font::updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyp
     glyph->mBitmapWidth = skiaGlyph.fWidth;
     glyph->mBitmapHeight = skiaGlyph.fHeight;
 
-    uint32_t cacheWidth = glyph->mCachedTextureLine->mCacheTexture->mWidth;
-    uint32_t cacheHeight = glyph->mCachedTextureLine->mCacheTexture->mHeight;
+    uint32_t cacheWidth = glyph->mCacheTexture->mWidth;
+    uint32_t cacheHeight = glyph->mCacheTexture->mHeight;
 
     glyph->mBitmapMinU = (float) startX / (float) cacheWidth;
     glyph->mBitmapMinV = (float) startY / (float) cacheHeight;
@@ -473,10 +568,7 @@ FontRenderer::FontRenderer() {
     mTextMeshPtr = NULL;
     mCurrentCacheTexture = NULL;
     mLastCacheTexture = NULL;
-    mCacheTextureSmall = NULL;
-    mCacheTexture128 = NULL;
-    mCacheTexture256 = NULL;
-    mCacheTexture512 = NULL;
+    mRenderGeneration = 0;
 
     mLinearFiltering = false;
 
@@ -512,21 +604,16 @@ FontRenderer::FontRenderer() {
 }
 
 FontRenderer::~FontRenderer() {
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        delete mCacheLines[i];
-    }
-    mCacheLines.clear();
-
     if (mInitialized) {
         // Unbinding the buffer shouldn't be necessary but it crashes with some drivers
         Caches::getInstance().unbindIndicesBuffer();
         glDeleteBuffers(1, &mIndexBufferID);
 
         delete[] mTextMeshPtr;
-        delete mCacheTextureSmall;
-        delete mCacheTexture128;
-        delete mCacheTexture256;
-        delete mCacheTexture512;
+        for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+            delete mCacheTextures[i];
+        }
+        mCacheTextures.clear();
     }
 
     Vector<Font*> fontsToDereference = mActiveFonts;
@@ -535,19 +622,37 @@ FontRenderer::~FontRenderer() {
     }
 }
 
-void FontRenderer::flushAllAndInvalidate() {
+void FontRenderer::evictCacheTexture(CacheTexture* cacheTexture) {
     if (mCurrentQuadIndex != 0) {
         issueDrawCommand();
         mCurrentQuadIndex = 0;
     }
 
     for (uint32_t i = 0; i < mActiveFonts.size(); i++) {
-        mActiveFonts[i]->invalidateTextureCache();
+        mActiveFonts[i]->invalidateTextureCache(cacheTexture);
     }
 
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        mCacheLines[i]->mCurrentCol = 0;
+    cacheTexture->reset();
+}
+
+void FontRenderer::removeCacheTexture(CacheTexture* cacheTexture) {
+    evictCacheTexture(cacheTexture);
+
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        if (mCacheTextures[i] == cacheTexture) {
+            mCacheTextures.removeAt(i);
+            break;
+        }
     }
+
+    if (mCurrentCacheTexture == cacheTexture) {
+        mCurrentCacheTexture = mCacheTextures[0];
+    }
+    if (mLastCacheTexture == cacheTexture) {
+        mLastCacheTexture = NULL;
+    }
+
+    delete cacheTexture;
 }
 
 void FontRenderer::deallocateTextureMemory(CacheTexture *cacheTexture) {
@@ -560,29 +665,10 @@ void FontRenderer::deallocateTextureMemory(CacheTexture *cacheTexture) {
 }
 
 void FontRenderer::flushLargeCaches() {
-    if ((!mCacheTexture128 || !mCacheTexture128->mTexture) &&
-            (!mCacheTexture256 || !mCacheTexture256->mTexture) &&
-            (!mCacheTexture512 || !mCacheTexture512->mTexture)) {
-        // Typical case; no large glyph caches allocated
-        return;
+    // Typical case; only the first page is allocated
+    while (mCacheTextures.size() > 1) {
+        removeCacheTexture(mCacheTextures.top());
     }
-
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        CacheTextureLine* cacheLine = mCacheLines[i];
-        if ((cacheLine->mCacheTexture == mCacheTexture128 ||
-                cacheLine->mCacheTexture == mCacheTexture256 ||
-                cacheLine->mCacheTexture == mCacheTexture512) &&
-                cacheLine->mCacheTexture->mTexture != NULL) {
-            cacheLine->mCurrentCol = 0;
-            for (uint32_t i = 0; i < mActiveFonts.size(); i++) {
-                mActiveFonts[i]->invalidateTextureCache(cacheLine);
-            }
-        }
-    }
-
-    deallocateTextureMemory(mCacheTexture128);
-    deallocateTextureMemory(mCacheTexture256);
-    deallocateTextureMemory(mCacheTexture512);
 }
 
 void FontRenderer::allocateTextureMemory(CacheTexture* cacheTexture) {
@@ -615,9 +701,12 @@ void FontRenderer::allocateTextureMemory(CacheTexture* cacheTexture) {
 
 void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyph,
         uint32_t* retOriginX, uint32_t* retOriginY) {
+    checkInit();
+
     cachedGlyph->mIsValid = false;
-    // If the glyph is too tall, don't cache it
-    if (glyph.fHeight + TEXTURE_BORDER_SIZE > mCacheLines[mCacheLines.size() - 1]->mMaxHeight) {
+    // If the glyph is too large, don't cache it
+    if (glyph.fWidth + TEXTURE_BORDER_SIZE > mLargeCacheWidth ||
+            glyph.fHeight + TEXTURE_BORDER_SIZE > MAX_LARGE_TEXT_CACHE_HEIGHT) {
         ALOGE("Font size to large to fit in cache. width, height = %i, %i",
                 (int) glyph.fWidth, (int) glyph.fHeight);
         return;
@@ -627,36 +716,14 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
     uint32_t startX = 0;
     uint32_t startY = 0;
 
-    bool bitmapFit = false;
-    CacheTextureLine *cacheLine;
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        bitmapFit = mCacheLines[i]->fitBitmap(glyph, &startX, &startY);
-        if (bitmapFit) {
-            cacheLine = mCacheLines[i];
-            break;
-        }
-    }
-
-    // If the new glyph didn't fit, flush the state so far and invalidate everything
-    if (!bitmapFit) {
-        flushAllAndInvalidate();
-
-        // Try to fit it again
-        for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-            bitmapFit = mCacheLines[i]->fitBitmap(glyph, &startX, &startY);
-            if (bitmapFit) {
-                cacheLine = mCacheLines[i];
-                break;
-            }
-        }
+    CacheTexture* cacheTexture = findCacheTexture(glyph, &startX, &startY);
 
-        // if we still don't fit, something is wrong and we shouldn't draw
-        if (!bitmapFit) {
-            return;
-        }
+    // if we still don't fit, something is wrong and we shouldn't draw
+    if (!cacheTexture) {
+        return;
     }
 
-    cachedGlyph->mCachedTextureLine = cacheLine;
+    cachedGlyph->mCacheTexture = cacheTexture;
 
     *retOriginX = startX;
     *retOriginY = startY;
@@ -664,9 +731,8 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
     uint32_t endX = startX + glyph.fWidth;
     uint32_t endY = startY + glyph.fHeight;
 
-    uint32_t cacheWidth = cacheLine->mMaxWidth;
+    uint32_t cacheWidth = cacheTexture->mWidth;
 
-    CacheTexture* cacheTexture = cacheLine->mCacheTexture;
     if (!cacheTexture->mTexture) {
         // Large-glyph texture memory is allocated only as needed
         allocateTextureMemory(cacheTexture);
@@ -699,19 +765,12 @@ CacheTexture* FontRenderer::createCacheTexture(int width, int height, bool alloc
 }
 
 void FontRenderer::initTextTexture() {
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        delete mCacheLines[i];
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        delete mCacheTextures[i];
     }
-    mCacheLines.clear();
+    mCacheTextures.clear();
 
-    if (mCacheTextureSmall) {
-        delete mCacheTextureSmall;
-        delete mCacheTexture128;
-        delete mCacheTexture256;
-        delete mCacheTexture512;
-    }
-
-    // Next, use other, separate caches for large glyphs.
+    // Large glyphs go in wider pages
     uint16_t maxWidth = 0;
     if (Caches::hasInstance()) {
         maxWidth = Caches::getInstance().maxTextureSize;
@@ -720,36 +779,82 @@ void FontRenderer::initTextTexture() {
     if (maxWidth > MAX_TEXT_CACHE_WIDTH || maxWidth == 0) {
         maxWidth = MAX_TEXT_CACHE_WIDTH;
     }
+    mLargeCacheWidth = maxWidth;
+
+    // Pages can use as much memory as the fixed large glyph caches used to
+    mMaxCacheSize = mSmallCacheWidth * mSmallCacheHeight +
+            mLargeCacheWidth * (LARGE_TEXT_CACHE_HEIGHT * 2 + MAX_LARGE_TEXT_CACHE_HEIGHT);
 
-    mCacheTextureSmall = createCacheTexture(mSmallCacheWidth, mSmallCacheHeight, true);
-    mCacheTexture128 = createCacheTexture(maxWidth, 256, false);
-    mCacheTexture256 = createCacheTexture(maxWidth, 256, false);
-    mCacheTexture512 = createCacheTexture(maxWidth, 512, false);
-    mCurrentCacheTexture = mCacheTextureSmall;
+    mCacheTextures.push(createCacheTexture(mSmallCacheWidth, mSmallCacheHeight, true));
+    mCurrentCacheTexture = mCacheTextures[0];
+    mLastCacheTexture = NULL;
 
     mUploadTexture = false;
-    // Split up our default cache texture into lines of certain widths
-    int nextLine = 0;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 18, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 26, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 26, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 34, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 34, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 42, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, mSmallCacheHeight - nextLine,
-            nextLine, 0, mCacheTextureSmall));
-
-    //  The first cache is split into 2 lines of height 128, the rest have just one cache line.
-    mCacheLines.push(new CacheTextureLine(maxWidth, 128, 0, 0, mCacheTexture128));
-    mCacheLines.push(new CacheTextureLine(maxWidth, 128, 128, 0, mCacheTexture128));
-    mCacheLines.push(new CacheTextureLine(maxWidth, 256, 0, 0, mCacheTexture256));
-    mCacheLines.push(new CacheTextureLine(maxWidth, 512, 0, 0, mCacheTexture512));
+}
+
+CacheTexture* FontRenderer::findCacheTexture(const SkGlyph& glyph,
+        uint32_t* retOriginX, uint32_t* retOriginY) {
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        CacheTexture* cacheTexture = mCacheTextures[i];
+        if (cacheTexture->fitBitmap(glyph, retOriginX, retOriginY)) {
+            return cacheTexture;
+        }
+    }
+
+    const uint32_t glyphWidth = glyph.fWidth + TEXTURE_BORDER_SIZE;
+    const uint32_t glyphHeight = glyph.fHeight + TEXTURE_BORDER_SIZE;
+
+    uint32_t width = mSmallCacheWidth;
+    uint32_t height = mSmallCacheHeight;
+    if (glyphWidth > mSmallCacheWidth || glyphHeight > mSmallCacheHeight) {
+        width = mLargeCacheWidth;
+        height = glyphHeight > LARGE_TEXT_CACHE_HEIGHT ?
+                MAX_LARGE_TEXT_CACHE_HEIGHT : LARGE_TEXT_CACHE_HEIGHT;
+    }
+
+    uint32_t size = 0;
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        size += mCacheTextures[i]->mWidth * mCacheTextures[i]->mHeight;
+    }
+
+    if (size + width * height > mMaxCacheSize) {
+        // The cache is full, recycle the least recently used page large enough
+        CacheTexture* victim = NULL;
+        for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+            CacheTexture* cacheTexture = mCacheTextures[i];
+            if (cacheTexture->mWidth >= glyphWidth && cacheTexture->mHeight >= glyphHeight &&
+                    (!victim || cacheTexture->mGeneration < victim->mGeneration)) {
+                victim = cacheTexture;
+            }
+        }
+
+        if (victim) {
+            evictCacheTexture(victim);
+            return victim->fitBitmap(glyph, retOriginX, retOriginY) ? victim : NULL;
+        }
+
+        // No page can hold this glyph, drop the least recently used extra
+        // pages until a new one can be created
+        while (size + width * height > mMaxCacheSize && mCacheTextures.size() > 1) {
+            CacheTexture* oldest = mCacheTextures[1];
+            for (uint32_t i = 2; i < mCacheTextures.size(); i++) {
+                if (mCacheTextures[i]->mGeneration < oldest->mGeneration) {
+                    oldest = mCacheTextures[i];
+                }
+            }
+            size -= oldest->mWidth * oldest->mHeight;
+            removeCacheTexture(oldest);
+        }
+
+        if (size + width * height > mMaxCacheSize) {
+            return NULL;
+        }
+    }
+
+    CacheTexture* cacheTexture = createCacheTexture(width, height, true);
+    mCacheTextures.push(cacheTexture);
+
+    return cacheTexture->fitBitmap(glyph, retOriginX, retOriginY) ? cacheTexture : NULL;
 }
 
 // Avoid having to reallocate memory and render quad by quad
@@ -804,26 +909,27 @@ void FontRenderer::checkTextureUpdate() {
 
     Caches& caches = Caches::getInstance();
     GLuint lastTextureId = 0;
-    // Iterate over all the cache lines and see which ones need to be updated
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        CacheTextureLine* cl = mCacheLines[i];
-        if (cl->mDirty && cl->mCacheTexture->mTexture != NULL) {
-            CacheTexture* cacheTexture = cl->mCacheTexture;
-            uint32_t xOffset = 0;
-            uint32_t yOffset = cl->mCurrentRow;
-            uint32_t width   = cl->mMaxWidth;
-            uint32_t height  = cl->mMaxHeight;
-            void* textureData = cacheTexture->mTexture + (yOffset * width);
-
+    // Iterate over all the pages and see which ones need to be updated
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        CacheTexture* cacheTexture = mCacheTextures[i];
+        if (!cacheTexture->mDirtyRect.isEmpty() && cacheTexture->mTexture != NULL) {
             if (cacheTexture->mTextureId != lastTextureId) {
                 caches.activeTexture(0);
                 glBindTexture(GL_TEXTURE_2D, cacheTexture->mTextureId);
                 lastTextureId = cacheTexture->mTextureId;
             }
-            glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, width, height,
+
+            // GLES 2.0 cannot upload a sub-rectangle of a wider buffer, upload
+            // the full rows spanned by the glyphs added since the last update
+            uint32_t width = cacheTexture->mWidth;
+            uint32_t top = (uint32_t) cacheTexture->mDirtyRect.top;
+            uint32_t height = (uint32_t) cacheTexture->mDirtyRect.bottom - top;
+            void* textureData = cacheTexture->mTexture + top * width;
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, top, width, height,
                     GL_ALPHA, GL_UNSIGNED_BYTE, textureData);
 
-            cl->mDirty = false;
+            cacheTexture->mDirtyRect.setEmpty();
         }
     }
 
@@ -856,6 +962,7 @@ void FontRenderer::issueDrawCommand() {
     }
 
     glDrawElements(GL_TRIANGLES, mCurrentQuadIndex * 6, GL_UNSIGNED_SHORT, NULL);
+    caches.stats.drawCalls++;
 
     mDrawn = true;
 }
@@ -872,6 +979,7 @@ void FontRenderer::appendMeshQuadNoClip(float x1, float y1, float u1, float v1,
         // Now use the new texture id
         mCurrentCacheTexture = texture;
     }
+    texture->mGeneration = mRenderGeneration;
 
     const uint32_t vertsPerQuad = 4;
     const uint32_t floatsPerVert = 4;
@@ -946,9 +1054,10 @@ void FontRenderer::appendRotatedMeshQuad(float x1, float y1, float u1, float v1,
 uint32_t FontRenderer::getRemainingCacheCapacity() {
     uint32_t remainingCapacity = 0;
     float totalPixels = 0;
-    for(uint32_t i = 0; i < mCacheLines.size(); i ++) {
-         remainingCapacity += (mCacheLines[i]->mMaxWidth - mCacheLines[i]->mCurrentCol);
-         totalPixels += mCacheLines[i]->mMaxWidth;
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        CacheTexture* cacheTexture = mCacheTextures[i];
+        remainingCapacity += cacheTexture->getRemainingArea();
+        totalPixels += cacheTexture->mWidth * cacheTexture->mHeight;
     }
     remainingCapacity = (remainingCapacity * 100) / totalPixels;
     return remainingCapacity;
@@ -1047,6 +1156,7 @@ FontRenderer::DropShadow FontRenderer::renderDropShadow(SkPaint* paint, const ch
 void FontRenderer::initRender(const Rect* clip, Rect* bounds) {
     checkInit();
 
+    mRenderGeneration++;
     mDrawn = false;
     mBounds = bounds;
     mClip = clip;
@@ -1143,30 +1253,60 @@ void FontRenderer::computeGaussianWeights(float* weights, int32_t radius) {
     }
 }
 
-void FontRenderer::horizontalBlur(float* weights, int32_t radius,
-        const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
-    float blurredPixel = 0.0f;
-    float currentPixel = 0.0f;
+void FontRenderer::computeFixedGaussianWeights(int32_t* weights, int32_t radius) {
+    float* gaussian = new float[2 * radius + 1];
+    computeGaussianWeights(gaussian, radius);
 
-    for (int32_t y = 0; y < height; y ++) {
+    // Convert the weights to 16.16 fixed point, the rounding error is
+    // folded into the center weight so that the weights add up to one
+    int32_t sum = 0;
+    for (int32_t r = -radius; r <= radius; r++) {
+        weights[r + radius] = (int32_t) (gaussian[r + radius] * 65536.0f + 0.5f);
+        sum += weights[r + radius];
+    }
+    weights[radius] += 65536 - sum;
+
+    delete[] gaussian;
+}
+
+void FontRenderer::computeBoxBlurRadii(int32_t* radii, int32_t radius) {
+    // Three successive box blurs approximate a gaussian blur; pick the box
+    // sizes so that the resulting variance matches the gaussian's
+    float sigma = 0.3f * (float) radius + 0.6f;
+    float variance = 12.0f * sigma * sigma;
+
+    int32_t lower = (int32_t) sqrtf(variance / BOX_BLUR_PASS_COUNT + 1.0f);
+    if (lower % 2 == 0) lower--;
+    int32_t upper = lower + 2;
+
+    float ideal = (variance - BOX_BLUR_PASS_COUNT * lower * lower -
+            4.0f * BOX_BLUR_PASS_COUNT * lower - 3.0f * BOX_BLUR_PASS_COUNT) /
+            (-4.0f * lower - 4.0f);
+    int32_t lowerCount = (int32_t) (ideal + 0.5f);
+
+    for (int32_t i = 0; i < BOX_BLUR_PASS_COUNT; i++) {
+        radii[i] = ((i < lowerCount ? lower : upper) - 1) / 2;
+    }
+}
+
+void FontRenderer::horizontalBlur(const int32_t* weights, int32_t radius,
+        const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
+    for (int32_t y = 0; y < height; y++) {
 
         const uint8_t* input = source + y * width;
         uint8_t* output = dest + y * width;
 
-        for (int32_t x = 0; x < width; x ++) {
-            blurredPixel = 0.0f;
-            const float* gPtr = weights;
+        for (int32_t x = 0; x < width; x++) {
+            uint32_t blurredPixel = 0;
+            const int32_t* gPtr = weights;
             // Optimization for non-border pixels
             if (x > radius && x < (width - radius)) {
                 const uint8_t *i = input + (x - radius);
-                for (int r = -radius; r <= radius; r ++) {
-                    currentPixel = (float) (*i);
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                    i++;
+                for (int32_t r = -radius; r <= radius; r++) {
+                    blurredPixel += *i++ * *gPtr++;
                 }
             } else {
-                for (int32_t r = -radius; r <= radius; r ++) {
+                for (int32_t r = -radius; r <= radius; r++) {
                     // Stepping left and right away from the pixel
                     int validW = x + r;
                     if (validW < 0) {
@@ -1176,73 +1316,133 @@ void FontRenderer::horizontalBlur(float* weights, int32_t radius,
                         validW = width - 1;
                     }
 
-                    currentPixel = (float) input[validW];
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
+                    blurredPixel += input[validW] * *gPtr++;
                 }
             }
-            *output = (uint8_t)blurredPixel;
-            output ++;
+            *output++ = (uint8_t) ((blurredPixel + 0x8000) >> 16);
         }
     }
 }
 
-void FontRenderer::verticalBlur(float* weights, int32_t radius,
+void FontRenderer::verticalBlur(const int32_t* weights, int32_t radius,
         const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
-    float blurredPixel = 0.0f;
-    float currentPixel = 0.0f;
+    // Accumulate whole rows at a time, walking the source image in memory
+    // order instead of down each column
+    uint32_t* sums = new uint32_t[width];
+
+    for (int32_t y = 0; y < height; y++) {
+        memset(sums, 0, width * sizeof(uint32_t));
+
+        for (int32_t r = -radius; r <= radius; r++) {
+            int32_t validH = y + r;
+            // Clamp to zero and height
+            if (validH < 0) {
+                validH = 0;
+            }
+            if (validH > height - 1) {
+                validH = height - 1;
+            }
 
-    for (int32_t y = 0; y < height; y ++) {
+            const uint8_t* input = source + validH * width;
+            const uint32_t weight = weights[r + radius];
+            for (int32_t x = 0; x < width; x++) {
+                sums[x] += input[x] * weight;
+            }
+        }
 
         uint8_t* output = dest + y * width;
+        for (int32_t x = 0; x < width; x++) {
+            output[x] = (uint8_t) ((sums[x] + 0x8000) >> 16);
+        }
+    }
 
-        for (int32_t x = 0; x < width; x ++) {
-            blurredPixel = 0.0f;
-            const float* gPtr = weights;
-            const uint8_t* input = source + x;
-            // Optimization for non-border pixels
-            if (y > radius && y < (height - radius)) {
-                const uint8_t *i = input + ((y - radius) * width);
-                for (int32_t r = -radius; r <= radius; r ++) {
-                    currentPixel = (float)(*i);
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                    i += width;
-                }
-            } else {
-                for (int32_t r = -radius; r <= radius; r ++) {
-                    int validH = y + r;
-                    // Clamp to zero and width
-                    if (validH < 0) {
-                        validH = 0;
-                    }
-                    if (validH > height - 1) {
-                        validH = height - 1;
-                    }
+    delete[] sums;
+}
 
-                    const uint8_t *i = input + validH * width;
-                    currentPixel = (float) (*i);
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                }
-            }
-            *output = (uint8_t) blurredPixel;
-            output ++;
+void FontRenderer::horizontalBoxBlur(int32_t radius, const uint8_t* source, uint8_t* dest,
+        int32_t width, int32_t height) {
+    const uint32_t scale = 65536 / (2 * radius + 1);
+    const int32_t last = width - 1;
+
+    for (int32_t y = 0; y < height; y++) {
+        const uint8_t* input = source + y * width;
+        uint8_t* output = dest + y * width;
+
+        // Running sum of the window, pixels outside the image repeat the edges
+        int32_t sum = input[0] * (radius + 1);
+        for (int32_t i = 1; i <= radius; i++) {
+            sum += input[i < last ? i : last];
+        }
+
+        for (int32_t x = 0; x < width; x++) {
+            output[x] = (uint8_t) ((sum * scale + 0x8000) >> 16);
+
+            const int32_t in = x + radius + 1;
+            const int32_t out = x - radius;
+            sum += input[in < last ? in : last] - input[out > 0 ? out : 0];
         }
     }
 }
 
+void FontRenderer::verticalBoxBlur(int32_t radius, const uint8_t* source, uint8_t* dest,
+        int32_t width, int32_t height) {
+    const uint32_t scale = 65536 / (2 * radius + 1);
+    const int32_t last = height - 1;
 
-void FontRenderer::blurImage(uint8_t *image, int32_t width, int32_t height, int32_t radius) {
-    float *gaussian = new float[2 * radius + 1];
-    computeGaussianWeights(gaussian, radius);
+    // Running sums of the window for each column, updated a row at a time
+    int32_t* sums = new int32_t[width];
+    for (int32_t x = 0; x < width; x++) {
+        sums[x] = source[x] * (radius + 1);
+    }
+    for (int32_t i = 1; i <= radius; i++) {
+        const uint8_t* input = source + (i < last ? i : last) * width;
+        for (int32_t x = 0; x < width; x++) {
+            sums[x] += input[x];
+        }
+    }
+
+    for (int32_t y = 0; y < height; y++) {
+        uint8_t* output = dest + y * width;
+        for (int32_t x = 0; x < width; x++) {
+            output[x] = (uint8_t) ((sums[x] * scale + 0x8000) >> 16);
+        }
+
+        const int32_t in = y + radius + 1;
+        const int32_t out = y - radius;
+        const uint8_t* added = source + (in < last ? in : last) * width;
+        const uint8_t* removed = source + (out > 0 ? out : 0) * width;
+        for (int32_t x = 0; x < width; x++) {
+            sums[x] += added[x] - removed[x];
+        }
+    }
 
+    delete[] sums;
+}
+
+void FontRenderer::blurImage(uint8_t *image, int32_t width, int32_t height, int32_t radius) {
     uint8_t* scratch = new uint8_t[width * height];
 
-    horizontalBlur(gaussian, radius, image, scratch, width, height);
-    verticalBlur(gaussian, radius, scratch, image, width, height);
+    if (radius <= MAX_GAUSSIAN_BLUR_RADIUS) {
+        int32_t* gaussian = new int32_t[2 * radius + 1];
+        computeFixedGaussianWeights(gaussian, radius);
+
+        horizontalBlur(gaussian, radius, image, scratch, width, height);
+        verticalBlur(gaussian, radius, scratch, image, width, height);
+
+        delete[] gaussian;
+    } else {
+        // The cost of the box blurs does not depend on the radius
+        int32_t radii[BOX_BLUR_PASS_COUNT];
+        computeBoxBlurRadii(radii, radius);
+
+        horizontalBoxBlur(radii[0], image, scratch, width, height);
+        horizontalBoxBlur(radii[1], scratch, image, width, height);
+        horizontalBoxBlur(radii[2], image, scratch, width, height);
+        verticalBoxBlur(radii[0], scratch, image, width, height);
+        verticalBoxBlur(radii[1], image, scratch, width, height);
+        verticalBoxBlur(radii[2], scratch, image, width, height);
+    }
 
-    delete[] gaussian;
     delete[] scratch;
 }
 
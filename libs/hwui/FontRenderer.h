@@ -59,12 +59,19 @@ namespace uirenderer {
 
 class FontRenderer;
 
+/**
+ * A page of the glyph cache. Glyphs are packed in the page using a skyline
+ * allocator: the page keeps track of the top edge of the glyphs already
+ * allocated in each of its columns, and new glyphs are placed as low as
+ * possible on that edge.
+ */
 class CacheTexture {
 public:
-    CacheTexture() { }
     CacheTexture(uint8_t* texture, uint16_t width, uint16_t height) :
             mTexture(texture), mTextureId(0), mWidth(width), mHeight(height),
-            mLinearFiltering(false) { }
+            mLinearFiltering(false), mGeneration(0) {
+        reset();
+    }
     ~CacheTexture() {
         if (mTexture) {
             delete[] mTexture;
@@ -74,33 +81,41 @@ public:
         }
     }
 
+    /**
+     * Finds room for the specified glyph. Returns false if the glyph does
+     * not fit in this page.
+     */
+    bool fitBitmap(const SkGlyph& glyph, uint32_t *retOriginX, uint32_t *retOriginY);
+
+    /**
+     * Marks the whole page as free. Glyphs that were stored in this page
+     * must be invalidated.
+     */
+    void reset();
+
+    /**
+     * Returns the number of pixels that can still be allocated in this page.
+     */
+    uint32_t getRemainingArea() const;
+
     uint8_t* mTexture;
     GLuint mTextureId;
     uint16_t mWidth;
     uint16_t mHeight;
     bool mLinearFiltering;
-};
-
-class CacheTextureLine {
-public:
-    CacheTextureLine(uint16_t maxWidth, uint16_t maxHeight, uint32_t currentRow,
-            uint32_t currentCol, CacheTexture* cacheTexture):
-                mMaxHeight(maxHeight),
-                mMaxWidth(maxWidth),
-                mCurrentRow(currentRow),
-                mCurrentCol(currentCol),
-                mDirty(false),
-                mCacheTexture(cacheTexture) {
-    }
-
-    bool fitBitmap(const SkGlyph& glyph, uint32_t *retOriginX, uint32_t *retOriginY);
+    // Area of the texture that must be uploaded before drawing
+    Rect mDirtyRect;
+    // Render generation in which this page was last used to draw glyphs
+    uint32_t mGeneration;
+
+private:
+    struct SkylineNode {
+        uint16_t x;
+        uint16_t y;
+        uint16_t width;
+    };
 
-    uint16_t mMaxHeight;
-    uint16_t mMaxWidth;
-    uint32_t mCurrentRow;
-    uint32_t mCurrentCol;
-    bool mDirty;
-    CacheTexture* mCacheTexture;
+    Vector<SkylineNode> mSkyline;
 };
 
 struct CachedGlyphInfo {
@@ -128,7 +143,7 @@ struct CachedGlyphInfo {
     // Auto-kerning
     SkFixed mLsbDelta;
     SkFixed mRsbDelta;
-    CacheTextureLine* mCachedTextureLine;
+    CacheTexture* mCacheTexture;
 };
 
 
@@ -193,7 +208,7 @@ protected:
     // Cache of glyphs
     DefaultKeyedVector<glyph_t, CachedGlyphInfo*> mCachedGlyphs;
 
-    void invalidateTextureCache(CacheTextureLine *cacheLine = NULL);
+    void invalidateTextureCache(CacheTexture* cacheTexture = NULL);
 
     CachedGlyphInfo* cacheGlyph(SkPaint* paint, glyph_t glyph);
     void updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyphInfo* glyph);
@@ -294,17 +309,11 @@ public:
 
     uint32_t getCacheSize() const {
         uint32_t size = 0;
-        if (mCacheTextureSmall != NULL && mCacheTextureSmall->mTexture != NULL) {
-            size += mCacheTextureSmall->mWidth * mCacheTextureSmall->mHeight;
-        }
-        if (mCacheTexture128 != NULL && mCacheTexture128->mTexture != NULL) {
-            size += mCacheTexture128->mWidth * mCacheTexture128->mHeight;
-        }
-        if (mCacheTexture256 != NULL && mCacheTexture256->mTexture != NULL) {
-            size += mCacheTexture256->mWidth * mCacheTexture256->mHeight;
-        }
-        if (mCacheTexture512 != NULL && mCacheTexture512->mTexture != NULL) {
-            size += mCacheTexture512->mWidth * mCacheTexture512->mHeight;
+        for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+            CacheTexture* cacheTexture = mCacheTextures[i];
+            if (cacheTexture->mTexture != NULL) {
+                size += cacheTexture->mWidth * cacheTexture->mHeight;
+            }
         }
         return size;
     }
@@ -321,7 +330,19 @@ protected:
     void cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyph,
             uint32_t *retOriginX, uint32_t *retOriginY);
 
-    void flushAllAndInvalidate();
+    /**
+     * Returns a page with enough room for the specified glyph, creating a
+     * new page or evicting the least recently used one if needed.
+     */
+    CacheTexture* findCacheTexture(const SkGlyph& glyph, uint32_t* retOriginX,
+            uint32_t* retOriginY);
+    /**
+     * Invalidates all the glyphs stored in the specified page and marks the
+     * page as free. Pending glyphs are drawn first.
+     */
+    void evictCacheTexture(CacheTexture* cacheTexture);
+    void removeCacheTexture(CacheTexture* cacheTexture);
+
     void initVertexArrayBuffers();
 
     void checkInit();
@@ -346,8 +367,10 @@ protected:
 
     uint32_t mSmallCacheWidth;
     uint32_t mSmallCacheHeight;
+    uint32_t mLargeCacheWidth;
+    // Maximum number of pixels of all the pages combined
+    uint32_t mMaxCacheSize;
 
-    Vector<CacheTextureLine*> mCacheLines;
     uint32_t getRemainingCacheCapacity();
 
     Font* mCurrentFont;
@@ -355,10 +378,10 @@ protected:
 
     CacheTexture* mCurrentCacheTexture;
     CacheTexture* mLastCacheTexture;
-    CacheTexture* mCacheTextureSmall;
-    CacheTexture* mCacheTexture128;
-    CacheTexture* mCacheTexture256;
-    CacheTexture* mCacheTexture512;
+    // The first page is always of the small cache size and is never removed
+    Vector<CacheTexture*> mCacheTextures;
+    // Incremented for every rendered string, used to find unused pages
+    uint32_t mRenderGeneration;
 
     void checkTextureUpdate();
     bool mUploadTexture;
@@ -379,9 +402,15 @@ protected:
     bool mLinearFiltering;
 
     void computeGaussianWeights(float* weights, int32_t radius);
-    void horizontalBlur(float* weights, int32_t radius, const uint8_t *source, uint8_t *dest,
+    void computeFixedGaussianWeights(int32_t* weights, int32_t radius);
+    void computeBoxBlurRadii(int32_t* radii, int32_t radius);
+    void horizontalBlur(const int32_t* weights, int32_t radius, const uint8_t *source,
+            uint8_t *dest, int32_t width, int32_t height);
+    void verticalBlur(const int32_t* weights, int32_t radius, const uint8_t *source,
+            uint8_t *dest, int32_t width, int32_t height);
+    void horizontalBoxBlur(int32_t radius, const uint8_t* source, uint8_t* dest,
             int32_t width, int32_t height);
-    void verticalBlur(float* weights, int32_t radius, const uint8_t *source, uint8_t *dest,
+    void verticalBoxBlur(int32_t radius, const uint8_t* source, uint8_t* dest,
             int32_t width, int32_t height);
     void blurImage(uint8_t* image, int32_t width, int32_t height, int32_t radius);
 };
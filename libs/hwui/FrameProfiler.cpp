@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <string.h>
+
+#include <EGL/egl.h>
+
+#include <cutils/properties.h>
+
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "FrameProfiler.h"
+#include "Properties.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define PROFILE_OP_COUNT (DisplayList::DrawGLFunction + 1)
+
+// GL_EXT_disjoint_timer_query
+#ifndef GL_TIME_ELAPSED_EXT
+    #define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+    #define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+    #define GL_QUERY_RESULT_EXT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+    #define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+
+typedef void (GL_APIENTRYP TimerGenQueriesProc) (GLsizei n, GLuint* ids);
+typedef void (GL_APIENTRYP TimerDeleteQueriesProc) (GLsizei n, const GLuint* ids);
+typedef void (GL_APIENTRYP TimerBeginQueryProc) (GLenum target, GLuint id);
+typedef void (GL_APIENTRYP TimerEndQueryProc) (GLenum target);
+typedef void (GL_APIENTRYP TimerGetQueryObjectuivProc) (GLuint id, GLenum pname, GLuint* params);
+typedef void (GL_APIENTRYP TimerGetQueryObjectui64vProc) (GLuint id, GLenum pname,
+        uint64_t* params);
+
+static TimerGenQueriesProc sGenQueries = NULL;
+static TimerDeleteQueriesProc sDeleteQueries = NULL;
+static TimerBeginQueryProc sBeginQuery = NULL;
+static TimerEndQueryProc sEndQuery = NULL;
+static TimerGetQueryObjectuivProc sGetQueryObjectuiv = NULL;
+static TimerGetQueryObjectui64vProc sGetQueryObjectui64v = NULL;
+
+///////////////////////////////////////////////////////////////////////////////
+// Frame
+///////////////////////////////////////////////////////////////////////////////
+
+struct FrameProfiler::Frame {
+    uint32_t serial;
+    nsecs_t recordTime;
+    nsecs_t replayTime;
+    nsecs_t issueTime;
+    // -1 until the result of the timer query is known
+    nsecs_t gpuTime;
+    uint32_t opCounts[PROFILE_OP_COUNT];
+
+    void reset(uint32_t frameSerial) {
+        serial = frameSerial;
+        recordTime = 0;
+        replayTime = 0;
+        issueTime = 0;
+        gpuTime = -1;
+        memset(opCounts, 0, sizeof(opCounts));
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+FrameProfiler::FrameProfiler(): mFrames(NULL), mFrameCount(0), mCurrent(NULL),
+        mInFrame(false), mSerial(0), mFrameStart(0), mPendingRecordTime(0),
+        mRecordStart(0), mRecordDepth(0), mReplayStart(0), mReplayDepth(0),
+        mHasTimerQuery(false), mQueriesInitialized(false), mActiveQuery(-1) {
+    char property[PROPERTY_VALUE_MAX];
+    mEnabled = property_get(PROPERTY_PROFILE, property, "false") > 0 &&
+            !strcmp(property, "true");
+
+    if (mEnabled) {
+        ALOGD("Enabling frame profiling");
+        mFrames = new Frame[PROFILE_FRAME_COUNT];
+        mCurrent = new Frame;
+    }
+
+    memset(mQueries, 0, sizeof(mQueries));
+    memset(mQuerySerials, 0, sizeof(mQuerySerials));
+}
+
+FrameProfiler::~FrameProfiler() {
+    delete[] mFrames;
+    delete mCurrent;
+}
+
+void FrameProfiler::terminate() {
+    if (mQueriesInitialized) {
+        if (mActiveQuery >= 0) {
+            sEndQuery(GL_TIME_ELAPSED_EXT);
+            mActiveQuery = -1;
+        }
+        sDeleteQueries(PROFILE_QUERY_COUNT, mQueries);
+        memset(mQuerySerials, 0, sizeof(mQuerySerials));
+        mQueriesInitialized = false;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GPU timer queries
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameProfiler::initQueries() {
+    mQueriesInitialized = true;
+
+    mHasTimerQuery = Caches::getInstance().extensions.hasTimerQuery();
+    if (mHasTimerQuery && !sGenQueries) {
+        sGenQueries = (TimerGenQueriesProc) eglGetProcAddress("glGenQueriesEXT");
+        sDeleteQueries = (TimerDeleteQueriesProc) eglGetProcAddress("glDeleteQueriesEXT");
+        sBeginQuery = (TimerBeginQueryProc) eglGetProcAddress("glBeginQueryEXT");
+        sEndQuery = (TimerEndQueryProc) eglGetProcAddress("glEndQueryEXT");
+        sGetQueryObjectuiv = (TimerGetQueryObjectuivProc)
+                eglGetProcAddress("glGetQueryObjectuivEXT");
+        sGetQueryObjectui64v = (TimerGetQueryObjectui64vProc)
+                eglGetProcAddress("glGetQueryObjectui64vEXT");
+
+        mHasTimerQuery = sGenQueries && sDeleteQueries && sBeginQuery && sEndQuery &&
+                sGetQueryObjectuiv && sGetQueryObjectui64v;
+        if (!mHasTimerQuery) {
+            sGenQueries = NULL;
+            ALOGW("GL_EXT_disjoint_timer_query is advertised but cannot be loaded");
+        }
+    }
+
+    if (mHasTimerQuery) {
+        sGenQueries(PROFILE_QUERY_COUNT, mQueries);
+    } else {
+        mQueriesInitialized = false;
+    }
+}
+
+/**
+ * Reads back the results of the queries issued during the previous frames.
+ * Results of frames that have already left the ring buffer are dropped, as
+ * are results obtained while a disjoint operation (a frequency change for
+ * instance) invalidated the GPU timer.
+ */
+void FrameProfiler::resolveQueries() {
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    for (int i = 0; i < PROFILE_QUERY_COUNT; i++) {
+        if (mQuerySerials[i] == 0 || i == mActiveQuery) continue;
+
+        GLuint available = GL_FALSE;
+        sGetQueryObjectuiv(mQueries[i], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available && !disjoint) continue;
+
+        if (available && !disjoint) {
+            uint64_t elapsed = 0;
+            sGetQueryObjectui64v(mQueries[i], GL_QUERY_RESULT_EXT, &elapsed);
+
+            Mutex::Autolock _l(mLock);
+            Frame& frame = mFrames[mQuerySerials[i] % PROFILE_FRAME_COUNT];
+            if (frame.serial == mQuerySerials[i]) {
+                frame.gpuTime = (nsecs_t) elapsed;
+            }
+        }
+
+        mQuerySerials[i] = 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Recording
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameProfiler::beginRecord() {
+    if (!mEnabled) return;
+    if (mRecordDepth++ == 0) {
+        mRecordStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+void FrameProfiler::endRecord() {
+    if (!mEnabled || mRecordDepth == 0) return;
+    if (--mRecordDepth == 0) {
+        mPendingRecordTime += systemTime(SYSTEM_TIME_MONOTONIC) - mRecordStart;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Drawing
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameProfiler::beginFrame() {
+    if (!mEnabled || mInFrame) return;
+
+    if (!mQueriesInitialized) {
+        initQueries();
+    }
+    if (mHasTimerQuery) {
+        resolveQueries();
+    }
+
+    // 0 marks free queries, never use it as a serial number
+    if (++mSerial == 0) mSerial = 1;
+
+    mCurrent->reset(mSerial);
+    mCurrent->recordTime = mPendingRecordTime;
+    mPendingRecordTime = 0;
+
+    mInFrame = true;
+    mFrameStart = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+void FrameProfiler::endFrame() {
+    if (!mEnabled || !mInFrame) return;
+
+    nsecs_t frameTime = systemTime(SYSTEM_TIME_MONOTONIC) - mFrameStart;
+    mCurrent->issueTime = frameTime - mCurrent->replayTime;
+    mInFrame = false;
+
+    Mutex::Autolock _l(mLock);
+    mFrames[mCurrent->serial % PROFILE_FRAME_COUNT] = *mCurrent;
+    if (mFrameCount < PROFILE_FRAME_COUNT) mFrameCount++;
+}
+
+/**
+ * Only the first root display list of each frame is measured on the GPU,
+ * timer queries cannot be nested.
+ */
+void FrameProfiler::beginReplay() {
+    if (!mEnabled || !mInFrame) return;
+    if (mReplayDepth++ > 0) return;
+
+    mReplayStart = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    if (mHasTimerQuery && mActiveQuery < 0) {
+        for (int i = 0; i < PROFILE_QUERY_COUNT; i++) {
+            if (mQuerySerials[i] == mSerial) return;
+        }
+        for (int i = 0; i < PROFILE_QUERY_COUNT; i++) {
+            if (mQuerySerials[i] == 0) {
+                mActiveQuery = i;
+                mQuerySerials[i] = mSerial;
+                sBeginQuery(GL_TIME_ELAPSED_EXT, mQueries[i]);
+                break;
+            }
+        }
+    }
+}
+
+void FrameProfiler::endReplay() {
+    if (!mEnabled || !mInFrame || mReplayDepth == 0) return;
+    if (--mReplayDepth > 0) return;
+
+    mCurrent->replayTime += systemTime(SYSTEM_TIME_MONOTONIC) - mReplayStart;
+
+    if (mActiveQuery >= 0) {
+        sEndQuery(GL_TIME_ELAPSED_EXT);
+        mActiveQuery = -1;
+    }
+}
+
+void FrameProfiler::incrementOpCount(int op) {
+    if (op >= 0 && op < PROFILE_OP_COUNT) {
+        mCurrent->opCounts[op]++;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Output
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameProfiler::output(FILE* file, const char* opNames[]) {
+    if (!mEnabled) return;
+
+    Mutex::Autolock _l(mLock);
+    if (mFrameCount == 0) return;
+
+    // Oldest frame first
+    const uint32_t last = mSerial - (mInFrame ? 1 : 0);
+    const uint32_t first = last - mFrameCount + 1;
+
+    double totals[4] = { 0.0, 0.0, 0.0, 0.0 };
+    uint32_t gpuFrames = 0;
+    uint64_t opTotals[PROFILE_OP_COUNT];
+    memset(opTotals, 0, sizeof(opTotals));
+
+    fprintf(file, "\nFrame profile (ms), last %d frames\n", mFrameCount);
+    fprintf(file, "\tRecord\tReplay\tIssue\tGPU\n");
+    for (uint32_t serial = first; serial != last + 1; serial++) {
+        const Frame& frame = mFrames[serial % PROFILE_FRAME_COUNT];
+
+        const double record = frame.recordTime / 1000000.0;
+        const double replay = frame.replayTime / 1000000.0;
+        const double issue = frame.issueTime / 1000000.0;
+        totals[0] += record;
+        totals[1] += replay;
+        totals[2] += issue;
+
+        if (frame.gpuTime >= 0) {
+            const double gpu = frame.gpuTime / 1000000.0;
+            totals[3] += gpu;
+            gpuFrames++;
+            fprintf(file, "\t%.2f\t%.2f\t%.2f\t%.2f\n", record, replay, issue, gpu);
+        } else {
+            fprintf(file, "\t%.2f\t%.2f\t%.2f\t-\n", record, replay, issue);
+        }
+
+        for (int i = 0; i < PROFILE_OP_COUNT; i++) {
+            opTotals[i] += frame.opCounts[i];
+        }
+    }
+
+    fprintf(file, "Average\t%.2f\t%.2f\t%.2f\t", totals[0] / mFrameCount,
+            totals[1] / mFrameCount, totals[2] / mFrameCount);
+    if (gpuFrames > 0) {
+        fprintf(file, "%.2f\n", totals[3] / gpuFrames);
+    } else {
+        fprintf(file, "-\n");
+    }
+
+    fprintf(file, "\nDisplayList operations per frame (average)\n");
+    for (int i = 0; i < PROFILE_OP_COUNT; i++) {
+        if (opTotals[i] > 0) {
+            fprintf(file, "  %-20s %.1f\n", opNames[i], opTotals[i] / (double) mFrameCount);
+        }
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_FRAME_PROFILER_H
+#define ANDROID_HWUI_FRAME_PROFILER_H
+
+#include <stdio.h>
+
+#include <GLES2/gl2.h>
+
+#include <cutils/compiler.h>
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of frames kept in the ring buffer
+#define PROFILE_FRAME_COUNT 64
+// Number of GPU timer queries that can be in flight at any time
+#define PROFILE_QUERY_COUNT 4
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Records the cost of the most recent frames in a circular buffer. For each
+ * frame the profiler keeps:
+ *
+ * - The CPU time spent recording display lists since the previous frame
+ * - The CPU time spent replaying the root display lists
+ * - The CPU time spent issuing commands outside of display lists (clears,
+ *   batches flushed at the end of the frame, etc.)
+ * - The GPU time spent executing the root display list, when the driver
+ *   supports GL_EXT_disjoint_timer_query
+ * - The number of times each display list operation was replayed
+ *
+ * GPU timings are collected asynchronously; a frame's GPU time is resolved
+ * a few frames after it was drawn and is reported as unavailable until then.
+ *
+ * The profiler is disabled unless the debug.hwui.profile property is set to
+ * true. The buffer is dumped by dumpsys gfxinfo.
+ */
+class FrameProfiler {
+public:
+    FrameProfiler();
+    ~FrameProfiler();
+
+    /**
+     * Releases the GL objects used by the profiler. Must be called with
+     * the GL context current.
+     */
+    void terminate();
+
+    bool isEnabled() const {
+        return mEnabled;
+    }
+
+    /**
+     * Called when a display list starts and stops recording.
+     */
+    void beginRecord();
+    void endRecord();
+
+    /**
+     * Called when the renderer targeting the window starts and finishes
+     * drawing a frame.
+     */
+    void beginFrame();
+    void endFrame();
+
+    /**
+     * Called around DisplayList::replay(). Only the outermost replay is
+     * timed, nested display lists are part of their parent's cost.
+     */
+    void beginReplay();
+    void endReplay();
+
+    /**
+     * Called for every operation executed when replaying a display list.
+     */
+    inline void countOp(int op) {
+        if (CC_UNLIKELY(mEnabled && mInFrame)) {
+            incrementOpCount(op);
+        }
+    }
+
+    /**
+     * Outputs the content of the ring buffer to the specified file.
+     */
+    void output(FILE* file, const char* opNames[]);
+
+private:
+    struct Frame;
+
+    void initQueries();
+    void resolveQueries();
+    void incrementOpCount(int op);
+
+    bool mEnabled;
+
+    // Protects the ring buffer; frames are written by the render thread
+    // and read by dumpsys
+    Mutex mLock;
+
+    Frame* mFrames;
+    uint32_t mFrameCount;
+
+    // Frame currently being drawn
+    Frame* mCurrent;
+    bool mInFrame;
+    uint32_t mSerial;
+    nsecs_t mFrameStart;
+
+    nsecs_t mPendingRecordTime;
+    nsecs_t mRecordStart;
+    uint32_t mRecordDepth;
+
+    nsecs_t mReplayStart;
+    uint32_t mReplayDepth;
+
+    bool mHasTimerQuery;
+    bool mQueriesInitialized;
+    GLuint mQueries[PROFILE_QUERY_COUNT];
+    // Serial number of the frame each query measures, 0 when the query is free
+    uint32_t mQuerySerials[PROFILE_QUERY_COUNT];
+    int mActiveQuery;
+}; // class FrameProfiler
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_FRAME_PROFILER_H
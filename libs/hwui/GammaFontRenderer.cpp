@@ -62,78 +62,43 @@ GammaFontRenderer::GammaFontRenderer() {
                 DEFAULT_TEXT_WHITE_GAMMA_THRESHOLD);
     }
 
-    // Compute the gamma tables
-    const float blackGamma = gamma;
-    const float whiteGamma = 1.0f / gamma;
+    // The shader raises the coverage to these powers
+    mBlackGamma = gamma;
+    mWhiteGamma = 1.0f / gamma;
 
     for (uint32_t i = 0; i <= 255; i++) {
         mGammaTable[i] = i;
-
-        const float v = i / 255.0f;
-        const float black = pow(v, blackGamma);
-        const float white = pow(v, whiteGamma);
-
-        mGammaTable[256 + i] = uint8_t((float)::floor(black * 255.0f + 0.5f));
-        mGammaTable[512 + i] = uint8_t((float)::floor(white * 255.0f + 0.5f));
     }
 
-    memset(mRenderers, 0, sizeof(FontRenderer*) * kGammaCount);
-    memset(mRenderersUsageCount, 0, sizeof(uint32_t) * kGammaCount);
+    mRenderer = NULL;
 }
 
 GammaFontRenderer::~GammaFontRenderer() {
-    for (int i = 0; i < kGammaCount; i++) {
-        delete mRenderers[i];
-    }
+    delete mRenderer;
 }
 
 void GammaFontRenderer::clear() {
-    for (int i = 0; i < kGammaCount; i++) {
-        delete mRenderers[i];
-        mRenderers[i] = NULL;
-    }
+    delete mRenderer;
+    mRenderer = NULL;
 }
 
 void GammaFontRenderer::flush() {
-    int count = 0;
-    int min = -1;
-    uint32_t minCount = UINT_MAX;
-
-    for (int i = 0; i < kGammaCount; i++) {
-        if (mRenderers[i]) {
-            count++;
-            if (mRenderersUsageCount[i] < minCount) {
-                minCount = mRenderersUsageCount[i];
-                min = i;
-            }
-        }
-    }
-
-    if (count <= 1 || min < 0) return;
-
-    delete mRenderers[min];
-    mRenderers[min] = NULL;
-
-    // Also eliminate the caches for large glyphs, as they consume significant memory
-    for (int i = 0; i < kGammaCount; ++i) {
-        if (mRenderers[i]) {
-            mRenderers[i]->flushLargeCaches();
-        }
+    // Eliminate the caches for large glyphs, as they consume significant memory
+    if (mRenderer) {
+        mRenderer->flushLargeCaches();
     }
 }
 
-FontRenderer* GammaFontRenderer::getRenderer(Gamma gamma) {
-    FontRenderer* renderer = mRenderers[gamma];
-    if (!renderer) {
-        renderer = new FontRenderer();
-        mRenderers[gamma] = renderer;
-        renderer->setGammaTable(&mGammaTable[gamma * 256]);
+FontRenderer& GammaFontRenderer::getFontRenderer(const SkPaint* paint) {
+    if (!mRenderer) {
+        mRenderer = new FontRenderer();
+        mRenderer->setGammaTable(&mGammaTable[0]);
     }
-    mRenderersUsageCount[gamma]++;
-    return renderer;
+    return *mRenderer;
 }
 
-FontRenderer& GammaFontRenderer::getFontRenderer(const SkPaint* paint) {
+void GammaFontRenderer::describe(ProgramDescription& description,
+        const SkPaint* paint) const {
     if (paint->getShader() == NULL) {
         uint32_t c = paint->getColor();
         const int r = (c >> 16) & 0xFF;
@@ -142,12 +107,20 @@ FontRenderer& GammaFontRenderer::getFontRenderer(const SkPaint* paint) {
         const int luminance = (r * 2 + g * 5 + b) >> 3;
 
         if (luminance <= mBlackThreshold) {
-            return *getRenderer(kGammaBlack);
+            description.hasGammaCorrection = true;
+            description.gamma = mBlackGamma;
         } else if (luminance >= mWhiteThreshold) {
-            return *getRenderer(kGammaWhite);
+            description.hasGammaCorrection = true;
+            description.gamma = mWhiteGamma;
         }
     }
-    return *getRenderer(kGammaDefault);
+}
+
+void GammaFontRenderer::setupProgram(ProgramDescription& description,
+        Program* program) const {
+    if (description.hasGammaCorrection) {
+        glUniform1f(program->getUniform("gamma"), description.gamma);
+    }
 }
 
 }; // namespace uirenderer
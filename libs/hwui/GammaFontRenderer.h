@@ -20,49 +20,57 @@
 #include <SkPaint.h>
 
 #include "FontRenderer.h"
+#include "Program.h"
 
 namespace android {
 namespace uirenderer {
 
+/**
+ * Glyphs are cached once, as linear coverage, in a single font renderer.
+ * The gamma correction picked from the luminance of the text color is
+ * applied by the text fragment shader rather than baked into separate
+ * glyph caches.
+ */
 struct GammaFontRenderer {
     GammaFontRenderer();
     ~GammaFontRenderer();
 
-    enum Gamma {
-        kGammaDefault = 0,
-        kGammaBlack = 1,
-        kGammaWhite = 2,
-        kGammaCount = 3
-    };
-
     void clear();
     void flush();
 
     FontRenderer& getFontRenderer(const SkPaint* paint);
 
+    /**
+     * Adds the gamma correction required by the specified paint to the
+     * description of the program used to draw text.
+     */
+    void describe(ProgramDescription& description, const SkPaint* paint) const;
+    /**
+     * Sets the gamma uniform of a program built from a description
+     * previously passed to describe().
+     */
+    void setupProgram(ProgramDescription& description, Program* program) const;
+
     uint32_t getFontRendererCount() const {
-        return kGammaCount;
+        return 1;
     }
 
     uint32_t getFontRendererSize(uint32_t fontRenderer) const {
-        if (fontRenderer >= kGammaCount) return 0;
-
-        FontRenderer* renderer = mRenderers[fontRenderer];
-        if (!renderer) return 0;
-
-        return renderer->getCacheSize();
+        if (fontRenderer >= 1 || !mRenderer) return 0;
+        return mRenderer->getCacheSize();
     }
 
 private:
-    FontRenderer* getRenderer(Gamma gamma);
-
-    uint32_t mRenderersUsageCount[kGammaCount];
-    FontRenderer* mRenderers[kGammaCount];
+    FontRenderer* mRenderer;
 
     int mBlackThreshold;
     int mWhiteThreshold;
 
-    uint8_t mGammaTable[256 * kGammaCount];
+    float mBlackGamma;
+    float mWhiteGamma;
+
+    // Glyphs are stored as is, the font renderer gets an identity table
+    uint8_t mGammaTable[256];
 };
 
 }; // namespace uirenderer
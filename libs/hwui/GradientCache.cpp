@@ -104,7 +104,10 @@ Texture* GradientCache::get(uint32_t* colors, float* positions,
     Texture* texture = mCache.get(gradient);
 
     if (!texture) {
+        stats.miss();
         texture = addLinearGradient(gradient, colors, positions, count, tileMode);
+    } else {
+        stats.hit();
     }
 
     return texture;
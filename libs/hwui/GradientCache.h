@@ -22,6 +22,7 @@
 #include <utils/Mutex.h>
 #include <utils/Vector.h>
 
+#include "RenderStats.h"
 #include "Texture.h"
 #include "utils/Compare.h"
 #include "utils/GenerationCache.h"
@@ -136,6 +137,11 @@ public:
      */
     uint32_t getSize();
 
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 private:
     /**
      * Adds a new linear gradient to the cache. The generated texture is
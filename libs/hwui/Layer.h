@@ -58,6 +58,7 @@ struct Layer {
         deferredUpdateScheduled = false;
         renderer = NULL;
         displayList = NULL;
+        textureTimestamp = -1;
     }
 
     ~Layer() {
@@ -88,8 +89,7 @@ struct Layer {
             int left, int top, int right, int bottom) {
         this->renderer = renderer;
         this->displayList = displayList;
-        const Rect r(left, top, right, bottom);
-        dirtyRect.unionWith(r);
+        dirtyRegion.orSelf(android::Rect(left, top, right, bottom));
         deferredUpdateScheduled = true;
     }
 
@@ -219,6 +219,14 @@ struct Layer {
         return texTransform;
     }
 
+    inline int64_t getTextureTimestamp() {
+        return textureTimestamp;
+    }
+
+    inline void setTextureTimestamp(int64_t timestamp) {
+        textureTimestamp = timestamp;
+    }
+
     inline mat4& getTransform() {
         return transform;
     }
@@ -251,12 +259,14 @@ struct Layer {
     GLsizei meshElementCount;
 
     /**
-     * Used for deferred updates.
+     * Used for deferred updates. The dirty region accumulates the areas
+     * invalidated since the last update, an empty region means the whole
+     * layer must be redrawn.
      */
     bool deferredUpdateScheduled;
     OpenGLRenderer* renderer;
     DisplayList* displayList;
-    Rect dirtyRect;
+    Region dirtyRegion;
 
 private:
     /**
@@ -315,6 +325,12 @@ private:
      */
     mat4 transform;
 
+    /**
+     * For texture layers, timestamp of the SurfaceTexture frame last
+     * latched, or -1 if none was.
+     */
+    int64_t textureTimestamp;
+
 }; // struct Layer
 
 }; // namespace uirenderer
@@ -81,6 +81,14 @@ void LayerCache::deleteLayer(Layer* layer) {
     }
 }
 
+void LayerCache::removeAt(size_t index) {
+    Layer* victim = mCache.itemAt(index).mLayer;
+    LAYER_LOGD("  Deleting layer %dx%d", victim->getWidth(), victim->getHeight());
+
+    deleteLayer(victim);
+    mCache.removeAt(index);
+}
+
 void LayerCache::clear() {
     size_t count = mCache.size();
     for (size_t i = 0; i < count; i++) {
@@ -89,13 +97,51 @@ void LayerCache::clear() {
     mCache.clear();
 }
 
+void LayerCache::trim() {
+    if (mCache.size() == 0) return;
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (ssize_t i = mCache.size() - 1; i >= 0; i--) {
+        if (now - mCache.itemAt(i).mLastUsed >= LAYER_CACHE_IDLE_TIMEOUT) {
+            removeAt(i);
+        }
+    }
+}
+
+ssize_t LayerCache::findLayer(const uint32_t width, const uint32_t height) {
+    ssize_t index = mCache.indexOf(LayerEntry(width, height));
+    if (index >= 0) return index;
+
+    const uint32_t widthClass = sizeClass(width);
+    const uint32_t heightClass = sizeClass(height);
+
+    // The cache is sorted by width, stop after the last width of the size class
+    uint32_t bestArea = 0;
+    const size_t count = mCache.size();
+    for (size_t i = 0; i < count; i++) {
+        const LayerEntry& entry = mCache.itemAt(i);
+        if (entry.mWidth < width || entry.mHeight < height) continue;
+        if (entry.mWidth > widthClass) break;
+        if (entry.mHeight > heightClass) continue;
+
+        const uint32_t area = entry.mWidth * entry.mHeight;
+        if (index < 0 || area < bestArea) {
+            index = i;
+            bestArea = area;
+        }
+    }
+
+    return index;
+}
+
 Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
     Layer* layer = NULL;
 
     LayerEntry entry(width, height);
-    ssize_t index = mCache.indexOf(entry);
+    ssize_t index = findLayer(entry.mWidth, entry.mHeight);
 
     if (index >= 0) {
+        stats.hit();
         entry = mCache.itemAt(index);
         mCache.removeAt(index);
 
@@ -104,6 +150,7 @@ Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
 
         LAYER_LOGD("Reusing layer %dx%d", layer->getWidth(), layer->getHeight());
     } else {
+        stats.miss();
         LAYER_LOGD("Creating new layer %dx%d", entry.mWidth, entry.mHeight);
 
         layer = new Layer(entry.mWidth, entry.mHeight);
@@ -169,20 +216,24 @@ bool LayerCache::put(Layer* layer) {
             size_t position = 0;
 #if LAYER_REMOVE_BIGGEST_FIRST
             position = mCache.size() - 1;
+#else
+            // Remove the layer that has been in the cache the longest
+            const size_t count = mCache.size();
+            for (size_t i = 1; i < count; i++) {
+                if (mCache.itemAt(i).mLastUsed < mCache.itemAt(position).mLastUsed) {
+                    position = i;
+                }
+            }
 #endif
-            Layer* victim = mCache.itemAt(position).mLayer;
-            deleteLayer(victim);
-            mCache.removeAt(position);
-
-            LAYER_LOGD("  Deleting layer %.2fx%.2f", victim->layer.getWidth(),
-                    victim->layer.getHeight());
+            removeAt(position);
         }
 
         layer->deferredUpdateScheduled = false;
         layer->renderer = NULL;
         layer->displayList = NULL;
+        layer->dirtyRegion.clear();
 
-        LayerEntry entry(layer);
+        LayerEntry entry(layer, systemTime(SYSTEM_TIME_MONOTONIC));
 
         mCache.add(entry);
         mSize += size;
@@ -17,9 +17,12 @@
 #ifndef ANDROID_HWUI_LAYER_CACHE_H
 #define ANDROID_HWUI_LAYER_CACHE_H
 
+#include <utils/Timers.h>
+
 #include "Debug.h"
 #include "Layer.h"
 #include "Properties.h"
+#include "RenderStats.h"
 #include "utils/SortedList.h"
 
 namespace android {
@@ -72,6 +75,11 @@ public:
      * Clears the cache. This causes all layers to be deleted.
      */
     void clear();
+    /**
+     * Deletes the layers that have not been used for LAYER_CACHE_IDLE_TIMEOUT.
+     * This should be called once per frame.
+     */
+    void trim();
     /**
      * Resize the specified layer if needed.
      *
@@ -102,21 +110,45 @@ public:
      */
     void dump();
 
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 private:
     void deleteLayer(Layer* layer);
+    void removeAt(size_t index);
+
+    /**
+     * Returns the index of the cached layer best suited for the specified
+     * entry, or -1 if no layer can hold it. A layer can be reused for any
+     * entry in the same size class that it is at least as large as.
+     */
+    ssize_t findLayer(const uint32_t width, const uint32_t height);
+
+    /**
+     * Returns the power-of-two size class of the specified dimension.
+     */
+    static uint32_t sizeClass(uint32_t size) {
+        uint32_t sizeClass = LAYER_SIZE;
+        while (sizeClass < size) sizeClass <<= 1;
+        return sizeClass;
+    }
 
     struct LayerEntry {
         LayerEntry():
-            mLayer(NULL), mWidth(0), mHeight(0) {
+            mLayer(NULL), mWidth(0), mHeight(0), mLastUsed(0) {
         }
 
-        LayerEntry(const uint32_t layerWidth, const uint32_t layerHeight): mLayer(NULL) {
+        LayerEntry(const uint32_t layerWidth, const uint32_t layerHeight):
+                mLayer(NULL), mLastUsed(0) {
             mWidth = uint32_t(ceilf(layerWidth / float(LAYER_SIZE)) * LAYER_SIZE);
             mHeight = uint32_t(ceilf(layerHeight / float(LAYER_SIZE)) * LAYER_SIZE);
         }
 
-        LayerEntry(Layer* layer):
-            mLayer(layer), mWidth(layer->getWidth()), mHeight(layer->getHeight()) {
+        LayerEntry(Layer* layer, nsecs_t lastUsed):
+            mLayer(layer), mWidth(layer->getWidth()), mHeight(layer->getHeight()),
+            mLastUsed(lastUsed) {
         }
 
         bool operator<(const LayerEntry& rhs) const {
@@ -133,6 +165,8 @@ private:
         Layer* mLayer;
         uint32_t mWidth;
         uint32_t mHeight;
+        // Time at which the layer was returned to the cache
+        nsecs_t mLastUsed;
     }; // struct LayerEntry
 
     SortedList<LayerEntry> mCache;
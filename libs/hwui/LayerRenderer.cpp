@@ -16,6 +16,8 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <string.h>
+
 #include <ui/Rect.h>
 
 #include "LayerCache.h"
@@ -50,6 +52,8 @@ int LayerRenderer::prepareDirty(float left, float top, float right, float bottom
 #ifdef QCOM_HARDWARE
     TILERENDERING_END(previousFbo, mLayer->getFbo());
 #endif
+    // The renderer of the previous framebuffer may still be tiling it
+    Caches::getInstance().endTiling();
     glBindFramebuffer(GL_FRAMEBUFFER, mLayer->getFbo());
 
     const float width = mLayer->layer.getWidth();
@@ -305,9 +309,18 @@ Layer* LayerRenderer::createTextureLayer(bool isOpaque) {
     return layer;
 }
 
-void LayerRenderer::updateTextureLayer(Layer* layer, uint32_t width, uint32_t height,
-        bool isOpaque, GLenum renderTarget, float* transform) {
+bool LayerRenderer::updateTextureLayer(Layer* layer, uint32_t width, uint32_t height,
+        bool isOpaque, GLenum renderTarget, float* transform, int64_t timestamp) {
     if (layer) {
+        if (timestamp >= 0 && timestamp == layer->getTextureTimestamp() &&
+                layer->getWidth() == width && layer->getHeight() == height &&
+                layer->isBlend() == !isOpaque &&
+                renderTarget == layer->getRenderTarget() &&
+                !memcmp(layer->getTexTransform().data, transform, sizeof(float) * 16)) {
+            return false;
+        }
+        layer->setTextureTimestamp(timestamp);
+
         layer->setBlend(!isOpaque);
         layer->setSize(width, height);
         layer->layer.set(0.0f, 0.0f, width, height);
@@ -322,6 +335,7 @@ void LayerRenderer::updateTextureLayer(Layer* layer, uint32_t width, uint32_t he
             layer->setWrap(GL_CLAMP_TO_EDGE, false, true);
         }
     }
+    return true;
 }
 
 void LayerRenderer::destroyLayer(Layer* layer) {
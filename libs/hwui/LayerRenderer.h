@@ -57,8 +57,14 @@ public:
     ANDROID_API static Layer* createTextureLayer(bool isOpaque);
     ANDROID_API static Layer* createLayer(uint32_t width, uint32_t height, bool isOpaque = false);
     ANDROID_API static bool resizeLayer(Layer* layer, uint32_t width, uint32_t height);
-    ANDROID_API static void updateTextureLayer(Layer* layer, uint32_t width, uint32_t height,
-            bool isOpaque, GLenum renderTarget, float* transform);
+    /**
+     * Updates a texture layer after its SurfaceTexture latched a frame.
+     * Returns false if nothing visible changed: same frame timestamp,
+     * size, opacity and texture transform. A timestamp of -1 always
+     * counts as a change.
+     */
+    ANDROID_API static bool updateTextureLayer(Layer* layer, uint32_t width, uint32_t height,
+            bool isOpaque, GLenum renderTarget, float* transform, int64_t timestamp = -1);
     ANDROID_API static void destroyLayer(Layer* layer);
     ANDROID_API static void destroyLayerDeferred(Layer* layer);
     ANDROID_API static void flushLayer(Layer* layer);
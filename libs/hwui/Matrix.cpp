@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__ARM_HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <utils/Log.h>
 
 #include <SkMatrix.h>
@@ -51,8 +55,27 @@ void Matrix4::loadIdentity() {
     data[kTranslateZ]   = 0.0f;
     data[kPerspective2] = 1.0f;
 
-    mIsIdentity = true;
-    mSimpleMatrix = true;
+    mType = kTypeIdentity;
+}
+
+void Matrix4::computeType() {
+    mType = kTypeIdentity;
+
+    if (data[kPerspective0] != 0.0f || data[kPerspective1] != 0.0f ||
+            data[kPerspective2] != 1.0f) {
+        mType |= kTypePerspective;
+    }
+    if (data[kSkewX] != 0.0f || data[kSkewY] != 0.0f ||
+            data[2] != 0.0f || data[6] != 0.0f || data[8] != 0.0f || data[9] != 0.0f) {
+        mType |= kTypeAffine;
+    }
+    if (data[kScaleX] != 1.0f || data[kScaleY] != 1.0f || data[kScaleZ] != 1.0f) {
+        mType |= kTypeScale;
+    }
+    if (data[kTranslateX] != 0.0f || data[kTranslateY] != 0.0f ||
+            data[kTranslateZ] != 0.0f) {
+        mType |= kTypeTranslate;
+    }
 }
 
 bool Matrix4::changesBounds() {
@@ -62,28 +85,25 @@ bool Matrix4::changesBounds() {
 }
 
 bool Matrix4::isPureTranslate() {
-    return mSimpleMatrix && data[kScaleX] == 1.0f && data[kScaleY] == 1.0f;
+    return isSimple() && data[kScaleX] == 1.0f && data[kScaleY] == 1.0f;
 }
 
 bool Matrix4::isSimple() {
-    return mSimpleMatrix;
+    return !(mType & (kTypeAffine | kTypePerspective));
 }
 
 bool Matrix4::isIdentity() {
-    return mIsIdentity;
+    return mType == kTypeIdentity;
 }
 
 void Matrix4::load(const float* v) {
     memcpy(data, v, sizeof(data));
-    // TODO: Do something smarter here
-    mSimpleMatrix = false;
-    mIsIdentity = false;
+    computeType();
 }
 
 void Matrix4::load(const Matrix4& v) {
     memcpy(data, v.data, sizeof(data));
-    mSimpleMatrix = v.mSimpleMatrix;
-    mIsIdentity = v.mIsIdentity;
+    mType = v.mType;
 }
 
 void Matrix4::load(const SkMatrix& v) {
@@ -103,8 +123,12 @@ void Matrix4::load(const SkMatrix& v) {
 
     data[kScaleZ] = 1.0f;
 
-    mSimpleMatrix = (v.getType() <= (SkMatrix::kScale_Mask | SkMatrix::kTranslate_Mask));
-    mIsIdentity = v.isIdentity();
+    const SkMatrix::TypeMask type = v.getType();
+    mType = kTypeIdentity;
+    if (type & SkMatrix::kTranslate_Mask) mType |= kTypeTranslate;
+    if (type & SkMatrix::kScale_Mask) mType |= kTypeScale;
+    if (type & SkMatrix::kAffine_Mask) mType |= kTypeAffine;
+    if (type & SkMatrix::kPerspective_Mask) mType |= kTypePerspective;
 }
 
 void Matrix4::copyTo(SkMatrix& v) const {
@@ -124,6 +148,28 @@ void Matrix4::copyTo(SkMatrix& v) const {
 }
 
 void Matrix4::loadInverse(const Matrix4& v) {
+    // Only the 2D part of the matrix is inverted; most matrices are made of
+    // translations and scales and do not need the full 3x3 inverse
+    if (!(v.mType & (kTypeAffine | kTypePerspective))) {
+        const float sx = 1.0f / v.data[kScaleX];
+        const float sy = 1.0f / v.data[kScaleY];
+
+        data[kScaleX] = sx;
+        data[kSkewX] = 0.0f;
+        data[kTranslateX] = -v.data[kTranslateX] * sx;
+
+        data[kSkewY] = 0.0f;
+        data[kScaleY] = sy;
+        data[kTranslateY] = -v.data[kTranslateY] * sy;
+
+        data[kPerspective0] = 0.0f;
+        data[kPerspective1] = 0.0f;
+        data[kPerspective2] = 1.0f;
+
+        mType = v.mType;
+        return;
+    }
+
     double scale = 1.0 /
             (v.data[kScaleX] * ((double) v.data[kScaleY]  * v.data[kPerspective2] -
                     (double) v.data[kTranslateY] * v.data[kPerspective1]) +
@@ -153,8 +199,7 @@ void Matrix4::loadInverse(const Matrix4& v) {
     data[kPerspective2] = (v.data[kScaleX] * v.data[kScaleY] -
             v.data[kSkewX] * v.data[kSkewY]) * scale;
 
-    mSimpleMatrix = v.mSimpleMatrix;
-    mIsIdentity = v.mIsIdentity;
+    mType = v.mType;
 }
 
 void Matrix4::copyTo(float* v) const {
@@ -173,7 +218,7 @@ void Matrix4::multiply(float v) {
     for (int i = 0; i < 16; i++) {
         data[i] *= v;
     }
-    mIsIdentity = false;
+    computeType();
 }
 
 void Matrix4::loadTranslate(float x, float y, float z) {
@@ -183,7 +228,9 @@ void Matrix4::loadTranslate(float x, float y, float z) {
     data[kTranslateY] = y;
     data[kTranslateZ] = z;
 
-    mIsIdentity = false;
+    if (x != 0.0f || y != 0.0f || z != 0.0f) {
+        mType = kTypeTranslate;
+    }
 }
 
 void Matrix4::loadScale(float sx, float sy, float sz) {
@@ -193,7 +240,9 @@ void Matrix4::loadScale(float sx, float sy, float sz) {
     data[kScaleY] = sy;
     data[kScaleZ] = sz;
 
-    mIsIdentity = false;
+    if (sx != 1.0f || sy != 1.0f || sz != 1.0f) {
+        mType = kTypeScale;
+    }
 }
 
 void Matrix4::loadSkew(float sx, float sy) {
@@ -211,8 +260,7 @@ void Matrix4::loadSkew(float sx, float sy) {
     data[kPerspective1] = 0.0f;
     data[kPerspective2] = 1.0f;
 
-    mSimpleMatrix = false;
-    mIsIdentity = false;
+    mType = kTypeAffine;
 }
 
 void Matrix4::loadRotate(float angle, float x, float y, float z) {
@@ -252,11 +300,27 @@ void Matrix4::loadRotate(float angle, float x, float y, float z) {
     data[6]       =    yz * nc + xs;
     data[kScaleZ] = z * z * nc +  c;
 
-    mSimpleMatrix = false;
-    mIsIdentity = false;
+    mType = kTypeAffine;
 }
 
 void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
+    // Each row of the result is a combination of the rows of u weighted by
+    // the entries of the same row of v
+#if defined(__ARM_HAVE_NEON)
+    const float32x4_t u0 = vld1q_f32(&u.data[0]);
+    const float32x4_t u1 = vld1q_f32(&u.data[4]);
+    const float32x4_t u2 = vld1q_f32(&u.data[8]);
+    const float32x4_t u3 = vld1q_f32(&u.data[12]);
+
+    for (int i = 0 ; i < 4 ; i++) {
+        const float* e = &v.data[i * 4];
+        float32x4_t r = vmulq_n_f32(u0, e[0]);
+        r = vmlaq_n_f32(r, u1, e[1]);
+        r = vmlaq_n_f32(r, u2, e[2]);
+        r = vmlaq_n_f32(r, u3, e[3]);
+        vst1q_f32(&data[i * 4], r);
+    }
+#else
     for (int i = 0 ; i < 4 ; i++) {
         float x = 0;
         float y = 0;
@@ -276,9 +340,11 @@ void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
         set(i, 2, z);
         set(i, 3, w);
     }
+#endif
 
-    mSimpleMatrix = u.mSimpleMatrix && v.mSimpleMatrix;
-    mIsIdentity = false;
+    // Conservative: the product of two transforms never needs more
+    // components than the two combined
+    mType = u.mType | v.mType;
 }
 
 void Matrix4::loadOrtho(float left, float right, float bottom, float top, float near, float far) {
@@ -291,13 +357,19 @@ void Matrix4::loadOrtho(float left, float right, float bottom, float top, float
     data[kTranslateY] = -(top + bottom) / (top - bottom);
     data[kTranslateZ] = -(far + near) / (far - near);
 
-    mIsIdentity = false;
+    mType = kTypeTranslate | kTypeScale;
 }
 
 #define MUL_ADD_STORE(a, b, c) a = (a) * (b) + (c)
 
 void Matrix4::mapPoint(float& x, float& y) const {
-    if (mSimpleMatrix) {
+    if (mType <= kTypeTranslate) {
+        x += data[kTranslateX];
+        y += data[kTranslateY];
+        return;
+    }
+
+    if (!(mType & (kTypeAffine | kTypePerspective))) {
         MUL_ADD_STORE(x, data[kScaleX], data[kTranslateX]);
         MUL_ADD_STORE(y, data[kScaleY], data[kTranslateY]);
         return;
@@ -305,6 +377,12 @@ void Matrix4::mapPoint(float& x, float& y) const {
 
     float dx = x * data[kScaleX] + y * data[kSkewX] + data[kTranslateX];
     float dy = x * data[kSkewY] + y * data[kScaleY] + data[kTranslateY];
+    if (!(mType & kTypePerspective)) {
+        x = dx;
+        y = dy;
+        return;
+    }
+
     float dz = x * data[kPerspective0] + y * data[kPerspective1] + data[kPerspective2];
     if (dz) dz = 1.0f / dz;
 
@@ -313,7 +391,23 @@ void Matrix4::mapPoint(float& x, float& y) const {
 }
 
 void Matrix4::mapRect(Rect& r) const {
-    if (mSimpleMatrix) {
+    if (mType == kTypeIdentity) {
+        return;
+    }
+
+    // The scale is often 1 even when the matrix is flagged as scaling
+    if (!(mType & (kTypeAffine | kTypePerspective)) &&
+            data[kScaleX] == 1.0f && data[kScaleY] == 1.0f) {
+        const float dx = data[kTranslateX];
+        const float dy = data[kTranslateY];
+        r.left += dx;
+        r.right += dx;
+        r.top += dy;
+        r.bottom += dy;
+        return;
+    }
+
+    if (!(mType & (kTypeAffine | kTypePerspective))) {
         MUL_ADD_STORE(r.left, data[kScaleX], data[kTranslateX]);
         MUL_ADD_STORE(r.right, data[kScaleX], data[kTranslateX]);
         MUL_ADD_STORE(r.top, data[kScaleY], data[kTranslateY]);
@@ -371,7 +465,7 @@ void Matrix4::mapRect(Rect& r) const {
 }
 
 void Matrix4::dump() const {
-    ALOGD("Matrix4[simple=%d", mSimpleMatrix);
+    ALOGD("Matrix4[simple=%d, type=0x%x", !(mType & (kTypeAffine | kTypePerspective)), mType);
     ALOGD("  %f %f %f %f", data[kScaleX], data[kSkewX], data[8], data[kTranslateX]);
     ALOGD("  %f %f %f %f", data[kSkewY], data[kScaleY], data[9], data[kTranslateY]);
     ALOGD("  %f %f %f %f", data[2], data[6], data[kScaleZ], data[kTranslateZ]);
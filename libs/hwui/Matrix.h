@@ -48,6 +48,23 @@ public:
         kPerspective2 = 15
     };
 
+    /**
+     * Classification of the transform applied by the matrix, as a
+     * combination of the following bits. A translation or scale along z
+     * counts as one along x and y, so only the identity is kTypeIdentity.
+     * The type is tracked as the matrix is loaded and multiplied and may be
+     * conservative: a matrix flagged with kTypeScale can happen to have a
+     * scale of 1.
+     */
+    enum Type {
+        kTypeIdentity = 0,
+        kTypeTranslate = 0x1,
+        kTypeScale = 0x2,
+        // Skew, rotation or any transform mixing the z axis with x and y
+        kTypeAffine = 0x4,
+        kTypePerspective = 0x8
+    };
+
     Matrix4() {
         loadIdentity();
     }
@@ -112,6 +129,10 @@ public:
         multiply(u);
     }
 
+    uint32_t getType() const {
+        return mType;
+    }
+
     bool isPureTranslate();
     bool isSimple();
     bool isIdentity();
@@ -130,8 +151,9 @@ public:
     void dump() const;
 
 private:
-    bool mSimpleMatrix;
-    bool mIsIdentity;
+    void computeType();
+
+    uint32_t mType;
 
     inline float get(int i, int j) const {
         return data[i * 4 + j];
@@ -33,6 +33,7 @@
 
 #include "OpenGLRenderer.h"
 #include "DisplayListRenderer.h"
+#include "PathTessellator.h"
 #include "Vector.h"
 #ifdef QCOM_HARDWARE
 #include "tilerenderer.h"
@@ -52,6 +53,12 @@ namespace uirenderer {
 
 #define FILTER(paint) (paint && paint->isFilterBitmap() ? GL_LINEAR : GL_NEAREST)
 
+// Deferred layer updates render each dirty rectangle separately, instead
+// of their bounds, when there are at most this many rectangles...
+#define LAYER_MAX_DIRTY_RECTS 4
+// ...and they cover at most this fraction of their bounds
+#define LAYER_DIRTY_AREA_RATIO 0.5f
+
 ///////////////////////////////////////////////////////////////////////////////
 // Globals
 ///////////////////////////////////////////////////////////////////////////////
@@ -111,6 +118,7 @@ static const Blender gBlendsSwap[] = {
 ///////////////////////////////////////////////////////////////////////////////
 
 OpenGLRenderer::OpenGLRenderer(): mCaches(Caches::getInstance()) {
+    mFrameTime = 0;
     mShader = NULL;
     mColorFilter = NULL;
     mHasShadow = false;
@@ -118,6 +126,11 @@ OpenGLRenderer::OpenGLRenderer(): mCaches(Caches::getInstance()) {
 
     memcpy(mMeshVertices, gMeshVertices, sizeof(gMeshVertices));
 
+    mBitmapBatch.bitmap = NULL;
+    mBitmapBatch.count = 0;
+
+    mLineBatch.count = 0;
+
     mFirstSnapshot = new Snapshot;
 }
 
@@ -178,18 +191,30 @@ int OpenGLRenderer::prepare(bool opaque) {
 }
 
 int OpenGLRenderer::prepareDirty(float left, float top, float right, float bottom, bool opaque) {
+    mFrameTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
     mCaches.clearGarbage();
+    mCaches.enforceMemoryBudget();
 
     mSnapshot = new Snapshot(mFirstSnapshot,
             SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
     mSnapshot->fbo = getTargetFbo();
     mSaveCount = 1;
 
+    // hasLayer() looks at the snapshot of this frame, not at the one left by the last
+    if (!hasLayer()) {
+        mCaches.profiler.beginFrame();
+    }
+
     mSnapshot->setClip(left, top, right, bottom);
     mDirtyClip = opaque;
 
     syncState();
 
+    // The dirty region is cleared below unless the surface is opaque
+    mTilingClip.set(left, top, right, bottom);
+    startTiling(mSnapshot, !opaque);
+
 #ifndef QCOM_HARDWARE
     if (!opaque) {
 #endif
@@ -205,6 +230,16 @@ int OpenGLRenderer::prepareDirty(float left, float top, float right, float botto
 #endif
 }
 
+void OpenGLRenderer::startTiling(const sp<Snapshot>& snapshot, bool discard) {
+    const Rect& clip = snapshot->fbo == getTargetFbo() ? mTilingClip : snapshot->viewport;
+    mCaches.startTiling(clip.left, snapshot->height - clip.bottom,
+            clip.getWidth(), clip.getHeight(), discard);
+}
+
+void OpenGLRenderer::endTiling() {
+    mCaches.endTiling();
+}
+
 void OpenGLRenderer::syncState() {
     glViewport(0, 0, mWidth, mHeight);
 
@@ -216,6 +251,12 @@ void OpenGLRenderer::syncState() {
 }
 
 void OpenGLRenderer::finish() {
+    flushBitmapBatch();
+    flushLineBatch();
+    mDirtyRegionBuilder.flush();
+    endTiling();
+    mCaches.stencil.disable();
+
 #if DEBUG_OPENGL
     GLenum status = GL_NO_ERROR;
     while ((status = glGetError()) != GL_NO_ERROR) {
@@ -243,9 +284,19 @@ void OpenGLRenderer::finish() {
         mCaches.dumpMemoryUsage();
     }
 #endif
+
+    if (!hasLayer()) {
+        mCaches.layerCache.trim();
+        mCaches.profiler.endFrame();
+    }
 }
 
 void OpenGLRenderer::interrupt() {
+    flushBitmapBatch();
+    flushLineBatch();
+    endTiling();
+    mCaches.stencil.disable();
+
     if (mCaches.currentProgram) {
         if (mCaches.currentProgram->isInUse()) {
             mCaches.currentProgram->remove();
@@ -285,6 +336,7 @@ void OpenGLRenderer::resume() {
                         snapshot->viewport.getWidth(),
                         snapshot->viewport.getHeight(), true);
 #endif
+    startTiling(snapshot);
 
     mCaches.blend = true;
     glEnable(GL_BLEND);
@@ -421,6 +473,13 @@ bool OpenGLRenderer::restoreSnapshot() {
     sp<Snapshot> current = mSnapshot;
     sp<Snapshot> previous = mSnapshot->previous;
 
+    if (restoreOrtho || restoreLayer) {
+        flushBitmapBatch();
+        flushLineBatch();
+    } else if (restoreClip) {
+        flushBitmapBatch();
+    }
+
     if (restoreOrtho) {
         Rect& r = previous->viewport;
         glViewport(r.left, r.top, r.right, r.bottom);
@@ -543,6 +602,9 @@ bool OpenGLRenderer::createLayer(sp<Snapshot> snapshot, float left, float top,
     LAYER_LOGD("Requesting layer %.2fx%.2f", right - left, bottom - top);
     LAYER_LOGD("Layer cache size = %d", mCaches.layerCache.getSize());
 
+    flushBitmapBatch();
+    flushLineBatch();
+
     const bool fboLayer = flags & SkCanvas::kClipToLayer_SaveFlag;
 
     // Window coordinates of the layer
@@ -655,6 +717,7 @@ bool OpenGLRenderer::createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> sna
 #ifdef QCOM_HARDWARE
     TILERENDERING_END(previousFbo, layer->getFbo());
 #endif
+    endTiling();
     glBindFramebuffer(GL_FRAMEBUFFER, layer->getFbo());
     layer->bindTexture();
 
@@ -675,6 +738,7 @@ bool OpenGLRenderer::createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> sna
 #ifdef QCOM_HARDWARE
         TILERENDERING_START(previousFbo, layer->getFbo(), true);
 #endif
+        startTiling(snapshot->previous);
         layer->deleteTexture();
         mCaches.fboCache.put(layer->getFbo());
         delete layer;
@@ -688,6 +752,9 @@ bool OpenGLRenderer::createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> sna
                       bounds.getWidth() + clip.left, clip.bottom,
                       bounds.getWidth(), bounds.getHeight());
 #endif
+    // The clip is cleared below, the rest of the layer is never sampled
+    mCaches.startTiling(clip.left, bounds.getHeight() - clip.bottom,
+            clip.getWidth(), clip.getHeight(), true);
 
     // Clear the FBO, expand the clear region by 1 to get nice bilinear filtering
     mCaches.setScissor(clip.left - 1.0f, bounds.getHeight() - clip.bottom - 1.0f,
@@ -718,6 +785,7 @@ void OpenGLRenderer::composeLayer(sp<Snapshot> current, sp<Snapshot> previous) {
 #ifdef QCOM_HARDWARE
         TILERENDERING_END(current->fbo, previous->fbo);
 #endif
+        endTiling();
         // Detach the texture from the FBO
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
 
@@ -726,6 +794,7 @@ void OpenGLRenderer::composeLayer(sp<Snapshot> current, sp<Snapshot> previous) {
 #ifdef QCOM_HARDWARE
         TILERENDERING_START(previous->fbo, current->fbo, true);
 #endif
+        startTiling(previous);
     }
 
     Layer* layer = current->layer;
@@ -825,6 +894,7 @@ void OpenGLRenderer::drawTextureLayer(Layer* layer, const Rect& rect) {
     setupDrawMesh(&mMeshVertices[0].position[0], &mMeshVertices[0].texture[0]);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.stats.drawCalls++;
 
     finishDrawTexture();
 
@@ -873,6 +943,8 @@ void OpenGLRenderer::composeLayerRect(Layer* layer, const Rect& rect, bool swap)
 
 void OpenGLRenderer::composeLayerRegion(Layer* layer, const Rect& rect) {
 #if RENDER_LAYERS_AS_REGIONS
+    mDirtyRegionBuilder.flush();
+
     if (layer->region.isRect()) {
         layer->setRegionAsRect();
 
@@ -936,6 +1008,7 @@ void OpenGLRenderer::composeLayerRegion(Layer* layer, const Rect& rect) {
 
             if (numQuads >= REGION_MESH_QUAD_COUNT) {
                 glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, NULL);
+                mCaches.stats.drawCalls++;
                 numQuads = 0;
                 mesh = mCaches.getRegionMesh();
             }
@@ -943,6 +1016,7 @@ void OpenGLRenderer::composeLayerRegion(Layer* layer, const Rect& rect) {
 
         if (numQuads > 0) {
             glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, NULL);
+            mCaches.stats.drawCalls++;
         }
 
         finishDrawTexture();
@@ -1011,7 +1085,9 @@ void OpenGLRenderer::dirtyLayerUnchecked(Rect& bounds, Region* region) {
         bounds.snapToPixelBoundaries();
         android::Rect dirty(bounds.left, bounds.top, bounds.right, bounds.bottom);
         if (!dirty.isEmpty()) {
-            region->orSelf(dirty);
+            // Merged into the region when the layer is composed or the
+            // frame ends, see DirtyRegionBuilder
+            mDirtyRegionBuilder.add(region, dirty);
         }
     }
 #endif
@@ -1055,7 +1131,14 @@ void OpenGLRenderer::clearLayerRegions() {
         setupDrawModelViewTranslate(0.0f, 0.0f, 0.0f, 0.0f, true);
         setupDrawVertices(&mesh[0].position[0]);
 
+        // The stencil clip must not apply either, it is set again on the next draw
+        if (CC_UNLIKELY(mCaches.stencil.isTestEnabled())) {
+            mCaches.stencil.disable();
+            dirtyClip();
+        }
+
         glDrawArrays(GL_TRIANGLES, 0, count * 6);
+        mCaches.stats.drawCalls++;
 
         glEnable(GL_SCISSOR_TEST);
     } else {
@@ -1120,6 +1203,49 @@ void OpenGLRenderer::setScissorFromClip() {
     mDirtyClip = false;
 }
 
+void OpenGLRenderer::setStencilFromClip() {
+    // Only the window has a stencil buffer, layers are clipped to the bounds
+    Region* clipRegion = mSnapshot->clipRegion;
+    if (!clipRegion || clipRegion->isEmpty() || mSnapshot->fbo != 0) {
+        mCaches.stencil.disable();
+        return;
+    }
+
+    size_t count;
+    const android::Rect* rects = clipRegion->getArray(&count);
+
+    Vertex mesh[count * 6];
+    Vertex* vertex = mesh;
+    for (size_t i = 0; i < count; i++) {
+        const android::Rect& r = rects[i];
+        Vertex::set(vertex++, r.left, r.bottom);
+        Vertex::set(vertex++, r.left, r.top);
+        Vertex::set(vertex++, r.right, r.top);
+        Vertex::set(vertex++, r.left, r.bottom);
+        Vertex::set(vertex++, r.right, r.top);
+        Vertex::set(vertex++, r.right, r.bottom);
+    }
+
+    // The scissor was set to the bounds of the clip, which restricts the clear
+    mCaches.stencil.enableWrite();
+    mCaches.stencil.clear();
+
+    // mDirtyClip is false at this point, setupDraw() won't call back into here.
+    // Nothing is drawn in the color buffer so the layer's region is not dirtied
+    setupDraw(false);
+    setupDrawColor(0.0f, 0.0f, 0.0f, 1.0f);
+    setupDrawBlending(false, SkXfermode::kSrc_Mode);
+    setupDrawProgram();
+    setupDrawPureColorUniforms();
+    setupDrawModelViewTranslate(0.0f, 0.0f, 0.0f, 0.0f, true);
+    setupDrawVertices(&mesh[0].position[0]);
+
+    glDrawArrays(GL_TRIANGLES, 0, count * 6);
+    mCaches.stats.drawCalls++;
+
+    mCaches.stencil.enableTest();
+}
+
 const Rect& OpenGLRenderer::getClipBounds() {
     return mSnapshot->getLocalClip();
 }
@@ -1139,7 +1265,55 @@ bool OpenGLRenderer::quickReject(float left, float top, float right, float botto
     return !clipRect.intersects(r);
 }
 
+bool OpenGLRenderer::quickReject(float left, float top, float right, float bottom, Rect& bounds) {
+    if (mSnapshot->isIgnored()) {
+        return true;
+    }
+
+    bounds.set(left, top, right, bottom);
+    mSnapshot->transform->mapRect(bounds);
+    bounds.snapToPixelBoundaries();
+
+    Rect clipRect(*mSnapshot->clipRect);
+    clipRect.snapToPixelBoundaries();
+
+    return !bounds.intersect(clipRect);
+}
+
+bool OpenGLRenderer::getOpaqueBounds(float left, float top, float right, float bottom,
+        Rect& bounds) {
+    if (mSnapshot->isIgnored() || mSnapshot->alpha < 1.0f || mShader || mColorFilter) {
+        return false;
+    }
+    // Rotated primitives and stencil clips do not cover rectangular areas
+    Region* clipRegion = mSnapshot->clipRegion;
+    if (!mSnapshot->transform->isSimple() || (clipRegion && !clipRegion->isEmpty())) {
+        return false;
+    }
+
+    bounds.set(left, top, right, bottom);
+    mSnapshot->transform->mapRect(bounds);
+    // Filtering and anti-aliasing may blend the pixels along the edges
+    bounds.set(ceilf(bounds.left) + 1.0f, ceilf(bounds.top) + 1.0f,
+            floorf(bounds.right) - 1.0f, floorf(bounds.bottom) - 1.0f);
+
+    Rect clipRect(*mSnapshot->clipRect);
+    clipRect.snapToPixelBoundaries();
+
+    return bounds.intersect(clipRect);
+}
+
 bool OpenGLRenderer::clipRect(float left, float top, float right, float bottom, SkRegion::Op op) {
+    if (CC_UNLIKELY(!mSnapshot->transform->isSimple())) {
+        // A rotated or skewed rect is not a rect anymore
+        SkPath path;
+        path.addRect(left, top, right, bottom);
+        return clipPath(&path, op);
+    }
+
+    // Batched bitmaps must be drawn with the clip they were added with
+    flushBitmapBatch();
+
     bool clipped = mSnapshot->clip(left, top, right, bottom, op);
     if (clipped) {
         dirtyClip();
@@ -1147,6 +1321,49 @@ bool OpenGLRenderer::clipRect(float left, float top, float right, float bottom,
     return !mSnapshot->clipRect->isEmpty();
 }
 
+bool OpenGLRenderer::clipPath(SkPath* path, SkRegion::Op op) {
+    flushBitmapBatch();
+
+    SkMatrix transform;
+    mSnapshot->transform->copyTo(transform);
+
+    SkPath transformed;
+    path->transform(transform, &transformed);
+
+    // Clips never extend past the surface
+    SkRegion clip;
+    clip.setRect(0, 0, mSnapshot->viewport.getWidth(), mSnapshot->viewport.getHeight());
+
+    SkRegion region;
+    region.setPath(transformed, clip);
+
+    bool clipped = mSnapshot->clipRegionTransformed(region, op);
+    if (clipped) {
+        dirtyClip();
+    }
+    return !mSnapshot->clipRect->isEmpty();
+}
+
+bool OpenGLRenderer::clipRegion(SkRegion* region, SkRegion::Op op) {
+    if (CC_LIKELY(mSnapshot->transform->isPureTranslate())) {
+        flushBitmapBatch();
+
+        SkRegion translated;
+        region->translate((int) floorf(mSnapshot->transform->getTranslateX() + 0.5f),
+                (int) floorf(mSnapshot->transform->getTranslateY() + 0.5f), &translated);
+
+        bool clipped = mSnapshot->clipRegionTransformed(translated, op);
+        if (clipped) {
+            dirtyClip();
+        }
+        return !mSnapshot->clipRect->isEmpty();
+    }
+
+    SkPath path;
+    region->getBoundaryPath(&path);
+    return clipPath(&path, op);
+}
+
 Rect* OpenGLRenderer::getClipRect() {
     return mSnapshot->clipRect;
 }
@@ -1156,9 +1373,12 @@ Rect* OpenGLRenderer::getClipRect() {
 ///////////////////////////////////////////////////////////////////////////////
 
 void OpenGLRenderer::setupDraw(bool clear) {
+    flushBitmapBatch();
+    flushLineBatch();
     if (clear) clearLayerRegions();
     if (mDirtyClip) {
         setScissorFromClip();
+        setStencilFromClip();
     }
     mDescription.reset();
     mSetShaderColor = false;
@@ -1185,6 +1405,10 @@ void OpenGLRenderer::setupDrawAALine() {
     mDescription.isAA = true;
 }
 
+void OpenGLRenderer::setupDrawVertexAlpha() {
+    mDescription.hasVertexAlpha = true;
+}
+
 void OpenGLRenderer::setupDrawPoint(float pointSize) {
     mDescription.isPoint = true;
     mDescription.pointSize = pointSize;
@@ -1218,6 +1442,13 @@ void OpenGLRenderer::setupDrawAlpha8Color(int color, int alpha) {
     mSetShaderColor = mDescription.setAlpha8Color(mColorR, mColorG, mColorB, mColorA);
 }
 
+void OpenGLRenderer::setupDrawTextGamma(const SkPaint* paint) {
+    // Text drawn with a shader is neither black nor white, glyphs are used as is
+    if (!mShader) {
+        mCaches.fontRenderer.describe(mDescription, paint);
+    }
+}
+
 void OpenGLRenderer::setupDrawColor(float r, float g, float b, float a) {
     mColorA = a;
     mColorR = r;
@@ -1324,6 +1555,10 @@ void OpenGLRenderer::setupDrawPureColorUniforms() {
     }
 }
 
+void OpenGLRenderer::setupDrawTextGammaUniforms() {
+    mCaches.fontRenderer.setupProgram(mDescription, mCaches.currentProgram);
+}
+
 void OpenGLRenderer::setupDrawShaderUniforms(bool ignoreTransform) {
     if (mShader) {
         if (ignoreTransform) {
@@ -1405,37 +1640,37 @@ void OpenGLRenderer::setupDrawVertices(GLvoid* vertices) {
 
 /**
  * Sets up the shader to draw an AA line. We draw AA lines with quads, where there is an
- * outer boundary that fades out to 0. The variables set in the shader define the proportion of
- * the width and length of the primitive occupied by the AA region. The vtxWidth and vtxLength
- * attributes (one per vertex) are values from zero to one that tells the fragment
- * shader where the fragment is in relation to the line width/length overall; these values are
- * then used to compute the proper color, based on whether the fragment lies in the fading AA
- * region of the line.
- * Note that we only pass down the width values in this setup function. The length coordinates
- * are set up for each individual segment.
+ * outer boundary that fades out to 0. The vtxWidth and vtxLength attributes (two per vertex)
+ * hold the distances of the vertex to both edges of the primitive, across its width and along
+ * its length, in units of the AA boundary (see AAVertex). Once interpolated, these values tell
+ * the fragment shader whether the fragment lies in the fading AA region of the line and how
+ * far into it. Since the boundary is not a uniform, segments of different sizes can share a
+ * single draw call.
  */
 void OpenGLRenderer::setupDrawAALine(GLvoid* vertices, GLvoid* widthCoords,
-        GLvoid* lengthCoords, float boundaryWidthProportion, int& widthSlot, int& lengthSlot) {
+        GLvoid* lengthCoords, int& widthSlot, int& lengthSlot) {
     bool force = mCaches.unbindMeshBuffer();
     mCaches.bindPositionVertexPointer(force, mCaches.currentProgram->position,
             vertices, gAAVertexStride);
     mCaches.resetTexCoordsVertexPointer();
     mCaches.unbindIndicesBuffer();
 
+    setupDrawAAAttributes(widthCoords, lengthCoords, widthSlot, lengthSlot);
+}
+
+/**
+ * Enables the vtxWidth and vtxLength attributes. The coordinates are offsets
+ * in the currently bound VBO, if any.
+ */
+void OpenGLRenderer::setupDrawAAAttributes(GLvoid* widthCoords, GLvoid* lengthCoords,
+        int& widthSlot, int& lengthSlot) {
     widthSlot = mCaches.currentProgram->getAttrib("vtxWidth");
     glEnableVertexAttribArray(widthSlot);
-    glVertexAttribPointer(widthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride, widthCoords);
+    glVertexAttribPointer(widthSlot, 2, GL_FLOAT, GL_FALSE, gAAVertexStride, widthCoords);
 
     lengthSlot = mCaches.currentProgram->getAttrib("vtxLength");
     glEnableVertexAttribArray(lengthSlot);
-    glVertexAttribPointer(lengthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride, lengthCoords);
-
-    int boundaryWidthSlot = mCaches.currentProgram->getUniform("boundaryWidth");
-    glUniform1f(boundaryWidthSlot, boundaryWidthProportion);
-
-    // Setting the inverse value saves computations per-fragment in the shader
-    int inverseBoundaryWidthSlot = mCaches.currentProgram->getUniform("inverseBoundaryWidth");
-    glUniform1f(inverseBoundaryWidthSlot, 1.0f / boundaryWidthProportion);
+    glVertexAttribPointer(lengthSlot, 2, GL_FLOAT, GL_FALSE, gAAVertexStride, lengthCoords);
 }
 
 void OpenGLRenderer::finishDrawAALine(const int widthSlot, const int lengthSlot) {
@@ -1443,6 +1678,27 @@ void OpenGLRenderer::finishDrawAALine(const int widthSlot, const int lengthSlot)
     glDisableVertexAttribArray(lengthSlot);
 }
 
+/**
+ * Binds a VBO of AlphaVertex. The alpha of each vertex is passed to the
+ * shader in the vtxAlpha attribute.
+ */
+void OpenGLRenderer::setupDrawVertexAlphaMesh(GLuint vbo, int& alphaSlot) {
+    bool force = mCaches.bindMeshBuffer(vbo);
+    mCaches.bindPositionVertexPointer(force, mCaches.currentProgram->position,
+            0, gAlphaVertexStride);
+    mCaches.resetTexCoordsVertexPointer();
+    mCaches.unbindIndicesBuffer();
+
+    alphaSlot = mCaches.currentProgram->getAttrib("vtxAlpha");
+    glEnableVertexAttribArray(alphaSlot);
+    glVertexAttribPointer(alphaSlot, 1, GL_FLOAT, GL_FALSE, gAlphaVertexStride,
+            (GLvoid*) gVertexAlphaOffset);
+}
+
+void OpenGLRenderer::finishDrawVertexAlphaMesh(const int alphaSlot) {
+    glDisableVertexAttribArray(alphaSlot);
+}
+
 void OpenGLRenderer::finishDrawTexture() {
 }
 
@@ -1456,7 +1712,10 @@ status_t OpenGLRenderer::drawDisplayList(DisplayList* displayList,
     // All the usual checks and setup operations (quickReject, setupDraw, etc.)
     // will be performed by the display list itself
     if (displayList && displayList->isRenderable()) {
-        return displayList->replay(*this, dirty, flags, level);
+        mCaches.profiler.beginReplay();
+        status_t status = displayList->replay(*this, dirty, flags, level);
+        mCaches.profiler.endReplay();
+        return status;
     }
 
     return DrawGlInfo::kStatusDone;
@@ -1508,6 +1767,7 @@ void OpenGLRenderer::drawAlphaBitmap(Texture* texture, float left, float top, Sk
     setupDrawMesh(NULL, (GLvoid*) gMeshTextureOffset);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.stats.drawCalls++;
 
     finishDrawTexture();
 }
@@ -1520,6 +1780,11 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, float left, float top, SkP
         return DrawGlInfo::kStatusDone;
     }
 
+    // Fetching another texture could evict or update the one used by the batch
+    if (mBitmapBatch.bitmap != bitmap || mBitmapBatch.generation != bitmap->getGenerationID()) {
+        flushBitmapBatch();
+    }
+
     mCaches.activeTexture(0);
     Texture* texture = mCaches.textureCache.get(bitmap);
     if (!texture) return DrawGlInfo::kStatusDone;
@@ -1527,13 +1792,113 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, float left, float top, SkP
 
     if (CC_UNLIKELY(bitmap->getConfig() == SkBitmap::kA8_Config)) {
         drawAlphaBitmap(texture, left, top, paint);
-    } else {
+    } else if (!batchBitmap(bitmap, texture, left, top, paint)) {
         drawTextureRect(left, top, right, bottom, texture, paint);
     }
 
     return DrawGlInfo::kStatusDrew;
 }
 
+bool OpenGLRenderer::batchBitmap(SkBitmap* bitmap, Texture* texture, float left, float top,
+        SkPaint* paint) {
+    // Pending lines must be drawn underneath the bitmap
+    flushLineBatch();
+
+    // The stencil only holds the current clip, see setStencilFromClip()
+    Region* clipRegion = mSnapshot->clipRegion;
+    if (!mSnapshot->transform->isPureTranslate() || texture->cleanup ||
+            (clipRegion && !clipRegion->isEmpty())) {
+        flushBitmapBatch();
+        return false;
+    }
+
+    int alpha;
+    SkXfermode::Mode mode;
+    getAlphaAndMode(paint, &alpha, &mode);
+
+    Rect clip(*mSnapshot->clipRect);
+    clip.snapToPixelBoundaries();
+
+    BitmapBatch& batch = mBitmapBatch;
+    if (batch.count > 0 && (batch.texture != texture->id || batch.alpha != alpha ||
+            batch.mode != mode || batch.clip != clip || batch.height != mSnapshot->height ||
+            batch.count >= BITMAP_BATCH_QUAD_COUNT)) {
+        flushBitmapBatch();
+    }
+
+    const float x = (int) floorf(left + mSnapshot->transform->getTranslateX() + 0.5f);
+    const float y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
+    const float right = x + texture->width;
+    const float bottom = y + texture->height;
+
+    texture->setWrap(GL_CLAMP_TO_EDGE, true);
+    texture->setFilter(GL_NEAREST, true);
+
+    if (batch.count == 0) {
+        batch.bitmap = bitmap;
+        batch.generation = bitmap->getGenerationID();
+        batch.texture = texture->id;
+        batch.alpha = alpha;
+        batch.mode = mode;
+        batch.blend = texture->blend;
+        batch.clip.set(clip);
+        batch.height = mSnapshot->height;
+    }
+
+    TextureVertex* mesh = &mBitmapBatchMesh[batch.count * 4];
+    TextureVertex::set(mesh++, x, y, 0.0f, 0.0f);
+    TextureVertex::set(mesh++, right, y, 1.0f, 0.0f);
+    TextureVertex::set(mesh++, x, bottom, 0.0f, 1.0f);
+    TextureVertex::set(mesh++, right, bottom, 1.0f, 1.0f);
+    batch.count++;
+
+    // The dirty region must be computed against the current clip
+    dirtyLayer(x, y, right, bottom);
+
+    return true;
+}
+
+void OpenGLRenderer::flushBitmapBatch() {
+    const GLsizei count = mBitmapBatch.count;
+    if (CC_LIKELY(count == 0)) return;
+
+    // setupDraw() flushes the batch, make sure we don't come back here
+    mBitmapBatch.count = 0;
+    mBitmapBatch.bitmap = NULL;
+
+    const float alpha = mBitmapBatch.alpha / 255.0f;
+
+    setupDraw();
+    setupDrawWithTexture();
+    setupDrawColor(alpha, alpha, alpha, alpha);
+    setupDrawColorFilter();
+    setupDrawBlending(mBitmapBatch.blend, mBitmapBatch.mode);
+    setupDrawProgram();
+    setupDrawDirtyRegionsDisabled();
+    setupDrawPureColorUniforms();
+    setupDrawColorFilterUniforms();
+    mCaches.activeTexture(0);
+    setupDrawTexture(mBitmapBatch.texture);
+    // The vertices are already in screen space
+    setupDrawModelViewTranslate(0.0f, 0.0f, 0.0f, 0.0f, true);
+    // Binds the quad indices buffer shared with layer regions
+    mCaches.getRegionMesh();
+    setupDrawMeshIndices(&mBitmapBatchMesh[0].position[0], &mBitmapBatchMesh[0].texture[0]);
+
+    // The clip may have changed since the quads were added
+    const Rect& clip = mBitmapBatch.clip;
+    mCaches.setScissor(clip.left, mBitmapBatch.height - clip.bottom,
+            clip.getWidth(), clip.getHeight());
+    // Bitmaps are never batched under a stencil clip
+    mCaches.stencil.disable();
+    dirtyClip();
+
+    glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, NULL);
+    mCaches.stats.drawCalls++;
+
+    finishDrawTexture();
+}
+
 status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint* paint) {
     Rect r(0.0f, 0.0f, bitmap->width(), bitmap->height());
     const mat4 transform(*matrix);
@@ -1543,6 +1908,7 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint*
         return DrawGlInfo::kStatusDone;
     }
 
+    flushBitmapBatch();
     mCaches.activeTexture(0);
     Texture* texture = mCaches.textureCache.get(bitmap);
     if (!texture) return DrawGlInfo::kStatusDone;
@@ -1566,6 +1932,7 @@ status_t OpenGLRenderer::drawBitmapData(SkBitmap* bitmap, float left, float top,
         return DrawGlInfo::kStatusDone;
     }
 
+    flushBitmapBatch();
     mCaches.activeTexture(0);
     Texture* texture = mCaches.textureCache.getTransient(bitmap);
     const AutoTexture autoCleanup(texture);
@@ -1582,6 +1949,7 @@ status_t OpenGLRenderer::drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int mes
         return DrawGlInfo::kStatusDone;
     }
 
+    flushBitmapBatch();
     mCaches.activeTexture(0);
     Texture* texture = mCaches.textureCache.get(bitmap);
     if (!texture) return DrawGlInfo::kStatusDone;
@@ -1596,6 +1964,48 @@ status_t OpenGLRenderer::drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int mes
 
     const uint32_t count = meshWidth * meshHeight * 6;
 
+    // Meshes that fit 16 bit indices are drawn from cached index and texture
+    // coordinates buffers, only the positions are uploaded
+    if ((meshWidth + 1) * (meshHeight + 1) <= 65536) {
+#if RENDER_LAYERS_AS_REGIONS
+        if (hasLayer()) {
+            float left = FLT_MAX;
+            float top = FLT_MAX;
+            float right = -FLT_MAX;
+            float bottom = -FLT_MAX;
+
+            const uint32_t vertexCount = (meshWidth + 1) * (meshHeight + 1);
+            for (uint32_t i = 0; i < vertexCount * 2; i += 2) {
+                left = fminf(left, vertices[i]);
+                right = fmaxf(right, vertices[i]);
+                top = fminf(top, vertices[i + 1]);
+                bottom = fmaxf(bottom, vertices[i + 1]);
+            }
+            dirtyLayer(left, top, right, bottom, *mSnapshot->transform);
+        }
+#endif
+
+        setupDraw();
+        setupDrawWithTexture();
+        setupDrawColor(alpha / 255.0f, alpha / 255.0f, alpha / 255.0f, alpha / 255.0f);
+        setupDrawColorFilter();
+        setupDrawBlending(texture->blend, mode, false);
+        setupDrawProgram();
+        setupDrawDirtyRegionsDisabled();
+        setupDrawModelView(0.0f, 0.0f, 1.0f, 1.0f, false);
+        setupDrawPureColorUniforms();
+        setupDrawColorFilterUniforms();
+        setupDrawTexture(texture->id);
+
+        if (mCaches.bindBitmapMesh(meshWidth, meshHeight, vertices,
+                mCaches.currentProgram->position, mCaches.currentProgram->texCoords)) {
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, NULL);
+            mCaches.stats.drawCalls++;
+            finishDrawTexture();
+            return DrawGlInfo::kStatusDrew;
+        }
+    }
+
     float left = FLT_MAX;
     float top = FLT_MAX;
     float right = FLT_MIN;
@@ -1669,6 +2079,7 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap,
         return DrawGlInfo::kStatusDone;
     }
 
+    flushBitmapBatch();
     mCaches.activeTexture(0);
     Texture* texture = mCaches.textureCache.get(bitmap);
     if (!texture) return DrawGlInfo::kStatusDone;
@@ -1725,6 +2136,7 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs, const
         return DrawGlInfo::kStatusDone;
     }
 
+    flushBitmapBatch();
     mCaches.activeTexture(0);
     Texture* texture = mCaches.textureCache.get(bitmap);
     if (!texture) return DrawGlInfo::kStatusDone;
@@ -1766,12 +2178,14 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs, const
             const float y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
 
             drawTextureMesh(x, y, x + right - left, y + bottom - top, texture->id, alpha / 255.0f,
-                    mode, texture->blend, (GLvoid*) 0, (GLvoid*) gMeshTextureOffset,
+                    mode, texture->blend, (GLvoid*) mesh->offset,
+                    (GLvoid*) (mesh->offset + gMeshTextureOffset),
                     GL_TRIANGLES, mesh->verticesCount, false, true, mesh->meshBuffer,
                     true, !mesh->hasEmptyQuads);
         } else {
             drawTextureMesh(left, top, right, bottom, texture->id, alpha / 255.0f,
-                    mode, texture->blend, (GLvoid*) 0, (GLvoid*) gMeshTextureOffset,
+                    mode, texture->blend, (GLvoid*) mesh->offset,
+                    (GLvoid*) (mesh->offset + gMeshTextureOffset),
                     GL_TRIANGLES, mesh->verticesCount, false, false, mesh->meshBuffer,
                     true, !mesh->hasEmptyQuads);
         }
@@ -1838,23 +2252,23 @@ void OpenGLRenderer::drawAARect(float left, float top, float right, float bottom
     int widthSlot;
     int lengthSlot;
 
-    float boundaryWidthProportion = (width != 0) ? (2 * boundarySizeX) / width : 0;
-    float boundaryHeightProportion = (height != 0) ? (2 * boundarySizeY) / height : 0;
-    setupDrawAALine((void*) aaVertices, widthCoords, lengthCoords,
-            boundaryWidthProportion, widthSlot, lengthSlot);
-
-    int boundaryLengthSlot = mCaches.currentProgram->getUniform("boundaryLength");
-    int inverseBoundaryLengthSlot = mCaches.currentProgram->getUniform("inverseBoundaryLength");
-    glUniform1f(boundaryLengthSlot, boundaryHeightProportion);
-    glUniform1f(inverseBoundaryLengthSlot, (1.0f / boundaryHeightProportion));
+    // Inverse of the proportion of the width and height occupied by the boundary
+    float inverseBoundaryWidth = (boundarySizeX != 0) ? width / (2 * boundarySizeX) : 0;
+    float inverseBoundaryHeight = (boundarySizeY != 0) ? height / (2 * boundarySizeY) : 0;
+    setupDrawAALine((void*) aaVertices, widthCoords, lengthCoords, widthSlot, lengthSlot);
 
     if (!quickReject(left, top, right, bottom)) {
-        AAVertex::set(aaVertices++, left, bottom, 1, 1);
-        AAVertex::set(aaVertices++, left, top, 1, 0);
-        AAVertex::set(aaVertices++, right, bottom, 0, 1);
-        AAVertex::set(aaVertices++, right, top, 0, 0);
+        AAVertex::set(aaVertices++, left, bottom, 1, 1,
+                inverseBoundaryWidth, inverseBoundaryHeight);
+        AAVertex::set(aaVertices++, left, top, 1, 0,
+                inverseBoundaryWidth, inverseBoundaryHeight);
+        AAVertex::set(aaVertices++, right, bottom, 0, 1,
+                inverseBoundaryWidth, inverseBoundaryHeight);
+        AAVertex::set(aaVertices++, right, top, 0, 0,
+                inverseBoundaryWidth, inverseBoundaryHeight);
         dirtyLayer(left, top, right, bottom, *mSnapshot->transform);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        mCaches.stats.drawCalls++;
     }
 
     finishDrawAALine(widthSlot, lengthSlot);
@@ -1896,13 +2310,6 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
     int alpha;
     SkXfermode::Mode mode;
 
-    int generatedVerticesCount = 0;
-    int verticesCount = count;
-    if (count > 4) {
-        // Polyline: account for extra vertices needed for continuous tri-strip
-        verticesCount += (count - 4);
-    }
-
     if (isHairLine || isAA) {
         // The quad that we use for AA and hairlines needs to account for scaling. For hairlines
         // the line on the screen should always be one pixel wide regardless of scale. For
@@ -1929,20 +2336,6 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
     }
 
     getAlphaAndMode(paint, &alpha, &mode);
-    setupDraw();
-    setupDrawNoTexture();
-    if (isAA) {
-        setupDrawAALine();
-    }
-    setupDrawColor(paint->getColor(), alpha);
-    setupDrawColorFilter();
-    setupDrawShader();
-    setupDrawBlending(isAA, mode);
-    setupDrawProgram();
-    setupDrawModelViewIdentity(true);
-    setupDrawColorUniforms();
-    setupDrawColorFilterUniforms();
-    setupDrawShaderIdentityUniforms();
 
     if (isHairLine) {
         // Set a real stroke width to be used in quad construction
@@ -1952,37 +2345,18 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
         halfStrokeWidth += .5f;
     }
 
-    int widthSlot;
-    int lengthSlot;
+    // Consecutive calls sharing a paint, a transform and a clip are drawn
+    // with a single draw call, see flushLineBatch()
+    const bool deferred = prepareLineBatch(paint->getColor(), alpha, mode, isAA);
 
-    Vertex lines[verticesCount];
-    Vertex* vertices = &lines[0];
+    // The inverse of the ratio of the AA part of the line to the total AA stroke width
+    // (the base stroke width expanded by a half pixel on either side). The fragment
+    // shader uses it to determine how to fill fragments. It must be computed on each
+    // segment for scaled non-hairlines, since the boundary proportion may differ
+    // per-axis when scaled.
+    const float strokeInverseBoundaryWidth = 2 * halfStrokeWidth;
 
-    AAVertex wLines[verticesCount];
-    AAVertex* aaVertices = &wLines[0];
-
-    if (CC_UNLIKELY(!isAA)) {
-        setupDrawVertices(vertices);
-    } else {
-        void* widthCoords = ((GLbyte*) aaVertices) + gVertexAAWidthOffset;
-        void* lengthCoords = ((GLbyte*) aaVertices) + gVertexAALengthOffset;
-        // innerProportion is the ratio of the inner (non-AA) part of the line to the total
-        // AA stroke width (the base stroke width expanded by a half pixel on either side).
-        // This value is used in the fragment shader to determine how to fill fragments.
-        // We will need to calculate the actual width proportion on each segment for
-        // scaled non-hairlines, since the boundary proportion may differ per-axis when scaled.
-        float boundaryWidthProportion = 1 / (2 * halfStrokeWidth);
-        setupDrawAALine((void*) aaVertices, widthCoords, lengthCoords,
-                boundaryWidthProportion, widthSlot, lengthSlot);
-    }
-
-    AAVertex* prevAAVertex = NULL;
-    Vertex* prevVertex = NULL;
-
-    int boundaryLengthSlot = -1;
-    int inverseBoundaryLengthSlot = -1;
-    int boundaryWidthSlot = -1;
-    int inverseBoundaryWidthSlot = -1;
+    AAVertex quad[4];
 
     for (int i = 0; i < count; i += 4) {
         // a = start point, b = end point
@@ -1990,8 +2364,8 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
         vec2 b(points[i + 2], points[i + 3]);
 
         float length = 0;
-        float boundaryLengthProportion = 0;
-        float boundaryWidthProportion = 0;
+        float inverseBoundaryLength = 0;
+        float inverseBoundaryWidth = strokeInverseBoundaryWidth;
 
         // Find the normal to the line
         vec2 n = (b - a).copyNormalized() * halfStrokeWidth;
@@ -2018,8 +2392,7 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
             extendedN.y *= inverseScaleY;
 
             float extendedNLength = extendedN.length();
-            // We need to set this value on the shader prior to drawing
-            boundaryWidthProportion = extendedNLength / (halfStrokeWidth + extendedNLength);
+            inverseBoundaryWidth = (halfStrokeWidth + extendedNLength) / extendedNLength;
             n += extendedN;
         }
 
@@ -2037,9 +2410,9 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
                 abVector.x *= inverseScaleX;
                 abVector.y *= inverseScaleY;
                 float abLength = abVector.length();
-                boundaryLengthProportion = abLength / (length + abLength);
+                inverseBoundaryLength = (length + abLength) / abLength;
             } else {
-                boundaryLengthProportion = .5 / (length + 1);
+                inverseBoundaryLength = (length + 1) / .5;
             }
 
             abVector /= 2;
@@ -2061,66 +2434,22 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
 
         if (!quickReject(left, top, right, bottom)) {
             if (!isAA) {
-                if (prevVertex != NULL) {
-                    // Issue two repeat vertices to create degenerate triangles to bridge
-                    // between the previous line and the new one. This is necessary because
-                    // we are creating a single triangle_strip which will contain
-                    // potentially discontinuous line segments.
-                    Vertex::set(vertices++, prevVertex->position[0], prevVertex->position[1]);
-                    Vertex::set(vertices++, p1.x, p1.y);
-                    generatedVerticesCount += 2;
-                }
-
-                Vertex::set(vertices++, p1.x, p1.y);
-                Vertex::set(vertices++, p2.x, p2.y);
-                Vertex::set(vertices++, p4.x, p4.y);
-                Vertex::set(vertices++, p3.x, p3.y);
-
-                prevVertex = vertices - 1;
-                generatedVerticesCount += 4;
+                // The AA attributes are ignored by the non-AA program
+                AAVertex::set(&quad[0], p1.x, p1.y, 0, 0, 0, 0);
+                AAVertex::set(&quad[1], p2.x, p2.y, 0, 0, 0, 0);
+                AAVertex::set(&quad[2], p4.x, p4.y, 0, 0, 0, 0);
+                AAVertex::set(&quad[3], p3.x, p3.y, 0, 0, 0, 0);
             } else {
-                if (!isHairLine && scaled) {
-                    // Must set width proportions per-segment for scaled non-hairlines to use the
-                    // correct AA boundary dimensions
-                    if (boundaryWidthSlot < 0) {
-                        boundaryWidthSlot =
-                                mCaches.currentProgram->getUniform("boundaryWidth");
-                        inverseBoundaryWidthSlot =
-                                mCaches.currentProgram->getUniform("inverseBoundaryWidth");
-                    }
-
-                    glUniform1f(boundaryWidthSlot, boundaryWidthProportion);
-                    glUniform1f(inverseBoundaryWidthSlot, (1 / boundaryWidthProportion));
-                }
-
-                if (boundaryLengthSlot < 0) {
-                    boundaryLengthSlot = mCaches.currentProgram->getUniform("boundaryLength");
-                    inverseBoundaryLengthSlot =
-                            mCaches.currentProgram->getUniform("inverseBoundaryLength");
-                }
-
-                glUniform1f(boundaryLengthSlot, boundaryLengthProportion);
-                glUniform1f(inverseBoundaryLengthSlot, (1 / boundaryLengthProportion));
-
-                if (prevAAVertex != NULL) {
-                    // Issue two repeat vertices to create degenerate triangles to bridge
-                    // between the previous line and the new one. This is necessary because
-                    // we are creating a single triangle_strip which will contain
-                    // potentially discontinuous line segments.
-                    AAVertex::set(aaVertices++,prevAAVertex->position[0],
-                            prevAAVertex->position[1], prevAAVertex->width, prevAAVertex->length);
-                    AAVertex::set(aaVertices++, p4.x, p4.y, 1, 1);
-                    generatedVerticesCount += 2;
-                }
-
-                AAVertex::set(aaVertices++, p4.x, p4.y, 1, 1);
-                AAVertex::set(aaVertices++, p1.x, p1.y, 1, 0);
-                AAVertex::set(aaVertices++, p3.x, p3.y, 0, 1);
-                AAVertex::set(aaVertices++, p2.x, p2.y, 0, 0);
-
-                prevAAVertex = aaVertices - 1;
-                generatedVerticesCount += 4;
+                AAVertex::set(&quad[0], p4.x, p4.y, 1, 1,
+                        inverseBoundaryWidth, inverseBoundaryLength);
+                AAVertex::set(&quad[1], p1.x, p1.y, 1, 0,
+                        inverseBoundaryWidth, inverseBoundaryLength);
+                AAVertex::set(&quad[2], p3.x, p3.y, 0, 1,
+                        inverseBoundaryWidth, inverseBoundaryLength);
+                AAVertex::set(&quad[3], p2.x, p2.y, 0, 0,
+                        inverseBoundaryWidth, inverseBoundaryLength);
             }
+            batchLineQuad(quad);
 
             dirtyLayer(a.x == b.x ? left - 1 : left, a.y == b.y ? top - 1 : top,
                     a.x == b.x ? right: right, a.y == b.y ? bottom: bottom,
@@ -2128,15 +2457,128 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
         }
     }
 
-    if (generatedVerticesCount > 0) {
-       glDrawArrays(GL_TRIANGLE_STRIP, 0, generatedVerticesCount);
+    if (!deferred) {
+        flushLineBatch();
     }
 
+    return DrawGlInfo::kStatusDrew;
+}
+
+bool OpenGLRenderer::prepareLineBatch(int color, int alpha, SkXfermode::Mode mode, bool isAA) {
+    // Pending bitmaps must be drawn underneath the lines
+    flushBitmapBatch();
+
+    Rect clip(*mSnapshot->clipRect);
+    clip.snapToPixelBoundaries();
+
+    // Only the window has a stencil buffer, see setStencilFromClip()
+    Region* clipRegion = mSnapshot->clipRegion;
+    const bool stencil = clipRegion && !clipRegion->isEmpty() && mSnapshot->fbo == 0;
+
+    LineBatch& batch = mLineBatch;
+    if (batch.count > 0 && (batch.color != color || batch.alpha != alpha ||
+            batch.mode != mode || batch.isAA != isAA || batch.clip != clip ||
+            batch.height != mSnapshot->height || batch.stencil != stencil ||
+            memcmp(batch.transform.data, mSnapshot->transform->data,
+                    sizeof(batch.transform.data)))) {
+        flushLineBatch();
+    }
+
+    if (batch.count == 0) {
+        batch.color = color;
+        batch.alpha = alpha;
+        batch.mode = mode;
+        batch.isAA = isAA;
+        batch.transform.load(*mSnapshot->transform);
+        batch.clip.set(clip);
+        batch.height = mSnapshot->height;
+        batch.stencil = stencil;
+    }
+
+    // Shaders depend on the snapshot used when drawing and the stencil holds
+    // the current clip only, lines drawn with either can't be deferred
+    return !mShader && !stencil;
+}
+
+void OpenGLRenderer::batchLineQuad(const AAVertex* quad) {
+    LineBatch& batch = mLineBatch;
+    // 4 vertices per quad plus 2 to bridge with the previous one
+    if (batch.count + 6 > LINE_MESH_VERTEX_COUNT) {
+        // The batch keeps its paint, transform and clip
+        flushLineBatch();
+    }
+
+    AAVertex* mesh = mCaches.getLineMesh() + batch.count;
+    if (batch.count > 0) {
+        // Issue two repeat vertices to create degenerate triangles to bridge
+        // between the previous line and the new one. This is necessary because
+        // we are creating a single triangle_strip which will contain
+        // potentially discontinuous line segments.
+        mesh[0] = mesh[-1];
+        mesh[1] = quad[0];
+        mesh += 2;
+        batch.count += 2;
+    }
+
+    memcpy(mesh, quad, 4 * sizeof(AAVertex));
+    batch.count += 4;
+}
+
+void OpenGLRenderer::flushLineBatch() {
+    const GLsizei count = mLineBatch.count;
+    if (CC_LIKELY(count == 0)) return;
+
+    // setupDraw() flushes the batch, make sure we don't come back here
+    mLineBatch.count = 0;
+
+    const bool isAA = mLineBatch.isAA;
+
+    setupDraw();
+    setupDrawNoTexture();
     if (isAA) {
-        finishDrawAALine(widthSlot, lengthSlot);
+        setupDrawAALine();
     }
+    setupDrawColor(mLineBatch.color, mLineBatch.alpha);
+    setupDrawColorFilter();
+    setupDrawShader();
+    setupDrawBlending(isAA, mLineBatch.mode);
+    setupDrawProgram();
+    setupDrawDirtyRegionsDisabled();
+    // The segments were dirtied when they were added to the batch
+    mCaches.currentProgram->set(mOrthoMatrix, mIdentity, mLineBatch.transform, true);
+    setupDrawColorUniforms();
+    setupDrawColorFilterUniforms();
+    setupDrawShaderIdentityUniforms();
 
-    return DrawGlInfo::kStatusDrew;
+    // Uploads the segments to the line mesh VBO and binds it
+    bool force = mCaches.bindLineMesh(count);
+    mCaches.bindPositionVertexPointer(force, mCaches.currentProgram->position,
+            NULL, gAAVertexStride);
+    mCaches.resetTexCoordsVertexPointer();
+    mCaches.unbindIndicesBuffer();
+
+    int widthSlot;
+    int lengthSlot;
+    if (isAA) {
+        setupDrawAAAttributes((GLvoid*) gVertexAAWidthOffset, (GLvoid*) gVertexAALengthOffset,
+                widthSlot, lengthSlot);
+    }
+
+    // The clip may have changed since the segments were added
+    const Rect& clip = mLineBatch.clip;
+    mCaches.setScissor(clip.left, mLineBatch.height - clip.bottom,
+            clip.getWidth(), clip.getHeight());
+    if (!mLineBatch.stencil) {
+        mCaches.stencil.disable();
+    }
+    dirtyClip();
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, count);
+    mCaches.stats.drawCalls++;
+
+    if (isAA) {
+        finishDrawAALine(widthSlot, lengthSlot);
+    }
 }
 
 status_t OpenGLRenderer::drawPoints(float* points, int count, SkPaint* paint) {
@@ -2192,6 +2634,7 @@ status_t OpenGLRenderer::drawPoints(float* points, int count, SkPaint* paint) {
     }
 
     glDrawArrays(GL_POINTS, 0, generatedVerticesCount);
+    mCaches.stats.drawCalls++;
 
     return DrawGlInfo::kStatusDrew;
 }
@@ -2342,11 +2785,13 @@ status_t OpenGLRenderer::drawPosText(const char* text, int bytesCount, int count
     setupDrawAlpha8Color(paint->getColor(), alpha);
     setupDrawColorFilter();
     setupDrawShader();
+    setupDrawTextGamma(paint);
     setupDrawBlending(true, mode);
     setupDrawProgram();
     setupDrawModelView(x, y, x, y, pureTranslate, true);
     setupDrawTexture(fontRenderer.getTexture(linearFilter));
     setupDrawPureColorUniforms();
+    setupDrawTextGammaUniforms();
     setupDrawColorFilterUniforms();
     setupDrawShaderUniforms(pureTranslate);
 
@@ -2451,6 +2896,7 @@ status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count,
         setupDrawMesh(NULL, (GLvoid*) gMeshTextureOffset);
 
         glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+        mCaches.stats.drawCalls++;
     }
 
     // Pick the appropriate texture filtering
@@ -2467,6 +2913,7 @@ status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count,
     setupDrawAlpha8Color(paint->getColor(), alpha);
     setupDrawColorFilter();
     setupDrawShader();
+    setupDrawTextGamma(paint);
     setupDrawBlending(true, mode);
     setupDrawProgram();
     setupDrawModelView(x, y, x, y, pureTranslate, true);
@@ -2474,6 +2921,7 @@ status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count,
     // assert(mTextureUnit == 0)
     setupDrawTexture(fontRenderer.getTexture(linearFilter));
     setupDrawPureColorUniforms();
+    setupDrawTextGammaUniforms();
     setupDrawColorFilterUniforms();
     setupDrawShaderUniforms(pureTranslate);
 
@@ -2525,11 +2973,13 @@ status_t OpenGLRenderer::drawTextOnPath(const char* text, int bytesCount, int co
     setupDrawAlpha8Color(paint->getColor(), alpha);
     setupDrawColorFilter();
     setupDrawShader();
+    setupDrawTextGamma(paint);
     setupDrawBlending(true, mode);
     setupDrawProgram();
     setupDrawModelView(0.0f, 0.0f, 0.0f, 0.0f, false, true);
     setupDrawTexture(fontRenderer.getTexture(true));
     setupDrawPureColorUniforms();
+    setupDrawTextGammaUniforms();
     setupDrawColorFilterUniforms();
     setupDrawShaderUniforms(false);
 
@@ -2558,6 +3008,18 @@ status_t OpenGLRenderer::drawTextOnPath(const char* text, int bytesCount, int co
 status_t OpenGLRenderer::drawPath(SkPath* path, SkPaint* paint) {
     if (mSnapshot->isIgnored()) return DrawGlInfo::kStatusDone;
 
+    if (mCaches.isTessellatingPaths() && PathTessellator::canTessellate(path, paint)) {
+        int alpha;
+        SkXfermode::Mode mode;
+        getAlphaAndMode(paint, &alpha, &mode);
+
+        // The triangles of a stroke can overlap where the path turns,
+        // translucent strokes would be blended twice there
+        if (paint->getStyle() == SkPaint::kFill_Style || alpha == 255) {
+            return drawPathMesh(path, paint);
+        }
+    }
+
     mCaches.activeTexture(0);
 
     // TODO: Perform early clip test before we rasterize the path
@@ -2573,26 +3035,65 @@ status_t OpenGLRenderer::drawPath(SkPath* path, SkPaint* paint) {
     return DrawGlInfo::kStatusDrew;
 }
 
-status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* paint) {
-    if (!layer || quickReject(x, y, x + layer->layer.getWidth(), y + layer->layer.getHeight())) {
-        return DrawGlInfo::kStatusDone;
+/**
+ * Each dirty rectangle is rendered in its own pass, clipped (and therefore
+ * scissored) to the rectangle, leaving the rest of the FBO untouched. This
+ * is only worth it when the rectangles are few and small compared to their
+ * bounds, since every pass replays the whole display list.
+ */
+void OpenGLRenderer::updateLayer(Layer* layer) {
+    OpenGLRenderer* renderer = layer->renderer;
+    Region& dirtyRegion = layer->dirtyRegion;
+
+    size_t count;
+    const android::Rect* rects = dirtyRegion.getArray(&count);
+    const android::Rect& bounds = dirtyRegion.getBounds();
+
+    bool renderRects = false;
+    if (count > 1 && count <= LAYER_MAX_DIRTY_RECTS) {
+        float area = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            area += float(rects[i].width()) * rects[i].height();
+        }
+        renderRects = area <= float(bounds.width()) * bounds.height() * LAYER_DIRTY_AREA_RATIO;
     }
 
-    if (layer->deferredUpdateScheduled && layer->renderer && layer->displayList) {
-        OpenGLRenderer* renderer = layer->renderer;
-        Rect& dirty = layer->dirtyRect;
+    interrupt();
+    renderer->setViewport(layer->layer.getWidth(), layer->layer.getHeight());
 
-        interrupt();
-        renderer->setViewport(layer->layer.getWidth(), layer->layer.getHeight());
+    if (renderRects) {
+        for (size_t i = 0; i < count; i++) {
+            const android::Rect& r = rects[i];
+            Rect dirty(r.left, r.top, r.right, r.bottom);
+            renderer->prepareDirty(dirty.left, dirty.top, dirty.right, dirty.bottom,
+                    !layer->isBlend());
+            renderer->drawDisplayList(layer->displayList, dirty,
+                    DisplayList::kReplayFlag_ClipChildren);
+            renderer->finish();
+        }
+    } else {
+        // An empty region redraws the entire layer
+        Rect dirty(bounds.left, bounds.top, bounds.right, bounds.bottom);
         renderer->prepareDirty(dirty.left, dirty.top, dirty.right, dirty.bottom, !layer->isBlend());
         renderer->drawDisplayList(layer->displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
         renderer->finish();
-        resume();
+    }
 
-        dirty.setEmpty();
-        layer->deferredUpdateScheduled = false;
-        layer->renderer = NULL;
-        layer->displayList = NULL;
+    resume();
+
+    dirtyRegion.clear();
+    layer->deferredUpdateScheduled = false;
+    layer->renderer = NULL;
+    layer->displayList = NULL;
+}
+
+status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* paint) {
+    if (!layer || quickReject(x, y, x + layer->layer.getWidth(), y + layer->layer.getHeight())) {
+        return DrawGlInfo::kStatusDone;
+    }
+
+    if (layer->deferredUpdateScheduled && layer->renderer && layer->displayList) {
+        updateLayer(layer);
     }
 
     mCaches.activeTexture(0);
@@ -2636,6 +3137,7 @@ status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* pain
 
             glDrawElements(GL_TRIANGLES, layer->meshElementCount,
                     GL_UNSIGNED_SHORT, layer->meshIndices);
+            mCaches.stats.drawCalls++;
 
             finishDrawTexture();
 
@@ -2657,10 +3159,12 @@ status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* pain
 ///////////////////////////////////////////////////////////////////////////////
 
 void OpenGLRenderer::resetShader() {
+    flushLineBatch();
     mShader = NULL;
 }
 
 void OpenGLRenderer::setupShader(SkiaShader* shader) {
+    flushLineBatch();
     mShader = shader;
     if (mShader) {
         mShader->set(&mCaches.textureCache, &mCaches.gradientCache);
@@ -2672,10 +3176,14 @@ void OpenGLRenderer::setupShader(SkiaShader* shader) {
 ///////////////////////////////////////////////////////////////////////////////
 
 void OpenGLRenderer::resetColorFilter() {
+    flushBitmapBatch();
+    flushLineBatch();
     mColorFilter = NULL;
 }
 
 void OpenGLRenderer::setupColorFilter(SkiaColorFilter* filter) {
+    flushBitmapBatch();
+    flushLineBatch();
     mColorFilter = filter;
 }
 
@@ -2749,10 +3257,75 @@ void OpenGLRenderer::drawPathTexture(const PathTexture* texture,
     setupDrawMesh(NULL, (GLvoid*) gMeshTextureOffset);
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.stats.drawCalls++;
 
     finishDrawTexture();
 }
 
+status_t OpenGLRenderer::drawPathMesh(SkPath* path, SkPaint* paint) {
+    // The AA fringe must be one pixel wide on screen
+    float inverseScaleX = 1.0f;
+    float inverseScaleY = 1.0f;
+    if (CC_UNLIKELY(!mSnapshot->transform->isPureTranslate())) {
+        const Matrix4& transform = *mSnapshot->transform;
+        const float m00 = transform.data[Matrix4::kScaleX];
+        const float m01 = transform.data[Matrix4::kSkewY];
+        const float m10 = transform.data[Matrix4::kSkewX];
+        const float m11 = transform.data[Matrix4::kScaleY];
+        const float scaleX = sqrtf(m00 * m00 + m01 * m01);
+        const float scaleY = sqrtf(m10 * m10 + m11 * m11);
+        if (scaleX == 0.0f || scaleY == 0.0f) return DrawGlInfo::kStatusDone;
+        inverseScaleX = 1.0f / scaleX;
+        inverseScaleY = 1.0f / scaleY;
+    }
+
+    PathMesh* mesh = mCaches.pathCache.getMesh(path, paint, inverseScaleX, inverseScaleY);
+    if (!mesh) return DrawGlInfo::kStatusDone;
+
+    const Rect& bounds = mesh->bounds;
+    if (quickReject(bounds.left, bounds.top, bounds.right, bounds.bottom)) {
+        if (mesh->cleanup) delete mesh;
+        return DrawGlInfo::kStatusDone;
+    }
+
+    int alpha;
+    SkXfermode::Mode mode;
+    getAlphaAndMode(paint, &alpha, &mode);
+
+    int color = paint->getColor();
+    // If a shader is set, preserve only the alpha
+    if (mShader) {
+        color |= 0x00ffffff;
+    }
+
+    setupDraw();
+    setupDrawNoTexture();
+    setupDrawVertexAlpha();
+    setupDrawColor(color, alpha);
+    setupDrawColorFilter();
+    setupDrawShader();
+    setupDrawBlending(true, mode);
+    setupDrawProgram();
+    setupDrawModelViewIdentity();
+    setupDrawColorUniforms();
+    setupDrawColorFilterUniforms();
+    setupDrawShaderIdentityUniforms();
+
+    int alphaSlot;
+    setupDrawVertexAlphaMesh(mesh->buffer, alphaSlot);
+
+    glDrawArrays(GL_TRIANGLES, 0, mesh->vertexCount);
+    mCaches.stats.drawCalls++;
+
+    finishDrawVertexAlphaMesh(alphaSlot);
+
+    dirtyLayer(bounds.left, bounds.top, bounds.right, bounds.bottom, *mSnapshot->transform);
+
+    if (mesh->cleanup) delete mesh;
+
+    return DrawGlInfo::kStatusDrew;
+}
+
 // Same values used by Skia
 #define kStdStrikeThru_Offset   (-6.0f / 21.0f)
 #define kStdUnderline_Offset    (1.0f / 9.0f)
@@ -2841,6 +3414,7 @@ void OpenGLRenderer::drawColorRect(float left, float top, float right, float bot
     setupDrawSimpleMesh();
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, gMeshCount);
+    mCaches.stats.drawCalls++;
 }
 
 void OpenGLRenderer::drawTextureRect(float left, float top, float right, float bottom,
@@ -2898,6 +3472,7 @@ void OpenGLRenderer::drawTextureMesh(float left, float top, float right, float b
     setupDrawMesh(vertices, texCoords, vbo);
 
     glDrawArrays(drawMode, 0, elementsCount);
+    mCaches.stats.drawCalls++;
 
     finishDrawTexture();
 }
@@ -2920,6 +3495,7 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
                 if (mCaches.blend) {
                     glDisable(GL_BLEND);
                     mCaches.blend = false;
+                    mCaches.stats.blendChanges++;
                 }
 
                 return;
@@ -2930,6 +3506,7 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
 
         if (!mCaches.blend) {
             glEnable(GL_BLEND);
+            mCaches.stats.blendChanges++;
         }
 
         GLenum sourceMode = swapSrcDst ? gBlendsSwap[mode].src : gBlends[mode].src;
@@ -2939,9 +3516,11 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
             glBlendFunc(sourceMode, destMode);
             mCaches.lastSrcMode = sourceMode;
             mCaches.lastDstMode = destMode;
+            mCaches.stats.blendChanges++;
         }
     } else if (mCaches.blend) {
         glDisable(GL_BLEND);
+        mCaches.stats.blendChanges++;
     }
     mCaches.blend = blend;
 }
@@ -2951,6 +3530,7 @@ bool OpenGLRenderer::useProgram(Program* program) {
         if (mCaches.currentProgram != NULL) mCaches.currentProgram->remove();
         program->use();
         mCaches.currentProgram = program;
+        mCaches.stats.programChanges++;
         return false;
     }
     return true;
@@ -30,11 +30,13 @@
 #include <utils/Functor.h>
 #include <utils/RefBase.h>
 #include <utils/SortedVector.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
 #include <cutils/compiler.h>
 
 #include "Debug.h"
+#include "DirtyRegionBuilder.h"
 #include "Extensions.h"
 #include "Matrix.h"
 #include "Program.h"
@@ -54,6 +56,9 @@ namespace uirenderer {
 
 class DisplayList;
 
+// Maximum number of bitmap quads collected before a batch is drawn
+#define BITMAP_BATCH_QUAD_COUNT 64
+
 /**
  * OpenGL renderer used to draw accelerated 2D graphics. The API is a
  * simplified version of Skia's Canvas API.
@@ -74,6 +79,14 @@ public:
     virtual int prepareDirty(float left, float top, float right, float bottom, bool opaque);
     virtual void finish();
 
+    /**
+     * Time at which the current frame was started by prepare(), used by the display
+     * list animators so that all of them advance together.
+     */
+    nsecs_t getFrameTime() const {
+        return mFrameTime;
+    }
+
     // These two calls must not be recorded in display lists
     virtual void interrupt();
     virtual void resume();
@@ -108,7 +121,24 @@ public:
 
     ANDROID_API const Rect& getClipBounds();
     ANDROID_API bool quickReject(float left, float top, float right, float bottom);
+    /**
+     * Identical to quickReject(float, float, float, float) but also returns
+     * the pixel bounds of the specified rectangle, in screen space and
+     * clipped against the current clip rect.
+     */
+    bool quickReject(float left, float top, float right, float bottom, Rect& bounds);
+
+    /**
+     * Computes, in screen space, the pixels that an opaque primitive drawn in
+     * the specified rect covers entirely with the current transform and clip.
+     * Returns false if no pixel is entirely covered or if the renderer state
+     * (alpha, shader, color filter, non-rectangular clip) would blend the
+     * primitive with the destination.
+     */
+    bool getOpaqueBounds(float left, float top, float right, float bottom, Rect& bounds);
     virtual bool clipRect(float left, float top, float right, float bottom, SkRegion::Op op);
+    virtual bool clipPath(SkPath* path, SkRegion::Op op);
+    virtual bool clipRegion(SkRegion* region, SkRegion::Op op);
     virtual Rect* getClipRect();
 
     virtual status_t drawDisplayList(DisplayList* displayList, Rect& dirty, int32_t flags,
@@ -153,6 +183,10 @@ public:
     virtual void resetShadow();
     virtual void setupShadow(float radius, float dx, float dy, int color);
 
+    bool hasShadow() const {
+        return mHasShadow;
+    }
+
     virtual void resetPaintFilter();
     virtual void setupPaintFilter(int clearBits, int setBits);
 
@@ -216,6 +250,21 @@ protected:
      */
     void drawTextureLayer(Layer* layer, const Rect& rect);
 
+    /**
+     * Starts tiling the region of the surface the specified snapshot renders
+     * to: the dirty region of the frame when rendering to the target of this
+     * renderer, the entire layer otherwise.
+     *
+     * @param discard True if the content of the region will be entirely redrawn
+     */
+    void startTiling(const sp<Snapshot>& snapshot, bool discard = false);
+
+    /**
+     * Ends tiling of the current surface. Must be called before binding
+     * another framebuffer.
+     */
+    void endTiling();
+
 private:
     /**
      * Ensures the state of the renderer is the same as the state of
@@ -247,6 +296,13 @@ private:
      */
     void setScissorFromClip();
 
+    /**
+     * Writes the current clip region into the stencil buffer and enables
+     * the stencil test if the clip is not a simple rectangle. Disables the
+     * stencil test otherwise.
+     */
+    void setStencilFromClip();
+
     /**
      * Creates a new layer stored in the specified snapshot.
      *
@@ -276,6 +332,12 @@ private:
     bool createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> snapshot,
             GLuint previousFbo);
 
+    /**
+     * Renders the areas of the specified layer invalidated since its last
+     * update.
+     */
+    void updateLayer(Layer* layer);
+
     /**
      * Compose the specified layer as a region.
      *
@@ -365,6 +427,52 @@ private:
      */
     void drawAlphaBitmap(Texture* texture, float left, float top, SkPaint* paint);
 
+    /**
+     * Adds the specified texture to the pending bitmap batch. Consecutive
+     * bitmaps drawn with the same texture, alpha, blending mode and clip
+     * are accumulated in a single mesh and drawn with one call. A batch can
+     * only be built when the current transform is a pure translation.
+     *
+     * @param bitmap The bitmap the texture was generated from
+     * @param texture The texture to draw with
+     * @param left The x coordinate of the bitmap
+     * @param top The y coordinate of the bitmap
+     * @param paint The paint to render with
+     *
+     * @return True if the bitmap was added to the batch, false if it
+     *         must be drawn immediately
+     */
+    bool batchBitmap(SkBitmap* bitmap, Texture* texture, float left, float top,
+            SkPaint* paint);
+
+    /**
+     * Draws the quads accumulated by batchBitmap(), if any. This must be
+     * invoked before any GL state used by the batch is modified.
+     */
+    void flushBitmapBatch();
+
+    /**
+     * Prepares the line batch to receive segments drawn with the specified
+     * paint. The pending batch is drawn first if it was started with a
+     * different paint, transform or clip.
+     *
+     * @return False if the batch must be drawn as soon as the segments are
+     *         added, because they require a shader or a stencil clip
+     */
+    bool prepareLineBatch(int color, int alpha, SkXfermode::Mode mode, bool isAA);
+
+    /**
+     * Adds a quad, described as a 4 vertices triangle strip, to the line
+     * batch. prepareLineBatch() must be invoked first.
+     */
+    void batchLineQuad(const AAVertex* quad);
+
+    /**
+     * Draws the segments accumulated by drawLines(), if any. This must be
+     * invoked before any GL state used by the batch is modified.
+     */
+    void flushLineBatch();
+
     /**
      * Renders the rect defined by the specified bounds as an anti-aliased rect.
      *
@@ -460,6 +568,15 @@ private:
      */
     void drawPathTexture(const PathTexture* texture, float x, float y, SkPaint* paint);
 
+    /**
+     * Draws a path as a triangle mesh generated by PathTessellator. The
+     * path must be accepted by PathTessellator::canTessellate().
+     *
+     * @param path The path to render
+     * @param paint The paint to draw the path with
+     */
+    status_t drawPathMesh(SkPath* path, SkPaint* paint);
+
     /**
      * Resets the texture coordinates stored in mMeshVertices. Setting the values
      * back to default is achieved by calling:
@@ -535,11 +652,13 @@ private:
     void setupDrawWithExternalTexture();
     void setupDrawNoTexture();
     void setupDrawAALine();
+    void setupDrawVertexAlpha();
     void setupDrawPoint(float pointSize);
     void setupDrawColor(int color);
     void setupDrawColor(int color, int alpha);
     void setupDrawColor(float r, float g, float b, float a);
     void setupDrawAlpha8Color(int color, int alpha);
+    void setupDrawTextGamma(const SkPaint* paint);
     void setupDrawShader();
     void setupDrawColorFilter();
     void setupDrawBlending(SkXfermode::Mode mode = SkXfermode::kSrcOver_Mode,
@@ -556,6 +675,7 @@ private:
     void setupDrawPointUniforms();
     void setupDrawColorUniforms();
     void setupDrawPureColorUniforms();
+    void setupDrawTextGammaUniforms();
     void setupDrawShaderIdentityUniforms();
     void setupDrawShaderUniforms(bool ignoreTransform = false);
     void setupDrawColorFilterUniforms();
@@ -567,9 +687,13 @@ private:
     void setupDrawMesh(GLvoid* vertices, GLvoid* texCoords = NULL, GLuint vbo = 0);
     void setupDrawMeshIndices(GLvoid* vertices, GLvoid* texCoords);
     void setupDrawVertices(GLvoid* vertices);
-    void setupDrawAALine(GLvoid* vertices, GLvoid* distanceCoords, GLvoid* lengthCoords,
-            float strokeWidth, int& widthSlot, int& lengthSlot);
+    void setupDrawAALine(GLvoid* vertices, GLvoid* widthCoords, GLvoid* lengthCoords,
+            int& widthSlot, int& lengthSlot);
+    void setupDrawAAAttributes(GLvoid* widthCoords, GLvoid* lengthCoords,
+            int& widthSlot, int& lengthSlot);
     void finishDrawAALine(const int widthSlot, const int lengthSlot);
+    void setupDrawVertexAlphaMesh(GLuint vbo, int& alphaSlot);
+    void finishDrawVertexAlphaMesh(const int alphaSlot);
     void finishDrawTexture();
     void accountForClear(SkXfermode::Mode mode);
 
@@ -585,6 +709,9 @@ private:
     // Dimensions of the drawing surface
     int mWidth, mHeight;
 
+    // See getFrameTime()
+    nsecs_t mFrameTime;
+
     // Matrix used for ortho projection in shaders
     mat4 mOrthoMatrix;
 
@@ -625,6 +752,8 @@ private:
 
     // List of rectangles to clear after saveLayer() is invoked
     Vector<Rect*> mLayers;
+    // Dirty rectangles not yet merged into the region of their layer
+    DirtyRegionBuilder mDirtyRegionBuilder;
     // List of functors to invoke after a frame is drawn
     SortedVector<Functor*> mFunctors;
 
@@ -633,6 +762,8 @@ private:
 
     // Indicates whether the clip must be restored
     bool mDirtyClip;
+    // Dirty region of the current frame, used for tiled rendering
+    Rect mTilingClip;
 
     // The following fields are used to setup drawing
     // Used to describe the shaders to generate
@@ -647,6 +778,39 @@ private:
     // Track dirty regions, true by default
     bool mTrackDirtyRegions;
 
+    // Bitmaps waiting to be drawn in a single call, see batchBitmap()
+    struct BitmapBatch {
+        SkBitmap* bitmap;
+        uint32_t generation;
+        GLuint texture;
+        int alpha;
+        SkXfermode::Mode mode;
+        bool blend;
+        // Pixel-aligned clip and height of the target when the batch started
+        Rect clip;
+        int height;
+        GLsizei count;
+    } mBitmapBatch;
+    // Screen space vertices of the batched quads
+    TextureVertex mBitmapBatchMesh[BITMAP_BATCH_QUAD_COUNT * 4];
+
+    // Line segments waiting to be drawn in a single call, see drawLines().
+    // The vertices are stored in the line mesh owned by Caches
+    struct LineBatch {
+        int color;
+        int alpha;
+        SkXfermode::Mode mode;
+        bool isAA;
+        // Transform, pixel-aligned clip and height of the target when the
+        // batch started
+        mat4 transform;
+        Rect clip;
+        int height;
+        // True if the segments are clipped by the stencil
+        bool stencil;
+        GLsizei count;
+    } mLineBatch;
+
     friend class DisplayListRenderer;
 
 }; // class OpenGLRenderer
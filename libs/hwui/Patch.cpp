@@ -37,8 +37,13 @@ Patch::Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQua
     // 2 triangles per patch, 3 vertices per triangle
     uint32_t maxVertices = ((xCount + 1) * (yCount + 1) - emptyQuads) * 2 * 3;
     mVertices = new TextureVertex[maxVertices];
+    mMaxVertices = maxVertices;
     mUploaded = false;
 
+    meshBuffer = 0;
+    offset = 0;
+    mOwnsBuffer = false;
+
     verticesCount = 0;
     hasEmptyQuads = emptyQuads > 0;
 
@@ -48,15 +53,25 @@ Patch::Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQua
 
     PATCH_LOGD("    patch: xCount = %d, yCount = %d, emptyQuads = %d, max vertices = %d",
             xCount, yCount, emptyQuads, maxVertices);
-
-    glGenBuffers(1, &meshBuffer);
 }
 
 Patch::~Patch() {
     delete[] mVertices;
     delete[] mXDivs;
     delete[] mYDivs;
-    glDeleteBuffers(1, &meshBuffer);
+    if (mOwnsBuffer) {
+        glDeleteBuffers(1, &meshBuffer);
+    }
+}
+
+void Patch::setMeshBuffer(GLuint buffer, uint32_t offset) {
+    if (mOwnsBuffer) {
+        glDeleteBuffers(1, &meshBuffer);
+        mOwnsBuffer = false;
+    }
+    meshBuffer = buffer;
+    this->offset = offset;
+    mUploaded = true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -197,6 +212,11 @@ void Patch::updateVertices(const float bitmapWidth, const float bitmapHeight,
     }
 
     if (verticesCount > 0) {
+        if (!meshBuffer) {
+            glGenBuffers(1, &meshBuffer);
+            mOwnsBuffer = true;
+        }
+
         Caches& caches = Caches::getInstance();
         caches.bindMeshBuffer(meshBuffer);
         if (!mUploaded) {
@@ -204,7 +224,7 @@ void Patch::updateVertices(const float bitmapWidth, const float bitmapHeight,
                     mVertices, GL_DYNAMIC_DRAW);
             mUploaded = true;
         } else {
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
+            glBufferSubData(GL_ARRAY_BUFFER, offset,
                     sizeof(TextureVertex) * verticesCount, mVertices);
         }
         caches.resetVertexPointers();
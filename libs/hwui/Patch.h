@@ -48,6 +48,20 @@ struct Patch {
     Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQuads = 0);
     ~Patch();
 
+    /**
+     * Returns the size in bytes of the largest mesh this patch can generate.
+     */
+    uint32_t getMaxSize() const {
+        return mMaxVertices * sizeof(TextureVertex);
+    }
+
+    /**
+     * Stores the vertices of this patch in the specified range of a shared
+     * VBO. The range must be at least getMaxSize() bytes long. When no
+     * range is set, the patch allocates a VBO of its own.
+     */
+    void setMeshBuffer(GLuint buffer, uint32_t offset);
+
     void updateVertices(const float bitmapWidth, const float bitmapHeight,
             float left, float top, float right, float bottom);
 
@@ -56,13 +70,17 @@ struct Patch {
     bool matches(const int32_t* xDivs, const int32_t* yDivs, const uint32_t colorKey);
 
     GLuint meshBuffer;
+    // Offset in bytes of the vertices in meshBuffer
+    uint32_t offset;
     uint32_t verticesCount;
     bool hasEmptyQuads;
     Vector<Rect> quads;
 
 private:
     TextureVertex* mVertices;
+    uint32_t mMaxVertices;
     bool mUploaded;
+    bool mOwnsBuffer;
 
     int32_t* mXDivs;
     int32_t* mYDivs;
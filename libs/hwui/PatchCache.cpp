@@ -18,6 +18,7 @@
 
 #include <utils/Log.h>
 
+#include "Caches.h"
 #include "PatchCache.h"
 #include "Properties.h"
 
@@ -28,14 +29,148 @@ namespace uirenderer {
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
 
-PatchCache::PatchCache(): mMaxEntries(DEFAULT_PATCH_CACHE_SIZE) {
+PatchCache::PatchCache(): mMaxEntries(DEFAULT_PATCH_CACHE_SIZE),
+        mCache(DEFAULT_PATCH_CACHE_SIZE), mListener(this) {
+    initBuffer();
 }
 
-PatchCache::PatchCache(uint32_t maxEntries): mMaxEntries(maxEntries) {
+PatchCache::PatchCache(uint32_t maxEntries): mMaxEntries(maxEntries),
+        mCache(maxEntries), mListener(this) {
+    initBuffer();
 }
 
 PatchCache::~PatchCache() {
-    clear();
+    mCache.clear();
+    clearBuffer();
+}
+
+void PatchCache::initBuffer() {
+    mCache.setOnEntryRemovedListener(&mListener);
+
+    mMeshBuffer = 0;
+    mBufferSize = DEFAULT_PATCH_CACHE_BUFFER_SIZE;
+    mBufferUsage = 0;
+    mFreeBlocks = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared buffer
+///////////////////////////////////////////////////////////////////////////////
+
+void PatchCache::PatchRemovedListener::operator()(PatchDescription& description, Patch*& mesh) {
+    if (mesh) {
+        if (mesh->meshBuffer && mesh->meshBuffer == mPatchCache->mMeshBuffer) {
+            mPatchCache->freeBlock(mesh->offset, mesh->getMaxSize());
+        }
+        delete mesh;
+    }
+}
+
+void PatchCache::clearBuffer() {
+    BufferBlock* block = mFreeBlocks;
+    while (block) {
+        BufferBlock* next = block->next;
+        delete block;
+        block = next;
+    }
+    mFreeBlocks = NULL;
+
+    if (mMeshBuffer) {
+        glDeleteBuffers(1, &mMeshBuffer);
+        mMeshBuffer = 0;
+    }
+    mBufferUsage = 0;
+}
+
+bool PatchCache::allocateBlock(uint32_t size, uint32_t& offset) {
+    BufferBlock* previous = NULL;
+    BufferBlock* block = mFreeBlocks;
+
+    // First fit
+    while (block && block->size < size) {
+        previous = block;
+        block = block->next;
+    }
+    if (!block) return false;
+
+    offset = block->offset;
+    if (block->size == size) {
+        if (previous) {
+            previous->next = block->next;
+        } else {
+            mFreeBlocks = block->next;
+        }
+        delete block;
+    } else {
+        block->offset += size;
+        block->size -= size;
+    }
+
+    mBufferUsage += size;
+    return true;
+}
+
+void PatchCache::freeBlock(uint32_t offset, uint32_t size) {
+    BufferBlock* previous = NULL;
+    BufferBlock* next = mFreeBlocks;
+    while (next && next->offset < offset) {
+        previous = next;
+        next = next->next;
+    }
+
+    mBufferUsage -= size;
+
+    // Coalesce with the neighbouring free blocks
+    if (previous && previous->offset + previous->size == offset) {
+        previous->size += size;
+        if (next && previous->offset + previous->size == next->offset) {
+            previous->size += next->size;
+            previous->next = next->next;
+            delete next;
+        }
+        return;
+    }
+
+    if (next && offset + size == next->offset) {
+        next->offset = offset;
+        next->size += size;
+        return;
+    }
+
+    BufferBlock* block = new BufferBlock(offset, size);
+    block->next = next;
+    if (previous) {
+        previous->next = block;
+    } else {
+        mFreeBlocks = block;
+    }
+}
+
+void PatchCache::allocateBuffer(Patch* mesh) {
+    const uint32_t size = mesh->getMaxSize();
+    if (size == 0 || size > mBufferSize) return;
+
+    if (!mMeshBuffer) {
+        glGenBuffers(1, &mMeshBuffer);
+        Caches::getInstance().bindMeshBuffer(mMeshBuffer);
+        glBufferData(GL_ARRAY_BUFFER, mBufferSize, NULL, GL_DYNAMIC_DRAW);
+
+        mFreeBlocks = new BufferBlock(0, mBufferSize);
+        mBufferUsage = 0;
+    }
+
+    uint32_t offset;
+    bool allocated = allocateBlock(size, offset);
+    while (!allocated && mCache.size() > 0) {
+        PATCH_LOGD("Patch mesh buffer full, evicting oldest mesh");
+        mCache.removeOldest();
+        allocated = allocateBlock(size, offset);
+    }
+
+    // If the buffer is too fragmented the mesh simply keeps its own VBO
+    if (allocated) {
+        mesh->setMeshBuffer(mMeshBuffer, offset);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -43,11 +178,13 @@ PatchCache::~PatchCache() {
 ///////////////////////////////////////////////////////////////////////////////
 
 void PatchCache::clear() {
-    size_t count = mCache.size();
-    for (size_t i = 0; i < count; i++) {
-        delete mCache.valueAt(i);
-    }
     mCache.clear();
+
+    // Deleting the buffer unbinds it, make sure the caches know about it
+    if (mMeshBuffer) {
+        Caches::getInstance().unbindMeshBuffer();
+    }
+    clearBuffer();
 }
 
 Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
@@ -75,13 +212,11 @@ Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
     const PatchDescription description(bitmapWidth, bitmapHeight,
             pixelWidth, pixelHeight, width, height, transparentQuads, colorKey);
 
-    ssize_t index = mCache.indexOfKey(description);
-    Patch* mesh = NULL;
-    if (index >= 0) {
-        mesh = mCache.valueAt(index);
-    }
+    Patch* mesh = mCache.get(description);
 
     if (!mesh) {
+        stats.miss();
+
         PATCH_LOGD("New patch mesh "
                 "xCount=%d yCount=%d, w=%.2f h=%.2f, bw=%.2f bh=%.2f",
                 width, height, pixelWidth, pixelHeight, bitmapWidth, bitmapHeight);
@@ -89,17 +224,22 @@ Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
         mesh = new Patch(width, height, transparentQuads);
         mesh->updateColorKey(colorKey);
         mesh->copy(xDivs, yDivs);
-        mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
 
         if (mCache.size() >= mMaxEntries) {
-            delete mCache.valueAt(mCache.size() - 1);
-            mCache.removeItemsAt(mCache.size() - 1, 1);
+            mCache.removeOldest();
         }
 
-        mCache.add(description, mesh);
+        allocateBuffer(mesh);
+        mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
+
+        mCache.put(description, mesh);
     } else if (!mesh->matches(xDivs, yDivs, colorKey)) {
+        stats.miss();
+
         PATCH_LOGD("Patch mesh does not match, refreshing vertices");
         mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
+    } else {
+        stats.hit();
     }
 
     return mesh;
@@ -17,11 +17,13 @@
 #ifndef ANDROID_HWUI_PATCH_CACHE_H
 #define ANDROID_HWUI_PATCH_CACHE_H
 
-#include <utils/KeyedVector.h>
+#include <GLES2/gl2.h>
 
 #include "utils/Compare.h"
+#include "utils/GenerationCache.h"
 #include "Debug.h"
 #include "Patch.h"
+#include "RenderStats.h"
 
 namespace android {
 namespace uirenderer {
@@ -41,6 +43,11 @@ namespace uirenderer {
 // Cache
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Caches the meshes of 9-patches, evicting the least recently used meshes
+ * first. The vertices of all the meshes are stored in a single VBO, each
+ * mesh being assigned a range of the buffer for its lifetime.
+ */
 class PatchCache {
 public:
     PatchCache();
@@ -61,7 +68,42 @@ public:
         return mMaxEntries;
     }
 
+    /**
+     * Returns the number of bytes of the shared VBO currently in use.
+     */
+    uint32_t getBufferUsage() const {
+        return mBufferUsage;
+    }
+
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 private:
+    /**
+     * Range of the shared VBO, kept in a list sorted by offset.
+     */
+    struct BufferBlock {
+        BufferBlock(uint32_t offset, uint32_t size): offset(offset), size(size), next(NULL) {
+        }
+
+        uint32_t offset;
+        uint32_t size;
+        BufferBlock* next;
+    };
+
+    void initBuffer();
+    void clearBuffer();
+
+    /**
+     * Assigns a range of the shared VBO to the specified mesh, evicting
+     * old meshes when the buffer is full.
+     */
+    void allocateBuffer(Patch* mesh);
+    bool allocateBlock(uint32_t size, uint32_t& offset);
+    void freeBlock(uint32_t offset, uint32_t size);
+
     /**
      * Description of a patch.
      */
@@ -111,8 +153,26 @@ private:
 
     }; // struct PatchDescription
 
+    class PatchRemovedListener: public OnEntryRemoved<PatchDescription, Patch*> {
+    public:
+        PatchRemovedListener(PatchCache* cache): mPatchCache(cache) {
+        }
+
+        void operator()(PatchDescription& description, Patch*& mesh);
+
+    private:
+        PatchCache* mPatchCache;
+    };
+
     uint32_t mMaxEntries;
-    KeyedVector<PatchDescription, Patch*> mCache;
+    GenerationCache<PatchDescription, Patch*> mCache;
+    PatchRemovedListener mListener;
+
+    GLuint mMeshBuffer;
+    uint32_t mBufferSize;
+    uint32_t mBufferUsage;
+    // Free ranges of the shared VBO
+    BufferBlock* mFreeBlocks;
 
 }; // class PatchCache
 
@@ -18,7 +18,9 @@
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "PathCache.h"
+#include "PathTessellator.h"
 #include "Properties.h"
 
 namespace android {
@@ -51,7 +53,54 @@ void computeBounds(const SkRect& bounds, const SkPaint* paint,
 ///////////////////////////////////////////////////////////////////////////////
 
 PathCache::PathCache(): ShapeCache<PathCacheEntry>("path",
-        PROPERTY_PATH_CACHE_SIZE, DEFAULT_PATH_CACHE_SIZE) {
+        PROPERTY_PATH_CACHE_SIZE, DEFAULT_PATH_CACHE_SIZE),
+        mMeshCache(GenerationCache<PathMeshCacheEntry, PathMesh*>::kUnlimitedCapacity),
+        mMeshSize(0), mMaxMeshSize(MB(DEFAULT_PATH_MESH_CACHE_SIZE)) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_PATH_MESH_CACHE_SIZE, property, NULL) > 0) {
+        INIT_LOGD("  Setting path mesh cache size to %sMB", property);
+        mMaxMeshSize = MB(atof(property));
+    } else {
+        INIT_LOGD("  Using default path mesh cache size of %.2fMB", DEFAULT_PATH_MESH_CACHE_SIZE);
+    }
+
+    mMeshCache.setOnEntryRemovedListener(this);
+}
+
+PathCache::~PathCache() {
+    mMeshCache.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Callbacks
+///////////////////////////////////////////////////////////////////////////////
+
+void PathCache::operator()(PathMeshCacheEntry& entry, PathMesh*& mesh) {
+    removeMesh(mesh);
+}
+
+void PathCache::removeMesh(PathMesh* mesh) {
+    if (mesh) {
+        const uint32_t size = mesh->vertexCount * sizeof(AlphaVertex);
+        mMeshSize -= size;
+
+        SHAPE_LOGD("PathCache::callback: delete mesh: buffer, size, mMeshSize = %d, %d, %d",
+                mesh->buffer, size, mMeshSize);
+        if (mDebugEnabled) {
+            ALOGD("Path mesh deleted, size = %d", size);
+        }
+
+        delete mesh;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Caching
+///////////////////////////////////////////////////////////////////////////////
+
+void PathCache::clear() {
+    ShapeCache<PathCacheEntry>::clear();
+    mMeshCache.clear();
 }
 
 void PathCache::remove(SkPath* path) {
@@ -71,6 +120,20 @@ void PathCache::remove(SkPath* path) {
         mCache.removeAt(pathsToRemove.itemAt(i) - i);
     }
     mCache.setOnEntryRemovedListener(this);
+
+    Vector<size_t> meshesToRemove;
+    for (size_t i = 0; i < mMeshCache.size(); i++) {
+        if (mMeshCache.getKeyAt(i).path == path) {
+            meshesToRemove.push(i);
+            removeMesh(mMeshCache.getValueAt(i));
+        }
+    }
+
+    mMeshCache.setOnEntryRemovedListener(NULL);
+    for (size_t i = 0; i < meshesToRemove.size(); i++) {
+        mMeshCache.removeAt(meshesToRemove.itemAt(i) - i);
+    }
+    mMeshCache.setOnEntryRemovedListener(this);
 }
 
 void PathCache::removeDeferred(SkPath* path) {
@@ -100,14 +163,81 @@ PathTexture* PathCache::get(SkPath* path, SkPaint* paint) {
     uint32_t width, height;
 
     if (!texture) {
+        stats.miss();
         texture = addTexture(entry, path, paint);
     } else if (path->getGenerationID() != texture->generation) {
+        stats.miss();
         mCache.remove(entry);
         texture = addTexture(entry, path, paint);
+    } else {
+        stats.hit();
     }
 
     return texture;
 }
 
+PathMesh* PathCache::getMesh(SkPath* path, SkPaint* paint,
+        float inverseScaleX, float inverseScaleY) {
+    const SkPath* sourcePath = path->getSourcePath();
+    if (sourcePath && sourcePath->getGenerationID() == path->getGenerationID()) {
+        path = const_cast<SkPath*>(sourcePath);
+    }
+
+    PathMeshCacheEntry entry(path, paint, inverseScaleX, inverseScaleY);
+    PathMesh* mesh = mMeshCache.get(entry);
+
+    if (!mesh) {
+        meshStats.miss();
+        mesh = addMesh(entry, path, paint, inverseScaleX, inverseScaleY);
+    } else if (path->getGenerationID() != mesh->generation) {
+        meshStats.miss();
+        mMeshCache.remove(entry);
+        mesh = addMesh(entry, path, paint, inverseScaleX, inverseScaleY);
+    } else {
+        meshStats.hit();
+    }
+
+    return mesh;
+}
+
+PathMesh* PathCache::addMesh(const PathMeshCacheEntry& entry, SkPath* path, SkPaint* paint,
+        float inverseScaleX, float inverseScaleY) {
+    Vector<AlphaVertex> vertices;
+    Rect bounds;
+    PathTessellator::tessellate(path, paint, inverseScaleX, inverseScaleY, vertices, bounds);
+    if (vertices.isEmpty()) return NULL;
+
+    PathMesh* mesh = new PathMesh;
+    mesh->vertexCount = vertices.size();
+    mesh->generation = path->getGenerationID();
+    mesh->bounds.set(bounds);
+
+    const uint32_t size = mesh->vertexCount * sizeof(AlphaVertex);
+
+    glGenBuffers(1, &mesh->buffer);
+    Caches::getInstance().bindMeshBuffer(mesh->buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, vertices.array(), GL_STATIC_DRAW);
+
+    // Don't even try to cache a mesh that's bigger than the cache
+    if (size < mMaxMeshSize) {
+        while (mMeshSize + size > mMaxMeshSize) {
+            mMeshCache.removeOldest();
+        }
+        mMeshSize += size;
+
+        SHAPE_LOGD("PathCache::getMesh: create mesh: buffer, size, mMeshSize = %d, %d, %d",
+                mesh->buffer, size, mMeshSize);
+        if (mDebugEnabled) {
+            ALOGD("Path mesh created, size = %d", size);
+        }
+
+        mMeshCache.put(entry, mesh);
+    } else {
+        mesh->cleanup = true;
+    }
+
+    return mesh;
+}
+
 }; // namespace uirenderer
 }; // namespace android
@@ -20,6 +20,7 @@
 #include <utils/Vector.h>
 
 #include "Debug.h"
+#include "Rect.h"
 #include "ShapeCache.h"
 
 #include "utils/Compare.h"
@@ -53,20 +54,106 @@ struct PathCacheEntry: public ShapeCacheEntry {
 
 }; // PathCacheEntry
 
+/**
+ * Describes a path tessellated for a given scale. Meshes are cached
+ * separately from the textures of the paths that cannot be tessellated.
+ */
+struct PathMeshCacheEntry: public PathCacheEntry {
+    PathMeshCacheEntry(SkPath* path, SkPaint* paint, float inverseScaleX, float inverseScaleY):
+            PathCacheEntry(path, paint) {
+        antiAlias = paint->isAntiAlias();
+        this->inverseScaleX = inverseScaleX;
+        this->inverseScaleY = inverseScaleY;
+    }
+
+    PathMeshCacheEntry(): PathCacheEntry() {
+        antiAlias = false;
+        inverseScaleX = 1.0f;
+        inverseScaleY = 1.0f;
+    }
+
+    bool lessThan(const ShapeCacheEntry& r) const {
+        const PathMeshCacheEntry& rhs = (const PathMeshCacheEntry&) r;
+        LTE_INT(path) {
+            LTE_INT(antiAlias) {
+                LTE_FLOAT(inverseScaleX) {
+                    LTE_FLOAT(inverseScaleY) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    bool antiAlias;
+    float inverseScaleX;
+    float inverseScaleY;
+
+}; // PathMeshCacheEntry
+
+/**
+ * Triangles generated by PathTessellator, stored in a VBO. Each vertex
+ * is an AlphaVertex.
+ */
+struct PathMesh {
+    PathMesh(): buffer(0), vertexCount(0), generation(0), cleanup(false) {
+    }
+
+    ~PathMesh() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+    }
+
+    GLuint buffer;
+    uint32_t vertexCount;
+    /**
+     * Generation of the path this mesh was generated from.
+     */
+    uint32_t generation;
+    /**
+     * Bounds of the mesh, in the coordinate space of the path.
+     */
+    Rect bounds;
+    /**
+     * Indicates whether this mesh should be deleted after being drawn
+     * because it could not be added to the cache.
+     */
+    bool cleanup;
+}; // struct PathMesh
+
 /**
  * A simple LRU path cache. The cache has a maximum size expressed in bytes.
  * Any texture added to the cache causing the cache to grow beyond the maximum
  * allowed size will also cause the oldest texture to be kicked out.
  */
-class PathCache: public ShapeCache<PathCacheEntry> {
+class PathCache: public ShapeCache<PathCacheEntry>,
+        public OnEntryRemoved<PathMeshCacheEntry, PathMesh*> {
 public:
     PathCache();
+    ~PathCache();
+
+    /**
+     * Used as a callback when a mesh is removed from the cache.
+     * Do not invoke directly.
+     */
+    void operator()(PathMeshCacheEntry& entry, PathMesh*& mesh);
 
     /**
      * Returns the texture associated with the specified path. If the texture
      * cannot be found in the cache, a new texture is generated.
      */
     PathTexture* get(SkPath* path, SkPaint* paint);
+    /**
+     * Returns the mesh associated with the specified path, tessellated for
+     * a pixel of the specified size. If the mesh cannot be found in the
+     * cache, a new mesh is generated. Returns NULL if the path is empty.
+     * The path must be accepted by PathTessellator::canTessellate().
+     */
+    PathMesh* getMesh(SkPath* path, SkPaint* paint, float inverseScaleX, float inverseScaleY);
+    /**
+     * Clears the cache. This causes all textures and meshes to be deleted.
+     */
+    void clear();
     /**
      * Removes an entry.
      */
@@ -81,7 +168,33 @@ public:
      */
     void clearGarbage();
 
+    /**
+     * Returns the current size of the meshes cache in bytes.
+     */
+    uint32_t getMeshSize() const {
+        return mMeshSize;
+    }
+    /**
+     * Returns the maximum size of the meshes cache in bytes.
+     */
+    uint32_t getMaxMeshSize() const {
+        return mMaxMeshSize;
+    }
+
+    /**
+     * Lookups served by the meshes cache.
+     */
+    CacheStats meshStats;
+
 private:
+    PathMesh* addMesh(const PathMeshCacheEntry& entry, SkPath* path, SkPaint* paint,
+            float inverseScaleX, float inverseScaleY);
+    void removeMesh(PathMesh* mesh);
+
+    GenerationCache<PathMeshCacheEntry, PathMesh*> mMeshCache;
+    uint32_t mMeshSize;
+    uint32_t mMaxMeshSize;
+
     Vector<SkPath*> mGarbage;
     mutable Mutex mLock;
 }; // class PathCache
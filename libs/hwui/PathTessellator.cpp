@@ -0,0 +1,455 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <math.h>
+
+#include <utils/Log.h>
+
+#include "PathTessellator.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Maximum distance, in pixels, between a curve and the segments approximating it
+#define CURVE_TOLERANCE 0.25f
+#define MAX_CURVE_SEGMENTS 64
+
+#define MIN_ROUND_CAP_SEGMENTS 4
+#define MAX_ROUND_CAP_SEGMENTS 32
+
+// Limits the length of the offsets computed for very sharp corners of fills
+#define MAX_FILL_MITER 4.0f
+
+///////////////////////////////////////////////////////////////////////////////
+// Utilities
+///////////////////////////////////////////////////////////////////////////////
+
+static inline vec2 scaled(const vec2& v, const vec2& pixel) {
+    return vec2(v.x * pixel.x, v.y * pixel.y);
+}
+
+static inline vec2 normal(const vec2& v) {
+    vec2 n(v.y, -v.x);
+    const float length = n.length();
+    if (length > 0.0f) n /= length;
+    return n;
+}
+
+/**
+ * Returns the offset to apply to the point cur so that both edges meeting
+ * at cur move by one unit along their normals. The length of the offset is
+ * limited to maxMiter.
+ */
+static vec2 computeMiter(const vec2& prev, const vec2& cur, const vec2& next,
+        float sign, float maxMiter) {
+    const vec2 n1 = normal(cur - prev) * sign;
+    const vec2 n2 = normal(next - cur) * sign;
+
+    vec2 miter = n1 + n2;
+    const float cosine = n1.dot(n2);
+    // The length of the miter is sqrt(2 / (1 + cosine))
+    const float minDenominator = 2.0f / (maxMiter * maxMiter);
+    miter /= fmax(1.0f + cosine, minDenominator);
+
+    return miter;
+}
+
+static inline uint32_t computeSegmentCount(const vec2& deviation, const vec2& pixel) {
+    const float distance = vec2(deviation.x / pixel.x, deviation.y / pixel.y).length();
+    const float count = ceilf(sqrtf(distance / CURVE_TOLERANCE));
+    if (count < 1.0f) return 1;
+    if (count > MAX_CURVE_SEGMENTS) return MAX_CURVE_SEGMENTS;
+    return (uint32_t) count;
+}
+
+static inline void addPoint(Vector<vec2>& points, size_t start, float x, float y) {
+    // Skip degenerate segments
+    if (points.size() > start) {
+        const vec2& last = points.top();
+        if (last.x == x && last.y == y) return;
+    }
+    points.push(vec2(x, y));
+}
+
+static inline void addVertex(Vector<AlphaVertex>& vertices, const vec2& p, float alpha) {
+    AlphaVertex vertex;
+    AlphaVertex::set(&vertex, p.x, p.y, alpha);
+    vertices.push(vertex);
+}
+
+static inline void addTriangle(Vector<AlphaVertex>& vertices,
+        const vec2& a, float alphaA, const vec2& b, float alphaB, const vec2& c, float alphaC) {
+    addVertex(vertices, a, alphaA);
+    addVertex(vertices, b, alphaB);
+    addVertex(vertices, c, alphaC);
+}
+
+/**
+ * Adds the two triangles joining the segment a0-a1 to the segment b0-b1.
+ */
+static inline void addQuad(Vector<AlphaVertex>& vertices,
+        const vec2& a0, float alphaA0, const vec2& a1, float alphaA1,
+        const vec2& b0, float alphaB0, const vec2& b1, float alphaB1) {
+    addTriangle(vertices, a0, alphaA0, a1, alphaA1, b0, alphaB0);
+    addTriangle(vertices, a1, alphaA1, b1, alphaB1, b0, alphaB0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tessellation
+///////////////////////////////////////////////////////////////////////////////
+
+bool PathTessellator::canTessellate(const SkPath* path, const SkPaint* paint) {
+    if (paint->getPathEffect() || path->isInverseFillType()) {
+        return false;
+    }
+
+    switch (paint->getStyle()) {
+        case SkPaint::kFill_Style:
+            return path->isConvex();
+        case SkPaint::kStroke_Style:
+            return paint->getStrokeJoin() != SkPaint::kRound_Join;
+        default:
+            return false;
+    }
+}
+
+void PathTessellator::tessellate(const SkPath* path, const SkPaint* paint,
+        float inverseScaleX, float inverseScaleY,
+        Vector<AlphaVertex>& vertices, Rect& bounds) {
+    const vec2 pixel(inverseScaleX, inverseScaleY);
+
+    Vector<vec2> points;
+    Vector<Contour> contours;
+    flatten(path, inverseScaleX, inverseScaleY, points, contours);
+
+    const bool isFill = paint->getStyle() == SkPaint::kFill_Style;
+    for (size_t i = 0; i < contours.size(); i++) {
+        const Contour& contour = contours[i];
+        if (isFill) {
+            tessellateFill(points.array() + contour.start, contour.count,
+                    paint->isAntiAlias(), pixel, vertices);
+        } else {
+            tessellateStroke(points.array() + contour.start, contour.count,
+                    contour.closed, paint, pixel, vertices);
+        }
+    }
+
+    bounds.setEmpty();
+    if (vertices.isEmpty()) return;
+
+    bounds.set(vertices[0].position[0], vertices[0].position[1],
+            vertices[0].position[0], vertices[0].position[1]);
+    for (size_t i = 1; i < vertices.size(); i++) {
+        const float x = vertices[i].position[0];
+        const float y = vertices[i].position[1];
+        if (x < bounds.left) bounds.left = x;
+        if (x > bounds.right) bounds.right = x;
+        if (y < bounds.top) bounds.top = y;
+        if (y > bounds.bottom) bounds.bottom = y;
+    }
+}
+
+void PathTessellator::flatten(const SkPath* path, float inverseScaleX, float inverseScaleY,
+        Vector<vec2>& points, Vector<Contour>& contours) {
+    const vec2 pixel(inverseScaleX, inverseScaleY);
+
+    SkPath::Iter iter(*path, false);
+    SkPoint pts[4];
+    SkPath::Verb verb;
+
+    size_t start = 0;
+    while ((verb = iter.next(pts)) != SkPath::kDone_Verb) {
+        switch (verb) {
+            case SkPath::kMove_Verb:
+                addContour(points, contours, start, false);
+                start = points.size();
+                addPoint(points, start, pts[0].fX, pts[0].fY);
+                break;
+            case SkPath::kLine_Verb:
+                addPoint(points, start, pts[1].fX, pts[1].fY);
+                break;
+            case SkPath::kQuad_Verb: {
+                const vec2 p0(pts[0].fX, pts[0].fY);
+                const vec2 p1(pts[1].fX, pts[1].fY);
+                const vec2 p2(pts[2].fX, pts[2].fY);
+                const uint32_t count = computeSegmentCount((p0 - p1 * 2.0f + p2) * 0.25f, pixel);
+                for (uint32_t i = 1; i <= count; i++) {
+                    const float t = i / (float) count;
+                    const float u = 1.0f - t;
+                    const vec2 p = p0 * (u * u) + p1 * (2.0f * u * t) + p2 * (t * t);
+                    addPoint(points, start, p.x, p.y);
+                }
+                break;
+            }
+            case SkPath::kCubic_Verb: {
+                const vec2 p0(pts[0].fX, pts[0].fY);
+                const vec2 p1(pts[1].fX, pts[1].fY);
+                const vec2 p2(pts[2].fX, pts[2].fY);
+                const vec2 p3(pts[3].fX, pts[3].fY);
+                const vec2 d1 = p0 - p1 * 2.0f + p2;
+                const vec2 d2 = p1 - p2 * 2.0f + p3;
+                const vec2& d = d1.length() > d2.length() ? d1 : d2;
+                const uint32_t count = computeSegmentCount(d * 0.75f, pixel);
+                for (uint32_t i = 1; i <= count; i++) {
+                    const float t = i / (float) count;
+                    const float u = 1.0f - t;
+                    const vec2 p = p0 * (u * u * u) + p1 * (3.0f * u * u * t) +
+                            p2 * (3.0f * u * t * t) + p3 * (t * t * t);
+                    addPoint(points, start, p.x, p.y);
+                }
+                break;
+            }
+            case SkPath::kClose_Verb:
+                addContour(points, contours, start, true);
+                start = points.size();
+                break;
+            default:
+                break;
+        }
+    }
+    addContour(points, contours, start, false);
+}
+
+void PathTessellator::addContour(Vector<vec2>& points, Vector<Contour>& contours,
+        size_t start, bool closed) {
+    if (closed && points.size() > start + 1) {
+        const vec2& first = points[start];
+        const vec2& last = points.top();
+        if (first.x == last.x && first.y == last.y) {
+            points.pop();
+        }
+    }
+
+    const size_t count = points.size() - start;
+    if (count < 2) {
+        while (points.size() > start) {
+            points.pop();
+        }
+        return;
+    }
+
+    Contour contour;
+    contour.start = start;
+    contour.count = count;
+    contour.closed = closed && count > 2;
+    contours.push(contour);
+}
+
+void PathTessellator::tessellateFill(const vec2* points, size_t count, bool isAA,
+        const vec2& pixel, Vector<AlphaVertex>& vertices) {
+    if (count < 3) return;
+
+    // The orientation of the contour tells which side of the edges is outside
+    float area = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        const vec2& a = points[i];
+        const vec2& b = points[(i + 1) % count];
+        area += a.x * b.y - b.x * a.y;
+    }
+    if (area == 0.0f) return;
+
+    if (!isAA) {
+        for (size_t i = 1; i + 1 < count; i++) {
+            addTriangle(vertices, points[0], 1.0f, points[i], 1.0f, points[i + 1], 1.0f);
+        }
+        return;
+    }
+
+    // Move each vertex half a pixel inside and outside the shape, the
+    // fringe between the two outlines fades from opaque to transparent
+    const float sign = area > 0.0f ? 1.0f : -1.0f;
+    Vector<vec2> inner;
+    Vector<vec2> outer;
+    inner.setCapacity(count);
+    outer.setCapacity(count);
+
+    for (size_t i = 0; i < count; i++) {
+        const vec2& prev = points[(i + count - 1) % count];
+        const vec2& cur = points[i];
+        const vec2& next = points[(i + 1) % count];
+
+        const vec2 miter = computeMiter(prev, cur, next, sign, MAX_FILL_MITER);
+        const vec2 offset = scaled(miter, pixel) * 0.5f;
+        inner.push(cur - offset);
+        outer.push(cur + offset);
+    }
+
+    for (size_t i = 1; i + 1 < count; i++) {
+        addTriangle(vertices, inner[0], 1.0f, inner[i], 1.0f, inner[i + 1], 1.0f);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const size_t j = (i + 1) % count;
+        addQuad(vertices, inner[i], 1.0f, inner[j], 1.0f, outer[i], 0.0f, outer[j], 0.0f);
+    }
+}
+
+void PathTessellator::tessellateStroke(const vec2* points, size_t count, bool closed,
+        const SkPaint* paint, const vec2& pixel, Vector<AlphaVertex>& vertices) {
+    const bool isAA = paint->isAntiAlias();
+    const SkPaint::Cap cap = closed ? SkPaint::kButt_Cap : paint->getStrokeCap();
+    const float maxMiter = paint->getStrokeJoin() == SkPaint::kMiter_Join ?
+            fmax(paint->getStrokeMiter(), 1.0f) : 1.0f;
+
+    // Hairlines are one pixel wide whatever the transform
+    const bool isHairline = paint->getStrokeWidth() == 0.0f;
+    const float halfWidth = paint->getStrokeWidth() * 0.5f;
+    const float pixelSize = (pixel.x + pixel.y) * 0.5f;
+    const float deviceHalfWidth = isHairline ? 0.5f : halfWidth / pixelSize;
+
+    // Strokes thinner than a pixel are drawn one pixel wide, fading out from
+    // the center, with an alpha proportional to their width
+    const bool isThin = isAA && deviceHalfWidth <= 0.5f;
+    const float alpha = isThin ? deviceHalfWidth * 2.0f : 1.0f;
+
+    Vector<vec2> path;
+    path.setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        path.push(points[i]);
+    }
+
+    const vec2 startDirection = (path[0] - path[1]).copyNormalized();
+    const vec2 endDirection = (path[count - 1] - path[count - 2]).copyNormalized();
+    if (cap == SkPaint::kSquare_Cap) {
+        path.editItemAt(0) += isHairline ?
+                scaled(startDirection, pixel) * 0.5f : startDirection * halfWidth;
+        path.editItemAt(count - 1) += isHairline ?
+                scaled(endDirection, pixel) * 0.5f : endDirection * halfWidth;
+    }
+
+    // Each point of the polyline is replaced by 4 rows of vertices: the outer
+    // and inner edges of the AA fringe on the left, then on the right
+    Vector<vec2> rows;
+    rows.setCapacity(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        const vec2& cur = path[i];
+        vec2 n;
+        if (closed || (i > 0 && i < count - 1)) {
+            const vec2& prev = path[(i + count - 1) % count];
+            const vec2& next = path[(i + 1) % count];
+            n = computeMiter(prev, cur, next, 1.0f, maxMiter);
+        } else if (i == 0) {
+            n = normal(path[1] - path[0]);
+        } else {
+            n = normal(path[i] - path[i - 1]);
+        }
+
+        const vec2 body = isHairline ? scaled(n, pixel) * 0.5f : n * halfWidth;
+        const vec2 fringe = scaled(n, pixel) * 0.5f;
+        if (!isAA) {
+            rows.push(cur + body);
+            rows.push(cur + body);
+            rows.push(cur - body);
+            rows.push(cur - body);
+        } else if (isThin) {
+            rows.push(cur + fringe * 2.0f);
+            rows.push(cur);
+            rows.push(cur);
+            rows.push(cur - fringe * 2.0f);
+        } else {
+            rows.push(cur + body + fringe);
+            rows.push(cur + body - fringe);
+            rows.push(cur - body + fringe);
+            rows.push(cur - body - fringe);
+        }
+    }
+
+    const size_t segments = closed ? count : count - 1;
+    for (size_t i = 0; i < segments; i++) {
+        const vec2* a = &rows[i * 4];
+        const vec2* b = &rows[((i + 1) % count) * 4];
+        if (isAA) {
+            addQuad(vertices, a[0], 0.0f, b[0], 0.0f, a[1], alpha, b[1], alpha);
+            addQuad(vertices, a[2], alpha, b[2], alpha, a[3], 0.0f, b[3], 0.0f);
+        }
+        if (!isThin) {
+            addQuad(vertices, a[1], alpha, b[1], alpha, a[2], alpha, b[2], alpha);
+        }
+    }
+
+    if (closed) return;
+
+    if (cap == SkPaint::kRound_Cap && !isThin) {
+        tessellateRoundCap(path[0], startDirection, normal(path[1] - path[0]), halfWidth,
+                isHairline, isAA, pixel, vertices);
+        tessellateRoundCap(path[count - 1], endDirection, normal(path[count - 1] - path[count - 2]),
+                halfWidth, isHairline, isAA, pixel, vertices);
+    } else if (isAA) {
+        // Fade out the ends of the stroke over half a pixel
+        const vec2* ends[2] = { &rows[0], &rows[(count - 1) * 4] };
+        const vec2 directions[2] = { startDirection, endDirection };
+        for (int i = 0; i < 2; i++) {
+            const vec2* row = ends[i];
+            const vec2 fringe = scaled(directions[i], pixel) * 0.5f;
+            for (int j = 0; j < 3; j++) {
+                if (j == 1 && isThin) continue;
+                const float alpha0 = j == 0 ? 0.0f : alpha;
+                const float alpha1 = j == 2 ? 0.0f : alpha;
+                addQuad(vertices, row[j], alpha0, row[j + 1], alpha1,
+                        row[j] + fringe, 0.0f, row[j + 1] + fringe, 0.0f);
+            }
+        }
+    }
+}
+
+void PathTessellator::tessellateRoundCap(const vec2& center, const vec2& direction,
+        const vec2& n, float halfWidth, bool isHairline, bool isAA, const vec2& pixel,
+        Vector<AlphaVertex>& vertices) {
+    const float pixelSize = (pixel.x + pixel.y) * 0.5f;
+    const float deviceRadius = isHairline ? 0.5f : halfWidth / pixelSize;
+
+    // Pick enough segments to keep the error of the arc within the tolerance
+    uint32_t segments = MIN_ROUND_CAP_SEGMENTS;
+    if (deviceRadius > CURVE_TOLERANCE) {
+        const float step = acosf(1.0f - CURVE_TOLERANCE / deviceRadius);
+        segments = (uint32_t) fmin(fmax(ceilf(M_PI / step), MIN_ROUND_CAP_SEGMENTS),
+                MAX_ROUND_CAP_SEGMENTS);
+    }
+
+    // The arc goes from the left edge of the stroke to its right edge
+    // through the point of the cap furthest from the center
+    vec2 previousInner;
+    vec2 previousOuter;
+    for (uint32_t i = 0; i <= segments; i++) {
+        const float theta = M_PI * i / (float) segments;
+        const vec2 v = n * cosf(theta) + direction * sinf(theta);
+
+        const vec2 body = isHairline ? scaled(v, pixel) * 0.5f : v * halfWidth;
+        const vec2 fringe = scaled(v, pixel) * 0.5f;
+        const vec2 inner = isAA ? center + body - fringe : center + body;
+        const vec2 outer = center + body + fringe;
+
+        if (i > 0) {
+            addTriangle(vertices, center, 1.0f, previousInner, 1.0f, inner, 1.0f);
+            if (isAA) {
+                addQuad(vertices, previousInner, 1.0f, inner, 1.0f,
+                        previousOuter, 0.0f, outer, 0.0f);
+            }
+        }
+
+        previousInner = inner;
+        previousOuter = outer;
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_PATH_TESSELLATOR_H
+#define ANDROID_HWUI_PATH_TESSELLATOR_H
+
+#include <utils/Vector.h>
+
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include "Rect.h"
+#include "Vector.h"
+#include "Vertex.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Converts paths into lists of triangles that can be drawn directly, without
+ * rasterizing the path into an alpha texture first. Anti-aliased paths are
+ * surrounded by a fringe, one pixel wide, whose vertices fade the alpha out
+ * to 0.
+ *
+ * Only convex fills and strokes without round joins can be tessellated.
+ */
+class PathTessellator {
+public:
+    /**
+     * Indicates whether the specified path, drawn with the specified paint,
+     * can be tessellated.
+     */
+    static bool canTessellate(const SkPath* path, const SkPaint* paint);
+
+    /**
+     * Generates the triangles of the specified path in the path's coordinate
+     * space. The inverse scale factors give the size of a pixel in that space
+     * and are used to compute the width of the AA fringe and the number of
+     * segments used to approximate curves.
+     *
+     * The bounds of the generated vertices are returned in bounds.
+     */
+    static void tessellate(const SkPath* path, const SkPaint* paint,
+            float inverseScaleX, float inverseScaleY,
+            Vector<AlphaVertex>& vertices, Rect& bounds);
+
+private:
+    /**
+     * Describes a polyline approximating one of the contours of a path.
+     */
+    struct Contour {
+        size_t start;
+        size_t count;
+        bool closed;
+    };
+
+    static void flatten(const SkPath* path, float inverseScaleX, float inverseScaleY,
+            Vector<vec2>& points, Vector<Contour>& contours);
+    static void addContour(Vector<vec2>& points, Vector<Contour>& contours,
+            size_t start, bool closed);
+
+    static void tessellateFill(const vec2* points, size_t count, bool isAA,
+            const vec2& pixel, Vector<AlphaVertex>& vertices);
+    static void tessellateStroke(const vec2* points, size_t count, bool closed,
+            const SkPaint* paint, const vec2& pixel, Vector<AlphaVertex>& vertices);
+    static void tessellateRoundCap(const vec2& center, const vec2& direction,
+            const vec2& n, float halfWidth, bool isHairline, bool isAA, const vec2& pixel,
+            Vector<AlphaVertex>& vertices);
+}; // class PathTessellator
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_PATH_TESSELLATOR_H
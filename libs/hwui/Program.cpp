@@ -84,18 +84,78 @@ Program::Program(const ProgramDescription& description, const char* vertex, cons
     }
 }
 
+Program::Program(const ProgramDescription& description, GLenum binaryFormat,
+        const void* binary, GLsizei length) {
+    mInitialized = false;
+    mHasColorUniform = false;
+    mHasSampler = false;
+    mUse = false;
+
+    mVertexShader = 0;
+    mFragmentShader = 0;
+
+    mProgramId = glCreateProgram();
+    glProgramBinaryOES(mProgramId, binaryFormat, binary, length);
+
+    // The attribute bindings are part of the binary
+    position = kBindingPosition;
+    mAttributes.add("position", kBindingPosition);
+    if (description.hasTexture || description.hasExternalTexture) {
+        texCoords = kBindingTexCoords;
+        mAttributes.add("texCoords", kBindingTexCoords);
+    } else {
+        texCoords = -1;
+    }
+
+    // Binaries are rejected when the driver or the device changed
+    GLint status;
+    glGetProgramiv(mProgramId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        PROGRAM_LOGD("Rejected program binary");
+        glDeleteProgram(mProgramId);
+    } else {
+        mInitialized = true;
+        transform = addUniform("transform");
+    }
+}
+
 Program::~Program() {
     if (mInitialized) {
-        glDetachShader(mProgramId, mVertexShader);
-        glDetachShader(mProgramId, mFragmentShader);
+        if (mVertexShader) {
+            glDetachShader(mProgramId, mVertexShader);
+            glDetachShader(mProgramId, mFragmentShader);
 
-        glDeleteShader(mVertexShader);
-        glDeleteShader(mFragmentShader);
+            glDeleteShader(mVertexShader);
+            glDeleteShader(mFragmentShader);
+        }
 
         glDeleteProgram(mProgramId);
     }
 }
 
+bool Program::getBinary(GLenum& binaryFormat, Vector<uint8_t>& binary) {
+    if (!mInitialized) return false;
+
+    GLint length = 0;
+    glGetProgramiv(mProgramId, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) return false;
+
+    binary.clear();
+    binary.insertAt(0, length);
+
+    GLsizei written = 0;
+    glGetProgramBinaryOES(mProgramId, length, &written, &binaryFormat, binary.editArray());
+    if (written <= 0) {
+        binary.clear();
+        return false;
+    }
+
+    if (written < length) {
+        binary.removeItemsAt(written, length - written);
+    }
+    return true;
+}
+
 int Program::addAttrib(const char* name) {
     int slot = glGetAttribLocation(mProgramId, name);
     mAttributes.add(name, slot);
@@ -18,6 +18,7 @@
 #define ANDROID_HWUI_PROGRAM_H
 
 #include <utils/KeyedVector.h>
+#include <utils/Vector.h>
 
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
@@ -77,6 +78,13 @@ namespace uirenderer {
 #define PROGRAM_HAS_EXTERNAL_TEXTURE_SHIFT 38
 #define PROGRAM_HAS_TEXTURE_TRANSFORM_SHIFT 39
 
+#define PROGRAM_HAS_VERTEX_ALPHA_SHIFT 40
+
+#define PROGRAM_IS_SIMPLE_GRADIENT_SHIFT 41
+#define PROGRAM_GRADIENT_WRAP_SHIFT 42
+
+#define PROGRAM_HAS_GAMMA_CORRECTION_SHIFT 44
+
 ///////////////////////////////////////////////////////////////////////////////
 // Types
 ///////////////////////////////////////////////////////////////////////////////
@@ -125,8 +133,15 @@ struct ProgramDescription {
 
     bool isAA;
 
+    // Per-vertex alpha, used by tessellated paths
+    bool hasVertexAlpha;
+
     bool hasGradient;
     Gradient gradientType;
+    // Gradients of 2 or 3 stops are computed in the fragment shader
+    // instead of being looked up in a texture
+    bool isSimpleGradient;
+    GLenum gradientWrap;
 
     SkXfermode::Mode shadersMode;
 
@@ -146,6 +161,11 @@ struct ProgramDescription {
     bool isPoint;
     float pointSize;
 
+    // Raises the alpha 8 texture coverage to the power of gamma; the value of
+    // gamma is a uniform and is not part of the program key
+    bool hasGammaCorrection;
+    float gamma;
+
     /**
      * Resets this description. All fields are reset back to the default
      * values they hold after building a new instance.
@@ -158,6 +178,8 @@ struct ProgramDescription {
 
         isAA = false;
 
+        hasVertexAlpha = false;
+
         modulate = false;
 
         hasBitmap = false;
@@ -165,6 +187,8 @@ struct ProgramDescription {
 
         hasGradient = false;
         gradientType = kGradientLinear;
+        isSimpleGradient = false;
+        gradientWrap = GL_CLAMP_TO_EDGE;
 
         shadersMode = SkXfermode::kClear_Mode;
 
@@ -180,6 +204,9 @@ struct ProgramDescription {
 
         isPoint = false;
         pointSize = 0.0f;
+
+        hasGammaCorrection = false;
+        gamma = DEFAULT_TEXT_GAMMA;
     }
 
     /**
@@ -221,6 +248,10 @@ struct ProgramDescription {
         }
         if (hasGradient) key |= PROGRAM_KEY_GRADIENT;
         key |= programid(gradientType) << PROGRAM_GRADIENT_TYPE_SHIFT;
+        if (isSimpleGradient) {
+            key |= programid(0x1) << PROGRAM_IS_SIMPLE_GRADIENT_SHIFT;
+            key |= programid(getEnumForWrap(gradientWrap)) << PROGRAM_GRADIENT_WRAP_SHIFT;
+        }
         if (isBitmapFirst) key |= PROGRAM_KEY_BITMAP_FIRST;
         if (hasBitmap && hasGradient) {
             key |= (shadersMode & PROGRAM_MAX_XFERMODE) << PROGRAM_XFERMODE_SHADER_SHIFT;
@@ -246,6 +277,8 @@ struct ProgramDescription {
         if (isAA) key |= programid(0x1) << PROGRAM_HAS_AA_SHIFT;
         if (hasExternalTexture) key |= programid(0x1) << PROGRAM_HAS_EXTERNAL_TEXTURE_SHIFT;
         if (hasTextureTransform) key |= programid(0x1) << PROGRAM_HAS_TEXTURE_TRANSFORM_SHIFT;
+        if (hasVertexAlpha) key |= programid(0x1) << PROGRAM_HAS_VERTEX_ALPHA_SHIFT;
+        if (hasGammaCorrection) key |= programid(0x1) << PROGRAM_HAS_GAMMA_CORRECTION_SHIFT;
         return key;
     }
 
@@ -291,6 +324,14 @@ public:
      * shaders sources.
      */
     Program(const ProgramDescription& description, const char* vertex, const char* fragment);
+
+    /**
+     * Creates a new program from a binary previously returned by getBinary().
+     * Requires GL_OES_get_program_binary. The binary may be rejected by the
+     * driver, in which case isInitialized() returns false.
+     */
+    Program(const ProgramDescription& description, GLenum binaryFormat,
+            const void* binary, GLsizei length);
     virtual ~Program();
 
     /**
@@ -329,6 +370,14 @@ public:
         return mInitialized;
     }
 
+    /**
+     * Retrieves the linked binary of this program. Requires
+     * GL_OES_get_program_binary.
+     *
+     * @return True if the binary could be retrieved, false otherwise.
+     */
+    bool getBinary(GLenum& binaryFormat, Vector<uint8_t>& binary);
+
     /**
      * Binds the program with the specified projection, modelView and
      * transform matrices.
@@ -384,7 +433,8 @@ private:
      */
     GLuint buildShader(const char* source, GLenum type);
 
-    // Name of the OpenGL program and shaders
+    // Name of the OpenGL program and shaders, the shaders are 0
+    // when the program was created from a binary
     GLuint mProgramId;
     GLuint mVertexShader;
     GLuint mFragmentShader;
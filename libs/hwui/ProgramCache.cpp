@@ -16,7 +16,12 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include "Caches.h"
 #include "ProgramCache.h"
@@ -32,6 +37,35 @@ namespace uirenderer {
 #define MODULATE_OP_MODULATE 1
 #define MODULATE_OP_MODULATE_A8 2
 
+// Program binaries file
+#define PROGRAM_BINARY_MAGIC 0x42505748 // HWPB
+#define PROGRAM_BINARY_VERSION 2
+// Maximum size of the program binaries file
+#define PROGRAM_BINARY_MAX_FILE_SIZE (2 * 1024 * 1024)
+
+#define PROGRAM_BINARY_FLAG_TEX_COORDS 0x1
+
+/**
+ * Header of the program binaries file. The header is followed by the
+ * driver version string and by a list of entries. Each entry is made of
+ * a ProgramBinaryEntry followed by the binary itself.
+ */
+struct ProgramBinaryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t driverVersionLength;
+    uint32_t count;
+};
+
+struct ProgramBinaryEntry {
+    programid key;
+    uint32_t flags;
+    uint32_t format;
+    uint32_t length;
+};
+
+static String8 sCacheFilename;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Vertex shaders snippets
 ///////////////////////////////////////////////////////////////////////////////
@@ -41,8 +75,10 @@ const char* gVS_Header_Attributes =
 const char* gVS_Header_Attributes_TexCoords =
         "attribute vec2 texCoords;\n";
 const char* gVS_Header_Attributes_AAParameters =
-        "attribute float vtxWidth;\n"
-        "attribute float vtxLength;\n";
+        "attribute vec2 vtxWidth;\n"
+        "attribute vec2 vtxLength;\n";
+const char* gVS_Header_Attributes_VertexAlpha =
+        "attribute float vtxAlpha;\n";
 const char* gVS_Header_Uniforms_TextureTransform =
         "uniform mat4 mainTextureTransform;\n";
 const char* gVS_Header_Uniforms =
@@ -63,8 +99,10 @@ const char* gVS_Header_Uniforms_HasBitmap =
 const char* gVS_Header_Varyings_HasTexture =
         "varying vec2 outTexCoords;\n";
 const char* gVS_Header_Varyings_IsAA =
-        "varying float widthProportion;\n"
-        "varying float lengthProportion;\n";
+        "varying vec2 widthProportion;\n"
+        "varying vec2 lengthProportion;\n";
+const char* gVS_Header_Varyings_HasVertexAlpha =
+        "varying float alpha;\n";
 const char* gVS_Header_Varyings_HasBitmap[2] = {
         // Default precision
         "varying vec2 outBitmapTexCoords;\n",
@@ -110,6 +148,8 @@ const char* gVS_Main_PointSize =
 const char* gVS_Main_AA =
         "    widthProportion = vtxWidth;\n"
         "    lengthProportion = vtxLength;\n";
+const char* gVS_Main_VertexAlpha =
+        "    alpha = vtxAlpha;\n";
 const char* gVS_Footer =
         "}\n\n";
 
@@ -125,11 +165,6 @@ const char* gFS_Header =
         "precision mediump float;\n\n";
 const char* gFS_Uniforms_Color =
         "uniform vec4 color;\n";
-const char* gFS_Uniforms_AA =
-        "uniform float boundaryWidth;\n"
-        "uniform float inverseBoundaryWidth;\n"
-        "uniform float boundaryLength;\n"
-        "uniform float inverseBoundaryLength;\n";
 const char* gFS_Header_Uniforms_PointHasBitmap =
         "uniform vec2 textureDimension;\n"
         "uniform float pointSize;\n";
@@ -145,8 +180,15 @@ const char* gFS_Uniforms_GradientSampler[3] = {
         // Sweep
         "uniform sampler2D gradientSampler;\n"
 };
+const char* gFS_Uniforms_SimpleGradient =
+        "uniform vec4 startColor;\n"
+        "uniform vec4 middleColor;\n"
+        "uniform vec4 endColor;\n"
+        "uniform float middle;\n";
 const char* gFS_Uniforms_BitmapSampler =
         "uniform sampler2D bitmapSampler;\n";
+const char* gFS_Uniforms_Gamma =
+        "uniform float gamma;\n";
 const char* gFS_Uniforms_ColorOp[4] = {
         // None
         "",
@@ -188,6 +230,14 @@ const char* gFS_Fast_SingleModulateA8Texture =
         "\nvoid main(void) {\n"
         "    gl_FragColor = color * texture2D(sampler, outTexCoords).a;\n"
         "}\n\n";
+const char* gFS_Fast_SingleA8Texture_ApplyGamma =
+        "\nvoid main(void) {\n"
+        "    gl_FragColor = vec4(0.0, 0.0, 0.0, pow(texture2D(sampler, outTexCoords).a, gamma));\n"
+        "}\n\n";
+const char* gFS_Fast_SingleModulateA8Texture_ApplyGamma =
+        "\nvoid main(void) {\n"
+        "    gl_FragColor = color * pow(texture2D(sampler, outTexCoords).a, gamma);\n"
+        "}\n\n";
 const char* gFS_Fast_SingleGradient =
         "\nvoid main(void) {\n"
         "    gl_FragColor = texture2D(gradientSampler, linear);\n"
@@ -202,17 +252,10 @@ const char* gFS_Main_FetchColor =
         "    fragColor = color;\n";
 const char* gFS_Main_ModulateColor =
         "    fragColor *= color.a;\n";
+// The AA proportions are distances to the edges in units of the AA boundary
 const char* gFS_Main_AccountForAA =
-        "    if (widthProportion < boundaryWidth) {\n"
-        "        fragColor *= (widthProportion * inverseBoundaryWidth);\n"
-        "    } else if (widthProportion > (1.0 - boundaryWidth)) {\n"
-        "        fragColor *= ((1.0 - widthProportion) * inverseBoundaryWidth);\n"
-        "    }\n"
-        "    if (lengthProportion < boundaryLength) {\n"
-        "        fragColor *= (lengthProportion * inverseBoundaryLength);\n"
-        "    } else if (lengthProportion > (1.0 - boundaryLength)) {\n"
-        "        fragColor *= ((1.0 - lengthProportion) * inverseBoundaryLength);\n"
-        "    }\n";
+        "    fragColor *= clamp(min(widthProportion.x, widthProportion.y), 0.0, 1.0) *\n"
+        "            clamp(min(lengthProportion.x, lengthProportion.y), 0.0, 1.0);\n";
 const char* gFS_Main_FetchTexture[2] = {
         // Don't modulate
         "    fragColor = texture2D(sampler, outTexCoords);\n",
@@ -225,6 +268,12 @@ const char* gFS_Main_FetchA8Texture[2] = {
         // Modulate
         "    fragColor = color * texture2D(sampler, outTexCoords).a;\n"
 };
+const char* gFS_Main_FetchA8Texture_ApplyGamma[2] = {
+        // Don't modulate
+        "    fragColor = vec4(0.0, 0.0, 0.0, pow(texture2D(sampler, outTexCoords).a, gamma));\n",
+        // Modulate
+        "    fragColor = color * pow(texture2D(sampler, outTexCoords).a, gamma);\n"
+};
 const char* gFS_Main_FetchGradient[3] = {
         // Linear
         "    vec4 gradientColor = texture2D(gradientSampler, linear);\n",
@@ -235,6 +284,29 @@ const char* gFS_Main_FetchGradient[3] = {
         "    float index = atan(sweep.y, sweep.x) * 0.15915494309; // inv(2 * PI)\n"
         "    vec4 gradientColor = texture2D(gradientSampler, vec2(index - floor(index), 0.5));\n"
 };
+const char* gFS_Main_SimpleGradientIndex[3] = {
+        // Linear
+        "    float index = linear.x;\n",
+        // Circular
+        "    float index = length(circular);\n",
+        // Sweep
+        "    float index = atan(sweep.y, sweep.x) * 0.15915494309; // inv(2 * PI)\n"
+        "    index = index - floor(index);\n"
+};
+const char* gFS_Main_SimpleGradientWrap[3] = {
+        // Clamp
+        "    index = clamp(index, 0.0, 1.0);\n",
+        // Repeat
+        "    index = fract(index);\n",
+        // Mirror
+        "    index = 1.0 - abs(mod(index, 2.0) - 1.0);\n"
+};
+// Colors are interpolated before being premultiplied, like Skia does
+const char* gFS_Main_FetchSimpleGradient =
+        "    vec4 gradientColor = index < middle ?\n"
+        "            mix(startColor, middleColor, index / middle) :\n"
+        "            mix(middleColor, endColor, (index - middle) / (1.0 - middle));\n"
+        "    gradientColor.rgb *= gradientColor.a;\n";
 const char* gFS_Main_FetchBitmap =
         "    vec4 bitmapColor = texture2D(bitmapSampler, outBitmapTexCoords);\n";
 const char* gFS_Main_FetchBitmapNpot =
@@ -267,6 +339,8 @@ const char* gFS_Main_BitmapShader_Modulate[3] = {
         // Modulate with alpha 8 texture
         "    fragColor = bitmapColor * texture2D(sampler, outTexCoords).a;\n"
     };
+const char* gFS_Main_ApplyVertexAlpha =
+        "    fragColor *= alpha;\n";
 const char* gFS_Main_FragColor =
         "    gl_FragColor = fragColor;\n";
 const char* gFS_Main_FragColor_Blend =
@@ -345,13 +419,235 @@ const char* gBlendOps[18] = {
 // Constructors/destructors
 ///////////////////////////////////////////////////////////////////////////////
 
-ProgramCache::ProgramCache() {
+ProgramCache::ProgramCache(): mHasProgramBinary(false), mDirty(false) {
 }
 
 ProgramCache::~ProgramCache() {
     clear();
 }
 
+void ProgramCache::setCacheFilename(const char* filename) {
+    sCacheFilename.setTo(filename);
+    sCacheFilename.append("_programs");
+}
+
+void ProgramCache::init(bool hasProgramBinary) {
+    mHasProgramBinary = hasProgramBinary;
+    mDirty = false;
+
+    loadFromDisk();
+    warmup();
+}
+
+/**
+ * Generates the programs used to draw solid colors, bitmaps, text, AA
+ * lines and gradients, with and without color modulation. Programs loaded
+ * from disk are not generated again.
+ *
+ * This is called while the Caches are being constructed: descriptions with
+ * a bitmap shader must not be generated here, their shaders depend on the
+ * Caches' extensions.
+ */
+void ProgramCache::warmup() {
+    ProgramDescription description;
+    for (int modulate = 0; modulate < 2; modulate++) {
+        // Solid colors
+        description.reset();
+        description.modulate = modulate;
+        get(description);
+
+        // Bitmaps and layers
+        description.reset();
+        description.hasTexture = true;
+        description.modulate = modulate;
+        get(description);
+
+        // Text, with and without gamma correction
+        description.reset();
+        description.hasTexture = true;
+        description.hasAlpha8Texture = true;
+        description.modulate = modulate;
+        get(description);
+
+        description.hasGammaCorrection = true;
+        get(description);
+
+        // Anti-aliased lines
+        description.reset();
+        description.isAA = true;
+        description.modulate = modulate;
+        get(description);
+
+        // Linear gradients, with and without a color matrix
+        description.reset();
+        description.hasGradient = true;
+        description.modulate = modulate;
+        get(description);
+
+        description.colorOp = ProgramDescription::kColorMatrix;
+        get(description);
+
+        // Linear gradients of 2 or 3 stops, computed in the fragment shader
+        description.colorOp = ProgramDescription::kColorNone;
+        description.isSimpleGradient = true;
+        get(description);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Persistence
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Program binaries are only valid for the driver that produced them.
+ */
+String8 ProgramCache::getDriverVersion() const {
+    String8 version;
+    version.appendFormat("%s\n%s\n%s", (const char*) glGetString(GL_VENDOR),
+            (const char*) glGetString(GL_RENDERER), (const char*) glGetString(GL_VERSION));
+    return version;
+}
+
+void ProgramCache::loadFromDisk() {
+    if (!mHasProgramBinary || sCacheFilename.isEmpty()) return;
+
+    FILE* file = fopen(sCacheFilename.string(), "rb");
+    if (!file) return;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (size < (long) sizeof(ProgramBinaryHeader) || size > PROGRAM_BINARY_MAX_FILE_SIZE) {
+        fclose(file);
+        return;
+    }
+
+    uint8_t* buffer = new uint8_t[size];
+    bool read = fread(buffer, 1, size, file) == (size_t) size;
+    fclose(file);
+
+    const ProgramBinaryHeader* header = (const ProgramBinaryHeader*) buffer;
+    const String8 driverVersion = getDriverVersion();
+
+    if (!read || header->magic != PROGRAM_BINARY_MAGIC ||
+            header->version != PROGRAM_BINARY_VERSION ||
+            header->driverVersionLength != driverVersion.length() ||
+            sizeof(ProgramBinaryHeader) + header->driverVersionLength > (size_t) size ||
+            memcmp(buffer + sizeof(ProgramBinaryHeader), driverVersion.string(),
+                    driverVersion.length())) {
+        PROGRAM_LOGD("Discarding program binaries from a different driver");
+        delete[] buffer;
+        unlink(sCacheFilename.string());
+        return;
+    }
+
+    size_t offset = sizeof(ProgramBinaryHeader) + header->driverVersionLength;
+    // Keep entries aligned on 4 bytes
+    offset = (offset + 3) & ~3;
+
+    for (uint32_t i = 0; i < header->count; i++) {
+        if (offset + sizeof(ProgramBinaryEntry) > (size_t) size) break;
+
+        ProgramBinaryEntry entry;
+        memcpy(&entry, buffer + offset, sizeof(ProgramBinaryEntry));
+        offset += sizeof(ProgramBinaryEntry);
+
+        if (entry.length > size - offset) break;
+
+        if (mCache.indexOfKey(entry.key) < 0) {
+            ProgramDescription description;
+            description.hasTexture = entry.flags & PROGRAM_BINARY_FLAG_TEX_COORDS;
+
+            Program* program = new Program(description, entry.format,
+                    buffer + offset, entry.length);
+            if (program->isInitialized()) {
+                mCache.add(entry.key, program);
+            } else {
+                // Rejected binaries are generated again on demand
+                delete program;
+                mDirty = true;
+            }
+        }
+
+        offset += (entry.length + 3) & ~3;
+    }
+
+    PROGRAM_LOGD("Loaded %d program binaries", mCache.size());
+
+    delete[] buffer;
+}
+
+void ProgramCache::saveToDisk() {
+    if (!mHasProgramBinary || !mDirty || sCacheFilename.isEmpty()) return;
+
+    // Write to a temporary file first to never leave a truncated cache
+    String8 tempFilename(sCacheFilename);
+    tempFilename.append(".tmp");
+
+    FILE* file = fopen(tempFilename.string(), "wb");
+    if (!file) {
+        ALOGW("Could not open program binaries file %s", tempFilename.string());
+        return;
+    }
+
+    const String8 driverVersion = getDriverVersion();
+    const uint8_t padding[4] = { 0, 0, 0, 0 };
+
+    ProgramBinaryHeader header;
+    header.magic = PROGRAM_BINARY_MAGIC;
+    header.version = PROGRAM_BINARY_VERSION;
+    header.driverVersionLength = driverVersion.length();
+    header.count = 0;
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    success &= fwrite(driverVersion.string(), 1, header.driverVersionLength, file) ==
+            header.driverVersionLength;
+
+    size_t size = sizeof(header) + header.driverVersionLength;
+    size_t pad = ((size + 3) & ~3) - size;
+    success &= fwrite(padding, 1, pad, file) == pad;
+    size += pad;
+
+    Vector<uint8_t> binary;
+    size_t count = mCache.size();
+    for (size_t i = 0; i < count && success; i++) {
+        Program* program = mCache.valueAt(i);
+
+        GLenum format;
+        if (!program->getBinary(format, binary)) continue;
+
+        ProgramBinaryEntry entry;
+        entry.key = mCache.keyAt(i);
+        entry.flags = program->texCoords >= 0 ? PROGRAM_BINARY_FLAG_TEX_COORDS : 0;
+        entry.format = format;
+        entry.length = binary.size();
+
+        pad = ((entry.length + 3) & ~3) - entry.length;
+        if (size + sizeof(entry) + entry.length + pad > PROGRAM_BINARY_MAX_FILE_SIZE) break;
+
+        success &= fwrite(&entry, sizeof(entry), 1, file) == 1;
+        success &= fwrite(binary.array(), 1, entry.length, file) == entry.length;
+        success &= fwrite(padding, 1, pad, file) == pad;
+        size += sizeof(entry) + entry.length + pad;
+
+        header.count++;
+    }
+
+    // Update the number of entries
+    success &= fseek(file, 0, SEEK_SET) == 0;
+    success &= fwrite(&header, sizeof(header), 1, file) == 1;
+    success &= fclose(file) == 0;
+
+    if (success && rename(tempFilename.string(), sCacheFilename.string()) == 0) {
+        PROGRAM_LOGD("Saved %d program binaries", header.count);
+        mDirty = false;
+    } else {
+        ALOGW("Could not write program binaries file %s", sCacheFilename.string());
+        unlink(tempFilename.string());
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Cache management
 ///////////////////////////////////////////////////////////////////////////////
@@ -359,6 +655,8 @@ ProgramCache::~ProgramCache() {
 void ProgramCache::clear() {
     PROGRAM_LOGD("Clearing program cache");
 
+    saveToDisk();
+
     size_t count = mCache.size();
     for (size_t i = 0; i < count; i++) {
         delete mCache.valueAt(i);
@@ -371,10 +669,13 @@ Program* ProgramCache::get(const ProgramDescription& description) {
     ssize_t index = mCache.indexOfKey(key);
     Program* program = NULL;
     if (index < 0) {
+        stats.miss();
         description.log("Could not find program");
         program = generateProgram(description, key);
         mCache.add(key, program);
+        mDirty = true;
     } else {
+        stats.hit();
         program = mCache.valueAt(index);
     }
     return program;
@@ -401,6 +702,9 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
     if (description.isAA) {
         shader.append(gVS_Header_Attributes_AAParameters);
     }
+    if (description.hasVertexAlpha) {
+        shader.append(gVS_Header_Attributes_VertexAlpha);
+    }
     // Uniforms
     shader.append(gVS_Header_Uniforms);
     if (description.hasTextureTransform) {
@@ -422,6 +726,9 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
     if (description.isAA) {
         shader.append(gVS_Header_Varyings_IsAA);
     }
+    if (description.hasVertexAlpha) {
+        shader.append(gVS_Header_Varyings_HasVertexAlpha);
+    }
     if (description.hasGradient) {
         shader.append(gVS_Header_Varyings_HasGradient[description.gradientType]);
     }
@@ -442,6 +749,9 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
         if (description.isAA) {
             shader.append(gVS_Main_AA);
         }
+        if (description.hasVertexAlpha) {
+            shader.append(gVS_Main_VertexAlpha);
+        }
         if (description.hasGradient) {
             shader.append(gVS_Main_OutGradient[description.gradientType]);
         }
@@ -464,6 +774,16 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
     return shader;
 }
 
+static int getGradientWrapIndex(GLenum wrap) {
+    switch (wrap) {
+        case GL_REPEAT:
+            return 1;
+        case GL_MIRRORED_REPEAT:
+            return 2;
+    }
+    return 0;
+}
+
 String8 ProgramCache::generateFragmentShader(const ProgramDescription& description) {
     String8 shader;
 
@@ -484,6 +804,9 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
     if (description.isAA) {
         shader.append(gVS_Header_Varyings_IsAA);
     }
+    if (description.hasVertexAlpha) {
+        shader.append(gVS_Header_Varyings_HasVertexAlpha);
+    }
     if (description.hasGradient) {
         shader.append(gVS_Header_Varyings_HasGradient[description.gradientType]);
     }
@@ -508,18 +831,22 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
     } else if (description.hasExternalTexture) {
         shader.append(gFS_Uniforms_ExternalTextureSampler);
     }
-    if (description.isAA) {
-        shader.append(gFS_Uniforms_AA);
-    }
     if (description.hasGradient) {
-        shader.append(gFS_Uniforms_GradientSampler[description.gradientType]);
+        if (description.isSimpleGradient) {
+            shader.append(gFS_Uniforms_SimpleGradient);
+        } else {
+            shader.append(gFS_Uniforms_GradientSampler[description.gradientType]);
+        }
     }
     if (description.hasBitmap && description.isPoint) {
         shader.append(gFS_Header_Uniforms_PointHasBitmap);
     }
+    if (description.hasGammaCorrection) {
+        shader.append(gFS_Uniforms_Gamma);
+    }
 
     // Optimization for common cases
-    if (!description.isAA && !blendFramebuffer &&
+    if (!description.isAA && !description.hasVertexAlpha && !blendFramebuffer &&
             description.colorOp == ProgramDescription::kColorNone && !description.isPoint) {
         bool fast = false;
 
@@ -530,7 +857,8 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
                 description.hasAlpha8Texture && noShader;
         const bool singleGradient = !description.hasTexture && !description.hasExternalTexture &&
                 description.hasGradient && !description.hasBitmap &&
-                description.gradientType == ProgramDescription::kGradientLinear;
+                description.gradientType == ProgramDescription::kGradientLinear &&
+                !description.isSimpleGradient;
 
         if (singleColor) {
             shader.append(gFS_Fast_SingleColor);
@@ -544,9 +872,17 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
             fast = true;
         } else if (singleA8Texture) {
             if (!description.modulate) {
-                shader.append(gFS_Fast_SingleA8Texture);
+                if (description.hasGammaCorrection) {
+                    shader.append(gFS_Fast_SingleA8Texture_ApplyGamma);
+                } else {
+                    shader.append(gFS_Fast_SingleA8Texture);
+                }
             } else {
-                shader.append(gFS_Fast_SingleModulateA8Texture);
+                if (description.hasGammaCorrection) {
+                    shader.append(gFS_Fast_SingleModulateA8Texture_ApplyGamma);
+                } else {
+                    shader.append(gFS_Fast_SingleModulateA8Texture);
+                }
             }
             fast = true;
         } else if (singleGradient) {
@@ -594,7 +930,11 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
         if (description.hasTexture || description.hasExternalTexture) {
             if (description.hasAlpha8Texture) {
                 if (!description.hasGradient && !description.hasBitmap) {
-                    shader.append(gFS_Main_FetchA8Texture[modulateOp]);
+                    if (description.hasGammaCorrection) {
+                        shader.append(gFS_Main_FetchA8Texture_ApplyGamma[modulateOp]);
+                    } else {
+                        shader.append(gFS_Main_FetchA8Texture[modulateOp]);
+                    }
                 }
             } else {
                 shader.append(gFS_Main_FetchTexture[modulateOp]);
@@ -608,7 +948,14 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
             shader.append(gFS_Main_AccountForAA);
         }
         if (description.hasGradient) {
-            shader.append(gFS_Main_FetchGradient[description.gradientType]);
+            if (description.isSimpleGradient) {
+                shader.append(gFS_Main_SimpleGradientIndex[description.gradientType]);
+                shader.append(gFS_Main_SimpleGradientWrap[
+                        getGradientWrapIndex(description.gradientWrap)]);
+                shader.append(gFS_Main_FetchSimpleGradient);
+            } else {
+                shader.append(gFS_Main_FetchGradient[description.gradientType]);
+            }
         }
         if (description.hasBitmap) {
             if (description.isPoint) {
@@ -647,6 +994,9 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
         }
         // Apply the color op if needed
         shader.append(gFS_Main_ApplyColorOp[description.colorOp]);
+        if (description.hasVertexAlpha) {
+            shader.append(gFS_Main_ApplyVertexAlpha);
+        }
         // Output the fragment
         if (!blendFramebuffer) {
             shader.append(gFS_Main_FragColor);
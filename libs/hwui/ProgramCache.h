@@ -23,9 +23,12 @@
 
 #include <GLES2/gl2.h>
 
+#include <cutils/compiler.h>
+
 #include "Debug.h"
 #include "Program.h"
 #include "Properties.h"
+#include "RenderStats.h"
 
 namespace android {
 namespace uirenderer {
@@ -48,17 +51,49 @@ namespace uirenderer {
 /**
  * Generates and caches program. Programs are generated based on
  * ProgramDescriptions.
+ *
+ * When GL_OES_get_program_binary is supported, linked programs are saved
+ * to disk and loaded back the next time the cache is initialized, as long
+ * as the GL driver did not change.
  */
 class ProgramCache {
 public:
     ProgramCache();
     ~ProgramCache();
 
+    /**
+     * Sets the file used to persist linked programs. Programs are not
+     * persisted until this method is called.
+     */
+    ANDROID_API static void setCacheFilename(const char* filename);
+
+    /**
+     * Loads the programs persisted on disk and generates the programs
+     * used by most applications, so that the first frames do not pay
+     * for shader compilation. Must be called with a GL context current.
+     */
+    void init(bool hasProgramBinary);
+
     Program* get(const ProgramDescription& description);
 
+    /**
+     * Writes the binaries of the programs in the cache to disk, if new
+     * programs were generated since the last save.
+     */
+    void saveToDisk();
+
     void clear();
 
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 private:
+    void loadFromDisk();
+    void warmup();
+    String8 getDriverVersion() const;
+
     Program* generateProgram(const ProgramDescription& description, programid key);
     String8 generateVertexShader(const ProgramDescription& description);
     String8 generateFragmentShader(const ProgramDescription& description);
@@ -68,6 +103,10 @@ private:
     void printLongString(const String8& shader) const;
 
     KeyedVector<programid, Program*> mCache;
+
+    bool mHasProgramBinary;
+    // True when the cache contains programs that are not on disk yet
+    bool mDirty;
 }; // class ProgramCache
 
 }; // namespace uirenderer
@@ -37,16 +37,67 @@
 // Textures used by layers must have dimensions multiples of this number
 #define LAYER_SIZE 64
 
+// Layers unused for longer than this delay are deleted from the cache when
+// the next frame completes
+#define LAYER_CACHE_IDLE_TIMEOUT ms2ns(5000)
+
 // Defines the size in bits of the stencil buffer
 // Note: Only 1 bit is required for clipping but more bits are required
 // to properly implement the winding fill rule when rasterizing paths
-#define STENCIL_BUFFER_SIZE 0
+#define STENCIL_BUFFER_SIZE 8
 
 /**
  * Debug level for app developers.
  */
 #define PROPERTY_DEBUG "hwui.debug_level"
 
+/**
+ * Used to enable/disable the frame profiler. When enabled, the cost of the
+ * most recent frames and the number of display list operations they execute
+ * are reported by dumpsys gfxinfo.
+ * Possible values:
+ * "true", to enable frame profiling
+ * "false", to disable frame profiling (default)
+ */
+#define PROPERTY_PROFILE "debug.hwui.profile"
+
+/**
+ * Used to enable/disable the reordering of display list operations.
+ * When enabled, drawing operations that do not overlap are grouped by
+ * program and texture before being sent to the renderer.
+ * Possible values:
+ * "true", to enable operations reordering
+ * "false", to disable operations reordering (default)
+ */
+#define PROPERTY_DEFER_OPS "hwui.defer_ops"
+
+/**
+ * Used to enable/disable the preparation of textures on a background
+ * thread for the bitmaps referenced by newly recorded display lists.
+ * Possible values:
+ * "true", to enable textures prefetching
+ * "false", to disable textures prefetching (default)
+ */
+#define PROPERTY_TEXTURE_PREFETCH "hwui.texture_prefetch"
+
+/**
+ * Used to enable/disable the tessellation of paths. When enabled, convex
+ * fills and most strokes are converted to triangle meshes drawn directly
+ * instead of being rasterized into alpha textures.
+ * Possible values:
+ * "true", to enable paths tessellation
+ * "false", to disable paths tessellation (default)
+ */
+#define PROPERTY_PATH_TESSELLATION "hwui.path_tessellation"
+
+/**
+ * Used to enable/disable tiled rendering on GPUs that support
+ * GL_QCOM_tiled_rendering. Possible values:
+ * "true", to bracket each frame's dirty region with tiling hints
+ * "false", to let the driver resolve the entire surface (default)
+ */
+#define PROPERTY_TILED_RENDERING "ro.hwui.tiled_rendering"
+
 /**
  * Debug levels. Debug levels are used as flags.
  */
@@ -62,9 +113,12 @@ enum DebugLevel {
 #define PROPERTY_LAYER_CACHE_SIZE "ro.hwui.layer_cache_size"
 #define PROPERTY_GRADIENT_CACHE_SIZE "ro.hwui.gradient_cache_size"
 #define PROPERTY_PATH_CACHE_SIZE "ro.hwui.path_cache_size"
+#define PROPERTY_PATH_MESH_CACHE_SIZE "ro.hwui.path_mesh_cache_size"
 #define PROPERTY_SHAPE_CACHE_SIZE "ro.hwui.shape_cache_size"
 #define PROPERTY_DROP_SHADOW_CACHE_SIZE "ro.hwui.drop_shadow_cache_size"
 #define PROPERTY_FBO_CACHE_SIZE "ro.hwui.fbo_cache_size"
+// Combined size of all the caches, no global limit is applied when not set
+#define PROPERTY_MEMORY_BUDGET "ro.hwui.memory_budget"
 
 // These properties are defined in percentage (range 0..1)
 #define PROPERTY_TEXTURE_CACHE_FLUSH_RATE "ro.hwui.texture_cache_flush_rate"
@@ -87,8 +141,11 @@ enum DebugLevel {
 #define DEFAULT_TEXTURE_CACHE_SIZE 24.0f
 #define DEFAULT_LAYER_CACHE_SIZE 16.0f
 #define DEFAULT_PATH_CACHE_SIZE 4.0f
+#define DEFAULT_PATH_MESH_CACHE_SIZE 1.0f
 #define DEFAULT_SHAPE_CACHE_SIZE 1.0f
 #define DEFAULT_PATCH_CACHE_SIZE 512
+// Size in bytes of the VBO shared by the 9-patch meshes
+#define DEFAULT_PATCH_CACHE_BUFFER_SIZE (128 * 1024)
 #define DEFAULT_GRADIENT_CACHE_SIZE 0.5f
 #define DEFAULT_DROP_SHADOW_CACHE_SIZE 2.0f
 #define DEFAULT_FBO_CACHE_SIZE 16
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_RENDER_STATS_H
+#define ANDROID_HWUI_RENDER_STATS_H
+
+#include <stdint.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Stats
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Number of lookups a cache could and could not serve from its content.
+ * The counters are never reset by the cache itself.
+ */
+struct CacheStats {
+    CacheStats() {
+        reset();
+    }
+
+    void reset() {
+        hits = 0;
+        misses = 0;
+    }
+
+    inline void hit() {
+        hits++;
+    }
+
+    inline void miss() {
+        misses++;
+    }
+
+    float getHitRate() const {
+        const uint32_t lookups = hits + misses;
+        return lookups > 0 ? float(hits) / lookups : 0.0f;
+    }
+
+    uint32_t hits;
+    uint32_t misses;
+}; // struct CacheStats
+
+/**
+ * Work submitted to GL by the renderer. State changes are only counted
+ * when the renderer actually calls into GL; redundant changes filtered out
+ * by the Caches are not counted.
+ */
+struct RenderStats {
+    RenderStats() {
+        reset();
+    }
+
+    void reset() {
+        drawCalls = 0;
+        programChanges = 0;
+        blendChanges = 0;
+        bufferChanges = 0;
+        textureUnitChanges = 0;
+    }
+
+    uint32_t drawCalls;
+    uint32_t programChanges;
+    uint32_t blendChanges;
+    uint32_t bufferChanges;
+    uint32_t textureUnitChanges;
+}; // struct RenderStats
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_RENDER_STATS_H
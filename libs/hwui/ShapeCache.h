@@ -27,6 +27,7 @@
 
 #include "Debug.h"
 #include "Properties.h"
+#include "RenderStats.h"
 #include "Texture.h"
 #include "utils/Compare.h"
 #include "utils/GenerationCache.h"
@@ -334,6 +335,11 @@ public:
      */
     uint32_t getSize();
 
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 protected:
     PathTexture* addTexture(const Entry& entry, const SkPath *path, const SkPaint* paint);
     PathTexture* addTexture(const Entry& entry, SkBitmap* bitmap);
@@ -351,7 +357,13 @@ protected:
     bool checkTextureSize(uint32_t width, uint32_t height);
 
     PathTexture* get(Entry entry) {
-        return mCache.get(entry);
+        PathTexture* texture = mCache.get(entry);
+        if (texture) {
+            stats.hit();
+        } else {
+            stats.miss();
+        }
+        return texture;
     }
 
     void removeTexture(PathTexture* texture);
@@ -38,6 +38,48 @@ static const GLint gTileModes[] = {
         GL_MIRRORED_REPEAT  // == SkShader::kMirror_TileMode
 };
 
+/**
+ * Indicates whether the specified gradient can be computed in the fragment
+ * shader: 2 or 3 stops, the first one at 0 and the last one at 1.
+ */
+static bool isSimpleGradient(const float* positions, int count) {
+    if (count == 2) {
+        return positions[0] == 0.0f && positions[1] == 1.0f;
+    }
+    if (count == 3) {
+        return positions[0] == 0.0f && positions[2] == 1.0f &&
+                positions[1] > 0.0f && positions[1] < 1.0f;
+    }
+    return false;
+}
+
+static inline void setGradientColor(Program* program, const char* name, uint32_t color) {
+    glUniform4f(program->getUniform(name),
+            ((color >> 16) & 0xff) / 255.0f, ((color >>  8) & 0xff) / 255.0f,
+            ((color      ) & 0xff) / 255.0f, ((color >> 24) & 0xff) / 255.0f);
+}
+
+static void setupSimpleGradient(Program* program, const uint32_t* colors,
+        const float* positions, int count) {
+    setGradientColor(program, "startColor", colors[0]);
+    setGradientColor(program, "endColor", colors[count - 1]);
+
+    if (count == 3) {
+        setGradientColor(program, "middleColor", colors[1]);
+        glUniform1f(program->getUniform("middle"), positions[1]);
+    } else {
+        // Splitting a 2 stops gradient in its middle does not change it
+        const uint32_t start = colors[0];
+        const uint32_t end = colors[1];
+        uint32_t middle = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            middle |= ((((start >> shift) & 0xff) + ((end >> shift) & 0xff)) / 2) << shift;
+        }
+        setGradientColor(program, "middleColor", middle);
+        glUniform1f(program->getUniform("middle"), 0.5f);
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Base shader
 ///////////////////////////////////////////////////////////////////////////////
@@ -213,21 +255,25 @@ void SkiaLinearGradientShader::describe(ProgramDescription& description,
         const Extensions& extensions) {
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientLinear;
+    description.isSimpleGradient = isSimpleGradient(mPositions, mCount);
+    description.gradientWrap = gTileModes[mTileX];
 }
 
 void SkiaLinearGradientShader::setupProgram(Program* program, const mat4& modelView,
         const Snapshot& snapshot, GLuint* textureUnit) {
-    GLuint textureSlot = (*textureUnit)++;
-    Caches::getInstance().activeTexture(textureSlot);
+    if (CC_LIKELY(isSimpleGradient(mPositions, mCount))) {
+        setupSimpleGradient(program, mColors, mPositions, mCount);
+    } else {
+        GLuint textureSlot = (*textureUnit)++;
+        Caches::getInstance().activeTexture(textureSlot);
 
-    Texture* texture = mGradientCache->get(mColors, mPositions, mCount, mTileX);
+        Texture* texture = mGradientCache->get(mColors, mPositions, mCount, mTileX);
+        bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
+        glUniform1i(program->getUniform("gradientSampler"), textureSlot);
+    }
 
     mat4 screenSpace;
     computeScreenSpaceMatrix(screenSpace, modelView);
-
-    // Uniforms
-    bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
-    glUniform1i(program->getUniform("gradientSampler"), textureSlot);
     glUniformMatrix4fv(program->getUniform("screenSpace"), 1, GL_FALSE, &screenSpace.data[0]);
 }
 
@@ -276,6 +322,8 @@ void SkiaCircularGradientShader::describe(ProgramDescription& description,
         const Extensions& extensions) {
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientCircular;
+    description.isSimpleGradient = isSimpleGradient(mPositions, mCount);
+    description.gradientWrap = gTileModes[mTileX];
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -325,21 +373,25 @@ void SkiaSweepGradientShader::describe(ProgramDescription& description,
         const Extensions& extensions) {
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientSweep;
+    description.isSimpleGradient = isSimpleGradient(mPositions, mCount);
+    description.gradientWrap = GL_CLAMP_TO_EDGE;
 }
 
 void SkiaSweepGradientShader::setupProgram(Program* program, const mat4& modelView,
         const Snapshot& snapshot, GLuint* textureUnit) {
-    GLuint textureSlot = (*textureUnit)++;
-    Caches::getInstance().activeTexture(textureSlot);
+    if (CC_LIKELY(isSimpleGradient(mPositions, mCount))) {
+        setupSimpleGradient(program, mColors, mPositions, mCount);
+    } else {
+        GLuint textureSlot = (*textureUnit)++;
+        Caches::getInstance().activeTexture(textureSlot);
 
-    Texture* texture = mGradientCache->get(mColors, mPositions, mCount);
+        Texture* texture = mGradientCache->get(mColors, mPositions, mCount);
+        bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
+        glUniform1i(program->getUniform("gradientSampler"), textureSlot);
+    }
 
     mat4 screenSpace;
     computeScreenSpaceMatrix(screenSpace, modelView);
-
-    // Uniforms
-    bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
-    glUniform1i(program->getUniform("gradientSampler"), textureSlot);
     glUniformMatrix4fv(program->getUniform("screenSpace"), 1, GL_FALSE, &screenSpace.data[0]);
 }
 
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <pthread.h>
+
 #include "Snapshot.h"
 
 #include <SkCanvas.h>
@@ -21,6 +23,81 @@
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Allocation
+///////////////////////////////////////////////////////////////////////////////
+
+// Deep enough for the save stacks of typical view hierarchies
+#define SNAPSHOT_POOL_MAX_SIZE 64
+
+struct SnapshotPoolEntry {
+    SnapshotPoolEntry* next;
+};
+
+struct SnapshotPool {
+    SnapshotPoolEntry* head;
+    size_t size;
+};
+
+static pthread_key_t sSnapshotPoolKey;
+static pthread_once_t sSnapshotPoolOnce = PTHREAD_ONCE_INIT;
+
+static void destroySnapshotPool(void* data) {
+    SnapshotPool* pool = (SnapshotPool*) data;
+    while (pool->head) {
+        SnapshotPoolEntry* entry = pool->head;
+        pool->head = entry->next;
+        ::operator delete(entry);
+    }
+    delete pool;
+}
+
+static void createSnapshotPoolKey() {
+    pthread_key_create(&sSnapshotPoolKey, destroySnapshotPool);
+}
+
+static SnapshotPool* getSnapshotPool() {
+    pthread_once(&sSnapshotPoolOnce, createSnapshotPoolKey);
+    SnapshotPool* pool = (SnapshotPool*) pthread_getspecific(sSnapshotPoolKey);
+    if (!pool) {
+        pool = new SnapshotPool;
+        pool->head = NULL;
+        pool->size = 0;
+        pthread_setspecific(sSnapshotPoolKey, pool);
+    }
+    return pool;
+}
+
+void* Snapshot::operator new(size_t size) {
+    if (size == sizeof(Snapshot)) {
+        SnapshotPool* pool = getSnapshotPool();
+        if (pool->head) {
+            SnapshotPoolEntry* entry = pool->head;
+            pool->head = entry->next;
+            pool->size--;
+            return entry;
+        }
+    }
+    return ::operator new(size);
+}
+
+void Snapshot::operator delete(void* ptr, size_t size) {
+    if (!ptr) return;
+
+    // A snapshot released on another thread simply joins that thread's pool
+    if (size == sizeof(Snapshot)) {
+        SnapshotPool* pool = getSnapshotPool();
+        if (pool->size < SNAPSHOT_POOL_MAX_SIZE) {
+            SnapshotPoolEntry* entry = (SnapshotPoolEntry*) ptr;
+            entry->next = pool->head;
+            pool->head = entry;
+            pool->size++;
+            return;
+        }
+    }
+    ::operator delete(ptr);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Constructors
 ///////////////////////////////////////////////////////////////////////////////
@@ -151,6 +228,19 @@ bool Snapshot::clipRegionNand(float left, float top, float right, float bottom)
 #endif
 }
 
+bool Snapshot::clipRegionReverseNand(float left, float top, float right, float bottom) {
+#if STENCIL_BUFFER_SIZE
+    android::Rect tmp(left, top, right, bottom);
+    Region reverse(tmp);
+    reverse.subtractSelf(*clipRegion);
+    *clipRegion = reverse;
+    copyClipRectFromRegion();
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool Snapshot::clip(float left, float top, float right, float bottom, SkRegion::Op op) {
     Rect r(left, top, right, bottom);
     transform->mapRect(r);
@@ -168,7 +258,7 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
         }
         case SkRegion::kIntersect_Op: {
             if (CC_UNLIKELY(clipRegion)) {
-                clipped = clipRegionOr(r.left, r.top, r.right, r.bottom);
+                clipped = clipRegionAnd(r.left, r.top, r.right, r.bottom);
             } else {
                 clipped = clipRect->intersect(r);
                 if (!clipped) {
@@ -180,7 +270,7 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
         }
         case SkRegion::kUnion_Op: {
             if (CC_UNLIKELY(clipRegion)) {
-                clipped = clipRegionAnd(r.left, r.top, r.right, r.bottom);
+                clipped = clipRegionOr(r.left, r.top, r.right, r.bottom);
             } else {
                 clipped = clipRect->unionWith(r);
             }
@@ -192,7 +282,8 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
             break;
         }
         case SkRegion::kReverseDifference_Op: {
-            // TODO!!!!!!!
+            ensureClipRegion();
+            clipped = clipRegionReverseNand(r.left, r.top, r.right, r.bottom);
             break;
         }
         case SkRegion::kReplace_Op: {
@@ -209,6 +300,56 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
     return clipped;
 }
 
+bool Snapshot::clipRegionTransformed(const SkRegion& region, SkRegion::Op op) {
+    const SkIRect& bounds = region.getBounds();
+    Rect r(bounds.fLeft, bounds.fTop, bounds.fRight, bounds.fBottom);
+
+#if STENCIL_BUFFER_SIZE
+    // Rectangular clips do not need the stencil buffer
+    if (CC_LIKELY(region.isRect() || region.isEmpty())) {
+        return clipTransformed(r, op);
+    }
+
+    Region tmp;
+    SkRegion::Iterator it(region);
+    while (!it.done()) {
+        const SkIRect& rect = it.rect();
+        tmp.orSelf(android::Rect(rect.fLeft, rect.fTop, rect.fRight, rect.fBottom));
+        it.next();
+    }
+
+    ensureClipRegion();
+    switch (op) {
+        case SkRegion::kDifference_Op:
+            clipRegion->subtractSelf(tmp);
+            break;
+        case SkRegion::kIntersect_Op:
+            clipRegion->andSelf(tmp);
+            break;
+        case SkRegion::kUnion_Op:
+            clipRegion->orSelf(tmp);
+            break;
+        case SkRegion::kXOR_Op:
+            clipRegion->xorSelf(tmp);
+            break;
+        case SkRegion::kReverseDifference_Op:
+            tmp.subtractSelf(*clipRegion);
+            *clipRegion = tmp;
+            break;
+        case SkRegion::kReplace_Op:
+            *clipRegion = tmp;
+            break;
+    }
+    copyClipRectFromRegion();
+
+    flags |= Snapshot::kFlagClipSet;
+    return true;
+#else
+    // Without a stencil buffer the clip is approximated by its bounds
+    return clipTransformed(r, op);
+#endif
+}
+
 void Snapshot::setClip(float left, float top, float right, float bottom) {
     clipRect->set(left, top, right, bottom);
 #if STENCIL_BUFFER_SIZE
@@ -47,6 +47,14 @@ public:
     Snapshot();
     Snapshot(const sp<Snapshot>& s, int saveFlags);
 
+    /**
+     * A snapshot is created by every save() and destroyed by the matching
+     * restore(), so their storage is recycled through a small per-thread
+     * free list instead of going back to the heap.
+     */
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size);
+
     /**
      * Various flags set on ::flags.
      */
@@ -93,6 +101,14 @@ public:
      */
     bool clipTransformed(const Rect& r, SkRegion::Op op = SkRegion::kIntersect_Op);
 
+    /**
+     * Modifies the current clip with the specified region and operation.
+     * The region is considered already transformed. When the resulting
+     * clip is not a rectangle, it is kept in clipRegion and clipRect
+     * holds its bounds.
+     */
+    bool clipRegionTransformed(const SkRegion& region, SkRegion::Op op = SkRegion::kIntersect_Op);
+
     /**
      * Sets the current clip.
      */
@@ -227,6 +243,7 @@ private:
     bool clipRegionXor(float left, float top, float right, float bottom);
     bool clipRegionAnd(float left, float top, float right, float bottom);
     bool clipRegionNand(float left, float top, float right, float bottom);
+    bool clipRegionReverseNand(float left, float top, float right, float bottom);
 
     mat4 mTransformRoot;
     Rect mClipRectRoot;
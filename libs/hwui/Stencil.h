@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_STENCIL_H
+#define ANDROID_HWUI_STENCIL_H
+
+#include <GLES2/gl2.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Stencil buffer management
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Tracks the state of the stencil test used to clip drawing to
+ * non-rectangular regions. Clip regions are written with a value of 1
+ * and drawing only passes where the stencil buffer contains 1.
+ */
+class Stencil {
+public:
+    Stencil();
+
+    /**
+     * Clears the stencil buffer. The clear is restricted by the scissor.
+     */
+    void clear();
+
+    /**
+     * Enables stencil writes. Color writes are disabled until the stencil
+     * test is enabled or the stencil is disabled.
+     */
+    void enableWrite();
+
+    /**
+     * Only lets drawing through where the stencil buffer was written.
+     */
+    void enableTest();
+
+    /**
+     * Disables stencil writes and testing.
+     */
+    void disable();
+
+    /**
+     * Forces the state to be set again on the next call. Must be invoked
+     * when the GL context was modified behind this object's back.
+     */
+    void reset() {
+        mState = kUnknown;
+    }
+
+    inline bool isTestEnabled() const {
+        return mState == kTest;
+    }
+
+private:
+    void enable();
+
+    enum StencilState {
+        kUnknown,
+        kDisabled,
+        kTest,
+        kWrite
+    };
+
+    StencilState mState;
+}; // class Stencil
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_STENCIL_H
@@ -107,6 +107,8 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
     ShadowTexture* texture = mCache.get(entry);
 
     if (!texture) {
+        stats.miss();
+
         FontRenderer::DropShadow shadow = mRenderer->renderDropShadow(paint, text, 0,
                 len, numGlyphs, radius);
 
@@ -155,6 +157,8 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
 
         // Cleanup shadow
         delete[] shadow.image;
+    } else {
+        stats.hit();
     }
 
     return texture;
@@ -26,6 +26,7 @@
 #include "utils/Compare.h"
 #include "utils/GenerationCache.h"
 #include "FontRenderer.h"
+#include "RenderStats.h"
 #include "Texture.h"
 
 namespace android {
@@ -141,6 +142,11 @@ public:
      */
     uint32_t getSize();
 
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 private:
     void init();
 
@@ -22,6 +22,7 @@
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "TextureCache.h"
 #include "Properties.h"
 
@@ -63,6 +64,26 @@ TextureCache::TextureCache(uint32_t maxByteSize):
 }
 
 TextureCache::~TextureCache() {
+    if (mPrefetchThread != NULL) {
+        {
+            Mutex::Autolock _l(mPrefetchLock);
+            mPrefetchThread->requestExit();
+            mPrefetchCondition.broadcast();
+        }
+        mPrefetchThread->requestExitAndWait();
+        mPrefetchThread.clear();
+    }
+
+    // The resource cache might already be destroyed, only drop the locks
+    for (size_t i = 0; i < mPrefetched.size(); i++) {
+        PrefetchEntry* entry = mPrefetched.valueAt(i);
+        if (entry->state == PrefetchEntry::kReady) {
+            entry->pinned.unlockPixels();
+        }
+        delete entry;
+    }
+    mPrefetched.clear();
+
     mCache.clear();
 }
 
@@ -124,6 +145,8 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
     Texture* texture = mCache.get(bitmap);
 
     if (!texture) {
+        stats.miss();
+
         if (bitmap->width() > mMaxTextureSize || bitmap->height() > mMaxTextureSize) {
             ALOGW("Bitmap too large to be uploaded into a texture (%dx%d, max=%dx%d)",
                     bitmap->width(), bitmap->height(), mMaxTextureSize, mMaxTextureSize);
@@ -138,9 +161,13 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
             }
         }
 
+        PrefetchEntry* entry = acquirePrefetched(bitmap);
+
         texture = new Texture;
         texture->bitmapSize = size;
-        generateTexture(bitmap, texture, false);
+        generateTexture(bitmap, texture, false, getConverted(bitmap, entry));
+
+        if (entry) releasePrefetched(entry);
 
         if (size < mMaxSize) {
             mSize += size;
@@ -154,7 +181,13 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
             texture->cleanup = true;
         }
     } else if (bitmap->getGenerationID() != texture->generation) {
-        generateTexture(bitmap, texture, true);
+        stats.miss();
+
+        PrefetchEntry* entry = acquirePrefetched(bitmap);
+        generateTexture(bitmap, texture, true, getConverted(bitmap, entry));
+        if (entry) releasePrefetched(entry);
+    } else {
+        stats.hit();
     }
 
     return texture;
@@ -180,15 +213,20 @@ void TextureCache::removeDeferred(SkBitmap* bitmap) {
 }
 
 void TextureCache::clearGarbage() {
-    Mutex::Autolock _l(mLock);
-    size_t count = mGarbage.size();
-    for (size_t i = 0; i < count; i++) {
-        mCache.remove(mGarbage.itemAt(i));
+    {
+        Mutex::Autolock _l(mLock);
+        size_t count = mGarbage.size();
+        for (size_t i = 0; i < count; i++) {
+            mCache.remove(mGarbage.itemAt(i));
+        }
+        mGarbage.clear();
     }
-    mGarbage.clear();
+
+    expirePrefetched(false);
 }
 
 void TextureCache::clear() {
+    expirePrefetched(true);
     mCache.clear();
     TEXTURE_LOGD("TextureCache:clear(), mSize = %d", mSize);
 }
@@ -208,7 +246,162 @@ void TextureCache::flush() {
     }
 }
 
-void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate) {
+///////////////////////////////////////////////////////////////////////////////
+// Prefetching
+///////////////////////////////////////////////////////////////////////////////
+
+void TextureCache::prefetch(SkBitmap* bitmap) {
+    if (mCache.contains(bitmap)) return;
+
+    // Bitmaps too large to be cached would not benefit from the preparation
+    if (bitmap->width() > mMaxTextureSize || bitmap->height() > mMaxTextureSize ||
+            bitmap->rowBytes() * bitmap->height() >= mMaxSize) {
+        return;
+    }
+
+    {
+        Mutex::Autolock _l(mPrefetchLock);
+        if (mPrefetched.size() >= MAX_PREFETCHED_TEXTURES ||
+                mPrefetched.indexOfKey(bitmap) >= 0) {
+            return;
+        }
+
+        PrefetchEntry* entry = new PrefetchEntry;
+        entry->bitmap = bitmap;
+        entry->pinned = *bitmap;
+        entry->generation = bitmap->getGenerationID();
+        entry->state = PrefetchEntry::kPending;
+        entry->age = 0;
+
+        // Keeps the bitmap alive until the entry is released
+        Caches::getInstance().resourceCache.incrementRefcount(bitmap);
+        mPrefetched.add(bitmap, entry);
+
+        if (mPrefetchThread == NULL) {
+            mPrefetchThread = new PrefetchThread(this);
+            mPrefetchThread->run("TexturePrefetch", PRIORITY_BACKGROUND);
+        }
+        mPrefetchCondition.signal();
+    }
+
+    TEXTURE_LOGD("TextureCache::prefetch: bitmap %p", bitmap);
+}
+
+bool TextureCache::PrefetchThread::threadLoop() {
+    return mCache->preparePrefetched();
+}
+
+bool TextureCache::preparePrefetched() {
+    PrefetchEntry* entry = NULL;
+
+    {
+        Mutex::Autolock _l(mPrefetchLock);
+        while (!entry) {
+            if (mPrefetchThread->exitPending()) {
+                return false;
+            }
+
+            const size_t count = mPrefetched.size();
+            for (size_t i = 0; i < count; i++) {
+                PrefetchEntry* pending = mPrefetched.valueAt(i);
+                if (pending->state == PrefetchEntry::kPending) {
+                    entry = pending;
+                    break;
+                }
+            }
+
+            if (!entry) {
+                mPrefetchCondition.wait(mPrefetchLock);
+            }
+        }
+        entry->state = PrefetchEntry::kPreparing;
+    }
+
+    // The pixels remain locked until the entry is released, this is
+    // where the expensive deferred decoding happens
+    SkBitmap* bitmap = &entry->pinned;
+    bitmap->lockPixels();
+
+    if (bitmap->readyToDraw()) {
+        switch (bitmap->getConfig()) {
+            case SkBitmap::kARGB_4444_Config:
+            case SkBitmap::kIndex8_Config:
+                convertLoFiBitmap(bitmap, entry->converted);
+                break;
+            default:
+                break;
+        }
+    }
+
+    Mutex::Autolock _l(mPrefetchLock);
+    entry->state = PrefetchEntry::kReady;
+    mPrefetchCondition.broadcast();
+
+    return true;
+}
+
+TextureCache::PrefetchEntry* TextureCache::acquirePrefetched(SkBitmap* bitmap) {
+    Mutex::Autolock _l(mPrefetchLock);
+
+    ssize_t index = mPrefetched.indexOfKey(bitmap);
+    if (index < 0) return NULL;
+
+    // Waiting is cheaper than doing the same work twice
+    PrefetchEntry* entry = mPrefetched.valueAt(index);
+    while (entry->state == PrefetchEntry::kPreparing) {
+        mPrefetchCondition.wait(mPrefetchLock);
+    }
+
+    mPrefetched.removeItem(bitmap);
+    return entry;
+}
+
+const SkBitmap* TextureCache::getConverted(SkBitmap* bitmap, const PrefetchEntry* entry) const {
+    if (entry && entry->state == PrefetchEntry::kReady && !entry->converted.isNull() &&
+            entry->generation == bitmap->getGenerationID()) {
+        return &entry->converted;
+    }
+    return NULL;
+}
+
+void TextureCache::releasePrefetched(PrefetchEntry* entry) {
+    if (entry->state == PrefetchEntry::kReady) {
+        entry->pinned.unlockPixels();
+    }
+    // This may destroy the bitmap if it was recycled in the meantime
+    Caches::getInstance().resourceCache.decrementRefcount(entry->bitmap);
+    delete entry;
+}
+
+void TextureCache::expirePrefetched(bool all) {
+    Vector<PrefetchEntry*> expired;
+
+    {
+        Mutex::Autolock _l(mPrefetchLock);
+        for (ssize_t i = mPrefetched.size() - 1; i >= 0; i--) {
+            PrefetchEntry* entry = mPrefetched.valueAt(i);
+            if (entry->state == PrefetchEntry::kPreparing) {
+                continue;
+            }
+            if (all || ++entry->age > MAX_PREFETCHED_TEXTURE_AGE) {
+                expired.add(entry);
+                mPrefetched.removeItemsAt(i);
+            }
+        }
+    }
+
+    const size_t count = expired.size();
+    for (size_t i = 0; i < count; i++) {
+        releasePrefetched(expired.itemAt(i));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Textures
+///////////////////////////////////////////////////////////////////////////////
+
+void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate,
+        const SkBitmap* converted) {
     SkAutoLockPixels alp(*bitmap);
 
     if (!bitmap->readyToDraw()) {
@@ -255,7 +448,12 @@ void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool rege
         break;
     case SkBitmap::kARGB_4444_Config:
     case SkBitmap::kIndex8_Config:
-        uploadLoFiTexture(resize, bitmap, texture->width, texture->height);
+        if (converted) {
+            uploadToTexture(resize, GL_RGBA, converted->rowBytesAsPixels(), texture->height,
+                    GL_UNSIGNED_BYTE, converted->getPixels());
+        } else {
+            uploadLoFiTexture(resize, bitmap, texture->width, texture->height);
+        }
         texture->blend = !bitmap->isOpaque();
         break;
     default:
@@ -269,16 +467,20 @@ void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool rege
     }
 }
 
-void TextureCache::uploadLoFiTexture(bool resize, SkBitmap* bitmap,
-        uint32_t width, uint32_t height) {
-    SkBitmap rgbaBitmap;
-    rgbaBitmap.setConfig(SkBitmap::kARGB_8888_Config, width, height);
+void TextureCache::convertLoFiBitmap(SkBitmap* bitmap, SkBitmap& rgbaBitmap) {
+    rgbaBitmap.setConfig(SkBitmap::kARGB_8888_Config, bitmap->width(), bitmap->height());
     rgbaBitmap.allocPixels();
     rgbaBitmap.eraseColor(0);
     rgbaBitmap.setIsOpaque(bitmap->isOpaque());
 
     SkCanvas canvas(rgbaBitmap);
     canvas.drawBitmap(*bitmap, 0.0f, 0.0f, NULL);
+}
+
+void TextureCache::uploadLoFiTexture(bool resize, SkBitmap* bitmap,
+        uint32_t width, uint32_t height) {
+    SkBitmap rgbaBitmap;
+    convertLoFiBitmap(bitmap, rgbaBitmap);
 
     uploadToTexture(resize, GL_RGBA, rgbaBitmap.rowBytesAsPixels(), height,
             GL_UNSIGNED_BYTE, rgbaBitmap.getPixels());
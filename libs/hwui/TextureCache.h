@@ -19,10 +19,12 @@
 
 #include <SkBitmap.h>
 
-#include <utils/Mutex.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
 #include <utils/Vector.h>
 
 #include "Debug.h"
+#include "RenderStats.h"
 #include "Texture.h"
 #include "utils/GenerationCache.h"
 
@@ -40,6 +42,11 @@ namespace uirenderer {
     #define TEXTURE_LOGD(...)
 #endif
 
+// Maximum number of bitmaps waiting to be drawn after being prefetched
+#define MAX_PREFETCHED_TEXTURES 32
+// Number of frames after which an unused prefetched bitmap is released
+#define MAX_PREFETCHED_TEXTURE_AGE 2
+
 ///////////////////////////////////////////////////////////////////////////////
 // Classes
 ///////////////////////////////////////////////////////////////////////////////
@@ -82,10 +89,23 @@ public:
      */
     void removeDeferred(SkBitmap* bitmap);
     /**
-     * Process deferred removals.
+     * Process deferred removals. Prefetched bitmaps that were not drawn
+     * recently are released.
      */
     void clearGarbage();
 
+    /**
+     * Hints that the specified bitmap will be drawn soon. If the bitmap is
+     * not already in the cache, a background thread locks its pixels, which
+     * forces Skia's deferred decoding, and converts them to a format OpenGL
+     * can upload directly if needed. The next call to get() for this bitmap
+     * only has to upload the prepared pixels.
+     *
+     * A reference to the bitmap is held until it is drawn or until the hint
+     * expires. This must be invoked from the thread owning the GL context.
+     */
+    void prefetch(SkBitmap* bitmap);
+
     /**
      * Clears the cache. This causes all textures to be deleted.
      */
@@ -115,21 +135,86 @@ public:
      */
     void setFlushRate(float flushRate);
 
+    /**
+     * Lookups served by this cache.
+     */
+    CacheStats stats;
+
 private:
+    /**
+     * A bitmap handed to the prefetch thread.
+     */
+    struct PrefetchEntry {
+        enum State {
+            kPending,
+            kPreparing,
+            kReady
+        };
+
+        SkBitmap* bitmap;
+        // Copy made by the drawing thread, sharing the pixel ref of bitmap.
+        // The prefetch thread only locks the pixels through this copy since
+        // SkBitmap itself is not thread safe.
+        SkBitmap pinned;
+        uint32_t generation;
+        // RGBA copy of the bitmap when its config cannot be uploaded directly
+        SkBitmap converted;
+        State state;
+        int age;
+    };
+
+    /**
+     * Prepares the bitmaps queued by prefetch().
+     */
+    class PrefetchThread: public Thread {
+    public:
+        PrefetchThread(TextureCache* cache): Thread(false), mCache(cache) { }
+
+    private:
+        virtual bool threadLoop();
+
+        TextureCache* mCache;
+    }; // class PrefetchThread
+
     /**
      * Generates the texture from a bitmap into the specified texture structure.
      *
      * @param regenerate If true, the bitmap data is reuploaded into the texture, but
      *        no new texture is generated.
+     * @param converted Optional RGBA copy of a lo-fi bitmap, prepared by the
+     *        prefetch thread
      */
-    void generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate = false);
+    void generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate = false,
+            const SkBitmap* converted = NULL);
 
+    void convertLoFiBitmap(SkBitmap* bitmap, SkBitmap& rgbaBitmap);
     void uploadLoFiTexture(bool resize, SkBitmap* bitmap, uint32_t width, uint32_t height);
     void uploadToTexture(bool resize, GLenum format, GLsizei width, GLsizei height,
             GLenum type, const GLvoid * data);
 
     void init();
 
+    /**
+     * Invoked by the prefetch thread, returns false when the thread must exit.
+     */
+    bool preparePrefetched();
+    /**
+     * Removes the prefetch entry of the specified bitmap, if any. Waits for
+     * the prefetch thread if it is currently preparing this bitmap.
+     */
+    PrefetchEntry* acquirePrefetched(SkBitmap* bitmap);
+    /**
+     * Returns the RGBA pixels prepared for the bitmap, or NULL if they
+     * cannot be used.
+     */
+    const SkBitmap* getConverted(SkBitmap* bitmap, const PrefetchEntry* entry) const;
+    void releasePrefetched(PrefetchEntry* entry);
+    /**
+     * Releases the prefetched bitmaps older than MAX_PREFETCHED_TEXTURE_AGE
+     * frames, or all of them if all is true.
+     */
+    void expirePrefetched(bool all);
+
     GenerationCache<SkBitmap*, Texture*> mCache;
 
     uint32_t mSize;
@@ -142,6 +227,11 @@ private:
 
     Vector<SkBitmap*> mGarbage;
     mutable Mutex mLock;
+
+    KeyedVector<SkBitmap*, PrefetchEntry*> mPrefetched;
+    sp<PrefetchThread> mPrefetchThread;
+    Mutex mPrefetchLock;
+    Condition mPrefetchCondition;
 }; // class TextureCache
 
 }; // namespace uirenderer
@@ -69,23 +69,29 @@ struct AlphaVertex : Vertex {
 }; // struct AlphaVertex
 
 /**
- * Simple structure to describe a vertex with a position and an alpha value.
+ * Simple structure to describe a vertex of an anti-aliased primitive. The width
+ * and length values hold the distances of the vertex to both edges of the
+ * primitive, across its width and along its length, expressed in units of
+ * the AA boundary. Storing the boundary per vertex lets primitives with
+ * different boundaries share a single draw call.
  */
 struct AAVertex : Vertex {
-    float width;
-    float length;
+    float width[2];
+    float length[2];
 
-    static inline void set(AAVertex* vertex, float x, float y, float width, float length) {
+    /**
+     * Sets the position of the vertex. The width and length arguments are
+     * proportions, from 0 to 1, of the primitive's width and length.
+     */
+    static inline void set(AAVertex* vertex, float x, float y, float width, float length,
+            float inverseBoundaryWidth, float inverseBoundaryLength) {
         Vertex::set(vertex, x, y);
-        vertex[0].width = width;
-        vertex[0].length = length;
-    }
-
-    static inline void setColor(AAVertex* vertex, float width, float length) {
-        vertex[0].width = width;
-        vertex[0].length = length;
+        vertex[0].width[0] = width * inverseBoundaryWidth;
+        vertex[0].width[1] = (1.0f - width) * inverseBoundaryWidth;
+        vertex[0].length[0] = length * inverseBoundaryLength;
+        vertex[0].length[1] = (1.0f - length) * inverseBoundaryLength;
     }
-}; // struct AlphaVertex
+}; // struct AAVertex
 
 }; // namespace uirenderer
 }; // namespace android
@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwuibench"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <SkBitmap.h>
+#include <SkCanvas.h>
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "LayerRenderer.h"
+
+using namespace android;
+using namespace android::uirenderer;
+
+/**
+ * Records display lists representative of common UI content and replays
+ * them offscreen, into an FBO, for a number of frames. For each scene the
+ * benchmark reports the CPU time spent replaying a frame, the time then
+ * spent waiting for the GPU to finish it, the GL work issued per frame and
+ * the hit rate of each cache.
+ *
+ * Usage: hwuibench [-w width] [-h height] [-f frames] [-d] [scene...]
+ */
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_WIDTH 480
+#define DEFAULT_HEIGHT 800
+#define DEFAULT_FRAME_COUNT 100
+// Frames drawn before measuring, to fill the caches and compile the programs
+#define WARMUP_FRAME_COUNT 10
+
+///////////////////////////////////////////////////////////////////////////////
+// Scenes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Holds the display lists of a scene and the resources they reference.
+ * The last display list is drawn by the benchmark, the others are its
+ * children.
+ */
+struct Scene {
+    ~Scene() {
+        for (size_t i = 0; i < displayLists.size(); i++) {
+            delete displayLists.itemAt(i);
+        }
+        for (size_t i = 0; i < bitmaps.size(); i++) {
+            delete bitmaps.itemAt(i);
+        }
+        for (size_t i = 0; i < paths.size(); i++) {
+            delete paths.itemAt(i);
+        }
+    }
+
+    SkBitmap* createBitmap(int width, int height, SkColor color) {
+        SkBitmap* bitmap = new SkBitmap;
+        bitmap->setConfig(SkBitmap::kARGB_8888_Config, width, height);
+        bitmap->allocPixels();
+        bitmap->eraseColor(color);
+        bitmaps.add(bitmap);
+        return bitmap;
+    }
+
+    SkPath* createPath() {
+        SkPath* path = new SkPath;
+        paths.add(path);
+        return path;
+    }
+
+    DisplayList* root() const {
+        return displayLists.top();
+    }
+
+    Vector<DisplayList*> displayLists;
+    Vector<SkBitmap*> bitmaps;
+    Vector<SkPath*> paths;
+};
+
+// libhwui only exports a few renderer methods, such as the constructors, so
+// the renderers are allocated on the heap and drawn to through the virtuals
+// of OpenGLRenderer.
+typedef void (*SceneRecorder)(Scene& scene, OpenGLRenderer& renderer,
+        int width, int height);
+
+static void drawGlyphs(OpenGLRenderer& renderer, const char* text,
+        float x, float y, SkPaint* paint) {
+    const size_t length = strlen(text);
+    uint16_t* glyphs = new uint16_t[length];
+    const int count = paint->textToGlyphs(text, length, glyphs);
+
+    SkPaint glyphPaint(*paint);
+    glyphPaint.setTextEncoding(SkPaint::kGlyphID_TextEncoding);
+    renderer.drawText((const char*) glyphs, count * 2, count, x, y, &glyphPaint);
+
+    delete[] glyphs;
+}
+
+static void recordRects(Scene& scene, OpenGLRenderer& renderer, int width, int height) {
+    SkPaint paint;
+    const float size = 40.0f;
+    for (float y = 0.0f; y < height; y += size) {
+        for (float x = 0.0f; x < width; x += size) {
+            const int c = int(x + y) & 0xff;
+            paint.setColor(SkColorSetARGB(0xff - (c >> 2), c, 0xff - c, 0x80));
+            renderer.drawRect(x, y, x + size - 2.0f, y + size - 2.0f, &paint);
+        }
+    }
+}
+
+static void recordShapes(Scene& scene, OpenGLRenderer& renderer, int width, int height) {
+    SkPaint paint;
+    paint.setAntiAlias(true);
+    const float size = 60.0f;
+    int i = 0;
+    for (float y = 0.0f; y < height; y += size) {
+        for (float x = 0.0f; x < width; x += size, i++) {
+            paint.setColor(i & 1 ? 0xff33b5e5 : 0xff99cc00);
+            paint.setStyle(i & 2 ? SkPaint::kStroke_Style : SkPaint::kFill_Style);
+            paint.setStrokeWidth(4.0f);
+            switch (i % 3) {
+                case 0:
+                    renderer.drawRoundRect(x + 4.0f, y + 4.0f, x + size - 4.0f, y + size - 4.0f,
+                            8.0f, 8.0f, &paint);
+                    break;
+                case 1:
+                    renderer.drawCircle(x + size / 2.0f, y + size / 2.0f, size / 2.0f - 4.0f,
+                            &paint);
+                    break;
+                case 2:
+                    renderer.drawOval(x + 4.0f, y + 12.0f, x + size - 4.0f, y + size - 12.0f,
+                            &paint);
+                    break;
+            }
+        }
+    }
+}
+
+static void recordText(Scene& scene, OpenGLRenderer& renderer, int width, int height) {
+    static const SkColor colors[] = { 0xff000000, 0xffffffff, 0xff808080, 0xff33b5e5 };
+    static const char* lines[] = {
+        "The quick brown fox jumps over the lazy dog",
+        "Pack my box with five dozen liquor jugs 0123456789",
+        "Sphinx of black quartz, judge my vow!"
+    };
+
+    SkPaint background;
+    background.setColor(0xff404040);
+    renderer.drawRect(0.0f, 0.0f, width, height, &background);
+
+    SkPaint paint;
+    paint.setAntiAlias(true);
+    int i = 0;
+    for (float y = 20.0f; y < height; y += 20.0f, i++) {
+        paint.setColor(colors[i % 4]);
+        paint.setTextSize(12.0f + (i % 3) * 4.0f);
+        drawGlyphs(renderer, lines[i % 3], 4.0f, y, &paint);
+    }
+}
+
+static void recordBitmaps(Scene& scene, OpenGLRenderer& renderer, int width, int height) {
+    static const SkColor colors[] = { 0xffff4444, 0xffffbb33, 0xff99cc00, 0xffaa66cc };
+
+    SkBitmap* bitmaps[4];
+    for (int i = 0; i < 4; i++) {
+        bitmaps[i] = scene.createBitmap(64 + i * 16, 64 + i * 16, colors[i]);
+    }
+
+    SkPaint paint;
+    paint.setFilterBitmap(true);
+    int i = 0;
+    for (float y = 0.0f; y < height; y += 72.0f) {
+        for (float x = 0.0f; x < width; x += 72.0f, i++) {
+            SkBitmap* bitmap = bitmaps[i % 4];
+            renderer.drawBitmap(bitmap, 0.0f, 0.0f, bitmap->width(), bitmap->height(),
+                    x, y, x + 64.0f, y + 64.0f, &paint);
+        }
+    }
+}
+
+static void recordPaths(Scene& scene, OpenGLRenderer& renderer, int width, int height) {
+    SkPath* star = scene.createPath();
+    star->moveTo(30.0f, 0.0f);
+    star->lineTo(39.0f, 20.0f);
+    star->lineTo(60.0f, 22.0f);
+    star->lineTo(44.0f, 37.0f);
+    star->lineTo(48.0f, 58.0f);
+    star->lineTo(30.0f, 47.0f);
+    star->lineTo(12.0f, 58.0f);
+    star->lineTo(16.0f, 37.0f);
+    star->lineTo(0.0f, 22.0f);
+    star->lineTo(21.0f, 20.0f);
+    star->close();
+
+    SkPath* curve = scene.createPath();
+    curve->moveTo(0.0f, 30.0f);
+    curve->cubicTo(15.0f, 0.0f, 45.0f, 60.0f, 60.0f, 30.0f);
+
+    SkPaint fill;
+    fill.setAntiAlias(true);
+    fill.setColor(0xffffbb33);
+
+    SkPaint stroke;
+    stroke.setAntiAlias(true);
+    stroke.setStyle(SkPaint::kStroke_Style);
+    stroke.setStrokeWidth(3.0f);
+    stroke.setColor(0xff0099cc);
+
+    for (float y = 0.0f; y < height; y += 64.0f) {
+        for (float x = 0.0f; x < width; x += 64.0f) {
+            renderer.save(SkCanvas::kMatrix_SaveFlag);
+            renderer.translate(x, y);
+            renderer.drawPath(star, &fill);
+            renderer.drawPath(curve, &stroke);
+            renderer.restore();
+        }
+    }
+}
+
+/**
+ * A list of rows, each recorded in its own display list: a background,
+ * an icon and two lines of text.
+ */
+static void recordList(Scene& scene, OpenGLRenderer& renderer, int width, int height) {
+    SkBitmap* icon = scene.createBitmap(48, 48, 0xff33b5e5);
+
+    SkPaint background;
+    SkPaint divider;
+    divider.setColor(0xff303030);
+
+    SkPaint title;
+    title.setAntiAlias(true);
+    title.setTextSize(18.0f);
+    title.setColor(0xffffffff);
+
+    SkPaint subtitle;
+    subtitle.setAntiAlias(true);
+    subtitle.setTextSize(14.0f);
+    subtitle.setColor(0xff808080);
+
+    const float rowHeight = 64.0f;
+    int i = 0;
+    for (float y = 0.0f; y < height; y += rowHeight, i++) {
+        DisplayListRenderer* recorder = new DisplayListRenderer();
+        OpenGLRenderer& row(*recorder);
+        row.setViewport(width, rowHeight);
+        row.prepare(false);
+
+        background.setColor(i & 1 ? 0xff101010 : 0xff181818);
+        row.drawRect(0.0f, 0.0f, width, rowHeight, &background);
+        row.drawBitmap(icon, 8.0f, 8.0f, NULL);
+        drawGlyphs(row, "Inbox, 12 unread messages", 64.0f, 28.0f, &title);
+        drawGlyphs(row, "Last synced a few minutes ago", 64.0f, 50.0f, &subtitle);
+        row.drawRect(0.0f, rowHeight - 1.0f, width, rowHeight, &divider);
+
+        row.finish();
+        DisplayList* displayList = recorder->getDisplayList(NULL);
+        scene.displayLists.add(displayList);
+        delete recorder;
+
+        uirenderer::Rect dirty;
+        renderer.save(SkCanvas::kMatrix_SaveFlag);
+        renderer.translate(0.0f, y);
+        renderer.drawDisplayList(displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
+        renderer.restore();
+    }
+}
+
+struct SceneInfo {
+    const char* name;
+    SceneRecorder record;
+};
+
+static const SceneInfo gScenes[] = {
+    { "rects", recordRects },
+    { "shapes", recordShapes },
+    { "text", recordText },
+    { "bitmaps", recordBitmaps },
+    { "paths", recordPaths },
+    { "list", recordList }
+};
+static const int gSceneCount = sizeof(gScenes) / sizeof(SceneInfo);
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+static int compareTimes(const void* lhs, const void* rhs) {
+    const nsecs_t a = *(const nsecs_t*) lhs;
+    const nsecs_t b = *(const nsecs_t*) rhs;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static void printTimes(const char* label, Vector<nsecs_t>& times) {
+    qsort(times.editArray(), times.size(), sizeof(nsecs_t), compareTimes);
+
+    nsecs_t total = 0;
+    for (size_t i = 0; i < times.size(); i++) {
+        total += times.itemAt(i);
+    }
+
+    printf("  %-19s min %7.3f  median %7.3f  avg %7.3f  max %7.3f ms\n", label,
+            times.itemAt(0) / 1000000.0f, times.itemAt(times.size() / 2) / 1000000.0f,
+            total / float(times.size()) / 1000000.0f, times.top() / 1000000.0f);
+}
+
+static void runScene(const SceneInfo& info, OpenGLRenderer& renderer,
+        int width, int height, int frameCount, bool dump) {
+    Caches& caches = Caches::getInstance();
+
+    Scene scene;
+    DisplayListRenderer* recorder = new DisplayListRenderer();
+    OpenGLRenderer& recording(*recorder);
+    recording.setViewport(width, height);
+    recording.prepare(false);
+    info.record(scene, recording, width, height);
+    recording.finish();
+    scene.displayLists.add(recorder->getDisplayList(NULL));
+    delete recorder;
+
+    if (dump) {
+        renderer.outputDisplayList(scene.root());
+    }
+
+    Vector<nsecs_t> cpuTimes;
+    Vector<nsecs_t> gpuTimes;
+
+    for (int i = -WARMUP_FRAME_COUNT; i < frameCount; i++) {
+        if (i == 0) caches.resetStats();
+
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        uirenderer::Rect dirty;
+        renderer.prepare(true);
+        renderer.drawDisplayList(scene.root(), dirty, DisplayList::kReplayFlag_ClipChildren);
+        renderer.finish();
+
+        const nsecs_t issued = systemTime(SYSTEM_TIME_MONOTONIC);
+        glFinish();
+        const nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        caches.clearGarbage();
+
+        if (i >= 0) {
+            cpuTimes.add(issued - start);
+            gpuTimes.add(end - issued);
+        }
+    }
+
+    const RenderStats& stats = caches.stats;
+    printf("%s: %d frames, %dx%d\n", info.name, frameCount, width, height);
+    printTimes("CPU time", cpuTimes);
+    printTimes("GPU wait time", gpuTimes);
+    printf("  Per frame: %.1f draw calls, %.1f program changes, %.1f blending changes, "
+            "%.1f buffer changes, %.1f texture unit changes\n",
+            stats.drawCalls / float(frameCount), stats.programChanges / float(frameCount),
+            stats.blendChanges / float(frameCount), stats.bufferChanges / float(frameCount),
+            stats.textureUnitChanges / float(frameCount));
+
+    String8 log;
+    caches.dumpStats(log);
+    printf("%s\n", log.string());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EGL
+///////////////////////////////////////////////////////////////////////////////
+
+static bool initEgl(EGLDisplay* outDisplay, EGLSurface* outSurface, EGLContext* outContext) {
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_STENCIL_SIZE, EGLint(OpenGLRenderer::getStencilSize()),
+        EGL_NONE
+    };
+    // The benchmark draws into an FBO, the surface only makes the context current
+    const EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        fprintf(stderr, "Could not initialize EGL\n");
+        return false;
+    }
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) ||
+            configCount == 0) {
+        fprintf(stderr, "Could not find an EGL config\n");
+        return false;
+    }
+
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(display, surface, surface, context)) {
+        fprintf(stderr, "Could not create a GL context (0x%x)\n", eglGetError());
+        return false;
+    }
+
+    *outDisplay = display;
+    *outSurface = surface;
+    *outContext = context;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-w width] [-h height] [-f frames] [-d] [scene...]\n", program);
+    fprintf(stderr, "  -d: print the operations of each scene's display list\n");
+    fprintf(stderr, "Scenes:");
+    for (int i = 0; i < gSceneCount; i++) {
+        fprintf(stderr, " %s", gScenes[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv) {
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    int frameCount = DEFAULT_FRAME_COUNT;
+    bool dump = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:h:f:d")) != -1) {
+        switch (opt) {
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'h':
+                height = atoi(optarg);
+                break;
+            case 'f':
+                frameCount = atoi(optarg);
+                break;
+            case 'd':
+                dump = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (width <= 0 || height <= 0 || frameCount <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++) {
+        bool found = false;
+        for (int j = 0; j < gSceneCount && !found; j++) {
+            found = !strcmp(argv[i], gScenes[j].name);
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown scene %s\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+    if (!initEgl(&display, &surface, &context)) {
+        return 1;
+    }
+
+    Layer* layer = LayerRenderer::createLayer(width, height, true);
+    if (!layer) {
+        fprintf(stderr, "Could not create a %dx%d layer\n", width, height);
+        return 1;
+    }
+
+    OpenGLRenderer* renderer = new LayerRenderer(layer);
+    renderer->setViewport(width, height);
+
+    for (int i = 0; i < gSceneCount; i++) {
+        bool selected = optind == argc;
+        for (int j = optind; j < argc && !selected; j++) {
+            selected = !strcmp(argv[j], gScenes[i].name);
+        }
+        if (selected) {
+            runScene(gScenes[i], *renderer, width, height, frameCount, dump);
+        }
+    }
+
+    delete renderer;
+
+    LayerRenderer::destroyLayer(layer);
+    Caches::getInstance().flush(Caches::kFlushMode_Full);
+    Caches::getInstance().terminate();
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglDestroySurface(display, surface);
+    eglTerminate(display);
+
+    return 0;
+}
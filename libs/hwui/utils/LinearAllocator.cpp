@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "LinearAllocator.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Most display lists only need a few paints and matrices, start small
+// and double the size of the pages as they fill up
+#define INITIAL_PAGE_SIZE 512
+#define MAX_PAGE_SIZE (16 * 1024)
+
+#define ALIGNMENT 8
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+// Allocations larger than this get a page of their own, to avoid wasting
+// the end of the current page
+#define MAX_WASTE_RATIO 2
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+LinearAllocator::LinearAllocator(): mPages(NULL), mNext(NULL), mEnd(NULL),
+        mPageSize(INITIAL_PAGE_SIZE), mUsedSize(0), mTotalSize(0) {
+}
+
+LinearAllocator::~LinearAllocator() {
+    Page* page = mPages;
+    while (page) {
+        Page* next = page->next;
+        free(page);
+        page = next;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation
+///////////////////////////////////////////////////////////////////////////////
+
+LinearAllocator::Page* LinearAllocator::newPage(size_t size) {
+    size_t allocationSize = ALIGN(sizeof(Page)) + size;
+    Page* page = (Page*) malloc(allocationSize);
+    if (!page) abort();
+
+    page->next = NULL;
+    mTotalSize += allocationSize;
+    return page;
+}
+
+void* LinearAllocator::alloc(size_t size) {
+    size = ALIGN(size);
+    mUsedSize += size;
+
+    if (mNext && size <= (size_t) (mEnd - mNext)) {
+        void* result = mNext;
+        mNext += size;
+        return result;
+    }
+
+    if (size > mPageSize / MAX_WASTE_RATIO) {
+        // Insert the dedicated page behind the current page to keep
+        // allocating from the latter
+        Page* page = newPage(size);
+        if (mPages) {
+            page->next = mPages->next;
+            mPages->next = page;
+        } else {
+            page->next = NULL;
+            mPages = page;
+        }
+        return ((char*) page) + ALIGN(sizeof(Page));
+    }
+
+    if (mPages) {
+        mPageSize = mPageSize * 2 > MAX_PAGE_SIZE ? MAX_PAGE_SIZE : mPageSize * 2;
+    }
+
+    Page* page = newPage(mPageSize);
+    page->next = mPages;
+    mPages = page;
+
+    mNext = ((char*) page) + ALIGN(sizeof(Page));
+    mEnd = mNext + mPageSize;
+
+    void* result = mNext;
+    mNext += size;
+    return result;
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_LINEAR_ALLOCATOR_H
+#define ANDROID_HWUI_LINEAR_ALLOCATOR_H
+
+#include <new>
+
+#include <stddef.h>
+
+#include <utils/RefBase.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Bump pointer allocator. Memory is carved out of pages that are only
+ * released, all at once, when the allocator is destroyed. Objects created
+ * in the allocator are never destroyed by it: callers must run the
+ * destructors of objects that hold resources.
+ */
+class LinearAllocator: public LightRefBase<LinearAllocator> {
+public:
+    LinearAllocator();
+    ~LinearAllocator();
+
+    /**
+     * Returns a block of the specified size, aligned on 8 bytes.
+     */
+    void* alloc(size_t size);
+
+    /**
+     * Copy constructs the specified object in this allocator.
+     */
+    template<typename T>
+    T* create(const T& value) {
+        return new (alloc(sizeof(T))) T(value);
+    }
+
+    /**
+     * Number of bytes handed out by alloc().
+     */
+    size_t usedSize() const {
+        return mUsedSize;
+    }
+
+    /**
+     * Number of bytes allocated in pages, including the page headers.
+     */
+    size_t totalSize() const {
+        return mTotalSize;
+    }
+
+private:
+    struct Page {
+        Page* next;
+    };
+
+    Page* newPage(size_t size);
+
+    // Pages are kept in a list, the current page is at the head
+    Page* mPages;
+    char* mNext;
+    char* mEnd;
+
+    size_t mPageSize;
+    size_t mUsedSize;
+    size_t mTotalSize;
+}; // class LinearAllocator
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_LINEAR_ALLOCATOR_H
@@ -50,6 +50,7 @@ enum {
     TRANSACTION_isExternalStorageEmulated,
     TRANSACTION_decryptStorage,
     TRANSACTION_encryptStorage,
+    TRANSACTION_cancelObbAction,
 };
 
 class BpMountService: public BpInterface<IMountService>
@@ -508,6 +509,23 @@ public:
         return true;
     }
 
+    void cancelObbAction(const sp<IObbActionListener>& token, const int32_t nonce)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(IMountService::getInterfaceDescriptor());
+        data.writeStrongBinder(token->asBinder());
+        data.writeInt32(nonce);
+        if (remote()->transact(TRANSACTION_cancelObbAction, data, &reply) != NO_ERROR) {
+            ALOGD("cancelObbAction could not contact remote\n");
+            return;
+        }
+        int32_t err = reply.readExceptionCode();
+        if (err < 0) {
+            ALOGD("cancelObbAction caught exception %d\n", err);
+            return;
+        }
+    }
+
     int32_t decryptStorage(const String16& password)
     {
         Parcel data, reply;
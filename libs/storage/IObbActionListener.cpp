@@ -21,6 +21,7 @@ namespace android {
 
 enum {
     TRANSACTION_onObbResult = IBinder::FIRST_CALL_TRANSACTION,
+    TRANSACTION_onObbProgress,
 };
 
 // This is a stub that real consumers should override.
@@ -50,6 +51,16 @@ status_t BnObbActionListener::onTransact(
             reply->writeNoException();
             return NO_ERROR;
         } break;
+        case TRANSACTION_onObbProgress: {
+            CHECK_INTERFACE(IObbActionListener, data, reply);
+            String16 filename = data.readString16();
+            int32_t nonce = data.readInt32();
+            int32_t stage = data.readInt32();
+            int32_t progress = data.readInt32();
+            onObbProgress(filename, nonce, stage, progress);
+            reply->writeNoException();
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
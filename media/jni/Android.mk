@@ -60,6 +60,10 @@ LOCAL_C_INCLUDES += \
 
 LOCAL_CFLAGS +=
 
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+
 LOCAL_LDLIBS := -lpthread
 
 LOCAL_MODULE:= libmedia_jni
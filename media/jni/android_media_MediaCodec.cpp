@@ -53,6 +53,8 @@ enum {
 struct fields_t {
     jfieldID context;
 
+    jmethodID bufferInfoSetID;
+
     jfieldID cryptoInfoNumSubSamplesID;
     jfieldID cryptoInfoNumBytesOfClearDataID;
     jfieldID cryptoInfoNumBytesOfEncryptedDataID;
@@ -76,6 +78,9 @@ JMediaCodec::JMediaCodec(
     mClass = (jclass)env->NewGlobalRef(clazz);
     mObject = env->NewWeakGlobalRef(thiz);
 
+    mBufferCache[0].mArray = NULL;
+    mBufferCache[1].mArray = NULL;
+
     mLooper = new ALooper;
     mLooper->setName("MediaCodec_looper");
 
@@ -100,6 +105,8 @@ JMediaCodec::~JMediaCodec() {
 
     JNIEnv *env = AndroidRuntime::getJNIEnv();
 
+    clearBufferCaches(env);
+
     env->DeleteWeakGlobalRef(mObject);
     mObject = NULL;
     env->DeleteGlobalRef(mClass);
@@ -128,6 +135,8 @@ status_t JMediaCodec::start() {
 status_t JMediaCodec::stop() {
     mSurfaceTextureClient.clear();
 
+    clearBufferCaches(AndroidRuntime::getJNIEnv());
+
     return mCodec->stop();
 }
 
@@ -174,10 +183,8 @@ status_t JMediaCodec::dequeueOutputBuffer(
         return err;
     }
 
-    jclass clazz = env->FindClass("android/media/MediaCodec$BufferInfo");
-
-    jmethodID method = env->GetMethodID(clazz, "set", "(IIJI)V");
-    env->CallVoidMethod(bufferInfo, method, offset, size, timeUs, flags);
+    env->CallVoidMethod(
+            bufferInfo, gFields.bufferInfoSetID, offset, size, timeUs, flags);
 
     return OK;
 }
@@ -198,8 +205,35 @@ status_t JMediaCodec::getOutputFormat(JNIEnv *env, jobject *format) const {
     return ConvertMessageToMap(env, msg, format);
 }
 
+void JMediaCodec::clearBufferCaches(JNIEnv *env) {
+    for (size_t i = 0; i < NELEM(mBufferCache); ++i) {
+        if (mBufferCache[i].mArray != NULL) {
+            env->DeleteGlobalRef(mBufferCache[i].mArray);
+            mBufferCache[i].mArray = NULL;
+        }
+        mBufferCache[i].mBuffers.clear();
+    }
+}
+
+static bool sameBuffers(
+        const Vector<sp<ABuffer> > &a, const Vector<sp<ABuffer> > &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a.itemAt(i) != b.itemAt(i)
+                || a.itemAt(i)->base() != b.itemAt(i)->base()
+                || a.itemAt(i)->capacity() != b.itemAt(i)->capacity()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 status_t JMediaCodec::getBuffers(
-        JNIEnv *env, bool input, jobjectArray *bufArray) const {
+        JNIEnv *env, bool input, jobjectArray *bufArray) {
     Vector<sp<ABuffer> > buffers;
 
     status_t err =
@@ -211,6 +245,28 @@ status_t JMediaCodec::getBuffers(
         return err;
     }
 
+    BufferCache *cache = &mBufferCache[input ? 0 : 1];
+    if (cache->mArray != NULL && sameBuffers(cache->mBuffers, buffers)) {
+        // The app may have moved the position and limit of the buffers it was
+        // handed before, reset them so they look like freshly wrapped ones.
+        jclass bufferClass = env->FindClass("java/nio/Buffer");
+        CHECK(bufferClass != NULL);
+
+        jmethodID clearID = env->GetMethodID(bufferClass, "clear", "()Ljava/nio/Buffer;");
+        CHECK(clearID != NULL);
+
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            jobject byteBuffer = env->GetObjectArrayElement(cache->mArray, i);
+            jobject me = env->CallObjectMethod(byteBuffer, clearID);
+            env->DeleteLocalRef(me);
+            env->DeleteLocalRef(byteBuffer);
+        }
+        env->DeleteLocalRef(bufferClass);
+
+        *bufArray = (jobjectArray)env->NewLocalRef(cache->mArray);
+        return OK;
+    }
+
     jclass byteBufferClass = env->FindClass("java/nio/ByteBuffer");
     CHECK(byteBufferClass != NULL);
 
@@ -258,6 +314,12 @@ status_t JMediaCodec::getBuffers(
     env->DeleteLocalRef(nativeByteOrderObj);
     nativeByteOrderObj = NULL;
 
+    if (cache->mArray != NULL) {
+        env->DeleteGlobalRef(cache->mArray);
+    }
+    cache->mArray = (jobjectArray)env->NewGlobalRef(*bufArray);
+    cache->mBuffers = buffers;
+
     return OK;
 }
 
@@ -657,6 +719,118 @@ static void android_media_MediaCodec_releaseOutputBuffer(
     throwExceptionAsNecessary(env, err);
 }
 
+// Releases an output buffer and dequeues the next one in a single call, saving
+// a JNI round trip per frame for pipelines that drain output in a loop.
+static jint android_media_MediaCodec_releaseAndDequeueOutputBuffer(
+        JNIEnv *env, jobject thiz, jint index, jboolean render,
+        jobject bufferInfo, jlong timeoutUs) {
+    ALOGV("android_media_MediaCodec_releaseAndDequeueOutputBuffer");
+
+    sp<JMediaCodec> codec = getMediaCodec(env, thiz);
+
+    if (codec == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return 0;
+    }
+
+    status_t err = codec->releaseOutputBuffer(index, render);
+
+    if (err != OK) {
+        return throwExceptionAsNecessary(env, err);
+    }
+
+    size_t nextIndex;
+    err = codec->dequeueOutputBuffer(env, bufferInfo, &nextIndex, timeoutUs);
+
+    if (err == OK) {
+        return nextIndex;
+    }
+
+    return throwExceptionAsNecessary(env, err);
+}
+
+// Queues several filled input buffers at once. Stops at the first failure, which
+// is thrown as queueInputBuffer() would; otherwise returns the number queued.
+static jint android_media_MediaCodec_queueInputBuffers(
+        JNIEnv *env,
+        jobject thiz,
+        jintArray indexObj,
+        jintArray offsetObj,
+        jintArray sizeObj,
+        jlongArray timestampUsObj,
+        jintArray flagsObj) {
+    ALOGV("android_media_MediaCodec_queueInputBuffers");
+
+    sp<JMediaCodec> codec = getMediaCodec(env, thiz);
+
+    if (codec == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return 0;
+    }
+
+    if (indexObj == NULL || offsetObj == NULL || sizeObj == NULL
+            || timestampUsObj == NULL || flagsObj == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+
+    jsize count = env->GetArrayLength(indexObj);
+    if (env->GetArrayLength(offsetObj) < count
+            || env->GetArrayLength(sizeObj) < count
+            || env->GetArrayLength(timestampUsObj) < count
+            || env->GetArrayLength(flagsObj) < count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+
+    jint *indices = env->GetIntArrayElements(indexObj, NULL);
+    jint *offsets = env->GetIntArrayElements(offsetObj, NULL);
+    jint *sizes = env->GetIntArrayElements(sizeObj, NULL);
+    jlong *timestampsUs = env->GetLongArrayElements(timestampUsObj, NULL);
+    jint *flags = env->GetIntArrayElements(flagsObj, NULL);
+
+    status_t err = OK;
+    AString errorDetailMsg;
+    jsize queued = 0;
+
+    if (indices == NULL || offsets == NULL || sizes == NULL
+            || timestampsUs == NULL || flags == NULL) {
+        err = -ENOMEM;
+    }
+
+    for (; err == OK && queued < count; ++queued) {
+        err = codec->queueInputBuffer(
+                indices[queued], offsets[queued], sizes[queued],
+                timestampsUs[queued], flags[queued], &errorDetailMsg);
+        if (err != OK) {
+            break;
+        }
+    }
+
+    if (flags != NULL) {
+        env->ReleaseIntArrayElements(flagsObj, flags, JNI_ABORT);
+    }
+    if (timestampsUs != NULL) {
+        env->ReleaseLongArrayElements(timestampUsObj, timestampsUs, JNI_ABORT);
+    }
+    if (sizes != NULL) {
+        env->ReleaseIntArrayElements(sizeObj, sizes, JNI_ABORT);
+    }
+    if (offsets != NULL) {
+        env->ReleaseIntArrayElements(offsetObj, offsets, JNI_ABORT);
+    }
+    if (indices != NULL) {
+        env->ReleaseIntArrayElements(indexObj, indices, JNI_ABORT);
+    }
+
+    if (err != OK) {
+        throwExceptionAsNecessary(
+                env, err, errorDetailMsg.empty() ? NULL : errorDetailMsg.c_str());
+    }
+
+    return queued;
+}
+
 static jobject android_media_MediaCodec_getOutputFormatNative(
         JNIEnv *env, jobject thiz) {
     ALOGV("android_media_MediaCodec_getOutputFormatNative");
@@ -728,6 +902,12 @@ static void android_media_MediaCodec_native_init(JNIEnv *env) {
     gFields.context = env->GetFieldID(clazz, "mNativeContext", "I");
     CHECK(gFields.context != NULL);
 
+    clazz = env->FindClass("android/media/MediaCodec$BufferInfo");
+    CHECK(clazz != NULL);
+
+    gFields.bufferInfoSetID = env->GetMethodID(clazz, "set", "(IIJI)V");
+    CHECK(gFields.bufferInfoSetID != NULL);
+
     clazz = env->FindClass("android/media/MediaCodec$CryptoInfo");
     CHECK(clazz != NULL);
 
@@ -835,7 +1015,20 @@ static JNINativeMethod gMethods[] = {
       (void *)android_media_MediaCodec_native_finalize },
 };
 
+// Only registered if MediaCodec declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "releaseAndDequeueOutputBuffer",
+      "(IZLandroid/media/MediaCodec$BufferInfo;J)I",
+      (void *)android_media_MediaCodec_releaseAndDequeueOutputBuffer },
+
+    { "queueInputBuffers", "([I[I[I[J[I)I",
+      (void *)android_media_MediaCodec_queueInputBuffers },
+};
+
 int register_android_media_MediaCodec(JNIEnv *env) {
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
                 "android/media/MediaCodec", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+                "android/media/MediaCodec", gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
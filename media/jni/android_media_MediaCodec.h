@@ -23,9 +23,11 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
+struct ABuffer;
 struct ALooper;
 struct AMessage;
 struct AString;
@@ -79,7 +81,7 @@ struct JMediaCodec : public RefBase {
     status_t getOutputFormat(JNIEnv *env, jobject *format) const;
 
     status_t getBuffers(
-            JNIEnv *env, bool input, jobjectArray *bufArray) const;
+            JNIEnv *env, bool input, jobjectArray *bufArray);
 
     void setVideoScalingMode(int mode);
 
@@ -94,6 +96,16 @@ private:
     sp<ALooper> mLooper;
     sp<MediaCodec> mCodec;
 
+    // The ByteBuffer[] last handed out for each port, and the buffers it wraps.
+    // Reused by getBuffers() until the codec reports a different set.
+    struct BufferCache {
+        jobjectArray mArray;
+        Vector<sp<ABuffer> > mBuffers;
+    };
+    BufferCache mBufferCache[2];
+
+    void clearBufferCaches(JNIEnv *env);
+
     DISALLOW_EVIL_CONSTRUCTORS(JMediaCodec);
 };
 
@@ -203,6 +203,55 @@ status_t JMediaExtractor::getSampleMeta(sp<MetaData> *sampleMeta) {
     return mImpl->getSampleMeta(sampleMeta);
 }
 
+status_t JMediaExtractor::readSampleBatch(
+        uint8_t *dst, size_t capacity, size_t maxSamples,
+        int64_t *meta, size_t *numSamples) {
+    *numSamples = 0;
+
+    size_t offset = 0;
+    while (*numSamples < maxSamples) {
+        size_t trackIndex;
+        status_t err = mImpl->getSampleTrackIndex(&trackIndex);
+        if (err != OK) {
+            return *numSamples > 0 ? OK : err;
+        }
+
+        int64_t timeUs;
+        uint32_t flags;
+        if ((err = mImpl->getSampleTime(&timeUs)) != OK
+                || (err = getSampleFlags(&flags)) != OK) {
+            return *numSamples > 0 ? OK : err;
+        }
+
+        sp<ABuffer> buffer = new ABuffer(dst + offset, capacity - offset);
+        err = mImpl->readSampleData(buffer);
+        if (err == -ENOMEM && *numSamples > 0) {
+            // The next sample is left for the following batch.
+            break;
+        } else if (err != OK) {
+            return *numSamples > 0 ? OK : err;
+        }
+
+        int64_t *entry = &meta[*numSamples * kBatchFieldCount];
+        entry[kBatchTimeUs] = timeUs;
+        entry[kBatchFlags] = flags;
+        entry[kBatchTrackIndex] = trackIndex;
+        entry[kBatchSize] = buffer->size();
+
+        offset += buffer->size();
+        ++*numSamples;
+
+        err = mImpl->advance();
+        if (err != OK) {
+            // End of stream or a read error; the samples gathered so far
+            // are still returned and the error surfaces on the next call.
+            break;
+        }
+    }
+
+    return OK;
+}
+
 bool JMediaExtractor::getCachedDuration(int64_t *durationUs, bool *eos) const {
     return mImpl->getCachedDuration(durationUs, eos);
 }
@@ -364,6 +413,60 @@ static jint android_media_MediaExtractor_readSampleData(
     return sampleSize;
 }
 
+static jint android_media_MediaExtractor_readSampleBatch(
+        JNIEnv *env, jobject thiz, jobject byteBuf, jint offset,
+        jlongArray metaArray) {
+    sp<JMediaExtractor> extractor = getMediaExtractor(env, thiz);
+
+    if (extractor == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return -1;
+    }
+
+    if (byteBuf == NULL || metaArray == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return -1;
+    }
+
+    uint8_t *dst = (uint8_t *)env->GetDirectBufferAddress(byteBuf);
+    jlong capacity = env->GetDirectBufferCapacity(byteBuf);
+
+    if (dst == NULL || offset < 0 || capacity < offset) {
+        jniThrowException(
+                env, "java/lang/IllegalArgumentException",
+                "a direct ByteBuffer is required");
+        return -1;
+    }
+
+    size_t maxSamples =
+        env->GetArrayLength(metaArray) / JMediaExtractor::kBatchFieldCount;
+
+    if (maxSamples == 0) {
+        return 0;
+    }
+
+    Vector<int64_t> meta;
+    meta.insertAt((int64_t)0, 0, maxSamples * JMediaExtractor::kBatchFieldCount);
+
+    size_t numSamples;
+    status_t err = extractor->readSampleBatch(
+            dst + offset, capacity - offset, maxSamples,
+            meta.editArray(), &numSamples);
+
+    if (err == ERROR_END_OF_STREAM) {
+        return -1;
+    } else if (err != OK) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return -1;
+    }
+
+    env->SetLongArrayRegion(
+            metaArray, 0, numSamples * JMediaExtractor::kBatchFieldCount,
+            (const jlong *)meta.array());
+
+    return numSamples;
+}
+
 static jint android_media_MediaExtractor_getSampleTrackIndex(
         JNIEnv *env, jobject thiz) {
     sp<JMediaExtractor> extractor = getMediaExtractor(env, thiz);
@@ -720,7 +823,16 @@ static JNINativeMethod gMethods[] = {
       (void *)android_media_MediaExtractor_hasCacheReachedEOS },
 };
 
+// Only registered if MediaExtractor declares them
+static JNINativeMethod gOptionalMethods[] = {
+    { "readSampleBatch", "(Ljava/nio/ByteBuffer;I[J)I",
+        (void *)android_media_MediaExtractor_readSampleBatch },
+};
+
 int register_android_media_MediaExtractor(JNIEnv *env) {
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
                 "android/media/MediaExtractor", gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+                "android/media/MediaExtractor", gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
@@ -55,6 +55,21 @@ struct JMediaExtractor : public RefBase {
     status_t getSampleFlags(uint32_t *sampleFlags);
     status_t getSampleMeta(sp<MetaData> *sampleMeta);
 
+    enum {
+        kBatchTimeUs,
+        kBatchFlags,
+        kBatchTrackIndex,
+        kBatchSize,
+        kBatchFieldCount,
+    };
+
+    // Reads up to maxSamples consecutive samples back to back into dst,
+    // advancing past each one. kBatchFieldCount values per sample are
+    // stored in meta. Stops early once the next sample does not fit.
+    status_t readSampleBatch(
+            uint8_t *dst, size_t capacity, size_t maxSamples,
+            int64_t *meta, size_t *numSamples);
+
     bool getCachedDuration(int64_t *durationUs, bool *eos) const;
 
 protected:
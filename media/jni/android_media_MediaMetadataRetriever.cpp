@@ -21,6 +21,8 @@
 #include <assert.h>
 #include <utils/Log.h>
 #include <utils/threads.h>
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
 #include <core/SkBitmap.h>
 #include <media/mediametadataretriever.h>
 #include <private/media/VideoFrame.h>
@@ -47,6 +49,28 @@ static fields_t fields;
 static Mutex sLock;
 static const char* const kClassPathName = "android/media/MediaMetadataRetriever";
 
+// Recently decoded frames are kept per retriever so that scrubbing through
+// nearby timestamps does not go back to the decoder for every thumbnail.
+// The cache is bounded both by entry count and by the shared memory held.
+static const size_t kMaxCachedFrames = 4;
+static const size_t kMaxCachedFrameBytes = 8 * 1024 * 1024;
+
+struct CachedFrame {
+    int64_t timeUs;
+    int option;
+    sp<IMemory> memory;
+};
+
+struct FrameCache {
+    FrameCache() : bytes(0) {}
+
+    Vector<CachedFrame> frames;  // most recently used first
+    size_t bytes;
+};
+
+// Guarded by sLock
+static KeyedVector<MediaMetadataRetriever*, FrameCache*> sFrameCaches;
+
 static void process_media_retriever_call(JNIEnv *env, status_t opStatus, const char* exception, const char *message)
 {
     if (opStatus == (status_t) INVALID_OPERATION) {
@@ -78,6 +102,21 @@ static void setRetriever(JNIEnv* env, jobject thiz, int retriever)
     env->SetIntField(thiz, fields.context, retriever);
 }
 
+static void clearFrameCache_l(MediaMetadataRetriever* retriever)
+{
+    ssize_t index = sFrameCaches.indexOfKey(retriever);
+    if (index >= 0) {
+        delete sFrameCaches.valueAt(index);
+        sFrameCaches.removeItemsAt(index);
+    }
+}
+
+static void clearFrameCache(MediaMetadataRetriever* retriever)
+{
+    Mutex::Autolock lock(sLock);
+    clearFrameCache_l(retriever);
+}
+
 static void
 android_media_MediaMetadataRetriever_setDataSourceAndHeaders(
         JNIEnv *env, jobject thiz, jstring path,
@@ -129,6 +168,7 @@ android_media_MediaMetadataRetriever_setDataSourceAndHeaders(
 
             "java/lang/RuntimeException",
             "setDataSource failed");
+    clearFrameCache(retriever);
 }
 
 static void android_media_MediaMetadataRetriever_setDataSourceFD(JNIEnv *env, jobject thiz, jobject fileDescriptor, jlong offset, jlong length)
@@ -158,6 +198,67 @@ static void android_media_MediaMetadataRetriever_setDataSourceFD(JNIEnv *env, jo
         return;
     }
     process_media_retriever_call(env, retriever->setDataSource(fd, offset, length), "java/lang/RuntimeException", "setDataSource failed");
+    clearFrameCache(retriever);
+}
+
+// Returns a cached frame whose timestamp lies within toleranceUs of timeUs
+// and which was retrieved with the same option, promoting it to the front.
+static sp<IMemory> findCachedFrame(MediaMetadataRetriever* retriever,
+        int64_t timeUs, int option, int64_t toleranceUs)
+{
+    Mutex::Autolock lock(sLock);
+    ssize_t index = sFrameCaches.indexOfKey(retriever);
+    if (index < 0) {
+        return NULL;
+    }
+    FrameCache* cache = sFrameCaches.valueAt(index);
+    for (size_t i = 0; i < cache->frames.size(); ++i) {
+        CachedFrame entry = cache->frames[i];
+        int64_t delta = entry.timeUs - timeUs;
+        if (entry.option != option || delta > toleranceUs || -delta > toleranceUs) {
+            continue;
+        }
+        if (i > 0) {
+            cache->frames.removeAt(i);
+            cache->frames.insertAt(entry, 0);
+        }
+        return entry.memory;
+    }
+    return NULL;
+}
+
+static void addCachedFrame(MediaMetadataRetriever* retriever,
+        int64_t timeUs, int option, const sp<IMemory>& memory)
+{
+    size_t size = memory->size();
+    if (size > kMaxCachedFrameBytes) {
+        return;
+    }
+
+    Mutex::Autolock lock(sLock);
+    FrameCache* cache;
+    ssize_t index = sFrameCaches.indexOfKey(retriever);
+    if (index < 0) {
+        cache = new FrameCache();
+        sFrameCaches.add(retriever, cache);
+    } else {
+        cache = sFrameCaches.valueAt(index);
+    }
+
+    while (cache->frames.size() > 0
+            && (cache->frames.size() >= kMaxCachedFrames
+                || cache->bytes + size > kMaxCachedFrameBytes)) {
+        size_t last = cache->frames.size() - 1;
+        cache->bytes -= cache->frames[last].memory->size();
+        cache->frames.removeAt(last);
+    }
+
+    CachedFrame entry;
+    entry.timeUs = timeUs;
+    entry.option = option;
+    entry.memory = memory;
+    cache->frames.insertAt(entry, 0);
+    cache->bytes += size;
 }
 
 template<typename T>
@@ -215,6 +316,74 @@ static void rotate(T *dst, const T *src, size_t width, size_t height, int angle)
     }
 }
 
+// Averages four RGB565 pixels by spreading the channels apart in a 32 bit
+// word so that all three can be summed at once without carrying over.
+static inline uint16_t average565(uint16_t a, uint16_t b, uint16_t c, uint16_t d)
+{
+    const uint32_t kMask = 0x07E0F81F;
+    uint32_t sum = ((a | (a << 16)) & kMask) + ((b | (b << 16)) & kMask)
+            + ((c | (c << 16)) & kMask) + ((d | (d << 16)) & kMask);
+    sum = (sum >> 2) & kMask;
+    return (uint16_t)(sum | (sum >> 16));
+}
+
+// Rotates and scales an RGB565 frame onto a dstWidth x dstHeight destination
+// in a single pass. Every destination pixel maps to a source offset that is
+// the sum of a per-row and a per-column term, so both are computed up front
+// for the given rotation and the inner loop is a plain table lookup. When
+// shrinking by at least 2x in both directions each sample is a 2x2 box
+// average, which keeps thumbnails from aliasing badly.
+static void rotateAndScale565(uint16_t* dst, size_t dstWidth, size_t dstHeight,
+        const uint16_t* src, size_t width, size_t height, int angle)
+{
+    bool swap = (angle == 90 || angle == 270);
+    size_t rotatedWidth = swap ? height : width;
+    size_t rotatedHeight = swap ? width : height;
+
+    Vector<size_t> columnOffsets;
+    columnOffsets.insertAt(0, 0, dstWidth);
+    size_t* columns = columnOffsets.editArray();
+    for (size_t x = 0; x < dstWidth; ++x) {
+        size_t c = x * rotatedWidth / dstWidth;
+        switch (angle) {
+            case 90:  columns[x] = (height - 1 - c) * width; break;
+            case 180: columns[x] = width - 1 - c; break;
+            case 270: columns[x] = c * width; break;
+            default:  columns[x] = c; break;
+        }
+    }
+
+    bool filter = rotatedWidth >= 2 * dstWidth && rotatedHeight >= 2 * dstHeight;
+    for (size_t y = 0; y < dstHeight; ++y) {
+        size_t r = y * rotatedHeight / dstHeight;
+        size_t rowOffset;
+        switch (angle) {
+            case 90:  rowOffset = r; break;
+            case 180: rowOffset = (height - 1 - r) * width; break;
+            case 270: rowOffset = width - 1 - r; break;
+            default:  rowOffset = r * width; break;
+        }
+
+        const uint16_t* row = src + rowOffset;
+        uint16_t* out = dst + y * dstWidth;
+        if (filter) {
+            // The sampled source block always extends away from the
+            // rotated origin, so step back towards it where needed to
+            // stay inside the frame.
+            ssize_t dx = (angle == 180 || angle == 270) ? -1 : 1;
+            ssize_t dy = (angle == 90 || angle == 180) ? -(ssize_t)width : width;
+            for (size_t x = 0; x < dstWidth; ++x) {
+                const uint16_t* p = row + columns[x];
+                out[x] = average565(p[0], p[dx], p[dy], p[dx + dy]);
+            }
+        } else {
+            for (size_t x = 0; x < dstWidth; ++x) {
+                out[x] = row[columns[x]];
+            }
+        }
+    }
+}
+
 static jobject android_media_MediaMetadataRetriever_getFrameAtTime(JNIEnv *env, jobject thiz, jlong timeUs, jint option)
 {
     ALOGV("getFrameAtTime: %lld us option: %d", timeUs, option);
@@ -296,6 +465,77 @@ static jobject android_media_MediaMetadataRetriever_getFrameAtTime(JNIEnv *env,
     return jBitmap;
 }
 
+// Thumbnail path: decodes (or reuses a cached frame within toleranceUs of
+// timeUs) and writes it rotated and scaled straight into a bitmap of the
+// requested size, without a full size intermediate bitmap. A non-positive
+// dstWidth or dstHeight selects the display size of the rotated frame.
+static jobject android_media_MediaMetadataRetriever_getScaledFrameAtTime(JNIEnv *env,
+        jobject thiz, jlong timeUs, jint option, jint dstWidth, jint dstHeight,
+        jlong toleranceUs)
+{
+    ALOGV("getScaledFrameAtTime: %lld us option: %d size: %dx%d",
+            timeUs, option, dstWidth, dstHeight);
+    MediaMetadataRetriever* retriever = getRetriever(env, thiz);
+    if (retriever == 0) {
+        jniThrowException(env, "java/lang/IllegalStateException", "No retriever available");
+        return NULL;
+    }
+
+    sp<IMemory> frameMemory = findCachedFrame(retriever, timeUs, option, toleranceUs);
+    if (frameMemory == 0) {
+        frameMemory = retriever->getFrameAtTime(timeUs, option);
+        if (frameMemory != 0) {
+            addCachedFrame(retriever, timeUs, option, frameMemory);
+        }
+    }
+    VideoFrame *videoFrame = NULL;
+    if (frameMemory != 0) {
+        videoFrame = static_cast<VideoFrame *>(frameMemory->pointer());
+    }
+    if (videoFrame == NULL) {
+        ALOGE("getScaledFrameAtTime: videoFrame is a NULL pointer");
+        return NULL;
+    }
+
+    if (dstWidth <= 0 || dstHeight <= 0) {
+        if (videoFrame->mRotationAngle == 90 || videoFrame->mRotationAngle == 270) {
+            dstWidth = videoFrame->mDisplayHeight;
+            dstHeight = videoFrame->mDisplayWidth;
+        } else {
+            dstWidth = videoFrame->mDisplayWidth;
+            dstHeight = videoFrame->mDisplayHeight;
+        }
+    }
+
+    jobject config = env->CallStaticObjectMethod(
+                        fields.configClazz,
+                        fields.createConfigMethod,
+                        SkBitmap::kRGB_565_Config);
+
+    jobject jBitmap = env->CallStaticObjectMethod(
+                            fields.bitmapClazz,
+                            fields.createBitmapMethod,
+                            dstWidth,
+                            dstHeight,
+                            config);
+    if (jBitmap == NULL) {  // OutOfMemoryError exception has already been thrown.
+        return NULL;
+    }
+
+    SkBitmap *bitmap =
+            (SkBitmap *) env->GetIntField(jBitmap, fields.nativeBitmap);
+
+    bitmap->lockPixels();
+    rotateAndScale565((uint16_t*)bitmap->getPixels(), dstWidth, dstHeight,
+            (uint16_t*)((char*)videoFrame + sizeof(VideoFrame)),
+            videoFrame->mWidth,
+            videoFrame->mHeight,
+            videoFrame->mRotationAngle);
+    bitmap->unlockPixels();
+
+    return jBitmap;
+}
+
 static jbyteArray android_media_MediaMetadataRetriever_getEmbeddedPicture(
         JNIEnv *env, jobject thiz, jint pictureType)
 {
@@ -358,6 +598,7 @@ static void android_media_MediaMetadataRetriever_release(JNIEnv *env, jobject th
     ALOGV("release");
     Mutex::Autolock lock(sLock);
     MediaMetadataRetriever* retriever = getRetriever(env, thiz);
+    clearFrameCache_l(retriever);
     delete retriever;
     setRetriever(env, thiz, 0);
 }
@@ -456,10 +697,18 @@ static JNINativeMethod nativeMethods[] = {
         {"native_init",     "()V", (void *)android_media_MediaMetadataRetriever_native_init},
 };
 
+// Only registered if MediaMetadataRetriever declares them
+static JNINativeMethod nativeOptionalMethods[] = {
+        {"_getScaledFrameAtTime", "(JIIIJ)Landroid/graphics/Bitmap;", (void *)android_media_MediaMetadataRetriever_getScaledFrameAtTime},
+};
+
 // This function only registers the native methods, and is called from
 // JNI_OnLoad in android_media_MediaPlayer.cpp
 int register_android_media_MediaMetadataRetriever(JNIEnv *env)
 {
-    return AndroidRuntime::registerNativeMethods
+    int result = AndroidRuntime::registerNativeMethods
         (env, kClassPathName, nativeMethods, NELEM(nativeMethods));
+    AndroidRuntime::registerOptionalNativeMethods
+        (env, kClassPathName, nativeOptionalMethods, NELEM(nativeOptionalMethods));
+    return result;
 }
@@ -17,9 +17,16 @@
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaScannerJNI"
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cutils/atomic.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
 #include <utils/Unicode.h>
+#include <utils/Vector.h>
 #include <media/mediascanner.h>
 #include <media/stagefright/StagefrightMediaScanner.h>
 
@@ -47,6 +54,27 @@ struct fields_t {
 };
 static fields_t fields;
 
+// Most worker threads processFiles() will run at once, whatever the CPU count.
+static const int kMaxScanThreads = 4;
+
+// Returns a copy of value with every non-ASCII byte replaced by '?' if value is not
+// valid UTF-8, or NULL if it can be used as is. The caller frees the copy.
+static char* cleanTagValue(const char* value) {
+    if (utf8_length(value) != -1) {
+        return NULL;
+    }
+    char *cleaned = strdup(value);
+    char *chp = cleaned;
+    char ch;
+    while ((ch = *chp)) {
+        if (ch & 0x80) {
+            *chp = '?';
+        }
+        chp++;
+    }
+    return cleaned;
+}
+
 static status_t checkAndClearExceptionFromCallback(JNIEnv* env, const char* methodName) {
     if (env->ExceptionCheck()) {
         ALOGE("An exception was thrown by callback '%s'.", methodName);
@@ -127,17 +155,8 @@ public:
 
         // Check if the value is valid UTF-8 string and replace
         // any un-printable characters with '?' when it's not.
-        char *cleaned = NULL;
-        if (utf8_length(value) == -1) {
-            cleaned = strdup(value);
-            char *chp = cleaned;
-            char ch;
-            while ((ch = *chp)) {
-                if (ch & 0x80) {
-                    *chp = '?';
-                }
-                chp++;
-            }
+        char *cleaned = cleanTagValue(value);
+        if (cleaned != NULL) {
             value = cleaned;
         }
         valueStr = mEnv->NewStringUTF(value);
@@ -180,6 +199,129 @@ private:
 };
 
 
+// Collects what a worker thread's scanner reports for one file, to be handed to
+// Java later from the thread that called processFiles().
+class RecordingMediaScannerClient : public MediaScannerClient
+{
+public:
+    virtual status_t scanFile(const char* path, long long lastModified,
+            long long fileSize, bool isDirectory, bool noMedia)
+    {
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char* name, const char* value)
+    {
+        char *cleaned = cleanTagValue(value);
+        mTags.push(String8(name));
+        mTags.push(String8(cleaned != NULL ? cleaned : value));
+        free(cleaned);
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char* mimeType)
+    {
+        mMimeType.setTo(mimeType);
+        return OK;
+    }
+
+    Vector<String8> mTags;      // name, value, name, value...
+    String8 mMimeType;
+};
+
+// The scanner held by every MediaScanner object. It exposes the locale so worker
+// threads can set up scanners of their own, and remembers what each file looked
+// like when it was last extracted so unchanged files can be skipped.
+class JMediaScanner : public StagefrightMediaScanner
+{
+public:
+    using MediaScanner::locale;
+
+    bool isUnchanged(const char* path, const struct stat& st)
+    {
+        Mutex::Autolock _l(mFingerprintLock);
+        ssize_t index = mFingerprints.indexOfKey(String8(path));
+        if (index < 0) {
+            return false;
+        }
+        const Fingerprint& fp = mFingerprints.valueAt(index);
+        return fp.inode == st.st_ino && fp.mtime == st.st_mtime && fp.size == st.st_size;
+    }
+
+    void setFingerprint(const char* path, const struct stat& st)
+    {
+        Fingerprint fp;
+        fp.inode = st.st_ino;
+        fp.mtime = st.st_mtime;
+        fp.size = st.st_size;
+        Mutex::Autolock _l(mFingerprintLock);
+        mFingerprints.add(String8(path), fp);
+    }
+
+private:
+    struct Fingerprint {
+        ino_t inode;
+        time_t mtime;
+        off_t size;
+    };
+
+    Mutex mFingerprintLock;
+    KeyedVector<String8, Fingerprint> mFingerprints;
+};
+
+// Result codes processFiles() reports in place of a tag count.
+enum {
+    SCAN_RESULT_UNCHANGED = -1,
+    SCAN_RESULT_ERROR     = -2,
+};
+
+struct ScanJob {
+    String8 path;
+    String8 mimeType;
+    bool hasMimeType;
+    RecordingMediaScannerClient client;
+    int result;
+};
+
+struct ScanBatch {
+    JMediaScanner* scanner;
+    ScanJob* jobs;
+    int32_t count;
+    volatile int32_t next;
+};
+
+static void* scanWorker(void* arg)
+{
+    ScanBatch* batch = (ScanBatch*)arg;
+    StagefrightMediaScanner scanner;
+    if (batch->scanner->locale() != NULL) {
+        scanner.setLocale(batch->scanner->locale());
+    }
+
+    int32_t i;
+    while ((i = android_atomic_inc(&batch->next)) < batch->count) {
+        ScanJob& job = batch->jobs[i];
+        struct stat st;
+        bool haveStat = stat(job.path.string(), &st) == 0;
+        if (haveStat && batch->scanner->isUnchanged(job.path.string(), st)) {
+            job.result = SCAN_RESULT_UNCHANGED;
+            continue;
+        }
+
+        if (scanner.processFile(job.path.string(),
+                job.hasMimeType ? job.mimeType.string() : NULL, job.client)
+                == MEDIA_SCAN_RESULT_ERROR) {
+            job.result = SCAN_RESULT_ERROR;
+            continue;
+        }
+        job.result = job.client.mTags.size() / 2;
+        if (haveStat) {
+            batch->scanner->setFingerprint(job.path.string(), st);
+        }
+    }
+    return NULL;
+}
+
 static MediaScanner *getNativeScanner_l(JNIEnv* env, jobject thiz)
 {
     return (MediaScanner *) env->GetIntField(thiz, fields.context);
@@ -262,6 +404,159 @@ android_media_MediaScanner_processFile(
     }
 }
 
+// Extracts metadata for a batch of files, typically one directory, on a pool of
+// worker threads and reports everything to the client in a single
+// handleScanResults(String[] mimeTypes, int[] tagCounts, String[] tags) call.
+// Entries are in the order of paths; a tag count is the number of name/value
+// pairs the file contributed to tags, or one of the SCAN_RESULT_ codes.
+static void
+android_media_MediaScanner_processFiles(
+        JNIEnv *env, jobject thiz, jobjectArray paths,
+        jobjectArray mimeTypes, jobject client)
+{
+    ALOGV("processFiles");
+    JMediaScanner *mp = static_cast<JMediaScanner *>(getNativeScanner_l(env, thiz));
+    if (mp == NULL) {
+        jniThrowException(env, kRunTimeException, "No scanner available");
+        return;
+    }
+
+    if (paths == NULL || client == NULL
+            || (mimeTypes != NULL
+                && env->GetArrayLength(mimeTypes) < env->GetArrayLength(paths))) {
+        jniThrowException(env, kIllegalArgumentException, NULL);
+        return;
+    }
+
+    jsize count = env->GetArrayLength(paths);
+
+    jclass clientClass = env->GetObjectClass(client);
+    jmethodID handleScanResults = env->GetMethodID(clientClass, "handleScanResults",
+            "([Ljava/lang/String;[I[Ljava/lang/String;)V");
+    env->DeleteLocalRef(clientClass);
+    if (handleScanResults == NULL) {
+        // older client without batch results, scan the files one at a time instead
+        env->ExceptionClear();
+        for (jsize i = 0; i < count && !env->ExceptionCheck(); i++) {
+            jstring pathStr = (jstring)env->GetObjectArrayElement(paths, i);
+            jstring mimeTypeStr = mimeTypes != NULL
+                    ? (jstring)env->GetObjectArrayElement(mimeTypes, i) : NULL;
+            android_media_MediaScanner_processFile(env, thiz, pathStr, mimeTypeStr, client);
+            env->DeleteLocalRef(pathStr);
+            env->DeleteLocalRef(mimeTypeStr);
+        }
+        return;
+    }
+
+    // The strings are copied and their local references dropped as we go, so a
+    // large directory cannot overflow the local reference table.
+    ScanJob* jobs = new ScanJob[count];
+    bool ok = true;
+    for (jsize i = 0; i < count && ok; i++) {
+        ScanJob& job = jobs[i];
+        jstring pathStr = (jstring)env->GetObjectArrayElement(paths, i);
+        jstring mimeTypeStr = mimeTypes != NULL
+                ? (jstring)env->GetObjectArrayElement(mimeTypes, i) : NULL;
+        const char* path = pathStr != NULL ? env->GetStringUTFChars(pathStr, NULL) : NULL;
+        const char* mimeType = mimeTypeStr != NULL
+                ? env->GetStringUTFChars(mimeTypeStr, NULL) : NULL;
+        job.hasMimeType = mimeType != NULL;
+        job.result = SCAN_RESULT_ERROR;
+        ok = path != NULL && (mimeTypeStr == NULL || mimeType != NULL);
+
+        // ReleaseStringUTFChars can be called with an exception pending.
+        if (path != NULL) {
+            job.path.setTo(path);
+            env->ReleaseStringUTFChars(pathStr, path);
+        }
+        if (mimeType != NULL) {
+            job.mimeType.setTo(mimeType);
+            env->ReleaseStringUTFChars(mimeTypeStr, mimeType);
+        }
+        env->DeleteLocalRef(pathStr);
+        env->DeleteLocalRef(mimeTypeStr);
+    }
+    if (!ok && !env->ExceptionCheck()) {
+        jniThrowException(env, kIllegalArgumentException, "null path");
+    }
+
+    if (ok && count > 0) {
+        ScanBatch batch;
+        batch.scanner = mp;
+        batch.jobs = jobs;
+        batch.count = count;
+        batch.next = 0;
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int threads = cpus < kMaxScanThreads ? (cpus > 0 ? cpus : 1) : kMaxScanThreads;
+        if (threads > count) {
+            threads = count;
+        }
+
+        // the calling thread is one of the workers
+        pthread_t workers[kMaxScanThreads];
+        int started = 0;
+        for (int i = 1; i < threads; i++) {
+            if (pthread_create(&workers[started], NULL, scanWorker, &batch) == 0) {
+                started++;
+            }
+        }
+        scanWorker(&batch);
+        for (int i = 0; i < started; i++) {
+            pthread_join(workers[i], NULL);
+        }
+
+        size_t totalTags = 0;
+        for (jsize i = 0; i < count; i++) {
+            totalTags += jobs[i].client.mTags.size();
+        }
+
+        jclass stringClass = env->FindClass("java/lang/String");
+        jobjectArray mimeTypeArray = env->NewObjectArray(count, stringClass, NULL);
+        jobjectArray tagArray = env->NewObjectArray(totalTags, stringClass, NULL);
+        jintArray countArray = env->NewIntArray(count);
+        env->DeleteLocalRef(stringClass);
+
+        if (mimeTypeArray != NULL && tagArray != NULL && countArray != NULL) {
+            jint* counts = new jint[count];
+            jsize tag = 0;
+            for (jsize i = 0; i < count && !env->ExceptionCheck(); i++) {
+                const RecordingMediaScannerClient& recorded = jobs[i].client;
+                counts[i] = jobs[i].result;
+                if (!recorded.mMimeType.isEmpty()) {
+                    jstring mimeTypeStr = env->NewStringUTF(recorded.mMimeType.string());
+                    env->SetObjectArrayElement(mimeTypeArray, i, mimeTypeStr);
+                    env->DeleteLocalRef(mimeTypeStr);
+                }
+                for (size_t j = 0; j < recorded.mTags.size(); j++) {
+                    jstring tagStr = env->NewStringUTF(recorded.mTags[j].string());
+                    env->SetObjectArrayElement(tagArray, tag++, tagStr);
+                    env->DeleteLocalRef(tagStr);
+                }
+            }
+            env->SetIntArrayRegion(countArray, 0, count, counts);
+            delete[] counts;
+
+            if (!env->ExceptionCheck()) {
+                env->CallVoidMethod(client, handleScanResults,
+                        mimeTypeArray, countArray, tagArray);
+            }
+        }
+
+        if (mimeTypeArray != NULL) {
+            env->DeleteLocalRef(mimeTypeArray);
+        }
+        if (tagArray != NULL) {
+            env->DeleteLocalRef(tagArray);
+        }
+        if (countArray != NULL) {
+            env->DeleteLocalRef(countArray);
+        }
+    }
+
+    delete[] jobs;
+}
+
 static void
 android_media_MediaScanner_setLocale(
         JNIEnv *env, jobject thiz, jstring locale)
@@ -347,7 +642,7 @@ static void
 android_media_MediaScanner_native_setup(JNIEnv *env, jobject thiz)
 {
     ALOGV("native_setup");
-    MediaScanner *mp = new StagefrightMediaScanner;
+    MediaScanner *mp = new JMediaScanner;
 
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "Out of memory");
@@ -413,10 +708,22 @@ static JNINativeMethod gMethods[] = {
     },
 };
 
+// Only registered if MediaScanner declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {
+        "processFiles",
+        "([Ljava/lang/String;[Ljava/lang/String;Landroid/media/MediaScannerClient;)V",
+        (void *)android_media_MediaScanner_processFiles
+    },
+};
+
 // This function only registers the native methods, and is called from
 // JNI_OnLoad in android_media_MediaPlayer.cpp
 int register_android_media_MediaScanner(JNIEnv *env)
 {
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
                 kClassMediaScanner, gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+                kClassMediaScanner, gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
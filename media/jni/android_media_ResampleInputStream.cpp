@@ -24,8 +24,15 @@
 #include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <utils/threads.h>
 
+#ifdef __ARM_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 #include "jni.h"
 #include "JNIHelp.h"
 #include "android_runtime/AndroidRuntime.h"
@@ -105,17 +112,234 @@ static void android_media_ResampleInputStream_fir21(JNIEnv *env, jclass clazz,
     env->SetByteArrayRegion(jOut, jOutOffset, jNpoints * 2, (jbyte*)out);
 }
 
+// ----------------------------------------------------------------------------
+// Polyphase resampler for any rational ratio. The prototype low-pass filter runs at
+// inRate * mUp and is split into mUp phases of mTaps taps each, so every output
+// sample is one mTaps long dot product.
+
+static const int RESAMPLE_TAPS = 16;       // taps per phase when not decimating
+static const int RESAMPLE_MAX_PHASES = 1024;
+static const int RESAMPLE_MAX_COEFS = 1 << 18;
+static const int RESAMPLE_COEF_SHIFT = 14;  // Q14, so unity gain phases cannot overflow
+
+struct Resampler {
+    int mUp;                // interpolation factor L
+    int mDown;              // decimation factor M
+    int mTaps;              // taps per phase, a multiple of 8 for NEON
+    int16_t* mCoefs;        // mUp phases, each stored with the taps reversed
+    int16_t* mWork;         // mTaps - 1 samples of history, then the current input
+    int mWorkSize;          // capacity of mWork in samples
+    int mPhase;             // phase of the next output, in [0, mUp)
+    int mSkip;              // input samples to step over before the next output
+};
+
+static int gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void designFilter(Resampler* r) {
+    const int L = r->mUp;
+    const int T = r->mTaps;
+    const int N = L * T;
+    const double center = (N - 1) / 2.0;
+    // cut off just below the lower of the two Nyquist rates, relative to inRate * L
+    const double fc = 0.5 * 0.95 / (L > r->mDown ? L : r->mDown);
+
+    double* h = new double[N];
+    for (int k = 0; k < N; k++) {
+        double x = k - center;
+        double sinc = x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * k / (N - 1))
+                + 0.08 * cos(4 * M_PI * k / (N - 1));
+        h[k] = sinc * window;
+    }
+
+    // normalize each phase to unity DC gain, which also undoes the zero stuffing loss
+    for (int p = 0; p < L; p++) {
+        double sum = 0;
+        for (int j = 0; j < T; j++) {
+            sum += h[p + j * L];
+        }
+        int16_t* coefs = r->mCoefs + p * T;
+        for (int j = 0; j < T; j++) {
+            double c = h[p + (T - 1 - j) * L] / sum;
+            coefs[j] = (int16_t)floor(c * (1 << RESAMPLE_COEF_SHIFT) + 0.5);
+        }
+    }
+    delete[] h;
+}
+
+static inline int32_t dotProduct(const int16_t* coefs, const int16_t* samples, int taps) {
+#ifdef __ARM_HAVE_NEON
+    int32x4_t acc = vdupq_n_s32(0);
+    for (int j = 0; j < taps; j += 8) {
+        int16x8_t c = vld1q_s16(coefs + j);
+        int16x8_t s = vld1q_s16(samples + j);
+        acc = vmlal_s16(acc, vget_low_s16(c), vget_low_s16(s));
+        acc = vmlal_s16(acc, vget_high_s16(c), vget_high_s16(s));
+    }
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    sum = vpadd_s32(sum, sum);
+    return vget_lane_s32(sum, 0);
+#else
+    int32_t sum = 0;
+    for (int j = 0; j < taps; j++) {
+        sum += coefs[j] * samples[j];
+    }
+    return sum;
+#endif
+}
+
+// Number of output samples the next nativeResample() call will produce from nIn samples.
+static int resampleOutputSize(const Resampler* r, int nIn) {
+    int64_t start = (int64_t)r->mSkip * r->mUp + r->mPhase;
+    int64_t end = (int64_t)nIn * r->mUp;
+    if (start >= end) {
+        return 0;
+    }
+    return (int)((end - start + r->mDown - 1) / r->mDown);
+}
+
+static jint android_media_ResampleInputStream_nativeCreate(JNIEnv *env, jclass clazz,
+        jint inRate, jint outRate) {
+    if (inRate <= 0 || outRate <= 0) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                "bad sample rates %d -> %d", inRate, outRate);
+        return 0;
+    }
+    int g = gcd(inRate, outRate);
+    if (outRate / g > RESAMPLE_MAX_PHASES) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                "ratio %d/%d needs too many phases", outRate / g, inRate / g);
+        return 0;
+    }
+
+    // when decimating, the filter has to span proportionally more input samples
+    int up = outRate / g;
+    int down = inRate / g;
+    int taps = RESAMPLE_TAPS * ((down + up - 1) / up);
+    if (down > up && (int64_t)up * taps > RESAMPLE_MAX_COEFS) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                "ratio %d/%d needs too long a filter", up, down);
+        return 0;
+    }
+
+    Resampler* r = new Resampler;
+    r->mUp = up;
+    r->mDown = down;
+    r->mTaps = taps;
+    r->mCoefs = new int16_t[r->mUp * r->mTaps];
+    r->mWorkSize = taps > BUF_SIZE ? taps : BUF_SIZE;
+    r->mWork = (int16_t*)calloc(r->mWorkSize, sizeof(int16_t));
+    r->mPhase = 0;
+    r->mSkip = 0;
+    designFilter(r);
+    return (jint)r;
+}
+
+static jint android_media_ResampleInputStream_nativeOutputSize(JNIEnv *env, jclass clazz,
+        jint handle, jint nIn) {
+    Resampler* r = (Resampler*)handle;
+    if (r == NULL || nIn < 0) {
+        return 0;
+    }
+    return resampleOutputSize(r, nIn);
+}
+
+// Resamples nIn 16 bit samples from jIn and returns the number written to jOut, which
+// must have room for nativeOutputSize(handle, nIn) samples. Filter state carries over
+// between calls, so a stream can be fed in chunks of any size.
+static jint android_media_ResampleInputStream_nativeResample(JNIEnv *env, jclass clazz,
+        jint handle, jbyteArray jIn, jint jInOffset, jbyteArray jOut, jint jOutOffset,
+        jint nIn) {
+    Resampler* r = (Resampler*)handle;
+    if (r == NULL || jIn == NULL || jOut == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return 0;
+    }
+
+    int nOut = resampleOutputSize(r, nIn);
+    if (nIn < 0 || jInOffset < 0 || jOutOffset < 0
+            || env->GetArrayLength(jIn) - jInOffset < nIn * 2
+            || env->GetArrayLength(jOut) - jOutOffset < nOut * 2) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return 0;
+    }
+
+    const int history = r->mTaps - 1;
+    if (history + nIn > r->mWorkSize) {
+        int16_t* work = (int16_t*)realloc(r->mWork, (history + nIn) * sizeof(int16_t));
+        if (work == NULL) {
+            jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+            return 0;
+        }
+        r->mWork = work;
+        r->mWorkSize = history + nIn;
+    }
+    env->GetByteArrayRegion(jIn, jInOffset, nIn * 2, (jbyte*)(r->mWork + history));
+
+    jbyte* outBytes = (jbyte*)env->GetPrimitiveArrayCritical(jOut, NULL);
+    if (outBytes == NULL) {
+        return 0;
+    }
+    int16_t* out = (int16_t*)(outBytes + jOutOffset);
+
+    // output at input position b uses samples b - history .. b, which start at mWork[b]
+    int b = r->mSkip;
+    int p = r->mPhase;
+    for (int i = 0; i < nOut; i++) {
+        int32_t sum = dotProduct(r->mCoefs + p * r->mTaps, r->mWork + b, r->mTaps)
+                >> RESAMPLE_COEF_SHIFT;
+        out[i] = sum > SHRT_MAX ? SHRT_MAX : sum < SHRT_MIN ? SHRT_MIN : sum;
+        p += r->mDown;
+        b += p / r->mUp;
+        p %= r->mUp;
+    }
+    env->ReleasePrimitiveArrayCritical(jOut, outBytes, 0);
+
+    r->mSkip = b - nIn;
+    r->mPhase = p;
+    memmove(r->mWork, r->mWork + nIn, history * sizeof(int16_t));
+    return nOut;
+}
+
+static void android_media_ResampleInputStream_nativeDestroy(JNIEnv *env, jclass clazz,
+        jint handle) {
+    Resampler* r = (Resampler*)handle;
+    if (r != NULL) {
+        free(r->mWork);
+        delete[] r->mCoefs;
+        delete r;
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 static JNINativeMethod gMethods[] = {
     {"fir21", "([BI[BII)V", (void*)android_media_ResampleInputStream_fir21},
 };
 
+// Only registered if ResampleInputStream declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"nativeCreate", "(II)I", (void*)android_media_ResampleInputStream_nativeCreate},
+    {"nativeOutputSize", "(II)I", (void*)android_media_ResampleInputStream_nativeOutputSize},
+    {"nativeResample", "(I[BI[BII)I", (void*)android_media_ResampleInputStream_nativeResample},
+    {"nativeDestroy", "(I)V", (void*)android_media_ResampleInputStream_nativeDestroy},
+};
+
 
 int register_android_media_ResampleInputStream(JNIEnv *env)
 {
     const char* const kClassPathName = "android/media/ResampleInputStream";
 
-    return AndroidRuntime::registerNativeMethods(env,
+    int result = AndroidRuntime::registerNativeMethods(env,
             kClassPathName, gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env,
+            kClassPathName, gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
@@ -27,6 +27,9 @@
 #include "JNIHelp.h"
 #include "android_runtime/AndroidRuntime.h"
 
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+
 #include "MtpDatabase.h"
 #include "MtpDataPacket.h"
 #include "MtpObjectInfo.h"
@@ -56,6 +59,7 @@ static jmethodID method_getDeviceProperty;
 static jmethodID method_setDeviceProperty;
 static jmethodID method_getObjectPropertyList;
 static jmethodID method_getObjectInfo;
+static jmethodID method_getObjectInfos;     // optional batch form of getObjectInfo
 static jmethodID method_getObjectFilePath;
 static jmethodID method_deleteFile;
 static jmethodID method_getObjectReferences;
@@ -81,6 +85,22 @@ MtpDatabase* getMtpDatabase(JNIEnv *env, jobject database) {
 
 // ----------------------------------------------------------------------------
 
+// Object info prefetched for the handles of a getObjectList() call. Hosts follow a
+// GetObjectHandles with one GetObjectInfo per handle, which would otherwise cost a
+// MediaProvider query each.
+struct CachedObjectInfo {
+    MtpStorageID        mStorageID;
+    MtpObjectFormat     mFormat;
+    MtpObjectHandle     mParent;
+    uint64_t            mSize;
+    time_t              mDateModified;
+    MtpString           mName;
+};
+
+// handles fetched per getObjectInfos() call, and the most the cache will hold
+static const int kObjectInfoBatchSize = 256;
+static const size_t kMaxCachedObjectInfos = 32768;
+
 class MyMtpDatabase : public MtpDatabase {
 private:
     jobject         mDatabase;
@@ -88,6 +108,13 @@ private:
     jlongArray      mLongBuffer;
     jcharArray      mStringBuffer;
 
+    // Written by the MTP thread, cleared from Java when the media store changes.
+    Mutex           mObjectInfoLock;
+    KeyedVector<MtpObjectHandle, CachedObjectInfo> mObjectInfoCache;
+
+    void                            prefetchObjectInfo(JNIEnv* env,
+                                            const MtpObjectHandleList& handles);
+
 public:
                                     MyMtpDatabase(JNIEnv *env, jobject client);
     virtual                         ~MyMtpDatabase();
@@ -168,6 +195,8 @@ public:
     virtual void                    sessionStarted();
 
     virtual void                    sessionEnded();
+
+    void                            invalidateObjectInfo(MtpObjectHandle handle);
 };
 
 // ----------------------------------------------------------------------------
@@ -239,6 +268,7 @@ void MyMtpDatabase::endSendObject(const char* path, MtpObjectHandle handle,
                                 MtpObjectFormat format, bool succeeded) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     jstring pathStr = env->NewStringUTF(path);
+    invalidateObjectInfo(handle);
     env->CallVoidMethod(mDatabase, method_endSendObject, pathStr,
                         (jint)handle, (jint)format, (jboolean)succeeded);
 
@@ -264,9 +294,92 @@ MtpObjectHandleList* MyMtpDatabase::getObjectList(MtpStorageID storageID,
     env->DeleteLocalRef(array);
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    prefetchObjectInfo(env, *list);
     return list;
 }
 
+void MyMtpDatabase::prefetchObjectInfo(JNIEnv* env, const MtpObjectHandleList& handles) {
+    if (method_getObjectInfos == NULL || handles.size() == 0)
+        return;
+
+    {
+        Mutex::Autolock _l(mObjectInfoLock);
+        if (mObjectInfoCache.size() + handles.size() > kMaxCachedObjectInfos)
+            mObjectInfoCache.clear();
+    }
+
+    jclass stringClass = env->FindClass("java/lang/String");
+    jintArray handleArray = env->NewIntArray(kObjectInfoBatchSize);
+    jintArray intArray = env->NewIntArray(kObjectInfoBatchSize * 3);
+    jlongArray longArray = env->NewLongArray(kObjectInfoBatchSize * 2);
+    jobjectArray nameArray = env->NewObjectArray(kObjectInfoBatchSize, stringClass, NULL);
+    env->DeleteLocalRef(stringClass);
+    if (!handleArray || !intArray || !longArray || !nameArray) {
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        goto done;
+    }
+
+    for (size_t start = 0; start < handles.size(); start += kObjectInfoBatchSize) {
+        jsize count = handles.size() - start;
+        if (count > kObjectInfoBatchSize)
+            count = kObjectInfoBatchSize;
+        env->SetIntArrayRegion(handleArray, 0, count, (const jint *)&handles[start]);
+
+        jint found = env->CallIntMethod(mDatabase, method_getObjectInfos,
+                handleArray, intArray, longArray, nameArray);
+        if (env->ExceptionCheck()) {
+            checkAndClearExceptionFromCallback(env, __FUNCTION__);
+            break;
+        }
+        if (found <= 0)
+            continue;
+
+        jint ints[kObjectInfoBatchSize * 3];
+        jlong longs[kObjectInfoBatchSize * 2];
+        env->GetIntArrayRegion(intArray, 0, count * 3, ints);
+        env->GetLongArrayRegion(longArray, 0, count * 2, longs);
+
+        Mutex::Autolock _l(mObjectInfoLock);
+        for (jsize i = 0; i < count; i++) {
+            // a null name marks a handle the media store no longer knows about
+            jstring name = (jstring)env->GetObjectArrayElement(nameArray, i);
+            if (!name)
+                continue;
+            const char* nameStr = env->GetStringUTFChars(name, NULL);
+            if (nameStr) {
+                CachedObjectInfo entry;
+                entry.mStorageID = ints[i * 3];
+                entry.mFormat = ints[i * 3 + 1];
+                entry.mParent = ints[i * 3 + 2];
+                entry.mSize = longs[i * 2];
+                entry.mDateModified = longs[i * 2 + 1];
+                entry.mName.setTo(nameStr);
+                mObjectInfoCache.add(handles[start + i], entry);
+                env->ReleaseStringUTFChars(name, nameStr);
+            }
+            env->DeleteLocalRef(name);
+        }
+    }
+
+done:
+    if (handleArray)
+        env->DeleteLocalRef(handleArray);
+    if (intArray)
+        env->DeleteLocalRef(intArray);
+    if (longArray)
+        env->DeleteLocalRef(longArray);
+    if (nameArray)
+        env->DeleteLocalRef(nameArray);
+}
+
+void MyMtpDatabase::invalidateObjectInfo(MtpObjectHandle handle) {
+    Mutex::Autolock _l(mObjectInfoLock);
+    if (handle == 0)
+        mObjectInfoCache.clear();
+    else
+        mObjectInfoCache.removeItem(handle);
+}
+
 int MyMtpDatabase::getNumObjects(MtpStorageID storageID,
                                 MtpObjectFormat format,
                                 MtpObjectHandle parent) {
@@ -512,6 +625,7 @@ MtpResponseCode MyMtpDatabase::setObjectPropertyValue(MtpObjectHandle handle,
             return MTP_RESPONSE_INVALID_OBJECT_PROP_FORMAT;
     }
 
+    invalidateObjectInfo(handle);
     jint result = env->CallIntMethod(mDatabase, method_setObjectProperty,
                 (jint)handle, (jint)property, longValue, stringValue);
     if (stringValue)
@@ -754,33 +868,51 @@ MtpResponseCode MyMtpDatabase::getObjectInfo(MtpObjectHandle handle,
     char    date[20];
 
     JNIEnv* env = AndroidRuntime::getJNIEnv();
-    jboolean result = env->CallBooleanMethod(mDatabase, method_getObjectInfo,
-                (jint)handle, mIntBuffer, mStringBuffer, mLongBuffer);
-    if (!result)
-        return MTP_RESPONSE_INVALID_OBJECT_HANDLE;
-
-    jint* intValues = env->GetIntArrayElements(mIntBuffer, 0);
-    info.mStorageID = intValues[0];
-    info.mFormat = intValues[1];
-    info.mParent = intValues[2];
-    env->ReleaseIntArrayElements(mIntBuffer, intValues, 0);
+    bool cached = false;
+    {
+        Mutex::Autolock _l(mObjectInfoLock);
+        ssize_t index = mObjectInfoCache.indexOfKey(handle);
+        if (index >= 0) {
+            const CachedObjectInfo& entry = mObjectInfoCache.valueAt(index);
+            info.mStorageID = entry.mStorageID;
+            info.mFormat = entry.mFormat;
+            info.mParent = entry.mParent;
+            info.mCompressedSize = (entry.mSize > 0xFFFFFFFFLL ? 0xFFFFFFFF : entry.mSize);
+            info.mDateModified = entry.mDateModified;
+            info.mName = strdup((const char *)entry.mName);
+            cached = true;
+        }
+    }
 
-    jlong* longValues = env->GetLongArrayElements(mLongBuffer, 0);
-    uint64_t size = longValues[0];
-    info.mCompressedSize = (size > 0xFFFFFFFFLL ? 0xFFFFFFFF : size);
-    info.mDateModified = longValues[1];
-    env->ReleaseLongArrayElements(mLongBuffer, longValues, 0);
+    if (!cached) {
+        jboolean result = env->CallBooleanMethod(mDatabase, method_getObjectInfo,
+                    (jint)handle, mIntBuffer, mStringBuffer, mLongBuffer);
+        if (!result)
+            return MTP_RESPONSE_INVALID_OBJECT_HANDLE;
+
+        jint* intValues = env->GetIntArrayElements(mIntBuffer, 0);
+        info.mStorageID = intValues[0];
+        info.mFormat = intValues[1];
+        info.mParent = intValues[2];
+        env->ReleaseIntArrayElements(mIntBuffer, intValues, 0);
+
+        jlong* longValues = env->GetLongArrayElements(mLongBuffer, 0);
+        uint64_t size = longValues[0];
+        info.mCompressedSize = (size > 0xFFFFFFFFLL ? 0xFFFFFFFF : size);
+        info.mDateModified = longValues[1];
+        env->ReleaseLongArrayElements(mLongBuffer, longValues, 0);
+
+        jchar* str = env->GetCharArrayElements(mStringBuffer, 0);
+        MtpString temp(str);
+        info.mName = strdup((const char *)temp);
+        env->ReleaseCharArrayElements(mStringBuffer, str, 0);
+    }
 
 //    info.mAssociationType = (format == MTP_FORMAT_ASSOCIATION ?
 //                            MTP_ASSOCIATION_TYPE_GENERIC_FOLDER :
 //                            MTP_ASSOCIATION_TYPE_UNDEFINED);
     info.mAssociationType = MTP_ASSOCIATION_TYPE_UNDEFINED;
 
-    jchar* str = env->GetCharArrayElements(mStringBuffer, 0);
-    MtpString temp(str);
-    info.mName = strdup((const char *)temp);
-    env->ReleaseCharArrayElements(mStringBuffer, str, 0);
-
     // read EXIF data for thumbnail information
     if (info.mFormat == MTP_FORMAT_EXIF_JPEG || info.mFormat == MTP_FORMAT_JFIF) {
         MtpString path;
@@ -869,6 +1001,7 @@ MtpResponseCode MyMtpDatabase::getObjectFilePath(MtpObjectHandle handle,
 
 MtpResponseCode MyMtpDatabase::deleteFile(MtpObjectHandle handle) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
+    invalidateObjectInfo(handle);
     MtpResponseCode result = env->CallIntMethod(mDatabase, method_deleteFile, (jint)handle);
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
@@ -1085,6 +1218,15 @@ android_mtp_MtpDatabase_finalize(JNIEnv *env, jobject thiz)
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
+// Called by MtpDatabase when the media store reports a change, with 0 for "all objects".
+static void
+android_mtp_MtpDatabase_invalidate_object_info(JNIEnv *env, jobject thiz, jint handle)
+{
+    MyMtpDatabase* database = (MyMtpDatabase *)env->GetIntField(thiz, field_context);
+    if (database)
+        database->invalidateObjectInfo(handle);
+}
+
 static jstring
 android_mtp_MtpPropertyGroup_format_date_time(JNIEnv *env, jobject thiz, jlong seconds)
 {
@@ -1100,6 +1242,12 @@ static JNINativeMethod gMtpDatabaseMethods[] = {
     {"native_finalize",         "()V",  (void *)android_mtp_MtpDatabase_finalize},
 };
 
+// Only registered if MtpDatabase declares them
+static JNINativeMethod gMtpDatabaseOptionalMethods[] = {
+    {"native_invalidate_object_info",
+                                "(I)V", (void *)android_mtp_MtpDatabase_invalidate_object_info},
+};
+
 static JNINativeMethod gMtpPropertyGroupMethods[] = {
     {"format_date_time",        "(J)Ljava/lang/String;",
                                         (void *)android_mtp_MtpPropertyGroup_format_date_time},
@@ -1182,6 +1330,12 @@ int register_android_mtp_MtpDatabase(JNIEnv *env)
         ALOGE("Can't find getObjectInfo");
         return -1;
     }
+    method_getObjectInfos = env->GetMethodID(clazz, "getObjectInfos",
+            "([I[I[J[Ljava/lang/String;)I");
+    if (method_getObjectInfos == NULL) {
+        // older MtpDatabase without batch lookups, fall back to one query per handle
+        env->ExceptionClear();
+    }
     method_getObjectFilePath = env->GetMethodID(clazz, "getObjectFilePath", "(I[C[J)I");
     if (method_getObjectFilePath == NULL) {
         ALOGE("Can't find getObjectFilePath");
@@ -1264,6 +1418,8 @@ int register_android_mtp_MtpDatabase(JNIEnv *env)
     if (AndroidRuntime::registerNativeMethods(env,
                 "android/mtp/MtpDatabase", gMtpDatabaseMethods, NELEM(gMtpDatabaseMethods)))
         return -1;
+    AndroidRuntime::registerOptionalNativeMethods(env, "android/mtp/MtpDatabase",
+                gMtpDatabaseOptionalMethods, NELEM(gMtpDatabaseOptionalMethods));
 
     return AndroidRuntime::registerNativeMethods(env,
                 "android/mtp/MtpPropertyGroup", gMtpPropertyGroupMethods, NELEM(gMtpPropertyGroupMethods));
@@ -19,6 +19,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "visualizers-JNI"
 
+#include <cutils/atomic.h>
 #include <utils/Log.h>
 #include <nativehelper/jni.h>
 #include <nativehelper/JNIHelp.h>
@@ -53,6 +54,21 @@ struct fields_t {
 };
 static fields_t fields;
 
+// Layout of a buffer attached with native_setCaptureBuffer(). All ints are in native
+// order. The header is followed by two capture slots; capture N goes to slot N & 1 and
+// the sequence number is bumped once the slot is complete, so a reader that sees the
+// same sequence number before and after copying a slot has a consistent capture.
+enum {
+    CAPTURE_HEADER_SEQUENCE     = 0,    // captures completed so far
+    CAPTURE_HEADER_CAPACITY     = 1,    // bytes available for each of waveform and fft
+    CAPTURE_HEADER_INTS         = 4,
+
+    CAPTURE_SLOT_SAMPLING_RATE  = 0,
+    CAPTURE_SLOT_WAVEFORM_SIZE  = 1,    // 0 if the capture had no waveform
+    CAPTURE_SLOT_FFT_SIZE       = 2,    // 0 if the capture had no fft
+    CAPTURE_SLOT_INTS           = 4,    // followed by the waveform, then the fft
+};
+
 struct visualizer_callback_cookie {
     jclass      visualizer_class;  // Visualizer class
     jobject     visualizer_ref;    // Visualizer object instance
@@ -68,9 +84,17 @@ struct visualizer_callback_cookie {
     jbyteArray  waveform_data;
     jbyteArray  fft_data;
 
+    // Direct buffer captures are written to instead of the arrays above, if set.
+    jobject     capture_buffer;
+    int32_t*    capture_base;
+    uint32_t    capture_capacity;
+
     visualizer_callback_cookie() {
         waveform_data = NULL;
         fft_data = NULL;
+        capture_buffer = NULL;
+        capture_base = NULL;
+        capture_capacity = 0;
     }
 
     ~visualizer_callback_cookie() {
@@ -92,6 +116,12 @@ struct visualizer_callback_cookie {
                 fft_data = NULL;
             }
         }
+        if (capture_buffer) {
+            AndroidRuntime::getJNIEnv()->DeleteGlobalRef(capture_buffer);
+            capture_buffer = NULL;
+            capture_base = NULL;
+            capture_capacity = 0;
+        }
     }
  };
 
@@ -151,6 +181,38 @@ static void ensureArraySize(JNIEnv *env, jbyteArray *array, uint32_t size) {
     }
 }
 
+// ----------------------------------------------------------------------------
+// Writes one capture into the next slot of the attached buffer. Needs no JNI calls.
+// Must be called with callback_data_lock held.
+static void writeCaptureBuffer_l(visualizer_callback_cookie *callbackInfo,
+        uint32_t waveformSize, uint8_t *waveform,
+        uint32_t fftSize, uint8_t *fft,
+        uint32_t samplingrate) {
+    int32_t *header = callbackInfo->capture_base;
+    uint32_t capacity = callbackInfo->capture_capacity;
+    if (waveform == NULL || waveformSize > capacity) {
+        waveformSize = 0;
+    }
+    if (fft == NULL || fftSize > capacity) {
+        fftSize = 0;
+    }
+
+    int32_t sequence = header[CAPTURE_HEADER_SEQUENCE];
+    size_t slotSize = CAPTURE_SLOT_INTS * sizeof(int32_t) + 2 * capacity;
+    int32_t *slot = (int32_t *)((uint8_t *)(header + CAPTURE_HEADER_INTS)
+            + ((sequence + 1) & 1) * slotSize);
+    uint8_t *data = (uint8_t *)(slot + CAPTURE_SLOT_INTS);
+
+    slot[CAPTURE_SLOT_SAMPLING_RATE] = samplingrate;
+    slot[CAPTURE_SLOT_WAVEFORM_SIZE] = waveformSize;
+    slot[CAPTURE_SLOT_FFT_SIZE] = fftSize;
+    memcpy(data, waveform, waveformSize);
+    memcpy(data + capacity, fft, fftSize);
+
+    android_atomic_release_store(sequence + 1, &header[CAPTURE_HEADER_SEQUENCE]);
+}
+
+// ----------------------------------------------------------------------------
 static void captureCallback(void* user,
         uint32_t waveformSize,
         uint8_t *waveform,
@@ -176,6 +238,12 @@ static void captureCallback(void* user,
         return;
     }
 
+    if (callbackInfo->capture_base != NULL) {
+        // readers poll the sequence number, so there is nothing to post
+        writeCaptureBuffer_l(callbackInfo, waveformSize, waveform, fftSize, fft, samplingrate);
+        return;
+    }
+
     if (waveformSize != 0 && waveform != NULL) {
         jbyteArray jArray;
 
@@ -588,6 +656,54 @@ android_media_setPeriodicCapture(JNIEnv *env, jobject thiz, jint rate, jboolean
                                                 rate));
 }
 
+// Attaches a direct ByteBuffer, laid out as described for CAPTURE_HEADER_SEQUENCE, that
+// periodic captures are written into in place of the PCM/FFT capture events. Null
+// detaches it. Returns the bytes available per waveform or fft, or an error code.
+static jint
+android_media_visualizer_native_setCaptureBuffer(JNIEnv *env, jobject thiz, jobject jBuffer)
+{
+    Visualizer* lpVisualizer = getVisualizer(env, thiz);
+    if (lpVisualizer == NULL) {
+        return VISUALIZER_ERROR_NO_INIT;
+    }
+    visualizerJniStorage* lpJniStorage = (visualizerJniStorage *)env->GetIntField(thiz,
+            fields.fidJniData);
+    if (lpJniStorage == NULL) {
+        return VISUALIZER_ERROR_NO_INIT;
+    }
+
+    int32_t* base = NULL;
+    uint32_t capacity = 0;
+    if (jBuffer != NULL) {
+        base = (int32_t *)env->GetDirectBufferAddress(jBuffer);
+        jlong size = env->GetDirectBufferCapacity(jBuffer);
+        const jlong fixed = (CAPTURE_HEADER_INTS + 2 * CAPTURE_SLOT_INTS) * sizeof(int32_t);
+        if (base == NULL || ((uintptr_t)base & (sizeof(int32_t) - 1)) != 0
+                || size < fixed + 4 * (jlong)lpVisualizer->getCaptureSize()) {
+            ALOGE("setCaptureBuffer: need an aligned direct buffer of at least %lld bytes",
+                    fixed + 4 * (jlong)lpVisualizer->getCaptureSize());
+            return VISUALIZER_ERROR_BAD_VALUE;
+        }
+        // keep the slots int aligned
+        capacity = ((size - fixed) / 4) & ~(sizeof(int32_t) - 1);
+    }
+
+    visualizer_callback_cookie* callbackInfo = &lpJniStorage->mCallbackData;
+    AutoMutex lock(&callbackInfo->callback_data_lock);
+    if (callbackInfo->capture_buffer != NULL) {
+        env->DeleteGlobalRef(callbackInfo->capture_buffer);
+        callbackInfo->capture_buffer = NULL;
+    }
+    if (base != NULL) {
+        callbackInfo->capture_buffer = env->NewGlobalRef(jBuffer);
+        base[CAPTURE_HEADER_SEQUENCE] = 0;
+        base[CAPTURE_HEADER_CAPACITY] = capacity;
+    }
+    callbackInfo->capture_base = base;
+    callbackInfo->capture_capacity = capacity;
+    return capacity;
+}
+
 // ----------------------------------------------------------------------------
 
 // Dalvik VM type signatures
@@ -611,10 +727,20 @@ static JNINativeMethod gMethods[] = {
     {"native_setPeriodicCapture","(IZZ)I",(void *)android_media_setPeriodicCapture},
 };
 
+// Only registered if Visualizer declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {"native_setCaptureBuffer",  "(Ljava/nio/ByteBuffer;)I",
+                                          (void *)android_media_visualizer_native_setCaptureBuffer},
+};
+
 // ----------------------------------------------------------------------------
 
 int register_android_media_visualizer(JNIEnv *env)
 {
-    return AndroidRuntime::registerNativeMethods(env, kClassPathName, gMethods, NELEM(gMethods));
+    int result = AndroidRuntime::registerNativeMethods(env, kClassPathName,
+            gMethods, NELEM(gMethods));
+    AndroidRuntime::registerOptionalNativeMethods(env, kClassPathName,
+            gOptionalMethods, NELEM(gOptionalMethods));
+    return result;
 }
 
@@ -19,7 +19,10 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "SoundPool-JNI"
 
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 #include <nativehelper/jni.h>
 #include <nativehelper/JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
@@ -33,10 +36,80 @@ static struct fields_t {
     jclass      mSoundPoolClass;
 } fields;
 
+// Keep in sync with SoundPool.java; follows SoundPoolEvent::SAMPLE_LOADED.
+enum {
+    SAMPLE_BATCH_LOADED = 2,
+};
+
+// Samples requested by one _loadBatch() call. Their individual SAMPLE_LOADED
+// events are held back and reported together once the last one arrives.
+struct SoundPoolBatch {
+    int         mBatchID;
+    int         mRemaining;
+    bool        mIssued;        // every load() of the batch has returned
+    Vector<int> mResults;       // sample ID, status, sample ID, status...
+};
+
+// What the SoundPool callback gets as its user pointer.
+struct SoundPoolCallbackData {
+    jobject     mWeakRef;
+    Mutex       mLock;
+    int         mNextBatchID;
+    int         mIssuing;       // _loadBatch() calls still issuing loads
+    KeyedVector<int, SoundPoolBatch*> mBatchOfSample;
+    // SAMPLE_LOADED events that arrived while a batch was being issued, before
+    // it was known whether the sample belongs to it
+    KeyedVector<int, int> mEarly;
+};
+
 static inline SoundPool* MusterSoundPool(JNIEnv *env, jobject thiz) {
     return (SoundPool*)env->GetIntField(thiz, fields.mNativeContext);
 }
 
+static void postEvent(JNIEnv *env, SoundPoolCallbackData* data, int msg, int arg1, int arg2,
+        jobject obj) {
+    env->CallStaticVoidMethod(fields.mSoundPoolClass, fields.mPostEvent, data->mWeakRef,
+            msg, arg1, arg2, obj);
+    if (env->ExceptionCheck()) {
+        ALOGW("An exception occurred while notifying an event.");
+        env->ExceptionClear();
+    }
+}
+
+// Posts batch if it is complete and frees it. Must be called with data->mLock held.
+static void finishBatchIfDone_l(JNIEnv *env, SoundPoolCallbackData* data,
+        SoundPoolBatch* batch) {
+    if (!batch->mIssued || batch->mRemaining > 0) {
+        return;
+    }
+    int failed = 0;
+    for (size_t i = 1; i < batch->mResults.size(); i += 2) {
+        if (batch->mResults[i] != 0) {
+            failed++;
+        }
+    }
+    jintArray results = env->NewIntArray(batch->mResults.size());
+    if (results != NULL) {
+        env->SetIntArrayRegion(results, 0, batch->mResults.size(), batch->mResults.array());
+    } else {
+        env->ExceptionClear();
+    }
+    postEvent(env, data, SAMPLE_BATCH_LOADED, batch->mBatchID, failed, results);
+    if (results != NULL) {
+        env->DeleteLocalRef(results);
+    }
+    delete batch;
+}
+
+// Records a loaded sample against its batch. Must be called with data->mLock held.
+static void addBatchResult_l(JNIEnv *env, SoundPoolCallbackData* data,
+        SoundPoolBatch* batch, int sampleID, int status) {
+    batch->mResults.push(sampleID);
+    batch->mResults.push(status);
+    batch->mRemaining--;
+    finishBatchIfDone_l(env, data, batch);
+}
+
 // ----------------------------------------------------------------------------
 static int
 android_media_SoundPool_load_URL(JNIEnv *env, jobject thiz, jstring path, jint priority)
@@ -64,6 +137,100 @@ android_media_SoundPool_load_FD(JNIEnv *env, jobject thiz, jobject fileDescripto
             int64_t(offset), int64_t(length), int(priority));
 }
 
+// Queues several file descriptor loads at once and fills sampleIDs with their
+// IDs. Instead of one event per sample, a single SAMPLE_BATCH_LOADED event
+// (batch ID, failure count, int[] of sample ID/status pairs) follows once every
+// sample of the batch has been decoded. Returns the batch ID, or 0 on error.
+static int
+android_media_SoundPool_load_FD_batch(JNIEnv *env, jobject thiz, jobjectArray fileDescriptors,
+        jlongArray offsets, jlongArray lengths, jintArray priorities, jintArray sampleIDs)
+{
+    ALOGV("android_media_SoundPool_load_FD_batch");
+    SoundPool *ap = MusterSoundPool(env, thiz);
+    if (ap == NULL) return 0;
+    SoundPoolCallbackData* data = (SoundPoolCallbackData*) ap->getUserData();
+
+    if (fileDescriptors == NULL || offsets == NULL || lengths == NULL
+            || priorities == NULL || sampleIDs == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+    jsize count = env->GetArrayLength(fileDescriptors);
+    if (count == 0 || env->GetArrayLength(offsets) < count
+            || env->GetArrayLength(lengths) < count
+            || env->GetArrayLength(priorities) < count
+            || env->GetArrayLength(sampleIDs) < count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+
+    jlong* offsetValues = env->GetLongArrayElements(offsets, NULL);
+    jlong* lengthValues = env->GetLongArrayElements(lengths, NULL);
+    jint* priorityValues = env->GetIntArrayElements(priorities, NULL);
+    jint* ids = new jint[count];
+
+    SoundPoolBatch* batch = new SoundPoolBatch;
+    batch->mRemaining = 0;
+    batch->mIssued = false;
+    int batchID;
+    {
+        Mutex::Autolock lock(data->mLock);
+        batchID = batch->mBatchID = ++data->mNextBatchID;
+        data->mIssuing++;
+    }
+
+    // Loads are issued without holding mLock: load() can block on the decode
+    // thread's queue, and that thread takes mLock in the callback.
+    for (jsize i = 0; i < count; i++) {
+        jobject fileDescriptor = env->GetObjectArrayElement(fileDescriptors, i);
+        int fd = fileDescriptor != NULL ? jniGetFDFromFileDescriptor(env, fileDescriptor) : -1;
+        env->DeleteLocalRef(fileDescriptor);
+        ids[i] = fd >= 0 ? ap->load(fd, int64_t(offsetValues[i]), int64_t(lengthValues[i]),
+                int(priorityValues[i])) : 0;
+
+        Mutex::Autolock lock(data->mLock);
+        if (ids[i] == 0) {
+            // report the failed request in the batch results as sample 0
+            batch->mResults.push(0);
+            batch->mResults.push(-1);
+            continue;
+        }
+        ssize_t early = data->mEarly.indexOfKey(ids[i]);
+        batch->mRemaining++;
+        if (early >= 0) {
+            int status = data->mEarly.valueAt(early);
+            data->mEarly.removeItemsAt(early);
+            addBatchResult_l(env, data, batch, ids[i], status);
+        } else {
+            data->mBatchOfSample.add(ids[i], batch);
+        }
+    }
+
+    KeyedVector<int, int> unclaimed;
+    {
+        Mutex::Autolock lock(data->mLock);
+        if (--data->mIssuing == 0) {
+            // whatever is left came from loads outside any batch
+            unclaimed = data->mEarly;
+            data->mEarly.clear();
+        }
+        batch->mIssued = true;
+        // batch may be freed from here on
+        finishBatchIfDone_l(env, data, batch);
+    }
+    for (size_t i = 0; i < unclaimed.size(); i++) {
+        postEvent(env, data, SoundPoolEvent::SAMPLE_LOADED, unclaimed.keyAt(i),
+                unclaimed.valueAt(i), NULL);
+    }
+
+    env->SetIntArrayRegion(sampleIDs, 0, count, ids);
+    delete[] ids;
+    env->ReleaseIntArrayElements(priorities, priorityValues, JNI_ABORT);
+    env->ReleaseLongArrayElements(lengths, lengthValues, JNI_ABORT);
+    env->ReleaseLongArrayElements(offsets, offsetValues, JNI_ABORT);
+    return batchID;
+}
+
 static bool
 android_media_SoundPool_unload(JNIEnv *env, jobject thiz, jint sampleID) {
     ALOGV("android_media_SoundPool_unload\n");
@@ -171,8 +338,23 @@ android_media_SoundPool_setRate(JNIEnv *env, jobject thiz, jint channelID,
 static void android_media_callback(SoundPoolEvent event, SoundPool* soundPool, void* user)
 {
     ALOGV("callback: (%d, %d, %d, %p, %p)", event.mMsg, event.mArg1, event.mArg2, soundPool, user);
+    SoundPoolCallbackData* data = (SoundPoolCallbackData*) user;
     JNIEnv *env = AndroidRuntime::getJNIEnv();
-    env->CallStaticVoidMethod(fields.mSoundPoolClass, fields.mPostEvent, user, event.mMsg, event.mArg1, event.mArg2, NULL);
+    if (event.mMsg == SoundPoolEvent::SAMPLE_LOADED) {
+        Mutex::Autolock lock(data->mLock);
+        ssize_t index = data->mBatchOfSample.indexOfKey(event.mArg1);
+        if (index >= 0) {
+            SoundPoolBatch* batch = data->mBatchOfSample.valueAt(index);
+            data->mBatchOfSample.removeItemsAt(index);
+            addBatchResult_l(env, data, batch, event.mArg1, event.mArg2);
+            return;
+        }
+        if (data->mIssuing > 0) {
+            data->mEarly.add(event.mArg1, event.mArg2);
+            return;
+        }
+    }
+    postEvent(env, data, event.mMsg, event.mArg1, event.mArg2, NULL);
 }
 
 static jint
@@ -188,8 +370,11 @@ android_media_SoundPool_native_setup(JNIEnv *env, jobject thiz, jobject weakRef,
     env->SetIntField(thiz, fields.mNativeContext, (int)ap);
 
     // set callback with weak reference
-    jobject globalWeakRef = env->NewGlobalRef(weakRef);
-    ap->setCallback(android_media_callback, globalWeakRef);
+    SoundPoolCallbackData* data = new SoundPoolCallbackData;
+    data->mWeakRef = env->NewGlobalRef(weakRef);
+    data->mNextBatchID = 0;
+    data->mIssuing = 0;
+    ap->setCallback(android_media_callback, data);
     return 0;
 }
 
@@ -200,14 +385,23 @@ android_media_SoundPool_release(JNIEnv *env, jobject thiz)
     SoundPool *ap = MusterSoundPool(env, thiz);
     if (ap != NULL) {
 
-        // release weak reference
-        jobject weakRef = (jobject) ap->getUserData();
-        if (weakRef != NULL) {
-            env->DeleteGlobalRef(weakRef);
+        // clear callback first, so no callback can still be using its data
+        SoundPoolCallbackData* data = (SoundPoolCallbackData*) ap->getUserData();
+        ap->setCallback(NULL, NULL);
+
+        // release weak reference and any batches still waiting for samples
+        if (data != NULL) {
+            env->DeleteGlobalRef(data->mWeakRef);
+            for (size_t i = 0; i < data->mBatchOfSample.size(); i++) {
+                SoundPoolBatch* batch = data->mBatchOfSample.valueAt(i);
+                if (--batch->mRemaining == 0) {
+                    delete batch;
+                }
+            }
+            delete data;
         }
 
-        // clear callback and native context
-        ap->setCallback(NULL, NULL);
+        // clear native context
         env->SetIntField(thiz, fields.mNativeContext, 0);
         delete ap;
     }
@@ -279,6 +473,14 @@ static JNINativeMethod gMethods[] = {
     }
 };
 
+// Only registered if SoundPool declares them
+static JNINativeMethod gOptionalMethods[] = {
+    {   "_loadBatch",
+        "([Ljava/io/FileDescriptor;[J[J[I[I)I",
+        (void *)android_media_SoundPool_load_FD_batch
+    },
+};
+
 static const char* const kClassPathName = "android/media/SoundPool";
 
 jint JNI_OnLoad(JavaVM* vm, void* reserved)
@@ -318,6 +520,8 @@ jint JNI_OnLoad(JavaVM* vm, void* reserved)
 
     if (AndroidRuntime::registerNativeMethods(env, kClassPathName, gMethods, NELEM(gMethods)) < 0)
         goto bail;
+    AndroidRuntime::registerOptionalNativeMethods(env, kClassPathName,
+            gOptionalMethods, NELEM(gOptionalMethods));
 
     /* success -- return valid version number */
     result = JNI_VERSION_1_4;
@@ -18,9 +18,12 @@
 #include <utils/Log.h>
 
 #include <android/asset_manager_jni.h>
+#include <android/looper.h>
 #include <androidfw/Asset.h>
 #include <androidfw/AssetDir.h>
 #include <androidfw/AssetManager.h>
+#include <utils/List.h>
+#include <utils/Looper.h>
 #include <utils/threads.h>
 
 #include "jni.h"
@@ -48,10 +51,23 @@ struct AAssetDir {
 struct AAsset {
     Asset* mAsset;
 
-    AAsset(Asset* asset) : mAsset(asset) { }
+    // Reads queued by AAsset_readAsync() that have not yet completed.
+    Mutex mLock;
+    Condition mIdle;
+    int mPendingReads;
+
+    AAsset(Asset* asset) : mAsset(asset), mPendingReads(0) { }
     ~AAsset() { delete mAsset; }
 };
 
+// These are not in the public NDK header yet.
+extern "C" {
+typedef void (*AAsset_readCallback)(AAsset* asset, void* buf, int result, void* data);
+
+int AAsset_readAsync(AAsset* asset, void* buf, size_t count, ALooper* looper,
+        AAsset_readCallback callback, void* data);
+}
+
 // -------------------- Public native C API --------------------
 
 /**
@@ -105,7 +121,7 @@ AAsset* AAssetManager_open(AAssetManager* amgr, const char* filename, int mode)
     }
 
     AssetManager* mgr = static_cast<AssetManager*>(amgr);
-    Asset* asset = mgr->open(filename, amMode);
+    Asset* asset = mgr->openConcurrent(filename, amMode);
     if (asset == NULL) {
         return NULL;
     }
@@ -185,10 +201,135 @@ off64_t AAsset_seek64(AAsset* asset, off64_t offset, int whence)
 
 void AAsset_close(AAsset* asset)
 {
+    {
+        Mutex::Autolock _l(asset->mLock);
+        while (asset->mPendingReads > 0) {
+            asset->mIdle.wait(asset->mLock);
+        }
+    }
     asset->mAsset->close();
     delete asset;
 }
 
+/**
+ * Asynchronous reads
+ *
+ * Reads are performed in order on a single worker thread, started the first
+ * time one is queued.  The callback is posted to the given looper, or run on
+ * the worker thread if the looper is NULL.  The asset must not be read or
+ * seeked by the caller while a read is outstanding; AAsset_close() waits for
+ * outstanding reads to finish, but not for their callbacks to run.
+ */
+
+struct AssetReadRequest {
+    AAsset* asset;
+    void* buf;
+    size_t count;
+    sp<Looper> looper;
+    AAsset_readCallback callback;
+    void* data;
+};
+
+class AssetReadCompletion : public MessageHandler {
+public:
+    AssetReadCompletion(const AssetReadRequest& request, int result)
+        : mRequest(request), mResult(result) { }
+
+    virtual void handleMessage(const Message& message) {
+        mRequest.callback(mRequest.asset, mRequest.buf, mResult, mRequest.data);
+    }
+
+private:
+    AssetReadRequest mRequest;
+    int mResult;
+};
+
+class AssetReadThread : public Thread {
+public:
+    AssetReadThread() : Thread(false) { }
+
+    void enqueue(const AssetReadRequest& request) {
+        Mutex::Autolock _l(mLock);
+        mQueue.push_back(request);
+        mCondition.signal();
+    }
+
+private:
+    virtual bool threadLoop() {
+        AssetReadRequest request;
+        {
+            Mutex::Autolock _l(mLock);
+            while (mQueue.empty()) {
+                mCondition.wait(mLock);
+            }
+            request = *mQueue.begin();
+            mQueue.erase(mQueue.begin());
+        }
+
+        int result = request.asset->mAsset->read(request.buf, request.count);
+
+        // Drop the pending count before delivering, so a callback that
+        // closes the asset does not wait on itself.
+        {
+            Mutex::Autolock _l(request.asset->mLock);
+            if (--request.asset->mPendingReads == 0) {
+                request.asset->mIdle.broadcast();
+            }
+        }
+
+        if (request.looper != NULL) {
+            request.looper->sendMessage(new AssetReadCompletion(request, result), Message());
+        } else {
+            request.callback(request.asset, request.buf, result, request.data);
+        }
+        return true;
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    List<AssetReadRequest> mQueue;
+};
+
+static Mutex gReadThreadLock;
+static sp<AssetReadThread> gReadThread;
+
+int AAsset_readAsync(AAsset* asset, void* buf, size_t count, ALooper* looper,
+        AAsset_readCallback callback, void* data)
+{
+    if (callback == NULL) {
+        return -1;
+    }
+
+    sp<AssetReadThread> thread;
+    {
+        Mutex::Autolock _l(gReadThreadLock);
+        if (gReadThread == NULL) {
+            sp<AssetReadThread> t = new AssetReadThread();
+            if (t->run("AAssetReader", PRIORITY_BACKGROUND) != NO_ERROR) {
+                ALOGE("AAsset_readAsync: unable to start reader thread");
+                return -1;
+            }
+            gReadThread = t;
+        }
+        thread = gReadThread;
+    }
+
+    {
+        Mutex::Autolock _l(asset->mLock);
+        asset->mPendingReads++;
+    }
+
+    AssetReadRequest request;
+    request.asset = asset;
+    request.buf = buf;
+    request.count = count;
+    request.looper = static_cast<Looper*>(looper);
+    request.callback = callback;
+    request.data = data;
+    thread->enqueue(request);
+    return 0;
+}
+
 const void* AAsset_getBuffer(AAsset* asset)
 {
     return asset->mAsset->getBuffer(false);
@@ -29,6 +29,7 @@
 #include <gui/SensorEventQueue.h>
 
 #include <poll.h>
+#include <sys/socket.h>
 
 using android::sp;
 using android::Sensor;
@@ -123,7 +124,28 @@ int ASensorEventQueue_hasEvents(ASensorEventQueue* queue)
 ssize_t ASensorEventQueue_getEvents(ASensorEventQueue* queue,
                 ASensorEvent* events, size_t count)
 {
-    return static_cast<SensorEventQueue*>(queue)->read(events, count);
+    // Each read returns at most one of the service's writes, so keep
+    // draining the channel while there is room rather than making the
+    // caller come back through poll for every packet. The channel is a
+    // SEQPACKET socket, which drops whatever part of a packet doesn't fit,
+    // so only read packets that fit whole.
+    SensorEventQueue* q = static_cast<SensorEventQueue*>(queue);
+    ssize_t total = q->read(events, count);
+    if (total <= 0) {
+        return total;
+    }
+    while (size_t(total) < count) {
+        ssize_t next = recv(q->getFd(), NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+        if (next <= 0 || size_t(next) > (count - total) * sizeof(ASensorEvent)) {
+            break;
+        }
+        ssize_t n = q->read(events + total, count - total);
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
 }
 
 
@@ -32,6 +32,17 @@
 
 using namespace android;
 
+// These are not in the public NDK header yet.
+extern "C" {
+typedef void (*AStorageManager_obbProgressFunc)(const char* filename, const int32_t stage,
+        const int32_t progress, void* data);
+
+int32_t AStorageManager_mountObbWithProgress(AStorageManager* mgr, const char* filename,
+        const char* key, AStorageManager_obbCallbackFunc cb,
+        AStorageManager_obbProgressFunc progressCb, void* data);
+void AStorageManager_cancelObb(AStorageManager* mgr, int32_t token);
+}
+
 struct ObbActionListener : public BnObbActionListener {
 private:
     sp<AStorageManager> mStorageManager;
@@ -43,18 +54,23 @@ public:
 
     virtual void onObbResult(const android::String16& filename, const int32_t nonce,
             const int32_t state);
+    virtual void onObbProgress(const android::String16& filename, const int32_t nonce,
+            const int32_t stage, const int32_t progress);
 };
 
 class ObbCallback {
 public:
-    ObbCallback(int32_t _nonce, AStorageManager_obbCallbackFunc _cb, void* _data)
+    ObbCallback(int32_t _nonce, AStorageManager_obbCallbackFunc _cb,
+            AStorageManager_obbProgressFunc _progressCb, void* _data)
             : nonce(_nonce)
             , cb(_cb)
+            , progressCb(_progressCb)
             , data(_data)
     {}
 
     int32_t nonce;
     AStorageManager_obbCallbackFunc cb;
+    AStorageManager_obbProgressFunc progressCb;
     void* data;
 };
 
@@ -70,8 +86,9 @@ protected:
         return android_atomic_inc(&mNextNonce);
     }
 
-    ObbCallback* registerObbCallback(AStorageManager_obbCallbackFunc func, void* data) {
-        ObbCallback* cb = new ObbCallback(getNextNonce(), func, data);
+    ObbCallback* registerObbCallback(AStorageManager_obbCallbackFunc func,
+            AStorageManager_obbProgressFunc progressFunc, void* data) {
+        ObbCallback* cb = new ObbCallback(getNextNonce(), func, progressFunc, data);
         {
             AutoMutex _l(mCallbackLock);
             mCallbacks.push(cb);
@@ -125,15 +142,47 @@ public:
         }
     }
 
-    void mountObb(const char* filename, const char* key, AStorageManager_obbCallbackFunc func, void* data) {
-        ObbCallback* cb = registerObbCallback(func, data);
+    void fireProgress(const char* filename, const int32_t nonce, const int32_t stage,
+            const int32_t progress) {
+        AStorageManager_obbProgressFunc func = NULL;
+        void* data = NULL;
+        {
+            AutoMutex _l(mCallbackLock);
+            int N = mCallbacks.size();
+            for (int i = 0; i < N; i++) {
+                ObbCallback* cb = mCallbacks.itemAt(i);
+                if (cb->nonce == nonce) {
+                    func = cb->progressCb;
+                    data = cb->data;
+                    break;
+                }
+            }
+        }
+
+        // The callback stays registered until the final result, so
+        // progress after cancellation or completion is simply dropped.
+        if (func != NULL) {
+            func(filename, stage, progress, data);
+        }
+    }
+
+    int32_t mountObb(const char* filename, const char* key, AStorageManager_obbCallbackFunc func,
+            AStorageManager_obbProgressFunc progressFunc, void* data) {
+        ObbCallback* cb = registerObbCallback(func, progressFunc, data);
+        const int32_t nonce = cb->nonce;
         String16 filename16(filename);
         String16 key16(key);
-        mMountService->mountObb(filename16, key16, mObbActionListener, cb->nonce);
+        // Each mount has its own nonce, so several may be in flight at once.
+        mMountService->mountObb(filename16, key16, mObbActionListener, nonce);
+        return nonce;
+    }
+
+    void cancelObb(int32_t nonce) {
+        mMountService->cancelObbAction(mObbActionListener, nonce);
     }
 
     void unmountObb(const char* filename, const bool force, AStorageManager_obbCallbackFunc func, void* data) {
-        ObbCallback* cb = registerObbCallback(func, data);
+        ObbCallback* cb = registerObbCallback(func, NULL, data);
         String16 filename16(filename);
         mMountService->unmountObb(filename16, force, mObbActionListener, cb->nonce);
     }
@@ -158,6 +207,11 @@ void ObbActionListener::onObbResult(const android::String16& filename, const int
     mStorageManager->fireCallback(String8(filename).string(), nonce, state);
 }
 
+void ObbActionListener::onObbProgress(const android::String16& filename, const int32_t nonce,
+        const int32_t stage, const int32_t progress) {
+    mStorageManager->fireProgress(String8(filename).string(), nonce, stage, progress);
+}
+
 
 AStorageManager* AStorageManager_new() {
     sp<AStorageManager> mgr = new AStorageManager();
@@ -176,7 +230,17 @@ void AStorageManager_delete(AStorageManager* mgr) {
 
 void AStorageManager_mountObb(AStorageManager* mgr, const char* filename, const char* key,
         AStorageManager_obbCallbackFunc cb, void* data) {
-    mgr->mountObb(filename, key, cb, data);
+    mgr->mountObb(filename, key, cb, NULL, data);
+}
+
+int32_t AStorageManager_mountObbWithProgress(AStorageManager* mgr, const char* filename,
+        const char* key, AStorageManager_obbCallbackFunc cb,
+        AStorageManager_obbProgressFunc progressCb, void* data) {
+    return mgr->mountObb(filename, key, cb, progressCb, data);
+}
+
+void AStorageManager_cancelObb(AStorageManager* mgr, int32_t token) {
+    mgr->cancelObb(token);
 }
 
 void AStorageManager_unmountObb(AStorageManager* mgr, const char* filename, const int force,
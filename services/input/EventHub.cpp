@@ -44,6 +44,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <dirent.h>
+#include <time.h>
 
 #include <sys/inotify.h>
 #include <sys/epoll.h>
@@ -817,8 +818,11 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
 
         // readNotify() will modify the list of devices so this must be done after
         // processing all other events to ensure that we read all remaining events
-        // before closing the devices.
-        if (mPendingINotify && mPendingEventIndex >= mPendingEventCount) {
+        // before closing the devices.  Opening a device is slow, so if input events
+        // were collected in this pass they are returned first and the notification
+        // is handled on the next call, before polling again.
+        if (mPendingINotify && mPendingEventIndex >= mPendingEventCount
+                && event == buffer) {
             mPendingINotify = false;
             readNotifyLocked();
             deviceChanged = true;
@@ -48,6 +48,7 @@
 #include <utils/Trace.h>
 #include <cutils/log.h>
 #include <androidfw/PowerManager.h>
+#include <androidfw/StallDetector.h>
 
 #include <stddef.h>
 #include <unistd.h>
@@ -207,6 +208,7 @@ InputDispatcher::~InputDispatcher() {
 
         resetKeyRepeatLocked();
         releasePendingEventLocked();
+        drainStagedEventsLocked();
         drainInboundQueueLocked();
     }
 
@@ -221,6 +223,7 @@ void InputDispatcher::dispatchOnce() {
         AutoMutex _l(mLock);
         mDispatcherIsAliveCondition.broadcast();
 
+        drainStagedEventsLocked();
         dispatchOnceInnerLocked(&nextWakeupTime);
 
         if (runCommandsLockedInterruptible()) {
@@ -231,7 +234,9 @@ void InputDispatcher::dispatchOnce() {
     // Wait for callback or timeout or wake.  (make sure we round up, not down)
     nsecs_t currentTime = now();
     int timeoutMillis = toMillisecondTimeoutDelay(currentTime, nextWakeupTime);
+    StallDetector::endWork();
     mLooper->pollOnce(timeoutMillis);
+    StallDetector::beginWork();
 }
 
 void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
@@ -284,6 +289,7 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
             mPendingEvent = mInboundQueue.dequeueAtHead();
             traceInboundQueueLengthLocked();
         }
+        mPendingEvent->dispatchTime = currentTime;
 
         // Poke user activity for this event.
         if (mPendingEvent->policyFlags & POLICY_FLAG_PASS_TO_USER) {
@@ -379,7 +385,58 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
     }
 }
 
+void InputDispatcher::stageInboundEvent(EventEntry* entry) {
+    bool needWake;
+    { // acquire staging lock
+        AutoMutex _l(mStagingLock);
+
+        // Only the first event staged since the last drain needs to wake the dispatcher,
+        // so a reader pass that produces many events wakes it once.
+        needWake = mStagedQueue.isEmpty();
+        entry->enqueueTime = now();
+        mStagedQueue.enqueueAtTail(entry);
+    } // release staging lock
+
+    if (needWake) {
+        mLooper->wake();
+    }
+}
+
+void InputDispatcher::drainStagedEventsLocked() {
+    Queue<EventEntry> stagedQueue;
+    { // acquire staging lock
+        AutoMutex _l(mStagingLock);
+        stagedQueue = mStagedQueue;
+        mStagedQueue.head = NULL;
+        mStagedQueue.tail = NULL;
+    } // release staging lock
+
+    while (!stagedQueue.isEmpty()) {
+        EventEntry* entry = stagedQueue.dequeueAtHead();
+
+        // The reader checks whether the input filter is enabled without holding mLock.
+        // Enabling the filter drops every pending event, so also drop events that were
+        // staged without being filtered.
+        if (mInputFilterEnabled
+                && (entry->type == EventEntry::TYPE_KEY
+                        || entry->type == EventEntry::TYPE_MOTION)
+                && !(entry->policyFlags & POLICY_FLAG_FILTERED)) {
+#if DEBUG_DISPATCH_CYCLE
+            ALOGD("Dropped staged event because the input filter was enabled.");
+#endif
+            entry->release();
+            continue;
+        }
+
+        enqueueInboundEventLocked(entry);
+    }
+}
+
 bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
+    if (!entry->enqueueTime) {
+        entry->enqueueTime = now();
+    }
+
     bool needWake = mInboundQueue.isEmpty();
     mInboundQueue.enqueueAtTail(entry);
     traceInboundQueueLengthLocked();
@@ -440,9 +497,10 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t x, int32_t y) {
     // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    const Vector<size_t>& candidates = mWindowIndex.getTouchCandidates(x, y);
+    size_t numCandidates = candidates.size();
+    for (size_t i = 0; i < numCandidates; i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates.itemAt(i));
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         int32_t flags = windowInfo->layoutParamsFlags;
 
@@ -1165,9 +1223,11 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         bool isTouchModal = false;
 
         // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+        // The index only lists the windows that may be touched at this location.
+        const Vector<size_t>& candidates = mWindowIndex.getTouchCandidates(x, y);
+        size_t numCandidates = candidates.size();
+        for (size_t i = 0; i < numCandidates; i++) {
+            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates.itemAt(i));
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             int32_t flags = windowInfo->layoutParamsFlags;
 
@@ -1605,13 +1665,18 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
+    // Only the windows in front of this one can obscure it.
+    ssize_t windowIndex = mWindowIndex.indexOf(windowHandle);
+    const Vector<size_t>& candidates = mWindowIndex.getObscuringCandidates(x, y);
+    size_t numCandidates = candidates.size();
+    for (size_t i = 0; i < numCandidates; i++) {
+        size_t otherIndex = candidates.itemAt(i);
+        if (windowIndex >= 0 && otherIndex >= size_t(windowIndex)) {
             break;
         }
 
+        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(otherIndex);
+
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherInfo->visible && ! otherInfo->isTrustedOverlay()
                 && otherInfo->frameContainsPoint(x, y)) {
@@ -1862,6 +1927,12 @@ void InputDispatcher::enqueueDispatchEntryLocked(
             delete dispatchEntry;
             return; // skip the inconsistent event
         }
+
+        if (mConfig.motionCoalescingEnabled
+                && coalesceMotionDispatchEntryLocked(connection, dispatchEntry)) {
+            delete dispatchEntry;
+            return; // merged into the pending move
+        }
         break;
     }
     }
@@ -1876,6 +1947,53 @@ void InputDispatcher::enqueueDispatchEntryLocked(
     traceOutboundQueueLengthLocked(connection);
 }
 
+bool InputDispatcher::coalesceMotionDispatchEntryLocked(const sp<Connection>& connection,
+        DispatchEntry* dispatchEntry) {
+    // Only coalesce while the application is not keeping up.  Until then the outbound
+    // queue is drained as soon as events are enqueued.
+    DispatchEntry* pendingEntry = connection->outboundQueue.tail;
+    if (!connection->inputPublisherBlocked || !pendingEntry
+            || pendingEntry->eventEntry->type != EventEntry::TYPE_MOTION
+            || pendingEntry->resolvedAction != AMOTION_EVENT_ACTION_MOVE
+            || dispatchEntry->resolvedAction != AMOTION_EVENT_ACTION_MOVE
+            || pendingEntry->resolvedFlags != dispatchEntry->resolvedFlags
+            || pendingEntry->targetFlags != dispatchEntry->targetFlags
+            || pendingEntry->xOffset != dispatchEntry->xOffset
+            || pendingEntry->yOffset != dispatchEntry->yOffset
+            || pendingEntry->scaleFactor != dispatchEntry->scaleFactor) {
+        return false;
+    }
+
+    // Injected events are never coalesced since their injectors may be waiting
+    // for each of them to be finished.
+    MotionEntry* pendingMotionEntry = static_cast<MotionEntry*>(pendingEntry->eventEntry);
+    MotionEntry* motionEntry = static_cast<MotionEntry*>(dispatchEntry->eventEntry);
+    if (pendingMotionEntry->injectionState || motionEntry->injectionState
+            || pendingMotionEntry->deviceId != motionEntry->deviceId
+            || pendingMotionEntry->source != motionEntry->source
+            || pendingMotionEntry->metaState != motionEntry->metaState
+            || pendingMotionEntry->buttonState != motionEntry->buttonState
+            || pendingMotionEntry->pointerCount != motionEntry->pointerCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+        if (pendingMotionEntry->pointerProperties[i] != motionEntry->pointerProperties[i]) {
+            return false;
+        }
+    }
+
+#if DEBUG_DISPATCH_CYCLE
+    ALOGD("channel '%s' ~ coalesceMotionDispatchEntryLocked: replacing pending move",
+            connection->getInputChannelName());
+#endif
+
+    // Swap the events so that the pending dispatch entry delivers the latest sample
+    // and the new dispatch entry releases the stale one when it is deleted.
+    pendingEntry->eventEntry = motionEntry;
+    dispatchEntry->eventEntry = pendingMotionEntry;
+    return true;
+}
+
 void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
         const sp<Connection>& connection) {
 #if DEBUG_DISPATCH_CYCLE
@@ -1885,76 +2003,35 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
 
     while (connection->status == Connection::STATUS_NORMAL
             && !connection->outboundQueue.isEmpty()) {
-        DispatchEntry* dispatchEntry = connection->outboundQueue.head;
-        dispatchEntry->deliveryTime = currentTime;
-
-        // Publish the event.
-        status_t status;
-        EventEntry* eventEntry = dispatchEntry->eventEntry;
-        switch (eventEntry->type) {
-        case EventEntry::TYPE_KEY: {
-            KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
-
-            // Publish the key event.
-            status = connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
-                    keyEntry->deviceId, keyEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    keyEntry->keyCode, keyEntry->scanCode,
-                    keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
-                    keyEntry->eventTime);
-            break;
-        }
-
-        case EventEntry::TYPE_MOTION: {
-            MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
-
-            PointerCoords scaledCoords[MAX_POINTERS];
-            const PointerCoords* usingCoords = motionEntry->pointerCoords;
-
-            // Set the X and Y offset depending on the input source.
-            float xOffset, yOffset, scaleFactor;
-            if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
-                    && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
-                scaleFactor = dispatchEntry->scaleFactor;
-                xOffset = dispatchEntry->xOffset * scaleFactor;
-                yOffset = dispatchEntry->yOffset * scaleFactor;
-                if (scaleFactor != 1.0f) {
-                    for (size_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i] = motionEntry->pointerCoords[i];
-                        scaledCoords[i].scale(scaleFactor);
-                    }
-                    usingCoords = scaledCoords;
-                }
-            } else {
-                xOffset = 0.0f;
-                yOffset = 0.0f;
-                scaleFactor = 1.0f;
-
-                // We don't want the dispatch target to know.
-                if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
-                    for (size_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i].clear();
-                    }
-                    usingCoords = scaledCoords;
-                }
+        // Publish as many queued events as fit in one batch so that they are written
+        // to the channel with a single system call.
+        connection->inputPublisher.beginBatch();
+        status_t status = OK;
+        for (DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+                dispatchEntry && !connection->inputPublisher.isBatchFull();
+                dispatchEntry = dispatchEntry->next) {
+            dispatchEntry->deliveryTime = currentTime;
+            status = publishDispatchEntryLocked(connection, dispatchEntry);
+            if (status) {
+                break;
             }
+        }
 
-            // Publish the motion event.
-            status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
-                    motionEntry->deviceId, motionEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
-                    xOffset, yOffset,
-                    motionEntry->xPrecision, motionEntry->yPrecision,
-                    motionEntry->downTime, motionEntry->eventTime,
-                    motionEntry->pointerCount, motionEntry->pointerProperties,
-                    usingCoords);
-            break;
+        size_t sentCount;
+        status_t sendStatus = connection->inputPublisher.endBatch(&sentCount);
+        if (sendStatus) {
+            status = sendStatus;
         }
 
-        default:
-            ALOG_ASSERT(false);
-            return;
+        // Re-enqueue the events that were sent on the wait queue.
+        if (sentCount) {
+            for (size_t i = 0; i < sentCount; i++) {
+                DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+                connection->outboundQueue.dequeue(dispatchEntry);
+                connection->waitQueue.enqueueAtTail(dispatchEntry);
+            }
+            traceOutboundQueueLengthLocked(connection);
+            traceWaitQueueLengthLocked(connection);
         }
 
         // Check the result.
@@ -1983,12 +2060,74 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             }
             return;
         }
+    }
+}
+
+status_t InputDispatcher::publishDispatchEntryLocked(const sp<Connection>& connection,
+        DispatchEntry* dispatchEntry) {
+    EventEntry* eventEntry = dispatchEntry->eventEntry;
+    switch (eventEntry->type) {
+    case EventEntry::TYPE_KEY: {
+        KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
+
+        // Publish the key event.
+        return connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
+                keyEntry->deviceId, keyEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                keyEntry->keyCode, keyEntry->scanCode,
+                keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
+                keyEntry->eventTime);
+    }
+
+    case EventEntry::TYPE_MOTION: {
+        MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
+
+        PointerCoords scaledCoords[MAX_POINTERS];
+        const PointerCoords* usingCoords = motionEntry->pointerCoords;
+
+        // Set the X and Y offset depending on the input source.
+        float xOffset, yOffset, scaleFactor;
+        if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
+                && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
+            scaleFactor = dispatchEntry->scaleFactor;
+            xOffset = dispatchEntry->xOffset * scaleFactor;
+            yOffset = dispatchEntry->yOffset * scaleFactor;
+            if (scaleFactor != 1.0f) {
+                for (size_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i] = motionEntry->pointerCoords[i];
+                    scaledCoords[i].scale(scaleFactor);
+                }
+                usingCoords = scaledCoords;
+            }
+        } else {
+            xOffset = 0.0f;
+            yOffset = 0.0f;
+            scaleFactor = 1.0f;
+
+            // We don't want the dispatch target to know.
+            if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
+                for (size_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i].clear();
+                }
+                usingCoords = scaledCoords;
+            }
+        }
 
-        // Re-enqueue the event on the wait queue.
-        connection->outboundQueue.dequeue(dispatchEntry);
-        traceOutboundQueueLengthLocked(connection);
-        connection->waitQueue.enqueueAtTail(dispatchEntry);
-        traceWaitQueueLengthLocked(connection);
+        // Publish the motion event.
+        return connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
+                motionEntry->deviceId, motionEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
+                xOffset, yOffset,
+                motionEntry->xPrecision, motionEntry->yPrecision,
+                motionEntry->downTime, motionEntry->eventTime,
+                motionEntry->pointerCount, motionEntry->pointerProperties,
+                usingCoords);
+    }
+
+    default:
+        ALOG_ASSERT(false);
+        return BAD_VALUE;
     }
 }
 
@@ -2281,17 +2420,7 @@ void InputDispatcher::notifyConfigurationChanged(const NotifyConfigurationChange
     ALOGD("notifyConfigurationChanged - eventTime=%lld", args->eventTime);
 #endif
 
-    bool needWake;
-    { // acquire lock
-        AutoMutex _l(mLock);
-
-        ConfigurationChangedEntry* newEntry = new ConfigurationChangedEntry(args->eventTime);
-        needWake = enqueueInboundEventLocked(newEntry);
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
-    }
+    stageInboundEvent(new ConfigurationChangedEntry(args->eventTime));
 }
 
 void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
@@ -2354,34 +2483,20 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
         flags |= AKEY_EVENT_FLAG_WOKE_HERE;
     }
 
-    bool needWake;
-    { // acquire lock
-        mLock.lock();
-
-        if (mInputFilterEnabled) {
-            mLock.unlock();
-
-            policyFlags |= POLICY_FLAG_FILTERED;
-            if (!mPolicy->filterInputEvent(&event, policyFlags)) {
-                return; // event was consumed by the filter
-            }
-
-            mLock.lock();
+    // Checked without the lock, see drainStagedEventsLocked().
+    if (mInputFilterEnabled) {
+        policyFlags |= POLICY_FLAG_FILTERED;
+        if (!mPolicy->filterInputEvent(&event, policyFlags)) {
+            return; // event was consumed by the filter
         }
-
-        int32_t repeatCount = 0;
-        KeyEntry* newEntry = new KeyEntry(args->eventTime,
-                args->deviceId, args->source, policyFlags,
-                args->action, flags, args->keyCode, args->scanCode,
-                metaState, repeatCount, args->downTime);
-
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
     }
+
+    int32_t repeatCount = 0;
+    KeyEntry* newEntry = new KeyEntry(args->eventTime,
+            args->deviceId, args->source, policyFlags,
+            args->action, flags, args->keyCode, args->scanCode,
+            metaState, repeatCount, args->downTime);
+    stageInboundEvent(newEntry);
 }
 
 void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
@@ -2418,42 +2533,28 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
     policyFlags |= POLICY_FLAG_TRUSTED;
     mPolicy->interceptMotionBeforeQueueing(args->eventTime, /*byref*/ policyFlags);
 
-    bool needWake;
-    { // acquire lock
-        mLock.lock();
-
-        if (mInputFilterEnabled) {
-            mLock.unlock();
-
-            MotionEvent event;
-            event.initialize(args->deviceId, args->source, args->action, args->flags,
-                    args->edgeFlags, args->metaState, args->buttonState, 0, 0,
-                    args->xPrecision, args->yPrecision,
-                    args->downTime, args->eventTime,
-                    args->pointerCount, args->pointerProperties, args->pointerCoords);
-
-            policyFlags |= POLICY_FLAG_FILTERED;
-            if (!mPolicy->filterInputEvent(&event, policyFlags)) {
-                return; // event was consumed by the filter
-            }
-
-            mLock.lock();
-        }
-
-        // Just enqueue a new motion event.
-        MotionEntry* newEntry = new MotionEntry(args->eventTime,
-                args->deviceId, args->source, policyFlags,
-                args->action, args->flags, args->metaState, args->buttonState,
-                args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
+    // Checked without the lock, see drainStagedEventsLocked().
+    if (mInputFilterEnabled) {
+        MotionEvent event;
+        event.initialize(args->deviceId, args->source, args->action, args->flags,
+                args->edgeFlags, args->metaState, args->buttonState, 0, 0,
+                args->xPrecision, args->yPrecision,
+                args->downTime, args->eventTime,
                 args->pointerCount, args->pointerProperties, args->pointerCoords);
 
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
+        policyFlags |= POLICY_FLAG_FILTERED;
+        if (!mPolicy->filterInputEvent(&event, policyFlags)) {
+            return; // event was consumed by the filter
+        }
     }
+
+    // Just enqueue a new motion event.
+    MotionEntry* newEntry = new MotionEntry(args->eventTime,
+            args->deviceId, args->source, policyFlags,
+            args->action, args->flags, args->metaState, args->buttonState,
+            args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
+            args->pointerCount, args->pointerProperties, args->pointerCoords);
+    stageInboundEvent(newEntry);
 }
 
 void InputDispatcher::notifySwitch(const NotifySwitchArgs* args) {
@@ -2475,115 +2576,70 @@ void InputDispatcher::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
             args->eventTime, args->deviceId);
 #endif
 
-    bool needWake;
-    { // acquire lock
-        AutoMutex _l(mLock);
-
-        DeviceResetEntry* newEntry = new DeviceResetEntry(args->eventTime, args->deviceId);
-        needWake = enqueueInboundEventLocked(newEntry);
-    } // release lock
-
-    if (needWake) {
-        mLooper->wake();
-    }
+    stageInboundEvent(new DeviceResetEntry(args->eventTime, args->deviceId));
 }
 
 int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
         int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
         uint32_t policyFlags) {
+    return injectInputEvents(&event, 1, injectorPid, injectorUid, syncMode, timeoutMillis,
+            policyFlags);
+}
+
+int32_t InputDispatcher::injectInputEvents(const InputEvent* const* events, size_t eventCount,
+        int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
+        uint32_t policyFlags) {
 #if DEBUG_INBOUND_EVENT_DETAILS
-    ALOGD("injectInputEvent - eventType=%d, injectorPid=%d, injectorUid=%d, "
+    ALOGD("injectInputEvents - eventCount=%d, injectorPid=%d, injectorUid=%d, "
             "syncMode=%d, timeoutMillis=%d, policyFlags=0x%08x",
-            event->getType(), injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
+            eventCount, injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
 #endif
 
+    if (eventCount == 0) {
+        return INPUT_EVENT_INJECTION_SUCCEEDED;
+    }
+
     nsecs_t endTime = now() + milliseconds_to_nanoseconds(timeoutMillis);
 
     policyFlags |= POLICY_FLAG_INJECTED;
     if (hasInjectionPermission(injectorPid, injectorUid)) {
         policyFlags |= POLICY_FLAG_TRUSTED;
-    }
-
-    EventEntry* firstInjectedEntry;
-    EventEntry* lastInjectedEntry;
-    switch (event->getType()) {
-    case AINPUT_EVENT_TYPE_KEY: {
-        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
-        int32_t action = keyEvent->getAction();
-        if (! validateKeyEvent(action)) {
-            return INPUT_EVENT_INJECTION_FAILED;
-        }
-
-        int32_t flags = keyEvent->getFlags();
-        if (flags & AKEY_EVENT_FLAG_VIRTUAL_HARD_KEY) {
-            policyFlags |= POLICY_FLAG_VIRTUAL;
-        }
-
-        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
-            mPolicy->interceptKeyBeforeQueueing(keyEvent, /*byref*/ policyFlags);
-        }
-
-        if (policyFlags & POLICY_FLAG_WOKE_HERE) {
-            flags |= AKEY_EVENT_FLAG_WOKE_HERE;
+    } else if (eventCount > 1) {
+        // Only the last entry of a sequence carries the injection state, which is
+        // what the dispatcher checks against the owner of the target window, so
+        // untrusted injectors have their events injected one at a time.
+        for (size_t i = 0; i < eventCount; i++) {
+            int32_t injectionResult = injectInputEvent(events[i], injectorPid, injectorUid,
+                    syncMode, timeoutMillis, policyFlags);
+            if (injectionResult != INPUT_EVENT_INJECTION_SUCCEEDED) {
+                return injectionResult;
+            }
         }
-
-        mLock.lock();
-        firstInjectedEntry = new KeyEntry(keyEvent->getEventTime(),
-                keyEvent->getDeviceId(), keyEvent->getSource(),
-                policyFlags, action, flags,
-                keyEvent->getKeyCode(), keyEvent->getScanCode(), keyEvent->getMetaState(),
-                keyEvent->getRepeatCount(), keyEvent->getDownTime());
-        lastInjectedEntry = firstInjectedEntry;
-        break;
+        return INPUT_EVENT_INJECTION_SUCCEEDED;
     }
 
-    case AINPUT_EVENT_TYPE_MOTION: {
-        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
-        int32_t action = motionEvent->getAction();
-        size_t pointerCount = motionEvent->getPointerCount();
-        const PointerProperties* pointerProperties = motionEvent->getPointerProperties();
-        if (! validateMotionEvent(action, pointerCount, pointerProperties)) {
+    EventEntry* firstInjectedEntry = NULL;
+    EventEntry* lastInjectedEntry = NULL;
+    for (size_t i = 0; i < eventCount; i++) {
+        EventEntry* firstEntry;
+        EventEntry* lastEntry;
+        if (!createInjectedEntries(events[i], policyFlags, &firstEntry, &lastEntry)) {
+            while (firstInjectedEntry) {
+                EventEntry* nextEntry = firstInjectedEntry->next;
+                firstInjectedEntry->release();
+                firstInjectedEntry = nextEntry;
+            }
             return INPUT_EVENT_INJECTION_FAILED;
         }
-
-        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
-            nsecs_t eventTime = motionEvent->getEventTime();
-            mPolicy->interceptMotionBeforeQueueing(eventTime, /*byref*/ policyFlags);
-        }
-
-        mLock.lock();
-        const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
-        const PointerCoords* samplePointerCoords = motionEvent->getSamplePointerCoords();
-        firstInjectedEntry = new MotionEntry(*sampleEventTimes,
-                motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
-                action, motionEvent->getFlags(),
-                motionEvent->getMetaState(), motionEvent->getButtonState(),
-                motionEvent->getEdgeFlags(),
-                motionEvent->getXPrecision(), motionEvent->getYPrecision(),
-                motionEvent->getDownTime(), uint32_t(pointerCount),
-                pointerProperties, samplePointerCoords);
-        lastInjectedEntry = firstInjectedEntry;
-        for (size_t i = motionEvent->getHistorySize(); i > 0; i--) {
-            sampleEventTimes += 1;
-            samplePointerCoords += pointerCount;
-            MotionEntry* nextInjectedEntry = new MotionEntry(*sampleEventTimes,
-                    motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
-                    action, motionEvent->getFlags(),
-                    motionEvent->getMetaState(), motionEvent->getButtonState(),
-                    motionEvent->getEdgeFlags(),
-                    motionEvent->getXPrecision(), motionEvent->getYPrecision(),
-                    motionEvent->getDownTime(), uint32_t(pointerCount),
-                    pointerProperties, samplePointerCoords);
-            lastInjectedEntry->next = nextInjectedEntry;
-            lastInjectedEntry = nextInjectedEntry;
+        if (lastInjectedEntry) {
+            lastInjectedEntry->next = firstEntry;
+        } else {
+            firstInjectedEntry = firstEntry;
         }
-        break;
+        lastInjectedEntry = lastEntry;
     }
 
-    default:
-        ALOGW("Cannot inject event of type %d", event->getType());
-        return INPUT_EVENT_INJECTION_FAILED;
-    }
+    mLock.lock();
 
     InjectionState* injectionState = new InjectionState(injectorPid, injectorUid);
     if (syncMode == INPUT_EVENT_INJECTION_SYNC_NONE) {
@@ -2671,6 +2727,87 @@ bool InputDispatcher::hasInjectionPermission(int32_t injectorPid, int32_t inject
             || mPolicy->checkInjectEventsPermissionNonReentrant(injectorPid, injectorUid);
 }
 
+bool InputDispatcher::createInjectedEntries(const InputEvent* event, uint32_t policyFlags,
+        EventEntry** outFirstEntry, EventEntry** outLastEntry) {
+    switch (event->getType()) {
+    case AINPUT_EVENT_TYPE_KEY: {
+        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
+        int32_t action = keyEvent->getAction();
+        if (! validateKeyEvent(action)) {
+            return false;
+        }
+
+        int32_t flags = keyEvent->getFlags();
+        if (flags & AKEY_EVENT_FLAG_VIRTUAL_HARD_KEY) {
+            policyFlags |= POLICY_FLAG_VIRTUAL;
+        }
+
+        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
+            mPolicy->interceptKeyBeforeQueueing(keyEvent, /*byref*/ policyFlags);
+        }
+
+        if (policyFlags & POLICY_FLAG_WOKE_HERE) {
+            flags |= AKEY_EVENT_FLAG_WOKE_HERE;
+        }
+
+        *outFirstEntry = new KeyEntry(keyEvent->getEventTime(),
+                keyEvent->getDeviceId(), keyEvent->getSource(),
+                policyFlags, action, flags,
+                keyEvent->getKeyCode(), keyEvent->getScanCode(), keyEvent->getMetaState(),
+                keyEvent->getRepeatCount(), keyEvent->getDownTime());
+        *outLastEntry = *outFirstEntry;
+        break;
+    }
+
+    case AINPUT_EVENT_TYPE_MOTION: {
+        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
+        int32_t action = motionEvent->getAction();
+        size_t pointerCount = motionEvent->getPointerCount();
+        const PointerProperties* pointerProperties = motionEvent->getPointerProperties();
+        if (! validateMotionEvent(action, pointerCount, pointerProperties)) {
+            return false;
+        }
+
+        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
+            nsecs_t eventTime = motionEvent->getEventTime();
+            mPolicy->interceptMotionBeforeQueueing(eventTime, /*byref*/ policyFlags);
+        }
+
+        const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
+        size_t sampleCount = motionEvent->getHistorySize() + 1;
+        PointerCoords samplePointerCoords[MAX_POINTERS];
+        *outFirstEntry = NULL;
+        *outLastEntry = NULL;
+        for (size_t sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++) {
+            for (size_t i = 0; i < pointerCount; i++) {
+                motionEvent->getHistoricalRawPointerCoords(i, sampleIndex,
+                        &samplePointerCoords[i]);
+            }
+            MotionEntry* nextInjectedEntry = new MotionEntry(sampleEventTimes[sampleIndex],
+                    motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
+                    action, motionEvent->getFlags(),
+                    motionEvent->getMetaState(), motionEvent->getButtonState(),
+                    motionEvent->getEdgeFlags(),
+                    motionEvent->getXPrecision(), motionEvent->getYPrecision(),
+                    motionEvent->getDownTime(), uint32_t(pointerCount),
+                    pointerProperties, samplePointerCoords);
+            if (*outLastEntry) {
+                (*outLastEntry)->next = nextInjectedEntry;
+            } else {
+                *outFirstEntry = nextInjectedEntry;
+            }
+            *outLastEntry = nextInjectedEntry;
+        }
+        break;
+    }
+
+    default:
+        ALOGW("Cannot inject event of type %d", event->getType());
+        return false;
+    }
+    return true;
+}
+
 void InputDispatcher::setInjectionResultLocked(EventEntry* entry, int32_t injectionResult) {
     InjectionState* injectionState = entry->injectionState;
     if (injectionState) {
@@ -2724,27 +2861,49 @@ void InputDispatcher::decrementPendingForegroundDispatchesLocked(EventEntry* ent
 
 sp<InputWindowHandle> InputDispatcher::getWindowHandleLocked(
         const sp<InputChannel>& inputChannel) const {
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
-        if (windowHandle->getInputChannel() == inputChannel) {
-            return windowHandle;
-        }
+    ssize_t index = mWindowHandlesByChannel.indexOfKey(inputChannel);
+    if (index < 0) {
+        return NULL;
     }
-    return NULL;
+    return mWindowHandlesByChannel.valueAt(index);
 }
 
 bool InputDispatcher::hasWindowHandleLocked(
         const sp<InputWindowHandle>& windowHandle) const {
+    if (windowHandle == NULL) {
+        return false;
+    }
+    sp<InputChannel> inputChannel = windowHandle->getInputChannel();
+    if (inputChannel == NULL) {
+        return false;
+    }
+    ssize_t index = mWindowHandlesByChannel.indexOfKey(inputChannel);
+    return index >= 0 && mWindowHandlesByChannel.valueAt(index) == windowHandle;
+}
+
+bool InputDispatcher::removeWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) {
     size_t numWindows = mWindowHandles.size();
     for (size_t i = 0; i < numWindows; i++) {
         if (mWindowHandles.itemAt(i) == windowHandle) {
+            mWindowHandles.removeAt(i);
             return true;
         }
     }
     return false;
 }
 
+void InputDispatcher::insertWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) {
+    // The window list is ordered front to back, so insert in front of the first
+    // window that is on a lower layer.
+    int32_t layer = windowHandle->getInfo()->layer;
+    size_t numWindows = mWindowHandles.size();
+    size_t i = 0;
+    while (i < numWindows && mWindowHandles.itemAt(i)->getInfo()->layer >= layer) {
+        i += 1;
+    }
+    mWindowHandles.insertAt(windowHandle, i);
+}
+
 void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) {
 #if DEBUG_FOCUS
     ALOGD("setInputWindows");
@@ -2755,85 +2914,157 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
         Vector<sp<InputWindowHandle> > oldWindowHandles = mWindowHandles;
         mWindowHandles = inputWindowHandles;
 
-        sp<InputWindowHandle> newFocusedWindowHandle;
-        bool foundHoveredWindow = false;
         for (size_t i = 0; i < mWindowHandles.size(); i++) {
             const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
             if (!windowHandle->updateInfo() || windowHandle->getInputChannel() == NULL) {
                 mWindowHandles.removeAt(i--);
-                continue;
             }
-            if (windowHandle->getInfo()->hasFocus) {
-                newFocusedWindowHandle = windowHandle;
+        }
+
+        onWindowHandlesChangedLocked(oldWindowHandles);
+    } // release lock
+
+    // Wake up poll loop since it may need to make new input dispatching choices.
+    mLooper->wake();
+}
+
+void InputDispatcher::updateInputWindows(
+        const Vector<sp<InputWindowHandle> >& addedWindowHandles,
+        const Vector<sp<InputWindowHandle> >& removedWindowHandles,
+        const Vector<sp<InputWindowHandle> >& changedWindowHandles) {
+#if DEBUG_FOCUS
+    ALOGD("updateInputWindows: %d added, %d removed, %d changed",
+            addedWindowHandles.size(), removedWindowHandles.size(),
+            changedWindowHandles.size());
+#endif
+    { // acquire lock
+        AutoMutex _l(mLock);
+
+        // Only windows that leave the list, or are reloaded, need to be considered
+        // for release.
+        Vector<sp<InputWindowHandle> > oldWindowHandles;
+        for (size_t i = 0; i < removedWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& windowHandle = removedWindowHandles.itemAt(i);
+            if (removeWindowHandleLocked(windowHandle)) {
+                oldWindowHandles.push(windowHandle);
+            }
+        }
+
+        // Changed windows are reinserted since their layer may have changed.
+        for (size_t i = 0; i < changedWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& windowHandle = changedWindowHandles.itemAt(i);
+            if (removeWindowHandleLocked(windowHandle)) {
+                oldWindowHandles.push(windowHandle);
             }
-            if (windowHandle == mLastHoverWindowHandle) {
-                foundHoveredWindow = true;
+            if (windowHandle->updateInfo() && windowHandle->getInputChannel() != NULL) {
+                insertWindowHandleLocked(windowHandle);
             }
         }
 
-        if (!foundHoveredWindow) {
-            mLastHoverWindowHandle = NULL;
+        for (size_t i = 0; i < addedWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& windowHandle = addedWindowHandles.itemAt(i);
+            if (removeWindowHandleLocked(windowHandle)) {
+                oldWindowHandles.push(windowHandle);
+            }
+            if (windowHandle->updateInfo() && windowHandle->getInputChannel() != NULL) {
+                insertWindowHandleLocked(windowHandle);
+            }
         }
 
-        if (mFocusedWindowHandle != newFocusedWindowHandle) {
-            if (mFocusedWindowHandle != NULL) {
+        onWindowHandlesChangedLocked(oldWindowHandles);
+    } // release lock
+
+    // Wake up poll loop since it may need to make new input dispatching choices.
+    mLooper->wake();
+}
+
+void InputDispatcher::onWindowHandlesChangedLocked(
+        const Vector<sp<InputWindowHandle> >& oldWindowHandles) {
+    mWindowHandlesByChannel.clear();
+    sp<InputWindowHandle> newFocusedWindowHandle;
+    bool foundHoveredWindow = false;
+    for (size_t i = 0; i < mWindowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
+        // An input channel belongs to a single window.  Should it show up twice, keep
+        // the frontmost window as a scan of the list would have found it first.
+        sp<InputChannel> inputChannel = windowHandle->getInputChannel();
+        if (mWindowHandlesByChannel.indexOfKey(inputChannel) >= 0) {
+            ALOGW("Dropping window '%s' whose input channel '%s' is already used by "
+                    "another window.", windowHandle->getName().string(),
+                    inputChannel->getName().string());
+            mWindowHandles.removeAt(i--);
+            continue;
+        }
+        mWindowHandlesByChannel.add(inputChannel, windowHandle);
+        if (windowHandle->getInfo()->hasFocus) {
+            newFocusedWindowHandle = windowHandle;
+        }
+        if (windowHandle == mLastHoverWindowHandle) {
+            foundHoveredWindow = true;
+        }
+    }
+
+    mWindowIndex.build(mWindowHandles);
+
+    if (!foundHoveredWindow) {
+        mLastHoverWindowHandle = NULL;
+    }
+
+    if (mFocusedWindowHandle != newFocusedWindowHandle) {
+        if (mFocusedWindowHandle != NULL) {
 #if DEBUG_FOCUS
-                ALOGD("Focus left window: %s",
-                        mFocusedWindowHandle->getName().string());
+            ALOGD("Focus left window: %s",
+                    mFocusedWindowHandle->getName().string());
 #endif
-                sp<InputChannel> focusedInputChannel = mFocusedWindowHandle->getInputChannel();
-                if (focusedInputChannel != NULL) {
-                    CancelationOptions options(CancelationOptions::CANCEL_NON_POINTER_EVENTS,
-                            "focus left window");
-                    synthesizeCancelationEventsForInputChannelLocked(
-                            focusedInputChannel, options);
-                }
+            sp<InputChannel> focusedInputChannel = mFocusedWindowHandle->getInputChannel();
+            if (focusedInputChannel != NULL) {
+                CancelationOptions options(CancelationOptions::CANCEL_NON_POINTER_EVENTS,
+                        "focus left window");
+                synthesizeCancelationEventsForInputChannelLocked(
+                        focusedInputChannel, options);
             }
-            if (newFocusedWindowHandle != NULL) {
+        }
+        if (newFocusedWindowHandle != NULL) {
 #if DEBUG_FOCUS
-                ALOGD("Focus entered window: %s",
-                        newFocusedWindowHandle->getName().string());
+            ALOGD("Focus entered window: %s",
+                    newFocusedWindowHandle->getName().string());
 #endif
-            }
-            mFocusedWindowHandle = newFocusedWindowHandle;
         }
+        mFocusedWindowHandle = newFocusedWindowHandle;
+    }
 
-        for (size_t i = 0; i < mTouchState.windows.size(); i++) {
-            TouchedWindow& touchedWindow = mTouchState.windows.editItemAt(i);
-            if (!hasWindowHandleLocked(touchedWindow.windowHandle)) {
+    for (size_t i = 0; i < mTouchState.windows.size(); i++) {
+        TouchedWindow& touchedWindow = mTouchState.windows.editItemAt(i);
+        if (!hasWindowHandleLocked(touchedWindow.windowHandle)) {
 #if DEBUG_FOCUS
-                ALOGD("Touched window was removed: %s",
-                        touchedWindow.windowHandle->getName().string());
+            ALOGD("Touched window was removed: %s",
+                    touchedWindow.windowHandle->getName().string());
 #endif
-                sp<InputChannel> touchedInputChannel =
-                        touchedWindow.windowHandle->getInputChannel();
-                if (touchedInputChannel != NULL) {
-                    CancelationOptions options(CancelationOptions::CANCEL_POINTER_EVENTS,
-                            "touched window was removed");
-                    synthesizeCancelationEventsForInputChannelLocked(
-                            touchedInputChannel, options);
-                }
-                mTouchState.windows.removeAt(i--);
+            sp<InputChannel> touchedInputChannel =
+                    touchedWindow.windowHandle->getInputChannel();
+            if (touchedInputChannel != NULL) {
+                CancelationOptions options(CancelationOptions::CANCEL_POINTER_EVENTS,
+                        "touched window was removed");
+                synthesizeCancelationEventsForInputChannelLocked(
+                        touchedInputChannel, options);
             }
+            mTouchState.windows.removeAt(i--);
         }
+    }
 
-        // Release information for windows that are no longer present.
-        // This ensures that unused input channels are released promptly.
-        // Otherwise, they might stick around until the window handle is destroyed
-        // which might not happen until the next GC.
-        for (size_t i = 0; i < oldWindowHandles.size(); i++) {
-            const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
-            if (!hasWindowHandleLocked(oldWindowHandle)) {
+    // Release information for windows that are no longer present.
+    // This ensures that unused input channels are released promptly.
+    // Otherwise, they might stick around until the window handle is destroyed
+    // which might not happen until the next GC.
+    for (size_t i = 0; i < oldWindowHandles.size(); i++) {
+        const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
+        if (!hasWindowHandleLocked(oldWindowHandle)) {
 #if DEBUG_FOCUS
-                ALOGD("Window went away: %s", oldWindowHandle->getName().string());
+            ALOGD("Window went away: %s", oldWindowHandle->getName().string());
 #endif
-                oldWindowHandle->releaseInfo();
-            }
+            oldWindowHandle->releaseInfo();
         }
-    } // release lock
-
-    // Wake up poll loop since it may need to make new input dispatching choices.
-    mLooper->wake();
+    }
 }
 
 void InputDispatcher::setFocusedApplication(
@@ -3173,6 +3404,21 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             mConfig.keyRepeatDelay * 0.000001f);
     dump.appendFormat(INDENT2 "KeyRepeatTimeout: %0.1fms\n",
             mConfig.keyRepeatTimeout * 0.000001f);
+    dump.appendFormat(INDENT2 "MotionCoalescingEnabled: %s\n",
+            toString(mConfig.motionCoalescingEnabled));
+
+    dump.append(INDENT "Latency:\n");
+    mReadLatency.dump(dump, INDENT2, "Read");
+    mQueueLatency.dump(dump, INDENT2, "Queue");
+    mTargetLatency.dump(dump, INDENT2, "Target");
+    mFinishLatency.dump(dump, INDENT2, "Finish");
+    mTotalLatency.dump(dump, INDENT2, "Total");
+
+    dump.append(INDENT "EntryPools:\n");
+    KeyEntry::sPool.dump(dump);
+    MotionEntry::sPool.dump(dump);
+    DispatchEntry::sPool.dump(dump);
+    CommandEntry::sPool.dump(dump);
 }
 
 status_t InputDispatcher::registerInputChannel(const sp<InputChannel>& inputChannel,
@@ -3399,6 +3645,8 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
     // Handle post-event policy actions.
     DispatchEntry* dispatchEntry = connection->findWaitQueueEntry(seq);
     if (dispatchEntry) {
+        updateFinishStatisticsLocked(finishTime, dispatchEntry);
+
         nsecs_t eventDuration = finishTime - dispatchEntry->deliveryTime;
         if (eventDuration > SLOW_EVENT_PROCESSING_WARNING_TIMEOUT) {
             String8 msg;
@@ -3634,7 +3882,38 @@ void InputDispatcher::initializeKeyEvent(KeyEvent* event, const KeyEntry* entry)
 
 void InputDispatcher::updateDispatchStatisticsLocked(nsecs_t currentTime, const EventEntry* entry,
         int32_t injectionResult, nsecs_t timeSpentWaitingForApplication) {
-    // TODO Write some statistics about how long we spend waiting.
+    // Targets are looked up again while waiting for an application, only count the
+    // event once its dispatch is decided.
+    if (injectionResult == INPUT_EVENT_INJECTION_PENDING || !entry->enqueueTime) {
+        return;
+    }
+
+    if (!entry->isInjected()) {
+        mReadLatency.add(entry->enqueueTime - entry->eventTime);
+    }
+    if (entry->dispatchTime) {
+        mQueueLatency.add(entry->dispatchTime - entry->enqueueTime);
+    }
+}
+
+void InputDispatcher::updateFinishStatisticsLocked(nsecs_t finishTime,
+        const DispatchEntry* dispatchEntry) {
+    const EventEntry* entry = dispatchEntry->eventEntry;
+    if (entry->type != EventEntry::TYPE_KEY && entry->type != EventEntry::TYPE_MOTION) {
+        return;
+    }
+
+    if (entry->dispatchTime && dispatchEntry->deliveryTime >= entry->dispatchTime) {
+        mTargetLatency.add(dispatchEntry->deliveryTime - entry->dispatchTime);
+    }
+    mFinishLatency.add(finishTime - dispatchEntry->deliveryTime);
+    if (!entry->isInjected()) {
+        mTotalLatency.add(finishTime - entry->eventTime);
+    }
+
+    if (ATRACE_ENABLED()) {
+        ATRACE_INT("inputLatencyUs", int32_t((finishTime - entry->eventTime) / 1000));
+    }
 }
 
 void InputDispatcher::traceInboundQueueLengthLocked() {
@@ -3680,6 +3959,90 @@ void InputDispatcher::monitor() {
 }
 
 
+// --- InputDispatcher::EntryPool ---
+
+InputDispatcher::EntryPool::EntryPool(const char* name, size_t objectSize,
+        size_t objectsPerSlab) :
+        mName(name),
+        mObjectSize(((objectSize > sizeof(FreeObject) ? objectSize : sizeof(FreeObject)) + 7)
+                & ~size_t(7)),
+        mObjectsPerSlab(objectsPerSlab),
+        mSlabs(NULL), mFreeList(NULL),
+        mSlabCount(0), mLiveCount(0), mPeakLiveCount(0), mAllocationCount(0) {
+}
+
+InputDispatcher::EntryPool::~EntryPool() {
+    // Entries that are still referenced at exit keep their slabs alive.
+    if (mLiveCount) {
+        return;
+    }
+    while (mSlabs) {
+        Slab* next = mSlabs->next;
+        ::free(mSlabs);
+        mSlabs = next;
+    }
+}
+
+void* InputDispatcher::EntryPool::allocate(size_t size) {
+    LOG_ALWAYS_FATAL_IF(size > mObjectSize,
+            "%s pool cannot allocate %u bytes, object size is %u.",
+            mName, size, mObjectSize);
+
+    AutoMutex _l(mLock);
+    if (!mFreeList) {
+        addSlabLocked();
+    }
+
+    FreeObject* object = mFreeList;
+    mFreeList = object->next;
+    mAllocationCount += 1;
+    mLiveCount += 1;
+    if (mLiveCount > mPeakLiveCount) {
+        mPeakLiveCount = mLiveCount;
+    }
+    return object;
+}
+
+void InputDispatcher::EntryPool::free(void* object) {
+    if (!object) {
+        return;
+    }
+
+    AutoMutex _l(mLock);
+    FreeObject* freeObject = static_cast<FreeObject*>(object);
+    freeObject->next = mFreeList;
+    mFreeList = freeObject;
+    mLiveCount -= 1;
+}
+
+void InputDispatcher::EntryPool::addSlabLocked() {
+    // The slab header is padded so that the objects that follow it stay 8 byte aligned.
+    size_t headerSize = (sizeof(Slab) + 7) & ~size_t(7);
+    char* memory = static_cast<char*>(malloc(headerSize + mObjectSize * mObjectsPerSlab));
+    LOG_ALWAYS_FATAL_IF(!memory, "Could not allocate a slab for the %s pool.", mName);
+
+    Slab* slab = reinterpret_cast<Slab*>(memory);
+    slab->next = mSlabs;
+    mSlabs = slab;
+    mSlabCount += 1;
+
+    char* objects = memory + headerSize;
+    for (size_t i = mObjectsPerSlab; i-- > 0; ) {
+        FreeObject* object = reinterpret_cast<FreeObject*>(objects + i * mObjectSize);
+        object->next = mFreeList;
+        mFreeList = object;
+    }
+}
+
+void InputDispatcher::EntryPool::dump(String8& dump) const {
+    AutoMutex _l(mLock);
+    dump.appendFormat(INDENT2 "%s: objectSize=%u, slabs=%u, capacity=%u, live=%u, "
+            "peakLive=%u, allocations=%llu\n",
+            mName, mObjectSize, mSlabCount, mSlabCount * mObjectsPerSlab,
+            mLiveCount, mPeakLiveCount, mAllocationCount);
+}
+
+
 // --- InputDispatcher::Queue ---
 
 template <typename T>
@@ -3718,7 +4081,8 @@ void InputDispatcher::InjectionState::release() {
 
 InputDispatcher::EventEntry::EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags) :
         refCount(1), type(type), eventTime(eventTime), policyFlags(policyFlags),
-        injectionState(NULL), dispatchInProgress(false) {
+        injectionState(NULL), dispatchInProgress(false),
+        enqueueTime(0), dispatchTime(0) {
 }
 
 InputDispatcher::EventEntry::~EventEntry() {
@@ -3773,6 +4137,9 @@ void InputDispatcher::DeviceResetEntry::appendDescription(String8& msg) const {
 
 // --- InputDispatcher::KeyEntry ---
 
+InputDispatcher::EntryPool InputDispatcher::KeyEntry::sPool("KeyEntry",
+        sizeof(InputDispatcher::KeyEntry), 32);
+
 InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action,
         int32_t flags, int32_t keyCode, int32_t scanCode, int32_t metaState,
@@ -3797,6 +4164,8 @@ void InputDispatcher::KeyEntry::recycle() {
     releaseInjectionState();
 
     dispatchInProgress = false;
+    enqueueTime = 0;
+    dispatchTime = 0;
     syntheticRepeat = false;
     interceptKeyResult = KeyEntry::INTERCEPT_KEY_RESULT_UNKNOWN;
     interceptKeyWakeupTime = 0;
@@ -3805,6 +4174,9 @@ void InputDispatcher::KeyEntry::recycle() {
 
 // --- InputDispatcher::MotionEntry ---
 
+InputDispatcher::EntryPool InputDispatcher::MotionEntry::sPool("MotionEntry",
+        sizeof(InputDispatcher::MotionEntry), 16);
+
 InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action, int32_t flags,
         int32_t metaState, int32_t buttonState,
@@ -3836,6 +4208,9 @@ void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
 
 volatile int32_t InputDispatcher::DispatchEntry::sNextSeqAtomic;
 
+InputDispatcher::EntryPool InputDispatcher::DispatchEntry::sPool("DispatchEntry",
+        sizeof(InputDispatcher::DispatchEntry), 64);
+
 InputDispatcher::DispatchEntry::DispatchEntry(EventEntry* eventEntry,
         int32_t targetFlags, float xOffset, float yOffset, float scaleFactor) :
         seq(nextSeq()),
@@ -4235,6 +4610,9 @@ InputDispatcher::DispatchEntry* InputDispatcher::Connection::findWaitQueueEntry(
 
 // --- InputDispatcher::CommandEntry ---
 
+InputDispatcher::EntryPool InputDispatcher::CommandEntry::sPool("CommandEntry",
+        sizeof(InputDispatcher::CommandEntry), 32);
+
 InputDispatcher::CommandEntry::CommandEntry(Command command) :
     command(command), eventTime(0), keyEntry(NULL), userActivityEventType(0),
     seq(0), handled(false) {
@@ -4355,6 +4733,11 @@ InputDispatcherThread::InputDispatcherThread(const sp<InputDispatcherInterface>&
 InputDispatcherThread::~InputDispatcherThread() {
 }
 
+status_t InputDispatcherThread::readyToRun() {
+    StallDetector::registerThread("InputDispatcher");
+    return OK;
+}
+
 bool InputDispatcherThread::threadLoop() {
     mDispatcher->dispatchOnce();
     return true;
@@ -19,6 +19,7 @@
 
 #include <androidfw/Input.h>
 #include <androidfw/InputTransport.h>
+#include <androidfw/LatencyHistogram.h>
 #include <utils/KeyedVector.h>
 #include <utils/Vector.h>
 #include <utils/threads.h>
@@ -173,9 +174,16 @@ struct InputDispatcherConfiguration {
     // The key repeat inter-key delay.
     nsecs_t keyRepeatDelay;
 
+    // True if motion moves should be coalesced for connections that are backed up.
+    // When the input channel of a window is full, a new move that would be queued
+    // behind an unpublished move for the same pointers replaces it so that the
+    // application catches up on the latest position instead of replaying stale samples.
+    bool motionCoalescingEnabled;
+
     InputDispatcherConfiguration() :
             keyRepeatTimeout(500 * 1000000LL),
-            keyRepeatDelay(50 * 1000000LL) { }
+            keyRepeatDelay(50 * 1000000LL),
+            motionCoalescingEnabled(true) { }
 };
 
 
@@ -298,12 +306,36 @@ public:
             int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
             uint32_t policyFlags) = 0;
 
+    /* Injects a sequence of input events in order and optionally waits for sync.
+     * The events are enqueued together and the synchronization mode applies to the
+     * last event of the sequence, so the whole sequence costs a single wait.
+     * Returns one of the INPUT_EVENT_INJECTION_XXX constants.
+     *
+     * This method may be called on any thread (usually by the input manager).
+     */
+    virtual int32_t injectInputEvents(const InputEvent* const* events, size_t eventCount,
+            int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
+            uint32_t policyFlags) = 0;
+
     /* Sets the list of input windows.
      *
      * This method may be called on any thread (usually by the input manager).
      */
     virtual void setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) = 0;
 
+    /* Applies an incremental update to the list of input windows.
+     *
+     * Added windows are inserted in z-order according to their layer, removed windows
+     * are dropped and changed windows have their information reloaded (and are moved
+     * if their layer changed).  Only the windows named in the update are reloaded and
+     * only the touch state of windows that went away is canceled.
+     *
+     * This method may be called on any thread (usually by the input manager).
+     */
+    virtual void updateInputWindows(const Vector<sp<InputWindowHandle> >& addedWindowHandles,
+            const Vector<sp<InputWindowHandle> >& removedWindowHandles,
+            const Vector<sp<InputWindowHandle> >& changedWindowHandles) = 0;
+
     /* Sets the focused application.
      *
      * This method may be called on any thread (usually by the input manager).
@@ -381,8 +413,14 @@ public:
     virtual int32_t injectInputEvent(const InputEvent* event,
             int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
             uint32_t policyFlags);
+    virtual int32_t injectInputEvents(const InputEvent* const* events, size_t eventCount,
+            int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
+            uint32_t policyFlags);
 
     virtual void setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles);
+    virtual void updateInputWindows(const Vector<sp<InputWindowHandle> >& addedWindowHandles,
+            const Vector<sp<InputWindowHandle> >& removedWindowHandles,
+            const Vector<sp<InputWindowHandle> >& changedWindowHandles);
     virtual void setFocusedApplication(const sp<InputApplicationHandle>& inputApplicationHandle);
     virtual void setInputDispatchMode(bool enabled, bool frozen);
     virtual void setInputFilterEnabled(bool enabled);
@@ -404,6 +442,45 @@ private:
         inline Link() : next(NULL), prev(NULL) { }
     };
 
+    // Fixed size allocator used for the entries that are created and destroyed for
+    // every input event.  Objects are carved out of slabs that are kept for the lifetime
+    // of the pool; freed objects go on a free list so that steady state dispatch does not
+    // touch the heap.  The pool has its own lock because entries are created by the
+    // reader and injecting threads as well as the dispatcher thread.
+    class EntryPool {
+    public:
+        EntryPool(const char* name, size_t objectSize, size_t objectsPerSlab);
+        ~EntryPool();
+
+        void* allocate(size_t size);
+        void free(void* object);
+
+        void dump(String8& dump) const;
+
+    private:
+        struct FreeObject {
+            FreeObject* next;
+        };
+
+        struct Slab {
+            Slab* next;
+        };
+
+        const char* mName;
+        size_t mObjectSize;
+        size_t mObjectsPerSlab;
+
+        mutable Mutex mLock;
+        Slab* mSlabs;
+        FreeObject* mFreeList;
+        size_t mSlabCount;
+        size_t mLiveCount;
+        size_t mPeakLiveCount;
+        uint64_t mAllocationCount;
+
+        void addSlabLocked();
+    };
+
     struct InjectionState {
         mutable int32_t refCount;
 
@@ -436,6 +513,10 @@ private:
 
         bool dispatchInProgress; // initially false, set to true while dispatching
 
+        // Latency tracing timestamps, 0 when the stage has not been reached.
+        nsecs_t enqueueTime;  // time the reader or injector handed the event over
+        nsecs_t dispatchTime; // time the event was taken from the inbound queue
+
         inline bool isInjected() const { return injectionState != NULL; }
 
         void release();
@@ -495,6 +576,10 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        static EntryPool sPool;
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* object) { sPool.free(object); }
+
     protected:
         virtual ~KeyEntry();
     };
@@ -523,6 +608,10 @@ private:
                 const PointerProperties* pointerProperties, const PointerCoords* pointerCoords);
         virtual void appendDescription(String8& msg) const;
 
+        static EntryPool sPool;
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* object) { sPool.free(object); }
+
     protected:
         virtual ~MotionEntry();
     };
@@ -546,6 +635,10 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        static EntryPool sPool;
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* object) { sPool.free(object); }
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -584,6 +677,10 @@ private:
         CommandEntry(Command command);
         ~CommandEntry();
 
+        static EntryPool sPool;
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* object) { sPool.free(object); }
+
         Command command;
 
         // parameters for the command (usage varies by command)
@@ -843,6 +940,16 @@ private:
     Queue<EventEntry> mInboundQueue;
     Queue<CommandEntry> mCommandQueue;
 
+    // Events from the input reader that have already been intercepted by the policy but
+    // not yet added to the inbound queue.  They are staged under their own lock so that
+    // the reader never waits for mLock while the dispatcher is busy.  The dispatcher
+    // moves them to the inbound queue at the start of every dispatchOnce().
+    Mutex mStagingLock;
+    Queue<EventEntry> mStagedQueue;
+
+    void stageInboundEvent(EventEntry* entry);
+    void drainStagedEventsLocked();
+
     void dispatchOnceInnerLocked(nsecs_t* nextWakeupTime);
 
     // Enqueues an inbound event.  Returns true if mLooper->wake() should be called.
@@ -880,6 +987,8 @@ private:
     // Event injection and synchronization.
     Condition mInjectionResultAvailableCondition;
     bool hasInjectionPermission(int32_t injectorPid, int32_t injectorUid);
+    bool createInjectedEntries(const InputEvent* event, uint32_t policyFlags,
+            EventEntry** outFirstEntry, EventEntry** outLastEntry);
     void setInjectionResultLocked(EventEntry* entry, int32_t injectionResult);
 
     Condition mInjectionSyncFinishedCondition;
@@ -911,10 +1020,21 @@ private:
     bool mInputFilterEnabled;
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
+    // Spatial index of mWindowHandles used for hit testing, rebuilt whenever the
+    // window list changes.
+    InputWindowIndex mWindowIndex;
+    // Window handles keyed by input channel.  Every window in mWindowHandles has an
+    // input channel so this also answers membership queries.
+    KeyedVector<sp<InputChannel>, sp<InputWindowHandle> > mWindowHandlesByChannel;
 
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
 
+    bool removeWindowHandleLocked(const sp<InputWindowHandle>& windowHandle);
+    void insertWindowHandleLocked(const sp<InputWindowHandle>& windowHandle);
+    void onWindowHandlesChangedLocked(
+            const Vector<sp<InputWindowHandle> >& oldWindowHandles);
+
     // Focus tracking for keys, trackball, etc.
     sp<InputWindowHandle> mFocusedWindowHandle;
 
@@ -1025,7 +1145,11 @@ private:
             EventEntry* eventEntry, const InputTarget* inputTarget);
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
+    bool coalesceMotionDispatchEntryLocked(const sp<Connection>& connection,
+            DispatchEntry* dispatchEntry);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
+    status_t publishDispatchEntryLocked(const sp<Connection>& connection,
+            DispatchEntry* dispatchEntry);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
     void abortBrokenDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
@@ -1083,8 +1207,16 @@ private:
     void initializeKeyEvent(KeyEvent* event, const KeyEntry* entry);
 
     // Statistics gathering.
+    // Latency of each stage of the pipeline for key and motion events.
+    LatencyHistogram mReadLatency;     // event time until handed to the dispatcher
+    LatencyHistogram mQueueLatency;    // waiting in the inbound queue
+    LatencyHistogram mTargetLatency;   // finding targets until published to the window
+    LatencyHistogram mFinishLatency;   // published until the window finished the event
+    LatencyHistogram mTotalLatency;    // event time until the window finished the event
+
     void updateDispatchStatisticsLocked(nsecs_t currentTime, const EventEntry* entry,
             int32_t injectionResult, nsecs_t timeSpentWaitingForApplication);
+    void updateFinishStatisticsLocked(nsecs_t finishTime, const DispatchEntry* dispatchEntry);
     void traceInboundQueueLengthLocked();
     void traceOutboundQueueLengthLocked(const sp<Connection>& connection);
     void traceWaitQueueLengthLocked(const sp<Connection>& connection);
@@ -1097,6 +1229,7 @@ public:
     ~InputDispatcherThread();
 
 private:
+    virtual status_t readyToRun();
     virtual bool threadLoop();
 
     sp<InputDispatcherInterface> mDispatcher;
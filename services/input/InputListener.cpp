@@ -177,5 +177,34 @@ void QueuedInputListener::flush() {
     mArgsQueue.clear();
 }
 
+void QueuedInputListener::mergeFrom(QueuedInputListener* const* listeners, size_t count) {
+    Vector<size_t> heads;
+    heads.insertAt(0, 0, count);
+    for (;;) {
+        ssize_t earliest = -1;
+        nsecs_t earliestTime = 0;
+        for (size_t i = 0; i < count; i++) {
+            const Vector<NotifyArgs*>& queue = listeners[i]->mArgsQueue;
+            if (heads[i] < queue.size()) {
+                nsecs_t eventTime = queue[heads[i]]->getEventTime();
+                if (earliest < 0 || eventTime < earliestTime) {
+                    earliest = i;
+                    earliestTime = eventTime;
+                }
+            }
+        }
+        if (earliest < 0) {
+            break;
+        }
+        mArgsQueue.push(listeners[earliest]->mArgsQueue[heads[earliest]]);
+        heads.editItemAt(earliest) += 1;
+    }
+
+    // The events now belong to this queue.
+    for (size_t i = 0; i < count; i++) {
+        listeners[i]->mArgsQueue.clear();
+    }
+}
+
 
 } // namespace android
@@ -30,6 +30,7 @@ class InputListenerInterface;
 struct NotifyArgs {
     virtual ~NotifyArgs() { }
 
+    virtual nsecs_t getEventTime() const = 0;
     virtual void notify(const sp<InputListenerInterface>& listener) const = 0;
 };
 
@@ -46,6 +47,7 @@ struct NotifyConfigurationChangedArgs : public NotifyArgs {
 
     virtual ~NotifyConfigurationChangedArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -73,6 +75,7 @@ struct NotifyKeyArgs : public NotifyArgs {
 
     virtual ~NotifyKeyArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -107,6 +110,7 @@ struct NotifyMotionArgs : public NotifyArgs {
 
     virtual ~NotifyMotionArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -127,6 +131,7 @@ struct NotifySwitchArgs : public NotifyArgs {
 
     virtual ~NotifySwitchArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -145,6 +150,7 @@ struct NotifyDeviceResetArgs : public NotifyArgs {
 
     virtual ~NotifyDeviceResetArgs() { }
 
+    virtual nsecs_t getEventTime() const { return eventTime; }
     virtual void notify(const sp<InputListenerInterface>& listener) const;
 };
 
@@ -185,6 +191,11 @@ public:
 
     void flush();
 
+    /* Moves the events queued by other listeners to the end of this queue.
+     * The queue of each listener is assumed to be in time order; events are
+     * merged by event time and ties are broken in favor of earlier listeners. */
+    void mergeFrom(QueuedInputListener* const* listeners, size_t count);
+
 private:
     sp<InputListenerInterface> mInnerListener;
     Vector<NotifyArgs*> mArgsQueue;
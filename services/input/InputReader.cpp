@@ -43,6 +43,7 @@
 
 #include <cutils/log.h>
 #include <androidfw/Keyboard.h>
+#include <androidfw/StallDetector.h>
 #include <androidfw/VirtualKeyMap.h>
 
 #include <stddef.h>
@@ -96,6 +97,12 @@ inline static int32_t signExtendNybble(int32_t value) {
     return value >= 8 ? value - 16 : value;
 }
 
+inline static void setTransformRow(float* row, float xCoeff, float yCoeff, float offset) {
+    row[0] = xCoeff;
+    row[1] = yCoeff;
+    row[2] = offset;
+}
+
 static inline const char* toString(bool value) {
     return value ? "true" : "false";
 }
@@ -239,7 +246,7 @@ void InputReaderConfiguration::setDisplayInfo(int32_t displayId, bool external,
 InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         const sp<InputReaderPolicyInterface>& policy,
         const sp<InputListenerInterface>& listener) :
-        mContext(this), mEventHub(eventHub), mPolicy(policy),
+        mContext(this), mEventHub(eventHub), mPolicy(policy), mShardPendingChanges(0),
         mGlobalMetaState(0), mGeneration(1),
         mDisableVirtualKeysTimeout(LLONG_MIN), mNextTimeout(LLONG_MAX),
         mConfigurationChangesToRefresh(0) {
@@ -250,10 +257,13 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
 
         refreshConfigurationLocked(0);
         updateGlobalMetaStateLocked();
+        startShardsLocked(mConfig.readerShardCount);
     } // release lock
 }
 
 InputReader::~InputReader() {
+    stopShards();
+
     for (size_t i = 0; i < mDevices.size(); i++) {
         delete mDevices.valueAt(i);
     }
@@ -275,13 +285,16 @@ void InputReader::loopOnce() {
             mConfigurationChangesToRefresh = 0;
             timeoutMillis = 0;
             refreshConfigurationLocked(changes);
+            flushShardsLocked();
         } else if (mNextTimeout != LLONG_MAX) {
             nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
             timeoutMillis = toMillisecondTimeoutDelay(now, mNextTimeout);
         }
     } // release lock
 
+    StallDetector::endWork();
     size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, EVENT_BUFFER_SIZE);
+    StallDetector::beginWork();
 
     { // acquire lock
         AutoMutex _l(mLock);
@@ -299,6 +312,7 @@ void InputReader::loopOnce() {
 #endif
                 mNextTimeout = LLONG_MAX;
                 timeoutExpiredLocked(now);
+                flushShardsLocked();
             }
         }
 
@@ -339,8 +353,16 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
 #if DEBUG_RAW_EVENTS
             ALOGD("BatchSize: %d Count: %d", batchSize, count);
 #endif
-            processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            if (mShards.isEmpty()) {
+                processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            } else {
+                mShards[uint32_t(deviceId) % mShards.size()]->enqueueBatch(
+                        deviceId, rawEvent, batchSize);
+            }
         } else {
+            // Devices must be done with earlier events before they are added or removed.
+            flushShardsLocked();
+
             switch (rawEvent->type) {
             case EventHubInterface::DEVICE_ADDED:
                 addDeviceLocked(rawEvent->when, rawEvent->deviceId);
@@ -355,10 +377,76 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
                 ALOG_ASSERT(false); // can't happen
                 break;
             }
+
+            flushShardsLocked();
         }
         count -= batchSize;
         rawEvent += batchSize;
     }
+
+    flushShardsLocked();
+}
+
+void InputReader::startShardsLocked(uint32_t shardCount) {
+    for (uint32_t i = 0; i < shardCount; i++) {
+        sp<Shard> shard = new Shard(this);
+        status_t result = shard->run("InputReaderShard", PRIORITY_URGENT_DISPLAY);
+        if (result) {
+            ALOGE("Could not start input reader shard thread due to error %d.  "
+                    "Processing the remaining devices on the reader thread.", result);
+            break;
+        }
+        mShards.push(shard);
+        mShardListeners.push(shard->getQueuedListener());
+    }
+}
+
+void InputReader::stopShards() {
+    for (size_t i = 0; i < mShards.size(); i++) {
+        mShards[i]->stop();
+    }
+}
+
+InputReaderContext* InputReader::getDeviceContextLocked(int32_t deviceId) {
+    if (mShards.isEmpty()) {
+        return &mContext;
+    }
+    return mShards[uint32_t(deviceId) % mShards.size()]->getContext();
+}
+
+void InputReader::flushShardsLocked() {
+    size_t shardCount = mShards.size();
+    if (!shardCount) {
+        return;
+    }
+
+    // Run the pending batches in parallel and wait for all of them to complete.
+    for (size_t i = 0; i < shardCount; i++) {
+        if (mShards[i]->hasBatches()) {
+            mShards[i]->start();
+        }
+    }
+    for (size_t i = 0; i < shardCount; i++) {
+        mShards[i]->waitUntilIdle();
+    }
+
+    // Apply the changes to shared state that the shards deferred.
+    uint32_t pendingChanges;
+    { // acquire lock
+        AutoMutex _l(mShardLock);
+        pendingChanges = mShardPendingChanges;
+        mShardPendingChanges = 0;
+    } // release lock
+    if (pendingChanges & SHARD_PENDING_META_STATE) {
+        updateGlobalMetaStateLocked();
+    }
+    if (pendingChanges & SHARD_PENDING_FADE_POINTER) {
+        fadePointerLocked();
+    }
+
+    // Merge the events produced by the devices of each shard, including those produced
+    // on the reader thread itself such as device resets, into the reader's queue.
+    mQueuedListener->mergeFrom(mShardListeners.array(), shardCount);
 }
 
 void InputReader::addDeviceLocked(nsecs_t when, int32_t deviceId) {
@@ -413,8 +501,8 @@ void InputReader::removeDeviceLocked(nsecs_t when, int32_t deviceId) {
 
 InputDevice* InputReader::createDeviceLocked(int32_t deviceId,
         const InputDeviceIdentifier& identifier, uint32_t classes) {
-    InputDevice* device = new InputDevice(&mContext, deviceId, bumpGenerationLocked(),
-            identifier, classes);
+    InputDevice* device = new InputDevice(getDeviceContextLocked(deviceId),
+            deviceId, bumpGenerationLocked(), identifier, classes);
 
     // External devices.
     if (classes & INPUT_DEVICE_CLASS_EXTERNAL) {
@@ -612,6 +700,27 @@ int32_t InputReader::getSwitchState(int32_t deviceId, uint32_t sourceMask, int32
     return getStateLocked(deviceId, sourceMask, switchCode, &InputDevice::getSwitchState);
 }
 
+void InputReader::getStates(int32_t deviceId, uint32_t sourceMask,
+        size_t numKeyCodes, const int32_t* keyCodes, int32_t* outKeyCodeStates,
+        size_t numScanCodes, const int32_t* scanCodes, int32_t* outScanCodeStates,
+        size_t numSwitches, const int32_t* switches, int32_t* outSwitchStates) {
+    AutoMutex _l(mLock);
+
+    getStatesLocked(deviceId, sourceMask, numKeyCodes, keyCodes, outKeyCodeStates,
+            &InputDevice::getKeyCodeState);
+    getStatesLocked(deviceId, sourceMask, numScanCodes, scanCodes, outScanCodeStates,
+            &InputDevice::getScanCodeState);
+    getStatesLocked(deviceId, sourceMask, numSwitches, switches, outSwitchStates,
+            &InputDevice::getSwitchState);
+}
+
+void InputReader::getStatesLocked(int32_t deviceId, uint32_t sourceMask, size_t numCodes,
+        const int32_t* codes, int32_t* outStates, GetStateFunc getStateFunc) {
+    for (size_t i = 0; i < numCodes; i++) {
+        outStates[i] = getStateLocked(deviceId, sourceMask, codes[i], getStateFunc);
+    }
+}
+
 int32_t InputReader::getStateLocked(int32_t deviceId, uint32_t sourceMask, int32_t code,
         GetStateFunc getStateFunc) {
     int32_t result = AKEY_STATE_UNKNOWN;
@@ -716,6 +825,7 @@ void InputReader::dump(String8& dump) {
     dump.append("\n");
 
     dump.append("Input Reader State:\n");
+    dump.appendFormat(INDENT "Shards: %d\n", mShards.size());
 
     for (size_t i = 0; i < mDevices.size(); i++) {
         mDevices.valueAt(i)->dump(dump);
@@ -841,6 +951,135 @@ EventHubInterface* InputReader::ContextImpl::getEventHub() {
 }
 
 
+// --- InputReader::Shard ---
+
+InputReader::Shard::Shard(InputReader* reader) :
+        Thread(/*canCallJava*/ true), mReader(reader), mContext(reader, this),
+        mQueuedListener(new QueuedInputListener(NULL)), mBusy(false) {
+}
+
+InputReader::Shard::~Shard() {
+}
+
+void InputReader::Shard::enqueueBatch(int32_t deviceId, const RawEvent* rawEvents,
+        size_t count) {
+    Batch batch;
+    batch.deviceId = deviceId;
+    batch.rawEvents = rawEvents;
+    batch.count = count;
+
+    AutoMutex _l(mLock);
+    mBatches.push(batch);
+}
+
+bool InputReader::Shard::hasBatches() {
+    AutoMutex _l(mLock);
+    return !mBatches.isEmpty();
+}
+
+void InputReader::Shard::start() {
+    AutoMutex _l(mLock);
+    mBusy = true;
+    mCondition.broadcast();
+}
+
+void InputReader::Shard::waitUntilIdle() {
+    AutoMutex _l(mLock);
+    while (mBusy) {
+        mCondition.wait(mLock);
+    }
+}
+
+void InputReader::Shard::stop() {
+    requestExit();
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mCondition.broadcast();
+    } // release lock
+    join();
+}
+
+bool InputReader::Shard::threadLoop() {
+    Vector<Batch> batches;
+    { // acquire lock
+        AutoMutex _l(mLock);
+        while (!mBusy) {
+            if (exitPending()) {
+                return false;
+            }
+            mCondition.wait(mLock);
+        }
+        // Take the batches so that the reader never sees the queue while it drains.
+        batches = mBatches;
+        mBatches.clear();
+    } // release lock
+
+    // The reader lock is held by the reader thread until the shard is idle again.
+    size_t count = batches.size();
+    for (size_t i = 0; i < count; i++) {
+        const Batch& batch = batches.itemAt(i);
+        mReader->processEventsForDeviceLocked(batch.deviceId, batch.rawEvents, batch.count);
+    }
+
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mBusy = false;
+        mCondition.broadcast();
+    } // release lock
+    return true;
+}
+
+
+// --- InputReader::Shard::ShardContext ---
+
+InputReader::Shard::ShardContext::ShardContext(InputReader* reader, Shard* shard) :
+        ContextImpl(reader), mReader(reader), mShard(shard) {
+}
+
+void InputReader::Shard::ShardContext::updateGlobalMetaState() {
+    // Computing the global meta state reads every device, including those that other
+    // shards are processing, so it is left to the reader once all shards are idle.
+    AutoMutex _l(mReader->mShardLock);
+    mReader->mShardPendingChanges |= SHARD_PENDING_META_STATE;
+}
+
+int32_t InputReader::Shard::ShardContext::getGlobalMetaState() {
+    AutoMutex _l(mReader->mShardLock);
+    return ContextImpl::getGlobalMetaState();
+}
+
+void InputReader::Shard::ShardContext::disableVirtualKeysUntil(nsecs_t time) {
+    AutoMutex _l(mReader->mShardLock);
+    ContextImpl::disableVirtualKeysUntil(time);
+}
+
+bool InputReader::Shard::ShardContext::shouldDropVirtualKey(nsecs_t now,
+        InputDevice* device, int32_t keyCode, int32_t scanCode) {
+    AutoMutex _l(mReader->mShardLock);
+    return ContextImpl::shouldDropVirtualKey(now, device, keyCode, scanCode);
+}
+
+void InputReader::Shard::ShardContext::fadePointer() {
+    // Same as updateGlobalMetaState(), fading reaches the devices of all shards.
+    AutoMutex _l(mReader->mShardLock);
+    mReader->mShardPendingChanges |= SHARD_PENDING_FADE_POINTER;
+}
+
+void InputReader::Shard::ShardContext::requestTimeoutAtTime(nsecs_t when) {
+    AutoMutex _l(mReader->mShardLock);
+    ContextImpl::requestTimeoutAtTime(when);
+}
+
+int32_t InputReader::Shard::ShardContext::bumpGeneration() {
+    AutoMutex _l(mReader->mShardLock);
+    return ContextImpl::bumpGeneration();
+}
+
+InputListenerInterface* InputReader::Shard::ShardContext::getListener() {
+    return mShard->mQueuedListener.get();
+}
+
+
 // --- InputReaderThread ---
 
 InputReaderThread::InputReaderThread(const sp<InputReaderInterface>& reader) :
@@ -850,6 +1089,11 @@ InputReaderThread::InputReaderThread(const sp<InputReaderInterface>& reader) :
 InputReaderThread::~InputReaderThread() {
 }
 
+status_t InputReaderThread::readyToRun() {
+    StallDetector::registerThread("InputReader");
+    return OK;
+}
+
 bool InputReaderThread::threadLoop() {
     mReader->loopOnce();
     return true;
@@ -1574,6 +1818,8 @@ void MultiTouchMotionAccumulator::configure(InputDevice* device,
 
     delete[] mSlots;
     mSlots = new Slot[slotCount];
+    mInUseSlots.clear();
+    mWrittenSlots.clear();
 }
 
 void MultiTouchMotionAccumulator::reset(InputDevice* device) {
@@ -1608,9 +1854,20 @@ void MultiTouchMotionAccumulator::clearSlots(int32_t initialSlot) {
             mSlots[i].clear();
         }
     }
+    mInUseSlots.clear();
+    mWrittenSlots.clear();
     mCurrentSlot = initialSlot;
 }
 
+void MultiTouchMotionAccumulator::clearWrittenSlots() {
+    // Slots that were not written since they were last cleared are still clear.
+    while (!mWrittenSlots.isEmpty()) {
+        mSlots[mWrittenSlots.clearFirstMarkedBit()].clear();
+    }
+    mInUseSlots.clear();
+    mCurrentSlot = -1;
+}
+
 void MultiTouchMotionAccumulator::process(const RawEvent* rawEvent) {
     if (rawEvent->type == EV_ABS) {
         bool newSlot = false;
@@ -1699,13 +1956,22 @@ void MultiTouchMotionAccumulator::process(const RawEvent* rawEvent) {
                 slot->mHaveAbsMTToolType = true;
                 break;
             }
+
+            mWrittenSlots.markBit(mCurrentSlot);
+            if (slot->mInUse) {
+                mInUseSlots.markBit(mCurrentSlot);
+            } else {
+                mInUseSlots.clearBit(mCurrentSlot);
+            }
         }
     } else if (rawEvent->type == EV_SYN && rawEvent->code == SYN_MT_REPORT) {
 #ifdef LEGACY_TOUCHSCREEN
         // don't use the slot with pressure less than or qeual to zero
         // some touchscreen driver sends multi-touch event for not-in-use pointer
-        if (mSlots[mCurrentSlot].mAbsMTPressure <= 0)
+        if (mSlots[mCurrentSlot].mAbsMTPressure <= 0) {
             mSlots[mCurrentSlot].mInUse = false;
+            mInUseSlots.clearBit(mCurrentSlot);
+        }
 #endif
         // MultiTouch Sync: The driver has returned all data for *one* of the pointers.
         mCurrentSlot += 1;
@@ -1714,7 +1980,7 @@ void MultiTouchMotionAccumulator::process(const RawEvent* rawEvent) {
 
 void MultiTouchMotionAccumulator::finishSync() {
     if (!mUsingSlotsProtocol) {
-        clearSlots(-1);
+        clearWrittenSlots();
     }
 }
 
@@ -2581,7 +2847,11 @@ void CursorInputMapper::fadePointer() {
 TouchInputMapper::TouchInputMapper(InputDevice* device) :
         InputMapper(device),
         mSource(0), mDeviceMode(DEVICE_MODE_DISABLED),
-        mSurfaceOrientation(-1), mSurfaceWidth(-1), mSurfaceHeight(-1) {
+        mSurfaceOrientation(-1), mSurfaceWidth(-1), mSurfaceHeight(-1),
+        mCurrentRawPointerData(&mRawPointerData[0]),
+        mLastRawPointerData(&mRawPointerData[1]),
+        mCurrentCookedPointerData(&mCookedPointerData[0]),
+        mLastCookedPointerData(&mCookedPointerData[1]) {
 }
 
 TouchInputMapper::~TouchInputMapper() {
@@ -2662,9 +2932,9 @@ void TouchInputMapper::dump(String8& dump) {
     dump.appendFormat(INDENT3 "Last Button State: 0x%08x\n", mLastButtonState);
 
     dump.appendFormat(INDENT3 "Last Raw Touch: pointerCount=%d\n",
-            mLastRawPointerData.pointerCount);
-    for (uint32_t i = 0; i < mLastRawPointerData.pointerCount; i++) {
-        const RawPointerData::Pointer& pointer = mLastRawPointerData.pointers[i];
+            mLastRawPointerData->pointerCount);
+    for (uint32_t i = 0; i < mLastRawPointerData->pointerCount; i++) {
+        const RawPointerData::Pointer& pointer = mLastRawPointerData->pointers[i];
         dump.appendFormat(INDENT4 "[%d]: id=%d, x=%d, y=%d, pressure=%d, "
                 "touchMajor=%d, touchMinor=%d, toolMajor=%d, toolMinor=%d, "
                 "orientation=%d, tiltX=%d, tiltY=%d, distance=%d, "
@@ -2677,10 +2947,10 @@ void TouchInputMapper::dump(String8& dump) {
     }
 
     dump.appendFormat(INDENT3 "Last Cooked Touch: pointerCount=%d\n",
-            mLastCookedPointerData.pointerCount);
-    for (uint32_t i = 0; i < mLastCookedPointerData.pointerCount; i++) {
-        const PointerProperties& pointerProperties = mLastCookedPointerData.pointerProperties[i];
-        const PointerCoords& pointerCoords = mLastCookedPointerData.pointerCoords[i];
+            mLastCookedPointerData->pointerCount);
+    for (uint32_t i = 0; i < mLastCookedPointerData->pointerCount; i++) {
+        const PointerProperties& pointerProperties = mLastCookedPointerData->pointerProperties[i];
+        const PointerCoords& pointerCoords = mLastCookedPointerData->pointerCoords[i];
         dump.appendFormat(INDENT4 "[%d]: id=%d, x=%0.3f, y=%0.3f, pressure=%0.3f, "
                 "touchMajor=%0.3f, touchMinor=%0.3f, toolMajor=%0.3f, toolMinor=%0.3f, "
                 "orientation=%0.3f, tilt=%0.3f, distance=%0.3f, "
@@ -2697,7 +2967,7 @@ void TouchInputMapper::dump(String8& dump) {
                 pointerCoords.getAxisValue(AMOTION_EVENT_AXIS_TILT),
                 pointerCoords.getAxisValue(AMOTION_EVENT_AXIS_DISTANCE),
                 pointerProperties.toolType,
-                toString(mLastCookedPointerData.isHovering(i)));
+                toString(mLastCookedPointerData->isHovering(i)));
     }
 
     if (mDeviceMode == DEVICE_MODE_POINTER) {
@@ -3187,6 +3457,34 @@ void TouchInputMapper::configureSurface(nsecs_t when, bool* outResetNeeded) {
             break;
         }
 
+        // Compute the transform applied to every pointer by cookPointerData().
+        float xMin = mRawPointerAxes.x.minValue;
+        float xMax = mRawPointerAxes.x.maxValue;
+        float yMin = mRawPointerAxes.y.minValue;
+        float yMax = mRawPointerAxes.y.maxValue;
+        switch (mSurfaceOrientation) {
+        case DISPLAY_ORIENTATION_90:
+            setTransformRow(mRawToSurfaceX, 0, mYScale, -yMin * mYScale);
+            setTransformRow(mRawToSurfaceY, -mXScale, 0, xMax * mXScale);
+            mRawToSurfaceOrientation = -M_PI_2;
+            break;
+        case DISPLAY_ORIENTATION_180:
+            setTransformRow(mRawToSurfaceX, -mXScale, 0, xMax * mXScale);
+            setTransformRow(mRawToSurfaceY, 0, -mYScale, yMax * mYScale);
+            mRawToSurfaceOrientation = 0;
+            break;
+        case DISPLAY_ORIENTATION_270:
+            setTransformRow(mRawToSurfaceX, 0, -mYScale, yMax * mYScale);
+            setTransformRow(mRawToSurfaceY, mXScale, 0, -xMin * mXScale);
+            mRawToSurfaceOrientation = M_PI_2;
+            break;
+        default:
+            setTransformRow(mRawToSurfaceX, mXScale, 0, -xMin * mXScale);
+            setTransformRow(mRawToSurfaceY, 0, mYScale, -yMin * mYScale);
+            mRawToSurfaceOrientation = 0;
+            break;
+        }
+
         // Compute pointer gesture detection parameters.
         if (mDeviceMode == DEVICE_MODE_POINTER) {
             int32_t rawWidth = mRawPointerAxes.x.maxValue - mRawPointerAxes.x.minValue + 1;
@@ -3518,10 +3816,10 @@ void TouchInputMapper::reset(nsecs_t when) {
     mWheelXVelocityControl.reset();
     mWheelYVelocityControl.reset();
 
-    mCurrentRawPointerData.clear();
-    mLastRawPointerData.clear();
-    mCurrentCookedPointerData.clear();
-    mLastCookedPointerData.clear();
+    mCurrentRawPointerData->clear();
+    mLastRawPointerData->clear();
+    mCurrentCookedPointerData->clear();
+    mLastCookedPointerData->clear();
     mCurrentButtonState = 0;
     mLastButtonState = 0;
     mCurrentRawVScroll = 0;
@@ -3571,23 +3869,23 @@ void TouchInputMapper::sync(nsecs_t when) {
 
     // Sync touch state.
     bool havePointerIds = true;
-    mCurrentRawPointerData.clear();
+    mCurrentRawPointerData->clear();
     syncTouch(when, &havePointerIds);
 
 #if DEBUG_RAW_EVENTS
     if (!havePointerIds) {
         ALOGD("syncTouch: pointerCount %d -> %d, no pointer ids",
-                mLastRawPointerData.pointerCount,
-                mCurrentRawPointerData.pointerCount);
+                mLastRawPointerData->pointerCount,
+                mCurrentRawPointerData->pointerCount);
     } else {
         ALOGD("syncTouch: pointerCount %d -> %d, touching ids 0x%08x -> 0x%08x, "
                 "hovering ids 0x%08x -> 0x%08x",
-                mLastRawPointerData.pointerCount,
-                mCurrentRawPointerData.pointerCount,
-                mLastRawPointerData.touchingIdBits.value,
-                mCurrentRawPointerData.touchingIdBits.value,
-                mLastRawPointerData.hoveringIdBits.value,
-                mCurrentRawPointerData.hoveringIdBits.value);
+                mLastRawPointerData->pointerCount,
+                mCurrentRawPointerData->pointerCount,
+                mLastRawPointerData->touchingIdBits.value,
+                mCurrentRawPointerData->touchingIdBits.value,
+                mLastRawPointerData->hoveringIdBits.value,
+                mCurrentRawPointerData->hoveringIdBits.value);
     }
 #endif
 
@@ -3595,11 +3893,11 @@ void TouchInputMapper::sync(nsecs_t when) {
     mCurrentFingerIdBits.clear();
     mCurrentStylusIdBits.clear();
     mCurrentMouseIdBits.clear();
-    mCurrentCookedPointerData.clear();
+    mCurrentCookedPointerData->clear();
 
     if (mDeviceMode == DEVICE_MODE_DISABLED) {
         // Drop all input if the device is disabled.
-        mCurrentRawPointerData.clear();
+        mCurrentRawPointerData->clear();
         mCurrentButtonState = 0;
     } else {
         // Preprocess pointer data.
@@ -3609,8 +3907,8 @@ void TouchInputMapper::sync(nsecs_t when) {
 
         // Handle policy on initial down or hover events.
         uint32_t policyFlags = 0;
-        bool initialDown = mLastRawPointerData.pointerCount == 0
-                && mCurrentRawPointerData.pointerCount != 0;
+        bool initialDown = mLastRawPointerData->pointerCount == 0
+                && mCurrentRawPointerData->pointerCount != 0;
         bool buttonsPressed = mCurrentButtonState & ~mLastButtonState;
         if (initialDown || buttonsPressed) {
             // If this is a touch screen, hide the pointer on an initial down.
@@ -3634,7 +3932,7 @@ void TouchInputMapper::sync(nsecs_t when) {
         // Consume raw off-screen touches before cooking pointer data.
         // If touches are consumed, subsequent code will not receive any pointer data.
         if (consumeRawTouches(when, policyFlags)) {
-            mCurrentRawPointerData.clear();
+            mCurrentRawPointerData->clear();
         }
 
         // Cook pointer data.  This call populates the mCurrentCookedPointerData structure
@@ -3644,9 +3942,9 @@ void TouchInputMapper::sync(nsecs_t when) {
 
         // Dispatch the touches either directly or by translation through a pointer on screen.
         if (mDeviceMode == DEVICE_MODE_POINTER) {
-            for (BitSet32 idBits(mCurrentRawPointerData.touchingIdBits); !idBits.isEmpty(); ) {
+            for (BitSet32 idBits(mCurrentRawPointerData->touchingIdBits); !idBits.isEmpty(); ) {
                 uint32_t id = idBits.clearFirstMarkedBit();
-                const RawPointerData::Pointer& pointer = mCurrentRawPointerData.pointerForId(id);
+                const RawPointerData::Pointer& pointer = mCurrentRawPointerData->pointerForId(id);
                 if (pointer.toolType == AMOTION_EVENT_TOOL_TYPE_STYLUS
                         || pointer.toolType == AMOTION_EVENT_TOOL_TYPE_ERASER) {
                     mCurrentStylusIdBits.markBit(id);
@@ -3657,9 +3955,9 @@ void TouchInputMapper::sync(nsecs_t when) {
                     mCurrentMouseIdBits.markBit(id);
                 }
             }
-            for (BitSet32 idBits(mCurrentRawPointerData.hoveringIdBits); !idBits.isEmpty(); ) {
+            for (BitSet32 idBits(mCurrentRawPointerData->hoveringIdBits); !idBits.isEmpty(); ) {
                 uint32_t id = idBits.clearFirstMarkedBit();
-                const RawPointerData::Pointer& pointer = mCurrentRawPointerData.pointerForId(id);
+                const RawPointerData::Pointer& pointer = mCurrentRawPointerData->pointerForId(id);
                 if (pointer.toolType == AMOTION_EVENT_TOOL_TYPE_STYLUS
                         || pointer.toolType == AMOTION_EVENT_TOOL_TYPE_ERASER) {
                     mCurrentStylusIdBits.markBit(id);
@@ -3687,9 +3985,9 @@ void TouchInputMapper::sync(nsecs_t when) {
                 mPointerController->fade(PointerControllerInterface::TRANSITION_GRADUAL);
 
                 mPointerController->setButtonState(mCurrentButtonState);
-                mPointerController->setSpots(mCurrentCookedPointerData.pointerCoords,
-                        mCurrentCookedPointerData.idToIndex,
-                        mCurrentCookedPointerData.touchingIdBits);
+                mPointerController->setSpots(mCurrentCookedPointerData->pointerCoords,
+                        mCurrentCookedPointerData->idToIndex,
+                        mCurrentCookedPointerData->touchingIdBits);
             }
 
             dispatchHoverExit(when, policyFlags);
@@ -3702,9 +4000,14 @@ void TouchInputMapper::sync(nsecs_t when) {
                 policyFlags, mLastButtonState, mCurrentButtonState);
     }
 
-    // Copy current touch to last touch in preparation for the next cycle.
-    mLastRawPointerData.copyFrom(mCurrentRawPointerData);
-    mLastCookedPointerData.copyFrom(mCurrentCookedPointerData);
+    // Swap current touch and last touch in preparation for the next cycle.
+    // The new current touch is cleared at the start of the next sync.
+    RawPointerData* rawPointerData = mLastRawPointerData;
+    mLastRawPointerData = mCurrentRawPointerData;
+    mCurrentRawPointerData = rawPointerData;
+    CookedPointerData* cookedPointerData = mLastCookedPointerData;
+    mLastCookedPointerData = mCurrentCookedPointerData;
+    mCurrentCookedPointerData = cookedPointerData;
     mLastButtonState = mCurrentButtonState;
     mLastFingerIdBits = mCurrentFingerIdBits;
     mLastStylusIdBits = mCurrentStylusIdBits;
@@ -3726,7 +4029,7 @@ void TouchInputMapper::timeoutExpired(nsecs_t when) {
 bool TouchInputMapper::consumeRawTouches(nsecs_t when, uint32_t policyFlags) {
     // Check for release of a virtual key.
     if (mCurrentVirtualKey.down) {
-        if (mCurrentRawPointerData.touchingIdBits.isEmpty()) {
+        if (mCurrentRawPointerData->touchingIdBits.isEmpty()) {
             // Pointer went up while virtual key was down.
             mCurrentVirtualKey.down = false;
             if (!mCurrentVirtualKey.ignored) {
@@ -3741,9 +4044,9 @@ bool TouchInputMapper::consumeRawTouches(nsecs_t when, uint32_t policyFlags) {
             return true;
         }
 
-        if (mCurrentRawPointerData.touchingIdBits.count() == 1) {
-            uint32_t id = mCurrentRawPointerData.touchingIdBits.firstMarkedBit();
-            const RawPointerData::Pointer& pointer = mCurrentRawPointerData.pointerForId(id);
+        if (mCurrentRawPointerData->touchingIdBits.count() == 1) {
+            uint32_t id = mCurrentRawPointerData->touchingIdBits.firstMarkedBit();
+            const RawPointerData::Pointer& pointer = mCurrentRawPointerData->pointerForId(id);
             const VirtualKey* virtualKey = findVirtualKeyHit(pointer.x, pointer.y);
             if (virtualKey && virtualKey->keyCode == mCurrentVirtualKey.keyCode) {
                 // Pointer is still within the space of the virtual key.
@@ -3768,15 +4071,15 @@ bool TouchInputMapper::consumeRawTouches(nsecs_t when, uint32_t policyFlags) {
         }
     }
 
-    if (mLastRawPointerData.touchingIdBits.isEmpty()
-            && !mCurrentRawPointerData.touchingIdBits.isEmpty()) {
+    if (mLastRawPointerData->touchingIdBits.isEmpty()
+            && !mCurrentRawPointerData->touchingIdBits.isEmpty()) {
         // Pointer just went down.  Check for virtual key press or off-screen touches.
-        uint32_t id = mCurrentRawPointerData.touchingIdBits.firstMarkedBit();
-        const RawPointerData::Pointer& pointer = mCurrentRawPointerData.pointerForId(id);
+        uint32_t id = mCurrentRawPointerData->touchingIdBits.firstMarkedBit();
+        const RawPointerData::Pointer& pointer = mCurrentRawPointerData->pointerForId(id);
         if (!isPointInsideSurface(pointer.x, pointer.y)) {
             // If exactly one pointer went down, check for virtual key hit.
             // Otherwise we will drop the entire stroke.
-            if (mCurrentRawPointerData.touchingIdBits.count() == 1) {
+            if (mCurrentRawPointerData->touchingIdBits.count() == 1) {
                 const VirtualKey* virtualKey = findVirtualKeyHit(pointer.x, pointer.y);
                 if (virtualKey) {
                     mCurrentVirtualKey.down = true;
@@ -3816,7 +4119,7 @@ bool TouchInputMapper::consumeRawTouches(nsecs_t when, uint32_t policyFlags) {
     //    area and accidentally triggers a virtual key.  This often happens when virtual keys
     //    are layed out below the screen near to where the on screen keyboard's space bar
     //    is displayed.
-    if (mConfig.virtualKeyQuietTime > 0 && !mCurrentRawPointerData.touchingIdBits.isEmpty()) {
+    if (mConfig.virtualKeyQuietTime > 0 && !mCurrentRawPointerData->touchingIdBits.isEmpty()) {
         mContext->disableVirtualKeysUntil(when + mConfig.virtualKeyQuietTime);
     }
     return false;
@@ -3836,8 +4139,8 @@ void TouchInputMapper::dispatchVirtualKey(nsecs_t when, uint32_t policyFlags,
 }
 
 void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
-    BitSet32 currentIdBits = mCurrentCookedPointerData.touchingIdBits;
-    BitSet32 lastIdBits = mLastCookedPointerData.touchingIdBits;
+    BitSet32 currentIdBits = mCurrentCookedPointerData->touchingIdBits;
+    BitSet32 lastIdBits = mLastCookedPointerData->touchingIdBits;
     int32_t metaState = getContext()->getGlobalMetaState();
     int32_t buttonState = mCurrentButtonState;
 
@@ -3848,9 +4151,9 @@ void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
             dispatchMotion(when, policyFlags, mSource,
                     AMOTION_EVENT_ACTION_MOVE, 0, metaState, buttonState,
                     AMOTION_EVENT_EDGE_FLAG_NONE,
-                    mCurrentCookedPointerData.pointerProperties,
-                    mCurrentCookedPointerData.pointerCoords,
-                    mCurrentCookedPointerData.idToIndex,
+                    mCurrentCookedPointerData->pointerProperties,
+                    mCurrentCookedPointerData->pointerCoords,
+                    mCurrentCookedPointerData->idToIndex,
                     currentIdBits, -1,
                     mOrientedXPrecision, mOrientedYPrecision, mDownTime);
         }
@@ -3865,12 +4168,12 @@ void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
         // Update last coordinates of pointers that have moved so that we observe the new
         // pointer positions at the same time as other pointers that have just gone up.
         bool moveNeeded = updateMovedPointers(
-                mCurrentCookedPointerData.pointerProperties,
-                mCurrentCookedPointerData.pointerCoords,
-                mCurrentCookedPointerData.idToIndex,
-                mLastCookedPointerData.pointerProperties,
-                mLastCookedPointerData.pointerCoords,
-                mLastCookedPointerData.idToIndex,
+                mCurrentCookedPointerData->pointerProperties,
+                mCurrentCookedPointerData->pointerCoords,
+                mCurrentCookedPointerData->idToIndex,
+                mLastCookedPointerData->pointerProperties,
+                mLastCookedPointerData->pointerCoords,
+                mLastCookedPointerData->idToIndex,
                 moveIdBits);
         if (buttonState != mLastButtonState) {
             moveNeeded = true;
@@ -3882,9 +4185,9 @@ void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
 
             dispatchMotion(when, policyFlags, mSource,
                     AMOTION_EVENT_ACTION_POINTER_UP, 0, metaState, buttonState, 0,
-                    mLastCookedPointerData.pointerProperties,
-                    mLastCookedPointerData.pointerCoords,
-                    mLastCookedPointerData.idToIndex,
+                    mLastCookedPointerData->pointerProperties,
+                    mLastCookedPointerData->pointerCoords,
+                    mLastCookedPointerData->idToIndex,
                     dispatchedIdBits, upId,
                     mOrientedXPrecision, mOrientedYPrecision, mDownTime);
             dispatchedIdBits.clearBit(upId);
@@ -3897,9 +4200,9 @@ void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
             ALOG_ASSERT(moveIdBits.value == dispatchedIdBits.value);
             dispatchMotion(when, policyFlags, mSource,
                     AMOTION_EVENT_ACTION_MOVE, 0, metaState, buttonState, 0,
-                    mCurrentCookedPointerData.pointerProperties,
-                    mCurrentCookedPointerData.pointerCoords,
-                    mCurrentCookedPointerData.idToIndex,
+                    mCurrentCookedPointerData->pointerProperties,
+                    mCurrentCookedPointerData->pointerCoords,
+                    mCurrentCookedPointerData->idToIndex,
                     dispatchedIdBits, -1,
                     mOrientedXPrecision, mOrientedYPrecision, mDownTime);
         }
@@ -3916,9 +4219,9 @@ void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
 
             dispatchMotion(when, policyFlags, mSource,
                     AMOTION_EVENT_ACTION_POINTER_DOWN, 0, metaState, buttonState, 0,
-                    mCurrentCookedPointerData.pointerProperties,
-                    mCurrentCookedPointerData.pointerCoords,
-                    mCurrentCookedPointerData.idToIndex,
+                    mCurrentCookedPointerData->pointerProperties,
+                    mCurrentCookedPointerData->pointerCoords,
+                    mCurrentCookedPointerData->idToIndex,
                     dispatchedIdBits, downId,
                     mOrientedXPrecision, mOrientedYPrecision, mDownTime);
         }
@@ -3927,57 +4230,63 @@ void TouchInputMapper::dispatchTouches(nsecs_t when, uint32_t policyFlags) {
 
 void TouchInputMapper::dispatchHoverExit(nsecs_t when, uint32_t policyFlags) {
     if (mSentHoverEnter &&
-            (mCurrentCookedPointerData.hoveringIdBits.isEmpty()
-                    || !mCurrentCookedPointerData.touchingIdBits.isEmpty())) {
+            (mCurrentCookedPointerData->hoveringIdBits.isEmpty()
+                    || !mCurrentCookedPointerData->touchingIdBits.isEmpty())) {
         int32_t metaState = getContext()->getGlobalMetaState();
         dispatchMotion(when, policyFlags, mSource,
                 AMOTION_EVENT_ACTION_HOVER_EXIT, 0, metaState, mLastButtonState, 0,
-                mLastCookedPointerData.pointerProperties,
-                mLastCookedPointerData.pointerCoords,
-                mLastCookedPointerData.idToIndex,
-                mLastCookedPointerData.hoveringIdBits, -1,
+                mLastCookedPointerData->pointerProperties,
+                mLastCookedPointerData->pointerCoords,
+                mLastCookedPointerData->idToIndex,
+                mLastCookedPointerData->hoveringIdBits, -1,
                 mOrientedXPrecision, mOrientedYPrecision, mDownTime);
         mSentHoverEnter = false;
     }
 }
 
 void TouchInputMapper::dispatchHoverEnterAndMove(nsecs_t when, uint32_t policyFlags) {
-    if (mCurrentCookedPointerData.touchingIdBits.isEmpty()
-            && !mCurrentCookedPointerData.hoveringIdBits.isEmpty()) {
+    if (mCurrentCookedPointerData->touchingIdBits.isEmpty()
+            && !mCurrentCookedPointerData->hoveringIdBits.isEmpty()) {
         int32_t metaState = getContext()->getGlobalMetaState();
         if (!mSentHoverEnter) {
             dispatchMotion(when, policyFlags, mSource,
                     AMOTION_EVENT_ACTION_HOVER_ENTER, 0, metaState, mCurrentButtonState, 0,
-                    mCurrentCookedPointerData.pointerProperties,
-                    mCurrentCookedPointerData.pointerCoords,
-                    mCurrentCookedPointerData.idToIndex,
-                    mCurrentCookedPointerData.hoveringIdBits, -1,
+                    mCurrentCookedPointerData->pointerProperties,
+                    mCurrentCookedPointerData->pointerCoords,
+                    mCurrentCookedPointerData->idToIndex,
+                    mCurrentCookedPointerData->hoveringIdBits, -1,
                     mOrientedXPrecision, mOrientedYPrecision, mDownTime);
             mSentHoverEnter = true;
         }
 
         dispatchMotion(when, policyFlags, mSource,
                 AMOTION_EVENT_ACTION_HOVER_MOVE, 0, metaState, mCurrentButtonState, 0,
-                mCurrentCookedPointerData.pointerProperties,
-                mCurrentCookedPointerData.pointerCoords,
-                mCurrentCookedPointerData.idToIndex,
-                mCurrentCookedPointerData.hoveringIdBits, -1,
+                mCurrentCookedPointerData->pointerProperties,
+                mCurrentCookedPointerData->pointerCoords,
+                mCurrentCookedPointerData->idToIndex,
+                mCurrentCookedPointerData->hoveringIdBits, -1,
                 mOrientedXPrecision, mOrientedYPrecision, mDownTime);
     }
 }
 
 void TouchInputMapper::cookPointerData() {
-    uint32_t currentPointerCount = mCurrentRawPointerData.pointerCount;
+    uint32_t currentPointerCount = mCurrentRawPointerData->pointerCount;
 
-    mCurrentCookedPointerData.clear();
-    mCurrentCookedPointerData.pointerCount = currentPointerCount;
-    mCurrentCookedPointerData.hoveringIdBits = mCurrentRawPointerData.hoveringIdBits;
-    mCurrentCookedPointerData.touchingIdBits = mCurrentRawPointerData.touchingIdBits;
+    mCurrentCookedPointerData->clear();
+    mCurrentCookedPointerData->pointerCount = currentPointerCount;
+    mCurrentCookedPointerData->hoveringIdBits = mCurrentRawPointerData->hoveringIdBits;
+    mCurrentCookedPointerData->touchingIdBits = mCurrentRawPointerData->touchingIdBits;
+
+    // Summed sizes are shared between all touching pointers.
+    uint32_t touchingCount = 1;
+    if (mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
+        touchingCount = mCurrentRawPointerData->touchingIdBits.count();
+    }
 
     // Walk through the the active pointers and map device coordinates onto
     // surface coordinates and adjust for display orientation.
     for (uint32_t i = 0; i < currentPointerCount; i++) {
-        const RawPointerData::Pointer& in = mCurrentRawPointerData.pointers[i];
+        const RawPointerData::Pointer& in = mCurrentRawPointerData->pointers[i];
 
         // Size
         float touchMajor, touchMinor, toolMajor, toolMinor, size;
@@ -4014,15 +4323,12 @@ void TouchInputMapper::cookPointerData() {
                 size = 0;
             }
 
-            if (mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
-                uint32_t touchingCount = mCurrentRawPointerData.touchingIdBits.count();
-                if (touchingCount > 1) {
-                    touchMajor /= touchingCount;
-                    touchMinor /= touchingCount;
-                    toolMajor /= touchingCount;
-                    toolMinor /= touchingCount;
-                    size /= touchingCount;
-                }
+            if (touchingCount > 1) {
+                touchMajor /= touchingCount;
+                touchMinor /= touchingCount;
+                toolMajor /= touchingCount;
+                toolMinor /= touchingCount;
+                size /= touchingCount;
             }
 
             if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_GEOMETRIC) {
@@ -4114,37 +4420,23 @@ void TouchInputMapper::cookPointerData() {
         }
 
         // X and Y
-        // Adjust coords for surface orientation.
-        float x, y;
-        switch (mSurfaceOrientation) {
-        case DISPLAY_ORIENTATION_90:
-            x = float(in.y - mRawPointerAxes.y.minValue) * mYScale;
-            y = float(mRawPointerAxes.x.maxValue - in.x) * mXScale;
-            orientation -= M_PI_2;
+        // Map onto the oriented surface with the transform computed by configureSurface().
+        float rawX = in.x;
+        float rawY = in.y;
+        float x = mRawToSurfaceX[0] * rawX + mRawToSurfaceX[1] * rawY + mRawToSurfaceX[2];
+        float y = mRawToSurfaceY[0] * rawX + mRawToSurfaceY[1] * rawY + mRawToSurfaceY[2];
+        if (mRawToSurfaceOrientation != 0) {
+            orientation += mRawToSurfaceOrientation;
             if (orientation < - M_PI_2) {
                 orientation += M_PI;
-            }
-            break;
-        case DISPLAY_ORIENTATION_180:
-            x = float(mRawPointerAxes.x.maxValue - in.x) * mXScale;
-            y = float(mRawPointerAxes.y.maxValue - in.y) * mYScale;
-            break;
-        case DISPLAY_ORIENTATION_270:
-            x = float(mRawPointerAxes.y.maxValue - in.y) * mYScale;
-            y = float(in.x - mRawPointerAxes.x.minValue) * mXScale;
-            orientation += M_PI_2;
-            if (orientation > M_PI_2) {
+            } else if (orientation > M_PI_2) {
                 orientation -= M_PI;
             }
-            break;
-        default:
-            x = float(in.x - mRawPointerAxes.x.minValue) * mXScale;
-            y = float(in.y - mRawPointerAxes.y.minValue) * mYScale;
-            break;
         }
 
         // Write output coords.
-        PointerCoords& out = mCurrentCookedPointerData.pointerCoords[i];
+        // Axes are set in increasing order so that setAxisValue() only ever appends.
+        PointerCoords& out = mCurrentCookedPointerData->pointerCoords[i];
         out.clear();
         out.setAxisValue(AMOTION_EVENT_AXIS_X, x);
         out.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
@@ -4155,18 +4447,18 @@ void TouchInputMapper::cookPointerData() {
         out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MAJOR, toolMajor);
         out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, toolMinor);
         out.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, orientation);
-        out.setAxisValue(AMOTION_EVENT_AXIS_TILT, tilt);
         out.setAxisValue(AMOTION_EVENT_AXIS_DISTANCE, distance);
+        out.setAxisValue(AMOTION_EVENT_AXIS_TILT, tilt);
 
         // Write output properties.
-        PointerProperties& properties = mCurrentCookedPointerData.pointerProperties[i];
+        PointerProperties& properties = mCurrentCookedPointerData->pointerProperties[i];
         uint32_t id = in.id;
         properties.clear();
         properties.id = id;
         properties.toolType = in.toolType;
 
         // Write id index.
-        mCurrentCookedPointerData.idToIndex[id] = i;
+        mCurrentCookedPointerData->idToIndex[id] = i;
     }
 }
 
@@ -4487,7 +4779,7 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
         uint32_t count = 0;
         for (BitSet32 idBits(mCurrentFingerIdBits); !idBits.isEmpty(); count++) {
             uint32_t id = idBits.clearFirstMarkedBit();
-            const RawPointerData::Pointer& pointer = mCurrentRawPointerData.pointerForId(id);
+            const RawPointerData::Pointer& pointer = mCurrentRawPointerData->pointerForId(id);
             positions[count].x = pointer.x * mPointerXMovementScale;
             positions[count].y = pointer.y * mPointerYMovementScale;
         }
@@ -4617,9 +4909,9 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
 
         if (activeTouchId >= 0 && mLastFingerIdBits.hasBit(activeTouchId)) {
             const RawPointerData::Pointer& currentPointer =
-                    mCurrentRawPointerData.pointerForId(activeTouchId);
+                    mCurrentRawPointerData->pointerForId(activeTouchId);
             const RawPointerData::Pointer& lastPointer =
-                    mLastRawPointerData.pointerForId(activeTouchId);
+                    mLastRawPointerData->pointerForId(activeTouchId);
             float deltaX = (currentPointer.x - lastPointer.x) * mPointerXMovementScale;
             float deltaY = (currentPointer.y - lastPointer.y) * mPointerYMovementScale;
 
@@ -4753,9 +5045,9 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
 
         if (mLastFingerIdBits.hasBit(activeTouchId)) {
             const RawPointerData::Pointer& currentPointer =
-                    mCurrentRawPointerData.pointerForId(activeTouchId);
+                    mCurrentRawPointerData->pointerForId(activeTouchId);
             const RawPointerData::Pointer& lastPointer =
-                    mLastRawPointerData.pointerForId(activeTouchId);
+                    mLastRawPointerData->pointerForId(activeTouchId);
             float deltaX = (currentPointer.x - lastPointer.x)
                     * mPointerXMovementScale;
             float deltaY = (currentPointer.y - lastPointer.y)
@@ -4860,7 +5152,7 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
                             + mConfig.pointerGestureMultitouchSettleInterval - when)
                             * 0.000001f);
 #endif
-            mCurrentRawPointerData.getCentroidOfTouchingPointers(
+            mCurrentRawPointerData->getCentroidOfTouchingPointers(
                     &mPointerGesture.referenceTouchX,
                     &mPointerGesture.referenceTouchY);
             mPointerController->getPosition(&mPointerGesture.referenceGestureX,
@@ -4883,8 +5175,8 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
         for (BitSet32 idBits(commonIdBits); !idBits.isEmpty(); ) {
             bool first = (idBits == commonIdBits);
             uint32_t id = idBits.clearFirstMarkedBit();
-            const RawPointerData::Pointer& cpd = mCurrentRawPointerData.pointerForId(id);
-            const RawPointerData::Pointer& lpd = mLastRawPointerData.pointerForId(id);
+            const RawPointerData::Pointer& cpd = mCurrentRawPointerData->pointerForId(id);
+            const RawPointerData::Pointer& lpd = mLastRawPointerData->pointerForId(id);
             PointerGesture::Delta& delta = mPointerGesture.referenceDeltas[id];
             delta.dx += cpd.x - lpd.x;
             delta.dy += cpd.y - lpd.y;
@@ -4928,8 +5220,8 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
                     BitSet32 idBits(mCurrentFingerIdBits);
                     uint32_t id1 = idBits.clearFirstMarkedBit();
                     uint32_t id2 = idBits.firstMarkedBit();
-                    const RawPointerData::Pointer& p1 = mCurrentRawPointerData.pointerForId(id1);
-                    const RawPointerData::Pointer& p2 = mCurrentRawPointerData.pointerForId(id2);
+                    const RawPointerData::Pointer& p1 = mCurrentRawPointerData->pointerForId(id1);
+                    const RawPointerData::Pointer& p2 = mCurrentRawPointerData->pointerForId(id2);
                     float mutualDistance = distance(p1.x, p1.y, p2.x, p2.y);
                     if (mutualDistance > mPointerGestureMaxSwipeWidth) {
                         // There are two pointers but they are too far apart for a SWIPE,
@@ -5125,7 +5417,7 @@ bool TouchInputMapper::preparePointerGestures(nsecs_t when,
                 mPointerGesture.currentGestureIdToIndex[gestureId] = i;
 
                 const RawPointerData::Pointer& pointer =
-                        mCurrentRawPointerData.pointerForId(touchId);
+                        mCurrentRawPointerData->pointerForId(touchId);
                 float deltaX = (pointer.x - mPointerGesture.referenceTouchX)
                         * mPointerXZoomScale;
                 float deltaY = (pointer.y - mPointerGesture.referenceTouchY)
@@ -5200,21 +5492,21 @@ void TouchInputMapper::dispatchPointerStylus(nsecs_t when, uint32_t policyFlags)
     bool down, hovering;
     if (!mCurrentStylusIdBits.isEmpty()) {
         uint32_t id = mCurrentStylusIdBits.firstMarkedBit();
-        uint32_t index = mCurrentCookedPointerData.idToIndex[id];
-        float x = mCurrentCookedPointerData.pointerCoords[index].getX();
-        float y = mCurrentCookedPointerData.pointerCoords[index].getY();
+        uint32_t index = mCurrentCookedPointerData->idToIndex[id];
+        float x = mCurrentCookedPointerData->pointerCoords[index].getX();
+        float y = mCurrentCookedPointerData->pointerCoords[index].getY();
         mPointerController->setPosition(x, y);
 
-        hovering = mCurrentCookedPointerData.hoveringIdBits.hasBit(id);
+        hovering = mCurrentCookedPointerData->hoveringIdBits.hasBit(id);
         down = !hovering;
 
         mPointerController->getPosition(&x, &y);
-        mPointerSimple.currentCoords.copyFrom(mCurrentCookedPointerData.pointerCoords[index]);
+        mPointerSimple.currentCoords.copyFrom(mCurrentCookedPointerData->pointerCoords[index]);
         mPointerSimple.currentCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
         mPointerSimple.currentCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
         mPointerSimple.currentProperties.id = 0;
         mPointerSimple.currentProperties.toolType =
-                mCurrentCookedPointerData.pointerProperties[index].toolType;
+                mCurrentCookedPointerData->pointerProperties[index].toolType;
     } else {
         down = false;
         hovering = false;
@@ -5234,14 +5526,14 @@ void TouchInputMapper::dispatchPointerMouse(nsecs_t when, uint32_t policyFlags)
     bool down, hovering;
     if (!mCurrentMouseIdBits.isEmpty()) {
         uint32_t id = mCurrentMouseIdBits.firstMarkedBit();
-        uint32_t currentIndex = mCurrentRawPointerData.idToIndex[id];
+        uint32_t currentIndex = mCurrentRawPointerData->idToIndex[id];
         if (mLastMouseIdBits.hasBit(id)) {
-            uint32_t lastIndex = mCurrentRawPointerData.idToIndex[id];
-            float deltaX = (mCurrentRawPointerData.pointers[currentIndex].x
-                    - mLastRawPointerData.pointers[lastIndex].x)
+            uint32_t lastIndex = mCurrentRawPointerData->idToIndex[id];
+            float deltaX = (mCurrentRawPointerData->pointers[currentIndex].x
+                    - mLastRawPointerData->pointers[lastIndex].x)
                     * mPointerXMovementScale;
-            float deltaY = (mCurrentRawPointerData.pointers[currentIndex].y
-                    - mLastRawPointerData.pointers[lastIndex].y)
+            float deltaY = (mCurrentRawPointerData->pointers[currentIndex].y
+                    - mLastRawPointerData->pointers[lastIndex].y)
                     * mPointerYMovementScale;
 
             rotateDelta(mSurfaceOrientation, &deltaX, &deltaY);
@@ -5258,14 +5550,14 @@ void TouchInputMapper::dispatchPointerMouse(nsecs_t when, uint32_t policyFlags)
         float x, y;
         mPointerController->getPosition(&x, &y);
         mPointerSimple.currentCoords.copyFrom(
-                mCurrentCookedPointerData.pointerCoords[currentIndex]);
+                mCurrentCookedPointerData->pointerCoords[currentIndex]);
         mPointerSimple.currentCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
         mPointerSimple.currentCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
         mPointerSimple.currentCoords.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE,
                 hovering ? 0.0f : 1.0f);
         mPointerSimple.currentProperties.id = 0;
         mPointerSimple.currentProperties.toolType =
-                mCurrentCookedPointerData.pointerProperties[currentIndex].toolType;
+                mCurrentCookedPointerData->pointerProperties[currentIndex].toolType;
     } else {
         mPointerVelocityControl.reset();
 
@@ -5508,10 +5800,10 @@ const TouchInputMapper::VirtualKey* TouchInputMapper::findVirtualKeyHit(
 }
 
 void TouchInputMapper::assignPointerIds() {
-    uint32_t currentPointerCount = mCurrentRawPointerData.pointerCount;
-    uint32_t lastPointerCount = mLastRawPointerData.pointerCount;
+    uint32_t currentPointerCount = mCurrentRawPointerData->pointerCount;
+    uint32_t lastPointerCount = mLastRawPointerData->pointerCount;
 
-    mCurrentRawPointerData.clearIdBits();
+    mCurrentRawPointerData->clearIdBits();
 
     if (currentPointerCount == 0) {
         // No pointers to assign.
@@ -5522,21 +5814,21 @@ void TouchInputMapper::assignPointerIds() {
         // All pointers are new.
         for (uint32_t i = 0; i < currentPointerCount; i++) {
             uint32_t id = i;
-            mCurrentRawPointerData.pointers[i].id = id;
-            mCurrentRawPointerData.idToIndex[id] = i;
-            mCurrentRawPointerData.markIdBit(id, mCurrentRawPointerData.isHovering(i));
+            mCurrentRawPointerData->pointers[i].id = id;
+            mCurrentRawPointerData->idToIndex[id] = i;
+            mCurrentRawPointerData->markIdBit(id, mCurrentRawPointerData->isHovering(i));
         }
         return;
     }
 
     if (currentPointerCount == 1 && lastPointerCount == 1
-            && mCurrentRawPointerData.pointers[0].toolType
-                    == mLastRawPointerData.pointers[0].toolType) {
+            && mCurrentRawPointerData->pointers[0].toolType
+                    == mLastRawPointerData->pointers[0].toolType) {
         // Only one pointer and no change in count so it must have the same id as before.
-        uint32_t id = mLastRawPointerData.pointers[0].id;
-        mCurrentRawPointerData.pointers[0].id = id;
-        mCurrentRawPointerData.idToIndex[id] = 0;
-        mCurrentRawPointerData.markIdBit(id, mCurrentRawPointerData.isHovering(0));
+        uint32_t id = mLastRawPointerData->pointers[0].id;
+        mCurrentRawPointerData->pointers[0].id = id;
+        mCurrentRawPointerData->idToIndex[id] = 0;
+        mCurrentRawPointerData->markIdBit(id, mCurrentRawPointerData->isHovering(0));
         return;
     }
 
@@ -5554,9 +5846,9 @@ void TouchInputMapper::assignPointerIds() {
         for (uint32_t lastPointerIndex = 0; lastPointerIndex < lastPointerCount;
                 lastPointerIndex++) {
             const RawPointerData::Pointer& currentPointer =
-                    mCurrentRawPointerData.pointers[currentPointerIndex];
+                    mCurrentRawPointerData->pointers[currentPointerIndex];
             const RawPointerData::Pointer& lastPointer =
-                    mLastRawPointerData.pointers[lastPointerIndex];
+                    mLastRawPointerData->pointers[lastPointerIndex];
             if (currentPointer.toolType == lastPointer.toolType) {
                 int64_t deltaX = currentPointer.x - lastPointer.x;
                 int64_t deltaY = currentPointer.y - lastPointer.y;
@@ -5662,11 +5954,11 @@ void TouchInputMapper::assignPointerIds() {
             matchedCurrentBits.markBit(currentPointerIndex);
             matchedLastBits.markBit(lastPointerIndex);
 
-            uint32_t id = mLastRawPointerData.pointers[lastPointerIndex].id;
-            mCurrentRawPointerData.pointers[currentPointerIndex].id = id;
-            mCurrentRawPointerData.idToIndex[id] = currentPointerIndex;
-            mCurrentRawPointerData.markIdBit(id,
-                    mCurrentRawPointerData.isHovering(currentPointerIndex));
+            uint32_t id = mLastRawPointerData->pointers[lastPointerIndex].id;
+            mCurrentRawPointerData->pointers[currentPointerIndex].id = id;
+            mCurrentRawPointerData->idToIndex[id] = currentPointerIndex;
+            mCurrentRawPointerData->markIdBit(id,
+                    mCurrentRawPointerData->isHovering(currentPointerIndex));
             usedIdBits.markBit(id);
 
 #if DEBUG_POINTER_ASSIGNMENT
@@ -5682,10 +5974,10 @@ void TouchInputMapper::assignPointerIds() {
         uint32_t currentPointerIndex = matchedCurrentBits.markFirstUnmarkedBit();
         uint32_t id = usedIdBits.markFirstUnmarkedBit();
 
-        mCurrentRawPointerData.pointers[currentPointerIndex].id = id;
-        mCurrentRawPointerData.idToIndex[id] = currentPointerIndex;
-        mCurrentRawPointerData.markIdBit(id,
-                mCurrentRawPointerData.isHovering(currentPointerIndex));
+        mCurrentRawPointerData->pointers[currentPointerIndex].id = id;
+        mCurrentRawPointerData->idToIndex[id] = currentPointerIndex;
+        mCurrentRawPointerData->markIdBit(id,
+                mCurrentRawPointerData->isHovering(currentPointerIndex));
 
 #if DEBUG_POINTER_ASSIGNMENT
         ALOGD("assignPointerIds - assigned: cur=%d, id=%d",
@@ -5766,16 +6058,16 @@ void SingleTouchInputMapper::process(const RawEvent* rawEvent) {
 
 void SingleTouchInputMapper::syncTouch(nsecs_t when, bool* outHavePointerIds) {
     if (mTouchButtonAccumulator.isToolActive()) {
-        mCurrentRawPointerData.pointerCount = 1;
-        mCurrentRawPointerData.idToIndex[0] = 0;
+        mCurrentRawPointerData->pointerCount = 1;
+        mCurrentRawPointerData->idToIndex[0] = 0;
 
         bool isHovering = mTouchButtonAccumulator.getToolType() != AMOTION_EVENT_TOOL_TYPE_MOUSE
                 && (mTouchButtonAccumulator.isHovering()
                         || (mRawPointerAxes.pressure.valid
                                 && mSingleTouchMotionAccumulator.getAbsolutePressure() <= 0));
-        mCurrentRawPointerData.markIdBit(0, isHovering);
+        mCurrentRawPointerData->markIdBit(0, isHovering);
 
-        RawPointerData::Pointer& outPointer = mCurrentRawPointerData.pointers[0];
+        RawPointerData::Pointer& outPointer = mCurrentRawPointerData->pointers[0];
         outPointer.id = 0;
         outPointer.x = mSingleTouchMotionAccumulator.getAbsoluteX();
         outPointer.y = mSingleTouchMotionAccumulator.getAbsoluteY();
@@ -5837,16 +6129,14 @@ void MultiTouchInputMapper::process(const RawEvent* rawEvent) {
 }
 
 void MultiTouchInputMapper::syncTouch(nsecs_t when, bool* outHavePointerIds) {
-    size_t inCount = mMultiTouchMotionAccumulator.getSlotCount();
     size_t outCount = 0;
     BitSet32 newPointerIdBits;
 
-    for (size_t inIndex = 0; inIndex < inCount; inIndex++) {
+    // Only visit the slots that are in use, in slot order.
+    for (BitSet32 inUseSlots(mMultiTouchMotionAccumulator.getInUseSlots());
+            !inUseSlots.isEmpty(); ) {
         const MultiTouchMotionAccumulator::Slot* inSlot =
-                mMultiTouchMotionAccumulator.getSlot(inIndex);
-        if (!inSlot->isInUse()) {
-            continue;
-        }
+                mMultiTouchMotionAccumulator.getSlot(inUseSlots.clearFirstMarkedBit());
 
         if (outCount >= MAX_POINTERS) {
 #if DEBUG_POINTERS
@@ -5857,7 +6147,7 @@ void MultiTouchInputMapper::syncTouch(nsecs_t when, bool* outHavePointerIds) {
             break; // too many fingers!
         }
 
-        RawPointerData::Pointer& outPointer = mCurrentRawPointerData.pointers[outCount];
+        RawPointerData::Pointer& outPointer = mCurrentRawPointerData->pointers[outCount];
         outPointer.x = inSlot->getX();
         outPointer.y = inSlot->getY();
         outPointer.pressure = inSlot->getPressure();
@@ -5902,12 +6192,12 @@ void MultiTouchInputMapper::syncTouch(nsecs_t when, bool* outHavePointerIds) {
             }
             if (id < 0) {
                 *outHavePointerIds = false;
-                mCurrentRawPointerData.clearIdBits();
+                mCurrentRawPointerData->clearIdBits();
                 newPointerIdBits.clear();
             } else {
                 outPointer.id = id;
-                mCurrentRawPointerData.idToIndex[id] = outCount;
-                mCurrentRawPointerData.markIdBit(id, isHovering);
+                mCurrentRawPointerData->idToIndex[id] = outCount;
+                mCurrentRawPointerData->markIdBit(id, isHovering);
                 newPointerIdBits.markBit(id);
             }
         }
@@ -5915,7 +6205,7 @@ void MultiTouchInputMapper::syncTouch(nsecs_t when, bool* outHavePointerIds) {
         outCount += 1;
     }
 
-    mCurrentRawPointerData.pointerCount = outCount;
+    mCurrentRawPointerData->pointerCount = outCount;
     mPointerIdBits = newPointerIdBits;
 
     mMultiTouchMotionAccumulator.finishSync();
@@ -5970,8 +6260,13 @@ bool MultiTouchInputMapper::hasStylus() const {
 
 // --- JoystickInputMapper ---
 
+// Default maximum rate of joystick motion events, in events per second.
+// Changes that arrive faster are folded into the next event.
+static const int32_t JOYSTICK_DEFAULT_MAX_EVENT_RATE = 60;
+
 JoystickInputMapper::JoystickInputMapper(InputDevice* device) :
-        InputMapper(device) {
+        InputMapper(device), mMinEventInterval(0), mLastEventTime(LLONG_MIN),
+        mHaveDeferredSync(false), mDeferredSyncTime(0) {
 }
 
 JoystickInputMapper::~JoystickInputMapper() {
@@ -5997,6 +6292,7 @@ void JoystickInputMapper::populateDeviceInfo(InputDeviceInfo* info) {
 
 void JoystickInputMapper::dump(String8& dump) {
     dump.append(INDENT2 "Joystick Input Mapper:\n");
+    dump.appendFormat(INDENT3 "MinEventInterval: %0.3fms\n", mMinEventInterval * 0.000001f);
 
     dump.append(INDENT3 "Axes:\n");
     size_t numAxes = mAxes.size();
@@ -6020,8 +6316,8 @@ void JoystickInputMapper::dump(String8& dump) {
             dump.append(" (invert)");
         }
 
-        dump.appendFormat(": min=%0.5f, max=%0.5f, flat=%0.5f, fuzz=%0.5f\n",
-                axis.min, axis.max, axis.flat, axis.fuzz);
+        dump.appendFormat(": min=%0.5f, max=%0.5f, flat=%0.5f, fuzz=%0.5f, filter=%0.5f\n",
+                axis.min, axis.max, axis.flat, axis.fuzz, axis.filter);
         dump.appendFormat(INDENT4 "  scale=%0.5f, offset=%0.5f, "
                 "highScale=%0.5f, highOffset=%0.5f\n",
                 axis.scale, axis.offset, axis.highScale, axis.highOffset);
@@ -6121,6 +6417,29 @@ void JoystickInputMapper::configure(nsecs_t when,
                 }
             }
         }
+
+        // Apply the configured deadbands, in normalized units.  An axis specific
+        // deadband such as joystick.deadband.X takes precedence over joystick.deadband.
+        const PropertyMap& configuration = getDevice()->getConfiguration();
+        float deviceDeadband;
+        bool haveDeviceDeadband = configuration.tryGetProperty(String8("joystick.deadband"),
+                deviceDeadband);
+        for (size_t i = 0; i < numAxes; i++) {
+            Axis& axis = mAxes.editValueAt(i);
+            float deadband;
+            const char* label = getAxisLabel(axis.axisInfo.axis);
+            if (label && configuration.tryGetProperty(
+                    String8::format("joystick.deadband.%s", label), deadband)) {
+                axis.filter = deadband;
+            } else if (haveDeviceDeadband) {
+                axis.filter = deviceDeadband;
+            }
+        }
+
+        // Limit the rate of motion events for high poll rate devices.
+        int32_t maxEventRate = JOYSTICK_DEFAULT_MAX_EVENT_RATE;
+        configuration.tryGetProperty(String8("joystick.maxEventRate"), maxEventRate);
+        mMinEventInterval = maxEventRate > 0 ? 1000000000LL / maxEventRate : 0;
     }
 }
 
@@ -6176,6 +6495,9 @@ void JoystickInputMapper::reset(nsecs_t when) {
         axis.resetValue();
     }
 
+    mLastEventTime = LLONG_MIN;
+    mHaveDeferredSync = false;
+
     InputMapper::reset(when);
 }
 
@@ -6227,11 +6549,44 @@ void JoystickInputMapper::process(const RawEvent* rawEvent) {
     }
 }
 
+void JoystickInputMapper::timeoutExpired(nsecs_t when) {
+    if (mHaveDeferredSync) {
+        nsecs_t nextEventTime = mLastEventTime + mMinEventInterval;
+        if (when >= nextEventTime) {
+            notifyAxes(mDeferredSyncTime);
+        } else {
+            // Another mapper's timeout expired first.
+            getContext()->requestTimeoutAtTime(nextEventTime);
+        }
+    }
+}
+
 void JoystickInputMapper::sync(nsecs_t when, bool force) {
     if (!filterAxes(force)) {
         return;
     }
 
+    // Report significant changes at most once per interval.  Later changes update
+    // the current axis values in the meantime so the deferred event has the latest state.
+    if (!force && mMinEventInterval > 0 && mLastEventTime != LLONG_MIN) {
+        nsecs_t nextEventTime = mLastEventTime + mMinEventInterval;
+        if (when < nextEventTime) {
+            if (!mHaveDeferredSync) {
+                mHaveDeferredSync = true;
+                getContext()->requestTimeoutAtTime(nextEventTime);
+            }
+            mDeferredSyncTime = when;
+            return;
+        }
+    }
+
+    notifyAxes(when);
+}
+
+void JoystickInputMapper::notifyAxes(nsecs_t when) {
+    mLastEventTime = when;
+    mHaveDeferredSync = false;
+
     int32_t metaState = mContext->getGlobalMetaState();
     int32_t buttonState = 0;
 
@@ -162,6 +162,11 @@ struct InputReaderConfiguration {
     // True to show the location of touches on the touch screen as spots.
     bool showTouches;
 
+    // The number of worker threads across which the processing of input devices is
+    // sharded, or 0 to process all devices on the reader thread.
+    // Only consulted when the reader is created.
+    uint32_t readerShardCount;
+
     InputReaderConfiguration() :
             virtualKeyQuietTime(0),
             pointerVelocityControlParameters(1.0f, 500.0f, 3000.0f, 3.0f),
@@ -178,7 +183,8 @@ struct InputReaderConfiguration {
             pointerGestureSwipeMaxWidthRatio(0.25f),
             pointerGestureMovementSpeedRatio(0.8f),
             pointerGestureZoomSpeedRatio(0.3f),
-            showTouches(false) { }
+            showTouches(false),
+            readerShardCount(0) { }
 
     bool getDisplayInfo(int32_t displayId, bool external,
             int32_t* width, int32_t* height, int32_t* orientation) const;
@@ -275,6 +281,14 @@ public:
     virtual int32_t getSwitchState(int32_t deviceId, uint32_t sourceMask,
             int32_t sw) = 0;
 
+    /* Query several key code, scan code and switch states in a single pass.
+     * Each out array receives the state of the code at the same index, exactly as
+     * returned by the individual query methods. */
+    virtual void getStates(int32_t deviceId, uint32_t sourceMask,
+            size_t numKeyCodes, const int32_t* keyCodes, int32_t* outKeyCodeStates,
+            size_t numScanCodes, const int32_t* scanCodes, int32_t* outScanCodeStates,
+            size_t numSwitches, const int32_t* switches, int32_t* outSwitchStates) = 0;
+
     /* Determine whether physical keys exist for the given framework-domain key codes. */
     virtual bool hasKeys(int32_t deviceId, uint32_t sourceMask,
             size_t numCodes, const int32_t* keyCodes, uint8_t* outFlags) = 0;
@@ -349,6 +363,11 @@ public:
     virtual int32_t getSwitchState(int32_t deviceId, uint32_t sourceMask,
             int32_t sw);
 
+    virtual void getStates(int32_t deviceId, uint32_t sourceMask,
+            size_t numKeyCodes, const int32_t* keyCodes, int32_t* outKeyCodeStates,
+            size_t numScanCodes, const int32_t* scanCodes, int32_t* outScanCodeStates,
+            size_t numSwitches, const int32_t* switches, int32_t* outSwitchStates);
+
     virtual bool hasKeys(int32_t deviceId, uint32_t sourceMask,
             size_t numCodes, const int32_t* keyCodes, uint8_t* outFlags);
 
@@ -384,6 +403,65 @@ protected:
 
     friend class ContextImpl;
 
+    /* Processes the events of a subset of the input devices on a worker thread.
+     * The reader thread holds mLock on behalf of the shards while they run so they
+     * have exclusive use of their own devices.  Any other reader state is reached
+     * through the shard's context, which serializes access with the other shards,
+     * and the events produced are queued per shard and merged by time afterwards. */
+    class Shard : public Thread {
+    public:
+        Shard(InputReader* reader);
+        virtual ~Shard();
+
+        inline InputReaderContext* getContext() { return &mContext; }
+        inline QueuedInputListener* getQueuedListener() { return mQueuedListener.get(); }
+
+        bool hasBatches();
+        void enqueueBatch(int32_t deviceId, const RawEvent* rawEvents, size_t count);
+
+        void start();
+        void waitUntilIdle();
+        void stop();
+
+    private:
+        class ShardContext : public ContextImpl {
+            InputReader* mReader;
+            Shard* mShard;
+
+        public:
+            ShardContext(InputReader* reader, Shard* shard);
+
+            virtual void updateGlobalMetaState();
+            virtual int32_t getGlobalMetaState();
+            virtual void disableVirtualKeysUntil(nsecs_t time);
+            virtual bool shouldDropVirtualKey(nsecs_t now,
+                    InputDevice* device, int32_t keyCode, int32_t scanCode);
+            virtual void fadePointer();
+            virtual void requestTimeoutAtTime(nsecs_t when);
+            virtual int32_t bumpGeneration();
+            virtual InputListenerInterface* getListener();
+        };
+
+        struct Batch {
+            int32_t deviceId;
+            const RawEvent* rawEvents;
+            size_t count;
+        };
+
+        InputReader* mReader;
+        ShardContext mContext;
+        sp<QueuedInputListener> mQueuedListener;
+        Vector<Batch> mBatches; // guarded by mLock, taken by the shard thread when it starts
+
+        Mutex mLock;
+        Condition mCondition;
+        bool mBusy;
+
+        virtual bool threadLoop();
+    };
+
+    friend class Shard;
+
 private:
     Mutex mLock;
 
@@ -401,6 +479,24 @@ private:
 
     KeyedVector<int32_t, InputDevice*> mDevices;
 
+    // Device processing shards, empty if all devices are processed on the reader thread.
+    Vector<sp<Shard> > mShards;
+    Vector<QueuedInputListener*> mShardListeners;
+    Mutex mShardLock; // serializes access to shared reader state from shard contexts
+
+    // Changes to state shared by all devices requested by the shards while they run,
+    // applied by the reader thread once they are idle.  Guarded by mShardLock.
+    enum {
+        SHARD_PENDING_META_STATE = 1 << 0,
+        SHARD_PENDING_FADE_POINTER = 1 << 1,
+    };
+    uint32_t mShardPendingChanges;
+
+    void startShardsLocked(uint32_t shardCount);
+    void stopShards();
+    InputReaderContext* getDeviceContextLocked(int32_t deviceId);
+    void flushShardsLocked();
+
     // low-level input event decoding and device management
     void processEventsLocked(const RawEvent* rawEvents, size_t count);
 
@@ -437,6 +533,8 @@ private:
     typedef int32_t (InputDevice::*GetStateFunc)(uint32_t sourceMask, int32_t code);
     int32_t getStateLocked(int32_t deviceId, uint32_t sourceMask, int32_t code,
             GetStateFunc getStateFunc);
+    void getStatesLocked(int32_t deviceId, uint32_t sourceMask, size_t numCodes,
+            const int32_t* codes, int32_t* outStates, GetStateFunc getStateFunc);
     bool markSupportedKeyCodesLocked(int32_t deviceId, uint32_t sourceMask, size_t numCodes,
             const int32_t* keyCodes, uint8_t* outFlags);
 };
@@ -451,6 +549,7 @@ public:
 private:
     sp<InputReaderInterface> mReader;
 
+    virtual status_t readyToRun();
     virtual bool threadLoop();
 };
 
@@ -833,14 +932,20 @@ public:
     inline size_t getSlotCount() const { return mSlotCount; }
     inline const Slot* getSlot(size_t index) const { return &mSlots[index]; }
 
+    /* Gets the indices of the slots that are currently in use. */
+    inline BitSet32 getInUseSlots() const { return mInUseSlots; }
+
 private:
     int32_t mCurrentSlot;
     Slot* mSlots;
     size_t mSlotCount;
+    BitSet32 mInUseSlots;
+    BitSet32 mWrittenSlots; // slots written since they were last cleared
     bool mUsingSlotsProtocol;
     bool mHaveStylus;
 
     void clearSlots(int32_t initialSlot);
+    void clearWrittenSlots();
 };
 
 
@@ -1221,12 +1326,16 @@ protected:
     RawPointerAxes mRawPointerAxes;
 
     // Raw pointer sample data.
-    RawPointerData mCurrentRawPointerData;
-    RawPointerData mLastRawPointerData;
+    // The current and last samples are double-buffered and swapped at the end of each sync.
+    RawPointerData mRawPointerData[2];
+    RawPointerData* mCurrentRawPointerData;
+    RawPointerData* mLastRawPointerData;
 
     // Cooked pointer sample data.
-    CookedPointerData mCurrentCookedPointerData;
-    CookedPointerData mLastCookedPointerData;
+    // The current and last samples are double-buffered and swapped at the end of each sync.
+    CookedPointerData mCookedPointerData[2];
+    CookedPointerData* mCurrentCookedPointerData;
+    CookedPointerData* mLastCookedPointerData;
 
     // Button state.
     int32_t mCurrentButtonState;
@@ -1288,6 +1397,14 @@ private:
     float mYScale;
     float mYPrecision;
 
+    // Affine transform from raw to oriented surface coordinates set by configureSurface():
+    //   x = mRawToSurfaceX[0] * rawX + mRawToSurfaceX[1] * rawY + mRawToSurfaceX[2]
+    //   y = mRawToSurfaceY[0] * rawX + mRawToSurfaceY[1] * rawY + mRawToSurfaceY[2]
+    // The orientation axis is rotated by mRawToSurfaceOrientation radians.
+    float mRawToSurfaceX[3];
+    float mRawToSurfaceY[3];
+    float mRawToSurfaceOrientation;
+
     float mGeometricScale;
 
     float mPressureScale;
@@ -1655,6 +1772,7 @@ public:
     virtual void configure(nsecs_t when, const InputReaderConfiguration* config, uint32_t changes);
     virtual void reset(nsecs_t when);
     virtual void process(const RawEvent* rawEvent);
+    virtual void timeoutExpired(nsecs_t when);
 
 private:
     struct Axis {
@@ -1709,7 +1827,19 @@ private:
     // Axes indexed by raw ABS_* axis index.
     KeyedVector<int32_t, Axis> mAxes;
 
+    // Minimum time between two motion events, or 0 to report every significant change.
+    nsecs_t mMinEventInterval;
+
+    // Time of the last motion event.
+    nsecs_t mLastEventTime;
+
+    // True if a significant change was held back by the rate limit and will be reported
+    // when it next allows, as of the time of the most recent sync.
+    bool mHaveDeferredSync;
+    nsecs_t mDeferredSyncTime;
+
     void sync(nsecs_t when, bool force);
+    void notifyAxes(nsecs_t when);
 
     bool haveAxis(int32_t axisId);
     void pruneAxes(bool ignoreExplicitlyMappedAxes);
@@ -22,6 +22,19 @@
 
 namespace android {
 
+// --- Static Functions ---
+
+template<typename T>
+inline static T min(const T& a, const T& b) {
+    return a < b ? a : b;
+}
+
+template<typename T>
+inline static T max(const T& a, const T& b) {
+    return a > b ? a : b;
+}
+
+
 // --- InputWindowInfo ---
 
 bool InputWindowInfo::touchableRegionContainsPoint(int32_t x, int32_t y) const {
@@ -61,4 +74,175 @@ void InputWindowHandle::releaseInfo() {
     }
 }
 
+
+// --- InputWindowIndex ---
+
+// Number of cells of the grid on each axis.
+static const size_t GRID_SIZE = 8;
+
+static bool isTouchableWindow(const InputWindowInfo* info) {
+    return info->visible && !(info->layoutParamsFlags & InputWindowInfo::FLAG_NOT_TOUCHABLE);
+}
+
+static bool isObscuringWindow(const InputWindowInfo* info) {
+    return info->visible && !info->isTrustedOverlay();
+}
+
+// Returns true if the window must be considered for touches at any location.
+static bool isGlobalTouchCandidate(const InputWindowInfo* info) {
+    int32_t flags = info->layoutParamsFlags;
+    if (flags & InputWindowInfo::FLAG_SYSTEM_ERROR) {
+        // Stops the search even when invisible.
+        return true;
+    }
+    if (!info->visible) {
+        return false;
+    }
+    if (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+        return true;
+    }
+    bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+    return isTouchModal && !(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE);
+}
+
+InputWindowIndex::InputWindowIndex() :
+        mLeft(0), mTop(0), mCellWidth(1), mCellHeight(1) {
+}
+
+void InputWindowIndex::clear() {
+    mCells.clear();
+    mOutsideCell.touchCandidates.clear();
+    mOutsideCell.obscuringCandidates.clear();
+    mIndices.clear();
+}
+
+void InputWindowIndex::build(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    clear();
+
+    // Compute the bounds of the areas that can be touched or obscured.
+    bool hasBounds = false;
+    int32_t left = 0, top = 0, right = 0, bottom = 0;
+    size_t numWindows = windowHandles.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        const sp<InputWindowHandle>& windowHandle = windowHandles.itemAt(i);
+        mIndices.add(windowHandle.get(), i);
+
+        const InputWindowInfo* info = windowHandle->getInfo();
+        if (isObscuringWindow(info)) {
+            if (!hasBounds) {
+                left = info->frameLeft;
+                top = info->frameTop;
+                right = info->frameRight;
+                bottom = info->frameBottom;
+                hasBounds = true;
+            } else {
+                left = min(left, info->frameLeft);
+                top = min(top, info->frameTop);
+                right = max(right, info->frameRight);
+                bottom = max(bottom, info->frameBottom);
+            }
+        }
+        if (isTouchableWindow(info) && !info->touchableRegion.isEmpty()) {
+            const SkIRect& r = info->touchableRegion.getBounds();
+            if (!hasBounds) {
+                left = r.fLeft;
+                top = r.fTop;
+                right = r.fRight;
+                bottom = r.fBottom;
+                hasBounds = true;
+            } else {
+                left = min(left, r.fLeft);
+                top = min(top, r.fTop);
+                right = max(right, r.fRight);
+                bottom = max(bottom, r.fBottom);
+            }
+        }
+    }
+
+    if (hasBounds) {
+        mLeft = left;
+        mTop = top;
+        mCellWidth = (right - left) / int32_t(GRID_SIZE) + 1;
+        mCellHeight = (bottom - top) / int32_t(GRID_SIZE) + 1;
+        mCells.insertAt(Cell(), 0, GRID_SIZE * GRID_SIZE);
+    }
+
+    // Windows are added front to back so each list stays sorted.
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* info = windowHandles.itemAt(i)->getInfo();
+        if (isGlobalTouchCandidate(info)) {
+            mOutsideCell.touchCandidates.add(i);
+            size_t numCells = mCells.size();
+            for (size_t j = 0; j < numCells; j++) {
+                mCells.editItemAt(j).touchCandidates.add(i);
+            }
+        } else if (isTouchableWindow(info) && !info->touchableRegion.isEmpty()) {
+            // Touchable regions are half-open, the bounds are conservative.
+            const SkIRect& r = info->touchableRegion.getBounds();
+            addTouchCandidate(i, r.fLeft, r.fTop, r.fRight, r.fBottom);
+        }
+
+        if (isObscuringWindow(info)) {
+            addObscuringCandidate(i, info->frameLeft, info->frameTop,
+                    info->frameRight, info->frameBottom);
+        }
+    }
+}
+
+void InputWindowIndex::getCellRange(int32_t left, int32_t top, int32_t right, int32_t bottom,
+        size_t* outColumn0, size_t* outRow0, size_t* outColumn1, size_t* outRow1) const {
+    // The grid covers all the indexed areas, clamping only guards against rounding.
+    *outColumn0 = size_t(max(left - mLeft, 0) / mCellWidth);
+    *outRow0 = size_t(max(top - mTop, 0) / mCellHeight);
+    *outColumn1 = min(size_t(max(right - mLeft, 0) / mCellWidth), GRID_SIZE - 1);
+    *outRow1 = min(size_t(max(bottom - mTop, 0) / mCellHeight), GRID_SIZE - 1);
+}
+
+void InputWindowIndex::addTouchCandidate(size_t index, int32_t left, int32_t top,
+        int32_t right, int32_t bottom) {
+    size_t column0, row0, column1, row1;
+    getCellRange(left, top, right, bottom, &column0, &row0, &column1, &row1);
+    for (size_t row = row0; row <= row1; row++) {
+        for (size_t column = column0; column <= column1; column++) {
+            mCells.editItemAt(row * GRID_SIZE + column).touchCandidates.add(index);
+        }
+    }
+}
+
+void InputWindowIndex::addObscuringCandidate(size_t index, int32_t left, int32_t top,
+        int32_t right, int32_t bottom) {
+    size_t column0, row0, column1, row1;
+    getCellRange(left, top, right, bottom, &column0, &row0, &column1, &row1);
+    for (size_t row = row0; row <= row1; row++) {
+        for (size_t column = column0; column <= column1; column++) {
+            mCells.editItemAt(row * GRID_SIZE + column).obscuringCandidates.add(index);
+        }
+    }
+}
+
+const InputWindowIndex::Cell& InputWindowIndex::getCell(int32_t x, int32_t y) const {
+    if (!mCells.isEmpty() && x >= mLeft && y >= mTop) {
+        size_t column = size_t((x - mLeft) / mCellWidth);
+        size_t row = size_t((y - mTop) / mCellHeight);
+        if (column < GRID_SIZE && row < GRID_SIZE) {
+            return mCells.itemAt(row * GRID_SIZE + column);
+        }
+    }
+    return mOutsideCell;
+}
+
+const Vector<size_t>& InputWindowIndex::getTouchCandidates(int32_t x, int32_t y) const {
+    return getCell(x, y).touchCandidates;
+}
+
+const Vector<size_t>& InputWindowIndex::getObscuringCandidates(int32_t x, int32_t y) const {
+    return getCell(x, y).obscuringCandidates;
+}
+
+ssize_t InputWindowIndex::indexOf(const sp<InputWindowHandle>& windowHandle) const {
+    ssize_t index = mIndices.indexOfKey(windowHandle.get());
+    return index >= 0 ? ssize_t(mIndices.valueAt(index)) : -1;
+}
+
 } // namespace android
@@ -19,9 +19,11 @@
 
 #include <androidfw/Input.h>
 #include <androidfw/InputTransport.h>
+#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include <SkRegion.h>
 
@@ -197,6 +199,72 @@ protected:
     InputWindowInfo* mInfo;
 };
 
+
+/*
+ * Spatial index of a list of windows sorted from front to back, used to hit test
+ * pointer events without traversing every window.
+ *
+ * The area covered by the windows is divided into a grid of cells. Each cell lists,
+ * front to back, the windows that may be touched in that cell and the windows that
+ * may obscure another window in that cell. Windows that influence touches anywhere
+ * (touch modal windows, windows watching outside touches and system error windows)
+ * are listed in every cell.
+ *
+ * The index only holds window indices, it must be rebuilt whenever the list of
+ * windows or their information changes.
+ */
+class InputWindowIndex {
+public:
+    InputWindowIndex();
+
+    /* Rebuilds the index for the specified windows, sorted from front to back. */
+    void build(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    void clear();
+
+    /* Returns the indices, front to back, of the windows that must be considered when
+     * looking for the window touched at the specified point. Windows that are not listed
+     * cannot be touched at that point and do not stop the search.
+     */
+    const Vector<size_t>& getTouchCandidates(int32_t x, int32_t y) const;
+
+    /* Returns the indices, front to back, of the visible windows that are not trusted
+     * overlays and whose frame may contain the specified point.
+     */
+    const Vector<size_t>& getObscuringCandidates(int32_t x, int32_t y) const;
+
+    /* Returns the index of the specified window, or -1 if it is not indexed. */
+    ssize_t indexOf(const sp<InputWindowHandle>& windowHandle) const;
+
+private:
+    struct Cell {
+        Vector<size_t> touchCandidates;
+        Vector<size_t> obscuringCandidates;
+    };
+
+    // Origin of the grid and size of its cells, the grid is empty when no window
+    // can be touched or obscure another window
+    int32_t mLeft;
+    int32_t mTop;
+    int32_t mCellWidth;
+    int32_t mCellHeight;
+    Vector<Cell> mCells;
+
+    // Used for the points outside of the grid, only lists the windows that influence
+    // touches anywhere
+    Cell mOutsideCell;
+
+    KeyedVector<InputWindowHandle*, size_t> mIndices;
+
+    const Cell& getCell(int32_t x, int32_t y) const;
+    void addTouchCandidate(size_t index, int32_t left, int32_t top,
+            int32_t right, int32_t bottom);
+    void addObscuringCandidate(size_t index, int32_t left, int32_t top,
+            int32_t right, int32_t bottom);
+    void getCellRange(int32_t left, int32_t top, int32_t right, int32_t bottom,
+            size_t* outColumn0, size_t* outRow0, size_t* outColumn1, size_t* outRow1) const;
+};
+
 } // namespace android
 
 #endif // _UI_INPUT_WINDOW_H
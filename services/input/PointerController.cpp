@@ -48,6 +48,32 @@ static const nsecs_t SPOT_FADE_DURATION = 200 * 1000000LL; // 200 ms
 // Time to spend fading out the pointer completely.
 static const nsecs_t POINTER_FADE_DURATION = 500 * 1000000LL; // 500 ms
 
+// Maximum number of display events to read at once.
+static const size_t EVENT_BUFFER_SIZE = 100;
+
+
+// --- WeakLooperCallback ---
+
+/*
+ * Forwards display events to a callback without keeping it alive, the looper
+ * holds a strong reference to the callbacks registered with it.
+ */
+class WeakLooperCallback : public LooperCallback {
+public:
+    WeakLooperCallback(const wp<LooperCallback>& callback) : mCallback(callback) { }
+
+    virtual int handleEvent(int fd, int events, void* data) {
+        sp<LooperCallback> callback = mCallback.promote();
+        if (callback != NULL) {
+            return callback->handleEvent(fd, events, data);
+        }
+        return 0; // the callback is gone, unregister
+    }
+
+private:
+    wp<LooperCallback> mCallback;
+};
+
 
 // --- PointerController ---
 
@@ -55,11 +81,28 @@ PointerController::PointerController(const sp<PointerControllerPolicyInterface>&
         const sp<Looper>& looper, const sp<SpriteController>& spriteController) :
         mPolicy(policy), mLooper(looper), mSpriteController(spriteController) {
     mHandler = new WeakMessageHandler(this);
+    mCallback = new WeakLooperCallback(this);
+
+    mDisplayEventReceiverInitialized = false;
+    status_t result = mDisplayEventReceiver.initCheck();
+    if (result) {
+        ALOGW("Failed to initialize display event receiver, animating on timers instead, "
+                "status=%d", result);
+    } else if (mLooper->addFd(mDisplayEventReceiver.getFd(), 0, ALOOPER_EVENT_INPUT,
+            mCallback, NULL) < 0) {
+        ALOGW("Failed to add display event receiver to the looper, "
+                "animating on timers instead");
+    } else {
+        mDisplayEventReceiverInitialized = true;
+    }
 
     AutoMutex _l(mLock);
 
     mLocked.animationPending = false;
 
+    mLocked.vsyncPending = false;
+    mLocked.pointerUpdatePending = false;
+
     mLocked.displayWidth = -1;
     mLocked.displayHeight = -1;
     mLocked.displayOrientation = DISPLAY_ORIENTATION_0;
@@ -83,6 +126,9 @@ PointerController::PointerController(const sp<PointerControllerPolicyInterface>&
 
 PointerController::~PointerController() {
     mLooper->removeMessages(mHandler);
+    if (mDisplayEventReceiverInitialized) {
+        mLooper->removeFd(mDisplayEventReceiver.getFd());
+    }
 
     AutoMutex _l(mLock);
 
@@ -180,7 +226,7 @@ void PointerController::setPositionLocked(float x, float y) {
         } else {
             mLocked.pointerY = y;
         }
-        updatePointerLocked();
+        schedulePointerUpdateLocked();
     }
 }
 
@@ -396,21 +442,67 @@ void PointerController::setPointerIcon(const SpriteIcon& icon) {
 
 void PointerController::handleMessage(const Message& message) {
     switch (message.what) {
-    case MSG_ANIMATE:
-        doAnimate();
+    case MSG_ANIMATE: {
+        AutoMutex _l(mLock);
+        doAnimateLocked(systemTime(SYSTEM_TIME_MONOTONIC));
         break;
+    }
     case MSG_INACTIVITY_TIMEOUT:
         doInactivityTimeout();
         break;
     }
 }
 
-void PointerController::doAnimate() {
+int PointerController::handleEvent(int fd, int events, void* data) {
+    if (events & (ALOOPER_EVENT_ERROR | ALOOPER_EVENT_HANGUP)) {
+        ALOGE("Display event receiver pipe was closed or an error occurred.  "
+                "events=0x%x", events);
+        return 0; // remove the callback
+    }
+
+    if (!(events & ALOOPER_EVENT_INPUT)) {
+        ALOGW("Received spurious callback for unhandled poll event.  "
+                "events=0x%x", events);
+        return 1; // keep the callback
+    }
+
+    // Drain all pending events, keep the last vsync.
+    bool gotVsync = false;
+    nsecs_t timestamp = 0;
+    DisplayEventReceiver::Event buf[EVENT_BUFFER_SIZE];
+    ssize_t n;
+    while ((n = mDisplayEventReceiver.getEvents(buf, EVENT_BUFFER_SIZE)) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i].header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                timestamp = buf[i].header.timestamp;
+                gotVsync = true;
+            }
+        }
+    }
+    if (n < 0) {
+        ALOGW("Failed to get events from display event receiver, status=%d", status_t(n));
+    }
+    if (!gotVsync) {
+        return 1; // keep the callback, did not obtain a vsync pulse
+    }
+
     AutoMutex _l(mLock);
 
+    mLocked.vsyncPending = false;
+    if (mLocked.animationPending) {
+        doAnimateLocked(timestamp);
+    }
+    // Moves since the last frame are coalesced into a single sprite update.
+    if (mLocked.pointerUpdatePending) {
+        updatePointerLocked();
+    }
+    return 1; // keep the callback
+}
+
+void PointerController::doAnimateLocked(nsecs_t timestamp) {
     bool keepAnimating = false;
     mLocked.animationPending = false;
-    nsecs_t frameDelay = systemTime(SYSTEM_TIME_MONOTONIC) - mLocked.animationTime;
+    nsecs_t frameDelay = timestamp - mLocked.animationTime;
 
     // Animate pointer fade.
     if (mLocked.pointerFadeDirection < 0) {
@@ -461,7 +553,38 @@ void PointerController::startAnimationLocked() {
     if (!mLocked.animationPending) {
         mLocked.animationPending = true;
         mLocked.animationTime = systemTime(SYSTEM_TIME_MONOTONIC);
-        mLooper->sendMessageDelayed(ANIMATION_FRAME_INTERVAL, mHandler, Message(MSG_ANIMATE));
+        if (mDisplayEventReceiverInitialized) {
+            requestVsyncLocked();
+        }
+        if (!mLocked.vsyncPending) {
+            mLooper->sendMessageDelayed(ANIMATION_FRAME_INTERVAL, mHandler,
+                    Message(MSG_ANIMATE));
+        }
+    }
+}
+
+void PointerController::requestVsyncLocked() {
+    if (!mLocked.vsyncPending) {
+        status_t status = mDisplayEventReceiver.requestNextVsync();
+        if (status) {
+            ALOGW("Failed to request next vsync, status=%d", status);
+            return;
+        }
+        mLocked.vsyncPending = true;
+    }
+}
+
+void PointerController::schedulePointerUpdateLocked() {
+    if (!mDisplayEventReceiverInitialized) {
+        updatePointerLocked();
+        return;
+    }
+
+    mLocked.pointerUpdatePending = true;
+    requestVsyncLocked();
+    if (!mLocked.vsyncPending) {
+        // The vsync could not be requested, do not drop the update.
+        updatePointerLocked();
     }
 }
 
@@ -478,6 +601,8 @@ void PointerController::removeInactivityTimeoutLocked() {
 }
 
 void PointerController::updatePointerLocked() {
+    mLocked.pointerUpdatePending = false;
+
     mSpriteController->openTransaction();
 
     mLocked.pointerSprite->setLayer(Sprite::BASE_LAYER_POINTER);
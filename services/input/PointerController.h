@@ -21,6 +21,7 @@
 
 #include <ui/DisplayInfo.h>
 #include <androidfw/Input.h>
+#include <gui/DisplayEventReceiver.h>
 #include <utils/BitSet.h>
 #include <utils/RefBase.h>
 #include <utils/Looper.h>
@@ -141,8 +142,12 @@ public:
  * Tracks pointer movements and draws the pointer sprite to a surface.
  *
  * Handles pointer acceleration and animation.
+ *
+ * Animations and pointer movements are applied on the display vsync when a display
+ * event receiver is available, so that at most one sprite update happens per frame.
  */
-class PointerController : public PointerControllerInterface, public MessageHandler {
+class PointerController : public PointerControllerInterface, public MessageHandler,
+        public LooperCallback {
 protected:
     virtual ~PointerController();
 
@@ -209,6 +214,10 @@ private:
     sp<Looper> mLooper;
     sp<SpriteController> mSpriteController;
     sp<WeakMessageHandler> mHandler;
+    sp<LooperCallback> mCallback;
+
+    DisplayEventReceiver mDisplayEventReceiver;
+    bool mDisplayEventReceiverInitialized;
 
     PointerResources mResources;
 
@@ -216,6 +225,9 @@ private:
         bool animationPending;
         nsecs_t animationTime;
 
+        bool vsyncPending;
+        bool pointerUpdatePending;
+
         int32_t displayWidth;
         int32_t displayHeight;
         int32_t displayOrientation;
@@ -243,10 +255,13 @@ private:
     void setPositionLocked(float x, float y);
 
     void handleMessage(const Message& message);
-    void doAnimate();
+    virtual int handleEvent(int fd, int events, void* data);
+    void doAnimateLocked(nsecs_t timestamp);
     void doInactivityTimeout();
 
     void startAnimationLocked();
+    void requestVsyncLocked();
+    void schedulePointerUpdateLocked();
 
     void resetInactivityTimeoutLocked();
     void removeInactivityTimeoutLocked();
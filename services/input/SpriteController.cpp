@@ -31,6 +31,12 @@
 
 namespace android {
 
+// Minimum time between two sprite updates.  Sprite surfaces are composited at most once
+// per display frame so there is no point committing more than one transaction per frame;
+// property changes that arrive sooner are coalesced into the next update.
+static const nsecs_t SPRITE_UPDATE_INTERVAL = 1000000000LL / 60;
+
+
 // --- SpriteController ---
 
 SpriteController::SpriteController(const sp<Looper>& looper, int32_t overlayLayer) :
@@ -39,6 +45,7 @@ SpriteController::SpriteController(const sp<Looper>& looper, int32_t overlayLaye
 
     mLocked.transactionNestingCount = 0;
     mLocked.deferredSpriteUpdate = false;
+    mLocked.lastUpdateTime = 0;
 }
 
 SpriteController::~SpriteController() {
@@ -69,7 +76,7 @@ void SpriteController::closeTransaction() {
     mLocked.transactionNestingCount -= 1;
     if (mLocked.transactionNestingCount == 0 && mLocked.deferredSpriteUpdate) {
         mLocked.deferredSpriteUpdate = false;
-        mLooper->sendMessage(mHandler, Message(MSG_UPDATE_SPRITES));
+        scheduleUpdateSpritesLocked();
     }
 }
 
@@ -80,11 +87,21 @@ void SpriteController::invalidateSpriteLocked(const sp<SpriteImpl>& sprite) {
         if (mLocked.transactionNestingCount != 0) {
             mLocked.deferredSpriteUpdate = true;
         } else {
-            mLooper->sendMessage(mHandler, Message(MSG_UPDATE_SPRITES));
+            scheduleUpdateSpritesLocked();
         }
     }
 }
 
+void SpriteController::scheduleUpdateSpritesLocked() {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t when = mLocked.lastUpdateTime + SPRITE_UPDATE_INTERVAL;
+    if (when <= now) {
+        mLooper->sendMessage(mHandler, Message(MSG_UPDATE_SPRITES));
+    } else {
+        mLooper->sendMessageAtTime(when, mHandler, Message(MSG_UPDATE_SPRITES));
+    }
+}
+
 void SpriteController::disposeSurfaceLocked(const sp<SurfaceControl>& surfaceControl) {
     bool wasEmpty = mLocked.disposedSurfaces.isEmpty();
     mLocked.disposedSurfaces.push(surfaceControl);
@@ -115,6 +132,8 @@ void SpriteController::doUpdateSprites() {
     { // acquire lock
         AutoMutex _l(mLock);
 
+        mLocked.lastUpdateTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
         numSprites = mLocked.invalidatedSprites.size();
         for (size_t i = 0; i < numSprites; i++) {
             const sp<SpriteImpl>& sprite = mLocked.invalidatedSprites.itemAt(i);
@@ -185,11 +204,15 @@ void SpriteController::doUpdateSprites() {
         SurfaceComposerClient::closeGlobalTransaction();
     }
 
-    // Redraw sprites if needed.
+    // Redraw sprites if needed.  Surfaces that already hold the icon are left alone
+    // so changing any other property, or restoring an icon that was cleared, never
+    // touches the pixels.
     for (size_t i = 0; i < numSprites; i++) {
         SpriteUpdate& update = updates.editItemAt(i);
 
-        if ((update.state.dirty & DIRTY_BITMAP) && update.state.surfaceDrawn) {
+        if ((update.state.dirty & DIRTY_BITMAP) && update.state.surfaceDrawn
+                && update.state.icon.isValid()
+                && update.state.surfaceGenerationId != update.state.iconGenerationId) {
             update.state.surfaceDrawn = false;
             update.surfaceChanged = surfaceChanged = true;
         }
@@ -231,6 +254,7 @@ void SpriteController::doUpdateSprites() {
                     ALOGE("Error %d unlocking and posting sprite surface after drawing.", status);
                 } else {
                     update.state.surfaceDrawn = true;
+                    update.state.surfaceGenerationId = update.state.iconGenerationId;
                     update.surfaceChanged = surfaceChanged = true;
                 }
             }
@@ -331,7 +355,8 @@ void SpriteController::doUpdateSprites() {
             if (update.surfaceChanged) {
                 update.sprite->setSurfaceLocked(update.state.surfaceControl,
                         update.state.surfaceWidth, update.state.surfaceHeight,
-                        update.state.surfaceDrawn, update.state.surfaceVisible);
+                        update.state.surfaceDrawn, update.state.surfaceVisible,
+                        update.state.surfaceGenerationId);
             }
         }
     } // release lock
@@ -401,7 +426,16 @@ void SpriteController::SpriteImpl::setIcon(const SpriteIcon& icon) {
 
     uint32_t dirty;
     if (icon.isValid()) {
+        uint32_t generationId = icon.bitmap.getGenerationID();
+        if (mLocked.state.icon.isValid()
+                && mLocked.state.iconGenerationId == generationId
+                && mLocked.state.icon.hotSpotX == icon.hotSpotX
+                && mLocked.state.icon.hotSpotY == icon.hotSpotY) {
+            return; // same icon so nothing to do
+        }
+
         icon.bitmap.copyTo(&mLocked.state.icon.bitmap, SkBitmap::kARGB_8888_Config);
+        mLocked.state.iconGenerationId = generationId;
 
         if (!mLocked.state.icon.isValid()
                 || mLocked.state.icon.hotSpotX != icon.hotSpotX
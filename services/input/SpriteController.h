@@ -177,8 +177,9 @@ private:
     struct SpriteState {
         inline SpriteState() :
                 dirty(0), visible(false),
-                positionX(0), positionY(0), layer(0), alpha(1.0f),
-                surfaceWidth(0), surfaceHeight(0), surfaceDrawn(false), surfaceVisible(false) {
+                positionX(0), positionY(0), layer(0), alpha(1.0f), iconGenerationId(0),
+                surfaceWidth(0), surfaceHeight(0), surfaceDrawn(false), surfaceVisible(false),
+                surfaceGenerationId(0) {
         }
 
         uint32_t dirty;
@@ -191,12 +192,20 @@ private:
         float alpha;
         SpriteTransformationMatrix transformationMatrix;
 
+        // Generation id of the bitmap the icon was copied from.
+        uint32_t iconGenerationId;
+
         sp<SurfaceControl> surfaceControl;
         int32_t surfaceWidth;
         int32_t surfaceHeight;
         bool surfaceDrawn;
         bool surfaceVisible;
 
+        // Generation id of the icon the surface was last drawn with.  The surface keeps
+        // its content when the icon is cleared so that it does not need to be redrawn
+        // if the same icon is set again, which happens every time a spot is recycled.
+        uint32_t surfaceGenerationId;
+
         inline bool wantSurfaceVisible() const {
             return visible && alpha > 0.0f && icon.isValid();
         }
@@ -232,12 +241,14 @@ private:
         }
 
         inline void setSurfaceLocked(const sp<SurfaceControl>& surfaceControl,
-                int32_t width, int32_t height, bool drawn, bool visible) {
+                int32_t width, int32_t height, bool drawn, bool visible,
+                uint32_t generationId) {
             mLocked.state.surfaceControl = surfaceControl;
             mLocked.state.surfaceWidth = width;
             mLocked.state.surfaceHeight = height;
             mLocked.state.surfaceDrawn = drawn;
             mLocked.state.surfaceVisible = visible;
+            mLocked.state.surfaceGenerationId = generationId;
         }
 
     private:
@@ -275,9 +286,11 @@ private:
         Vector<sp<SurfaceControl> > disposedSurfaces;
         uint32_t transactionNestingCount;
         bool deferredSpriteUpdate;
+        nsecs_t lastUpdateTime;
     } mLocked; // guarded by mLock
 
     void invalidateSpriteLocked(const sp<SpriteImpl>& sprite);
+    void scheduleUpdateSpritesLocked();
     void disposeSurfaceLocked(const sp<SurfaceControl>& surfaceControl);
 
     void handleMessage(const Message& message);
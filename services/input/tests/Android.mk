@@ -42,5 +42,14 @@ $(foreach file,$(test_src_files), \
     $(eval include $(BUILD_EXECUTABLE)) \
 )
 
+# Build the benchmark.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := InputPipeline_benchmark.cpp
+LOCAL_SHARED_LIBRARIES := $(shared_libraries)
+LOCAL_C_INCLUDES := $(c_includes)
+LOCAL_MODULE := InputPipeline_benchmark
+LOCAL_MODULE_TAGS := $(module_tags)
+include $(BUILD_EXECUTABLE)
+
 # Build the manual test programs.
 include $(call all-makefiles-under, $(LOCAL_PATH))
@@ -18,6 +18,8 @@
 
 #include <gtest/gtest.h>
 #include <linux/input.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace android {
 
@@ -138,6 +140,31 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesKeyEvents) {
             << "Should reject key events with ACTION_MULTIPLE.";
 }
 
+TEST_F(InputDispatcherTest, InjectInputEvents_RejectsSequencesWithInvalidEvents) {
+    KeyEvent down, invalid;
+    down.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    invalid.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_MULTIPLE, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    const InputEvent* events[] = { &down, &invalid };
+
+    // Trusted injectors have the whole sequence validated before anything is enqueued.
+    ASSERT_EQ(INPUT_EVENT_INJECTION_FAILED, mDispatcher->injectInputEvents(events, 2,
+            INJECTOR_PID, /*injectorUid*/ 0, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0))
+            << "Should reject sequences that contain an invalid key event.";
+
+    // Untrusted injectors have their events injected one at a time.
+    ASSERT_EQ(INPUT_EVENT_INJECTION_FAILED, mDispatcher->injectInputEvents(events, 2,
+            INJECTOR_PID, INJECTOR_UID, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0))
+            << "Should reject sequences that contain an invalid key event.";
+
+    ASSERT_EQ(INPUT_EVENT_INJECTION_SUCCEEDED, mDispatcher->injectInputEvents(events, 0,
+            INJECTOR_PID, INJECTOR_UID, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0))
+            << "Should accept empty sequences.";
+}
+
 TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
     MotionEvent event;
     PointerProperties pointerProperties[MAX_POINTERS + 1];
@@ -243,4 +270,245 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
             << "Should reject motion events with duplicate pointer ids.";
 }
 
+
+
+// --- FakeInputWindowHandle ---
+
+class FakeInputWindowHandle : public InputWindowHandle {
+protected:
+    virtual ~FakeInputWindowHandle() {
+    }
+
+public:
+    FakeInputWindowHandle(int32_t left, int32_t top, int32_t right, int32_t bottom,
+            int32_t flags) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->layoutParamsFlags = flags;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->frameLeft = left;
+        mInfo->frameTop = top;
+        mInfo->frameRight = right;
+        mInfo->frameBottom = bottom;
+        mInfo->touchableRegion.setRect(left, top, right, bottom);
+        mInfo->visible = true;
+    }
+
+    InputWindowInfo* editInfo() {
+        return mInfo;
+    }
+
+    virtual bool updateInfo() {
+        return mInfo != NULL;
+    }
+};
+
+
+// --- InputWindowIndexTest ---
+
+class InputWindowIndexTest : public testing::Test {
+protected:
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowIndex mIndex;
+
+    sp<FakeInputWindowHandle> addWindow(int32_t left, int32_t top, int32_t right,
+            int32_t bottom, int32_t flags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL) {
+        sp<FakeInputWindowHandle> windowHandle = new FakeInputWindowHandle(
+                left, top, right, bottom, flags);
+        mWindowHandles.add(windowHandle);
+        return windowHandle;
+    }
+
+    static bool contains(const Vector<size_t>& indices, size_t index) {
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (indices.itemAt(i) == index) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+TEST_F(InputWindowIndexTest, GetTouchCandidates_ListsOnlyWindowsNearThePoint) {
+    addWindow(0, 0, 100, 100);
+    addWindow(700, 0, 800, 100);
+    addWindow(0, 0, 800, 800);
+    mIndex.build(mWindowHandles);
+
+    const Vector<size_t>& topLeft = mIndex.getTouchCandidates(10, 10);
+    ASSERT_TRUE(contains(topLeft, 0));
+    ASSERT_FALSE(contains(topLeft, 1));
+    ASSERT_TRUE(contains(topLeft, 2));
+
+    const Vector<size_t>& topRight = mIndex.getTouchCandidates(790, 10);
+    ASSERT_FALSE(contains(topRight, 0));
+    ASSERT_TRUE(contains(topRight, 1));
+    ASSERT_TRUE(contains(topRight, 2));
+
+    const Vector<size_t>& outside = mIndex.getTouchCandidates(-10, 900);
+    ASSERT_EQ(size_t(0), outside.size());
+}
+
+TEST_F(InputWindowIndexTest, GetTouchCandidates_ListsModalAndErrorWindowsEverywhere) {
+    addWindow(0, 0, 10, 10, 0);
+    addWindow(0, 0, 10, 10,
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL | InputWindowInfo::FLAG_SYSTEM_ERROR)
+            ->editInfo()->visible = false;
+    addWindow(0, 0, 10, 10,
+            InputWindowInfo::FLAG_NOT_TOUCH_MODAL | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    addWindow(0, 0, 800, 800);
+    mIndex.build(mWindowHandles);
+
+    const Vector<size_t>& candidates = mIndex.getTouchCandidates(790, 790);
+    ASSERT_EQ(size_t(4), candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        ASSERT_EQ(i, candidates.itemAt(i))
+                << "Candidates should be sorted front to back.";
+    }
+
+    const Vector<size_t>& outside = mIndex.getTouchCandidates(-10, -10);
+    ASSERT_EQ(size_t(3), outside.size());
+    ASSERT_FALSE(contains(outside, 3));
+}
+
+TEST_F(InputWindowIndexTest, GetObscuringCandidates_IgnoresInvisibleWindowsAndTrustedOverlays) {
+    addWindow(0, 0, 800, 100)->editInfo()->layoutParamsType =
+            InputWindowInfo::TYPE_INPUT_METHOD;
+    addWindow(0, 0, 800, 100)->editInfo()->visible = false;
+    addWindow(0, 0, 800, 100);
+    sp<FakeInputWindowHandle> background = addWindow(0, 0, 800, 800);
+    mIndex.build(mWindowHandles);
+
+    const Vector<size_t>& candidates = mIndex.getObscuringCandidates(400, 50);
+    ASSERT_EQ(size_t(2), candidates.size());
+    ASSERT_EQ(size_t(2), candidates.itemAt(0));
+    ASSERT_EQ(size_t(3), candidates.itemAt(1));
+
+    ASSERT_EQ(3, mIndex.indexOf(background));
+    ASSERT_EQ(-1, mIndex.indexOf(new FakeInputWindowHandle(0, 0, 1, 1, 0)));
+}
+
+
+// --- InputDispatcherWindowsTest ---
+
+class InputDispatcherWindowsTest : public InputDispatcherTest {
+protected:
+    Vector<sp<InputChannel> > mClientChannels;
+
+    virtual void TearDown() {
+        mDispatcher->setInputWindows(Vector<sp<InputWindowHandle> >());
+        mClientChannels.clear();
+        InputDispatcherTest::TearDown();
+    }
+
+    sp<FakeInputWindowHandle> createWindow(const char* name, int32_t layer,
+            const sp<InputChannel>& inputChannel = NULL) {
+        sp<FakeInputWindowHandle> windowHandle = new FakeInputWindowHandle(
+                0, 0, 100, 100, InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+        InputWindowInfo* info = windowHandle->editInfo();
+        info->name = name;
+        info->layer = layer;
+        info->hasFocus = false;
+        info->paused = false;
+        if (inputChannel != NULL) {
+            info->inputChannel = inputChannel;
+        } else {
+            sp<InputChannel> clientChannel;
+            InputChannel::openInputChannelPair(String8(name), info->inputChannel,
+                    clientChannel);
+            mClientChannels.push(clientChannel);
+        }
+        return windowHandle;
+    }
+
+    // Returns the position of the window in the dispatcher window list, front to
+    // back, or -1 if it is not in the list.
+    int getWindowPosition(const char* name) {
+        String8 dump;
+        mDispatcher->dump(dump);
+        const char* windows = strstr(dump.string(), "Windows:\n");
+        if (!windows) {
+            return -1;
+        }
+        String8 pattern = String8::format(": name='%s', paused=", name);
+        const char* window = strstr(windows, pattern.string());
+        if (!window) {
+            return -1;
+        }
+        while (window > windows && window[-1] >= '0' && window[-1] <= '9') {
+            window--;
+        }
+        return atoi(window);
+    }
+};
+
+TEST_F(InputDispatcherWindowsTest, UpdateInputWindows_InsertsByLayerAndRemoves) {
+    sp<FakeInputWindowHandle> back = createWindow("back", 1);
+    sp<FakeInputWindowHandle> front = createWindow("front", 3);
+    Vector<sp<InputWindowHandle> > added;
+    added.push(back);
+    added.push(front);
+    mDispatcher->updateInputWindows(added, Vector<sp<InputWindowHandle> >(),
+            Vector<sp<InputWindowHandle> >());
+
+    ASSERT_EQ(0, getWindowPosition("front"));
+    ASSERT_EQ(1, getWindowPosition("back"));
+
+    sp<FakeInputWindowHandle> middle = createWindow("middle", 2);
+    added.clear();
+    added.push(middle);
+    mDispatcher->updateInputWindows(added, Vector<sp<InputWindowHandle> >(),
+            Vector<sp<InputWindowHandle> >());
+
+    ASSERT_EQ(0, getWindowPosition("front"));
+    ASSERT_EQ(1, getWindowPosition("middle"));
+    ASSERT_EQ(2, getWindowPosition("back"));
+
+    Vector<sp<InputWindowHandle> > removed;
+    removed.push(front);
+    mDispatcher->updateInputWindows(Vector<sp<InputWindowHandle> >(), removed,
+            Vector<sp<InputWindowHandle> >());
+
+    ASSERT_EQ(-1, getWindowPosition("front"));
+    ASSERT_EQ(0, getWindowPosition("middle"));
+    ASSERT_EQ(1, getWindowPosition("back"));
+    ASSERT_TRUE(front->getInfo() == NULL)
+            << "The info of a removed window should be released.";
+}
+
+TEST_F(InputDispatcherWindowsTest, UpdateInputWindows_MovesChangedWindows) {
+    sp<FakeInputWindowHandle> first = createWindow("first", 2);
+    sp<FakeInputWindowHandle> second = createWindow("second", 1);
+    Vector<sp<InputWindowHandle> > added;
+    added.push(first);
+    added.push(second);
+    mDispatcher->updateInputWindows(added, Vector<sp<InputWindowHandle> >(),
+            Vector<sp<InputWindowHandle> >());
+
+    second->editInfo()->layer = 3;
+    Vector<sp<InputWindowHandle> > changed;
+    changed.push(second);
+    mDispatcher->updateInputWindows(Vector<sp<InputWindowHandle> >(),
+            Vector<sp<InputWindowHandle> >(), changed);
+
+    ASSERT_EQ(0, getWindowPosition("second"));
+    ASSERT_EQ(1, getWindowPosition("first"));
+    ASSERT_TRUE(second->getInfo() != NULL)
+            << "The info of a changed window should be kept.";
+}
+
+TEST_F(InputDispatcherWindowsTest, SetInputWindows_DropsWindowsSharingAnInputChannel) {
+    sp<FakeInputWindowHandle> front = createWindow("front", 2);
+    sp<FakeInputWindowHandle> duplicate = createWindow("duplicate", 1,
+            front->getInputChannel());
+    Vector<sp<InputWindowHandle> > windowHandles;
+    windowHandles.push(front);
+    windowHandles.push(duplicate);
+    mDispatcher->setInputWindows(windowHandles);
+
+    ASSERT_EQ(0, getWindowPosition("front"));
+    ASSERT_EQ(-1, getWindowPosition("duplicate"))
+            << "Only the frontmost window of an input channel should be kept.";
+}
+
 } // namespace android
@@ -0,0 +1,732 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays touch traces through the whole native input pipeline:
+//
+//   TraceEventHub -> InputReader -> InputDispatcher -> InputPublisher -> InputConsumer
+//
+// The reader and dispatcher run on their usual threads; a consumer thread stands in for
+// the application.  At the end of the run the benchmark reports the end to end latency
+// seen by the consumer, the per-stage latency recorded by the dispatcher and the CPU
+// time spent per evdev frame.
+//
+// Usage: InputPipeline_benchmark [-r rate] [-p pointers] [-w windows] [-s strokes]
+//            [-m moves] [-t trace]
+//
+// By default synthetic strokes are generated.  With -t, a trace captured with
+// "getevent -t <device>" is replayed with its original timing instead.
+
+#include "../InputReader.h"
+#include "../InputDispatcher.h"
+
+#include <androidfw/InputTransport.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+namespace android {
+
+static const int32_t DEVICE_ID = 1;
+static const int32_t DISPLAY_WIDTH = 720;
+static const int32_t DISPLAY_HEIGHT = 1280;
+static const int32_t MAX_TRACE_POINTERS = 10;
+
+static nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+static nsecs_t processCpuTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return nsecs_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+
+// --- TraceFrame ---
+
+// A group of raw events terminated by SYN_REPORT, and the delay to wait
+// after the previous frame before delivering it.
+struct TraceFrame {
+    nsecs_t delay;
+    Vector<RawEvent> events;
+};
+
+static void addRawEvent(TraceFrame& frame, int32_t type, int32_t code, int32_t value) {
+    RawEvent event;
+    event.when = 0;
+    event.deviceId = DEVICE_ID;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    frame.events.push(event);
+}
+
+// Generates strokes of pointerCount pointers moving diagonally, using the type A
+// multitouch protocol.
+static void generateTrace(Vector<TraceFrame>& frames, int32_t rate,
+        int32_t pointerCount, int32_t strokeCount, int32_t moveCount) {
+    nsecs_t interval = 1000000000LL / rate;
+    for (int32_t stroke = 0; stroke < strokeCount; stroke++) {
+        for (int32_t move = 0; move <= moveCount; move++) {
+            TraceFrame frame;
+            frame.delay = interval;
+            for (int32_t i = 0; i < pointerCount; i++) {
+                int32_t x = (DISPLAY_WIDTH / (pointerCount + 1)) * (i + 1)
+                        + (move * 3) % (DISPLAY_WIDTH / 4);
+                int32_t y = DISPLAY_HEIGHT / 4 + (move * 11) % (DISPLAY_HEIGHT / 2);
+                addRawEvent(frame, EV_ABS, ABS_MT_TRACKING_ID, i);
+                addRawEvent(frame, EV_ABS, ABS_MT_POSITION_X, x);
+                addRawEvent(frame, EV_ABS, ABS_MT_POSITION_Y, y);
+                addRawEvent(frame, EV_SYN, SYN_MT_REPORT, 0);
+            }
+            addRawEvent(frame, EV_SYN, SYN_REPORT, 0);
+            frames.push(frame);
+        }
+
+        TraceFrame up;
+        up.delay = interval;
+        addRawEvent(up, EV_SYN, SYN_MT_REPORT, 0);
+        addRawEvent(up, EV_SYN, SYN_REPORT, 0);
+        frames.push(up);
+    }
+}
+
+// Loads a trace in the format printed by "getevent -t", with or without the device path:
+//   [   12345.678901] /dev/input/event2: 0003 0035 000001d1
+static bool loadTrace(Vector<TraceFrame>& frames, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Could not open trace '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char line[256];
+    double lastFrameTime = -1;
+    TraceFrame frame;
+    while (fgets(line, sizeof(line), file)) {
+        double time;
+        if (sscanf(line, " [ %lf ]", &time) != 1) {
+            continue;
+        }
+        const char* fields = strchr(line, ']') + 1;
+        const char* colon = strchr(fields, ':');
+        if (colon) {
+            fields = colon + 1;
+        }
+        unsigned int type, code, value;
+        if (sscanf(fields, "%x %x %x", &type, &code, &value) != 3) {
+            continue;
+        }
+
+        addRawEvent(frame, type, code, int32_t(value));
+        if (type == EV_SYN && code == SYN_REPORT) {
+            frame.delay = lastFrameTime < 0 ? 0 : nsecs_t((time - lastFrameTime) * 1000000000.0);
+            lastFrameTime = time;
+            frames.push(frame);
+            frame.events.clear();
+        }
+    }
+    fclose(file);
+
+    if (frames.isEmpty()) {
+        fprintf(stderr, "Trace '%s' does not contain any complete frames.\n", path);
+        return false;
+    }
+    return true;
+}
+
+
+// --- TraceEventHub ---
+
+// An event hub with a single multitouch screen that plays back a trace.  Each frame
+// is delivered by its own call to getEvents() once its delay has elapsed, and is
+// stamped with the time it was delivered.
+class TraceEventHub : public EventHubInterface {
+    Mutex mLock;
+    Condition mCondition;
+    const Vector<TraceFrame>& mFrames;
+    size_t mNextFrame;
+    nsecs_t mNextFrameTime;
+    bool mDeviceAdded;
+    bool mWakeRequested;
+
+protected:
+    virtual ~TraceEventHub() {
+    }
+
+public:
+    TraceEventHub(const Vector<TraceFrame>& frames) :
+            mFrames(frames), mNextFrame(0), mNextFrameTime(0),
+            mDeviceAdded(false), mWakeRequested(false) {
+    }
+
+    // Starts delivering frames.
+    void start() {
+        AutoMutex _l(mLock);
+        mNextFrameTime = now();
+        mCondition.broadcast();
+    }
+
+    bool isFinished() {
+        AutoMutex _l(mLock);
+        return mNextFrame >= mFrames.size();
+    }
+
+private:
+    virtual uint32_t getDeviceClasses(int32_t deviceId) const {
+        return INPUT_DEVICE_CLASS_TOUCH | INPUT_DEVICE_CLASS_TOUCH_MT;
+    }
+
+    virtual InputDeviceIdentifier getDeviceIdentifier(int32_t deviceId) const {
+        InputDeviceIdentifier identifier;
+        identifier.name = "trace-touchscreen";
+        return identifier;
+    }
+
+    virtual void getConfiguration(int32_t deviceId, PropertyMap* outConfiguration) const {
+        outConfiguration->addProperty(String8("touch.deviceType"), String8("touchScreen"));
+    }
+
+    virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
+            RawAbsoluteAxisInfo* outAxisInfo) const {
+        outAxisInfo->clear();
+        switch (axis) {
+        case ABS_MT_POSITION_X:
+            outAxisInfo->maxValue = DISPLAY_WIDTH - 1;
+            break;
+        case ABS_MT_POSITION_Y:
+            outAxisInfo->maxValue = DISPLAY_HEIGHT - 1;
+            break;
+        case ABS_MT_TRACKING_ID:
+            outAxisInfo->maxValue = MAX_TRACE_POINTERS - 1;
+            break;
+        default:
+            return -1;
+        }
+        outAxisInfo->valid = true;
+        return OK;
+    }
+
+    virtual bool hasRelativeAxis(int32_t deviceId, int axis) const {
+        return false;
+    }
+
+    virtual bool hasInputProperty(int32_t deviceId, int property) const {
+        return property == INPUT_PROP_DIRECT;
+    }
+
+    virtual status_t mapKey(int32_t deviceId, int32_t scanCode, int32_t usageCode,
+            int32_t* outKeycode, uint32_t* outFlags) const {
+        return NAME_NOT_FOUND;
+    }
+
+    virtual status_t mapAxis(int32_t deviceId, int32_t scanCode,
+            AxisInfo* outAxisInfo) const {
+        return NAME_NOT_FOUND;
+    }
+
+    virtual void setExcludedDevices(const Vector<String8>& devices) {
+    }
+
+    virtual size_t getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSize) {
+        AutoMutex _l(mLock);
+
+        nsecs_t currentTime = now();
+        if (!mDeviceAdded) {
+            mDeviceAdded = true;
+            buffer[0].when = currentTime;
+            buffer[0].deviceId = DEVICE_ID;
+            buffer[0].type = DEVICE_ADDED;
+            buffer[1].when = currentTime;
+            buffer[1].deviceId = 0;
+            buffer[1].type = FINISHED_DEVICE_SCAN;
+            return 2;
+        }
+
+        nsecs_t timeoutTime = timeoutMillis < 0 ? LLONG_MAX
+                : currentTime + milliseconds_to_nanoseconds(timeoutMillis);
+        for (;;) {
+            if (mWakeRequested) {
+                mWakeRequested = false;
+                return 0;
+            }
+
+            nsecs_t dueTime = LLONG_MAX;
+            if (mNextFrameTime != 0 && mNextFrame < mFrames.size()) {
+                dueTime = mNextFrameTime + mFrames.itemAt(mNextFrame).delay;
+            }
+            currentTime = now();
+            if (dueTime <= currentTime) {
+                break;
+            }
+
+            nsecs_t wakeTime = dueTime < timeoutTime ? dueTime : timeoutTime;
+            if (wakeTime == LLONG_MAX) {
+                mCondition.wait(mLock);
+            } else if (wakeTime > currentTime) {
+                mCondition.waitRelative(mLock, wakeTime - currentTime);
+            } else {
+                return 0;
+            }
+        }
+
+        const TraceFrame& frame = mFrames.itemAt(mNextFrame++);
+        mNextFrameTime = currentTime;
+        size_t count = frame.events.size() < bufferSize ? frame.events.size() : bufferSize;
+        for (size_t i = 0; i < count; i++) {
+            buffer[i] = frame.events.itemAt(i);
+            buffer[i].when = currentTime;
+        }
+        return count;
+    }
+
+    virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const {
+        return AKEY_STATE_UNKNOWN;
+    }
+
+    virtual int32_t getKeyCodeState(int32_t deviceId, int32_t keyCode) const {
+        return AKEY_STATE_UNKNOWN;
+    }
+
+    virtual int32_t getSwitchState(int32_t deviceId, int32_t sw) const {
+        return AKEY_STATE_UNKNOWN;
+    }
+
+    virtual status_t getAbsoluteAxisValue(int32_t deviceId, int32_t axis,
+            int32_t* outValue) const {
+        *outValue = 0;
+        return -1;
+    }
+
+    virtual bool markSupportedKeyCodes(int32_t deviceId, size_t numCodes, const int32_t* keyCodes,
+            uint8_t* outFlags) const {
+        return false;
+    }
+
+    virtual bool hasScanCode(int32_t deviceId, int32_t scanCode) const {
+        return false;
+    }
+
+    virtual bool hasLed(int32_t deviceId, int32_t led) const {
+        return false;
+    }
+
+    virtual void setLedState(int32_t deviceId, int32_t led, bool on) {
+    }
+
+    virtual void getVirtualKeyDefinitions(int32_t deviceId,
+            Vector<VirtualKeyDefinition>& outVirtualKeys) const {
+    }
+
+    virtual sp<KeyCharacterMap> getKeyCharacterMap(int32_t deviceId) const {
+        return NULL;
+    }
+
+    virtual bool setKeyboardLayoutOverlay(int32_t deviceId, const sp<KeyCharacterMap>& map) {
+        return false;
+    }
+
+    virtual void vibrate(int32_t deviceId, nsecs_t duration) {
+    }
+
+    virtual void cancelVibrate(int32_t deviceId) {
+    }
+
+    virtual void requestReopenDevices() {
+    }
+
+    virtual void wake() {
+        AutoMutex _l(mLock);
+        mWakeRequested = true;
+        mCondition.broadcast();
+    }
+
+    virtual void dump(String8& dump) {
+    }
+
+    virtual void monitor() {
+    }
+};
+
+
+// --- BenchmarkReaderPolicy ---
+
+class BenchmarkReaderPolicy : public InputReaderPolicyInterface {
+protected:
+    virtual ~BenchmarkReaderPolicy() {
+    }
+
+private:
+    virtual void getReaderConfiguration(InputReaderConfiguration* outConfig) {
+        outConfig->setDisplayInfo(0, false /*external*/,
+                DISPLAY_WIDTH, DISPLAY_HEIGHT, DISPLAY_ORIENTATION_0);
+    }
+
+    virtual sp<PointerControllerInterface> obtainPointerController(int32_t deviceId) {
+        return NULL;
+    }
+
+    virtual void notifyInputDevicesChanged(const Vector<InputDeviceInfo>& inputDevices) {
+    }
+
+    virtual sp<KeyCharacterMap> getKeyboardLayoutOverlay(const String8& inputDeviceDescriptor) {
+        return NULL;
+    }
+
+    virtual String8 getDeviceAlias(const InputDeviceIdentifier& identifier) {
+        return String8();
+    }
+};
+
+
+// --- BenchmarkDispatcherPolicy ---
+
+class BenchmarkDispatcherPolicy : public InputDispatcherPolicyInterface {
+    InputDispatcherConfiguration mConfig;
+
+protected:
+    virtual ~BenchmarkDispatcherPolicy() {
+    }
+
+private:
+    virtual void notifyConfigurationChanged(nsecs_t when) {
+    }
+
+    virtual nsecs_t notifyANR(const sp<InputApplicationHandle>& inputApplicationHandle,
+            const sp<InputWindowHandle>& inputWindowHandle) {
+        return 0;
+    }
+
+    virtual void notifyInputChannelBroken(const sp<InputWindowHandle>& inputWindowHandle) {
+    }
+
+    virtual void getDispatcherConfiguration(InputDispatcherConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    virtual bool isKeyRepeatEnabled() {
+        return false;
+    }
+
+    virtual bool filterInputEvent(const InputEvent* inputEvent, uint32_t policyFlags) {
+        return true;
+    }
+
+    virtual void interceptKeyBeforeQueueing(const KeyEvent* keyEvent, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual void interceptMotionBeforeQueueing(nsecs_t when, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual nsecs_t interceptKeyBeforeDispatching(const sp<InputWindowHandle>& inputWindowHandle,
+            const KeyEvent* keyEvent, uint32_t policyFlags) {
+        return 0;
+    }
+
+    virtual bool dispatchUnhandledKey(const sp<InputWindowHandle>& inputWindowHandle,
+            const KeyEvent* keyEvent, uint32_t policyFlags, KeyEvent* outFallbackKeyEvent) {
+        return false;
+    }
+
+    virtual void notifySwitch(nsecs_t when,
+            int32_t switchCode, int32_t switchValue, uint32_t policyFlags) {
+    }
+
+    virtual void pokeUserActivity(nsecs_t eventTime, int32_t eventType) {
+    }
+
+    virtual bool checkInjectEventsPermissionNonReentrant(
+            int32_t injectorPid, int32_t injectorUid) {
+        return false;
+    }
+};
+
+
+// --- BenchmarkWindowHandle ---
+
+class BenchmarkWindowHandle : public InputWindowHandle {
+protected:
+    virtual ~BenchmarkWindowHandle() {
+    }
+
+public:
+    BenchmarkWindowHandle(const sp<InputChannel>& inputChannel, int32_t layer,
+            int32_t left, int32_t top, int32_t right, int32_t bottom, int32_t flags) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->inputChannel = inputChannel;
+        mInfo->name = inputChannel->getName();
+        mInfo->layoutParamsFlags = flags;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->dispatchingTimeout = seconds_to_nanoseconds(5);
+        mInfo->frameLeft = left;
+        mInfo->frameTop = top;
+        mInfo->frameRight = right;
+        mInfo->frameBottom = bottom;
+        mInfo->scaleFactor = 1.0f;
+        mInfo->touchableRegion.setRect(left, top, right, bottom);
+        mInfo->visible = true;
+        mInfo->canReceiveKeys = false;
+        mInfo->hasFocus = false;
+        mInfo->hasWallpaper = false;
+        mInfo->paused = false;
+        mInfo->layer = layer;
+        mInfo->ownerPid = getpid();
+        mInfo->ownerUid = getuid();
+        mInfo->inputFeatures = 0;
+    }
+
+    virtual bool updateInfo() {
+        return mInfo != NULL;
+    }
+};
+
+
+// --- ConsumerThread ---
+
+// Plays the part of the application: consumes events from the target window as soon
+// as they arrive and records the latency from evdev to the consumer for each of them.
+class ConsumerThread : public Thread {
+    InputConsumer mConsumer;
+    PreallocatedInputEventFactory mEventFactory;
+
+public:
+    Vector<nsecs_t> latencies;
+    size_t sampleCount;
+    size_t upCount;
+
+    ConsumerThread(const sp<InputChannel>& inputChannel) :
+            Thread(/*canCallJava*/ false), mConsumer(inputChannel),
+            sampleCount(0), upCount(0) {
+    }
+
+private:
+    virtual bool threadLoop() {
+        struct pollfd pfd;
+        pfd.fd = mConsumer.getChannel()->getFd();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int result = poll(&pfd, 1, 100);
+        if (result <= 0) {
+            return true;
+        }
+
+        for (;;) {
+            uint32_t seq;
+            InputEvent* event;
+            status_t status = mConsumer.consume(&mEventFactory, true /*consumeBatches*/,
+                    -1, &seq, &event);
+            if (status) {
+                return status == WOULD_BLOCK;
+            }
+
+            nsecs_t latency = now() - event->getEventTime();
+            latencies.push(latency);
+            if (event->getType() == AINPUT_EVENT_TYPE_MOTION) {
+                MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+                sampleCount += motionEvent->getHistorySize() + 1;
+                if (motionEvent->getActionMasked() == AMOTION_EVENT_ACTION_UP) {
+                    upCount += 1;
+                }
+            }
+            mConsumer.sendFinishedSignal(seq, true);
+        }
+    }
+};
+
+
+// --- Benchmark ---
+
+static int compareLatencies(const nsecs_t* a, const nsecs_t* b) {
+    return *a < *b ? -1 : *a > *b ? 1 : 0;
+}
+
+static float getPercentileMillis(const Vector<nsecs_t>& sortedLatencies, float percentile) {
+    if (sortedLatencies.isEmpty()) {
+        return 0;
+    }
+    size_t index = size_t(percentile * (sortedLatencies.size() - 1) / 100.0f + 0.5f);
+    return sortedLatencies.itemAt(index) * 0.000001f;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-r rate] [-p pointers] [-w windows] [-s strokes] [-m moves]"
+            " [-t trace]\n"
+            "  -r  frames per second of the synthetic strokes (default 120)\n"
+            "  -p  pointers per stroke, 1 to %d (default 2)\n"
+            "  -w  number of windows, all but one of them above the target (default 1)\n"
+            "  -s  number of strokes (default 50)\n"
+            "  -m  moves per stroke (default 60)\n"
+            "  -t  replay a trace captured with 'getevent -t' instead\n",
+            name, MAX_TRACE_POINTERS);
+}
+
+static int runBenchmark(int argc, char** argv) {
+    int32_t rate = 120;
+    int32_t pointerCount = 2;
+    int32_t windowCount = 1;
+    int32_t strokeCount = 50;
+    int32_t moveCount = 60;
+    const char* tracePath = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:p:w:s:m:t:")) != -1) {
+        switch (opt) {
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 'p':
+            pointerCount = atoi(optarg);
+            break;
+        case 'w':
+            windowCount = atoi(optarg);
+            break;
+        case 's':
+            strokeCount = atoi(optarg);
+            break;
+        case 'm':
+            moveCount = atoi(optarg);
+            break;
+        case 't':
+            tracePath = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rate <= 0 || pointerCount < 1 || pointerCount > MAX_TRACE_POINTERS
+            || windowCount < 1 || strokeCount < 1 || moveCount < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Vector<TraceFrame> frames;
+    if (tracePath) {
+        if (!loadTrace(frames, tracePath)) {
+            return 1;
+        }
+    } else {
+        generateTrace(frames, rate, pointerCount, strokeCount, moveCount);
+    }
+
+    sp<TraceEventHub> eventHub = new TraceEventHub(frames);
+    sp<InputDispatcher> dispatcher = new InputDispatcher(new BenchmarkDispatcherPolicy());
+    sp<InputReader> reader = new InputReader(eventHub, new BenchmarkReaderPolicy(), dispatcher);
+
+    // The target window covers the display.  The other windows are stacked above it
+    // along the top edge so every touch has to be hit tested against them.
+    Vector<sp<InputChannel> > clientChannels;
+    Vector<sp<InputWindowHandle> > windowHandles;
+    for (int32_t i = 0; i < windowCount; i++) {
+        sp<InputChannel> serverChannel, clientChannel;
+        status_t result = InputChannel::openInputChannelPair(
+                String8::format("benchmark window %d", i), serverChannel, clientChannel);
+        if (result) {
+            fprintf(stderr, "Could not open input channel pair: %d\n", result);
+            return 1;
+        }
+
+        bool target = i == windowCount - 1;
+        sp<InputWindowHandle> windowHandle = target
+                ? new BenchmarkWindowHandle(serverChannel, 1000, 0, 0,
+                        DISPLAY_WIDTH, DISPLAY_HEIGHT, InputWindowInfo::FLAG_SPLIT_TOUCH)
+                : new BenchmarkWindowHandle(serverChannel, 2000 + windowCount - i,
+                        (i * 16) % DISPLAY_WIDTH, 0, (i * 16) % DISPLAY_WIDTH + 64,
+                        DISPLAY_HEIGHT / 8,
+                        InputWindowInfo::FLAG_NOT_FOCUSABLE
+                                | InputWindowInfo::FLAG_NOT_TOUCH_MODAL);
+        dispatcher->registerInputChannel(serverChannel, windowHandle, false /*monitor*/);
+        clientChannels.push(clientChannel);
+        windowHandles.push(windowHandle);
+    }
+    dispatcher->setInputWindows(windowHandles);
+    dispatcher->setInputDispatchMode(true /*enabled*/, false /*frozen*/);
+
+    sp<ConsumerThread> consumerThread = new ConsumerThread(clientChannels.top());
+    sp<InputReaderThread> readerThread = new InputReaderThread(reader);
+    sp<InputDispatcherThread> dispatcherThread = new InputDispatcherThread(dispatcher);
+    consumerThread->run("InputConsumer", PRIORITY_URGENT_DISPLAY);
+    dispatcherThread->run("InputDispatcher", PRIORITY_URGENT_DISPLAY);
+    readerThread->run("InputReader", PRIORITY_URGENT_DISPLAY);
+
+    // Give the reader a moment to configure the device before starting the clock.
+    usleep(100 * 1000);
+    nsecs_t startCpuTime = processCpuTime();
+    nsecs_t startTime = now();
+    eventHub->start();
+
+    while (!eventHub->isFinished()) {
+        usleep(10 * 1000);
+    }
+    // Let the last frames drain through the pipeline.
+    usleep(200 * 1000);
+
+    nsecs_t elapsedTime = now() - startTime;
+    nsecs_t cpuTime = processCpuTime() - startCpuTime;
+
+    readerThread->requestExit();
+    eventHub->wake();
+    readerThread->join();
+    dispatcherThread->requestExit();
+    dispatcher->setInputWindows(Vector<sp<InputWindowHandle> >());
+    dispatcherThread->join();
+    consumerThread->requestExitAndWait();
+
+    Vector<nsecs_t>& latencies = consumerThread->latencies;
+    latencies.sort(compareLatencies);
+
+    printf("Input pipeline benchmark: %s, pointers=%d, windows=%d\n",
+            tracePath ? tracePath : String8::format("synthetic at %dHz", rate).string(),
+            tracePath ? 0 : pointerCount, windowCount);
+    printf("  Frames: %d replayed in %0.3fs\n", int(frames.size()), elapsedTime * 0.000000001f);
+    printf("  Delivered: %d motion events, %d samples, %d strokes completed\n",
+            int(latencies.size()), int(consumerThread->sampleCount),
+            int(consumerThread->upCount));
+    printf("  End to end latency: 50%%=%0.3fms, 90%%=%0.3fms, 99%%=%0.3fms, max=%0.3fms\n",
+            getPercentileMillis(latencies, 50), getPercentileMillis(latencies, 90),
+            getPercentileMillis(latencies, 99), getPercentileMillis(latencies, 100));
+    printf("  CPU: %0.1fus per frame, %0.1f%% of one core\n",
+            cpuTime * 0.001f / frames.size(), cpuTime * 100.0f / elapsedTime);
+
+    // The dispatcher keeps its own per-stage latency histograms.
+    String8 dump;
+    dispatcher->dump(dump);
+    const char* latencyDump = strstr(dump.string(), "Latency:");
+    if (latencyDump) {
+        const char* end = strstr(latencyDump, "EntryPools:");
+        printf("  Dispatcher %.*s", end ? int(end - latencyDump) : int(strlen(latencyDump)),
+                latencyDump);
+    }
+    return 0;
+}
+
+} // namespace android
+
+int main(int argc, char** argv) {
+    return android::runBenchmark(argc, argv);
+}
@@ -142,6 +142,10 @@ public:
         mConfig.setDisplayInfo(displayId, true /*external*/, width, height, orientation);
     }
 
+    void setReaderShardCount(uint32_t shardCount) {
+        mConfig.readerShardCount = shardCount;
+    }
+
     void addExcludedDeviceName(const String8& deviceName) {
         mConfig.excludedDeviceNames.push(deviceName);
     }
@@ -309,6 +313,7 @@ class FakeEventHub : public EventHubInterface {
     KeyedVector<int32_t, Device*> mDevices;
     Vector<String8> mExcludedDevices;
     List<RawEvent> mEvents;
+    bool mReturnAllEvents;
 
 protected:
     virtual ~FakeEventHub() {
@@ -318,7 +323,12 @@ protected:
     }
 
 public:
-    FakeEventHub() { }
+    FakeEventHub() : mReturnAllEvents(false) { }
+
+    // By default getEvents() returns a single event at a time.
+    void setReturnAllEvents(bool returnAllEvents) {
+        mReturnAllEvents = returnAllEvents;
+    }
 
     void addDevice(int32_t deviceId, const String8& name, uint32_t classes) {
         Device* device = new Device(classes);
@@ -537,9 +547,12 @@ private:
             return 0;
         }
 
-        *buffer = *mEvents.begin();
-        mEvents.erase(mEvents.begin());
-        return 1;
+        size_t count = 0;
+        do {
+            buffer[count++] = *mEvents.begin();
+            mEvents.erase(mEvents.begin());
+        } while (mReturnAllEvents && count < bufferSize && !mEvents.empty());
+        return count;
     }
 
     virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const {
@@ -1091,6 +1104,45 @@ TEST_F(InputReaderTest, GetSwitchState_ForwardsRequestsToMappers) {
             << "Should return value provided by mapper when device id is < 0 and one of the devices supports some of the sources.";
 }
 
+TEST_F(InputReaderTest, GetStates_ReturnsSameStatesAsIndividualQueries) {
+    FakeInputMapper* mapper = NULL;
+    ASSERT_NO_FATAL_FAILURE(mapper = addDeviceWithFakeInputMapper(1, String8("fake"),
+            INPUT_DEVICE_CLASS_KEYBOARD, AINPUT_SOURCE_KEYBOARD, NULL));
+    mapper->setKeyCodeState(AKEYCODE_A, AKEY_STATE_DOWN);
+    mapper->setKeyCodeState(AKEYCODE_B, AKEY_STATE_UP);
+    mapper->setScanCodeState(KEY_A, AKEY_STATE_DOWN);
+    mapper->setSwitchState(SW_LID, AKEY_STATE_DOWN);
+
+    const int32_t keyCodes[2] = { AKEYCODE_A, AKEYCODE_B };
+    const int32_t scanCodes[1] = { KEY_A };
+    const int32_t switches[1] = { SW_LID };
+    int32_t keyCodeStates[2];
+    int32_t scanCodeStates[1];
+    int32_t switchStates[1];
+
+    mReader->getStates(1, AINPUT_SOURCE_KEYBOARD, 2, keyCodes, keyCodeStates,
+            1, scanCodes, scanCodeStates, 1, switches, switchStates);
+    ASSERT_EQ(AKEY_STATE_DOWN, keyCodeStates[0]);
+    ASSERT_EQ(AKEY_STATE_UP, keyCodeStates[1]);
+    ASSERT_EQ(AKEY_STATE_DOWN, scanCodeStates[0]);
+    ASSERT_EQ(AKEY_STATE_DOWN, switchStates[0]);
+
+    mReader->getStates(1, AINPUT_SOURCE_TRACKBALL, 2, keyCodes, keyCodeStates,
+            1, scanCodes, scanCodeStates, 1, switches, switchStates);
+    ASSERT_EQ(AKEY_STATE_UNKNOWN, keyCodeStates[0])
+            << "Should return unknown when the sources are not supported by the device.";
+    ASSERT_EQ(AKEY_STATE_UNKNOWN, keyCodeStates[1]);
+    ASSERT_EQ(AKEY_STATE_UNKNOWN, scanCodeStates[0]);
+    ASSERT_EQ(AKEY_STATE_UNKNOWN, switchStates[0]);
+
+    mReader->getStates(-1, AINPUT_SOURCE_ANY, 2, keyCodes, keyCodeStates,
+            0, NULL, NULL, 1, switches, switchStates);
+    ASSERT_EQ(AKEY_STATE_DOWN, keyCodeStates[0])
+            << "Should combine the states of all devices when the device id is < 0.";
+    ASSERT_EQ(AKEY_STATE_UP, keyCodeStates[1]);
+    ASSERT_EQ(AKEY_STATE_DOWN, switchStates[0]);
+}
+
 TEST_F(InputReaderTest, MarkSupportedKeyCodes_ForwardsRequestsToMappers) {
     FakeInputMapper* mapper = NULL;
     ASSERT_NO_FATAL_FAILURE(mapper = addDeviceWithFakeInputMapper(1, String8("fake"),
@@ -1154,6 +1206,115 @@ TEST_F(InputReaderTest, LoopOnce_ForwardsRawEventsToMappers) {
 }
 
 
+// --- ShardedInputReaderTest ---
+
+class ShardedInputReaderTest : public testing::Test {
+protected:
+    sp<FakeInputListener> mFakeListener;
+    sp<FakeInputReaderPolicy> mFakePolicy;
+    sp<FakeEventHub> mFakeEventHub;
+    sp<InputReader> mReader;
+
+    virtual void SetUp() {
+        mFakeEventHub = new FakeEventHub();
+        mFakePolicy = new FakeInputReaderPolicy();
+        mFakeListener = new FakeInputListener();
+
+        // Each loop then processes several batches of events, on both shards.
+        mFakeEventHub->setReturnAllEvents(true);
+        mFakePolicy->setReaderShardCount(2);
+        mReader = new InputReader(mFakeEventHub, mFakePolicy, mFakeListener);
+    }
+
+    virtual void TearDown() {
+        mReader.clear();
+
+        mFakeListener.clear();
+        mFakePolicy.clear();
+        mFakeEventHub.clear();
+    }
+
+    // Adds a keyboard with a single key.  Devices 1 and 2 are processed by different shards.
+    void addKeyboard(int32_t deviceId, int32_t scanCode, int32_t keyCode) {
+        mFakeEventHub->addDevice(deviceId, String8("keyboard"), INPUT_DEVICE_CLASS_KEYBOARD);
+        mFakeEventHub->addKey(deviceId, scanCode, 0, keyCode, 0);
+        mFakeEventHub->finishDeviceScan();
+        mReader->loopOnce();
+        mFakeEventHub->assertQueueIsEmpty();
+
+        mFakeListener->assertNotifyConfigurationChangedWasCalled();
+        mFakeListener->assertNotifyDeviceResetWasCalled();
+    }
+
+    void assertKey(nsecs_t eventTime, int32_t deviceId, int32_t action, int32_t keyCode) {
+        NotifyKeyArgs args;
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyKeyWasCalled(&args));
+        ASSERT_EQ(eventTime, args.eventTime);
+        ASSERT_EQ(deviceId, args.deviceId);
+        ASSERT_EQ(action, args.action);
+        ASSERT_EQ(keyCode, args.keyCode);
+    }
+};
+
+TEST_F(ShardedInputReaderTest, LoopOnce_MergesEventsOfAllShardsByTime) {
+    ASSERT_NO_FATAL_FAILURE(addKeyboard(1, KEY_A, AKEYCODE_A));
+    ASSERT_NO_FATAL_FAILURE(addKeyboard(2, KEY_B, AKEYCODE_B));
+
+    mFakeEventHub->enqueueEvent(10, 1, EV_KEY, KEY_A, 1);
+    mFakeEventHub->enqueueEvent(20, 2, EV_KEY, KEY_B, 1);
+    mFakeEventHub->enqueueEvent(30, 1, EV_KEY, KEY_A, 0);
+    mFakeEventHub->enqueueEvent(40, 2, EV_KEY, KEY_B, 0);
+    mReader->loopOnce();
+    ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+
+    ASSERT_NO_FATAL_FAILURE(assertKey(10, 1, AKEY_EVENT_ACTION_DOWN, AKEYCODE_A));
+    ASSERT_NO_FATAL_FAILURE(assertKey(20, 2, AKEY_EVENT_ACTION_DOWN, AKEYCODE_B));
+    ASSERT_NO_FATAL_FAILURE(assertKey(30, 1, AKEY_EVENT_ACTION_UP, AKEYCODE_A));
+    ASSERT_NO_FATAL_FAILURE(assertKey(40, 2, AKEY_EVENT_ACTION_UP, AKEYCODE_B));
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyKeyWasNotCalled());
+}
+
+TEST_F(ShardedInputReaderTest, LoopOnce_ProcessesEventsBeforeRemovingDevice) {
+    ASSERT_NO_FATAL_FAILURE(addKeyboard(1, KEY_A, AKEYCODE_A));
+
+    mFakeEventHub->enqueueEvent(10, 1, EV_KEY, KEY_A, 1);
+    mFakeEventHub->removeDevice(1);
+    mReader->loopOnce();
+    ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+
+    ASSERT_NO_FATAL_FAILURE(assertKey(10, 1, AKEY_EVENT_ACTION_DOWN, AKEYCODE_A));
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyDeviceResetWasCalled());
+
+    Vector<InputDeviceInfo> inputDevices;
+    mReader->getInputDevices(inputDevices);
+    ASSERT_EQ(0U, inputDevices.size());
+}
+
+TEST_F(ShardedInputReaderTest, LoopOnce_ManyBatchesOnEachShard) {
+    ASSERT_NO_FATAL_FAILURE(addKeyboard(1, KEY_A, AKEYCODE_A));
+    ASSERT_NO_FATAL_FAILURE(addKeyboard(2, KEY_B, AKEYCODE_B));
+
+    // Alternating devices make a batch of a single event each.
+    const int32_t presses = 50;
+    for (nsecs_t i = 0; i < presses; i++) {
+        mFakeEventHub->enqueueEvent(i * 4 + 1, 1, EV_KEY, KEY_A, 1);
+        mFakeEventHub->enqueueEvent(i * 4 + 2, 2, EV_KEY, KEY_B, 1);
+        mFakeEventHub->enqueueEvent(i * 4 + 3, 1, EV_KEY, KEY_A, 0);
+        mFakeEventHub->enqueueEvent(i * 4 + 4, 2, EV_KEY, KEY_B, 0);
+    }
+    mReader->loopOnce();
+    ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+
+    for (nsecs_t i = 0; i < presses; i++) {
+        ASSERT_NO_FATAL_FAILURE(assertKey(i * 4 + 1, 1, AKEY_EVENT_ACTION_DOWN, AKEYCODE_A));
+        ASSERT_NO_FATAL_FAILURE(assertKey(i * 4 + 2, 2, AKEY_EVENT_ACTION_DOWN, AKEYCODE_B));
+        ASSERT_NO_FATAL_FAILURE(assertKey(i * 4 + 3, 1, AKEY_EVENT_ACTION_UP, AKEYCODE_A));
+        ASSERT_NO_FATAL_FAILURE(assertKey(i * 4 + 4, 2, AKEY_EVENT_ACTION_UP, AKEYCODE_B));
+    }
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyKeyWasNotCalled());
+}
+
+
 // --- InputDeviceTest ---
 
 class InputDeviceTest : public testing::Test {
@@ -4405,6 +4566,53 @@ TEST_F(MultiTouchInputMapperTest, Process_NormalMultiTouchGesture_WithSlots) {
     ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasNotCalled());
 }
 
+TEST_F(MultiTouchInputMapperTest, Process_SparseSlots_OnlyReportsSlotsInUse) {
+    MultiTouchInputMapper* mapper = new MultiTouchInputMapper(mDevice);
+    addConfigurationProperty("touch.deviceType", "touchScreen");
+    prepareDisplay(DISPLAY_ORIENTATION_0);
+    prepareAxes(POSITION | ID | SLOT);
+    addMapperAndConfigure(mapper);
+
+    NotifyMotionArgs motionArgs;
+
+    // One finger down in the last slot.
+    int32_t x = 100, y = 125;
+    processSlot(mapper, RAW_SLOT_MAX);
+    processPosition(mapper, x, y);
+    processId(mapper, 1);
+    processSync(mapper);
+
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&motionArgs));
+    ASSERT_EQ(AMOTION_EVENT_ACTION_DOWN, motionArgs.action);
+    ASSERT_EQ(size_t(1), motionArgs.pointerCount);
+    ASSERT_EQ(0, motionArgs.pointerProperties[0].id);
+    ASSERT_NO_FATAL_FAILURE(assertPointerCoords(motionArgs.pointerCoords[0],
+            toDisplayX(x), toDisplayY(y), 1, 0, 0, 0, 0, 0, 0, 0));
+
+    // Move.  The sample before it must have been read from the other buffer.
+    x += 10; y += 15;
+    processPosition(mapper, x, y);
+    processSync(mapper);
+
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&motionArgs));
+    ASSERT_EQ(AMOTION_EVENT_ACTION_MOVE, motionArgs.action);
+    ASSERT_EQ(size_t(1), motionArgs.pointerCount);
+    ASSERT_NO_FATAL_FAILURE(assertPointerCoords(motionArgs.pointerCoords[0],
+            toDisplayX(x), toDisplayY(y), 1, 0, 0, 0, 0, 0, 0, 0));
+
+    // Up.
+    processId(mapper, -1);
+    processSync(mapper);
+
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&motionArgs));
+    ASSERT_EQ(AMOTION_EVENT_ACTION_UP, motionArgs.action);
+    ASSERT_EQ(size_t(1), motionArgs.pointerCount);
+    ASSERT_NO_FATAL_FAILURE(assertPointerCoords(motionArgs.pointerCoords[0],
+            toDisplayX(x), toDisplayY(y), 1, 0, 0, 0, 0, 0, 0, 0));
+
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasNotCalled());
+}
+
 TEST_F(MultiTouchInputMapperTest, Process_AllAxes_WithDefaultCalibration) {
     MultiTouchInputMapper* mapper = new MultiTouchInputMapper(mDevice);
     addConfigurationProperty("touch.deviceType", "touchScreen");
@@ -30,6 +30,7 @@
 #include <limits.h>
 #include <android_runtime/AndroidRuntime.h>
 
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Looper.h>
 #include <utils/threads.h>
@@ -173,7 +174,10 @@ public:
     status_t unregisterInputChannel(JNIEnv* env, const sp<InputChannel>& inputChannel);
 
     void setInputWindows(JNIEnv* env, jobjectArray windowHandleObjArray);
+    void updateInputWindows(JNIEnv* env, jobjectArray addedWindowHandleObjArray,
+            jobjectArray removedWindowHandleObjArray, jobjectArray changedWindowHandleObjArray);
     void setFocusedApplication(JNIEnv* env, jobject applicationHandleObj);
+    void setPointerGesturesEnabled(bool enabled);
     void setInputDispatchMode(bool enabled, bool frozen);
     void setSystemUiVisibility(int32_t visibility);
     void setPointerSpeed(int32_t speed);
@@ -396,6 +400,10 @@ void NativeInputManager::getReaderConfiguration(InputReaderConfiguration* outCon
         outConfig->virtualKeyQuietTime = milliseconds_to_nanoseconds(virtualKeyQuietTime);
     }
 
+    char readerShardCount[PROPERTY_VALUE_MAX];
+    property_get("ro.input.reader_shards", readerShardCount, "0");
+    outConfig->readerShardCount = max(atoi(readerShardCount), 0);
+
     outConfig->excludedDeviceNames.clear();
     jobjectArray excludedDeviceNames = jobjectArray(env->CallObjectMethod(mServiceObj,
             gServiceClassInfo.getExcludedDeviceNames));
@@ -664,9 +672,8 @@ bool NativeInputManager::isKeyRepeatEnabled() {
     return isScreenOn();
 }
 
-void NativeInputManager::setInputWindows(JNIEnv* env, jobjectArray windowHandleObjArray) {
-    Vector<sp<InputWindowHandle> > windowHandles;
-
+static void getWindowHandles(JNIEnv* env, jobjectArray windowHandleObjArray,
+        Vector<sp<InputWindowHandle> >& outWindowHandles) {
     if (windowHandleObjArray) {
         jsize length = env->GetArrayLength(windowHandleObjArray);
         for (jsize i = 0; i < length; i++) {
@@ -678,11 +685,16 @@ void NativeInputManager::setInputWindows(JNIEnv* env, jobjectArray windowHandleO
             sp<InputWindowHandle> windowHandle =
                     android_server_InputWindowHandle_getHandle(env, windowHandleObj);
             if (windowHandle != NULL) {
-                windowHandles.push(windowHandle);
+                outWindowHandles.push(windowHandle);
             }
             env->DeleteLocalRef(windowHandleObj);
         }
     }
+}
+
+void NativeInputManager::setInputWindows(JNIEnv* env, jobjectArray windowHandleObjArray) {
+    Vector<sp<InputWindowHandle> > windowHandles;
+    getWindowHandles(env, windowHandleObjArray, windowHandles);
 
     mInputManager->getDispatcher()->setInputWindows(windowHandles);
 
@@ -698,6 +710,38 @@ void NativeInputManager::setInputWindows(JNIEnv* env, jobjectArray windowHandleO
         }
     }
 
+    setPointerGesturesEnabled(newPointerGesturesEnabled);
+}
+
+void NativeInputManager::updateInputWindows(JNIEnv* env, jobjectArray addedWindowHandleObjArray,
+        jobjectArray removedWindowHandleObjArray, jobjectArray changedWindowHandleObjArray) {
+    Vector<sp<InputWindowHandle> > addedWindowHandles;
+    Vector<sp<InputWindowHandle> > removedWindowHandles;
+    Vector<sp<InputWindowHandle> > changedWindowHandles;
+    getWindowHandles(env, addedWindowHandleObjArray, addedWindowHandles);
+    getWindowHandles(env, removedWindowHandleObjArray, removedWindowHandles);
+    getWindowHandles(env, changedWindowHandleObjArray, changedWindowHandles);
+
+    mInputManager->getDispatcher()->updateInputWindows(addedWindowHandles,
+            removedWindowHandles, changedWindowHandles);
+
+    // A change of focus changes hasFocus on both windows, so the focused window is
+    // among the updated ones whenever it changed, otherwise the setting stays.
+    Vector<sp<InputWindowHandle> > updatedWindowHandles(addedWindowHandles);
+    updatedWindowHandles.appendVector(changedWindowHandles);
+    size_t numWindows = updatedWindowHandles.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        const sp<InputWindowHandle>& windowHandle = updatedWindowHandles.itemAt(i);
+        const InputWindowInfo* windowInfo = windowHandle->getInfo();
+        if (windowInfo && windowInfo->hasFocus) {
+            setPointerGesturesEnabled(!(windowInfo->inputFeatures
+                    & InputWindowInfo::INPUT_FEATURE_DISABLE_TOUCH_PAD_GESTURES));
+            break;
+        }
+    }
+}
+
+void NativeInputManager::setPointerGesturesEnabled(bool newPointerGesturesEnabled) {
     uint32_t changes = 0;
     { // acquire lock
         AutoMutex _l(mLock);
@@ -1079,6 +1123,50 @@ static jint nativeGetSwitchState(JNIEnv* env, jclass clazz,
             deviceId, uint32_t(sourceMask), sw);
 }
 
+static jint getCodesLength(JNIEnv* env, jintArray codes) {
+    return codes != NULL ? env->GetArrayLength(codes) : 0;
+}
+
+static void nativeGetStates(JNIEnv* env, jclass clazz,
+        jint ptr, jint deviceId, jint sourceMask, jintArray keyCodes, jintArray scanCodes,
+        jintArray switches, jintArray outStates) {
+    NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
+
+    // The states are returned in the order of the requested codes: key codes,
+    // then scan codes, then switches.
+    jsize numKeyCodes = getCodesLength(env, keyCodes);
+    jsize numScanCodes = getCodesLength(env, scanCodes);
+    jsize numSwitches = getCodesLength(env, switches);
+    jsize numStates = numKeyCodes + numScanCodes + numSwitches;
+    if (env->GetArrayLength(outStates) < numStates) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outStates is too small for the requested codes");
+        return;
+    }
+
+    int32_t* codes = new int32_t[numStates];
+    int32_t* states = new int32_t[numStates];
+    if (numKeyCodes) {
+        env->GetIntArrayRegion(keyCodes, 0, numKeyCodes, codes);
+    }
+    if (numScanCodes) {
+        env->GetIntArrayRegion(scanCodes, 0, numScanCodes, codes + numKeyCodes);
+    }
+    if (numSwitches) {
+        env->GetIntArrayRegion(switches, 0, numSwitches, codes + numKeyCodes + numScanCodes);
+    }
+
+    im->getInputManager()->getReader()->getStates(deviceId, uint32_t(sourceMask),
+            numKeyCodes, codes, states,
+            numScanCodes, codes + numKeyCodes, states + numKeyCodes,
+            numSwitches, codes + numKeyCodes + numScanCodes,
+            states + numKeyCodes + numScanCodes);
+
+    env->SetIntArrayRegion(outStates, 0, numStates, states);
+    delete[] codes;
+    delete[] states;
+}
+
 static jboolean nativeHasKeys(JNIEnv* env, jclass clazz,
         jint ptr, jint deviceId, jint sourceMask, jintArray keyCodes, jbooleanArray outFlags) {
     NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
@@ -1209,6 +1297,15 @@ static void nativeSetInputWindows(JNIEnv* env, jclass clazz,
     im->setInputWindows(env, windowHandleObjArray);
 }
 
+static void nativeUpdateInputWindows(JNIEnv* env, jclass clazz,
+        jint ptr, jobjectArray addedWindowHandleObjArray,
+        jobjectArray removedWindowHandleObjArray, jobjectArray changedWindowHandleObjArray) {
+    NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
+
+    im->updateInputWindows(env, addedWindowHandleObjArray, removedWindowHandleObjArray,
+            changedWindowHandleObjArray);
+}
+
 static void nativeSetFocusedApplication(JNIEnv* env, jclass clazz,
         jint ptr, jobject applicationHandleObj) {
     NativeInputManager* im = reinterpret_cast<NativeInputManager*>(ptr);
@@ -1382,6 +1479,16 @@ static JNINativeMethod gInputManagerMethods[] = {
             (void*) nativeMonitor },
 };
 
+// Only registered if InputManagerService declares them
+static JNINativeMethod gInputManagerOptionalMethods[] = {
+    { "nativeGetStates", "(III[I[I[I[I)V",
+            (void*) nativeGetStates },
+    { "nativeUpdateInputWindows", "(I[Lcom/android/server/input/InputWindowHandle;"
+            "[Lcom/android/server/input/InputWindowHandle;"
+            "[Lcom/android/server/input/InputWindowHandle;)V",
+            (void*) nativeUpdateInputWindows },
+};
+
 #define FIND_CLASS(var, className) \
         var = env->FindClass(className); \
         LOG_FATAL_IF(! var, "Unable to find class " className);
@@ -1398,6 +1505,9 @@ int register_android_server_InputManager(JNIEnv* env) {
     int res = jniRegisterNativeMethods(env, "com/android/server/input/InputManagerService",
             gInputManagerMethods, NELEM(gInputManagerMethods));
     LOG_FATAL_IF(res < 0, "Unable to register native methods.");
+    AndroidRuntime::registerOptionalNativeMethods(env,
+            "com/android/server/input/InputManagerService",
+            gInputManagerOptionalMethods, NELEM(gInputManagerOptionalMethods));
 
     // Callbacks
 
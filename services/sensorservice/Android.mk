@@ -18,6 +18,7 @@ LOCAL_SRC_FILES:= \
 LOCAL_CFLAGS:= -DLOG_TAG=\"SensorService\"
 
 LOCAL_SHARED_LIBRARIES := \
+	libandroidfw \
 	libcutils \
 	libhardware \
 	libutils \
@@ -387,7 +387,18 @@ void Fusion::predict(const vec3_t& w, float dT) {
     Phi[0][0] = I33 - wx*(k1*ilwe) + wx2*k0;
     Phi[1][0] = wx*k0 - I33dT - wx2*(ilwe*ilwe*ilwe)*(lwedT-k1);
 
-    P = Phi*P*transpose(Phi) + GQGt;
+    // Phi's bottom row is | 0 1 |, so expand Phi*P*Phi^t into the blocks
+    // that actually change rather than doing the full 6x6 products.
+    const mat33_t& Phi00(Phi[0][0]);
+    const mat33_t& Phi10(Phi[1][0]);
+    const mat33_t Phi00t(transpose(Phi00));
+    const mat33_t Phi10t(transpose(Phi10));
+    const mat33_t P10(P[1][0]);
+    const mat33_t P01(P[0][1]);
+    P[1][0] = Phi00*P10 + Phi10*P[1][1];
+    P[0][0] = (Phi00*P[0][0] + Phi10*P01)*Phi00t + P[1][0]*Phi10t;
+    P[0][1] = P01*Phi00t + P[1][1]*Phi10t;
+    P += GQGt;
 
     checkState();
 }
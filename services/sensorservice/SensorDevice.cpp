@@ -14,10 +14,18 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <math.h>
 #include <sys/types.h>
 
+#include <cutils/properties.h>
+
 #include <utils/Atomic.h>
 #include <utils/Errors.h>
 #include <utils/Singleton.h>
@@ -31,9 +39,6 @@
 #include "SensorDevice.h"
 #include "SensorService.h"
 
-#ifdef SYSFS_LIGHT_SENSOR
-#include <fcntl.h>
-#endif
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -123,10 +128,28 @@ static ssize_t addDummyLightSensor(sensor_t const **list, ssize_t count) {
 }
 #endif
 
+static const uint32_t REPLAY_MAGIC = 0x4c505253; // 'SRPL'
+static const uint32_t REPLAY_VERSION = 1;
+
 SensorDevice::SensorDevice()
     :  mSensorDevice(0),
-       mSensorModule(0)
+       mSensorModule(0),
+       mRecordFd(-1),
+       mReplayFd(-1),
+       mReplaySpeed(1),
+       mReplayDataOffset(0),
+       mReplayHasNext(false),
+       mReplayStart(0),
+       mReplayFirst(0)
 {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sensors.replay", value, "");
+    if (value[0]) {
+        if (openReplay(value) == NO_ERROR) {
+            return;
+        }
+    }
+
     status_t err = hw_get_module(SENSORS_HARDWARE_MODULE_ID,
             (hw_module_t const**)&mSensorModule);
 
@@ -151,17 +174,190 @@ SensorDevice::SensorDevice()
                 mActivationCount.add(list[i].handle, model);
                 mSensorDevice->activate(mSensorDevice, list[i].handle, 0);
             }
+
+            property_get("debug.sensors.record", value, "");
+            if (value[0]) {
+                openRecord(value, list, count);
+            }
+        }
+    }
+}
+
+void SensorDevice::openRecord(const char* path, sensor_t const* list, size_t count)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        ALOGE("couldn't open sensor trace %s (%s)", path, strerror(errno));
+        return;
+    }
+    ReplayHeader header;
+    header.magic = REPLAY_MAGIC;
+    header.version = REPLAY_VERSION;
+    header.sensorCount = count;
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header);
+    for (size_t i=0 ; ok && i<count ; i++) {
+        ReplaySensor s;
+        memset(&s, 0, sizeof(s));
+        strncpy(s.name, list[i].name, sizeof(s.name) - 1);
+        strncpy(s.vendor, list[i].vendor, sizeof(s.vendor) - 1);
+        s.version = list[i].version;
+        s.handle = list[i].handle;
+        s.type = list[i].type;
+        s.maxRange = list[i].maxRange;
+        s.resolution = list[i].resolution;
+        s.power = list[i].power;
+        s.minDelay = list[i].minDelay;
+        ok = write(fd, &s, sizeof(s)) == sizeof(s);
+    }
+    if (!ok) {
+        ALOGE("couldn't write sensor trace %s (%s)", path, strerror(errno));
+        close(fd);
+        return;
+    }
+    ALOGD("recording sensor events to %s", path);
+    mRecordFd = fd;
+}
+
+status_t SensorDevice::openReplay(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("couldn't open sensor trace %s (%s)", path, strerror(errno));
+        return -errno;
+    }
+    ReplayHeader header;
+    if (read(fd, &header, sizeof(header)) != sizeof(header)
+            || header.magic != REPLAY_MAGIC || header.version != REPLAY_VERSION) {
+        ALOGE("%s is not a sensor trace", path);
+        close(fd);
+        return BAD_VALUE;
+    }
+
+    mReplaySensors.setCapacity(header.sensorCount);
+    for (size_t i=0 ; i<header.sensorCount ; i++) {
+        ReplaySensor s;
+        if (read(fd, &s, sizeof(s)) != sizeof(s)) {
+            ALOGE("truncated sensor trace %s", path);
+            mReplaySensors.clear();
+            close(fd);
+            return BAD_VALUE;
+        }
+        s.name[sizeof(s.name) - 1] = '\0';
+        s.vendor[sizeof(s.vendor) - 1] = '\0';
+        mReplaySensors.add(s);
+    }
+
+    // the strings point into mReplaySensors, which doesn't change anymore
+    mReplayList.setCapacity(header.sensorCount);
+    mActivationCount.setCapacity(header.sensorCount);
+    Info model;
+    for (size_t i=0 ; i<mReplaySensors.size() ; i++) {
+        const ReplaySensor& s(mReplaySensors[i]);
+        sensor_t sensor;
+        memset(&sensor, 0, sizeof(sensor));
+        sensor.name = s.name;
+        sensor.vendor = s.vendor;
+        sensor.version = s.version;
+        sensor.handle = s.handle;
+        sensor.type = s.type;
+        sensor.maxRange = s.maxRange;
+        sensor.resolution = s.resolution;
+        sensor.power = s.power;
+        sensor.minDelay = s.minDelay;
+        mReplayList.add(sensor);
+        mActivationCount.add(sensor.handle, model);
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sensors.replay.speed", value, "1");
+    mReplaySpeed = atof(value);
+    if (!(mReplaySpeed > 0)) {
+        mReplaySpeed = 1;
+    }
+    mReplayDataOffset = lseek(fd, 0, SEEK_CUR);
+    mReplayFd = fd;
+    if (!readReplayEvent()) {
+        ALOGE("sensor trace %s has no events", path);
+        mReplayFd = -1;
+        mReplayList.clear();
+        mActivationCount.clear();
+        close(fd);
+        return BAD_VALUE;
+    }
+    mReplayHasNext = true;
+    ALOGD("replaying sensor events from %s at %.1fx", path, mReplaySpeed);
+    return NO_ERROR;
+}
+
+bool SensorDevice::readReplayEvent()
+{
+    for (int attempt=0 ; attempt<2 ; attempt++) {
+        if (read(mReplayFd, &mReplayNext, sizeof(mReplayNext)) == sizeof(mReplayNext)) {
+            return true;
+        }
+        // end of the trace, start over
+        lseek(mReplayFd, mReplayDataOffset, SEEK_SET);
+        mReplayStart = 0;
+    }
+    return false;
+}
+
+ssize_t SensorDevice::pollReplay(sensors_event_t* buffer, size_t count)
+{
+    // Each event is due at its offset from the start of the trace divided
+    // by the replay speed, and is returned with that time as its
+    // timestamp. Like a real HAL, only events of active sensors are
+    // returned, and this blocks until at least one is due.
+    size_t n = 0;
+    while (n < count) {
+        if (!mReplayHasNext) {
+            if (!readReplayEvent()) {
+                ALOGE("couldn't read sensor trace (%s)", strerror(errno));
+                return n ? ssize_t(n) : ssize_t(NO_INIT);
+            }
+            mReplayHasNext = true;
+        }
+        const nsecs_t now = systemTime();
+        if (mReplayStart == 0) {
+            mReplayStart = now;
+            mReplayFirst = mReplayNext.timestamp;
+        }
+        const nsecs_t due = mReplayStart +
+                nsecs_t((mReplayNext.timestamp - mReplayFirst) / mReplaySpeed);
+        if (due > now) {
+            if (n) {
+                break;
+            }
+            struct timespec ts;
+            ts.tv_sec = (due - now) / 1000000000;
+            ts.tv_nsec = (due - now) % 1000000000;
+            nanosleep(&ts, NULL);
+        }
+        mReplayHasNext = false;
+
+        bool active;
+        { // scope for the lock
+            Mutex::Autolock _l(mLock);
+            ssize_t index = mActivationCount.indexOfKey(mReplayNext.sensor);
+            active = index >= 0 && mActivationCount.valueAt(index).rates.size();
+        }
+        if (active) {
+            buffer[n] = mReplayNext;
+            buffer[n].timestamp = due;
+            n++;
         }
     }
+    return n;
 }
 
 void SensorDevice::dump(String8& result, char* buffer, size_t SIZE)
 {
-    if (!mSensorModule) return;
     sensor_t const* list;
-    ssize_t count = mSensorModule->get_sensors_list(mSensorModule, &list);
+    ssize_t count = getSensorList(&list);
+    if (count < 0) return;
 
-    snprintf(buffer, SIZE, "%d h/w sensors:\n", int(count));
+    snprintf(buffer, SIZE, "%d h/w sensors%s:\n", int(count),
+            isReplaying() ? " (replayed)" : "");
     result.append(buffer);
 
     Mutex::Autolock _l(mLock);
@@ -183,6 +379,10 @@ void SensorDevice::dump(String8& result, char* buffer, size_t SIZE)
 }
 
 ssize_t SensorDevice::getSensorList(sensor_t const** list) {
+    if (isReplaying()) {
+        *list = mReplayList.array();
+        return mReplayList.size();
+    }
     if (!mSensorModule) return NO_INIT;
     ssize_t count = mSensorModule->get_sensors_list(mSensorModule, list);
 #ifdef SYSFS_LIGHT_SENSOR
@@ -193,21 +393,30 @@ ssize_t SensorDevice::getSensorList(sensor_t const** list) {
 }
 
 status_t SensorDevice::initCheck() const {
-    return mSensorDevice && mSensorModule ? NO_ERROR : NO_INIT;
+    return (mSensorDevice && mSensorModule) || isReplaying() ? NO_ERROR : NO_INIT;
 }
 
 ssize_t SensorDevice::poll(sensors_event_t* buffer, size_t count) {
+    if (isReplaying()) return pollReplay(buffer, count);
     if (!mSensorDevice) return NO_INIT;
     ssize_t c;
     do {
         c = mSensorDevice->poll(mSensorDevice, buffer, count);
     } while (c == -EINTR);
+    if (c > 0 && mRecordFd >= 0) {
+        const size_t size = c * sizeof(sensors_event_t);
+        if (write(mRecordFd, buffer, size) != ssize_t(size)) {
+            ALOGE("couldn't record sensor events (%s), stopping", strerror(errno));
+            close(mRecordFd);
+            mRecordFd = -1;
+        }
+    }
     return c;
 }
 
 status_t SensorDevice::activate(void* ident, int handle, int enabled)
 {
-    if (!mSensorDevice) return NO_INIT;
+    if (!mSensorDevice && !isReplaying()) return NO_INIT;
     status_t err(NO_ERROR);
     bool actuateHardware = false;
 
@@ -263,7 +472,7 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
         }
     }
 
-    if (actuateHardware) {
+    if (actuateHardware && mSensorDevice) {
         ALOGD_IF(DEBUG_CONNECTIONS, "\t>>> actuating h/w");
 
         err = mSensorDevice->activate(mSensorDevice, handle, enabled);
@@ -282,7 +491,9 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
     { // scope for the lock
         Mutex::Autolock _l(mLock);
         nsecs_t ns = info.selectDelay();
-        mSensorDevice->setDelay(mSensorDevice, handle, ns);
+        if (mSensorDevice) {
+            mSensorDevice->setDelay(mSensorDevice, handle, ns);
+        }
     }
 
     return err;
@@ -290,12 +501,13 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
 
 status_t SensorDevice::setDelay(void* ident, int handle, int64_t ns)
 {
-    if (!mSensorDevice) return NO_INIT;
+    if (!mSensorDevice && !isReplaying()) return NO_INIT;
     Mutex::Autolock _l(mLock);
     Info& info( mActivationCount.editValueFor(handle) );
     status_t err = info.setDelayForIdent(ident, ns);
     if (err < 0) return err;
     ns = info.selectDelay();
+    if (!mSensorDevice) return NO_ERROR;
     return mSensorDevice->setDelay(mSensorDevice, handle, ns);
 }
 
@@ -23,6 +23,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/Singleton.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include <gui/Sensor.h>
 
@@ -48,6 +49,46 @@ class SensorDevice : public Singleton<SensorDevice> {
     };
     DefaultKeyedVector<int, Info> mActivationCount;
 
+    // Trace recording and replay, for exercising the service without
+    // sensor hardware. Setting debug.sensors.record to a path records
+    // the HAL's sensor list and every polled event. Setting
+    // debug.sensors.replay to such a file replaces the HAL with the
+    // trace, played back in a loop at debug.sensors.replay.speed
+    // (default 1) times its original pace. A trace is a ReplayHeader,
+    // then sensorCount ReplaySensor entries, then raw sensors_event_t
+    // records.
+    struct ReplayHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sensorCount;
+    };
+    struct ReplaySensor {
+        char name[64];
+        char vendor[64];
+        int32_t version;
+        int32_t handle;
+        int32_t type;
+        float maxRange;
+        float resolution;
+        float power;
+        int32_t minDelay;
+    };
+    int mRecordFd;
+    int mReplayFd;
+    float mReplaySpeed;
+    off_t mReplayDataOffset;        // where the events start in the trace
+    Vector<sensor_t> mReplayList;
+    Vector<ReplaySensor> mReplaySensors;  // storage for mReplayList's strings
+    sensors_event_t mReplayNext;
+    bool mReplayHasNext;
+    nsecs_t mReplayStart;           // when the current pass began
+    nsecs_t mReplayFirst;           // trace timestamp of the first event
+
+    void openRecord(const char* path, sensor_t const* list, size_t count);
+    status_t openReplay(const char* path);
+    ssize_t pollReplay(sensors_event_t* buffer, size_t count);
+    bool readReplayEvent();
+
     SensorDevice();
 public:
     ssize_t getSensorList(sensor_t const** list);
@@ -56,6 +97,7 @@ public:
     status_t activate(void* ident, int handle, int enabled);
     status_t setDelay(void* ident, int handle, int64_t ns);
     void dump(String8& result, char* buffer, size_t SIZE);
+    bool isReplaying() const { return mReplayFd >= 0; }
 };
 
 // ---------------------------------------------------------------------------
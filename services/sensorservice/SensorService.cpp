@@ -14,10 +14,16 @@
  * limitations under the License.
  */
 
+// There is no sensor trace tag; sensors are traced as an input source.
+#define ATRACE_TAG ATRACE_TAG_INPUT
+
 #include <stdint.h>
 #include <math.h>
+#include <string.h>
 #include <sys/types.h>
+#include <time.h>
 
+#include <cutils/atomic-inline.h>
 #include <cutils/properties.h>
 
 #include <utils/SortedVector.h>
@@ -28,6 +34,10 @@
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <androidfw/StallDetector.h>
 
 #include <binder/BinderService.h>
 #include <binder/IServiceManager.h>
@@ -61,8 +71,15 @@ namespace android {
  */
 
 SensorService::SensorService()
-    : mInitCheck(NO_INIT)
+    : mInitCheck(NO_INIT), mPollThreadCpuTime(0)
+{
+}
+
+static nsecs_t threadCpuTime()
 {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return nsecs_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
 }
 
 void SensorService::onFirstRef()
@@ -82,6 +99,7 @@ void SensorService::onFirstRef()
                     (1<<SENSOR_TYPE_LINEAR_ACCELERATION) |
                     (1<<SENSOR_TYPE_ROTATION_VECTOR);
 
+            mLastEventIndex.setCapacity(count);
             mLastEventSeen.setCapacity(count);
             for (ssize_t i=0 ; i<count ; i++) {
                 registerSensor( new HardwareSensor(list[i]) );
@@ -145,6 +163,11 @@ void SensorService::onFirstRef()
                 }
             }
 
+            if (mVirtualSensorList.size()) {
+                mVirtualSensorThread = new VirtualSensorThread(this);
+                mVirtualSensorThread->run("SensorServiceVirtual",
+                        PRIORITY_URGENT_DISPLAY);
+            }
             run("SensorService", PRIORITY_URGENT_DISPLAY);
             mInitCheck = NO_ERROR;
         }
@@ -153,8 +176,8 @@ void SensorService::onFirstRef()
 
 void SensorService::registerSensor(SensorInterface* s)
 {
-    sensors_event_t event;
-    memset(&event, 0, sizeof(event));
+    LastEvent last;
+    memset(&last, 0, sizeof(last));
 
     const Sensor sensor(s->getSensor());
     // add to the sensor list (returned to clients)
@@ -162,7 +185,7 @@ void SensorService::registerSensor(SensorInterface* s)
     // add to our handle->SensorInterface mapping
     mSensorMap.add(sensor.getHandle(), s);
     // create an entry in the mLastEventSeen array
-    mLastEventSeen.add(sensor.getHandle(), event);
+    mLastEventIndex.add(sensor.getHandle(), mLastEventSeen.add(last));
 }
 
 void SensorService::registerVirtualSensor(SensorInterface* s)
@@ -191,37 +214,75 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
                 IPCThreadState::self()->getCallingUid());
         result.append(buffer);
     } else {
-        Mutex::Autolock _l(mLock);
-        snprintf(buffer, SIZE, "Sensor List:\n");
-        result.append(buffer);
-        for (size_t i=0 ; i<mSensorList.size() ; i++) {
-            const Sensor& s(mSensorList[i]);
-            const sensors_event_t& e(mLastEventSeen.valueFor(s.getHandle()));
-            snprintf(buffer, SIZE,
-                    "%-48s| %-32s | 0x%08x | maxRate=%7.2fHz | "
-                    "last=<%5.1f,%5.1f,%5.1f>\n",
-                    s.getName().string(),
-                    s.getVendor().string(),
-                    s.getHandle(),
-                    s.getMinDelay() ? (1000000.0f / s.getMinDelay()) : 0.0f,
-                    e.data[0], e.data[1], e.data[2]);
+        {
+            Mutex::Autolock _l(mLock);
+            snprintf(buffer, SIZE, "Sensor List:\n");
             result.append(buffer);
-        }
-        SensorFusion::getInstance().dump(result, buffer, SIZE);
-        SensorDevice::getInstance().dump(result, buffer, SIZE);
+            uint32_t polled = 0;
+            uint32_t synthesized = 0;
+            for (size_t i=0 ; i<mSensorList.size() ; i++) {
+                const Sensor& s(mSensorList[i]);
+                sensors_event_t e;
+                getLastEvent(s.getHandle(), &e);
+                const uint32_t events = getEventCount(s.getHandle());
+                snprintf(buffer, SIZE,
+                        "%-48s| %-32s | 0x%08x | maxRate=%7.2fHz | "
+                        "last=<%5.1f,%5.1f,%5.1f> | events=%u\n",
+                        s.getName().string(),
+                        s.getVendor().string(),
+                        s.getHandle(),
+                        s.getMinDelay() ? (1000000.0f / s.getMinDelay()) : 0.0f,
+                        e.data[0], e.data[1], e.data[2], events);
+                result.append(buffer);
+                SensorInterface* si = mSensorMap.valueFor(s.getHandle());
+                if (si && si->isVirtual()) {
+                    synthesized += events;
+                } else {
+                    polled += events;
+                }
+            }
+            snprintf(buffer, SIZE, "%u events polled, %u events synthesized\n",
+                    polled, synthesized);
+            result.append(buffer);
+            const nsecs_t pollCpu = mPollThreadCpuTime;
+            snprintf(buffer, SIZE, "poll thread cpu: %lldms (%.1fus per polled event)\n",
+                    pollCpu / 1000000, polled ? pollCpu / 1000.0f / polled : 0.0f);
+            result.append(buffer);
+            if (mVirtualSensorThread != 0) {
+                const nsecs_t virtualCpu = mVirtualSensorThread->getCpuTime();
+                snprintf(buffer, SIZE, "virtual sensor thread cpu: %lldms "
+                        "(%.1fus per synthesized event)\n", virtualCpu / 1000000,
+                        synthesized ? virtualCpu / 1000.0f / synthesized : 0.0f);
+                result.append(buffer);
+            }
+            SensorFusion::getInstance().dump(result, buffer, SIZE);
+            SensorDevice::getInstance().dump(result, buffer, SIZE);
 
-        snprintf(buffer, SIZE, "%d active connections\n",
-                mActiveConnections.size());
-        result.append(buffer);
-        snprintf(buffer, SIZE, "Active sensors:\n");
-        result.append(buffer);
-        for (size_t i=0 ; i<mActiveSensors.size() ; i++) {
-            int handle = mActiveSensors.keyAt(i);
-            snprintf(buffer, SIZE, "%s (handle=0x%08x, connections=%d)\n",
-                    getSensorName(handle).string(),
-                    handle,
-                    mActiveSensors.valueAt(i)->getNumConnections());
+            snprintf(buffer, SIZE, "%d active connections\n",
+                    mActiveConnections.size());
+            result.append(buffer);
+            snprintf(buffer, SIZE, "Active sensors:\n");
             result.append(buffer);
+            for (size_t i=0 ; i<mActiveSensors.size() ; i++) {
+                int handle = mActiveSensors.keyAt(i);
+                snprintf(buffer, SIZE, "%s (handle=0x%08x, connections=%d)\n",
+                        getSensorName(handle).string(),
+                        handle,
+                        mActiveSensors.valueAt(i)->getNumConnections());
+                result.append(buffer);
+            }
+        }
+        // Connections are promoted outside of mLock: dropping the last
+        // reference to one unregisters it, which takes mLock.
+        const SortedVector< wp<SensorEventConnection> > activeConnections(
+                getActiveConnections());
+        snprintf(buffer, SIZE, "Active connections:\n");
+        result.append(buffer);
+        for (size_t i=0 ; i<activeConnections.size() ; i++) {
+            sp<SensorEventConnection> connection(activeConnections[i].promote());
+            if (connection != 0) {
+                connection->dump(result);
+            }
         }
     }
     write(fd, result.string(), result.size());
@@ -233,79 +294,39 @@ bool SensorService::threadLoop()
     ALOGD("nuSensorService thread starting...");
 
     const size_t numEventMax = 16;
-    const size_t minBufferSize = numEventMax + numEventMax * mVirtualSensorList.size();
-    sensors_event_t buffer[minBufferSize];
-    sensors_event_t scratch[minBufferSize];
+    sensors_event_t buffer[numEventMax];
+    sensors_event_t scratch[numEventMax];
     SensorDevice& device(SensorDevice::getInstance());
-    const size_t vcount = mVirtualSensorList.size();
+    StallDetector::registerThread("SensorService");
 
     ssize_t count;
     do {
+        StallDetector::endWork();
         count = device.poll(buffer, numEventMax);
+        StallDetector::beginWork();
         if (count<0) {
             ALOGE("sensor poll failed (%s)", strerror(-count));
             break;
         }
 
+        if (ATRACE_ENABLED()) {
+            ATRACE_INT("sensorEventsPolled", count);
+        }
+
         recordLastValue(buffer, count);
 
-        // handle virtual sensors
-        if (count && vcount) {
-            sensors_event_t const * const event = buffer;
-            const DefaultKeyedVector<int, SensorInterface*> virtualSensors(
-                    getActiveVirtualSensors());
-            const size_t activeVirtualSensorCount = virtualSensors.size();
-            if (activeVirtualSensorCount) {
-                size_t k = 0;
-                SensorFusion& fusion(SensorFusion::getInstance());
-                if (fusion.isEnabled()) {
-                    for (size_t i=0 ; i<size_t(count) ; i++) {
-                        fusion.process(event[i]);
-                    }
-                }
-                RotationVectorSensor2& rv2(RotationVectorSensor2::getInstance());
-                if (rv2.isEnabled()) {
-                    for (size_t i=0 ; i<size_t(count) ; i++) {
-                        rv2.process(event[i]);
-                    }
-                }
-                for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
-                    for (size_t j=0 ; j<activeVirtualSensorCount ; j++) {
-                        if (count + k >= minBufferSize) {
-                            ALOGE("buffer too small to hold all events: "
-                                    "count=%ld, k=%ld, size=%ld",
-                                    count, k, minBufferSize);
-                            break;
-                        }
-                        sensors_event_t out;
-                        SensorInterface* si = virtualSensors.valueAt(j);
-                        if (si->process(&out, event[i])) {
-                            buffer[count + k] = out;
-                            k++;
-                        }
-                    }
-                }
-                if (k) {
-                    // record the last synthesized values
-                    recordLastValue(&buffer[count], k);
-                    count += k;
-                    // sort the buffer by time-stamps
-                    sortEventBuffer(buffer, count);
-                }
-            }
-        }
+        // send our events to clients first, then hand them to the virtual
+        // sensors which deliver their own output from their thread.
+        sendEventsToConnections(buffer, count, scratch);
 
-        // send our events to clients...
-        const SortedVector< wp<SensorEventConnection> > activeConnections(
-                getActiveConnections());
-        size_t numConnections = activeConnections.size();
-        for (size_t i=0 ; i<numConnections ; i++) {
-            sp<SensorEventConnection> connection(
-                    activeConnections[i].promote());
-            if (connection != 0) {
-                connection->sendEvents(buffer, count, scratch);
-            }
+        if (count && mVirtualSensorThread != 0 && hasActiveVirtualSensors()) {
+            size_t queued = mVirtualSensorThread->enqueue(buffer, count);
+            ALOGW_IF(queued < size_t(count),
+                    "virtual sensors falling behind, dropped %d events",
+                    int(count - queued));
         }
+
+        mPollThreadCpuTime = threadCpuTime();
     } while (count >= 0 || Thread::exitPending());
 
     ALOGW("Exiting SensorService::threadLoop => aborting...");
@@ -313,34 +334,184 @@ bool SensorService::threadLoop()
     return false;
 }
 
+void SensorService::processVirtualSensors(sensors_event_t const* event, size_t count,
+        sensors_event_t* buffer, sensors_event_t* scratch, size_t bufferSize)
+{
+    const DefaultKeyedVector<int, SensorInterface*> virtualSensors(
+            getActiveVirtualSensors());
+    const size_t activeVirtualSensorCount = virtualSensors.size();
+    if (!activeVirtualSensorCount) {
+        return;
+    }
+
+    SensorFusion& fusion(SensorFusion::getInstance());
+    if (fusion.isEnabled()) {
+        for (size_t i=0 ; i<count ; i++) {
+            fusion.process(event[i]);
+        }
+    }
+    RotationVectorSensor2& rv2(RotationVectorSensor2::getInstance());
+    if (rv2.isEnabled()) {
+        for (size_t i=0 ; i<count ; i++) {
+            rv2.process(event[i]);
+        }
+    }
+
+    // each virtual sensor's output is produced as its own run, which is
+    // time-ordered as long as the HAL reported the events in order
+    size_t runs[activeVirtualSensorCount + 1];
+    size_t numRuns = 0;
+    size_t k = 0;
+    for (size_t j=0 ; j<activeVirtualSensorCount && k<bufferSize ; j++) {
+        SensorInterface* si = virtualSensors.valueAt(j);
+        const size_t start = k;
+        bool ordered = true;
+        for (size_t i=0 ; i<count ; i++) {
+            if (k >= bufferSize) {
+                ALOGE("buffer too small to hold all events: "
+                        "count=%d, k=%d, size=%d",
+                        int(count), int(k), int(bufferSize));
+                break;
+            }
+            sensors_event_t out;
+            if (si->process(&out, event[i])) {
+                if (k > start && out.timestamp < buffer[k-1].timestamp) {
+                    ordered = false;
+                }
+                buffer[k] = out;
+                k++;
+            }
+        }
+        if (k > start) {
+            if (!ordered) {
+                // the HAL doesn't guarantee the order of events across
+                // sensors; the merge below needs every run sorted
+                sortEventRun(buffer + start, k - start);
+            }
+            runs[numRuns++] = start;
+        }
+    }
+    if (k) {
+        // record the last synthesized values
+        recordLastValue(buffer, k);
+        sensors_event_t* events = buffer;
+        if (numRuns > 1) {
+            // merge the runs by time-stamps
+            runs[numRuns] = k;
+            mergeEventRuns(buffer, runs, numRuns, scratch);
+            events = scratch;
+            scratch = buffer;
+        }
+        sendEventsToConnections(events, k, scratch);
+    }
+}
+
+void SensorService::sendEventsToConnections(sensors_event_t const* events,
+        size_t count, sensors_event_t* scratch)
+{
+    const SortedVector< wp<SensorEventConnection> > activeConnections(
+            getActiveConnections());
+    size_t numConnections = activeConnections.size();
+    for (size_t i=0 ; i<numConnections ; i++) {
+        sp<SensorEventConnection> connection(
+                activeConnections[i].promote());
+        if (connection != 0) {
+            connection->sendEvents(events, count, scratch);
+        }
+    }
+}
+
 void SensorService::recordLastValue(
         sensors_event_t const * buffer, size_t count)
 {
-    Mutex::Autolock _l(mLock);
-
     // record the last event for each sensor
-    int32_t prev = buffer[0].sensor;
-    for (size_t i=1 ; i<count ; i++) {
+    size_t start = 0;
+    for (size_t i=0 ; i<count ; i++) {
         // record the last event of each sensor type in this buffer
-        int32_t curr = buffer[i].sensor;
-        if (curr != prev) {
-            mLastEventSeen.editValueFor(prev) = buffer[i-1];
-            prev = curr;
+        const int32_t curr = buffer[i].sensor;
+        if (i+1 == count || buffer[i+1].sensor != curr) {
+            ssize_t index = mLastEventIndex.indexOfKey(curr);
+            if (index >= 0) {
+                storeLastEvent(mLastEventIndex.valueAt(index), buffer[i], i+1 - start);
+            }
+            start = i+1;
         }
     }
-    mLastEventSeen.editValueFor(prev) = buffer[count-1];
 }
 
-void SensorService::sortEventBuffer(sensors_event_t* buffer, size_t count)
+void SensorService::storeLastEvent(size_t index, const sensors_event_t& event,
+        size_t count)
+{
+    // each slot is only written from one thread, see mLastEventSeen
+    LastEvent& last(mLastEventSeen.editItemAt(index));
+    last.count += count;
+    last.seq++;
+    android_memory_barrier();
+    last.event = event;
+    android_memory_barrier();
+    last.seq++;
+}
+
+bool SensorService::getLastEvent(int32_t handle, sensors_event_t* outEvent) const
+{
+    ssize_t index = mLastEventIndex.indexOfKey(handle);
+    if (index < 0) {
+        return false;
+    }
+    const LastEvent& last(mLastEventSeen[mLastEventIndex.valueAt(index)]);
+    int32_t seq;
+    do {
+        seq = last.seq;
+        android_memory_barrier();
+        *outEvent = last.event;
+        android_memory_barrier();
+    } while ((seq & 1) || seq != last.seq);
+    return true;
+}
+
+uint32_t SensorService::getEventCount(int32_t handle) const
 {
-    struct compar {
-        static int cmp(void const* lhs, void const* rhs) {
-            sensors_event_t const* l = static_cast<sensors_event_t const*>(lhs);
-            sensors_event_t const* r = static_cast<sensors_event_t const*>(rhs);
-            return l->timestamp - r->timestamp;
+    ssize_t index = mLastEventIndex.indexOfKey(handle);
+    return index >= 0 ? mLastEventSeen[mLastEventIndex.valueAt(index)].count : 0;
+}
+
+void SensorService::mergeEventRuns(sensors_event_t const* in,
+        size_t const* runs, size_t numRuns, sensors_event_t* out)
+{
+    // runs[r] is where the r-th time-ordered run of "in" starts, and
+    // runs[numRuns] is where the last one ends. There are only a handful
+    // of runs, so a linear scan for the earliest head is cheapest. Ties go
+    // to the earlier run.
+    size_t heads[numRuns];
+    for (size_t r=0 ; r<numRuns ; r++) {
+        heads[r] = runs[r];
+    }
+    const size_t total = runs[numRuns];
+    for (size_t n=0 ; n<total ; n++) {
+        size_t best = numRuns;
+        for (size_t r=0 ; r<numRuns ; r++) {
+            if (heads[r] < runs[r+1] && (best == numRuns ||
+                    in[heads[r]].timestamp < in[heads[best]].timestamp)) {
+                best = r;
+            }
         }
-    };
-    qsort(buffer, count, sizeof(sensors_event_t), compar::cmp);
+        out[n] = in[heads[best]++];
+    }
+}
+
+void SensorService::sortEventRun(sensors_event_t* events, size_t count)
+{
+    // Out of order events are rare and usually only a few places off, so
+    // a stable insertion sort is close to linear here.
+    for (size_t i=1 ; i<count ; i++) {
+        const sensors_event_t e = events[i];
+        size_t j = i;
+        while (j > 0 && e.timestamp < events[j-1].timestamp) {
+            events[j] = events[j-1];
+            j--;
+        }
+        events[j] = e;
+    }
 }
 
 SortedVector< wp<SensorService::SensorEventConnection> >
@@ -357,6 +528,86 @@ SensorService::getActiveVirtualSensors() const
     return mActiveVirtualSensors;
 }
 
+bool SensorService::hasActiveVirtualSensors() const
+{
+    Mutex::Autolock _l(mLock);
+    return mActiveVirtualSensors.size() != 0;
+}
+
+// ---------------------------------------------------------------------------
+
+SensorService::VirtualSensorThread::VirtualSensorThread(SensorService* service)
+    : Thread(false), mService(service),
+      mQueueHead(0), mQueueTail(0), mWaiting(0), mCpuTime(0)
+{
+}
+
+size_t SensorService::VirtualSensorThread::enqueue(
+        sensors_event_t const* events, size_t count)
+{
+    // only the poll thread writes mQueueTail
+    const uint32_t head = uint32_t(android_atomic_acquire_load(&mQueueHead));
+    const uint32_t tail = uint32_t(mQueueTail);
+    const size_t room = QUEUE_SIZE - (tail - head);
+    if (count > room) {
+        count = room;
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        mQueue[(tail + i) & (QUEUE_SIZE - 1)] = events[i];
+    }
+    android_atomic_release_store(int32_t(tail + count), &mQueueTail);
+
+    // pairs with the barrier in dequeue(), so that either we see mWaiting
+    // or the virtual sensor thread sees the new tail before sleeping
+    android_memory_barrier();
+    if (mWaiting) {
+        Mutex::Autolock _l(mLock);
+        mCondition.signal();
+    }
+    return count;
+}
+
+size_t SensorService::VirtualSensorThread::dequeue(
+        sensors_event_t* events, size_t max)
+{
+    // only this thread writes mQueueHead
+    const uint32_t head = uint32_t(mQueueHead);
+    uint32_t tail = uint32_t(android_atomic_acquire_load(&mQueueTail));
+    if (tail == head) {
+        Mutex::Autolock _l(mLock);
+        mWaiting = 1;
+        android_memory_barrier();
+        while ((tail = uint32_t(android_atomic_acquire_load(&mQueueTail))) == head) {
+            mCondition.wait(mLock);
+        }
+        mWaiting = 0;
+    }
+    size_t count = tail - head;
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        events[i] = mQueue[(head + i) & (QUEUE_SIZE - 1)];
+    }
+    android_atomic_release_store(int32_t(head + count), &mQueueHead);
+    return count;
+}
+
+bool SensorService::VirtualSensorThread::threadLoop()
+{
+    const size_t numEventMax = 16;
+    const size_t bufferSize = numEventMax * mService->mVirtualSensorList.size();
+    sensors_event_t input[numEventMax];
+    sensors_event_t buffer[bufferSize];
+    sensors_event_t scratch[bufferSize];
+    do {
+        size_t count = dequeue(input, numEventMax);
+        mService->processVirtualSensors(input, count, buffer, scratch, bufferSize);
+        mCpuTime = threadCpuTime();
+    } while (!exitPending());
+    return false;
+}
+
 String8 SensorService::getSensorName(int handle) const {
     size_t count = mUserSensorList.size();
     for (size_t i=0 ; i<count ; i++) {
@@ -439,9 +690,9 @@ status_t SensorService::enable(const sp<SensorEventConnection>& connection,
                 // known value of the requested sensor if it's not a
                 // "continuous" sensor.
                 if (sensor->getSensor().getMinDelay() == 0) {
-                    sensors_event_t scratch;
-                    sensors_event_t& event(mLastEventSeen.editValueFor(handle));
-                    if (event.version == sizeof(sensors_event_t)) {
+                    sensors_event_t event;
+                    if (getLastEvent(handle, &event) &&
+                            event.version == sizeof(sensors_event_t)) {
                         connection->sendEvents(&event, 1);
                     }
                 }
@@ -509,6 +760,12 @@ status_t SensorService::setEventRate(const sp<SensorEventConnection>& connection
     if (ns < MINIMUM_EVENTS_PERIOD)
         ns = MINIMUM_EVENTS_PERIOD;
 
+    // The sensor runs at the fastest rate any client asks for; continuous
+    // sensors are decimated back to this client's own rate when sending.
+    if (sensor->getSensor().getMinDelay() != 0) {
+        connection->setEventPeriod(handle, ns);
+    }
+
     return sensor->setDelay(connection.get(), handle, ns);
 }
 
@@ -544,7 +801,8 @@ bool SensorService::SensorRecord::removeConnection(
 
 SensorService::SensorEventConnection::SensorEventConnection(
         const sp<SensorService>& service)
-    : mService(service), mChannel(new BitTube())
+    : mService(service), mChannel(new BitTube()),
+      mEventsDelivered(0), mEventsDropped(0), mStalled(false)
 {
 }
 
@@ -560,8 +818,8 @@ void SensorService::SensorEventConnection::onFirstRef()
 
 bool SensorService::SensorEventConnection::addSensor(int32_t handle) {
     Mutex::Autolock _l(mConnectionLock);
-    if (mSensorInfo.indexOf(handle) <= 0) {
-        mSensorInfo.add(handle);
+    if (mSensorInfo.indexOfKey(handle) < 0) {
+        mSensorInfo.add(handle, SensorInfo());
         return true;
     }
     return false;
@@ -569,7 +827,7 @@ bool SensorService::SensorEventConnection::addSensor(int32_t handle) {
 
 bool SensorService::SensorEventConnection::removeSensor(int32_t handle) {
     Mutex::Autolock _l(mConnectionLock);
-    if (mSensorInfo.remove(handle) >= 0) {
+    if (mSensorInfo.removeItem(handle) >= 0) {
         return true;
     }
     return false;
@@ -577,7 +835,36 @@ bool SensorService::SensorEventConnection::removeSensor(int32_t handle) {
 
 bool SensorService::SensorEventConnection::hasSensor(int32_t handle) const {
     Mutex::Autolock _l(mConnectionLock);
-    return mSensorInfo.indexOf(handle) >= 0;
+    return mSensorInfo.indexOfKey(handle) >= 0;
+}
+
+void SensorService::SensorEventConnection::setEventPeriod(int32_t handle, nsecs_t ns) {
+    Mutex::Autolock _l(mConnectionLock);
+    ssize_t index = mSensorInfo.indexOfKey(handle);
+    if (index >= 0) {
+        mSensorInfo.editValueAt(index).period = ns;
+    }
+}
+
+bool SensorService::SensorEventConnection::SensorInfo::accept(nsecs_t timestamp) {
+    // Allow some jitter, so that a sensor already running at this
+    // connection's rate is not decimated to half of it.
+    if (period == 0 || timestamp - acceptedTimestamp >= period - period/8) {
+        acceptedTimestamp = timestamp;
+        return true;
+    }
+    return false;
+}
+
+void SensorService::SensorEventConnection::commitAcceptedLocked(bool delivered) {
+    for (size_t i=0 ; i<mSensorInfo.size() ; i++) {
+        SensorInfo& info(mSensorInfo.editValueAt(i));
+        if (delivered) {
+            info.lastTimestamp = info.acceptedTimestamp;
+        } else {
+            info.acceptedTimestamp = info.lastTimestamp;
+        }
+    }
 }
 
 bool SensorService::SensorEventConnection::hasAnySensor() const {
@@ -589,39 +876,140 @@ status_t SensorService::SensorEventConnection::sendEvents(
         sensors_event_t const* buffer, size_t numEvents,
         sensors_event_t* scratch)
 {
-    // filter out events not for this connection
+    // filter out events not for this connection, or faster than it asked
+    // for. Events are only copied into scratch once one has been dropped;
+    // until then the accepted events are a prefix of buffer.
+    sensors_event_t const* events = buffer;
     size_t count = 0;
     if (scratch) {
         Mutex::Autolock _l(mConnectionLock);
+        if (mStalled) {
+            return resumeStalledLocked();
+        }
+        bool filtered = false;
         size_t i=0;
         while (i<numEvents) {
             const int32_t curr = buffer[i].sensor;
-            if (mSensorInfo.indexOf(curr) >= 0) {
-                do {
-                    scratch[count++] = buffer[i++];
-                } while ((i<numEvents) && (buffer[i].sensor == curr));
-            } else {
+            const ssize_t index = mSensorInfo.indexOfKey(curr);
+            SensorInfo* info = index >= 0 ? &mSensorInfo.editValueAt(index) : NULL;
+            do {
+                if (info && info->accept(buffer[i].timestamp)) {
+                    if (filtered) {
+                        scratch[count] = buffer[i];
+                    }
+                    count++;
+                } else if (!filtered) {
+                    memcpy(scratch, buffer, count * sizeof(sensors_event_t));
+                    filtered = true;
+                }
                 i++;
-            }
+            } while ((i<numEvents) && (buffer[i].sensor == curr));
+        }
+        if (filtered) {
+            events = scratch;
         }
     } else {
-        scratch = const_cast<sensors_event_t *>(buffer);
         count = numEvents;
     }
 
+    if (count == 0) {
+        // nothing for this connection, don't wake it up
+        return NO_ERROR;
+    }
+
     // NOTE: ASensorEvent and sensors_event_t are the same type
     ssize_t size = SensorEventQueue::write(mChannel,
-            reinterpret_cast<ASensorEvent const*>(scratch), count);
+            reinterpret_cast<ASensorEvent const*>(events), count);
+    {
+        Mutex::Autolock _l(mConnectionLock);
+        recordWriteLocked(events, count, size);
+        if (scratch) {
+            // events that didn't go through must not decimate the next ones
+            commitAcceptedLocked(size >= 0);
+            if (size == -EAGAIN) {
+                mStalled = true;
+            }
+        }
+    }
     if (size == -EAGAIN) {
         // the destination doesn't accept events anymore, it's probably
-        // full. For now, we just drop the events on the floor.
-        //ALOGW("dropping %d events on the floor", count);
+        // full. The events are dropped, counted in recordWriteLocked, and
+        // until the client catches up it only gets the latest values.
         return size;
     }
 
     return size < 0 ? status_t(size) : status_t(NO_ERROR);
 }
 
+status_t SensorService::SensorEventConnection::resumeStalledLocked()
+{
+    // While the client isn't reading, don't filter every batch for it:
+    // only try to hand it the newest value of each of its sensors, taken
+    // from the last-value store, and go back to normal delivery once that
+    // goes through.
+    const size_t numSensors = mSensorInfo.size();
+    sensors_event_t latest[numSensors ? numSensors : 1];
+    size_t count = 0;
+    for (size_t i=0 ; i<numSensors ; i++) {
+        sensors_event_t& event(latest[count]);
+        if (mService->getLastEvent(mSensorInfo.keyAt(i), &event) &&
+                event.version == sizeof(sensors_event_t) &&
+                event.timestamp > mSensorInfo.valueAt(i).lastTimestamp) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        return NO_ERROR;
+    }
+
+    ssize_t size = SensorEventQueue::write(mChannel,
+            reinterpret_cast<ASensorEvent const*>(latest), count);
+    if (size < 0) {
+        return status_t(size);
+    }
+    mStalled = false;
+    for (size_t i=0 ; i<count ; i++) {
+        ssize_t index = mSensorInfo.indexOfKey(latest[i].sensor);
+        if (index >= 0) {
+            SensorInfo& info(mSensorInfo.editValueAt(index));
+            info.lastTimestamp = latest[i].timestamp;
+            info.acceptedTimestamp = latest[i].timestamp;
+        }
+    }
+    recordWriteLocked(latest, count, size);
+    return NO_ERROR;
+}
+
+void SensorService::SensorEventConnection::recordWriteLocked(
+        sensors_event_t const* events, size_t count, ssize_t result)
+{
+    if (result < 0) {
+        mEventsDropped += count;
+        if (ATRACE_ENABLED()) {
+            char counterName[40];
+            snprintf(counterName, sizeof(counterName), "sensorDrops:%p", this);
+            ATRACE_INT(counterName, mEventsDropped);
+        }
+        return;
+    }
+    mEventsDelivered += count;
+    // sensor timestamps use the same clock as systemTime()
+    const nsecs_t now = systemTime();
+    for (size_t i=0 ; i<count ; i++) {
+        mDeliveryLatency.add(now - events[i].timestamp);
+    }
+}
+
+void SensorService::SensorEventConnection::dump(String8& result) const
+{
+    Mutex::Autolock _l(mConnectionLock);
+    result.appendFormat("  connection %p: %d sensors, %u events delivered, "
+            "%u dropped%s\n",
+            this, mSensorInfo.size(), mEventsDelivered, mEventsDropped,
+            mStalled ? ", stalled" : "");
+    mDeliveryLatency.dump(result, "    ", "delivery latency");
+}
+
 sp<BitTube> SensorService::SensorEventConnection::getSensorChannel() const
 {
     return mChannel;
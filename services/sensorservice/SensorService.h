@@ -26,6 +26,8 @@
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 
+#include <androidfw/LatencyHistogram.h>
+
 #include <binder/BinderService.h>
 
 #include <gui/Sensor.h>
@@ -67,7 +69,6 @@ class SensorService :
     virtual sp<ISensorEventConnection> createSensorEventConnection();
     virtual status_t dump(int fd, const Vector<String16>& args);
 
-
     class SensorEventConnection : public BnSensorEventConnection {
         virtual ~SensorEventConnection();
         virtual void onFirstRef();
@@ -79,8 +80,35 @@ class SensorService :
         sp<BitTube> const mChannel;
         mutable Mutex mConnectionLock;
 
-        // protected by SensorService::mLock
-        SortedVector<int> mSensorInfo;
+        struct SensorInfo {
+            // Minimum time between events delivered to this connection, or
+            // 0 to deliver every event the sensor produces.
+            nsecs_t period;
+            nsecs_t lastTimestamp;  // of the last event delivered
+            nsecs_t acceptedTimestamp;  // of the last event accepted for writing
+            SensorInfo() : period(0), lastTimestamp(0), acceptedTimestamp(0) { }
+            bool accept(nsecs_t timestamp);
+        };
+
+        // protected by mConnectionLock
+        KeyedVector<int, SensorInfo> mSensorInfo;
+
+        // statistics, protected by mConnectionLock
+        uint32_t mEventsDelivered;
+        uint32_t mEventsDropped;
+        LatencyHistogram mDeliveryLatency;  // HAL timestamp until written to the channel
+
+        void recordWriteLocked(sensors_event_t const* events, size_t count,
+                ssize_t result);
+
+        // Makes the events accepted since the last write count as delivered,
+        // or forgets them if the write failed.
+        void commitAcceptedLocked(bool delivered);
+
+        // Set when the channel was full; only the latest value of each
+        // sensor is offered until the client reads again.
+        bool mStalled;
+        status_t resumeStalledLocked();
 
     public:
         SensorEventConnection(const sp<SensorService>& service);
@@ -91,6 +119,8 @@ class SensorService :
         bool hasAnySensor() const;
         bool addSensor(int32_t handle);
         bool removeSensor(int32_t handle);
+        void setEventPeriod(int32_t handle, nsecs_t ns);
+        void dump(String8& result) const;
     };
 
     class SensorRecord {
@@ -102,12 +132,47 @@ class SensorService :
         size_t getNumConnections() const { return mConnections.size(); }
     };
 
+    // Runs sensor fusion and the virtual sensors off the poll thread, so
+    // computing them doesn't delay raw events. Hardware events are handed
+    // over through a single-producer single-consumer ring.
+    class VirtualSensorThread : public Thread {
+        enum { QUEUE_SIZE = 256 };  // must be a power of 2
+
+        SensorService* const mService;
+        sensors_event_t mQueue[QUEUE_SIZE];
+        volatile int32_t mQueueHead;    // next event to read, written by this thread
+        volatile int32_t mQueueTail;    // next event to write, written by the poll thread
+        volatile int32_t mWaiting;      // set while this thread waits for events
+        volatile nsecs_t mCpuTime;      // this thread's cpu time, for dump
+        Mutex mLock;
+        Condition mCondition;
+
+        virtual bool threadLoop();
+        size_t dequeue(sensors_event_t* events, size_t max);
+
+    public:
+        VirtualSensorThread(SensorService* service);
+
+        // Returns how many events were queued, less than count if the
+        // virtual sensors are falling behind.
+        size_t enqueue(sensors_event_t const* events, size_t count);
+        nsecs_t getCpuTime() const { return mCpuTime; }
+    };
+
     SortedVector< wp<SensorEventConnection> > getActiveConnections() const;
     DefaultKeyedVector<int, SensorInterface*> getActiveVirtualSensors() const;
+    bool hasActiveVirtualSensors() const;
+
+    void processVirtualSensors(sensors_event_t const* events, size_t count,
+            sensors_event_t* buffer, sensors_event_t* scratch, size_t bufferSize);
+    void sendEventsToConnections(sensors_event_t const* events, size_t count,
+            sensors_event_t* scratch);
 
     String8 getSensorName(int handle) const;
     void recordLastValue(sensors_event_t const * buffer, size_t count);
-    static void sortEventBuffer(sensors_event_t* buffer, size_t count);
+    static void mergeEventRuns(sensors_event_t const* in,
+            size_t const* runs, size_t numRuns, sensors_event_t* out);
+    static void sortEventRun(sensors_event_t* events, size_t count);
     void registerSensor(SensorInterface* sensor);
     void registerVirtualSensor(SensorInterface* sensor);
 
@@ -116,16 +181,34 @@ class SensorService :
     Vector<Sensor> mUserSensorList;
     DefaultKeyedVector<int, SensorInterface*> mSensorMap;
     Vector<SensorInterface *> mVirtualSensorList;
+    sp<VirtualSensorThread> mVirtualSensorThread;
     status_t mInitCheck;
 
+    // cpu time used by the poll thread, for dump
+    volatile nsecs_t mPollThreadCpuTime;
+
     // protected by mLock
     mutable Mutex mLock;
     DefaultKeyedVector<int, SensorRecord*> mActiveSensors;
     DefaultKeyedVector<int, SensorInterface*> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
 
-    // The size of this vector is constant, only the items are mutable
-    KeyedVector<int32_t, sensors_event_t> mLastEventSeen;
+    // Last event seen for each sensor, found through mLastEventIndex. Both
+    // are sized at startup; after that each slot has a single writer (the
+    // poll thread for hardware sensors, the virtual sensor thread for
+    // virtual ones), and readers retry while a slot's sequence number is odd or
+    // changes under them, so neither side takes mLock.
+    struct LastEvent {
+        volatile int32_t seq;
+        sensors_event_t event;
+        uint32_t count;     // events seen from this sensor, for dump
+    };
+    KeyedVector<int32_t, size_t> mLastEventIndex;
+    Vector<LastEvent> mLastEventSeen;
+
+    void storeLastEvent(size_t index, const sensors_event_t& event, size_t count);
+    bool getLastEvent(int32_t handle, sensors_event_t* outEvent) const;
+    uint32_t getEventCount(int32_t handle) const;
 
 public:
     static char const* getServiceName() { return "sensorservice"; }
@@ -380,6 +380,24 @@ mat<T, N, N> PURE invert(const mat<T, N, N>& src) {
     return inverse;
 }
 
+// closed-form inversion of 3x3 matrices, used by sensor fusion for every
+// accelerometer and magnetometer sample. With columns a, b and c, the rows
+// of the inverse are b^c, c^a and a^b divided by the determinant.
+template<typename T>
+mat<T, 3, 3> PURE invert(const mat<T, 3, 3>& src) {
+    const vec<T, 3> bc(cross_product(src[1], src[2]));
+    const vec<T, 3> ca(cross_product(src[2], src[0]));
+    const vec<T, 3> ab(cross_product(src[0], src[1]));
+    const T idet = 1 / dot_product(src[0], bc);
+    mat<T, 3, 3> inverse;
+    for (size_t i=0 ; i<3 ; i++) {
+        inverse[i][0] = bc[i] * idet;
+        inverse[i][1] = ca[i] * idet;
+        inverse[i][2] = ab[i] * idet;
+    }
+    return inverse;
+}
+
 // -----------------------------------------------------------------------
 
 typedef mat<float, 2, 2> mat22_t;
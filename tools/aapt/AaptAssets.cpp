@@ -5,6 +5,7 @@
 #include "AaptAssets.h"
 #include "ResourceFilter.h"
 #include "Main.h"
+#include "Profile.h"
 
 #include <utils/misc.h>
 #include <utils/SortedVector.h>
@@ -2004,6 +2005,7 @@ void AaptAssets::addResource(const String8& leafName, const String8& path,
 
 ssize_t AaptAssets::slurpFromArgs(Bundle* bundle)
 {
+    ProfilePhase phase("slurpFromArgs");
     int count;
     int totalCount = 0;
     FileType type;
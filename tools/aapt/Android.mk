@@ -14,9 +14,11 @@ LOCAL_SRC_FILES := \
 	AaptAssets.cpp \
 	Command.cpp \
 	CrunchCache.cpp \
+	CrunchStore.cpp \
 	FileFinder.cpp \
 	Main.cpp \
 	Package.cpp \
+	Profile.cpp \
 	StringPool.cpp \
 	XMLNode.cpp \
 	ResourceFilter.cpp \
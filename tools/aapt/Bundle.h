@@ -63,7 +63,9 @@ public:
           mMinSdkVersion(NULL), mTargetSdkVersion(NULL), mMaxSdkVersion(NULL),
           mVersionCode(NULL), mVersionName(NULL), mCustomPackage(NULL), mExtraPackages(NULL),
           mMaxResVersion(NULL), mDebugMode(false), mNonConstantId(false), mProduct(NULL),
-          mUseCrunchCache(false), mArgc(0), mArgv(NULL)
+          mUseCrunchCache(false), mCrunchThreads(0), mCrunchCacheDir(NULL),
+          mDumpList(NULL), mZipAlignment(0), mProfileFile(NULL),
+          mArgc(0), mArgv(NULL)
         {}
     ~Bundle(void) {}
 
@@ -177,6 +179,16 @@ public:
     void setProduct(const char * val) { mProduct = val; }
     void setUseCrunchCache(bool val) { mUseCrunchCache = val; }
     bool getUseCrunchCache() const { return mUseCrunchCache; }
+    int getCrunchThreads() const { return mCrunchThreads; }
+    void setCrunchThreads(int val) { mCrunchThreads = val; }
+    const char* getCrunchCacheDir() const { return mCrunchCacheDir; }
+    void setCrunchCacheDir(const char* dir) { mCrunchCacheDir = dir; }
+    const char* getDumpList() const { return mDumpList; }
+    void setDumpList(const char* file) { mDumpList = file; }
+    int getZipAlignment() const { return mZipAlignment; }
+    void setZipAlignment(int val) { mZipAlignment = val; }
+    const char* getProfileFile() const { return mProfileFile; }
+    void setProfileFile(const char* file) { mProfileFile = file; }
 
     /*
      * Set and get the file specification.
@@ -284,6 +296,11 @@ private:
     bool        mNonConstantId;
     const char* mProduct;
     bool        mUseCrunchCache;
+    int         mCrunchThreads;
+    const char* mCrunchCacheDir;
+    const char* mDumpList;
+    int         mZipAlignment;
+    const char* mProfileFile;
 
     /* file specification */
     int         mArgc;
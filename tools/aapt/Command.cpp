@@ -8,6 +8,7 @@
 #include "ResourceFilter.h"
 #include "ResourceTable.h"
 #include "XMLNode.h"
+#include "ResourceIdCache.h"
 
 #include <utils/Log.h>
 #include <utils/threads.h>
@@ -427,24 +428,16 @@ static void printCompatibleScreens(ResXMLTree& tree) {
  * Handle the "dump" command, to extract select data from an archive.
  */
 extern char CONSOLE_DATA[2925]; // see EOF
-int doDump(Bundle* bundle)
+/*
+ * Dump one APK.  Any asset names given for "xmltree" and "xmlstrings" are
+ * the file specs from firstAsset on.
+ */
+static int dumpApk(Bundle* bundle, const char* option, const char* filename,
+                   int firstAsset)
 {
     status_t result = UNKNOWN_ERROR;
     Asset* asset = NULL;
 
-    if (bundle->getFileSpecCount() < 1) {
-        fprintf(stderr, "ERROR: no dump option specified\n");
-        return 1;
-    }
-
-    if (bundle->getFileSpecCount() < 2) {
-        fprintf(stderr, "ERROR: no dump file specified\n");
-        return 1;
-    }
-
-    const char* option = bundle->getFileSpecEntry(0);
-    const char* filename = bundle->getFileSpecEntry(1);
-
     AssetManager assets;
     void* assetsCookie;
     if (!assets.addAssetPath(String8(filename), &assetsCookie)) {
@@ -486,12 +479,12 @@ int doDump(Bundle* bundle)
         printStringPool(pool);
 
     } else if (strcmp("xmltree", option) == 0) {
-        if (bundle->getFileSpecCount() < 3) {
+        if (bundle->getFileSpecCount() <= firstAsset) {
             fprintf(stderr, "ERROR: no dump xmltree resource file specified\n");
             goto bail;
         }
 
-        for (int i=2; i<bundle->getFileSpecCount(); i++) {
+        for (int i=firstAsset; i<bundle->getFileSpecCount(); i++) {
             const char* resname = bundle->getFileSpecEntry(i);
             ResXMLTree tree;
             asset = assets.openNonAsset(resname, Asset::ACCESS_BUFFER);
@@ -513,12 +506,12 @@ int doDump(Bundle* bundle)
         }
 
     } else if (strcmp("xmlstrings", option) == 0) {
-        if (bundle->getFileSpecCount() < 3) {
+        if (bundle->getFileSpecCount() <= firstAsset) {
             fprintf(stderr, "ERROR: no dump xmltree resource file specified\n");
             goto bail;
         }
 
-        for (int i=2; i<bundle->getFileSpecCount(); i++) {
+        for (int i=firstAsset; i<bundle->getFileSpecCount(); i++) {
             const char* resname = bundle->getFileSpecEntry(i);
             ResXMLTree tree;
             asset = assets.openNonAsset(resname, Asset::ACCESS_BUFFER);
@@ -1503,6 +1496,78 @@ bail:
     return (result != NO_ERROR);
 }
 
+/*
+ * Dump each APK named in the --dump-list file, so that a large number of
+ * APKs can be handled by one process.  Failures are reported and the rest
+ * of the list is still dumped.
+ */
+static int dumpApkList(Bundle* bundle, const char* option)
+{
+    const char* listName = bundle->getDumpList();
+    FILE* fp = strcmp(listName, "-") == 0 ? stdin : fopen(listName, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: unable to open dump list '%s': %s\n", listName,
+                strerror(errno));
+        return 1;
+    }
+
+    int count = 0;
+    int failed = 0;
+    String8 path;
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        size_t len = strlen(buf);
+        const bool eol = len > 0 && buf[len-1] == '\n';
+        path.append(buf);
+        if (!eol && !feof(fp)) {
+            continue;   // path longer than buf
+        }
+
+        len = path.length();
+        while (len > 0 && (path.string()[len-1] == '\n' || path.string()[len-1] == '\r')) {
+            len--;
+        }
+        path.setTo(path.string(), len);
+        if (len > 0) {
+            printf("file: '%s'\n", path.string());
+            count++;
+            if (dumpApk(bundle, option, path.string(), 1) != 0) {
+                fprintf(stderr, "ERROR: dump of '%s' failed\n", path.string());
+                failed++;
+            }
+        }
+        path.setTo("");
+    }
+
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    if (failed > 0) {
+        fprintf(stderr, "ERROR: %d of %d files could not be dumped\n", failed, count);
+    }
+    return failed > 0;
+}
+
+int doDump(Bundle* bundle)
+{
+    if (bundle->getFileSpecCount() < 1) {
+        fprintf(stderr, "ERROR: no dump option specified\n");
+        return 1;
+    }
+
+    const char* option = bundle->getFileSpecEntry(0);
+    if (bundle->getDumpList() != NULL) {
+        return dumpApkList(bundle, option);
+    }
+
+    if (bundle->getFileSpecCount() < 2) {
+        fprintf(stderr, "ERROR: no dump file specified\n");
+        return 1;
+    }
+
+    return dumpApk(bundle, option, bundle->getFileSpecEntry(1), 2);
+}
+
 
 /*
  * Handle the "add" command, which wants to add files to a new or
@@ -1702,6 +1767,7 @@ int doPackage(Bundle* bundle)
         if (err != 0) {
             goto bail;
         }
+        ResourceIdCache::save();
     }
 
     // At this point we've read everything and processed everything.  From here
@@ -0,0 +1,186 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Content-addressed store of crunched PNG files and parsed values files,
+// shared between builds.
+//
+
+#include "CrunchStore.h"
+
+#include <utils/threads.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+// Bump whenever the output of the PNG crunching code changes, so that
+// images crunched by older versions of aapt aren't used.
+static const int CRUNCH_STORE_VERSION = 1;
+
+// Likewise for the flattened form of values files.
+static const int VALUES_STORE_VERSION = 2;
+
+// And for the format written by ResourceIdCache::save().
+static const int IDS_STORE_VERSION = 1;
+
+static bool readFile(const char* path, void** outData, size_t* outSize)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = false;
+    void* data = NULL;
+    long size;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0
+            && fseek(fp, 0, SEEK_SET) == 0) {
+        data = malloc(size ? size : 1);
+        ok = data != NULL && fread(data, 1, size, fp) == (size_t)size;
+    }
+    fclose(fp);
+    if (!ok) {
+        free(data);
+        return false;
+    }
+    *outData = data;
+    *outSize = size;
+    return true;
+}
+
+CrunchStore::CrunchStore(const Bundle* bundle)
+    : mGrayscaleTolerance(bundle->getGrayscaleTolerance())
+{
+    const char* dir = bundle->getCrunchCacheDir();
+    if (dir == NULL) {
+        dir = getenv("AAPT_CRUNCH_CACHE");
+    }
+    if (dir != NULL) {
+        mDir = dir;
+    }
+}
+
+static bool makeKey(const String8& sourcePath, const char* options,
+        const char* extension, String8* outKey)
+{
+    void* data;
+    size_t size;
+    if (!readFile(sourcePath.string(), &data, &size)) {
+        return false;
+    }
+
+    // FNV-1a over the options and contents, plus the zlib CRC and length
+    // of the contents, is plenty to keep distinct images apart.
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* p = options; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 1099511628211ULL;
+    }
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    const unsigned long crc = crc32(crc32(0L, Z_NULL, 0), bytes, size);
+    free(data);
+
+    outKey->appendFormat("%016llx%08lx%lx-%s.%s", (unsigned long long)hash, crc,
+            (unsigned long)size, options, extension);
+    return true;
+}
+
+bool CrunchStore::getKey(const String8& sourcePath, String8* outKey) const
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    // Nine-patches are crunched differently, so the name's suffix is part
+    // of the key alongside the options.
+    const bool ninePatch = sourcePath.length() > 6
+            && strcmp(sourcePath.string() + sourcePath.length() - 6, ".9.png") == 0;
+    char options[64];
+    snprintf(options, sizeof(options), "v%d-g%d-%s",
+            CRUNCH_STORE_VERSION, mGrayscaleTolerance, ninePatch ? "9" : "n");
+    return makeKey(sourcePath, options, "png", outKey);
+}
+
+bool CrunchStore::getValuesKey(const String8& sourcePath, String8* outKey) const
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    char options[16];
+    snprintf(options, sizeof(options), "v%d", VALUES_STORE_VERSION);
+    return makeKey(sourcePath, options, "xmlc", outKey);
+}
+
+bool CrunchStore::load(const String8& key, void** outData, size_t* outSize) const
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    String8 path(mDir);
+    path.appendPath(key);
+    return readFile(path.string(), outData, outSize);
+}
+
+bool CrunchStore::getIncludesKey(const Vector<const char*>& includes,
+        String8* outKey) const
+{
+    if (!isEnabled() || includes.size() == 0) {
+        return false;
+    }
+    // Key each package like any other input, then fold the keys together
+    // in order.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < includes.size(); i++) {
+        String8 key;
+        if (!makeKey(String8(includes[i]), "i", "apk", &key)) {
+            return false;
+        }
+        for (const char* p = key.string(); *p; p++) {
+            hash = (hash ^ (uint8_t)*p) * 1099511628211ULL;
+        }
+    }
+    outKey->appendFormat("%016llx-%d-v%d.ids", (unsigned long long)hash,
+            (int)includes.size(), IDS_STORE_VERSION);
+    return true;
+}
+
+void CrunchStore::store(const String8& key, const void* data, size_t size) const
+{
+    if (!isEnabled()) {
+        return;
+    }
+    String8 path(mDir);
+    path.appendPath(key);
+
+    // Write to a private file and rename it into place, so that concurrent
+    // builds sharing the directory never see a partial image.  Worker
+    // threads of the same build may store the same key too, hence the
+    // thread id.
+    String8 tmpPath(path);
+    tmpPath.appendFormat(".%d.%p.tmp", (int)getpid(), androidGetThreadId());
+    FILE* fp = fopen(tmpPath.string(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "WARNING: unable to write to crunch cache %s (%s)\n",
+                mDir.string(), strerror(errno));
+        return;
+    }
+    bool ok = fwrite(data, 1, size, fp) == size;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpPath.string(), path.string()) != 0) {
+        unlink(tmpPath.string());
+    }
+}
+
+void CrunchStore::storeFile(const String8& key, const String8& path) const
+{
+    void* data;
+    size_t size;
+    if (isEnabled() && readFile(path.string(), &data, &size)) {
+        store(key, data, size);
+        free(data);
+    }
+}
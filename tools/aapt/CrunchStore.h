@@ -0,0 +1,66 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Content-addressed store of crunched PNG files and parsed values files,
+// shared between builds.
+//
+
+#ifndef CRUNCH_STORE_H
+#define CRUNCH_STORE_H
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "Bundle.h"
+
+using namespace android;
+
+/** CrunchStore
+ *  Keeps crunched images in a directory, named by a hash of the source
+ *  image's contents and of the options that affect crunching. Unlike the
+ *  modification times used by CrunchCache, the key survives clean builds,
+ *  branch switches and fresh checkouts, and the directory can be shared
+ *  between machines.
+ *
+ *  Values files are kept the same way as flattened XML, so that only the
+ *  ones that changed go through the XML parser again; the resource table
+ *  itself is still rebuilt from them every time.
+ *
+ *  The directory comes from --crunch-cache-dir or the AAPT_CRUNCH_CACHE
+ *  environment variable; without either the store is disabled.
+ */
+class CrunchStore {
+public:
+    CrunchStore(const Bundle* bundle);
+
+    bool isEnabled() const { return mDir.length() > 0; }
+
+    // Computes the key for the image at sourcePath. Returns false if the
+    // store is disabled or the file can't be read.
+    bool getKey(const String8& sourcePath, String8* outKey) const;
+
+    // Computes the key for the flattened XML of the values file at
+    // sourcePath, letting unchanged values files skip the XML parser.
+    bool getValuesKey(const String8& sourcePath, String8* outKey) const;
+
+    // Computes the key for the resource ID lookups made against the given
+    // included packages (-I), which hold as long as they don't change.
+    bool getIncludesKey(const Vector<const char*>& includes, String8* outKey) const;
+
+    // Reads the data stored under key into a malloc()ed buffer
+    // owned by the caller. Returns false if there is none.
+    bool load(const String8& key, void** outData, size_t* outSize) const;
+
+    // Stores a crunched image or flattened values file under key. Failures
+    // are not fatal, the source will simply be processed again next time.
+    void store(const String8& key, const void* data, size_t size) const;
+
+    // Stores the crunched image in the file at path under key.
+    void storeFile(const String8& key, const String8& path) const;
+
+private:
+    String8 mDir;
+    int mGrayscaleTolerance;
+};
+
+#endif // CRUNCH_STORE_H
@@ -7,6 +7,7 @@
 #define PNG_INTERNAL
 
 #include "Images.h"
+#include "CrunchStore.h"
 
 #include <androidfw/ResourceTypes.h>
 #include <utils/ByteOrder.h>
@@ -1140,6 +1141,21 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
         printf("Processing image: %s\n", printableName.string());
     }
 
+    CrunchStore store(bundle);
+    String8 key;
+    const bool cacheable = store.getKey(file->getSourceFile(), &key);
+    if (cacheable) {
+        void* data;
+        size_t size;
+        if (store.load(key, &data, &size)) {
+            NOISY(printf("Using cached image for %s\n", printableName.string()));
+            file->clearData();
+            status_t err = file->writeData(data, size);
+            free(data);
+            return err;
+        }
+    }
+
     png_structp read_ptr = NULL;
     png_infop read_info = NULL;
     FILE* fp;
@@ -1213,6 +1229,10 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
 
     error = NO_ERROR;
 
+    if (cacheable) {
+        store.store(key, file->getData(), file->getSize());
+    }
+
     if (bundle->getVerbose()) {
         fseek(fp, 0, SEEK_END);
         size_t oldSize = (size_t)ftell(fp);
@@ -1240,7 +1260,8 @@ bail:
     return error;
 }
 
-status_t preProcessImageToCache(const Bundle* bundle, const String8& source, const String8& dest)
+static status_t crunchImageToFile(const Bundle* bundle, const String8& source,
+                                  const String8& dest)
 {
     png_structp read_ptr = NULL;
     png_infop read_info = NULL;
@@ -1367,6 +1388,37 @@ status_t preProcessImageToCache(const Bundle* bundle, const String8& source, con
     return NO_ERROR;
 }
 
+status_t preProcessImageToCache(const Bundle* bundle, const String8& source, const String8& dest)
+{
+    CrunchStore store(bundle);
+    String8 key;
+    const bool cacheable = store.getKey(source, &key);
+    void* data;
+    size_t size;
+    if (cacheable && store.load(key, &data, &size)) {
+        if (bundle->getVerbose()) {
+            printf("Using cached image: %s => %s\n", source.string(), dest.string());
+        }
+        FILE* fp = fopen(dest.string(), "wb");
+        bool ok = fp != NULL && fwrite(data, 1, size, fp) == size;
+        if (fp != NULL) {
+            ok = (fclose(fp) == 0) && ok;
+        }
+        free(data);
+        if (!ok) {
+            fprintf(stderr, "%s ERROR: Unable to write PNG file\n", dest.string());
+            return UNKNOWN_ERROR;
+        }
+        return NO_ERROR;
+    }
+
+    status_t err = crunchImageToFile(bundle, source, dest);
+    if (err == NO_ERROR && cacheable) {
+        store.storeFile(key, dest);
+    }
+    return err;
+}
+
 status_t postProcessImage(const sp<AaptAssets>& assets,
                           ResourceTable* table, const sp<AaptFile>& file)
 {
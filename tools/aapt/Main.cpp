@@ -6,6 +6,7 @@
 //
 #include "Main.h"
 #include "Bundle.h"
+#include "Profile.h"
 
 #include <utils/Log.h>
 #include <utils/threads.h>
@@ -50,12 +51,14 @@ void usage(void)
         "   List contents of Zip-compatible archive.\n\n", gProgName);
     fprintf(stderr,
         " %s d[ump] [--values] WHAT file.{apk} [asset [asset ...]]\n"
+        " %s d[ump] [--values] --dump-list FILE WHAT [asset [asset ...]]\n"
         "   badging          Print the label and icon for the app declared in APK.\n"
         "   permissions      Print the permissions from the APK.\n"
         "   resources        Print the resource table from the APK.\n"
         "   configurations   Print the configurations in the APK.\n"
         "   xmltree          Print the compiled xmls in the given assets.\n"
-        "   xmlstrings       Print the strings of the given compiled xml assets.\n\n", gProgName);
+        "   xmlstrings       Print the strings of the given compiled xml assets.\n\n",
+        gProgName, gProgName);
     fprintf(stderr,
         " %s p[ackage] [-d][-f][-m][-u][-v][-x[ extending-resource-id]][-z][-M AndroidManifest.xml] \\\n"
         "        [-0 extension [-0 extension ...]] [-g tolerance] [-j jarfile] \\\n"
@@ -64,7 +67,8 @@ void usage(void)
         "        [--rename-manifest-package PACKAGE] \\\n"
         "        [--rename-instrumentation-target-package PACKAGE] \\\n"
         "        [--utf16] [--auto-add-overlay] \\\n"
-        "        [--max-res-version VAL] \\\n"
+        "        [--max-res-version VAL] [--crunch-threads N] [--crunch-cache-dir DIR] \\\n"
+        "        [--zip-align N] [--profile FILE] \\\n"
         "        [-I base-package [-I base-package ...]] \\\n"
         "        [-A asset-source-dir]  [-G class-list-file] [-P public-definitions-file] \\\n"
         "        [-S resource-sources [-S resource-sources ...]] \\\n"
@@ -145,6 +149,10 @@ void usage(void)
         "       ignores versioned resource directories above the given value.\n"
         "   --values\n"
         "       when used with \"dump resources\" also includes resource values.\n"
+        "   --dump-list\n"
+        "       when used with \"dump\", reads the APKs to dump from the given file\n"
+        "       (\"-\" for stdin), one path per line, and dumps each in turn after a\n"
+        "       \"file: 'path'\" line.\n"
         "   --version-code\n"
         "       inserts android:versionCode in to manifest.\n"
         "   --version-name\n"
@@ -181,6 +189,21 @@ void usage(void)
         "       Make the resources ID non constant. This is required to make an R java class\n"
         "       that does not contain the final value but is used to make reusable compiled\n"
         "       libraries that need to access resources.\n"
+        "   --crunch-threads\n"
+        "       Number of threads used to process PNG images and to compress files\n"
+        "       added to the APK. Defaults to the number of online CPUs.\n"
+        "   --zip-align\n"
+        "       Align the data of uncompressed files in the APK to the given number\n"
+        "       of bytes (typically 4), and shared libraries to 4096, as zipalign\n"
+        "       would.  Not applied to files left in place by -u.\n"
+        "   --crunch-cache-dir\n"
+        "       Directory, possibly shared, where crunched PNG images, parsed values\n"
+        "       files and resource ID lookups in -I packages are kept by content\n"
+        "       hash and reused across builds. Defaults to the\n"
+        "       AAPT_CRUNCH_CACHE environment variable; no cache if neither is set.\n"
+        "   --profile\n"
+        "       Write the wall and CPU time and heap growth of each build phase to\n"
+        "       the given file, as JSON in the Trace Event format (chrome://tracing).\n"
         "   --ignore-assets\n"
         "       Assets to be ignored. Default pattern is:\n"
         "       %s\n",
@@ -570,6 +593,54 @@ int main(int argc, char* const argv[])
                     bundle.setNonConstantId(true);
                 } else if (strcmp(cp, "-no-crunch") == 0) {
                     bundle.setUseCrunchCache(true);
+                } else if (strcmp(cp, "-crunch-threads") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--crunch-threads' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setCrunchThreads(atoi(argv[0]));
+                } else if (strcmp(cp, "-crunch-cache-dir") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--crunch-cache-dir' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    convertPath(argv[0]);
+                    bundle.setCrunchCacheDir(argv[0]);
+                } else if (strcmp(cp, "-zip-align") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--zip-align' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setZipAlignment(atoi(argv[0]));
+                } else if (strcmp(cp, "-dump-list") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--dump-list' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    convertPath(argv[0]);
+                    bundle.setDumpList(argv[0]);
+                } else if (strcmp(cp, "-profile") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--profile' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    convertPath(argv[0]);
+                    bundle.setProfileFile(argv[0]);
                 } else if (strcmp(cp, "-ignore-assets") == 0) {
                     argc--;
                     argv++;
@@ -603,7 +674,14 @@ int main(int argc, char* const argv[])
      */
     bundle.setFileSpec(argv, argc);
 
-    result = handleCommand(&bundle);
+    if (bundle.getProfileFile() != NULL) {
+        ProfilePhase::start(bundle.getProfileFile());
+    }
+    {
+        ProfilePhase total("total");
+        result = handleCommand(&bundle);
+    }
+    ProfilePhase::finish();
 
 bail:
     if (wantUsage) {
@@ -48,6 +48,9 @@ extern android::status_t writeProguardFile(Bundle* bundle, const sp<AaptAssets>&
 
 extern bool isValidResourceType(const String8& type);
 
+// Number of threads to use for crunching images and compressing APK entries.
+extern size_t getWorkerThreadCount(const Bundle* bundle);
+
 ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptAssets>& assets);
 
 extern status_t filterResources(Bundle* bundle, const sp<AaptAssets>& assets);
@@ -6,12 +6,14 @@
 #include "Main.h"
 #include "AaptAssets.h"
 #include "ResourceTable.h"
+#include "Profile.h"
 #include "ResourceFilter.h"
 
 #include <utils/Log.h>
 #include <utils/threads.h>
 #include <utils/List.h>
 #include <utils/Errors.h>
+#include <utils/WorkQueue.h>
 
 #include <sys/types.h>
 #include <dirent.h>
@@ -32,13 +34,30 @@ static const char* kNoCompressExt[] = {
     ".amr", ".awb", ".wma", ".wmv"
 };
 
+/*
+ * Files are compressed this many at a time on the worker threads, while
+ * the previous batch is written out in order.  This bounds how much
+ * compressed data is held in memory.
+ */
+static const size_t kPrepareBatch = 64;
+
+/* a file picked by processAssets(), possibly compressed ahead of time */
+struct PackagedFile {
+    sp<AaptGroup> group;
+    sp<AaptFile> file;
+    ZipFile::Prepared* prepared;
+};
+
 /* fwd decls, so I can write this downward */
 ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptAssets>& assets);
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
-                        const AaptGroupEntry& ge, const ResourceFilter* filter);
+ssize_t processAssets(Bundle* bundle, const sp<AaptDir>& dir,
+                        const AaptGroupEntry& ge, const ResourceFilter* filter,
+                        Vector<PackagedFile>* files);
 bool processFile(Bundle* bundle, ZipFile* zip,
-                        const sp<AaptGroup>& group, const sp<AaptFile>& file);
+                        const sp<AaptGroup>& group, const sp<AaptFile>& file,
+                        const ZipFile::Prepared* prepared);
 bool okayToCompress(Bundle* bundle, const String8& pathName);
+bool endsWith(const char* haystack, const char* needle);
 ssize_t processJarFiles(Bundle* bundle, ZipFile* zip);
 
 /*
@@ -51,6 +70,8 @@ ssize_t processJarFiles(Bundle* bundle, ZipFile* zip);
 status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
                        const String8& outputFile)
 {
+    ProfilePhase phase("writeAPK");
+
     #if BENCHMARK
     fprintf(stdout, "BENCHMARK: Starting APK Bundling \n");
     long startAPKTime = clock();
@@ -104,6 +125,7 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
                 outputFile.string());
         goto bail;
     }
+    zip->setAlignment(bundle->getZipAlignment());
 
     if (bundle->getVerbose()) {
         printf("Writing all files...\n");
@@ -215,6 +237,136 @@ bail:
     return result;
 }
 
+/*
+ * How a file will be stored: generated files carry their own method, and
+ * certain source files, e.g. PNGs, aren't compressed.
+ */
+static int getCompressionMethod(Bundle* bundle, const String8& storageName,
+                                const sp<AaptFile>& file)
+{
+    if (file->hasData()) {
+        return file->getCompressionMethod();
+    }
+    if (!okayToCompress(bundle, storageName)) {
+        return ZipEntry::kCompressStored;
+    }
+    return bundle->getCompressionMethod();
+}
+
+/*
+ * Whether processFile() can take the file already compressed.  Only files
+ * that will be deflated are worth doing off the writer thread, and in
+ * "update" mode most files are skipped, so everything is left to
+ * processFile() there.
+ */
+static bool canPrepare(Bundle* bundle, const PackagedFile& pf, int* outCompressionMethod)
+{
+    if (bundle->getUpdate()) {
+        return false;
+    }
+    String8 storageName(pf.group->getPath());
+    storageName.convertToResPath();
+    if (strcasecmp(storageName.getPathExtension().string(), ".gz") == 0
+            || endsWith(storageName.string(), kExcludeExtension)) {
+        return false;
+    }
+    *outCompressionMethod = getCompressionMethod(bundle, storageName, pf.file);
+    return *outCompressionMethod == ZipEntry::kCompressDeflated;
+}
+
+class PrepareFileWorkUnit : public WorkQueue::WorkUnit {
+public:
+    PrepareFileWorkUnit(const sp<AaptFile>& file, int compressionMethod,
+            ZipFile::Prepared** prepared) :
+            mFile(file), mCompressionMethod(compressionMethod), mPrepared(prepared) {
+    }
+
+    virtual bool run() {
+        status_t status = mFile->hasData()
+                ? ZipFile::prepare(NULL, mFile->getData(), mFile->getSize(),
+                        mCompressionMethod, *mPrepared)
+                : ZipFile::prepare(mFile->getSourceFile().string(), NULL, 0,
+                        mCompressionMethod, *mPrepared);
+        if (status != NO_ERROR) {
+            // processFile() will add it the slow way and report any error.
+            delete *mPrepared;
+            *mPrepared = NULL;
+        }
+        return true;
+    }
+
+private:
+    sp<AaptFile> mFile;
+    int mCompressionMethod;
+    ZipFile::Prepared** mPrepared;
+};
+
+/*
+ * Starts compressing files [start, end) on a new work queue, or returns
+ * NULL if there's nothing to do off the writer thread.
+ */
+static WorkQueue* prepareFiles(Bundle* bundle, Vector<PackagedFile>* files,
+                               size_t start, size_t end, size_t threads)
+{
+    if (threads <= 1 || start >= end) {
+        return NULL;
+    }
+    WorkQueue* wq = new WorkQueue(threads, false);
+    for (size_t i = start; i < end; i++) {
+        PackagedFile& pf = files->editItemAt(i);
+        int compressionMethod;
+        if (!canPrepare(bundle, pf, &compressionMethod)) {
+            continue;
+        }
+        pf.prepared = new ZipFile::Prepared;
+        PrepareFileWorkUnit* w = new PrepareFileWorkUnit(pf.file, compressionMethod,
+                &pf.prepared);
+        if (wq->schedule(w, kPrepareBatch) != NO_ERROR) {
+            delete w;
+            delete pf.prepared;
+            pf.prepared = NULL;
+        }
+    }
+    return wq;
+}
+
+/*
+ * Adds the files to the archive in order.  Compression of each batch runs
+ * on the worker threads while the batch before it is being written, so the
+ * archive's layout doesn't depend on the number of threads.
+ */
+static ssize_t addFiles(Bundle* bundle, ZipFile* zip, Vector<PackagedFile>* files)
+{
+    const size_t N = files->size();
+    const size_t threads = getWorkerThreadCount(bundle);
+    ssize_t result = N;
+
+    WorkQueue* wq = prepareFiles(bundle, files, 0, kPrepareBatch < N ? kPrepareBatch : N,
+            threads);
+    for (size_t start = 0; start < N; start += kPrepareBatch) {
+        const size_t end = start + kPrepareBatch < N ? start + kPrepareBatch : N;
+        const size_t nextEnd = end + kPrepareBatch < N ? end + kPrepareBatch : N;
+
+        WorkQueue* next = result >= 0 ? prepareFiles(bundle, files, end, nextEnd, threads)
+                : NULL;
+        if (wq != NULL) {
+            wq->finish();
+            delete wq;
+        }
+        wq = next;
+
+        for (size_t i = start; i < end; i++) {
+            PackagedFile& pf = files->editItemAt(i);
+            if (result >= 0 && !processFile(bundle, zip, pf.group, pf.file, pf.prepared)) {
+                result = UNKNOWN_ERROR;
+            }
+            delete pf.prepared;
+            pf.prepared = NULL;
+        }
+    }
+    return result;
+}
+
 ssize_t processAssets(Bundle* bundle, ZipFile* zip,
                       const sp<AaptAssets>& assets)
 {
@@ -224,25 +376,24 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip,
         return -1;
     }
 
-    ssize_t count = 0;
+    Vector<PackagedFile> files;
 
     const size_t N = assets->getGroupEntries().size();
     for (size_t i=0; i<N; i++) {
         const AaptGroupEntry& ge = assets->getGroupEntries()[i];
 
-        ssize_t res = processAssets(bundle, zip, assets, ge, &filter);
+        ssize_t res = processAssets(bundle, assets, ge, &filter, &files);
         if (res < 0) {
             return res;
         }
-
-        count += res;
     }
 
-    return count;
+    return addFiles(bundle, zip, &files);
 }
 
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
-        const AaptGroupEntry& ge, const ResourceFilter* filter)
+ssize_t processAssets(Bundle* bundle, const sp<AaptDir>& dir,
+        const AaptGroupEntry& ge, const ResourceFilter* filter,
+        Vector<PackagedFile>* files)
 {
     ssize_t count = 0;
 
@@ -257,7 +408,7 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
             continue;
         }
 
-        ssize_t res = processAssets(bundle, zip, subDir, ge, filterable ? filter : NULL);
+        ssize_t res = processAssets(bundle, subDir, ge, filterable ? filter : NULL, files);
         if (res < 0) {
             return res;
         }
@@ -273,10 +424,11 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
         sp<AaptGroup> gp = dir->getFiles().valueAt(i);
         ssize_t fi = gp->getFiles().indexOfKey(ge);
         if (fi >= 0) {
-            sp<AaptFile> fl = gp->getFiles().valueAt(fi);
-            if (!processFile(bundle, zip, gp, fl)) {
-                return UNKNOWN_ERROR;
-            }
+            PackagedFile pf;
+            pf.group = gp;
+            pf.file = gp->getFiles().valueAt(fi);
+            pf.prepared = NULL;
+            files->add(pf);
             count++;
         }
     }
@@ -291,7 +443,8 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
  * delete the existing entry before adding the new one.
  */
 bool processFile(Bundle* bundle, ZipFile* zip,
-                 const sp<AaptGroup>& group, const sp<AaptFile>& file)
+                 const sp<AaptGroup>& group, const sp<AaptFile>& file,
+                 const ZipFile::Prepared* prepared)
 {
     const bool hasData = file->hasData();
 
@@ -372,17 +525,14 @@ bool processFile(Bundle* bundle, ZipFile* zip,
 
     if (fromGzip) {
         result = zip->addGzip(file->getSourceFile().string(), storageName.string(), &entry);
+    } else if (prepared != NULL) {
+        result = zip->addPrepared(*prepared, storageName.string(), &entry);
     } else if (!hasData) {
-        /* don't compress certain files, e.g. PNGs */
-        int compressionMethod = bundle->getCompressionMethod();
-        if (!okayToCompress(bundle, storageName)) {
-            compressionMethod = ZipEntry::kCompressStored;
-        }
-        result = zip->add(file->getSourceFile().string(), storageName.string(), compressionMethod,
-                            &entry);
+        result = zip->add(file->getSourceFile().string(), storageName.string(),
+                            getCompressionMethod(bundle, storageName, file), &entry);
     } else {
         result = zip->add(file->getData(), file->getSize(), storageName.string(),
-                           file->getCompressionMethod(), &entry);
+                           getCompressionMethod(bundle, storageName, file), &entry);
     }
     if (result == NO_ERROR) {
         if (bundle->getVerbose()) {
@@ -0,0 +1,117 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Records how long each phase of a build takes, for --profile.
+//
+
+#include "Profile.h"
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace android;
+
+struct PhaseRecord {
+    String8 name;
+    nsecs_t start;
+    nsecs_t wall;
+    double cpuMs;
+    long heapBytes;
+    int depth;
+};
+
+static const char* gProfilePath = NULL;
+static nsecs_t gProfileStart = 0;
+static int gProfileDepth = 0;
+static Vector<PhaseRecord> gPhases;
+
+static long heapInUse()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    // mallinfo() is deprecated, and its int fields wrap past 2GB
+    struct mallinfo2 mi = mallinfo2();
+    return (long)mi.uordblks + (long)mi.hblkhd;
+#elif defined(__GLIBC__)
+    struct mallinfo mi = mallinfo();
+    return (long)mi.uordblks + (long)mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+void ProfilePhase::start(const char* path)
+{
+    gProfilePath = path;
+    gProfileStart = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+void ProfilePhase::begin(const char* name)
+{
+    if (gProfilePath == NULL) {
+        return;
+    }
+    mName = name;
+    gProfileDepth++;
+    mHeapStart = heapInUse();
+    mCpuStart = clock();
+    mWallStart = systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+void ProfilePhase::end()
+{
+    if (mName == NULL) {
+        return;
+    }
+    const nsecs_t wallEnd = systemTime(SYSTEM_TIME_MONOTONIC);
+    const clock_t cpuEnd = clock();
+
+    PhaseRecord record;
+    record.name = mName;
+    record.start = mWallStart - gProfileStart;
+    record.wall = wallEnd - mWallStart;
+    record.cpuMs = (cpuEnd - mCpuStart) * 1000.0 / CLOCKS_PER_SEC;
+    record.heapBytes = heapInUse() - mHeapStart;
+    record.depth = gProfileDepth--;
+    gPhases.add(record);
+    mName = NULL;
+}
+
+void ProfilePhase::finish()
+{
+    if (gProfilePath == NULL) {
+        return;
+    }
+    FILE* fp = fopen(gProfilePath, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: unable to write profile '%s': %s\n", gProfilePath,
+                strerror(errno));
+        return;
+    }
+
+    // Phases are recorded as they end, so nested ones come first; viewers
+    // sort complete ("X") events by their timestamps anyway.
+    const int pid = (int)getpid();
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < gPhases.size(); i++) {
+        const PhaseRecord& r = gPhases[i];
+        fprintf(fp, "  {\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":1,"
+                "\"ts\":%lld,\"dur\":%lld,"
+                "\"args\":{\"cpu_ms\":%.3f,\"heap_growth_bytes\":%ld,\"depth\":%d}}%s\n",
+                r.name.string(), pid,
+                (long long)ns2us(r.start), (long long)ns2us(r.wall),
+                r.cpuMs, r.heapBytes, r.depth,
+                i + 1 < gPhases.size() ? "," : "");
+    }
+    fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+    gProfilePath = NULL;
+}
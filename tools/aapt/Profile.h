@@ -0,0 +1,50 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Records how long each phase of a build takes, for --profile.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <utils/Timers.h>
+#include <time.h>
+
+/** ProfilePhase
+ *  Times the enclosing scope as one phase of the build, when profiling
+ *  has been started.  Phases nest, and next() moves on to a sibling phase,
+ *  which suits functions that are a sequence of steps with early returns.
+ *
+ *  The trace is written by finish() as JSON in the Trace Event format, so
+ *  it can be loaded into chrome://tracing or compared between changes.
+ *  Each phase records wall time, CPU time of the process and, where the C
+ *  library can report it, how much the heap grew.
+ */
+class ProfilePhase {
+public:
+    explicit ProfilePhase(const char* name) : mName(NULL) { begin(name); }
+    ~ProfilePhase() { end(); }
+
+    // Ends this phase and starts the next one at the same depth.
+    void next(const char* name) { end(); begin(name); }
+
+    // Turns profiling on; the trace will be written to path.
+    static void start(const char* path);
+
+    // Writes the trace, if profiling was started.
+    static void finish();
+
+private:
+    ProfilePhase(const ProfilePhase&);
+    ProfilePhase& operator=(const ProfilePhase&);
+
+    void begin(const char* name);
+    void end();
+
+    const char* mName;
+    nsecs_t mWallStart;
+    clock_t mCpuStart;
+    long mHeapStart;
+};
+
+#endif // PROFILE_H
@@ -9,6 +9,7 @@
 #include "XMLNode.h"
 #include "ResourceTable.h"
 #include "Images.h"
+#include "Profile.h"
 
 #include "CrunchCache.h"
 #include "FileFinder.h"
@@ -16,6 +17,8 @@
 
 #include <utils/WorkQueue.h>
 
+#include <unistd.h>
+
 #if HAVE_PRINTF_ZD
 #  define ZD "%zd"
 #  define ZD_TYPE ssize_t
@@ -27,7 +30,8 @@
 #define NOISY(x) // x
 
 // Number of threads to use for preprocessing images.
-static const size_t MAX_THREADS = 4;
+// used when --crunch-threads isn't given and the CPU count is unknown
+static const size_t DEFAULT_THREADS = 4;
 
 // ==========================================================================
 // ==========================================================================
@@ -329,13 +333,25 @@ private:
     volatile bool* mHasErrors;
 };
 
+size_t getWorkerThreadCount(const Bundle* bundle)
+{
+    long threads = bundle->getCrunchThreads();
+#ifdef _SC_NPROCESSORS_ONLN
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    return threads > 0 ? size_t(threads) : DEFAULT_THREADS;
+}
+
 static status_t preProcessImages(const Bundle* bundle, const sp<AaptAssets>& assets,
                           const sp<ResourceTypeSet>& set, const char* type)
 {
+    ProfilePhase phase("preProcessImages");
     volatile bool hasErrors = false;
     ssize_t res = NO_ERROR;
     if (bundle->getUseCrunchCache() == false) {
-        WorkQueue wq(MAX_THREADS, false);
+        WorkQueue wq(getWorkerThreadCount(bundle), false);
         ResourceDirIterator it(set, String8(type));
         while ((res=it.next()) == NO_ERROR) {
             PreProcessImageWorkUnit* w = new PreProcessImageWorkUnit(
@@ -851,6 +867,9 @@ status_t updatePreProcessedCache(Bundle* bundle)
 
 status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 {
+    ProfilePhase phase("buildResources");
+    ProfilePhase step("parsePackage");
+
     // First, look for a package file to parse.  This is required to
     // be able to generate the resource information.
     sp<AaptGroup> androidManifestFile =
@@ -887,6 +906,8 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
         xmlFlags |= XML_COMPILE_UTF8;
     }
 
+    step.next("gatherResources");
+
     // --------------------------------------------------------------
     // First, gather all resource information.
     // --------------------------------------------------------------
@@ -1015,6 +1036,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     }
 
     // compile resources
+    step.next("compileValues");
     current = assets;
     while(current.get()) {
         KeyedVector<String8, sp<ResourceTypeSet> > *resources = 
@@ -1050,6 +1072,8 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
         }
     }
 
+    step.next("assignResourceIds");
+
     // --------------------------------------------------------------------
     // Assignment of resource IDs and initial generation of resource table.
     // --------------------------------------------------------------------
@@ -1067,6 +1091,8 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
         }
     }
 
+    step.next("compileXmlFiles");
+
     // --------------------------------------------------------------
     // Finally, we can now we can compile XML files, which may reference
     // resources.
@@ -1205,6 +1231,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     String8 manifestPath(manifestFile->getPrintableSource());
 
     // Generate final compiled manifest file.
+    step.next("compileManifest");
     manifestFile->clearData();
     sp<XMLNode> manifestTree = XMLNode::parse(manifestFile);
     if (manifestTree == NULL) {
@@ -1222,6 +1249,8 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     //block.restart();
     //printXMLBlock(&block);
 
+    step.next("flattenTable");
+
     // --------------------------------------------------------------
     // Generate the final resource table.
     // Re-flatten because we may have added new resource IDs
@@ -1273,6 +1302,8 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 #endif
     }
     
+    step.next("validateManifest");
+
     // Perform a basic validation of the manifest file.  This time we
     // parse it with the comments intact, so that we can use them to
     // generate java docs...  so we are not going to write this one
@@ -1963,6 +1994,7 @@ static status_t writeSymbolClass(
 status_t writeResourceSymbols(Bundle* bundle, const sp<AaptAssets>& assets,
     const String8& package, bool includePrivate)
 {
+    ProfilePhase phase("writeResourceSymbols");
     if (!bundle->getRClassDir()) {
         return NO_ERROR;
     }
@@ -5,6 +5,9 @@
 //
 
 #include "ResourceIdCache.h"
+#include "CrunchStore.h"
+
+#include <utils/ByteOrder.h>
 
 struct lutEntry {
     String16 package;
@@ -19,11 +22,44 @@ static const int lutCapacity = 4096;
 static struct lutEntry* lut = NULL;
 static int lutUsed = 0;
 
+// Open-addressed index of lut, twice its size so probes stay short.
+static const int lutIndexSize = lutCapacity * 2;
+static int* lutIndex = NULL;
+
+// Where save() writes lookups back to, if anywhere.
+static const uint32_t kSavedMagic = 0x43444952;     // 'RIDC'
+static CrunchStore* savedStore = NULL;
+static String8 savedKey;
+static String16 savedOwnPackage;
+static bool savedDirty = false;
+
 static bool lutAlloc() {
-    if (lut == NULL) lut = new struct lutEntry[lutCapacity];
+    if (lut == NULL) {
+        lut = new struct lutEntry[lutCapacity];
+        lutIndex = new int[lutIndexSize];
+        for (int i = 0; i < lutIndexSize; i++) lutIndex[i] = -1;
+    }
     return (lut != NULL);
 }
 
+static uint32_t hashString(uint32_t hash, const String16& str) {
+    const char16_t* p = str.string();
+    for (size_t i = str.size(); i > 0; i--) {
+        hash = (hash ^ *p++) * 16777619u;
+    }
+    return hash;
+}
+
+static int lutSlot(const String16& package, const String16& type,
+                   const String16& name, bool onlyPublic) {
+    uint32_t hash = 2166136261u;
+    hash = hashString(hash, name);
+    hash = hashString(hash, type);
+    hash = hashString(hash, package);
+    hash = (hash ^ (onlyPublic ? 1 : 0)) * 16777619u;
+    return hash & (lutIndexSize - 1);
+}
+
 uint32_t ResourceIdCache::lookup(const String16& package,
                                  const String16& type,
                                  const String16& name,
@@ -31,15 +67,17 @@ uint32_t ResourceIdCache::lookup(const String16& package,
 {
     if (!lutAlloc()) return 0;
 
-    for (int i = 0; i < lutUsed; i++) {
+    for (int slot = lutSlot(package, type, name, onlyPublic); lutIndex[slot] >= 0;
+            slot = (slot + 1) & (lutIndexSize - 1)) {
+        const lutEntry& e = lut[lutIndex[slot]];
         if (
             // name is most likely to be different
-            (name == lut[i].name) &&
-            (type == lut[i].type) &&
-            (package == lut[i].package) &&
-            (onlyPublic == lut[i].onlyPublic)
+            (name == e.name) &&
+            (type == e.type) &&
+            (package == e.package) &&
+            (onlyPublic == e.onlyPublic)
         ) {
-            return lut[i].resId;
+            return e.resId;
         }
     }
     return 0;
@@ -53,15 +91,131 @@ bool ResourceIdCache::store(const String16& package,
 {
     if (!lutAlloc()) return false;
 
+    // A zero can't be told apart from a miss, so there's no point keeping it.
+    if (resId == 0) return false;
+
     if (lutUsed < lutCapacity) {
         lut[lutUsed].package = String16(package);
         lut[lutUsed].type = String16(type);
         lut[lutUsed].name = String16(name);
         lut[lutUsed].onlyPublic = onlyPublic;
         lut[lutUsed].resId = resId;
+
+        int slot = lutSlot(package, type, name, onlyPublic);
+        while (lutIndex[slot] >= 0) {
+            slot = (slot + 1) & (lutIndexSize - 1);
+        }
+        lutIndex[slot] = lutUsed;
         lutUsed++;
+
+        if (savedStore != NULL && package != savedOwnPackage) {
+            savedDirty = true;
+        }
         return true;
     } else {
         return false;
     }
 }
+
+/*
+ * The saved form is little-endian: the magic and an entry count, then for
+ * each entry its resId, onlyPublic flag, and package, type and name, each
+ * a UTF-16 length and code units.
+ */
+static void writeU32(const sp<AaptFile>& out, uint32_t val) {
+    val = htodl(val);
+    out->writeData(&val, sizeof(val));
+}
+
+static void writeString(const sp<AaptFile>& out, const String16& str) {
+    writeU32(out, str.size());
+    const char16_t* p = str.string();
+    for (size_t i = str.size(); i > 0; i--) {
+        uint16_t c = htods(*p++);
+        out->writeData(&c, sizeof(c));
+    }
+}
+
+static bool readU32(const uint8_t** p, const uint8_t* end, uint32_t* out) {
+    if ((size_t)(end - *p) < sizeof(uint32_t)) return false;
+    uint32_t val;
+    memcpy(&val, *p, sizeof(val));
+    *out = dtohl(val);
+    *p += sizeof(val);
+    return true;
+}
+
+static bool readString(const uint8_t** p, const uint8_t* end, String16* out) {
+    uint32_t len;
+    if (!readU32(p, end, &len) || (size_t)(end - *p) / sizeof(uint16_t) < len) {
+        return false;
+    }
+    char16_t* chars = new char16_t[len ? len : 1];
+    for (uint32_t i = 0; i < len; i++) {
+        uint16_t c;
+        memcpy(&c, *p, sizeof(c));
+        chars[i] = dtohs(c);
+        *p += sizeof(c);
+    }
+    *out = String16(chars, len);
+    delete[] chars;
+    return true;
+}
+
+void ResourceIdCache::load(const CrunchStore& cache, const String8& key,
+                           const String16& ownPackage)
+{
+    if (savedStore != NULL) return;
+    savedStore = new CrunchStore(cache);
+    savedKey = key;
+    savedOwnPackage = ownPackage;
+
+    void* data;
+    size_t size;
+    if (!cache.load(key, &data, &size)) return;
+
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+    uint32_t magic, count;
+    if (readU32(&p, end, &magic) && magic == kSavedMagic && readU32(&p, end, &count)) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t resId, onlyPublic;
+            String16 package, type, name;
+            if (!readU32(&p, end, &resId) || !readU32(&p, end, &onlyPublic)
+                    || !readString(&p, end, &package) || !readString(&p, end, &type)
+                    || !readString(&p, end, &name)) {
+                break;
+            }
+            if (package != ownPackage && lookup(package, type, name, onlyPublic != 0) == 0) {
+                store(package, type, name, onlyPublic != 0, resId);
+            }
+        }
+    }
+    free(data);
+    savedDirty = false;
+}
+
+void ResourceIdCache::save()
+{
+    if (savedStore == NULL || !savedDirty) return;
+
+    uint32_t count = 0;
+    for (int i = 0; i < lutUsed; i++) {
+        if (lut[i].package != savedOwnPackage) count++;
+    }
+
+    sp<AaptFile> out = new AaptFile(String8(), AaptGroupEntry(), String8());
+    writeU32(out, kSavedMagic);
+    writeU32(out, count);
+    for (int i = 0; i < lutUsed; i++) {
+        const lutEntry& e = lut[i];
+        if (e.package == savedOwnPackage) continue;
+        writeU32(out, e.resId);
+        writeU32(out, e.onlyPublic ? 1 : 0);
+        writeString(out, e.package);
+        writeString(out, e.type);
+        writeString(out, e.name);
+    }
+    savedStore->store(savedKey, out->getData(), out->getSize());
+    savedDirty = false;
+}
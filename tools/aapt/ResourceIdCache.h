@@ -9,6 +9,8 @@
 
 #include "StringPool.h"
 
+class CrunchStore;
+
 class ResourceIdCache {
 public:
     static uint32_t lookup(const String16& package,
@@ -21,6 +23,16 @@ public:
                       const String16& name,
                       bool onlyPublic,
                       uint32_t resId);
+
+    // Loads the lookups saved under key by an earlier run against the same
+    // included packages, and remembers where save() should put this run's.
+    // Lookups in ownPackage are never saved, since its IDs are assigned
+    // afresh every time.
+    static void load(const CrunchStore& cache, const String8& key,
+                     const String16& ownPackage);
+
+    // Writes the cache back if load() was called and new lookups were made.
+    static void save();
 };
 
 #endif
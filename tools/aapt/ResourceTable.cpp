@@ -10,6 +10,8 @@
 #include "XMLNode.h"
 #include "ResourceFilter.h"
 #include "ResourceIdCache.h"
+#include "CrunchStore.h"
+#include "Profile.h"
 
 #include <androidfw/ResourceTypes.h>
 #include <utils/ByteOrder.h>
@@ -17,6 +19,10 @@
 
 #define NOISY(x) //x
 
+// Layouts and the other XML files compiled here still go through an XMLNode
+// tree rather than flattenXMLResource(): attribute names with resource IDs
+// must lead the string pool, and which names have IDs is only known once
+// assignResourceIds() and parseValues() have seen the whole file.
 status_t compileXmlFile(const sp<AaptAssets>& assets,
                         const sp<AaptFile>& target,
                         ResourceTable* table,
@@ -719,6 +725,38 @@ status_t parseAndAddEntry(Bundle* bundle,
     return err;
 }
 
+// Parses a values file, reusing its flattened XML from the crunch store
+// when the file hasn't changed since it was last parsed.
+static status_t parseValuesResource(const Bundle* bundle, const sp<AaptFile>& in,
+                                    ResXMLTree* outTree)
+{
+    CrunchStore store(bundle);
+    String8 key;
+    const bool keyed = store.getValuesKey(in->getSourceFile(), &key);
+    if (keyed) {
+        void* data;
+        size_t size;
+        if (store.load(key, &data, &size)) {
+            status_t err = outTree->setTo(data, size, true);
+            free(data);
+            if (err == NO_ERROR) {
+                return NO_ERROR;
+            }
+            // A damaged entry is parsed again and replaced below.
+        }
+    }
+
+    sp<AaptFile> rsc = flattenXMLResource(in, false, true);
+    if (rsc == NULL) {
+        return UNKNOWN_ERROR;
+    }
+    status_t err = outTree->setTo(rsc->getData(), rsc->getSize(), true);
+    if (err == NO_ERROR && keyed) {
+        store.store(key, rsc->getData(), rsc->getSize());
+    }
+    return err;
+}
+
 status_t compileResourceFile(Bundle* bundle,
                              const sp<AaptAssets>& assets,
                              const sp<AaptFile>& in,
@@ -727,7 +765,7 @@ status_t compileResourceFile(Bundle* bundle,
                              ResourceTable* outTable)
 {
     ResXMLTree block;
-    status_t err = parseXMLResource(in, &block, false, true);
+    status_t err = parseValuesResource(bundle, in, &block);
     if (err != NO_ERROR) {
         return err;
     }
@@ -1618,6 +1656,14 @@ status_t ResourceTable::addIncludedResources(Bundle* bundle, const sp<AaptAssets
     // For future reference to included resources.
     mAssets = assets;
 
+    // Lookups in the included packages hold for as long as they don't
+    // change, so pick up those made by earlier runs.
+    CrunchStore cache(bundle);
+    String8 cacheKey;
+    if (cache.getIncludesKey(bundle->getPackageIncludes(), &cacheKey)) {
+        ResourceIdCache::load(cache, cacheKey, mAssetsPackage);
+    }
+
     const ResTable& incl = assets->getIncludedResources();
 
     // Retrieve all the packages.
@@ -2587,6 +2633,7 @@ ResourceTable::validateLocalizations(void)
 
 status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
 {
+    ProfilePhase phase("ResourceTable::flatten");
     ResourceFilter filter;
     status_t err = filter.parse(bundle->getConfigurations());
     if (err != NO_ERROR) {
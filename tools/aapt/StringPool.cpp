@@ -102,10 +102,70 @@ int StringPool::entry::compare(const entry& o) const {
 }
 
 StringPool::StringPool(bool utf8) :
-        mUTF8(utf8), mValues(-1)
+        mUTF8(utf8), mValueCount(0)
 {
 }
 
+static inline uint32_t hashString16(const String16& value)
+{
+    // FNV-1a over the UTF-16 code units.
+    uint32_t hash = 2166136261u;
+    const char16_t* str = value.string();
+    for (size_t i = value.size(); i > 0; i--) {
+        hash = (hash ^ *str++) * 16777619u;
+    }
+    return hash;
+}
+
+ssize_t StringPool::findValue(const String16& value) const
+{
+    const size_t N = mValues.size();
+    if (N == 0) {
+        return -1;
+    }
+    const size_t mask = N - 1;
+    for (size_t slot = hashString16(value) & mask; ; slot = (slot + 1) & mask) {
+        const ssize_t pos = mValues[slot];
+        if (pos < 0) {
+            return -1;
+        }
+        if (mEntries[mEntryArray[pos]].value == value) {
+            return pos;
+        }
+    }
+}
+
+void StringPool::addValue(size_t pos)
+{
+    // Keep the table at most half full, so probes stay short.
+    if ((mValueCount + 1) * 2 > mValues.size()) {
+        Vector<ssize_t> old(mValues);
+        const size_t N = old.size() > 0 ? old.size() * 2 : 64;
+        mValues.clear();
+        mValues.insertAt((ssize_t)-1, 0, N);
+        mValueCount = 0;
+        for (size_t i = 0; i < old.size(); i++) {
+            if (old[i] >= 0) {
+                addValue(old[i]);
+            }
+        }
+    }
+
+    const size_t mask = mValues.size() - 1;
+    size_t slot = hashString16(mEntries[mEntryArray[pos]].value) & mask;
+    while (mValues[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    mValues.editItemAt(slot) = pos;
+    mValueCount++;
+}
+
+void StringPool::clearValues()
+{
+    mValues.clear();
+    mValueCount = 0;
+}
+
 ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& spans,
         const String8* configTypeName, const ResTable_config* config)
 {
@@ -119,8 +179,7 @@ ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& s
 ssize_t StringPool::add(const String16& value,
         bool mergeDuplicates, const String8* configTypeName, const ResTable_config* config)
 {
-    ssize_t vidx = mValues.indexOfKey(value);
-    ssize_t pos = vidx >= 0 ? mValues.valueAt(vidx) : -1;
+    ssize_t pos = findValue(value);
     ssize_t eidx = pos >= 0 ? mEntryArray.itemAt(pos) : -1;
     if (eidx < 0) {
         eidx = mEntries.add(entry(value));
@@ -161,20 +220,20 @@ ssize_t StringPool::add(const String16& value,
         }
     }
 
-    const bool first = vidx < 0;
+    const bool first = pos < 0;
     const bool styled = (pos >= 0 && (size_t)pos < mEntryStyleArray.size()) ?
         mEntryStyleArray[pos].spans.size() : 0;
     if (first || styled || !mergeDuplicates) {
         pos = mEntryArray.add(eidx);
         if (first) {
-            vidx = mValues.add(value, pos);
+            addValue(pos);
         }
         entry& ent = mEntries.editItemAt(eidx);
         ent.indices.add(pos);
     }
 
-    NOISY(printf("Adding string %s to pool: pos=%d eidx=%d vidx=%d\n",
-            String8(value).string(), pos, eidx, vidx));
+    NOISY(printf("Adding string %s to pool: pos=%d eidx=%d first=%d\n",
+            String8(value).string(), pos, eidx, first));
     
     return pos;
 }
@@ -326,10 +385,14 @@ void StringPool::sortByConfig()
     mEntries = newEntries;
     mEntryArray = newEntryArray;
     mEntryStyleArray = newEntryStyleArray;
-    mValues.clear();
-    for (size_t i=0; i<mEntries.size(); i++) {
-        const entry& ent = mEntries[i];
-        mValues.add(ent.value, ent.indices[0]);
+    // Walked backwards so that, as before, the last of several equal
+    // entries is the one found by value.
+    clearValues();
+    for (size_t i=mEntries.size(); i>0; i--) {
+        const entry& ent = mEntries[i-1];
+        if (findValue(ent.value) < 0) {
+            addValue(ent.indices[0]);
+        }
     }
 
 #if 0
@@ -566,7 +629,7 @@ ssize_t StringPool::offsetForString(const String16& val) const
 
 const Vector<size_t>* StringPool::offsetsForString(const String16& val) const
 {
-    ssize_t pos = mValues.valueFor(val);
+    ssize_t pos = findValue(val);
     if (pos < 0) {
         return NULL;
     }
@@ -141,6 +141,12 @@ public:
 private:
     static int config_sort(void* state, const void* lhs, const void* rhs);
 
+    // Returns the first index of mEntryArray holding value, or -1.
+    ssize_t findValue(const String16& value) const;
+    // Records pos as the first index of mEntryArray holding its string.
+    void addValue(size_t pos);
+    void clearValues();
+
     const bool                              mUTF8;
 
     // The following data structures represent the actual structures
@@ -165,8 +171,13 @@ private:
     // string pool is constructed.
 
     // Unique set of all the strings added to the pool, mapped to
-    // the first index of mEntryArray where the value was added.
-    DefaultKeyedVector<String16, ssize_t>   mValues;
+    // the first index of mEntryArray where the value was added.  This is
+    // an open-addressed hash table with linear probing whose size is a
+    // power of two; each slot holds an index of mEntryArray, or -1.
+    // Resource tables can add hundreds of thousands of strings, which a
+    // sorted KeyedVector would have to keep shifting around.
+    Vector<ssize_t>                         mValues;
+    size_t                                  mValueCount;
     // This array maps from the original position a string was placed at
     // in mEntryArray to its new position after being sorted with sortByConfig().
     Vector<size_t>                          mOriginalPosToNewPos;
@@ -522,20 +522,11 @@ status_t parseXMLResource(const sp<AaptFile>& file, ResXMLTree* outTree,
                           bool stripAll, bool keepComments,
                           const char** cDataTags)
 {
-    sp<XMLNode> root = XMLNode::parse(file);
-    if (root == NULL) {
+    sp<AaptFile> rsc = flattenXMLResource(file, stripAll, keepComments, cDataTags);
+    if (rsc == NULL) {
         return UNKNOWN_ERROR;
     }
-    root->removeWhitespace(stripAll, cDataTags);
-
-    NOISY(printf("Input XML from %s:\n", (const char*)file->getPrintableSource()));
-    NOISY(root->print());
-    sp<AaptFile> rsc = new AaptFile(String8(), AaptGroupEntry(), String8());
-    status_t err = root->flatten(rsc, !keepComments, false);
-    if (err != NO_ERROR) {
-        return err;
-    }
-    err = outTree->setTo(rsc->getData(), rsc->getSize(), true);
+    status_t err = outTree->setTo(rsc->getData(), rsc->getSize(), true);
     if (err != NO_ERROR) {
         return err;
     }
@@ -1507,3 +1498,371 @@ status_t XMLNode::flatten_node(const StringPool& strings, const sp<AaptFile>& de
 
     return NO_ERROR;
 }
+
+/*
+ * flattenXMLResource() writes the binary XML chunks straight from the expat
+ * callbacks instead of building an XMLNode tree and flattening that.  The
+ * result is what XMLNode::flatten() gives for a tree without resource IDs,
+ * with the same whitespace handling as removeWhitespace(), though strings
+ * may be pooled in a different order.  Trees that need resource IDs must
+ * still be built, because the attribute names with IDs have to lead the
+ * string pool and the attributes are sorted by ID.
+ */
+struct FlattenState
+{
+    struct Open {
+        bool isNamespace;
+        bool written;           // false for the tools namespace
+        bool stripAll;          // for the CDATA directly inside this node
+        size_t chunkPos;        // start chunk's position in "nodes"
+        uint32_t ns;            // or the prefix, for namespaces
+        uint32_t name;          // or the uri, for namespaces
+        String16 comment;
+    };
+
+    FlattenState()
+        : parser(NULL), stripAll(true), keepComments(false), cDataTags(NULL),
+          strings(false), nodes(new AaptFile(String8(), AaptGroupEntry(), String8())),
+          charsLine(0), hasChars(false), sawElement(false)
+    {
+    }
+
+    String8 filename;
+    XML_Parser parser;
+    bool stripAll;
+    bool keepComments;
+    const char** cDataTags;
+    StringPool strings;
+    sp<AaptFile> nodes;
+    Vector<Open> stack;
+    String16 pendingComment;
+    String16 chars;
+    int32_t charsLine;
+    bool hasChars;
+    bool sawElement;
+};
+
+static uint32_t poolString(FlattenState* st, const String16& str)
+{
+    return (uint32_t)st->strings.add(str, true);
+}
+
+static void writeNode(FlattenState* st, uint16_t type, int32_t lineNumber,
+        uint32_t comment, const void* ext, size_t extSize,
+        const ResXMLTree_attribute* attrs, size_t attrCount)
+{
+    ResXMLTree_node node;
+    memset(&node, 0, sizeof(node));
+    node.header.type = htods(type);
+    node.header.headerSize = htods(sizeof(node));
+    node.header.size = htodl(sizeof(node) + extSize + sizeof(*attrs)*attrCount);
+    node.lineNumber = htodl(lineNumber);
+    node.comment.index = htodl(comment);
+    st->nodes->writeData(&node, sizeof(node));
+    st->nodes->writeData(ext, extSize);
+    if (attrCount > 0) {
+        st->nodes->writeData(attrs, sizeof(*attrs)*attrCount);
+    }
+}
+
+/*
+ * Emit any character data collected since the last tag, compacting its
+ * whitespace the way XMLNode::removeWhitespace() does.
+ */
+static void flushChars(FlattenState* st)
+{
+    if (!st->hasChars) {
+        return;
+    }
+    st->hasChars = false;
+    String16 chars(st->chars);
+    st->chars = String16();
+
+    const char16_t* s = chars.string();
+    const char16_t* p = s;
+    while (*p != 0 && *p < 128 && isspace(*p)) {
+        p++;
+    }
+    if (*p == 0) {
+        if (st->stack[st->stack.size()-1].stripAll) {
+            return;
+        }
+        chars = String16(" ");
+    } else {
+        const char16_t* last = s + chars.size() - 1;
+        const char16_t* e = last;
+        while (e > p && *e < 128 && isspace(*e)) {
+            e--;
+        }
+        if (p > s) {
+            p--;
+        }
+        if (e < last) {
+            e++;
+        }
+        if (p > s || e < last) {
+            chars = String16(p, e-p+1);
+        }
+    }
+
+    ResXMLTree_cdataExt cdataExt;
+    memset(&cdataExt, 0, sizeof(cdataExt));
+    cdataExt.data.index = htodl(poolString(st, chars));
+    cdataExt.typedData.size = htods(sizeof(cdataExt.typedData));
+    writeNode(st, RES_XML_CDATA_TYPE, st->charsLine, (uint32_t)-1,
+            &cdataExt, sizeof(cdataExt), NULL, 0);
+}
+
+static bool isCDataTag(const char** cDataTags, const String16& name)
+{
+    if (cDataTags == NULL) {
+        return false;
+    }
+    String8 tag(name);
+    for (const char** p = cDataTags; *p; p++) {
+        if (tag == *p) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void XMLCALL
+flattenStartNamespace(void *userData, const char *prefix, const char *uri)
+{
+    FlattenState* st = (FlattenState*)userData;
+    flushChars(st);
+
+    FlattenState::Open open;
+    open.isNamespace = true;
+    open.stripAll = st->stack.size() > 0 ? st->stack[st->stack.size()-1].stripAll
+            : st->stripAll;
+    open.chunkPos = st->nodes->getSize();
+    const String16 uri16(uri);
+    open.written = uri16 != RESOURCES_TOOLS_NAMESPACE;
+    open.ns = poolString(st, String16(prefix != NULL ? prefix : ""));
+    open.name = poolString(st, uri16);
+    if (open.written) {
+        ResXMLTree_namespaceExt namespaceExt;
+        memset(&namespaceExt, 0, sizeof(namespaceExt));
+        namespaceExt.prefix.index = htodl(open.ns);
+        namespaceExt.uri.index = htodl(open.name);
+        writeNode(st, RES_XML_START_NAMESPACE_TYPE, XML_GetCurrentLineNumber(st->parser),
+                (uint32_t)-1, &namespaceExt, sizeof(namespaceExt), NULL, 0);
+    }
+    st->stack.push(open);
+}
+
+static void XMLCALL
+flattenStartElement(void *userData, const char *name, const char **atts)
+{
+    FlattenState* st = (FlattenState*)userData;
+    flushChars(st);
+    st->sawElement = true;
+
+    String16 ns16, name16;
+    splitName(name, &ns16, &name16);
+
+    FlattenState::Open open;
+    open.isNamespace = false;
+    open.written = true;
+    open.stripAll = (st->stack.size() > 0 ? st->stack[st->stack.size()-1].stripAll
+            : st->stripAll) && !isCDataTag(st->cDataTags, name16);
+    open.chunkPos = st->nodes->getSize();
+    open.ns = ns16.size() > 0 ? poolString(st, ns16) : (uint32_t)-1;
+    open.name = poolString(st, name16);
+    open.comment = st->pendingComment;
+    st->pendingComment = String16();
+
+    ResXMLTree_attrExt attrExt;
+    memset(&attrExt, 0, sizeof(attrExt));
+    attrExt.ns.index = htodl(open.ns);
+    attrExt.name.index = htodl(open.name);
+    attrExt.attributeStart = htods(sizeof(attrExt));
+    attrExt.attributeSize = htods(sizeof(ResXMLTree_attribute));
+
+    const String16 id16("id");
+    const String16 class16("class");
+    const String16 style16("style");
+
+    Vector<ResXMLTree_attribute> attrs;
+    for (int i = 0; atts[i]; i += 2) {
+        splitName(atts[i], &ns16, &name16);
+        if (ns16 == RESOURCES_TOOLS_NAMESPACE) {
+            continue;
+        }
+        ResXMLTree_attribute attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.ns.index = htodl(ns16.size() > 0 ? poolString(st, ns16) : (uint32_t)-1);
+        attr.name.index = htodl(poolString(st, name16));
+        const uint32_t value = poolString(st, String16(atts[i+1]));
+        attr.rawValue.index = htodl(value);
+        attr.typedValue.size = htods(sizeof(attr.typedValue));
+        attr.typedValue.dataType = Res_value::TYPE_STRING;
+        attr.typedValue.data = htodl(value);
+        attrs.add(attr);
+        if (ns16.size() == 0) {
+            if (name16 == id16) {
+                attrExt.idIndex = htods(attrs.size());
+            } else if (name16 == class16) {
+                attrExt.classIndex = htods(attrs.size());
+            } else if (name16 == style16) {
+                attrExt.styleIndex = htods(attrs.size());
+            }
+        }
+    }
+    attrExt.attributeCount = htods(attrs.size());
+
+    const uint32_t comment = st->keepComments && open.comment.size() > 0
+            ? poolString(st, open.comment) : (uint32_t)-1;
+    writeNode(st, RES_XML_START_ELEMENT_TYPE, XML_GetCurrentLineNumber(st->parser),
+            comment, &attrExt, sizeof(attrExt), attrs.array(), attrs.size());
+    st->stack.push(open);
+}
+
+static void XMLCALL
+flattenCharacterData(void *userData, const XML_Char *s, int len)
+{
+    FlattenState* st = (FlattenState*)userData;
+    if (st->stack.size() == 0) {
+        return;
+    }
+    if (!st->hasChars) {
+        st->hasChars = true;
+        st->charsLine = XML_GetCurrentLineNumber(st->parser);
+    }
+    st->chars.append(String16(s, len));
+}
+
+static void XMLCALL
+flattenEndElement(void *userData, const char *name)
+{
+    FlattenState* st = (FlattenState*)userData;
+    flushChars(st);
+
+    FlattenState::Open& open = st->stack.editItemAt(st->stack.size()-1);
+    if (st->pendingComment.size() > 0) {
+        // A comment just before the end tag belongs to the element too, so
+        // its start chunk is pointed at the combined comment.
+        if (open.comment.size() > 0) {
+            open.comment.append(String16("\n"));
+        }
+        open.comment.append(st->pendingComment);
+        st->pendingComment = String16();
+        if (st->keepComments) {
+            ResXMLTree_node* node = (ResXMLTree_node*)
+                    ((uint8_t*)st->nodes->editData() + open.chunkPos);
+            node->comment.index = htodl(poolString(st, open.comment));
+        }
+    }
+
+    ResXMLTree_endElementExt endElementExt;
+    memset(&endElementExt, 0, sizeof(endElementExt));
+    endElementExt.ns.index = htodl(open.ns);
+    endElementExt.name.index = htodl(open.name);
+    writeNode(st, RES_XML_END_ELEMENT_TYPE, XML_GetCurrentLineNumber(st->parser),
+            (uint32_t)-1, &endElementExt, sizeof(endElementExt), NULL, 0);
+    st->stack.pop();
+}
+
+static void XMLCALL
+flattenEndNamespace(void *userData, const char *prefix)
+{
+    FlattenState* st = (FlattenState*)userData;
+    flushChars(st);
+
+    const FlattenState::Open& open = st->stack[st->stack.size()-1];
+    if (open.written) {
+        ResXMLTree_namespaceExt namespaceExt;
+        memset(&namespaceExt, 0, sizeof(namespaceExt));
+        namespaceExt.prefix.index = htodl(open.ns);
+        namespaceExt.uri.index = htodl(open.name);
+        writeNode(st, RES_XML_END_NAMESPACE_TYPE, XML_GetCurrentLineNumber(st->parser),
+                (uint32_t)-1, &namespaceExt, sizeof(namespaceExt), NULL, 0);
+    }
+    st->stack.pop();
+}
+
+static void XMLCALL
+flattenCommentData(void *userData, const char *comment)
+{
+    FlattenState* st = (FlattenState*)userData;
+    if (st->pendingComment.size() > 0) {
+        st->pendingComment.append(String16("\n"));
+    }
+    st->pendingComment.append(String16(comment));
+}
+
+sp<AaptFile> flattenXMLResource(const sp<AaptFile>& file,
+                                bool stripAll, bool keepComments,
+                                const char** cDataTags)
+{
+    char buf[16384];
+    int fd = open(file->getSourceFile().string(), O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        SourcePos(file->getSourceFile(), -1).error("Unable to open file for read: %s",
+                strerror(errno));
+        return NULL;
+    }
+
+    XML_Parser parser = XML_ParserCreateNS(NULL, 1);
+    FlattenState state;
+    state.filename = file->getPrintableSource();
+    state.parser = parser;
+    state.stripAll = stripAll;
+    state.keepComments = keepComments;
+    state.cDataTags = cDataTags;
+    XML_SetUserData(parser, &state);
+    XML_SetElementHandler(parser, flattenStartElement, flattenEndElement);
+    XML_SetNamespaceDeclHandler(parser, flattenStartNamespace, flattenEndNamespace);
+    XML_SetCharacterDataHandler(parser, flattenCharacterData);
+    XML_SetCommentHandler(parser, flattenCommentData);
+
+    ssize_t len;
+    bool done;
+    do {
+        len = read(fd, buf, sizeof(buf));
+        done = len < (ssize_t)sizeof(buf);
+        if (len < 0) {
+            SourcePos(file->getSourceFile(), -1).error("Error reading file: %s\n", strerror(errno));
+            XML_ParserFree(parser);
+            close(fd);
+            return NULL;
+        }
+        if (XML_Parse(parser, buf, len, done) == XML_STATUS_ERROR) {
+            SourcePos(file->getSourceFile(), (int)XML_GetCurrentLineNumber(parser)).error(
+                    "Error parsing XML: %s\n", XML_ErrorString(XML_GetErrorCode(parser)));
+            XML_ParserFree(parser);
+            close(fd);
+            return NULL;
+        }
+    } while (!done);
+
+    XML_ParserFree(parser);
+    close(fd);
+    if (!state.sawElement) {
+        SourcePos(file->getSourceFile(), -1).error("No XML data generated when parsing");
+        return NULL;
+    }
+
+    sp<AaptFile> stringPool = state.strings.createStringBlock();
+    if (stringPool == NULL) {
+        return NULL;
+    }
+
+    ResXMLTree_header header;
+    memset(&header, 0, sizeof(header));
+    header.header.type = htods(RES_XML_TYPE);
+    header.header.headerSize = htods(sizeof(header));
+    header.header.size = htodl(sizeof(header) + stringPool->getSize()
+            + state.nodes->getSize());
+
+    sp<AaptFile> rsc = new AaptFile(String8(), AaptGroupEntry(), String8());
+    rsc->writeData(&header, sizeof(header));
+    rsc->writeData(stringPool->getData(), stringPool->getSize());
+    rsc->writeData(state.nodes->getData(), state.nodes->getSize());
+
+    NOISY(aout << "XML resource:"
+          << HexDump(rsc->getData(), rsc->getSize()) << endl);
+    return rsc;
+}
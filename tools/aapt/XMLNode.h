@@ -34,6 +34,13 @@ status_t parseXMLResource(const sp<AaptFile>& file, ResXMLTree* outTree,
                           bool stripAll=true, bool keepComments=false,
                           const char** cDataTags=NULL);
 
+// Like parseXMLResource(), but returns the flattened XML itself, or NULL
+// on error.  The XML is flattened as it is parsed, without building an
+// XMLNode tree, so it can't have resource IDs assigned.
+sp<AaptFile> flattenXMLResource(const sp<AaptFile>& file,
+                                bool stripAll=true, bool keepComments=false,
+                                const char** cDataTags=NULL);
+
 class XMLNode : public RefBase
 {
 public:
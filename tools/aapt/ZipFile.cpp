@@ -405,6 +405,13 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
      * practice some utilities demand it.
      */
     lfhPosn = ftell(mZipFp);
+    if (sourceType == ZipEntry::kCompressStored &&
+        compressionMethod == ZipEntry::kCompressStored)
+    {
+        result = alignEntry(pEntry, lfhPosn);
+        if (result != NO_ERROR)
+            goto bail;
+    }
     pEntry->mLFH.write(mZipFp);
     startPosn = ftell(mZipFp);
 
@@ -436,7 +443,13 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
             if (failed) {
                 compressionMethod = ZipEntry::kCompressStored;
                 if (inputFp) rewind(inputFp);
-                fseek(mZipFp, startPosn, SEEK_SET);
+                /* stored data is aligned, which may move it along */
+                result = alignEntry(pEntry, lfhPosn);
+                if (result != NO_ERROR)
+                    goto bail;
+                fseek(mZipFp, lfhPosn, SEEK_SET);
+                pEntry->mLFH.write(mZipFp);
+                startPosn = ftell(mZipFp);
                 /* fall through to kCompressStored case */
             }
         }
@@ -529,6 +542,179 @@ bail:
     return result;
 }
 
+/*
+ * Compress a file or buffer into memory, without touching any archive.
+ *
+ * The whole input is deflated in one call; the output matches what
+ * compressFpToFp() would stream out, so prepared and unprepared APKs are
+ * byte-for-byte identical.
+ */
+status_t ZipFile::prepare(const char* fileName, const void* data, size_t size,
+    int compressionMethod, Prepared* pPrepared)
+{
+    unsigned char* inBuf = NULL;
+    unsigned char* outBuf = NULL;
+    status_t result = NO_ERROR;
+
+    assert(compressionMethod == ZipEntry::kCompressDeflated ||
+           compressionMethod == ZipEntry::kCompressStored);
+
+    if (!data) {
+        FILE* inputFp = fopen(fileName, FILE_OPEN_RO);
+        if (inputFp == NULL)
+            return errnoToStatus(errno);
+        pPrepared->mModWhen = getModTime(fileno(inputFp));
+
+        long len = -1;
+        if (fseek(inputFp, 0, SEEK_END) == 0) {
+            len = ftell(inputFp);
+            rewind(inputFp);
+        }
+        if (len >= 0) {
+            inBuf = (unsigned char*) malloc(len ? len : 1);
+            if (inBuf == NULL) {
+                result = NO_MEMORY;
+            } else if (fread(inBuf, 1, len, inputFp) != (size_t) len) {
+                ALOGD("failed reading '%s'\n", fileName);
+                result = UNKNOWN_ERROR;
+            }
+        } else {
+            result = UNKNOWN_ERROR;
+        }
+        fclose(inputFp);
+        if (result != NO_ERROR)
+            goto bail;
+        data = inBuf;
+        size = len;
+    } else {
+        pPrepared->mModWhen = (time_t) -1;
+    }
+
+    pPrepared->mUncompressedLen = size;
+    pPrepared->mCRC32 = crc32(crc32(0L, Z_NULL, 0), (const Bytef*) data, size);
+
+    if (compressionMethod == ZipEntry::kCompressDeflated) {
+        z_stream zstream;
+        memset(&zstream, 0, sizeof(zstream));
+        int zerr = deflateInit2(&zstream, Z_BEST_COMPRESSION,
+            Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+        if (zerr != Z_OK) {
+            ALOGD("Call to deflateInit2 failed (zerr=%d)\n", zerr);
+            compressionMethod = ZipEntry::kCompressStored;
+        } else {
+            size_t bound = deflateBound(&zstream, size);
+            outBuf = (unsigned char*) malloc(bound);
+            zstream.next_in = (Bytef*) data;
+            zstream.avail_in = size;
+            zstream.next_out = outBuf;
+            zstream.avail_out = bound;
+            if (outBuf == NULL
+                    || (zerr = deflate(&zstream, Z_FINISH)) != Z_STREAM_END) {
+                ALOGD("compression failed, storing\n");
+                compressionMethod = ZipEntry::kCompressStored;
+            } else {
+                /* same "compressed enough" test as addCommon() */
+                long src = size;
+                long dst = zstream.total_out;
+                if (dst + (dst / 10) > src) {
+                    ALOGD("insufficient compression (src=%ld dst=%ld), storing\n",
+                        src, dst);
+                    compressionMethod = ZipEntry::kCompressStored;
+                } else {
+                    pPrepared->mSize = dst;
+                }
+            }
+            deflateEnd(&zstream);
+        }
+    }
+
+    if (compressionMethod == ZipEntry::kCompressDeflated) {
+        pPrepared->mData = outBuf;
+        outBuf = NULL;
+    } else if (inBuf != NULL) {
+        pPrepared->mData = inBuf;
+        pPrepared->mSize = size;
+        inBuf = NULL;
+    } else {
+        pPrepared->mData = (unsigned char*) malloc(size ? size : 1);
+        if (pPrepared->mData == NULL) {
+            result = NO_MEMORY;
+            goto bail;
+        }
+        memcpy(pPrepared->mData, data, size);
+        pPrepared->mSize = size;
+    }
+    pPrepared->mCompressionMethod = compressionMethod;
+
+bail:
+    free(inBuf);
+    free(outBuf);
+    return result;
+}
+
+/*
+ * Append a prepared entry.  Unlike addCommon() the sizes and CRC are known
+ * up front, so the LFH is written once.
+ */
+status_t ZipFile::addPrepared(const Prepared& prepared, const char* storageName,
+    ZipEntry** ppEntry)
+{
+    ZipEntry* pEntry = NULL;
+    long lfhPosn, startPosn;
+
+    if (mReadOnly)
+        return INVALID_OPERATION;
+
+    /* make sure we're in a reasonable state */
+    assert(mZipFp != NULL);
+    assert(mEntries.size() == mEOCD.mTotalNumEntries);
+    assert(prepared.mData != NULL);
+
+    if (getEntryByName(storageName) != NULL)
+        return ALREADY_EXISTS;
+
+    if (fseek(mZipFp, mEOCD.mCentralDirOffset, SEEK_SET) != 0)
+        return UNKNOWN_ERROR;
+
+    pEntry = new ZipEntry;
+    pEntry->initNew(storageName, NULL);
+    mNeedCDRewrite = true;
+
+    lfhPosn = ftell(mZipFp);
+    if (prepared.mCompressionMethod == ZipEntry::kCompressStored &&
+        alignEntry(pEntry, lfhPosn) != NO_ERROR)
+    {
+        delete pEntry;
+        return UNKNOWN_ERROR;
+    }
+    pEntry->setDataInfo(prepared.mUncompressedLen, prepared.mSize, prepared.mCRC32,
+        prepared.mCompressionMethod);
+    pEntry->setModWhen(prepared.mModWhen != (time_t) -1
+        ? prepared.mModWhen : getModTime(fileno(mZipFp)));
+    pEntry->setLFHOffset(lfhPosn);
+    if (pEntry->mLFH.write(mZipFp) != NO_ERROR) {
+        delete pEntry;
+        return UNKNOWN_ERROR;
+    }
+    startPosn = ftell(mZipFp);
+    if (fwrite(prepared.mData, 1, prepared.mSize, mZipFp) != prepared.mSize) {
+        // don't need to truncate; happens in CDE rewrite
+        ALOGD("failed writing prepared data for '%s'\n", storageName);
+        delete pEntry;
+        return UNKNOWN_ERROR;
+    }
+
+    mEOCD.mNumEntries++;
+    mEOCD.mTotalNumEntries++;
+    mEOCD.mCentralDirSize = 0;      // mark invalid; set by flush()
+    mEOCD.mCentralDirOffset = startPosn + prepared.mSize;
+
+    mEntries.add(pEntry);
+    if (ppEntry != NULL)
+        *ppEntry = pEntry;
+    return NO_ERROR;
+}
+
 /*
  * Add an entry by copying it from another zip file.  If "padding" is
  * nonzero, the specified number of bytes will be added to the "extra"
@@ -1096,6 +1282,29 @@ status_t ZipFile::filemove(FILE* fp, off_t dst, off_t src, size_t n)
 }
 
 
+/*
+ * Grow the extra field of a stored entry's LFH so that its data starts on
+ * an aligned offset.  The CDE is left alone, as with zipalign.
+ */
+status_t ZipFile::alignEntry(ZipEntry* pEntry, long lfhPosn) const
+{
+    static const long kPageAlignment = 4096;
+
+    if (mAlignment <= 0)
+        return NO_ERROR;
+
+    long alignment = mAlignment;
+    const char* name = pEntry->getFileName();
+    size_t nameLen = strlen(name);
+    if (nameLen > 3 && strcmp(name + nameLen - 3, ".so") == 0)
+        alignment = kPageAlignment;
+
+    long dataPosn = lfhPosn + ZipEntry::LocalFileHeader::kLFHLen +
+        pEntry->mLFH.mFileNameLength + pEntry->mLFH.mExtraFieldLength;
+    int padding = (alignment - (dataPosn % alignment)) % alignment;
+    return padding > 0 ? pEntry->addPadding(padding) : NO_ERROR;
+}
+
 /*
  * Get the modification time from a file descriptor.
  */
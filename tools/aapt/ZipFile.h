@@ -44,7 +44,7 @@ namespace android {
 class ZipFile {
 public:
     ZipFile(void)
-      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false)
+      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false), mAlignment(0)
       {}
     ~ZipFile(void) {
         if (!mReadOnly)
@@ -65,6 +65,18 @@ public:
     };
     status_t open(const char* zipFileName, int flags);
 
+    /*
+     * Place the data of stored (uncompressed) entries added from now on at
+     * a multiple of "alignment" bytes from the start of the file, padding
+     * the local header's extra field the way zipalign does.  Shared
+     * libraries are page-aligned so they can be mapped in place.  0 turns
+     * this off.
+     *
+     * Entries moved when flush() squeezes out deleted ones aren't
+     * realigned, so archives updated in place still need zipalign.
+     */
+    void setAlignment(int alignment) { mAlignment = alignment; }
+
     /*
      * Add a file to the end of the archive.  Specify whether you want the
      * library to try to store it compressed.
@@ -116,6 +128,49 @@ public:
                          compressionMethod, ppEntry);
     }
 
+    /*
+     * A file or buffer that has already been through the compressor, ready
+     * to be appended with addPrepared().  Preparing doesn't touch the
+     * archive, so several entries can be prepared at once on different
+     * threads while a single thread adds them in a fixed order.
+     */
+    class Prepared {
+    public:
+        Prepared()
+            : mData(NULL), mSize(0), mUncompressedLen(0), mCRC32(0),
+              mCompressionMethod(ZipEntry::kCompressStored), mModWhen((time_t) -1)
+            {}
+        ~Prepared() { free(mData); }
+
+    private:
+        Prepared(const Prepared&);
+        Prepared& operator=(const Prepared&);
+
+        friend class ZipFile;
+
+        unsigned char*  mData;
+        size_t          mSize;
+        size_t          mUncompressedLen;
+        unsigned long   mCRC32;
+        int             mCompressionMethod;
+        time_t          mModWhen;           // -1 for in-memory data
+    };
+
+    /*
+     * Compress a file, or an in-memory buffer if "data" is non-NULL, the
+     * way add() would.  Safe to call concurrently.
+     */
+    static status_t prepare(const char* fileName, const void* data, size_t size,
+        int compressionMethod, Prepared* pPrepared);
+
+    /*
+     * Add an entry prepared with prepare() to the end of the archive.
+     *
+     * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+     */
+    status_t addPrepared(const Prepared& prepared, const char* storageName,
+        ZipEntry** ppEntry);
+
     /*
      * Add an entry by copying it from another zip file.  If "padding" is
      * nonzero, the specified number of bytes will be added to the "extra"
@@ -239,8 +294,11 @@ private:
     status_t compressFpToFp(FILE* dstFp, FILE* srcFp,
         const void* data, size_t size, unsigned long* pCRC32);
 
+    /* pad the LFH of a stored entry at "lfhPosn" to align its data */
+    status_t alignEntry(ZipEntry* pEntry, long lfhPosn) const;
+
     /* get modification date from a file descriptor */
-    time_t getModTime(int fd);
+    static time_t getModTime(int fd);
 
     /*
      * We use stdio FILE*, which gives us buffering but makes dealing
@@ -257,6 +315,9 @@ private:
     /* set this when we trash the central dir */
     bool            mNeedCDRewrite;
 
+    /* alignment of stored entries' data, or 0 */
+    int             mAlignment;
+
     /*
      * One ZipEntry per entry in the zip file.  I'm using pointers instead
      * of objects because it's easier than making operator= work for the
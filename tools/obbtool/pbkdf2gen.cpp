@@ -19,60 +19,166 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 /**
  * Simple program to generate a key based on PBKDF2 with preset inputs.
  *
- * Will print out the salt and key in hex.
+ * Will print out the salt and key in hex. Several passwords may be given
+ * at once; their keys are derived in parallel, one thread per CPU unless
+ * -j says otherwise, and printed in the order the passwords were given.
  */
 
 #define SALT_LEN 8
 #define ROUNDS 1024
 #define KEY_BITS 128
 
+struct KeyJob {
+    const char* password;
+    unsigned char salt[SALT_LEN];
+    unsigned char key[KEY_BITS / 8];
+    bool ok;
+};
+
+struct JobQueue {
+    KeyJob* jobs;
+    int count;
+    int rounds;
+    int next;
+    pthread_mutex_t lock;
+};
+
+static void* deriveKeys(void* arg)
+{
+    JobQueue* queue = static_cast<JobQueue*>(arg);
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        int index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->count) {
+            break;
+        }
+
+        // Only ask for the bytes we print: every further 20 bytes of
+        // output costs another full set of rounds.
+        KeyJob* job = &queue->jobs[index];
+        job->ok = PKCS5_PBKDF2_HMAC_SHA1(job->password, strlen(job->password),
+                job->salt, SALT_LEN, queue->rounds, sizeof(job->key), job->key) == 1;
+    }
+    return NULL;
+}
+
+static void usage(const char* progName)
+{
+    fprintf(stderr, "Usage: %s [-i <rounds>] [-j <threads>] <password> [<password> ...]\n",
+            progName);
+    exit(1);
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <password>\n", argv[0]);
-        exit(1);
+    int rounds = ROUNDS;
+    int threads = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:j:")) != -1) {
+        switch (opt) {
+        case 'i':
+            rounds = atoi(optarg);
+            if (rounds <= 0) {
+                fprintf(stderr, "Rounds must be a positive number\n");
+                exit(1);
+            }
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            if (threads <= 0) {
+                fprintf(stderr, "Threads must be a positive number\n");
+                exit(1);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    const int count = argc - optind;
+    if (count < 1) {
+        usage(argv[0]);
     }
 
     int fd = open("/dev/urandom", O_RDONLY);
     if (fd < 0) {
         fprintf(stderr, "Could not open /dev/urandom: %s\n", strerror(errno));
-        close(fd);
         exit(1);
     }
 
-    unsigned char salt[SALT_LEN];
-
-    if (read(fd, &salt, SALT_LEN) != SALT_LEN) {
-        fprintf(stderr, "Could not read salt from /dev/urandom: %s\n", strerror(errno));
-        close(fd);
-        exit(1);
+    KeyJob* jobs = new KeyJob[count];
+    for (int i = 0; i < count; i++) {
+        jobs[i].password = argv[optind + i];
+        if (read(fd, jobs[i].salt, SALT_LEN) != SALT_LEN) {
+            fprintf(stderr, "Could not read salt from /dev/urandom: %s\n", strerror(errno));
+            close(fd);
+            exit(1);
+        }
     }
     close(fd);
 
-    unsigned char rawKey[KEY_BITS];
-
-    if (PKCS5_PBKDF2_HMAC_SHA1(argv[1], strlen(argv[1]), salt, SALT_LEN,
-            ROUNDS, KEY_BITS, rawKey) != 1) {
-        fprintf(stderr, "Could not generate PBKDF2 output: %s\n", strerror(errno));
-        exit(1);
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int) cpus : 1;
     }
+    if (threads > count) {
+        threads = count;
+    }
+
+    JobQueue queue;
+    queue.jobs = jobs;
+    queue.count = count;
+    queue.rounds = rounds;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
 
-    printf("salt=");
-    for (int i = 0; i < SALT_LEN; i++) {
-        printf("%02x", salt[i]);
+    // The calling thread takes its share of the jobs too.
+    pthread_t* workers = new pthread_t[threads];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, deriveKeys, &queue) == 0) {
+            started++;
+        }
+    }
+    deriveKeys(&queue);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
     }
-    printf("\n");
+    delete[] workers;
+    pthread_mutex_destroy(&queue.lock);
 
-    printf("key=");
-    for (int i = 0; i < (KEY_BITS / 8); i++) {
-        printf("%02x", rawKey[i]);
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        if (!jobs[i].ok) {
+            fprintf(stderr, "Could not generate PBKDF2 output for password %d\n", i + 1);
+            status = 1;
+            continue;
+        }
+
+        printf("salt=");
+        for (int j = 0; j < SALT_LEN; j++) {
+            printf("%02x", jobs[i].salt[j]);
+        }
+        printf("\n");
+
+        printf("key=");
+        for (int j = 0; j < (KEY_BITS / 8); j++) {
+            printf("%02x", jobs[i].key[j]);
+        }
+        printf("\n");
     }
-    printf("\n");
+
+    delete[] jobs;
+    return status;
 }
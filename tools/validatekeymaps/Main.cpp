@@ -17,17 +17,26 @@
 #include <androidfw/KeyCharacterMap.h>
 #include <androidfw/KeyLayoutMap.h>
 #include <androidfw/VirtualKeyMap.h>
+#include <cutils/atomic.h>
 #include <utils/PropertyMap.h>
 #include <utils/String8.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 using namespace android;
 
 static const char* gProgName = "validatekeymaps";
 
+// When true, key layouts are also written out in their compiled form.
+static bool gCompile = false;
+
+// Upper bound on the number of files validated concurrently.
+static const int MAX_JOBS = 32;
+
 enum FileType {
     FILETYPE_UNKNOWN,
     FILETYPE_KEYLAYOUT,
@@ -41,9 +50,13 @@ static void usage() {
     fprintf(stderr, "Keymap Validation Tool\n\n");
     fprintf(stderr, "Usage:\n");
     fprintf(stderr,
-        " %s [*.kl] [*.kcm] [*.idc] [virtualkeys.*] [...]\n"
+        " %s [-c] [-j jobs] [*.kl] [*.kcm] [*.idc] [virtualkeys.*] [...]\n"
         "   Validates the specified key layouts, key character maps, \n"
-        "   input device configurations, or virtual key definitions.\n\n",
+        "   input device configurations, or virtual key definitions.\n\n"
+        "   -c  also writes the compiled form of each key layout Foo.kl\n"
+        "       to Foo.klc, which is loaded in place of the text file.\n"
+        "   -j  number of files validated in parallel, defaults to the\n"
+        "       number of processors.\n\n",
         gProgName);
 }
 
@@ -68,22 +81,38 @@ static FileType getFileType(const char* filename) {
     return FILETYPE_UNKNOWN;
 }
 
-static bool validateFile(const char* filename) {
-    fprintf(stdout, "Validating file '%s'...\n", filename);
+/*
+ * Validates a file. Messages are collected rather than printed so that files
+ * validated in parallel still report in the order they were given.
+ */
+static bool validateFile(const char* filename, String8& out, String8& err) {
+    out.appendFormat("Validating file '%s'...\n", filename);
 
     FileType fileType = getFileType(filename);
     switch (fileType) {
     case FILETYPE_UNKNOWN:
-        fprintf(stderr, "Supported file types: *.kl, *.kcm, virtualkeys.*\n\n");
+        err.append("Supported file types: *.kl, *.kcm, virtualkeys.*\n\n");
         return false;
 
     case FILETYPE_KEYLAYOUT: {
         sp<KeyLayoutMap> map;
-        status_t status = KeyLayoutMap::load(String8(filename), &map);
+        status_t status = KeyLayoutMap::parse(String8(filename), &map);
         if (status) {
-            fprintf(stderr, "Error %d parsing key layout file.\n\n", status);
+            err.appendFormat("Error %d parsing key layout file.\n\n", status);
             return false;
         }
+        if (gCompile) {
+            String8 compiledFilename(filename);
+            compiledFilename.append("c");
+            status = map->compile(compiledFilename);
+            if (status) {
+                err.appendFormat("Error %d writing compiled key layout file '%s'.\n\n",
+                        status, compiledFilename.string());
+                return false;
+            }
+            out.appendFormat("Wrote compiled key layout file '%s'.\n",
+                    compiledFilename.string());
+        }
         break;
     }
 
@@ -92,7 +121,7 @@ static bool validateFile(const char* filename) {
         status_t status = KeyCharacterMap::load(String8(filename),
                 KeyCharacterMap::FORMAT_ANY, &map);
         if (status) {
-            fprintf(stderr, "Error %d parsing key character map file.\n\n", status);
+            err.appendFormat("Error %d parsing key character map file.\n\n", status);
             return false;
         }
         break;
@@ -102,7 +131,7 @@ static bool validateFile(const char* filename) {
         PropertyMap* map;
         status_t status = PropertyMap::load(String8(filename), &map);
         if (status) {
-            fprintf(stderr, "Error %d parsing input device configuration file.\n\n", status);
+            err.appendFormat("Error %d parsing input device configuration file.\n\n", status);
             return false;
         }
         delete map;
@@ -113,7 +142,7 @@ static bool validateFile(const char* filename) {
         VirtualKeyMap* map;
         status_t status = VirtualKeyMap::load(String8(filename), &map);
         if (status) {
-            fprintf(stderr, "Error %d parsing virtual key definition file.\n\n", status);
+            err.appendFormat("Error %d parsing virtual key definition file.\n\n", status);
             return false;
         }
         delete map;
@@ -121,22 +150,101 @@ static bool validateFile(const char* filename) {
     }
     }
 
-    fputs("No errors.\n\n", stdout);
+    out.append("No errors.\n\n");
     return true;
 }
 
+struct ValidationResult {
+    String8 out;
+    String8 err;
+    bool success;
+};
+
+struct ValidationQueue {
+    const char* const* filenames;
+    ValidationResult* results;
+    int32_t count;
+    volatile int32_t next;
+};
+
+static void* validationThread(void* arg) {
+    ValidationQueue* queue = static_cast<ValidationQueue*>(arg);
+    for (;;) {
+        int32_t index = android_atomic_inc(&queue->next);
+        if (index >= queue->count) {
+            break;
+        }
+        ValidationResult& result = queue->results[index];
+        result.success = validateFile(queue->filenames[index], result.out, result.err);
+    }
+    return NULL;
+}
+
+static int getDefaultJobs() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? int(cpus) : 1;
+}
+
 int main(int argc, const char** argv) {
-    if (argc < 2) {
+    int jobs = getDefaultJobs();
+    int first = 1;
+    while (first < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-c") == 0) {
+            gCompile = true;
+            first += 1;
+        } else if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+            jobs = atoi(argv[first + 1]);
+            if (jobs < 1) {
+                usage();
+                return 1;
+            }
+            first += 2;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (first >= argc) {
         usage();
         return 1;
     }
 
+    ValidationQueue queue;
+    queue.filenames = argv + first;
+    queue.count = argc - first;
+    queue.results = new ValidationResult[queue.count];
+    queue.next = 0;
+
+    if (jobs > queue.count) {
+        jobs = queue.count;
+    }
+    if (jobs > MAX_JOBS) {
+        jobs = MAX_JOBS;
+    }
+
+    // The calling thread takes part in the validation as well.
+    pthread_t threads[MAX_JOBS];
+    int threadCount = 0;
+    while (threadCount < jobs - 1
+            && pthread_create(&threads[threadCount], NULL, validationThread, &queue) == 0) {
+        threadCount += 1;
+    }
+    validationThread(&queue);
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
     int result = 0;
-    for (int i = 1; i < argc; i++) {
-        if (!validateFile(argv[i])) {
+    for (int32_t i = 0; i < queue.count; i++) {
+        const ValidationResult& fileResult = queue.results[i];
+        fputs(fileResult.out.string(), stdout);
+        fflush(stdout);
+        fputs(fileResult.err.string(), stderr);
+        if (!fileResult.success) {
             result = 1;
         }
     }
+    delete[] queue.results;
 
     if (result) {
         fputs("Failed!\n", stderr);